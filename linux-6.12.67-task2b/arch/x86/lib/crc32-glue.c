@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * CRC32 and CRC32C for x86_64 using PCLMULQDQ folding.
+ *
+ * Overrides the weak crc32_le() and __crc32c_le() of lib/crc32.c when that
+ * is built in. Buffers of at least CRC32_FOLD_MIN bytes are folded with
+ * carry-less multiplies; anything shorter, the tail that is not a multiple
+ * of 16 bytes, and calls from contexts where the FPU is not usable go to the
+ * table driven *_base() versions.
+ */
+
+#include <linux/crc32.h>
+#include <linux/minmax.h>
+#include <linux/sizes.h>
+#include <linux/types.h>
+
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+
+/* see crc32-pclmul_64.S */
+#define CRC32_FOLD_MIN		64
+/* bytes folded per kernel_fpu_begin() section, to bound preemption latency */
+#define CRC32_FOLD_CHUNK	SZ_4K
+
+/*
+ * Bit-reflected constants for one polynomial P of degree 32, each in the
+ * high 32 bits of its quadword:
+ *
+ *	fold_4:  x^(512+63) mod P, x^(512-1) mod P
+ *	fold_1:  x^(128+63) mod P, x^(128-1) mod P
+ *	reduce:  x^95 mod P, x^63 mod P
+ *	barrett: floor(x^64 / P) and P itself, 33 bits each
+ */
+struct crc32_fold_consts {
+	u64 fold_4[2];
+	u64 fold_1[2];
+	u64 reduce[2];
+	u64 barrett[2];
+} __aligned(16);
+
+static const struct crc32_fold_consts crc32_consts = {
+	.fold_4		= { 0x653d982200000000, 0xcad38e8f00000000 },
+	.fold_1		= { 0x65673b4600000000, 0x9ba54c6f00000000 },
+	.reduce		= { 0xccaa009e00000000, 0xb8bc676500000000 },
+	.barrett	= { 0x00000001f7011641, 0x00000001db710641 },
+};
+
+static const struct crc32_fold_consts crc32c_consts = {
+	.fold_4		= { 0x1c19243b00000000, 0x75bba45b00000000 },
+	.fold_1		= { 0x3743f7bd00000000, 0x3171d43000000000 },
+	.reduce		= { 0x493c7d2700000000, 0xdd45aab800000000 },
+	.barrett	= { 0x00000000dea713f1, 0x0000000105ec76f1 },
+};
+
+asmlinkage u32 crc32_le_fold_pclmul(u32 crc, const u8 *p, size_t len,
+				    const struct crc32_fold_consts *consts);
+
+static __always_inline u32 crc32_le_fold(u32 crc, const u8 *p, size_t len,
+					 const struct crc32_fold_consts *consts,
+					 u32 (*crc_fb)(u32, unsigned char const *,
+						       size_t))
+{
+	if (len < CRC32_FOLD_MIN || !static_cpu_has(X86_FEATURE_PCLMULQDQ) ||
+	    !irq_fpu_usable())
+		return crc_fb(crc, p, len);
+
+	while (len >= CRC32_FOLD_MIN) {
+		size_t n = min_t(size_t, len, CRC32_FOLD_CHUNK) & ~15UL;
+
+		kernel_fpu_begin();
+		crc = crc32_le_fold_pclmul(crc, p, n, consts);
+		kernel_fpu_end();
+		p += n;
+		len -= n;
+	}
+
+	if (len)
+		crc = crc_fb(crc, p, len);
+	return crc;
+}
+
+u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_fold(crc, p, len, &crc32_consts, crc32_le_base);
+}
+
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_fold(crc, p, len, &crc32c_consts, __crc32c_le_base);
+}
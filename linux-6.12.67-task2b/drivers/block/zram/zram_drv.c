@@ -46,12 +46,18 @@ static const char *default_compressor = CONFIG_ZRAM_DEF_COMP;
 
 /* Module params (documentation at end) */
 static unsigned int num_devices = 1;
+static unsigned int write_workers;
 /*
  * Pages that compress to sizes equals or greater than this are stored
  * uncompressed in memory.
  */
 static size_t huge_class_size;
 
+/* Compresses the pages of large writes, see zram_bio_write_parallel() */
+static struct workqueue_struct *zram_write_wq;
+/* Fewest pages worth handing to another worker */
+#define ZRAM_WRITE_CHUNK_PAGES	8
+
 static const struct block_device_operations zram_devops;
 
 static void zram_free_page(struct zram *zram, size_t index);
@@ -2066,11 +2072,9 @@ static void zram_bio_read(struct zram *zram, struct bio *bio)
 	bio_endio(bio);
 }
 
-static void zram_bio_write(struct zram *zram, struct bio *bio)
+static void zram_bio_write_iter(struct zram *zram, struct bio *bio,
+				struct bvec_iter iter)
 {
-	unsigned long start_time = bio_start_io_acct(bio);
-	struct bvec_iter iter = bio->bi_iter;
-
 	do {
 		u32 index = iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
 		u32 offset = (iter.bi_sector & (SECTORS_PER_PAGE - 1)) <<
@@ -2081,7 +2085,7 @@ static void zram_bio_write(struct zram *zram, struct bio *bio)
 
 		if (zram_bvec_write(zram, &bv, index, offset, bio) < 0) {
 			atomic64_inc(&zram->stats.failed_writes);
-			bio->bi_status = BLK_STS_IOERR;
+			WRITE_ONCE(bio->bi_status, BLK_STS_IOERR);
 			break;
 		}
 
@@ -2091,7 +2095,97 @@ static void zram_bio_write(struct zram *zram, struct bio *bio)
 
 		bio_advance_iter_single(bio, &iter, bv.bv_len);
 	} while (iter.bi_size);
+}
 
+struct zram_write_chunk {
+	struct work_struct work;
+	struct zram_write_batch *batch;
+	struct bvec_iter iter;
+};
+
+struct zram_write_batch {
+	struct zram *zram;
+	struct bio *bio;
+	unsigned long start_time;
+	atomic_t pending;
+	struct zram_write_chunk chunks[];
+};
+
+static void zram_write_chunk_fn(struct work_struct *work)
+{
+	struct zram_write_chunk *chunk =
+		container_of(work, struct zram_write_chunk, work);
+	struct zram_write_batch *batch = chunk->batch;
+
+	zram_bio_write_iter(batch->zram, batch->bio, chunk->iter);
+	if (atomic_dec_and_test(&batch->pending)) {
+		bio_end_io_acct(batch->bio, batch->start_time);
+		bio_endio(batch->bio);
+		kfree(batch);
+	}
+}
+
+/*
+ * Compression of a write happens in the submitting context, so a burst of
+ * swap-out or writeback on one CPU leaves the others idle. Split a large
+ * page aligned write into chunks of whole pages and compress all but the
+ * first on up to write_workers workers, the bio completes when the last
+ * chunk is done. Returns false if the write should just be done here.
+ */
+static bool zram_bio_write_parallel(struct zram *zram, struct bio *bio,
+				    unsigned long start_time)
+{
+	unsigned int workers = READ_ONCE(write_workers);
+	struct bvec_iter iter = bio->bi_iter;
+	struct zram_write_batch *batch;
+	unsigned int nr_pages, nr, i;
+
+	if (!workers || (iter.bi_sector & (SECTORS_PER_PAGE - 1)) ||
+	    !PAGE_ALIGNED(iter.bi_size))
+		return false;
+
+	nr_pages = iter.bi_size >> PAGE_SHIFT;
+	nr = min(workers + 1, nr_pages / ZRAM_WRITE_CHUNK_PAGES);
+	if (nr < 2)
+		return false;
+
+	batch = kmalloc(struct_size(batch, chunks, nr),
+			GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN);
+	if (!batch)
+		return false;
+
+	batch->zram = zram;
+	batch->bio = bio;
+	batch->start_time = start_time;
+	atomic_set(&batch->pending, nr);
+
+	for (i = 0; i < nr; i++) {
+		struct zram_write_chunk *chunk = &batch->chunks[i];
+		unsigned int pages = nr_pages / nr + (i < nr_pages % nr);
+
+		chunk->batch = batch;
+		chunk->iter = iter;
+		chunk->iter.bi_size = pages << PAGE_SHIFT;
+		bio_advance_iter(bio, &iter, chunk->iter.bi_size);
+
+		INIT_WORK(&chunk->work, zram_write_chunk_fn);
+		if (i)
+			queue_work(zram_write_wq, &chunk->work);
+	}
+
+	/* the batch stays around until this one is done as well */
+	zram_write_chunk_fn(&batch->chunks[0].work);
+	return true;
+}
+
+static void zram_bio_write(struct zram *zram, struct bio *bio)
+{
+	unsigned long start_time = bio_start_io_acct(bio);
+
+	if (zram_bio_write_parallel(zram, bio, start_time))
+		return;
+
+	zram_bio_write_iter(zram, bio, bio->bi_iter);
 	bio_end_io_acct(bio, start_time);
 	bio_endio(bio);
 }
@@ -2172,6 +2266,9 @@ static void zram_destroy_comps(struct zram *zram)
 
 static void zram_reset_device(struct zram *zram)
 {
+	/* writes still being compressed by workers */
+	flush_workqueue(zram_write_wq);
+
 	down_write(&zram->init_lock);
 
 	zram->limit_pages = 0;
@@ -2576,6 +2673,7 @@ static void destroy_devices(void)
 	idr_destroy(&zram_index_idr);
 	unregister_blkdev(zram_major, "zram");
 	cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+	destroy_workqueue(zram_write_wq);
 }
 
 static int __init zram_init(void)
@@ -2585,15 +2683,24 @@ static int __init zram_init(void)
 
 	BUILD_BUG_ON(__NR_ZRAM_PAGEFLAGS > sizeof(zram_te.flags) * 8);
 
+	/* in the swap-out path, so it must be able to make progress */
+	zram_write_wq = alloc_workqueue("zram_write",
+				       WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!zram_write_wq)
+		return -ENOMEM;
+
 	ret = cpuhp_setup_state_multi(CPUHP_ZCOMP_PREPARE, "block/zram:prepare",
 				      zcomp_cpu_up_prepare, zcomp_cpu_dead);
-	if (ret < 0)
+	if (ret < 0) {
+		destroy_workqueue(zram_write_wq);
 		return ret;
+	}
 
 	ret = class_register(&zram_control_class);
 	if (ret) {
 		pr_err("Unable to register zram-control class\n");
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		destroy_workqueue(zram_write_wq);
 		return ret;
 	}
 
@@ -2603,6 +2710,7 @@ static int __init zram_init(void)
 		pr_err("Unable to get major number\n");
 		class_unregister(&zram_control_class);
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		destroy_workqueue(zram_write_wq);
 		return -EBUSY;
 	}
 
@@ -2632,6 +2740,9 @@ module_exit(zram_exit);
 
 module_param(num_devices, uint, 0);
 MODULE_PARM_DESC(num_devices, "Number of pre-created zram devices");
+module_param(write_workers, uint, 0644);
+MODULE_PARM_DESC(write_workers,
+		 "Extra workers compressing each large write, 0 to compress in the submitter");
 
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_AUTHOR("Nitin Gupta <ngupta@vflare.org>");
@@ -286,45 +286,73 @@ EXPORT_SYMBOL(dma_resv_reset_max_fences);
  */
 void dma_resv_add_fence(struct dma_resv *obj, struct dma_fence *fence,
 			enum dma_resv_usage usage)
+{
+	dma_resv_add_fences(obj, &fence, 1, usage);
+}
+EXPORT_SYMBOL(dma_resv_add_fence);
+
+/**
+ * dma_resv_add_fences - Add several fences to the dma_resv obj
+ * @obj: the reservation object
+ * @fences: the fences to add
+ * @num_fences: number of entries in @fences
+ * @usage: how the fences are used, see enum dma_resv_usage
+ *
+ * Same as calling dma_resv_add_fence() for each of @fences, but new slots are
+ * published to unlocked readers only once for the whole batch. @obj must be
+ * locked with dma_resv_lock(), and dma_resv_reserve_fences() must have been
+ * called for @num_fences.
+ */
+void dma_resv_add_fences(struct dma_resv *obj, struct dma_fence **fences,
+			 unsigned int num_fences, enum dma_resv_usage usage)
 {
 	struct dma_resv_list *fobj;
 	struct dma_fence *old;
-	unsigned int i, count;
-
-	dma_fence_get(fence);
+	unsigned int i, j, count;
 
 	dma_resv_assert_held(obj);
 
-	/* Drivers should not add containers here, instead add each fence
-	 * individually.
-	 */
-	WARN_ON(dma_fence_is_container(fence));
-
 	fobj = dma_resv_fences_list(obj);
 	count = fobj->num_fences;
 
-	for (i = 0; i < count; ++i) {
-		enum dma_resv_usage old_usage;
+	for (j = 0; j < num_fences; ++j) {
+		struct dma_fence *fence = fences[j];
 
-		dma_resv_list_entry(fobj, i, obj, &old, &old_usage);
-		if ((old->context == fence->context && old_usage >= usage &&
-		     dma_fence_is_later_or_same(fence, old)) ||
-		    dma_fence_is_signaled(old)) {
-			dma_resv_list_set(fobj, i, fence, usage);
-			dma_fence_put(old);
-			return;
+		dma_fence_get(fence);
+
+		/* Drivers should not add containers here, instead add each
+		 * fence individually.
+		 */
+		WARN_ON(dma_fence_is_container(fence));
+
+		for (i = 0; i < count; ++i) {
+			enum dma_resv_usage old_usage;
+
+			dma_resv_list_entry(fobj, i, obj, &old, &old_usage);
+			if ((old->context == fence->context &&
+			     old_usage >= usage &&
+			     dma_fence_is_later_or_same(fence, old)) ||
+			    dma_fence_is_signaled(old)) {
+				dma_resv_list_set(fobj, i, fence, usage);
+				dma_fence_put(old);
+				break;
+			}
 		}
+		if (i < count)
+			continue;
+
+		BUG_ON(count >= fobj->max_fences);
+		dma_resv_list_set(fobj, count++, fence, usage);
 	}
 
-	BUG_ON(fobj->num_fences >= fobj->max_fences);
-	count++;
+	if (count == fobj->num_fences)
+		return;
 
-	dma_resv_list_set(fobj, i, fence, usage);
 	/* fence update must be visible before we extend the num_fences */
 	smp_wmb();
 	fobj->num_fences = count;
 }
-EXPORT_SYMBOL(dma_resv_add_fence);
+EXPORT_SYMBOL(dma_resv_add_fences);
 
 /**
  * dma_resv_replace_fences - replace fences in the dma_resv obj
@@ -609,6 +637,50 @@ int dma_resv_get_fences(struct dma_resv *obj, enum dma_resv_usage usage,
 }
 EXPORT_SYMBOL_GPL(dma_resv_get_fences);
 
+/**
+ * dma_resv_get_fences_array - Get an object's fences into a caller array
+ * @obj: the reservation object
+ * @usage: controls which fences to include, see enum dma_resv_usage.
+ * @fences: array receiving a reference to each fence
+ * @max_fences: number of entries in @fences
+ *
+ * Like dma_resv_get_fences(), but takes the snapshot under RCU only and does
+ * not allocate, which suits callers expecting only a few fences and keeping
+ * @fences on the stack. The caller must drop the returned references.
+ *
+ * Returns the number of fences stored, or -ENOSPC if @obj holds more than
+ * @max_fences fences, in which case no references are held.
+ */
+int dma_resv_get_fences_array(struct dma_resv *obj, enum dma_resv_usage usage,
+			      struct dma_fence **fences,
+			      unsigned int max_fences)
+{
+	struct dma_resv_iter cursor;
+	struct dma_fence *fence;
+	unsigned int count = 0;
+
+	dma_resv_iter_begin(&cursor, obj, usage);
+	dma_resv_for_each_fence_unlocked(&cursor, fence) {
+
+		if (dma_resv_iter_is_restarted(&cursor))
+			while (count)
+				dma_fence_put(fences[--count]);
+
+		if (count == max_fences) {
+			while (count)
+				dma_fence_put(fences[--count]);
+			dma_resv_iter_end(&cursor);
+			return -ENOSPC;
+		}
+
+		fences[count++] = dma_fence_get(fence);
+	}
+	dma_resv_iter_end(&cursor);
+
+	return count;
+}
+EXPORT_SYMBOL_GPL(dma_resv_get_fences_array);
+
 /**
  * dma_resv_get_singleton - Get a single fence for all the fences
  * @obj: the reservation object
@@ -293,6 +293,76 @@ err_resv:
 	return r;
 }
 
+static int test_get_fences_array(void *arg)
+{
+	enum dma_resv_usage usage = (unsigned long)arg;
+	struct dma_fence *f[2], *fences[2];
+	struct dma_resv resv;
+	u64 context;
+	int r, i, n = 0;
+
+	f[0] = alloc_fence();
+	f[1] = alloc_fence();
+	if (!f[0] || !f[1]) {
+		r = -ENOMEM;
+		goto err_fence;
+	}
+
+	/* distinct contexts, so the second fence does not replace the first */
+	context = dma_fence_context_alloc(2);
+	for (i = 0; i < 2; i++) {
+		f[i]->context = context + i;
+		dma_fence_enable_sw_signaling(f[i]);
+	}
+
+	dma_resv_init(&resv);
+	r = dma_resv_lock(&resv, NULL);
+	if (r) {
+		pr_err("Resv locking failed\n");
+		goto err_resv;
+	}
+
+	r = dma_resv_reserve_fences(&resv, 2);
+	if (r) {
+		pr_err("Resv shared slot allocation failed\n");
+		dma_resv_unlock(&resv);
+		goto err_resv;
+	}
+
+	dma_resv_add_fences(&resv, f, 2, usage);
+	dma_resv_unlock(&resv);
+
+	r = dma_resv_get_fences_array(&resv, usage, fences, 1);
+	if (r != -ENOSPC) {
+		pr_err("get_fences_array did not report a short array\n");
+		n = max(r, 0);
+		r = -EINVAL;
+		goto err_put;
+	}
+
+	n = dma_resv_get_fences_array(&resv, usage, fences, 2);
+	if (n != 2 || fences[0] != f[0] || fences[1] != f[1]) {
+		pr_err("get_fences_array returned unexpected fences\n");
+		n = max(n, 0);
+		r = -EINVAL;
+		goto err_put;
+	}
+	r = 0;
+
+	for (i = 0; i < 2; i++)
+		dma_fence_signal(f[i]);
+err_put:
+	while (n--)
+		dma_fence_put(fences[n]);
+err_resv:
+	dma_resv_fini(&resv);
+err_fence:
+	for (i = 0; i < 2; i++)
+		if (f[i])
+			dma_fence_put(f[i]);
+	return r;
+}
+
 int dma_resv(void)
 {
 	static const struct subtest tests[] = {
@@ -301,6 +371,7 @@ int dma_resv(void)
 		SUBTEST(test_for_each),
 		SUBTEST(test_for_each_unlocked),
 		SUBTEST(test_get_fences),
+		SUBTEST(test_get_fences_array),
 	};
 	enum dma_resv_usage usage;
 	int r;
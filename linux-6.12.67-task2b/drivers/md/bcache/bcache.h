@@ -393,6 +393,16 @@ struct cached_dev {
 	unsigned int		writeback_rate_fp_term_high;
 	unsigned int		writeback_rate_minimum;
 
+	/*
+	 * Backing device write latency feedback: if writeback writes take
+	 * longer than writeback_latency_target_us on average, the rate is
+	 * scaled down accordingly. 0 disables.
+	 */
+	unsigned int		writeback_latency_target_us;
+	uint64_t		writeback_latency_us;
+	atomic64_t		writeback_latency_sum;
+	atomic_t		writeback_latency_nr;
+
 	enum stop_on_failure	stop_when_cache_set_failed;
 #define DEFAULT_CACHED_DEV_ERROR_LIMIT	64
 	atomic_t		io_errors;
@@ -58,6 +58,31 @@ static uint64_t __calc_target_rate(struct cached_dev *dc)
 	return (cache_dirty_target * bdev_share) >> WRITEBACK_SHARE_SHIFT;
 }
 
+/*
+ * Scale the rate by how far the average backing device write latency of
+ * the last period is above the configured target. The latency goes up with
+ * the foreground load on the backing device, so writeback backs off during
+ * peaks and speeds up again as the load goes away.
+ */
+static uint32_t latency_scaled_rate(struct cached_dev *dc, uint32_t rate)
+{
+	uint64_t target = dc->writeback_latency_target_us;
+	uint64_t sum = atomic64_xchg(&dc->writeback_latency_sum, 0);
+	unsigned int nr = atomic_xchg(&dc->writeback_latency_nr, 0);
+
+	if (!nr) {
+		dc->writeback_latency_us = 0;
+		return rate;
+	}
+
+	dc->writeback_latency_us = div64_u64(sum, (uint64_t)nr * NSEC_PER_USEC);
+	if (!target || dc->writeback_latency_us <= target)
+		return rate;
+
+	rate = div64_u64((uint64_t)rate * target, dc->writeback_latency_us);
+	return max(rate, dc->writeback_rate_minimum);
+}
+
 static void __update_writeback_rate(struct cached_dev *dc)
 {
 	/*
@@ -148,6 +173,7 @@ static void __update_writeback_rate(struct cached_dev *dc)
 
 	new_rate = clamp_t(int32_t, (proportional_scaled + integral_scaled),
 			dc->writeback_rate_minimum, NSEC_PER_SEC);
+	new_rate = latency_scaled_rate(dc, new_rate);
 
 	dc->writeback_rate_proportional = proportional_scaled;
 	dc->writeback_rate_integral_scaled = integral_scaled;
@@ -323,6 +349,7 @@ struct dirty_io {
 	struct closure		cl;
 	struct cached_dev	*dc;
 	uint16_t		sequence;
+	u64			start_time;
 	struct bio		bio;
 };
 
@@ -400,6 +427,20 @@ static void dirty_endio(struct bio *bio)
 	closure_put(&io->cl);
 }
 
+static void write_dirty_endio(struct bio *bio)
+{
+	struct keybuf_key *w = bio->bi_private;
+	struct dirty_io *io = w->private;
+
+	if (!bio->bi_status) {
+		atomic64_add(local_clock() - io->start_time,
+			     &io->dc->writeback_latency_sum);
+		atomic_inc(&io->dc->writeback_latency_nr);
+	}
+
+	dirty_endio(bio);
+}
+
 static CLOSURE_CALLBACK(write_dirty)
 {
 	closure_type(io, struct dirty_io, cl);
@@ -437,7 +478,8 @@ static CLOSURE_CALLBACK(write_dirty)
 		io->bio.bi_opf = REQ_OP_WRITE;
 		io->bio.bi_iter.bi_sector = KEY_START(&w->key);
 		bio_set_dev(&io->bio, io->dc->bdev);
-		io->bio.bi_end_io	= dirty_endio;
+		io->bio.bi_end_io	= write_dirty_endio;
+		io->start_time		= local_clock();
 
 		/* I/O request sent to backing device */
 		closure_bio_submit(io->dc->disk.c, &io->bio, cl);
@@ -1065,6 +1107,9 @@ void bch_cached_dev_writeback_init(struct cached_dev *dc)
 	dc->writeback_rate_fp_term_mid = 10;
 	dc->writeback_rate_fp_term_high = 1000;
 	dc->writeback_rate_i_term_inverse = 10000;
+	dc->writeback_latency_target_us = 0;
+	atomic64_set(&dc->writeback_latency_sum, 0);
+	atomic_set(&dc->writeback_latency_nr, 0);
 
 	/* For dc->writeback_lock contention in update_writeback_rate() */
 	dc->rate_update_retry = 0;
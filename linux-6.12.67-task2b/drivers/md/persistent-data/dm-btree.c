@@ -1435,6 +1435,14 @@ static int walk_node(struct dm_btree_info *info, dm_block_t block,
 	n = dm_block_data(node);
 
 	nr = le32_to_cpu(n->header.nr_entries);
+	if (le32_to_cpu(n->header.flags) & INTERNAL_NODE) {
+		struct dm_block_manager *bm = dm_tm_get_bm(info->tm);
+
+		/* the children are all visited, get them read in parallel */
+		for (i = 0; i < nr; i++)
+			dm_bm_prefetch(bm, value64(n, i));
+	}
+
 	for (i = 0; i < nr; i++) {
 		if (le32_to_cpu(n->header.flags) & INTERNAL_NODE) {
 			r = walk_node(info, value64(n, i), fn, context);
@@ -13,6 +13,7 @@
 #include <linux/nvme-keyring.h>
 #include <net/sock.h>
 #include <net/tcp.h>
+#include <net/busy_poll.h>
 #include <net/tls.h>
 #include <net/tls_prot.h>
 #include <net/handshake.h>
@@ -73,6 +74,16 @@ device_param_cb(idle_poll_period_usecs, &set_param_ops,
 MODULE_PARM_DESC(idle_poll_period_usecs,
 		"nvmet tcp io_work poll till idle time period in usecs: Default 0");
 
+/* Define a time (in usecs) that io_work() may busy poll the NIC receive
+ * queue of an activated queue once its socket ran dry, instead of waiting
+ * for the next interrupt.  The poll runs on the CPU the queue's io_work is
+ * bound to, which follows the socket's receive CPU.
+ */
+static int busy_poll_usecs;
+device_param_cb(busy_poll_usecs, &set_param_ops, &busy_poll_usecs, 0644);
+MODULE_PARM_DESC(busy_poll_usecs,
+		"nvmet tcp socket busy poll time in usecs: Default 0");
+
 #ifdef CONFIG_NVME_TARGET_TCP_TLS
 /*
  * TLS handshake timeout
@@ -1442,6 +1453,18 @@ static bool nvmet_tcp_check_queue_deadline(struct nvmet_tcp_queue *queue,
 	return !time_after(jiffies, queue->poll_end);
 }
 
+/* Busy poll the socket's device queue, return true if data arrived */
+static bool nvmet_tcp_busy_poll(struct nvmet_tcp_queue *queue)
+{
+	struct sock *sk = queue->sock->sk;
+
+	if (!sk_can_busy_loop(sk))
+		return false;
+
+	sk_busy_loop(sk, false);
+	return !skb_queue_empty_lockless(&sk->sk_receive_queue);
+}
+
 static void nvmet_tcp_io_work(struct work_struct *w)
 {
 	struct nvmet_tcp_queue *queue =
@@ -1466,6 +1489,9 @@ static void nvmet_tcp_io_work(struct work_struct *w)
 
 	} while (pending && ops < NVMET_TCP_IO_WORK_BUDGET);
 
+	if (!pending && nvmet_tcp_busy_poll(queue))
+		pending = true;
+
 	/*
 	 * Requeue the worker if idle deadline period is in progress or any
 	 * ops activity was recorded during the do-while loop above.
@@ -1731,6 +1757,11 @@ static int nvmet_tcp_set_queue_sock(struct nvmet_tcp_queue *queue)
 	if (so_priority > 0)
 		sock_set_priority(sock->sk, so_priority);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	if (busy_poll_usecs > 0)
+		WRITE_ONCE(sock->sk->sk_ll_usec, busy_poll_usecs);
+#endif
+
 	/* Set socket type of service */
 	if (inet->rcv_tos > 0)
 		ip_sock_set_tos(sock->sk, inet->rcv_tos);
@@ -40,6 +40,11 @@ module_param(experimental_zcopytx, int, 0444);
 MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
 		                       " 1 -Enable; 0 - Disable");
 
+static unsigned int zcopytx_slow_us = 1000;
+module_param(zcopytx_slow_us, uint, 0644);
+MODULE_PARM_DESC(zcopytx_slow_us, "Zero Copy TX completing later than this"
+		 " counts as failed, falling back to copy; 0 - Disable");
+
 /* Max number of bytes transferred before requeueing the job.
  * Using this limit prevents one virtqueue from starving others. */
 #define VHOST_NET_WEIGHT 0x80000
@@ -58,6 +63,8 @@ MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
  * For transmit, used buffer len is unused; we override it to track buffer
  * status internally; used for zerocopy tx only.
  */
+/* Lower device DMA done, but later than zcopytx_slow_us */
+#define VHOST_DMA_SLOW_LEN	((__force __virtio32)4)
 /* Lower device DMA failed */
 #define VHOST_DMA_FAILED_LEN	((__force __virtio32)3)
 /* Lower device DMA done */
@@ -121,6 +128,8 @@ struct vhost_net_virtqueue {
 	int batched_xdp;
 	/* an array of userspace buffers info */
 	struct ubuf_info_msgzc *ubuf_info;
+	/* submit times of the above, when tracking slow completions */
+	u64 *ubuf_start;
 	/* Reference counting for outstanding ubufs.
 	 * Protected by vq mutex. Writers must also take device mutex. */
 	struct vhost_net_ubuf_ref *ubufs;
@@ -277,6 +286,8 @@ static void vhost_net_clear_ubuf_info(struct vhost_net *n)
 	for (i = 0; i < VHOST_NET_VQ_MAX; ++i) {
 		kfree(n->vqs[i].ubuf_info);
 		n->vqs[i].ubuf_info = NULL;
+		kfree(n->vqs[i].ubuf_start);
+		n->vqs[i].ubuf_start = NULL;
 	}
 }
 
@@ -295,6 +306,12 @@ static int vhost_net_set_ubuf_info(struct vhost_net *n)
 				      GFP_KERNEL);
 		if  (!n->vqs[i].ubuf_info)
 			goto err;
+		n->vqs[i].ubuf_start =
+			kmalloc_array(UIO_MAXIOV,
+				      sizeof(*n->vqs[i].ubuf_start),
+				      GFP_KERNEL);
+		if  (!n->vqs[i].ubuf_start)
+			goto err;
 	}
 	return 0;
 
@@ -368,7 +385,12 @@ static void vhost_zerocopy_signal_used(struct vhost_net *net,
 	int j = 0;
 
 	for (i = nvq->done_idx; i != nvq->upend_idx; i = (i + 1) % UIO_MAXIOV) {
-		if (vq->heads[i].len == VHOST_DMA_FAILED_LEN)
+		/*
+		 * Slow completions hold guest buffers as long as failures
+		 * cost, so back off from zerocopy for them as well.
+		 */
+		if (vq->heads[i].len == VHOST_DMA_FAILED_LEN ||
+		    vq->heads[i].len == VHOST_DMA_SLOW_LEN)
 			vhost_net_tx_err(net);
 		if (VHOST_DMA_IS_DONE(vq->heads[i].len)) {
 			vq->heads[i].len = VHOST_DMA_CLEAR_LEN;
@@ -391,13 +413,22 @@ static void vhost_zerocopy_complete(struct sk_buff *skb,
 	struct ubuf_info_msgzc *ubuf = uarg_to_msgzc(ubuf_base);
 	struct vhost_net_ubuf_ref *ubufs = ubuf->ctx;
 	struct vhost_virtqueue *vq = ubufs->vq;
+	struct vhost_net_virtqueue *nvq =
+		container_of(vq, struct vhost_net_virtqueue, vq);
+	u64 slow_ns = READ_ONCE(zcopytx_slow_us) * NSEC_PER_USEC;
+	__virtio32 len = VHOST_DMA_FAILED_LEN;
 	int cnt;
 
 	rcu_read_lock_bh();
 
+	if (success) {
+		len = VHOST_DMA_DONE_LEN;
+		if (slow_ns &&
+		    ktime_get_ns() - nvq->ubuf_start[ubuf->desc] > slow_ns)
+			len = VHOST_DMA_SLOW_LEN;
+	}
 	/* set len to mark this desc buffers done DMA */
-	vq->heads[ubuf->desc].len = success ?
-		VHOST_DMA_DONE_LEN : VHOST_DMA_FAILED_LEN;
+	vq->heads[ubuf->desc].len = len;
 	cnt = vhost_net_ubuf_put(ubufs);
 
 	/*
@@ -886,6 +917,7 @@ static void handle_tx_zerocopy(struct vhost_net *net, struct socket *sock)
 			ubuf = nvq->ubuf_info + nvq->upend_idx;
 			vq->heads[nvq->upend_idx].id = cpu_to_vhost32(vq, head);
 			vq->heads[nvq->upend_idx].len = VHOST_DMA_IN_PROGRESS;
+			nvq->ubuf_start[nvq->upend_idx] = ktime_get_ns();
 			ubuf->ctx = nvq->ubufs;
 			ubuf->desc = nvq->upend_idx;
 			ubuf->ubuf.ops = &vhost_ubuf_ops;
@@ -1311,6 +1343,7 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 	for (i = 0; i < VHOST_NET_VQ_MAX; i++) {
 		n->vqs[i].ubufs = NULL;
 		n->vqs[i].ubuf_info = NULL;
+		n->vqs[i].ubuf_start = NULL;
 		n->vqs[i].upend_idx = 0;
 		n->vqs[i].done_idx = 0;
 		n->vqs[i].batched_xdp = 0;
@@ -95,10 +95,13 @@ struct vring_virtqueue_split {
 
 	/*
 	 * Last written value to avail->idx in
-	 * guest byte order.
+	 * guest byte order, ahead of it while avail_idx_pending.
 	 */
 	u16 avail_idx_shadow;
 
+	/* Buffers added in a batch aren't exposed in avail->idx yet. */
+	bool avail_idx_pending;
+
 	/* Per-descriptor state. */
 	struct vring_desc_state_split *desc_state;
 	struct vring_desc_extra *desc_extra;
@@ -139,6 +142,11 @@ struct vring_virtqueue_packed {
 	 */
 	u16 event_flags_shadow;
 
+	/* First head added in a batch, made available at its end. */
+	bool batch_head_pending;
+	u16 batch_head;
+	__le16 batch_head_flags;
+
 	/* Per-descriptor state. */
 	struct vring_desc_state_packed *desc_state;
 	struct vring_desc_extra *desc_extra;
@@ -196,6 +204,9 @@ struct vring_virtqueue {
 	/* Hint for event idx: already triggered no need to disable. */
 	bool event_triggered;
 
+	/* Adding a batch: new buffers are exposed together at its end. */
+	bool in_batch;
+
 	union {
 		/* Available for split ring */
 		struct vring_virtqueue_split split;
@@ -427,6 +438,7 @@ static void virtqueue_init(struct vring_virtqueue *vq, u32 num)
 		vq->last_used_idx = 0;
 
 	vq->event_triggered = false;
+	vq->in_batch = false;
 	vq->num_added = 0;
 
 #ifdef DEBUG
@@ -541,6 +553,16 @@ static inline unsigned int virtqueue_add_desc_split(struct virtqueue *vq,
 	return next;
 }
 
+static void virtqueue_expose_avail_split(struct vring_virtqueue *vq)
+{
+	/* Descriptors and available array need to be set before we expose the
+	 * new available array entries. */
+	virtio_wmb(vq->weak_barriers);
+	vq->split.vring.avail->idx = cpu_to_virtio16(vq->vq.vdev,
+						vq->split.avail_idx_shadow);
+	vq->split.avail_idx_pending = false;
+}
+
 static inline int virtqueue_add_split(struct virtqueue *_vq,
 				      struct scatterlist *sgs[],
 				      unsigned int total_sg,
@@ -687,12 +709,11 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 	avail = vq->split.avail_idx_shadow & (vq->split.vring.num - 1);
 	vq->split.vring.avail->ring[avail] = cpu_to_virtio16(_vq->vdev, head);
 
-	/* Descriptors and available array need to be set before we expose the
-	 * new available array entries. */
-	virtio_wmb(vq->weak_barriers);
 	vq->split.avail_idx_shadow++;
-	vq->split.vring.avail->idx = cpu_to_virtio16(_vq->vdev,
-						vq->split.avail_idx_shadow);
+	if (likely(!vq->in_batch))
+		virtqueue_expose_avail_split(vq);
+	else
+		vq->split.avail_idx_pending = true;
 	vq->num_added++;
 
 	pr_debug("Added buffer head %i to %p\n", head, vq);
@@ -814,6 +835,65 @@ static void detach_buf_split(struct vring_virtqueue *vq, unsigned int head,
 	}
 }
 
+static unsigned int virtqueue_get_bufs_split(struct virtqueue *_vq,
+					     void **bufs, unsigned int *lens,
+					     void **ctxs, unsigned int max)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int n, i;
+	u16 used_idx, last_used;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return 0;
+	}
+
+	used_idx = virtio16_to_cpu(_vq->vdev, vq->split.vring.used->idx);
+	max = min_t(unsigned int, max, (u16)(used_idx - vq->last_used_idx));
+	if (!max) {
+		END_USE(vq);
+		return 0;
+	}
+
+	/* Only get used array entries after they have been exposed by host. */
+	virtio_rmb(vq->weak_barriers);
+
+	for (n = 0; n < max; n++) {
+		last_used = (vq->last_used_idx & (vq->split.vring.num - 1));
+		i = virtio32_to_cpu(_vq->vdev,
+				vq->split.vring.used->ring[last_used].id);
+		lens[n] = virtio32_to_cpu(_vq->vdev,
+				vq->split.vring.used->ring[last_used].len);
+
+		if (unlikely(i >= vq->split.vring.num)) {
+			BAD_RING(vq, "id %u out of range\n", i);
+			return n;
+		}
+		if (unlikely(!vq->split.desc_state[i].data)) {
+			BAD_RING(vq, "id %u is not a head!\n", i);
+			return n;
+		}
+
+		/* detach_buf_split clears data, so grab it now. */
+		bufs[n] = vq->split.desc_state[i].data;
+		detach_buf_split(vq, i, ctxs ? &ctxs[n] : NULL);
+		vq->last_used_idx++;
+	}
+
+	/* One event index update and barrier for the whole batch. */
+	if (!(vq->split.avail_flags_shadow & VRING_AVAIL_F_NO_INTERRUPT))
+		virtio_store_mb(vq->weak_barriers,
+				&vring_used_event(&vq->split.vring),
+				cpu_to_virtio16(_vq->vdev, vq->last_used_idx));
+
+	LAST_ADD_TIME_INVALID(vq);
+
+	END_USE(vq);
+	return n;
+}
+
 static bool more_used_split(const struct vring_virtqueue *vq)
 {
 	return vq->last_used_idx != virtio16_to_cpu(vq->vq.vdev,
@@ -1007,6 +1087,7 @@ static void virtqueue_vring_init_split(struct vring_virtqueue_split *vring_split
 
 	vring_split->avail_flags_shadow = 0;
 	vring_split->avail_idx_shadow = 0;
+	vring_split->avail_idx_pending = false;
 
 	/* No callback?  Tell other side not to bother us. */
 	if (!vq->vq.callback) {
@@ -1280,6 +1361,34 @@ static struct vring_packed_desc *alloc_indirect_packed(unsigned int total_sg,
 	return desc;
 }
 
+static void virtqueue_expose_head_packed(struct vring_virtqueue *vq, u16 head,
+					 __le16 flags)
+{
+	/*
+	 * The device reads the ring in order and won't look at any later
+	 * head before the first one of a batch, so only that one has to
+	 * wait for the barrier at the end of the batch.
+	 */
+	if (unlikely(vq->in_batch)) {
+		if (vq->packed.batch_head_pending) {
+			vq->packed.vring.desc[head].flags = flags;
+			return;
+		}
+		vq->packed.batch_head_pending = true;
+		vq->packed.batch_head = head;
+		vq->packed.batch_head_flags = flags;
+		return;
+	}
+
+	/*
+	 * A driver MUST NOT make the first descriptor in the list
+	 * available before all subsequent descriptors comprising
+	 * the list are made available.
+	 */
+	virtio_wmb(vq->weak_barriers);
+	vq->packed.vring.desc[head].flags = flags;
+}
+
 static int virtqueue_add_indirect_packed(struct vring_virtqueue *vq,
 					 struct scatterlist *sgs[],
 					 unsigned int total_sg,
@@ -1348,14 +1457,9 @@ static int virtqueue_add_indirect_packed(struct vring_virtqueue *vq,
 						  vq->packed.avail_used_flags;
 	}
 
-	/*
-	 * A driver MUST NOT make the first descriptor in the list
-	 * available before all subsequent descriptors comprising
-	 * the list are made available.
-	 */
-	virtio_wmb(vq->weak_barriers);
-	vq->packed.vring.desc[head].flags = cpu_to_le16(VRING_DESC_F_INDIRECT |
-						vq->packed.avail_used_flags);
+	virtqueue_expose_head_packed(vq, head,
+				     cpu_to_le16(VRING_DESC_F_INDIRECT |
+						 vq->packed.avail_used_flags));
 
 	/* We're using some buffers from the free list. */
 	vq->vq.num_free -= 1;
@@ -1515,13 +1619,7 @@ static inline int virtqueue_add_packed(struct virtqueue *_vq,
 	vq->packed.desc_state[id].indir_desc = ctx;
 	vq->packed.desc_state[id].last = prev;
 
-	/*
-	 * A driver MUST NOT make the first descriptor in the list
-	 * available before all subsequent descriptors comprising
-	 * the list are made available.
-	 */
-	virtio_wmb(vq->weak_barriers);
-	vq->packed.vring.desc[head].flags = head_flags;
+	virtqueue_expose_head_packed(vq, head, head_flags);
 	vq->num_added += descs_used;
 
 	pr_debug("Added buffer head %i to %p\n", head, vq);
@@ -2020,6 +2118,7 @@ static void virtqueue_vring_init_packed(struct vring_virtqueue_packed *vring_pac
 	vring_packed->avail_wrap_counter = 1;
 	vring_packed->event_flags_shadow = 0;
 	vring_packed->avail_used_flags = 1 << VRING_PACKED_DESC_F_AVAIL;
+	vring_packed->batch_head_pending = false;
 
 	/* No callback?  Tell other side not to bother us. */
 	if (!callback) {
@@ -2194,6 +2293,24 @@ static int virtqueue_enable_after_reset(struct virtqueue *_vq)
  * Generic functions and exported symbols.
  */
 
+/* Expose the buffers added to a batch so far, the batch stays open. */
+static void virtqueue_flush_batch(struct vring_virtqueue *vq)
+{
+	if (!vq->packed_ring) {
+		if (vq->split.avail_idx_pending)
+			virtqueue_expose_avail_split(vq);
+		return;
+	}
+
+	if (vq->packed.batch_head_pending) {
+		/* Everything after the first head is written, expose it all. */
+		virtio_wmb(vq->weak_barriers);
+		vq->packed.vring.desc[vq->packed.batch_head].flags =
+			vq->packed.batch_head_flags;
+		vq->packed.batch_head_pending = false;
+	}
+}
+
 static inline int virtqueue_add(struct virtqueue *_vq,
 				struct scatterlist *sgs[],
 				unsigned int total_sg,
@@ -2290,6 +2407,87 @@ int virtqueue_add_inbuf(struct virtqueue *vq,
 }
 EXPORT_SYMBOL_GPL(virtqueue_add_inbuf);
 
+/**
+ * virtqueue_add_batch_begin - start adding a batch of buffers
+ * @_vq: the struct virtqueue we're talking about.
+ *
+ * Buffers added by virtqueue_add_sgs(), virtqueue_add_outbuf() and
+ * virtqueue_add_inbuf() calls until virtqueue_add_batch_end() are exposed
+ * to the other end together: on a split ring with a single write barrier
+ * and available index update, on a packed ring with a single write barrier
+ * before making the first of them available.
+ *
+ * virtqueue_kick() and virtqueue_kick_prepare() expose what was added so
+ * far first, and the batch stays open.
+ *
+ * Caller must ensure we don't call this with other virtqueue operations
+ * at the same time (except where noted).
+ */
+void virtqueue_add_batch_begin(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	vq->in_batch = true;
+}
+EXPORT_SYMBOL_GPL(virtqueue_add_batch_begin);
+
+/**
+ * virtqueue_add_batch_end - expose a batch of buffers to other end
+ * @_vq: the struct virtqueue we're talking about.
+ *
+ * Ends the batch started by virtqueue_add_batch_begin(). Buffers added
+ * after it are exposed one by one again.
+ *
+ * Caller must ensure we don't call this with other virtqueue operations
+ * at the same time (except where noted).
+ */
+void virtqueue_add_batch_end(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	virtqueue_flush_batch(vq);
+	vq->in_batch = false;
+}
+EXPORT_SYMBOL_GPL(virtqueue_add_batch_end);
+
+/**
+ * virtqueue_add_inbufs - expose several input buffers to other end
+ * @_vq: the struct virtqueue we're talking about.
+ * @sgs: array of @n scatterlists (each must be well-formed and terminated!)
+ * @data: array of @n tokens identifying the buffers.
+ * @n: the number of buffers.
+ * @gfp: how to do memory allocations (if necessary).
+ *
+ * Adds each scatterlist as an input buffer like virtqueue_add_inbuf(), in
+ * a single batch (see virtqueue_add_batch_begin()).
+ *
+ * Caller must ensure we don't call this with other virtqueue operations
+ * at the same time (except where noted).
+ *
+ * Returns the number of buffers added, less than @n if the ring filled up,
+ * or a negative error (ie. ENOSPC, ENOMEM, EIO) if none could be added.
+ */
+int virtqueue_add_inbufs(struct virtqueue *_vq, struct scatterlist *sgs[],
+			 void *data[], unsigned int n, gfp_t gfp)
+{
+	unsigned int i;
+	int err = 0;
+
+	virtqueue_add_batch_begin(_vq);
+
+	for (i = 0; i < n; i++) {
+		err = virtqueue_add(_vq, &sgs[i], sg_nents(sgs[i]), 0, 1,
+				    data[i], NULL, gfp);
+		if (err)
+			break;
+	}
+
+	virtqueue_add_batch_end(_vq);
+
+	return i ? i : err;
+}
+EXPORT_SYMBOL_GPL(virtqueue_add_inbufs);
+
 /**
  * virtqueue_add_inbuf_ctx - expose input buffers to other end
  * @vq: the struct virtqueue we're talking about.
@@ -2346,6 +2544,9 @@ bool virtqueue_kick_prepare(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
+	if (unlikely(vq->in_batch))
+		virtqueue_flush_batch(vq);
+
 	return vq->packed_ring ? virtqueue_kick_prepare_packed(_vq) :
 				 virtqueue_kick_prepare_split(_vq);
 }
@@ -2427,6 +2628,51 @@ void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 	return virtqueue_get_buf_ctx(_vq, len, NULL);
 }
 EXPORT_SYMBOL_GPL(virtqueue_get_buf);
+
+/**
+ * virtqueue_get_bufs_ctx - get several used buffers at once
+ * @_vq: the struct virtqueue we're talking about.
+ * @bufs: where to put the tokens of up to @max used buffers.
+ * @lens: where to put the length written by the other side for each.
+ * @ctxs: where to put the context of each, or NULL.
+ * @max: the number of entries in @bufs, @lens and @ctxs.
+ *
+ * Like calling virtqueue_get_buf_ctx() until it returns NULL or @max buffers
+ * were returned, but on a split ring with a single read barrier and used
+ * event update for all of them.
+ *
+ * Caller must ensure we don't call this with other virtqueue operations
+ * at the same time (except where noted).
+ *
+ * Returns the number of buffers returned.
+ */
+unsigned int virtqueue_get_bufs_ctx(struct virtqueue *_vq, void **bufs,
+				    unsigned int *lens, void **ctxs,
+				    unsigned int max)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int n;
+
+	if (!vq->packed_ring)
+		return virtqueue_get_bufs_split(_vq, bufs, lens, ctxs, max);
+
+	/* each packed descriptor carries its own used flag to check */
+	for (n = 0; n < max; n++) {
+		bufs[n] = virtqueue_get_buf_ctx_packed(_vq, &lens[n],
+						       ctxs ? &ctxs[n] : NULL);
+		if (!bufs[n])
+			break;
+	}
+	return n;
+}
+EXPORT_SYMBOL_GPL(virtqueue_get_bufs_ctx);
+
+unsigned int virtqueue_get_bufs(struct virtqueue *_vq, void **bufs,
+				unsigned int *lens, unsigned int max)
+{
+	return virtqueue_get_bufs_ctx(_vq, bufs, lens, NULL, max);
+}
+EXPORT_SYMBOL_GPL(virtqueue_get_bufs);
 /**
  * virtqueue_disable_cb - disable callbacks
  * @_vq: the struct virtqueue we're talking about.
@@ -772,6 +772,106 @@ static int add_new_bucket(struct bch_fs *c,
 	return 0;
 }
 
+/*
+ * Preallocated buckets:
+ *
+ * Allocating a bucket means walking the freespace btree and taking the alloc
+ * key, from within the transaction of the write that needs it. For user data,
+ * whenever a device has few buckets on the partial list, a worker allocates a
+ * few more in the background and puts them there, unused; write points then
+ * pick them up from the partial list (see bucket_alloc_set_partial()), which is
+ * one short freelist_lock critical section.
+ *
+ * Preallocation leaves the reserve for other watermarks alone and does not take
+ * the last free buckets of a device, and preallocated buckets go away with the
+ * rest of the partial list when the device stops being writable.
+ */
+#define BUCKET_PREALLOC_NR		4
+
+static bool bucket_prealloc_want(struct bch_fs *c, struct bch_dev *ca)
+{
+	struct bch_dev_usage usage;
+
+	if (READ_ONCE(ca->nr_partial_buckets) >= BUCKET_PREALLOC_NR ||
+	    READ_ONCE(c->open_buckets_nr_free) <=
+	    open_buckets_reserved(BCH_WATERMARK_normal) + OPEN_BUCKETS_COUNT / 8 ||
+	    !READ_ONCE(ca->mi.freespace_initialized))
+		return false;
+
+	bch2_dev_usage_read_fast(ca, &usage);
+	return dev_buckets_free(ca, usage, BCH_WATERMARK_normal) > BUCKET_PREALLOC_NR * 4;
+}
+
+static bool bucket_prealloc_add(struct bch_fs *c, struct open_bucket *ob)
+{
+	bool ret;
+
+	spin_lock(&c->freelist_lock);
+	/* checked under freelist_lock, which bch2_open_buckets_stop() takes: */
+	ret = test_bit(ob->dev, c->rw_devs[BCH_DATA_user].d) &&
+		c->open_buckets_partial_nr < ARRAY_SIZE(c->open_buckets_partial);
+	if (ret) {
+		rcu_read_lock();
+		bch2_dev_rcu(c, ob->dev)->nr_partial_buckets++;
+		rcu_read_unlock();
+
+		ob->on_partial_list = true;
+		c->open_buckets_partial[c->open_buckets_partial_nr++] =
+			ob - c->open_buckets;
+	}
+	spin_unlock(&c->freelist_lock);
+
+	if (ret)
+		closure_wake_up(&c->open_buckets_wait);
+	return ret;
+}
+
+static void bch2_bucket_prealloc_work(struct work_struct *work)
+{
+	struct bch_dev *ca = container_of(work, struct bch_dev, prealloc_work);
+	struct bch_fs *c = ca->fs;
+
+	while (bucket_prealloc_want(c, ca)) {
+		struct bch_dev_usage usage;
+		struct open_bucket *ob;
+
+		int ret = bch2_trans_do(c,
+			PTR_ERR_OR_ZERO(ob = bch2_bucket_alloc_trans(trans, ca,
+						BCH_WATERMARK_normal, BCH_DATA_user,
+						NULL, true, &usage)));
+		if (ret)
+			break;
+
+		if (!bucket_prealloc_add(c, ob)) {
+			bch2_open_bucket_put(c, ob);
+			break;
+		}
+	}
+
+	percpu_ref_put(&ca->io_ref);
+	bch2_write_ref_put(c, BCH_WRITE_REF_bucket_prealloc);
+}
+
+static void bch2_dev_bucket_prealloc(struct bch_fs *c, struct bch_dev *ca)
+{
+	if (!bucket_prealloc_want(c, ca) ||
+	    work_pending(&ca->prealloc_work))
+		return;
+
+	if (!bch2_write_ref_tryget(c, BCH_WRITE_REF_bucket_prealloc))
+		return;
+
+	if (!bch2_dev_get_ioref(c, ca->dev_idx, WRITE))
+		goto put_ref;
+
+	if (queue_work(c->write_ref_wq, &ca->prealloc_work))
+		return;
+
+	percpu_ref_put(&ca->io_ref);
+put_ref:
+	bch2_write_ref_put(c, BCH_WRITE_REF_bucket_prealloc);
+}
+
 int bch2_bucket_alloc_set_trans(struct btree_trans *trans,
 		      struct open_buckets *ptrs,
 		      struct dev_stripe_state *stripe,
@@ -809,6 +909,10 @@ int bch2_bucket_alloc_set_trans(struct btree_trans *trans,
 					     cl, flags & BCH_WRITE_ALLOC_NOWAIT, &usage);
 		if (!IS_ERR(ob))
 			bch2_dev_stripe_increment_inlined(ca, stripe, &usage);
+		if (!IS_ERR(ob) &&
+		    data_type == BCH_DATA_user &&
+		    watermark == BCH_WATERMARK_normal)
+			bch2_dev_bucket_prealloc(c, ca);
 		bch2_dev_put(ca);
 
 		if (IS_ERR(ob)) {
@@ -1558,6 +1662,11 @@ static inline void writepoint_init(struct write_point *wp,
 	spin_lock_init(&wp->writes_lock);
 }
 
+void bch2_dev_allocator_foreground_init(struct bch_dev *ca)
+{
+	INIT_WORK(&ca->prealloc_work, bch2_bucket_prealloc_work);
+}
+
 void bch2_fs_allocator_foreground_init(struct bch_fs *c)
 {
 	struct open_bucket *ob;
@@ -567,6 +567,7 @@ struct bch_dev {
 	struct mutex		discard_buckets_in_flight_lock;
 	DARRAY(struct discard_in_flight)	discard_buckets_in_flight;
 	struct work_struct	discard_fast_work;
+	struct work_struct	prealloc_work;
 
 	atomic64_t		rebalance_work;
 
@@ -697,7 +698,9 @@ struct btree_trans_buf {
 	x(gc_gens)							\
 	x(snapshot_delete_pagecache)					\
 	x(sysfs)							\
-	x(btree_write_buffer)
+	x(btree_write_buffer)						\
+	x(compression_dict)						\
+	x(bucket_prealloc)
 
 enum bch_write_ref {
 #define x(n) BCH_WRITE_REF_##n,
@@ -970,6 +973,7 @@ struct bch_fs {
 	mempool_t		compress_workspace[BCH_COMPRESSION_TYPE_NR];
 	mempool_t		decompress_workspace;
 	size_t			zstd_workspace_size;
+	struct bch_compression_dicts *compression_dicts;
 
 	struct crypto_shash	*sha256;
 	struct crypto_sync_skcipher *chacha20;
@@ -982,6 +986,8 @@ struct bch_fs {
 	/* MOVE.C */
 	struct list_head	moving_context_list;
 	struct mutex		moving_context_lock;
+	/* jiffies of the last foreground read or write: */
+	unsigned long		foreground_io_time;
 
 	/* REBALANCE */
 	struct bch_fs_rebalance	rebalance;
@@ -1227,6 +1233,15 @@ static inline u64 bch2_current_io_time(const struct bch_fs *c, int rw)
 	return max(1ULL, (u64) atomic64_read(&c->io_clock[rw].now) & LRU_TIME_MAX);
 }
 
+/* background data moves back off while this has been called recently: */
+static inline void bch2_foreground_io(struct bch_fs *c)
+{
+	unsigned long now = jiffies;
+
+	if (READ_ONCE(c->foreground_io_time) != now)
+		WRITE_ONCE(c->foreground_io_time, now);
+}
+
 static inline struct stdio_redirect *bch2_fs_stdio_redirect(struct bch_fs *c)
 {
 	struct stdio_redirect *stdio = c->stdio;
@@ -491,7 +491,8 @@ struct bch_sb_field {
 	x(members_v2,			11)	\
 	x(errors,			12)	\
 	x(ext,				13)	\
-	x(downgrade,			14)
+	x(downgrade,			14)	\
+	x(compression_dicts,		15)
 
 #include "alloc_background_format.h"
 #include "dirent_format.h"
@@ -595,6 +596,27 @@ LE64_BITMASK(BCH_KDF_SCRYPT_N,	struct bch_sb_field_crypt, kdf_flags,  0, 16);
 LE64_BITMASK(BCH_KDF_SCRYPT_R,	struct bch_sb_field_crypt, kdf_flags, 16, 32);
 LE64_BITMASK(BCH_KDF_SCRYPT_P,	struct bch_sb_field_crypt, kdf_flags, 32, 48);
 
+/*
+ * BCH_SB_FIELD_compression_dicts:
+ *
+ * zstd dictionaries (raw content) for extents compressed with
+ * BCH_COMPRESSION_TYPE_zstd_dict; such extents start with the id of their
+ * dictionary. Dictionaries are only ever added, never changed or removed:
+ */
+#define BCH_COMPRESSION_DICTS_MAX	4
+#define BCH_COMPRESSION_DICT_MAX_BYTES	(16U << 10)
+
+struct bch_compression_dict {
+	__le32			id;
+	__le32			len;
+	__u8			data[];		/* padded to a multiple of 8 bytes */
+} __packed __aligned(8);
+
+struct bch_sb_field_compression_dicts {
+	struct bch_sb_field	field;
+	struct bch_compression_dict d[];
+};
+
 /*
  * On clean shutdown, store btree roots and current journal sequence number in
  * the superblock:
@@ -876,6 +898,7 @@ static inline void SET_BCH_SB_BACKGROUND_COMPRESSION_TYPE(struct bch_sb *sb, __u
  * inline_data:			gates KEY_TYPE_inline_data
  * new_siphash:			gates BCH_STR_HASH_siphash
  * new_extent_overwrite:	gates BTREE_NODE_NEW_EXTENT_OVERWRITE
+ * zstd_dict:			gates BCH_COMPRESSION_TYPE_zstd_dict
  */
 #define BCH_SB_FEATURES()			\
 	x(lz4,				0)	\
@@ -896,7 +919,8 @@ static inline void SET_BCH_SB_BACKGROUND_COMPRESSION_TYPE(struct bch_sb *sb, __u
 	x(new_varint,			15)	\
 	x(journal_no_flush,		16)	\
 	x(alloc_v2,			17)	\
-	x(extents_across_btree_nodes,	18)
+	x(extents_across_btree_nodes,	18)	\
+	x(zstd_dict,			19)
 
 #define BCH_SB_FEATURES_ALWAYS				\
 	((1ULL << BCH_FEATURE_new_extent_overwrite)|	\
@@ -1045,7 +1069,8 @@ enum bch_csum_opts {
 	x(gzip,			2)	\
 	x(lz4,			3)	\
 	x(zstd,			4)	\
-	x(incompressible,	5)
+	x(incompressible,	5)	\
+	x(zstd_dict,		6)
 
 enum bch_compression_type {
 #define x(t, n) BCH_COMPRESSION_TYPE_##t = n,
@@ -87,6 +87,7 @@ struct bch_ioctl_incremental {
 #define BCH_IOCTL_FSCK_OFFLINE	_IOW(0xbc,	19,  struct bch_ioctl_fsck_offline)
 #define BCH_IOCTL_FSCK_ONLINE	_IOW(0xbc,	20,  struct bch_ioctl_fsck_online)
 #define BCH_IOCTL_QUERY_ACCOUNTING _IOW(0xbc,	21,  struct bch_ioctl_query_accounting)
+#define BCH_IOCTL_QUERY_TIME_STATS _IOW(0xbc,	22,  struct bch_ioctl_query_time_stats)
 
 /* ioctl below act on a particular file, not the filesystem as a whole: */
 
@@ -443,4 +444,66 @@ struct bch_ioctl_query_accounting {
 	struct bkey_i_accounting accounting[];
 };
 
+/*
+ * BCH_IOCTL_QUERY_TIME_STATS: read the latency statistics that are also in
+ * sysfs as text (the time_stats directory, btree_transactions and each device's
+ * io_latency_stats_*), as one binary snapshot
+ *
+ * @entries_u64s - size, in u64s, allocated for @entries
+ *
+ * On success, @nr is set to the number of entries returned and @entries_u64s
+ * to the number of u64s used. Returns -ERANGE if @entries_u64s was too small,
+ * with @entries_u64s set to the size needed.
+ *
+ * Entries are struct bch_ioctl_time_stats, each @entry_u64s long. Durations
+ * are in nanoseconds. @hist holds @hist_nr buckets of a log bucketed histogram
+ * of durations, starting at bucket @hist_first; buckets outside that range are
+ * empty. Bucket i covers durations from
+ *
+ *   i < 2 << SUB_BITS:	i
+ *   otherwise:		((1 << SUB_BITS) | (i & ((1 << SUB_BITS) - 1))) << ((i >> SUB_BITS) - 1)
+ *
+ * up to the start of bucket i + 1, with SUB_BITS BCH_TIME_STATS_HIST_SUB_BITS.
+ * The name of the statistic follows @hist, @name_len bytes without a
+ * terminating nul.
+ */
+#define BCH_TIME_STATS_HIST_SUB_BITS	2
+
+enum bch_time_stats_source {
+	BCH_TIME_STATS_SOURCE_fs		= 0,
+	BCH_TIME_STATS_SOURCE_btree_trans	= 1,
+	BCH_TIME_STATS_SOURCE_btree_trans_lock_hold = 2,
+	BCH_TIME_STATS_SOURCE_dev_read		= 3,
+	BCH_TIME_STATS_SOURCE_dev_write		= 4,
+};
+
+struct bch_ioctl_time_stats {
+	__u32			entry_u64s;
+	__u8			source;
+	__u8			dev;
+	__u8			name_len;
+	__u8			pad;
+	__u16			hist_first;
+	__u16			hist_nr;
+	__u32			pad2;
+
+	__u64			count;
+	__u64			min_duration;
+	__u64			max_duration;
+	__u64			total_duration;
+	__u64			mean_duration;
+	__u64			stddev_duration;
+
+	__u64			hist[];
+};
+
+struct bch_ioctl_query_time_stats {
+	__u32			flags;		/* must be 0 */
+	__u32			nr;
+	__u32			entries_u64s;	/* input parameter */
+	__u32			pad;
+
+	__u64			entries[];
+};
+
 #endif /* _BCACHEFS_IOCTL_H */
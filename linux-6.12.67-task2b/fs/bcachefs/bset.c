@@ -1088,6 +1088,28 @@ static inline bool bkey_mantissa_bits_dropped(const struct btree *b,
 #endif
 }
 
+/*
+ * Compare the search key against a bfloat: returns 1 if we go right, 0 if we
+ * go left, or -1 if the bfloat can't tell and the key has to be compared:
+ */
+static __always_inline int bfloat_cmp(const struct btree *b,
+				      const struct bkey_float *f,
+				      const struct bkey_packed *packed_search)
+{
+	unsigned l, r;
+
+	if (unlikely(f->exponent >= BFLOAT_FAILED))
+		return -1;
+
+	l = f->mantissa;
+	r = bkey_mantissa(packed_search, f);
+
+	if (unlikely(l == r) && bkey_mantissa_bits_dropped(b, f))
+		return -1;
+
+	return l < r;
+}
+
 __flatten
 static struct bkey_packed *bset_search_tree(const struct btree *b,
 				const struct bset_tree *t,
@@ -1097,26 +1119,42 @@ static struct bkey_packed *bset_search_tree(const struct btree *b,
 	struct ro_aux_tree *base = ro_aux_tree_base(b, t);
 	struct bkey_float *f;
 	struct bkey_packed *k;
-	unsigned inorder, n = 1, l, r;
+	unsigned inorder, n = 1;
 	int cmp;
 
 	do {
 		if (likely(n << 4 < t->size))
 			prefetch(&base->f[n << 4]);
 
-		f = &base->f[n];
-		if (unlikely(f->exponent >= BFLOAT_FAILED))
-			goto slowpath;
-
-		l = f->mantissa;
-		r = bkey_mantissa(packed_search, f);
-
-		if (unlikely(l == r) && bkey_mantissa_bits_dropped(b, f))
-			goto slowpath;
+		/*
+		 * Descend two levels at a time: both children sit next to each
+		 * other, and comparing against them doesn't depend on the
+		 * result for n, so the three mantissa compares overlap instead
+		 * of forming one long dependency chain:
+		 */
+		if (likely(n * 2 + 1 < t->size)) {
+			int c	= bfloat_cmp(b, &base->f[n], packed_search);
+			int cl	= bfloat_cmp(b, &base->f[n * 2], packed_search);
+			int cr	= bfloat_cmp(b, &base->f[n * 2 + 1], packed_search);
+			int cc	= c ? cr : cl;
+
+			if (likely(c >= 0 && cc >= 0)) {
+				n = n * 4 + c * 2 + cc;
+				continue;
+			}
+			if (c >= 0) {
+				n = n * 2 + c;
+				continue;
+			}
+		} else {
+			cmp = bfloat_cmp(b, &base->f[n], packed_search);
+			if (likely(cmp >= 0)) {
+				n = n * 2 + cmp;
+				continue;
+			}
+		}
 
-		n = n * 2 + (l < r);
-		continue;
-slowpath:
+		/* slowpath: */
 		k = tree_to_bkey(b, t, n);
 		cmp = bkey_cmp_p_or_unp(b, k, packed_search, search);
 		if (!cmp)
@@ -1125,6 +1163,7 @@ slowpath:
 		n = n * 2 + (cmp < 0);
 	} while (n < t->size);
 
+	f = &base->f[n >> 1];
 	inorder = __eytzinger1_to_inorder(n >> 1, t->size - 1, t->extra);
 
 	/*
@@ -3439,6 +3439,7 @@ void bch2_fs_btree_iter_exit(struct bch_fs *c)
 	     s++) {
 		kfree(s->max_paths_text);
 		bch2_time_stats_exit(&s->lock_hold_times);
+		bch2_time_stats_exit(&s->duration);
 	}
 
 	if (c->btree_trans_barrier_initialized) {
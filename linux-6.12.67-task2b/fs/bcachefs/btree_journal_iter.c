@@ -7,6 +7,7 @@
 #include "btree_journal_iter.h"
 #include "journal_io.h"
 
+#include <linux/cpumask.h>
 #include <linux/sort.h>
 
 /*
@@ -526,9 +527,103 @@ void bch2_journal_keys_put(struct bch_fs *c)
 	bch2_journal_entries_free(c);
 }
 
+/*
+ * Big journals are sorted in parallel: each cpu sorts a run of the keys, then
+ * pairs of runs are merged, also in parallel, until one run is left:
+ */
+#define JOURNAL_KEYS_SORT_PARALLEL_MIN	(1U << 16)
+#define JOURNAL_KEYS_SORT_MAX_RUNS	16U
+
+struct journal_keys_sort_job {
+	struct closure		cl;
+	struct journal_key	*src;
+	struct journal_key	*dst;
+	size_t			l_nr;
+	size_t			r_nr;
+};
+
+static CLOSURE_CALLBACK(journal_keys_sort_run)
+{
+	closure_type(job, struct journal_keys_sort_job, cl);
+
+	sort(job->src, job->l_nr, sizeof(job->src[0]), journal_sort_key_cmp, NULL);
+	closure_return(cl);
+}
+
+static CLOSURE_CALLBACK(journal_keys_merge_runs)
+{
+	closure_type(job, struct journal_keys_sort_job, cl);
+	struct journal_key *l = job->src, *r = job->src + job->l_nr, *dst = job->dst;
+	struct journal_key *l_end = r, *r_end = r + job->r_nr;
+
+	while (l < l_end && r < r_end)
+		*dst++ = journal_sort_key_cmp(r, l) < 0 ? *r++ : *l++;
+
+	memcpy(dst, l, (l_end - l) * sizeof(*l));
+	dst += l_end - l;
+	memcpy(dst, r, (r_end - r) * sizeof(*r));
+	closure_return(cl);
+}
+
+static bool journal_keys_sort_parallel(struct journal_keys *keys)
+{
+	struct journal_keys_sort_job jobs[JOURNAL_KEYS_SORT_MAX_RUNS];
+	size_t start[JOURNAL_KEYS_SORT_MAX_RUNS + 1];
+	struct journal_key *src = keys->data, *tmp;
+	unsigned nr_runs = min(num_online_cpus(), JOURNAL_KEYS_SORT_MAX_RUNS);
+	struct closure cl;
+
+	if (keys->nr < JOURNAL_KEYS_SORT_PARALLEL_MIN || nr_runs < 2)
+		return false;
+
+	tmp = kvmalloc_array(keys->nr, sizeof(keys->data[0]), GFP_KERNEL);
+	if (!tmp)
+		return false;
+
+	closure_init_stack(&cl);
+
+	for (unsigned i = 0; i <= nr_runs; i++)
+		start[i] = keys->nr * i / nr_runs;
+
+	for (unsigned i = 0; i < nr_runs; i++) {
+		jobs[i].src	= src + start[i];
+		jobs[i].l_nr	= start[i + 1] - start[i];
+		closure_call(&jobs[i].cl, journal_keys_sort_run, system_unbound_wq, &cl);
+	}
+	closure_sync(&cl);
+
+	while (nr_runs > 1) {
+		unsigned i, j;
+
+		for (i = 0, j = 0; i < nr_runs; i += 2, j++) {
+			size_t end = start[min(i + 2, nr_runs)];
+
+			jobs[j].src	= src + start[i];
+			jobs[j].dst	= tmp + start[i];
+			jobs[j].l_nr	= start[i + 1] - start[i];
+			jobs[j].r_nr	= end - start[i + 1];
+			start[j]	= start[i];
+			closure_call(&jobs[j].cl, journal_keys_merge_runs, system_unbound_wq, &cl);
+		}
+		closure_sync(&cl);
+
+		start[j] = keys->nr;
+		nr_runs = j;
+		swap(src, tmp);
+	}
+
+	if (src != keys->data) {
+		memcpy(keys->data, src, keys->nr * sizeof(keys->data[0]));
+		tmp = src;
+	}
+	kvfree(tmp);
+	return true;
+}
+
 static void __journal_keys_sort(struct journal_keys *keys)
 {
-	sort(keys->data, keys->nr, sizeof(keys->data[0]), journal_sort_key_cmp, NULL);
+	if (!journal_keys_sort_parallel(keys))
+		sort(keys->data, keys->nr, sizeof(keys->data[0]), journal_sort_key_cmp, NULL);
 
 	cond_resched();
 
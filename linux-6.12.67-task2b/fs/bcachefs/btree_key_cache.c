@@ -14,9 +14,20 @@
 
 #include <linux/sched/mm.h>
 
+/*
+ * Keys that are looked up by many threads at once get percpu reader counts:
+ * a read lock then only touches this cpu's counter and checks that no write
+ * lock is held, so readers of an entry that isn't being modified never share
+ * a cacheline. Write locks pay for this by summing the counters of all cpus.
+ *
+ * Subvolume keys are read on every lookup, inode keys by anything that
+ * stats, opens or looks up files, often many times for the same directory's
+ * inodes.
+ */
 static inline bool btree_uses_pcpu_readers(enum btree_id id)
 {
-	return id == BTREE_ID_subvolumes;
+	return id == BTREE_ID_subvolumes ||
+		id == BTREE_ID_inodes;
 }
 
 static struct kmem_cache *bch2_key_cache;
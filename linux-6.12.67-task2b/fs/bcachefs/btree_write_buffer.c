@@ -13,6 +13,7 @@
 #include "journal_io.h"
 #include "journal_reclaim.h"
 
+#include <linux/cpumask.h>
 #include <linux/prefetch.h>
 #include <linux/sort.h>
 
@@ -114,6 +115,103 @@ static noinline void wb_sort(struct wb_key_ref *base, size_t num)
 	}
 }
 
+/*
+ * Big flushes are sorted in parallel: the key refs are cut into one run per
+ * cpu, each run is sorted on its own cpu, then the runs are merged through a
+ * heap of run heads. Key refs compare equal only if they are the same ref (idx
+ * is part of the comparison), so the result is the same as a single sort.
+ *
+ * Flushes can be waited on from memory reclaim, so the runs are sorted on our
+ * own WQ_MEM_RECLAIM workqueue, which has a rescuer to make forward progress:
+ */
+#define WB_SORT_PARALLEL_MIN	(1U << 14)
+#define WB_SORT_MAX_RUNS	16U
+
+struct wb_sort_job {
+	struct closure		cl;
+	struct wb_key_ref	*base;
+	size_t			nr;
+};
+
+struct wb_merge_run {
+	struct wb_key_ref	*pos;
+	struct wb_key_ref	*end;
+};
+
+static CLOSURE_CALLBACK(wb_sort_run)
+{
+	closure_type(job, struct wb_sort_job, cl);
+
+	wb_sort(job->base, job->nr);
+	closure_return(cl);
+}
+
+static inline void wb_merge_sift(struct wb_merge_run *runs, unsigned nr, unsigned i)
+{
+	for (;;) {
+		unsigned c = 2 * i + 1, min = i;
+
+		if (c < nr && wb_key_ref_cmp(runs[min].pos, runs[c].pos))
+			min = c;
+		if (c + 1 < nr && wb_key_ref_cmp(runs[min].pos, runs[c + 1].pos))
+			min = c + 1;
+		if (min == i)
+			break;
+
+		swap(runs[i], runs[min]);
+		i = min;
+	}
+}
+
+static noinline void wb_merge_runs(struct wb_key_ref *dst,
+				   struct wb_merge_run *runs, unsigned nr)
+{
+	for (unsigned i = nr / 2; i--;)
+		wb_merge_sift(runs, nr, i);
+
+	while (nr) {
+		*dst++ = *runs[0].pos++;
+
+		if (runs[0].pos == runs[0].end)
+			runs[0] = runs[--nr];
+		wb_merge_sift(runs, nr, 0);
+	}
+}
+
+static bool wb_sort_parallel(struct btree_write_buffer *wb)
+{
+	struct wb_sort_job jobs[WB_SORT_MAX_RUNS];
+	struct wb_merge_run runs[WB_SORT_MAX_RUNS];
+	unsigned nr_runs = min(num_online_cpus(), WB_SORT_MAX_RUNS);
+	size_t nr = wb->sorted.nr;
+	struct closure cl;
+
+	if (nr < WB_SORT_PARALLEL_MIN || nr_runs < 2 ||
+	    wb->merge.size < wb->sorted.size)
+		return false;
+
+	closure_init_stack(&cl);
+
+	for (unsigned i = 0; i < nr_runs; i++) {
+		struct wb_key_ref *start = wb->sorted.data + nr * i / nr_runs;
+		struct wb_key_ref *end	 = wb->sorted.data + nr * (i + 1) / nr_runs;
+
+		jobs[i].base	= start;
+		jobs[i].nr	= end - start;
+		runs[i].pos	= start;
+		runs[i].end	= end;
+		closure_call(&jobs[i].cl, wb_sort_run, wb->sort_wq, &cl);
+	}
+	closure_sync(&cl);
+
+	wb_merge_runs(wb->merge.data, runs, nr_runs);
+
+	wb->merge.nr = nr;
+	swap(wb->sorted, wb->merge);
+	wb->merge.nr = 0;
+	return true;
+}
+
 static noinline int wb_flush_one_slowpath(struct btree_trans *trans,
 					  struct btree_iter *iter,
 					  struct btree_write_buffered_key *wb)
@@ -230,6 +328,8 @@ static void move_keys_from_inc_to_flushing(struct btree_write_buffer *wb)
 
 	darray_resize(&wb->flushing.keys, min_t(size_t, 1U << 20, wb->flushing.keys.nr + wb->inc.keys.nr));
 	darray_resize(&wb->sorted, wb->flushing.keys.size);
+	/* only needed for sorting in parallel, failure is not an error: */
+	darray_resize(&wb->merge, wb->sorted.size);
 
 	if (!wb->flushing.keys.nr && wb->sorted.size >= wb->inc.keys.nr) {
 		swap(wb->flushing.keys, wb->inc.keys);
@@ -309,7 +409,8 @@ static int bch2_btree_write_buffer_flush_locked(struct btree_trans *trans)
 	 * If that happens, simply skip the key so we can optimistically insert
 	 * as many keys as possible in the fast path.
 	 */
-	wb_sort(wb->sorted.data, wb->sorted.nr);
+	if (!wb_sort_parallel(wb))
+		wb_sort(wb->sorted.data, wb->sorted.nr);
 
 	darray_for_each(wb->sorted, i) {
 		struct btree_write_buffered_key *k = &wb->flushing.keys.data[i->idx];
@@ -825,9 +926,13 @@ void bch2_fs_btree_write_buffer_exit(struct bch_fs *c)
 	       !bch2_journal_error(&c->journal));
 
 	darray_exit(&wb->accounting);
+	darray_exit(&wb->merge);
 	darray_exit(&wb->sorted);
 	darray_exit(&wb->flushing.keys);
 	darray_exit(&wb->inc.keys);
+
+	if (wb->sort_wq)
+		destroy_workqueue(wb->sort_wq);
 }
 
 int bch2_fs_btree_write_buffer_init(struct bch_fs *c)
@@ -838,6 +943,11 @@ int bch2_fs_btree_write_buffer_init(struct bch_fs *c)
 	mutex_init(&wb->flushing.lock);
 	INIT_WORK(&wb->flush_work, bch2_btree_write_buffer_flush_work);
 
+	wb->sort_wq = alloc_workqueue("bcachefs_write_buffer_sort",
+				      WQ_MEM_RECLAIM|WQ_UNBOUND, WB_SORT_MAX_RUNS);
+	if (!wb->sort_wq)
+		return -BCH_ERR_ENOMEM_fs_btree_write_buffer_init;
+
 	/* Will be resized by journal as needed: */
 	unsigned initial_size = 1 << 16;
 
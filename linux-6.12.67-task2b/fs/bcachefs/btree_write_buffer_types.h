@@ -49,9 +49,11 @@ struct btree_write_buffer_keys {
 
 struct btree_write_buffer {
 	DARRAY(struct wb_key_ref)	sorted;
+	DARRAY(struct wb_key_ref)	merge;
 	struct btree_write_buffer_keys	inc;
 	struct btree_write_buffer_keys	flushing;
 	struct work_struct		flush_work;
+	struct workqueue_struct		*sort_wq;
 
 	DARRAY(struct btree_write_buffered_key) accounting;
 };
@@ -3,6 +3,7 @@
 
 #include "bcachefs.h"
 #include "bcachefs_ioctl.h"
+#include "btree_iter.h"
 #include "buckets.h"
 #include "chardev.h"
 #include "disk_accounting.h"
@@ -572,6 +573,142 @@ err:
 	return ret;
 }
 
+static const char * const bch2_time_stats_names[] = {
+#define x(name) #name,
+	BCH_TIME_STATS()
+#undef x
+};
+
+static int time_stats_entry_add(darray_char *out,
+				struct bch2_time_stats_summary *sum,
+				struct bch2_time_stats *stats,
+				unsigned source, unsigned dev,
+				const char *name)
+{
+	struct bch_ioctl_time_stats *e;
+	unsigned first = 0, last = TIME_STATS_HIST_NR, name_len = strlen(name);
+	unsigned bytes;
+
+	bch2_time_stats_summary(stats, sum);
+	if (!sum->count)
+		return 0;
+
+	while (first < last && !sum->hist[first])
+		first++;
+	while (last > first && !sum->hist[last - 1])
+		--last;
+
+	name_len = min_t(unsigned, name_len, U8_MAX);
+	bytes = round_up(sizeof(*e) + (last - first) * sizeof(u64) + name_len,
+			 sizeof(u64));
+
+	int ret = darray_make_room(out, bytes);
+	if (ret)
+		return ret;
+
+	e = (void *) &darray_top(*out);
+	memset(e, 0, bytes);
+	e->entry_u64s		= bytes / sizeof(u64);
+	e->source		= source;
+	e->dev			= dev;
+	e->name_len		= name_len;
+	e->hist_first		= first;
+	e->hist_nr		= last - first;
+	e->count		= sum->count;
+	e->min_duration		= sum->min_duration;
+	e->max_duration		= sum->max_duration;
+	e->total_duration	= sum->total_duration;
+	e->mean_duration	= sum->mean_duration;
+	e->stddev_duration	= sum->stddev_duration;
+	memcpy(e->hist, sum->hist + first, (last - first) * sizeof(u64));
+	memcpy(e->hist + (last - first), name, name_len);
+
+	out->nr += bytes;
+	return 0;
+}
+
+static int bch2_time_stats_export(struct bch_fs *c, darray_char *out, u32 *nr)
+{
+	struct bch2_time_stats_summary *sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+	unsigned i;
+	int ret = 0;
+
+	if (!sum)
+		return -ENOMEM;
+
+	for (i = 0; i < BCH_TIME_STAT_NR && !ret; i++)
+		ret = time_stats_entry_add(out, sum, &c->times[i],
+				BCH_TIME_STATS_SOURCE_fs, 0, bch2_time_stats_names[i]);
+
+	for (i = 0; i < BCH_TRANSACTIONS_NR && !ret; i++) {
+		struct btree_transaction_stats *s = &c->btree_transaction_stats[i];
+		const char *fn = READ_ONCE(bch2_btree_transaction_fns[i]);
+
+		if (!fn)
+			continue;
+
+		ret =   time_stats_entry_add(out, sum, &s->duration,
+				BCH_TIME_STATS_SOURCE_btree_trans, 0, fn) ?:
+			time_stats_entry_add(out, sum, &s->lock_hold_times,
+				BCH_TIME_STATS_SOURCE_btree_trans_lock_hold, 0, fn);
+	}
+
+	if (!ret)
+		for_each_member_device(c, ca) {
+			ret =   time_stats_entry_add(out, sum, &ca->io_latency[READ].stats,
+					BCH_TIME_STATS_SOURCE_dev_read, ca->dev_idx, ca->name) ?:
+				time_stats_entry_add(out, sum, &ca->io_latency[WRITE].stats,
+					BCH_TIME_STATS_SOURCE_dev_write, ca->dev_idx, ca->name);
+			if (ret) {
+				bch2_dev_put(ca);
+				break;
+			}
+		}
+
+	for (unsigned pos = 0; pos < out->nr; (*nr)++)
+		pos += ((struct bch_ioctl_time_stats *) (out->data + pos))->entry_u64s * sizeof(u64);
+
+	kfree(sum);
+	return ret;
+}
+
+static long bch2_ioctl_query_time_stats(struct bch_fs *c,
+			struct bch_ioctl_query_time_stats __user *user_arg)
+{
+	struct bch_ioctl_query_time_stats arg;
+	darray_char entries = {};
+	int ret = 0;
+
+	BUILD_BUG_ON(BCH_TIME_STATS_HIST_SUB_BITS != TIME_STATS_HIST_SUB_BITS);
+
+	ret = copy_from_user_errcode(&arg, user_arg, sizeof(arg));
+	if (ret)
+		return ret;
+
+	if (arg.flags || arg.pad)
+		return -EINVAL;
+
+	arg.nr = 0;
+	ret = bch2_time_stats_export(c, &entries, &arg.nr);
+	if (ret)
+		goto err;
+
+	if (arg.entries_u64s * sizeof(u64) < entries.nr) {
+		arg.nr			= 0;
+		arg.entries_u64s	= entries.nr / sizeof(u64);
+		ret = copy_to_user_errcode(user_arg, &arg, sizeof(arg)) ?: -ERANGE;
+		goto err;
+	}
+
+	arg.entries_u64s = entries.nr / sizeof(u64);
+
+	ret =   copy_to_user_errcode(&user_arg->entries, entries.data, entries.nr) ?:
+		copy_to_user_errcode(user_arg, &arg, sizeof(arg));
+err:
+	darray_exit(&entries);
+	return ret;
+}
+
 /* obsolete, didn't allow for new data types: */
 static long bch2_ioctl_dev_usage(struct bch_fs *c,
 				 struct bch_ioctl_dev_usage __user *user_arg)
@@ -927,6 +1064,8 @@ long bch2_fs_ioctl(struct bch_fs *c, unsigned cmd, void __user *arg)
 		BCH_IOCTL(fsck_online, struct bch_ioctl_fsck_online);
 	case BCH_IOCTL_QUERY_ACCOUNTING:
 		return bch2_ioctl_query_accounting(c, arg);
+	case BCH_IOCTL_QUERY_TIME_STATS:
+		return bch2_ioctl_query_time_stats(c, arg);
 	default:
 		return -ENOTTY;
 	}
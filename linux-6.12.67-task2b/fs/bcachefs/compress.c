@@ -4,8 +4,10 @@
 #include "compress.h"
 #include "extents.h"
 #include "super-io.h"
+#include "vstructs.h"
 
 #include <linux/lz4.h>
+#include <linux/random.h>
 #include <linux/zlib.h>
 #include <linux/zstd.h>
 
@@ -149,6 +151,627 @@ static inline void zlib_set_workspace(z_stream *strm, void *workspace)
 #endif
 }
 
+/*
+ * zstd dictionaries:
+ *
+ * Small extents compress badly on their own, as there is little history for
+ * matches to refer to. With the compression_dict option, we sample the start
+ * of small extents written with zstd compression until we have
+ * BCH_COMPRESSION_DICT_MAX_BYTES, and store that in the superblock as a raw
+ * content dictionary - the kernel doesn't have zstd's dictionary trainer, but
+ * zstd can use any data as a dictionary, and data from the same filesystem
+ * tends to share a lot of strings.
+ *
+ * Once the superblock with the dictionary has been written, small extents are
+ * compressed against it and marked BCH_COMPRESSION_TYPE_zstd_dict; they start
+ * with the id of the dictionary used. Dictionaries are never removed, extents
+ * may still refer to them.
+ *
+ * After that we keep sampling, less often, and add the new sample as the next
+ * dictionary if it would compress new data noticeably better than the current
+ * one, i.e. if the data written has changed, up to BCH_COMPRESSION_DICTS_MAX.
+ *
+ * The superblock isn't encrypted, so with encryption enabled we never sample:
+ * the dictionary would be plaintext file data.
+ */
+
+/* Bigger extents gain little from a dictionary: */
+#define COMPRESSION_DICT_EXTENT_MAX	(64U << 10)
+/* Sample this many bytes from every COMPRESSION_DICT_SAMPLE_EVERY'th extent: */
+#define COMPRESSION_DICT_SAMPLE_BYTES	1024U
+#define COMPRESSION_DICT_SAMPLE_EVERY	8U
+/* ... and from every COMPRESSION_DICT_RESAMPLE_EVERY'th once we have one: */
+#define COMPRESSION_DICT_RESAMPLE_EVERY	256U
+
+struct compression_dict {
+	u32			id;
+	void			*data;
+	size_t			len;
+	zstd_cdict		*cdict;
+	zstd_ddict		*ddict;
+};
+
+struct bch_compression_dicts {
+	struct bch_fs		*c;
+	/* Dictionaries below nr never change: */
+	unsigned		nr;
+	struct compression_dict	d[BCH_COMPRESSION_DICTS_MAX];
+
+	spinlock_t		sample_lock;
+	void			*sample;
+	size_t			sample_len;
+	unsigned		sample_skip;
+	struct work_struct	train_work;
+};
+
+static void *compression_dict_alloc(void *opaque, size_t size)
+{
+	return kvzalloc(size, GFP_KERNEL);
+}
+
+static void compression_dict_free(void *opaque, void *address)
+{
+	kvfree(address);
+}
+
+static const zstd_custom_mem compression_dict_mem = {
+	.customAlloc	= compression_dict_alloc,
+	.customFree	= compression_dict_free,
+};
+
+static inline struct bch_compression_dict *
+compression_dict_next(struct bch_compression_dict *d)
+{
+	return (void *) d + sizeof(*d) + round_up(le32_to_cpu(d->len), sizeof(u64));
+}
+
+#define for_each_compression_dict(_f, _d)				\
+	for (_d = (_f)->d;						\
+	     (void *) _d < vstruct_end(&(_f)->field);			\
+	     _d = compression_dict_next(_d))
+
+static void compression_dict_exit(struct compression_dict *d)
+{
+	zstd_free_cdict(d->cdict);
+	zstd_free_ddict(d->ddict);
+	kvfree(d->data);
+	memset(d, 0, sizeof(*d));
+}
+
+static int compression_dict_init(struct bch_fs *c, struct compression_dict *d,
+				 u32 id, const void *data, size_t len)
+{
+	struct bch_compression_opt opt = bch2_compression_decode(c->opts.compression);
+
+	if (__bch2_compression_opt_to_type[opt.type] != BCH_COMPRESSION_TYPE_zstd)
+		opt = bch2_compression_decode(c->opts.background_compression);
+
+	/* same rescaling as attempt_compress(): */
+	unsigned level = min((opt.level * 3) / 2, zstd_max_clevel());
+	zstd_compression_parameters params =
+		zstd_get_cparams(level, COMPRESSION_DICT_EXTENT_MAX, len);
+
+	d->id	= id;
+	d->len	= len;
+	d->data	= kvmemdup(data, len, GFP_KERNEL);
+	if (d->data) {
+		d->cdict = zstd_create_cdict_byreference(d->data, len, params,
+							 compression_dict_mem);
+		d->ddict = zstd_create_ddict_byreference(d->data, len,
+							 compression_dict_mem);
+	}
+
+	if (!d->cdict || !d->ddict) {
+		compression_dict_exit(d);
+		return -BCH_ERR_ENOMEM_compression_dict_init;
+	}
+
+	return 0;
+}
+
+static struct compression_dict *compression_dict_find(struct bch_fs *c, u32 id)
+{
+	struct bch_compression_dicts *dicts = c->compression_dicts;
+	unsigned nr = smp_load_acquire(&dicts->nr);
+
+	for (unsigned i = 0; i < nr; i++)
+		if (dicts->d[i].id == id)
+			return &dicts->d[i];
+	return NULL;
+}
+
+/* The dictionary to compress @src_len bytes with, if any: */
+static struct compression_dict *compression_dict_get(struct bch_fs *c, size_t src_len)
+{
+	struct bch_compression_dicts *dicts = c->compression_dicts;
+	unsigned nr;
+
+	if (!c->opts.compression_dict || src_len > COMPRESSION_DICT_EXTENT_MAX)
+		return NULL;
+
+	nr = smp_load_acquire(&dicts->nr);
+	return nr ? &dicts->d[nr - 1] : NULL;
+}
+
+/* Append a dictionary to the superblock; only used once written out: */
+static int compression_dict_add(struct bch_fs *c, const void *data, size_t len)
+{
+	struct bch_compression_dicts *dicts = c->compression_dicts;
+	struct bch_sb_field_compression_dicts *f;
+	struct bch_compression_dict *d;
+	unsigned nr, old_u64s, u64s;
+	int ret = 0;
+
+	mutex_lock(&c->sb_lock);
+	nr = dicts->nr;
+	if (nr >= BCH_COMPRESSION_DICTS_MAX)
+		goto unlock;
+
+	ret = compression_dict_init(c, &dicts->d[nr],
+				    nr ? dicts->d[nr - 1].id + 1 : 1, data, len);
+	if (ret)
+		goto unlock;
+
+	f = bch2_sb_field_get(c->disk_sb.sb, compression_dicts);
+	old_u64s = f ? le32_to_cpu(f->field.u64s) : sizeof(*f) / sizeof(u64);
+	u64s = (sizeof(*d) + round_up(len, sizeof(u64))) / sizeof(u64);
+
+	f = bch2_sb_field_resize(&c->disk_sb, compression_dicts, old_u64s + u64s);
+	if (!f) {
+		ret = -BCH_ERR_ENOSPC_sb_compression_dicts;
+		goto err;
+	}
+
+	d = (void *) f + old_u64s * sizeof(u64);
+	d->id	= cpu_to_le32(dicts->d[nr].id);
+	d->len	= cpu_to_le32(len);
+	memcpy(d->data, data, len);
+
+	c->disk_sb.sb->features[0] |= cpu_to_le64(BIT_ULL(BCH_FEATURE_zstd_dict));
+
+	ret = bch2_write_super(c);
+	if (ret) {
+		bch2_sb_field_resize(&c->disk_sb, compression_dicts, old_u64s);
+		goto err;
+	}
+
+	smp_store_release(&dicts->nr, nr + 1);
+unlock:
+	mutex_unlock(&c->sb_lock);
+	return ret;
+err:
+	compression_dict_exit(&dicts->d[nr]);
+	goto unlock;
+}
+
+/*
+ * Would a dictionary made from @sample do better than @cur on new data? Build
+ * one from the first half of the sample, and compare on the second half,
+ * compressing it in extent-sized pieces:
+ */
+static bool compression_dict_better(struct bch_fs *c, struct compression_dict *cur,
+				    const void *sample, size_t len)
+{
+	struct compression_dict new = {};
+	size_t half = len / 2, cur_bytes = 0, new_bytes = 0;
+	size_t dst_len = zstd_compress_bound(COMPRESSION_DICT_SAMPLE_BYTES);
+	void *workspace = NULL, *dst = NULL;
+	ZSTD_CCtx *ctx;
+	bool ret = false;
+
+	if (compression_dict_init(c, &new, 0, sample, half))
+		return false;
+
+	dst = kmalloc(dst_len, GFP_KERNEL);
+	if (!dst)
+		goto out;
+
+	workspace = mempool_alloc(&c->compress_workspace[BCH_COMPRESSION_TYPE_zstd],
+				  GFP_NOFS);
+	ctx = zstd_init_cctx(workspace, c->zstd_workspace_size);
+
+	for (size_t i = half; i < len; i += COMPRESSION_DICT_SAMPLE_BYTES) {
+		size_t n = min(len - i, (size_t) COMPRESSION_DICT_SAMPLE_BYTES);
+		size_t cur_len = zstd_compress_using_cdict(ctx, dst, dst_len,
+						sample + i, n, cur->cdict);
+		size_t new_len = zstd_compress_using_cdict(ctx, dst, dst_len,
+						sample + i, n, new.cdict);
+
+		if (zstd_is_error(cur_len) || zstd_is_error(new_len))
+			goto out_free;
+		cur_bytes += cur_len;
+		new_bytes += new_len;
+	}
+
+	/* Only worth a new dictionary if it saves an eighth: */
+	ret = new_bytes * 8 < cur_bytes * 7;
+out_free:
+	mempool_free(workspace, &c->compress_workspace[BCH_COMPRESSION_TYPE_zstd]);
+out:
+	kfree(dst);
+	compression_dict_exit(&new);
+	return ret;
+}
+
+static void compression_dict_train_work(struct work_struct *work)
+{
+	struct bch_compression_dicts *dicts =
+		container_of(work, struct bch_compression_dicts, train_work);
+	struct bch_fs *c = dicts->c;
+	unsigned nr = READ_ONCE(dicts->nr);
+	int ret = 0;
+
+	/* the sample is full, nothing else touches it until we reset it: */
+	if (!nr || compression_dict_better(c, &dicts->d[nr - 1],
+					   dicts->sample, dicts->sample_len))
+		ret = compression_dict_add(c, dicts->sample, dicts->sample_len);
+
+	spin_lock(&dicts->sample_lock);
+	if (!ret) {
+		kfree(dicts->sample);
+		dicts->sample = NULL;
+	}
+	dicts->sample_len = 0;
+	spin_unlock(&dicts->sample_lock);
+
+	bch_err_msg(c, ret, "creating compression dictionary");
+	bch2_write_ref_put(c, BCH_WRITE_REF_compression_dict);
+}
+
+static void compression_dict_sample(struct bch_fs *c, const void *src, size_t src_len)
+{
+	struct bch_compression_dicts *dicts = c->compression_dicts;
+	unsigned nr = READ_ONCE(dicts->nr);
+
+	if (!c->opts.compression_dict ||
+	    c->sb.encryption_type ||
+	    src_len > COMPRESSION_DICT_EXTENT_MAX ||
+	    nr >= BCH_COMPRESSION_DICTS_MAX ||
+	    !spin_trylock(&dicts->sample_lock))
+		return;
+
+	if (dicts->sample_len == BCH_COMPRESSION_DICT_MAX_BYTES ||
+	    dicts->sample_skip++ % (nr
+				    ? COMPRESSION_DICT_RESAMPLE_EVERY
+				    : COMPRESSION_DICT_SAMPLE_EVERY))
+		goto unlock;
+
+	if (!dicts->sample)
+		dicts->sample = kmalloc(BCH_COMPRESSION_DICT_MAX_BYTES,
+					GFP_NOWAIT|__GFP_NOWARN);
+	if (!dicts->sample)
+		goto unlock;
+
+	size_t n = min3(src_len, (size_t) COMPRESSION_DICT_SAMPLE_BYTES,
+			BCH_COMPRESSION_DICT_MAX_BYTES - dicts->sample_len);
+
+	memcpy(dicts->sample + dicts->sample_len, src, n);
+	dicts->sample_len += n;
+
+	if (dicts->sample_len == BCH_COMPRESSION_DICT_MAX_BYTES) {
+		if (!bch2_write_ref_tryget(c, BCH_WRITE_REF_compression_dict))
+			dicts->sample_len = 0;
+		else if (!queue_work(system_long_wq, &dicts->train_work))
+			bch2_write_ref_put(c, BCH_WRITE_REF_compression_dict);
+	}
+unlock:
+	spin_unlock(&dicts->sample_lock);
+}
+
+static int bch2_fs_compression_dicts_init(struct bch_fs *c)
+{
+	struct bch_compression_dicts *dicts = kzalloc(sizeof(*dicts), GFP_KERNEL);
+	if (!dicts)
+		return -BCH_ERR_ENOMEM_compression_dict_init;
+
+	dicts->c = c;
+	spin_lock_init(&dicts->sample_lock);
+	INIT_WORK(&dicts->train_work, compression_dict_train_work);
+	c->compression_dicts = dicts;
+
+	if (c->opts.compression_dict && c->sb.encryption_type)
+		bch_info(c, "compression_dict: not creating dictionaries on an encrypted filesystem");
+
+	struct bch_sb_field_compression_dicts *f =
+		bch2_sb_field_get(c->disk_sb.sb, compression_dicts);
+	struct bch_compression_dict *d;
+
+	if (f)
+		for_each_compression_dict(f, d) {
+			int ret = compression_dict_init(c, &dicts->d[dicts->nr],
+							le32_to_cpu(d->id), d->data,
+							le32_to_cpu(d->len));
+			if (ret)
+				return ret;
+			dicts->nr++;
+		}
+
+	return 0;
+}
+
+static void bch2_fs_compression_dicts_exit(struct bch_fs *c)
+{
+	struct bch_compression_dicts *dicts = c->compression_dicts;
+
+	if (!dicts)
+		return;
+
+	cancel_work_sync(&dicts->train_work);
+	for (unsigned i = 0; i < dicts->nr; i++)
+		compression_dict_exit(&dicts->d[i]);
+	kfree(dicts->sample);
+	kfree(dicts);
+	c->compression_dicts = NULL;
+}
+
+static int bch2_sb_compression_dicts_validate(struct bch_sb *sb, struct bch_sb_field *f,
+				enum bch_validate_flags flags, struct printbuf *err)
+{
+	struct bch_sb_field_compression_dicts *dicts = field_to_type(f, compression_dicts);
+	struct bch_compression_dict *d;
+	unsigned nr = 0;
+	u32 prev_id = 0;
+
+	for_each_compression_dict(dicts, d) {
+		if ((void *) d->data > vstruct_end(f) ||
+		    (void *) compression_dict_next(d) > vstruct_end(f)) {
+			prt_printf(err, "dictionary %u extends past end of field", nr);
+			return -BCH_ERR_invalid_sb_compression_dicts;
+		}
+
+		if (!le32_to_cpu(d->len) ||
+		    le32_to_cpu(d->len) > BCH_COMPRESSION_DICT_MAX_BYTES) {
+			prt_printf(err, "dictionary %u has invalid size %u",
+				   nr, le32_to_cpu(d->len));
+			return -BCH_ERR_invalid_sb_compression_dicts;
+		}
+
+		if (le32_to_cpu(d->id) <= prev_id) {
+			prt_printf(err, "dictionary %u: ids not increasing (%u after %u)",
+				   nr, le32_to_cpu(d->id), prev_id);
+			return -BCH_ERR_invalid_sb_compression_dicts;
+		}
+		prev_id = le32_to_cpu(d->id);
+
+		if (++nr > BCH_COMPRESSION_DICTS_MAX) {
+			prt_printf(err, "too many dictionaries");
+			return -BCH_ERR_invalid_sb_compression_dicts;
+		}
+	}
+
+	return 0;
+}
+
+static void bch2_sb_compression_dicts_to_text(struct printbuf *out, struct bch_sb *sb,
+					      struct bch_sb_field *f)
+{
+	struct bch_sb_field_compression_dicts *dicts = field_to_type(f, compression_dicts);
+	struct bch_compression_dict *d;
+
+	for_each_compression_dict(dicts, d)
+		prt_printf(out, "zstd dictionary %u:\t%u bytes\n",
+			   le32_to_cpu(d->id), le32_to_cpu(d->len));
+}
+
+const struct bch_sb_field_ops bch_sb_field_ops_compression_dicts = {
+	.validate	= bch2_sb_compression_dicts_validate,
+	.to_text	= bch2_sb_compression_dicts_to_text,
+};
+
+#ifdef CONFIG_BCACHEFS_TESTS
+
+static const char * const dict_test_words[2][16] = {
+	{ "btree", "journal", "bucket", "extent", "inode", "snapshot",
+	  "allocator", "superblock", "checksum", "replicas", "rebalance",
+	  "copygc", "reflink", "subvolume", "dirent", "xattr" },
+	{ "lorem", "ipsum", "dolor", "consectetur", "adipiscing", "eiusmod",
+	  "tempor", "incididunt", "labore", "magna", "aliqua", "veniam",
+	  "nostrud", "exercitation", "ullamco", "laboris" },
+};
+
+/* Fill @buf with random words from one of two vocabularies: */
+static void dict_test_fill(char *buf, size_t len, unsigned vocab)
+{
+	size_t i = 0;
+
+	while (i < len) {
+		const char *w = dict_test_words[vocab][get_random_u32_below(16)];
+		size_t n = min(strlen(w), len - i);
+
+		memcpy(buf + i, w, n);
+		i += n;
+		if (i < len)
+			buf[i++] = get_random_u32_below(8) ? ' ' : '\n';
+	}
+}
+
+/*
+ * Compress @nr small extents of the same kind of data as the dictionary, check
+ * that they decompress to the original and that the dictionary beats plain
+ * zstd at its highest level:
+ */
+static int dict_test_roundtrip(struct bch_fs *c, struct compression_dict *dict,
+			       u64 nr)
+{
+	size_t src_len = COMPRESSION_DICT_SAMPLE_BYTES;
+	size_t dst_len = zstd_compress_bound(src_len);
+	size_t dict_bytes = 0, plain_bytes = 0;
+	ZSTD_parameters params = zstd_get_params(zstd_max_clevel(), src_len);
+	void *cwksp = kvmalloc(c->zstd_workspace_size, GFP_KERNEL);
+	void *dwksp = kvmalloc(zstd_dctx_workspace_bound(), GFP_KERNEL);
+	char *src = kmalloc(src_len, GFP_KERNEL);
+	char *dst = kmalloc(dst_len, GFP_KERNEL);
+	char *out = kmalloc(src_len, GFP_KERNEL);
+	ZSTD_CCtx *cctx;
+	ZSTD_DCtx *dctx;
+	int ret = -ENOMEM;
+
+	if (!cwksp || !dwksp || !src || !dst || !out)
+		goto out;
+
+	cctx = zstd_init_cctx(cwksp, c->zstd_workspace_size);
+	dctx = zstd_init_dctx(dwksp, zstd_dctx_workspace_bound());
+
+	ret = -EINVAL;
+	for (u64 i = 0; i < nr; i++) {
+		dict_test_fill(src, src_len, 0);
+
+		size_t len = zstd_compress_using_cdict(cctx, dst, dst_len,
+						       src, src_len, dict->cdict);
+		if (zstd_is_error(len)) {
+			pr_err("compressing with dictionary: %s",
+			       zstd_get_error_name(len));
+			goto out;
+		}
+		dict_bytes += len;
+
+		size_t res = zstd_decompress_using_ddict(dctx, out, src_len,
+							 dst, len, dict->ddict);
+		if (res != src_len || memcmp(src, out, src_len)) {
+			pr_err("dictionary round trip returned different data");
+			goto out;
+		}
+
+		len = zstd_compress_cctx(cctx, dst, dst_len, src, src_len, &params);
+		if (zstd_is_error(len)) {
+			pr_err("compressing without dictionary: %s",
+			       zstd_get_error_name(len));
+			goto out;
+		}
+		plain_bytes += len;
+	}
+
+	if (dict_bytes >= plain_bytes) {
+		pr_err("dictionary doesn't help: %zu bytes with, %zu without",
+		       dict_bytes, plain_bytes);
+		goto out;
+	}
+
+	ret = 0;
+out:
+	kfree(out);
+	kfree(dst);
+	kfree(src);
+	kvfree(dwksp);
+	kvfree(cwksp);
+	return ret;
+}
+
+/* Put dictionaries of the given ids and lengths into a superblock field: */
+static struct bch_sb_field_compression_dicts *
+dict_test_field(const u32 *ids, const u32 *lens, unsigned nr, unsigned u64s)
+{
+	struct bch_sb_field_compression_dicts *f =
+		kzalloc(u64s * sizeof(u64), GFP_KERNEL);
+	struct bch_compression_dict *d;
+
+	if (!f)
+		return NULL;
+
+	f->field.u64s = cpu_to_le32(u64s);
+	d = f->d;
+	for (unsigned i = 0; i < nr; i++) {
+		d->id	= cpu_to_le32(ids[i]);
+		d->len	= cpu_to_le32(lens[i]);
+		d = compression_dict_next(d);
+	}
+	return f;
+}
+
+static int dict_test_validate(void)
+{
+	static const struct {
+		u32	ids[3];
+		u32	lens[3];
+		unsigned nr;
+		int	u64s_adjust;
+		bool	valid;
+	} tests[] = {
+		{ { 1, 2 },	{ 100, 16 },			2, 0,	true },
+		{ { 2, 2 },	{ 100, 16 },			2, 0,	false },
+		{ { 1, 2 },	{ 100, 0 },			2, 0,	false },
+		{ { 1 },	{ BCH_COMPRESSION_DICT_MAX_BYTES + 8 }, 1, 0, false },
+		{ { 1, 2 },	{ 100, 16 },			2, -1,	false },
+	};
+
+	for (unsigned i = 0; i < ARRAY_SIZE(tests); i++) {
+		unsigned u64s = sizeof(struct bch_sb_field_compression_dicts) / sizeof(u64);
+
+		for (unsigned j = 0; j < tests[i].nr; j++)
+			u64s += (sizeof(struct bch_compression_dict) +
+				 round_up(tests[i].lens[j], sizeof(u64))) / sizeof(u64);
+
+		struct bch_sb_field_compression_dicts *f =
+			dict_test_field(tests[i].ids, tests[i].lens, tests[i].nr,
+					u64s + tests[i].u64s_adjust);
+		if (!f)
+			return -ENOMEM;
+
+		struct printbuf err = PRINTBUF;
+		int ret = bch2_sb_compression_dicts_validate(NULL, &f->field, 0, &err);
+		kfree(f);
+
+		if (!ret != tests[i].valid) {
+			pr_err("dictionary field %u: expected %s, got %i %s",
+			       i, tests[i].valid ? "valid" : "invalid", ret, err.buf);
+			printbuf_exit(&err);
+			return -EINVAL;
+		}
+		printbuf_exit(&err);
+	}
+
+	return 0;
+}
+
+int bch2_compression_dict_test(struct bch_fs *c, u64 nr)
+{
+	struct compression_dict dict = {};
+	size_t len = BCH_COMPRESSION_DICT_MAX_BYTES;
+	char *sample = kvmalloc(len, GFP_KERNEL);
+	int ret;
+
+	if (!sample)
+		return -ENOMEM;
+
+	ret = bch2_check_set_has_compressed_data(c,
+			bch2_compression_encode((struct bch_compression_opt) {
+				.type = BCH_COMPRESSION_OPT_zstd }));
+	if (ret)
+		goto out;
+
+	dict_test_fill(sample, len, 0);
+	ret = compression_dict_init(c, &dict, 1, sample, len);
+	if (ret)
+		goto out;
+
+	ret = dict_test_roundtrip(c, &dict, nr);
+	if (ret)
+		goto out;
+
+	/* More of the same data shouldn't make a new dictionary, other data should: */
+	dict_test_fill(sample, len, 0);
+	if (compression_dict_better(c, &dict, sample, len)) {
+		pr_err("new dictionary for the same kind of data");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	dict_test_fill(sample, len, 1);
+	if (!compression_dict_better(c, &dict, sample, len)) {
+		pr_err("no new dictionary for different data");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = dict_test_validate();
+out:
+	compression_dict_exit(&dict);
+	kvfree(sample);
+	return ret;
+}
+
+#endif /* CONFIG_BCACHEFS_TESTS */
+
 static int __bio_uncompress(struct bch_fs *c, struct bio *src,
 			    void *dst_data, struct bch_extent_crc_unpacked crc)
 {
@@ -208,6 +831,34 @@ static int __bio_uncompress(struct bch_fs *c, struct bio *src,
 			goto err;
 		break;
 	}
+	case BCH_COMPRESSION_TYPE_zstd_dict: {
+		struct compression_dict *dict;
+		ZSTD_DCtx *ctx;
+		size_t real_src_len;
+
+		if (src_len < 8)
+			goto err;
+
+		dict = compression_dict_find(c, le32_to_cpup(src_data.b));
+		real_src_len = le32_to_cpup(src_data.b + 4);
+
+		if (!dict || real_src_len > src_len - 8)
+			goto err;
+
+		workspace = mempool_alloc(&c->decompress_workspace, GFP_NOFS);
+		ctx = zstd_init_dctx(workspace, zstd_dctx_workspace_bound());
+
+		ret = zstd_decompress_using_ddict(ctx,
+				dst_data,	dst_len,
+				src_data.b + 8, real_src_len,
+				dict->ddict);
+
+		mempool_free(workspace, &c->decompress_workspace);
+
+		if (ret != dst_len)
+			goto err;
+		break;
+	}
 	default:
 		BUG();
 	}
@@ -296,7 +947,8 @@ static int attempt_compress(struct bch_fs *c,
 			    void *workspace,
 			    void *dst, size_t dst_len,
 			    void *src, size_t src_len,
-			    struct bch_compression_opt compression)
+			    struct bch_compression_opt compression,
+			    struct compression_dict *dict)
 {
 	enum bch_compression_type compression_type =
 		__bch2_compression_opt_to_type[compression.type];
@@ -356,6 +1008,20 @@ static int attempt_compress(struct bch_fs *c,
 		ZSTD_parameters params = zstd_get_params(level, c->opts.encoded_extent_max);
 		ZSTD_CCtx *ctx = zstd_init_cctx(workspace, c->zstd_workspace_size);
 
+		if (dict) {
+			/* The dictionary id goes before the compressed size: */
+			size_t len = zstd_compress_using_cdict(ctx,
+					dst + 8,	dst_len - 8 - 7,
+					src,		src_len,
+					dict->cdict);
+			if (zstd_is_error(len))
+				return 0;
+
+			((__le32 *) dst)[0] = cpu_to_le32(dict->id);
+			((__le32 *) dst)[1] = cpu_to_le32(len);
+			return len + 8;
+		}
+
 		/*
 		 * ZSTD requires that when we decompress we pass in the exact
 		 * compressed size - rounding it up to the nearest sector
@@ -388,6 +1054,7 @@ static unsigned __bio_compress(struct bch_fs *c,
 			       struct bch_compression_opt compression)
 {
 	struct bbuf src_data = { NULL }, dst_data = { NULL };
+	struct compression_dict *dict = NULL;
 	void *workspace;
 	enum bch_compression_type compression_type =
 		__bch2_compression_opt_to_type[compression.type];
@@ -409,6 +1076,11 @@ static unsigned __bio_compress(struct bch_fs *c,
 	*src_len = src->bi_iter.bi_size;
 	*dst_len = dst->bi_iter.bi_size;
 
+	if (compression_type == BCH_COMPRESSION_TYPE_zstd) {
+		compression_dict_sample(c, src_data.b, *src_len);
+		dict = compression_dict_get(c, *src_len);
+	}
+
 	/*
 	 * XXX: this algorithm sucks when the compression code doesn't tell us
 	 * how much would fit, like LZ4 does:
@@ -422,7 +1094,7 @@ static unsigned __bio_compress(struct bch_fs *c,
 		ret = attempt_compress(c, workspace,
 				       dst_data.b,	*dst_len,
 				       src_data.b,	*src_len,
-				       compression);
+				       compression, dict);
 		if (ret > 0) {
 			*dst_len = ret;
 			ret = 0;
@@ -469,7 +1141,7 @@ static unsigned __bio_compress(struct bch_fs *c,
 	BUG_ON(!*src_len || *src_len > src->bi_iter.bi_size);
 	BUG_ON(*dst_len & (block_bytes(c) - 1));
 	BUG_ON(*src_len & (block_bytes(c) - 1));
-	ret = compression_type;
+	ret = dict ? BCH_COMPRESSION_TYPE_zstd_dict : compression_type;
 out:
 	bio_unmap_or_unbounce(c, src_data);
 	bio_unmap_or_unbounce(c, dst_data);
@@ -559,6 +1231,7 @@ void bch2_fs_compress_exit(struct bch_fs *c)
 {
 	unsigned i;
 
+	bch2_fs_compression_dicts_exit(c);
 	mempool_exit(&c->decompress_workspace);
 	for (i = 0; i < ARRAY_SIZE(c->compress_workspace); i++)
 		mempool_exit(&c->compress_workspace[i]);
@@ -650,7 +1323,8 @@ int bch2_fs_compress_init(struct bch_fs *c)
 	f |= compression_opt_to_feature(c->opts.compression);
 	f |= compression_opt_to_feature(c->opts.background_compression);
 
-	return __bch2_fs_compress_init(c, f);
+	return  bch2_fs_compression_dicts_init(c) ?:
+		__bch2_fs_compress_init(c, f);
 }
 
 int bch2_opt_compression_parse(struct bch_fs *c, const char *_val, u64 *res,
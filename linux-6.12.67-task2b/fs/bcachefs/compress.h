@@ -47,6 +47,14 @@ static inline enum bch_compression_type bch2_compression_opt_to_type(unsigned v)
 	return __bch2_compression_opt_to_type[bch2_compression_decode(v).type];
 }
 
+/* Extents compressed with a dictionary are still what the zstd option asks for: */
+static inline bool bch2_compression_type_matches(unsigned crc_type, unsigned type)
+{
+	return crc_type == type ||
+		(crc_type == BCH_COMPRESSION_TYPE_zstd_dict &&
+		 type == BCH_COMPRESSION_TYPE_zstd);
+}
+
 int bch2_bio_uncompress_inplace(struct bch_fs *, struct bio *,
 				struct bch_extent_crc_unpacked *);
 int bch2_bio_uncompress(struct bch_fs *, struct bio *, struct bio *,
@@ -54,6 +62,12 @@ int bch2_bio_uncompress(struct bch_fs *, struct bio *, struct bio *,
 unsigned bch2_bio_compress(struct bch_fs *, struct bio *, size_t *,
 			   struct bio *, size_t *, unsigned);
 
+extern const struct bch_sb_field_ops bch_sb_field_ops_compression_dicts;
+
+#ifdef CONFIG_BCACHEFS_TESTS
+int bch2_compression_dict_test(struct bch_fs *, u64);
+#endif
+
 int bch2_check_set_has_compressed_data(struct bch_fs *, unsigned);
 void bch2_fs_compress_exit(struct bch_fs *);
 int bch2_fs_compress_init(struct bch_fs *);
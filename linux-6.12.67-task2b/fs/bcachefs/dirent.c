@@ -12,6 +12,7 @@
 #include "subvolume.h"
 
 #include <linux/dcache.h>
+#include <linux/sort.h>
 
 static unsigned bch2_dirent_name_bytes(struct bkey_s_c_dirent d)
 {
@@ -494,6 +495,74 @@ u64 bch2_dirent_lookup(struct bch_fs *c, subvol_inum dir,
 	return ret;
 }
 
+struct dirent_lookup_idx {
+	u64		hash;
+	unsigned	idx;
+};
+
+static int dirent_lookup_idx_cmp(const void *_l, const void *_r)
+{
+	const struct dirent_lookup_idx *l = _l, *r = _r;
+
+	return cmp_int(l->hash, r->hash);
+}
+
+/**
+ * bch2_dirent_lookup_batch - look up several names in one directory
+ * @c:		filesystem handle
+ * @dir:	directory to look in
+ * @hash_info:	hash info of @dir
+ * @names:	names to look up
+ * @nr:		number of names
+ * @inums:	returns the inode each name points to, or 0 if it doesn't exist
+ *
+ * The lookups share one transaction and are done in hash order, i.e. in
+ * dirents btree order, so names that land in the same btree node are looked up
+ * together.
+ *
+ * Returns: 0 on success (including names that weren't found), or an error
+ */
+int bch2_dirent_lookup_batch(struct bch_fs *c, subvol_inum dir,
+			     const struct bch_hash_info *hash_info,
+			     const struct qstr *names, unsigned nr,
+			     subvol_inum *inums)
+{
+	struct dirent_lookup_idx *order;
+	unsigned i;
+	int ret = 0;
+
+	order = kvmalloc_array(nr, sizeof(*order), GFP_KERNEL);
+	if (!order)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		order[i].hash	= bch2_dirent_hash(hash_info, &names[i]);
+		order[i].idx	= i;
+	}
+	sort(order, nr, sizeof(*order), dirent_lookup_idx_cmp, NULL);
+
+	struct btree_trans *trans = bch2_trans_get(c);
+
+	for (i = 0; i < nr && !ret; i++) {
+		unsigned idx = order[i].idx;
+		struct btree_iter iter = { NULL };
+
+		ret = lockrestart_do(trans,
+			bch2_dirent_lookup_trans(trans, &iter, dir, hash_info,
+						 &names[idx], &inums[idx], 0));
+		bch2_trans_iter_exit(trans, &iter);
+
+		if (bch2_err_matches(ret, ENOENT)) {
+			inums[idx] = (subvol_inum) { 0 };
+			ret = 0;
+		}
+	}
+
+	bch2_trans_put(trans);
+	kvfree(order);
+	return ret;
+}
+
 int bch2_empty_dir_snapshot(struct btree_trans *trans, u64 dir, u32 subvol, u32 snapshot)
 {
 	struct btree_iter iter;
@@ -543,32 +612,86 @@ static int bch2_dir_emit(struct dir_context *ctx, struct bkey_s_c_dirent d, subv
 	return ret;
 }
 
+/*
+ * dir_emit() can fault and block, so it's called without btree locks held:
+ * dirents are copied out and emitted in batches of up to READDIR_BATCH_U64S,
+ * so that locks are dropped and retaken once per batch, not once per dirent.
+ */
+#define READDIR_BATCH_U64S	512
+
+struct readdir_batch {
+	DARRAY(u64)		keys;
+	DARRAY(subvol_inum)	targets;
+};
+
+static int readdir_batch_add(struct btree_trans *trans, subvol_inum dir,
+			     struct readdir_batch *b, struct bkey_s_c k)
+{
+	struct bkey_i *copy;
+	subvol_inum target;
+	int ret = darray_make_room(&b->keys, k.k->u64s) ?:
+		  darray_make_room(&b->targets, 1);
+	if (ret)
+		return ret;
+
+	copy = (void *) &darray_top(b->keys);
+	bkey_reassemble(copy, k);
+
+	ret = bch2_dirent_read_target(trans, dir, bkey_i_to_s_c_dirent(copy), &target);
+	if (ret)
+		return ret < 0 ? ret : 0;
+
+	b->keys.nr += k.k->u64s;
+	darray_push(&b->targets, target);
+
+	return b->keys.nr >= READDIR_BATCH_U64S;
+}
+
+static bool readdir_batch_emit(struct dir_context *ctx, struct readdir_batch *b)
+{
+	struct bkey_i *k = (void *) b->keys.data;
+
+	darray_for_each(b->targets, target) {
+		if (!bch2_dir_emit(ctx, bkey_i_to_s_c_dirent(k), *target))
+			return false;
+		k = bkey_next(k);
+	}
+
+	return true;
+}
+
 int bch2_readdir(struct bch_fs *c, subvol_inum inum, struct dir_context *ctx)
 {
-	struct bkey_buf sk;
-	bch2_bkey_buf_init(&sk);
+	struct btree_trans *trans = bch2_trans_get(c);
+	struct readdir_batch b = {};
+	int ret;
+
+	do {
+		b.keys.nr	= 0;
+		b.targets.nr	= 0;
+
+		bch2_trans_begin(trans);
 
-	int ret = bch2_trans_run(c,
-		for_each_btree_key_in_subvolume_upto(trans, iter, BTREE_ID_dirents,
+		ret = for_each_btree_key_in_subvolume_upto(trans, iter, BTREE_ID_dirents,
 				   POS(inum.inum, ctx->pos),
 				   POS(inum.inum, U64_MAX),
 				   inum.subvol, 0, k, ({
 			if (k.k->type != KEY_TYPE_dirent)
 				continue;
 
-			/* dir_emit() can fault and block: */
-			bch2_bkey_buf_reassemble(&sk, c, k);
-			struct bkey_s_c_dirent dirent = bkey_i_to_s_c_dirent(sk.k);
+			readdir_batch_add(trans, inum, &b, k);
+		}));
 
-			subvol_inum target;
-			int ret2 = bch2_dirent_read_target(trans, inum, dirent, &target);
-			if (ret2 > 0)
-				continue;
+		bch2_trans_unlock(trans);
 
-			ret2 ?: drop_locks_do(trans, bch2_dir_emit(ctx, dirent, target));
-		})));
+		if (ret < 0 ||
+		    !readdir_batch_emit(ctx, &b))
+			break;
+	} while (ret);
 
-	bch2_bkey_buf_exit(&sk, c);
+	darray_exit(&b.targets);
+	darray_exit(&b.keys);
+	bch2_trans_put(trans);
 
 	return ret < 0 ? ret : 0;
 }
@@ -838,26 +838,96 @@ err:
 }
 
 /* recovery read path: */
+
+/*
+ * A reconstruct read reads the same range of every block of the stripe, and
+ * only completes the read bio once the blocks are all in and the missing one
+ * is rebuilt. The block reads are not waited on by the thread doing the read,
+ * so the reads of consecutive extents that all need reconstructing (as after
+ * losing a device) are in flight at the same time instead of one stripe after
+ * the other.
+ */
+struct ec_read_op {
+	struct closure		cl;
+	struct bch_read_bio	*rbio;
+	unsigned		offset;
+	struct ec_stripe_buf	buf;
+};
+
+static void ec_read_op_free(struct ec_read_op *op)
+{
+	closure_debug_destroy(&op->cl);
+	ec_stripe_buf_exit(&op->buf);
+	kfree(op);
+}
+
+static int ec_read_extent_finish(struct bch_fs *c, struct ec_read_op *op)
+{
+	struct ec_stripe_buf *buf = &op->buf;
+	struct bch_read_bio *rbio = op->rbio;
+	struct bch_stripe *v = &bkey_i_to_stripe(&buf->key)->v;
+
+	if (ec_nr_failed(buf) > v->nr_redundant) {
+		struct printbuf msgbuf = PRINTBUF;
+
+		bch2_bkey_val_to_text(&msgbuf, c, bkey_i_to_s_c(&buf->key));
+		bch_err_ratelimited(c,
+			"error doing reconstruct read: unable to read enough blocks\n  %s",
+			msgbuf.buf);
+		printbuf_exit(&msgbuf);
+		return -BCH_ERR_stripe_reconstruct;
+	}
+
+	ec_validate_checksums(c, buf);
+
+	if (ec_do_recov(c, buf))
+		return -BCH_ERR_stripe_reconstruct;
+
+	memcpy_to_bio(&rbio->bio, rbio->bio.bi_iter,
+		      buf->data[rbio->pick.ec.block] + ((op->offset - buf->offset) << 9));
+	return 0;
+}
+
+static void ec_read_extent_done(struct closure *cl)
+{
+	struct ec_read_op *op = container_of(cl, struct ec_read_op, cl);
+	struct bch_read_bio *rbio = op->rbio;
+
+	if (ec_read_extent_finish(rbio->c, op))
+		rbio->bio.bi_status = BLK_STS_IOERR;
+
+	ec_read_op_free(op);
+	bio_endio(&rbio->bio);
+}
+
+/*
+ * Returns 0 if the reconstruct read was started: the read bio is then
+ * completed, with an error if reconstructing fails, once the stripe has been
+ * read - except for BCH_READ_IN_RETRY, where this waits for the stripe and
+ * leaves completing the bio to the caller as for normal reads.
+ */
 int bch2_ec_read_extent(struct btree_trans *trans, struct bch_read_bio *rbio,
 			struct bkey_s_c orig_k)
 {
 	struct bch_fs *c = trans->c;
-	struct ec_stripe_buf *buf = NULL;
-	struct closure cl;
+	struct ec_read_op *op = NULL;
+	struct ec_stripe_buf *buf;
 	struct bch_stripe *v;
 	unsigned i, offset;
 	const char *msg = NULL;
 	struct printbuf msgbuf = PRINTBUF;
 	int ret = 0;
 
-	closure_init_stack(&cl);
-
 	BUG_ON(!rbio->pick.has_ec);
 
-	buf = kzalloc(sizeof(*buf), GFP_NOFS);
-	if (!buf)
+	op = kzalloc(sizeof(*op), GFP_NOFS);
+	if (!op)
 		return -BCH_ERR_ENOMEM_ec_read_extent;
 
+	closure_init(&op->cl, NULL);
+	op->rbio = rbio;
+	buf = &op->buf;
+
 	ret = lockrestart_do(trans, get_stripe_key_trans(trans, rbio->pick.ec.idx, buf));
 	if (ret) {
 		msg = "stripe not found";
@@ -882,36 +952,28 @@ int bch2_ec_read_extent(struct btree_trans *trans, struct bch_read_bio *rbio,
 		msg = "-ENOMEM";
 		goto err;
 	}
+	op->offset = offset;
 
 	for (i = 0; i < v->nr_blocks; i++)
-		ec_block_io(c, buf, REQ_OP_READ, i, &cl);
-
-	closure_sync(&cl);
+		ec_block_io(c, buf, REQ_OP_READ, i, &op->cl);
 
-	if (ec_nr_failed(buf) > v->nr_redundant) {
-		msg = "unable to read enough blocks";
-		goto err;
+	if (!(rbio->flags & BCH_READ_IN_RETRY)) {
+		continue_at(&op->cl, ec_read_extent_done, system_unbound_wq);
+		return 0;
 	}
 
-	ec_validate_checksums(c, buf);
+	closure_sync(&op->cl);
 
-	ret = ec_do_recov(c, buf);
-	if (ret)
-		goto err;
-
-	memcpy_to_bio(&rbio->bio, rbio->bio.bi_iter,
-		      buf->data[rbio->pick.ec.block] + ((offset - buf->offset) << 9));
-out:
-	ec_stripe_buf_exit(buf);
-	kfree(buf);
+	ret = ec_read_extent_finish(c, op);
+	ec_read_op_free(op);
 	return ret;
 err:
 	bch2_bkey_val_to_text(&msgbuf, c, orig_k);
 	bch_err_ratelimited(c,
 			    "error doing reconstruct read: %s\n  %s", msg, msgbuf.buf);
-	printbuf_exit(&msgbuf);;
-	ret = -BCH_ERR_stripe_reconstruct;
-	goto out;
+	printbuf_exit(&msgbuf);
+	ec_read_op_free(op);
+	return -BCH_ERR_stripe_reconstruct;
 }
 
 /* stripe bucket accounting: */
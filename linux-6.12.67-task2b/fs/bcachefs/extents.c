@@ -1422,7 +1422,8 @@ unsigned bch2_bkey_ptrs_need_rebalance(struct bch_fs *c, struct bkey_s_c k,
 				goto incompressible;
 			}
 
-			if (!p.ptr.cached && p.crc.compression_type != compression_type)
+			if (!p.ptr.cached &&
+			    !bch2_compression_type_matches(p.crc.compression_type, compression_type))
 				rewrite_ptrs |= 1U << i;
 			i++;
 		}
@@ -1476,7 +1477,8 @@ static u64 __bch2_bkey_sectors_need_rebalance(struct bch_fs *c, struct bkey_s_c
 				goto incompressible;
 			}
 
-			if (!p.ptr.cached && p.crc.compression_type != compression_type)
+			if (!p.ptr.cached &&
+			    !bch2_compression_type_matches(p.crc.compression_type, compression_type))
 				sectors += p.crc.compressed_size;
 		}
 	}
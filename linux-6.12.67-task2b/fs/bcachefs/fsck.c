@@ -19,6 +19,7 @@
 #include "xattr.h"
 
 #include <linux/bsearch.h>
+#include <linux/cpumask.h>
 #include <linux/dcache.h> /* struct qstr */
 
 static bool inode_points_to_dirent(struct bch_inode_unpacked *inode,
@@ -2021,11 +2022,123 @@ fsck_err:
 }
 
 /*
- * Walk extents: verify that extents have a corresponding S_ISREG inode, and
- * that i_size an i_sectors are consistent
+ * Passes that check keys against the inode they belong to, with state that
+ * never outlives one inode, are run over inode number ranges in parallel:
+ * workers, one per cpu up to FSCK_MAX_WORKERS, each with their own btree_trans,
+ * take ranges from a shared counter. Checks that span inodes - link counts,
+ * directory structure - are separate passes that run afterwards.
+ *
+ * When we have to ask the user about each error, the pass is run by one thread
+ * so that questions come in key order.
  */
-int bch2_check_extents(struct bch_fs *c)
+#define FSCK_MAX_WORKERS		16U
+#define FSCK_RANGES_PER_WORKER		4U
+#define FSCK_MIN_INODES_PER_RANGE	1024U
+
+typedef int (*fsck_range_fn)(struct btree_trans *, u64, u64);
+
+struct fsck_ranges {
+	fsck_range_fn		fn;
+	u64			start;
+	u64			step;
+	unsigned		nr;
+	atomic_t		next;
+	atomic_t		ret;
+};
+
+struct fsck_range_worker {
+	struct closure		cl;
+	struct bch_fs		*c;
+	struct fsck_ranges	*r;
+};
+
+static CLOSURE_CALLBACK(fsck_range_worker_fn)
 {
+	closure_type(w, struct fsck_range_worker, cl);
+	struct fsck_ranges *r = w->r;
+	struct btree_trans *trans = bch2_trans_get(w->c);
+	unsigned i;
+
+	while (!atomic_read(&r->ret) &&
+	       (i = atomic_inc_return(&r->next) - 1) < r->nr) {
+		u64 start	= i ? r->start + r->step * i : BCACHEFS_ROOT_INO;
+		u64 end		= i + 1 < r->nr ? r->start + r->step * (i + 1) - 1 : U64_MAX;
+		int ret		= r->fn(trans, start, end);
+
+		if (ret)
+			atomic_cmpxchg(&r->ret, 0, ret);
+	}
+
+	bch2_trans_put(trans);
+	closure_return(cl);
+}
+
+/* Inode numbers of the first and the last key in @btree: */
+static int fsck_btree_inum_range(struct btree_trans *trans, enum btree_id btree,
+				 u64 *min, u64 *max)
+{
+	struct btree_iter iter;
+	struct bkey_s_c k;
+	int ret;
+
+	bch2_trans_iter_init(trans, &iter, btree, POS(BCACHEFS_ROOT_INO, 0),
+			     BTREE_ITER_all_snapshots);
+	k = bch2_btree_iter_peek(&iter);
+	ret = bkey_err(k);
+	if (ret || !k.k)
+		goto err;
+	*min = k.k->p.inode;
+
+	bch2_btree_iter_set_pos(&iter, SPOS_MAX);
+	k = bch2_btree_iter_peek_prev(&iter);
+	ret = bkey_err(k);
+	if (!ret && k.k)
+		*max = k.k->p.inode;
+err:
+	bch2_trans_iter_exit(trans, &iter);
+	return ret;
+}
+
+static int fsck_run_ranges(struct bch_fs *c, enum btree_id btree, fsck_range_fn fn)
+{
+	struct fsck_range_worker workers[FSCK_MAX_WORKERS];
+	struct fsck_ranges r = { .fn = fn };
+	unsigned nr_workers = min(num_online_cpus(), FSCK_MAX_WORKERS);
+	u64 min = 0, max = 0;
+	struct closure cl;
+
+	if (nr_workers < 2 || c->opts.fix_errors == FSCK_FIX_ask)
+		goto serial;
+
+	int ret = bch2_trans_run(c,
+		lockrestart_do(trans, fsck_btree_inum_range(trans, btree, &min, &max)));
+	if (ret)
+		return ret;
+
+	r.start = min;
+	r.nr	= min_t(u64, nr_workers * FSCK_RANGES_PER_WORKER,
+			div_u64(max - min, FSCK_MIN_INODES_PER_RANGE));
+	if (r.nr < 2)
+		goto serial;
+	r.step	= div_u64(max - min, r.nr) + 1;
+
+	closure_init_stack(&cl);
+
+	for (unsigned i = 0; i < nr_workers; i++) {
+		workers[i].c = c;
+		workers[i].r = &r;
+		closure_call(&workers[i].cl, fsck_range_worker_fn, system_unbound_wq, &cl);
+	}
+	closure_sync(&cl);
+
+	return atomic_read(&r.ret);
+serial:
+	return bch2_trans_run(c, fn(trans, BCACHEFS_ROOT_INO, U64_MAX));
+}
+
+static int check_extents_range(struct btree_trans *trans, u64 start, u64 end)
+{
+	struct bch_fs *c = trans->c;
 	struct inode_walker w = inode_walker_init();
 	struct snapshots_seen s;
 	struct extent_ends extent_ends;
@@ -2034,20 +2147,29 @@ int bch2_check_extents(struct bch_fs *c)
 	snapshots_seen_init(&s);
 	extent_ends_init(&extent_ends);
 
-	int ret = bch2_trans_run(c,
-		for_each_btree_key(trans, iter, BTREE_ID_extents,
-				POS(BCACHEFS_ROOT_INO, 0),
+	int ret = for_each_btree_key_upto(trans, iter, BTREE_ID_extents,
+				POS(start, 0), SPOS(end, U64_MAX, U32_MAX),
 				BTREE_ITER_prefetch|BTREE_ITER_all_snapshots, k, ({
 			bch2_disk_reservation_put(c, &res);
 			check_extent(trans, &iter, k, &w, &s, &extent_ends, &res) ?:
 			check_extent_overbig(trans, &iter, k);
 		})) ?:
-		check_i_sectors_notnested(trans, &w));
+		check_i_sectors_notnested(trans, &w);
 
 	bch2_disk_reservation_put(c, &res);
 	extent_ends_exit(&extent_ends);
 	inode_walker_exit(&w);
 	snapshots_seen_exit(&s);
+	return ret;
+}
+
+/*
+ * Walk extents: verify that extents have a corresponding S_ISREG inode, and
+ * that i_size an i_sectors are consistent
+ */
+int bch2_check_extents(struct bch_fs *c)
+{
+	int ret = fsck_run_ranges(c, BTREE_ID_extents, check_extents_range);
 
 	bch_err_fn(c, ret);
 	return ret;
@@ -2540,7 +2662,7 @@ fsck_err:
  * Walk dirents: verify that they all have a corresponding S_ISDIR inode,
  * validate d_type
  */
-int bch2_check_dirents(struct bch_fs *c)
+static int check_dirents_range(struct btree_trans *trans, u64 start, u64 end)
 {
 	struct inode_walker dir = inode_walker_init();
 	struct inode_walker target = inode_walker_init();
@@ -2549,16 +2671,22 @@ int bch2_check_dirents(struct bch_fs *c)
 
 	snapshots_seen_init(&s);
 
-	int ret = bch2_trans_run(c,
-		for_each_btree_key(trans, iter, BTREE_ID_dirents,
-				POS(BCACHEFS_ROOT_INO, 0),
+	int ret = for_each_btree_key_upto(trans, iter, BTREE_ID_dirents,
+				POS(start, 0), SPOS(end, U64_MAX, U32_MAX),
 				BTREE_ITER_prefetch|BTREE_ITER_all_snapshots, k,
 			check_dirent(trans, &iter, k, &hash_info, &dir, &target, &s)) ?:
-		check_subdir_count_notnested(trans, &dir));
+		check_subdir_count_notnested(trans, &dir);
 
 	snapshots_seen_exit(&s);
 	inode_walker_exit(&dir);
 	inode_walker_exit(&target);
+	return ret;
+}
+
+int bch2_check_dirents(struct bch_fs *c)
+{
+	int ret = fsck_run_ranges(c, BTREE_ID_dirents, check_dirents_range);
+
 	bch_err_fn(c, ret);
 	return ret;
 }
@@ -2602,22 +2730,27 @@ static int check_xattr(struct btree_trans *trans, struct btree_iter *iter,
 /*
  * Walk xattrs: verify that they all have a corresponding inode
  */
-int bch2_check_xattrs(struct bch_fs *c)
+static int check_xattrs_range(struct btree_trans *trans, u64 start, u64 end)
 {
 	struct inode_walker inode = inode_walker_init();
 	struct bch_hash_info hash_info;
-	int ret = 0;
 
-	ret = bch2_trans_run(c,
-		for_each_btree_key_commit(trans, iter, BTREE_ID_xattrs,
-			POS(BCACHEFS_ROOT_INO, 0),
+	int ret = for_each_btree_key_upto_commit(trans, iter, BTREE_ID_xattrs,
+			POS(start, 0), SPOS(end, U64_MAX, U32_MAX),
 			BTREE_ITER_prefetch|BTREE_ITER_all_snapshots,
 			k,
 			NULL, NULL,
 			BCH_TRANS_COMMIT_no_enospc,
-		check_xattr(trans, &iter, k, &hash_info, &inode)));
+		check_xattr(trans, &iter, k, &hash_info, &inode));
 
 	inode_walker_exit(&inode);
+	return ret;
+}
+
+int bch2_check_xattrs(struct bch_fs *c)
+{
+	int ret = fsck_run_ranges(c, BTREE_ID_xattrs, check_xattrs_range);
+
 	bch_err_fn(c, ret);
 	return ret;
 }
@@ -1096,9 +1096,6 @@ get_bio:
 			bch2_rbio_error(rbio, READ_RETRY_AVOID, BLK_STS_IOERR);
 			goto out;
 		}
-
-		if (likely(!(flags & BCH_READ_IN_RETRY)))
-			bio_endio(&rbio->bio);
 	}
 out:
 	if (likely(!(flags & BCH_READ_IN_RETRY))) {
@@ -135,6 +135,8 @@ static inline void bch2_read(struct bch_fs *c, struct bch_read_bio *rbio,
 	rbio->start_time = local_clock();
 	rbio->subvol = inum.subvol;
 
+	bch2_foreground_io(c);
+
 	__bch2_read(c, rbio, rbio->bio.bi_iter, inum, &failed,
 		    BCH_READ_RETRY_IF_STALE|
 		    BCH_READ_MAY_PROMOTE|
@@ -831,7 +831,8 @@ static enum prep_encoded_ret {
 	if (op->crc.uncompressed_size == op->crc.live_size &&
 	    op->crc.uncompressed_size <= c->opts.encoded_extent_max >> 9 &&
 	    op->crc.compressed_size <= wp->sectors_free &&
-	    (op->crc.compression_type == bch2_compression_opt_to_type(op->compression_opt) ||
+	    (bch2_compression_type_matches(op->crc.compression_type,
+				bch2_compression_opt_to_type(op->compression_opt)) ||
 	     op->incompressible)) {
 		if (!crc_is_compressed(op->crc) &&
 		    op->csum_type != op->crc.csum_type &&
@@ -1616,6 +1617,9 @@ CLOSURE_CALLBACK(bch2_write)
 		goto err;
 	}
 
+	if (!(op->flags & BCH_WRITE_MOVE))
+		bch2_foreground_io(c);
+
 	this_cpu_add(c->counters[BCH_COUNTER_io_write], bio_sectors(bio));
 	bch2_increment_clock(c, bio_sectors(bio), WRITE);
 
@@ -225,6 +225,139 @@ void bch2_journal_buf_put_final(struct journal *j, u64 seq)
  * We don't close a journal_buf until the next journal_buf is finished writing,
  * and can be opened again - this also initializes the next journal_buf:
  */
+/* per cpu reservation blocks: */
+
+/*
+ * Take the reservation block away from @p, and fill whatever wasn't used of it
+ * with empty entries, as bch2_journal_res_put() does for unused reservations:
+ */
+static union journal_res_pcpu_state journal_res_pcpu_retire(struct journal *j,
+							    struct journal_res_pcpu *p)
+{
+	union journal_res_pcpu_state old, new;
+
+	old.v = atomic64_read(&p->state.counter);
+	do {
+		new.v	= 0;
+		new.gen	= old.gen;
+	} while (!atomic64_try_cmpxchg(&p->state.counter, &old.v, new.v));
+
+	if (old.valid) {
+		struct jset *jset = j->buf[old.idx].data;
+
+		for (unsigned i = old.offset; i < old.end; i++)
+			journal_entry_init(vstruct_idx(jset, i),
+					   BCH_JSET_ENTRY_btree_keys, 0, 0, 0);
+	}
+
+	return old;
+}
+
+/*
+ * Closing buffer @idx: retire the blocks of all cpus and drop the bias from
+ * their counts. Each cpu that still has reservations outstanding holds a ref on
+ * j->res_pcpu_refs[idx], the caller holds the initial one:
+ */
+static void journal_res_pcpu_close(struct journal *j, unsigned idx)
+{
+	int cpu;
+
+	lockdep_assert_held(&j->lock);
+
+	atomic_set(&j->res_pcpu_refs[idx], 1);
+
+	for_each_possible_cpu(cpu) {
+		struct journal_res_pcpu *p = per_cpu_ptr(j->res_pcpu, cpu);
+		union journal_res_pcpu_state old = journal_res_pcpu_retire(j, p);
+
+		EBUG_ON(old.valid && old.idx != idx);
+
+		/* counts are only armed under j->lock: */
+		if (atomic_read(&p->count[idx]) < JOURNAL_RES_PCPU_BIAS)
+			continue;
+
+		atomic_inc(&j->res_pcpu_refs[idx]);
+		if (!atomic_sub_return(JOURNAL_RES_PCPU_BIAS, &p->count[idx]))
+			atomic_dec(&j->res_pcpu_refs[idx]);
+	}
+}
+
+/*
+ * The reservation block of this cpu is exhausted: claim a new one from the
+ * current journal entry - sized so that all cpus together take at most half of
+ * what's left - and carve @res from it. Returns 0 if the caller should fall
+ * back to the shared fast path.
+ */
+int bch2_journal_res_get_pcpu_refill(struct journal *j, struct journal_res *res,
+				     unsigned flags)
+{
+	union journal_res_state old, new;
+	union journal_res_pcpu_state s, prev;
+	struct journal_res_pcpu *p;
+	unsigned cpu, u64s;
+	int ret = 0;
+
+	old.v = atomic64_read(&j->reservations.counter);
+	if (old.cur_entry_offset >= j->cur_entry_u64s ||
+	    (j->cur_entry_u64s - old.cur_entry_offset) / (2 * num_online_cpus()) <
+	    JOURNAL_RES_PCPU_RES_MAX)
+		return 0;
+
+	spin_lock(&j->lock);
+	/* Someone else on this cpu may have just refilled it: */
+	if (journal_res_get_pcpu(j, res, flags)) {
+		ret = 1;
+		goto unlock;
+	}
+
+	old.v = atomic64_read(&j->reservations.counter);
+	do {
+		new.v = old.v;
+
+		if ((flags & BCH_WATERMARK_MASK) < j->watermark ||
+		    old.cur_entry_offset >= j->cur_entry_u64s)
+			goto unlock;
+
+		u64s = min_t(unsigned, JOURNAL_RES_PCPU_U64S_MAX,
+			   (j->cur_entry_u64s - old.cur_entry_offset) /
+			   (2 * num_online_cpus()));
+		if (u64s < JOURNAL_RES_PCPU_RES_MAX)
+			goto unlock;
+
+		new.cur_entry_offset += u64s;
+	} while (!atomic64_try_cmpxchg(&j->reservations.counter,
+				       &old.v, new.v));
+
+	cpu	= raw_smp_processor_id();
+	p	= per_cpu_ptr(j->res_pcpu, cpu);
+	prev	= journal_res_pcpu_retire(j, p);
+
+	EBUG_ON(prev.valid && prev.idx != old.idx);
+
+	/* First block from this buffer on this cpu: arm the count */
+	atomic_cmpxchg(&p->count[old.idx], 0, JOURNAL_RES_PCPU_BIAS);
+	atomic_inc(&p->count[old.idx]);
+
+	s.v		= 0;
+	s.offset	= old.cur_entry_offset + res->u64s;
+	s.end		= old.cur_entry_offset + u64s;
+	s.idx		= old.idx;
+	s.valid		= true;
+	s.gen		= prev.gen + 1;
+	atomic64_set(&p->state.counter, s.v);
+
+	res->ref	= true;
+	res->pcpu	= true;
+	res->cpu	= cpu;
+	res->idx	= old.idx;
+	res->offset	= old.cur_entry_offset;
+	res->seq	= le64_to_cpu(j->buf[old.idx].data->seq);
+	ret = 1;
+unlock:
+	spin_unlock(&j->lock);
+	return ret;
+}
+
 static void __journal_entry_close(struct journal *j, unsigned closed_val, bool trace)
 {
 	struct bch_fs *c = container_of(j, struct bch_fs, journal);
@@ -251,6 +384,8 @@ static void __journal_entry_close(struct journal *j, unsigned closed_val, bool t
 	if (!__journal_entry_is_open(old))
 		return;
 
+	journal_res_pcpu_close(j, old.idx);
+
 	/* Close out old buffer: */
 	buf->data->u64s		= cpu_to_le32(old.cur_entry_offset);
 
@@ -298,7 +433,9 @@ static void __journal_entry_close(struct journal *j, unsigned closed_val, bool t
 
 	bch2_journal_space_available(j);
 
-	__bch2_journal_buf_put(j, old.idx, le64_to_cpu(buf->data->seq));
+	/* Outstanding per cpu reservations now hold the journal's ref: */
+	if (atomic_dec_and_test(&j->res_pcpu_refs[old.idx]))
+		__bch2_journal_buf_put(j, old.idx, le64_to_cpu(buf->data->seq));
 }
 
 void bch2_journal_halt(struct journal *j)
@@ -1376,6 +1513,7 @@ void bch2_fs_journal_exit(struct journal *j)
 	for (unsigned i = 0; i < ARRAY_SIZE(j->buf); i++)
 		kvfree(j->buf[i].data);
 	free_fifo(&j->pin);
+	free_percpu(j->res_pcpu);
 }
 
 int bch2_fs_journal_init(struct journal *j)
@@ -1401,6 +1539,10 @@ int bch2_fs_journal_init(struct journal *j)
 	if (!(init_fifo(&j->pin, JOURNAL_PIN, GFP_KERNEL)))
 		return -BCH_ERR_ENOMEM_journal_pin_fifo;
 
+	j->res_pcpu = alloc_percpu(struct journal_res_pcpu);
+	if (!j->res_pcpu)
+		return -BCH_ERR_ENOMEM_journal_res_pcpu;
+
 	for (unsigned i = 0; i < ARRAY_SIZE(j->buf); i++) {
 		j->buf[i].buf_size = JOURNAL_ENTRY_SIZE_MIN;
 		j->buf[i].data = kvmalloc(j->buf[i].buf_size, GFP_KERNEL);
@@ -288,6 +288,19 @@ static inline void bch2_journal_buf_put(struct journal *j, unsigned idx, u64 seq
 	}
 }
 
+/*
+ * Reservations carved from a per cpu block are counted on the cpu they were
+ * carved on; once a buffer has been closed, the last put on each cpu drops that
+ * cpu from j->res_pcpu_refs:
+ */
+static inline void journal_res_pcpu_put(struct journal *j, unsigned cpu,
+					unsigned idx, u64 seq)
+{
+	if (!atomic_dec_return(&per_cpu_ptr(j->res_pcpu, cpu)->count[idx]) &&
+	    atomic_dec_and_test(&j->res_pcpu_refs[idx]))
+		bch2_journal_buf_put(j, idx, seq);
+}
+
 /*
  * This function releases the journal write structure so other threads can
  * then proceed to add their keys as well.
@@ -305,13 +318,19 @@ static inline void bch2_journal_res_put(struct journal *j,
 				       BCH_JSET_ENTRY_btree_keys,
 				       0, 0, 0);
 
-	bch2_journal_buf_put(j, res->idx, res->seq);
+	if (res->pcpu)
+		journal_res_pcpu_put(j, res->cpu, res->idx, res->seq);
+	else
+		bch2_journal_buf_put(j, res->idx, res->seq);
 
 	res->ref = 0;
+	res->pcpu = false;
 }
 
 int bch2_journal_res_get_slowpath(struct journal *, struct journal_res *,
 				  unsigned);
+int bch2_journal_res_get_pcpu_refill(struct journal *, struct journal_res *,
+				     unsigned);
 
 /* First bits for BCH_WATERMARK: */
 enum journal_res_flags {
@@ -366,6 +385,54 @@ static inline int journal_res_get_fast(struct journal *j,
 	return 1;
 }
 
+/* Reservations up to this size are carved from per cpu blocks: */
+#define JOURNAL_RES_PCPU_U64S_MAX	512
+#define JOURNAL_RES_PCPU_RES_MAX	(JOURNAL_RES_PCPU_U64S_MAX / 4)
+
+static inline int journal_res_get_pcpu(struct journal *j,
+				       struct journal_res *res,
+				       unsigned flags)
+{
+	unsigned cpu = raw_smp_processor_id();
+	struct journal_res_pcpu *p = per_cpu_ptr(j->res_pcpu, cpu);
+	union journal_res_pcpu_state old, new;
+	u64 seq;
+
+	if ((flags & BCH_WATERMARK_MASK) < j->watermark)
+		return 0;
+
+	old.v = atomic64_read(&p->state.counter);
+	while (1) {
+		if (!old.valid || old.end - old.offset < res->u64s)
+			return 0;
+
+		/*
+		 * Take our ref before claiming the space, so that closing the
+		 * buffer sees it; a zero count means the block is stale:
+		 */
+		if (!atomic_inc_not_zero(&p->count[old.idx]))
+			return 0;
+
+		seq = le64_to_cpu(j->buf[old.idx].data->seq);
+
+		new.v = old.v;
+		new.offset += res->u64s;
+
+		if (atomic64_try_cmpxchg(&p->state.counter, &old.v, new.v))
+			break;
+
+		journal_res_pcpu_put(j, cpu, new.idx, seq);
+	}
+
+	res->ref	= true;
+	res->pcpu	= true;
+	res->cpu	= cpu;
+	res->idx	= old.idx;
+	res->offset	= old.offset;
+	res->seq	= seq;
+	return 1;
+}
+
 static inline int bch2_journal_res_get(struct journal *j, struct journal_res *res,
 				       unsigned u64s, unsigned flags)
 {
@@ -376,6 +443,12 @@ static inline int bch2_journal_res_get(struct journal *j, struct journal_res *re
 
 	res->u64s = u64s;
 
+	if (!(flags & JOURNAL_RES_GET_CHECK) &&
+	    u64s <= JOURNAL_RES_PCPU_RES_MAX &&
+	    (journal_res_get_pcpu(j, res, flags) ||
+	     bch2_journal_res_get_pcpu_refill(j, res, flags)))
+		goto out;
+
 	if (journal_res_get_fast(j, res, flags))
 		goto out;
 
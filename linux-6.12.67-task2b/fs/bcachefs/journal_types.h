@@ -80,6 +80,9 @@ struct journal_res {
 	u16			u64s;
 	u32			offset;
 	u64			seq;
+	/* carved from the per cpu reservation block of @cpu: */
+	bool			pcpu;
+	u32			cpu;
 };
 
 union journal_res_state {
@@ -102,6 +105,42 @@ union journal_res_state {
 	};
 };
 
+/*
+ * Per cpu reservation block: a range of the current journal entry claimed from
+ * j->reservations in one go, that small reservations are then carved out of
+ * without touching the shared counter. @gen protects against ABA when a new
+ * block gets installed.
+ */
+union journal_res_pcpu_state {
+	struct {
+		atomic64_t	counter;
+	};
+
+	struct {
+		u64		v;
+	};
+
+	struct {
+		u64		offset:20,
+				end:20,
+				idx:2,
+				valid:1,
+				gen:21;
+	};
+};
+
+#define JOURNAL_RES_PCPU_BIAS		(1U << 30)
+
+struct journal_res_pcpu {
+	union journal_res_pcpu_state	state;
+	/*
+	 * Outstanding reservations carved on this cpu, per journal buffer, plus
+	 * JOURNAL_RES_PCPU_BIAS while the buffer is open and this cpu has had a
+	 * block from it:
+	 */
+	atomic_t			count[JOURNAL_BUF_NR];
+};
+
 /* bytes: */
 #define JOURNAL_ENTRY_SIZE_MIN		(64U << 10) /* 64k */
 #define JOURNAL_ENTRY_SIZE_MAX		(4U  << 20) /* 4M */
@@ -175,9 +214,17 @@ struct journal {
 
 	union journal_res_state reservations;
 	enum bch_watermark	watermark;
+	struct journal_res_pcpu __percpu *res_pcpu;
 
 	} __aligned(SMP_CACHE_BYTES);
 
+	/*
+	 * Cpus that still have reservations outstanding against a closed
+	 * buffer, + 1 while the buffer is being closed; the last one drops the
+	 * buffer ref the journal holds on an open entry:
+	 */
+	atomic_t		res_pcpu_refs[JOURNAL_BUF_NR];
+
 	unsigned long		flags;
 
 	/* Max size of current journal entry */
@@ -454,6 +454,61 @@ int bch2_move_get_io_opts_one(struct btree_trans *trans,
 	return 0;
 }
 
+/*
+ * Background moves yield to foreground IO: while there has been foreground IO
+ * in the last MOVE_THROTTLE_FG_WINDOW and one of the devices is congested (its
+ * latency is well over what it's capable of, see bch2_congested_acct()), the in
+ * flight limits are halved on every move, down to 1 >> MOVE_THROTTLE_MAX_SHIFT.
+ * Otherwise they're doubled again every MOVE_THROTTLE_RAMP, back up to the
+ * move_bytes_in_flight/move_ios_in_flight options.
+ */
+#define MOVE_THROTTLE_MAX_SHIFT		4
+#define MOVE_THROTTLE_FG_WINDOW		msecs_to_jiffies(100)
+#define MOVE_THROTTLE_RAMP		msecs_to_jiffies(10)
+
+static bool move_devs_congested(struct bch_fs *c)
+{
+	u64 now = local_clock(), last;
+	s64 congested, max = 0;
+	unsigned d;
+
+	rcu_read_lock();
+	for_each_set_bit(d, c->rw_devs[BCH_DATA_user].d, BCH_SB_MEMBERS_MAX) {
+		struct bch_dev *ca = rcu_dereference(c->devs[d]);
+		if (!ca)
+			continue;
+
+		congested = atomic_read(&ca->congested);
+		last = READ_ONCE(ca->congested_last);
+		if (time_after64(now, last))
+			congested -= (now - last) >> 12;
+		max = max(max, congested);
+	}
+	rcu_read_unlock();
+
+	return max > CONGESTED_MAX / 8;
+}
+
+static void move_throttle_update(struct moving_context *ctxt)
+{
+	struct bch_fs *c = ctxt->trans->c;
+	unsigned long now = jiffies;
+
+	if (!ctxt->throttle)
+		return;
+
+	if (time_before(now, READ_ONCE(c->foreground_io_time) + MOVE_THROTTLE_FG_WINDOW) &&
+	    move_devs_congested(c)) {
+		if (ctxt->throttle_shift < MOVE_THROTTLE_MAX_SHIFT)
+			ctxt->throttle_shift++;
+		ctxt->throttle_time = now;
+	} else if (ctxt->throttle_shift &&
+		   time_after_eq(now, ctxt->throttle_time + MOVE_THROTTLE_RAMP)) {
+		ctxt->throttle_shift--;
+		ctxt->throttle_time = now;
+	}
+}
+
 int bch2_move_ratelimit(struct moving_context *ctxt)
 {
 	struct bch_fs *c = ctxt->trans->c;
@@ -485,15 +540,20 @@ int bch2_move_ratelimit(struct moving_context *ctxt)
 		}
 	} while (delay);
 
+	move_throttle_update(ctxt);
+
 	/*
 	 * XXX: these limits really ought to be per device, SSDs and hard drives
 	 * will want different limits
 	 */
+	unsigned max_sectors	= max(c->opts.move_bytes_in_flight >> 9 >> ctxt->throttle_shift, 1U);
+	unsigned max_ios	= max(c->opts.move_ios_in_flight >> ctxt->throttle_shift, 1U);
+
 	move_ctxt_wait_event(ctxt,
-		atomic_read(&ctxt->write_sectors) < c->opts.move_bytes_in_flight >> 9 &&
-		atomic_read(&ctxt->read_sectors) < c->opts.move_bytes_in_flight >> 9 &&
-		atomic_read(&ctxt->write_ios) < c->opts.move_ios_in_flight &&
-		atomic_read(&ctxt->read_ios) < c->opts.move_ios_in_flight);
+		atomic_read(&ctxt->write_sectors) < max_sectors &&
+		atomic_read(&ctxt->read_sectors) < max_sectors &&
+		atomic_read(&ctxt->write_ios) < max_ios &&
+		atomic_read(&ctxt->read_ios) < max_ios);
 
 	return 0;
 }
@@ -1154,6 +1214,10 @@ static void bch2_moving_ctxt_to_text(struct printbuf *out, struct bch_fs *c, str
 		   atomic_read(&ctxt->write_sectors),
 		   c->opts.move_bytes_in_flight >> 9);
 
+	if (ctxt->throttle)
+		prt_printf(out, "throttled to foreground io: 1/%u\n",
+			   1U << ctxt->throttle_shift);
+
 	printbuf_indent_add(out, 2);
 
 	mutex_lock(&ctxt->lock);
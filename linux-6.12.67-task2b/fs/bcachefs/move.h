@@ -22,6 +22,14 @@ struct moving_context {
 	bool			wait_on_copygc;
 	bool			write_error;
 
+	/*
+	 * Throttle to foreground IO, see move_throttle_update(): in flight
+	 * limits are shifted right by throttle_shift
+	 */
+	bool			throttle;
+	u8			throttle_shift;
+	unsigned long		throttle_time;
+
 	/* For waiting on outstanding reads and writes: */
 	struct closure		cl;
 
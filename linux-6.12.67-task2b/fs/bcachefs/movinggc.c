@@ -377,6 +377,14 @@ static int bch2_copygc_thread(void *arg)
 
 		c->copygc_wait = 0;
 
+		/*
+		 * Yield to foreground IO unless we're already over the
+		 * fragmentation limit - then allocations may be waiting on us:
+		 */
+		ctxt.throttle = wait != 0;
+		if (!ctxt.throttle)
+			ctxt.throttle_shift = 0;
+
 		c->copygc_running = true;
 		ret = bch2_copygc(&ctxt, buckets, &did_work);
 		c->copygc_running = false;
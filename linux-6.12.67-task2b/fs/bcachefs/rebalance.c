@@ -397,6 +397,7 @@ static int bch2_rebalance_thread(void *arg)
 	bch2_moving_ctxt_init(&ctxt, c, NULL, &r->work_stats,
 			      writepoint_ptr(&c->rebalance_write_point),
 			      true);
+	ctxt.throttle = true;
 
 	while (!kthread_should_stop() && !do_rebalance(&ctxt))
 		;
@@ -29,6 +29,7 @@
 #include "snapshot.h"
 #include "super-io.h"
 
+#include <linux/cpumask.h>
 #include <linux/sort.h>
 #include <linux/stat.h>
 
@@ -247,10 +248,183 @@ static int journal_sort_seq_cmp(const void *_l, const void *_r)
 	return cmp_int(l->journal_seq - 1, r->journal_seq - 1);
 }
 
+/*
+ * The first pass of journal replay runs in parallel: the sorted keys are cut
+ * into runs that never span two btrees, so runs of different btrees are
+ * independent and runs within a btree cover disjoint key ranges. Leaf keys go
+ * first and interior node keys last, as in sorted order, and all interior
+ * keys of a btree form a single run so that they are replayed in order:
+ */
+#define JOURNAL_REPLAY_RUN_MIN		4096
+#define JOURNAL_REPLAY_MAX_WORKERS	16U
+
+typedef DARRAY(struct journal_key *) journal_key_ptrs;
+
+struct journal_replay_run {
+	size_t			start;
+	size_t			end;
+};
+
+struct journal_replay_runs {
+	struct journal_key	*keys;
+	DARRAY(struct journal_replay_run) runs;
+	atomic_long_t		next;
+};
+
+struct journal_replay_worker {
+	struct closure		cl;
+	struct bch_fs		*c;
+	struct journal_replay_runs *runs;
+	journal_key_ptrs	failed;
+	bool			immediate_flush;
+	int			ret;
+};
+
+static int journal_replay_run(struct btree_trans *trans,
+			      struct journal_replay_worker *w,
+			      struct journal_key *k,
+			      struct journal_key *end)
+{
+	struct bch_fs *c = trans->c;
+	int ret;
+
+	for (; k < end; k++) {
+		cond_resched();
+
+		/*
+		 * k->allocated means the key wasn't read in from the journal,
+		 * rather it was from early repair code
+		 */
+		if (k->allocated)
+			w->immediate_flush = true;
+
+		/* Skip fastpath if we're low on space in the journal */
+		ret = c->journal.watermark ? -1 :
+			commit_do(trans, NULL, NULL,
+				  BCH_TRANS_COMMIT_no_enospc|
+				  BCH_TRANS_COMMIT_journal_reclaim|
+				  BCH_TRANS_COMMIT_skip_accounting_apply|
+				  (!k->allocated ? BCH_TRANS_COMMIT_no_journal_res : 0),
+			     bch2_journal_replay_key(trans, k));
+		BUG_ON(!ret && !k->overwritten && k->k->k.type != KEY_TYPE_accounting);
+		if (ret) {
+			ret = darray_push(&w->failed, k);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+static CLOSURE_CALLBACK(journal_replay_worker_fn)
+{
+	closure_type(w, struct journal_replay_worker, cl);
+	struct journal_replay_runs *r = w->runs;
+	struct btree_trans *trans = bch2_trans_get(w->c);
+	size_t i;
+
+	while (!w->ret &&
+	       (i = atomic_long_inc_return(&r->next) - 1) < r->runs.nr)
+		w->ret = journal_replay_run(trans, w,
+					    r->keys + r->runs.data[i].start,
+					    r->keys + r->runs.data[i].end);
+
+	bch2_trans_put(trans);
+	closure_return(cl);
+}
+
+/* Cut the leaf or the interior keys into runs: */
+static int journal_replay_runs_init(struct journal_replay_runs *r,
+				    struct journal_keys *keys, bool interior,
+				    size_t run_size)
+{
+	struct journal_replay_run *run = NULL;
+	size_t i;
+
+	r->runs.nr = 0;
+	atomic_long_set(&r->next, 0);
+
+	for (i = 0; i < keys->nr; i++) {
+		struct journal_key *k = keys->data + i;
+
+		if (!!k->level != interior) {
+			run = NULL;
+			continue;
+		}
+
+		if (!run ||
+		    k->btree_id != keys->data[run->start].btree_id ||
+		    (!interior && i - run->start >= run_size)) {
+			int ret = darray_push(&r->runs,
+					((struct journal_replay_run) { i, i }));
+			if (ret)
+				return ret;
+			run = &darray_last(r->runs);
+		}
+
+		run->end = i + 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Replay keys in sorted order, with up to one worker per cpu. Keys that
+ * couldn't be replayed here are added to @failed:
+ */
+static int journal_replay_sorted(struct bch_fs *c, journal_key_ptrs *failed,
+				 bool *immediate_flush)
+{
+	struct journal_keys *keys = &c->journal_keys;
+	struct journal_replay_runs r = { .keys = keys->data };
+	struct journal_replay_worker *workers;
+	unsigned nr_workers = min(num_online_cpus(), JOURNAL_REPLAY_MAX_WORKERS);
+	size_t run_size = max_t(size_t, JOURNAL_REPLAY_RUN_MIN,
+				keys->nr / (nr_workers * 8));
+	struct closure cl;
+	int ret = 0;
+
+	workers = kcalloc(nr_workers, sizeof(*workers), GFP_KERNEL);
+	if (!workers)
+		return -ENOMEM;
+
+	closure_init_stack(&cl);
+
+	for (unsigned interior = 0; interior < 2 && !ret; interior++) {
+		ret = journal_replay_runs_init(&r, keys, interior, run_size);
+		if (ret)
+			break;
+
+		unsigned n = min_t(size_t, nr_workers, r.runs.nr);
+		for (unsigned i = 0; i < n; i++) {
+			workers[i].c	= c;
+			workers[i].runs	= &r;
+			closure_call(&workers[i].cl, journal_replay_worker_fn,
+				     system_unbound_wq, &cl);
+		}
+		closure_sync(&cl);
+
+		for (unsigned i = 0; i < n; i++)
+			ret = ret ?: workers[i].ret;
+	}
+
+	for (unsigned i = 0; i < nr_workers; i++) {
+		*immediate_flush |= workers[i].immediate_flush;
+		darray_for_each(workers[i].failed, kp)
+			ret = ret ?: darray_push(failed, *kp);
+		darray_exit(&workers[i].failed);
+	}
+
+	darray_exit(&r.runs);
+	kfree(workers);
+	return ret;
+}
+
 int bch2_journal_replay(struct bch_fs *c)
 {
 	struct journal_keys *keys = &c->journal_keys;
-	DARRAY(struct journal_key *) keys_sorted = { 0 };
+	journal_key_ptrs keys_sorted = { 0 };
 	struct journal *j = &c->journal;
 	u64 start_seq	= c->journal_replay_seq_start;
 	u64 end_seq	= c->journal_replay_seq_start;
@@ -300,33 +474,11 @@ int bch2_journal_replay(struct bch_fs *c)
 	 * efficient - better locality of btree access -  but some might fail if
 	 * that would cause a journal deadlock.
 	 */
-	darray_for_each(*keys, k) {
-		cond_resched();
-
-		/*
-		 * k->allocated means the key wasn't read in from the journal,
-		 * rather it was from early repair code
-		 */
-		if (k->allocated)
-			immediate_flush = true;
-
-		/* Skip fastpath if we're low on space in the journal */
-		ret = c->journal.watermark ? -1 :
-			commit_do(trans, NULL, NULL,
-				  BCH_TRANS_COMMIT_no_enospc|
-				  BCH_TRANS_COMMIT_journal_reclaim|
-				  BCH_TRANS_COMMIT_skip_accounting_apply|
-				  (!k->allocated ? BCH_TRANS_COMMIT_no_journal_res : 0),
-			     bch2_journal_replay_key(trans, k));
-		BUG_ON(!ret && !k->overwritten && k->k->k.type != KEY_TYPE_accounting);
-		if (ret) {
-			ret = darray_push(&keys_sorted, k);
-			if (ret)
-				goto err;
-		}
-	}
-
 	bch2_trans_unlock_long(trans);
+
+	ret = journal_replay_sorted(c, &keys_sorted, &immediate_flush);
+	if (ret)
+		goto err;
 	/*
 	 * Now, replay any remaining keys in the order in which they appear in
 	 * the journal, unpinning those journal entries as we go:
@@ -31,6 +31,7 @@ static void do_six_unlock_type(struct six_lock *lock, enum six_lock_type type);
 #define SIX_LOCK_HELD_intent		(1U << 26)
 #define SIX_LOCK_HELD_write		(1U << 27)
 #define SIX_LOCK_WAITING_read		(1U << (28 + SIX_LOCK_read))
+#define SIX_LOCK_WAITING_intent		(1U << (28 + SIX_LOCK_intent))
 #define SIX_LOCK_WAITING_write		(1U << (28 + SIX_LOCK_write))
 #define SIX_LOCK_NOSPIN			(1U << 31)
 
@@ -347,9 +348,17 @@ static inline bool six_owner_running(struct six_lock *lock)
 	return ret;
 }
 
+/*
+ * Only the first waiter spins - except that readers queued behind nothing but
+ * other readers spin too: they are all granted the lock by the same wakeup,
+ * so sleeping would only add a wakeup per reader. Concurrent btree path
+ * traversals waiting on an interior node that is briefly write locked are
+ * exactly that case.
+ */
 static inline bool six_optimistic_spin(struct six_lock *lock,
 				       struct six_lock_waiter *wait,
-				       enum six_lock_type type)
+				       enum six_lock_type type,
+				       bool behind_readers)
 {
 	unsigned loop = 0;
 	u64 end_time;
@@ -357,7 +366,7 @@ static inline bool six_optimistic_spin(struct six_lock *lock,
 	if (type == SIX_LOCK_write)
 		return false;
 
-	if (lock->wait_list.next != &wait->list)
+	if (lock->wait_list.next != &wait->list && !behind_readers)
 		return false;
 
 	if (atomic_read(&lock->state) & SIX_LOCK_NOSPIN)
@@ -399,7 +408,8 @@ static inline bool six_optimistic_spin(struct six_lock *lock,
 
 static inline bool six_optimistic_spin(struct six_lock *lock,
 				       struct six_lock_waiter *wait,
-				       enum six_lock_type type)
+				       enum six_lock_type type,
+				       bool behind_readers)
 {
 	return false;
 }
@@ -412,6 +422,7 @@ static int six_lock_slowpath(struct six_lock *lock, enum six_lock_type type,
 			     six_lock_should_sleep_fn should_sleep_fn, void *p,
 			     unsigned long ip)
 {
+	bool behind_readers = false;
 	int ret = 0;
 
 	if (type == SIX_LOCK_write) {
@@ -446,6 +457,10 @@ static int six_lock_slowpath(struct six_lock *lock, enum six_lock_type type,
 				wait->start_time = last->start_time + 1;
 		}
 
+		behind_readers = type == SIX_LOCK_read &&
+			!(atomic_read(&lock->state) &
+			  (SIX_LOCK_WAITING_intent|SIX_LOCK_WAITING_write));
+
 		list_add_tail(&wait->list, &lock->wait_list);
 	}
 	raw_spin_unlock(&lock->wait_lock);
@@ -460,7 +475,7 @@ static int six_lock_slowpath(struct six_lock *lock, enum six_lock_type type,
 		ret = 0;
 	}
 
-	if (six_optimistic_spin(lock, wait, type))
+	if (six_optimistic_spin(lock, wait, type, behind_readers))
 		goto out;
 
 	while (1) {
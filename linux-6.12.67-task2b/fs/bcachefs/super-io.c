@@ -2,6 +2,7 @@
 
 #include "bcachefs.h"
 #include "checksum.h"
+#include "compress.h"
 #include "disk_groups.h"
 #include "ec.h"
 #include "error.h"
@@ -1334,6 +1334,7 @@ static struct bch_dev *__bch2_dev_alloc(struct bch_fs *c,
 #endif
 
 	bch2_dev_allocator_background_init(ca);
+	bch2_dev_allocator_foreground_init(ca);
 
 	if (percpu_ref_init(&ca->io_ref, bch2_dev_io_ref_complete,
 			    PERCPU_REF_INIT_DEAD, GFP_KERNEL) ||
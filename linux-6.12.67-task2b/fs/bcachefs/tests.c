@@ -3,6 +3,9 @@
 
 #include "bcachefs.h"
 #include "btree_update.h"
+#include "btree_write_buffer.h"
+#include "compress.h"
+#include "journal.h"
 #include "journal_reclaim.h"
 #include "snapshot.h"
 #include "tests.h"
@@ -528,6 +531,36 @@ static int test_snapshots(struct bch_fs *c, u64 nr)
 
 /* perf tests */
 
+/*
+ * Per operation latencies of the perf test being run, for the percentiles in
+ * the report - perf tests are run one at a time:
+ */
+static struct bch2_time_stats *perf_test_times;
+
+static DEFINE_MUTEX(perf_test_lock);
+
+static inline void perf_op_done(u64 start)
+{
+	bch2_time_stats_update(perf_test_times, start);
+}
+
+/* upper bound of the bucket the @pct_x10 / 1000 quantile falls in: */
+static u64 perf_test_percentile(struct bch2_time_stats_summary *s, unsigned pct_x10)
+{
+	u64 want = div_u64(s->count * pct_x10 + 999, 1000), seen = 0;
+	unsigned i;
+
+	for (i = 0; i < TIME_STATS_HIST_NR; i++) {
+		seen += s->hist[i];
+		if (seen >= want)
+			return i + 1 < TIME_STATS_HIST_NR
+				? min(time_stats_hist_bucket_start(i + 1) - 1, s->max_duration)
+				: s->max_duration;
+	}
+
+	return s->max_duration;
+}
+
 static u64 test_rand(void)
 {
 	u64 v;
@@ -544,6 +577,8 @@ static int rand_insert(struct bch_fs *c, u64 nr)
 	u64 i;
 
 	for (i = 0; i < nr; i++) {
+		u64 start = local_clock();
+
 		bkey_cookie_init(&k.k_i);
 		k.k.p.offset = test_rand();
 		k.k.p.snapshot = U32_MAX;
@@ -552,6 +587,7 @@ static int rand_insert(struct bch_fs *c, u64 nr)
 			bch2_btree_insert_trans(trans, BTREE_ID_xattrs, &k.k_i, 0));
 		if (ret)
 			break;
+		perf_op_done(start);
 	}
 
 	bch2_trans_put(trans);
@@ -567,6 +603,8 @@ static int rand_insert_multi(struct bch_fs *c, u64 nr)
 	u64 i;
 
 	for (i = 0; i < nr; i += ARRAY_SIZE(k)) {
+		u64 start = local_clock();
+
 		for (j = 0; j < ARRAY_SIZE(k); j++) {
 			bkey_cookie_init(&k[j].k_i);
 			k[j].k.p.offset = test_rand();
@@ -584,6 +622,7 @@ static int rand_insert_multi(struct bch_fs *c, u64 nr)
 			bch2_btree_insert_trans(trans, BTREE_ID_xattrs, &k[7].k_i, 0));
 		if (ret)
 			break;
+		perf_op_done(start);
 	}
 
 	bch2_trans_put(trans);
@@ -602,12 +641,15 @@ static int rand_lookup(struct bch_fs *c, u64 nr)
 			     SPOS(0, 0, U32_MAX), 0);
 
 	for (i = 0; i < nr; i++) {
+		u64 start = local_clock();
+
 		bch2_btree_iter_set_pos(&iter, SPOS(0, test_rand(), U32_MAX));
 
 		lockrestart_do(trans, bkey_err(k = bch2_btree_iter_peek(&iter)));
 		ret = bkey_err(k);
 		if (ret)
 			break;
+		perf_op_done(start);
 	}
 
 	bch2_trans_iter_exit(trans, &iter);
@@ -652,11 +694,14 @@ static int rand_mixed(struct bch_fs *c, u64 nr)
 			     SPOS(0, 0, U32_MAX), 0);
 
 	for (i = 0; i < nr; i++) {
+		u64 start = local_clock();
+
 		rand = test_rand();
 		ret = commit_do(trans, NULL, NULL, 0,
 			rand_mixed_trans(trans, &iter, &cookie, i, rand));
 		if (ret)
 			break;
+		perf_op_done(start);
 	}
 
 	bch2_trans_iter_exit(trans, &iter);
@@ -693,12 +738,14 @@ static int rand_delete(struct bch_fs *c, u64 nr)
 	u64 i;
 
 	for (i = 0; i < nr; i++) {
+		u64 start = local_clock();
 		struct bpos pos = SPOS(0, test_rand(), U32_MAX);
 
 		ret = commit_do(trans, NULL, NULL, 0,
 			__do_delete(trans, pos));
 		if (ret)
 			break;
+		perf_op_done(start);
 	}
 
 	bch2_trans_put(trans);
@@ -754,6 +801,143 @@ static int seq_delete(struct bch_fs *c, u64 nr)
 				      0, NULL);
 }
 
+/*
+ * 70% lookups, 20% inserts, 10% deletes, each in its own transaction - run
+ * with several threads for a concurrent mixed workload:
+ */
+static int rand_mixed_rw(struct bch_fs *c, u64 nr)
+{
+	struct btree_trans *trans = bch2_trans_get(c);
+	struct btree_iter iter;
+	struct bkey_i_cookie k;
+	struct bkey_s_c s;
+	int ret = 0;
+	u64 i;
+
+	bch2_trans_iter_init(trans, &iter, BTREE_ID_xattrs,
+			     SPOS(0, 0, U32_MAX), 0);
+
+	for (i = 0; i < nr; i++) {
+		u64 start = local_clock();
+		u64 rand = test_rand();
+		struct bpos pos = SPOS(0, rand, U32_MAX);
+
+		switch ((rand >> 32) % 10) {
+		case 0 ... 6:
+			bch2_btree_iter_set_pos(&iter, pos);
+			ret = lockrestart_do(trans, bkey_err(s = bch2_btree_iter_peek(&iter)));
+			break;
+		case 7 ... 8:
+			bkey_cookie_init(&k.k_i);
+			k.k.p = pos;
+			ret = commit_do(trans, NULL, NULL, 0,
+				bch2_btree_insert_trans(trans, BTREE_ID_xattrs, &k.k_i, 0));
+			break;
+		default:
+			ret = commit_do(trans, NULL, NULL, 0,
+				__do_delete(trans, pos));
+			break;
+		}
+
+		if (ret)
+			break;
+		perf_op_done(start);
+	}
+
+	bch2_trans_iter_exit(trans, &iter);
+	bch2_trans_put(trans);
+	return ret;
+}
+
+/*
+ * Key cache lookups, read only: inode numbers in the test range don't exist,
+ * so this measures the key cache itself. key_cache_hit keeps looking up the same
+ * few keys, key_cache_miss a new one every time (which has to be filled from
+ * the btree):
+ */
+static int key_cache_lookup(struct bch_fs *c, u64 nr, u64 mask)
+{
+	struct btree_trans *trans = bch2_trans_get(c);
+	u64 base = U64_MAX - U32_MAX;
+	int ret = 0;
+	u64 i;
+
+	for (i = 0; i < nr; i++) {
+		u64 start = local_clock();
+		struct btree_iter iter;
+		struct bkey_s_c k;
+
+		ret = lockrestart_do(trans,
+			bkey_err(k = bch2_bkey_get_iter(trans, &iter, BTREE_ID_inodes,
+					SPOS(0, base + (test_rand() & mask), U32_MAX),
+					BTREE_ITER_cached)));
+		bch2_trans_iter_exit(trans, &iter);
+		if (ret)
+			break;
+		perf_op_done(start);
+	}
+
+	bch2_trans_put(trans);
+	return ret;
+}
+
+static int key_cache_hit(struct bch_fs *c, u64 nr)
+{
+	return key_cache_lookup(c, nr, 63);
+}
+
+static int key_cache_miss(struct bch_fs *c, u64 nr)
+{
+	return key_cache_lookup(c, nr, U32_MAX);
+}
+
+/* flushing whatever the filesystem has queued up in the btree write buffer: */
+static int wb_flush(struct bch_fs *c, u64 nr)
+{
+	struct btree_trans *trans = bch2_trans_get(c);
+	int ret = 0;
+	u64 i;
+
+	for (i = 0; i < nr; i++) {
+		u64 start = local_clock();
+
+		ret = bch2_btree_write_buffer_flush_sync(trans);
+		if (ret)
+			break;
+		perf_op_done(start);
+	}
+
+	bch2_trans_put(trans);
+	return ret;
+}
+
+/* journal reservations, with several threads for contention on the journal: */
+static int journal_res(struct bch_fs *c, u64 nr)
+{
+	struct journal *j = &c->journal;
+	int ret = 0;
+	u64 i;
+
+	for (i = 0; i < nr; i++) {
+		u64 start = local_clock();
+		struct journal_res res = {};
+
+		ret = bch2_journal_res_get(j, &res, jset_u64s(BKEY_U64s), 0);
+		if (ret)
+			break;
+		bch2_journal_res_put(j, &res);
+		perf_op_done(start);
+	}
+
+	return ret;
+}
+
+/* zstd dictionaries, see compress.c: */
+static int test_compression_dict(struct bch_fs *c, u64 nr)
+{
+	return bch2_compression_dict_test(c, nr);
+}
+
 typedef int (*perf_test_fn)(struct bch_fs *, u64);
 
 struct test_job {
@@ -803,6 +987,7 @@ int bch2_btree_perf_test(struct bch_fs *c, const char *testname,
 			 u64 nr, unsigned nr_threads)
 {
 	struct test_job j = { .c = c, .nr = nr, .nr_threads = nr_threads };
+	struct bch2_time_stats_summary *s = NULL;
 	char name_buf[20];
 	struct printbuf nr_buf = PRINTBUF;
 	struct printbuf per_sec_buf = PRINTBUF;
@@ -834,6 +1019,12 @@ int bch2_btree_perf_test(struct bch_fs *c, const char *testname,
 	perf_test(seq_overwrite);
 	perf_test(seq_delete);
 
+	perf_test(rand_mixed_rw);
+	perf_test(key_cache_hit);
+	perf_test(key_cache_miss);
+	perf_test(wb_flush);
+	perf_test(journal_res);
+
 	/* a unit test, not a perf test: */
 	perf_test(test_delete);
 	perf_test(test_delete_written);
@@ -852,6 +1043,8 @@ int bch2_btree_perf_test(struct bch_fs *c, const char *testname,
 
 	perf_test(test_snapshots);
 
+	perf_test(test_compression_dict);
+
 	if (!j.fn) {
 		pr_err("unknown test %s", testname);
 		return -EINVAL;
@@ -859,6 +1052,19 @@ int bch2_btree_perf_test(struct bch_fs *c, const char *testname,
 
 	//pr_info("running test %s:", testname);
 
+	s = kmalloc(sizeof(*s), GFP_KERNEL);
+	if (!s)
+		return -ENOMEM;
+
+	mutex_lock(&perf_test_lock);
+	perf_test_times = kmalloc(sizeof(*perf_test_times), GFP_KERNEL);
+	if (!perf_test_times) {
+		mutex_unlock(&perf_test_lock);
+		kfree(s);
+		return -ENOMEM;
+	}
+	bch2_time_stats_init(perf_test_times);
+
 	if (nr_threads == 1)
 		btree_perf_test_thread(&j);
 	else
@@ -879,6 +1085,30 @@ int bch2_btree_perf_test(struct bch_fs *c, const char *testname,
 		div_u64(time, NSEC_PER_SEC),
 		div_u64(time * nr_threads, nr),
 		per_sec_buf.buf);
+
+	/*
+	 * Machine readable, one line per run; latencies are only collected by
+	 * the tests that time individual operations:
+	 */
+	bch2_time_stats_summary(perf_test_times, s);
+	printk(KERN_INFO "bcachefs perf: test=%s nr=%llu threads=%u time_ns=%llu ops=%llu"
+	       " min_ns=%llu mean_ns=%llu p50_ns=%llu p90_ns=%llu p99_ns=%llu p999_ns=%llu max_ns=%llu ret=%i\n",
+	       testname, nr, nr_threads, time, s->count,
+	       s->min_duration,
+	       s->mean_duration,
+	       perf_test_percentile(s, 500),
+	       perf_test_percentile(s, 900),
+	       perf_test_percentile(s, 990),
+	       perf_test_percentile(s, 999),
+	       s->max_duration,
+	       j.ret);
+
+	bch2_time_stats_exit(perf_test_times);
+	kfree(perf_test_times);
+	perf_test_times = NULL;
+	mutex_unlock(&perf_test_lock);
+	kfree(s);
+
 	printbuf_exit(&per_sec_buf);
 	printbuf_exit(&nr_buf);
 	return j.ret;
@@ -4,6 +4,7 @@
 #include <linux/module.h>
 #include <linux/percpu.h>
 #include <linux/preempt.h>
+#include <linux/slab.h>
 #include <linux/time.h>
 #include <linux/spinlock.h>
 
@@ -85,6 +86,12 @@ static inline void time_stats_update_one(struct bch2_time_stats *stats,
 
 		if (quantiles)
 			quantiles_update(quantiles, duration);
+
+		if (unlikely(!stats->hist))
+			stats->hist = kcalloc(TIME_STATS_HIST_NR, sizeof(*stats->hist),
+					      GFP_ATOMIC|__GFP_NOWARN);
+		if (likely(stats->hist))
+			stats->hist[time_stats_hist_idx(duration)]++;
 	}
 
 	if (stats->last_event && time_after64(end, stats->last_event)) {
@@ -151,12 +158,42 @@ void __bch2_time_stats_update(struct bch2_time_stats *stats, u64 start, u64 end)
 	}
 }
 
+void bch2_time_stats_summary(struct bch2_time_stats *stats,
+			     struct bch2_time_stats_summary *out)
+{
+	memset(out, 0, sizeof(*out));
+
+	spin_lock_irq(&stats->lock);
+	if (stats->buffer) {
+		int cpu;
+
+		for_each_possible_cpu(cpu)
+			__bch2_time_stats_clear_buffer(stats, per_cpu_ptr(stats->buffer, cpu));
+	}
+
+	out->count		= stats->duration_stats.n;
+	if (out->count) {
+		out->min_duration	= stats->min_duration;
+		out->max_duration	= stats->max_duration;
+		out->total_duration	= stats->total_duration;
+		out->mean_duration	= mean_and_variance_get_mean(stats->duration_stats);
+		out->stddev_duration	= mean_and_variance_get_stddev(stats->duration_stats);
+	}
+
+	if (stats->hist)
+		memcpy(out->hist, stats->hist, sizeof(out->hist));
+	spin_unlock_irq(&stats->lock);
+}
+
 void bch2_time_stats_reset(struct bch2_time_stats *stats)
 {
 	spin_lock_irq(&stats->lock);
 	unsigned offset = offsetof(struct bch2_time_stats, min_duration);
 	memset((void *) stats + offset, 0, sizeof(*stats) - offset);
 
+	if (stats->hist)
+		memset(stats->hist, 0, TIME_STATS_HIST_NR * sizeof(*stats->hist));
+
 	if (stats->buffer) {
 		int cpu;
 		for_each_possible_cpu(cpu)
@@ -167,6 +204,7 @@ void bch2_time_stats_reset(struct bch2_time_stats *stats)
 
 void bch2_time_stats_exit(struct bch2_time_stats *stats)
 {
+	kfree(stats->hist);
 	free_percpu(stats->buffer);
 }
 
@@ -59,6 +59,38 @@ struct quantiles {
 	}		entries[NR_QUANTILES];
 };
 
+/*
+ * Log bucketed histogram of event durations, HDR style: values below
+ * 2 << TIME_STATS_HIST_SUB_BITS nanoseconds get a bucket each, and every power
+ * of two above is split in 1 << TIME_STATS_HIST_SUB_BITS buckets, so the
+ * relative error is bounded over the whole range. Allocated on the first event.
+ */
+#define TIME_STATS_HIST_SUB_BITS	2
+#define TIME_STATS_HIST_NR		((64 - TIME_STATS_HIST_SUB_BITS + 1) << TIME_STATS_HIST_SUB_BITS)
+
+static inline unsigned time_stats_hist_idx(u64 v)
+{
+	unsigned e;
+
+	if (v < 2U << TIME_STATS_HIST_SUB_BITS)
+		return v;
+
+	e = fls64(v) - 1 - TIME_STATS_HIST_SUB_BITS;
+	return ((e + 1) << TIME_STATS_HIST_SUB_BITS) +
+		((v >> e) & ((1U << TIME_STATS_HIST_SUB_BITS) - 1));
+}
+
+/* smallest duration that goes in bucket @idx: */
+static inline u64 time_stats_hist_bucket_start(unsigned idx)
+{
+	if (idx < 2U << TIME_STATS_HIST_SUB_BITS)
+		return idx;
+
+	return (u64) ((1U << TIME_STATS_HIST_SUB_BITS) |
+		      (idx & ((1U << TIME_STATS_HIST_SUB_BITS) - 1))) <<
+		((idx >> TIME_STATS_HIST_SUB_BITS) - 1);
+}
+
 struct time_stat_buffer {
 	unsigned	nr;
 	struct time_stat_buffer_entry {
@@ -71,6 +103,7 @@ struct bch2_time_stats {
 	spinlock_t	lock;
 	bool		have_quantiles;
 	struct time_stat_buffer __percpu *buffer;
+	u64		*hist;
 	/* all fields are in nanoseconds */
 	u64             min_duration;
 	u64		max_duration;
@@ -142,6 +175,18 @@ static inline bool track_event_change(struct bch2_time_stats *stats, bool v)
 	return false;
 }
 
+struct bch2_time_stats_summary {
+	u64		count;
+	u64		min_duration;
+	u64		max_duration;
+	u64		total_duration;
+	u64		mean_duration;
+	u64		stddev_duration;
+	u64		hist[TIME_STATS_HIST_NR];
+};
+
+void bch2_time_stats_summary(struct bch2_time_stats *, struct bch2_time_stats_summary *);
+
 void bch2_time_stats_reset(struct bch2_time_stats *);
 void bch2_time_stats_exit(struct bch2_time_stats *);
 void bch2_time_stats_init(struct bch2_time_stats *);
@@ -77,7 +77,9 @@ static const struct cachefiles_daemon_cmd cachefiles_daemon_cmds[] = {
 	{ "secctx",	cachefiles_daemon_secctx	},
 	{ "tag",	cachefiles_daemon_tag		},
 #ifdef CONFIG_CACHEFILES_ONDEMAND
+	{ "batch",	cachefiles_ondemand_batch	},
 	{ "copen",	cachefiles_ondemand_copen	},
+	{ "ra",		cachefiles_ondemand_ra		},
 	{ "restore",	cachefiles_ondemand_restore	},
 #endif
 	{ "",		NULL				}
@@ -159,7 +161,7 @@ void cachefiles_flush_reqs(struct cachefiles_cache *cache)
 	xa_lock(xa);
 	xa_for_each(xa, index, req) {
 		req->error = -EIO;
-		complete(&req->done);
+		complete_all(&req->done);
 		__xa_erase(xa, index);
 	}
 	xa_unlock(xa);
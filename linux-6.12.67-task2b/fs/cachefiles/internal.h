@@ -57,6 +57,7 @@ struct cachefiles_ondemand_info {
 	enum cachefiles_object_state	state;
 	struct cachefiles_object	*object;
 	spinlock_t			lock;
+	unsigned long			last_read_id;	/* msg_id of last READ sent (under reqs lock) */
 };
 
 /*
@@ -129,6 +130,8 @@ struct cachefiles_cache {
 	struct xarray			ondemand_ids;	/* xarray for ondemand_id allocation */
 	u32				ondemand_id_next;
 	u32				msg_id_next;
+	size_t				ondemand_ra;	/* min length of on-demand READ requests */
+	unsigned int			ondemand_batch;	/* max requests per daemon read() */
 	u32				secid;		/* LSM security id */
 	bool				have_secid;	/* whether "secid" was set */
 };
@@ -144,6 +147,7 @@ struct cachefiles_req {
 	struct completion done;
 	refcount_t ref;
 	int error;
+	int waiters;		/* senders sharing a coalesced READ (under reqs lock) */
 	struct cachefiles_msg msg;
 };
 
@@ -312,6 +316,11 @@ extern int cachefiles_ondemand_copen(struct cachefiles_cache *cache,
 extern int cachefiles_ondemand_restore(struct cachefiles_cache *cache,
 					char *args);
 
+extern int cachefiles_ondemand_ra(struct cachefiles_cache *cache, char *args);
+
+extern int cachefiles_ondemand_batch(struct cachefiles_cache *cache,
+				     char *args);
+
 extern int cachefiles_ondemand_init_object(struct cachefiles_object *object);
 extern void cachefiles_ondemand_clean_object(struct cachefiles_object *object);
 
@@ -1,8 +1,14 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #include <linux/anon_inodes.h>
+#include <linux/sizes.h>
 #include <linux/uio.h>
 #include "internal.h"
 
+/* upper bound of a READ request grown by coalescing, unless "ra" is larger */
+#define CACHEFILES_ONDEMAND_COALESCE_MAX	SZ_1M
+#define CACHEFILES_ONDEMAND_RA_MAX		SZ_1G
+#define CACHEFILES_ONDEMAND_BATCH_MAX		64
+
 struct ondemand_anon_file {
 	struct file *file;
 	int fd;
@@ -138,7 +144,7 @@ static long cachefiles_ondemand_fd_ioctl(struct file *filp, unsigned int ioctl,
 	xa_unlock(&cache->reqs);
 
 	trace_cachefiles_ondemand_cread(object, id);
-	complete(&req->done);
+	complete_all(&req->done);
 	return 0;
 }
 
@@ -290,6 +296,49 @@ int cachefiles_ondemand_restore(struct cachefiles_cache *cache, char *args)
 	return 0;
 }
 
+/*
+ * Readahead window for READ requests
+ * - command: "ra <size>"
+ *   cache misses shorter than <size> bytes are asked for as <size> bytes
+ *   from the start of the miss, 0 (default) asks for just the miss
+ */
+int cachefiles_ondemand_ra(struct cachefiles_cache *cache, char *args)
+{
+	unsigned long long size;
+	char *end;
+
+	if (!*args)
+		return -EINVAL;
+
+	size = memparse(args, &end);
+	if (*end || size > CACHEFILES_ONDEMAND_RA_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(cache->ondemand_ra, size);
+	return 0;
+}
+
+/*
+ * Batched request delivery
+ * - command: "batch <n>"
+ *   a read() on the device returns up to <n> requests back to back, each
+ *   one starting 8-byte aligned, 1 (default) returns a single request
+ */
+int cachefiles_ondemand_batch(struct cachefiles_cache *cache, char *args)
+{
+	unsigned int n;
+	int ret;
+
+	ret = kstrtouint(args, 0, &n);
+	if (ret)
+		return ret;
+	if (!n || n > CACHEFILES_ONDEMAND_BATCH_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(cache->ondemand_batch, n);
+	return 0;
+}
+
 static int cachefiles_ondemand_get_fd(struct cachefiles_req *req,
 				      struct ondemand_anon_file *anon_file)
 {
@@ -407,12 +456,57 @@ static inline bool cachefiles_ondemand_finish_req(struct cachefiles_req *req,
 		return false;
 
 	req->error = err;
-	complete(&req->done);
+	complete_all(&req->done);
 	return true;
 }
 
-ssize_t cachefiles_ondemand_daemon_read(struct cachefiles_cache *cache,
-					char __user *_buffer, size_t buflen)
+/*
+ * A sender of the request was interrupted. Only fail the request if nobody
+ * else coalesced into it is still waiting for the result.
+ */
+static bool cachefiles_ondemand_abandon_req(struct cachefiles_req *req,
+					    struct xa_state *xas, int err)
+{
+	xas_lock(xas);
+	if (req->waiters > 1) {
+		req->waiters--;
+		xas_unlock(xas);
+		return true;
+	}
+	if (__xa_cmpxchg(xas->xa, xas->xa_index, req, NULL, 0) != req) {
+		xas_unlock(xas);
+		return false;
+	}
+	req->error = err;
+	xas_unlock(xas);
+	complete_all(&req->done);
+	return true;
+}
+
+static int cachefiles_ondemand_wait_req(struct cachefiles_req *req,
+					struct xa_state *xas)
+{
+	int ret;
+
+wait:
+	ret = wait_for_completion_killable(&req->done);
+	if (!ret) {
+		ret = req->error;
+	} else {
+		ret = -EINTR;
+		if (!cachefiles_ondemand_abandon_req(req, xas, ret)) {
+			/* Someone will complete it soon. */
+			cpu_relax();
+			goto wait;
+		}
+	}
+	cachefiles_req_put(req);
+	return ret;
+}
+
+static ssize_t cachefiles_ondemand_daemon_read_one(struct cachefiles_cache *cache,
+						   char __user *_buffer,
+						   size_t buflen)
 {
 	struct cachefiles_req *req;
 	struct cachefiles_msg *msg;
@@ -480,6 +574,30 @@ out:
 	return ret ? ret : n;
 }
 
+ssize_t cachefiles_ondemand_daemon_read(struct cachefiles_cache *cache,
+					char __user *_buffer, size_t buflen)
+{
+	unsigned int batch = max(READ_ONCE(cache->ondemand_batch), 1U);
+	size_t off = 0, done = 0;
+	ssize_t ret;
+
+	do {
+		ret = cachefiles_ondemand_daemon_read_one(cache, _buffer + off,
+							  buflen - off);
+		/*
+		 * The requests already copied out stand, whatever happens to
+		 * the next one; a request that fails is failed to its sender.
+		 */
+		if (ret <= 0)
+			return done ? done : ret;
+
+		done = off + ret;
+		off = ALIGN(done, 8);
+	} while (--batch > 0 && off < buflen);
+
+	return done;
+}
+
 typedef int (*init_req_fn)(struct cachefiles_req *req, void *private);
 
 static int cachefiles_ondemand_send_req(struct cachefiles_object *object,
@@ -508,6 +626,7 @@ static int cachefiles_ondemand_send_req(struct cachefiles_object *object,
 	}
 
 	refcount_set(&req->ref, 1);
+	req->waiters = 1;
 	req->object = object;
 	init_completion(&req->done);
 	req->msg.opcode = opcode;
@@ -571,6 +690,8 @@ static int cachefiles_ondemand_send_req(struct cachefiles_object *object,
 			cache->msg_id_next = xas.xa_index + 1;
 			xas_clear_mark(&xas, XA_FREE_MARK);
 			xas_set_mark(&xas, CACHEFILES_REQ_NEW);
+			if (opcode == CACHEFILES_OP_READ)
+				object->ondemand->last_read_id = xas.xa_index;
 		}
 		xas_unlock(&xas);
 	} while (xas_nomem(&xas, GFP_KERNEL));
@@ -580,20 +701,7 @@ static int cachefiles_ondemand_send_req(struct cachefiles_object *object,
 		goto out;
 
 	wake_up_all(&cache->daemon_pollwq);
-wait:
-	ret = wait_for_completion_killable(&req->done);
-	if (!ret) {
-		ret = req->error;
-	} else {
-		ret = -EINTR;
-		if (!cachefiles_ondemand_finish_req(req, &xas, ret)) {
-			/* Someone will complete it soon. */
-			cpu_relax();
-			goto wait;
-		}
-	}
-	cachefiles_req_put(req);
-	return ret;
+	return cachefiles_ondemand_wait_req(req, &xas);
 out:
 	/* Reset the object to close state in error handling path.
 	 * If error occurs after creating the anonymous fd,
@@ -719,7 +827,7 @@ void cachefiles_ondemand_clean_object(struct cachefiles_object *object)
 	xa_for_each(&cache->reqs, index, req) {
 		if (req->object == object) {
 			req->error = -EIO;
-			complete(&req->done);
+			complete_all(&req->done);
 			__xa_erase(&cache->reqs, index);
 		}
 	}
@@ -752,10 +860,74 @@ void cachefiles_ondemand_deinit_obj_info(struct cachefiles_object *object)
 	object->ondemand = NULL;
 }
 
+/*
+ * Try to piggyback on the last READ request sent for the object, if the
+ * daemon hasn't picked it up yet and the two ranges overlap or abut. The
+ * request is extended to cover both and -EAGAIN returned if that's not
+ * possible.
+ */
+static int cachefiles_ondemand_coalesce_read(struct cachefiles_object *object,
+					     loff_t pos, size_t len)
+{
+	struct cachefiles_cache *cache = object->volume->cache;
+	struct cachefiles_read *load;
+	struct cachefiles_req *req;
+	u64 start, end, max_len;
+	XA_STATE(xas, &cache->reqs, 0);
+
+	max_len = max_t(u64, READ_ONCE(cache->ondemand_ra),
+			CACHEFILES_ONDEMAND_COALESCE_MAX);
+
+	xas_lock(&xas);
+	xas_set(&xas, object->ondemand->last_read_id);
+	req = xas_load(&xas);
+	if (!req || req->object != object ||
+	    req->msg.opcode != CACHEFILES_OP_READ ||
+	    !xas_get_mark(&xas, CACHEFILES_REQ_NEW))
+		goto no_luck;
+
+	load = (void *)req->msg.data;
+	if (pos > load->off + load->len || pos + len < load->off)
+		goto no_luck;
+
+	start = min_t(u64, load->off, pos);
+	end = max_t(u64, load->off + load->len, pos + len);
+	if (end - start > max_len)
+		goto no_luck;
+
+	load->off = start;
+	load->len = end - start;
+	req->waiters++;
+	refcount_inc(&req->ref);
+	xas_unlock(&xas);
+
+	trace_cachefiles_ondemand_read(object, &req->msg, load);
+	return cachefiles_ondemand_wait_req(req, &xas);
+
+no_luck:
+	xas_unlock(&xas);
+	return -EAGAIN;
+}
+
 int cachefiles_ondemand_read(struct cachefiles_object *object,
 			     loff_t pos, size_t len)
 {
+	struct cachefiles_cache *cache = object->volume->cache;
 	struct cachefiles_read_ctx read_ctx = {pos, len};
+	size_t ra = READ_ONCE(cache->ondemand_ra);
+	loff_t end;
+	int ret;
+
+	ret = cachefiles_ondemand_coalesce_read(object, pos, len);
+	if (ret != -EAGAIN)
+		return ret;
+
+	/* ask for more than the miss, but not past the end of the object */
+	if (len < ra) {
+		end = min_t(loff_t, pos + ra, object->cookie->object_size);
+		if (end > pos + (loff_t)len)
+			read_ctx.len = end - pos;
+	}
 
 	return cachefiles_ondemand_send_req(object, CACHEFILES_OP_READ,
 			sizeof(struct cachefiles_read),
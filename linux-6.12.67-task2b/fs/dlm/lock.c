@@ -737,7 +737,18 @@ static int find_rsb_dir(struct dlm_ls *ls, const void *name, int len,
 	if (error)
 		goto do_new;
 
-	/* check if the rsb is active under read lock - likely path */
+	/*
+	 * Only active rsbs are refcounted, and one we hold a reference
+	 * on stays active, so taking that reference needs no lock at all.
+	 * Inactive and dying rsbs have a zero refcount.
+	 */
+	if (kref_get_unless_zero(&r->res_ref)) {
+		/* pairs with smp_wmb() in activating an inactive rsb */
+		smp_rmb();
+		goto out;
+	}
+
+	/* check if the rsb is active under read lock */
 	read_lock_bh(&ls->ls_rsbtbl_lock);
 	if (!rsb_flag(r, RSB_HASHED)) {
 		read_unlock_bh(&ls->ls_rsbtbl_lock);
@@ -834,6 +845,8 @@ static int find_rsb_dir(struct dlm_ls *ls, const void *name, int len,
 	del_scan(ls, r);
 	list_move(&r->res_slow_list, &ls->ls_slow_active);
 	rsb_clear_flag(r, RSB_INACTIVE);
+	/* the rsb state must be visible to lockless lookups taking a ref */
+	smp_wmb();
 	kref_init(&r->res_ref); /* ref is now used in active state */
 	write_unlock_bh(&ls->ls_rsbtbl_lock);
 
@@ -929,7 +942,13 @@ static int find_rsb_nodir(struct dlm_ls *ls, const void *name, int len,
 	if (error)
 		goto do_new;
 
-	/* check if the rsb is in active state under read lock - likely path */
+	/* See comment in find_rsb_dir. */
+	if (kref_get_unless_zero(&r->res_ref)) {
+		smp_rmb();
+		goto out;
+	}
+
+	/* check if the rsb is in active state under read lock */
 	read_lock_bh(&ls->ls_rsbtbl_lock);
 	if (!rsb_flag(r, RSB_HASHED)) {
 		read_unlock_bh(&ls->ls_rsbtbl_lock);
@@ -997,6 +1016,7 @@ static int find_rsb_nodir(struct dlm_ls *ls, const void *name, int len,
 	del_scan(ls, r);
 	list_move(&r->res_slow_list, &ls->ls_slow_active);
 	rsb_clear_flag(r, RSB_INACTIVE);
+	smp_wmb();
 	kref_init(&r->res_ref);
 	write_unlock_bh(&ls->ls_rsbtbl_lock);
 
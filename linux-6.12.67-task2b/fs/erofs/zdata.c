@@ -290,6 +290,10 @@ static void z_erofs_free_pcluster(struct z_erofs_pcluster *pcl)
 
 static struct workqueue_struct *z_erofs_workqueue __read_mostly;
 
+/* max # of workers sharing one decompression queue, 0 means online CPUs */
+static unsigned int z_erofs_max_workers;
+module_param_named(decompress_workers, z_erofs_max_workers, uint, 0644);
+
 #ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
 static struct kthread_worker __rcu **z_erofs_pcpu_workers;
 
@@ -1370,27 +1374,108 @@ static int z_erofs_decompress_pcluster(struct z_erofs_backend *be, bool eio)
 	return err;
 }
 
-static int z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
+/* decompress up to @nr pclusters of the chain starting at @pcl */
+static int z_erofs_decompress_chain(struct super_block *sb,
+				    struct z_erofs_pcluster *pcl,
+				    unsigned int nr, bool eio,
 				    struct page **pagepool)
 {
 	struct z_erofs_backend be = {
-		.sb = io->sb,
+		.sb = sb,
 		.pagepool = pagepool,
 		.decompressed_secondary_bvecs =
 			LIST_HEAD_INIT(be.decompressed_secondary_bvecs),
-		.pcl = io->head,
+		.pcl = pcl,
 	};
 	struct z_erofs_pcluster *next;
 	int err = 0;
 
-	for (; be.pcl != Z_EROFS_PCLUSTER_TAIL; be.pcl = next) {
+	for (; nr && be.pcl != Z_EROFS_PCLUSTER_TAIL; be.pcl = next, --nr) {
 		DBG_BUGON(!be.pcl);
 		next = READ_ONCE(be.pcl->next);
-		err = z_erofs_decompress_pcluster(&be, io->eio) ?: err;
+		err = z_erofs_decompress_pcluster(&be, eio) ?: err;
 	}
 	return err;
 }
 
+/* a share of a decompression queue handed to another worker */
+struct z_erofs_decompress_split {
+	struct work_struct work;
+	struct super_block *sb;
+	struct z_erofs_pcluster *head;
+	unsigned int nr;
+	bool eio;
+};
+
+/* don't bother other workers for less than this many pclusters each */
+#define Z_EROFS_SPLIT_MIN_PCLUSTERS	2
+
+static void z_erofs_decompress_split_work(struct work_struct *work)
+{
+	struct z_erofs_decompress_split *split =
+		container_of(work, struct z_erofs_decompress_split, work);
+	struct page *pagepool = NULL;
+
+	z_erofs_decompress_chain(split->sb, split->head, split->nr,
+				 split->eio, &pagepool);
+	erofs_release_pages(&pagepool);
+	kfree(split);
+}
+
+/*
+ * Long queues (e.g. large readahead requests) are spread over several
+ * workers so that decompression isn't bound to a single CPU. The caller
+ * keeps the first share, the others go to z_erofs_workqueue; per-worker
+ * decompressor contexts come from the per-algorithm stream pools. The
+ * chain must be walked past each share before it's queued since
+ * decompressing a pcluster resets its ->next.
+ */
+static int z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
+				    struct page **pagepool)
+{
+	struct z_erofs_pcluster *pcl, *rest = Z_EROFS_PCLUSTER_TAIL;
+	unsigned int workers, nr = 0, share, i;
+	int err;
+
+	workers = READ_ONCE(z_erofs_max_workers) ?: num_online_cpus();
+	if (workers > 1)
+		for (pcl = io->head; pcl != Z_EROFS_PCLUSTER_TAIL;
+		     pcl = READ_ONCE(pcl->next))
+			++nr;
+	workers = min(workers, nr / Z_EROFS_SPLIT_MIN_PCLUSTERS);
+	if (workers <= 1)
+		return z_erofs_decompress_chain(io->sb, io->head, UINT_MAX,
+						io->eio, pagepool);
+
+	share = DIV_ROUND_UP(nr, workers);
+	pcl = io->head;
+	for (i = 0; i < share; ++i)
+		pcl = READ_ONCE(pcl->next);
+
+	while (pcl != Z_EROFS_PCLUSTER_TAIL) {
+		struct z_erofs_decompress_split *split;
+
+		split = kmalloc(sizeof(*split), GFP_NOWAIT | __GFP_NOWARN);
+		if (!split) {
+			rest = pcl;	/* decompress the remaining ones here */
+			break;
+		}
+		split->sb = io->sb;
+		split->head = pcl;
+		split->nr = share;
+		split->eio = io->eio;
+		for (i = 0; i < share && pcl != Z_EROFS_PCLUSTER_TAIL; ++i)
+			pcl = READ_ONCE(pcl->next);
+		INIT_WORK(&split->work, z_erofs_decompress_split_work);
+		queue_work(z_erofs_workqueue, &split->work);
+	}
+
+	err = z_erofs_decompress_chain(io->sb, io->head, share, io->eio,
+				       pagepool);
+	return z_erofs_decompress_chain(io->sb, rest, UINT_MAX, io->eio,
+					pagepool) ?: err;
+}
+
 static void z_erofs_decompressqueue_work(struct work_struct *work)
 {
 	struct z_erofs_decompressqueue *bgq =
@@ -111,12 +111,18 @@ struct jbd2_revoke_record_s
 struct jbd2_revoke_table_s
 {
 	/* It is conceivable that we might want a larger hash table
-	 * for recovery.  Must be a power of two. */
+	 * for recovery.  Must be a power of two.  The table grows
+	 * with the number of records, see jbd2_revoke_table_grow(). */
 	int		  hash_size;
 	int		  hash_shift;
+	int		  hash_count;
 	struct list_head *hash_table;
 };
 
+/* Grow the table above this many records per bucket, up to a limit. */
+#define JOURNAL_REVOKE_LOAD_FACTOR	2
+#define JOURNAL_REVOKE_MAX_HASH_SHIFT	16
+
 
 #ifdef __KERNEL__
 static void write_one_revoke_record(transaction_t *,
@@ -128,15 +134,69 @@ static void flush_descriptor(journal_t *, struct buffer_head *, int);
 
 /* Utility functions to maintain the revoke table */
 
-static inline int hash(journal_t *journal, unsigned long long block)
+/* Must be called under j_revoke_lock, as the table may be resized. */
+static inline struct list_head *revoke_hash_list(journal_t *journal,
+						 unsigned long long block)
+{
+	struct jbd2_revoke_table_s *table = journal->j_revoke;
+
+	return &table->hash_table[hash_64(block, table->hash_shift)];
+}
+
+static inline bool revoke_table_needs_grow(struct jbd2_revoke_table_s *table)
+{
+	return table->hash_shift < JOURNAL_REVOKE_MAX_HASH_SHIFT &&
+	       READ_ONCE(table->hash_count) >
+			table->hash_size * JOURNAL_REVOKE_LOAD_FACTOR;
+}
+
+/*
+ * Double the number of buckets of the running transaction's revoke table.
+ * Large deletes can revoke hundreds of thousands of blocks in a single
+ * transaction, and with a fixed table every revoke and every cancel walks
+ * an ever longer chain.  If the allocation fails we just carry on with the
+ * smaller table.
+ */
+static void jbd2_revoke_table_grow(journal_t *journal)
 {
-	return hash_64(block, journal->j_revoke->hash_shift);
+	struct jbd2_revoke_table_s *table = journal->j_revoke;
+	struct jbd2_revoke_record_s *record, *next;
+	struct list_head *new_table, *old_table;
+	int new_shift = table->hash_shift + 1;
+	int new_size = 1 << new_shift;
+	int i;
+
+	new_table = kvmalloc_array(new_size, sizeof(struct list_head),
+				   GFP_NOFS | __GFP_NOWARN);
+	if (!new_table)
+		return;
+	for (i = 0; i < new_size; i++)
+		INIT_LIST_HEAD(&new_table[i]);
+
+	spin_lock(&journal->j_revoke_lock);
+	if (table->hash_shift + 1 != new_shift) {
+		/* somebody else beat us to it */
+		spin_unlock(&journal->j_revoke_lock);
+		kvfree(new_table);
+		return;
+	}
+	for (i = 0; i < table->hash_size; i++)
+		list_for_each_entry_safe(record, next, &table->hash_table[i],
+					 hash)
+			list_move(&record->hash,
+				  &new_table[hash_64(record->blocknr,
+						     new_shift)]);
+	old_table = table->hash_table;
+	table->hash_table = new_table;
+	table->hash_size = new_size;
+	table->hash_shift = new_shift;
+	spin_unlock(&journal->j_revoke_lock);
+	kvfree(old_table);
 }
 
 static int insert_revoke_hash(journal_t *journal, unsigned long long blocknr,
 			      tid_t seq)
 {
-	struct list_head *hash_list;
 	struct jbd2_revoke_record_s *record;
 	gfp_t gfp_mask = GFP_NOFS;
 
@@ -148,9 +208,11 @@ static int insert_revoke_hash(journal_t *journal, unsigned long long blocknr,
 
 	record->sequence = seq;
 	record->blocknr = blocknr;
-	hash_list = &journal->j_revoke->hash_table[hash(journal, blocknr)];
+	if (revoke_table_needs_grow(journal->j_revoke))
+		jbd2_revoke_table_grow(journal);
 	spin_lock(&journal->j_revoke_lock);
-	list_add(&record->hash, hash_list);
+	list_add(&record->hash, revoke_hash_list(journal, blocknr));
+	journal->j_revoke->hash_count++;
 	spin_unlock(&journal->j_revoke_lock);
 	return 0;
 }
@@ -163,9 +225,8 @@ static struct jbd2_revoke_record_s *find_revoke_record(journal_t *journal,
 	struct list_head *hash_list;
 	struct jbd2_revoke_record_s *record;
 
-	hash_list = &journal->j_revoke->hash_table[hash(journal, blocknr)];
-
 	spin_lock(&journal->j_revoke_lock);
+	hash_list = revoke_hash_list(journal, blocknr);
 	record = (struct jbd2_revoke_record_s *) hash_list->next;
 	while (&(record->hash) != hash_list) {
 		if (record->blocknr == blocknr) {
@@ -230,6 +291,7 @@ static struct jbd2_revoke_table_s *jbd2_journal_init_revoke_table(int hash_size)
 
 	table->hash_size = hash_size;
 	table->hash_shift = shift;
+	table->hash_count = 0;
 	table->hash_table =
 		kmalloc_array(hash_size, sizeof(struct list_head), GFP_KERNEL);
 	if (!table->hash_table) {
@@ -255,7 +317,7 @@ static void jbd2_journal_destroy_revoke_table(struct jbd2_revoke_table_s *table)
 		J_ASSERT(list_empty(hash_list));
 	}
 
-	kfree(table->hash_table);
+	kvfree(table->hash_table);
 	kmem_cache_free(jbd2_revoke_table_cache, table);
 }
 
@@ -450,6 +512,7 @@ int jbd2_journal_cancel_revoke(handle_t *handle, struct journal_head *jh)
 				  "blocknr %llu\n", (unsigned long long)bh->b_blocknr);
 			spin_lock(&journal->j_revoke_lock);
 			list_del(&record->hash);
+			journal->j_revoke->hash_count--;
 			spin_unlock(&journal->j_revoke_lock);
 			kmem_cache_free(jbd2_revoke_record_cache, record);
 			did_revoke = 1;
@@ -524,6 +587,7 @@ void jbd2_journal_switch_revoke_table(journal_t *journal)
 
 	for (i = 0; i < journal->j_revoke->hash_size; i++)
 		INIT_LIST_HEAD(&journal->j_revoke->hash_table[i]);
+	journal->j_revoke->hash_count = 0;
 }
 
 /*
@@ -561,6 +625,7 @@ void jbd2_journal_write_revoke_records(transaction_t *transaction,
 			kmem_cache_free(jbd2_revoke_record_cache, record);
 		}
 	}
+	revoke->hash_count = 0;
 	if (descriptor)
 		flush_descriptor(journal, descriptor, offset);
 	jbd2_debug(1, "Wrote %d revoke records\n", count);
@@ -743,4 +808,5 @@ void jbd2_journal_clear_revoke(journal_t *journal)
 			kmem_cache_free(jbd2_revoke_record_cache, record);
 		}
 	}
+	revoke->hash_count = 0;
 }
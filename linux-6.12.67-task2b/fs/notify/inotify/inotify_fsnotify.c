@@ -46,14 +46,40 @@ static bool event_compare(struct fsnotify_event *old_fsn,
 	return false;
 }
 
+/* How far back in the queue to look for an event to merge with */
+#define INOTIFY_MERGE_WINDOW	16
+
+/*
+ * Merge with the most recent queued event for the same watch and name, if it
+ * is identical.  Looking past events for other objects lets interleaved
+ * storms of modifications to a few files merge, while stopping at the first
+ * event for the same object keeps the order of events on any one object.
+ */
 static int inotify_merge(struct fsnotify_group *group,
 			 struct fsnotify_event *event)
 {
 	struct list_head *list = &group->notification_list;
-	struct fsnotify_event *last_event;
-
-	last_event = list_entry(list->prev, struct fsnotify_event, list);
-	return event_compare(last_event, event);
+	struct inotify_event_info *old, *new = INOTIFY_E(event);
+	struct fsnotify_event *old_fsn;
+	int window = INOTIFY_MERGE_WINDOW;
+
+	list_for_each_entry_reverse(old_fsn, list, list) {
+		/* nothing is merged across a queue overflow */
+		if (old_fsn == group->overflow_event)
+			break;
+		old = INOTIFY_E(old_fsn);
+		if (old->wd == new->wd) {
+			/* nor across the removal of the watch */
+			if (old->mask & FS_IN_IGNORED)
+				break;
+			if (old->name_len == new->name_len &&
+			    (!old->name_len || !strcmp(old->name, new->name)))
+				return event_compare(old_fsn, event);
+		}
+		if (!--window)
+			break;
+	}
+	return 0;
 }
 
 int inotify_handle_inode_event(struct fsnotify_mark *inode_mark, u32 mask,
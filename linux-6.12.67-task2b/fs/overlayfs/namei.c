@@ -1105,6 +1105,14 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		upperopaque = d.opaque;
 	}
 
+	/*
+	 * A missing name need not be looked up in every lower layer if the
+	 * merged directory's readdir cache says it's in none of them.
+	 */
+	if (!d.stop && !upperdentry && ovl_numlower(poe) &&
+	    ovl_dir_cache_excludes(dir, &d.name))
+		d.stop = true;
+
 	if (!d.stop && ovl_numlower(poe)) {
 		err = -ENOMEM;
 		stack = ovl_stack_alloc(ofs->numlayer - 1);
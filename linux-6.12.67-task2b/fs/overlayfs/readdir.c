@@ -34,8 +34,20 @@ struct ovl_dir_cache {
 	u64 version;
 	struct list_head entries;
 	struct rb_root root;
+	/* all names of a merged directory, see ovl_dir_cache_excludes() */
+	bool merged;
+	/* keep after the last close */
+	bool keep;
 };
 
+/*
+ * Readdir caches of merged directories with at least this many lower layers
+ * stay attached to the inode after the last close, until the directory is
+ * modified or the inode is evicted, as they save ovl_lookup() from looking up
+ * missing names in every layer.
+ */
+#define OVL_DIR_CACHE_KEEP_LOWER	4
+
 struct ovl_readdir_data {
 	struct dir_context ctx;
 	struct dentry *dentry;
@@ -202,17 +214,23 @@ static bool ovl_fill_lowest(struct ovl_readdir_data *rdd,
 			   const char *name, int namelen,
 			   loff_t offset, u64 ino, unsigned int d_type)
 {
+	struct rb_node **newp = &rdd->root->rb_node;
+	struct rb_node *parent = NULL;
 	struct ovl_cache_entry *p;
 
-	p = ovl_cache_entry_find(rdd->root, name, namelen);
-	if (p) {
+	if (ovl_cache_entry_find_link(name, namelen, &newp, &parent)) {
+		p = ovl_cache_entry_from_node(*newp);
 		list_move_tail(&p->l_node, &rdd->middle);
 	} else {
 		p = ovl_cache_entry_new(rdd, name, namelen, ino, d_type);
-		if (p == NULL)
+		if (p == NULL) {
 			rdd->err = -ENOMEM;
-		else
+		} else {
 			list_add_tail(&p->l_node, &rdd->middle);
+			/* index it too, see ovl_dir_cache_excludes() */
+			rb_link_node(&p->node, parent, newp);
+			rb_insert_color(&p->node, rdd->root);
+		}
 	}
 
 	return rdd->err == 0;
@@ -246,8 +264,12 @@ static void ovl_cache_put(struct ovl_dir_file *od, struct inode *inode)
 	WARN_ON(cache->refcount <= 0);
 	cache->refcount--;
 	if (!cache->refcount) {
-		if (ovl_dir_cache(inode) == cache)
+		if (ovl_dir_cache(inode) == cache) {
+			if (cache->keep &&
+			    ovl_inode_version_get(inode) == cache->version)
+				return;
 			ovl_set_dir_cache(inode, NULL);
+		}
 
 		ovl_cache_free(&cache->entries);
 		kfree(cache);
@@ -405,10 +427,13 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 
 	cache = ovl_dir_cache(inode);
 	if (cache && ovl_inode_version_get(inode) == cache->version) {
-		WARN_ON(!cache->refcount);
+		WARN_ON(!cache->refcount && !cache->keep);
 		cache->refcount++;
 		return cache;
 	}
+	/* a kept cache has no other owner to free it */
+	if (cache && cache->keep && !cache->refcount)
+		ovl_dir_cache_free(inode);
 	ovl_set_dir_cache(d_inode(dentry), NULL);
 
 	cache = kzalloc(sizeof(struct ovl_dir_cache), GFP_KERNEL);
@@ -427,11 +452,29 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 	}
 
 	cache->version = ovl_inode_version_get(inode);
+	cache->merged = true;
+	cache->keep = ovl_numlower(OVL_E(dentry)) >= OVL_DIR_CACHE_KEEP_LOWER;
 	ovl_set_dir_cache(inode, cache);
 
 	return cache;
 }
 
+/*
+ * Return true if the up to date readdir cache of merged directory @dir shows
+ * that @name exists in none of its layers, not even as a whiteout.  Called
+ * with @dir locked, which keeps the cache stable.
+ */
+bool ovl_dir_cache_excludes(struct inode *dir, const struct qstr *name)
+{
+	struct ovl_dir_cache *cache = ovl_dir_cache(dir);
+
+	if (!cache || !cache->merged ||
+	    ovl_inode_version_get(dir) != cache->version)
+		return false;
+
+	return !ovl_cache_entry_find(&cache->root, name->name, name->len);
+}
+
 /* Map inode number to lower fs unique range */
 static u64 ovl_remap_lower_ino(u64 ino, int xinobits, int fsid,
 			       const char *name, int namelen, bool warn)
@@ -743,9 +743,9 @@ int proc_setattr(struct mnt_idmap *idmap, struct dentry *dentry,
  * May current process learn task's sched/cmdline info (for hide_pid_min=1)
  * or euid/egid (for hide_pid_min=2)?
  */
-static bool has_pid_permissions(struct proc_fs_info *fs_info,
-				 struct task_struct *task,
-				 enum proc_hidepid hide_pid_min)
+bool has_pid_permissions(struct proc_fs_info *fs_info,
+			 struct task_struct *task,
+			 enum proc_hidepid hide_pid_min)
 {
 	/*
 	 * If 'hidpid' mount option is set force a ptrace check,
@@ -4,6 +4,9 @@
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
+#include <linux/mm.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
 #include <linux/proc_fs.h>
 #include <linux/sched.h>
 #include <linux/sched/stat.h>
@@ -79,42 +82,142 @@ static void show_all_irqs(struct seq_file *p)
 	show_irq_gap(p, nr_irqs - next);
 }
 
-static int show_stat(struct seq_file *p, void *v)
-{
-	int i, j;
+/*
+ * The "intr" line costs a sum over all CPUs for every per-CPU interrupt and
+ * a number for every interrupt. With proc.stat_irq_cache_ms set, the line is
+ * formatted at most once per that many milliseconds and reused in between.
+ */
+static unsigned int stat_irq_cache_ms;
+module_param(stat_irq_cache_ms, uint, 0644);
+
+static DEFINE_MUTEX(stat_irq_lock);
+static char *stat_irq_buf;
+static size_t stat_irq_len, stat_irq_size;
+static unsigned long stat_irq_stamp;
+
+struct stat_cpu_times {
 	u64 user, nice, system, idle, iowait, irq, softirq, steal;
 	u64 guest, guest_nice;
+};
+
+static void stat_add_cpu_times(struct stat_cpu_times *t, int cpu)
+{
+	struct kernel_cpustat kcpustat;
+	u64 *cpustat = kcpustat.cpustat;
+
+	kcpustat_cpu_fetch(&kcpustat, cpu);
+
+	t->user		+= cpustat[CPUTIME_USER];
+	t->nice		+= cpustat[CPUTIME_NICE];
+	t->system	+= cpustat[CPUTIME_SYSTEM];
+	t->idle		+= get_idle_time(&kcpustat, cpu);
+	t->iowait	+= get_iowait_time(&kcpustat, cpu);
+	t->irq		+= cpustat[CPUTIME_IRQ];
+	t->softirq	+= cpustat[CPUTIME_SOFTIRQ];
+	t->steal	+= cpustat[CPUTIME_STEAL];
+	t->guest	+= cpustat[CPUTIME_GUEST];
+	t->guest_nice	+= cpustat[CPUTIME_GUEST_NICE];
+}
+
+static void show_cpu_times(struct seq_file *p, const struct stat_cpu_times *t)
+{
+	seq_put_decimal_ull(p, " ", nsec_to_clock_t(t->user));
+	seq_put_decimal_ull(p, " ", nsec_to_clock_t(t->nice));
+	seq_put_decimal_ull(p, " ", nsec_to_clock_t(t->system));
+	seq_put_decimal_ull(p, " ", nsec_to_clock_t(t->idle));
+	seq_put_decimal_ull(p, " ", nsec_to_clock_t(t->iowait));
+	seq_put_decimal_ull(p, " ", nsec_to_clock_t(t->irq));
+	seq_put_decimal_ull(p, " ", nsec_to_clock_t(t->softirq));
+	seq_put_decimal_ull(p, " ", nsec_to_clock_t(t->steal));
+	seq_put_decimal_ull(p, " ", nsec_to_clock_t(t->guest));
+	seq_put_decimal_ull(p, " ", nsec_to_clock_t(t->guest_nice));
+	seq_putc(p, '\n');
+}
+
+/* the "cpu" line summed over all CPUs, then one "cpuN" line per online CPU */
+static void show_all_cpu_times(struct seq_file *p)
+{
+	struct stat_cpu_times t = {};
+	int i;
+
+	for_each_possible_cpu(i)
+		stat_add_cpu_times(&t, i);
+	seq_puts(p, "cpu ");
+	show_cpu_times(p, &t);
+
+	for_each_online_cpu(i) {
+		memset(&t, 0, sizeof(t));
+		stat_add_cpu_times(&t, i);
+		seq_printf(p, "cpu%d", i);
+		show_cpu_times(p, &t);
+	}
+}
+
+static void __show_intr(struct seq_file *p)
+{
 	u64 sum = 0;
+	int i;
+
+	for_each_possible_cpu(i) {
+		sum += kstat_cpu_irqs_sum(i);
+		sum += arch_irq_stat_cpu(i);
+	}
+	sum += arch_irq_stat();
+
+	seq_put_decimal_ull(p, "intr ", (unsigned long long)sum);
+	show_all_irqs(p);
+}
+
+static void show_intr(struct seq_file *p)
+{
+	unsigned int cache_ms = READ_ONCE(stat_irq_cache_ms);
+	size_t start = p->count, len;
+
+	if (!cache_ms) {
+		__show_intr(p);
+		return;
+	}
+
+	mutex_lock(&stat_irq_lock);
+	if (stat_irq_len &&
+	    time_before(jiffies, stat_irq_stamp + msecs_to_jiffies(cache_ms))) {
+		seq_write(p, stat_irq_buf, stat_irq_len);
+		goto unlock;
+	}
+
+	__show_intr(p);
+	/* an overflowed buffer is retried larger, cache the complete line */
+	if (seq_has_overflowed(p))
+		goto unlock;
+
+	len = p->count - start;
+	if (len > stat_irq_size) {
+		kvfree(stat_irq_buf);
+		stat_irq_buf = kvmalloc(len, GFP_KERNEL);
+		stat_irq_size = stat_irq_buf ? len : 0;
+	}
+	stat_irq_len = 0;
+	if (stat_irq_buf) {
+		memcpy(stat_irq_buf, p->buf + start, len);
+		stat_irq_len = len;
+		stat_irq_stamp = jiffies;
+	}
+unlock:
+	mutex_unlock(&stat_irq_lock);
+}
+
+static int show_stat(struct seq_file *p, void *v)
+{
+	int i, j;
 	u64 sum_softirq = 0;
 	unsigned int per_softirq_sums[NR_SOFTIRQS] = {0};
 	struct timespec64 boottime;
 
-	user = nice = system = idle = iowait =
-		irq = softirq = steal = 0;
-	guest = guest_nice = 0;
 	getboottime64(&boottime);
 	/* shift boot timestamp according to the timens offset */
 	timens_sub_boottime(&boottime);
 
 	for_each_possible_cpu(i) {
-		struct kernel_cpustat kcpustat;
-		u64 *cpustat = kcpustat.cpustat;
-
-		kcpustat_cpu_fetch(&kcpustat, i);
-
-		user		+= cpustat[CPUTIME_USER];
-		nice		+= cpustat[CPUTIME_NICE];
-		system		+= cpustat[CPUTIME_SYSTEM];
-		idle		+= get_idle_time(&kcpustat, i);
-		iowait		+= get_iowait_time(&kcpustat, i);
-		irq		+= cpustat[CPUTIME_IRQ];
-		softirq		+= cpustat[CPUTIME_SOFTIRQ];
-		steal		+= cpustat[CPUTIME_STEAL];
-		guest		+= cpustat[CPUTIME_GUEST];
-		guest_nice	+= cpustat[CPUTIME_GUEST_NICE];
-		sum		+= kstat_cpu_irqs_sum(i);
-		sum		+= arch_irq_stat_cpu(i);
-
 		for (j = 0; j < NR_SOFTIRQS; j++) {
 			unsigned int softirq_stat = kstat_softirqs_cpu(j, i);
 
@@ -122,53 +225,9 @@ static int show_stat(struct seq_file *p, void *v)
 			sum_softirq += softirq_stat;
 		}
 	}
-	sum += arch_irq_stat();
-
-	seq_put_decimal_ull(p, "cpu  ", nsec_to_clock_t(user));
-	seq_put_decimal_ull(p, " ", nsec_to_clock_t(nice));
-	seq_put_decimal_ull(p, " ", nsec_to_clock_t(system));
-	seq_put_decimal_ull(p, " ", nsec_to_clock_t(idle));
-	seq_put_decimal_ull(p, " ", nsec_to_clock_t(iowait));
-	seq_put_decimal_ull(p, " ", nsec_to_clock_t(irq));
-	seq_put_decimal_ull(p, " ", nsec_to_clock_t(softirq));
-	seq_put_decimal_ull(p, " ", nsec_to_clock_t(steal));
-	seq_put_decimal_ull(p, " ", nsec_to_clock_t(guest));
-	seq_put_decimal_ull(p, " ", nsec_to_clock_t(guest_nice));
-	seq_putc(p, '\n');
-
-	for_each_online_cpu(i) {
-		struct kernel_cpustat kcpustat;
-		u64 *cpustat = kcpustat.cpustat;
-
-		kcpustat_cpu_fetch(&kcpustat, i);
-
-		/* Copy values here to work around gcc-2.95.3, gcc-2.96 */
-		user		= cpustat[CPUTIME_USER];
-		nice		= cpustat[CPUTIME_NICE];
-		system		= cpustat[CPUTIME_SYSTEM];
-		idle		= get_idle_time(&kcpustat, i);
-		iowait		= get_iowait_time(&kcpustat, i);
-		irq		= cpustat[CPUTIME_IRQ];
-		softirq		= cpustat[CPUTIME_SOFTIRQ];
-		steal		= cpustat[CPUTIME_STEAL];
-		guest		= cpustat[CPUTIME_GUEST];
-		guest_nice	= cpustat[CPUTIME_GUEST_NICE];
-		seq_printf(p, "cpu%d", i);
-		seq_put_decimal_ull(p, " ", nsec_to_clock_t(user));
-		seq_put_decimal_ull(p, " ", nsec_to_clock_t(nice));
-		seq_put_decimal_ull(p, " ", nsec_to_clock_t(system));
-		seq_put_decimal_ull(p, " ", nsec_to_clock_t(idle));
-		seq_put_decimal_ull(p, " ", nsec_to_clock_t(iowait));
-		seq_put_decimal_ull(p, " ", nsec_to_clock_t(irq));
-		seq_put_decimal_ull(p, " ", nsec_to_clock_t(softirq));
-		seq_put_decimal_ull(p, " ", nsec_to_clock_t(steal));
-		seq_put_decimal_ull(p, " ", nsec_to_clock_t(guest));
-		seq_put_decimal_ull(p, " ", nsec_to_clock_t(guest_nice));
-		seq_putc(p, '\n');
-	}
-	seq_put_decimal_ull(p, "intr ", (unsigned long long)sum);
 
-	show_all_irqs(p);
+	show_all_cpu_times(p);
+	show_intr(p);
 
 	seq_printf(p,
 		"\nctxt %llu\n"
@@ -191,6 +250,13 @@ static int show_stat(struct seq_file *p, void *v)
 	return 0;
 }
 
+/* /proc/stat_cpu: just the CPU time lines of /proc/stat */
+static int show_stat_cpu(struct seq_file *p, void *v)
+{
+	show_all_cpu_times(p);
+	return 0;
+}
+
 static int stat_open(struct inode *inode, struct file *file)
 {
 	unsigned int size = 1024 + 128 * num_online_cpus();
@@ -200,6 +266,12 @@ static int stat_open(struct inode *inode, struct file *file)
 	return single_open_size(file, show_stat, NULL, size);
 }
 
+static int stat_cpu_open(struct inode *inode, struct file *file)
+{
+	return single_open_size(file, show_stat_cpu, NULL,
+				256 + 128 * num_online_cpus());
+}
+
 static const struct proc_ops stat_proc_ops = {
 	.proc_flags	= PROC_ENTRY_PERMANENT,
 	.proc_open	= stat_open,
@@ -208,9 +280,18 @@ static const struct proc_ops stat_proc_ops = {
 	.proc_release	= single_release,
 };
 
+static const struct proc_ops stat_cpu_proc_ops = {
+	.proc_flags	= PROC_ENTRY_PERMANENT,
+	.proc_open	= stat_cpu_open,
+	.proc_read_iter	= seq_read_iter,
+	.proc_lseek	= seq_lseek,
+	.proc_release	= single_release,
+};
+
 static int __init proc_stat_init(void)
 {
 	proc_create("stat", 0, NULL, &stat_proc_ops);
+	proc_create("stat_cpu", 0, NULL, &stat_cpu_proc_ops);
 	return 0;
 }
 fs_initcall(proc_stat_init);
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * /proc/task_stat - per-process statistics for all processes in one read,
+ * as fixed size binary records (struct proc_task_stat), so monitors do not
+ * have to open and parse /proc/<pid>/stat and status for every process.
+ */
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/pid_namespace.h>
+#include <linux/proc_fs.h>
+#include <linux/proc_task_stat.h>
+#include <linux/sched/cputime.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/task.h>
+#include <linux/seq_file.h>
+#include <linux/threads.h>
+#include <linux/uidgid.h>
+#include "internal.h"
+
+/*
+ * Find the first visible process with tgid >= *pos, a reference to it is
+ * returned and *pos is set to its tgid. The position is a pid rather than
+ * a record index, so a read resumes correctly when processes come and go.
+ */
+static struct task_struct *task_stat_find(struct seq_file *m, loff_t *pos)
+{
+	struct super_block *sb = file_inode(m->file)->i_sb;
+	struct proc_fs_info *fs_info = proc_sb_info(sb);
+	struct pid_namespace *ns = proc_pid_ns(sb);
+	struct task_struct *task;
+	struct pid *pid;
+
+	while (*pos < PID_MAX_LIMIT) {
+		rcu_read_lock();
+		pid = find_ge_pid(*pos, ns);
+		if (!pid) {
+			rcu_read_unlock();
+			break;
+		}
+		*pos = pid_nr_ns(pid, ns);
+		task = pid_task(pid, PIDTYPE_TGID);
+		if (task)
+			get_task_struct(task);
+		rcu_read_unlock();
+
+		if (task) {
+			if (has_pid_permissions(fs_info, task, HIDEPID_INVISIBLE))
+				return task;
+			put_task_struct(task);
+		}
+		++*pos;
+		cond_resched();
+	}
+
+	*pos = PID_MAX_LIMIT;
+	return NULL;
+}
+
+static void *task_stat_start(struct seq_file *m, loff_t *pos)
+{
+	return task_stat_find(m, pos);
+}
+
+static void *task_stat_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	put_task_struct(v);
+	++*pos;
+	return task_stat_find(m, pos);
+}
+
+static void task_stat_stop(struct seq_file *m, void *v)
+{
+	if (v)
+		put_task_struct(v);
+}
+
+static int task_stat_show(struct seq_file *m, void *v)
+{
+	struct pid_namespace *ns = proc_pid_ns(file_inode(m->file)->i_sb);
+	struct proc_task_stat rec = {};
+	struct task_struct *task = v;
+	struct mm_struct *mm;
+	u64 utime, stime;
+
+	rec.pid = task_tgid_nr_ns(task, ns);
+	if (!rec.pid)
+		return SEQ_SKIP;	/* reaped since it was found */
+	rec.uid = from_kuid_munged(seq_user_ns(m), task_uid(task));
+
+	thread_group_cputime_adjusted(task, &utime, &stime);
+	rec.utime = utime;
+	rec.stime = stime;
+
+	mm = get_task_mm(task);
+	if (mm) {
+		rec.rss = get_mm_rss(mm);
+		mmput(mm);
+	}
+
+	seq_write(m, &rec, sizeof(rec));
+	return 0;
+}
+
+static const struct seq_operations task_stat_seq_ops = {
+	.start	= task_stat_start,
+	.next	= task_stat_next,
+	.stop	= task_stat_stop,
+	.show	= task_stat_show,
+};
+
+static int __init proc_task_stat_init(void)
+{
+	struct proc_dir_entry *pde;
+
+	pde = proc_create_seq("task_stat", 0444, NULL, &task_stat_seq_ops);
+	pde_make_permanent(pde);
+	return 0;
+}
+fs_initcall(proc_task_stat_init);
@@ -87,7 +87,8 @@
 /*
  * There are five quota SMP locks:
  * * dq_list_lock protects all lists with quotas and quota formats.
- * * dquot->dq_dqb_lock protects data from dq_dqb
+ * * dquot->dq_dqb_lock protects data from dq_dqb, usage changes kept in
+ *   the per-CPU counters dquot->dq_pcp are folded in under it
  * * inode->i_lock protects inode->i_blocks, i_bytes and also guards
  *   consistency of dquot->dq_dqb with inode->i_blocks, i_bytes so that
  *   dquot_transfer() can stabilize amount it transfers
@@ -497,6 +498,54 @@ out_iolock:
 }
 EXPORT_SYMBOL(dquot_acquire);
 
+/*
+ * Allocations and frees far away from every limit of a dquot are accounted
+ * in the per-CPU counters dquot->dq_pcp instead of dq_dqb, so that writers
+ * charging the same user or project do not all serialize on dq_dqb_lock.
+ * The exact usage is dq_dqb plus the counters, and everyone who takes
+ * dq_dqb_lock to look at usage folds the counters into dq_dqb first.
+ */
+static void dquot_pcp_fold(struct dquot *dquot)
+{
+	qsize_t *usage[DQ_PCP_NR] = {
+		[DQ_PCP_CURSPACE]	= &dquot->dq_dqb.dqb_curspace,
+		[DQ_PCP_RSVSPACE]	= &dquot->dq_dqb.dqb_rsvspace,
+		[DQ_PCP_CURINODES]	= &dquot->dq_dqb.dqb_curinodes,
+	};
+	int i;
+
+	lockdep_assert_held(&dquot->dq_dqb_lock);
+	if (!test_bit(DQ_PCP_B, &dquot->dq_flags))
+		return;
+	clear_bit(DQ_PCP_B, &dquot->dq_flags);
+	/* pairs with smp_mb() in dquot_pcp_add() */
+	smp_mb__after_atomic();
+
+	for (i = 0; i < DQ_PCP_NR; i++) {
+		s64 delta = percpu_counter_sum(&dquot->dq_pcp[i]);
+
+		/*
+		 * Subtracting what was summed keeps any change made meanwhile
+		 * in the counter. Add to dq_dqb first so that lockless readers
+		 * overestimate the usage for a moment rather than miss it.
+		 */
+		WRITE_ONCE(*usage[i], *usage[i] + delta);
+		percpu_counter_sub(&dquot->dq_pcp[i], delta);
+	}
+}
+
+/*
+ * Take dq_dqb_lock with the usage in dq_dqb exact. Everyone outside of the
+ * charging paths who reads usage from dq_dqb, like quota formats and
+ * filesystems reporting it, has to lock it with this.
+ */
+void dquot_dqb_lock(struct dquot *dquot)
+{
+	spin_lock(&dquot->dq_dqb_lock);
+	dquot_pcp_fold(dquot);
+}
+EXPORT_SYMBOL(dquot_dqb_lock);
+
 /*
  *	Write dquot to disk
  */
@@ -510,6 +559,9 @@ int dquot_commit(struct dquot *dquot)
 	memalloc = memalloc_nofs_save();
 	if (!clear_dquot_dirty(dquot))
 		goto out_lock;
+	/* changes made after this redirty the dquot */
+	dquot_dqb_lock(dquot);
+	spin_unlock(&dquot->dq_dqb_lock);
 	/* Inactive dquot can be only if there was error during read/init
 	 * => we have better not writing it */
 	if (dquot_active(dquot))
@@ -537,6 +589,8 @@ int dquot_release(struct dquot *dquot)
 	/* Check whether we are not racing with some other dqget() */
 	if (dquot_is_busy(dquot))
 		goto out_dqlock;
+	dquot_dqb_lock(dquot);
+	spin_unlock(&dquot->dq_dqb_lock);
 	if (dqopt->ops[dquot->dq_id.type]->release_dqblk) {
 		ret = dqopt->ops[dquot->dq_id.type]->release_dqblk(dquot);
 		/* Write the info */
@@ -563,6 +617,7 @@ EXPORT_SYMBOL(dquot_destroy);
 
 static inline void do_destroy_dquot(struct dquot *dquot)
 {
+	percpu_counter_destroy_many(dquot->dq_pcp, DQ_PCP_NR);
 	dquot->dq_sb->dq_op->destroy_dquot(dquot);
 }
 
@@ -912,6 +967,10 @@ static struct dquot *get_empty_dquot(struct super_block *sb, int type)
 	dquot->dq_id = make_kqid_invalid(type);
 	atomic_set(&dquot->dq_count, 1);
 	spin_lock_init(&dquot->dq_dqb_lock);
+	if (percpu_counter_init_many(dquot->dq_pcp, 0, GFP_NOFS, DQ_PCP_NR)) {
+		sb->dq_op->destroy_dquot(dquot);
+		return NULL;
+	}
 
 	return dquot;
 }
@@ -1298,7 +1357,7 @@ static int dquot_add_inodes(struct dquot *dquot, qsize_t inodes,
 	qsize_t newinodes;
 	int ret = 0;
 
-	spin_lock(&dquot->dq_dqb_lock);
+	dquot_dqb_lock(dquot);
 	newinodes = dquot->dq_dqb.dqb_curinodes + inodes;
 	if (!sb_has_quota_limits_enabled(dquot->dq_sb, dquot->dq_id.type) ||
 	    test_bit(DQ_FAKE_B, &dquot->dq_flags))
@@ -1345,7 +1404,7 @@ static int dquot_add_space(struct dquot *dquot, qsize_t space,
 	struct super_block *sb = dquot->dq_sb;
 	int ret = 0;
 
-	spin_lock(&dquot->dq_dqb_lock);
+	dquot_dqb_lock(dquot);
 	if (!sb_has_quota_limits_enabled(sb, dquot->dq_id.type) ||
 	    test_bit(DQ_FAKE_B, &dquot->dq_flags))
 		goto finish;
@@ -1441,6 +1500,180 @@ static int info_bdq_free(struct dquot *dquot, qsize_t space)
 	return QUOTA_NL_NOWARN;
 }
 
+/*
+ * Per-CPU counters fold into their central count once a CPU has gathered a
+ * batch, so an estimate from dq_dqb and the central counts is off by less
+ * than a batch per CPU, plus a change in flight per CPU. Charges take the
+ * lockless path only while they stay clear of every limit by twice that,
+ * so limits, grace times and warnings are handled exactly as before.
+ */
+#define DQUOT_PCP_SPACE_BATCH	(1 << 20)
+#define DQUOT_PCP_INODE_BATCH	32
+#define DQUOT_PCP_SLACK(batch)	(2LL * (batch) * num_possible_cpus())
+
+static inline qsize_t dquot_pcp_read(struct dquot *dquot, int item,
+				     qsize_t *usage)
+{
+	return data_race(*usage) + percpu_counter_read(&dquot->dq_pcp[item]);
+}
+
+/* the lowest of a soft and hard limit, 0 if neither is set */
+static inline qsize_t dquot_pcp_limit(qsize_t softlimit, qsize_t hardlimit)
+{
+	if (softlimit && hardlimit)
+		return min(softlimit, hardlimit);
+	return softlimit ?: hardlimit;
+}
+
+static bool dquot_pcp_space_ok(struct dquot *dquot, qsize_t number,
+			       int item, bool free)
+{
+	struct mem_dqblk *dm = &dquot->dq_dqb;
+	qsize_t slack = DQUOT_PCP_SLACK(DQUOT_PCP_SPACE_BATCH);
+	qsize_t limit, space;
+
+	if (number >= DQUOT_PCP_SPACE_BATCH)
+		return false;
+	space = dquot_pcp_read(dquot, DQ_PCP_CURSPACE, &dm->dqb_curspace) +
+		dquot_pcp_read(dquot, DQ_PCP_RSVSPACE, &dm->dqb_rsvspace);
+
+	if (free) {
+		/* no grace time to reset, no warning to clear or issue */
+		if (data_race(dm->dqb_btime) ||
+		    test_bit(DQ_BLKS_B, &dquot->dq_flags))
+			return false;
+		/* and no usage to clamp at zero */
+		if (item == DQ_PCP_CURSPACE &&
+		    dquot_pcp_read(dquot, item, &dm->dqb_curspace) < number + slack)
+			return false;
+		if (item == DQ_PCP_RSVSPACE &&
+		    dquot_pcp_read(dquot, item, &dm->dqb_rsvspace) < number + slack)
+			return false;
+	} else if (!sb_has_quota_limits_enabled(dquot->dq_sb, dquot->dq_id.type) ||
+		   test_bit(DQ_FAKE_B, &dquot->dq_flags)) {
+		return true;
+	}
+
+	limit = dquot_pcp_limit(data_race(dm->dqb_bsoftlimit),
+				data_race(dm->dqb_bhardlimit));
+	return !limit || space + number + slack <= limit;
+}
+
+static bool dquot_pcp_inodes_ok(struct dquot *dquot, qsize_t number,
+				bool free)
+{
+	struct mem_dqblk *dm = &dquot->dq_dqb;
+	qsize_t slack = DQUOT_PCP_SLACK(DQUOT_PCP_INODE_BATCH);
+	qsize_t limit, inodes;
+
+	inodes = dquot_pcp_read(dquot, DQ_PCP_CURINODES, &dm->dqb_curinodes);
+
+	if (free) {
+		if (data_race(dm->dqb_itime) ||
+		    test_bit(DQ_INODES_B, &dquot->dq_flags) ||
+		    inodes < number + slack)
+			return false;
+	} else if (!sb_has_quota_limits_enabled(dquot->dq_sb, dquot->dq_id.type) ||
+		   test_bit(DQ_FAKE_B, &dquot->dq_flags)) {
+		return true;
+	}
+
+	limit = dquot_pcp_limit(data_race(dm->dqb_isoftlimit),
+				data_race(dm->dqb_ihardlimit));
+	return !limit || inodes + number + slack <= limit;
+}
+
+static void dquot_pcp_add(struct dquot *dquot, int item, qsize_t number,
+			  s32 batch)
+{
+	percpu_counter_add_batch(&dquot->dq_pcp[item], number, batch);
+	/* pairs with smp_mb__after_atomic() in dquot_pcp_fold() */
+	smp_mb();
+	if (!test_bit(DQ_PCP_B, &dquot->dq_flags))
+		set_bit(DQ_PCP_B, &dquot->dq_flags);
+}
+
+/*
+ * Account @number bytes of @item (used or reserved space) to all dquots of
+ * an inode without taking dq_dqb_lock, negative @number frees. Returns false
+ * without changing anything if any dquot needs the exact, locked path.
+ * Called under inode->i_lock and dquot_srcu.
+ */
+static bool dquot_pcp_space(struct dquot __rcu * const *dquots,
+			    qsize_t number, int item)
+{
+	bool free = number < 0;
+	struct dquot *dquot;
+	int cnt;
+
+	if (BITS_PER_LONG < 64)
+		return false;
+	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
+		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
+		if (dquot && !dquot_pcp_space_ok(dquot, abs(number), item, free))
+			return false;
+	}
+	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
+		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
+		if (dquot)
+			dquot_pcp_add(dquot, item, number,
+				      DQUOT_PCP_SPACE_BATCH);
+	}
+	return true;
+}
+
+/* As dquot_pcp_space(), for turning reserved space into used space */
+static bool dquot_pcp_claim(struct dquot __rcu * const *dquots,
+			    qsize_t number)
+{
+	qsize_t slack = DQUOT_PCP_SLACK(DQUOT_PCP_SPACE_BATCH);
+	struct dquot *dquot;
+	int cnt;
+
+	if (BITS_PER_LONG < 64)
+		return false;
+	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
+		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
+		if (dquot && dquot_pcp_read(dquot, DQ_PCP_RSVSPACE,
+				&dquot->dq_dqb.dqb_rsvspace) < number + slack)
+			return false;
+	}
+	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
+		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
+		if (!dquot)
+			continue;
+		dquot_pcp_add(dquot, DQ_PCP_CURSPACE, number,
+			      DQUOT_PCP_SPACE_BATCH);
+		dquot_pcp_add(dquot, DQ_PCP_RSVSPACE, -number,
+			      DQUOT_PCP_SPACE_BATCH);
+	}
+	return true;
+}
+
+/* As dquot_pcp_space(), for the inode count */
+static bool dquot_pcp_inodes(struct dquot __rcu * const *dquots,
+			     qsize_t number)
+{
+	bool free = number < 0;
+	struct dquot *dquot;
+	int cnt;
+
+	if (BITS_PER_LONG < 64)
+		return false;
+	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
+		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
+		if (dquot && !dquot_pcp_inodes_ok(dquot, abs(number), free))
+			return false;
+	}
+	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
+		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
+		if (dquot)
+			dquot_pcp_add(dquot, DQ_PCP_CURINODES, number,
+				      DQUOT_PCP_INODE_BATCH);
+	}
+	return true;
+}
+
 static int inode_quota_active(const struct inode *inode)
 {
 	struct super_block *sb = inode->i_sb;
@@ -1550,7 +1783,7 @@ static int __dquot_initialize(struct inode *inode, int type)
 				spin_lock(&inode->i_lock);
 				/* Get reservation again under proper lock */
 				rsv = __inode_get_rsv_space(inode);
-				spin_lock(&dquot->dq_dqb_lock);
+				dquot_dqb_lock(dquot);
 				dquot->dq_dqb.dqb_rsvspace += rsv;
 				spin_unlock(&dquot->dq_dqb_lock);
 				spin_unlock(&inode->i_lock);
@@ -1707,6 +1940,9 @@ int __dquot_alloc_space(struct inode *inode, qsize_t number, int flags)
 	dquots = i_dquot(inode);
 	index = srcu_read_lock(&dquot_srcu);
 	spin_lock(&inode->i_lock);
+	if (dquot_pcp_space(dquots, number,
+			    reserve ? DQ_PCP_RSVSPACE : DQ_PCP_CURSPACE))
+		goto charged;
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
 		if (!dquot)
@@ -1722,7 +1958,7 @@ int __dquot_alloc_space(struct inode *inode, qsize_t number, int flags)
 				dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
 				if (!dquot)
 					continue;
-				spin_lock(&dquot->dq_dqb_lock);
+				dquot_dqb_lock(dquot);
 				if (reserve)
 					dquot_free_reserved_space(dquot, number);
 				else
@@ -1733,6 +1969,7 @@ int __dquot_alloc_space(struct inode *inode, qsize_t number, int flags)
 			goto out_flush_warn;
 		}
 	}
+charged:
 	if (reserve)
 		*inode_reserved_space(inode) += number;
 	else
@@ -1768,6 +2005,8 @@ int dquot_alloc_inode(struct inode *inode)
 	dquots = i_dquot(inode);
 	index = srcu_read_lock(&dquot_srcu);
 	spin_lock(&inode->i_lock);
+	if (dquot_pcp_inodes(dquots, 1))
+		goto warn_put_all;
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
 		if (!dquot)
@@ -1779,7 +2018,7 @@ int dquot_alloc_inode(struct inode *inode)
 				if (!dquot)
 					continue;
 				/* Back out changes we already did */
-				spin_lock(&dquot->dq_dqb_lock);
+				dquot_dqb_lock(dquot);
 				dquot_decr_inodes(dquot, 1);
 				spin_unlock(&dquot->dq_dqb_lock);
 			}
@@ -1817,11 +2056,13 @@ void dquot_claim_space_nodirty(struct inode *inode, qsize_t number)
 	dquots = i_dquot(inode);
 	index = srcu_read_lock(&dquot_srcu);
 	spin_lock(&inode->i_lock);
+	if (dquot_pcp_claim(dquots, number))
+		goto claimed;
 	/* Claim reserved quotas to allocated quotas */
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
 		if (dquot) {
-			spin_lock(&dquot->dq_dqb_lock);
+			dquot_dqb_lock(dquot);
 			if (WARN_ON_ONCE(dquot->dq_dqb.dqb_rsvspace < number))
 				number = dquot->dq_dqb.dqb_rsvspace;
 			dquot->dq_dqb.dqb_curspace += number;
@@ -1829,6 +2070,7 @@ void dquot_claim_space_nodirty(struct inode *inode, qsize_t number)
 			spin_unlock(&dquot->dq_dqb_lock);
 		}
 	}
+claimed:
 	/* Update inode bytes */
 	*inode_reserved_space(inode) -= number;
 	__inode_add_bytes(inode, number);
@@ -1862,7 +2104,7 @@ void dquot_reclaim_space_nodirty(struct inode *inode, qsize_t number)
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
 		if (dquot) {
-			spin_lock(&dquot->dq_dqb_lock);
+			dquot_dqb_lock(dquot);
 			if (WARN_ON_ONCE(dquot->dq_dqb.dqb_curspace < number))
 				number = dquot->dq_dqb.dqb_curspace;
 			dquot->dq_dqb.dqb_rsvspace += number;
@@ -1901,17 +2143,22 @@ void __dquot_free_space(struct inode *inode, qsize_t number, int flags)
 		return;
 	}
 
+	for (cnt = 0; cnt < MAXQUOTAS; cnt++)
+		warn[cnt].w_type = QUOTA_NL_NOWARN;
+
 	dquots = i_dquot(inode);
 	index = srcu_read_lock(&dquot_srcu);
 	spin_lock(&inode->i_lock);
+	if (dquot_pcp_space(dquots, -number,
+			    reserve ? DQ_PCP_RSVSPACE : DQ_PCP_CURSPACE))
+		goto freed;
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		int wtype;
 
-		warn[cnt].w_type = QUOTA_NL_NOWARN;
 		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
 		if (!dquot)
 			continue;
-		spin_lock(&dquot->dq_dqb_lock);
+		dquot_dqb_lock(dquot);
 		wtype = info_bdq_free(dquot, number);
 		if (wtype != QUOTA_NL_NOWARN)
 			prepare_warning(&warn[cnt], dquot, wtype);
@@ -1921,6 +2168,7 @@ void __dquot_free_space(struct inode *inode, qsize_t number, int flags)
 			dquot_decr_space(dquot, number);
 		spin_unlock(&dquot->dq_dqb_lock);
 	}
+freed:
 	if (reserve)
 		*inode_reserved_space(inode) -= number;
 	else
@@ -1950,22 +2198,28 @@ void dquot_free_inode(struct inode *inode)
 	if (!inode_quota_active(inode))
 		return;
 
+	for (cnt = 0; cnt < MAXQUOTAS; cnt++)
+		warn[cnt].w_type = QUOTA_NL_NOWARN;
+
 	dquots = i_dquot(inode);
 	index = srcu_read_lock(&dquot_srcu);
 	spin_lock(&inode->i_lock);
+	if (dquot_pcp_inodes(dquots, -1))
+		goto freed;
 	for (cnt = 0; cnt < MAXQUOTAS; cnt++) {
 		int wtype;
-		warn[cnt].w_type = QUOTA_NL_NOWARN;
+
 		dquot = srcu_dereference(dquots[cnt], &dquot_srcu);
 		if (!dquot)
 			continue;
-		spin_lock(&dquot->dq_dqb_lock);
+		dquot_dqb_lock(dquot);
 		wtype = info_idq_free(dquot, 1);
 		if (wtype != QUOTA_NL_NOWARN)
 			prepare_warning(&warn[cnt], dquot, wtype);
 		dquot_decr_inodes(dquot, 1);
 		spin_unlock(&dquot->dq_dqb_lock);
 	}
+freed:
 	spin_unlock(&inode->i_lock);
 	mark_all_dquot_dirty(dquots);
 	srcu_read_unlock(&dquot_srcu, index);
@@ -2047,7 +2301,7 @@ int __dquot_transfer(struct inode *inode, struct dquot **transfer_to)
 		ret = dquot_add_space(transfer_to[cnt], cur_space, rsv_space,
 				      DQUOT_SPACE_WARN, &warn_to[cnt]);
 		if (ret) {
-			spin_lock(&transfer_to[cnt]->dq_dqb_lock);
+			dquot_dqb_lock(transfer_to[cnt]);
 			dquot_decr_inodes(transfer_to[cnt], inode_usage);
 			spin_unlock(&transfer_to[cnt]->dq_dqb_lock);
 			goto over_quota;
@@ -2062,7 +2316,7 @@ int __dquot_transfer(struct inode *inode, struct dquot **transfer_to)
 		if (transfer_from[cnt]) {
 			int wtype;
 
-			spin_lock(&transfer_from[cnt]->dq_dqb_lock);
+			dquot_dqb_lock(transfer_from[cnt]);
 			wtype = info_idq_free(transfer_from[cnt], inode_usage);
 			if (wtype != QUOTA_NL_NOWARN)
 				prepare_warning(&warn_from_inodes[cnt],
@@ -2110,7 +2364,7 @@ over_quota:
 	for (cnt--; cnt >= 0; cnt--) {
 		if (!is_valid[cnt])
 			continue;
-		spin_lock(&transfer_to[cnt]->dq_dqb_lock);
+		dquot_dqb_lock(transfer_to[cnt]);
 		dquot_decr_inodes(transfer_to[cnt], inode_usage);
 		dquot_decr_space(transfer_to[cnt], cur_space);
 		dquot_free_reserved_space(transfer_to[cnt], rsv_space);
@@ -2668,7 +2922,7 @@ static void do_get_dqblk(struct dquot *dquot, struct qc_dqblk *di)
 	struct mem_dqblk *dm = &dquot->dq_dqb;
 
 	memset(di, 0, sizeof(*di));
-	spin_lock(&dquot->dq_dqb_lock);
+	dquot_dqb_lock(dquot);
 	di->d_spc_hardlimit = dm->dqb_bhardlimit;
 	di->d_spc_softlimit = dm->dqb_bsoftlimit;
 	di->d_ino_hardlimit = dm->dqb_ihardlimit;
@@ -2742,7 +2996,7 @@ static int do_set_dqblk(struct dquot *dquot, struct qc_dqblk *di)
 	     (di->d_ino_hardlimit > dqi->dqi_max_ino_limit)))
 		return -ERANGE;
 
-	spin_lock(&dquot->dq_dqb_lock);
+	dquot_dqb_lock(dquot);
 	if (di->d_fieldmask & QC_SPACE) {
 		dm->dqb_curspace = di->d_space - dm->dqb_rsvspace;
 		check_blim = 1;
@@ -85,7 +85,9 @@ static int v1_commit_dqblk(struct dquot *dquot)
 	ssize_t ret;
 	struct v1_disk_dqblk dqblk;
 
+	dquot_dqb_lock(dquot);
 	v1_mem2disk_dqblk(&dqblk, &dquot->dq_dqb);
+	spin_unlock(&dquot->dq_dqb_lock);
 	if (((type == USRQUOTA) && uid_eq(dquot->dq_id.uid, GLOBAL_ROOT_UID)) ||
 	    ((type == GRPQUOTA) && gid_eq(dquot->dq_id.gid, GLOBAL_ROOT_GID))) {
 		dqblk.dqb_btime =
@@ -34,6 +34,7 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -563,6 +564,116 @@ out:
 	return 1;
 }
 
+/*
+ * Read and decompress one datablock into the (locked) readahead pages,
+ * which are unlocked and released afterwards.  The pages are the last
+ * thing touched, as they pin the inode and the superblock.
+ */
+static int squashfs_readahead_block(struct inode *inode, struct page **pages,
+	unsigned int nr_pages, u64 block, int bsize, unsigned int expected,
+	loff_t start)
+{
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	loff_t file_end = i_size_read(inode) >> msblk->block_log;
+	struct squashfs_page_actor *actor;
+	struct page *last_page;
+	int i, res = -ENOMEM;
+
+	actor = squashfs_page_actor_init_special(msblk, pages, nr_pages,
+						expected, start);
+	if (!actor)
+		goto out;
+
+	res = squashfs_read_data(inode->i_sb, block, bsize, NULL, actor);
+
+	last_page = squashfs_page_actor_free(actor);
+
+	if (res == expected && !IS_ERR(last_page)) {
+		int bytes;
+
+		/* Last page (if present) may have trailing bytes not filled */
+		bytes = res % PAGE_SIZE;
+		if (start >> msblk->block_log == file_end && bytes && last_page)
+			memzero_page(last_page, bytes,
+				     PAGE_SIZE - bytes);
+
+		for (i = 0; i < nr_pages; i++) {
+			flush_dcache_page(pages[i]);
+			SetPageUptodate(pages[i]);
+		}
+	}
+	res = 0;
+
+out:
+	for (i = 0; i < nr_pages; i++) {
+		unlock_page(pages[i]);
+		put_page(pages[i]);
+	}
+	return res;
+}
+
+/*
+ * With more than one decompressor, the datablocks of a readahead request
+ * are read and decompressed by workers, so that the reads of a large
+ * sequential request are in flight together and decompression runs on
+ * as many CPUs as there are decompressors.
+ */
+static struct workqueue_struct *squashfs_read_wq;
+
+struct squashfs_readahead_work {
+	struct work_struct	work;
+	struct inode		*inode;
+	u64			block;
+	int			bsize;
+	unsigned int		expected;
+	loff_t			start;
+	unsigned int		nr_pages;
+	struct page		*pages[];
+};
+
+static void squashfs_readahead_workfn(struct work_struct *work)
+{
+	struct squashfs_readahead_work *ra =
+		container_of(work, struct squashfs_readahead_work, work);
+
+	squashfs_readahead_block(ra->inode, ra->pages, ra->nr_pages,
+				 ra->block, ra->bsize, ra->expected, ra->start);
+	kfree(ra);
+}
+
+static bool squashfs_readahead_queue(struct inode *inode, struct page **pages,
+	unsigned int nr_pages, u64 block, int bsize, unsigned int expected,
+	loff_t start)
+{
+	struct squashfs_readahead_work *ra;
+
+	ra = kmalloc(struct_size(ra, pages, nr_pages), GFP_KERNEL | __GFP_NOWARN);
+	if (!ra)
+		return false;
+
+	INIT_WORK(&ra->work, squashfs_readahead_workfn);
+	ra->inode = inode;
+	ra->block = block;
+	ra->bsize = bsize;
+	ra->expected = expected;
+	ra->start = start;
+	ra->nr_pages = nr_pages;
+	memcpy(ra->pages, pages, nr_pages * sizeof(*pages));
+	queue_work(squashfs_read_wq, &ra->work);
+	return true;
+}
+
+int __init squashfs_init_readahead(void)
+{
+	squashfs_read_wq = alloc_workqueue("squashfs_read", WQ_UNBOUND, 0);
+	return squashfs_read_wq ? 0 : -ENOMEM;
+}
+
+void squashfs_exit_readahead(void)
+{
+	destroy_workqueue(squashfs_read_wq);
+}
+
 static void squashfs_readahead(struct readahead_control *ractl)
 {
 	struct inode *inode = ractl->mapping->host;
@@ -571,7 +682,6 @@ static void squashfs_readahead(struct readahead_control *ractl)
 	unsigned short shift = msblk->block_log - PAGE_SHIFT;
 	loff_t start = readahead_pos(ractl) & ~mask;
 	size_t len = readahead_length(ractl) + readahead_pos(ractl) - start;
-	struct squashfs_page_actor *actor;
 	unsigned int nr_pages = 0;
 	struct page **pages;
 	int i;
@@ -588,7 +698,6 @@ static void squashfs_readahead(struct readahead_control *ractl)
 		int res, bsize;
 		u64 block = 0;
 		unsigned int expected;
-		struct page *last_page;
 
 		expected = start >> msblk->block_log == file_end ?
 			   (i_size_read(inode) & (msblk->block_size - 1)) :
@@ -616,34 +725,17 @@ static void squashfs_readahead(struct readahead_control *ractl)
 		if (bsize == 0)
 			goto skip_pages;
 
-		actor = squashfs_page_actor_init_special(msblk, pages, nr_pages,
-							expected, start);
-		if (!actor)
-			goto skip_pages;
-
-		res = squashfs_read_data(inode->i_sb, block, bsize, NULL, actor);
-
-		last_page = squashfs_page_actor_free(actor);
-
-		if (res == expected && !IS_ERR(last_page)) {
-			int bytes;
-
-			/* Last page (if present) may have trailing bytes not filled */
-			bytes = res % PAGE_SIZE;
-			if (start >> msblk->block_log == file_end && bytes && last_page)
-				memzero_page(last_page, bytes,
-					     PAGE_SIZE - bytes);
-
-			for (i = 0; i < nr_pages; i++) {
-				flush_dcache_page(pages[i]);
-				SetPageUptodate(pages[i]);
-			}
+		if (msblk->max_thread_num > 1 &&
+		    squashfs_readahead_queue(inode, pages, nr_pages, block,
+					     bsize, expected, start)) {
+			start += readahead_batch_length(ractl);
+			continue;
 		}
 
-		for (i = 0; i < nr_pages; i++) {
-			unlock_page(pages[i]);
-			put_page(pages[i]);
-		}
+		res = squashfs_readahead_block(inode, pages, nr_pages, block,
+					       bsize, expected, start);
+		if (res)
+			break;
 
 		start += readahead_batch_length(ractl);
 	}
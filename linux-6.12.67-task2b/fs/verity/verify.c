@@ -12,6 +12,23 @@
 
 static struct workqueue_struct *fsverity_read_workqueue;
 
+/*
+ * Consecutive data blocks of a folio or bio mostly hash into the same level 0
+ * hash page, so keep a reference to the last one while verifying them rather
+ * than looking it up again through ->read_merkle_tree_page() for every block.
+ */
+struct fsverity_verify_ctx {
+	struct page *hpage;
+	pgoff_t hpage_idx;
+};
+
+static void fsverity_verify_ctx_put(struct fsverity_verify_ctx *ctx)
+{
+	if (ctx->hpage)
+		put_page(ctx->hpage);
+	ctx->hpage = NULL;
+}
+
 /*
  * Returns true if the hash block with index @hblock_idx in the tree, located in
  * @hpage, has already been verified.
@@ -90,7 +107,8 @@ static bool is_hash_block_verified(struct fsverity_info *vi, struct page *hpage,
  */
 static bool
 verify_data_block(struct inode *inode, struct fsverity_info *vi,
-		  const void *data, u64 data_pos, unsigned long max_ra_pages)
+		  struct fsverity_verify_ctx *ctx, const void *data,
+		  u64 data_pos, unsigned long max_ra_pages)
 {
 	const struct merkle_tree_params *params = &vi->tree_params;
 	const unsigned int hsize = params->digest_size;
@@ -169,14 +187,25 @@ verify_data_block(struct inode *inode, struct fsverity_info *vi,
 		hoffset = (hidx << params->log_digestsize) &
 			  (params->block_size - 1);
 
-		hpage = inode->i_sb->s_vop->read_merkle_tree_page(inode,
-				hpage_idx, level == 0 ? min(max_ra_pages,
-					params->tree_pages - hpage_idx) : 0);
-		if (IS_ERR(hpage)) {
-			fsverity_err(inode,
-				     "Error %ld reading Merkle tree page %lu",
-				     PTR_ERR(hpage), hpage_idx);
-			goto error;
+		if (level == 0 && ctx->hpage && ctx->hpage_idx == hpage_idx) {
+			hpage = ctx->hpage;
+			get_page(hpage);
+		} else {
+			hpage = inode->i_sb->s_vop->read_merkle_tree_page(inode,
+					hpage_idx, level == 0 ? min(max_ra_pages,
+						params->tree_pages - hpage_idx) : 0);
+			if (IS_ERR(hpage)) {
+				fsverity_err(inode,
+					     "Error %ld reading Merkle tree page %lu",
+					     PTR_ERR(hpage), hpage_idx);
+				goto error;
+			}
+			if (level == 0) {
+				fsverity_verify_ctx_put(ctx);
+				get_page(hpage);
+				ctx->hpage = hpage;
+				ctx->hpage_idx = hpage_idx;
+			}
 		}
 		haddr = kmap_local_page(hpage) + hblock_offset_in_page;
 		if (is_hash_block_verified(vi, hpage, hblock_idx)) {
@@ -243,8 +272,8 @@ error:
 }
 
 static bool
-verify_data_blocks(struct folio *data_folio, size_t len, size_t offset,
-		   unsigned long max_ra_pages)
+verify_data_blocks(struct folio *data_folio, struct fsverity_verify_ctx *ctx,
+		   size_t len, size_t offset, unsigned long max_ra_pages)
 {
 	struct inode *inode = data_folio->mapping->host;
 	struct fsverity_info *vi = inode->i_verity_info;
@@ -261,7 +290,7 @@ verify_data_blocks(struct folio *data_folio, size_t len, size_t offset,
 		bool valid;
 
 		data = kmap_local_folio(data_folio, offset);
-		valid = verify_data_block(inode, vi, data, pos + offset,
+		valid = verify_data_block(inode, vi, ctx, data, pos + offset,
 					  max_ra_pages);
 		kunmap_local(data);
 		if (!valid)
@@ -286,7 +315,12 @@ verify_data_blocks(struct folio *data_folio, size_t len, size_t offset,
  */
 bool fsverity_verify_blocks(struct folio *folio, size_t len, size_t offset)
 {
-	return verify_data_blocks(folio, len, offset, 0);
+	struct fsverity_verify_ctx ctx = {};
+	bool valid;
+
+	valid = verify_data_blocks(folio, &ctx, len, offset, 0);
+	fsverity_verify_ctx_put(&ctx);
+	return valid;
 }
 EXPORT_SYMBOL_GPL(fsverity_verify_blocks);
 
@@ -307,6 +341,7 @@ EXPORT_SYMBOL_GPL(fsverity_verify_blocks);
  */
 void fsverity_verify_bio(struct bio *bio)
 {
+	struct fsverity_verify_ctx ctx = {};
 	struct folio_iter fi;
 	unsigned long max_ra_pages = 0;
 
@@ -324,12 +359,13 @@ void fsverity_verify_bio(struct bio *bio)
 	}
 
 	bio_for_each_folio_all(fi, bio) {
-		if (!verify_data_blocks(fi.folio, fi.length, fi.offset,
+		if (!verify_data_blocks(fi.folio, &ctx, fi.length, fi.offset,
 					max_ra_pages)) {
 			bio->bi_status = BLK_STS_IOERR;
 			break;
 		}
 	}
+	fsverity_verify_ctx_put(&ctx);
 }
 EXPORT_SYMBOL_GPL(fsverity_verify_bio);
 #endif /* CONFIG_BLOCK */
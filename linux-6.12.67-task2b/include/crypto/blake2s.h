@@ -86,6 +86,10 @@ static inline void blake2s_init_key(struct blake2s_state *state,
 void blake2s_update(struct blake2s_state *state, const u8 *in, size_t inlen);
 void blake2s_final(struct blake2s_state *state, u8 *out);
 
+void blake2s_many(u8 *const out[], const u8 *const in[], const size_t inlen[],
+		  unsigned int nr, const u8 *key, const size_t outlen,
+		  const size_t keylen);
+
 static inline void blake2s(u8 *out, const u8 *in, const u8 *key,
 			   const size_t outlen, const size_t inlen,
 			   const size_t keylen)
@@ -1257,6 +1257,8 @@ struct bpf_dispatcher {
 	void *image;
 	void *rw_image;
 	u32 image_off;
+	int image_num_progs;
+	struct delayed_work update_work;
 	struct bpf_ksym ksym;
 #ifdef CONFIG_HAVE_STATIC_CALL
 	struct static_call_key *sc_key;
@@ -1349,6 +1351,8 @@ int arch_prepare_bpf_dispatcher(void *image, void *buf, s64 *funcs, int num_func
 #define __BPF_DISPATCHER_UPDATE(_d, _new)
 #endif
 
+void bpf_dispatcher_update_workfn(struct work_struct *work);
+
 #define BPF_DISPATCHER_INIT(_name) {				\
 	.mutex = __MUTEX_INITIALIZER(_name.mutex),		\
 	.func = &_name##_func,					\
@@ -1356,6 +1360,9 @@ int arch_prepare_bpf_dispatcher(void *image, void *buf, s64 *funcs, int num_func
 	.num_progs = 0,						\
 	.image = NULL,						\
 	.image_off = 0,						\
+	.image_num_progs = 0,					\
+	.update_work = __DELAYED_WORK_INITIALIZER(		\
+		_name.update_work, bpf_dispatcher_update_workfn, 0),	\
 	.ksym = {						\
 		.name  = #_name,				\
 		.lnode = LIST_HEAD_INIT(_name.ksym.lnode),	\
@@ -2318,6 +2325,8 @@ struct bpf_prog *bpf_prog_get_curr_or_next(u32 *id);
 
 int bpf_map_alloc_pages(const struct bpf_map *map, gfp_t gfp, int nid,
 			unsigned long nr_pages, struct page **page_array);
+int bpf_map_alloc_pages_order(const struct bpf_map *map, gfp_t gfp, int nid,
+			      unsigned int order, struct page **page_array);
 #ifdef CONFIG_MEMCG
 void *bpf_map_kmalloc_node(const struct bpf_map *map, size_t size, gfp_t flags,
 			   int node);
@@ -515,6 +515,7 @@ struct bpf_verifier_state_list {
 	struct bpf_verifier_state state;
 	struct bpf_verifier_state_list *next;
 	int miss_cnt, hit_cnt;
+	u32 key; /* state_key() of insn_idx and callsites */
 };
 
 struct bpf_loop_inline_state {
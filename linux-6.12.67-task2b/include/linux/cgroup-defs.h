@@ -534,6 +534,12 @@ struct cgroup {
 	 */
 	struct cgroup	*rstat_flush_next;
 
+	/*
+	 * jiffies at the start of the last completed flush of this subtree,
+	 * see cgroup_rstat_flush_shared().  Written under cgroup_rstat_lock.
+	 */
+	unsigned long	rstat_flush_time;
+
 	/* cgroup basic resource statistics */
 	struct cgroup_base_stat last_bstat;
 	struct cgroup_base_stat bstat;
@@ -370,6 +370,15 @@ irq_create_affinity_masks(unsigned int nvec, struct irq_affinity *affd);
 unsigned int irq_calc_affinity_vectors(unsigned int minvec, unsigned int maxvec,
 				       const struct irq_affinity *affd);
 
+#ifdef CONFIG_IRQ_BALANCE
+extern int irq_balance_hint(unsigned int irq);
+#else
+static inline int irq_balance_hint(unsigned int irq)
+{
+	return -1;
+}
+#endif
+
 #else /* CONFIG_SMP */
 
 static inline int irq_set_affinity(unsigned int irq, const struct cpumask *m)
@@ -432,6 +441,11 @@ irq_calc_affinity_vectors(unsigned int minvec, unsigned int maxvec,
 	return maxvec;
 }
 
+static inline int irq_balance_hint(unsigned int irq)
+{
+	return -1;
+}
+
 #endif /* CONFIG_SMP */
 
 /*
@@ -820,9 +834,31 @@ static inline void init_irq_proc(void)
 #endif
 
 #ifdef CONFIG_IRQ_TIMINGS
+/**
+ * struct irq_timings_hint - interrupt coalescing hint
+ * @mode:	IRQ_TIMINGS_HINT_BATCH if the device should coalesce for
+ *		@delay_ns, IRQ_TIMINGS_HINT_IMMEDIATE if it should not
+ *		coalesce at all, IRQ_TIMINGS_HINT_NONE to keep its default
+ * @interval_ns: average interval between two interrupts, 0 if unknown
+ * @next_ns:	predicted time until the next interrupt on this CPU, 0 if
+ *		unknown
+ * @delay_ns:	suggested coalescing delay
+ */
+struct irq_timings_hint {
+	enum {
+		IRQ_TIMINGS_HINT_NONE,
+		IRQ_TIMINGS_HINT_IMMEDIATE,
+		IRQ_TIMINGS_HINT_BATCH,
+	} mode;
+	u64	interval_ns;
+	u64	next_ns;
+	u64	delay_ns;
+};
+
 void irq_timings_enable(void);
 void irq_timings_disable(void);
 u64 irq_timings_next_event(u64 now);
+int irq_timings_get_hint(unsigned int irq, struct irq_timings_hint *hint);
 #endif
 
 struct seq_file;
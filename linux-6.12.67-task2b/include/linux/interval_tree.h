@@ -2,6 +2,7 @@
 #ifndef _LINUX_INTERVAL_TREE_H
 #define _LINUX_INTERVAL_TREE_H
 
+#include <linux/gfp_types.h>
 #include <linux/rbtree.h>
 
 struct interval_tree_node {
@@ -85,4 +86,81 @@ interval_tree_span_iter_done(struct interval_tree_span_iter *state)
 	     !interval_tree_span_iter_done(span);                              \
 	     interval_tree_span_iter_next(span))
 
+/*
+ * Static interval index
+ *
+ * For a set of intervals which rarely changes but is queried a lot, a
+ * snapshot of an interval tree can be laid out as an implicit augmented
+ * binary tree in one array, in eytzinger (breadth-first) order: the
+ * children of entry i are entries 2i and 2i + 1, so each level of the
+ * search touches the next cacheline or two and the grandchildren can be
+ * prefetched before the comparison is made.
+ *
+ * The index does not track the rbtree it was built from. After changing
+ * the tree, call interval_tree_static_invalidate(); queries then fall back
+ * to the rbtree until interval_tree_static_build() is called again. Queries
+ * need the same serialization against updates as queries on the rbtree.
+ */
+struct interval_tree_static_entry {
+	unsigned long start;
+	unsigned long last;
+	unsigned long subtree_last;
+	struct interval_tree_node *node;
+};
+
+/**
+ * struct interval_tree_static - Static interval index
+ * @entries: Intervals in eytzinger order, indexed from 1
+ * @nr: Number of intervals in @entries
+ * @valid: @entries matches @root, queries use the static layout
+ * @root: The interval tree the index was built from
+ */
+struct interval_tree_static {
+	/* private: not for use by the caller */
+	struct interval_tree_static_entry *entries;
+	unsigned int nr;
+	bool valid;
+	struct rb_root_cached *root;
+};
+
+/**
+ * struct interval_tree_static_iter - Iterate a static interval index
+ *
+ * Iteration state for interval_tree_static_iter_first() and
+ * interval_tree_static_iter_next().
+ */
+struct interval_tree_static_iter {
+	/* private: not for use by the caller */
+	const struct interval_tree_static *its;
+	struct interval_tree_node *node;
+	unsigned int pos;
+	unsigned long start;
+	unsigned long last;
+};
+
+int interval_tree_static_build(struct interval_tree_static *its,
+			       struct rb_root_cached *root, gfp_t gfp);
+void interval_tree_static_destroy(struct interval_tree_static *its);
+
+static inline void
+interval_tree_static_invalidate(struct interval_tree_static *its)
+{
+	its->valid = false;
+}
+
+struct interval_tree_node *
+interval_tree_static_iter_first(const struct interval_tree_static *its,
+				struct interval_tree_static_iter *iter,
+				unsigned long start, unsigned long last);
+struct interval_tree_node *
+interval_tree_static_iter_next(struct interval_tree_static_iter *iter);
+
+void interval_tree_static_lookup(const struct interval_tree_static *its,
+				 const unsigned long *index, unsigned int nr,
+				 struct interval_tree_node **nodes);
+
+#define interval_tree_static_for_each(node, its, iter, start, last)	       \
+	for (node = interval_tree_static_iter_first(its, iter, start, last);  \
+	     node; node = interval_tree_static_iter_next(iter))
+
 #endif	/* _LINUX_INTERVAL_TREE_H */
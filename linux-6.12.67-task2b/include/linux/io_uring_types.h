@@ -40,6 +40,8 @@ enum io_uring_cmd_flags {
 	IO_URING_F_TASK_DEAD		= (1 << 13),
 };
 
+struct io_lat_stats;
+
 struct io_wq_work_node {
 	struct io_wq_work_node *next;
 };
@@ -407,10 +409,14 @@ struct io_ring_ctx {
 	/* napi busy poll default timeout */
 	ktime_t			napi_busy_poll_dt;
 	bool			napi_prefer_busy_poll;
+	bool			napi_adaptive;
 	bool			napi_enabled;
 
 	DECLARE_HASHTABLE(napi_ht, 4);
 #endif
+#ifdef CONFIG_IO_URING_STATS
+	struct io_lat_stats	*lat_stats;
+#endif
 
 	/* protected by ->completion_lock */
 	unsigned			evfd_last_cq_tail;
@@ -669,6 +675,12 @@ struct io_kiocb {
 		u64			extra1;
 		u64			extra2;
 	} big_cqe;
+
+#ifdef CONFIG_IO_URING_STATS
+	/* ktime_get_ns() at submission and first issue, see stats.h */
+	u64				submit_ns;
+	u64				issue_ns;
+#endif
 };
 
 struct io_overflow_cqe {
@@ -8,6 +8,17 @@
 #include <uapi/linux/ipc.h>
 #include <linux/refcount.h>
 
+#ifdef CONFIG_SYSVIPC_STATS
+/* activity of one ipc object, see ipc_stats_show() */
+struct ipc_stats {
+	atomic64_t	ops;		/* semop()s, msgsnd()s and msgrcv()s */
+	atomic64_t	contended;	/* object or semaphore lock was busy */
+	atomic64_t	sleeps;		/* sleeps in semop() and msgrcv() */
+	atomic64_t	sleep_ns;	/* total time of those sleeps */
+	atomic64_t	max_sleep_ns;
+};
+#endif
+
 /* used by in-kernel data structures */
 struct kern_ipc_perm {
 	spinlock_t	lock;
@@ -26,6 +37,9 @@ struct kern_ipc_perm {
 
 	struct rcu_head rcu;
 	refcount_t refcount;
+#ifdef CONFIG_SYSVIPC_STATS
+	struct ipc_stats stats;
+#endif
 } ____cacheline_aligned_in_smp __randomize_layout;
 
 #endif /* _LINUX_IPC_H */
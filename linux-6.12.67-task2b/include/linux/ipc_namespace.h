@@ -14,6 +14,7 @@
 #include <linux/percpu_counter.h>
 
 struct user_namespace;
+struct ipc_id_cache;
 
 struct ipc_ids {
 	int in_use;
@@ -26,6 +27,7 @@ struct ipc_ids {
 	int next_id;
 #endif
 	struct rhashtable key_ht;
+	struct ipc_id_cache __percpu *id_cache;	/* may be NULL */
 };
 
 struct ipc_namespace {
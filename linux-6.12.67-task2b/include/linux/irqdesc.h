@@ -49,6 +49,9 @@ struct irqstat {
  * @affinity_hint:	hint to user space for preferred irq affinity
  * @affinity_notify:	context for notification of affinity changes
  * @pending_mask:	pending rebalanced interrupts
+ * @balance_count:	tot_count at the last sample of the interrupt balancer
+ * @balance_delta:	interrupts seen in the last balancer interval
+ * @balance_hint:	less loaded CPU suggested for a managed interrupt
  * @threads_oneshot:	bitfield to handle shared oneshot threads
  * @threads_active:	number of irqaction threads currently running
  * @wait_for_threads:	wait queue for sync_irq to wait for threaded handlers
@@ -89,6 +92,11 @@ struct irq_desc {
 #ifdef CONFIG_GENERIC_PENDING_IRQ
 	cpumask_var_t		pending_mask;
 #endif
+#ifdef CONFIG_IRQ_BALANCE
+	unsigned int		balance_count;
+	unsigned int		balance_delta;
+	int			balance_hint;
+#endif
 #endif
 	unsigned long		threads_oneshot;
 	atomic_t		threads_active;
@@ -37,6 +37,7 @@
  */
 
 #include <linux/array_size.h>
+#include <linux/cache.h>
 #include <linux/spinlock.h>
 #include <linux/stddef.h>
 #include <linux/types.h>
@@ -967,4 +968,69 @@ extern unsigned int __kfifo_out_linear_r(struct __kfifo *fifo,
 
 extern unsigned int __kfifo_max_r(unsigned int len, size_t recsize);
 
+/*
+ * Multi-producer, multi-consumer fifo of records.
+ *
+ * Unlike the fifos above, any number of writers and readers may use a
+ * kfifo_mp concurrently without locking. It holds a power of two number of
+ * slots, each with a sequence number and room for one record of up to
+ * @esize bytes. Writers claim a slot by advancing @in with cmpxchg, fill it
+ * and publish it through its sequence number; readers do the same with @out.
+ *
+ * A writer or reader stalled between prepare and finish holds up the readers
+ * or writers that follow it in the ring until it is done, but never loses or
+ * reorders records. The prepare/finish pairs give direct access to a slot, for
+ * example to fill it by DMA in place.
+ */
+struct kfifo_mp {
+	unsigned int	in ____cacheline_aligned_in_smp;
+	unsigned int	out ____cacheline_aligned_in_smp;
+	unsigned int	mask ____cacheline_aligned_in_smp;
+	unsigned int	esize;
+	unsigned int	slot_size;
+	void		*data;
+};
+
+extern int kfifo_mp_alloc(struct kfifo_mp *fifo, unsigned int size,
+	unsigned int esize, gfp_t gfp_mask);
+
+extern void kfifo_mp_free(struct kfifo_mp *fifo);
+
+extern void *kfifo_mp_in_prepare(struct kfifo_mp *fifo, unsigned int *pos);
+
+extern void kfifo_mp_in_finish(struct kfifo_mp *fifo, unsigned int pos,
+	unsigned int len);
+
+extern const void *kfifo_mp_out_prepare(struct kfifo_mp *fifo,
+	unsigned int *pos, unsigned int *len);
+
+extern void kfifo_mp_out_finish(struct kfifo_mp *fifo, unsigned int pos);
+
+extern unsigned int kfifo_mp_in(struct kfifo_mp *fifo,
+	const void *buf, unsigned int len);
+
+extern unsigned int kfifo_mp_out(struct kfifo_mp *fifo,
+	void *buf, unsigned int len);
+
+/**
+ * kfifo_mp_len - returns the number of records in the fifo
+ * @fifo: address of the fifo
+ *
+ * This includes records still being written or read, and is only a snapshot
+ * when other CPUs use the fifo concurrently.
+ */
+static inline unsigned int kfifo_mp_len(struct kfifo_mp *fifo)
+{
+	return READ_ONCE(fifo->in) - READ_ONCE(fifo->out);
+}
+
+/**
+ * kfifo_mp_is_empty - returns true if the fifo is empty
+ * @fifo: address of the fifo
+ */
+static inline bool kfifo_mp_is_empty(struct kfifo_mp *fifo)
+{
+	return !kfifo_mp_len(fifo);
+}
+
 #endif
@@ -391,6 +391,7 @@ struct kvm_vcpu {
 	struct kvm_vcpu_arch arch;
 	struct kvm_vcpu_stat stat;
 	char stats_id[KVM_STATS_NAME_SIZE];
+	struct kvm_stats_mmap *stats_map;
 	struct kvm_dirty_ring dirty_ring;
 
 	/*
@@ -2006,6 +2007,10 @@ ssize_t kvm_stats_read(char *id, const struct kvm_stats_header *header,
 		       const struct _kvm_stats_desc *desc,
 		       void *stats, size_t size_stats,
 		       char __user *user_buffer, size_t size, loff_t *offset);
+int kvm_stats_mmap(struct kvm_stats_mmap **mapp, const void *stats,
+		   size_t size_stats, struct vm_area_struct *vma);
+void kvm_stats_mmap_update(struct kvm_stats_mmap *map, const void *stats,
+			   size_t size_stats);
 
 /**
  * kvm_stats_linear_hist_update() - Update bucket value for linear histogram
@@ -323,6 +323,18 @@ struct ma_topiary {
 	struct maple_tree *mtree;
 };
 
+/**
+ * struct maple_bulk_entry - A range to store with mtree_bulk_load()
+ * @index: The start of the range
+ * @last: The end of the range (inclusive)
+ * @entry: The entry to store over the range
+ */
+struct maple_bulk_entry {
+	unsigned long index;
+	unsigned long last;
+	void *entry;
+};
+
 void *mtree_load(struct maple_tree *mt, unsigned long index);
 
 int mtree_insert(struct maple_tree *mt, unsigned long index,
@@ -347,6 +359,12 @@ void *mtree_erase(struct maple_tree *mt, unsigned long index);
 
 int mtree_dup(struct maple_tree *mt, struct maple_tree *new, gfp_t gfp);
 int __mt_dup(struct maple_tree *mt, struct maple_tree *new, gfp_t gfp);
+int __mt_bulk_load(struct maple_tree *mt,
+		const struct maple_bulk_entry *entries, unsigned long nr,
+		gfp_t gfp);
+int mtree_bulk_load(struct maple_tree *mt,
+		const struct maple_bulk_entry *entries, unsigned long nr,
+		gfp_t gfp);
 
 void mtree_destroy(struct maple_tree *mt);
 void __mt_destroy(struct maple_tree *mt);
@@ -3,11 +3,14 @@
 #define _LINUX_MSG_H
 
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <uapi/linux/msg.h>
 
 /* one msg_msg structure for each message */
 struct msg_msg {
 	struct list_head m_list;
+	struct rb_node m_tnode;		/* SysV: queue's index by type */
+	struct list_head m_tlist;	/* SysV: messages of the same type */
 	long m_type;
 	size_t m_ts;		/* message text size */
 	struct msg_msgseg *next;
@@ -43,6 +43,7 @@ struct mutex {
 	raw_spinlock_t		wait_lock;
 #ifdef CONFIG_MUTEX_SPIN_ON_OWNER
 	struct optimistic_spin_queue osq; /* Spinner MCS lock */
+	unsigned int		spin_avg; /* Average owner wait in ns */
 #endif
 	struct list_head	wait_list;
 #ifdef CONFIG_DEBUG_MUTEXES
@@ -8,7 +8,10 @@
 #include <linux/atomic.h>
 #include <linux/cpumask.h>
 #include <linux/irqflags.h>
+#include <linux/llist.h>
+#include <linux/preempt.h>
 #include <linux/smp.h>
+#include <linux/topology.h>
 
 /*
  * objpool: ring-array based lockless MPMC queue
@@ -28,6 +31,13 @@
  * 1) Maximum objects (capacity) is fixed after objpool creation
  * 2) All pre-allocated objects are managed in percpu ring array,
  *    which consumes more memory than linked lists
+ *
+ * On NUMA systems, in pools large enough for it, every object remembers
+ * the cpu whose slot it was allocated with. An object released on a cpu of another node is not
+ * put into the local ring but queued on a small percpu batch, which
+ * is handed over to the remote list of its home slot with a single
+ * atomic operation once full, so objects keep being reused from
+ * node-local memory and cross-node cache traffic is paid per batch.
  */
 
 /**
@@ -36,6 +46,11 @@
  * @tail: tail sequence of the local ring array (to append at)
  * @last: the last sequence number marked as ready for retrieve
  * @mask: bits mask for modulo capacity to compute array indexes
+ * @remote: objects returned to this slot by cpus of other nodes
+ * @batch_first: first object of the pending batch of remote frees
+ * @batch_last: last object of the pending batch of remote frees
+ * @batch_cpu: home cpu the pending batch is to be returned to
+ * @batch_nr: number of objects in the pending batch
  * @entries: object entries on this slot
  *
  * Represents a cpu-local array-based ring buffer, its size is specialized
@@ -49,15 +64,34 @@
  * of head and tail are used as the actual position in the ring array. In
  * general the ring array is acting like a small sliding window, which is
  * always moving forward in the loop of [0, 2^32).
+ *
+ * The pending batch is only ever touched by the owning cpu with irqs
+ * disabled, while @remote may be filled and drained by any cpu.
  */
 struct objpool_slot {
 	uint32_t            head;
 	uint32_t            tail;
 	uint32_t            last;
 	uint32_t            mask;
+	struct llist_head   remote;
+	struct llist_node  *batch_first;
+	struct llist_node  *batch_last;
+	int                 batch_cpu;
+	int                 batch_nr;
 	void               *entries[];
 } __packed;
 
+/*
+ * struct objpool_tag - per-object bookkeeping, kept right after the
+ * caller-visible part of every object when OBJPOOL_REMOTE_FREE is set
+ * @node: link for the remote list and the pending batch
+ * @cpu:  home cpu of the object (the slot it was allocated with)
+ */
+struct objpool_tag {
+	struct llist_node   node;
+	int                 cpu;
+};
+
 struct objpool_head;
 
 /*
@@ -71,7 +105,8 @@ typedef int (*objpool_fini_cb)(struct objpool_head *head, void *context);
 
 /**
  * struct objpool_head - object pooling metadata
- * @obj_size:   object size, aligned to sizeof(void *)
+ * @obj_size:   object size, aligned to sizeof(void *), including the
+ *              trailing struct objpool_tag if OBJPOOL_REMOTE_FREE is set
  * @nr_objs:    total objs (to be pre-allocated with objpool)
  * @nr_possible_cpus: cached value of num_possible_cpus()
  * @capacity:   max objs can be managed by one objpool_slot
@@ -97,6 +132,10 @@ struct objpool_head {
 
 #define OBJPOOL_NR_OBJECT_MAX	(1UL << 24) /* maximum numbers of total objects */
 #define OBJPOOL_OBJECT_SIZE_MAX	(1UL << 16) /* maximum size of an object */
+#define OBJPOOL_REMOTE_BATCH	16	    /* size of a remote-free batch */
+
+/* objpool_head flags */
+#define OBJPOOL_REMOTE_FREE	0x1 /* return objects to their home node */
 
 /**
  * objpool_init() - initialize objpool and pre-allocated objects
@@ -160,6 +199,9 @@ static inline void *__objpool_try_get_slot(struct objpool_head *pool, int cpu)
 	return NULL;
 }
 
+/* look for objects in other slots: same node first, then remote ones */
+void *__objpool_pop_slow(struct objpool_head *pool, int cpu);
+
 /**
  * objpool_pop() - allocate an object from objpool
  * @pool: object pool
@@ -168,20 +210,17 @@ static inline void *__objpool_try_get_slot(struct objpool_head *pool, int cpu)
  */
 static inline void *objpool_pop(struct objpool_head *pool)
 {
-	void *obj = NULL;
 	unsigned long flags;
-	int i, cpu;
+	void *obj;
+	int cpu;
 
 	/* disable local irq to avoid preemption & interruption */
 	raw_local_irq_save(flags);
 
 	cpu = raw_smp_processor_id();
-	for (i = 0; i < pool->nr_possible_cpus; i++) {
-		obj = __objpool_try_get_slot(pool, cpu);
-		if (obj)
-			break;
-		cpu = cpumask_next_wrap(cpu, cpu_possible_mask, -1, 1);
-	}
+	obj = __objpool_try_get_slot(pool, cpu);
+	if (!obj)
+		obj = __objpool_pop_slow(pool, cpu);
 	raw_local_irq_restore(flags);
 
 	return obj;
@@ -211,6 +250,15 @@ __objpool_try_add_slot(void *obj, struct objpool_head *pool, int cpu)
 	return 0;
 }
 
+static inline struct objpool_tag *
+__objpool_obj_tag(struct objpool_head *pool, void *obj)
+{
+	return obj + pool->obj_size - sizeof(struct objpool_tag);
+}
+
+/* queue an object of another node on the pending batch of this cpu */
+void __objpool_push_remote(void *obj, struct objpool_head *pool, int cpu);
+
 /**
  * objpool_push() - reclaim the object and return back to objpool
  * @obj:  object ptr to be pushed to objpool
@@ -222,11 +270,20 @@ __objpool_try_add_slot(void *obj, struct objpool_head *pool, int cpu)
 static inline int objpool_push(void *obj, struct objpool_head *pool)
 {
 	unsigned long flags;
-	int rc;
+	int rc = 0, cpu;
 
 	/* disable local irq to avoid preemption & interruption */
 	raw_local_irq_save(flags);
-	rc = __objpool_try_add_slot(obj, pool, raw_smp_processor_id());
+	cpu = raw_smp_processor_id();
+	/*
+	 * the pending batch is not nmi-safe, objects released in nmi
+	 * context just stay with the local slot as they always did
+	 */
+	if ((pool->flags & OBJPOOL_REMOTE_FREE) && !in_nmi() &&
+	    cpu_to_node(__objpool_obj_tag(pool, obj)->cpu) != cpu_to_node(cpu))
+		__objpool_push_remote(obj, pool, cpu);
+	else
+		rc = __objpool_try_add_slot(obj, pool, cpu);
 	raw_local_irq_restore(flags);
 
 	return rc;
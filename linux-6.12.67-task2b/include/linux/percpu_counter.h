@@ -19,6 +19,16 @@
 
 #ifdef CONFIG_SMP
 
+/*
+ * Per-node accumulator of a counter set up with percpu_counter_init_nodes().
+ * CPUs fold their batches in here and the node folds into ->count once it
+ * exceeds a batch for each of its CPUs.
+ */
+struct percpu_counter_node {
+	raw_spinlock_t lock;
+	s64 count;
+} ____cacheline_aligned_in_smp;
+
 struct percpu_counter {
 	raw_spinlock_t lock;
 	s64 count;
@@ -26,6 +36,7 @@ struct percpu_counter {
 	struct list_head list;	/* All percpu_counters are on a list */
 #endif
 	s32 __percpu *counters;
+	struct percpu_counter_node *nodes;	/* NULL unless per-node */
 };
 
 extern int percpu_counter_batch;
@@ -33,6 +44,8 @@ extern int percpu_counter_batch;
 int __percpu_counter_init_many(struct percpu_counter *fbc, s64 amount,
 			       gfp_t gfp, u32 nr_counters,
 			       struct lock_class_key *key);
+int __percpu_counter_init_nodes(struct percpu_counter *fbc, s64 amount,
+				gfp_t gfp, struct lock_class_key *key);
 
 #define percpu_counter_init_many(fbc, value, gfp, nr_counters)		\
 	({								\
@@ -46,6 +59,19 @@ int __percpu_counter_init_many(struct percpu_counter *fbc, s64 amount,
 #define percpu_counter_init(fbc, value, gfp)				\
 	percpu_counter_init_many(fbc, value, gfp, 1)
 
+/*
+ * Like percpu_counter_init(), but with a per-node accumulator between the
+ * per-CPU counts and ->count, for counters updated from many nodes.
+ * percpu_counter_read_nodes() then gives a value within the usual error of
+ * percpu_counter_read() at a cost proportional to the number of nodes.
+ */
+#define percpu_counter_init_nodes(fbc, value, gfp)			\
+	({								\
+		static struct lock_class_key __key;			\
+									\
+		__percpu_counter_init_nodes(fbc, value, gfp, &__key);	\
+	})
+
 void percpu_counter_destroy_many(struct percpu_counter *fbc, u32 nr_counters);
 static inline void percpu_counter_destroy(struct percpu_counter *fbc)
 {
@@ -56,6 +82,7 @@ void percpu_counter_set(struct percpu_counter *fbc, s64 amount);
 void percpu_counter_add_batch(struct percpu_counter *fbc, s64 amount,
 			      s32 batch);
 s64 __percpu_counter_sum(struct percpu_counter *fbc);
+s64 __percpu_counter_read_nodes(struct percpu_counter *fbc);
 int __percpu_counter_compare(struct percpu_counter *fbc, s64 rhs, s32 batch);
 bool __percpu_counter_limited_add(struct percpu_counter *fbc, s64 limit,
 				  s64 amount, s32 batch);
@@ -105,11 +132,28 @@ static inline s64 percpu_counter_sum(struct percpu_counter *fbc)
 	return __percpu_counter_sum(fbc);
 }
 
+/*
+ * For counters set up with percpu_counter_init_nodes(), this can be off by up
+ * to twice as much as for other counters, see percpu_counter_read_nodes().
+ */
 static inline s64 percpu_counter_read(struct percpu_counter *fbc)
 {
 	return fbc->count;
 }
 
+/*
+ * Add up ->count and the per-node accumulators without taking any locks.
+ * The result differs from percpu_counter_sum() by less than the batch times
+ * the number of online CPUs. Without per-node accumulators this is
+ * percpu_counter_read().
+ */
+static inline s64 percpu_counter_read_nodes(struct percpu_counter *fbc)
+{
+	if (!fbc->nodes)
+		return READ_ONCE(fbc->count);
+	return __percpu_counter_read_nodes(fbc);
+}
+
 /*
  * It is possible for the percpu_counter_read() to return a small negative
  * number for some counter which should never be negative.
@@ -154,6 +198,12 @@ static inline int percpu_counter_init(struct percpu_counter *fbc, s64 amount,
 	return percpu_counter_init_many(fbc, amount, gfp, 1);
 }
 
+static inline int percpu_counter_init_nodes(struct percpu_counter *fbc,
+					    s64 amount, gfp_t gfp)
+{
+	return percpu_counter_init(fbc, amount, gfp);
+}
+
 static inline void percpu_counter_destroy_many(struct percpu_counter *fbc,
 					       u32 nr_counters)
 {
@@ -233,6 +283,11 @@ static inline s64 percpu_counter_read(struct percpu_counter *fbc)
 	return fbc->count;
 }
 
+static inline s64 percpu_counter_read_nodes(struct percpu_counter *fbc)
+{
+	return fbc->count;
+}
+
 /*
  * percpu_counter is intended to track positive numbers. In the UP case the
  * number should never be negative.
@@ -1238,6 +1238,8 @@ struct perf_sample_data {
 	 */
 	u64				ip;
 	struct perf_callchain_entry	*callchain;
+	u64				callchain_hash;
+	u64				*callchain_slot;
 	struct perf_raw_record		*raw;
 	struct perf_branch_stack	*br_stack;
 	u64				*br_stack_cntr;
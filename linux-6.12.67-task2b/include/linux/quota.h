@@ -292,6 +292,16 @@ static inline void dqstats_dec(unsigned int type)
 				 * quotactl. They are set under dq_data_lock\
 				 * and the quota format handling dquot can\
 				 * clear them when it sees fit. */
+#define DQ_PCP_B	(DQ_LASTSET_B + 6)	/* dq_pcp may hold changes
+				 * not yet folded into dq_dqb */
+
+/* Usage counters of a dquot which can be changed without dq_dqb_lock */
+enum {
+	DQ_PCP_CURSPACE,
+	DQ_PCP_RSVSPACE,
+	DQ_PCP_CURINODES,
+	DQ_PCP_NR
+};
 
 struct dquot {
 	struct hlist_node dq_hash;	/* Hash list in memory [dq_list_lock] */
@@ -306,6 +316,9 @@ struct dquot {
 	loff_t dq_off;			/* Offset of dquot on disk [dq_lock, stable once set] */
 	unsigned long dq_flags;		/* See DQ_* */
 	struct mem_dqblk dq_dqb;	/* Diskquota usage [dq_dqb_lock] */
+	struct percpu_counter dq_pcp[DQ_PCP_NR];	/* Usage changes made
+					 * without dq_dqb_lock, see
+					 * dquot_dqb_lock() */
 };
 
 /* Operations which must be implemented by each quota format */
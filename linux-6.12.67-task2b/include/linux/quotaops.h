@@ -86,6 +86,7 @@ static inline int dquot_suspend(struct super_block *sb, int type)
 }
 int dquot_resume(struct super_block *sb, int type);
 
+void dquot_dqb_lock(struct dquot *dquot);
 int dquot_commit(struct dquot *dquot);
 int dquot_acquire(struct dquot *dquot);
 int dquot_release(struct dquot *dquot);
@@ -71,6 +71,7 @@ struct rhash_lock_head {};
  * @rcu: RCU structure for freeing the table
  * @future_tbl: Table under construction during rehashing
  * @ntbl: Nested table used when out of memory.
+ * @replicas: Per-node copies of @buckets without lock bits, or NULL
  * @buckets: size * hash buckets
  */
 struct bucket_table {
@@ -84,6 +85,8 @@ struct bucket_table {
 
 	struct lockdep_map	dep_map;
 
+	struct rhash_lock_head __rcu ***replicas;
+
 	struct rhash_lock_head __rcu *buckets[] ____cacheline_aligned_in_smp;
 };
 
@@ -297,6 +300,23 @@ static inline struct rhash_lock_head __rcu **rht_bucket_var(
 				     &tbl->buckets[hash];
 }
 
+/*
+ * The bucket a lookup reads its chain head from: this node's replica if the
+ * table has them, @hash's bucket otherwise. Chains still end in the nulls
+ * marker of the bucket returned by rht_bucket().
+ */
+static inline struct rhash_lock_head __rcu *const *rht_bucket_local(
+	const struct bucket_table *tbl, unsigned int hash)
+{
+	if (tbl->replicas) {
+		struct rhash_lock_head __rcu **r = tbl->replicas[numa_node_id()];
+
+		if (r)
+			return &r[hash];
+	}
+	return rht_bucket(tbl, hash);
+}
+
 static inline struct rhash_lock_head __rcu **rht_bucket_insert(
 	struct rhashtable *ht, struct bucket_table *tbl, unsigned int hash)
 {
@@ -321,6 +341,8 @@ static inline struct rhash_lock_head __rcu **rht_bucket_insert(
  * provides the same release semantics that bit_spin_unlock() provides,
  * this is safe.
  * When we write to a bucket without unlocking, we use rht_assign_locked().
+ * Both update the per-node replicas of the bucket, if any, while the lock is
+ * still held.
  */
 
 static inline unsigned long rht_lock(struct bucket_table *tbl,
@@ -390,11 +412,28 @@ static inline struct rhash_head *rht_ptr_exclusive(
 	return __rht_ptr(rcu_dereference_protected(*bkt, 1), bkt);
 }
 
-static inline void rht_assign_locked(struct rhash_lock_head __rcu **bkt,
+static inline void rht_assign_replicas(struct bucket_table *tbl,
+				       struct rhash_lock_head __rcu **bkt,
+				       struct rhash_head *obj)
+{
+	unsigned int i, node;
+
+	if (likely(!tbl->replicas))
+		return;
+
+	i = bkt - tbl->buckets;
+	for (node = 0; node < nr_node_ids; node++)
+		if (tbl->replicas[node])
+			rcu_assign_pointer(tbl->replicas[node][i], (void *)obj);
+}
+
+static inline void rht_assign_locked(struct bucket_table *tbl,
+				     struct rhash_lock_head __rcu **bkt,
 				     struct rhash_head *obj)
 {
 	if (rht_is_a_nulls(obj))
 		obj = NULL;
+	rht_assign_replicas(tbl, bkt, obj);
 	rcu_assign_pointer(*bkt, (void *)((unsigned long)obj | BIT(0)));
 }
 
@@ -405,6 +444,7 @@ static inline void rht_assign_unlock(struct bucket_table *tbl,
 {
 	if (rht_is_a_nulls(obj))
 		obj = NULL;
+	rht_assign_replicas(tbl, bkt, obj);
 	lock_map_release(&tbl->dep_map);
 	rcu_assign_pointer(*bkt, (void *)obj);
 	preempt_enable();
@@ -594,7 +634,7 @@ static inline struct rhash_head *__rhashtable_lookup(
 		.ht = ht,
 		.key = key,
 	};
-	struct rhash_lock_head __rcu *const *bkt;
+	struct rhash_lock_head __rcu *const *bkt, *const *local;
 	struct bucket_table *tbl;
 	struct rhash_head *he;
 	unsigned int hash;
@@ -603,8 +643,10 @@ static inline struct rhash_head *__rhashtable_lookup(
 restart:
 	hash = rht_key_hashfn(ht, tbl, key, params);
 	bkt = rht_bucket(tbl, hash);
+	local = rht_bucket_local(tbl, hash);
 	do {
-		rht_for_each_rcu_from(he, rht_ptr_rcu(bkt), tbl, hash) {
+		rht_for_each_rcu_from(he, __rht_ptr(rcu_dereference(*local), bkt),
+				      tbl, hash) {
 			if (params.obj_cmpfn ?
 			    params.obj_cmpfn(&arg, rht_obj(ht, he)) :
 			    rhashtable_compare(&arg, rht_obj(ht, he)))
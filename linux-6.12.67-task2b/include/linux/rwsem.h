@@ -53,6 +53,10 @@ struct rw_semaphore {
 	 * check to see if the write owner is running on the cpu.
 	 */
 	atomic_long_t owner;
+#ifdef CONFIG_RWSEM_READER_BIAS
+	/* per-CPU reader counts, see rwsem_enable_reader_bias() */
+	struct rwsem_bias *bias;
+#endif
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 	struct optimistic_spin_queue osq; /* spinner MCS lock */
 #endif
@@ -70,14 +74,37 @@ struct rw_semaphore {
 #define RWSEM_WRITER_LOCKED		(1UL << 0)
 #define __RWSEM_COUNT_INIT(name)	.count = ATOMIC_LONG_INIT(RWSEM_UNLOCKED_VALUE)
 
+#ifdef CONFIG_RWSEM_READER_BIAS
+extern int rwsem_enable_reader_bias(struct rw_semaphore *sem);
+extern void rwsem_free_reader_bias(struct rw_semaphore *sem);
+extern bool __rwsem_bias_is_read_locked(const struct rw_semaphore *sem);
+
+static inline bool rwsem_bias_is_read_locked(const struct rw_semaphore *sem)
+{
+	return READ_ONCE(sem->bias) && __rwsem_bias_is_read_locked(sem);
+}
+#else
+static inline int rwsem_enable_reader_bias(struct rw_semaphore *sem)
+{
+	return 0;
+}
+static inline void rwsem_free_reader_bias(struct rw_semaphore *sem) { }
+static inline bool rwsem_bias_is_read_locked(const struct rw_semaphore *sem)
+{
+	return false;
+}
+#endif
+
 static inline int rwsem_is_locked(struct rw_semaphore *sem)
 {
-	return atomic_long_read(&sem->count) != RWSEM_UNLOCKED_VALUE;
+	return atomic_long_read(&sem->count) != RWSEM_UNLOCKED_VALUE ||
+	       rwsem_bias_is_read_locked(sem);
 }
 
 static inline void rwsem_assert_held_nolockdep(const struct rw_semaphore *sem)
 {
-	WARN_ON(atomic_long_read(&sem->count) == RWSEM_UNLOCKED_VALUE);
+	WARN_ON(atomic_long_read(&sem->count) == RWSEM_UNLOCKED_VALUE &&
+		!rwsem_bias_is_read_locked(sem));
 }
 
 static inline void rwsem_assert_held_write_nolockdep(const struct rw_semaphore *sem)
@@ -182,6 +209,13 @@ static __always_inline int rwsem_is_contended(struct rw_semaphore *sem)
 	return rw_base_is_contended(&sem->rwbase);
 }
 
+/* The per-CPU reader bias is not available on PREEMPT_RT */
+static inline int rwsem_enable_reader_bias(struct rw_semaphore *sem)
+{
+	return 0;
+}
+static inline void rwsem_free_reader_bias(struct rw_semaphore *sem) { }
+
 #endif /* CONFIG_PREEMPT_RT */
 
 /*
@@ -82,6 +82,12 @@ struct sbitmap {
 	 * cachelines until the map is exhausted.
 	 */
 	unsigned int __percpu *alloc_hint;
+
+	/*
+	 * @node_start: If not NULL, CPUs of node n prefer the words
+	 * [@node_start[n], @node_start[n + 1]), see sbitmap_queue_init_numa().
+	 */
+	unsigned int *node_start;
 };
 
 #define SBQ_WAIT_QUEUES 8
@@ -185,6 +191,8 @@ static inline unsigned int __map_depth(const struct sbitmap *sb, int index)
 static inline void sbitmap_free(struct sbitmap *sb)
 {
 	free_percpu(sb->alloc_hint);
+	kfree(sb->node_start);
+	sb->node_start = NULL;
 	kvfree(sb->map);
 	sb->map = NULL;
 }
@@ -418,6 +426,27 @@ void sbitmap_bitmap_show(struct sbitmap *sb, struct seq_file *m);
 int sbitmap_queue_init_node(struct sbitmap_queue *sbq, unsigned int depth,
 			    int shift, bool round_robin, gfp_t flags, int node);
 
+/**
+ * sbitmap_queue_init_numa() - Initialize a &struct sbitmap_queue shared by
+ * CPUs on all NUMA nodes.
+ * @sbq: Bitmap queue to initialize.
+ * @depth: See sbitmap_init_node().
+ * @shift: See sbitmap_init_node().
+ * @flags: Allocation flags.
+ *
+ * Like sbitmap_queue_init_node(), but the words of the bitmap are split
+ * between the NUMA nodes in proportion to their CPUs. Allocations search the
+ * words of the local node first and only take bits from other nodes' words
+ * when those are exhausted, and a freed bit only becomes the allocation hint
+ * of a CPU on the node owning it. This keeps the cachelines of the bitmap
+ * from bouncing between nodes for tag sets used by every CPU. Round-robin
+ * allocation is not supported.
+ *
+ * Return: Zero on success or negative errno on failure.
+ */
+int sbitmap_queue_init_numa(struct sbitmap_queue *sbq, unsigned int depth,
+			    int shift, gfp_t flags);
+
 /**
  * sbitmap_queue_free() - Free memory used by a &struct sbitmap_queue.
  *
@@ -775,6 +775,24 @@ struct wake_q_node {
 	struct wake_q_node *next;
 };
 
+/*
+ * One in-flight sample of the lock contention profiler, see
+ * kernel/locking/lock_contention.c.
+ */
+struct lock_contention_sample {
+	void				*lock;		/* waited for */
+	unsigned long			site;
+	u64				start;
+	u64				phase_start;
+	u64				spin_ns;
+	unsigned int			flags;
+	unsigned int			gen;
+	void				*held;		/* acquired, not released */
+	unsigned long			held_site;
+	u64				held_since;
+	unsigned int			held_gen;
+};
+
 struct kmap_ctrl {
 #ifdef CONFIG_KMAP_LOCAL
 	int				idx;
@@ -1212,6 +1230,11 @@ struct task_struct {
 	int				non_block_count;
 #endif
 
+#ifdef CONFIG_LOCK_CONTENTION_PROFILE
+	/* Sampled sleeping-lock contention: */
+	struct lock_contention_sample	lock_contention;
+#endif
+
 #ifdef CONFIG_TRACE_IRQFLAGS
 	struct irqtrace_events		irqtrace;
 	unsigned int			hardirq_threaded;
@@ -2,6 +2,8 @@
 #ifndef _LINUX_SCHED_CPUTIME_H
 #define _LINUX_SCHED_CPUTIME_H
 
+#include <linux/jiffies.h>
+#include <linux/percpu.h>
 #include <linux/sched/signal.h>
 
 /*
@@ -66,7 +68,18 @@ void thread_group_sample_cputime(struct task_struct *tsk, u64 *samples);
  *
  * @tsk:	Pointer to target task.
  */
+/*
+ * Amount of cputime a CPU accumulates for a thread group before it is
+ * folded into the shared atomics. The group sample read from the atomics
+ * therefore lags behind by less than nr_cpu_ids * TG_CPUTIMER_BATCH per
+ * clock.
+ */
+#define TG_CPUTIMER_BATCH	(4 * TICK_NSEC)
+
 #ifdef CONFIG_POSIX_TIMERS
+extern void thread_group_cputimer_fold(struct thread_group_cputimer *cputimer,
+				       struct thread_group_cputimer_pcpu *pcpu);
+
 static inline
 struct thread_group_cputimer *get_running_cputimer(struct task_struct *tsk)
 {
@@ -104,6 +117,9 @@ struct thread_group_cputimer *get_running_cputimer(struct task_struct *tsk)
 {
 	return NULL;
 }
+
+static inline void thread_group_cputimer_fold(struct thread_group_cputimer *cputimer,
+					      struct thread_group_cputimer_pcpu *pcpu) { }
 #endif
 
 /**
@@ -120,10 +136,18 @@ static inline void account_group_user_time(struct task_struct *tsk,
 					   u64 cputime)
 {
 	struct thread_group_cputimer *cputimer = get_running_cputimer(tsk);
+	struct thread_group_cputimer_pcpu *pcpu;
 
 	if (!cputimer)
 		return;
 
+	pcpu = READ_ONCE(cputimer->pcpu);
+	if (pcpu) {
+		if (this_cpu_add_return(pcpu->times->utime, cputime) >= TG_CPUTIMER_BATCH)
+			thread_group_cputimer_fold(cputimer, pcpu);
+		return;
+	}
+
 	atomic64_add(cputime, &cputimer->cputime_atomic.utime);
 }
 
@@ -141,10 +165,18 @@ static inline void account_group_system_time(struct task_struct *tsk,
 					     u64 cputime)
 {
 	struct thread_group_cputimer *cputimer = get_running_cputimer(tsk);
+	struct thread_group_cputimer_pcpu *pcpu;
 
 	if (!cputimer)
 		return;
 
+	pcpu = READ_ONCE(cputimer->pcpu);
+	if (pcpu) {
+		if (this_cpu_add_return(pcpu->times->stime, cputime) >= TG_CPUTIMER_BATCH)
+			thread_group_cputimer_fold(cputimer, pcpu);
+		return;
+	}
+
 	atomic64_add(cputime, &cputimer->cputime_atomic.stime);
 }
 
@@ -162,10 +194,18 @@ static inline void account_group_exec_runtime(struct task_struct *tsk,
 					      unsigned long long ns)
 {
 	struct thread_group_cputimer *cputimer = get_running_cputimer(tsk);
+	struct thread_group_cputimer_pcpu *pcpu;
 
 	if (!cputimer)
 		return;
 
+	pcpu = READ_ONCE(cputimer->pcpu);
+	if (pcpu) {
+		if (this_cpu_add_return(pcpu->times->sum_exec_runtime, ns) >= TG_CPUTIMER_BATCH)
+			thread_group_cputimer_fold(cputimer, pcpu);
+		return;
+	}
+
 	atomic64_add(ns, &cputimer->cputime_atomic.sum_exec_runtime);
 }
 
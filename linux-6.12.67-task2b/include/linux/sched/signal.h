@@ -57,15 +57,42 @@ struct task_cputime_atomic {
 		.stime = ATOMIC64_INIT(0),			\
 		.sum_exec_runtime = ATOMIC64_INIT(0),		\
 	}
+/*
+ * Per CPU part of the thread group cputimer. Each CPU accumulates the
+ * cputime of the group's threads running on it and folds it into the
+ * shared atomics under @lock once one of the values reaches
+ * TG_CPUTIMER_BATCH. Only allocated on 64-bit SMP.
+ */
+struct task_cputime_pcpu {
+	u64 utime;
+	u64 stime;
+	u64 sum_exec_runtime;
+};
+
+struct thread_group_cputimer_pcpu {
+	raw_spinlock_t			lock;
+	struct task_cputime_pcpu __percpu *times;
+	/* jiffies of the last exact sample taken from the tick */
+	unsigned long			tick_sample;
+	struct rcu_head			rcu;
+};
+
 /**
  * struct thread_group_cputimer - thread group interval timer counts
  * @cputime_atomic:	atomic thread group interval timers.
+ * @pcpu:		per CPU accumulators in front of @cputime_atomic, or
+ *			NULL. Set when the group accounting is started and
+ *			freed (RCU delayed) when the thread group exits.
+ * @pcpu_tried:		set up of @pcpu was attempted; if not, a group which
+ *			inherited RLIMIT_CPU does so on its next tick.
  *
  * This structure contains the version of task_cputime, above, that is
  * used for thread group CPU timer calculations.
  */
 struct thread_group_cputimer {
 	struct task_cputime_atomic cputime_atomic;
+	struct thread_group_cputimer_pcpu *pcpu;
+	bool pcpu_tried;
 };
 
 struct multiprocess_signals {
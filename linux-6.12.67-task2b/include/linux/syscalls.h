@@ -55,6 +55,7 @@ struct timezone;
 struct tms;
 struct utimbuf;
 struct mq_attr;
+struct mq_mmsg;
 struct compat_stat;
 struct old_timeval32;
 struct robust_list_head;
@@ -561,6 +562,9 @@ asmlinkage long sys_futex_waitv(struct futex_waitv __user *waiters,
 
 asmlinkage long sys_futex_wake(void __user *uaddr, unsigned long mask, int nr, unsigned int flags);
 
+asmlinkage long sys_futex_wakev(struct futex_waitv __user *waiters,
+				unsigned int nr_futexes, unsigned int flags);
+
 asmlinkage long sys_futex_wait(void __user *uaddr, unsigned long val, unsigned long mask,
 			       unsigned int flags, struct __kernel_timespec __user *timespec,
 			       clockid_t clockid);
@@ -715,6 +719,8 @@ asmlinkage long sys_mq_timedsend(mqd_t mqdes, const char __user *msg_ptr, size_t
 asmlinkage long sys_mq_timedreceive(mqd_t mqdes, char __user *msg_ptr, size_t msg_len, unsigned int __user *msg_prio, const struct __kernel_timespec __user *abs_timeout);
 asmlinkage long sys_mq_notify(mqd_t mqdes, const struct sigevent __user *notification);
 asmlinkage long sys_mq_getsetattr(mqd_t mqdes, const struct mq_attr __user *mqstat, struct mq_attr __user *omqstat);
+asmlinkage long sys_mq_sendmmsg(mqd_t mqdes, struct mq_mmsg __user *vec, unsigned int vlen, unsigned int flags, const struct __kernel_timespec __user *abs_timeout);
+asmlinkage long sys_mq_recvmmsg(mqd_t mqdes, struct mq_mmsg __user *vec, unsigned int vlen, unsigned int flags, const struct __kernel_timespec __user *abs_timeout);
 asmlinkage long sys_mq_timedreceive_time32(mqd_t mqdes,
 			char __user *u_msg_ptr,
 			unsigned int msg_len, unsigned int __user *u_msg_prio,
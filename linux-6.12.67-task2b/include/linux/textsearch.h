@@ -18,11 +18,13 @@ struct ts_config;
 /**
  * struct ts_state - search state
  * @offset: offset for next match
+ * @pattern: pattern found by the last match, for multi-pattern algorithms
  * @cb: control buffer, for persistent variables of get_next_block()
  */
 struct ts_state
 {
 	unsigned int		offset;
+	unsigned int		pattern;
 	char			cb[48];
 };
 
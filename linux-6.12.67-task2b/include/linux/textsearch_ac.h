@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef __LINUX_TEXTSEARCH_AC_H
+#define __LINUX_TEXTSEARCH_AC_H
+
+#include <linux/types.h>
+
+/*
+ * The pattern handed to textsearch_prepare() for the "ac" algorithm is a
+ * set of patterns: a sequence of records made of a struct ts_ac_pattern
+ * followed by @len bytes of pattern, records are not padded. After a
+ * match, ts_state.pattern holds the index of the pattern that was found,
+ * counting records from 0.
+ */
+#define TS_AC_MAX_PATTERNS	4096
+#define TS_AC_MAX_STATES	65535	/* total pattern bytes + 1 */
+
+/**
+ * struct ts_ac_pattern - one pattern of an "ac" pattern set
+ * @len: length of @data, 1..255
+ * @data: pattern bytes
+ */
+struct ts_ac_pattern
+{
+	__u8		len;
+	__u8		data[];
+};
+
+#endif
@@ -48,6 +48,17 @@ struct uprobe_consumer {
 	struct list_head cons_node;
 };
 
+/*
+ * One probe of a uprobe_register_batch() call; @uprobe is filled in on
+ * success and is what uprobe_unregister_nosync() takes.
+ */
+struct uprobe_batch_entry {
+	loff_t			offset;
+	loff_t			ref_ctr_offset;
+	struct uprobe_consumer	*uc;
+	struct uprobe		*uprobe;
+};
+
 #ifdef CONFIG_UPROBES
 #include <asm/uprobes.h>
 
@@ -116,6 +127,7 @@ extern unsigned long uprobe_get_swbp_addr(struct pt_regs *regs);
 extern unsigned long uprobe_get_trap_addr(struct pt_regs *regs);
 extern int uprobe_write_opcode(struct arch_uprobe *auprobe, struct mm_struct *mm, unsigned long vaddr, uprobe_opcode_t);
 extern struct uprobe *uprobe_register(struct inode *inode, loff_t offset, loff_t ref_ctr_offset, struct uprobe_consumer *uc);
+extern int uprobe_register_batch(struct inode *inode, struct uprobe_batch_entry *entries, unsigned int cnt);
 extern int uprobe_apply(struct uprobe *uprobe, struct uprobe_consumer *uc, bool);
 extern void uprobe_unregister_nosync(struct uprobe *uprobe, struct uprobe_consumer *uc);
 extern void uprobe_unregister_sync(void);
@@ -162,6 +174,11 @@ uprobe_register(struct inode *inode, loff_t offset, loff_t ref_ctr_offset, struc
 	return ERR_PTR(-ENOSYS);
 }
 static inline int
+uprobe_register_batch(struct inode *inode, struct uprobe_batch_entry *entries, unsigned int cnt)
+{
+	return -ENOSYS;
+}
+static inline int
 uprobe_apply(struct uprobe* uprobe, struct uprobe_consumer *uc, bool add)
 {
 	return -ENOSYS;
@@ -50,6 +50,13 @@ int virtqueue_add_inbuf(struct virtqueue *vq,
 			void *data,
 			gfp_t gfp);
 
+int virtqueue_add_inbufs(struct virtqueue *vq, struct scatterlist *sgs[],
+			 void *data[], unsigned int n, gfp_t gfp);
+
+void virtqueue_add_batch_begin(struct virtqueue *vq);
+
+void virtqueue_add_batch_end(struct virtqueue *vq);
+
 int virtqueue_add_inbuf_ctx(struct virtqueue *vq,
 			    struct scatterlist sg[], unsigned int num,
 			    void *data,
@@ -76,6 +83,13 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len);
 void *virtqueue_get_buf_ctx(struct virtqueue *vq, unsigned int *len,
 			    void **ctx);
 
+unsigned int virtqueue_get_bufs(struct virtqueue *vq, void **bufs,
+				unsigned int *lens, unsigned int max);
+
+unsigned int virtqueue_get_bufs_ctx(struct virtqueue *vq, void **bufs,
+				    unsigned int *lens, void **ctxs,
+				    unsigned int max);
+
 void virtqueue_disable_cb(struct virtqueue *vq);
 
 bool virtqueue_enable_cb(struct virtqueue *vq);
@@ -352,9 +352,23 @@ struct xarray {
  */
 #define DEFINE_XARRAY_ALLOC1(name) DEFINE_XARRAY_FLAGS(name, XA_FLAGS_ALLOC1)
 
+/**
+ * struct xa_batch_entry - An entry to store with xa_store_batch().
+ * @index: Index into array.
+ * @entry: New entry.
+ */
+struct xa_batch_entry {
+	unsigned long index;
+	void *entry;
+};
+
 void *xa_load(struct xarray *, unsigned long index);
 void *xa_store(struct xarray *, unsigned long index, void *entry, gfp_t);
 void *xa_erase(struct xarray *, unsigned long index);
+int xa_store_batch(struct xarray *, const struct xa_batch_entry *batch,
+			unsigned int nr, gfp_t);
+void xa_erase_batch(struct xarray *, const unsigned long *indices,
+			unsigned int nr);
 void *xa_store_range(struct xarray *, unsigned long first, unsigned long last,
 			void *entry, gfp_t);
 bool xa_get_mark(struct xarray *, unsigned long index, xa_mark_t);
@@ -107,6 +107,42 @@ uint32_t xxh32(const void *input, size_t length, uint32_t seed);
  */
 uint64_t xxh64(const void *input, size_t length, uint64_t seed);
 
+/**
+ * struct xxh128_hash - a 128-bit XXH3 hash value
+ * @low64:  The low 64 bits of the hash.
+ * @high64: The high 64 bits of the hash.
+ */
+struct xxh128_hash {
+	uint64_t low64;
+	uint64_t high64;
+};
+
+/**
+ * xxh3_64() - calculate the 64-bit XXH3 hash of the input with a given seed.
+ *
+ * @input:  The data to hash.
+ * @length: The length of the data to hash.
+ * @seed:   The seed can be used to alter the result predictably.
+ *
+ * XXH3 is considerably faster than xxh64() on short inputs. Inputs longer
+ * than 1 KiB are hashed with SSE2 or AVX2 on x86_64 when the FPU is usable.
+ * The result is not related to xxh64() of the same input.
+ *
+ * Return:  The 64-bit XXH3 hash of the data.
+ */
+uint64_t xxh3_64(const void *input, size_t length, uint64_t seed);
+
+/**
+ * xxh3_128() - calculate the 128-bit XXH3 hash of the input with a given seed.
+ *
+ * @input:  The data to hash.
+ * @length: The length of the data to hash.
+ * @seed:   The seed can be used to alter the result predictably.
+ *
+ * Return:  The 128-bit XXH3 hash of the data.
+ */
+struct xxh128_hash xxh3_128(const void *input, size_t length, uint64_t seed);
+
 /**
  * xxhash() - calculate wordsize hash of the input with a given seed
  * @input:  The data to hash.
@@ -58,6 +58,9 @@ struct nf_conntrack_net {
 	unsigned int users4;
 	unsigned int users6;
 	unsigned int users_bridge;
+#if IS_ENABLED(CONFIG_NETFILTER_CONNCOUNT)
+	atomic_t conncount_sketches;	/* nf_conn_count is preallocated */
+#endif
 #ifdef CONFIG_SYSCTL
 	struct ctl_table_header	*sysctl_header;
 #endif
@@ -2,6 +2,7 @@
 #define _NF_CONNTRACK_COUNT_H
 
 #include <linux/list.h>
+#include <linux/percpu-refcount.h>
 #include <linux/spinlock.h>
 #include <net/netfilter/nf_conntrack_tuple.h>
 #include <net/netfilter/nf_conntrack_zones.h>
@@ -15,7 +16,58 @@ struct nf_conncount_list {
 	unsigned int count;	/* length of list */
 };
 
+/* Approximate mode: a count-min sketch of the connections per key, one for
+ * each rule. A new conntrack bumps the counters of its key in every sketch
+ * it is counted in and remembers them in its extension area, they are
+ * dropped again when the conntrack is freed. A sketch of 0 bits is a single
+ * exact counter.
+ */
+#define NF_CONNCOUNT_SKETCH_ROWS	2
+
+struct nf_conncount_sketch {
+	struct percpu_ref	ref;		/* conntracks counted */
+	struct net		*net;
+	unsigned int		bits;
+	atomic_t		cnt[];		/* NF_CONNCOUNT_SKETCH_ROWS << bits */
+};
+
+struct nf_conncount_sketch_ref {
+	struct nf_conncount_sketch	*sketch;
+	u32				slot[NF_CONNCOUNT_SKETCH_ROWS];
+};
+
+/* one cacheline of references, chained when a conntrack is in many sketches */
+#define NF_CONNCOUNT_REFS	3
+
+struct nf_conncount_refs {
+	struct nf_conncount_refs	*next;
+	unsigned int			nr;
+	struct nf_conncount_sketch_ref	ref[NF_CONNCOUNT_REFS];
+};
+
+/* Sketches a conntrack is counted in. Allocated along with the conntrack
+ * while the netns has sketches, and only grown before the conntrack is
+ * confirmed, so it is never changed under a concurrent user.
+ */
+struct nf_conn_count {
+	struct nf_conncount_refs	*refs;
+};
+
+void nf_conncount_sketch_release(struct percpu_ref *ref);
+struct nf_conn_count *nf_ct_count_ext_add(struct nf_conn *ct, gfp_t gfp);
+
+struct nf_conncount_sketch *nf_conncount_sketch_create(struct net *net,
+							unsigned int bits,
+							gfp_t gfp);
+void nf_conncount_sketch_destroy(struct nf_conncount_sketch *sketch);
+unsigned int nf_conncount_sketch_count_skb(struct nf_conncount_sketch *sketch,
+					   const struct sk_buff *skb,
+					   const u32 *key,
+					   unsigned int keylen);
+
 struct nf_conncount_data *nf_conncount_init(struct net *net, unsigned int keylen);
+struct nf_conncount_data *nf_conncount_init_approx(struct net *net,
+						   unsigned int keylen);
 void nf_conncount_destroy(struct net *net, struct nf_conncount_data *data);
 
 unsigned int nf_conncount_count_skb(struct net *net,
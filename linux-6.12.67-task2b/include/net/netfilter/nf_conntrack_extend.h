@@ -30,6 +30,9 @@ enum nf_ct_ext_id {
 #endif
 #if IS_ENABLED(CONFIG_NET_ACT_CT)
 	NF_CT_EXT_ACT_CT,
+#endif
+#if IS_ENABLED(CONFIG_NETFILTER_CONNCOUNT)
+	NF_CT_EXT_CONNCOUNT,
 #endif
 	NF_CT_EXT_NUM,
 };
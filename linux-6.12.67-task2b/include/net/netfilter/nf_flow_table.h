@@ -73,10 +73,24 @@ enum nf_flowtable_flags {
 	NF_FLOWTABLE_COUNTER		= 0x2,	/* NFT_FLOWTABLE_COUNTER */
 };
 
+/* per cpu direct mapped cache in front of the rhashtable */
+#define NF_FLOW_CACHE_BITS	6
+#define NF_FLOW_CACHE_SIZE	(1 << NF_FLOW_CACHE_BITS)
+
+struct nf_flow_cache_entry {
+	struct flow_offload_tuple_rhash	*tuplehash;
+	unsigned int			gen;
+};
+
+struct nf_flow_cache {
+	struct nf_flow_cache_entry	ent[NF_FLOW_CACHE_SIZE];
+};
+
 struct nf_flowtable {
 	unsigned int			flags;		/* readonly in datapath */
 	int				priority;	/* control path (padding hole) */
 	struct rhashtable		rhashtable;	/* datapath, read-mostly members come first */
+	struct nf_flow_cache __percpu	*cache;
 
 	struct list_head		list;		/* slowpath parts */
 	const struct nf_flowtable_type	*type;
@@ -84,6 +98,9 @@ struct nf_flowtable {
 	struct flow_block		flow_block;
 	struct rw_semaphore		flow_block_lock; /* Guards flow_block */
 	possible_net_t			net;
+
+	/* bumped on every removal, kept away from the read-mostly members */
+	atomic_t			cache_gen[NF_FLOW_CACHE_SIZE] ____cacheline_aligned_in_smp;
 };
 
 static inline bool nf_flowtable_hw_offload(struct nf_flowtable *flowtable)
@@ -1069,6 +1069,7 @@ static inline void nft_set_elem_update_expr(const struct nft_set_ext *ext,
 
 struct nft_rule_dp {
 	u64				is_last:1,
+					jit:1,		/* nft_jit_run follows */
 					dlen:12,
 					handle:42;	/* for tracing */
 	unsigned char			data[]
@@ -92,6 +92,7 @@ extern const struct nft_set_type nft_set_rbtree_type;
 extern const struct nft_set_type nft_set_bitmap_type;
 extern const struct nft_set_type nft_set_pipapo_type;
 extern const struct nft_set_type nft_set_pipapo_avx2_type;
+extern const struct nft_set_type nft_set_pipapo_neon_type;
 
 #ifdef CONFIG_MITIGATION_RETPOLINE
 const struct nft_set_ext *
@@ -115,7 +116,7 @@ const struct nft_set_ext *
 nft_set_do_lookup(const struct net *net, const struct nft_set *set,
 		  const u32 *key);
 
-/* called from nft_pipapo_avx2.c */
+/* called from nft_pipapo_avx2.c and nft_set_pipapo_neon.c */
 const struct nft_set_ext *
 nft_pipapo_lookup(const struct net *net, const struct nft_set *set,
 		  const u32 *key);
@@ -123,9 +124,46 @@ nft_pipapo_lookup(const struct net *net, const struct nft_set *set,
 const struct nft_set_ext *
 nft_pipapo_avx2_lookup(const struct net *net, const struct nft_set *set,
 			const u32 *key);
+const struct nft_set_ext *
+nft_pipapo_neon_lookup(const struct net *net, const struct nft_set *set,
+		       const u32 *key);
 
 void nft_counter_init_seqcount(void);
 
+struct bpf_prog;
+
+/**
+ * struct nft_jit_run - Compiled run of rules, data of the pseudo-rule before it
+ * @prog:	eBPF program, returns offset of the rule to evaluate next
+ * @rules:	Number of rules in the run
+ */
+struct nft_jit_run {
+	struct bpf_prog		*prog;
+	unsigned int		rules;
+};
+
+const struct nft_rule_dp *nft_jit_run(const struct nft_rule_dp *prule,
+				      const struct nft_pktinfo *pkt);
+#ifdef CONFIG_NF_TABLES_JIT
+bool nft_jit_enabled(void);
+unsigned int nft_jit_run_find(const struct nft_rule_dp *rule,
+			      const struct nft_rule_dp **end);
+int nft_jit_compile(struct nft_rule_dp *prule, unsigned int n);
+void nft_jit_release(struct nft_rule_blob *blob);
+#else
+static inline bool nft_jit_enabled(void) { return false; }
+static inline unsigned int nft_jit_run_find(const struct nft_rule_dp *rule,
+					    const struct nft_rule_dp **end)
+{
+	return 0;
+}
+static inline int nft_jit_compile(struct nft_rule_dp *prule, unsigned int n)
+{
+	return -EOPNOTSUPP;
+}
+static inline void nft_jit_release(struct nft_rule_blob *blob) { }
+#endif
+
 struct nft_expr;
 struct nft_regs;
 struct nft_pktinfo;
@@ -841,8 +841,16 @@ __SYSCALL(__NR_lsm_list_modules, sys_lsm_list_modules)
 #define __NR_mseal 462
 __SYSCALL(__NR_mseal, sys_mseal)
 
+#define __NR_mq_sendmmsg 463
+__SYSCALL(__NR_mq_sendmmsg, sys_mq_sendmmsg)
+#define __NR_mq_recvmmsg 464
+__SYSCALL(__NR_mq_recvmmsg, sys_mq_recvmmsg)
+
+#define __NR_futex_wakev 465
+__SYSCALL(__NR_futex_wakev, sys_futex_wakev)
+
 #undef __NR_syscalls
-#define __NR_syscalls 463
+#define __NR_syscalls 466
 
 /*
  * 32 bit systems traditionally used different
@@ -25,6 +25,9 @@ enum cachefiles_opcode {
  * @len		message length, including message header and following data
  * @object_id	a unique ID identifying a cache file
  * @data	message type specific payload
+ *
+ * After a "batch <n>" command, one read() returns up to n messages back to
+ * back, each one starting at an 8-byte aligned offset in the buffer.
  */
 struct cachefiles_msg {
 	__u32 msg_id;
@@ -53,6 +56,9 @@ struct cachefiles_open {
 /*
  * @off		indicates the starting offset of the requested file range
  * @len		indicates the length of the requested file range
+ *
+ * Adjacent cache misses may be coalesced into a single READ request, and
+ * after a "ra <size>" command short misses are extended to <size> bytes.
  */
 struct cachefiles_read {
 	__u64 off;
@@ -200,6 +200,13 @@ enum io_uring_sqe_flags_bit {
  */
 #define IORING_SETUP_NO_SQARRAY		(1U << 16)
 
+/*
+ * SQPOLL thread: instead of always spinning for sq_thread_idle before going
+ * to sleep, only spin as long as new submissions are likely to arrive, based
+ * on the gaps seen so far. sq_thread_idle becomes the upper bound.
+ */
+#define IORING_SETUP_SQPOLL_ADAPTIVE	(1U << 17)
+
 enum io_uring_op {
 	IORING_OP_NOP,
 	IORING_OP_READV,
@@ -259,6 +266,8 @@ enum io_uring_op {
 	IORING_OP_FTRUNCATE,
 	IORING_OP_BIND,
 	IORING_OP_LISTEN,
+	IORING_OP_SEMTIMEDOP,
+	IORING_OP_STATX_BATCH,
 
 	/* this goes last, obviously */
 	IORING_OP_LAST,
@@ -391,6 +400,7 @@ enum io_uring_op {
 enum io_uring_msg_ring_flags {
 	IORING_MSG_DATA,	/* pass sqe->len as 'res' and off as user_data */
 	IORING_MSG_SEND_FD,	/* send a registered fd to another ring */
+	IORING_MSG_SEND_BUF,	/* move a registered buffer to another ring */
 };
 
 /*
@@ -701,6 +711,17 @@ enum {
 	IORING_REGISTER_SRC_REGISTERED = 1,
 };
 
+/*
+ * IORING_OP_STATX_BATCH: sqe->addr points to an array of sqe->len of these,
+ * each path is looked up relative to sqe->fd with sqe->statx_flags.
+ */
+struct io_uring_statx_entry {
+	__u64	path;		/* pointer to NUL terminated path */
+	__u64	buf;		/* pointer to struct statx */
+	__u32	mask;		/* STATX_* fields wanted */
+	__s32	res;		/* set by the kernel, as for IORING_OP_STATX */
+};
+
 struct io_uring_clone_buffers {
 	__u32	src_fd;
 	__u32	flags;
@@ -772,10 +793,20 @@ struct io_uring_buf_status {
 struct io_uring_napi {
 	__u32	busy_poll_to;
 	__u8	prefer_busy_poll;
-	__u8	pad[3];
+	__u8	flags;
+	__u8	pad[2];
 	__u64	resv;
 };
 
+/*
+ * io_uring_napi->flags
+ *
+ * IO_URING_NAPI_ADAPTIVE	Busy poll each NAPI ID in proportion to how
+ *				often polling it produced completions lately,
+ *				and drop IDs that stay cold early.
+ */
+#define IO_URING_NAPI_ADAPTIVE	(1U << 0)
+
 /*
  * io_uring_restriction->opcode values
  */
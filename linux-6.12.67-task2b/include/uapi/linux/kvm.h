@@ -1529,6 +1529,23 @@ struct kvm_stats_desc {
 	char name[];
 };
 
+/**
+ * struct kvm_stats_mmap - Layout of a mapped vcpu binary stats fd.
+ * @seq: Sequence count, odd while @data is being updated. A reader samples
+ *       it before and after copying @data and retries if it was odd or
+ *       changed in between.
+ * @size: The size of @data in bytes.
+ * @data: A snapshot of the stats data, laid out as the block found at
+ *        &kvm_stats_header->data_offset of the fd. It is refreshed whenever
+ *        the vcpu thread leaves the vcpu: on return from a vcpu ioctl and
+ *        when it is scheduled out.
+ */
+struct kvm_stats_mmap {
+	__u32 seq;
+	__u32 size;
+	__u64 data[];
+};
+
 #define KVM_GET_STATS_FD  _IO(KVMIO,  0xce)
 
 /* Available with KVM_CAP_XSAVE2 */
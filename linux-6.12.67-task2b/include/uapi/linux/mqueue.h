@@ -33,6 +33,15 @@ struct mq_attr {
 	__kernel_long_t	__reserved[4];	/* ignored for input, zeroed for output */
 };
 
+/* one message of mq_sendmmsg() and mq_recvmmsg() */
+struct mq_mmsg {
+	__u64	msg_ptr;	/* message buffer				*/
+	__u64	msg_len;	/* send: message length; receive: buffer size
+				   in, message length out			*/
+	__u32	msg_prio;	/* send: priority; receive: priority out	*/
+	__u32	__reserved;	/* must be zero for send			*/
+};
+
 /*
  * SIGEV_THREAD implementation:
  * SIGEV_THREAD must be implemented in user space. If SIGEV_THREAD is passed
@@ -1224,6 +1224,7 @@ enum nft_limit_attributes {
 
 enum nft_connlimit_flags {
 	NFT_CONNLIMIT_F_INV	= (1 << 0),
+	NFT_CONNLIMIT_F_APPROX	= (1 << 1),
 };
 
 /**
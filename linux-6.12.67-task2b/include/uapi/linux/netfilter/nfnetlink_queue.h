@@ -3,6 +3,7 @@
 #define _NFNETLINK_QUEUE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 #include <linux/netfilter/nfnetlink.h>
 
 enum nfqnl_msg_types {
@@ -127,4 +128,59 @@ enum nfqnl_attr_config {
 /* csum not validated (incoming device doesn't support hw checksum, etc.) */
 #define NFQA_SKB_CSUM_NOTVERIFIED (1 << 2)
 
+/* Shared memory ring, attached to a bound queue through /dev/nfqueue.
+ *
+ * The mapping holds a struct nfq_ring_hdr, the receive frames at rx_off and
+ * the verdict ring at vr_off. The kernel fills frame rx_head % frame_nr and
+ * advances rx_head, userspace advances rx_tail once it is done with a frame.
+ * Verdicts are put at vr_head % frame_nr, they are consumed on
+ * NFQ_RING_IOC_VERDICT and on poll(). A verdict carrying a payload refers to
+ * a receive frame which must not be released before the verdict is consumed.
+ */
+struct nfq_ring_req {
+	__u32	queue_num;
+	__u32	portid;		/* of the netlink socket bound to the queue */
+	__u32	frame_size;	/* power of two */
+	__u32	frame_nr;	/* power of two */
+};
+
+struct nfq_ring_hdr {
+	__u32	rx_head;	/* written by the kernel */
+	__u32	rx_tail;	/* written by userspace */
+	__u32	vr_head;	/* written by userspace */
+	__u32	vr_tail;	/* written by the kernel */
+	__u32	frame_size;
+	__u32	frame_nr;
+	__u32	rx_off;
+	__u32	vr_off;
+};
+
+struct nfq_ring_frame {
+	__u32	id;		/* packet id, for the verdict */
+	__u32	len;		/* bytes of packet data after the header */
+	__u32	cap_len;	/* length of the packet */
+	__u32	mark;
+	__u32	indev;		/* ifindex, 0 if none */
+	__u32	outdev;		/* ifindex, 0 if none */
+	__be16	hw_protocol;
+	__u8	hook;
+	__u8	pf;
+	__u32	priority;
+};
+#define NFQ_RING_FRAME_DATA	32	/* offset of the packet data in a frame */
+
+struct nfq_ring_verdict {
+	__u32	id;
+	__u32	verdict;
+	__u32	flags;		/* NFQ_RING_VF_* */
+	__u32	mark;
+	__u32	frame;		/* receive frame holding the new payload */
+	__u32	len;		/* length of the new payload */
+};
+#define NFQ_RING_VF_MARK	(1 << 0)
+#define NFQ_RING_VF_PAYLOAD	(1 << 1)
+
+#define NFQ_RING_IOC_SETUP	_IOW('q', 1, struct nfq_ring_req)
+#define NFQ_RING_IOC_VERDICT	_IO('q', 2)
+
 #endif /* _NFNETLINK_QUEUE_H */
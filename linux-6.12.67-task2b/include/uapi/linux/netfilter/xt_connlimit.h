@@ -10,6 +10,7 @@ struct xt_connlimit_data;
 enum {
 	XT_CONNLIMIT_INVERT = 1 << 0,
 	XT_CONNLIMIT_DADDR  = 1 << 1,
+	XT_CONNLIMIT_APPROX = 1 << 2,
 };
 
 struct xt_connlimit_info {
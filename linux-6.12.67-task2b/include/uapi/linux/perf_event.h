@@ -460,7 +460,8 @@ struct perf_event_attr {
 				inherit_thread :  1, /* children only inherit if cloned with CLONE_THREAD */
 				remove_on_exec :  1, /* event is removed from task on exec */
 				sigtrap        :  1, /* send synchronous SIGTRAP on event */
-				__reserved_1   : 26;
+				callchain_dict :  1, /* dictionary encode callchains */
+				__reserved_1   : 25;
 
 	union {
 		__u32		wakeup_events;	  /* wakeup every n events */
@@ -979,6 +980,17 @@ enum perf_event_type {
 	 *	  u64			ips[nr];  } && PERF_SAMPLE_CALLCHAIN
 	 *
 	 *	#
+	 *	# With perf_event_attr::callchain_dict, a callchain may
+	 *	# instead be emitted as
+	 *	#
+	 *	#   ips[0] == PERF_CONTEXT_CALLCHAIN_DEF, ips[1] == id,
+	 *	#   ips[2..nr) being the callchain itself, or as
+	 *	#
+	 *	#   nr == 2, ips[0] == PERF_CONTEXT_CALLCHAIN_REF, ips[1] == id,
+	 *	#   referring to the callchain of an earlier DEF with the
+	 *	#   same id in the same ring buffer.
+	 *	#
+	 *	#
 	 *	# The RAW record below is opaque data wrt the ABI
 	 *	#
 	 *	# That is, the ABI doesn't make any promises wrt to
@@ -1261,6 +1273,9 @@ enum perf_callchain_context {
 	PERF_CONTEXT_GUEST_KERNEL	= (__u64)-2176,
 	PERF_CONTEXT_GUEST_USER		= (__u64)-2560,
 
+	PERF_CONTEXT_CALLCHAIN_DEF	= (__u64)-3072,
+	PERF_CONTEXT_CALLCHAIN_REF	= (__u64)-3073,
+
 	PERF_CONTEXT_MAX		= (__u64)-4095,
 };
 
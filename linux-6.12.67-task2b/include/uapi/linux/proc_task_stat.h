@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_PROC_TASK_STAT_H
+#define _UAPI_LINUX_PROC_TASK_STAT_H
+
+#include <linux/types.h>
+
+/*
+ * Record layout of /proc/task_stat. Reading the file yields one record per
+ * process visible in the pid namespace of the proc mount, in ascending pid
+ * order, with no header or padding between records.
+ */
+struct proc_task_stat {
+	__s32	pid;		/* thread group id */
+	__u32	uid;		/* real uid */
+	__u64	utime;		/* user time of all threads, in ns */
+	__u64	stime;		/* system time of all threads, in ns */
+	__u64	rss;		/* resident set size, in pages */
+};
+
+#endif /* _UAPI_LINUX_PROC_TASK_STAT_H */
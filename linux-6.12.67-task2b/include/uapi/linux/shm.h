@@ -51,6 +51,9 @@ struct shmid_ds {
 /* Bits 9 & 10 are IPC_CREAT and IPC_EXCL */
 #define SHM_HUGETLB	04000	/* segment will use huge TLB pages */
 #define SHM_NORESERVE	010000	/* don't check for reservations */
+#define SHM_THP		020000	/* map with transparent huge pages, as if
+				   madvise(MADV_HUGEPAGE) had been called */
+#define SHM_POPULATE	040000	/* fault the whole segment in at shmget */
 
 /*
  * Huge page size encoding when SHM_HUGETLB is specified, and a huge page
@@ -14,6 +14,8 @@
 #include "fdinfo.h"
 #include "cancel.h"
 #include "rsrc.h"
+#include "napi.h"
+#include "stats.h"
 
 #ifdef CONFIG_PROC_FS
 static __cold int io_uring_show_cred(struct seq_file *m, unsigned int id,
@@ -238,9 +240,13 @@ __cold void io_uring_show_fdinfo(struct seq_file *m, struct file *file)
 			seq_puts(m, "napi_prefer_busy_poll:\ttrue\n");
 		else
 			seq_puts(m, "napi_prefer_busy_poll:\tfalse\n");
+		seq_printf(m, "napi_adaptive:\t%s\n",
+			   ctx->napi_adaptive ? "true" : "false");
+		io_napi_show_fdinfo(ctx, m);
 	} else {
 		seq_puts(m, "NAPI:\tdisabled\n");
 	}
 #endif
+	io_stats_show_fdinfo(ctx, m);
 }
 #endif
@@ -17,6 +17,7 @@
 #include <linux/task_work.h>
 #include <linux/audit.h>
 #include <linux/mmu_context.h>
+#include <linux/topology.h>
 #include <uapi/linux/io_uring.h>
 
 #include "io-wq.h"
@@ -52,6 +53,7 @@ struct io_worker {
 	struct list_head all_list;
 	struct task_struct *task;
 	struct io_wq *wq;
+	int node;
 
 	struct io_wq_work *cur_work;
 	raw_spinlock_t lock;
@@ -80,6 +82,7 @@ struct io_wq_acct {
 	unsigned nr_workers;
 	unsigned max_workers;
 	int index;
+	int node;
 	atomic_t nr_running;
 	raw_spinlock_t lock;
 	struct io_wq_work_list work_list;
@@ -92,6 +95,21 @@ enum {
 	IO_WQ_ACCT_NR,
 };
 
+/*
+ * Per NUMA node state. Work is queued on the node of the submitting CPU and
+ * run by workers of that node; a worker only takes work from another node
+ * when its own node has none.
+ */
+struct io_wq_node {
+	struct io_wq_acct acct[IO_WQ_ACCT_NR];
+
+	/* idle workers of this node, protected by io_wq->lock */
+	struct hlist_nulls_head free_list;
+
+	/* protected by the acct->lock of the list the work is on */
+	struct io_wq_work *hash_tail[IO_WQ_NR_HASH_BUCKETS];
+};
+
 /*
  * Per io_wq state
   */
@@ -110,19 +128,20 @@ struct io_wq {
 
 	struct task_struct *task;
 
-	struct io_wq_acct acct[IO_WQ_ACCT_NR];
-
-	/* lock protects access to elements below */
+	/*
+	 * lock protects the worker counts, the free lists of all nodes and
+	 * the elements below
+	 */
 	raw_spinlock_t lock;
 
-	struct hlist_nulls_head free_list;
 	struct list_head all_list;
 
 	struct wait_queue_entry wait;
 
-	struct io_wq_work *hash_tail[IO_WQ_NR_HASH_BUCKETS];
-
 	cpumask_var_t cpu_mask;
+
+	/* indexed by node id, one for each possible node */
+	struct io_wq_node *nodes[];
 };
 
 static enum cpuhp_state io_wq_online;
@@ -135,7 +154,7 @@ struct io_cb_cancel_data {
 	bool cancel_all;
 };
 
-static bool create_io_worker(struct io_wq *wq, int index);
+static bool create_io_worker(struct io_wq *wq, struct io_wq_acct *acct);
 static void io_wq_dec_running(struct io_worker *worker);
 static bool io_acct_cancel_pending_work(struct io_wq *wq,
 					struct io_wq_acct *acct,
@@ -154,20 +173,24 @@ static void io_worker_release(struct io_worker *worker)
 		complete(&worker->ref_done);
 }
 
-static inline struct io_wq_acct *io_get_acct(struct io_wq *wq, bool bound)
+static inline struct io_wq_acct *io_get_acct(struct io_wq *wq, int node,
+					     bool bound)
 {
-	return &wq->acct[bound ? IO_WQ_ACCT_BOUND : IO_WQ_ACCT_UNBOUND];
+	return &wq->nodes[node]->acct[bound ? IO_WQ_ACCT_BOUND : IO_WQ_ACCT_UNBOUND];
 }
 
+/* new work goes to the node of the CPU submitting it */
 static inline struct io_wq_acct *io_work_get_acct(struct io_wq *wq,
 						  struct io_wq_work *work)
 {
-	return io_get_acct(wq, !(atomic_read(&work->flags) & IO_WQ_WORK_UNBOUND));
+	return io_get_acct(wq, numa_node_id(),
+			   !(atomic_read(&work->flags) & IO_WQ_WORK_UNBOUND));
 }
 
 static inline struct io_wq_acct *io_wq_get_acct(struct io_worker *worker)
 {
-	return io_get_acct(worker->wq, test_bit(IO_WORKER_F_BOUND, &worker->flags));
+	return io_get_acct(worker->wq, worker->node,
+			   test_bit(IO_WORKER_F_BOUND, &worker->flags));
 }
 
 static void io_worker_ref_put(struct io_wq *wq)
@@ -265,6 +288,19 @@ static inline bool io_acct_run_queue(struct io_wq_acct *acct)
 	return false;
 }
 
+/*
+ * Bound work that has hit the bound worker limit. Idle unbound workers of
+ * the same node help out with it, one item at a time, so that bursts of
+ * bound work (e.g. buffered writes) don't queue up behind max_workers while
+ * unbound workers sleep. The reverse is never done: unbound work may block
+ * indefinitely and would tie up the bounded pool.
+ */
+static inline bool io_acct_saturated(struct io_wq_acct *acct)
+{
+	return acct->index == IO_WQ_ACCT_BOUND &&
+		data_race(acct->nr_workers) >= acct->max_workers;
+}
+
 /*
  * Check head of free list for an available worker. If one isn't available,
  * caller must create one.
@@ -281,7 +317,8 @@ static bool io_wq_activate_free_worker(struct io_wq *wq,
 	 * activate. If a given worker is on the free_list but in the process
 	 * of exiting, keep trying.
 	 */
-	hlist_nulls_for_each_entry_rcu(worker, n, &wq->free_list, nulls_node) {
+	hlist_nulls_for_each_entry_rcu(worker, n, &wq->nodes[acct->node]->free_list,
+				       nulls_node) {
 		if (!io_worker_get(worker))
 			continue;
 		if (io_wq_get_acct(worker) != acct) {
@@ -323,7 +360,7 @@ static bool io_wq_create_worker(struct io_wq *wq, struct io_wq_acct *acct)
 	raw_spin_unlock(&wq->lock);
 	atomic_inc(&acct->nr_running);
 	atomic_inc(&wq->worker_refs);
-	return create_io_worker(wq, acct->index);
+	return create_io_worker(wq, acct);
 }
 
 static void io_wq_inc_running(struct io_worker *worker)
@@ -343,7 +380,7 @@ static void create_worker_cb(struct callback_head *cb)
 
 	worker = container_of(cb, struct io_worker, create_work);
 	wq = worker->wq;
-	acct = &wq->acct[worker->create_index];
+	acct = &wq->nodes[worker->node]->acct[worker->create_index];
 	raw_spin_lock(&wq->lock);
 
 	if (acct->nr_workers < acct->max_workers) {
@@ -352,7 +389,7 @@ static void create_worker_cb(struct callback_head *cb)
 	}
 	raw_spin_unlock(&wq->lock);
 	if (do_create) {
-		create_io_worker(wq, worker->create_index);
+		create_io_worker(wq, acct);
 	} else {
 		atomic_dec(&acct->nr_running);
 		io_worker_ref_put(wq);
@@ -448,7 +485,8 @@ static void __io_worker_idle(struct io_wq *wq, struct io_worker *worker)
 {
 	if (!test_bit(IO_WORKER_F_FREE, &worker->flags)) {
 		set_bit(IO_WORKER_F_FREE, &worker->flags);
-		hlist_nulls_add_head_rcu(&worker->nulls_node, &wq->free_list);
+		hlist_nulls_add_head_rcu(&worker->nulls_node,
+					 &wq->nodes[worker->node]->free_list);
 	}
 }
 
@@ -482,6 +520,7 @@ static struct io_wq_work *io_get_next_work(struct io_wq_acct *acct,
 	struct io_wq_work *work, *tail;
 	unsigned int stall_hash = -1U;
 	struct io_wq *wq = worker->wq;
+	struct io_wq_work **hash_tail = wq->nodes[acct->node]->hash_tail;
 
 	wq_list_for_each(node, prev, &acct->work_list) {
 		unsigned int hash;
@@ -496,11 +535,11 @@ static struct io_wq_work *io_get_next_work(struct io_wq_acct *acct,
 
 		hash = io_get_work_hash(work);
 		/* all items with this hash lie in [work, tail] */
-		tail = wq->hash_tail[hash];
+		tail = hash_tail[hash];
 
 		/* hashed, can run if not already running */
 		if (!test_and_set_bit(hash, &wq->hash->map)) {
-			wq->hash_tail[hash] = NULL;
+			hash_tail[hash] = NULL;
 			wq_list_cut(&acct->work_list, &tail->list, prev);
 			return work;
 		}
@@ -545,13 +584,16 @@ static void io_assign_current_work(struct io_worker *worker,
 }
 
 /*
- * Called with acct->lock held, drops it before returning
+ * Called with acct->lock held, drops it before returning. acct is either the
+ * worker's own or, when stealing, the same class on another node or the
+ * saturated bound list of the worker's node.
  */
 static void io_worker_handle_work(struct io_wq_acct *acct,
 				  struct io_worker *worker)
 	__releases(&acct->lock)
 {
 	struct io_wq *wq = worker->wq;
+	struct io_wq_acct *own = io_wq_get_acct(worker);
 	bool do_kill = test_bit(IO_WQ_BIT_EXIT, &wq->state);
 
 	do {
@@ -624,10 +666,55 @@ static void io_worker_handle_work(struct io_wq_acct *acct,
 
 		if (!__io_acct_run_queue(acct))
 			break;
+		/*
+		 * Stop stealing as soon as our own list has work again, and
+		 * take only one item at a time from the other class.
+		 */
+		if (acct != own && (acct->index != own->index ||
+				    __io_acct_run_queue(own)))
+			break;
 		raw_spin_lock(&acct->lock);
 	} while (1);
 }
 
+/*
+ * Our own list ran dry: take work of the same class from the other nodes,
+ * or, for unbound workers, bound work the bound workers can't keep up with.
+ * Returns true if any work was run.
+ */
+static bool io_worker_steal_work(struct io_wq_acct *acct,
+				 struct io_worker *worker)
+{
+	struct io_wq *wq = worker->wq;
+	bool stole = false;
+	int node;
+
+	for_each_node(node) {
+		struct io_wq_acct *victim = &wq->nodes[node]->acct[acct->index];
+
+		if (nr_node_ids == 1)
+			break;
+		if (victim == acct || !__io_acct_run_queue(victim))
+			continue;
+		if (io_acct_run_queue(victim)) {
+			io_worker_handle_work(victim, worker);
+			stole = true;
+		}
+		if (__io_acct_run_queue(acct))
+			return stole;
+	}
+
+	if (!stole && acct->index == IO_WQ_ACCT_UNBOUND) {
+		struct io_wq_acct *bound = io_get_acct(wq, worker->node, true);
+
+		if (io_acct_saturated(bound) && io_acct_run_queue(bound)) {
+			io_worker_handle_work(bound, worker);
+			stole = true;
+		}
+	}
+	return stole;
+}
+
 static int io_wq_worker(void *data)
 {
 	struct io_worker *worker = data;
@@ -653,6 +740,8 @@ static int io_wq_worker(void *data)
 		 */
 		while (io_acct_run_queue(acct))
 			io_worker_handle_work(acct, worker);
+		if (io_worker_steal_work(acct, worker))
+			continue;
 
 		raw_spin_lock(&wq->lock);
 		/*
@@ -728,15 +817,38 @@ void io_wq_worker_sleeping(struct task_struct *tsk)
 	io_wq_dec_running(worker);
 }
 
+/*
+ * Keep the worker on the CPUs of its node, unless the io_wq affinity leaves
+ * none of them.
+ */
+static void io_worker_set_affinity(struct io_wq *wq, struct io_worker *worker,
+				   struct task_struct *tsk)
+{
+	cpumask_var_t mask;
+
+	if (nr_node_ids > 1 && alloc_cpumask_var(&mask, GFP_KERNEL)) {
+		bool local = cpumask_and(mask, wq->cpu_mask,
+					 cpumask_of_node(worker->node));
+
+		if (local)
+			set_cpus_allowed_ptr(tsk, mask);
+		free_cpumask_var(mask);
+		if (local)
+			return;
+	}
+	set_cpus_allowed_ptr(tsk, wq->cpu_mask);
+}
+
 static void io_init_new_worker(struct io_wq *wq, struct io_worker *worker,
 			       struct task_struct *tsk)
 {
 	tsk->worker_private = worker;
 	worker->task = tsk;
-	set_cpus_allowed_ptr(tsk, wq->cpu_mask);
+	io_worker_set_affinity(wq, worker, tsk);
 
 	raw_spin_lock(&wq->lock);
-	hlist_nulls_add_head_rcu(&worker->nulls_node, &wq->free_list);
+	hlist_nulls_add_head_rcu(&worker->nulls_node,
+				 &wq->nodes[worker->node]->free_list);
 	list_add_tail_rcu(&worker->all_list, &wq->all_list);
 	set_bit(IO_WORKER_F_FREE, &worker->flags);
 	raw_spin_unlock(&wq->lock);
@@ -791,7 +903,7 @@ static void create_worker_cont(struct callback_head *cb)
 	worker = container_of(cb, struct io_worker, create_work);
 	clear_bit_unlock(0, &worker->create_state);
 	wq = worker->wq;
-	tsk = create_io_thread(io_wq_worker, worker, NUMA_NO_NODE);
+	tsk = create_io_thread(io_wq_worker, worker, worker->node);
 	if (!IS_ERR(tsk)) {
 		io_init_new_worker(wq, worker, tsk);
 		io_worker_release(worker);
@@ -834,15 +946,14 @@ static void io_workqueue_create(struct work_struct *work)
 		kfree(worker);
 }
 
-static bool create_io_worker(struct io_wq *wq, int index)
+static bool create_io_worker(struct io_wq *wq, struct io_wq_acct *acct)
 {
-	struct io_wq_acct *acct = &wq->acct[index];
 	struct io_worker *worker;
 	struct task_struct *tsk;
 
 	__set_current_state(TASK_RUNNING);
 
-	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	worker = kzalloc_node(sizeof(*worker), GFP_KERNEL, acct->node);
 	if (!worker) {
 fail:
 		atomic_dec(&acct->nr_running);
@@ -855,13 +966,14 @@ fail:
 
 	refcount_set(&worker->ref, 1);
 	worker->wq = wq;
+	worker->node = acct->node;
 	raw_spin_lock_init(&worker->lock);
 	init_completion(&worker->ref_done);
 
-	if (index == IO_WQ_ACCT_BOUND)
+	if (acct->index == IO_WQ_ACCT_BOUND)
 		set_bit(IO_WORKER_F_BOUND, &worker->flags);
 
-	tsk = create_io_thread(io_wq_worker, worker, NUMA_NO_NODE);
+	tsk = create_io_thread(io_wq_worker, worker, acct->node);
 	if (!IS_ERR(tsk)) {
 		io_init_new_worker(wq, worker, tsk);
 	} else if (!io_should_retry_thread(worker, PTR_ERR(tsk))) {
@@ -916,9 +1028,10 @@ static void io_run_cancel(struct io_wq_work *work, struct io_wq *wq)
 	} while (work);
 }
 
-static void io_wq_insert_work(struct io_wq *wq, struct io_wq_work *work)
+static void io_wq_insert_work(struct io_wq *wq, struct io_wq_acct *acct,
+			      struct io_wq_work *work)
 {
-	struct io_wq_acct *acct = io_work_get_acct(wq, work);
+	struct io_wq_work **hash_tail = wq->nodes[acct->node]->hash_tail;
 	unsigned int hash;
 	struct io_wq_work *tail;
 
@@ -929,8 +1042,8 @@ append:
 	}
 
 	hash = io_get_work_hash(work);
-	tail = wq->hash_tail[hash];
-	wq->hash_tail[hash] = work;
+	tail = hash_tail[hash];
+	hash_tail[hash] = work;
 	if (!tail)
 		goto append;
 
@@ -964,12 +1077,14 @@ void io_wq_enqueue(struct io_wq *wq, struct io_wq_work *work)
 	}
 
 	raw_spin_lock(&acct->lock);
-	io_wq_insert_work(wq, work);
+	io_wq_insert_work(wq, acct, work);
 	clear_bit(IO_ACCT_STALLED_BIT, &acct->flags);
 	raw_spin_unlock(&acct->lock);
 
 	rcu_read_lock();
 	do_create = !io_wq_activate_free_worker(wq, acct);
+	if (do_create && io_acct_saturated(acct))
+		io_wq_activate_free_worker(wq, io_get_acct(wq, acct->node, false));
 	rcu_read_unlock();
 
 	if (do_create && ((work_flags & IO_WQ_WORK_CONCURRENT) ||
@@ -1034,20 +1149,21 @@ static bool io_wq_worker_cancel(struct io_worker *worker, void *data)
 }
 
 static inline void io_wq_remove_pending(struct io_wq *wq,
+					 struct io_wq_acct *acct,
 					 struct io_wq_work *work,
 					 struct io_wq_work_node *prev)
 {
-	struct io_wq_acct *acct = io_work_get_acct(wq, work);
+	struct io_wq_work **hash_tail = wq->nodes[acct->node]->hash_tail;
 	unsigned int hash = io_get_work_hash(work);
 	struct io_wq_work *prev_work = NULL;
 
-	if (io_wq_is_hashed(work) && work == wq->hash_tail[hash]) {
+	if (io_wq_is_hashed(work) && work == hash_tail[hash]) {
 		if (prev)
 			prev_work = container_of(prev, struct io_wq_work, list);
 		if (prev_work && io_get_work_hash(prev_work) == hash)
-			wq->hash_tail[hash] = prev_work;
+			hash_tail[hash] = prev_work;
 		else
-			wq->hash_tail[hash] = NULL;
+			hash_tail[hash] = NULL;
 	}
 	wq_list_del(&acct->work_list, &work->list, prev);
 }
@@ -1064,7 +1180,7 @@ static bool io_acct_cancel_pending_work(struct io_wq *wq,
 		work = container_of(node, struct io_wq_work, list);
 		if (!match->fn(work, match->data))
 			continue;
-		io_wq_remove_pending(wq, work, prev);
+		io_wq_remove_pending(wq, acct, work, prev);
 		raw_spin_unlock(&acct->lock);
 		io_run_cancel(work, wq);
 		match->nr_pending++;
@@ -1079,15 +1195,17 @@ static bool io_acct_cancel_pending_work(struct io_wq *wq,
 static void io_wq_cancel_pending_work(struct io_wq *wq,
 				      struct io_cb_cancel_data *match)
 {
-	int i;
+	int node, i;
 retry:
-	for (i = 0; i < IO_WQ_ACCT_NR; i++) {
-		struct io_wq_acct *acct = io_get_acct(wq, i == 0);
-
-		if (io_acct_cancel_pending_work(wq, acct, match)) {
-			if (match->cancel_all)
-				goto retry;
-			break;
+	for_each_node(node) {
+		for (i = 0; i < IO_WQ_ACCT_NR; i++) {
+			struct io_wq_acct *acct = io_get_acct(wq, node, i == 0);
+
+			if (io_acct_cancel_pending_work(wq, acct, match)) {
+				if (match->cancel_all)
+					goto retry;
+				return;
+			}
 		}
 	}
 }
@@ -1143,24 +1261,34 @@ static int io_wq_hash_wake(struct wait_queue_entry *wait, unsigned mode,
 			    int sync, void *key)
 {
 	struct io_wq *wq = container_of(wait, struct io_wq, wait);
-	int i;
+	int node, i;
 
 	list_del_init(&wait->entry);
 
 	rcu_read_lock();
-	for (i = 0; i < IO_WQ_ACCT_NR; i++) {
-		struct io_wq_acct *acct = &wq->acct[i];
+	for_each_node(node) {
+		for (i = 0; i < IO_WQ_ACCT_NR; i++) {
+			struct io_wq_acct *acct = &wq->nodes[node]->acct[i];
 
-		if (test_and_clear_bit(IO_ACCT_STALLED_BIT, &acct->flags))
-			io_wq_activate_free_worker(wq, acct);
+			if (test_and_clear_bit(IO_ACCT_STALLED_BIT, &acct->flags))
+				io_wq_activate_free_worker(wq, acct);
+		}
 	}
 	rcu_read_unlock();
 	return 1;
 }
 
+static void io_wq_free_nodes(struct io_wq *wq)
+{
+	int node;
+
+	for_each_node(node)
+		kfree(wq->nodes[node]);
+}
+
 struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 {
-	int ret, i;
+	int ret, node, i;
 	struct io_wq *wq;
 
 	if (WARN_ON_ONCE(!data->free_work || !data->do_work))
@@ -1168,7 +1296,7 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 	if (WARN_ON_ONCE(!bounded))
 		return ERR_PTR(-EINVAL);
 
-	wq = kzalloc(sizeof(struct io_wq), GFP_KERNEL);
+	wq = kzalloc(struct_size(wq, nodes, nr_node_ids), GFP_KERNEL);
 	if (!wq)
 		return ERR_PTR(-ENOMEM);
 
@@ -1182,22 +1310,34 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 	if (!alloc_cpumask_var(&wq->cpu_mask, GFP_KERNEL))
 		goto err;
 	cpuset_cpus_allowed(data->task, wq->cpu_mask);
-	wq->acct[IO_WQ_ACCT_BOUND].max_workers = bounded;
-	wq->acct[IO_WQ_ACCT_UNBOUND].max_workers =
-				task_rlimit(current, RLIMIT_NPROC);
-	INIT_LIST_HEAD(&wq->wait.entry);
-	wq->wait.func = io_wq_hash_wake;
-	for (i = 0; i < IO_WQ_ACCT_NR; i++) {
-		struct io_wq_acct *acct = &wq->acct[i];
 
-		acct->index = i;
-		atomic_set(&acct->nr_running, 0);
-		INIT_WQ_LIST(&acct->work_list);
-		raw_spin_lock_init(&acct->lock);
+	/* the worker limits apply to each node */
+	for_each_node(node) {
+		struct io_wq_node *wqn;
+
+		wqn = kzalloc_node(sizeof(*wqn), GFP_KERNEL,
+				   node_online(node) ? node : NUMA_NO_NODE);
+		if (!wqn)
+			goto err;
+		wq->nodes[node] = wqn;
+		wqn->acct[IO_WQ_ACCT_BOUND].max_workers = bounded;
+		wqn->acct[IO_WQ_ACCT_UNBOUND].max_workers =
+					task_rlimit(current, RLIMIT_NPROC);
+		for (i = 0; i < IO_WQ_ACCT_NR; i++) {
+			struct io_wq_acct *acct = &wqn->acct[i];
+
+			acct->index = i;
+			acct->node = node;
+			atomic_set(&acct->nr_running, 0);
+			INIT_WQ_LIST(&acct->work_list);
+			raw_spin_lock_init(&acct->lock);
+		}
+		INIT_HLIST_NULLS_HEAD(&wqn->free_list, 0);
 	}
+	INIT_LIST_HEAD(&wq->wait.entry);
+	wq->wait.func = io_wq_hash_wake;
 
 	raw_spin_lock_init(&wq->lock);
-	INIT_HLIST_NULLS_HEAD(&wq->free_list, 0);
 	INIT_LIST_HEAD(&wq->all_list);
 
 	wq->task = get_task_struct(data->task);
@@ -1212,6 +1352,7 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 	return wq;
 err:
 	io_wq_put_hash(data->hash);
+	io_wq_free_nodes(wq);
 	free_cpumask_var(wq->cpu_mask);
 	kfree(wq);
 	return ERR_PTR(ret);
@@ -1280,6 +1421,7 @@ static void io_wq_destroy(struct io_wq *wq)
 
 	cpuhp_state_remove_instance_nocalls(io_wq_online, &wq->cpuhp_node);
 	io_wq_cancel_pending_work(wq, &match);
+	io_wq_free_nodes(wq);
 	free_cpumask_var(wq->cpu_mask);
 	io_wq_put_hash(wq->hash);
 	kfree(wq);
@@ -1365,13 +1507,13 @@ int io_wq_cpu_affinity(struct io_uring_task *tctx, cpumask_var_t mask)
 
 /*
  * Set max number of unbounded workers, returns old value. If new_count is 0,
- * then just return the old value.
+ * then just return the old value. The limits apply to each node.
  */
 int io_wq_max_workers(struct io_wq *wq, int *new_count)
 {
 	struct io_wq_acct *acct;
 	int prev[IO_WQ_ACCT_NR];
-	int i;
+	int node, i;
 
 	BUILD_BUG_ON((int) IO_WQ_ACCT_BOUND   != (int) IO_WQ_BOUND);
 	BUILD_BUG_ON((int) IO_WQ_ACCT_UNBOUND != (int) IO_WQ_UNBOUND);
@@ -1388,11 +1530,13 @@ int io_wq_max_workers(struct io_wq *wq, int *new_count)
 	rcu_read_lock();
 
 	raw_spin_lock(&wq->lock);
-	for (i = 0; i < IO_WQ_ACCT_NR; i++) {
-		acct = &wq->acct[i];
-		prev[i] = max_t(int, acct->max_workers, prev[i]);
-		if (new_count[i])
-			acct->max_workers = new_count[i];
+	for_each_node(node) {
+		for (i = 0; i < IO_WQ_ACCT_NR; i++) {
+			acct = &wq->nodes[node]->acct[i];
+			prev[i] = max_t(int, acct->max_workers, prev[i]);
+			if (new_count[i])
+				acct->max_workers = new_count[i];
+		}
 	}
 	raw_spin_unlock(&wq->lock);
 	rcu_read_unlock();
@@ -344,6 +344,7 @@ static __cold struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
 	INIT_WQ_LIST(&ctx->submit_state.compl_reqs);
 	INIT_HLIST_HEAD(&ctx->cancelable_uring_cmd);
 	io_napi_init(ctx);
+	io_stats_init(ctx);
 
 	return ctx;
 
@@ -512,6 +513,7 @@ static void io_queue_iowq(struct io_kiocb *req)
 		atomic_or(IO_WQ_WORK_CANCEL, &req->work.flags);
 
 	trace_io_uring_queue_async_work(req, io_wq_is_hashed(&req->work));
+	io_stats_iowq(req);
 	io_wq_enqueue(tctx->io_wq, &req->work);
 }
 
@@ -744,6 +746,7 @@ static bool io_cqring_event_overflow(struct io_ring_ctx *ctx, u64 user_data,
 
 static void io_req_cqe_overflow(struct io_kiocb *req)
 {
+	io_stats_complete(req);
 	io_cqring_event_overflow(req->ctx, req->cqe.user_data,
 				req->cqe.res, req->cqe.flags,
 				req->big_cqe.extra1, req->big_cqe.extra2);
@@ -944,6 +947,9 @@ static void io_preinit_req(struct io_kiocb *req, struct io_ring_ctx *ctx)
 	/* not necessary, but safer to zero */
 	memset(&req->cqe, 0, sizeof(req->cqe));
 	memset(&req->big_cqe, 0, sizeof(req->big_cqe));
+#ifdef CONFIG_IO_URING_STATS
+	req->issue_ns = 0;
+#endif
 }
 
 /*
@@ -1423,6 +1429,46 @@ static void io_free_batch_list(struct io_ring_ctx *ctx,
 	} while (node);
 }
 
+/*
+ * Post the CQEs of a completion batch. Rather than going through
+ * io_get_cqe() for every request, take the whole contiguous run of free CQ
+ * slots at once, copy into it and advance the cached tail once per run.
+ * Returns the first request that did not fit, NULL if all did.
+ */
+static struct io_wq_work_node *io_fill_cqe_batch(struct io_ring_ctx *ctx,
+						 struct io_wq_work_node *node)
+{
+	unsigned int shift = (ctx->flags & IORING_SETUP_CQE32) ? 1 : 0;
+
+	io_lockdep_assert_cq_locked(ctx);
+
+	while (node) {
+		struct io_uring_cqe *cqe = ctx->cqe_cached;
+		unsigned int nr;
+
+		if (cqe >= ctx->cqe_sentinel) {
+			if (unlikely(!io_cqe_cache_refill(ctx, false)))
+				break;
+			cqe = ctx->cqe_cached;
+		}
+
+		nr = (ctx->cqe_sentinel - cqe) >> shift;
+		for (; node && nr; node = node->next) {
+			struct io_kiocb *req = container_of(node, struct io_kiocb,
+							    comp_list);
+
+			if (req->flags & REQ_F_CQE_SKIP)
+				continue;
+			io_copy_cqe_req(ctx, cqe, req);
+			cqe += 1 << shift;
+			nr--;
+		}
+		ctx->cached_cq_tail += (cqe - ctx->cqe_cached) >> shift;
+		ctx->cqe_cached = cqe;
+	}
+	return node;
+}
+
 void __io_submit_flush_completions(struct io_ring_ctx *ctx)
 	__must_hold(&ctx->uring_lock)
 {
@@ -1430,20 +1476,20 @@ void __io_submit_flush_completions(struct io_ring_ctx *ctx)
 	struct io_wq_work_node *node;
 
 	__io_cq_lock(ctx);
-	__wq_list_for_each(node, &state->compl_reqs) {
-		struct io_kiocb *req = container_of(node, struct io_kiocb,
-					    comp_list);
+	node = io_fill_cqe_batch(ctx, state->compl_reqs.first);
+	if (unlikely(node)) {
+		/* the CQ is full, the rest of the batch overflows */
+		if (ctx->lockless_cq)
+			spin_lock(&ctx->completion_lock);
+		for (; node; node = node->next) {
+			struct io_kiocb *req = container_of(node, struct io_kiocb,
+							    comp_list);
 
-		if (!(req->flags & REQ_F_CQE_SKIP) &&
-		    unlikely(!io_fill_cqe_req(ctx, req))) {
-			if (ctx->lockless_cq) {
-				spin_lock(&ctx->completion_lock);
-				io_req_cqe_overflow(req);
-				spin_unlock(&ctx->completion_lock);
-			} else {
+			if (!(req->flags & REQ_F_CQE_SKIP))
 				io_req_cqe_overflow(req);
-			}
 		}
+		if (ctx->lockless_cq)
+			spin_unlock(&ctx->completion_lock);
 	}
 	__io_cq_unlock_post(ctx);
 
@@ -1735,6 +1781,7 @@ static int io_issue_sqe(struct io_kiocb *req, unsigned int issue_flags)
 	if (!def->audit_skip)
 		audit_uring_entry(req->opcode);
 
+	io_stats_issue(req);
 	ret = def->issue(req, issue_flags);
 
 	if (!def->audit_skip)
@@ -2040,6 +2087,7 @@ static int io_init_req(struct io_ring_ctx *ctx, struct io_kiocb *req,
 	req->rsrc_node = NULL;
 	req->task = current;
 	req->cancel_seq_set = false;
+	io_stats_submit(req);
 
 	if (unlikely(opcode >= IORING_OP_LAST)) {
 		req->opcode = 0;
@@ -2770,6 +2818,7 @@ static __cold void io_ring_ctx_free(struct io_ring_ctx *ctx)
 	if (ctx->hash_map)
 		io_wq_put_hash(ctx->hash_map);
 	io_napi_free(ctx);
+	io_stats_free(ctx);
 	kfree(ctx->cancel_table.hbs);
 	kfree(ctx->cancel_table_locked.hbs);
 	xa_destroy(&ctx->io_bl_xa);
@@ -3736,7 +3785,7 @@ static long io_uring_setup(u32 entries, struct io_uring_params __user *params)
 			IORING_SETUP_SQE128 | IORING_SETUP_CQE32 |
 			IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN |
 			IORING_SETUP_NO_MMAP | IORING_SETUP_REGISTERED_FD_ONLY |
-			IORING_SETUP_NO_SQARRAY))
+			IORING_SETUP_NO_SQARRAY | IORING_SETUP_SQPOLL_ADAPTIVE))
 		return -EINVAL;
 
 	return io_uring_create(entries, &p, params);
@@ -141,15 +141,23 @@ static inline bool io_kbuf_commit(struct io_kiocb *req,
 
 	if (bl->flags & IOBL_INC) {
 		struct io_uring_buf *buf;
+		u32 buf_len;
 
+		/*
+		 * The ring is shared with the application, read the length
+		 * once so the updated address and length stay consistent.
+		 */
 		buf = io_ring_head_to_buf(bl->buf_ring, bl->head, bl->mask);
-		if (len > buf->len)
-			len = buf->len;
-		buf->len -= len;
-		if (buf->len) {
-			buf->addr += len;
+		buf_len = READ_ONCE(buf->len);
+		if (len > buf_len)
+			len = buf_len;
+		buf_len -= len;
+		if (buf_len) {
+			WRITE_ONCE(buf->addr, READ_ONCE(buf->addr) + len);
+			WRITE_ONCE(buf->len, buf_len);
 			return false;
 		}
+		WRITE_ONCE(buf->len, 0);
 	}
 
 	bl->head += nr;
@@ -19,7 +19,10 @@
 
 struct io_msg {
 	struct file			*file;
-	struct file			*src_file;
+	union {
+		struct file		*src_file;
+		struct io_mapped_ubuf	*src_buf;
+	};
 	struct callback_head		tw;
 	u64 user_data;
 	u32 len;
@@ -58,6 +61,13 @@ void io_msg_ring_cleanup(struct io_kiocb *req)
 {
 	struct io_msg *msg = io_kiocb_to_cmd(req, struct io_msg);
 
+	if (msg->cmd == IORING_MSG_SEND_BUF) {
+		if (WARN_ON_ONCE(!msg->src_buf))
+			return;
+		io_buffer_put(req->ctx, msg->src_buf);
+		msg->src_buf = NULL;
+		return;
+	}
 	if (WARN_ON_ONCE(!msg->src_file))
 		return;
 
@@ -252,6 +262,112 @@ static int io_msg_send_fd(struct io_kiocb *req, unsigned int issue_flags)
 	return io_msg_install_complete(req, issue_flags);
 }
 
+static int io_msg_buf_install_complete(struct io_kiocb *req,
+				       unsigned int issue_flags)
+{
+	struct io_ring_ctx *target_ctx = req->file->private_data;
+	struct io_msg *msg = io_kiocb_to_cmd(req, struct io_msg);
+	struct io_mapped_ubuf *imu = msg->src_buf;
+	struct io_ring_ctx *ctx = req->ctx;
+	int ret;
+
+	if (unlikely(io_double_lock_ctx(target_ctx, issue_flags)))
+		return -EAGAIN;
+
+	ret = io_buffer_install(target_ctx, imu, msg->dst_fd - 1);
+	if (ret < 0)
+		goto out_unlock;
+
+	msg->src_buf = NULL;
+	req->flags &= ~REQ_F_NEED_CLEANUP;
+
+	if (msg->flags & IORING_MSG_RING_CQE_SKIP)
+		goto out_unlock;
+	/* as for IORING_MSG_SEND_FD, the buffer is installed regardless */
+	if (!io_post_aux_cqe(target_ctx, msg->user_data, ret, 0))
+		ret = -EOVERFLOW;
+out_unlock:
+	io_double_unlock_ctx(target_ctx);
+	if (msg->src_buf)
+		return ret;
+
+	/*
+	 * The target owns the buffer now, drop it from the source slot unless
+	 * that was updated in the meantime. Taking our own lock again after
+	 * dropping the target's keeps the lock ordering of the fd path.
+	 */
+	io_ring_submit_lock(ctx, issue_flags);
+	io_buffer_release(ctx, imu, msg->src_fd);
+	io_ring_submit_unlock(ctx, issue_flags);
+	return ret;
+}
+
+static void io_msg_tw_buf_complete(struct callback_head *head)
+{
+	struct io_msg *msg = container_of(head, struct io_msg, tw);
+	struct io_kiocb *req = cmd_to_io_kiocb(msg);
+	int ret = -EOWNERDEAD;
+
+	if (!(current->flags & PF_EXITING))
+		ret = io_msg_buf_install_complete(req, IO_URING_F_UNLOCKED);
+	if (ret < 0)
+		req_set_fail(req);
+	io_req_queue_tw_complete(req, ret);
+}
+
+static int io_msg_buf_remote(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->file->private_data;
+	struct io_msg *msg = io_kiocb_to_cmd(req, struct io_msg);
+	struct task_struct *task = READ_ONCE(ctx->submitter_task);
+
+	if (unlikely(!task))
+		return -EOWNERDEAD;
+
+	init_task_work(&msg->tw, io_msg_tw_buf_complete);
+	if (task_work_add(task, &msg->tw, TWA_SIGNAL))
+		return -EOWNERDEAD;
+
+	return IOU_ISSUE_SKIP_COMPLETE;
+}
+
+/*
+ * Move registered buffer sqe->addr3 of this ring to slot sqe->file_index - 1
+ * of the target ring. The pages stay pinned and accounted throughout, the
+ * target simply takes over the mapping. That shared accounting is why both
+ * rings must be charged to the same user and mm, as for cloning buffers.
+ */
+static int io_msg_send_buf(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_ring_ctx *target_ctx = req->file->private_data;
+	struct io_msg *msg = io_kiocb_to_cmd(req, struct io_msg);
+	struct io_ring_ctx *ctx = req->ctx;
+
+	if (msg->len || !msg->dst_fd)
+		return -EINVAL;
+	if (msg->flags & ~IORING_MSG_RING_CQE_SKIP)
+		return -EINVAL;
+	if (target_ctx == ctx)
+		return -EINVAL;
+	if (target_ctx->user != ctx->user ||
+	    target_ctx->mm_account != ctx->mm_account)
+		return -EINVAL;
+	if (target_ctx->flags & IORING_SETUP_R_DISABLED)
+		return -EBADFD;
+	if (!msg->src_buf) {
+		io_ring_submit_lock(ctx, issue_flags);
+		msg->src_buf = io_buffer_get(ctx, msg->src_fd);
+		io_ring_submit_unlock(ctx, issue_flags);
+		if (!msg->src_buf)
+			return -EBADF;
+		req->flags |= REQ_F_NEED_CLEANUP;
+	}
+
+	if (io_msg_need_remote(target_ctx))
+		return io_msg_buf_remote(req);
+	return io_msg_buf_install_complete(req, issue_flags);
+}
+
 int io_msg_ring_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 {
 	struct io_msg *msg = io_kiocb_to_cmd(req, struct io_msg);
@@ -288,6 +404,9 @@ int io_msg_ring(struct io_kiocb *req, unsigned int issue_flags)
 	case IORING_MSG_SEND_FD:
 		ret = io_msg_send_fd(req, issue_flags);
 		break;
+	case IORING_MSG_SEND_BUF:
+		ret = io_msg_send_buf(req, issue_flags);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -1,5 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0
 
+#include <linux/seq_file.h>
+
 #include "io_uring.h"
 #include "napi.h"
 
@@ -8,13 +10,28 @@
 /* Timeout for cleanout of stale entries. */
 #define NAPI_TIMEOUT		(60 * SEC_CONVERSION)
 
+/*
+ * IO_URING_NAPI_ADAPTIVE: an ID whose poll produced nothing is skipped for
+ * twice as many rounds as before, up to NAPI_MAX_BACKOFF. Once there and
+ * not added by any socket for NAPI_COLD_TIMEOUT, it is dropped.
+ */
+#define NAPI_MAX_BACKOFF	16
+#define NAPI_COLD_TIMEOUT	HZ
+
 struct io_napi_entry {
 	unsigned int		napi_id;
 	struct list_head	list;
 
 	unsigned long		timeout;
+	unsigned long		last_add;
 	struct hlist_node	node;
 
+	/* updated without locking by the pollers, only heuristics */
+	unsigned int		polls;
+	unsigned int		hits;
+	unsigned int		backoff;
+	unsigned int		skip;
+
 	struct rcu_head		rcu;
 };
 
@@ -60,17 +77,19 @@ void __io_napi_add(struct io_ring_ctx *ctx, struct socket *sock)
 	rcu_read_lock();
 	e = io_napi_hash_find(hash_list, napi_id);
 	if (e) {
-		e->timeout = jiffies + NAPI_TIMEOUT;
+		WRITE_ONCE(e->last_add, jiffies);
+		WRITE_ONCE(e->timeout, jiffies + NAPI_TIMEOUT);
 		rcu_read_unlock();
 		return;
 	}
 	rcu_read_unlock();
 
-	e = kmalloc(sizeof(*e), GFP_NOWAIT);
+	e = kzalloc(sizeof(*e), GFP_NOWAIT);
 	if (!e)
 		return;
 
 	e->napi_id = napi_id;
+	e->last_add = jiffies;
 	e->timeout = jiffies + NAPI_TIMEOUT;
 
 	spin_lock(&ctx->napi_lock);
@@ -85,6 +104,15 @@ void __io_napi_add(struct io_ring_ctx *ctx, struct socket *sock)
 	spin_unlock(&ctx->napi_lock);
 }
 
+static bool io_napi_entry_stale(struct io_napi_entry *e)
+{
+	if (time_after(jiffies, READ_ONCE(e->timeout)))
+		return true;
+	/* backoff only grows in adaptive mode */
+	return READ_ONCE(e->backoff) == NAPI_MAX_BACKOFF &&
+	       time_after(jiffies, READ_ONCE(e->last_add) + NAPI_COLD_TIMEOUT);
+}
+
 static void __io_napi_remove_stale(struct io_ring_ctx *ctx)
 {
 	struct io_napi_entry *e;
@@ -97,7 +125,7 @@ static void __io_napi_remove_stale(struct io_ring_ctx *ctx)
 	 *    state
 	 */
 	list_for_each_entry(e, &ctx->napi_list, list) {
-		if (time_after(jiffies, READ_ONCE(e->timeout))) {
+		if (io_napi_entry_stale(e)) {
 			list_del_rcu(&e->list);
 			hash_del_rcu(&e->node);
 			kfree_rcu(e, rcu);
@@ -141,21 +169,73 @@ static bool io_napi_busy_loop_should_end(void *data,
 	return false;
 }
 
+/*
+ * Packets found by a busy poll wake the sockets, which queues task_work
+ * for the ring. That is the closest we get to the yield of a given poll.
+ */
+static bool io_napi_ring_has_work(struct io_ring_ctx *ctx)
+{
+	struct io_uring_task *tctx = current->io_uring;
+
+	return io_has_work(ctx) || (tctx && !llist_empty(&tctx->task_list));
+}
+
+/* adaptive mode, returns true if @e sits out this round */
+static bool io_napi_skip(struct io_napi_entry *e)
+{
+	if (!READ_ONCE(e->skip))
+		return false;
+	WRITE_ONCE(e->skip, e->skip - 1);
+	return true;
+}
+
+static void io_napi_account(struct io_ring_ctx *ctx, struct io_napi_entry *e,
+			    bool had_work)
+{
+	bool hit;
+
+	WRITE_ONCE(e->polls, e->polls + 1);
+	/* work that was there before the poll says nothing about it */
+	if (had_work)
+		return;
+	hit = io_napi_ring_has_work(ctx);
+	if (hit)
+		WRITE_ONCE(e->hits, e->hits + 1);
+
+	if (!READ_ONCE(ctx->napi_adaptive))
+		return;
+	if (hit) {
+		WRITE_ONCE(e->backoff, 0);
+	} else {
+		WRITE_ONCE(e->backoff, clamp_t(unsigned int, e->backoff * 2, 1, NAPI_MAX_BACKOFF));
+		WRITE_ONCE(e->skip, e->backoff);
+	}
+}
+
 static bool __io_napi_do_busy_loop(struct io_ring_ctx *ctx,
 				   void *loop_end_arg)
 {
 	struct io_napi_entry *e;
 	bool (*loop_end)(void *, unsigned long) = NULL;
+	bool adaptive = READ_ONCE(ctx->napi_adaptive);
 	bool is_stale = false;
 
 	if (loop_end_arg)
 		loop_end = io_napi_busy_loop_should_end;
 
 	list_for_each_entry_rcu(e, &ctx->napi_list, list) {
+		bool had_work;
+
+		/* a single ID is all there is to poll, never skip it */
+		if (adaptive && !loop_end_arg && io_napi_skip(e))
+			goto check_stale;
+
+		had_work = io_napi_ring_has_work(ctx);
 		napi_busy_loop_rcu(e->napi_id, loop_end, loop_end_arg,
 				   ctx->napi_prefer_busy_poll, BUSY_POLL_BUDGET);
-
-		if (time_after(jiffies, e->timeout))
+		io_napi_account(ctx, e, had_work);
+check_stale:
+		if (io_napi_entry_stale(e))
 			is_stale = true;
 	}
 
@@ -197,6 +277,7 @@ void io_napi_init(struct io_ring_ctx *ctx)
 	INIT_LIST_HEAD(&ctx->napi_list);
 	spin_lock_init(&ctx->napi_lock);
 	ctx->napi_prefer_busy_poll = false;
+	ctx->napi_adaptive = false;
 	ctx->napi_busy_poll_dt = ns_to_ktime(sys_dt);
 }
 
@@ -230,7 +311,8 @@ int io_register_napi(struct io_ring_ctx *ctx, void __user *arg)
 {
 	const struct io_uring_napi curr = {
 		.busy_poll_to 	  = ktime_to_us(ctx->napi_busy_poll_dt),
-		.prefer_busy_poll = ctx->napi_prefer_busy_poll
+		.prefer_busy_poll = ctx->napi_prefer_busy_poll,
+		.flags		  = ctx->napi_adaptive ? IO_URING_NAPI_ADAPTIVE : 0,
 	};
 	struct io_uring_napi napi;
 
@@ -238,7 +320,9 @@ int io_register_napi(struct io_ring_ctx *ctx, void __user *arg)
 		return -EINVAL;
 	if (copy_from_user(&napi, arg, sizeof(napi)))
 		return -EFAULT;
-	if (napi.pad[0] || napi.pad[1] || napi.pad[2] || napi.resv)
+	if (napi.pad[0] || napi.pad[1] || napi.resv)
+		return -EINVAL;
+	if (napi.flags & ~IO_URING_NAPI_ADAPTIVE)
 		return -EINVAL;
 
 	if (copy_to_user(arg, &curr, sizeof(curr)))
@@ -246,6 +330,7 @@ int io_register_napi(struct io_ring_ctx *ctx, void __user *arg)
 
 	WRITE_ONCE(ctx->napi_busy_poll_dt, napi.busy_poll_to * NSEC_PER_USEC);
 	WRITE_ONCE(ctx->napi_prefer_busy_poll, !!napi.prefer_busy_poll);
+	WRITE_ONCE(ctx->napi_adaptive, !!(napi.flags & IO_URING_NAPI_ADAPTIVE));
 	WRITE_ONCE(ctx->napi_enabled, true);
 	return 0;
 }
@@ -262,7 +347,8 @@ int io_unregister_napi(struct io_ring_ctx *ctx, void __user *arg)
 {
 	const struct io_uring_napi curr = {
 		.busy_poll_to 	  = ktime_to_us(ctx->napi_busy_poll_dt),
-		.prefer_busy_poll = ctx->napi_prefer_busy_poll
+		.prefer_busy_poll = ctx->napi_prefer_busy_poll,
+		.flags		  = ctx->napi_adaptive ? IO_URING_NAPI_ADAPTIVE : 0,
 	};
 
 	if (arg && copy_to_user(arg, &curr, sizeof(curr)))
@@ -270,6 +356,7 @@ int io_unregister_napi(struct io_ring_ctx *ctx, void __user *arg)
 
 	WRITE_ONCE(ctx->napi_busy_poll_dt, 0);
 	WRITE_ONCE(ctx->napi_prefer_busy_poll, false);
+	WRITE_ONCE(ctx->napi_adaptive, false);
 	WRITE_ONCE(ctx->napi_enabled, false);
 	return 0;
 }
@@ -320,4 +407,25 @@ int io_napi_sqpoll_busy_poll(struct io_ring_ctx *ctx)
 	return 1;
 }
 
+/*
+ * io_napi_show_fdinfo() - show per NAPI ID statistics
+ * @ctx: pointer to io-uring context structure
+ * @m: fdinfo seq_file
+ *
+ * Print, for each tracked NAPI ID, how often it was busy polled and how many
+ * of those polls produced completions for the ring.
+ */
+void io_napi_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m)
+{
+	struct io_napi_entry *e;
+
+	seq_puts(m, "napi_ids:\n");
+	rcu_read_lock();
+	list_for_each_entry_rcu(e, &ctx->napi_list, list)
+		seq_printf(m, "  id=%u polls=%u hits=%u backoff=%u\n",
+			   e->napi_id, READ_ONCE(e->polls), READ_ONCE(e->hits),
+			   READ_ONCE(e->backoff));
+	rcu_read_unlock();
+}
+
 #endif
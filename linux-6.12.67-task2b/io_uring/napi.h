@@ -9,6 +9,8 @@
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
 
+struct seq_file;
+
 void io_napi_init(struct io_ring_ctx *ctx);
 void io_napi_free(struct io_ring_ctx *ctx);
 
@@ -19,6 +21,7 @@ void __io_napi_add(struct io_ring_ctx *ctx, struct socket *sock);
 
 void __io_napi_busy_loop(struct io_ring_ctx *ctx, struct io_wait_queue *iowq);
 int io_napi_sqpoll_busy_poll(struct io_ring_ctx *ctx);
+void io_napi_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m);
 
 static inline bool io_napi(struct io_ring_ctx *ctx)
 {
@@ -36,6 +36,7 @@
 #include "waitid.h"
 #include "futex.h"
 #include "truncate.h"
+#include "sem.h"
 
 static int io_no_issue(struct io_kiocb *req, unsigned int issue_flags)
 {
@@ -516,6 +517,19 @@ const struct io_issue_def io_issue_defs[] = {
 		.prep			= io_eopnotsupp_prep,
 #endif
 	},
+	[IORING_OP_SEMTIMEDOP] = {
+#if defined(CONFIG_SYSVIPC)
+		.prep			= io_semtimedop_prep,
+		.issue			= io_semtimedop,
+#else
+		.prep			= io_eopnotsupp_prep,
+#endif
+	},
+	[IORING_OP_STATX_BATCH] = {
+		.audit_skip		= 1,
+		.prep			= io_statx_batch_prep,
+		.issue			= io_statx_batch,
+	},
 };
 
 const struct io_cold_def io_cold_defs[] = {
@@ -743,6 +757,15 @@ const struct io_cold_def io_cold_defs[] = {
 	[IORING_OP_LISTEN] = {
 		.name			= "LISTEN",
 	},
+	[IORING_OP_SEMTIMEDOP] = {
+		.name			= "SEMTIMEDOP",
+#if defined(CONFIG_SYSVIPC)
+		.cleanup		= io_semtimedop_cleanup,
+#endif
+	},
+	[IORING_OP_STATX_BATCH] = {
+		.name			= "STATX_BATCH",
+	},
 };
 
 const char *io_uring_get_opcode(u8 opcode)
@@ -120,9 +120,16 @@ static void io_buffer_unmap(struct io_ring_ctx *ctx, struct io_mapped_ubuf **slo
 		if (!refcount_dec_and_test(&imu->refs))
 			return;
 		for (i = 0; i < imu->nr_bvecs; i++) {
-			struct folio *folio = page_folio(imu->bvec[i].bv_page);
+			struct bio_vec *bv = &imu->bvec[i];
 
-			unpin_user_folio(folio, 1);
+			/* merged bvecs hold a pin for each page they span */
+			if (!imu->folio_shift) {
+				unpin_user_page_range_dirty_lock(bv->bv_page,
+					DIV_ROUND_UP(bv->bv_offset + bv->bv_len,
+						     PAGE_SIZE), false);
+				continue;
+			}
+			unpin_user_folio(page_folio(bv->bv_page), 1);
 		}
 		if (imu->acct_pages)
 			io_unaccount_mem(ctx, imu->acct_pages);
@@ -954,6 +961,53 @@ static bool io_try_coalesce_buffer(struct page ***pages, int *nr_pages,
 	return io_do_coalesce_buffer(pages, nr_pages, data, nr_folios);
 }
 
+/*
+ * A page can share a bvec with the one before it if it follows it physically
+ * and both are order-0 pages or parts of the same folio. Keeping folios
+ * apart lets headpage_already_acct() still see each compound head.
+ */
+static bool io_pages_mergeable(struct page *prev, struct page *page)
+{
+	if (page_to_pfn(page) != page_to_pfn(prev) + 1)
+		return false;
+	if (PageCompound(page) || PageCompound(prev))
+		return page_folio(page) == page_folio(prev);
+	return true;
+}
+
+/*
+ * For buffers that io_try_coalesce_buffer() can't handle, e.g. runs of
+ * contiguous order-0 pages or a mix of folio sizes: return how many bvecs
+ * are needed if every physically contiguous run becomes one bvec.
+ */
+static int io_count_merged_bvecs(struct page **pages, int nr_pages)
+{
+	int i, nr_bvecs = 1;
+
+	for (i = 1; i < nr_pages; i++)
+		if (!io_pages_mergeable(pages[i - 1], pages[i]))
+			nr_bvecs++;
+	return nr_bvecs;
+}
+
+static void io_merge_buffer_pages(struct io_mapped_ubuf *imu,
+				  struct page **pages, int nr_pages,
+				  unsigned long off, size_t size)
+{
+	int i, seg = -1;
+
+	for (i = 0; i < nr_pages; i++) {
+		size_t vec_len = min_t(size_t, size, PAGE_SIZE - off);
+
+		if (seg >= 0 && io_pages_mergeable(pages[i - 1], pages[i]))
+			imu->bvec[seg].bv_len += vec_len;
+		else
+			bvec_set_page(&imu->bvec[++seg], pages[i], vec_len, off);
+		off = 0;
+		size -= vec_len;
+	}
+}
+
 static int io_sqe_buffer_register(struct io_ring_ctx *ctx, struct iovec *iov,
 				  struct io_mapped_ubuf **pimu,
 				  struct page **last_hpage)
@@ -962,9 +1016,9 @@ static int io_sqe_buffer_register(struct io_ring_ctx *ctx, struct iovec *iov,
 	struct page **pages = NULL;
 	unsigned long off;
 	size_t size;
-	int ret, nr_pages, i;
+	int ret, nr_pages, nr_bvecs, i;
 	struct io_imu_folio_data data;
-	bool coalesced;
+	bool coalesced, merged = false;
 
 	*pimu = (struct io_mapped_ubuf *)&dummy_ubuf;
 	if (!iov->iov_base)
@@ -981,8 +1035,14 @@ static int io_sqe_buffer_register(struct io_ring_ctx *ctx, struct iovec *iov,
 
 	/* If it's huge page(s), try to coalesce them into fewer bvec entries */
 	coalesced = io_try_coalesce_buffer(&pages, &nr_pages, &data);
+	nr_bvecs = nr_pages;
+	if (!coalesced && nr_pages > 1) {
+		/* otherwise merge what is physically contiguous */
+		nr_bvecs = io_count_merged_bvecs(pages, nr_pages);
+		merged = nr_bvecs < nr_pages;
+	}
 
-	imu = kvmalloc(struct_size(imu, bvec, nr_pages), GFP_KERNEL);
+	imu = kvmalloc(struct_size(imu, bvec, nr_bvecs), GFP_KERNEL);
 	if (!imu)
 		goto done;
 
@@ -994,10 +1054,12 @@ static int io_sqe_buffer_register(struct io_ring_ctx *ctx, struct iovec *iov,
 	/* store original address for later verification */
 	imu->ubuf = (unsigned long) iov->iov_base;
 	imu->len = iov->iov_len;
-	imu->nr_bvecs = nr_pages;
+	imu->nr_bvecs = nr_bvecs;
 	imu->folio_shift = PAGE_SHIFT;
 	if (coalesced)
 		imu->folio_shift = data.folio_shift;
+	else if (merged)
+		imu->folio_shift = 0;
 	refcount_set(&imu->refs, 1);
 	off = (unsigned long)iov->iov_base & ~PAGE_MASK;
 	if (coalesced)
@@ -1005,6 +1067,11 @@ static int io_sqe_buffer_register(struct io_ring_ctx *ctx, struct iovec *iov,
 	*pimu = imu;
 	ret = 0;
 
+	if (merged) {
+		io_merge_buffer_pages(imu, pages, nr_pages, off, size);
+		goto done;
+	}
+
 	for (i = 0; i < nr_pages; i++) {
 		size_t vec_len;
 
@@ -1139,6 +1206,9 @@ int io_import_fixed(int ddir, struct iov_iter *iter,
 			iter->bvec = bvec;
 			iter->count -= offset;
 			iter->iov_offset = offset;
+		} else if (!imu->folio_shift) {
+			/* merged bvecs differ in size, but there are few */
+			iov_iter_advance(iter, offset);
 		} else {
 			unsigned long seg_skip;
 
@@ -1253,3 +1323,78 @@ int io_register_clone_buffers(struct io_ring_ctx *ctx, void __user *arg)
 		fput(file);
 	return ret;
 }
+
+/*
+ * Helpers for IORING_MSG_SEND_BUF, which moves a registered buffer from one
+ * ring to another. As with cloning, the mapping itself is shared rather than
+ * copied: the target takes a reference, and the source then drops its slot
+ * like an unregister would. All of these must be called with the uring_lock
+ * of @ctx held.
+ */
+struct io_mapped_ubuf *io_buffer_get(struct io_ring_ctx *ctx, unsigned int idx)
+{
+	struct io_mapped_ubuf *imu;
+
+	lockdep_assert_held(&ctx->uring_lock);
+
+	if (unlikely(!ctx->buf_data || idx >= ctx->nr_user_bufs))
+		return NULL;
+	imu = ctx->user_bufs[array_index_nospec(idx, ctx->nr_user_bufs)];
+	if (imu == &dummy_ubuf)
+		return NULL;
+	refcount_inc(&imu->refs);
+	return imu;
+}
+
+void io_buffer_put(struct io_ring_ctx *ctx, struct io_mapped_ubuf *imu)
+{
+	io_buffer_unmap(ctx, &imu);
+}
+
+/*
+ * Install @imu in slot @idx of @ctx, replacing whatever buffer was there.
+ * On success the caller's reference is handed over to @ctx.
+ */
+int io_buffer_install(struct io_ring_ctx *ctx, struct io_mapped_ubuf *imu,
+		      unsigned int idx)
+{
+	int ret;
+
+	lockdep_assert_held(&ctx->uring_lock);
+
+	if (!ctx->buf_data)
+		return -ENXIO;
+	if (idx >= ctx->nr_user_bufs)
+		return -EINVAL;
+	idx = array_index_nospec(idx, ctx->nr_user_bufs);
+
+	if (ctx->user_bufs[idx] != &dummy_ubuf) {
+		ret = io_queue_rsrc_removal(ctx->buf_data, idx,
+					    ctx->user_bufs[idx]);
+		if (unlikely(ret))
+			return ret;
+	}
+	ctx->user_bufs[idx] = imu;
+	*io_get_tag_slot(ctx->buf_data, idx) = 0;
+	return 0;
+}
+
+/*
+ * Drop slot @idx of @ctx if it still holds @imu. Requests already using the
+ * buffer keep it alive through the rsrc node, and the slot's tag, if any, is
+ * posted once they are done.
+ */
+void io_buffer_release(struct io_ring_ctx *ctx, struct io_mapped_ubuf *imu,
+		       unsigned int idx)
+{
+	lockdep_assert_held(&ctx->uring_lock);
+
+	if (!ctx->buf_data || idx >= ctx->nr_user_bufs)
+		return;
+	idx = array_index_nospec(idx, ctx->nr_user_bufs);
+	if (ctx->user_bufs[idx] != imu)
+		return;
+	if (io_queue_rsrc_removal(ctx->buf_data, idx, imu))
+		return;
+	ctx->user_bufs[idx] = (struct io_mapped_ubuf *)&dummy_ubuf;
+}
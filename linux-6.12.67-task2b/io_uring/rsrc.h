@@ -44,6 +44,7 @@ struct io_mapped_ubuf {
 	u64		ubuf;
 	unsigned int	len;
 	unsigned int	nr_bvecs;
+	/* 0 if the bvecs have different sizes, see io_merge_buffer_pages() */
 	unsigned int    folio_shift;
 	refcount_t	refs;
 	unsigned long	acct_pages;
@@ -69,6 +70,12 @@ int io_import_fixed(int ddir, struct iov_iter *iter,
 			   u64 buf_addr, size_t len);
 
 int io_register_clone_buffers(struct io_ring_ctx *ctx, void __user *arg);
+struct io_mapped_ubuf *io_buffer_get(struct io_ring_ctx *ctx, unsigned int idx);
+void io_buffer_put(struct io_ring_ctx *ctx, struct io_mapped_ubuf *imu);
+int io_buffer_install(struct io_ring_ctx *ctx, struct io_mapped_ubuf *imu,
+		      unsigned int idx);
+void io_buffer_release(struct io_ring_ctx *ctx, struct io_mapped_ubuf *imu,
+		       unsigned int idx);
 void __io_sqe_buffers_unregister(struct io_ring_ctx *ctx);
 int io_sqe_buffers_unregister(struct io_ring_ctx *ctx);
 int io_sqe_buffers_register(struct io_ring_ctx *ctx, void __user *arg,
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/sem.h>
+#include <linux/slab.h>
+#include <linux/syscalls.h>
+#include <linux/nsproxy.h>
+#include <linux/ipc_namespace.h>
+#include <linux/io_uring.h>
+
+#include <uapi/linux/io_uring.h>
+
+#include "io_uring.h"
+#include "sem.h"
+
+struct io_semop {
+	struct file			*file;
+	int				semid;
+	unsigned int			nsops;
+	bool				has_timeout;
+	struct timespec64		ts;
+	/*
+	 * nsops operations as submitted, followed by the same operations
+	 * with IPC_NOWAIT set for the inline attempt.
+	 */
+	struct sembuf			*sops;
+};
+
+void io_semtimedop_cleanup(struct io_kiocb *req)
+{
+	struct io_semop *sem = io_kiocb_to_cmd(req, struct io_semop);
+
+	kfree(sem->sops);
+}
+
+/*
+ * sqe->fd is the semid, sqe->addr points to sqe->len struct sembuf and
+ * sqe->addr2 to an optional relative timeout, as for semtimedop(2).
+ */
+int io_semtimedop_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	struct io_semop *sem = io_kiocb_to_cmd(req, struct io_semop);
+	struct ipc_namespace *ns = current->nsproxy->ipc_ns;
+	struct __kernel_timespec __user *uts;
+	struct sembuf __user *usops;
+	unsigned int i;
+
+	if (unlikely(req->flags & REQ_F_FIXED_FILE))
+		return -EBADF;
+	if (sqe->ioprio || sqe->rw_flags || sqe->buf_index ||
+	    sqe->splice_fd_in || sqe->addr3)
+		return -EINVAL;
+
+	sem->semid = READ_ONCE(sqe->fd);
+	sem->nsops = READ_ONCE(sqe->len);
+	usops = u64_to_user_ptr(READ_ONCE(sqe->addr));
+	uts = u64_to_user_ptr(READ_ONCE(sqe->addr2));
+
+	if (sem->nsops < 1 || sem->semid < 0)
+		return -EINVAL;
+	if (sem->nsops > ns->sc_semopm)
+		return -E2BIG;
+
+	sem->has_timeout = uts != NULL;
+	if (uts && get_timespec64(&sem->ts, uts))
+		return -EFAULT;
+
+	sem->sops = kmalloc_array(2 * sem->nsops, sizeof(*sem->sops),
+				  GFP_KERNEL);
+	if (!sem->sops)
+		return -ENOMEM;
+	if (copy_from_user(sem->sops, usops,
+			   sem->nsops * sizeof(*sem->sops))) {
+		kfree(sem->sops);
+		return -EFAULT;
+	}
+
+	for (i = 0; i < sem->nsops; i++) {
+		/*
+		 * Undo adjustments belong to the task that performs the
+		 * operation, which may be an io-wq worker.
+		 */
+		if (sem->sops[i].sem_flg & SEM_UNDO) {
+			kfree(sem->sops);
+			return -EINVAL;
+		}
+		sem->sops[sem->nsops + i] = sem->sops[i];
+		sem->sops[sem->nsops + i].sem_flg |= IPC_NOWAIT;
+	}
+
+	req->flags |= REQ_F_NEED_CLEANUP;
+	return 0;
+}
+
+int io_semtimedop(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_semop *sem = io_kiocb_to_cmd(req, struct io_semop);
+	struct ipc_namespace *ns = current->nsproxy->ipc_ns;
+	long ret;
+
+	if (issue_flags & IO_URING_F_NONBLOCK) {
+		/*
+		 * Complete inline if nothing has to wait. Otherwise nothing
+		 * was changed, and the operation is retried from io-wq where
+		 * it may sleep.
+		 */
+		ret = __do_semtimedop(sem->semid, sem->sops + sem->nsops,
+				      sem->nsops, NULL, ns);
+		if (ret == -EAGAIN)
+			return -EAGAIN;
+	} else {
+		ret = __do_semtimedop(sem->semid, sem->sops, sem->nsops,
+				      sem->has_timeout ? &sem->ts : NULL, ns);
+	}
+
+	/* a signal interrupted the wait; the restart is not ours to do */
+	if (ret == -ERESTARTNOHAND)
+		ret = -EINTR;
+	if (ret < 0)
+		req_set_fail(req);
+
+	req->flags &= ~REQ_F_NEED_CLEANUP;
+	io_semtimedop_cleanup(req);
+	io_req_set_res(req, ret, 0);
+	return IOU_OK;
+}
@@ -0,0 +1,5 @@
+// SPDX-License-Identifier: GPL-2.0
+
+int io_semtimedop_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe);
+int io_semtimedop(struct io_kiocb *req, unsigned int issue_flags);
+void io_semtimedop_cleanup(struct io_kiocb *req);
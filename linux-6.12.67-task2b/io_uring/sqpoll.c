@@ -12,6 +12,7 @@
 #include <linux/security.h>
 #include <linux/cpuset.h>
 #include <linux/sched/cputime.h>
+#include <linux/sched/clock.h>
 #include <linux/io_uring.h>
 
 #include <uapi/linux/io_uring.h>
@@ -90,10 +91,24 @@ static __cold void io_sqd_update_thread_idle(struct io_sq_data *sqd)
 {
 	struct io_ring_ctx *ctx;
 	unsigned sq_thread_idle = 0;
+	bool adaptive = true;
+	s64 idle_ns;
 
-	list_for_each_entry(ctx, &sqd->ctx_list, sqd_list)
+	list_for_each_entry(ctx, &sqd->ctx_list, sqd_list) {
 		sq_thread_idle = max(sq_thread_idle, ctx->sq_thread_idle);
+		/* one ring asking for the full idle period gets it */
+		if (!(ctx->flags & IORING_SETUP_SQPOLL_ADAPTIVE))
+			adaptive = false;
+	}
 	sqd->sq_thread_idle = sq_thread_idle;
+	sqd->adaptive_idle = adaptive;
+
+	/* the set of rings changed, start learning from scratch */
+	idle_ns = jiffies_to_nsecs(sq_thread_idle);
+	sqd->idle_start = 0;
+	sqd->gap_avg = idle_ns / 2;
+	sqd->gap_dev = idle_ns / 4;
+	sqd->gap_hit = 1024;
 }
 
 void io_sq_thread_finish(struct io_ring_ctx *ctx)
@@ -176,6 +191,51 @@ static inline bool io_sqd_events_pending(struct io_sq_data *sqd)
 	return READ_ONCE(sqd->state);
 }
 
+/*
+ * The rings had work again after being idle since ->idle_start. Gaps that
+ * fit in sq_thread_idle feed a smoothed mean and mean deviation, in the
+ * same way TCP estimates its RTT; ->gap_hit tracks, in 1/1024 units, how
+ * many gaps fit at all.
+ */
+static void io_sqd_work_found(struct io_sq_data *sqd)
+{
+	s64 gap, err;
+
+	if (!sqd->idle_start)
+		return;
+	gap = local_clock() - sqd->idle_start;
+	sqd->idle_start = 0;
+
+	if (gap >= (s64)jiffies_to_nsecs(sqd->sq_thread_idle)) {
+		sqd->gap_hit -= sqd->gap_hit >> 3;
+		return;
+	}
+	sqd->gap_hit += (1024 - sqd->gap_hit) >> 3;
+	err = gap - sqd->gap_avg;
+	sqd->gap_avg += err >> 3;
+	sqd->gap_dev += (abs(err) - sqd->gap_dev) >> 2;
+}
+
+/*
+ * Adaptive idle: spin for the expected gap plus four deviations, capped at
+ * sq_thread_idle. If most gaps are longer than sq_thread_idle anyway,
+ * spinning is wasted and we go to sleep right away.
+ */
+static bool io_sqd_keep_spinning(struct io_sq_data *sqd)
+{
+	u64 now = local_clock();
+	s64 budget;
+
+	if (!sqd->idle_start)
+		sqd->idle_start = now;
+	if (sqd->gap_hit < 512)
+		return false;
+
+	budget = min_t(s64, sqd->gap_avg + 4 * sqd->gap_dev,
+		       jiffies_to_nsecs(sqd->sq_thread_idle));
+	return now - sqd->idle_start < budget;
+}
+
 struct io_sq_time {
 	bool started;
 	u64 usec;
@@ -364,7 +424,10 @@ static int io_sq_thread(void *data)
 
 		io_sq_update_worktime(sqd, &ist);
 
-		if (sqt_spin || !time_after(jiffies, timeout)) {
+		if (sqt_spin)
+			io_sqd_work_found(sqd);
+		if (sqt_spin || (sqd->adaptive_idle ? io_sqd_keep_spinning(sqd) :
+				 !time_after(jiffies, timeout))) {
 			if (sqt_spin)
 				timeout = jiffies + sqd->sq_thread_idle;
 			if (unlikely(need_resched())) {
@@ -539,8 +602,8 @@ __cold int io_sq_offload_create(struct io_ring_ctx *ctx,
 		wake_up_new_task(tsk);
 		if (ret)
 			goto err;
-	} else if (p->flags & IORING_SETUP_SQ_AFF) {
-		/* Can't have SQ_AFF without SQPOLL */
+	} else if (p->flags & (IORING_SETUP_SQ_AFF | IORING_SETUP_SQPOLL_ADAPTIVE)) {
+		/* Can't have SQ_AFF or SQPOLL_ADAPTIVE without SQPOLL */
 		ret = -EINVAL;
 		goto err;
 	}
@@ -12,6 +12,7 @@ struct io_sq_data {
 	struct wait_queue_head	wait;
 
 	unsigned		sq_thread_idle;
+	bool			adaptive_idle;
 	int			sq_cpu;
 	pid_t			task_pid;
 	pid_t			task_tgid;
@@ -19,6 +20,12 @@ struct io_sq_data {
 	u64			work_time;
 	unsigned long		state;
 	struct completion	exited;
+
+	/* IORING_SETUP_SQPOLL_ADAPTIVE state, see io_sqd_keep_spinning() */
+	u64			idle_start;
+	s64			gap_avg;
+	s64			gap_dev;
+	unsigned int		gap_hit;
 };
 
 int io_sq_offload_create(struct io_ring_ctx *ctx, struct io_uring_params *p);
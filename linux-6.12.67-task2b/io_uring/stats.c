@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Per-opcode latency histograms of a ring, shown in its fdinfo. Two spans
+ * are measured: from taking the SQE off the ring to the first ->issue()
+ * (which includes any time spent queued in io-wq), and from there to the
+ * post of the CQE.
+ */
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/seq_file.h>
+#include <linux/io_uring.h>
+
+#include <uapi/linux/io_uring.h>
+
+#include "io_uring.h"
+#include "stats.h"
+
+/* bucket b holds latencies in [2^(b-1), 2^b) ns, the last one is open */
+#define IO_LAT_BUCKETS		32
+
+enum {
+	IO_LAT_QUEUE,		/* submission to issue */
+	IO_LAT_EXEC,		/* issue to completion */
+	IO_LAT_NR,
+};
+
+/*
+ * Updated without locking from the submitter, io-wq workers and completion
+ * paths alike. A lost increment now and then is fine for statistics.
+ */
+struct io_lat_stats {
+	unsigned long	issued[IORING_OP_LAST];
+	unsigned long	iowq[IORING_OP_LAST];
+	u32		hist[IORING_OP_LAST][IO_LAT_NR][IO_LAT_BUCKETS];
+};
+
+void io_stats_init(struct io_ring_ctx *ctx)
+{
+	/* statistics are best effort, run without them if this fails */
+	ctx->lat_stats = kvzalloc(sizeof(*ctx->lat_stats), GFP_KERNEL_ACCOUNT);
+}
+
+void io_stats_free(struct io_ring_ctx *ctx)
+{
+	kvfree(ctx->lat_stats);
+	ctx->lat_stats = NULL;
+}
+
+static void io_stats_add(struct io_kiocb *req, int span, u64 ns)
+{
+	unsigned int b = min_t(unsigned int, fls64(ns), IO_LAT_BUCKETS - 1);
+
+	data_race(req->ctx->lat_stats->hist[req->opcode][span][b]++);
+}
+
+void __io_stats_issue(struct io_kiocb *req)
+{
+	u64 now = ktime_get_ns();
+
+	req->issue_ns = now;
+	data_race(req->ctx->lat_stats->issued[req->opcode]++);
+	if (req->submit_ns)
+		io_stats_add(req, IO_LAT_QUEUE, now - req->submit_ns);
+}
+
+void __io_stats_iowq(struct io_kiocb *req)
+{
+	data_race(req->ctx->lat_stats->iowq[req->opcode]++);
+}
+
+void __io_stats_complete(struct io_kiocb *req)
+{
+	io_stats_add(req, IO_LAT_EXEC, ktime_get_ns() - req->issue_ns);
+	req->issue_ns = 0;
+}
+
+static void io_stats_show_hist(struct seq_file *m, const char *name,
+			       const u32 *hist)
+{
+	int b;
+
+	seq_printf(m, "    %s:", name);
+	for (b = 0; b < IO_LAT_BUCKETS; b++) {
+		u32 nr = data_race(hist[b]);
+
+		if (nr)
+			seq_printf(m, " %llu:%u", b ? 1ULL << (b - 1) : 0, nr);
+	}
+	seq_putc(m, '\n');
+}
+
+/*
+ * For each opcode that was issued: how often, how many of those went
+ * through io-wq, and both histograms as "<lower bound in ns>:<count>" pairs
+ * of the non-empty buckets.
+ */
+void io_stats_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m)
+{
+	struct io_lat_stats *s = ctx->lat_stats;
+	int op;
+
+	if (!s)
+		return;
+
+	seq_puts(m, "LatencyStats:\n");
+	for (op = 0; op < IORING_OP_LAST; op++) {
+		unsigned long issued = data_race(s->issued[op]);
+
+		if (!issued)
+			continue;
+		seq_printf(m, "  %s: issued=%lu iowq=%lu\n",
+			   io_uring_get_opcode(op), issued,
+			   data_race(s->iowq[op]));
+		io_stats_show_hist(m, "queue_ns", s->hist[op][IO_LAT_QUEUE]);
+		io_stats_show_hist(m, "exec_ns", s->hist[op][IO_LAT_EXEC]);
+	}
+}
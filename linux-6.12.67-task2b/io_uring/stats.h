@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#ifndef IOU_STATS_H
+#define IOU_STATS_H
+
+#include <linux/io_uring_types.h>
+#include <linux/timekeeping.h>
+
+struct seq_file;
+
+#ifdef CONFIG_IO_URING_STATS
+
+void io_stats_init(struct io_ring_ctx *ctx);
+void io_stats_free(struct io_ring_ctx *ctx);
+void io_stats_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m);
+
+void __io_stats_issue(struct io_kiocb *req);
+void __io_stats_iowq(struct io_kiocb *req);
+void __io_stats_complete(struct io_kiocb *req);
+
+/* the request was taken off the SQ */
+static inline void io_stats_submit(struct io_kiocb *req)
+{
+	req->issue_ns = 0;
+	if (req->ctx->lat_stats)
+		req->submit_ns = ktime_get_ns();
+}
+
+/* ->issue() is about to run, inline or from io-wq */
+static inline void io_stats_issue(struct io_kiocb *req)
+{
+	if (req->ctx->lat_stats && !req->issue_ns)
+		__io_stats_issue(req);
+}
+
+static inline void io_stats_iowq(struct io_kiocb *req)
+{
+	if (req->ctx->lat_stats)
+		__io_stats_iowq(req);
+}
+
+/* the CQE of the request is being posted */
+static inline void io_stats_complete(struct io_kiocb *req)
+{
+	if (req->issue_ns && req->ctx->lat_stats)
+		__io_stats_complete(req);
+}
+
+#else
+
+static inline void io_stats_init(struct io_ring_ctx *ctx)
+{
+}
+static inline void io_stats_free(struct io_ring_ctx *ctx)
+{
+}
+static inline void io_stats_show_fdinfo(struct io_ring_ctx *ctx,
+					struct seq_file *m)
+{
+}
+static inline void io_stats_submit(struct io_kiocb *req)
+{
+}
+static inline void io_stats_issue(struct io_kiocb *req)
+{
+}
+static inline void io_stats_iowq(struct io_kiocb *req)
+{
+}
+static inline void io_stats_complete(struct io_kiocb *req)
+{
+}
+#endif /* CONFIG_IO_URING_STATS */
+
+#endif
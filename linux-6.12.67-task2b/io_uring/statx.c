@@ -3,6 +3,7 @@
 #include <linux/errno.h>
 #include <linux/file.h>
 #include <linux/io_uring.h>
+#include <linux/uio.h>
 
 #include <uapi/linux/io_uring.h>
 
@@ -70,3 +71,85 @@ void io_statx_cleanup(struct io_kiocb *req)
 	if (sx->filename)
 		putname(sx->filename);
 }
+
+struct io_statx_batch {
+	struct file			*file;
+	int				dfd;
+	unsigned int			flags;
+	unsigned int			nr;
+	struct io_uring_statx_entry __user *entries;
+};
+
+int io_statx_batch_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	struct io_statx_batch *sb = io_kiocb_to_cmd(req, struct io_statx_batch);
+
+	if (sqe->buf_index || sqe->splice_fd_in || sqe->off)
+		return -EINVAL;
+	if (req->flags & REQ_F_FIXED_FILE)
+		return -EBADF;
+
+	sb->dfd = READ_ONCE(sqe->fd);
+	sb->nr = READ_ONCE(sqe->len);
+	sb->entries = u64_to_user_ptr(READ_ONCE(sqe->addr));
+	sb->flags = READ_ONCE(sqe->statx_flags);
+	if (!sb->nr || sb->nr > UIO_MAXIOV)
+		return -EINVAL;
+
+	req->flags |= REQ_F_FORCE_ASYNC;
+	return 0;
+}
+
+/*
+ * Run all entries of the batch from this one work item, rather than paying
+ * for an io-wq punt per path. Each entry gets its own result; the request
+ * completes with the number of entries done, which is short of the total only
+ * if an entry couldn't be accessed or we were hit by a fatal signal.
+ */
+int io_statx_batch(struct io_kiocb *req, unsigned int issue_flags)
+{
+	struct io_statx_batch *sb = io_kiocb_to_cmd(req, struct io_statx_batch);
+	unsigned int lookup_flags = getname_statx_lookup_flags(sb->flags);
+	unsigned int done;
+	int ret = 0;
+
+	WARN_ON_ONCE(issue_flags & IO_URING_F_NONBLOCK);
+
+	for (done = 0; done < sb->nr; done++) {
+		struct io_uring_statx_entry __user *uentry = &sb->entries[done];
+		struct io_uring_statx_entry entry;
+		struct filename *name;
+		int res;
+
+		if (copy_from_user(&entry, uentry, sizeof(entry))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		name = getname_flags(u64_to_user_ptr(entry.path), lookup_flags);
+		if (IS_ERR(name)) {
+			res = PTR_ERR(name);
+		} else {
+			res = do_statx(sb->dfd, name, sb->flags, entry.mask,
+				       u64_to_user_ptr(entry.buf));
+			putname(name);
+		}
+		if (put_user(res, &uentry->res)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		if (fatal_signal_pending(current)) {
+			done++;
+			break;
+		}
+		cond_resched();
+	}
+
+	if (done)
+		ret = done;
+	if (ret < 0)
+		req_set_fail(req);
+	io_req_set_res(req, ret, 0);
+	return IOU_OK;
+}
@@ -39,6 +39,7 @@
 #include <linux/sched/wake_q.h>
 #include <linux/sched/signal.h>
 #include <linux/sched/user.h>
+#include <linux/uio.h>
 
 #include <net/sock.h>
 #include "util.h"
@@ -64,6 +65,15 @@ struct posix_msg_tree_node {
 	int			priority;
 };
 
+/*
+ * Most queues use only a few low priorities.  Messages of a priority
+ * below MQ_PRIO_BUCKETS are kept on a FIFO per priority, with a bitmap of
+ * the non-empty ones, so that queueing and dequeueing them takes constant
+ * time under info->lock and never allocates.  Higher priorities go to the
+ * msg_tree, which therefore always holds the highest priority messages.
+ */
+#define MQ_PRIO_BUCKETS		16
+
 /*
  * Locking:
  *
@@ -139,6 +149,8 @@ struct mqueue_inode_info {
 	struct rb_root msg_tree;
 	struct rb_node *msg_tree_rightmost;
 	struct posix_msg_tree_node *node_cache;
+	unsigned long prio_map;
+	struct list_head prio_list[MQ_PRIO_BUCKETS];
 	struct mq_attr attr;
 
 	struct sigevent notify;
@@ -194,6 +206,12 @@ static int msg_insert(struct msg_msg *msg, struct mqueue_inode_info *info)
 	struct posix_msg_tree_node *leaf;
 	bool rightmost = true;
 
+	if (msg->m_type < MQ_PRIO_BUCKETS) {
+		__set_bit(msg->m_type, &info->prio_map);
+		list_add_tail(&msg->m_list, &info->prio_list[msg->m_type]);
+		goto account;
+	}
+
 	p = &info->msg_tree.rb_node;
 	while (*p) {
 		parent = *p;
@@ -224,9 +242,10 @@ static int msg_insert(struct msg_msg *msg, struct mqueue_inode_info *info)
 	rb_link_node(&leaf->rb_node, parent, p);
 	rb_insert_color(&leaf->rb_node, &info->msg_tree);
 insert_msg:
+	list_add_tail(&msg->m_list, &leaf->msg_list);
+account:
 	info->attr.mq_curmsgs++;
 	info->qsize += msg->m_ts;
-	list_add_tail(&msg->m_list, &leaf->msg_list);
 	return 0;
 }
 
@@ -258,6 +277,16 @@ try_again:
 	 * walk all the way to the right.
 	 */
 	parent = info->msg_tree_rightmost;
+	if (!parent && info->prio_map) {
+		int prio = __fls(info->prio_map);
+
+		msg = list_first_entry(&info->prio_list[prio],
+				       struct msg_msg, m_list);
+		list_del(&msg->m_list);
+		if (list_empty(&info->prio_list[prio]))
+			__clear_bit(prio, &info->prio_map);
+		goto account;
+	}
 	if (!parent) {
 		if (info->attr.mq_curmsgs) {
 			pr_warn_once("Inconsistency in POSIX message queue, "
@@ -282,6 +311,7 @@ try_again:
 			msg_tree_erase(leaf, info);
 		}
 	}
+account:
 	info->attr.mq_curmsgs--;
 	info->qsize -= msg->m_ts;
 	return msg;
@@ -293,6 +323,7 @@ static struct inode *mqueue_get_inode(struct super_block *sb,
 {
 	struct inode *inode;
 	int ret = -ENOMEM;
+	int i;
 
 	inode = new_inode(sb);
 	if (!inode)
@@ -323,6 +354,9 @@ static struct inode *mqueue_get_inode(struct super_block *sb,
 		info->msg_tree = RB_ROOT;
 		info->msg_tree_rightmost = NULL;
 		info->node_cache = NULL;
+		info->prio_map = 0;
+		for (i = 0; i < MQ_PRIO_BUCKETS; i++)
+			INIT_LIST_HEAD(&info->prio_list[i]);
 		memset(&info->attr, 0, sizeof(info->attr));
 		info->attr.mq_maxmsg = min(ipc_ns->mq_msg_max,
 					   ipc_ns->mq_msg_default);
@@ -1121,9 +1155,9 @@ static int do_mq_timedsend(mqd_t mqdes, const char __user *u_msg_ptr,
 	/*
 	 * msg_insert really wants us to have a valid, spare node struct so
 	 * it doesn't have to kmalloc a GFP_ATOMIC allocation, but it will
-	 * fall back to that if necessary.
+	 * fall back to that if necessary.  Low priorities need none.
 	 */
-	if (!info->node_cache)
+	if (!info->node_cache && msg_prio >= MQ_PRIO_BUCKETS)
 		new_leaf = kmalloc(sizeof(*new_leaf), GFP_KERNEL);
 
 	spin_lock(&info->lock);
@@ -1309,6 +1343,325 @@ SYSCALL_DEFINE5(mq_timedreceive, mqd_t, mqdes, char __user *, u_msg_ptr,
 	return do_mq_timedreceive(mqdes, u_msg_ptr, msg_len, u_msg_prio, p);
 }
 
+/*
+ * mq_sendmmsg() and mq_recvmmsg() move up to vlen messages with a single
+ * info->lock hold and a single wakeup pass.  Like mq_timedsend() and
+ * mq_timedreceive() they block until the first message can be moved,
+ * then move as many more as the queue allows without blocking, and
+ * return the number of messages moved.
+ */
+#define MQ_MMSG_MAX	UIO_MAXIOV
+
+static int do_mq_sendmmsg(mqd_t mqdes, struct mq_mmsg __user *u_vec,
+		unsigned int vlen, struct timespec64 *ts)
+{
+	struct fd f;
+	struct inode *inode;
+	struct ext_wait_queue wait;
+	struct ext_wait_queue *receiver;
+	struct mq_mmsg *vec;
+	struct msg_msg **msgs;
+	struct mqueue_inode_info *info;
+	ktime_t expires, *timeout = NULL;
+	struct posix_msg_tree_node *new_leaf = NULL;
+	unsigned int i, nr, sent = 0;
+	int ret = 0;
+	DEFINE_WAKE_Q(wake_q);
+
+	if (!vlen)
+		return 0;
+	vlen = min_t(unsigned int, vlen, MQ_MMSG_MAX);
+
+	if (ts) {
+		expires = timespec64_to_ktime(*ts);
+		timeout = &expires;
+	}
+
+	vec = vmemdup_array_user(u_vec, vlen, sizeof(*vec));
+	if (IS_ERR(vec))
+		return PTR_ERR(vec);
+
+	audit_mq_sendrecv(mqdes, vec[0].msg_len, vec[0].msg_prio, ts);
+
+	f = fdget(mqdes);
+	if (unlikely(!fd_file(f))) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	inode = file_inode(fd_file(f));
+	if (unlikely(fd_file(f)->f_op != &mqueue_file_operations)) {
+		ret = -EBADF;
+		goto out_fput;
+	}
+	info = MQUEUE_I(inode);
+	audit_file(fd_file(f));
+
+	if (unlikely(!(fd_file(f)->f_mode & FMODE_WRITE))) {
+		ret = -EBADF;
+		goto out_fput;
+	}
+
+	msgs = kvmalloc_array(vlen, sizeof(*msgs), GFP_KERNEL);
+	if (!msgs) {
+		ret = -ENOMEM;
+		goto out_fput;
+	}
+
+	/* A bad entry ends the batch; it is an error only if it is the first. */
+	for (nr = 0; nr < vlen; nr++) {
+		struct msg_msg *msg_ptr;
+
+		if (unlikely(vec[nr].msg_prio >= (unsigned long) MQ_PRIO_MAX ||
+			     vec[nr].__reserved)) {
+			ret = -EINVAL;
+			break;
+		}
+		if (unlikely(vec[nr].msg_len > info->attr.mq_msgsize)) {
+			ret = -EMSGSIZE;
+			break;
+		}
+		msg_ptr = load_msg(u64_to_user_ptr(vec[nr].msg_ptr),
+				   vec[nr].msg_len);
+		if (IS_ERR(msg_ptr)) {
+			ret = PTR_ERR(msg_ptr);
+			break;
+		}
+		msg_ptr->m_ts = vec[nr].msg_len;
+		msg_ptr->m_type = vec[nr].msg_prio;
+		msgs[nr] = msg_ptr;
+	}
+	if (!nr)
+		goto out_free;
+	ret = 0;
+
+	if (!info->node_cache)
+		new_leaf = kmalloc(sizeof(*new_leaf), GFP_KERNEL);
+
+	spin_lock(&info->lock);
+
+	if (!info->node_cache && new_leaf) {
+		/* Save our speculative allocation into the cache */
+		INIT_LIST_HEAD(&new_leaf->msg_list);
+		info->node_cache = new_leaf;
+	} else {
+		kfree(new_leaf);
+	}
+
+	if (info->attr.mq_curmsgs == info->attr.mq_maxmsg) {
+		if (fd_file(f)->f_flags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			goto out_unlock;
+		}
+		wait.task = current;
+		wait.msg = msgs[0];
+
+		/* memory barrier not required, we hold info->lock */
+		WRITE_ONCE(wait.state, STATE_NONE);
+		ret = wq_sleep(info, SEND, timeout, &wait);
+		if (!ret)
+			sent = 1;
+		goto out_free;
+	}
+
+	for (; sent < nr; sent++) {
+		if (info->attr.mq_curmsgs == info->attr.mq_maxmsg)
+			break;
+		receiver = wq_get_first_waiter(info, RECV);
+		if (receiver) {
+			pipelined_send(&wake_q, info, msgs[sent], receiver);
+		} else {
+			ret = msg_insert(msgs[sent], info);
+			if (ret)
+				break;
+			__do_notify(info);
+		}
+	}
+	simple_inode_init_ts(inode);
+out_unlock:
+	spin_unlock(&info->lock);
+	wake_up_q(&wake_q);
+out_free:
+	for (i = sent; i < nr; i++)
+		free_msg(msgs[i]);
+	kvfree(msgs);
+	if (sent)
+		ret = sent;
+out_fput:
+	fdput(f);
+out:
+	kvfree(vec);
+	return ret;
+}
+
+static int do_mq_recvmmsg(mqd_t mqdes, struct mq_mmsg __user *u_vec,
+		unsigned int vlen, struct timespec64 *ts)
+{
+	struct fd f;
+	struct inode *inode;
+	struct ext_wait_queue wait;
+	struct mq_mmsg *vec;
+	struct msg_msg **msgs;
+	struct mqueue_inode_info *info;
+	ktime_t expires, *timeout = NULL;
+	struct posix_msg_tree_node *new_leaf = NULL;
+	unsigned int i, nr = 0, done;
+	int ret = 0;
+	DEFINE_WAKE_Q(wake_q);
+
+	if (!vlen)
+		return 0;
+	vlen = min_t(unsigned int, vlen, MQ_MMSG_MAX);
+
+	if (ts) {
+		expires = timespec64_to_ktime(*ts);
+		timeout = &expires;
+	}
+
+	vec = vmemdup_array_user(u_vec, vlen, sizeof(*vec));
+	if (IS_ERR(vec))
+		return PTR_ERR(vec);
+
+	audit_mq_sendrecv(mqdes, vec[0].msg_len, 0, ts);
+
+	f = fdget(mqdes);
+	if (unlikely(!fd_file(f))) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	inode = file_inode(fd_file(f));
+	if (unlikely(fd_file(f)->f_op != &mqueue_file_operations)) {
+		ret = -EBADF;
+		goto out_fput;
+	}
+	info = MQUEUE_I(inode);
+	audit_file(fd_file(f));
+
+	if (unlikely(!(fd_file(f)->f_mode & FMODE_READ))) {
+		ret = -EBADF;
+		goto out_fput;
+	}
+
+	/* checks if the buffers are big enough; a short one ends the batch */
+	for (i = 0; i < vlen; i++) {
+		if (vec[i].msg_len < info->attr.mq_msgsize)
+			break;
+	}
+	if (!i) {
+		ret = -EMSGSIZE;
+		goto out_fput;
+	}
+	vlen = i;
+
+	msgs = kvmalloc_array(vlen, sizeof(*msgs), GFP_KERNEL);
+	if (!msgs) {
+		ret = -ENOMEM;
+		goto out_fput;
+	}
+
+	/*
+	 * msg_insert really wants us to have a valid, spare node struct so
+	 * it doesn't have to kmalloc a GFP_ATOMIC allocation, but it will
+	 * fall back to that if necessary.
+	 */
+	if (!info->node_cache)
+		new_leaf = kmalloc(sizeof(*new_leaf), GFP_KERNEL);
+
+	spin_lock(&info->lock);
+
+	if (!info->node_cache && new_leaf) {
+		/* Save our speculative allocation into the cache */
+		INIT_LIST_HEAD(&new_leaf->msg_list);
+		info->node_cache = new_leaf;
+	} else {
+		kfree(new_leaf);
+	}
+
+	if (info->attr.mq_curmsgs == 0) {
+		if (fd_file(f)->f_flags & O_NONBLOCK) {
+			spin_unlock(&info->lock);
+			ret = -EAGAIN;
+		} else {
+			wait.task = current;
+
+			/* memory barrier not required, we hold info->lock */
+			WRITE_ONCE(wait.state, STATE_NONE);
+			ret = wq_sleep(info, RECV, timeout, &wait);
+			if (!ret)
+				msgs[nr++] = wait.msg;
+		}
+	} else {
+		while (nr < vlen && info->attr.mq_curmsgs) {
+			msgs[nr++] = msg_get(info);
+
+			/* There is now free space in queue. */
+			pipelined_receive(&wake_q, info);
+		}
+		simple_inode_init_ts(inode);
+		spin_unlock(&info->lock);
+		wake_up_q(&wake_q);
+	}
+
+	/* As with mq_timedreceive(), a message that cannot be stored is lost. */
+	for (done = 0; done < nr; done++) {
+		struct msg_msg *msg_ptr = msgs[done];
+
+		if (put_user(msg_ptr->m_ts, &u_vec[done].msg_len) ||
+		    put_user(msg_ptr->m_type, &u_vec[done].msg_prio) ||
+		    store_msg(u64_to_user_ptr(vec[done].msg_ptr), msg_ptr,
+			      msg_ptr->m_ts))
+			break;
+		free_msg(msg_ptr);
+	}
+	if (done < nr && !done)
+		ret = -EFAULT;
+	for (i = done; i < nr; i++)
+		free_msg(msgs[i]);
+	kvfree(msgs);
+	if (done)
+		ret = done;
+out_fput:
+	fdput(f);
+out:
+	kvfree(vec);
+	return ret;
+}
+
+SYSCALL_DEFINE5(mq_sendmmsg, mqd_t, mqdes, struct mq_mmsg __user *, u_vec,
+		unsigned int, vlen, unsigned int, flags,
+		const struct __kernel_timespec __user *, u_abs_timeout)
+{
+	struct timespec64 ts, *p = NULL;
+
+	if (flags)
+		return -EINVAL;
+	if (u_abs_timeout) {
+		int res = prepare_timeout(u_abs_timeout, &ts);
+		if (res)
+			return res;
+		p = &ts;
+	}
+	return do_mq_sendmmsg(mqdes, u_vec, vlen, p);
+}
+
+SYSCALL_DEFINE5(mq_recvmmsg, mqd_t, mqdes, struct mq_mmsg __user *, u_vec,
+		unsigned int, vlen, unsigned int, flags,
+		const struct __kernel_timespec __user *, u_abs_timeout)
+{
+	struct timespec64 ts, *p = NULL;
+
+	if (flags)
+		return -EINVAL;
+	if (u_abs_timeout) {
+		int res = prepare_timeout(u_abs_timeout, &ts);
+		if (res)
+			return res;
+		p = &ts;
+	}
+	return do_mq_recvmmsg(mqdes, u_vec, vlen, p);
+}
+
 /*
  * Notes: the case when user wants us to deregister (with NULL as pointer)
  * and he isn't currently owner of notification, will be silently discarded.
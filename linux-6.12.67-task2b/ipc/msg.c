@@ -58,10 +58,22 @@ struct msg_queue {
 	struct pid *q_lrpid;		/* last receive pid */
 
 	struct list_head q_messages;
+	struct rb_root q_types;		/* oldest message of each type */
 	struct list_head q_receivers;
 	struct list_head q_senders;
 } __randomize_layout;
 
+/*
+ * Index by type:
+ *
+ * Besides q_messages, which keeps all messages in queue order, the
+ * oldest message of each type is in the q_types rbtree, keyed by m_type.
+ * The other messages of that type are on its m_tlist, in queue order.
+ * This lets msgrcv() with SEARCH_EQUAL or SEARCH_LESSEQUAL find its
+ * message in O(log types) instead of scanning the whole queue.
+ * Both are protected by q_perm.lock.
+ */
+
 /*
  * MSG_BARRIER Locking:
  *
@@ -82,6 +94,7 @@ struct msg_receiver {
 	long			r_maxsize;
 
 	struct msg_msg		*r_msg;
+	u64			r_sleep_start;	/* for SYSVIPC_STATS */
 };
 
 /* one msg_sender for each sleeping sender */
@@ -168,6 +181,7 @@ static int newque(struct ipc_namespace *ns, struct ipc_params *params)
 	msq->q_qbytes = ns->msg_ctlmnb;
 	msq->q_lspid = msq->q_lrpid = NULL;
 	INIT_LIST_HEAD(&msq->q_messages);
+	msq->q_types = RB_ROOT;
 	INIT_LIST_HEAD(&msq->q_receivers);
 	INIT_LIST_HEAD(&msq->q_senders);
 
@@ -791,6 +805,47 @@ COMPAT_SYSCALL_DEFINE3(old_msgctl, int, msqid, int, cmd, void __user *, uptr)
 #endif
 #endif
 
+static void msg_type_insert(struct msg_queue *msq, struct msg_msg *msg)
+{
+	struct rb_node **link = &msq->q_types.rb_node, *parent = NULL;
+	struct msg_msg *first;
+
+	while (*link) {
+		parent = *link;
+		first = rb_entry(parent, struct msg_msg, m_tnode);
+		if (msg->m_type < first->m_type) {
+			link = &parent->rb_left;
+		} else if (msg->m_type > first->m_type) {
+			link = &parent->rb_right;
+		} else {
+			RB_CLEAR_NODE(&msg->m_tnode);
+			list_add_tail(&msg->m_tlist, &first->m_tlist);
+			return;
+		}
+	}
+
+	INIT_LIST_HEAD(&msg->m_tlist);
+	rb_link_node(&msg->m_tnode, parent, link);
+	rb_insert_color(&msg->m_tnode, &msq->q_types);
+}
+
+static void msg_type_erase(struct msg_queue *msq, struct msg_msg *msg)
+{
+	if (!RB_EMPTY_NODE(&msg->m_tnode)) {
+		if (list_empty(&msg->m_tlist)) {
+			rb_erase(&msg->m_tnode, &msq->q_types);
+		} else {
+			/* the next message of the type takes over */
+			struct msg_msg *next = list_first_entry(&msg->m_tlist,
+						struct msg_msg, m_tlist);
+
+			rb_replace_node(&msg->m_tnode, &next->m_tnode,
+					&msq->q_types);
+		}
+	}
+	list_del(&msg->m_tlist);
+}
+
 static int testmsg(struct msg_msg *msg, long type, int mode)
 {
 	switch (mode) {
@@ -832,6 +887,7 @@ static inline int pipelined_send(struct msg_queue *msq, struct msg_msg *msg,
 			} else {
 				ipc_update_pid(&msq->q_lrpid, task_pid(msr->r_tsk));
 				msq->q_rtime = ktime_get_real_seconds();
+				ipc_stat_sleep(&msq->q_perm, msr->r_sleep_start);
 
 				wake_q_add(wake_q, msr->r_tsk);
 
@@ -845,11 +901,34 @@ static inline int pipelined_send(struct msg_queue *msq, struct msg_msg *msg,
 	return 0;
 }
 
+/*
+ * A message of at least MSG_PIN_MIN bytes that finds a receiver already
+ * waiting is copied once, from the sender's pinned buffer straight to the
+ * receiver, instead of through a kernel copy, see pin_msg().
+ */
+#define MSG_PIN_MIN	(4 * PAGE_SIZE)
+
+/* Only a hint: a receiver can come or go before the queue is locked. */
+static bool msg_receiver_waiting(struct ipc_namespace *ns, int msqid)
+{
+	struct msg_queue *msq;
+	bool ret = false;
+
+	rcu_read_lock();
+	msq = msq_obtain_object_check(ns, msqid);
+	if (!IS_ERR(msq))
+		ret = !list_empty(&msq->q_receivers);
+	rcu_read_unlock();
+
+	return ret;
+}
+
 static long do_msgsnd(int msqid, long mtype, void __user *mtext,
 		size_t msgsz, int msgflg)
 {
 	struct msg_queue *msq;
 	struct msg_msg *msg;
+	bool pinned = false;
 	int err;
 	struct ipc_namespace *ns;
 	DEFINE_WAKE_Q(wake_q);
@@ -861,9 +940,16 @@ static long do_msgsnd(int msqid, long mtype, void __user *mtext,
 	if (mtype < 1)
 		return -EINVAL;
 
-	msg = load_msg(mtext, msgsz);
-	if (IS_ERR(msg))
-		return PTR_ERR(msg);
+	if (msgsz >= MSG_PIN_MIN && msg_receiver_waiting(ns, msqid)) {
+		msg = pin_msg(mtext, msgsz);
+		pinned = !IS_ERR(msg);
+	}
+load:
+	if (!pinned) {
+		msg = load_msg(mtext, msgsz);
+		if (IS_ERR(msg))
+			return PTR_ERR(msg);
+	}
 
 	msg->m_type = mtype;
 	msg->m_ts = msgsz;
@@ -875,6 +961,7 @@ static long do_msgsnd(int msqid, long mtype, void __user *mtext,
 		goto out_unlock1;
 	}
 
+	ipc_stat_op(&msq->q_perm);
 	ipc_lock_object(&msq->q_perm);
 
 	for (;;) {
@@ -937,8 +1024,22 @@ static long do_msgsnd(int msqid, long mtype, void __user *mtext,
 	msq->q_stime = ktime_get_real_seconds();
 
 	if (!pipelined_send(msq, msg, &wake_q)) {
+		if (pinned) {
+			/*
+			 * The receiver is gone, so the message has to be
+			 * copied into the kernel after all to be queued.
+			 */
+			ipc_unlock_object(&msq->q_perm);
+			wake_up_q(&wake_q);
+			rcu_read_unlock();
+			unpin_msg(msg, false);
+			pinned = false;
+			goto load;
+		}
+
 		/* no one is waiting for this message, enqueue it */
 		list_add_tail(&msg->m_list, &msq->q_messages);
+		msg_type_insert(msq, msg);
 		msq->q_cbytes += msgsz;
 		msq->q_qnum++;
 		percpu_counter_add_local(&ns->percpu_msg_bytes, msgsz);
@@ -946,14 +1047,18 @@ static long do_msgsnd(int msqid, long mtype, void __user *mtext,
 	}
 
 	err = 0;
-	msg = NULL;
+	if (!pinned)
+		msg = NULL;
 
 out_unlock0:
 	ipc_unlock_object(&msq->q_perm);
 	wake_up_q(&wake_q);
 out_unlock1:
 	rcu_read_unlock();
-	if (msg != NULL)
+	/* a pinned message sent without error went to a receiver */
+	if (pinned)
+		unpin_msg(msg, !err);
+	else if (msg != NULL)
 		free_msg(msg);
 	return err;
 }
@@ -1071,20 +1176,72 @@ static inline void free_copy(struct msg_msg *copy)
 }
 #endif
 
-static struct msg_msg *find_msg(struct msg_queue *msq, long *msgtyp, int mode)
+/* The oldest message of the type of first that the caller may receive */
+static struct msg_msg *find_msg_of_type(struct msg_queue *msq,
+					struct msg_msg *first,
+					long msgtyp, int mode)
+{
+	struct msg_msg *msg = first;
+
+	do {
+		if (!security_msg_queue_msgrcv(&msq->q_perm, msg, current,
+					       msgtyp, mode))
+			return msg;
+		msg = list_next_entry(msg, m_tlist);
+	} while (msg != first);
+
+	return NULL;
+}
+
+/* find_msg() for SEARCH_EQUAL and SEARCH_LESSEQUAL, using q_types */
+static struct msg_msg *find_msg_by_type(struct msg_queue *msq, long msgtyp,
+					int mode)
 {
-	struct msg_msg *msg, *found = NULL;
+	struct msg_msg *first, *msg;
+	struct rb_node *node;
+
+	if (mode == SEARCH_EQUAL) {
+		node = msq->q_types.rb_node;
+		while (node) {
+			first = rb_entry(node, struct msg_msg, m_tnode);
+			if (msgtyp < first->m_type) {
+				node = node->rb_left;
+			} else if (msgtyp > first->m_type) {
+				node = node->rb_right;
+			} else {
+				msg = find_msg_of_type(msq, first, msgtyp, mode);
+				return msg ?: ERR_PTR(-EAGAIN);
+			}
+		}
+		return ERR_PTR(-EAGAIN);
+	}
+
+	/* SEARCH_LESSEQUAL: the lowest type wins */
+	for (node = rb_first(&msq->q_types); node; node = rb_next(node)) {
+		first = rb_entry(node, struct msg_msg, m_tnode);
+		if (first->m_type > msgtyp)
+			break;
+		msg = find_msg_of_type(msq, first, msgtyp, mode);
+		if (msg)
+			return msg;
+	}
+	return ERR_PTR(-EAGAIN);
+}
+
+static struct msg_msg *find_msg(struct msg_queue *msq, long msgtyp, int mode)
+{
+	struct msg_msg *msg;
 	long count = 0;
 
+	if (mode == SEARCH_EQUAL || mode == SEARCH_LESSEQUAL)
+		return find_msg_by_type(msq, msgtyp, mode);
+
 	list_for_each_entry(msg, &msq->q_messages, m_list) {
-		if (testmsg(msg, *msgtyp, mode) &&
+		if (testmsg(msg, msgtyp, mode) &&
 		    !security_msg_queue_msgrcv(&msq->q_perm, msg, current,
-					       *msgtyp, mode)) {
-			if (mode == SEARCH_LESSEQUAL && msg->m_type != 1) {
-				*msgtyp = msg->m_type - 1;
-				found = msg;
-			} else if (mode == SEARCH_NUMBER) {
-				if (*msgtyp == count)
+					       msgtyp, mode)) {
+			if (mode == SEARCH_NUMBER) {
+				if (msgtyp == count)
 					return msg;
 			} else
 				return msg;
@@ -1092,7 +1249,7 @@ static struct msg_msg *find_msg(struct msg_queue *msq, long *msgtyp, int mode)
 		}
 	}
 
-	return found ?: ERR_PTR(-EAGAIN);
+	return ERR_PTR(-EAGAIN);
 }
 
 static long do_msgrcv(int msqid, void __user *buf, size_t bufsz, long msgtyp, int msgflg,
@@ -1126,6 +1283,7 @@ static long do_msgrcv(int msqid, void __user *buf, size_t bufsz, long msgtyp, in
 		return PTR_ERR(msq);
 	}
 
+	ipc_stat_op(&msq->q_perm);
 	for (;;) {
 		struct msg_receiver msr_d;
 
@@ -1141,7 +1299,7 @@ static long do_msgrcv(int msqid, void __user *buf, size_t bufsz, long msgtyp, in
 			goto out_unlock0;
 		}
 
-		msg = find_msg(msq, &msgtyp, mode);
+		msg = find_msg(msq, msgtyp, mode);
 		if (!IS_ERR(msg)) {
 			/*
 			 * Found a suitable message.
@@ -1161,6 +1319,7 @@ static long do_msgrcv(int msqid, void __user *buf, size_t bufsz, long msgtyp, in
 			}
 
 			list_del(&msg->m_list);
+			msg_type_erase(msq, msg);
 			msq->q_qnum--;
 			msq->q_rtime = ktime_get_real_seconds();
 			ipc_update_pid(&msq->q_lrpid, task_tgid(current));
@@ -1192,6 +1351,7 @@ static long do_msgrcv(int msqid, void __user *buf, size_t bufsz, long msgtyp, in
 
 		/* memory barrier not required, we own ipc_lock_object() */
 		__set_current_state(TASK_INTERRUPTIBLE);
+		msr_d.r_sleep_start = ipc_stat_now();
 
 		ipc_unlock_object(&msq->q_perm);
 		rcu_read_unlock();
@@ -1237,6 +1397,8 @@ static long do_msgrcv(int msqid, void __user *buf, size_t bufsz, long msgtyp, in
 			goto out_unlock0;
 
 		list_del(&msr_d.r_list);
+		/* no message came, so nobody accounted the sleep yet */
+		ipc_stat_sleep(&msq->q_perm, msr_d.r_sleep_start);
 		if (signal_pending(current)) {
 			msg = ERR_PTR(-ERESTARTNOHAND);
 			goto out_unlock0;
@@ -1332,6 +1494,7 @@ void msg_exit_ns(struct ipc_namespace *ns)
 	free_ipcs(ns, &msg_ids(ns), freeque);
 	idr_destroy(&ns->ids[IPC_MSG_IDS].ipcs_idr);
 	rhashtable_destroy(&ns->ids[IPC_MSG_IDS].key_ht);
+	free_percpu(ns->ids[IPC_MSG_IDS].id_cache);
 	percpu_counter_destroy(&ns->percpu_msg_bytes);
 	percpu_counter_destroy(&ns->percpu_msg_hdrs);
 }
@@ -1346,7 +1509,7 @@ static int sysvipc_msg_proc_show(struct seq_file *s, void *it)
 	struct msg_queue *msq = container_of(ipcp, struct msg_queue, q_perm);
 
 	seq_printf(s,
-		   "%10d %10d  %4o  %10lu %10lu %5u %5u %5u %5u %5u %5u %10llu %10llu %10llu\n",
+		   "%10d %10d  %4o  %10lu %10lu %5u %5u %5u %5u %5u %5u %10llu %10llu %10llu",
 		   msq->q_perm.key,
 		   msq->q_perm.id,
 		   msq->q_perm.mode,
@@ -1361,6 +1524,7 @@ static int sysvipc_msg_proc_show(struct seq_file *s, void *it)
 		   msq->q_stime,
 		   msq->q_rtime,
 		   msq->q_ctime);
+	ipc_stats_show(s, &msq->q_perm);
 
 	return 0;
 }
@@ -1371,6 +1535,7 @@ void __init msg_init(void)
 	msg_init_ns(&init_ipc_ns);
 
 	ipc_init_proc_interface("sysvipc/msg",
-				"       key      msqid perms      cbytes       qnum lspid lrpid   uid   gid  cuid  cgid      stime      rtime      ctime\n",
+				"       key      msqid perms      cbytes       qnum lspid lrpid   uid   gid  cuid  cgid      stime      rtime      ctime"
+				IPC_STATS_HEADER "\n",
 				IPC_MSG_IDS, sysvipc_msg_proc_show);
 }
@@ -15,6 +15,13 @@
 #include <linux/proc_ns.h>
 #include <linux/uaccess.h>
 #include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/completion.h>
+#include <linux/cpuhotplug.h>
+#include <linux/local_lock.h>
+#include <linux/memcontrol.h>
+#include <linux/refcount.h>
 
 #include "util.h"
 
@@ -42,14 +49,135 @@ struct msg_msgseg {
 #define DATALEN_MSG	((size_t)PAGE_SIZE-sizeof(struct msg_msg))
 #define DATALEN_SEG	((size_t)PAGE_SIZE-sizeof(struct msg_msgseg))
 
+/*
+ * A message handed straight to a waiting receiver need not be copied
+ * into the kernel: the sender pins its own buffer, the receiver copies
+ * out of the pinned pages and the sender sleeps until it has done so.
+ * Such a message has no text of its own; ->next marks it.
+ *
+ * A fatal signal ends the sender's sleep early. Sender and receiver each
+ * hold a reference, and whoever drops the last one releases the pages.
+ */
+#define MSG_PINNED	((struct msg_msgseg *)1)
+
+struct msg_pinned {
+	struct msg_msg msg;
+	struct page **pages;
+	unsigned int nr_pages;
+	unsigned int offset;		/* of the text in pages[0] */
+	struct completion done;		/* the receiver has copied the text */
+	refcount_t refs;		/* sender and receiver */
+};
+
 static kmem_buckets *msg_buckets __ro_after_init;
 
+/*
+ * Page sized buffers, that is the header and all but the last segment
+ * of a message longer than DATALEN_MSG, are recycled through a small
+ * per-CPU cache rather than handed back to the slab allocator: sender
+ * and receiver usually run on different CPUs, and remote frees of such
+ * large objects keep the slab allocator on its slow path.
+ *
+ * The buffers come from SLAB_ACCOUNT caches and stay charged to the
+ * cgroup that allocated them, so a cached buffer is only handed to a
+ * sender of that same cgroup. One charged elsewhere is freed instead of
+ * being reused, which also keeps the cache from holding on to buffers of
+ * cgroups that no longer send.
+ */
+#define MSG_CACHE_SIZE	32
+
+struct msg_cache {
+	local_lock_t lock;
+	unsigned int nr;
+	void *bufs[MSG_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct msg_cache, msg_cache) = {
+	.lock = INIT_LOCAL_LOCK(lock),
+};
+
+#ifdef CONFIG_MEMCG
+static bool msg_buf_charged_to_current(void *buf)
+{
+	struct obj_cgroup *objcg;
+	bool ret;
+
+	if (!memcg_kmem_online())
+		return true;
+
+	objcg = current_obj_cgroup();
+	rcu_read_lock();
+	ret = mem_cgroup_from_slab_obj(buf) ==
+	      (objcg ? obj_cgroup_memcg(objcg) : NULL);
+	rcu_read_unlock();
+	return ret;
+}
+#else
+static inline bool msg_buf_charged_to_current(void *buf)
+{
+	return true;
+}
+#endif
+
+static void *msg_buf_alloc(size_t size)
+{
+	struct msg_cache *mc;
+	void *buf = NULL;
+
+	if (size == PAGE_SIZE) {
+		local_lock(&msg_cache.lock);
+		mc = this_cpu_ptr(&msg_cache);
+		if (mc->nr)
+			buf = mc->bufs[--mc->nr];
+		local_unlock(&msg_cache.lock);
+		if (buf) {
+			if (msg_buf_charged_to_current(buf))
+				return buf;
+			kfree(buf);
+		}
+	}
+
+	return kmem_buckets_alloc(msg_buckets, size, GFP_KERNEL);
+}
+
+static void msg_buf_free(void *buf, size_t size)
+{
+	struct msg_cache *mc;
+
+	if (size == PAGE_SIZE) {
+		local_lock(&msg_cache.lock);
+		mc = this_cpu_ptr(&msg_cache);
+		if (mc->nr < MSG_CACHE_SIZE) {
+			mc->bufs[mc->nr++] = buf;
+			buf = NULL;
+		}
+		local_unlock(&msg_cache.lock);
+		if (buf == NULL)
+			return;
+	}
+
+	kfree(buf);
+}
+
+static int msg_cache_dead(unsigned int cpu)
+{
+	struct msg_cache *mc = per_cpu_ptr(&msg_cache, cpu);
+
+	while (mc->nr)
+		kfree(mc->bufs[--mc->nr]);
+
+	return 0;
+}
+
 static int __init init_msg_buckets(void)
 {
 	msg_buckets = kmem_buckets_create("msg_msg", SLAB_ACCOUNT,
 					  sizeof(struct msg_msg),
 					  DATALEN_MSG, NULL);
 
+	cpuhp_setup_state_nocalls(CPUHP_BP_PREPARE_DYN, "ipc/msg:dead",
+				  NULL, msg_cache_dead);
+
 	return 0;
 }
 subsys_initcall(init_msg_buckets);
@@ -61,10 +189,12 @@ static struct msg_msg *alloc_msg(size_t len)
 	size_t alen;
 
 	alen = min(len, DATALEN_MSG);
-	msg = kmem_buckets_alloc(msg_buckets, sizeof(*msg) + alen, GFP_KERNEL);
+	msg = msg_buf_alloc(sizeof(*msg) + alen);
 	if (msg == NULL)
 		return NULL;
 
+	/* free_msg() derives the size of each buffer from m_ts */
+	msg->m_ts = len;
 	msg->next = NULL;
 	msg->security = NULL;
 
@@ -76,7 +206,7 @@ static struct msg_msg *alloc_msg(size_t len)
 		cond_resched();
 
 		alen = min(len, DATALEN_SEG);
-		seg = kmalloc(sizeof(*seg) + alen, GFP_KERNEL_ACCOUNT);
+		seg = msg_buf_alloc(sizeof(*seg) + alen);
 		if (seg == NULL)
 			goto out_err;
 		*pseg = seg;
@@ -125,6 +255,110 @@ out_err:
 	free_msg(msg);
 	return ERR_PTR(err);
 }
+/*
+ * Pin the user buffer of a message that is about to be handed to a
+ * waiting receiver.  The caller must either pass the message to a
+ * receiver and then call unpin_msg(msg, true), which waits killably until
+ * the receiver has stored it, or release it with unpin_msg(msg, false).
+ */
+struct msg_msg *pin_msg(const void __user *src, size_t len)
+{
+	unsigned long start = (unsigned long)src;
+	struct msg_pinned *pm;
+	int nr, err = -ENOMEM;
+
+	pm = kmalloc(sizeof(*pm), GFP_KERNEL_ACCOUNT);
+	if (pm == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	pm->offset = offset_in_page(start);
+	pm->nr_pages = DIV_ROUND_UP(pm->offset + len, PAGE_SIZE);
+	pm->pages = kvmalloc_array(pm->nr_pages, sizeof(*pm->pages),
+				   GFP_KERNEL_ACCOUNT);
+	if (pm->pages == NULL)
+		goto out_free;
+
+	nr = pin_user_pages_fast(start & PAGE_MASK, pm->nr_pages, 0, pm->pages);
+	if (nr != pm->nr_pages) {
+		if (nr > 0)
+			unpin_user_pages(pm->pages, nr);
+		err = nr < 0 ? nr : -EFAULT;
+		goto out_free_pages;
+	}
+
+	init_completion(&pm->done);
+	refcount_set(&pm->refs, 2);
+	pm->msg.next = MSG_PINNED;
+	pm->msg.security = NULL;
+	pm->msg.m_ts = len;
+
+	err = security_msg_msg_alloc(&pm->msg);
+	if (err)
+		goto out_unpin;
+
+	return &pm->msg;
+
+out_unpin:
+	unpin_user_pages(pm->pages, pm->nr_pages);
+out_free_pages:
+	kvfree(pm->pages);
+out_free:
+	kfree(pm);
+	return ERR_PTR(err);
+}
+
+static void put_pinned_msg(struct msg_pinned *pm, unsigned int nr)
+{
+	if (!refcount_sub_and_test(nr, &pm->refs))
+		return;
+
+	security_msg_msg_free(&pm->msg);
+	unpin_user_pages(pm->pages, pm->nr_pages);
+	kvfree(pm->pages);
+	kfree(pm);
+}
+
+void unpin_msg(struct msg_msg *msg, bool delivered)
+{
+	struct msg_pinned *pm = container_of(msg, struct msg_pinned, msg);
+
+	/*
+	 * The receiver signals completion from free_msg(). A sender that
+	 * is killed meanwhile won't return to look at its buffer again, so
+	 * it can leave the pinned pages to the receiver.
+	 */
+	if (delivered)
+		wait_for_completion_killable(&pm->done);
+
+	/* if no receiver got it, its reference goes too */
+	put_pinned_msg(pm, delivered ? 1 : 2);
+}
+
+static int store_pinned_msg(void __user *dest, struct msg_pinned *pm,
+			    size_t len)
+{
+	unsigned int offset = pm->offset;
+	struct page **page = pm->pages;
+
+	while (len > 0) {
+		size_t alen = min_t(size_t, len, PAGE_SIZE - offset);
+		unsigned long left;
+		void *src;
+
+		src = kmap_local_page(*page);
+		left = copy_to_user(dest, src + offset, alen);
+		kunmap_local(src);
+		if (left)
+			return -1;
+
+		len -= alen;
+		dest = (char __user *)dest + alen;
+		offset = 0;
+		page++;
+	}
+	return 0;
+}
+
 #ifdef CONFIG_CHECKPOINT_RESTORE
 struct msg_msg *copy_msg(struct msg_msg *src, struct msg_msg *dst)
 {
@@ -163,6 +397,10 @@ int store_msg(void __user *dest, struct msg_msg *msg, size_t len)
 	size_t alen;
 	struct msg_msgseg *seg;
 
+	if (msg->next == MSG_PINNED)
+		return store_pinned_msg(dest,
+				container_of(msg, struct msg_pinned, msg), len);
+
 	alen = min(len, DATALEN_MSG);
 	if (copy_to_user(dest, msg + 1, alen))
 		return -1;
@@ -180,16 +418,30 @@ int store_msg(void __user *dest, struct msg_msg *msg, size_t len)
 void free_msg(struct msg_msg *msg)
 {
 	struct msg_msgseg *seg;
+	size_t len, alen;
+
+	/* tell the sender we are done with its pinned message */
+	if (msg->next == MSG_PINNED) {
+		struct msg_pinned *pm = container_of(msg, struct msg_pinned, msg);
+
+		complete(&pm->done);
+		put_pinned_msg(pm, 1);
+		return;
+	}
 
 	security_msg_msg_free(msg);
 
+	len = msg->m_ts;
+	alen = min(len, DATALEN_MSG);
 	seg = msg->next;
-	kfree(msg);
+	msg_buf_free(msg, sizeof(*msg) + alen);
 	while (seg != NULL) {
 		struct msg_msgseg *tmp = seg->next;
 
 		cond_resched();
-		kfree(seg);
+		len -= alen;
+		alen = min(len, DATALEN_SEG);
+		msg_buf_free(seg, sizeof(*seg) + alen);
 		seg = tmp;
 	}
 }
@@ -107,6 +107,8 @@ struct sem {
 					/* that alter the semaphore */
 	struct list_head pending_const; /* pending single-sop operations */
 					/* that do not alter the semaphore*/
+	int		alter_min;	/* lower bound of the decrements */
+					/* pending_alter waits for */
 	time64_t	 sem_otime;	/* candidate for sem_otime */
 } ____cacheline_aligned_in_smp;
 
@@ -138,6 +140,7 @@ struct sem_queue {
 	int			nsops;	 /* number of operations */
 	bool			alter;	 /* does *sops alter the array? */
 	bool                    dupsop;	 /* sops on more than one sem_num */
+	u64			sleep_start; /* for SYSVIPC_STATS */
 };
 
 /* Each task has a list of undo requests. They are executed automatically
@@ -194,6 +197,10 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it);
  *
  * b) global or semaphore sem_lock() for read/write:
  *	sem_array.sems[i].pending_{const,alter}:
+ *	sem_array.sems[i].alter_min:
+ *	A complex operation that does not sleep may hold the semaphore
+ *	locks of all the semaphores it operates on instead of the global
+ *	lock, see sem_lock_multi().
  *
  * c) special:
  *	sem_undo_list.list_proc:
@@ -262,6 +269,7 @@ void sem_exit_ns(struct ipc_namespace *ns)
 	free_ipcs(ns, &sem_ids(ns), freeary);
 	idr_destroy(&ns->ids[IPC_SEM_IDS].ipcs_idr);
 	rhashtable_destroy(&ns->ids[IPC_SEM_IDS].key_ht);
+	free_percpu(ns->ids[IPC_SEM_IDS].id_cache);
 }
 #endif
 
@@ -269,10 +277,30 @@ void __init sem_init(void)
 {
 	sem_init_ns(&init_ipc_ns);
 	ipc_init_proc_interface("sysvipc/sem",
-				"       key      semid perms      nsems   uid   gid  cuid  cgid      otime      ctime\n",
+				"       key      semid perms      nsems   uid   gid  cuid  cgid      otime      ctime"
+				IPC_STATS_HEADER "\n",
 				IPC_SEM_IDS, sysvipc_sem_proc_show);
 }
 
+/**
+ * sem_queue_alter - add a simple alter operation to its semaphore's queue
+ * @sem: semaphore the operation waits on
+ * @q: queue entry of the operation
+ *
+ * Operations on a per-semaphore alter queue are all decrements, since
+ * simple increments never sleep.  sem->alter_min tracks a lower bound of
+ * how much they need: while semval is below it, none of them can proceed
+ * and update_queue() need not look at them.
+ */
+static void sem_queue_alter(struct sem *sem, struct sem_queue *q)
+{
+	int need = -q->sops[0].sem_op;
+
+	list_add_tail(&q->list, &sem->pending_alter);
+	if (need < sem->alter_min)
+		sem->alter_min = need;
+}
+
 /**
  * unmerge_queues - unmerge queues, if possible.
  * @sma: semaphore array
@@ -296,7 +324,7 @@ static void unmerge_queues(struct sem_array *sma)
 		struct sem *curr;
 		curr = &sma->sems[q->sops[0].sem_num];
 
-		list_add_tail(&q->list, &curr->pending_alter);
+		sem_queue_alter(curr, q);
 	}
 	INIT_LIST_HEAD(&sma->pending_alter);
 }
@@ -379,11 +407,71 @@ static void complexmode_tryleave(struct sem_array *sma)
 }
 
 #define SEM_GLOBAL_LOCK	(-1)
+#define SEM_MULTI_LOCK	(-2)
+
+/*
+ * Largest complex operation that may lock its semaphores one by one.
+ * Bounded by the number of lockdep subclasses for sem->lock.
+ */
+#define SEM_MULTI_LOCK_MAX	8
+
+/*
+ * Lock the semaphores of a complex operation instead of the whole array.
+ * This is possible if the operation touches distinct semaphores and no
+ * complex operation is pending: then all sleepers that it can wake are on
+ * the per-semaphore queues of its own semaphores.  The locks are taken in
+ * ascending order, so that overlapping operations cannot deadlock.
+ *
+ * An operation locked this way must not sleep, since sleeping complex
+ * operations are queued on the global queues; __do_semtimedop() retries
+ * it with the global lock instead.
+ *
+ * Returns true if the semaphore locks are held, false if nothing is
+ * locked and the caller must use the global lock.
+ */
+static bool sem_lock_multi(struct sem_array *sma, struct sembuf *sops,
+			   int nsops)
+{
+	unsigned short nums[SEM_MULTI_LOCK_MAX];
+	int i, j;
+
+	if (nsops > SEM_MULTI_LOCK_MAX || READ_ONCE(sma->use_global_lock))
+		return false;
+
+	for (i = 0; i < nsops; i++) {
+		unsigned short num;
+
+		num = array_index_nospec(sops[i].sem_num, sma->sem_nsems);
+		for (j = i; j > 0 && nums[j - 1] > num; j--)
+			nums[j] = nums[j - 1];
+		if (j > 0 && nums[j - 1] == num)
+			return false;
+		nums[j] = num;
+	}
+
+	for (i = 0; i < nsops; i++)
+		spin_lock_nested(&sma->sems[nums[i]].lock, i);
+
+	/*
+	 * see SEM_BARRIER_1 for purpose/pairing: complexmode_enter() takes
+	 * every semaphore lock after setting use_global_lock, so checking
+	 * once with all of ours held is enough.
+	 */
+	if (!smp_load_acquire(&sma->use_global_lock))
+		return true;
+
+	for (i = nsops - 1; i >= 0; i--)
+		spin_unlock(&sma->sems[nums[i]].lock);
+	return false;
+}
+
 /*
  * If the request contains only one semaphore operation, and there are
  * no complex transactions pending, lock only the semaphore involved.
+ * The same applies to a complex operation on a few distinct semaphores,
+ * as long as it does not need to sleep.
  * Otherwise, lock the entire semaphore array, since we either have
- * multiple semaphores in our own semops, or we need to look at
+ * to queue multiple semaphores of our own semops, or we need to look at
  * semaphores from other pending complex operations.
  */
 static inline int sem_lock(struct sem_array *sma, struct sembuf *sops,
@@ -393,6 +481,9 @@ static inline int sem_lock(struct sem_array *sma, struct sembuf *sops,
 	int idx;
 
 	if (nsops != 1) {
+		if (sops && sem_lock_multi(sma, sops, nsops))
+			return SEM_MULTI_LOCK;
+
 		/* Complex operation - acquire a full lock */
 		ipc_lock_object(&sma->sem_perm);
 
@@ -420,7 +511,7 @@ static inline int sem_lock(struct sem_array *sma, struct sembuf *sops,
 		 * It appears that no complex operation is around.
 		 * Acquire the per-semaphore lock.
 		 */
-		spin_lock(&sem->lock);
+		ipc_stat_lock(&sma->sem_perm, &sem->lock);
 
 		/* see SEM_BARRIER_1 for purpose/pairing */
 		if (!smp_load_acquire(&sma->use_global_lock)) {
@@ -469,6 +560,23 @@ static inline void sem_unlock(struct sem_array *sma, int locknum)
 	}
 }
 
+/*
+ * Unlock what sem_lock(sma, sops, nsops) locked, including the semaphore
+ * locks taken by sem_lock_multi().
+ */
+static inline void sem_unlock_sops(struct sem_array *sma, struct sembuf *sops,
+				   int nsops, int locknum)
+{
+	int i;
+
+	if (locknum != SEM_MULTI_LOCK) {
+		sem_unlock(sma, locknum);
+		return;
+	}
+	for (i = 0; i < nsops; i++)
+		spin_unlock(&sma->sems[sops[i].sem_num].lock);
+}
+
 /*
  * sem_lock_(check_) routines are called in the paths where the rwsem
  * is not held.
@@ -559,6 +667,7 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 	for (i = 0; i < nsems; i++) {
 		INIT_LIST_HEAD(&sma->sems[i].pending_alter);
 		INIT_LIST_HEAD(&sma->sems[i].pending_const);
+		sma->sems[i].alter_min = INT_MAX;
 		spin_lock_init(&sma->sems[i].lock);
 	}
 
@@ -871,6 +980,8 @@ static int wake_const_ops(struct sem_array *sma, int semnum,
 		/* operation completed, remove from queue & wakeup */
 		unlink_queue(sma, q);
 
+		/* before the wakeup, q lives on the sleeper's stack */
+		ipc_stat_sleep(&sma->sem_perm, q->sleep_start);
 		wake_up_sem_queue_prepare(q, error, wake_q);
 		if (error == 0)
 			semop_completed = 1;
@@ -944,20 +1055,31 @@ static int do_smart_wakeup_zero(struct sem_array *sma, struct sembuf *sops,
  * is stored in q->pid.
  * The function internally checks if const operations can now succeed.
  *
+ * For a single semaphore, the sleepers are only looked at if semval is
+ * at least the smallest decrement one of them may wait for.  A scan of
+ * the whole queue refreshes that bound for the sleepers that remain.
+ *
  * The function return 1 if at least one semop was completed successfully.
  */
 static int update_queue(struct sem_array *sma, int semnum, struct wake_q_head *wake_q)
 {
 	struct sem_queue *q, *tmp;
 	struct list_head *pending_list;
+	struct sem *sem = NULL;
 	int semop_completed = 0;
+	int alter_min;
 
-	if (semnum == -1)
+	if (semnum == -1) {
 		pending_list = &sma->pending_alter;
-	else
-		pending_list = &sma->sems[semnum].pending_alter;
+	} else {
+		sem = &sma->sems[semnum];
+		pending_list = &sem->pending_alter;
+		if (sem->semval < sem->alter_min)
+			return 0;
+	}
 
 again:
+	alter_min = INT_MAX;
 	list_for_each_entry_safe(q, tmp, pending_list, list) {
 		int error, restart;
 
@@ -968,14 +1090,18 @@ again:
 		 * be in the  per semaphore pending queue, and decrements
 		 * cannot be successful if the value is already 0.
 		 */
-		if (semnum != -1 && sma->sems[semnum].semval == 0)
+		if (sem && sem->semval == 0) {
+			alter_min = 0;
 			break;
+		}
 
 		error = perform_atomic_semop(sma, q);
 
 		/* Does q->sleeper still need to sleep? */
-		if (error > 0)
+		if (error > 0) {
+			alter_min = min(alter_min, -q->sops[0].sem_op);
 			continue;
+		}
 
 		unlink_queue(sma, q);
 
@@ -987,10 +1113,15 @@ again:
 			restart = check_restart(sma, q);
 		}
 
+		ipc_stat_sleep(&sma->sem_perm, q->sleep_start);
 		wake_up_sem_queue_prepare(q, error, wake_q);
 		if (restart)
 			goto again;
 	}
+
+	/* After a partial scan, the old bound is all we know */
+	if (sem && alter_min)
+		sem->alter_min = alter_min;
 	return semop_completed;
 }
 
@@ -2069,8 +2200,10 @@ long __do_semtimedop(int semid, struct sembuf *sops,
 		goto out;
 	}
 
-	error = -EIDRM;
+	ipc_stat_op(&sma->sem_perm);
 	locknum = sem_lock(sma, sops, nsops);
+retry_global:
+	error = -EIDRM;
 	/*
 	 * We eventually might perform the following check in a lockless
 	 * fashion, considering ipc_valid_object() locking constraints.
@@ -2111,7 +2244,7 @@ long __do_semtimedop(int semid, struct sembuf *sops,
 		else
 			set_semotime(sma, sops);
 
-		sem_unlock(sma, locknum);
+		sem_unlock_sops(sma, sops, nsops, locknum);
 		rcu_read_unlock();
 		wake_up_q(&wake_q);
 
@@ -2120,6 +2253,19 @@ long __do_semtimedop(int semid, struct sembuf *sops,
 	if (error < 0) /* non-blocking error path */
 		goto out_unlock;
 
+	if (locknum == SEM_MULTI_LOCK) {
+		/*
+		 * A complex operation can only sleep on the global queues.
+		 * Switch to the global lock and try again, the semaphores
+		 * may have changed while they were unlocked.
+		 */
+		sem_unlock_sops(sma, sops, nsops, locknum);
+		ipc_lock_object(&sma->sem_perm);
+		complexmode_enter(sma);
+		locknum = SEM_GLOBAL_LOCK;
+		goto retry_global;
+	}
+
 	/*
 	 * We need to sleep on this operation, so we put the current
 	 * task into the pending queue and go to sleep.
@@ -2134,9 +2280,7 @@ long __do_semtimedop(int semid, struct sembuf *sops,
 				list_add_tail(&queue.list,
 						&sma->pending_alter);
 			} else {
-
-				list_add_tail(&queue.list,
-						&curr->pending_alter);
+				sem_queue_alter(curr, &queue);
 			}
 		} else {
 			list_add_tail(&queue.list, &curr->pending_const);
@@ -2160,6 +2304,7 @@ long __do_semtimedop(int semid, struct sembuf *sops,
 
 		/* memory ordering is ensured by the lock in sem_lock() */
 		__set_current_state(TASK_INTERRUPTIBLE);
+		queue.sleep_start = ipc_stat_now();
 		sem_unlock(sma, locknum);
 		rcu_read_unlock();
 
@@ -2186,6 +2331,10 @@ long __do_semtimedop(int semid, struct sembuf *sops,
 			goto out;
 		}
 
+		/*
+		 * A queued complex operation keeps use_global_lock raised,
+		 * thus this never returns SEM_MULTI_LOCK.
+		 */
 		locknum = sem_lock(sma, sops, nsops);
 
 		if (!ipc_valid_object(&sma->sem_perm))
@@ -2203,6 +2352,9 @@ long __do_semtimedop(int semid, struct sembuf *sops,
 		if (error != -EINTR)
 			goto out_unlock;
 
+		/* not woken by an update, so nobody accounted the sleep yet */
+		ipc_stat_sleep(&sma->sem_perm, queue.sleep_start);
+
 		/*
 		 * If an interrupt occurred we have to clean up the queue.
 		 */
@@ -2213,7 +2365,7 @@ long __do_semtimedop(int semid, struct sembuf *sops,
 	unlink_queue(sma, &queue);
 
 out_unlock:
-	sem_unlock(sma, locknum);
+	sem_unlock_sops(sma, sops, nsops, locknum);
 	rcu_read_unlock();
 out:
 	return error;
@@ -2465,7 +2617,7 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it)
 	sem_otime = get_semotime(sma);
 
 	seq_printf(s,
-		   "%10d %10d  %4o %10u %5u %5u %5u %5u %10llu %10llu\n",
+		   "%10d %10d  %4o %10u %5u %5u %5u %5u %10llu %10llu",
 		   sma->sem_perm.key,
 		   sma->sem_perm.id,
 		   sma->sem_perm.mode,
@@ -2476,6 +2628,7 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it)
 		   from_kgid_munged(user_ns, sma->sem_perm.cgid),
 		   sem_otime,
 		   sma->sem_ctime);
+	ipc_stats_show(s, &sma->sem_perm);
 
 	complexmode_tryleave(sma);
 
@@ -45,6 +45,10 @@
 #include <linux/mount.h>
 #include <linux/ipc_namespace.h>
 #include <linux/rhashtable.h>
+#include <linux/workqueue.h>
+#include <linux/memcontrol.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/signal.h>
 
 #include <linux/uaccess.h>
 
@@ -62,6 +66,7 @@ struct shmid_kernel /* private to the kernel */
 	struct pid		*shm_cprid;
 	struct pid		*shm_lprid;
 	struct ucounts		*mlock_ucounts;
+	bool			shm_thp;	/* SHM_THP: mapped VM_HUGEPAGE */
 
 	/*
 	 * The task created the shm object, for
@@ -86,6 +91,7 @@ struct shm_file_data {
 	struct ipc_namespace *ns;
 	struct file *file;
 	const struct vm_operations_struct *vm_ops;
+	bool thp;
 };
 
 #define shm_file_data(file) (*((struct shm_file_data **)&(file)->private_data))
@@ -142,6 +148,7 @@ void shm_exit_ns(struct ipc_namespace *ns)
 	free_ipcs(ns, &shm_ids(ns), do_shm_rmid);
 	idr_destroy(&ns->ids[IPC_SHM_IDS].ipcs_idr);
 	rhashtable_destroy(&ns->ids[IPC_SHM_IDS].key_ht);
+	free_percpu(ns->ids[IPC_SHM_IDS].id_cache);
 }
 #endif
 
@@ -612,6 +619,9 @@ static int shm_mmap(struct file *file, struct vm_area_struct *vma)
 	WARN_ON(!sfd->vm_ops->fault);
 #endif
 	vma->vm_ops = &shm_vm_ops;
+	/* as if madvise(MADV_HUGEPAGE) had been called on the mapping */
+	if (sfd->thp)
+		vm_flags_set(vma, VM_HUGEPAGE);
 	return 0;
 }
 
@@ -712,6 +722,9 @@ static int newseg(struct ipc_namespace *ns, struct ipc_params *params)
 	if (size < SHMMIN || size > ns->shm_ctlmax)
 		return -EINVAL;
 
+	if ((shmflg & SHM_THP) && (shmflg & SHM_HUGETLB))
+		return -EINVAL;
+
 	if (numpages << PAGE_SHIFT < size)
 		return -ENOSPC;
 
@@ -726,6 +739,7 @@ static int newseg(struct ipc_namespace *ns, struct ipc_params *params)
 	shp->shm_perm.key = key;
 	shp->shm_perm.mode = (shmflg & S_IRWXUGO);
 	shp->mlock_ucounts = NULL;
+	shp->shm_thp = shmflg & SHM_THP;
 
 	shp->shm_perm.security = NULL;
 	error = security_shm_alloc(&shp->shm_perm);
@@ -823,6 +837,125 @@ static int shm_more_checks(struct kern_ipc_perm *ipcp, struct ipc_params *params
 	return 0;
 }
 
+/*
+ * SHM_POPULATE: fault the whole segment in right after shmget(), spread
+ * over the caller and one worker per other online CPU, so that its users
+ * do not pay for the first touch of every page.  Like MAP_POPULATE this is
+ * best effort, and a fatal signal to the caller stops it.
+ */
+#define SHM_POPULATE_CHUNK	(SZ_2M >> PAGE_SHIFT)
+
+struct shm_populate_ctl {
+	struct address_space *mapping;
+	struct mem_cgroup *memcg;	/* charge the caller, not the kworker */
+	pgoff_t nr_pages;
+	atomic_long_t next;		/* first index of the next chunk */
+	bool stop;
+};
+
+struct shm_populate_work {
+	struct work_struct work;
+	struct shm_populate_ctl *ctl;
+};
+
+/* Fault chunks in until there are none left or someone stops. */
+static void shm_populate_chunks(struct shm_populate_ctl *ctl)
+{
+	pgoff_t index, end;
+
+	while (!READ_ONCE(ctl->stop)) {
+		index = atomic_long_fetch_add(SHM_POPULATE_CHUNK, &ctl->next);
+		if (index >= ctl->nr_pages)
+			break;
+		end = min(index + SHM_POPULATE_CHUNK, ctl->nr_pages);
+
+		while (index < end) {
+			struct folio *folio;
+
+			/* only ever true in the caller, not in the workers */
+			if (fatal_signal_pending(current)) {
+				WRITE_ONCE(ctl->stop, true);
+				break;
+			}
+
+			folio = shmem_read_folio(ctl->mapping, index);
+			if (IS_ERR(folio)) {
+				WRITE_ONCE(ctl->stop, true);
+				break;
+			}
+			index = folio_next_index(folio);
+			folio_put(folio);
+			cond_resched();
+		}
+	}
+}
+
+static void shm_populate_fn(struct work_struct *work)
+{
+	struct shm_populate_ctl *ctl =
+		container_of(work, struct shm_populate_work, work)->ctl;
+	struct mem_cgroup *old_memcg = set_active_memcg(ctl->memcg);
+
+	shm_populate_chunks(ctl);
+	set_active_memcg(old_memcg);
+}
+
+static void shm_populate(struct ipc_namespace *ns, int shmid)
+{
+	struct shm_populate_ctl ctl;
+	struct shm_populate_work *works;
+	struct shmid_kernel *shp;
+	struct file *file;
+	unsigned int i, nr_works;
+
+	rcu_read_lock();
+	shp = shm_obtain_object_check(ns, shmid);
+	if (IS_ERR(shp)) {
+		rcu_read_unlock();
+		return;
+	}
+	ipc_lock_object(&shp->shm_perm);
+	if (!ipc_valid_object(&shp->shm_perm) ||
+	    is_file_hugepages(shp->shm_file)) {
+		ipc_unlock_object(&shp->shm_perm);
+		rcu_read_unlock();
+		return;
+	}
+	file = get_file(shp->shm_file);
+	ipc_unlock_object(&shp->shm_perm);
+	rcu_read_unlock();
+
+	ctl.mapping = file->f_mapping;
+	ctl.nr_pages = DIV_ROUND_UP(i_size_read(file_inode(file)), PAGE_SIZE);
+	atomic_long_set(&ctl.next, 0);
+	ctl.stop = false;
+
+	/* the caller takes a share itself, and does it alone if need be */
+	nr_works = min_t(unsigned long, num_online_cpus(),
+			 DIV_ROUND_UP(ctl.nr_pages, SHM_POPULATE_CHUNK)) - 1;
+	works = nr_works ? kcalloc(nr_works, sizeof(*works), GFP_KERNEL) : NULL;
+	if (!works)
+		nr_works = 0;
+
+	ctl.memcg = nr_works ? get_mem_cgroup_from_mm(current->mm) : NULL;
+	for (i = 0; i < nr_works; i++) {
+		INIT_WORK(&works[i].work, shm_populate_fn);
+		works[i].ctl = &ctl;
+		queue_work(system_unbound_wq, &works[i].work);
+	}
+
+	/*
+	 * Once the caller runs out of chunks or is killed, the workers
+	 * have at most the chunk they are on left to do.
+	 */
+	shm_populate_chunks(&ctl);
+	for (i = 0; i < nr_works; i++)
+		flush_work(&works[i].work);
+	mem_cgroup_put(ctl.memcg);
+	kfree(works);
+	fput(file);
+}
+
 long ksys_shmget(key_t key, size_t size, int shmflg)
 {
 	struct ipc_namespace *ns;
@@ -832,6 +965,7 @@ long ksys_shmget(key_t key, size_t size, int shmflg)
 		.more_checks = shm_more_checks,
 	};
 	struct ipc_params shm_params;
+	int id;
 
 	ns = current->nsproxy->ipc_ns;
 
@@ -839,7 +973,11 @@ long ksys_shmget(key_t key, size_t size, int shmflg)
 	shm_params.flg = shmflg;
 	shm_params.u.size = size;
 
-	return ipcget(ns, &shm_ids(ns), &shm_ops, &shm_params);
+	id = ipcget(ns, &shm_ids(ns), &shm_ops, &shm_params);
+	/* outside shm_ids.rwsem, populating a large segment takes a while */
+	if (id >= 0 && (shmflg & SHM_POPULATE))
+		shm_populate(ns, id);
+	return id;
 }
 
 SYSCALL_DEFINE3(shmget, key_t, key, size_t, size, int, shmflg)
@@ -1527,6 +1665,7 @@ long do_shmat(int shmid, char __user *shmaddr, int shmflg,
 	int acc_mode;
 	struct ipc_namespace *ns;
 	struct shm_file_data *sfd;
+	bool thp;
 	int f_flags;
 	unsigned long populate = 0;
 
@@ -1610,6 +1749,7 @@ long do_shmat(int shmid, char __user *shmaddr, int shmflg,
 	 * detect shm ID reuse we need to compare the file pointers.
 	 */
 	base = get_file(shp->shm_file);
+	thp = shp->shm_thp;
 	shp->shm_nattch++;
 	size = i_size_read(file_inode(base));
 	ipc_unlock_object(&shp->shm_perm);
@@ -1637,6 +1777,7 @@ long do_shmat(int shmid, char __user *shmaddr, int shmflg,
 	sfd->ns = get_ipc_ns(ns);
 	sfd->file = base;
 	sfd->vm_ops = NULL;
+	sfd->thp = thp;
 	file->private_data = sfd;
 
 	err = security_mmap_file(file, prot, flags);
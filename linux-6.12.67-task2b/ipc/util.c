@@ -65,6 +65,7 @@
 #include <linux/ipc_namespace.h>
 #include <linux/rhashtable.h>
 #include <linux/log2.h>
+#include <linux/percpu.h>
 
 #include <asm/unistd.h>
 
@@ -103,8 +104,90 @@ static const struct rhashtable_params ipc_kht_params = {
 	.key_offset		= offsetof(struct kern_ipc_perm, key),
 	.key_len		= sizeof_field(struct kern_ipc_perm, key),
 	.automatic_shrinking	= true,
+	.numa_replicate		= true,
 };
 
+/*
+ * Per-CPU cache of recently looked up objects, so that the object of a
+ * hot id is found without walking the idr.  An entry is used only if the
+ * full id, sequence number included, matches.  Entries may be read
+ * inside any RCU read-side section: an object's entries are cleared when
+ * it is marked deleted, before it is freed, see ipc_id_cache_fill().
+ */
+#define IPC_ID_CACHE_SIZE	16
+
+struct ipc_id_cache {
+	struct kern_ipc_perm *ent[IPC_ID_CACHE_SIZE];
+};
+
+static inline struct kern_ipc_perm **
+ipc_id_cache_slot(struct ipc_id_cache *cache, int id)
+{
+	return &cache->ent[ipcid_to_idx(id) % IPC_ID_CACHE_SIZE];
+}
+
+static struct kern_ipc_perm *ipc_id_cache_find(struct ipc_ids *ids, int id)
+{
+	struct kern_ipc_perm *ipcp;
+
+	if (!ids->id_cache)
+		return NULL;
+
+	ipcp = READ_ONCE(*ipc_id_cache_slot(raw_cpu_ptr(ids->id_cache), id));
+	if (ipcp && ipcp->id == id && !READ_ONCE(ipcp->deleted))
+		return ipcp;
+	return NULL;
+}
+
+static void ipc_id_cache_fill(struct ipc_ids *ids, struct kern_ipc_perm *ipcp)
+{
+	struct kern_ipc_perm **slot;
+
+	if (!ids->id_cache)
+		return;
+
+	slot = ipc_id_cache_slot(raw_cpu_ptr(ids->id_cache), ipcp->id);
+	WRITE_ONCE(*slot, ipcp);
+
+	/*
+	 * Pairs with the barrier in ipc_id_cache_evict(): either the
+	 * eviction sees the new entry, or we see the object deleted and
+	 * drop the entry again ourselves.
+	 */
+	smp_mb();
+	if (READ_ONCE(ipcp->deleted))
+		cmpxchg(slot, ipcp, NULL);
+}
+
+/* Called after ipcp->deleted is set, before the object can be freed. */
+static void ipc_id_cache_evict(struct ipc_ids *ids, struct kern_ipc_perm *ipcp)
+{
+	int cpu;
+
+	if (!ids->id_cache)
+		return;
+
+	smp_mb();
+	for_each_possible_cpu(cpu)
+		cmpxchg(ipc_id_cache_slot(per_cpu_ptr(ids->id_cache, cpu),
+					  ipcp->id), ipcp, NULL);
+}
+
+#ifdef CONFIG_SYSVIPC_STATS
+/* account a sleep that started at @start, see ipc_stat_now() */
+void ipc_stat_sleep(struct kern_ipc_perm *perm, u64 start)
+{
+	struct ipc_stats *st = &perm->stats;
+	s64 ns = ktime_get_ns() - start;
+	s64 max = atomic64_read(&st->max_sleep_ns);
+
+	atomic64_inc(&st->sleeps);
+	atomic64_add(ns, &st->sleep_ns);
+	while (ns > max && !atomic64_try_cmpxchg(&st->max_sleep_ns, &max, ns))
+		;
+}
+#endif
+
 /**
  * ipc_init_ids	- initialise ipc identifiers
  * @ids: ipc identifier set
@@ -124,6 +207,8 @@ void ipc_init_ids(struct ipc_ids *ids)
 #ifdef CONFIG_CHECKPOINT_RESTORE
 	ids->next_id = -1;
 #endif
+	/* the cache is only an optimization, lookups work without it */
+	ids->id_cache = alloc_percpu(struct ipc_id_cache);
 }
 
 #ifdef CONFIG_PROC_FS
@@ -301,6 +386,9 @@ int ipc_addid(struct ipc_ids *ids, struct kern_ipc_perm *new, int limit)
 	new->gid = new->cgid = egid;
 
 	new->deleted = false;
+#ifdef CONFIG_SYSVIPC_STATS
+	memset(&new->stats, 0, sizeof(new->stats));
+#endif
 
 	idx = ipc_idr_alloc(ids, new);
 	idr_preload_end();
@@ -310,6 +398,9 @@ int ipc_addid(struct ipc_ids *ids, struct kern_ipc_perm *new, int limit)
 					     ipc_kht_params);
 		if (err < 0) {
 			idr_remove(&ids->ipcs_idr, idx);
+			/* a concurrent lookup may have cached it */
+			new->deleted = true;
+			ipc_id_cache_evict(ids, new);
 			idx = err;
 		}
 	}
@@ -502,6 +593,7 @@ void ipc_rmid(struct ipc_ids *ids, struct kern_ipc_perm *ipcp)
 	ipc_kht_remove(ids, ipcp);
 	ids->in_use--;
 	ipcp->deleted = true;
+	ipc_id_cache_evict(ids, ipcp);
 
 	if (unlikely(idx == ids->max_idx)) {
 		idx = ids->max_idx-1;
@@ -642,20 +734,25 @@ struct kern_ipc_perm *ipc_obtain_object_idr(struct ipc_ids *ids, int id)
  * @id: ipc id to look for
  *
  * Similar to ipc_obtain_object_idr() but also checks the ipc object
- * sequence number.
+ * sequence number.  Recently used ids are found in a per-CPU cache first.
  *
  * Call inside the RCU critical section.
  * The ipc object is *not* locked on exit.
  */
 struct kern_ipc_perm *ipc_obtain_object_check(struct ipc_ids *ids, int id)
 {
-	struct kern_ipc_perm *out = ipc_obtain_object_idr(ids, id);
+	struct kern_ipc_perm *out = ipc_id_cache_find(ids, id);
 
+	if (out)
+		return out;
+
+	out = ipc_obtain_object_idr(ids, id);
 	if (IS_ERR(out))
 		goto out;
 
 	if (ipc_checkid(out, id))
 		return ERR_PTR(-EINVAL);
+	ipc_id_cache_fill(ids, out);
 out:
 	return out;
 }
@@ -782,6 +879,21 @@ struct pid_namespace *ipc_seq_pid_ns(struct seq_file *s)
 	return iter->pid_ns;
 }
 
+void ipc_stats_show(struct seq_file *s, struct kern_ipc_perm *perm)
+{
+#ifdef CONFIG_SYSVIPC_STATS
+	struct ipc_stats *st = &perm->stats;
+	u64 sleeps = atomic64_read(&st->sleeps);
+
+	seq_printf(s, " %10llu %10llu %10llu %13llu %13llu",
+		   atomic64_read(&st->ops), atomic64_read(&st->contended),
+		   sleeps,
+		   sleeps ? div64_u64(atomic64_read(&st->sleep_ns), sleeps) : 0,
+		   atomic64_read(&st->max_sleep_ns));
+#endif
+	seq_putc(s, '\n');
+}
+
 /**
  * sysvipc_find_ipc - Find and lock the ipc structure based on seq pos
  * @ids: ipc identifier set
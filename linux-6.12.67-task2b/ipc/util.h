@@ -15,6 +15,7 @@
 #include <linux/err.h>
 #include <linux/ipc_namespace.h>
 #include <linux/pid.h>
+#include <linux/timekeeping.h>
 
 /*
  * The IPC ID contains 2 separate numbers - index and sequence number.
@@ -199,15 +200,56 @@ extern void free_msg(struct msg_msg *msg);
 extern struct msg_msg *load_msg(const void __user *src, size_t len);
 extern struct msg_msg *copy_msg(struct msg_msg *src, struct msg_msg *dst);
 extern int store_msg(void __user *dest, struct msg_msg *msg, size_t len);
+extern struct msg_msg *pin_msg(const void __user *src, size_t len);
+extern void unpin_msg(struct msg_msg *msg, bool delivered);
 
 static inline int ipc_checkid(struct kern_ipc_perm *ipcp, int id)
 {
 	return ipcid_to_seqx(id) != ipcp->seq;
 }
 
+#ifdef CONFIG_SYSVIPC_STATS
+static inline void ipc_stat_op(struct kern_ipc_perm *perm)
+{
+	atomic64_inc(&perm->stats.ops);
+}
+
+static inline void ipc_stat_lock(struct kern_ipc_perm *perm, spinlock_t *lock)
+{
+	if (!spin_trylock(lock)) {
+		atomic64_inc(&perm->stats.contended);
+		spin_lock(lock);
+	}
+}
+
+/* start of a sleep, for ipc_stat_sleep() */
+static inline u64 ipc_stat_now(void)
+{
+	return ktime_get_ns();
+}
+
+void ipc_stat_sleep(struct kern_ipc_perm *perm, u64 start);
+#define IPC_STATS_HEADER \
+	"        ops  contended     sleeps  avg_sleep_ns  max_sleep_ns"
+#else
+static inline void ipc_stat_op(struct kern_ipc_perm *perm) { }
+
+static inline void ipc_stat_lock(struct kern_ipc_perm *perm, spinlock_t *lock)
+{
+	spin_lock(lock);
+}
+
+static inline u64 ipc_stat_now(void) { return 0; }
+static inline void ipc_stat_sleep(struct kern_ipc_perm *perm, u64 start) { }
+#define IPC_STATS_HEADER ""
+#endif
+
+/* ends a line of /proc/sysvipc/{sem,msg} */
+void ipc_stats_show(struct seq_file *s, struct kern_ipc_perm *perm);
+
 static inline void ipc_lock_object(struct kern_ipc_perm *perm)
 {
-	spin_lock(&perm->lock);
+	ipc_stat_lock(perm, &perm->lock);
 }
 
 static inline void ipc_unlock_object(struct kern_ipc_perm *perm)
@@ -34,12 +34,26 @@
  * bpf program can allocate a page via bpf_arena_alloc_pages() kfunc
  * which will insert it into kernel vm_area.
  * The later fault-in from user space will populate that page into user vma.
+ *
+ * With BPF_F_ARENA_HUGE every allocation that covers a whole naturally aligned
+ * chunk (PMD sized where the page allocator allows it) of user address space
+ * is backed by one physically contiguous chunk, and a user fault populates
+ * the whole chunk around the faulting address if none of it is allocated yet.
+ * The chunk is still mapped and freed with page granularity.
+ *
+ * Pages are placed on the node passed to bpf_arena_alloc_pages(), or else on
+ * the map's numa_node, or spread chunk by chunk over all memory nodes with
+ * BPF_F_ARENA_INTERLEAVE.
  */
 
 /* number of bytes addressable by LDX/STX insn with 16-bit 'off' field */
 #define GUARD_SZ round_up(1ull << sizeof_field(struct bpf_insn, off) * 8, PAGE_SIZE << 1)
 #define KERN_VM_SZ (SZ_4G + GUARD_SZ)
 
+#define ARENA_CHUNK_ORDER min(PMD_SHIFT - PAGE_SHIFT, MAX_PAGE_ORDER)
+#define ARENA_CHUNK_PAGES (1L << ARENA_CHUNK_ORDER)
+#define ARENA_CHUNK_SIZE (ARENA_CHUNK_PAGES << PAGE_SHIFT)
+
 struct bpf_arena {
 	struct bpf_map map;
 	u64 user_vm_start;
@@ -48,6 +62,8 @@ struct bpf_arena {
 	struct maple_tree mt;
 	struct list_head vma_list;
 	struct mutex lock;
+	int numa_node;
+	int next_node; /* last node used by BPF_F_ARENA_INTERLEAVE */
 };
 
 u64 bpf_arena_get_kern_vm_start(struct bpf_arena *arena)
@@ -90,6 +106,67 @@ static long compute_pgoff(struct bpf_arena *arena, long uaddr)
 	return (u32)(uaddr - (u32)arena->user_vm_start) >> PAGE_SHIFT;
 }
 
+/* offset of @pgoff within its chunk of user address space */
+static long arena_chunk_off(struct bpf_arena *arena, long pgoff)
+{
+	return (((u32)arena->user_vm_start >> PAGE_SHIFT) + pgoff) &
+	       (ARENA_CHUNK_PAGES - 1);
+}
+
+/* Called with arena->lock held */
+static int arena_page_node(struct bpf_arena *arena, int node_id)
+{
+	if (node_id != NUMA_NO_NODE)
+		return node_id;
+	if (arena->map.map_flags & BPF_F_ARENA_INTERLEAVE) {
+		arena->next_node = next_node_in(arena->next_node,
+						node_states[N_MEMORY]);
+		return arena->next_node;
+	}
+	return arena->numa_node;
+}
+
+static int arena_alloc_chunk(struct bpf_arena *arena, int nid, struct page **pages)
+{
+	return bpf_map_alloc_pages_order(&arena->map,
+					 GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN |
+					 __GFP_NORETRY, nid, ARENA_CHUNK_ORDER, pages);
+}
+
+/*
+ * Allocate zeroed pages for @page_cnt pages starting at @pgoff, one chunk at a
+ * time so that each chunk lands on one node. Chunks that are covered entirely
+ * are allocated contiguously with BPF_F_ARENA_HUGE, if memory permits.
+ */
+static int arena_alloc_backing(struct bpf_arena *arena, long pgoff, long page_cnt,
+			       int node_id, struct page **pages)
+{
+	bool huge = arena->map.map_flags & BPF_F_ARENA_HUGE;
+	long i = 0, n;
+	int nid;
+
+	while (i < page_cnt) {
+		n = min(page_cnt - i, ARENA_CHUNK_PAGES - arena_chunk_off(arena, pgoff + i));
+		nid = arena_page_node(arena, node_id);
+
+		if (huge && n == ARENA_CHUNK_PAGES &&
+		    !arena_alloc_chunk(arena, nid, pages + i)) {
+			i += n;
+			continue;
+		}
+
+		if (bpf_map_alloc_pages(&arena->map, GFP_KERNEL | __GFP_ZERO,
+					nid, n, pages + i))
+			goto err;
+		i += n;
+	}
+	return 0;
+err:
+	while (i--)
+		__free_page(pages[i]);
+	return -ENOMEM;
+}
+
 static struct bpf_map *arena_map_alloc(union bpf_attr *attr)
 {
 	struct vm_struct *kern_vm;
@@ -102,7 +179,12 @@ static struct bpf_map *arena_map_alloc(union bpf_attr *attr)
 	    /* BPF_F_MMAPABLE must be set */
 	    !(attr->map_flags & BPF_F_MMAPABLE) ||
 	    /* No unsupported flags present */
-	    (attr->map_flags & ~(BPF_F_SEGV_ON_FAULT | BPF_F_MMAPABLE | BPF_F_NO_USER_CONV)))
+	    (attr->map_flags & ~(BPF_F_SEGV_ON_FAULT | BPF_F_MMAPABLE | BPF_F_NO_USER_CONV |
+				 BPF_F_NUMA_NODE | BPF_F_ARENA_HUGE |
+				 BPF_F_ARENA_INTERLEAVE)))
+		return ERR_PTR(-EINVAL);
+
+	if ((attr->map_flags & BPF_F_ARENA_INTERLEAVE) && numa_node != NUMA_NO_NODE)
 		return ERR_PTR(-EINVAL);
 
 	if (attr->map_extra & ~PAGE_MASK)
@@ -134,6 +216,8 @@ static struct bpf_map *arena_map_alloc(union bpf_attr *attr)
 	bpf_map_init_from_attr(&arena->map, attr);
 	mt_init_flags(&arena->mt, MT_FLAGS_ALLOC_RANGE);
 	mutex_init(&arena->lock);
+	arena->numa_node = numa_node;
+	arena->next_node = NUMA_NO_NODE;
 
 	return &arena->map;
 err:
@@ -253,6 +337,49 @@ static void arena_vm_close(struct vm_area_struct *vma)
 
 #define MT_ENTRY ((void *)&arena_map_ops) /* unused. has to be valid pointer */
 
+/*
+ * Populate the whole chunk around @pgoff if none of it is allocated yet and
+ * return the page at @pgoff, or NULL to fall back to a single page.
+ */
+static struct page *arena_fault_chunk(struct bpf_arena *arena, long pgoff)
+{
+	u64 kern_vm_start = bpf_arena_get_kern_vm_start(arena);
+	long start = pgoff - arena_chunk_off(arena, pgoff);
+	struct page **pages, *page = NULL;
+	u32 uaddr32;
+	long i;
+
+	if (start < 0 || (start + ARENA_CHUNK_PAGES) << PAGE_SHIFT >
+			 arena->user_vm_end - arena->user_vm_start)
+		return NULL;
+
+	pages = kvcalloc(ARENA_CHUNK_PAGES, sizeof(struct page *), GFP_KERNEL);
+	if (!pages)
+		return NULL;
+
+	if (mtree_insert_range(&arena->mt, start, start + ARENA_CHUNK_PAGES - 1,
+			       MT_ENTRY, GFP_KERNEL))
+		goto out;
+
+	if (arena_alloc_chunk(arena, arena_page_node(arena, NUMA_NO_NODE), pages))
+		goto out_erase;
+
+	uaddr32 = (u32)(arena->user_vm_start + start * PAGE_SIZE);
+	if (vm_area_map_pages(arena->kern_vm, kern_vm_start + uaddr32,
+			      kern_vm_start + uaddr32 + ARENA_CHUNK_SIZE, pages)) {
+		for (i = 0; i < ARENA_CHUNK_PAGES; i++)
+			__free_page(pages[i]);
+		goto out_erase;
+	}
+	page = pages[pgoff - start];
+	goto out;
+out_erase:
+	mtree_erase(&arena->mt, start);
+out:
+	kvfree(pages);
+	return page;
+}
+
 static vm_fault_t arena_vm_fault(struct vm_fault *vmf)
 {
 	struct bpf_map *map = vmf->vma->vm_file->private_data;
@@ -274,12 +401,19 @@ static vm_fault_t arena_vm_fault(struct vm_fault *vmf)
 		/* User space requested to segfault when page is not allocated by bpf prog */
 		return VM_FAULT_SIGSEGV;
 
+	if (arena->map.map_flags & BPF_F_ARENA_HUGE) {
+		page = arena_fault_chunk(arena, vmf->pgoff);
+		if (page)
+			goto out;
+	}
+
 	ret = mtree_insert(&arena->mt, vmf->pgoff, MT_ENTRY, GFP_KERNEL);
 	if (ret)
 		return VM_FAULT_SIGSEGV;
 
 	/* Account into memcg of the process that created bpf_arena */
-	ret = bpf_map_alloc_pages(map, GFP_KERNEL | __GFP_ZERO, NUMA_NO_NODE, 1, &page);
+	ret = bpf_map_alloc_pages(map, GFP_KERNEL | __GFP_ZERO,
+				  arena_page_node(arena, NUMA_NO_NODE), 1, &page);
 	if (ret) {
 		mtree_erase(&arena->mt, vmf->pgoff);
 		return VM_FAULT_SIGSEGV;
@@ -329,6 +463,20 @@ static unsigned long arena_get_unmapped_area(struct file *filp, unsigned long ad
 	ret = mm_get_unmapped_area(current->mm, filp, addr, len * 2, 0, flags);
 	if (IS_ERR_VALUE(ret))
 		return ret;
+	if (flags & MAP_FIXED) {
+		/* the address is the caller's, it can't be moved */
+		if ((ret >> 32) != ((ret + len - 1) >> 32))
+			return -EINVAL;
+		return ret;
+	}
+	if ((arena->map.map_flags & BPF_F_ARENA_HUGE) && !arena->user_vm_start &&
+	    len >= ARENA_CHUNK_SIZE) {
+		/* align chunks of user address space with the backing chunks */
+		u64 aligned = round_up(ret, ARENA_CHUNK_SIZE);
+
+		if ((aligned >> 32) == ((aligned + len - 1) >> 32))
+			return aligned;
+	}
 	if ((ret >> 32) == ((ret + len - 1) >> 32))
 		return ret;
 	if (WARN_ON_ONCE(arena->user_vm_start))
@@ -453,8 +601,7 @@ static long arena_alloc_pages(struct bpf_arena *arena, long uaddr, long page_cnt
 	if (ret)
 		goto out_free_pages;
 
-	ret = bpf_map_alloc_pages(&arena->map, GFP_KERNEL | __GFP_ZERO,
-				  node_id, page_cnt, pages);
+	ret = arena_alloc_backing(arena, pgoff, page_cnt, node_id, pages);
 	if (ret)
 		goto out;
 
@@ -5,6 +5,7 @@
 #include <linux/bpf.h>
 #include <linux/btf.h>
 #include <linux/err.h>
+#include <linux/hash.h>
 #include <linux/jhash.h>
 #include <linux/random.h>
 #include <linux/btf_ids.h>
@@ -12,25 +13,88 @@
 #define BLOOM_CREATE_FLAG_MASK \
 	(BPF_F_NUMA_NODE | BPF_F_ZERO_SEED | BPF_F_ACCESS_MASK)
 
+/* map_extra bits */
+#define BLOOM_EXTRA_NR_HASH_MASK	0xF
+#define BLOOM_EXTRA_BLOCKED		0x10
+
+/*
+ * In the blocked layout all bits of a value fall into one 512 bit block,
+ * i.e. one cache line, which is picked by a single jhash of the value. The
+ * positions within the block are derived from the same hash.
+ */
+#define BLOOM_BLOCK_SHIFT	9
+#define BLOOM_BLOCK_BITS	(1U << BLOOM_BLOCK_SHIFT)
+#define BLOOM_BLOCK_LONGS	(BLOOM_BLOCK_BITS / BITS_PER_LONG)
+
 struct bpf_bloom_filter {
 	struct bpf_map map;
 	u32 bitset_mask;
 	u32 hash_seed;
 	u32 nr_hash_funcs;
-	unsigned long bitset[];
+	bool blocked;
+	unsigned long bitset[] __aligned(BLOOM_BLOCK_BITS / 8);
 };
 
+static u32 __hash(struct bpf_bloom_filter *bloom, void *value,
+		  u32 value_size, u32 index)
+{
+	if (likely(value_size % 4 == 0))
+		return jhash2(value, value_size / 4, bloom->hash_seed + index);
+	return jhash(value, value_size, bloom->hash_seed + index);
+}
+
 static u32 hash(struct bpf_bloom_filter *bloom, void *value,
 		u32 value_size, u32 index)
 {
-	u32 h;
+	return __hash(bloom, value, value_size, index) & bloom->bitset_mask;
+}
 
-	if (likely(value_size % 4 == 0))
-		h = jhash2(value, value_size / 4, bloom->hash_seed + index);
-	else
-		h = jhash(value, value_size, bloom->hash_seed + index);
+/*
+ * Returns the block @value maps to and fills @mask with its bits in there.
+ * The bit positions are picked by double hashing with two 9 bit values
+ * taken from the top of a 64 bit multiplicative hash of the jhash.
+ */
+static unsigned long *bloom_block(struct bpf_bloom_filter *bloom, void *value,
+				  unsigned long *mask)
+{
+	u32 h = __hash(bloom, value, bloom->map.value_size, 0);
+	u64 x = (u64)h * GOLDEN_RATIO_64;
+	u32 h1 = x >> (64 - BLOOM_BLOCK_SHIFT);
+	u32 h2 = (x >> (64 - 2 * BLOOM_BLOCK_SHIFT)) | 1;
+	u32 i, pos;
+
+	memset(mask, 0, BLOOM_BLOCK_LONGS * sizeof(*mask));
+	for (i = 0; i < bloom->nr_hash_funcs; i++) {
+		pos = (h1 + i * h2) & (BLOOM_BLOCK_BITS - 1);
+		__set_bit(pos, mask);
+	}
 
-	return h & bloom->bitset_mask;
+	h >>= BLOOM_BLOCK_SHIFT;
+	return &bloom->bitset[(h & (bloom->bitset_mask >> BLOOM_BLOCK_SHIFT)) *
+			      BLOOM_BLOCK_LONGS];
+}
+
+static long bloom_block_peek(struct bpf_bloom_filter *bloom, void *value)
+{
+	unsigned long mask[BLOOM_BLOCK_LONGS], missing = 0;
+	unsigned long *block = bloom_block(bloom, value, mask);
+	u32 i;
+
+	/* the block is a single cache line, test it all in one go */
+	for (i = 0; i < BLOOM_BLOCK_LONGS; i++)
+		missing |= mask[i] & ~READ_ONCE(block[i]);
+
+	return missing ? -ENOENT : 0;
+}
+
+static void bloom_block_push(struct bpf_bloom_filter *bloom, void *value)
+{
+	unsigned long mask[BLOOM_BLOCK_LONGS];
+	unsigned long *block = bloom_block(bloom, value, mask);
+	u32 i;
+
+	for_each_set_bit(i, mask, BLOOM_BLOCK_BITS)
+		set_bit(i, block);
 }
 
 static long bloom_map_peek_elem(struct bpf_map *map, void *value)
@@ -39,6 +103,9 @@ static long bloom_map_peek_elem(struct bpf_map *map, void *value)
 		container_of(map, struct bpf_bloom_filter, map);
 	u32 i, h;
 
+	if (bloom->blocked)
+		return bloom_block_peek(bloom, value);
+
 	for (i = 0; i < bloom->nr_hash_funcs; i++) {
 		h = hash(bloom, value, map->value_size, i);
 		if (!test_bit(h, bloom->bitset))
@@ -57,6 +124,11 @@ static long bloom_map_push_elem(struct bpf_map *map, void *value, u64 flags)
 	if (flags != BPF_ANY)
 		return -EINVAL;
 
+	if (bloom->blocked) {
+		bloom_block_push(bloom, value);
+		return 0;
+	}
+
 	for (i = 0; i < bloom->nr_hash_funcs; i++) {
 		h = hash(bloom, value, map->value_size, i);
 		set_bit(h, bloom->bitset);
@@ -103,12 +175,13 @@ static struct bpf_map *bloom_map_alloc(union bpf_attr *attr)
 	    attr->map_flags & ~BLOOM_CREATE_FLAG_MASK ||
 	    !bpf_map_flags_access_ok(attr->map_flags) ||
 	    /* The lower 4 bits of map_extra (0xF) specify the number
-	     * of hash functions
+	     * of hash functions, the next one selects the blocked layout
 	     */
-	    (attr->map_extra & ~0xF))
+	    (attr->map_extra & ~(BLOOM_EXTRA_NR_HASH_MASK |
+				 BLOOM_EXTRA_BLOCKED)))
 		return ERR_PTR(-EINVAL);
 
-	nr_hash_funcs = attr->map_extra;
+	nr_hash_funcs = attr->map_extra & BLOOM_EXTRA_NR_HASH_MASK;
 	if (nr_hash_funcs == 0)
 		/* Default to using 5 hash functions if unspecified */
 		nr_hash_funcs = 5;
@@ -134,6 +207,8 @@ static struct bpf_map *bloom_map_alloc(union bpf_attr *attr)
 		bitset_bytes = BITS_TO_BYTES(U32_MAX);
 		bitset_mask = U32_MAX;
 	} else {
+		if (attr->map_extra & BLOOM_EXTRA_BLOCKED)
+			nr_bits = max(nr_bits, BLOOM_BLOCK_BITS);
 		if (nr_bits <= BITS_PER_LONG)
 			nr_bits = BITS_PER_LONG;
 		else
@@ -152,6 +227,7 @@ static struct bpf_map *bloom_map_alloc(union bpf_attr *attr)
 
 	bloom->nr_hash_funcs = nr_hash_funcs;
 	bloom->bitset_mask = bitset_mask;
+	bloom->blocked = attr->map_extra & BLOOM_EXTRA_BLOCKED;
 
 	if (!(attr->map_flags & BPF_F_ZERO_SEED))
 		bloom->hash_seed = get_random_u32();
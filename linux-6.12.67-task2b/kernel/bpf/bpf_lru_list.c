@@ -13,6 +13,8 @@
 #define PERCPU_FREE_TARGET		(4)
 #define PERCPU_NR_SCANS			PERCPU_FREE_TARGET
 
+#define CLOCK_NR_SCANS			(256)
+
 /* Helpers to get the local list index */
 #define LOCAL_LIST_IDX(t)	((t) - BPF_LOCAL_LIST_T_OFFSET)
 #define LOCAL_FREE_LIST_IDX	LOCAL_LIST_IDX(BPF_LRU_LOCAL_LIST_T_FREE)
@@ -496,10 +498,118 @@ static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 	return node;
 }
 
+static struct bpf_lru_node *bpf_clock_lru_node(struct bpf_clock_lru *clru,
+					       u32 idx)
+{
+	return clru->buf + (size_t)idx * clru->elem_size;
+}
+
+/* Take @node away from the htab. Only one CPU can hold it as EVICTING. */
+static bool bpf_clock_lru_evict(struct bpf_lru *lru, struct bpf_lru_node *node)
+{
+	u8 state = BPF_CLOCK_LRU_USED;
+
+	if (!try_cmpxchg(&node->type, &state, BPF_CLOCK_LRU_EVICTING))
+		return false;
+
+	if (lru->del_from_htab(lru->del_arg, node))
+		return true;
+
+	/* Not (or not yet) linked in the htab, or its bucket is busy. If it
+	 * was pushed free meanwhile, bpf_clock_lru_push_free() left it to us.
+	 */
+	state = BPF_CLOCK_LRU_EVICTING;
+	return !try_cmpxchg(&node->type, &state, BPF_CLOCK_LRU_USED);
+}
+
+/* Advance the hand by up to CLOCK_NR_SCANS nodes looking for a victim */
+static struct bpf_lru_node *bpf_clock_lru_sweep(struct bpf_lru *lru,
+						bool use_ref)
+{
+	struct bpf_clock_lru *clru = &lru->clock_lru;
+	struct bpf_lru_node *node;
+	unsigned int i;
+	u32 idx;
+
+	for (i = 0; i < lru->nr_scans; i++) {
+		idx = (u32)atomic_inc_return(&clru->hand) % clru->nr_elems;
+		node = bpf_clock_lru_node(clru, idx);
+
+		if (READ_ONCE(node->type) != BPF_CLOCK_LRU_USED)
+			continue;
+
+		/* second chance */
+		if (use_ref && READ_ONCE(node->ref)) {
+			bpf_lru_node_clear_ref(node);
+			continue;
+		}
+
+		if (bpf_clock_lru_evict(lru, node))
+			return node;
+	}
+
+	return NULL;
+}
+
+static struct bpf_lru_node *bpf_clock_lru_pop_free(struct bpf_lru *lru,
+						   u32 hash)
+{
+	struct pcpu_freelist_node *f;
+	struct bpf_lru_node *node;
+
+	f = pcpu_freelist_pop(&lru->clock_lru.free);
+	if (f) {
+		node = container_of(f, struct bpf_lru_node, fnode);
+	} else {
+		node = bpf_clock_lru_sweep(lru, true);
+		/* everything was referenced lately, evict regardless */
+		if (!node)
+			node = bpf_clock_lru_sweep(lru, false);
+		if (!node)
+			return NULL;
+	}
+
+	*(u32 *)((void *)node + lru->hash_offset) = hash;
+	bpf_lru_node_clear_ref(node);
+	WRITE_ONCE(node->type, BPF_CLOCK_LRU_USED);
+
+	return node;
+}
+
+static void bpf_clock_lru_push_free(struct bpf_lru *lru,
+				    struct bpf_lru_node *node)
+{
+	u8 state = READ_ONCE(node->type);
+
+	/* The clock hand moves a node only between USED and EVICTING */
+	for (;;) {
+		switch (state) {
+		case BPF_CLOCK_LRU_USED:
+			if (!try_cmpxchg(&node->type, &state,
+					 BPF_CLOCK_LRU_FREE))
+				continue;
+			bpf_lru_node_clear_ref(node);
+			pcpu_freelist_push(&lru->clock_lru.free, &node->fnode);
+			return;
+		case BPF_CLOCK_LRU_EVICTING:
+			/* the evicting CPU will reuse it */
+			if (!try_cmpxchg(&node->type, &state,
+					 BPF_CLOCK_LRU_FREED))
+				continue;
+			return;
+		default:
+			WARN_ON_ONCE(1);
+			return;
+		}
+	}
+}
+
 struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru, u32 hash)
 {
 	if (lru->percpu)
 		return bpf_percpu_lru_pop_free(lru, hash);
+	else if (lru->clock)
+		return bpf_clock_lru_pop_free(lru, hash);
 	else
 		return bpf_common_lru_pop_free(lru, hash);
 }
@@ -557,6 +667,8 @@ void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node)
 {
 	if (lru->percpu)
 		bpf_percpu_lru_push_free(lru, node);
+	else if (lru->clock)
+		bpf_clock_lru_push_free(lru, node);
 	else
 		bpf_common_lru_push_free(lru, node);
 }
@@ -582,6 +694,27 @@ static void bpf_common_lru_populate(struct bpf_lru *lru, void *buf,
 				 1, LOCAL_FREE_TARGET);
 }
 
+static void bpf_clock_lru_populate(struct bpf_lru *lru, void *buf,
+				   u32 node_offset, u32 elem_size,
+				   u32 nr_elems)
+{
+	struct bpf_clock_lru *clru = &lru->clock_lru;
+	struct bpf_lru_node *node;
+	u32 i;
+
+	clru->buf = buf + node_offset;
+	clru->elem_size = elem_size;
+	clru->nr_elems = nr_elems;
+
+	for (i = 0; i < nr_elems; i++) {
+		node = bpf_clock_lru_node(clru, i);
+		node->type = BPF_CLOCK_LRU_FREE;
+		bpf_lru_node_clear_ref(node);
+	}
+
+	pcpu_freelist_populate(&clru->free, clru->buf, elem_size, nr_elems);
+}
+
 static void bpf_percpu_lru_populate(struct bpf_lru *lru, void *buf,
 				    u32 node_offset, u32 elem_size,
 				    u32 nr_elems)
@@ -619,6 +752,9 @@ void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 	if (lru->percpu)
 		bpf_percpu_lru_populate(lru, buf, node_offset, elem_size,
 					nr_elems);
+	else if (lru->clock)
+		bpf_clock_lru_populate(lru, buf, node_offset, elem_size,
+				       nr_elems);
 	else
 		bpf_common_lru_populate(lru, buf, node_offset, elem_size,
 					nr_elems);
@@ -651,10 +787,10 @@ static void bpf_lru_list_init(struct bpf_lru_list *l)
 	raw_spin_lock_init(&l->lock);
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool clock, u32 hash_offset,
 		 del_from_htab_func del_from_htab, void *del_arg)
 {
-	int cpu;
+	int cpu, err;
 
 	if (percpu) {
 		lru->percpu_lru = alloc_percpu(struct bpf_lru_list);
@@ -668,6 +804,13 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 			bpf_lru_list_init(l);
 		}
 		lru->nr_scans = PERCPU_NR_SCANS;
+	} else if (clock) {
+		err = pcpu_freelist_init(&lru->clock_lru.free);
+		if (err)
+			return err;
+
+		atomic_set(&lru->clock_lru.hand, 0);
+		lru->nr_scans = CLOCK_NR_SCANS;
 	} else {
 		struct bpf_common_lru *clru = &lru->common_lru;
 
@@ -687,6 +830,7 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 	}
 
 	lru->percpu = percpu;
+	lru->clock = clock;
 	lru->del_from_htab = del_from_htab;
 	lru->del_arg = del_arg;
 	lru->hash_offset = hash_offset;
@@ -698,6 +842,8 @@ void bpf_lru_destroy(struct bpf_lru *lru)
 {
 	if (lru->percpu)
 		free_percpu(lru->percpu_lru);
+	else if (lru->clock)
+		pcpu_freelist_destroy(&lru->clock_lru.free);
 	else
 		free_percpu(lru->common_lru.local_list);
 }
@@ -8,6 +8,8 @@
 #include <linux/list.h>
 #include <linux/spinlock_types.h>
 
+#include "percpu_freelist.h"
+
 #define NR_BPF_LRU_LIST_T	(3)
 #define NR_BPF_LRU_LIST_COUNT	(2)
 #define NR_BPF_LRU_LOCAL_LIST_T (2)
@@ -21,8 +23,19 @@ enum bpf_lru_list_type {
 	BPF_LRU_LOCAL_LIST_T_PENDING,
 };
 
+/* Node states of a CLOCK LRU, kept in bpf_lru_node->type */
+enum bpf_clock_lru_state {
+	BPF_CLOCK_LRU_FREE,	/* on the free list */
+	BPF_CLOCK_LRU_USED,	/* handed out to the htab */
+	BPF_CLOCK_LRU_EVICTING,	/* claimed by the clock hand */
+	BPF_CLOCK_LRU_FREED,	/* pushed free while claimed */
+};
+
 struct bpf_lru_node {
-	struct list_head list;
+	union {
+		struct list_head list;
+		struct pcpu_freelist_node fnode;	/* CLOCK LRU */
+	};
 	u16 cpu;
 	u8 type;
 	u8 ref;
@@ -48,12 +61,22 @@ struct bpf_common_lru {
 	struct bpf_lru_locallist __percpu *local_list;
 };
 
+/* The nodes are swept in array order; no lock is taken on eviction */
+struct bpf_clock_lru {
+	struct pcpu_freelist free;
+	void *buf;
+	u32 elem_size;
+	u32 nr_elems;
+	atomic_t hand ____cacheline_aligned_in_smp;
+};
+
 typedef bool (*del_from_htab_func)(void *arg, struct bpf_lru_node *node);
 
 struct bpf_lru {
 	union {
 		struct bpf_common_lru common_lru;
 		struct bpf_lru_list __percpu *percpu_lru;
+		struct bpf_clock_lru clock_lru;
 	};
 	del_from_htab_func del_from_htab;
 	void *del_arg;
@@ -61,6 +84,7 @@ struct bpf_lru {
 	unsigned int target_free;
 	unsigned int nr_scans;
 	bool percpu;
+	bool clock;
 };
 
 static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
@@ -69,7 +93,7 @@ static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
 		WRITE_ONCE(node->ref, 1);
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool clock, u32 hash_offset,
 		 del_from_htab_func del_from_htab, void *delete_arg);
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems);
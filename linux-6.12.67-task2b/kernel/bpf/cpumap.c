@@ -44,6 +44,14 @@
  */
 
 #define CPU_MAP_BULK_SIZE 8  /* 8 == one cacheline on 64-bit archs */
+
+/* The kthread dequeues between CPUMAP_BATCH and CPUMAP_BATCH_MAX frames at
+ * a time, doubling the batch while the ring stays backlogged and halving it
+ * when it drains.
+ */
+#define CPUMAP_BATCH 8
+#define CPUMAP_BATCH_MAX 64
+
 struct bpf_cpu_map_entry;
 struct bpf_cpu_map;
 
@@ -71,6 +79,11 @@ struct bpf_cpu_map_entry {
 
 	struct completion kthread_running;
 	struct rcu_work free_work;
+
+	/* Only used by the kthread */
+	unsigned int batch;
+	void *frames[CPUMAP_BATCH_MAX];
+	void *skbs[CPUMAP_BATCH_MAX];
 };
 
 struct bpf_cpu_map {
@@ -232,8 +245,6 @@ static int cpu_map_bpf_prog_run_xdp(struct bpf_cpu_map_entry *rcpu,
 	return nframes;
 }
 
-#define CPUMAP_BATCH 8
-
 static int cpu_map_bpf_prog_run(struct bpf_cpu_map_entry *rcpu, void **frames,
 				int xdp_n, struct xdp_cpumap_stats *stats,
 				struct list_head *list)
@@ -261,6 +272,14 @@ static int cpu_map_bpf_prog_run(struct bpf_cpu_map_entry *rcpu, void **frames,
 	return nframes;
 }
 
+static void cpu_map_adapt_batch(struct bpf_cpu_map_entry *rcpu, int n)
+{
+	if (n == rcpu->batch && !__ptr_ring_empty(rcpu->queue))
+		rcpu->batch = min(rcpu->batch * 2, CPUMAP_BATCH_MAX);
+	else if (n < rcpu->batch / 2)
+		rcpu->batch = max(rcpu->batch / 2, CPUMAP_BATCH);
+}
+
 static int cpu_map_kthread_run(void *data)
 {
 	struct bpf_cpu_map_entry *rcpu = data;
@@ -278,9 +297,8 @@ static int cpu_map_kthread_run(void *data)
 		struct xdp_cpumap_stats stats = {}; /* zero stats */
 		unsigned int kmem_alloc_drops = 0, sched = 0;
 		gfp_t gfp = __GFP_ZERO | GFP_ATOMIC;
+		void **frames = rcpu->frames, **skbs = rcpu->skbs;
 		int i, n, m, nframes, xdp_n;
-		void *frames[CPUMAP_BATCH];
-		void *skbs[CPUMAP_BATCH];
 		LIST_HEAD(list);
 
 		/* Release CPU reschedule checks */
@@ -305,7 +323,8 @@ static int cpu_map_kthread_run(void *data)
 		 * consume side valid as no-resize allowed of queue.
 		 */
 		n = __ptr_ring_consume_batched(rcpu->queue, frames,
-					       CPUMAP_BATCH);
+					       rcpu->batch);
+		cpu_map_adapt_batch(rcpu, n);
 		for (i = 0, xdp_n = 0; i < n; i++) {
 			void *f = frames[i];
 			struct page *page;
@@ -430,6 +449,7 @@ __cpu_map_entry_alloc(struct bpf_map *map, struct bpf_cpumap_val *value,
 	rcpu->cpu    = cpu;
 	rcpu->map_id = map->id;
 	rcpu->value.qsize  = value->qsize;
+	rcpu->batch  = CPUMAP_BATCH;
 
 	if (fd > 0 && __cpu_map_load_bpf_program(rcpu, map, fd))
 		goto free_ptr_ring;
@@ -20,8 +20,17 @@
  * unsigned int trampoline(const void *ctx, const struct bpf_insn *insnsi,
  *                         unsigned int (*bpf_func)(const void *,
  *                                                  const struct bpf_insn *));
+ *
+ * The image is regenerated from a worker shortly after the set of programs
+ * changes, so that a burst of attaches costs one update and one grace
+ * period instead of one each. An image that lags behind is still correct:
+ * a program it doesn't know yet takes the indirect call, and a direct call
+ * only goes to the very address the caller passed in.
  */
 
+/* Regenerate the image this long after the last change */
+#define BPF_DISPATCHER_UPDATE_DELAY	msecs_to_jiffies(10)
+
 static struct bpf_dispatcher_prog *bpf_dispatcher_find_prog(
 	struct bpf_dispatcher *d, struct bpf_prog *prog)
 {
@@ -103,6 +112,7 @@ static int bpf_dispatcher_prepare(struct bpf_dispatcher *d, void *image, void *b
 	return arch_prepare_bpf_dispatcher(image, buf, &ips[0], d->num_progs);
 }
 
+/* Called with d->mutex held, the caller waits for a grace period after */
 static void bpf_dispatcher_update(struct bpf_dispatcher *d, int prev_num_progs)
 {
 	void *new, *tmp;
@@ -125,20 +135,33 @@ static void bpf_dispatcher_update(struct bpf_dispatcher *d, int prev_num_progs)
 
 	__BPF_DISPATCHER_UPDATE(d, new ?: (void *)&bpf_dispatcher_nop_func);
 
+	if (new)
+		d->image_off = noff;
+}
+
+void bpf_dispatcher_update_workfn(struct work_struct *work)
+{
+	struct bpf_dispatcher *d = container_of(to_delayed_work(work),
+						struct bpf_dispatcher,
+						update_work);
+
+	mutex_lock(&d->mutex);
+	bpf_dispatcher_update(d, d->image_num_progs);
+	d->image_num_progs = d->num_progs;
+	mutex_unlock(&d->mutex);
+
 	/* Make sure all the callers executing the previous/old half of the
 	 * image leave it, so following update call can modify it safely.
+	 * That call comes from this work again, which doesn't run
+	 * concurrently with itself.
 	 */
 	synchronize_rcu();
-
-	if (new)
-		d->image_off = noff;
 }
 
 void bpf_dispatcher_change_prog(struct bpf_dispatcher *d, struct bpf_prog *from,
 				struct bpf_prog *to)
 {
 	bool changed = false;
-	int prev_num_progs;
 
 	if (from == to)
 		return;
@@ -158,14 +181,12 @@ void bpf_dispatcher_change_prog(struct bpf_dispatcher *d, struct bpf_prog *from,
 		bpf_image_ksym_add(&d->ksym);
 	}
 
-	prev_num_progs = d->num_progs;
 	changed |= bpf_dispatcher_remove_prog(d, from);
 	changed |= bpf_dispatcher_add_prog(d, to);
 
-	if (!changed)
-		goto out;
-
-	bpf_dispatcher_update(d, prev_num_progs);
+	if (changed)
+		queue_delayed_work(system_wq, &d->update_work,
+				   BPF_DISPATCHER_UPDATE_DELAY);
 out:
 	mutex_unlock(&d->mutex);
 }
@@ -12,6 +12,8 @@
 #include <uapi/linux/btf.h>
 #include <linux/rcupdate_trace.h>
 #include <linux/btf_ids.h>
+#include <linux/irq_work.h>
+#include <linux/bitrev.h>
 #include "percpu_freelist.h"
 #include "bpf_lru_list.h"
 #include "map_in_map.h"
@@ -19,7 +21,8 @@
 
 #define HTAB_CREATE_FLAG_MASK						\
 	(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU | BPF_F_NUMA_NODE |	\
-	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED)
+	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED | BPF_F_RESIZABLE |	\
+	 BPF_F_LRU_CLOCK)
 
 #define BATCH_OPS(_name)			\
 	.map_lookup_batch =			\
@@ -84,11 +87,44 @@ struct bucket {
 #define HASHTAB_MAP_LOCK_COUNT 8
 #define HASHTAB_MAP_LOCK_MASK (HASHTAB_MAP_LOCK_COUNT - 1)
 
+/* a BPF_F_RESIZABLE map never has fewer buckets than this */
+#define HTAB_RESIZE_MIN_BUCKETS 16
+
+/*
+ * Nulls value left in a bucket whose elements have all been moved to the
+ * future table. The nulls value of a regular bucket is n_buckets | index,
+ * see htab_nulls(), which is never zero.
+ */
+#define HTAB_NULLS_MOVED 0
+
+/*
+ * The bucket array of a hash map.
+ *
+ * BPF_F_RESIZABLE maps start out small and replace their table from
+ * htab_resize_workfn() as they grow or shrink. The new table is published
+ * in @future first, then the elements are moved over one bucket at a time
+ * under the bucket locks. Lockless lookups that miss in a table with a
+ * future retry in the future; updates that find their bucket already moved
+ * take the lock of the future bucket instead. Once every bucket has been
+ * moved, the future becomes htab->table and the old table is freed after a
+ * grace period.
+ *
+ * The get_next_key and batch cursors of these maps are positions rather
+ * than bucket indices, see htab_pos(), so a resize between two calls does
+ * not make them skip or repeat elements. seq_file iterators instead hold
+ * off resizes for as long as they are open.
+ */
+struct htab_table {
+	u32 n_buckets;
+	struct htab_table *future;
+	struct bucket buckets[];
+};
+
 struct bpf_htab {
 	struct bpf_map map;
 	struct bpf_mem_alloc ma;
 	struct bpf_mem_alloc pcpu_ma;
-	struct bucket *buckets;
+	struct htab_table __rcu *table;
 	void *elems;
 	union {
 		struct pcpu_freelist freelist;
@@ -101,11 +137,14 @@ struct bpf_htab {
 	struct percpu_counter pcount;
 	atomic_t count;
 	bool use_percpu_counter;
-	u32 n_buckets;	/* number of hash buckets */
+	u32 max_buckets;	/* number of hash buckets at max_entries */
 	u32 elem_size;	/* size of each element in bytes */
 	u32 hashrnd;
 	struct lock_class_key lockdep_key;
 	int __percpu *map_locked[HASHTAB_MAP_LOCK_COUNT];
+	struct irq_work resize_irq_work;
+	struct work_struct resize_work;
+	atomic_t resize_blocked;	/* open seq_file iterators */
 };
 
 /* each htab element is struct htab_elem + key + value */
@@ -134,27 +173,70 @@ static inline bool htab_is_prealloc(const struct bpf_htab *htab)
 	return !(htab->map.map_flags & BPF_F_NO_PREALLOC);
 }
 
-static void htab_init_buckets(struct bpf_htab *htab)
+static inline bool htab_is_resizable(const struct bpf_htab *htab)
+{
+	return htab->map.map_flags & BPF_F_RESIZABLE;
+}
+
+static inline struct htab_table *htab_table(const struct bpf_htab *htab)
+{
+	return rcu_dereference_raw(htab->table);
+}
+
+static inline u32 htab_nulls(const struct htab_table *tbl, u32 hash)
+{
+	return tbl->n_buckets | (hash & (tbl->n_buckets - 1));
+}
+
+static void htab_init_table(struct bpf_htab *htab, struct htab_table *tbl)
 {
 	unsigned int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		INIT_HLIST_NULLS_HEAD(&htab->buckets[i].head, i);
-		raw_spin_lock_init(&htab->buckets[i].raw_lock);
-		lockdep_set_class(&htab->buckets[i].raw_lock,
+	for (i = 0; i < tbl->n_buckets; i++) {
+		INIT_HLIST_NULLS_HEAD(&tbl->buckets[i].head, htab_nulls(tbl, i));
+		raw_spin_lock_init(&tbl->buckets[i].raw_lock);
+		lockdep_set_class(&tbl->buckets[i].raw_lock,
 					  &htab->lockdep_key);
 		cond_resched();
 	}
 }
 
+static struct htab_table *htab_alloc_table(struct bpf_htab *htab,
+					   u32 n_buckets)
+{
+	size_t size = struct_size_t(struct htab_table, buckets, n_buckets);
+	struct htab_table *tbl;
+
+	/* the initial table is charged to the creator of the map */
+	if (!rcu_access_pointer(htab->table))
+		tbl = bpf_map_area_alloc(size, htab->map.numa_node);
+	else
+		tbl = bpf_map_kvcalloc(&htab->map, 1, size,
+				       GFP_USER | __GFP_NOWARN);
+	if (!tbl)
+		return NULL;
+
+	tbl->n_buckets = n_buckets;
+	tbl->future = NULL;
+	htab_init_table(htab, tbl);
+	return tbl;
+}
+
+/*
+ * The map_locked counter of a bucket is picked by its address rather than
+ * by hash, so that it stays the same whatever the size of its table.
+ */
+static inline u32 htab_lock_slot(const struct bucket *b)
+{
+	return ((unsigned long)b / sizeof(*b)) & HASHTAB_MAP_LOCK_MASK;
+}
+
 static inline int htab_lock_bucket(const struct bpf_htab *htab,
-				   struct bucket *b, u32 hash,
-				   unsigned long *pflags)
+				   struct bucket *b, unsigned long *pflags)
 {
+	u32 hash = htab_lock_slot(b);
 	unsigned long flags;
 
-	hash = hash & min_t(u32, HASHTAB_MAP_LOCK_MASK, htab->n_buckets - 1);
-
 	preempt_disable();
 	local_irq_save(flags);
 	if (unlikely(__this_cpu_inc_return(*(htab->map_locked[hash])) != 1)) {
@@ -171,16 +253,278 @@ static inline int htab_lock_bucket(const struct bpf_htab *htab,
 }
 
 static inline void htab_unlock_bucket(const struct bpf_htab *htab,
-				      struct bucket *b, u32 hash,
-				      unsigned long flags)
+				      struct bucket *b, unsigned long flags)
 {
-	hash = hash & min_t(u32, HASHTAB_MAP_LOCK_MASK, htab->n_buckets - 1);
+	u32 hash = htab_lock_slot(b);
+
 	raw_spin_unlock(&b->raw_lock);
 	__this_cpu_dec(*(htab->map_locked[hash]));
 	local_irq_restore(flags);
 	preempt_enable();
 }
 
+static inline struct bucket *__select_bucket(struct htab_table *tbl, u32 hash)
+{
+	return &tbl->buckets[hash & (tbl->n_buckets - 1)];
+}
+
+static inline struct hlist_nulls_head *select_bucket(struct htab_table *tbl, u32 hash)
+{
+	return &__select_bucket(tbl, hash)->head;
+}
+
+/*
+ * Bucket @i of a walk over all elements: the buckets of @tbl followed by
+ * those of its future, if it is being resized. NULL once past the end.
+ * Elements being moved concurrently may be seen twice, walks that must not
+ * see them twice go by position instead, see htab_lock_pos(). A walk has to
+ * pass the same @tbl for every index: once a resize completes the indices of
+ * the new table no longer line up with the old ones.
+ */
+static struct bucket *htab_iter_bucket(struct htab_table *tbl, u32 i)
+{
+	struct htab_table *future;
+
+	if (i < tbl->n_buckets)
+		return &tbl->buckets[i];
+
+	i -= tbl->n_buckets;
+	future = READ_ONCE(tbl->future);
+	if (!future || i >= future->n_buckets)
+		return NULL;
+	return &future->buckets[i];
+}
+
+static inline bool htab_bucket_moved(const struct bucket *b)
+{
+	struct hlist_nulls_node *first = READ_ONCE(b->head.first);
+
+	return is_a_nulls(first) && get_nulls_value(first) == HTAB_NULLS_MOVED;
+}
+
+/*
+ * Lock the bucket @hash belongs to, which is in the future table if its
+ * bucket in the current one has already been moved there.
+ */
+static int __htab_lock_hash(struct bpf_htab *htab, u32 hash,
+			    struct htab_table **ptbl, struct bucket **pb,
+			    unsigned long *pflags)
+{
+	struct htab_table *tbl = htab_table(htab);
+	struct bucket *b;
+	int ret;
+
+	for (;;) {
+		b = __select_bucket(tbl, hash);
+		ret = htab_lock_bucket(htab, b, pflags);
+		if (ret)
+			return ret;
+		if (likely(!htab_bucket_moved(b)))
+			break;
+		htab_unlock_bucket(htab, b, *pflags);
+		tbl = READ_ONCE(tbl->future);
+	}
+
+	*ptbl = tbl;
+	*pb = b;
+	return 0;
+}
+
+static int htab_lock_hash(struct bpf_htab *htab, u32 hash, struct bucket **pb,
+			  unsigned long *pflags)
+{
+	struct htab_table *tbl;
+
+	return __htab_lock_hash(htab, hash, &tbl, pb, pflags);
+}
+
+/*
+ * Position of @hash in [0, max_buckets): its low bits reversed. A bucket of
+ * a table of any size holds one aligned range of positions, and doubling
+ * the table splits each range in two halves, so a walk in position order
+ * visits every element exactly once however the table is resized under it.
+ */
+static inline u32 htab_pos(const struct bpf_htab *htab, u32 hash)
+{
+	u32 bits = ilog2(htab->max_buckets);
+
+	return bits ? bitrev32(hash) >> (32 - bits) : 0;
+}
+
+/*
+ * Lock the bucket holding position @pos, whichever table it is in, and
+ * return the first position past that bucket in @pnext.
+ */
+static int htab_lock_pos(struct bpf_htab *htab, u32 pos, struct bucket **pb,
+			 u32 *pnext, unsigned long *pflags)
+{
+	u32 bits = ilog2(htab->max_buckets), span;
+	u32 hash = bits ? bitrev32(pos << (32 - bits)) : 0;
+	struct htab_table *tbl;
+	int ret;
+
+	ret = __htab_lock_hash(htab, hash, &tbl, pb, pflags);
+	if (ret)
+		return ret;
+
+	span = htab->max_buckets / tbl->n_buckets;
+	*pnext = (pos & ~(span - 1)) + span;
+	return 0;
+}
+
+/*
+ * Whether @l comes before position @pos. After a shrink, the bucket holding
+ * a batch cursor may also hold elements the previous batches handed out.
+ */
+static inline bool htab_elem_before(const struct bpf_htab *htab,
+				    const struct htab_elem *l, u32 pos)
+{
+	return htab_is_resizable(htab) && htab_pos(htab, l->hash) < pos;
+}
+
+/* Order of a walk in position order: position, then hash, then key */
+static int htab_elem_cmp(const struct bpf_htab *htab,
+			 const struct htab_elem *l, u32 hash, const void *key)
+{
+	u32 lpos = htab_pos(htab, l->hash), pos = htab_pos(htab, hash);
+
+	if (lpos != pos)
+		return lpos < pos ? -1 : 1;
+	if (l->hash != hash)
+		return l->hash < hash ? -1 : 1;
+	return memcmp(l->key, key, htab->map.key_size);
+}
+
+static u32 htab_resize_target(const struct bpf_htab *htab, u32 n_buckets,
+			      u64 count)
+{
+	if (count > (u64)n_buckets * 3 / 4 && n_buckets < htab->max_buckets)
+		return n_buckets * 2;
+	if (count < (u64)n_buckets * 3 / 10 &&
+	    n_buckets > HTAB_RESIZE_MIN_BUCKETS)
+		return n_buckets / 2;
+	return 0;
+}
+
+/* Called after adding or removing an element, kicks off a resize if due */
+static void htab_resize_check(struct bpf_htab *htab)
+{
+	u32 n_buckets;
+	u64 count;
+
+	if (!htab_is_resizable(htab))
+		return;
+
+	if (htab->use_percpu_counter)
+		count = percpu_counter_read_positive(&htab->pcount);
+	else
+		count = atomic_read(&htab->count);
+
+	rcu_read_lock();
+	n_buckets = htab_table(htab)->n_buckets;
+	rcu_read_unlock();
+
+	/* may be called from NMI, so go through irq_work to the worker */
+	if (htab_resize_target(htab, n_buckets, count))
+		irq_work_queue(&htab->resize_irq_work);
+}
+
+/* Move all elements of bucket @i of @tbl to @tbl->future. */
+static void htab_rehash_bucket(struct bpf_htab *htab, struct htab_table *tbl,
+			       u32 i)
+{
+	struct htab_table *future = tbl->future;
+	struct bucket *b = &tbl->buckets[i], *nb;
+	struct hlist_nulls_node **pprev, *n;
+	struct htab_elem *l, *last;
+	unsigned long flags;
+	u32 slot;
+
+	/* only fails when nested in another locked section on this CPU */
+	while (htab_lock_bucket(htab, b, &flags))
+		cpu_relax();
+
+	while (!is_a_nulls(b->head.first)) {
+		last = NULL;
+		hlist_nulls_for_each_entry(l, n, &b->head, hash_node)
+			last = l;
+
+		nb = __select_bucket(future, last->hash);
+		slot = htab_lock_slot(nb);
+		__this_cpu_inc(*(htab->map_locked[slot]));
+		raw_spin_lock_nested(&nb->raw_lock, SINGLE_DEPTH_NESTING);
+
+		/*
+		 * Link the last element into the future bucket before cutting
+		 * it off here. A lookup walking this chain in the meantime
+		 * either finds it or runs into the future bucket's nulls
+		 * value and restarts, it can't miss it.
+		 */
+		pprev = last->hash_node.pprev;
+		hlist_nulls_add_head_rcu(&last->hash_node, &nb->head);
+		smp_store_release(pprev, (struct hlist_nulls_node *)
+				  NULLS_MARKER(htab_nulls(tbl, i)));
+
+		raw_spin_unlock(&nb->raw_lock);
+		__this_cpu_dec(*(htab->map_locked[slot]));
+	}
+
+	smp_store_release(&b->head.first, (struct hlist_nulls_node *)
+			  NULLS_MARKER(HTAB_NULLS_MOVED));
+	htab_unlock_bucket(htab, b, flags);
+}
+
+static void htab_resize_workfn(struct work_struct *work)
+{
+	struct bpf_htab *htab = container_of(work, struct bpf_htab, resize_work);
+	struct htab_table *tbl, *future;
+	u32 i, n_buckets;
+	u64 count;
+
+	for (;;) {
+		tbl = rcu_dereference_protected(htab->table, true);
+
+		/* picked up again by bpf_iter_fini_hash_map() */
+		if (atomic_read(&htab->resize_blocked))
+			break;
+
+		if (htab->use_percpu_counter)
+			count = percpu_counter_sum(&htab->pcount);
+		else
+			count = atomic_read(&htab->count);
+
+		n_buckets = htab_resize_target(htab, tbl->n_buckets, count);
+		if (!n_buckets)
+			break;
+
+		future = htab_alloc_table(htab, n_buckets);
+		if (!future)
+			break;
+
+		/* lookups missing in @tbl continue in @future from here on */
+		smp_store_release(&tbl->future, future);
+
+		for (i = 0; i < tbl->n_buckets; i++) {
+			htab_rehash_bucket(htab, tbl, i);
+			cond_resched();
+		}
+
+		rcu_assign_pointer(htab->table, future);
+
+		/* sleepable programs may still be walking @tbl, too */
+		synchronize_rcu_mult(call_rcu, call_rcu_tasks_trace);
+		bpf_map_area_free(tbl);
+	}
+}
+
+static void htab_resize_irq_work(struct irq_work *work)
+{
+	struct bpf_htab *htab = container_of(work, struct bpf_htab,
+					     resize_irq_work);
+
+	queue_work(system_unbound_wq, &htab->resize_work);
+}
+
 static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node);
 
 static bool htab_is_lru(const struct bpf_htab *htab)
@@ -351,6 +695,7 @@ skip_percpu_elems:
 	if (htab_is_lru(htab))
 		err = bpf_lru_init(&htab->lru,
 				   htab->map.map_flags & BPF_F_NO_COMMON_LRU,
+				   htab->map.map_flags & BPF_F_LRU_CLOCK,
 				   offsetof(struct htab_elem, hash) -
 				   offsetof(struct htab_elem, lru_node),
 				   htab_lru_map_delete_node,
@@ -425,6 +770,8 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
 	bool zero_seed = (attr->map_flags & BPF_F_ZERO_SEED);
+	bool resizable = (attr->map_flags & BPF_F_RESIZABLE);
+	bool clock_lru = (attr->map_flags & BPF_F_LRU_CLOCK);
 	int numa_node = bpf_map_attr_numa_node(attr);
 
 	BUILD_BUG_ON(offsetof(struct htab_elem, fnode.next) !=
@@ -441,9 +788,17 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	if (!lru && percpu_lru)
 		return -EINVAL;
 
+	/* the clock hand sweeps one common set of elements */
+	if (clock_lru && (!lru || percpu_lru))
+		return -EINVAL;
+
 	if (lru && !prealloc)
 		return -ENOTSUPP;
 
+	/* only elements allocated on demand can follow the table size */
+	if (resizable && (lru || prealloc))
+		return -EINVAL;
+
 	if (numa_node != NUMA_NO_NODE && (percpu || percpu_lru))
 		return -EINVAL;
 
@@ -482,7 +837,9 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	 */
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
+	struct htab_table *tbl;
 	struct bpf_htab *htab;
+	u32 n_buckets;
 	int err, i;
 
 	htab = bpf_map_area_alloc(sizeof(*htab), NUMA_NO_NODE);
@@ -512,7 +869,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	if (htab->map.max_entries > 1UL << 31)
 		goto free_htab;
 
-	htab->n_buckets = roundup_pow_of_two(htab->map.max_entries);
+	htab->max_buckets = roundup_pow_of_two(htab->map.max_entries);
 
 	htab->elem_size = sizeof(struct htab_elem) +
 			  round_up(htab->map.key_size, 8);
@@ -522,19 +879,24 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		htab->elem_size += round_up(htab->map.value_size, 8);
 
 	/* check for u32 overflow */
-	if (htab->n_buckets > U32_MAX / sizeof(struct bucket))
+	if (htab->max_buckets > U32_MAX / sizeof(struct bucket))
 		goto free_htab;
 
 	err = bpf_map_init_elem_count(&htab->map);
 	if (err)
 		goto free_htab;
 
+	n_buckets = htab->max_buckets;
+	if (htab_is_resizable(htab))
+		n_buckets = min_t(u32, n_buckets, HTAB_RESIZE_MIN_BUCKETS);
+
 	err = -ENOMEM;
-	htab->buckets = bpf_map_area_alloc(htab->n_buckets *
-					   sizeof(struct bucket),
-					   htab->map.numa_node);
-	if (!htab->buckets)
+	tbl = htab_alloc_table(htab, n_buckets);
+	if (!tbl)
 		goto free_elem_count;
+	RCU_INIT_POINTER(htab->table, tbl);
+	init_irq_work(&htab->resize_irq_work, htab_resize_irq_work);
+	INIT_WORK(&htab->resize_work, htab_resize_workfn);
 
 	for (i = 0; i < HASHTAB_MAP_LOCK_COUNT; i++) {
 		htab->map_locked[i] = bpf_map_alloc_percpu(&htab->map,
@@ -550,8 +912,6 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	else
 		htab->hashrnd = get_random_u32();
 
-	htab_init_buckets(htab);
-
 /* compute_batch_value() computes batch value as num_online_cpus() * 2
  * and __percpu_counter_compare() needs
  * htab->max_entries - cur_number_of_elems to be more than batch * num_online_cpus()
@@ -609,7 +969,7 @@ free_map_locked:
 		percpu_counter_destroy(&htab->pcount);
 	for (i = 0; i < HASHTAB_MAP_LOCK_COUNT; i++)
 		free_percpu(htab->map_locked[i]);
-	bpf_map_area_free(htab->buckets);
+	bpf_map_area_free(tbl);
 	bpf_mem_alloc_destroy(&htab->pcpu_ma);
 	bpf_mem_alloc_destroy(&htab->ma);
 free_elem_count:
@@ -627,16 +987,6 @@ static inline u32 htab_map_hash(const void *key, u32 key_len, u32 hashrnd)
 	return jhash(key, key_len, hashrnd);
 }
 
-static inline struct bucket *__select_bucket(struct bpf_htab *htab, u32 hash)
-{
-	return &htab->buckets[hash & (htab->n_buckets - 1)];
-}
-
-static inline struct hlist_nulls_head *select_bucket(struct bpf_htab *htab, u32 hash)
-{
-	return &__select_bucket(htab, hash)->head;
-}
-
 /* this lookup function can only be called with bucket lock taken */
 static struct htab_elem *lookup_elem_raw(struct hlist_nulls_head *head, u32 hash,
 					 void *key, u32 key_size)
@@ -653,23 +1003,43 @@ static struct htab_elem *lookup_elem_raw(struct hlist_nulls_head *head, u32 hash
 
 /* can be called without bucket lock. it will repeat the loop in
  * the unlikely event when elements moved from one bucket into another
- * while link list is being walked
+ * while link list is being walked. On success *ptbl is set to the table
+ * the element was found in.
  */
-static struct htab_elem *lookup_nulls_elem_raw(struct hlist_nulls_head *head,
+static struct htab_elem *lookup_nulls_elem_raw(const struct bpf_htab *htab,
+					       struct htab_table **ptbl,
 					       u32 hash, void *key,
-					       u32 key_size, u32 n_buckets)
+					       u32 key_size)
 {
+	struct htab_table *tbl = *ptbl;
+	struct hlist_nulls_head *head;
 	struct hlist_nulls_node *n;
+	unsigned long nulls;
 	struct htab_elem *l;
 
 again:
+	head = select_bucket(tbl, hash);
 	hlist_nulls_for_each_entry_rcu(l, n, head, hash_node)
-		if (l->hash == hash && !memcmp(&l->key, key, key_size))
+		if (l->hash == hash && !memcmp(&l->key, key, key_size)) {
+			*ptbl = tbl;
 			return l;
+		}
 
-	if (unlikely(get_nulls_value(n) != (hash & (n_buckets - 1))))
+	nulls = get_nulls_value(n);
+	if (unlikely(nulls != htab_nulls(tbl, hash) && nulls != HTAB_NULLS_MOVED))
 		goto again;
 
+	if (htab_is_resizable(htab)) {
+		/* An element being moved is linked into the future bucket
+		 * before it is unlinked from this one, so if it was missed
+		 * here, it is there.
+		 */
+		smp_rmb();
+		tbl = READ_ONCE(tbl->future);
+		if (tbl)
+			goto again;
+	}
+
 	return NULL;
 }
 
@@ -681,7 +1051,7 @@ again:
 static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
-	struct hlist_nulls_head *head;
+	struct htab_table *tbl = htab_table(htab);
 	struct htab_elem *l;
 	u32 hash, key_size;
 
@@ -692,9 +1062,7 @@ static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	head = select_bucket(htab, hash);
-
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
+	l = lookup_nulls_elem_raw(htab, &tbl, hash, key, key_size);
 
 	return l;
 }
@@ -814,12 +1182,11 @@ static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
 	int ret;
 
 	tgt_l = container_of(node, struct htab_elem, lru_node);
-	b = __select_bucket(htab, tgt_l->hash);
-	head = &b->head;
 
-	ret = htab_lock_bucket(htab, b, tgt_l->hash, &flags);
+	ret = htab_lock_hash(htab, tgt_l->hash, &b, &flags);
 	if (ret)
 		return false;
+	head = &b->head;
 
 	hlist_nulls_for_each_entry_rcu(l, n, head, hash_node)
 		if (l == tgt_l) {
@@ -829,22 +1196,73 @@ static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
 			break;
 		}
 
-	htab_unlock_bucket(htab, b, tgt_l->hash, flags);
+	htab_unlock_bucket(htab, b, flags);
 
 	return l == tgt_l;
 }
 
+/*
+ * Resizable maps hand out keys in position order, so that the key passed
+ * in still tells where to go on if the table was resized since, or if the
+ * key itself was deleted.
+ */
+static int htab_pos_get_next_key(struct bpf_htab *htab, void *key,
+				 void *next_key)
+{
+	u32 key_size = htab->map.key_size, hash = 0, pos = 0, next;
+	struct htab_elem *l, *next_l;
+	struct hlist_nulls_node *n;
+	unsigned long flags;
+	struct bucket *b;
+	int ret;
+
+	if (key) {
+		hash = htab_map_hash(key, key_size, htab->hashrnd);
+		pos = htab_pos(htab, hash);
+	}
+
+	for (; pos < htab->max_buckets; pos = next, key = NULL) {
+		ret = htab_lock_pos(htab, pos, &b, &next, &flags);
+		if (ret)
+			return ret;
+
+		/* pick the first element after @key, or at or after @pos */
+		next_l = NULL;
+		hlist_nulls_for_each_entry(l, n, &b->head, hash_node) {
+			if (key ? htab_elem_cmp(htab, l, hash, key) <= 0 :
+				  htab_pos(htab, l->hash) < pos)
+				continue;
+			if (!next_l ||
+			    htab_elem_cmp(htab, l, next_l->hash, next_l->key) < 0)
+				next_l = l;
+		}
+		if (next_l)
+			memcpy(next_key, next_l->key, key_size);
+		htab_unlock_bucket(htab, b, flags);
+
+		if (next_l)
+			return 0;
+	}
+
+	return -ENOENT;
+}
+
 /* Called from syscall */
 static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct htab_table *tbl = htab_table(htab), *found = tbl;
 	struct hlist_nulls_head *head;
 	struct htab_elem *l, *next_l;
 	u32 hash, key_size;
+	struct bucket *b;
 	int i = 0;
 
 	WARN_ON_ONCE(!rcu_read_lock_held());
 
+	if (htab_is_resizable(htab))
+		return htab_pos_get_next_key(htab, key, next_key);
+
 	key_size = map->key_size;
 
 	if (!key)
@@ -852,10 +1270,8 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	head = select_bucket(htab, hash);
-
 	/* lookup the key */
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
+	l = lookup_nulls_elem_raw(htab, &found, hash, key, key_size);
 
 	if (!l)
 		goto find_first_elem;
@@ -871,13 +1287,15 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 	}
 
 	/* no more elements in this hash list, go to the next bucket */
-	i = hash & (htab->n_buckets - 1);
+	i = hash & (found->n_buckets - 1);
+	if (found != tbl)
+		i += tbl->n_buckets;
 	i++;
 
 find_first_elem:
 	/* iterate over buckets */
-	for (; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
+	for (; (b = htab_iter_bucket(tbl, i)); i++) {
+		head = &b->head;
 
 		/* pick first element in the bucket */
 		next_l = hlist_nulls_entry_safe(rcu_dereference_raw(hlist_nulls_first_rcu(head)),
@@ -1129,15 +1547,13 @@ static long htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	if (unlikely(map_flags & BPF_F_LOCK)) {
+		struct htab_table *tbl = htab_table(htab);
+
 		if (unlikely(!btf_record_has_field(map->record, BPF_SPIN_LOCK)))
 			return -EINVAL;
 		/* find an element without taking the bucket lock */
-		l_old = lookup_nulls_elem_raw(head, hash, key, key_size,
-					      htab->n_buckets);
+		l_old = lookup_nulls_elem_raw(htab, &tbl, hash, key, key_size);
 		ret = check_flags(htab, l_old, map_flags);
 		if (ret)
 			return ret;
@@ -1154,9 +1570,10 @@ static long htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 		 */
 	}
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1205,16 +1622,18 @@ static long htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 			check_and_free_fields(htab, l_old);
 		}
 	}
-	htab_unlock_bucket(htab, b, hash, flags);
+	htab_unlock_bucket(htab, b, flags);
 	if (l_old) {
 		if (old_map_ptr)
 			map->ops->map_fd_put_ptr(map, old_map_ptr, true);
 		if (!htab_is_prealloc(htab))
 			free_htab_elem(htab, l_old);
+	} else {
+		htab_resize_check(htab);
 	}
 	return 0;
 err:
-	htab_unlock_bucket(htab, b, hash, flags);
+	htab_unlock_bucket(htab, b, flags);
 	return ret;
 }
 
@@ -1247,8 +1666,6 @@ static long htab_lru_map_update_elem(struct bpf_map *map, void *key, void *value
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
 
 	/* For LRU, we need to alloc before taking bucket's
 	 * spinlock because getting free nodes from LRU may need
@@ -1261,9 +1678,10 @@ static long htab_lru_map_update_elem(struct bpf_map *map, void *key, void *value
 	copy_map_value(&htab->map,
 		       l_new->key + round_up(map->key_size, 8), value);
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		goto err_lock_bucket;
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1282,7 +1700,7 @@ static long htab_lru_map_update_elem(struct bpf_map *map, void *key, void *value
 	ret = 0;
 
 err:
-	htab_unlock_bucket(htab, b, hash, flags);
+	htab_unlock_bucket(htab, b, flags);
 
 err_lock_bucket:
 	if (ret)
@@ -1316,12 +1734,11 @@ static long __htab_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1344,7 +1761,9 @@ static long __htab_percpu_map_update_elem(struct bpf_map *map, void *key,
 	}
 	ret = 0;
 err:
-	htab_unlock_bucket(htab, b, hash, flags);
+	htab_unlock_bucket(htab, b, flags);
+	if (l_new && !ret)
+		htab_resize_check(htab);
 	return ret;
 }
 
@@ -1371,8 +1790,6 @@ static long __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
 
 	/* For LRU, we need to alloc before taking bucket's
 	 * spinlock because LRU's elem alloc may need
@@ -1385,9 +1802,10 @@ static long __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 			return -ENOMEM;
 	}
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		goto err_lock_bucket;
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1409,7 +1827,7 @@ static long __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 	}
 	ret = 0;
 err:
-	htab_unlock_bucket(htab, b, hash, flags);
+	htab_unlock_bucket(htab, b, flags);
 err_lock_bucket:
 	if (l_new) {
 		bpf_map_dec_elem_count(&htab->map);
@@ -1448,12 +1866,11 @@ static long htab_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
-	head = &b->head;
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l = lookup_elem_raw(head, hash, key, key_size);
 	if (l)
@@ -1461,10 +1878,12 @@ static long htab_map_delete_elem(struct bpf_map *map, void *key)
 	else
 		ret = -ENOENT;
 
-	htab_unlock_bucket(htab, b, hash, flags);
+	htab_unlock_bucket(htab, b, flags);
 
-	if (l)
+	if (l) {
 		free_htab_elem(htab, l);
+		htab_resize_check(htab);
+	}
 	return ret;
 }
 
@@ -1484,12 +1903,11 @@ static long htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
-	head = &b->head;
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1498,7 +1916,7 @@ static long htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 	else
 		ret = -ENOENT;
 
-	htab_unlock_bucket(htab, b, hash, flags);
+	htab_unlock_bucket(htab, b, flags);
 	if (l)
 		htab_lru_push_free(htab, l);
 	return ret;
@@ -1506,14 +1924,15 @@ static long htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 
 static void delete_all_elements(struct bpf_htab *htab)
 {
+	struct htab_table *tbl = rcu_dereference_protected(htab->table, true);
 	int i;
 
 	/* It's called from a worker thread, so disable migration here,
 	 * since bpf_mem_cache_free() relies on that.
 	 */
 	migrate_disable();
-	for (i = 0; i < htab->n_buckets; i++) {
-		struct hlist_nulls_head *head = select_bucket(htab, i);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		struct hlist_nulls_head *head = select_bucket(tbl, i);
 		struct hlist_nulls_node *n;
 		struct htab_elem *l;
 
@@ -1528,11 +1947,14 @@ static void delete_all_elements(struct bpf_htab *htab)
 
 static void htab_free_malloced_timers_and_wq(struct bpf_htab *htab)
 {
+	struct htab_table *tbl;
+	struct bucket *b;
 	int i;
 
 	rcu_read_lock();
-	for (i = 0; i < htab->n_buckets; i++) {
-		struct hlist_nulls_head *head = select_bucket(htab, i);
+	tbl = htab_table(htab);
+	for (i = 0; (b = htab_iter_bucket(tbl, i)); i++) {
+		struct hlist_nulls_head *head = &b->head;
 		struct hlist_nulls_node *n;
 		struct htab_elem *l;
 
@@ -1574,6 +1996,10 @@ static void htab_map_free(struct bpf_map *map)
 	 * There is no need to synchronize_rcu() here to protect map elements.
 	 */
 
+	/* nothing can queue a resize any more, wait for one in flight */
+	irq_work_sync(&htab->resize_irq_work);
+	cancel_work_sync(&htab->resize_work);
+
 	/* htab no longer uses call_rcu() directly. bpf_mem_alloc does it
 	 * underneath and is responsible for waiting for callbacks to finish
 	 * during bpf_mem_alloc_destroy().
@@ -1587,7 +2013,7 @@ static void htab_map_free(struct bpf_map *map)
 
 	bpf_map_free_elem_count(map);
 	free_percpu(htab->extra_elems);
-	bpf_map_area_free(htab->buckets);
+	bpf_map_area_free(rcu_dereference_protected(htab->table, true));
 	bpf_mem_alloc_destroy(&htab->pcpu_ma);
 	bpf_mem_alloc_destroy(&htab->ma);
 	if (htab->use_percpu_counter)
@@ -1634,12 +2060,11 @@ static int __htab_map_lookup_and_delete_elem(struct bpf_map *map, void *key,
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
-	head = &b->head;
 
-	ret = htab_lock_bucket(htab, b, hash, &bflags);
+	ret = htab_lock_hash(htab, hash, &b, &bflags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l = lookup_elem_raw(head, hash, key, key_size);
 	if (!l) {
@@ -1675,10 +2100,12 @@ static int __htab_map_lookup_and_delete_elem(struct bpf_map *map, void *key,
 			free_htab_elem(htab, l);
 	}
 
-	htab_unlock_bucket(htab, b, hash, bflags);
+	htab_unlock_bucket(htab, b, bflags);
 
 	if (is_lru_map && l)
 		htab_lru_push_free(htab, l);
+	else if (l)
+		htab_resize_check(htab);
 
 	return ret;
 }
@@ -1713,6 +2140,21 @@ static int htab_lru_percpu_map_lookup_and_delete_elem(struct bpf_map *map,
 						 flags);
 }
 
+/* bytes of keys and values a batch operation stages between copies to user */
+#define HTAB_BATCH_STAGE_SIZE SZ_256K
+
+static int htab_batch_flush(void __user *ukeys, void __user *uvalues,
+			    void *keys, void *values, u32 key_size,
+			    u32 value_size, u32 total, u32 cnt)
+{
+	if (cnt && (copy_to_user(ukeys + total * key_size, keys,
+				 key_size * cnt) ||
+		    copy_to_user(uvalues + total * value_size, values,
+				 value_size * cnt)))
+		return -EFAULT;
+	return 0;
+}
+
 static int
 __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 				   const union bpf_attr *attr,
@@ -1726,8 +2168,11 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 	void __user *uvalues = u64_to_user_ptr(attr->batch.values);
 	void __user *ukeys = u64_to_user_ptr(attr->batch.keys);
 	void __user *ubatch = u64_to_user_ptr(attr->batch.in_batch);
-	u32 batch, max_count, size, bucket_size, map_id;
+	u32 batch, next, max_count, size, bucket_size, map_id;
+	bool resizable = htab_is_resizable(htab);
 	struct htab_elem *node_to_free = NULL;
+	struct htab_table *tbl;
+	u32 staged = 0;
 	u64 elem_map_flags, map_flags;
 	struct hlist_nulls_head *head;
 	struct hlist_nulls_node *n;
@@ -1757,9 +2202,6 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 	if (ubatch && copy_from_user(&batch, ubatch, sizeof(batch)))
 		return -EFAULT;
 
-	if (batch >= htab->n_buckets)
-		return -ENOENT;
-
 	key_size = htab->map.key_size;
 	roundup_key_size = round_up(htab->map.key_size, 8);
 	value_size = htab->map.value_size;
@@ -1769,8 +2211,12 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 	total = 0;
 	/* while experimenting with hash tables with sizes ranging from 10 to
 	 * 1000, it was observed that a bucket can have up to 5 entries.
+	 * Stage as many buckets as fit in HTAB_BATCH_STAGE_SIZE though, so a
+	 * large dump does not pay for an rcu section and two copy_to_user()
+	 * calls per bucket.
 	 */
-	bucket_size = 5;
+	bucket_size = max_t(u32, 5, HTAB_BATCH_STAGE_SIZE / (key_size + value_size));
+	bucket_size = min(bucket_size, max_count);
 
 alloc:
 	/* We cannot do copy_from_user or copy_to_user inside
@@ -1786,50 +2232,84 @@ alloc:
 again:
 	bpf_disable_instrumentation();
 	rcu_read_lock();
+	tbl = htab_table(htab);
 again_nocopy:
-	dst_key = keys;
-	dst_val = values;
-	b = &htab->buckets[batch];
+	dst_key = keys + staged * key_size;
+	dst_val = values + staged * value_size;
+	if (resizable) {
+		/* @batch is a position here, see htab_lock_pos() */
+		b = NULL;
+		if (batch < htab->max_buckets) {
+			ret = htab_lock_pos(htab, batch, &b, &next, &flags);
+			if (ret) {
+				rcu_read_unlock();
+				bpf_enable_instrumentation();
+				goto flush;
+			}
+			locked = true;
+		}
+	} else {
+		b = htab_iter_bucket(tbl, batch);
+		next = batch + 1;
+	}
+	if (!b) {
+		rcu_read_unlock();
+		bpf_enable_instrumentation();
+		ret = -ENOENT;
+		goto flush;
+	}
 	head = &b->head;
 	/* do not grab the lock unless need it (bucket_cnt > 0). */
-	if (locked) {
-		ret = htab_lock_bucket(htab, b, batch, &flags);
+	if (locked && !resizable) {
+		ret = htab_lock_bucket(htab, b, &flags);
 		if (ret) {
 			rcu_read_unlock();
 			bpf_enable_instrumentation();
-			goto after_loop;
+			goto flush;
 		}
 	}
 
 	bucket_cnt = 0;
 	hlist_nulls_for_each_entry_rcu(l, n, head, hash_node)
-		bucket_cnt++;
+		if (!htab_elem_before(htab, l, batch))
+			bucket_cnt++;
 
 	if (bucket_cnt && !locked) {
 		locked = true;
 		goto again_nocopy;
 	}
 
-	if (bucket_cnt > (max_count - total)) {
-		if (total == 0)
+	if (bucket_cnt > (max_count - total - staged)) {
+		if (total + staged == 0)
 			ret = -ENOSPC;
 		/* Note that since bucket_cnt > 0 here, it is implicit
 		 * that the locked was grabbed, so release it.
 		 */
-		htab_unlock_bucket(htab, b, batch, flags);
+		htab_unlock_bucket(htab, b, flags);
 		rcu_read_unlock();
 		bpf_enable_instrumentation();
-		goto after_loop;
+		goto flush;
 	}
 
-	if (bucket_cnt > bucket_size) {
-		bucket_size = bucket_cnt;
+	if (staged + bucket_cnt > bucket_size) {
 		/* Note that since bucket_cnt > 0 here, it is implicit
 		 * that the locked was grabbed, so release it.
 		 */
-		htab_unlock_bucket(htab, b, batch, flags);
+		htab_unlock_bucket(htab, b, flags);
+		locked = false;
 		rcu_read_unlock();
 		bpf_enable_instrumentation();
+		if (staged) {
+			/* hand out what is staged and retry this bucket */
+			ret = htab_batch_flush(ukeys, uvalues, keys, values,
+					       key_size, value_size, total, staged);
+			if (ret)
+				goto after_loop;
+			total += staged;
+			staged = 0;
+			goto again;
+		}
+		bucket_size = bucket_cnt;
 		kvfree(keys);
 		kvfree(values);
 		goto alloc;
@@ -1840,6 +2320,9 @@ again_nocopy:
 		goto next_batch;
 
 	hlist_nulls_for_each_entry_safe(l, n, head, hash_node) {
+		if (htab_elem_before(htab, l, batch))
+			continue;
+
 		memcpy(dst_key, l->key, key_size);
 
 		if (is_percpu) {
@@ -1890,8 +2373,9 @@ again_nocopy:
 		dst_val += value_size;
 	}
 
-	htab_unlock_bucket(htab, b, batch, flags);
+	htab_unlock_bucket(htab, b, flags);
 	locked = false;
+	staged += bucket_cnt;
 
 	while (node_to_free) {
 		l = node_to_free;
@@ -1903,33 +2387,29 @@ again_nocopy:
 	}
 
 next_batch:
-	/* If we are not copying data, we can go to next bucket and avoid
-	 * unlocking the rcu.
+	/* Keep going within the rcu section; the staged elements are copied
+	 * out once the buffer is full or the walk stops.
 	 */
-	if (!bucket_cnt && (batch + 1 < htab->n_buckets)) {
-		batch++;
+	batch = next;
+	if (resizable ? batch < htab->max_buckets :
+			htab_iter_bucket(tbl, batch) != NULL)
 		goto again_nocopy;
-	}
 
 	rcu_read_unlock();
 	bpf_enable_instrumentation();
-	if (bucket_cnt && (copy_to_user(ukeys + total * key_size, keys,
-	    key_size * bucket_cnt) ||
-	    copy_to_user(uvalues + total * value_size, values,
-	    value_size * bucket_cnt))) {
-		ret = -EFAULT;
-		goto after_loop;
-	}
-
-	total += bucket_cnt;
-	batch++;
-	if (batch >= htab->n_buckets) {
-		ret = -ENOENT;
-		goto after_loop;
-	}
 	goto again;
 
+flush:
+	if (htab_batch_flush(ukeys, uvalues, keys, values, key_size,
+			     value_size, total, staged))
+		ret = -EFAULT;
+	else
+		total += staged;
+
 after_loop:
+	if (do_delete && total)
+		htab_resize_check(htab);
+
 	if (ret == -EFAULT)
 		goto out;
 
@@ -2035,9 +2515,6 @@ bpf_hash_map_seq_find_next(struct bpf_iter_seq_hash_map_info *info,
 	struct bucket *b;
 	u32 i, count;
 
-	if (bucket_id >= htab->n_buckets)
-		return NULL;
-
 	/* try to find next elem in the same bucket */
 	if (prev_elem) {
 		/* no update/deletion on this bucket, prev_elem should be still valid
@@ -2049,14 +2526,18 @@ bpf_hash_map_seq_find_next(struct bpf_iter_seq_hash_map_info *info,
 			return elem;
 
 		/* not found, unlock and go to the next bucket */
-		b = &htab->buckets[bucket_id++];
+		bucket_id++;
 		rcu_read_unlock();
 		skip_elems = 0;
 	}
 
-	for (i = bucket_id; i < htab->n_buckets; i++) {
-		b = &htab->buckets[i];
+	for (i = bucket_id; ; i++) {
 		rcu_read_lock();
+		b = htab_iter_bucket(htab_table(htab), i);
+		if (!b) {
+			rcu_read_unlock();
+			break;
+		}
 
 		count = 0;
 		head = &b->head;
@@ -2174,12 +2655,25 @@ static int bpf_iter_init_hash_map(void *priv_data,
 	bpf_map_inc_with_uref(map);
 	seq_info->map = map;
 	seq_info->htab = container_of(map, struct bpf_htab, map);
+
+	/* bucket_id and skip_elems only hold while the table stays put */
+	if (htab_is_resizable(seq_info->htab)) {
+		atomic_inc(&seq_info->htab->resize_blocked);
+		irq_work_sync(&seq_info->htab->resize_irq_work);
+		flush_work(&seq_info->htab->resize_work);
+	}
 	return 0;
 }
 
 static void bpf_iter_fini_hash_map(void *priv_data)
 {
 	struct bpf_iter_seq_hash_map_info *seq_info = priv_data;
+	struct bpf_htab *htab = seq_info->htab;
+
+	/* catch up on the resizes held off while iterating */
+	if (htab_is_resizable(htab) &&
+	    atomic_dec_and_test(&htab->resize_blocked))
+		htab_resize_check(htab);
 
 	bpf_map_put_with_uref(seq_info->map);
 	kfree(seq_info->percpu_value_buf);
@@ -2206,6 +2700,7 @@ static long bpf_for_each_hash_elem(struct bpf_map *map, bpf_callback_t callback_
 	struct hlist_nulls_head *head;
 	struct hlist_nulls_node *n;
 	struct htab_elem *elem;
+	struct htab_table *tbl;
 	u32 roundup_key_size;
 	int i, num_elems = 0;
 	void __percpu *pptr;
@@ -2225,9 +2720,13 @@ static long bpf_for_each_hash_elem(struct bpf_map *map, bpf_callback_t callback_
 	 */
 	if (is_percpu)
 		migrate_disable();
-	for (i = 0; i < htab->n_buckets; i++) {
-		b = &htab->buckets[i];
-		rcu_read_lock();
+	/*
+	 * Walk the table seen at the start to the end, the caller's RCU read
+	 * section keeps it alive even if a resize completes meanwhile.
+	 */
+	rcu_read_lock();
+	tbl = htab_table(htab);
+	for (i = 0; (b = htab_iter_bucket(tbl, i)); i++) {
 		head = &b->head;
 		hlist_nulls_for_each_entry_safe(elem, n, head, hash_node) {
 			key = elem->key;
@@ -2242,14 +2741,12 @@ static long bpf_for_each_hash_elem(struct bpf_map *map, bpf_callback_t callback_
 			ret = callback_fn((u64)(long)map, (u64)(long)key,
 					  (u64)(long)val, (u64)(long)callback_ctx, 0);
 			/* return value: 0 - continue, 1 - stop and return */
-			if (ret) {
-				rcu_read_unlock();
+			if (ret)
 				goto out;
-			}
 		}
-		rcu_read_unlock();
 	}
 out:
+	rcu_read_unlock();
 	if (is_percpu)
 		migrate_enable();
 	return num_elems;
@@ -2265,7 +2762,10 @@ static u64 htab_map_mem_usage(const struct bpf_map *map)
 	u64 num_entries;
 	u64 usage = sizeof(struct bpf_htab);
 
-	usage += sizeof(struct bucket) * htab->n_buckets;
+	rcu_read_lock();
+	usage += struct_size_t(struct htab_table, buckets,
+			       htab_table(htab)->n_buckets);
+	rcu_read_unlock();
 	usage += sizeof(int) * num_possible_cpus() * HASHTAB_MAP_LOCK_COUNT;
 	if (prealloc) {
 		num_entries = map->max_entries;
@@ -2542,11 +3042,17 @@ static void fd_htab_map_free(struct bpf_map *map)
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
 	struct hlist_nulls_node *n;
 	struct hlist_nulls_head *head;
+	struct htab_table *tbl;
 	struct htab_elem *l;
 	int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
+	/* a resize in flight would move elements under our feet */
+	irq_work_sync(&htab->resize_irq_work);
+	cancel_work_sync(&htab->resize_work);
+
+	tbl = rcu_dereference_protected(htab->table, true);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		head = select_bucket(tbl, i);
 
 		hlist_nulls_for_each_entry_safe(l, n, head, hash_node) {
 			void *ptr = fd_htab_map_get_ptr(map, l);
@@ -12,6 +12,7 @@
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <net/ipv6.h>
 #include <uapi/linux/btf.h>
 #include <linux/btf_ids.h>
@@ -29,6 +30,42 @@ struct lpm_trie_node {
 	u8				data[];
 };
 
+/* A slot of an index node points to a child node if this bit is set */
+#define LPM_INDEX_CHILD		1UL
+#define LPM_INDEX_STRIDE	8
+#define LPM_INDEX_SLOTS		(1U << LPM_INDEX_STRIDE)
+
+/* The index is only built for keys up to IPv6 address size */
+#define LPM_INDEX_DATA_SIZE_MAX	16
+
+/* Index nodes are allocated outside of RCU, this many at a time */
+#define LPM_INDEX_POOL		32
+
+/* Trie nodes indexed per RCU read-side section of a build */
+#define LPM_INDEX_WALK_BATCH	256
+
+/* Rebuild the index this long after the last change to the trie */
+#define LPM_INDEX_DELAY		msecs_to_jiffies(10)
+
+struct lpm_index_node {
+	unsigned long			slot[LPM_INDEX_SLOTS];
+};
+
+struct lpm_index {
+	struct lpm_index_node		*root;
+	struct lpm_index		*next_stale;
+	u32				n_nodes;
+};
+
+/* State of an index build, see lpm_index_build() */
+struct lpm_index_builder {
+	struct lpm_index		*idx;
+	struct lpm_trie_node		**stack;
+	struct lpm_index_node		*pool[LPM_INDEX_POOL];
+	u32				n_pool;
+	u64				gen;
+};
+
 struct lpm_trie {
 	struct bpf_map			map;
 	struct lpm_trie_node __rcu	*root;
@@ -36,6 +73,12 @@ struct lpm_trie {
 	size_t				max_prefixlen;
 	size_t				data_size;
 	spinlock_t			lock;
+
+	/* BPF_F_LPM_MULTIBIT only */
+	struct lpm_index __rcu		*index;
+	struct lpm_index		*index_stale;
+	u64				index_gen;
+	struct delayed_work		index_work;
 };
 
 /* This trie implements a longest prefix match algorithm that can be used to
@@ -149,11 +192,280 @@ struct lpm_trie {
  * returned.
  */
 
+/* BPF_F_LPM_MULTIBIT maps also keep a read-only multibit index of the trie
+ * for lookups of full length keys, such as the addresses of packets.
+ *
+ * The index consumes 8 bits of the key per level, so a lookup is at most
+ * data_size array accesses, and typically four or less. Each prefix is
+ * expanded into all slots of the level it ends in, and slots covered by a
+ * more specific prefix get a child node whose slots all start out with the
+ * shorter one. A slot thus either points to the trie node of the longest
+ * matching prefix, or to the next level.
+ *
+ * Any change to the trie unpublishes the index and schedules a rebuild from
+ * a worker, and lookups take the regular path until the new index is in
+ * place. The worker only publishes its index if the trie did not change
+ * while it was being built. It builds the index in batches within short RCU
+ * read-side sections and allocates index nodes with GFP_KERNEL in between;
+ * a change to the trie during a break ends the build, as the change has
+ * scheduled a new one. A prefix of n bytes takes up to n - 1 index nodes,
+ * which are charged to the map like its trie nodes.
+ */
+
 static inline int extract_bit(const u8 *data, size_t index)
 {
 	return !!(data[index / 8] & (1 << (7 - (index % 8))));
 }
 
+static inline bool trie_has_index(const struct lpm_trie *trie)
+{
+	return trie->map.map_flags & BPF_F_LPM_MULTIBIT;
+}
+
+static struct lpm_trie_node *lpm_index_lookup(const struct lpm_index *idx,
+					      const u8 *data)
+{
+	const struct lpm_index_node *node = idx->root;
+	unsigned long slot;
+
+	for (;;) {
+		slot = node->slot[*data++];
+		if (!(slot & LPM_INDEX_CHILD))
+			return (struct lpm_trie_node *)slot;
+		node = (const struct lpm_index_node *)(slot & ~LPM_INDEX_CHILD);
+	}
+}
+
+/* Top up the node pool of @b, called outside of RCU */
+static int lpm_index_pool_fill(struct lpm_trie *trie,
+			       struct lpm_index_builder *b)
+{
+	struct lpm_index_node *node;
+
+	while (b->n_pool < LPM_INDEX_POOL) {
+		node = bpf_map_kmalloc_node(&trie->map, sizeof(*node),
+					    GFP_KERNEL | __GFP_NOWARN,
+					    trie->map.numa_node);
+		if (!node)
+			return -ENOMEM;
+		b->pool[b->n_pool++] = node;
+	}
+	return 0;
+}
+
+/* The pool holds enough nodes for any one prefix, see lpm_index_build() */
+static struct lpm_index_node *lpm_index_node_alloc(struct lpm_index_builder *b,
+						   unsigned long slot)
+{
+	struct lpm_index_node *node = b->pool[--b->n_pool];
+	unsigned int i;
+
+	for (i = 0; i < LPM_INDEX_SLOTS; i++)
+		node->slot[i] = slot;
+	return node;
+}
+
+static void lpm_index_free_node(struct lpm_index_node *node)
+{
+	unsigned int i;
+
+	for (i = 0; i < LPM_INDEX_SLOTS; i++) {
+		if (node->slot[i] & LPM_INDEX_CHILD)
+			lpm_index_free_node((void *)(node->slot[i] &
+						     ~LPM_INDEX_CHILD));
+	}
+	kfree(node);
+}
+
+static void lpm_index_free(struct lpm_index *idx)
+{
+	if (!idx)
+		return;
+	if (idx->root)
+		lpm_index_free_node(idx->root);
+	kfree(idx);
+}
+
+/* Point slots [@lo, @lo + @cnt) of @node, and their children, at @leaf
+ * unless they already have a longer prefix.
+ */
+static void lpm_index_fill(struct lpm_index_node *node, unsigned int lo,
+			   unsigned int cnt, struct lpm_trie_node *leaf)
+{
+	struct lpm_trie_node *old;
+	unsigned int i;
+
+	for (i = lo; i < lo + cnt; i++) {
+		if (node->slot[i] & LPM_INDEX_CHILD) {
+			lpm_index_fill((void *)(node->slot[i] & ~LPM_INDEX_CHILD),
+				       0, LPM_INDEX_SLOTS, leaf);
+			continue;
+		}
+
+		old = (struct lpm_trie_node *)node->slot[i];
+		if (!old || old->prefixlen <= leaf->prefixlen)
+			node->slot[i] = (unsigned long)leaf;
+	}
+}
+
+static void lpm_index_insert(struct lpm_index_builder *b,
+			     struct lpm_trie_node *leaf)
+{
+	struct lpm_index_node *node = b->idx->root, *child;
+	u32 level, bits, cnt;
+	unsigned long *slot;
+
+	for (level = 0; leaf->prefixlen > (level + 1) * LPM_INDEX_STRIDE;
+	     level++) {
+		slot = &node->slot[leaf->data[level]];
+		if (!(*slot & LPM_INDEX_CHILD)) {
+			child = lpm_index_node_alloc(b, *slot);
+			b->idx->n_nodes++;
+			*slot = (unsigned long)child | LPM_INDEX_CHILD;
+		}
+		node = (struct lpm_index_node *)(*slot & ~LPM_INDEX_CHILD);
+	}
+
+	bits = leaf->prefixlen - level * LPM_INDEX_STRIDE;
+	cnt = 1U << (LPM_INDEX_STRIDE - bits);
+	lpm_index_fill(node, leaf->data[level] & ~(cnt - 1), cnt, leaf);
+}
+
+/* Whether the trie is still the one the build of @b started on */
+static bool lpm_index_gen_valid(struct lpm_trie *trie,
+				const struct lpm_index_builder *b)
+{
+	unsigned long irq_flags;
+	bool valid;
+
+	spin_lock_irqsave(&trie->lock, irq_flags);
+	valid = trie->index_gen == b->gen;
+	spin_unlock_irqrestore(&trie->lock, irq_flags);
+	return valid;
+}
+
+/*
+ * Index the trie as of generation @b->gen, the caller frees @b->idx on
+ * failure. The stack of trie nodes still to visit stays valid across the
+ * breaks between RCU read-side sections as long as the generation did not
+ * move: nodes are only freed after a change bumped it.
+ */
+static int lpm_index_build(struct lpm_trie *trie, struct lpm_index_builder *b)
+{
+	struct lpm_trie_node *node, *child;
+	u32 visited = 0;
+	int err, sp = 0;
+
+	/* at most one pending sibling per level, plus the current node */
+	b->stack = kmalloc_array(trie->max_prefixlen + 2, sizeof(*b->stack),
+				 GFP_KERNEL | __GFP_NOWARN);
+	if (!b->stack)
+		return -ENOMEM;
+
+	b->idx = bpf_map_kzalloc(&trie->map, sizeof(*b->idx),
+				 GFP_KERNEL | __GFP_NOWARN);
+	if (!b->idx)
+		return -ENOMEM;
+
+	err = lpm_index_pool_fill(trie, b);
+	if (err)
+		return err;
+	b->idx->root = lpm_index_node_alloc(b, 0);
+
+	/* Walk the trie in preorder, so shorter prefixes go in first */
+	rcu_read_lock();
+	node = rcu_dereference(trie->root);
+	if (node)
+		b->stack[sp++] = node;
+	while (sp) {
+		/* one prefix takes at most a node per byte but the last */
+		if (b->n_pool < trie->data_size ||
+		    ++visited % LPM_INDEX_WALK_BATCH == 0) {
+			rcu_read_unlock();
+			err = lpm_index_pool_fill(trie, b);
+			cond_resched();
+			rcu_read_lock();
+			if (!err && !lpm_index_gen_valid(trie, b))
+				err = -EAGAIN;
+			if (err)
+				break;
+		}
+
+		node = b->stack[--sp];
+		if (!(node->flags & LPM_TREE_NODE_FLAG_IM))
+			lpm_index_insert(b, node);
+
+		child = rcu_dereference(node->child[1]);
+		if (child)
+			b->stack[sp++] = child;
+		child = rcu_dereference(node->child[0]);
+		if (child)
+			b->stack[sp++] = child;
+	}
+	rcu_read_unlock();
+	return err;
+}
+
+static void trie_index_workfn(struct work_struct *work)
+{
+	struct lpm_trie *trie = container_of(to_delayed_work(work),
+					     struct lpm_trie, index_work);
+	struct lpm_index_builder b = {};
+	struct lpm_index *stale, *next;
+	unsigned long irq_flags;
+	int err;
+
+	spin_lock_irqsave(&trie->lock, irq_flags);
+	stale = trie->index_stale;
+	trie->index_stale = NULL;
+	b.gen = trie->index_gen;
+	spin_unlock_irqrestore(&trie->lock, irq_flags);
+
+	err = lpm_index_build(trie, &b);
+	if (!err) {
+		spin_lock_irqsave(&trie->lock, irq_flags);
+		if (b.gen == trie->index_gen) {
+			rcu_assign_pointer(trie->index, b.idx);
+			b.idx = NULL;
+		}
+		spin_unlock_irqrestore(&trie->lock, irq_flags);
+	}
+	lpm_index_free(b.idx);
+	while (b.n_pool)
+		kfree(b.pool[--b.n_pool]);
+	kfree(b.stack);
+
+	if (!stale)
+		return;
+
+	synchronize_rcu();
+	for (; stale; stale = next) {
+		next = stale->next_stale;
+		lpm_index_free(stale);
+		cond_resched();
+	}
+}
+
+/* The trie changed, retire the index and schedule a new one. */
+static void trie_index_stale(struct lpm_trie *trie)
+{
+	struct lpm_index *idx;
+
+	if (!trie_has_index(trie))
+		return;
+
+	trie->index_gen++;
+	idx = rcu_dereference_protected(trie->index,
+					lockdep_is_held(&trie->lock));
+	if (idx) {
+		RCU_INIT_POINTER(trie->index, NULL);
+		idx->next_stale = trie->index_stale;
+		trie->index_stale = idx;
+	}
+	queue_delayed_work(system_unbound_wq, &trie->index_work,
+			   LPM_INDEX_DELAY);
+}
+
 /**
  * __longest_prefix_match() - determine the longest prefix
  * @trie:	The trie to get internal sizes from
@@ -242,6 +554,17 @@ static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 	if (key->prefixlen > trie->max_prefixlen)
 		return NULL;
 
+	if (key->prefixlen == trie->max_prefixlen && trie_has_index(trie)) {
+		struct lpm_index *idx;
+
+		idx = rcu_dereference_check(trie->index,
+					    rcu_read_lock_bh_held());
+		if (idx) {
+			found = lpm_index_lookup(idx, key->data);
+			goto out;
+		}
+	}
+
 	/* Start walking the trie from the root node ... */
 
 	for (node = rcu_dereference_check(trie->root, rcu_read_lock_bh_held());
@@ -281,6 +604,7 @@ static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 					     rcu_read_lock_bh_held());
 	}
 
+out:
 	if (!found)
 		return NULL;
 
@@ -450,6 +774,8 @@ static long trie_update_elem(struct bpf_map *map,
 out:
 	if (ret)
 		kfree(new_node);
+	else
+		trie_index_stale(trie);
 	spin_unlock_irqrestore(&trie->lock, irq_flags);
 	kfree_rcu(free_node, rcu);
 
@@ -548,6 +874,8 @@ static long trie_delete_elem(struct bpf_map *map, void *_key)
 	free_node = node;
 
 out:
+	if (!ret)
+		trie_index_stale(trie);
 	spin_unlock_irqrestore(&trie->lock, irq_flags);
 	kfree_rcu(free_parent, rcu);
 	kfree_rcu(free_node, rcu);
@@ -567,7 +895,7 @@ out:
 #define LPM_KEY_SIZE_MIN	LPM_KEY_SIZE(LPM_DATA_SIZE_MIN)
 
 #define LPM_CREATE_FLAG_MASK	(BPF_F_NO_PREALLOC | BPF_F_NUMA_NODE |	\
-				 BPF_F_ACCESS_MASK)
+				 BPF_F_ACCESS_MASK | BPF_F_LPM_MULTIBIT)
 
 static struct bpf_map *trie_alloc(union bpf_attr *attr)
 {
@@ -594,7 +922,14 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 			  offsetof(struct bpf_lpm_trie_key_u8, data);
 	trie->max_prefixlen = trie->data_size * 8;
 
+	if (trie_has_index(trie) &&
+	    trie->data_size > LPM_INDEX_DATA_SIZE_MAX) {
+		bpf_map_area_free(trie);
+		return ERR_PTR(-EINVAL);
+	}
+
 	spin_lock_init(&trie->lock);
+	INIT_DELAYED_WORK(&trie->index_work, trie_index_workfn);
 
 	return &trie->map;
 }
@@ -604,6 +939,16 @@ static void trie_free(struct bpf_map *map)
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct lpm_trie_node __rcu **slot;
 	struct lpm_trie_node *node;
+	struct lpm_index *idx;
+
+	if (trie_has_index(trie)) {
+		cancel_delayed_work_sync(&trie->index_work);
+		lpm_index_free(rcu_dereference_protected(trie->index, 1));
+		while ((idx = trie->index_stale)) {
+			trie->index_stale = idx->next_stale;
+			lpm_index_free(idx);
+		}
+	}
 
 	/* Always start at the root and walk down to a node that has no
 	 * children. Then free that node, nullify its reference in the parent
@@ -751,9 +1096,21 @@ static u64 trie_mem_usage(const struct bpf_map *map)
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	u64 elem_size;
 
+	struct lpm_index *idx;
+	u64 usage;
+
 	elem_size = sizeof(struct lpm_trie_node) + trie->data_size +
 			    trie->map.value_size;
-	return elem_size * READ_ONCE(trie->n_entries);
+	usage = elem_size * READ_ONCE(trie->n_entries);
+
+	rcu_read_lock();
+	idx = rcu_dereference(trie->index);
+	if (idx)
+		usage += sizeof(*idx) +
+			 (u64)(idx->n_nodes + 1) * sizeof(struct lpm_index_node);
+	rcu_read_unlock();
+
+	return usage;
 }
 
 BTF_ID_LIST_SINGLE(trie_map_btf_ids, struct, lpm_trie)
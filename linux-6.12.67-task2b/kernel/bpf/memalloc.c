@@ -32,9 +32,20 @@
  *
  * Every allocated objected is padded with extra 8 bytes that contains
  * struct llist_node.
+ *
+ * The watermarks of each cache follow its allocation rate. A cache that runs
+ * low again shortly after a refill, or that ran dry, doubles its watermarks
+ * (up to 1 << BPF_MA_MAX_SHIFT times the initial ones). A cache that trims
+ * extra elements long after its last refill halves them again. Part of what
+ * is trimmed is left in steal_llist, where a CPU whose cache is empty takes
+ * it from before failing an allocation.
  */
 #define LLIST_NODE_SZ sizeof(struct llist_node)
 
+#define BPF_MA_MAX_SHIFT 3
+#define BPF_MA_BURST_WINDOW msecs_to_jiffies(10)
+#define BPF_MA_IDLE_WINDOW msecs_to_jiffies(1000)
+
 #define BPF_MEM_ALLOC_SIZE_MAX 4096
 
 /* similar to kmalloc, but sizeof == 8 bucket is gone */
@@ -99,9 +110,21 @@ struct bpf_mem_cache {
 	/* count of objects in free_llist */
 	int free_cnt;
 	int low_watermark, high_watermark, batch;
+	int base_low_watermark, base_high_watermark;
 	int percpu_size;
 	bool draining;
+	/* unit_alloc() failed since the last refill */
+	bool starved;
+	u8 watermark_shift;
+	unsigned long refill_time;
 	struct bpf_mem_cache *tgt;
+	/* this cache on every cpu */
+	struct bpf_mem_cache __percpu *pcpu;
+
+	/* objects trimmed by free_bulk() that other cpus may take over.
+	 * Only ever emptied with llist_del_all().
+	 */
+	struct llist_head steal_llist;
 
 	/* list of objects to be freed after RCU GP */
 	struct llist_head free_by_rcu;
@@ -338,11 +361,30 @@ static void free_bulk(struct bpf_mem_cache *c)
 	struct bpf_mem_cache *tgt = c->tgt;
 	struct llist_node *llnode, *t;
 	unsigned long flags;
-	int cnt;
+	int cnt, spill;
 
 	WARN_ON_ONCE(tgt->unit_size != c->unit_size);
 	WARN_ON_ONCE(tgt->percpu_size != c->percpu_size);
 
+	/* whatever nobody took since the last trim goes back to kmalloc */
+	llist_for_each_safe(llnode, t, llist_del_all(&c->steal_llist))
+		enque_to_free(tgt, llnode);
+
+	for (spill = 0; spill < c->batch; spill++) {
+		inc_active(c, &flags);
+		llnode = __llist_del_first(&c->free_llist);
+		if (llnode)
+			cnt = --c->free_cnt;
+		else
+			cnt = 0;
+		dec_active(c, &flags);
+		if (!llnode)
+			break;
+		llist_add(llnode, &c->steal_llist);
+		if (cnt <= (c->high_watermark + c->low_watermark) / 2)
+			goto drain_extra;
+	}
+
 	do {
 		inc_active(c, &flags);
 		llnode = __llist_del_first(&c->free_llist);
@@ -355,6 +397,7 @@ static void free_bulk(struct bpf_mem_cache *c)
 			enque_to_free(tgt, llnode);
 	} while (cnt > (c->high_watermark + c->low_watermark) / 2);
 
+drain_extra:
 	/* and drain free_llist_extra */
 	llist_for_each_safe(llnode, t, llist_del_all(&c->free_llist_extra))
 		enque_to_free(tgt, llnode);
@@ -427,6 +470,36 @@ static void check_free_by_rcu(struct bpf_mem_cache *c)
 	}
 }
 
+static void set_watermarks(struct bpf_mem_cache *c)
+{
+	c->low_watermark = c->base_low_watermark << c->watermark_shift;
+	c->high_watermark = c->base_high_watermark << c->watermark_shift;
+	c->batch = max((c->high_watermark - c->low_watermark) / 4 * 3, 1);
+}
+
+/* Scale the watermarks with the recent allocation rate of this cpu */
+static void adapt_watermarks(struct bpf_mem_cache *c, bool refill)
+{
+	unsigned long now = jiffies;
+	u8 shift = c->watermark_shift;
+
+	if (refill) {
+		if ((READ_ONCE(c->starved) ||
+		     time_before(now, c->refill_time + BPF_MA_BURST_WINDOW)) &&
+		    shift < BPF_MA_MAX_SHIFT)
+			shift++;
+		c->refill_time = now;
+		WRITE_ONCE(c->starved, false);
+	} else if (shift && time_after(now, c->refill_time + BPF_MA_IDLE_WINDOW)) {
+		shift--;
+	}
+
+	if (shift != c->watermark_shift) {
+		c->watermark_shift = shift;
+		set_watermarks(c);
+	}
+}
+
 static void bpf_mem_refill(struct irq_work *work)
 {
 	struct bpf_mem_cache *c = container_of(work, struct bpf_mem_cache, refill_work);
@@ -434,13 +507,16 @@ static void bpf_mem_refill(struct irq_work *work)
 
 	/* Racy access to free_cnt. It doesn't need to be 100% accurate */
 	cnt = c->free_cnt;
-	if (cnt < c->low_watermark)
+	if (cnt < c->low_watermark) {
+		adapt_watermarks(c, true);
 		/* irq_work runs on this cpu and kmalloc will allocate
 		 * from the current numa node which is what we want here.
 		 */
 		alloc_bulk(c, c->batch, NUMA_NO_NODE, true);
-	else if (cnt > c->high_watermark)
+	} else if (cnt > c->high_watermark) {
+		adapt_watermarks(c, false);
 		free_bulk(c);
+	}
 
 	check_free_by_rcu(c);
 }
@@ -485,7 +561,11 @@ static void init_refill_work(struct bpf_mem_cache *c)
 		c->low_watermark = max(32 * 256 / c->unit_size, 1);
 		c->high_watermark = max(96 * 256 / c->unit_size, 3);
 	}
-	c->batch = max((c->high_watermark - c->low_watermark) / 4 * 3, 1);
+	c->base_low_watermark = c->low_watermark;
+	c->base_high_watermark = c->high_watermark;
+	c->watermark_shift = 0;
+	set_watermarks(c);
+	c->refill_time = jiffies - BPF_MA_BURST_WINDOW;
 }
 
 static void prefill_mem_cache(struct bpf_mem_cache *c, int cpu)
@@ -545,6 +625,7 @@ int bpf_mem_alloc_init(struct bpf_mem_alloc *ma, int size, bool percpu)
 			c->objcg = objcg;
 			c->percpu_size = percpu_size;
 			c->tgt = c;
+			c->pcpu = pc;
 			init_refill_work(c);
 			prefill_mem_cache(c, cpu);
 		}
@@ -567,6 +648,7 @@ int bpf_mem_alloc_init(struct bpf_mem_alloc *ma, int size, bool percpu)
 			c->objcg = objcg;
 			c->percpu_size = percpu_size;
 			c->tgt = c;
+			c->pcpu = &pcc->cache[i];
 
 			init_refill_work(c);
 			prefill_mem_cache(c, cpu);
@@ -619,6 +701,7 @@ int bpf_mem_alloc_percpu_unit_init(struct bpf_mem_alloc *ma, int size)
 		c->objcg = objcg;
 		c->percpu_size = percpu_size;
 		c->tgt = c;
+		c->pcpu = &pcc->cache[i];
 
 		init_refill_work(c);
 		prefill_mem_cache(c, cpu);
@@ -645,6 +728,7 @@ static void drain_mem_cache(struct bpf_mem_cache *c)
 	free_all(__llist_del_all(&c->free_by_rcu), percpu);
 	free_all(__llist_del_all(&c->free_llist_extra_rcu), percpu);
 	free_all(llist_del_all(&c->waiting_for_gp), percpu);
+	free_all(llist_del_all(&c->steal_llist), percpu);
 }
 
 static void check_mem_cache(struct bpf_mem_cache *c)
@@ -656,6 +740,7 @@ static void check_mem_cache(struct bpf_mem_cache *c)
 	WARN_ON_ONCE(!llist_empty(&c->free_by_rcu));
 	WARN_ON_ONCE(!llist_empty(&c->free_llist_extra_rcu));
 	WARN_ON_ONCE(!llist_empty(&c->waiting_for_gp));
+	WARN_ON_ONCE(!llist_empty(&c->steal_llist));
 }
 
 static void check_leaked_objs(struct bpf_mem_alloc *ma)
@@ -782,6 +867,35 @@ void bpf_mem_alloc_destroy(struct bpf_mem_alloc *ma)
 /* notrace is necessary here and in other functions to make sure
  * bpf programs cannot attach to them and cause llist corruptions.
  */
+
+/* Take the objects another cpu trimmed last. Called with c->active held. */
+static struct llist_node notrace *steal_objs(struct bpf_mem_cache *c)
+{
+	struct llist_node *llnode, *pos, *t;
+	struct bpf_mem_cache *remote;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		remote = per_cpu_ptr(c->pcpu, cpu);
+		if (remote == c || llist_empty(&remote->steal_llist))
+			continue;
+
+		llnode = llist_del_all(&remote->steal_llist);
+		if (!llnode)
+			continue;
+
+		llist_for_each_safe(pos, t, llnode->next) {
+			__llist_add(pos, &c->free_llist);
+			c->free_cnt++;
+		}
+		/* the caller takes llnode off the count again */
+		c->free_cnt++;
+		return llnode;
+	}
+
+	return NULL;
+}
+
 static void notrace *unit_alloc(struct bpf_mem_cache *c)
 {
 	struct llist_node *llnode = NULL;
@@ -801,6 +915,8 @@ static void notrace *unit_alloc(struct bpf_mem_cache *c)
 	local_irq_save(flags);
 	if (local_inc_return(&c->active) == 1) {
 		llnode = __llist_del_first(&c->free_llist);
+		if (!llnode)
+			llnode = steal_objs(c);
 		if (llnode) {
 			cnt = --c->free_cnt;
 			*(struct bpf_mem_cache **)llnode = c;
@@ -810,6 +926,9 @@ static void notrace *unit_alloc(struct bpf_mem_cache *c)
 
 	WARN_ON(cnt < 0);
 
+	if (!llnode)
+		WRITE_ONCE(c->starved, true);
+
 	if (cnt < c->low_watermark)
 		irq_work_raise(c);
 	/* Enable IRQ after the enqueue of irq work completes, so irq work
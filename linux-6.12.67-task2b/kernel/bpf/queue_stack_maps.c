@@ -11,7 +11,21 @@
 #include "percpu_freelist.h"
 
 #define QUEUE_STACK_CREATE_FLAG_MASK \
-	(BPF_F_NUMA_NODE | BPF_F_ACCESS_MASK)
+	(BPF_F_NUMA_NODE | BPF_F_ACCESS_MASK | BPF_F_LOCKLESS)
+
+/*
+ * A BPF_F_LOCKLESS queue is a bounded multi-producer/multi-consumer ring
+ * without a lock: each slot carries a sequence number telling whether it
+ * is free for the push at position @prod, or holds the element for the pop
+ * at position @cons. Pushers and poppers claim a position with a cmpxchg
+ * on their counter and release the slot with a store to its sequence.
+ * A push or pop that got interrupted between the two only delays the
+ * slot it claimed: pops see the queue as empty there, pushes as full.
+ */
+struct bpf_queue_slot {
+	unsigned long seq;
+	char value[] __aligned(8);
+};
 
 struct bpf_queue_stack {
 	struct bpf_map map;
@@ -19,6 +33,12 @@ struct bpf_queue_stack {
 	u32 head, tail;
 	u32 size; /* max_entries + 1 */
 
+	/* BPF_F_LOCKLESS only */
+	u32 mask;
+	u32 slot_size;
+	atomic_long_t prod ____cacheline_aligned_in_smp;
+	atomic_long_t cons ____cacheline_aligned_in_smp;
+
 	char elements[] __aligned(8);
 };
 
@@ -42,6 +62,95 @@ static bool queue_stack_map_is_full(struct bpf_queue_stack *qs)
 	return head == qs->tail;
 }
 
+static bool queue_map_is_lockless(const struct bpf_map *map)
+{
+	return map->map_flags & BPF_F_LOCKLESS;
+}
+
+static struct bpf_queue_slot *queue_ring_slot(struct bpf_queue_stack *qs,
+					      unsigned long pos)
+{
+	return (void *)&qs->elements[(pos & qs->mask) * qs->slot_size];
+}
+
+static long queue_ring_pop(struct bpf_queue_stack *qs, void *value,
+			   bool delete)
+{
+	unsigned long pos = atomic_long_read(&qs->cons), seq;
+	struct bpf_queue_slot *slot;
+	long diff;
+
+	for (;;) {
+		slot = queue_ring_slot(qs, pos);
+		seq = smp_load_acquire(&slot->seq);
+		diff = (long)(seq - (pos + 1));
+		if (diff < 0) {
+			if (value)
+				memset(value, 0, qs->map.value_size);
+			return -ENOENT;
+		}
+
+		if (diff) {
+			pos = atomic_long_read(&qs->cons);
+			continue;
+		}
+
+		if (!delete) {
+			/* the copy is only good if nobody popped it meanwhile */
+			memcpy(value, slot->value, qs->map.value_size);
+			smp_rmb();
+			if (READ_ONCE(slot->seq) == seq)
+				return 0;
+			pos = atomic_long_read(&qs->cons);
+			continue;
+		}
+
+		if (atomic_long_try_cmpxchg_relaxed(&qs->cons, &pos, pos + 1))
+			break;
+	}
+
+	if (value)
+		memcpy(value, slot->value, qs->map.value_size);
+	smp_store_release(&slot->seq, pos + qs->mask + 1);
+	return 0;
+}
+
+static long queue_ring_push(struct bpf_queue_stack *qs, void *value,
+			    bool replace)
+{
+	unsigned long pos = atomic_long_read(&qs->prod);
+	struct bpf_queue_slot *slot;
+	long diff;
+
+	for (;;) {
+		slot = queue_ring_slot(qs, pos);
+		diff = (long)(smp_load_acquire(&slot->seq) - pos);
+		if (!diff &&
+		    pos - atomic_long_read(&qs->cons) < qs->map.max_entries) {
+			if (atomic_long_try_cmpxchg_relaxed(&qs->prod, &pos,
+							    pos + 1))
+				break;
+			continue;
+		}
+
+		if (diff > 0) {
+			pos = atomic_long_read(&qs->prod);
+			continue;
+		}
+
+		/* full */
+		if (!replace)
+			return -E2BIG;
+		/* drop the oldest element to make room, like the locked queue */
+		queue_ring_pop(qs, NULL, true);
+		pos = atomic_long_read(&qs->prod);
+	}
+
+	memcpy(slot->value, value, qs->map.value_size);
+	smp_store_release(&slot->seq, pos + 1);
+	return 0;
+}
+
 /* Called from syscall */
 static int queue_stack_map_alloc_check(union bpf_attr *attr)
 {
@@ -52,6 +161,11 @@ static int queue_stack_map_alloc_check(union bpf_attr *attr)
 	    !bpf_map_flags_access_ok(attr->map_flags))
 		return -EINVAL;
 
+	if (attr->map_flags & BPF_F_LOCKLESS &&
+	    (attr->map_type != BPF_MAP_TYPE_QUEUE ||
+	     attr->max_entries > (1U << 31)))
+		return -EINVAL;
+
 	if (attr->value_size > KMALLOC_MAX_SIZE)
 		/* if value_size is bigger, the user space won't be able to
 		 * access the elements.
@@ -66,9 +180,18 @@ static struct bpf_map *queue_stack_map_alloc(union bpf_attr *attr)
 	int numa_node = bpf_map_attr_numa_node(attr);
 	struct bpf_queue_stack *qs;
 	u64 size, queue_size;
-
-	size = (u64) attr->max_entries + 1;
-	queue_size = sizeof(*qs) + size * attr->value_size;
+	u32 slot_size = 0;
+	unsigned long i;
+
+	if (attr->map_flags & BPF_F_LOCKLESS) {
+		size = roundup_pow_of_two(attr->max_entries);
+		slot_size = struct_size_t(struct bpf_queue_slot, value,
+					  round_up(attr->value_size, 8));
+		queue_size = sizeof(*qs) + size * slot_size;
+	} else {
+		size = (u64) attr->max_entries + 1;
+		queue_size = sizeof(*qs) + size * attr->value_size;
+	}
 
 	qs = bpf_map_area_alloc(queue_size, numa_node);
 	if (!qs)
@@ -80,6 +203,13 @@ static struct bpf_map *queue_stack_map_alloc(union bpf_attr *attr)
 
 	raw_spin_lock_init(&qs->lock);
 
+	if (slot_size) {
+		qs->mask = size - 1;
+		qs->slot_size = slot_size;
+		for (i = 0; i < size; i++)
+			queue_ring_slot(qs, i)->seq = i;
+	}
+
 	return &qs->map;
 }
 
@@ -164,6 +294,8 @@ out:
 /* Called from syscall or from eBPF program */
 static long queue_map_peek_elem(struct bpf_map *map, void *value)
 {
+	if (queue_map_is_lockless(map))
+		return queue_ring_pop(bpf_queue_stack(map), value, false);
 	return __queue_map_get(map, value, false);
 }
 
@@ -176,6 +308,8 @@ static long stack_map_peek_elem(struct bpf_map *map, void *value)
 /* Called from syscall or from eBPF program */
 static long queue_map_pop_elem(struct bpf_map *map, void *value)
 {
+	if (queue_map_is_lockless(map))
+		return queue_ring_pop(bpf_queue_stack(map), value, true);
 	return __queue_map_get(map, value, true);
 }
 
@@ -203,6 +337,9 @@ static long queue_stack_map_push_elem(struct bpf_map *map, void *value,
 	if (flags & BPF_NOEXIST || flags > BPF_EXIST)
 		return -EINVAL;
 
+	if (queue_map_is_lockless(map))
+		return queue_ring_push(qs, value, replace);
+
 	if (in_nmi()) {
 		if (!raw_spin_trylock_irqsave(&qs->lock, irq_flags))
 			return -EBUSY;
@@ -257,11 +394,61 @@ static int queue_stack_map_get_next_key(struct bpf_map *map, void *key,
 	return -EINVAL;
 }
 
+/* Called from syscall, pops up to batch.count elements into batch.values */
+static int queue_map_pop_batch(struct bpf_map *map,
+			       const union bpf_attr *attr,
+			       union bpf_attr __user *uattr)
+{
+	void __user *values = u64_to_user_ptr(attr->batch.values);
+	u32 value_size = map->value_size, max_count, cp;
+	void *value;
+	int err = 0;
+
+	if (attr->batch.elem_flags || attr->batch.in_batch)
+		return -EINVAL;
+
+	max_count = attr->batch.count;
+	if (!max_count)
+		return 0;
+
+	if (put_user(0, &uattr->batch.count))
+		return -EFAULT;
+
+	value = kvmalloc(value_size, GFP_USER | __GFP_NOWARN);
+	if (!value)
+		return -ENOMEM;
+
+	for (cp = 0; cp < max_count; cp++) {
+		err = map->ops->map_pop_elem(map, value);
+		if (err)
+			break;
+		if (copy_to_user(values + cp * value_size, value, value_size)) {
+			err = -EFAULT;
+			break;
+		}
+		cond_resched();
+	}
+
+	/* an empty queue only ends the batch, unless nothing was popped */
+	if (err == -ENOENT && cp)
+		err = 0;
+	if (err != -EFAULT && copy_to_user(&uattr->batch.count, &cp, sizeof(cp)))
+		err = -EFAULT;
+
+	kvfree(value);
+	return err;
+}
+
 static u64 queue_stack_map_mem_usage(const struct bpf_map *map)
 {
+	const struct bpf_queue_stack *qs =
+		container_of(map, struct bpf_queue_stack, map);
 	u64 usage = sizeof(struct bpf_queue_stack);
 
-	usage += ((u64)map->max_entries + 1) * map->value_size;
+	if (queue_map_is_lockless(map))
+		usage += (u64)qs->size * qs->slot_size;
+	else
+		usage += ((u64)map->max_entries + 1) * map->value_size;
 	return usage;
 }
 
@@ -278,6 +465,7 @@ const struct bpf_map_ops queue_map_ops = {
 	.map_pop_elem = queue_map_pop_elem,
 	.map_peek_elem = queue_map_peek_elem,
 	.map_get_next_key = queue_stack_map_get_next_key,
+	.map_lookup_and_delete_batch = queue_map_pop_batch,
 	.map_mem_usage = queue_stack_map_mem_usage,
 	.map_btf_id = &queue_map_btf_ids[0],
 };
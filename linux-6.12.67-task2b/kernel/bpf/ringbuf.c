@@ -12,7 +12,7 @@
 #include <uapi/linux/btf.h>
 #include <linux/btf_ids.h>
 
-#define RINGBUF_CREATE_FLAG_MASK (BPF_F_NUMA_NODE)
+#define RINGBUF_CREATE_FLAG_MASK (BPF_F_NUMA_NODE | BPF_F_RINGBUF_PERCPU)
 
 /* non-mmap()'able part of bpf_ringbuf (everything up to consumer page) */
 #define RINGBUF_PGOFF \
@@ -75,9 +75,17 @@ struct bpf_ringbuf {
 	char data[] __aligned(PAGE_SIZE);
 };
 
+/* With BPF_F_RINGBUF_PERCPU, each possible CPU gets its own ring buffer of
+ * max_entries bytes in @cpu_rb, and programs reserve from the one of the
+ * CPU they run on. For mmap(), the rings of all possible CPUs are laid out
+ * one after the other, in CPU order, each as for a single ring buffer: the
+ * consumer page, the producer page and the data pages. @rb is the ring of
+ * the first possible CPU. The map fd polls readable if any ring has data.
+ */
 struct bpf_ringbuf_map {
 	struct bpf_map map;
 	struct bpf_ringbuf *rb;
+	struct bpf_ringbuf **cpu_rb;
 };
 
 /* 8-byte ring buffer record header structure */
@@ -186,6 +194,58 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 	return rb;
 }
 
+static void bpf_ringbuf_free(struct bpf_ringbuf *rb);
+
+static bool ringbuf_map_is_percpu(const struct bpf_ringbuf_map *rb_map)
+{
+	return rb_map->cpu_rb;
+}
+
+/* The ring buffer a program running on this CPU reserves from */
+static struct bpf_ringbuf *ringbuf_map_rb(struct bpf_ringbuf_map *rb_map)
+{
+	if (ringbuf_map_is_percpu(rb_map))
+		return rb_map->cpu_rb[smp_processor_id()];
+	return rb_map->rb;
+}
+
+static void ringbuf_map_free_percpu(struct bpf_ringbuf_map *rb_map)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (rb_map->cpu_rb[cpu])
+			bpf_ringbuf_free(rb_map->cpu_rb[cpu]);
+	}
+	bpf_map_area_free(rb_map->cpu_rb);
+}
+
+static int ringbuf_map_alloc_percpu(struct bpf_ringbuf_map *rb_map,
+				    size_t data_sz)
+{
+	int cpu, numa_node;
+
+	rb_map->cpu_rb = bpf_map_area_alloc(nr_cpu_ids * sizeof(*rb_map->cpu_rb),
+					    NUMA_NO_NODE);
+	if (!rb_map->cpu_rb)
+		return -ENOMEM;
+	memset(rb_map->cpu_rb, 0, nr_cpu_ids * sizeof(*rb_map->cpu_rb));
+
+	for_each_possible_cpu(cpu) {
+		numa_node = rb_map->map.numa_node;
+		if (numa_node == NUMA_NO_NODE)
+			numa_node = cpu_to_node(cpu);
+
+		rb_map->cpu_rb[cpu] = bpf_ringbuf_alloc(data_sz, numa_node);
+		if (!rb_map->cpu_rb[cpu]) {
+			ringbuf_map_free_percpu(rb_map);
+			return -ENOMEM;
+		}
+	}
+	rb_map->rb = rb_map->cpu_rb[cpumask_first(cpu_possible_mask)];
+	return 0;
+}
+
 static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 {
 	struct bpf_ringbuf_map *rb_map;
@@ -198,12 +258,24 @@ static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 	    !PAGE_ALIGNED(attr->max_entries))
 		return ERR_PTR(-EINVAL);
 
+	if ((attr->map_flags & BPF_F_RINGBUF_PERCPU) &&
+	    attr->map_type != BPF_MAP_TYPE_RINGBUF)
+		return ERR_PTR(-EINVAL);
+
 	rb_map = bpf_map_area_alloc(sizeof(*rb_map), NUMA_NO_NODE);
 	if (!rb_map)
 		return ERR_PTR(-ENOMEM);
 
 	bpf_map_init_from_attr(&rb_map->map, attr);
 
+	if (attr->map_flags & BPF_F_RINGBUF_PERCPU) {
+		if (ringbuf_map_alloc_percpu(rb_map, attr->max_entries)) {
+			bpf_map_area_free(rb_map);
+			return ERR_PTR(-ENOMEM);
+		}
+		return &rb_map->map;
+	}
+
 	rb_map->rb = bpf_ringbuf_alloc(attr->max_entries, rb_map->map.numa_node);
 	if (!rb_map->rb) {
 		bpf_map_area_free(rb_map);
@@ -234,7 +306,10 @@ static void ringbuf_map_free(struct bpf_map *map)
 	struct bpf_ringbuf_map *rb_map;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	bpf_ringbuf_free(rb_map->rb);
+	if (ringbuf_map_is_percpu(rb_map))
+		ringbuf_map_free_percpu(rb_map);
+	else
+		bpf_ringbuf_free(rb_map->rb);
 	bpf_map_area_free(rb_map);
 }
 
@@ -263,17 +338,38 @@ static int ringbuf_map_get_next_key(struct bpf_map *map, void *key,
 static int ringbuf_map_mmap_kern(struct bpf_map *map, struct vm_area_struct *vma)
 {
 	struct bpf_ringbuf_map *rb_map;
+	unsigned long pgoff = vma->vm_pgoff;
+	struct bpf_ringbuf *rb;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	rb = rb_map->rb;
+
+	if (ringbuf_map_is_percpu(rb_map)) {
+		/* pages of one ring that can be mapped */
+		unsigned long stride = RINGBUF_POS_PAGES +
+				       2 * (map->max_entries >> PAGE_SHIFT);
+		unsigned long idx = pgoff / stride;
+		int cpu;
+
+		rb = NULL;
+		for_each_possible_cpu(cpu) {
+			if (!idx--) {
+				rb = rb_map->cpu_rb[cpu];
+				break;
+			}
+		}
+		if (!rb)
+			return -EINVAL;
+		pgoff %= stride;
+	}
 
 	if (vma->vm_flags & VM_WRITE) {
 		/* allow writable mapping for the consumer_pos only */
-		if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		if (pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
 			return -EPERM;
 	}
 	/* remap_vmalloc_range() checks size and offset constraints */
-	return remap_vmalloc_range(vma, rb_map->rb,
-				   vma->vm_pgoff + RINGBUF_PGOFF);
+	return remap_vmalloc_range(vma, rb, pgoff + RINGBUF_PGOFF);
 }
 
 static int ringbuf_map_mmap_user(struct bpf_map *map, struct vm_area_struct *vma)
@@ -314,6 +410,19 @@ static __poll_t ringbuf_map_poll_kern(struct bpf_map *map, struct file *filp,
 	struct bpf_ringbuf_map *rb_map;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+
+	if (ringbuf_map_is_percpu(rb_map)) {
+		__poll_t mask = 0;
+		int cpu;
+
+		for_each_possible_cpu(cpu) {
+			poll_wait(filp, &rb_map->cpu_rb[cpu]->waitq, pts);
+			if (ringbuf_avail_data_sz(rb_map->cpu_rb[cpu]))
+				mask = EPOLLIN | EPOLLRDNORM;
+		}
+		return mask;
+	}
+
 	poll_wait(filp, &rb_map->rb->waitq, pts);
 
 	if (ringbuf_avail_data_sz(rb_map->rb))
@@ -336,17 +445,24 @@ static __poll_t ringbuf_map_poll_user(struct bpf_map *map, struct file *filp,
 
 static u64 ringbuf_map_mem_usage(const struct bpf_map *map)
 {
+	struct bpf_ringbuf_map *rb_map;
 	struct bpf_ringbuf *rb;
 	int nr_data_pages;
 	int nr_meta_pages;
-	u64 usage = sizeof(struct bpf_ringbuf_map);
+	u64 usage = sizeof(struct bpf_ringbuf_map), ring_usage;
 
-	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
-	usage += (u64)rb->nr_pages << PAGE_SHIFT;
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	rb = rb_map->rb;
+	ring_usage = (u64)rb->nr_pages << PAGE_SHIFT;
 	nr_meta_pages = RINGBUF_NR_META_PAGES;
 	nr_data_pages = map->max_entries >> PAGE_SHIFT;
-	usage += (nr_meta_pages + 2 * nr_data_pages) * sizeof(struct page *);
-	return usage;
+	ring_usage += (nr_meta_pages + 2 * nr_data_pages) * sizeof(struct page *);
+
+	if (ringbuf_map_is_percpu(rb_map)) {
+		usage += nr_cpu_ids * sizeof(*rb_map->cpu_rb);
+		ring_usage *= num_possible_cpus();
+	}
+	return usage + ring_usage;
 }
 
 BTF_ID_LIST_SINGLE(ringbuf_map_btf_ids, struct, bpf_ringbuf_map)
@@ -473,7 +589,7 @@ BPF_CALL_3(bpf_ringbuf_reserve, struct bpf_map *, map, u64, size, u64, flags)
 		return 0;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	return (unsigned long)__bpf_ringbuf_reserve(rb_map->rb, size);
+	return (unsigned long)__bpf_ringbuf_reserve(ringbuf_map_rb(rb_map), size);
 }
 
 const struct bpf_func_proto bpf_ringbuf_reserve_proto = {
@@ -548,7 +664,7 @@ BPF_CALL_4(bpf_ringbuf_output, struct bpf_map *, map, void *, data, u64, size,
 		return -EINVAL;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	rec = __bpf_ringbuf_reserve(rb_map->rb, size);
+	rec = __bpf_ringbuf_reserve(ringbuf_map_rb(rb_map), size);
 	if (!rec)
 		return -EAGAIN;
 
@@ -570,7 +686,8 @@ BPF_CALL_2(bpf_ringbuf_query, struct bpf_map *, map, u64, flags)
 {
 	struct bpf_ringbuf *rb;
 
-	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
+	/* for a per-CPU map, the ring of the current CPU */
+	rb = ringbuf_map_rb(container_of(map, struct bpf_ringbuf_map, map));
 
 	switch (flags) {
 	case BPF_RB_AVAIL_DATA:
@@ -613,7 +730,7 @@ BPF_CALL_4(bpf_ringbuf_reserve_dynptr, struct bpf_map *, map, u32, size, u64, fl
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
 
-	sample = __bpf_ringbuf_reserve(rb_map->rb, size);
+	sample = __bpf_ringbuf_reserve(ringbuf_map_rb(rb_map), size);
 	if (!sample) {
 		bpf_dynptr_set_null(ptr);
 		return -EINVAL;
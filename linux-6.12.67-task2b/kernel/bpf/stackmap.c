@@ -9,15 +9,22 @@
 #include <linux/perf_event.h>
 #include <linux/btf_ids.h>
 #include <linux/buildid.h>
+#include <linux/bpf_mem_alloc.h>
+#include <linux/fs.h>
+#include <linux/hash.h>
 #include "percpu_freelist.h"
 #include "mmap_unlock_work.h"
 
 #define STACK_CREATE_FLAG_MASK					\
 	(BPF_F_NUMA_NODE | BPF_F_RDONLY | BPF_F_WRONLY |	\
-	 BPF_F_STACK_BUILD_ID)
+	 BPF_F_STACK_BUILD_ID | BPF_F_RESIZABLE)
 
 struct stack_map_bucket {
-	struct pcpu_freelist_node fnode;
+	union {
+		struct pcpu_freelist_node fnode;
+		/* BPF_F_RESIZABLE: bytes used in data */
+		u32 len;
+	};
 	u32 hash;
 	u32 nr;
 	u64 data[];
@@ -27,6 +34,9 @@ struct bpf_stack_map {
 	struct bpf_map map;
 	void *elems;
 	struct pcpu_freelist freelist;
+	/* BPF_F_RESIZABLE: buckets are allocated from here instead */
+	struct bpf_mem_alloc ma;
+	s64 __percpu *used_bytes;
 	u32 n_buckets;
 	struct stack_map_bucket *buckets[] __counted_by(n_buckets);
 };
@@ -36,12 +46,144 @@ static inline bool stack_map_use_build_id(struct bpf_map *map)
 	return (map->map_flags & BPF_F_STACK_BUILD_ID);
 }
 
+static inline bool stack_map_resizable(const struct bpf_map *map)
+{
+	return (map->map_flags & BPF_F_RESIZABLE);
+}
+
 static inline int stack_map_data_size(struct bpf_map *map)
 {
 	return stack_map_use_build_id(map) ?
 		sizeof(struct bpf_stack_build_id) : sizeof(u64);
 }
 
+/*
+ * BPF_F_RESIZABLE maps allocate each bucket to fit its trace rather than
+ * preallocating max_entries values of the full depth, so that max_entries
+ * mostly costs the bucket pointers and can be made large enough to keep
+ * stacks from evicting each other. IPs are stored as zigzag varint deltas
+ * from the previous frame: consecutive frames tend to be in the same object,
+ * which brings most of them down to two or three bytes. Build ID traces are
+ * stored as they are.
+ */
+#define STACK_MAP_VARINT_MAX	10	/* bytes to encode any u64 */
+
+static inline u64 stack_map_zigzag(u64 ip, u64 prev)
+{
+	s64 delta = ip - prev;
+
+	return ((u64)delta << 1) ^ (u64)(delta >> 63);
+}
+
+static u32 stack_map_encoded_len(const u64 *ips, u32 nr)
+{
+	u32 i, len = 0;
+	u64 prev = 0, v;
+
+	for (i = 0; i < nr; i++) {
+		v = stack_map_zigzag(ips[i], prev);
+		prev = ips[i];
+		len++;
+		while (v >= 0x80) {
+			v >>= 7;
+			len++;
+		}
+	}
+	return len;
+}
+
+static void stack_map_encode(u8 *p, const u64 *ips, u32 nr)
+{
+	u64 prev = 0, v;
+	u32 i;
+
+	for (i = 0; i < nr; i++) {
+		v = stack_map_zigzag(ips[i], prev);
+		prev = ips[i];
+		while (v >= 0x80) {
+			*p++ = v | 0x80;
+			v >>= 7;
+		}
+		*p++ = v;
+	}
+}
+
+/* advance *ip by the next encoded delta, never reading past end */
+static bool stack_map_decode_next(const u8 **p, const u8 *end, u64 *ip)
+{
+	u32 shift = 0;
+	u64 v = 0;
+	u8 b;
+
+	do {
+		if (*p == end || shift > 63)
+			return false;
+		b = *(*p)++;
+		v |= (u64)(b & 0x7f) << shift;
+		shift += 7;
+	} while (b & 0x80);
+
+	*ip += (v >> 1) ^ -(v & 1);
+	return true;
+}
+
+/*
+ * May race with the bucket being replaced and reused, like the memcmp() of
+ * the preallocated case; len has been checked against the bucket, so the
+ * reads stay within its allocation.
+ */
+static bool stack_map_encoded_equal(const struct stack_map_bucket *bucket,
+				    const u64 *ips, u32 nr, u32 len)
+{
+	const u8 *p = (const u8 *)bucket->data, *end = p + len;
+	u64 ip = 0;
+	u32 i;
+
+	for (i = 0; i < nr; i++)
+		if (!stack_map_decode_next(&p, end, &ip) || ip != ips[i])
+			return false;
+	return p == end;
+}
+
+static void stack_map_decode(u64 *ips, const struct stack_map_bucket *bucket)
+{
+	const u8 *p = (const u8 *)bucket->data, *end = p + bucket->len;
+	u64 ip = 0;
+	u32 i;
+
+	for (i = 0; i < bucket->nr && stack_map_decode_next(&p, end, &ip); i++)
+		ips[i] = ip;
+}
+
+static struct stack_map_bucket *stack_map_get_bucket(struct bpf_stack_map *smap,
+						     u32 len)
+{
+	struct stack_map_bucket *bucket;
+
+	if (!stack_map_resizable(&smap->map))
+		return (struct stack_map_bucket *)
+			pcpu_freelist_pop(&smap->freelist);
+
+	bucket = bpf_mem_alloc(&smap->ma, sizeof(*bucket) + len);
+	if (bucket) {
+		bucket->len = len;
+		this_cpu_add(*smap->used_bytes, sizeof(*bucket) + len);
+	}
+	return bucket;
+}
+
+static void stack_map_put_bucket(struct bpf_stack_map *smap,
+				 struct stack_map_bucket *bucket)
+{
+	if (!stack_map_resizable(&smap->map)) {
+		pcpu_freelist_push(&smap->freelist, &bucket->fnode);
+		return;
+	}
+
+	this_cpu_sub(*smap->used_bytes, sizeof(*bucket) + bucket->len);
+	bpf_mem_free(&smap->ma, bucket);
+}
+
 /**
  * stack_map_calculate_max_depth - Calculate maximum allowed stack trace depth
  * @size:  Size of the buffer/map value in bytes
@@ -88,6 +230,23 @@ free_elems:
 	return err;
 }
 
+static int stack_map_init_resizable(struct bpf_stack_map *smap)
+{
+	int err;
+
+	smap->used_bytes = bpf_map_alloc_percpu(&smap->map,
+						sizeof(*smap->used_bytes),
+						__alignof__(*smap->used_bytes),
+						GFP_USER | __GFP_NOWARN);
+	if (!smap->used_bytes)
+		return -ENOMEM;
+
+	err = bpf_mem_alloc_init(&smap->ma, 0, false);
+	if (err)
+		free_percpu(smap->used_bytes);
+	return err;
+}
+
 /* Called from syscall */
 static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 {
@@ -113,6 +272,16 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 	} else if (value_size / 8 > sysctl_perf_event_max_stack)
 		return ERR_PTR(-EINVAL);
 
+	/* the worst case trace has to fit into a single bpf_mem_alloc() */
+	if (attr->map_flags & BPF_F_RESIZABLE) {
+		u64 max_len = attr->map_flags & BPF_F_STACK_BUILD_ID ?
+			      value_size : value_size / 8 * STACK_MAP_VARINT_MAX;
+
+		if (bpf_mem_alloc_check_size(false, sizeof(struct stack_map_bucket) +
+					     max_len))
+			return ERR_PTR(-E2BIG);
+	}
+
 	/* hash table size must be power of 2; roundup_pow_of_two() can overflow
 	 * into UB on 32-bit arches, so check that first
 	 */
@@ -133,7 +302,10 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 	if (err)
 		goto free_smap;
 
-	err = prealloc_elems_and_freelist(smap);
+	if (stack_map_resizable(&smap->map))
+		err = stack_map_init_resizable(smap);
+	else
+		err = prealloc_elems_and_freelist(smap);
 	if (err)
 		goto put_buffers;
 
@@ -146,12 +318,85 @@ free_smap:
 	return ERR_PTR(err);
 }
 
+/*
+ * A build ID belongs to the file rather than to the mapping, and parsing it
+ * means walking ELF notes in the page cache on every frame. Keep the last
+ * few results per CPU, keyed by the inode, so that profiles of many
+ * processes sharing the same binaries and libraries only pay for it once.
+ * The inode pointer is only compared, never dereferenced; its number and
+ * ctime guard against the inode having been freed and reused.
+ */
+#define STACK_MAP_BUILD_ID_CACHE_BITS	4
+
+struct stack_map_build_id_ent {
+	const struct inode *inode;
+	unsigned long ino;
+	struct timespec64 ctime;
+	unsigned char build_id[BUILD_ID_SIZE_MAX];
+};
+
+struct stack_map_build_id_cache {
+	/* set while in use, a nested user (e.g. from NMI) bypasses the cache */
+	int busy;
+	struct stack_map_build_id_ent ents[1 << STACK_MAP_BUILD_ID_CACHE_BITS];
+};
+
+static DEFINE_PER_CPU(struct stack_map_build_id_cache, stack_map_build_id_cache);
+
+static bool stack_map_build_id_cache_access(const struct inode *inode,
+					    const struct timespec64 *ctime,
+					    unsigned char *build_id, bool store)
+{
+	struct stack_map_build_id_cache *cache;
+	struct stack_map_build_id_ent *ent;
+	bool hit = false;
+
+	preempt_disable();
+	cache = this_cpu_ptr(&stack_map_build_id_cache);
+	if (this_cpu_inc_return(stack_map_build_id_cache.busy) != 1)
+		goto out;
+
+	ent = &cache->ents[hash_ptr(inode, STACK_MAP_BUILD_ID_CACHE_BITS)];
+	if (store) {
+		ent->inode = inode;
+		ent->ino = inode->i_ino;
+		ent->ctime = *ctime;
+		memcpy(ent->build_id, build_id, BUILD_ID_SIZE_MAX);
+	} else if (ent->inode == inode && ent->ino == inode->i_ino &&
+		   timespec64_equal(&ent->ctime, ctime)) {
+		memcpy(build_id, ent->build_id, BUILD_ID_SIZE_MAX);
+		hit = true;
+	}
+out:
+	this_cpu_dec(stack_map_build_id_cache.busy);
+	preempt_enable();
+	return hit;
+}
+
 static int fetch_build_id(struct vm_area_struct *vma, unsigned char *build_id, bool may_fault)
 {
-	return may_fault ? build_id_parse(vma, build_id, NULL)
-			 : build_id_parse_nofault(vma, build_id, NULL);
+	struct timespec64 ctime;
+	struct inode *inode;
+	int err;
+
+	if (!vma->vm_file)
+		return -EINVAL;
+
+	inode = file_inode(vma->vm_file);
+	ctime = inode_get_ctime(inode);
+	if (stack_map_build_id_cache_access(inode, &ctime, build_id, false))
+		return 0;
+
+	err = may_fault ? build_id_parse(vma, build_id, NULL)
+			: build_id_parse_nofault(vma, build_id, NULL);
+	if (!err)
+		stack_map_build_id_cache_access(inode, &ctime, build_id, true);
+	return err;
 }
 
+/* distinct VMAs to look in first while resolving one trace */
+#define STACK_MAP_RECENT_VMAS	4
+
 /*
  * Expects all id_offs[i].ip values to be set to correct initial IPs.
  * They will be subsequently:
@@ -168,8 +413,12 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 	int i;
 	struct mmap_unlock_irq_work *work = NULL;
 	bool irq_work_busy = bpf_mmap_unlock_get_irq_work(&work);
-	struct vm_area_struct *vma, *prev_vma = NULL;
-	const char *prev_build_id;
+	struct {
+		struct vm_area_struct *vma;
+		const char *build_id;
+	} recent[STACK_MAP_RECENT_VMAS] = {};
+	struct vm_area_struct *vma;
+	u32 j, nr_recent = 0;
 
 	/* If the irq_work is in use, fall back to report ips. Same
 	 * fallback is used for kernel stack (!user) on a stackmap with
@@ -188,10 +437,14 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 	for (i = 0; i < trace_nr; i++) {
 		u64 ip = READ_ONCE(id_offs[i].ip);
 
-		if (range_in_vma(prev_vma, ip, ip)) {
-			vma = prev_vma;
-			memcpy(id_offs[i].build_id, prev_build_id, BUILD_ID_SIZE_MAX);
-			goto build_id_valid;
+		/* frames tend to alternate between a handful of objects */
+		for (j = 0; j < ARRAY_SIZE(recent); j++) {
+			if (range_in_vma(recent[j].vma, ip, ip)) {
+				vma = recent[j].vma;
+				memcpy(id_offs[i].build_id, recent[j].build_id,
+				       BUILD_ID_SIZE_MAX);
+				goto build_id_valid;
+			}
 		}
 		vma = find_vma(current->mm, ip);
 		if (!vma || fetch_build_id(vma, id_offs[i].build_id, may_fault)) {
@@ -200,11 +453,12 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 			memset(id_offs[i].build_id, 0, BUILD_ID_SIZE_MAX);
 			continue;
 		}
+		j = nr_recent++ % ARRAY_SIZE(recent);
+		recent[j].vma = vma;
+		recent[j].build_id = id_offs[i].build_id;
 build_id_valid:
 		id_offs[i].offset = (vma->vm_pgoff << PAGE_SHIFT) + ip - vma->vm_start;
 		id_offs[i].status = BPF_STACK_BUILD_ID_VALID;
-		prev_vma = vma;
-		prev_build_id = id_offs[i].build_id;
 	}
 	bpf_mmap_unlock_mm(work, current->mm);
 }
@@ -251,7 +505,7 @@ static long __bpf_get_stackid(struct bpf_map *map,
 {
 	struct bpf_stack_map *smap = container_of(map, struct bpf_stack_map, map);
 	struct stack_map_bucket *bucket, *new_bucket, *old_bucket;
-	u32 hash, id, trace_nr, trace_len, i, max_depth;
+	u32 hash, id, trace_nr, trace_len, enc_len, i, max_depth;
 	u32 skip = flags & BPF_F_SKIP_FIELD_MASK;
 	bool user = flags & BPF_F_USER_STACK;
 	u64 *ips;
@@ -278,8 +532,8 @@ static long __bpf_get_stackid(struct bpf_map *map,
 		struct bpf_stack_build_id *id_offs;
 
 		/* for build_id+offset, pop a bucket before slow cmp */
-		new_bucket = (struct stack_map_bucket *)
-			pcpu_freelist_pop(&smap->freelist);
+		trace_len = trace_nr * sizeof(struct bpf_stack_build_id);
+		new_bucket = stack_map_get_bucket(smap, trace_len);
 		if (unlikely(!new_bucket))
 			return -ENOMEM;
 		new_bucket->nr = trace_nr;
@@ -287,16 +541,28 @@ static long __bpf_get_stackid(struct bpf_map *map,
 		for (i = 0; i < trace_nr; i++)
 			id_offs[i].ip = ips[i];
 		stack_map_get_build_id_offset(id_offs, trace_nr, user, false /* !may_fault */);
-		trace_len = trace_nr * sizeof(struct bpf_stack_build_id);
 		if (hash_matches && bucket->nr == trace_nr &&
 		    memcmp(bucket->data, new_bucket->data, trace_len) == 0) {
-			pcpu_freelist_push(&smap->freelist, &new_bucket->fnode);
+			stack_map_put_bucket(smap, new_bucket);
 			return id;
 		}
 		if (bucket && !(flags & BPF_F_REUSE_STACKID)) {
-			pcpu_freelist_push(&smap->freelist, &new_bucket->fnode);
+			stack_map_put_bucket(smap, new_bucket);
 			return -EEXIST;
 		}
+	} else if (stack_map_resizable(map)) {
+		enc_len = stack_map_encoded_len(ips, trace_nr);
+		if (hash_matches && bucket->nr == trace_nr &&
+		    READ_ONCE(bucket->len) == enc_len &&
+		    stack_map_encoded_equal(bucket, ips, trace_nr, enc_len))
+			return id;
+		if (bucket && !(flags & BPF_F_REUSE_STACKID))
+			return -EEXIST;
+
+		new_bucket = stack_map_get_bucket(smap, enc_len);
+		if (unlikely(!new_bucket))
+			return -ENOMEM;
+		stack_map_encode((u8 *)new_bucket->data, ips, trace_nr);
 	} else {
 		if (hash_matches && bucket->nr == trace_nr &&
 		    memcmp(bucket->data, ips, trace_len) == 0)
@@ -304,8 +570,7 @@ static long __bpf_get_stackid(struct bpf_map *map,
 		if (bucket && !(flags & BPF_F_REUSE_STACKID))
 			return -EEXIST;
 
-		new_bucket = (struct stack_map_bucket *)
-			pcpu_freelist_pop(&smap->freelist);
+		new_bucket = stack_map_get_bucket(smap, trace_len);
 		if (unlikely(!new_bucket))
 			return -ENOMEM;
 		memcpy(new_bucket->data, ips, trace_len);
@@ -316,7 +581,7 @@ static long __bpf_get_stackid(struct bpf_map *map,
 
 	old_bucket = xchg(&smap->buckets[id], new_bucket);
 	if (old_bucket)
-		pcpu_freelist_push(&smap->freelist, &old_bucket->fnode);
+		stack_map_put_bucket(smap, old_bucket);
 	return id;
 }
 
@@ -678,12 +943,15 @@ int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 		return -ENOENT;
 
 	trace_len = bucket->nr * stack_map_data_size(map);
-	memcpy(value, bucket->data, trace_len);
+	if (stack_map_resizable(map) && !stack_map_use_build_id(map))
+		stack_map_decode(value, bucket);
+	else
+		memcpy(value, bucket->data, trace_len);
 	memset(value + trace_len, 0, map->value_size - trace_len);
 
 	old_bucket = xchg(&smap->buckets[id], bucket);
 	if (old_bucket)
-		pcpu_freelist_push(&smap->freelist, &old_bucket->fnode);
+		stack_map_put_bucket(smap, old_bucket);
 	return 0;
 }
 
@@ -734,7 +1002,7 @@ static long stack_map_delete_elem(struct bpf_map *map, void *key)
 
 	old_bucket = xchg(&smap->buckets[id], NULL);
 	if (old_bucket) {
-		pcpu_freelist_push(&smap->freelist, &old_bucket->fnode);
+		stack_map_put_bucket(smap, old_bucket);
 		return 0;
 	} else {
 		return -ENOENT;
@@ -745,9 +1013,21 @@ static long stack_map_delete_elem(struct bpf_map *map, void *key)
 static void stack_map_free(struct bpf_map *map)
 {
 	struct bpf_stack_map *smap = container_of(map, struct bpf_stack_map, map);
+	u32 id;
 
-	bpf_map_area_free(smap->elems);
-	pcpu_freelist_destroy(&smap->freelist);
+	if (stack_map_resizable(map)) {
+		/* bpf_mem_free() has to stay on one CPU */
+		migrate_disable();
+		for (id = 0; id < smap->n_buckets; id++)
+			if (smap->buckets[id])
+				bpf_mem_free(&smap->ma, smap->buckets[id]);
+		migrate_enable();
+		bpf_mem_alloc_destroy(&smap->ma);
+		free_percpu(smap->used_bytes);
+	} else {
+		bpf_map_area_free(smap->elems);
+		pcpu_freelist_destroy(&smap->freelist);
+	}
 	bpf_map_area_free(smap);
 	put_callchain_buffers();
 }
@@ -761,6 +1041,14 @@ static u64 stack_map_mem_usage(const struct bpf_map *map)
 	u64 usage = sizeof(*smap);
 
 	usage += n_buckets * sizeof(struct stack_map_bucket *);
+	if (stack_map_resizable(map)) {
+		s64 used = 0;
+		int cpu;
+
+		for_each_possible_cpu(cpu)
+			used += *per_cpu_ptr(smap->used_bytes, cpu);
+		return usage + max_t(s64, used, 0);
+	}
 	usage += enties * (sizeof(struct stack_map_bucket) + value_size);
 	return usage;
 }
@@ -514,6 +514,32 @@ int bpf_map_alloc_pages(const struct bpf_map *map, gfp_t gfp, int nid,
 	return ret;
 }
 
+/* Like bpf_map_alloc_pages(), but the 1 << @order pages are contiguous */
+int bpf_map_alloc_pages_order(const struct bpf_map *map, gfp_t gfp, int nid,
+			      unsigned int order, struct page **pages)
+{
+	unsigned long i;
+	struct page *pg;
+#ifdef CONFIG_MEMCG
+	struct mem_cgroup *memcg, *old_memcg;
+
+	memcg = bpf_map_get_memcg(map);
+	old_memcg = set_active_memcg(memcg);
+#endif
+	pg = alloc_pages_node(nid, gfp | __GFP_ACCOUNT, order);
+#ifdef CONFIG_MEMCG
+	set_active_memcg(old_memcg);
+	mem_cgroup_put(memcg);
+#endif
+	if (!pg)
+		return -ENOMEM;
+
+	split_page(pg, order);
+	for (i = 0; i < (1UL << order); i++)
+		pages[i] = nth_page(pg, i);
+	return 0;
+}
+
 
 static int btf_field_cmp(const void *a, const void *b)
 {
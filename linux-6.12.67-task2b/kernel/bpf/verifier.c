@@ -30,6 +30,7 @@
 #include <net/xdp.h>
 #include <linux/trace_events.h>
 #include <linux/kallsyms.h>
+#include <linux/jhash.h>
 
 #include "disasm.h"
 
@@ -1458,12 +1459,23 @@ static u32 state_htab_size(struct bpf_verifier_env *env)
 	return env->prog->len;
 }
 
-static struct bpf_verifier_state_list **explored_state(struct bpf_verifier_env *env, int idx)
+/* States can only be equal if they stopped at the same insn with the same
+ * chain of callsites, so explored states are hashed on all of them. Entries
+ * also keep the key to skip other states in the same bucket cheaply.
+ */
+static u32 state_key(struct bpf_verifier_state *st, int idx)
 {
-	struct bpf_verifier_state *cur = env->cur_state;
-	struct bpf_func_state *state = cur->frame[cur->curframe];
+	u32 key = idx;
+	int i;
 
-	return &env->explored_states[(idx ^ state->callsite) % state_htab_size(env)];
+	for (i = 0; i <= st->curframe; i++)
+		key = jhash_2words(key, st->frame[i]->callsite, i);
+	return key;
+}
+
+static struct bpf_verifier_state_list **explored_state(struct bpf_verifier_env *env, int idx)
+{
+	return &env->explored_states[state_key(env->cur_state, idx) % state_htab_size(env)];
 }
 
 static bool same_callsites(struct bpf_verifier_state *a, struct bpf_verifier_state *b)
@@ -18085,6 +18097,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 	struct bpf_verifier_state *cur = env->cur_state, *new, *loop_entry;
 	int i, j, n, err, states_cnt = 0;
 	bool force_new_state, add_new_state, force_exact;
+	u32 key = state_key(cur, insn_idx);
 
 	force_new_state = env->test_state_freq || is_force_checkpoint(env, insn_idx) ||
 			  /* Avoid accumulating infinitely long jmp history */
@@ -18110,7 +18123,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 
 	while (sl) {
 		states_cnt++;
-		if (sl->state.insn_idx != insn_idx)
+		if (sl->key != key || sl->state.insn_idx != insn_idx)
 			goto next;
 
 		if (sl->state.branches) {
@@ -18387,6 +18400,7 @@ next:
 	cur->first_insn_idx = insn_idx;
 	cur->insn_hist_start = cur->insn_hist_end;
 	cur->dfs_depth = new->dfs_depth + 1;
+	new_sl->key = key;
 	new_sl->next = *explored_state(env, insn_idx);
 	*explored_state(env, insn_idx) = new_sl;
 	/* connect new state to parentage chain. Current frame needs all
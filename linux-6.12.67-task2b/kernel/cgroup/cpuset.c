@@ -101,6 +101,18 @@ static struct list_head remote_children;
  */
 static bool force_sd_rebuild;
 
+/*
+ * Sched domain rebuilds requested by cgroup v2 configuration changes are
+ * deferred by up to this many milliseconds so that a burst of cpuset.cpus or
+ * cpuset.cpus.partition writes ends in a single rebuild.  0 rebuilds before
+ * the write returns.  Hotplug and cgroup v1 always rebuild synchronously.
+ */
+static unsigned int sched_rebuild_delay_ms;
+module_param(sched_rebuild_delay_ms, uint, 0644);
+
+static void cpuset_sd_rebuild_workfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(cpuset_sd_rebuild_work, cpuset_sd_rebuild_workfn);
+
 /*
  * Partition root states:
  *
@@ -1003,6 +1015,76 @@ static void dl_rebuild_rd_accounting(void)
 	rcu_read_unlock();
 }
 
+/*
+ * Copy of the last domain set handed to the scheduler, used to skip rebuilds
+ * that would not change anything.  Protected by cpuset_mutex.
+ */
+static cpumask_var_t *sd_last_doms;
+static struct sched_domain_attr *sd_last_attr;
+static int sd_last_ndoms;
+
+static bool sd_attr_equal(struct sched_domain_attr *a, int i,
+			  struct sched_domain_attr *b, int j)
+{
+	struct sched_domain_attr dflt = SD_ATTR_INIT;
+
+	return !memcmp(a ? a + i : &dflt, b ? b + j : &dflt, sizeof(dflt));
+}
+
+/* Does <@ndoms, @doms, @attr> match the domains the scheduler already has? */
+static bool sd_last_match(int ndoms, cpumask_var_t doms[],
+			  struct sched_domain_attr *attr)
+{
+	int i, j;
+
+	if (!doms || !sd_last_doms || ndoms != sd_last_ndoms)
+		return false;
+
+	for (i = 0; i < ndoms; i++) {
+		for (j = 0; j < ndoms; j++) {
+			if (cpumask_equal(doms[i], sd_last_doms[j]) &&
+			    sd_attr_equal(attr, i, sd_last_attr, j))
+				break;
+		}
+		if (j == ndoms)
+			return false;
+	}
+	return true;
+}
+
+static void sd_last_update(int ndoms, cpumask_var_t doms[],
+			   struct sched_domain_attr *attr)
+{
+	struct sched_domain_attr *last_attr = NULL;
+	cpumask_var_t *last_doms = NULL;
+	int i;
+
+	/* on allocation failure we simply stop skipping rebuilds */
+	if (doms) {
+		last_doms = alloc_sched_domains(ndoms);
+		if (attr)
+			last_attr = kmemdup(attr, ndoms * sizeof(*attr),
+					    GFP_KERNEL);
+		if (last_doms && (last_attr || !attr)) {
+			for (i = 0; i < ndoms; i++)
+				cpumask_copy(last_doms[i], doms[i]);
+		} else {
+			if (last_doms)
+				free_sched_domains(last_doms, ndoms);
+			kfree(last_attr);
+			last_doms = NULL;
+			last_attr = NULL;
+		}
+	}
+
+	if (sd_last_doms)
+		free_sched_domains(sd_last_doms, sd_last_ndoms);
+	kfree(sd_last_attr);
+	sd_last_doms = last_doms;
+	sd_last_attr = last_attr;
+	sd_last_ndoms = ndoms;
+}
+
 static void
 partition_and_rebuild_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 				    struct sched_domain_attr *dattr_new)
@@ -1013,6 +1095,8 @@ partition_and_rebuild_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 	mutex_unlock(&sched_domains_mutex);
 }
 
+static void __rebuild_sched_domains_locked(bool skip_unchanged);
+
 /*
  * Rebuild scheduler domains.
  *
@@ -1025,6 +1109,17 @@ partition_and_rebuild_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
  * Call with cpuset_mutex held.  Takes cpus_read_lock().
  */
 void rebuild_sched_domains_locked(void)
+{
+	__rebuild_sched_domains_locked(false);
+}
+
+/*
+ * With @skip_unchanged, the rebuild is skipped if the resulting domain set
+ * is identical to the one the scheduler already has.  Otherwise
+ * partition_sched_domains() only tears down and rebuilds the domains that
+ * differ, so the cost scales with the cpusets that actually changed.
+ */
+static void __rebuild_sched_domains_locked(bool skip_unchanged)
 {
 	struct cgroup_subsys_state *pos_css;
 	struct sched_domain_attr *attr;
@@ -1073,6 +1168,13 @@ void rebuild_sched_domains_locked(void)
 	/* Generate domain masks and attrs */
 	ndoms = generate_sched_domains(&doms, &attr);
 
+	if (skip_unchanged && sd_last_match(ndoms, doms, attr)) {
+		free_sched_domains(doms, ndoms);
+		kfree(attr);
+		return;
+	}
+	sd_last_update(ndoms, doms, attr);
+
 	/* Have scheduler rebuild the domains */
 	partition_and_rebuild_sched_domains(ndoms, doms, attr);
 }
@@ -1080,8 +1182,48 @@ void rebuild_sched_domains_locked(void)
 void rebuild_sched_domains_locked(void)
 {
 }
+
+static void __rebuild_sched_domains_locked(bool skip_unchanged)
+{
+}
 #endif /* CONFIG_SMP */
 
+static void cpuset_sd_rebuild_workfn(struct work_struct *work)
+{
+	cpus_read_lock();
+	mutex_lock(&cpuset_mutex);
+	/* a synchronous rebuild may have beaten us to it */
+	if (force_sd_rebuild)
+		__rebuild_sched_domains_locked(true);
+	mutex_unlock(&cpuset_mutex);
+	cpus_read_unlock();
+}
+
+/*
+ * Act on force_sd_rebuild at the end of a cpuset configuration change,
+ * either right away or, on cgroup v2, batched after sched_rebuild_delay_ms.
+ *
+ * Call with cpuset_mutex held.
+ */
+static void cpuset_commit_sd_rebuild(void)
+{
+	unsigned int delay = READ_ONCE(sched_rebuild_delay_ms);
+
+	lockdep_assert_held(&cpuset_mutex);
+
+	if (!force_sd_rebuild)
+		return;
+
+	if (!delay || !cpuset_v2()) {
+		__rebuild_sched_domains_locked(true);
+		return;
+	}
+
+	/* an already pending rebuild will pick up this change too */
+	queue_delayed_work(system_unbound_wq, &cpuset_sd_rebuild_work,
+			   msecs_to_jiffies(delay));
+}
+
 static void rebuild_sched_domains_cpuslocked(void)
 {
 	mutex_lock(&cpuset_mutex);
@@ -2915,8 +3057,7 @@ out:
 	update_partition_sd_lb(cs, old_prs);
 
 	notify_partition_change(cs, old_prs);
-	if (force_sd_rebuild)
-		rebuild_sched_domains_locked();
+	cpuset_commit_sd_rebuild();
 	free_cpumasks(NULL, &tmpmask);
 	return 0;
 }
@@ -3185,8 +3326,7 @@ ssize_t cpuset_write_resmask(struct kernfs_open_file *of,
 	}
 
 	free_cpuset(trialcs);
-	if (force_sd_rebuild)
-		rebuild_sched_domains_locked();
+	cpuset_commit_sd_rebuild();
 out_unlock:
 	mutex_unlock(&cpuset_mutex);
 	cpus_read_unlock();
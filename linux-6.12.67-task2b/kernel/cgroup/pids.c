@@ -25,6 +25,12 @@
  * pids.current tracks all child cgroup hierarchies, so parent/pids.current is
  * a superset of parent/child/pids.current.
  *
+ * To keep fork() from touching every counter up to the root, each CPU keeps a
+ * small stock of pids pre-charged to one cgroup, much like memcg does for
+ * pages.  Stocked pids are charged in the counters but not used by any task;
+ * pids.current hides them and they are drained when a limit is hit or
+ * changed.
+ *
  * Copyright (C) 2015 Aleksa Sarai <cyphar@cyphar.com>
  */
 
@@ -33,11 +39,17 @@
 #include <linux/atomic.h>
 #include <linux/cgroup.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
 #include <linux/sched/task.h>
 
 #define PIDS_MAX (PID_MAX_LIMIT + 1ULL)
 #define PIDS_MAX_STR "max"
 
+/* pids pre-charged per refill of a CPU's stock, and the most it may hold */
+#define PIDS_STOCK_BATCH	32
+#define PIDS_STOCK_MAX		(2 * PIDS_STOCK_BATCH)
+
 enum pidcg_event {
 	/* Fork failed in subtree because this pids_cgroup limit was hit. */
 	PIDCG_MAX,
@@ -65,6 +77,16 @@ struct pids_cgroup {
 	atomic64_t			events_local[NR_PIDCG_EVENTS];
 };
 
+struct pids_stock {
+	spinlock_t			lock;
+	struct pids_cgroup		*cached;	/* holds a css reference */
+	unsigned int			nr_pids;
+};
+
+static DEFINE_PER_CPU(struct pids_stock, pids_stock) = {
+	.lock = __SPIN_LOCK_UNLOCKED(pids_stock.lock),
+};
+
 static struct pids_cgroup *css_pids(struct cgroup_subsys_state *css)
 {
 	return container_of(css, struct pids_cgroup, css);
@@ -75,6 +97,12 @@ static struct pids_cgroup *parent_pids(struct pids_cgroup *pids)
 	return css_pids(pids->css.parent);
 }
 
+static bool pids_is_descendant(struct pids_cgroup *pids,
+			       struct pids_cgroup *ancestor)
+{
+	return cgroup_is_descendant(pids->css.cgroup, ancestor->css.cgroup);
+}
+
 static struct cgroup_subsys_state *
 pids_css_alloc(struct cgroup_subsys_state *parent)
 {
@@ -154,7 +182,7 @@ static void pids_charge(struct pids_cgroup *pids, int num)
 }
 
 /**
- * pids_try_charge - hierarchically try to charge the pid count
+ * __pids_try_charge - hierarchically try to charge the pid count
  * @pids: the pid cgroup state
  * @num: the number of pids to charge
  * @fail: storage of pid cgroup causing the fail
@@ -162,8 +190,15 @@ static void pids_charge(struct pids_cgroup *pids, int num)
  * This function follows the set limit. It will fail if the charge would cause
  * the new value to exceed the hierarchical limit. Returns 0 if the charge
  * succeeded, otherwise -EAGAIN.
+ *
+ * Once the whole hierarchy took the charge, the watermarks are raised to the
+ * committed counters. Forks served from a per-cpu stock don't touch the
+ * counters, so like memory.peak with memcg's charge stock, pids.peak includes
+ * the stocked pids. It can exceed the highest pids.current by those, but
+ * never misses a peak.
  */
-static int pids_try_charge(struct pids_cgroup *pids, int num, struct pids_cgroup **fail)
+static int __pids_try_charge(struct pids_cgroup *pids, int num,
+			     struct pids_cgroup **fail)
 {
 	struct pids_cgroup *p, *q;
 
@@ -180,13 +215,11 @@ static int pids_try_charge(struct pids_cgroup *pids, int num, struct pids_cgroup
 			*fail = p;
 			goto revert;
 		}
-		/*
-		 * Not technically accurate if we go over limit somewhere up
-		 * the hierarchy, but that's tolerable for the watermark.
-		 */
-		pids_update_watermark(p, new);
 	}
 
+	for (p = pids; parent_pids(p); p = parent_pids(p))
+		pids_update_watermark(p, atomic64_read(&p->counter));
+
 	return 0;
 
 revert:
@@ -197,6 +230,165 @@ revert:
 	return -EAGAIN;
 }
 
+/*
+ * Take @stock's pids if its cgroup is in @root's subtree, or unconditionally
+ * if @root is NULL.  The caller uncharges and drops the css reference.
+ */
+static struct pids_cgroup *pids_stock_take(struct pids_stock *stock,
+					   struct pids_cgroup *root,
+					   unsigned int *nr_pids)
+{
+	struct pids_cgroup *cached;
+	unsigned long flags;
+
+	spin_lock_irqsave(&stock->lock, flags);
+	cached = stock->cached;
+	if (cached && (!root || pids_is_descendant(cached, root))) {
+		*nr_pids = stock->nr_pids;
+		stock->cached = NULL;
+		stock->nr_pids = 0;
+	} else {
+		cached = NULL;
+	}
+	spin_unlock_irqrestore(&stock->lock, flags);
+
+	return cached;
+}
+
+/* return the stocked pids of every cgroup in @root's subtree */
+static void pids_drain_stocks(struct pids_cgroup *root)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct pids_stock *stock = per_cpu_ptr(&pids_stock, cpu);
+		struct pids_cgroup *cached;
+		unsigned int nr_pids;
+
+		cached = pids_stock_take(stock, root, &nr_pids);
+		if (cached) {
+			pids_uncharge(cached, nr_pids);
+			css_put(&cached->css);
+		}
+	}
+}
+
+/* number of stocked pids charged to @root's subtree, for pids.current */
+static int64_t pids_stocked(struct pids_cgroup *root)
+{
+	int64_t nr_pids = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct pids_stock *stock = per_cpu_ptr(&pids_stock, cpu);
+		unsigned long flags;
+
+		spin_lock_irqsave(&stock->lock, flags);
+		if (stock->cached && pids_is_descendant(stock->cached, root))
+			nr_pids += stock->nr_pids;
+		spin_unlock_irqrestore(&stock->lock, flags);
+	}
+
+	return nr_pids;
+}
+
+static bool pids_stock_consume(struct pids_cgroup *pids, int num)
+{
+	struct pids_stock *stock = raw_cpu_ptr(&pids_stock);
+	unsigned long flags;
+	bool ret = false;
+
+	spin_lock_irqsave(&stock->lock, flags);
+	if (stock->cached == pids && stock->nr_pids >= num) {
+		stock->nr_pids -= num;
+		ret = true;
+	}
+	spin_unlock_irqrestore(&stock->lock, flags);
+
+	return ret;
+}
+
+/* put @num pids charged to @pids into this CPU's stock */
+static void pids_stock_refill(struct pids_cgroup *pids, int num)
+{
+	struct pids_stock *stock = raw_cpu_ptr(&pids_stock);
+	struct pids_cgroup *old = NULL;
+	unsigned int old_nr = 0;
+	unsigned long flags;
+
+	spin_lock_irqsave(&stock->lock, flags);
+	if (stock->cached != pids) {
+		old = stock->cached;
+		old_nr = stock->nr_pids;
+		css_get(&pids->css);
+		stock->cached = pids;
+		stock->nr_pids = 0;
+	}
+	stock->nr_pids += num;
+	if (stock->nr_pids > PIDS_STOCK_MAX) {
+		num = stock->nr_pids - PIDS_STOCK_BATCH;
+		stock->nr_pids = PIDS_STOCK_BATCH;
+	} else {
+		num = 0;
+	}
+	spin_unlock_irqrestore(&stock->lock, flags);
+
+	if (num)
+		pids_uncharge(pids, num);
+	if (old) {
+		pids_uncharge(old, old_nr);
+		css_put(&old->css);
+	}
+}
+
+/**
+ * pids_try_charge - try to charge the pid count, preferably from the stock
+ * @pids: the pid cgroup state
+ * @num: the number of pids to charge
+ * @fail: storage of pid cgroup causing the fail
+ *
+ * Like __pids_try_charge() but charges come out of this CPU's stock when it
+ * holds pids of @pids, and a stock miss charges an extra batch to refill it.
+ * Before failing, the stocks under the cgroup at its limit are drained.
+ */
+static int pids_try_charge(struct pids_cgroup *pids, int num, struct pids_cgroup **fail)
+{
+	if (!parent_pids(pids))
+		return 0;
+
+	if (pids_stock_consume(pids, num))
+		return 0;
+
+	if (!__pids_try_charge(pids, num + PIDS_STOCK_BATCH, fail)) {
+		pids_stock_refill(pids, PIDS_STOCK_BATCH);
+		return 0;
+	}
+
+	if (!__pids_try_charge(pids, num, fail))
+		return 0;
+
+	pids_drain_stocks(*fail);
+	return __pids_try_charge(pids, num, fail);
+}
+
+/* uncharge @num pids of a task, returning them to this CPU's stock if it can */
+static void pids_task_uncharge(struct pids_cgroup *pids, int num)
+{
+	struct pids_stock *stock = raw_cpu_ptr(&pids_stock);
+	unsigned long flags;
+	bool stocked = false;
+
+	spin_lock_irqsave(&stock->lock, flags);
+	if (stock->cached == pids && stock->nr_pids + num <= PIDS_STOCK_MAX) {
+		stock->nr_pids += num;
+		stocked = true;
+	}
+	spin_unlock_irqrestore(&stock->lock, flags);
+
+	if (!stocked)
+		pids_uncharge(pids, num);
+}
+
 static int pids_can_attach(struct cgroup_taskset *tset)
 {
 	struct task_struct *task;
@@ -288,14 +480,20 @@ static void pids_cancel_fork(struct task_struct *task, struct css_set *cset)
 	struct pids_cgroup *pids;
 
 	pids = css_pids(cset->subsys[pids_cgrp_id]);
-	pids_uncharge(pids, 1);
+	pids_task_uncharge(pids, 1);
 }
 
 static void pids_release(struct task_struct *task)
 {
 	struct pids_cgroup *pids = css_pids(task_css(task, pids_cgrp_id));
 
-	pids_uncharge(pids, 1);
+	pids_task_uncharge(pids, 1);
+}
+
+static void pids_css_offline(struct cgroup_subsys_state *css)
+{
+	/* stocks pin the css, don't keep a dying cgroup around */
+	pids_drain_stocks(css_pids(css));
 }
 
 static ssize_t pids_max_write(struct kernfs_open_file *of, char *buf,
@@ -322,9 +520,11 @@ static ssize_t pids_max_write(struct kernfs_open_file *of, char *buf,
 set_limit:
 	/*
 	 * Limit updates don't need to be mutex'd, since it isn't
-	 * critical that any racing fork()s follow the new limit.
+	 * critical that any racing fork()s follow the new limit.  Stocked
+	 * pids would let later forks bypass it though, drain them.
 	 */
 	atomic64_set(&pids->limit, limit);
+	pids_drain_stocks(pids);
 	return nbytes;
 }
 
@@ -347,7 +547,7 @@ static s64 pids_current_read(struct cgroup_subsys_state *css,
 {
 	struct pids_cgroup *pids = css_pids(css);
 
-	return atomic64_read(&pids->counter);
+	return max_t(int64_t, atomic64_read(&pids->counter) - pids_stocked(pids), 0);
 }
 
 static s64 pids_peak_read(struct cgroup_subsys_state *css,
@@ -448,6 +648,7 @@ static struct cftype pids_files_legacy[] = {
 
 struct cgroup_subsys pids_cgrp_subsys = {
 	.css_alloc	= pids_css_alloc,
+	.css_offline	= pids_css_offline,
 	.css_free	= pids_css_free,
 	.can_attach 	= pids_can_attach,
 	.cancel_attach 	= pids_cancel_attach,
@@ -2,6 +2,8 @@
 #include "cgroup-internal.h"
 
 #include <linux/sched/cputime.h>
+#include <linux/moduleparam.h>
+#include <linux/wait_bit.h>
 
 #include <linux/bpf.h>
 #include <linux/btf.h>
@@ -12,6 +14,25 @@
 static DEFINE_SPINLOCK(cgroup_rstat_lock);
 static DEFINE_PER_CPU(raw_spinlock_t, cgroup_rstat_cpu_lock);
 
+/*
+ * The flush currently in progress that readers may share, see
+ * cgroup_rstat_flush_shared().  @cgroup_rstat_flush_seq is odd while
+ * @cgroup_rstat_flusher is valid.  Both are written under cgroup_rstat_lock.
+ */
+static struct cgroup *cgroup_rstat_flusher;
+static unsigned long cgroup_rstat_flush_seq;
+
+/*
+ * Readers going through cgroup_rstat_flush_shared() skip the flush if the
+ * cgroup or one of its ancestors was flushed less than this many milliseconds
+ * ago.  0 means always flush.
+ */
+static unsigned int cgroup_rstat_max_stale_ms;
+
+#undef MODULE_PARAM_PREFIX
+#define MODULE_PARAM_PREFIX "cgroup."
+module_param_named(rstat_max_stale_ms, cgroup_rstat_max_stale_ms, uint, 0644);
+
 static void cgroup_base_stat_flush(struct cgroup *cgrp, int cpu);
 
 static struct cgroup_rstat_cpu *cgroup_rstat_cpu(struct cgroup *cgrp, int cpu)
@@ -331,6 +352,83 @@ static void cgroup_rstat_flush_locked(struct cgroup *cgrp)
 	}
 }
 
+/*
+ * Flush @cgrp's subtree with cgroup_rstat_lock held and publish the flush so
+ * that readers of cgroups inside the subtree can wait for it instead of
+ * queueing up on the lock.  Only one flush is published at a time; flushes
+ * that overlap the published one simply run unpublished.
+ */
+static void __cgroup_rstat_flush(struct cgroup *cgrp)
+	__releases(&cgroup_rstat_lock) __acquires(&cgroup_rstat_lock)
+{
+	unsigned long start = jiffies;
+	bool publish = !cgroup_rstat_flusher;
+
+	if (publish) {
+		WRITE_ONCE(cgroup_rstat_flusher, cgrp);
+		smp_wmb();	/* pairs with cgroup_rstat_join_flush() */
+		WRITE_ONCE(cgroup_rstat_flush_seq, cgroup_rstat_flush_seq + 1);
+	}
+
+	cgroup_rstat_flush_locked(cgrp);
+	WRITE_ONCE(cgrp->rstat_flush_time, start);
+
+	if (publish) {
+		WRITE_ONCE(cgroup_rstat_flush_seq, cgroup_rstat_flush_seq + 1);
+		smp_wmb();	/* pairs with cgroup_rstat_join_flush() */
+		WRITE_ONCE(cgroup_rstat_flusher, NULL);
+		wake_up_var(&cgroup_rstat_flush_seq);
+	}
+}
+
+/*
+ * Wait for the published flush if it covers @cgrp.  Returns %false if there
+ * is none, in which case the caller has to flush by itself.
+ */
+static bool cgroup_rstat_join_flush(struct cgroup *cgrp)
+{
+	struct cgroup *flusher;
+	unsigned long seq;
+	bool covered;
+
+	seq = smp_load_acquire(&cgroup_rstat_flush_seq);
+	if (!(seq & 1))
+		return false;
+
+	/* cgroups are RCU freed, @flusher may be on its way out */
+	rcu_read_lock();
+	flusher = READ_ONCE(cgroup_rstat_flusher);
+	covered = flusher && cgroup_is_descendant(cgrp, flusher);
+	rcu_read_unlock();
+
+	/* @flusher may belong to a later flush, recheck */
+	smp_rmb();
+	if (!covered || READ_ONCE(cgroup_rstat_flush_seq) != seq)
+		return false;
+
+	wait_var_event(&cgroup_rstat_flush_seq,
+		       READ_ONCE(cgroup_rstat_flush_seq) != seq);
+	return true;
+}
+
+/* was @cgrp's subtree flushed within cgroup_rstat_max_stale_ms? */
+static bool cgroup_rstat_fresh(struct cgroup *cgrp)
+{
+	unsigned long max_stale;
+
+	max_stale = msecs_to_jiffies(READ_ONCE(cgroup_rstat_max_stale_ms));
+	if (!max_stale)
+		return false;
+
+	for (; cgrp; cgrp = cgroup_parent(cgrp)) {
+		unsigned long last = READ_ONCE(cgrp->rstat_flush_time);
+
+		if (last && time_before(jiffies, last + max_stale))
+			return true;
+	}
+	return false;
+}
+
 /**
  * cgroup_rstat_flush - flush stats in @cgrp's subtree
  * @cgrp: target cgroup
@@ -349,7 +447,32 @@ __bpf_kfunc void cgroup_rstat_flush(struct cgroup *cgrp)
 	might_sleep();
 
 	__cgroup_rstat_lock(cgrp, -1);
-	cgroup_rstat_flush_locked(cgrp);
+	__cgroup_rstat_flush(cgrp);
+	__cgroup_rstat_unlock(cgrp, -1);
+}
+
+/**
+ * cgroup_rstat_flush_shared - flush stats in @cgrp's subtree for a reader
+ * @cgrp: target cgroup
+ *
+ * Like cgroup_rstat_flush() but meant for stat readers which can live with
+ * slightly stale numbers.  If @cgrp's subtree was flushed within the last
+ * cgroup.rstat_max_stale_ms milliseconds, nothing is done.  If a flush
+ * covering @cgrp is already in progress, wait for it to finish instead of
+ * starting another one, so that concurrent readers never serialize behind
+ * each other's flushes.  Updates which raced with that flush may be missed.
+ *
+ * This function may block.
+ */
+void cgroup_rstat_flush_shared(struct cgroup *cgrp)
+{
+	might_sleep();
+
+	if (cgroup_rstat_fresh(cgrp) || cgroup_rstat_join_flush(cgrp))
+		return;
+
+	__cgroup_rstat_lock(cgrp, -1);
+	__cgroup_rstat_flush(cgrp);
 	__cgroup_rstat_unlock(cgrp, -1);
 }
 
@@ -367,7 +490,7 @@ void cgroup_rstat_flush_hold(struct cgroup *cgrp)
 {
 	might_sleep();
 	__cgroup_rstat_lock(cgrp, -1);
-	cgroup_rstat_flush_locked(cgrp);
+	__cgroup_rstat_flush(cgrp);
 }
 
 /**
@@ -613,11 +736,12 @@ void cgroup_base_stat_cputime_show(struct seq_file *seq)
 	struct cgroup_base_stat bstat;
 
 	if (cgroup_parent(cgrp)) {
-		cgroup_rstat_flush_hold(cgrp);
+		cgroup_rstat_flush_shared(cgrp);
+		__cgroup_rstat_lock(cgrp, -1);
 		bstat = cgrp->bstat;
 		cputime_adjust(&cgrp->bstat.cputime, &cgrp->prev_cputime,
 			       &bstat.cputime.utime, &bstat.cputime.stime);
-		cgroup_rstat_flush_release(cgrp);
+		__cgroup_rstat_unlock(cgrp, -1);
 	} else {
 		root_cgroup_cputime(&bstat);
 	}
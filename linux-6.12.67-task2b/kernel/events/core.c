@@ -55,6 +55,7 @@
 #include <linux/pgtable.h>
 #include <linux/buildid.h>
 #include <linux/task_work.h>
+#include <linux/jhash.h>
 
 #include "internal.h"
 
@@ -6803,6 +6804,9 @@ accounting:
 	if (vma->vm_flags & VM_WRITE)
 		flags |= RING_BUFFER_WRITABLE;
 
+	if (event->attr.callchain_dict)
+		flags |= RING_BUFFER_CALLCHAIN_DICT;
+
 	if (!rb) {
 		rb = rb_alloc(nr_pages,
 			      event->attr.watermark ? event->attr.wakeup_watermark : 0,
@@ -7521,6 +7525,36 @@ static void perf_output_read(struct perf_output_handle *handle,
 		perf_output_read_one(handle, event, enabled, running);
 }
 
+static void perf_output_callchain_dict(struct perf_output_handle *handle,
+				       struct perf_sample_data *data)
+{
+	struct perf_callchain_entry *entry = data->callchain;
+	u64 hash = data->callchain_hash;
+	u64 nr, ctx;
+
+	if (!data->callchain_slot) {
+		nr = 2;
+		ctx = PERF_CONTEXT_CALLCHAIN_REF;
+		perf_output_put(handle, nr);
+		perf_output_put(handle, ctx);
+		perf_output_put(handle, hash);
+		return;
+	}
+
+	nr = entry->nr + 2;
+	ctx = PERF_CONTEXT_CALLCHAIN_DEF;
+	perf_output_put(handle, nr);
+	perf_output_put(handle, ctx);
+	perf_output_put(handle, hash);
+	__output_copy(handle, entry->ip, entry->nr * sizeof(u64));
+
+	/*
+	 * Only publish the callchain once its definition has a place in the
+	 * buffer; any later reference is then written behind it.
+	 */
+	WRITE_ONCE(*data->callchain_slot, hash);
+}
+
 void perf_output_sample(struct perf_output_handle *handle,
 			struct perf_event_header *header,
 			struct perf_sample_data *data,
@@ -7564,11 +7598,15 @@ void perf_output_sample(struct perf_output_handle *handle,
 		perf_output_read(handle, event);
 
 	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
-		int size = 1;
+		if (data->callchain_hash) {
+			perf_output_callchain_dict(handle, data);
+		} else {
+			int size = 1;
 
-		size += data->callchain->nr;
-		size *= sizeof(u64);
-		__output_copy(handle, data->callchain, size);
+			size += data->callchain->nr;
+			size *= sizeof(u64);
+			__output_copy(handle, data->callchain, size);
+		}
 	}
 
 	if (sample_type & PERF_SAMPLE_RAW) {
@@ -7870,6 +7908,51 @@ static __always_inline u64 __cond_set(u64 flags, u64 s, u64 d)
 	return d * !!(flags & s);
 }
 
+/*
+ * With attr::callchain_dict, a callchain that has been written to the buffer
+ * before is replaced by a reference to it. The callchain is identified by a
+ * 64 bit hash of its entries, which doubles as the id user space keys its
+ * dictionary on, so a dictionary slot being reused by another callchain does
+ * not invalidate earlier references.
+ */
+static void perf_sample_callchain_dict(struct perf_sample_data *data,
+				       struct perf_event *event)
+{
+	struct perf_callchain_entry *entry = data->callchain;
+	struct perf_buffer *rb;
+	u32 len;
+	u64 hash, *slot;
+
+	if (entry->nr <= 2)
+		return;
+
+	if (event->parent)
+		event = event->parent;
+
+	rb = rcu_dereference(event->rb);
+	if (!rb || !rb->callchain_dict)
+		return;
+
+	len = entry->nr * sizeof(u64) / sizeof(u32);
+	hash = (u64)jhash2((u32 *)entry->ip, len, 0) << 32;
+	hash |= jhash2((u32 *)entry->ip, len, JHASH_INITVAL);
+	if (!hash)
+		hash = 1;
+
+	slot = &rb->callchain_dict[hash & (PERF_CALLCHAIN_DICT_SIZE - 1)];
+	data->callchain_hash = hash;
+
+	if (READ_ONCE(*slot) == hash) {
+		/* { nr, REF, id } instead of { nr, ips[nr] } */
+		data->callchain_slot = NULL;
+		data->dyn_size -= (entry->nr - 2) * sizeof(u64);
+	} else {
+		/* { nr + 2, DEF, id, ips[nr] } */
+		data->callchain_slot = slot;
+		data->dyn_size += 2 * sizeof(u64);
+	}
+}
+
 void perf_prepare_sample(struct perf_sample_data *data,
 			 struct perf_event *event,
 			 struct pt_regs *regs)
@@ -7877,6 +7960,8 @@ void perf_prepare_sample(struct perf_sample_data *data,
 	u64 sample_type = event->attr.sample_type;
 	u64 filtered_sample_type;
 
+	data->callchain_hash = 0;
+
 	/*
 	 * Add the sample flags that are dependent to others.  And clear the
 	 * sample flags that have already been done by the PMU driver.
@@ -7906,6 +7991,9 @@ void perf_prepare_sample(struct perf_sample_data *data,
 	if (filtered_sample_type & PERF_SAMPLE_CALLCHAIN)
 		perf_sample_save_callchain(data, event, regs);
 
+	if ((sample_type & PERF_SAMPLE_CALLCHAIN) && event->attr.callchain_dict)
+		perf_sample_callchain_dict(data, event);
+
 	if (filtered_sample_type & PERF_SAMPLE_RAW) {
 		data->raw = NULL;
 		data->dyn_size += sizeof(u64);
@@ -12640,6 +12728,14 @@ static int perf_copy_attr(struct perf_event_attr __user *uattr,
 	if (attr->sigtrap && !attr->remove_on_exec)
 		return -EINVAL;
 
+	/*
+	 * References must follow their definition in the order the buffer is
+	 * read, which does not hold for backward buffers.
+	 */
+	if (attr->callchain_dict &&
+	    (!(attr->sample_type & PERF_SAMPLE_CALLCHAIN) || attr->write_backward))
+		return -EINVAL;
+
 out:
 	return ret;
 
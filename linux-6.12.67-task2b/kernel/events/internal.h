@@ -9,6 +9,10 @@
 /* Buffer handling */
 
 #define RING_BUFFER_WRITABLE		0x01
+#define RING_BUFFER_CALLCHAIN_DICT	0x02
+
+/* slots of the per buffer callchain dictionary, see perf_sample_callchain_dict() */
+#define PERF_CALLCHAIN_DICT_SIZE	1024
 
 struct perf_buffer {
 	refcount_t			refcount;
@@ -56,6 +60,9 @@ struct perf_buffer {
 	void				**aux_pages;
 	void				*aux_priv;
 
+	/* hashes of callchains already written, for attr::callchain_dict */
+	u64				*callchain_dict;
+
 	struct perf_event_mmap_page	*user_page;
 	void				*data_pages[];
 };
@@ -14,6 +14,7 @@
 #include <linux/circ_buf.h>
 #include <linux/poll.h>
 #include <linux/nospec.h>
+#include <linux/moduleparam.h>
 
 #include "internal.h"
 
@@ -339,6 +340,15 @@ ring_buffer_init(struct perf_buffer *rb, long watermark, int flags)
 	if (!rb->nr_pages)
 		rb->paused = 1;
 
+	/*
+	 * Callchain references are only decodable if the record defining
+	 * them is still around, that is, if the buffer never overwrites
+	 * itself. Without the dictionary, callchains are written in full.
+	 */
+	if ((flags & RING_BUFFER_CALLCHAIN_DICT) && !rb->overwrite)
+		rb->callchain_dict = kcalloc(PERF_CALLCHAIN_DICT_SIZE,
+					     sizeof(u64), GFP_KERNEL);
+
 	mutex_init(&rb->aux_mutex);
 }
 
@@ -789,8 +799,20 @@ void rb_free_aux(struct perf_buffer *rb)
 
 /*
  * Back perf_mmap() with regular GFP_KERNEL-0 pages.
+ *
+ * With perf.rb_huge_pages set, the data pages are carved out of PMD sized
+ * (or smaller, if that fails) physically contiguous allocations, split into
+ * individual pages so the mapping code does not need to know. That keeps a
+ * large buffer within a few direct map TLB entries while perf_output_*()
+ * writes it.
  */
 
+static bool perf_rb_huge_pages __read_mostly;
+
+#undef MODULE_PARAM_PREFIX
+#define MODULE_PARAM_PREFIX "perf."
+module_param_named(rb_huge_pages, perf_rb_huge_pages, bool, 0644);
+
 static struct page *
 __perf_mmap_to_page(struct perf_buffer *rb, unsigned long pgoff)
 {
@@ -824,6 +846,35 @@ static void perf_mmap_free_page(void *addr)
 	__free_page(page);
 }
 
+/*
+ * Allocate up to 2^@order contiguous data pages, falling back to smaller
+ * orders. Returns the number of pages stored at @pages, 0 on failure.
+ */
+static int perf_mmap_alloc_pages(int cpu, int order, void **pages)
+{
+	struct page *page = NULL;
+	int i, node;
+
+	node = (cpu == -1) ? cpu : cpu_to_node(cpu);
+	for (order = min(order, MAX_PAGE_ORDER); order > 0; order--) {
+		page = alloc_pages_node(node, PERF_AUX_GFP, order);
+		if (page)
+			break;
+	}
+
+	/* order-0 pages get the usual GFP_KERNEL effort */
+	if (!page) {
+		pages[0] = perf_mmap_alloc_page(cpu);
+		return pages[0] ? 1 : 0;
+	}
+
+	split_page(page, order);
+	for (i = 0; i < (1 << order); i++)
+		pages[i] = page_address(page + i);
+
+	return 1 << order;
+}
+
 struct perf_buffer *rb_alloc(int nr_pages, long watermark, int cpu, int flags)
 {
 	struct perf_buffer *rb;
@@ -845,10 +896,16 @@ struct perf_buffer *rb_alloc(int nr_pages, long watermark, int cpu, int flags)
 	if (!rb->user_page)
 		goto fail_user_page;
 
-	for (i = 0; i < nr_pages; i++) {
-		rb->data_pages[i] = perf_mmap_alloc_page(cpu);
-		if (!rb->data_pages[i])
+	for (i = 0; i < nr_pages;) {
+		int order = 0, nr;
+
+		if (READ_ONCE(perf_rb_huge_pages))
+			order = min(PMD_ORDER, ilog2(nr_pages - i));
+
+		nr = perf_mmap_alloc_pages(cpu, order, &rb->data_pages[i]);
+		if (!nr)
 			goto fail_data_pages;
+		i += nr;
 	}
 
 	rb->nr_pages = nr_pages;
@@ -877,6 +934,7 @@ void rb_free(struct perf_buffer *rb)
 	perf_mmap_free_page(rb->user_page);
 	for (i = 0; i < rb->nr_pages; i++)
 		perf_mmap_free_page(rb->data_pages[i]);
+	kfree(rb->callchain_dict);
 	kfree(rb);
 }
 
@@ -913,6 +971,7 @@ static void rb_free_work(struct work_struct *work)
 		perf_mmap_unmark_page(base + (i * PAGE_SIZE));
 
 	vfree(base);
+	kfree(rb->callchain_dict);
 	kfree(rb);
 }
 
@@ -26,6 +26,7 @@
 #include <linux/task_work.h>
 #include <linux/shmem_fs.h>
 #include <linux/khugepaged.h>
+#include <linux/sort.h>
 
 #include <linux/uprobes.h>
 
@@ -44,6 +45,9 @@ static seqcount_rwlock_t uprobes_seqcount = SEQCNT_RWLOCK_ZERO(uprobes_seqcount,
 
 DEFINE_STATIC_SRCU(uprobes_srcu);
 
+/* serializes uprobe_register_batch(), which holds many register_rwsems */
+static DEFINE_MUTEX(uprobes_batch_mutex);
+
 #define UPROBES_HASH_SZ	13
 /* serialize uprobe->pending_list */
 static struct mutex uprobes_mmap_mutex[UPROBES_HASH_SZ];
@@ -1009,10 +1013,17 @@ static inline struct map_info *free_map_info(struct map_info *info)
 	return next;
 }
 
+/*
+ * Collect the mms mapping any of [@offset, @last] of @mapping, one map_info
+ * per vma. @vaddr is where @offset, or the start of the vma if it maps only
+ * later offsets, is mapped.
+ */
 static struct map_info *
-build_map_info(struct address_space *mapping, loff_t offset, bool is_register)
+build_map_info(struct address_space *mapping, loff_t offset, loff_t last,
+	       bool is_register)
 {
 	unsigned long pgoff = offset >> PAGE_SHIFT;
+	unsigned long last_pgoff = last >> PAGE_SHIFT;
 	struct vm_area_struct *vma;
 	struct map_info *curr = NULL;
 	struct map_info *prev = NULL;
@@ -1021,7 +1032,7 @@ build_map_info(struct address_space *mapping, loff_t offset, bool is_register)
 
  again:
 	i_mmap_lock_read(mapping);
-	vma_interval_tree_foreach(vma, &mapping->i_mmap, pgoff, pgoff) {
+	vma_interval_tree_foreach(vma, &mapping->i_mmap, pgoff, last_pgoff) {
 		if (!valid_vma(vma, is_register))
 			continue;
 
@@ -1049,7 +1060,8 @@ build_map_info(struct address_space *mapping, loff_t offset, bool is_register)
 		curr = info;
 
 		info->mm = vma->vm_mm;
-		info->vaddr = offset_to_vaddr(vma, offset);
+		info->vaddr = offset_to_vaddr(vma,
+				max_t(loff_t, offset, vaddr_to_offset(vma, vma->vm_start)));
 	}
 	i_mmap_unlock_read(mapping);
 
@@ -1088,7 +1100,7 @@ register_for_each_vma(struct uprobe *uprobe, struct uprobe_consumer *new)
 
 	percpu_down_write(&dup_mmap_sem);
 	info = build_map_info(uprobe->inode->i_mapping,
-					uprobe->offset, is_register);
+			      uprobe->offset, uprobe->offset, is_register);
 	if (IS_ERR(info)) {
 		err = PTR_ERR(info);
 		goto out;
@@ -1137,6 +1149,66 @@ register_for_each_vma(struct uprobe *uprobe, struct uprobe_consumer *new)
 	return err;
 }
 
+/*
+ * Install the breakpoints of a whole batch, taking each mm's mmap_lock once
+ * per vma rather than once per probe. All @entries are on the same inode and
+ * their register_rwsems are held.
+ */
+static int register_for_each_vma_batch(struct inode *inode,
+				       struct uprobe_batch_entry *entries,
+				       unsigned int cnt, loff_t first, loff_t last)
+{
+	struct map_info *info;
+	int err = 0;
+
+	percpu_down_write(&dup_mmap_sem);
+	info = build_map_info(inode->i_mapping, first, last, true);
+	if (IS_ERR(info)) {
+		err = PTR_ERR(info);
+		goto out;
+	}
+
+	while (info) {
+		struct mm_struct *mm = info->mm;
+		struct vm_area_struct *vma;
+		loff_t vm_first, vm_last;
+		unsigned int i;
+
+		if (err)
+			goto free;
+
+		/* see register_for_each_vma() for why this is a write lock */
+		mmap_write_lock(mm);
+		vma = find_vma(mm, info->vaddr);
+		if (!vma || !valid_vma(vma, true) ||
+		    file_inode(vma->vm_file) != inode ||
+		    vma->vm_start > info->vaddr)
+			goto unlock;
+
+		vm_first = vaddr_to_offset(vma, vma->vm_start);
+		vm_last = vaddr_to_offset(vma, vma->vm_end);
+
+		for (i = 0; i < cnt && !err; i++) {
+			struct uprobe_batch_entry *e = &entries[i];
+
+			if (e->offset < vm_first || e->offset >= vm_last)
+				continue;
+			if (consumer_filter(e->uc, mm))
+				err = install_breakpoint(e->uprobe, mm, vma,
+						offset_to_vaddr(vma, e->offset));
+		}
+
+ unlock:
+		mmap_write_unlock(mm);
+ free:
+		mmput(mm);
+		info = free_map_info(info);
+	}
+ out:
+	percpu_up_write(&dup_mmap_sem);
+	return err;
+}
+
 /**
  * uprobe_unregister_nosync - unregister an already registered probe.
  * @uprobe: uprobe to remove
@@ -1176,6 +1248,34 @@ void uprobe_unregister_sync(void)
 }
 EXPORT_SYMBOL_GPL(uprobe_unregister_sync);
 
+static int uprobe_register_check(struct inode *inode,
+				 loff_t offset, loff_t ref_ctr_offset,
+				 struct uprobe_consumer *uc)
+{
+	/* Uprobe must have at least one set consumer */
+	if (!uc->handler && !uc->ret_handler)
+		return -EINVAL;
+
+	/* copy_insn() uses read_mapping_page() or shmem_read_mapping_page() */
+	if (!inode->i_mapping->a_ops->read_folio &&
+	    !shmem_mapping(inode->i_mapping))
+		return -EIO;
+	/* Racy, just to catch the obvious mistakes */
+	if (offset > i_size_read(inode))
+		return -EINVAL;
+
+	/*
+	 * This ensures that copy_from_page(), copy_to_page() and
+	 * __update_ref_ctr() can't cross page boundary.
+	 */
+	if (!IS_ALIGNED(offset, UPROBE_SWBP_INSN_SIZE))
+		return -EINVAL;
+	if (!IS_ALIGNED(ref_ctr_offset, sizeof(short)))
+		return -EINVAL;
+
+	return 0;
+}
+
 /**
  * uprobe_register - register a probe
  * @inode: the file in which the probe has to be placed.
@@ -1201,26 +1301,9 @@ struct uprobe *uprobe_register(struct inode *inode,
 	struct uprobe *uprobe;
 	int ret;
 
-	/* Uprobe must have at least one set consumer */
-	if (!uc->handler && !uc->ret_handler)
-		return ERR_PTR(-EINVAL);
-
-	/* copy_insn() uses read_mapping_page() or shmem_read_mapping_page() */
-	if (!inode->i_mapping->a_ops->read_folio &&
-	    !shmem_mapping(inode->i_mapping))
-		return ERR_PTR(-EIO);
-	/* Racy, just to catch the obvious mistakes */
-	if (offset > i_size_read(inode))
-		return ERR_PTR(-EINVAL);
-
-	/*
-	 * This ensures that copy_from_page(), copy_to_page() and
-	 * __update_ref_ctr() can't cross page boundary.
-	 */
-	if (!IS_ALIGNED(offset, UPROBE_SWBP_INSN_SIZE))
-		return ERR_PTR(-EINVAL);
-	if (!IS_ALIGNED(ref_ctr_offset, sizeof(short)))
-		return ERR_PTR(-EINVAL);
+	ret = uprobe_register_check(inode, offset, ref_ctr_offset, uc);
+	if (ret)
+		return ERR_PTR(ret);
 
 	uprobe = alloc_uprobe(inode, offset, ref_ctr_offset);
 	if (IS_ERR(uprobe))
@@ -1246,6 +1329,112 @@ struct uprobe *uprobe_register(struct inode *inode,
 }
 EXPORT_SYMBOL_GPL(uprobe_register);
 
+static int uprobe_ptr_cmp(const void *a, const void *b)
+{
+	const struct uprobe *l = *(const struct uprobe **)a;
+	const struct uprobe *r = *(const struct uprobe **)b;
+
+	return l < r ? -1 : l > r;
+}
+
+/**
+ * uprobe_register_batch - register many probes on the same file
+ * @inode: the file in which the probes have to be placed.
+ * @entries: offset, ref_ctr_offset and consumer of each probe.
+ * @cnt: number of @entries.
+ *
+ * Same as calling uprobe_register() for each entry, but the mms mapping
+ * @inode are walked only once for the whole batch instead of once per probe.
+ * On success, each entry's @uprobe is set and has to be unregistered with
+ * uprobe_unregister_nosync() as usual. On failure nothing stays registered.
+ *
+ * Return: 0 on success or negative error code.
+ */
+int uprobe_register_batch(struct inode *inode,
+			  struct uprobe_batch_entry *entries, unsigned int cnt)
+{
+	loff_t first = LLONG_MAX, last = 0;
+	struct uprobe **sorted;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < cnt; i++) {
+		struct uprobe_batch_entry *e = &entries[i];
+
+		ret = uprobe_register_check(inode, e->offset,
+					    e->ref_ctr_offset, e->uc);
+		if (ret)
+			return ret;
+		first = min(first, e->offset);
+		last = max(last, e->offset);
+		e->uprobe = NULL;
+	}
+	if (!cnt)
+		return 0;
+
+	sorted = kvmalloc_array(cnt, sizeof(*sorted), GFP_KERNEL);
+	if (!sorted)
+		return -ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		struct uprobe *uprobe;
+
+		uprobe = alloc_uprobe(inode, entries[i].offset,
+				      entries[i].ref_ctr_offset);
+		if (IS_ERR(uprobe)) {
+			ret = PTR_ERR(uprobe);
+			goto put;
+		}
+		entries[i].uprobe = sorted[i] = uprobe;
+	}
+
+	/*
+	 * Several entries may share a uprobe; lock each one once, in address
+	 * order, so concurrent batches can't deadlock against each other.
+	 */
+	sort(sorted, cnt, sizeof(*sorted), uprobe_ptr_cmp, NULL);
+
+	mutex_lock(&uprobes_batch_mutex);
+	for (i = 0; i < cnt; i++) {
+		if (i && sorted[i] == sorted[i - 1])
+			continue;
+		down_write_nest_lock(&sorted[i]->register_rwsem,
+				     &uprobes_batch_mutex);
+	}
+
+	for (i = 0; i < cnt; i++)
+		consumer_add(entries[i].uprobe, entries[i].uc);
+
+	ret = register_for_each_vma_batch(inode, entries, cnt, first, last);
+
+	for (i = 0; i < cnt; i++) {
+		if (i && sorted[i] == sorted[i - 1])
+			continue;
+		up_write(&sorted[i]->register_rwsem);
+	}
+	mutex_unlock(&uprobes_batch_mutex);
+	kvfree(sorted);
+
+	if (ret) {
+		for (i = 0; i < cnt; i++) {
+			uprobe_unregister_nosync(entries[i].uprobe, entries[i].uc);
+			entries[i].uprobe = NULL;
+		}
+		/* see uprobe_register() */
+		uprobe_unregister_sync();
+	}
+	return ret;
+
+put:
+	while (i--) {
+		put_uprobe(entries[i].uprobe);
+		entries[i].uprobe = NULL;
+	}
+	kvfree(sorted);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(uprobe_register_batch);
+
 /**
  * uprobe_apply - add or remove the breakpoints according to @uc->filter
  * @uprobe: uprobe which "owns" the breakpoint
@@ -2112,12 +2301,40 @@ static int is_trap_at_addr(struct mm_struct *mm, unsigned long vaddr)
 }
 
 /* assumes being inside RCU protected region */
+/*
+ * Look the uprobe up under the per-VMA lock instead of mmap_lock, so hot
+ * probes in a multi-threaded process don't all bounce on it. Only a hit is
+ * conclusive: registration installs breakpoints under mmap_lock, so telling
+ * a stray breakpoint from a racing registration is left to the slow path.
+ */
+static struct uprobe *find_active_uprobe_speculative(unsigned long bp_vaddr)
+{
+	struct mm_struct *mm = current->mm;
+	struct uprobe *uprobe = NULL;
+	struct vm_area_struct *vma;
+
+	vma = lock_vma_under_rcu(mm, bp_vaddr);
+	if (!vma)
+		return NULL;
+
+	if (valid_vma(vma, false))
+		uprobe = find_uprobe_rcu(file_inode(vma->vm_file),
+					 vaddr_to_offset(vma, bp_vaddr));
+	vma_end_read(vma);
+
+	return uprobe;
+}
+
 static struct uprobe *find_active_uprobe_rcu(unsigned long bp_vaddr, int *is_swbp)
 {
 	struct mm_struct *mm = current->mm;
 	struct uprobe *uprobe = NULL;
 	struct vm_area_struct *vma;
 
+	uprobe = find_active_uprobe_speculative(bp_vaddr);
+	if (uprobe)
+		return uprobe;
+
 	mmap_read_lock(mm);
 	vma = vma_lookup(mm, bp_vaddr);
 	if (vma) {
@@ -382,6 +382,65 @@ SYSCALL_DEFINE4(futex_wake,
 	return futex_wake(uaddr, FLAGS_STRICT | flags, nr, mask);
 }
 
+/*
+ * sys_futex_wakev - Wake waiters on a list of futexes
+ * @waiters:	Array of futexes, each with val set to the number to wake
+ * @nr_futexes:	Length of the array, at most FUTEX_WAITV_MAX
+ * @flags:	unused
+ *
+ * The vectored counterpart of futex_wake(), for releasing many futex based
+ * locks at once: one syscall, one lock round-trip per hash bucket and one
+ * wakeup pass for the lot. Returns the total number of woken waiters.
+ */
+
+SYSCALL_DEFINE3(futex_wakev,
+		struct futex_waitv __user *, waiters,
+		unsigned int, nr_futexes,
+		unsigned int, flags)
+{
+	struct futex_vector *futexv;
+	struct futex_waitv aux;
+	unsigned int i;
+	int ret;
+
+	if (flags)
+		return -EINVAL;
+
+	if (!nr_futexes || nr_futexes > FUTEX_WAITV_MAX || !waiters)
+		return -EINVAL;
+
+	futexv = kcalloc(nr_futexes, sizeof(*futexv), GFP_KERNEL);
+	if (!futexv)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_futexes; i++) {
+		unsigned int fl;
+
+		ret = -EFAULT;
+		if (copy_from_user(&aux, &waiters[i], sizeof(aux)))
+			goto out;
+
+		ret = -EINVAL;
+		if ((aux.flags & ~FUTEX2_VALID_MASK) || aux.__reserved ||
+		    aux.val > INT_MAX)
+			goto out;
+
+		fl = futex2_to_flags(aux.flags);
+		if (!futex_flags_valid(fl))
+			goto out;
+
+		futexv[i].w.flags = fl;
+		futexv[i].w.val = aux.val;
+		futexv[i].w.uaddr = aux.uaddr;
+		futexv[i].q = futex_q_init;
+	}
+
+	ret = futex_wake_multiple(futexv, nr_futexes);
+out:
+	kfree(futexv);
+	return ret;
+}
+
 /*
  * sys_futex_wait - Wait on a futex
  * @uaddr:	Address of the futex to wait on
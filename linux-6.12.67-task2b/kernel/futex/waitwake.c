@@ -200,6 +200,71 @@ int futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	return ret;
 }
 
+/**
+ * futex_wake_multiple - Wake waiters on a list of futexes
+ * @vs:		The futex list, w.val is the number of waiters to wake on each
+ * @count:	The size of the list
+ *
+ * Each hash bucket is locked only once however many of the futexes hash to
+ * it, and all woken tasks are collected into a single wake_q that is only
+ * flushed at the end. All keys are looked up before anything is woken, so a
+ * bad address fails the whole call without side effects.
+ *
+ * Return: the total number of woken waiters, or an error code.
+ */
+int futex_wake_multiple(struct futex_vector *vs, unsigned int count)
+{
+	DECLARE_BITMAP(done, FUTEX_WAITV_MAX) = { };
+	DEFINE_WAKE_Q(wake_q);
+	unsigned int i, j;
+	int woken = 0, ret;
+
+	for (i = 0; i < count; i++) {
+		ret = get_futex_key(u64_to_user_ptr(vs[i].w.uaddr),
+				    vs[i].w.flags, &vs[i].q.key, FUTEX_READ);
+		if (unlikely(ret))
+			return ret;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct futex_hash_bucket *hb;
+
+		if (test_bit(i, done))
+			continue;
+
+		hb = futex_hash(&vs[i].q.key);
+		if (!futex_hb_waiters_pending(hb))
+			continue;
+
+		spin_lock(&hb->lock);
+		for (j = i; j < count; j++) {
+			struct futex_q *this, *next;
+			int nr = 0;
+
+			if (test_bit(j, done) || !vs[j].w.val ||
+			    futex_hash(&vs[j].q.key) != hb)
+				continue;
+			__set_bit(j, done);
+
+			plist_for_each_entry_safe(this, next, &hb->chain, list) {
+				if (!futex_match(&this->key, &vs[j].q.key))
+					continue;
+				/* PI futexes are never woken this way */
+				if (this->pi_state || this->rt_waiter)
+					break;
+				this->wake(&wake_q, this);
+				if (++nr >= vs[j].w.val)
+					break;
+			}
+			woken += nr;
+		}
+		spin_unlock(&hb->lock);
+	}
+
+	wake_up_q(&wake_q);
+	return woken;
+}
+
 static int futex_atomic_op_inuser(unsigned int encoded_op, u32 __user *uaddr)
 {
 	unsigned int op =	  (encoded_op & 0x70000000) >> 28;
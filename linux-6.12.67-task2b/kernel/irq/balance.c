@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Load based interrupt rebalancing.
+ *
+ * Periodically samples the interrupt counts of all device interrupts and
+ * attributes them to the CPU the interrupt is currently delivered to (its
+ * effective affinity). If the busiest CPU gets noticeably more interrupts
+ * than a CPU some of its interrupts could be delivered to instead, one such
+ * interrupt is moved over per interval.
+ *
+ * Only the effective affinity is changed; the affinity mask set by user
+ * space or the driver is left alone and still bounds where an interrupt may
+ * go. Vector allocation goes through the irq chip as for any other affinity
+ * change, so a target CPU without free vectors simply fails the move.
+ *
+ * Managed interrupts are never moved. For those sitting on the busiest CPU a
+ * less loaded CPU from their affinity mask is recorded instead, which drivers
+ * can query with irq_balance_hint() to steer work submission.
+ */
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "internals.h"
+
+static bool irq_balance_enabled;
+static unsigned int irq_balance_interval_ms = 1000;
+static unsigned int irq_balance_threshold_pct = 25;
+static unsigned int irq_balance_min_rate = 1000;
+
+static unsigned long *irq_balance_load;
+static cpumask_var_t irq_balance_saved_mask;
+static bool irq_balance_ready;
+
+static void irq_balance_workfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(irq_balance_work, irq_balance_workfn);
+
+static void irq_balance_kick(void)
+{
+	if (READ_ONCE(irq_balance_ready) && READ_ONCE(irq_balance_enabled))
+		mod_delayed_work(system_unbound_wq, &irq_balance_work,
+				 msecs_to_jiffies(irq_balance_interval_ms));
+}
+
+static int irq_balance_enable_set(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_bool(val, kp);
+
+	if (!ret)
+		irq_balance_kick();
+	return ret;
+}
+
+static const struct kernel_param_ops irq_balance_enable_ops = {
+	.set	= irq_balance_enable_set,
+	.get	= param_get_bool,
+};
+
+#undef MODULE_PARAM_PREFIX
+#define MODULE_PARAM_PREFIX "irq_balance."
+module_param_cb(enable, &irq_balance_enable_ops, &irq_balance_enabled, 0644);
+module_param_named(interval_ms, irq_balance_interval_ms, uint, 0644);
+module_param_named(threshold_pct, irq_balance_threshold_pct, uint, 0644);
+module_param_named(min_rate, irq_balance_min_rate, uint, 0644);
+
+/*
+ * Interrupts the balancer may move. The move itself rechecks all of this
+ * under desc->lock.
+ */
+static bool irq_balance_movable(struct irq_desc *desc)
+{
+	struct irq_data *data = irq_desc_get_irq_data(desc);
+
+	return desc->action && irqd_can_balance(data) &&
+	       !irqd_affinity_is_managed(data) && irq_can_move_pcntxt(data) &&
+	       !irqd_is_setaffinity_pending(data);
+}
+
+static unsigned int irq_balance_cpu(struct irq_desc *desc)
+{
+	struct irq_data *data = irq_desc_get_irq_data(desc);
+
+	return cpumask_first(irq_data_get_effective_affinity_mask(data));
+}
+
+/* the least loaded online CPU in @desc's affinity mask */
+static unsigned int irq_balance_coldest(struct irq_desc *desc)
+{
+	unsigned int cpu, coldest = nr_cpu_ids;
+
+	for_each_cpu_and(cpu, desc->irq_common_data.affinity, cpu_online_mask) {
+		if (coldest >= nr_cpu_ids ||
+		    irq_balance_load[cpu] < irq_balance_load[coldest])
+			coldest = cpu;
+	}
+	return coldest;
+}
+
+/*
+ * Deliver @desc to @cpu without touching its affinity mask. Returns 0 on
+ * success.
+ */
+static int irq_balance_move(struct irq_desc *desc, unsigned int cpu)
+{
+	struct cpumask *affinity = desc->irq_common_data.affinity;
+	struct irq_data *data = irq_desc_get_irq_data(desc);
+	unsigned long flags;
+	int ret = -EBUSY;
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	if (irq_balance_movable(desc) && irqd_is_activated(data) &&
+	    cpumask_test_cpu(cpu, affinity) && cpu_online(cpu)) {
+		cpumask_copy(irq_balance_saved_mask, affinity);
+		ret = irq_do_set_affinity(data, cpumask_of(cpu), false);
+		cpumask_copy(affinity, irq_balance_saved_mask);
+	}
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+
+	return ret;
+}
+
+/* Sample the interrupt rates and move at most one interrupt. */
+static void irq_balance_one(void)
+{
+	unsigned long threshold, min_load, gap, best_delta = 0;
+	unsigned int irq, cpu, hot = nr_cpu_ids, best_irq = 0;
+	unsigned int best_cpu = nr_cpu_ids;
+	struct irq_desc *desc;
+
+	memset(irq_balance_load, 0, nr_cpu_ids * sizeof(*irq_balance_load));
+
+	irq_lock_sparse();
+
+	for_each_active_irq(irq) {
+		unsigned int count;
+
+		desc = irq_to_desc(irq);
+		if (!desc || irqd_is_per_cpu(irq_desc_get_irq_data(desc)))
+			continue;
+
+		count = data_race(desc->tot_count);
+		desc->balance_delta = count - desc->balance_count;
+		desc->balance_count = count;
+
+		cpu = irq_balance_cpu(desc);
+		if (cpu < nr_cpu_ids)
+			irq_balance_load[cpu] += desc->balance_delta;
+	}
+
+	for_each_online_cpu(cpu) {
+		if (hot >= nr_cpu_ids || irq_balance_load[cpu] > irq_balance_load[hot])
+			hot = cpu;
+	}
+
+	min_load = (unsigned long)irq_balance_min_rate * irq_balance_interval_ms /
+		   MSEC_PER_SEC;
+	if (hot >= nr_cpu_ids || irq_balance_load[hot] < max(min_load, 1UL))
+		goto unlock;
+	threshold = irq_balance_load[hot] * irq_balance_threshold_pct / 100;
+
+	/*
+	 * Pick the interrupt on the busiest CPU which closes most of the gap
+	 * to the coldest CPU it may move to, without overshooting it.
+	 */
+	for_each_active_irq(irq) {
+		unsigned int cold;
+
+		desc = irq_to_desc(irq);
+		if (!desc)
+			continue;
+		WRITE_ONCE(desc->balance_hint, -1);
+		if (irqd_is_per_cpu(irq_desc_get_irq_data(desc)) ||
+		    irq_balance_cpu(desc) != hot)
+			continue;
+
+		cold = irq_balance_coldest(desc);
+		if (cold >= nr_cpu_ids || cold == hot)
+			continue;
+		gap = irq_balance_load[hot] - irq_balance_load[cold];
+		if (gap <= threshold)
+			continue;
+
+		if (irqd_affinity_is_managed(irq_desc_get_irq_data(desc))) {
+			WRITE_ONCE(desc->balance_hint, cold);
+			continue;
+		}
+
+		if (irq_balance_movable(desc) && desc->balance_delta &&
+		    desc->balance_delta <= gap / 2 &&
+		    desc->balance_delta > best_delta) {
+			best_delta = desc->balance_delta;
+			best_irq = irq;
+			best_cpu = cold;
+		}
+	}
+
+	if (best_cpu < nr_cpu_ids) {
+		desc = irq_to_desc(best_irq);
+		if (desc)
+			irq_balance_move(desc, best_cpu);
+	}
+
+unlock:
+	irq_unlock_sparse();
+}
+
+static void irq_balance_workfn(struct work_struct *work)
+{
+	if (!READ_ONCE(irq_balance_enabled))
+		return;
+
+	irq_balance_one();
+	irq_balance_kick();
+}
+
+/**
+ * irq_balance_hint - suggest a less loaded CPU for a managed interrupt
+ * @irq:	Interrupt number
+ *
+ * Returns a CPU from the affinity mask of @irq which receives noticeably fewer
+ * interrupts than the CPU @irq is delivered to, or -1 if there is none or
+ * balancing is disabled. Managed interrupts are not moved by the kernel;
+ * drivers may use the hint to direct submissions towards that CPU.
+ */
+int irq_balance_hint(unsigned int irq)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+
+	if (!desc || !READ_ONCE(irq_balance_enabled))
+		return -1;
+	return READ_ONCE(desc->balance_hint);
+}
+EXPORT_SYMBOL_GPL(irq_balance_hint);
+
+static int __init irq_balance_init(void)
+{
+	irq_balance_load = kcalloc(nr_cpu_ids, sizeof(*irq_balance_load),
+				   GFP_KERNEL);
+	if (!irq_balance_load)
+		return -ENOMEM;
+	if (!alloc_cpumask_var(&irq_balance_saved_mask, GFP_KERNEL)) {
+		kfree(irq_balance_load);
+		return -ENOMEM;
+	}
+
+	WRITE_ONCE(irq_balance_ready, true);
+	irq_balance_kick();
+	return 0;
+}
+late_initcall(irq_balance_init);
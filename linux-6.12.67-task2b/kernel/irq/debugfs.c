@@ -155,6 +155,29 @@ static const struct irq_bit_descr irqdesc_istates[] = {
 };
 
 
+#ifdef CONFIG_IRQ_TIMINGS
+static void irq_debug_show_timings(struct seq_file *m, struct irq_desc *desc)
+{
+	static const char * const modes[] = {
+		[IRQ_TIMINGS_HINT_NONE]		= "none",
+		[IRQ_TIMINGS_HINT_IMMEDIATE]	= "immediate",
+		[IRQ_TIMINGS_HINT_BATCH]	= "batch",
+	};
+	struct irq_timings_hint hint;
+
+	if (!static_branch_unlikely(&irq_timing_enabled) ||
+	    irq_timings_get_hint(irq_desc_get_irq(desc), &hint))
+		return;
+
+	seq_printf(m, "timings:  interval %llu ns, next %llu ns\n",
+		   hint.interval_ns, hint.next_ns);
+	seq_printf(m, "coalesce: %s %llu ns\n", modes[hint.mode], hint.delay_ns);
+}
+#else
+static inline void irq_debug_show_timings(struct seq_file *m,
+					  struct irq_desc *desc) { }
+#endif
+
 static int irq_debug_show(struct seq_file *m, void *p)
 {
 	struct irq_desc *desc = m->private;
@@ -179,6 +202,7 @@ static int irq_debug_show(struct seq_file *m, void *p)
 	irq_debug_show_masks(m, desc);
 	irq_debug_show_data(m, data, 0);
 	raw_spin_unlock_irq(&desc->lock);
+	irq_debug_show_timings(m, desc);
 	return 0;
 }
 
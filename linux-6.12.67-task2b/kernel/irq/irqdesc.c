@@ -131,6 +131,10 @@ static void desc_set_defaults(unsigned int irq, struct irq_desc *desc, int node,
 	desc->irq_count = 0;
 	desc->irqs_unhandled = 0;
 	desc->tot_count = 0;
+#ifdef CONFIG_IRQ_BALANCE
+	desc->balance_count = 0;
+	desc->balance_hint = -1;
+#endif
 	desc->name = NULL;
 	desc->owner = owner;
 	for_each_possible_cpu(cpu)
@@ -27,12 +27,30 @@ void irq_timings_enable(void)
 {
 	static_branch_enable(&irq_timing_enabled);
 }
+EXPORT_SYMBOL_GPL(irq_timings_enable);
 
 void irq_timings_disable(void)
 {
 	static_branch_disable(&irq_timing_enabled);
 }
 
+static bool irq_timings_boot_enable __initdata;
+
+static int __init irq_timings_setup(char *str)
+{
+	irq_timings_boot_enable = true;
+	return 1;
+}
+__setup("irq_timings", irq_timings_setup);
+
+static int __init irq_timings_boot_init(void)
+{
+	if (irq_timings_boot_enable)
+		irq_timings_enable();
+	return 0;
+}
+early_initcall(irq_timings_boot_init);
+
 /*
  * The main goal of this algorithm is to predict the next interrupt
  * occurrence on the current CPU.
@@ -288,6 +306,7 @@ void irq_timings_disable(void)
 
 struct irqt_stat {
 	u64	last_ts;
+	u64	ema_interval;
 	u64	ema_time[PREDICTION_BUFFER_SIZE];
 	int	timings[IRQ_TIMINGS_SIZE];
 	int	circ_timings[IRQ_TIMINGS_SIZE];
@@ -504,9 +523,29 @@ static inline void irq_timings_store(int irq, struct irqt_stat *irqs, u64 ts)
 		return;
 	}
 
+	irqs->ema_interval = irq_timings_ema_new(interval, irqs->ema_interval);
 	__irq_timings_store(irq, irqs, interval);
 }
 
+/*
+ * Inject the measured irq/timestamp pairs of this CPU into the prediction
+ * model, consuming the circular buffer. Must be called with the local irq
+ * disabled.
+ */
+static void irq_timings_consume(struct irq_timings *irqts)
+{
+	struct irqt_stat __percpu *s;
+	int i, irq;
+	u64 ts;
+
+	for_each_irqts(i, irqts) {
+		irq = irq_timing_decode(irqts->values[i], &ts);
+		s = idr_find(&irqt_stats, irq);
+		if (s)
+			irq_timings_store(irq, this_cpu_ptr(s), ts);
+	}
+}
+
 /**
  * irq_timings_next_event - Return when the next event is supposed to arrive
  *
@@ -539,7 +578,7 @@ u64 irq_timings_next_event(u64 now)
 	struct irqt_stat *irqs;
 	struct irqt_stat __percpu *s;
 	u64 ts, next_evt = U64_MAX;
-	int i, irq = 0;
+	int i;
 
 	/*
 	 * This function must be called with the local irq disabled in
@@ -565,12 +604,7 @@ u64 irq_timings_next_event(u64 now)
 	 * model while decrementing the counter because we consume the
 	 * data from our circular buffer.
 	 */
-	for_each_irqts(i, irqts) {
-		irq = irq_timing_decode(irqts->values[i], &ts);
-		s = idr_find(&irqt_stats, irq);
-		if (s)
-			irq_timings_store(irq, this_cpu_ptr(s), ts);
-	}
+	irq_timings_consume(irqts);
 
 	/*
 	 * Look in the list of interrupts' statistics, the earliest
@@ -591,6 +625,85 @@ u64 irq_timings_next_event(u64 now)
 	return next_evt;
 }
 
+/*
+ * Interrupts arriving closer than IRQ_TIMINGS_HINT_BATCH_NS apart on average
+ * are worth batching; interrupts further apart than
+ * IRQ_TIMINGS_HINT_SPARSE_NS are latency sensitive and should fire right
+ * away. In between, a predicted next occurrence closer than the batching
+ * bound still makes batching worthwhile.
+ */
+#define IRQ_TIMINGS_HINT_BATCH_NS	(50 * NSEC_PER_USEC)
+#define IRQ_TIMINGS_HINT_SPARSE_NS	(1 * NSEC_PER_MSEC)
+#define IRQ_TIMINGS_HINT_DELAY_MAX_NS	(200 * NSEC_PER_USEC)
+
+/**
+ * irq_timings_get_hint - Return an interrupt coalescing hint for an interrupt
+ * @irq:	Interrupt number
+ * @hint:	Where to store the hint
+ *
+ * Folds the interrupt timings recorded on this CPU into the prediction
+ * model, then derives from the average interval of @irq over all CPUs and
+ * the predicted next occurrence on this CPU whether the device should
+ * batch its interrupts and for how long, or fire them immediately.
+ * Drivers are expected to call this from the CPU handling the queue, e.g.
+ * from their polling loop, and only requires irq_timings_enable().
+ *
+ * Returns 0 on success, -ENOENT if @irq has no timing statistics.
+ */
+int irq_timings_get_hint(unsigned int irq, struct irq_timings_hint *hint)
+{
+	struct irqt_stat __percpu *s;
+	u64 now, next, interval = U64_MAX;
+	unsigned long flags;
+	int cpu;
+
+	memset(hint, 0, sizeof(*hint));
+
+	s = idr_find(&irqt_stats, irq);
+	if (!s)
+		return -ENOENT;
+
+	local_irq_save(flags);
+	irq_timings_consume(this_cpu_ptr(&irq_timings));
+	now = local_clock();
+	next = __irq_timings_next_event(this_cpu_ptr(s), irq, now);
+	local_irq_restore(flags);
+
+	for_each_possible_cpu(cpu) {
+		struct irqt_stat *irqs = per_cpu_ptr(s, cpu);
+		u64 last_ts = data_race(irqs->last_ts);
+		u64 ema = data_race(irqs->ema_interval);
+
+		if (!last_ts || now - last_ts >= NSEC_PER_SEC || !ema)
+			continue;
+		interval = min(interval, ema);
+	}
+
+	if (interval == U64_MAX || interval >= IRQ_TIMINGS_HINT_SPARSE_NS) {
+		hint->mode = IRQ_TIMINGS_HINT_IMMEDIATE;
+		hint->interval_ns = interval == U64_MAX ? 0 : interval;
+		return 0;
+	}
+
+	hint->interval_ns = interval;
+	if (next != U64_MAX && next > now)
+		hint->next_ns = next - now;
+
+	if (interval < IRQ_TIMINGS_HINT_BATCH_NS) {
+		hint->mode = IRQ_TIMINGS_HINT_BATCH;
+		hint->delay_ns = min_t(u64, interval * PREDICTION_FACTOR,
+				       IRQ_TIMINGS_HINT_DELAY_MAX_NS);
+	} else if (hint->next_ns && hint->next_ns < IRQ_TIMINGS_HINT_BATCH_NS) {
+		hint->mode = IRQ_TIMINGS_HINT_BATCH;
+		hint->delay_ns = hint->next_ns;
+	} else {
+		hint->mode = IRQ_TIMINGS_HINT_NONE;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(irq_timings_get_hint);
+
 void irq_timings_free(int irq)
 {
 	struct irqt_stat __percpu *s;
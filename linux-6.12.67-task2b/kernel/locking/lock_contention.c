@@ -0,0 +1,720 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Sampling lock contention profiler
+ *
+ * Attaches to the contention_begin/contention_end tracepoints that the
+ * qspinlock, qrwlock, mutex, rwsem, semaphore and rtmutex slow paths already
+ * emit, and samples one in sample_period contended acquisitions per CPU. For
+ * a sampled acquisition it records the call site (the first caller outside of
+ * lock and scheduler text), the wait time, how much of that wait was spent
+ * spinning, and for mutexes and rwsems the time until the lock is released.
+ *
+ * Nothing is hooked until profiling is enabled, and lockdep is not needed,
+ * so this can be used on production kernels:
+ *
+ *   <debugfs>/lock_contention/enable		- write 1/0 to start/stop
+ *   <debugfs>/lock_contention/sample_period	- sample 1 in N, default 64
+ *   <debugfs>/lock_contention/profile	- per call site summary
+ *   <debugfs>/lock_contention/histogram	- per call site wait histogram
+ *   <debugfs>/lock_contention/delta	- raw totals since the last read
+ *   <debugfs>/lock_contention/by_lock	- also tell sites apart by lock
+ *   <debugfs>/lock_contention/reset		- write to clear the data
+ *
+ * Wait times land in log4 buckets: bucket i counts waits in [4^i, 4^(i+1)) ns,
+ * the last one everything from about a second up.
+ *
+ * The counters are per CPU, so that a hot lock contended from many CPUs does
+ * not also bounce the cache line of its statistics around. Only the site
+ * table and the maxima are shared. Each open file of delta keeps its own
+ * copy of the totals it last reported, a monitoring daemon can keep it open
+ * and pread() it periodically to stream what changed in between.
+ *
+ * The statistics are updated without locks and are only approximate.
+ */
+#include <linux/debugfs.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/sched/clock.h>
+#include <linux/sched/debug.h>
+#include <linux/seq_file.h>
+#include <linux/stacktrace.h>
+#include <linux/tracepoint.h>
+#include <trace/events/lock.h>
+
+#include "lock_contention.h"
+
+#define LCP_DIR			"lock_contention"
+#define LCP_SITE_BITS		9
+#define LCP_NR_SITES		(1U << LCP_SITE_BITS)
+#define LCP_NR_PROBES		8
+#define LCP_HIST_BUCKETS	16
+#define LCP_STACK_DEPTH		16
+#define LCP_SITE_BUSY		1UL	/* slot being claimed */
+
+struct lcp_site {
+	unsigned long		site;
+	void			*lock;		/* NULL unless by_lock */
+	unsigned int		flags;
+	u64			wait_max;
+	u64			hold_max;
+};
+
+/* per CPU counters of a site, indexed like lcp_sites[] */
+struct lcp_stats {
+	unsigned long		samples;
+	u64			wait_ns;
+	u64			spin_ns;
+	unsigned long		holds;
+	u64			hold_ns;
+	unsigned int		hist[LCP_HIST_BUCKETS];
+};
+
+/* the counters of a site summed over all CPUs */
+struct lcp_totals {
+	unsigned long		samples;
+	u64			wait_ns;
+	u64			spin_ns;
+	unsigned long		holds;
+	u64			hold_ns;
+};
+
+static struct lcp_site lcp_sites[LCP_NR_SITES];
+static atomic_long_t lcp_dropped;
+/* too large for the percpu allocator, allocated on first enable */
+static DEFINE_PER_CPU(struct lcp_stats *, lcp_cpu_stats);
+
+DEFINE_STATIC_KEY_FALSE(lock_contention_enabled);
+
+static DEFINE_MUTEX(lcp_mutex);
+static bool lcp_on;
+static u32 lcp_sample_period = 64;
+static bool lcp_by_lock;
+/* bumped on enable and reset, so that stale in-flight samples are ignored */
+static unsigned int lcp_gen;
+
+static DEFINE_PER_CPU(unsigned int, lcp_seq);
+/* spinning locks: one slot per context level (task, softirq, hardirq, nmi) */
+static DEFINE_PER_CPU(struct lock_contention_sample, lcp_spin[4]);
+
+/* Sleeping locks may migrate between begin and end; track them per task. */
+static inline bool lcp_sleeping(unsigned int flags)
+{
+	return !(flags & LCB_F_SPIN) || (flags & LCB_F_MUTEX);
+}
+
+/* Lock types whose release calls lock_contention_release(). */
+static inline bool lcp_has_hold(unsigned int flags)
+{
+	if (flags & (LCB_F_RT | LCB_F_PERCPU))
+		return false;
+	return (flags & LCB_F_MUTEX) ||
+	       (!(flags & LCB_F_SPIN) && (flags & (LCB_F_READ | LCB_F_WRITE)));
+}
+
+static const char *lcp_type(unsigned int flags)
+{
+	if (flags & LCB_F_MUTEX)
+		return "mutex";
+
+	switch (flags & (LCB_F_SPIN | LCB_F_READ | LCB_F_WRITE |
+			 LCB_F_RT | LCB_F_PERCPU)) {
+	case LCB_F_SPIN:
+		return "spinlock";
+	case LCB_F_SPIN | LCB_F_READ:
+		return "rwlock:R";
+	case LCB_F_SPIN | LCB_F_WRITE:
+		return "rwlock:W";
+	case LCB_F_READ:
+		return "rwsem:R";
+	case LCB_F_WRITE:
+		return "rwsem:W";
+	case LCB_F_RT:
+		return "rtmutex";
+	case LCB_F_RT | LCB_F_READ:
+		return "rwlock-rt:R";
+	case LCB_F_RT | LCB_F_WRITE:
+		return "rwlock-rt:W";
+	case LCB_F_PERCPU | LCB_F_READ:
+		return "pcpu-sem:R";
+	case LCB_F_PERCPU | LCB_F_WRITE:
+		return "pcpu-sem:W";
+	case 0:
+		return "semaphore";
+	}
+	return "unknown";
+}
+
+static inline unsigned int lcp_bucket(u64 ns)
+{
+	unsigned int b = ns ? ilog2(ns) / 2 : 0;
+
+	return min(b, LCP_HIST_BUCKETS - 1);
+}
+
+static void lcp_update_max(u64 *max, u64 val)
+{
+	u64 old = READ_ONCE(*max);
+
+	while (val > old) {
+		if (try_cmpxchg64(max, &old, val))
+			break;
+	}
+}
+
+/*
+ * The call site is the first return address after the lock and scheduler
+ * functions on the stack.
+ */
+static unsigned long lcp_call_site(void)
+{
+	unsigned long entries[LCP_STACK_DEPTH];
+	unsigned int i, nr;
+	bool inside = false;
+
+	nr = stack_trace_save(entries, ARRAY_SIZE(entries), 2);
+	for (i = 0; i < nr; i++) {
+		if (in_sched_functions(entries[i]))
+			inside = true;
+		else if (inside)
+			return entries[i];
+	}
+	return nr ? entries[nr - 1] : 0;
+}
+
+/*
+ * With by_lock set, a site is keyed by call site and lock. A slot is claimed
+ * by setting its site to LCP_SITE_BUSY, and the site is only published once
+ * the lock is in place. Lookups racing with the claim may rarely create a
+ * second slot for the same key.
+ */
+static struct lcp_site *lcp_site_get(unsigned long site, void *lock,
+				     unsigned int flags, bool create)
+{
+	unsigned int h, i;
+
+	if (!site)
+		return NULL;
+
+	if (!READ_ONCE(lcp_by_lock))
+		lock = NULL;
+	h = hash_long(site ^ (unsigned long)lock, LCP_SITE_BITS);
+
+	for (i = 0; i < LCP_NR_PROBES; i++) {
+		struct lcp_site *s = &lcp_sites[(h + i) & (LCP_NR_SITES - 1)];
+		unsigned long cur = smp_load_acquire(&s->site);
+
+		if (cur == site && READ_ONCE(s->lock) == lock)
+			return s;
+		if (cur)
+			continue;
+		if (!create)
+			return NULL;
+
+		if (cmpxchg(&s->site, 0UL, LCP_SITE_BUSY))
+			continue;
+		WRITE_ONCE(s->lock, lock);
+		WRITE_ONCE(s->flags, flags);
+		smp_store_release(&s->site, site);
+		return s;
+	}
+
+	if (create)
+		atomic_long_inc(&lcp_dropped);
+	return NULL;
+}
+
+static void lcp_contention_begin(void *data, void *lock, unsigned int flags)
+{
+	struct lock_contention_sample *s;
+	unsigned int gen = READ_ONCE(lcp_gen);
+	u32 period;
+	u64 now;
+
+	if (in_nmi())
+		return;
+
+	if (lcp_sleeping(flags))
+		s = &current->lock_contention;
+	else
+		s = this_cpu_ptr(&lcp_spin[interrupt_context_level()]);
+
+	if (s->lock && s->gen == gen) {
+		if (s->lock != lock)
+			return;
+		/* mutexes switch between spinning and sleeping */
+		now = local_clock();
+		if (s->flags & LCB_F_SPIN)
+			s->spin_ns += now - s->phase_start;
+		s->phase_start = now;
+		s->flags = flags;
+		return;
+	}
+
+	period = READ_ONCE(lcp_sample_period);
+	if (period > 1 && this_cpu_inc_return(lcp_seq) % period)
+		return;
+
+	s->site = lcp_call_site();
+	s->start = s->phase_start = local_clock();
+	s->spin_ns = 0;
+	s->flags = flags;
+	s->gen = gen;
+	WRITE_ONCE(s->lock, lock);
+}
+
+static void lcp_contention_end(void *data, void *lock, int ret)
+{
+	struct lock_contention_sample *s = &current->lock_contention;
+	struct lcp_site *site;
+	u64 now, wait;
+
+	if (in_nmi())
+		return;
+
+	if (READ_ONCE(s->lock) != lock) {
+		/* spinning locks are waited for with preemption disabled */
+		s = raw_cpu_ptr(&lcp_spin[interrupt_context_level()]);
+		if (READ_ONCE(s->lock) != lock)
+			return;
+	}
+
+	now = local_clock();
+	wait = now - s->start;
+	if (s->flags & LCB_F_SPIN)
+		s->spin_ns += now - s->phase_start;
+
+	if (s->gen == READ_ONCE(lcp_gen)) {
+		site = lcp_site_get(s->site, lock, s->flags, true);
+		if (site) {
+			unsigned long irqflags;
+			struct lcp_stats *st;
+
+			local_irq_save(irqflags);
+			st = &__this_cpu_read(lcp_cpu_stats)[site - lcp_sites];
+			st->samples++;
+			st->wait_ns += wait;
+			st->spin_ns += s->spin_ns;
+			st->hist[lcp_bucket(wait)]++;
+			local_irq_restore(irqflags);
+			lcp_update_max(&site->wait_max, wait);
+		}
+
+		if (!ret && lcp_has_hold(s->flags) &&
+		    s == &current->lock_contention) {
+			s->held_site = s->site;
+			s->held_since = now;
+			s->held_gen = s->gen;
+			WRITE_ONCE(s->held, lock);
+		}
+	}
+
+	WRITE_ONCE(s->lock, NULL);
+}
+
+void __lock_contention_release(void *lock)
+{
+	struct lock_contention_sample *s = &current->lock_contention;
+	unsigned long irqflags;
+	struct lcp_site *site;
+	struct lcp_stats *st;
+	u64 hold;
+
+	WRITE_ONCE(s->held, NULL);
+	if (s->held_gen != READ_ONCE(lcp_gen))
+		return;
+
+	hold = local_clock() - s->held_since;
+	site = lcp_site_get(s->held_site, lock, 0, false);
+	if (!site)
+		return;
+
+	local_irq_save(irqflags);
+	st = &__this_cpu_read(lcp_cpu_stats)[site - lcp_sites];
+	st->holds++;
+	st->hold_ns += hold;
+	local_irq_restore(irqflags);
+	lcp_update_max(&site->hold_max, hold);
+}
+
+/* kept once allocated, the data stays readable after disabling */
+static int lcp_alloc_stats(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct lcp_stats *st;
+
+		if (per_cpu(lcp_cpu_stats, cpu))
+			continue;
+		st = kvzalloc_node(sizeof(*st) * LCP_NR_SITES, GFP_KERNEL,
+				   cpu_to_node(cpu));
+		if (!st)
+			return -ENOMEM;
+		per_cpu(lcp_cpu_stats, cpu) = st;
+	}
+	return 0;
+}
+
+static int lcp_set_enabled(bool on)
+{
+	int ret = 0;
+
+	mutex_lock(&lcp_mutex);
+	if (on == lcp_on)
+		goto unlock;
+
+	if (on) {
+		ret = lcp_alloc_stats();
+		if (ret)
+			goto unlock;
+		WRITE_ONCE(lcp_gen, lcp_gen + 1);
+		/* never see a wait begin without being able to see it end */
+		ret = register_trace_contention_end(lcp_contention_end, NULL);
+		if (ret)
+			goto unlock;
+		ret = register_trace_contention_begin(lcp_contention_begin, NULL);
+		if (ret) {
+			unregister_trace_contention_end(lcp_contention_end, NULL);
+			tracepoint_synchronize_unregister();
+			goto unlock;
+		}
+		static_branch_enable(&lock_contention_enabled);
+	} else {
+		static_branch_disable(&lock_contention_enabled);
+		unregister_trace_contention_begin(lcp_contention_begin, NULL);
+		unregister_trace_contention_end(lcp_contention_end, NULL);
+		tracepoint_synchronize_unregister();
+	}
+	lcp_on = on;
+unlock:
+	mutex_unlock(&lcp_mutex);
+	return ret;
+}
+
+static ssize_t lcp_enable_read(struct file *file, char __user *user_buf,
+			       size_t count, loff_t *ppos)
+{
+	char buf[3];
+
+	buf[0] = READ_ONCE(lcp_on) ? '1' : '0';
+	buf[1] = '\n';
+	buf[2] = 0;
+	return simple_read_from_buffer(user_buf, count, ppos, buf, 2);
+}
+
+static ssize_t lcp_enable_write(struct file *file, const char __user *user_buf,
+				size_t count, loff_t *ppos)
+{
+	bool on;
+	int ret;
+
+	ret = kstrtobool_from_user(user_buf, count, &on);
+	if (ret)
+		return ret;
+
+	ret = lcp_set_enabled(on);
+	return ret ? ret : count;
+}
+
+static const struct file_operations fops_lcp_enable = {
+	.read = lcp_enable_read,
+	.write = lcp_enable_write,
+	.llseek = default_llseek,
+};
+
+static void lcp_reset(void)
+{
+	int cpu;
+
+	lockdep_assert_held(&lcp_mutex);
+
+	WRITE_ONCE(lcp_gen, lcp_gen + 1);
+	memset(lcp_sites, 0, sizeof(lcp_sites));
+	for_each_possible_cpu(cpu) {
+		struct lcp_stats *st = per_cpu(lcp_cpu_stats, cpu);
+
+		if (st)
+			memset(st, 0, sizeof(*st) * LCP_NR_SITES);
+	}
+	atomic_long_set(&lcp_dropped, 0);
+}
+
+static ssize_t lcp_reset_write(struct file *file, const char __user *user_buf,
+			       size_t count, loff_t *ppos)
+{
+	mutex_lock(&lcp_mutex);
+	lcp_reset();
+	mutex_unlock(&lcp_mutex);
+	return count;
+}
+
+static const struct file_operations fops_lcp_reset = {
+	.write = lcp_reset_write,
+	.llseek = default_llseek,
+};
+
+static ssize_t lcp_by_lock_read(struct file *file, char __user *user_buf,
+				size_t count, loff_t *ppos)
+{
+	char buf[3];
+
+	buf[0] = READ_ONCE(lcp_by_lock) ? '1' : '0';
+	buf[1] = '\n';
+	buf[2] = 0;
+	return simple_read_from_buffer(user_buf, count, ppos, buf, 2);
+}
+
+/* Sites keyed one way can't be found the other way; start over. */
+static ssize_t lcp_by_lock_write(struct file *file, const char __user *user_buf,
+				 size_t count, loff_t *ppos)
+{
+	bool by_lock;
+	int ret;
+
+	ret = kstrtobool_from_user(user_buf, count, &by_lock);
+	if (ret)
+		return ret;
+
+	mutex_lock(&lcp_mutex);
+	if (by_lock != lcp_by_lock) {
+		WRITE_ONCE(lcp_by_lock, by_lock);
+		lcp_reset();
+	}
+	mutex_unlock(&lcp_mutex);
+	return count;
+}
+
+static const struct file_operations fops_lcp_by_lock = {
+	.read = lcp_by_lock_read,
+	.write = lcp_by_lock_write,
+	.llseek = default_llseek,
+};
+
+static void lcp_read_totals(unsigned int i, struct lcp_totals *t)
+{
+	int cpu;
+
+	memset(t, 0, sizeof(*t));
+	for_each_possible_cpu(cpu) {
+		struct lcp_stats *st = per_cpu(lcp_cpu_stats, cpu);
+
+		if (!st)
+			continue;
+		st += i;
+		t->samples += READ_ONCE(st->samples);
+		t->wait_ns += READ_ONCE(st->wait_ns);
+		t->spin_ns += READ_ONCE(st->spin_ns);
+		t->holds += READ_ONCE(st->holds);
+		t->hold_ns += READ_ONCE(st->hold_ns);
+	}
+}
+
+static void lcp_show_site(struct seq_file *m, struct lcp_site *s)
+{
+	void *lock = READ_ONCE(s->lock);
+
+	if (lock)
+		seq_printf(m, "  %pS  %pS\n", (void *)s->site, lock);
+	else
+		seq_printf(m, "  %pS\n", (void *)s->site);
+}
+
+static int lcp_profile_show(struct seq_file *m, void *v)
+{
+	unsigned int i;
+
+	seq_printf(m, "# sample_period: %u, dropped sites: %lu\n",
+		   READ_ONCE(lcp_sample_period),
+		   atomic_long_read(&lcp_dropped));
+	seq_puts(m, "# type           samples    wait_avg    wait_max spin%"
+		    "      holds    hold_avg    hold_max  site [lock]\n");
+
+	for (i = 0; i < LCP_NR_SITES; i++) {
+		struct lcp_site *s = &lcp_sites[i];
+		struct lcp_totals t;
+
+		if (smp_load_acquire(&s->site) <= LCP_SITE_BUSY)
+			continue;
+		lcp_read_totals(i, &t);
+		if (!t.samples)
+			continue;
+
+		seq_printf(m, "%-12s %10lu %11llu %11llu %4llu%% %10lu %11llu %11llu",
+			   lcp_type(READ_ONCE(s->flags)), t.samples,
+			   div64_ul(t.wait_ns, t.samples), READ_ONCE(s->wait_max),
+			   t.wait_ns ? div64_u64(min(t.spin_ns, t.wait_ns) * 100,
+						 t.wait_ns) : 0,
+			   t.holds, t.holds ? div64_ul(t.hold_ns, t.holds) : 0,
+			   READ_ONCE(s->hold_max));
+		lcp_show_site(m, s);
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(lcp_profile);
+
+static int lcp_histogram_show(struct seq_file *m, void *v)
+{
+	unsigned int i, b;
+
+	seq_puts(m, "# wait time buckets of [4^i, 4^(i+1)) ns, i = 0..15\n");
+	for (i = 0; i < LCP_NR_SITES; i++) {
+		struct lcp_site *s = &lcp_sites[i];
+		unsigned int hist[LCP_HIST_BUCKETS] = {};
+		unsigned long samples = 0;
+		int cpu;
+
+		if (smp_load_acquire(&s->site) <= LCP_SITE_BUSY)
+			continue;
+
+		for_each_possible_cpu(cpu) {
+			struct lcp_stats *st = per_cpu(lcp_cpu_stats, cpu);
+
+			if (!st)
+				continue;
+			st += i;
+			samples += READ_ONCE(st->samples);
+			for (b = 0; b < LCP_HIST_BUCKETS; b++)
+				hist[b] += READ_ONCE(st->hist[b]);
+		}
+		if (!samples)
+			continue;
+
+		seq_printf(m, "%-12s", lcp_type(READ_ONCE(s->flags)));
+		for (b = 0; b < LCP_HIST_BUCKETS; b++)
+			seq_printf(m, " %u", hist[b]);
+		lcp_show_site(m, s);
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(lcp_histogram);
+
+struct lcp_delta_site {
+	unsigned long		site;
+	void			*lock;
+	struct lcp_totals	t;
+};
+
+/* what an open delta file last reported, and what it is reporting now */
+struct lcp_delta {
+	unsigned int		gen;
+	u64			time;
+	struct lcp_delta_site	prev[LCP_NR_SITES];
+	struct lcp_delta_site	cur[LCP_NR_SITES];
+};
+
+/*
+ * Raw sums rather than averages, so that consumers can aggregate intervals.
+ * Multiply samples by sample_period to estimate the number of contentions.
+ */
+static int lcp_delta_show(struct seq_file *m, void *v)
+{
+	static const struct lcp_totals zero;
+	struct lcp_delta *d = m->private;
+	unsigned int gen = READ_ONCE(lcp_gen), i;
+	u64 now = local_clock();
+
+	/* a reset, or re-enabling, starts the totals over */
+	if (d->gen != gen) {
+		memset(d->prev, 0, sizeof(d->prev));
+		d->gen = gen;
+	}
+
+	seq_printf(m, "# interval_ns: %llu, sample_period: %u, dropped sites: %lu\n",
+		   now - d->time, READ_ONCE(lcp_sample_period),
+		   atomic_long_read(&lcp_dropped));
+	seq_puts(m, "# type           samples       wait_ns       spin_ns"
+		    "      holds       hold_ns  site [lock]\n");
+
+	for (i = 0; i < LCP_NR_SITES; i++) {
+		struct lcp_site *s = &lcp_sites[i];
+		struct lcp_delta_site *c = &d->cur[i], *p = &d->prev[i];
+		const struct lcp_totals *base = &p->t;
+
+		c->site = smp_load_acquire(&s->site);
+		c->lock = READ_ONCE(s->lock);
+		memset(&c->t, 0, sizeof(c->t));
+		if (c->site <= LCP_SITE_BUSY)
+			continue;
+		if (p->site != c->site || p->lock != c->lock)
+			base = &zero;
+
+		lcp_read_totals(i, &c->t);
+		if (c->t.samples == base->samples && c->t.holds == base->holds)
+			continue;
+
+		seq_printf(m, "%-12s %10lu %13llu %13llu %10lu %13llu",
+			   lcp_type(READ_ONCE(s->flags)),
+			   c->t.samples - base->samples,
+			   c->t.wait_ns - base->wait_ns,
+			   c->t.spin_ns - base->spin_ns,
+			   c->t.holds - base->holds,
+			   c->t.hold_ns - base->hold_ns);
+		lcp_show_site(m, s);
+	}
+
+	/* seq_file calls us again with a larger buffer after an overflow */
+	if (!seq_has_overflowed(m)) {
+		memcpy(d->prev, d->cur, sizeof(d->prev));
+		d->time = now;
+	}
+	return 0;
+}
+
+static int lcp_delta_open(struct inode *inode, struct file *file)
+{
+	struct lcp_delta *d;
+	int ret;
+
+	d = kvzalloc(sizeof(*d), GFP_KERNEL);
+	if (!d)
+		return -ENOMEM;
+	d->gen = READ_ONCE(lcp_gen);
+	d->time = local_clock();
+
+	ret = single_open(file, lcp_delta_show, d);
+	if (ret)
+		kvfree(d);
+	return ret;
+}
+
+static int lcp_delta_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+
+	kvfree(m->private);
+	return single_release(inode, file);
+}
+
+static const struct file_operations fops_lcp_delta = {
+	.open = lcp_delta_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = lcp_delta_release,
+};
+
+static int __init init_lock_contention(void)
+{
+	struct dentry *dir = debugfs_create_dir(LCP_DIR, NULL);
+
+	if (IS_ERR(dir)) {
+		pr_warn("Could not create '%s' debugfs entries\n", LCP_DIR);
+		return -ENOMEM;
+	}
+
+	/*
+	 * Like the lock event counts, reading the data walks every site, so
+	 * only root gets to do it.
+	 */
+	debugfs_create_file("enable", 0600, dir, NULL, &fops_lcp_enable);
+	debugfs_create_u32("sample_period", 0600, dir, &lcp_sample_period);
+	debugfs_create_file("profile", 0400, dir, NULL, &lcp_profile_fops);
+	debugfs_create_file("histogram", 0400, dir, NULL, &lcp_histogram_fops);
+	debugfs_create_file("delta", 0400, dir, NULL, &fops_lcp_delta);
+	debugfs_create_file("by_lock", 0600, dir, NULL, &fops_lcp_by_lock);
+	debugfs_create_file("reset", 0200, dir, NULL, &fops_lcp_reset);
+
+	return 0;
+}
+fs_initcall(init_lock_contention);
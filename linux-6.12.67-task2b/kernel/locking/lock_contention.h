@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Sampling lock contention profiler, see lock_contention.c.
+ */
+#ifndef __LOCKING_LOCK_CONTENTION_H
+#define __LOCKING_LOCK_CONTENTION_H
+
+#ifdef CONFIG_LOCK_CONTENTION_PROFILE
+#include <linux/jump_label.h>
+#include <linux/sched.h>
+
+DECLARE_STATIC_KEY_FALSE(lock_contention_enabled);
+
+extern void __lock_contention_release(void *lock);
+
+/*
+ * Called on release of a sleeping lock; ends the hold time of an acquisition
+ * that was sampled while contended.
+ */
+static __always_inline void lock_contention_release(void *lock)
+{
+	if (static_branch_unlikely(&lock_contention_enabled) &&
+	    unlikely(current->lock_contention.held == lock))
+		__lock_contention_release(lock);
+}
+#else
+static inline void lock_contention_release(void *lock) { }
+#endif
+
+#endif /* __LOCKING_LOCK_CONTENTION_H */
@@ -21,6 +21,7 @@
 #include <linux/smp.h>
 #include <linux/interrupt.h>
 #include <linux/sched.h>
+#include <linux/sched/clock.h>
 #include <uapi/linux/sched/types.h>
 #include <linux/rtmutex.h>
 #include <linux/atomic.h>
@@ -35,6 +36,10 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Paul E. McKenney <paulmck@linux.ibm.com>");
 
 torture_param(int, acq_writer_lim, 0, "Write_acquisition time limit (jiffies).");
+torture_param(int, bench, 0, "Measure throughput and latency instead of torturing");
+torture_param(int, bench_gap_ns, 0, "Benchmark delay between acquisitions (ns)");
+torture_param(int, bench_read_ns, 0, "Benchmark read-side critical-section length (ns)");
+torture_param(int, bench_write_ns, 0, "Benchmark write-side critical-section length (ns)");
 torture_param(int, call_rcu_chains, 0, "Self-propagate call_rcu() chains during test (0=disable).");
 torture_param(int, long_hold, 100, "Do occasional long hold of lock (ms), 0=disable");
 torture_param(int, nested_locks, 0, "Number of nested locks (max = 8)");
@@ -119,6 +124,9 @@ static unsigned long last_lock_release;
 struct lock_stress_stats {
 	long n_lock_fail;
 	long n_lock_acquired;
+	u64 bench_lat_max;		/* Longest acquisition (ns). */
+	u64 bench_last;			/* local_clock() of last acquisition. */
+	unsigned long *bench_hist;	/* Acquisition latency histogram. */
 };
 
 struct call_rcu_chain {
@@ -159,10 +167,76 @@ struct lock_torture_cxt {
 	struct lock_torture_ops *cur_ops;
 	struct lock_stress_stats *lwsa; /* writer statistics */
 	struct lock_stress_stats *lrsa; /* reader statistics */
+	unsigned long *bench_whist; /* writer latency histograms */
+	unsigned long *bench_rhist; /* reader latency histograms */
+	u64 bench_start;
 };
 static struct lock_torture_cxt cxt = { 0, 0, false, false,
 				       ATOMIC_INIT(0),
 				       NULL, NULL};
+
+/*
+ * Benchmark mode.  Each thread records the time it takes to acquire the
+ * lock in a log-linear histogram: every power of two is split into
+ * 1 << LT_BENCH_SUB_BITS buckets, which bounds the quantization error of
+ * the reported percentiles to 25%.
+ */
+#define LT_BENCH_SUB_BITS	2
+#define LT_BENCH_BUCKETS	(64 << LT_BENCH_SUB_BITS)
+
+static unsigned int lt_bench_bucket(u64 ns)
+{
+	unsigned int l;
+
+	if (ns < (1 << LT_BENCH_SUB_BITS))
+		return ns;
+	l = fls64(ns) - 1;
+	return ((l - LT_BENCH_SUB_BITS + 1) << LT_BENCH_SUB_BITS) +
+	       ((ns >> (l - LT_BENCH_SUB_BITS)) & ((1 << LT_BENCH_SUB_BITS) - 1));
+}
+
+/* Smallest latency that lands in bucket @idx. */
+static u64 lt_bench_bucket_ns(unsigned int idx)
+{
+	unsigned int g = idx >> LT_BENCH_SUB_BITS;
+	u64 s = idx & ((1 << LT_BENCH_SUB_BITS) - 1);
+	unsigned int l;
+
+	if (!g)
+		return s;
+	l = g + LT_BENCH_SUB_BITS - 1;
+	return (1ULL << l) + (s << (l - LT_BENCH_SUB_BITS));
+}
+
+static void lt_bench_record(struct lock_stress_stats *lsp, u64 start)
+{
+	u64 now = local_clock();
+	u64 lat = (s64)(now - start) > 0 ? now - start : 0;
+
+	lsp->bench_hist[lt_bench_bucket(lat)]++;
+	if (lat > lsp->bench_lat_max)
+		lsp->bench_lat_max = lat;
+	WRITE_ONCE(lsp->bench_last, now);
+}
+
+static void lt_bench_delay(int ns)
+{
+	if (ns > 0)
+		ndelay(ns);
+}
+
+static unsigned long *lt_bench_alloc(struct lock_stress_stats *statp, int n)
+{
+	unsigned long *hist;
+	int i;
+
+	hist = kcalloc(array_size(n, LT_BENCH_BUCKETS), sizeof(*hist), GFP_KERNEL);
+	if (!hist)
+		return NULL;
+	for (i = 0; i < n; i++)
+		statp[i].bench_hist = hist + i * LT_BENCH_BUCKETS;
+	return hist;
+}
 /*
  * Definitions for lock torture testing.
  */
@@ -844,6 +918,7 @@ static int lock_torture_writer(void *arg)
 {
 	unsigned long j;
 	unsigned long j1;
+	u64 t = 0;
 	u32 lockset_mask;
 	struct lock_stress_stats *lwsp = arg;
 	DEFINE_TORTURE_RANDOM(rand);
@@ -855,7 +930,7 @@ static int lock_torture_writer(void *arg)
 		set_user_nice(current, MAX_NICE);
 
 	do {
-		if ((torture_random(&rand) & 0xfffff) == 0)
+		if (!bench && (torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
 
 		lockset_mask = torture_random(&rand);
@@ -877,7 +952,11 @@ static int lock_torture_writer(void *arg)
 		if (!skip_main_lock) {
 			if (acq_writer_lim > 0)
 				j = jiffies;
+			if (bench)
+				t = local_clock();
 			cxt.cur_ops->writelock(tid);
+			if (bench)
+				lt_bench_record(lwsp, t);
 			if (WARN_ON_ONCE(lock_is_write_held))
 				lwsp->n_lock_fail++;
 			lock_is_write_held = true;
@@ -891,7 +970,10 @@ static int lock_torture_writer(void *arg)
 			}
 			lwsp->n_lock_acquired++;
 
-			cxt.cur_ops->write_delay(&rand);
+			if (bench)
+				lt_bench_delay(bench_write_ns);
+			else
+				cxt.cur_ops->write_delay(&rand);
 
 			lock_is_write_held = false;
 			WRITE_ONCE(last_lock_release, jiffies);
@@ -900,6 +982,7 @@ static int lock_torture_writer(void *arg)
 		if (cxt.cur_ops->nested_unlock)
 			cxt.cur_ops->nested_unlock(tid, lockset_mask);
 
+		lt_bench_delay(bench_gap_ns);
 		stutter_wait("lock_torture_writer");
 	} while (!torture_must_stop());
 
@@ -917,24 +1000,33 @@ static int lock_torture_reader(void *arg)
 	struct lock_stress_stats *lrsp = arg;
 	int tid = lrsp - cxt.lrsa;
 	DEFINE_TORTURE_RANDOM(rand);
+	u64 t = 0;
 
 	VERBOSE_TOROUT_STRING("lock_torture_reader task started");
 	set_user_nice(current, MAX_NICE);
 
 	do {
-		if ((torture_random(&rand) & 0xfffff) == 0)
+		if (!bench && (torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
 
+		if (bench)
+			t = local_clock();
 		cxt.cur_ops->readlock(tid);
+		if (bench)
+			lt_bench_record(lrsp, t);
 		atomic_inc(&lock_is_read_held);
 		if (WARN_ON_ONCE(lock_is_write_held))
 			lrsp->n_lock_fail++; /* rare, but... */
 
 		lrsp->n_lock_acquired++;
-		cxt.cur_ops->read_delay(&rand);
+		if (bench)
+			lt_bench_delay(bench_read_ns);
+		else
+			cxt.cur_ops->read_delay(&rand);
 		atomic_dec(&lock_is_read_held);
 		cxt.cur_ops->readunlock(tid);
 
+		lt_bench_delay(bench_gap_ns);
 		stutter_wait("lock_torture_reader");
 	} while (!torture_must_stop());
 	torture_kthread_stopping("lock_torture_reader");
@@ -974,6 +1066,102 @@ static void __torture_print_stats(char *page,
 		atomic_inc(&cxt.n_lock_torture_errors);
 }
 
+/*
+ * Append the benchmark results of one class of threads to @page as a JSON
+ * object member.  Fairness is the ratio of the least to the most productive
+ * thread, in permille.
+ */
+static int lt_bench_print_class(char *page, size_t size, unsigned long *hist,
+				struct lock_stress_stats *statp, int n_stress,
+				bool write, u64 elapsed)
+{
+	static const unsigned int pct[] = { 500, 900, 990, 999 };
+	u64 lat[ARRAY_SIZE(pct)], lat_max = 0;
+	long cur, max = 0, min = n_stress ? LONG_MAX : 0;
+	unsigned long long sum = 0, cum = 0;
+	unsigned int i, k = 0;
+	int t;
+
+	memset(hist, 0, LT_BENCH_BUCKETS * sizeof(*hist));
+	for (t = 0; t < n_stress; t++) {
+		for (i = 0; i < LT_BENCH_BUCKETS; i++)
+			hist[i] += data_race(statp[t].bench_hist[i]);
+		lat_max = max(lat_max, data_race(statp[t].bench_lat_max));
+		cur = data_race(statp[t].n_lock_acquired);
+		sum += cur;
+		max = max(max, cur);
+		min = min(min, cur);
+	}
+	for (i = 0; i < ARRAY_SIZE(pct); i++)
+		lat[i] = lat_max;
+	for (i = 0; i < LT_BENCH_BUCKETS && k < ARRAY_SIZE(pct); i++) {
+		cum += hist[i];
+		/* Report the upper bound of the bucket holding the percentile. */
+		while (k < ARRAY_SIZE(pct) && cum * 1000 >= sum * pct[k]) {
+			if (i + 1 < LT_BENCH_BUCKETS)
+				lat[k] = min(lat_max, lt_bench_bucket_ns(i + 1) - 1);
+			k++;
+		}
+	}
+
+	return scnprintf(page, size,
+			 "\"%s\":{\"threads\":%d,\"ops\":%llu,\"ops_per_sec\":%llu,"
+			 "\"lat_ns\":{\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu},"
+			 "\"per_thread\":{\"max\":%ld,\"min\":%ld,\"fairness\":%llu}}",
+			 write ? "writes" : "reads", n_stress, sum,
+			 elapsed ? mul_u64_u64_div_u64(sum, NSEC_PER_SEC, elapsed) : 0,
+			 lat[0], lat[1], lat[2], lat[3], lat_max, max, min,
+			 max ? div64_u64((u64)min * 1000, max) : 0);
+}
+
+/*
+ * Print the benchmark results as a single line of JSON, so that runs can
+ * be scraped from the console log and compared across lock types.
+ */
+static void lock_torture_bench_print(void)
+{
+	unsigned long *hist;
+	u64 last = 0, elapsed;
+	size_t size = 1024;
+	char *buf;
+	int i, len;
+
+	for (i = 0; cxt.lwsa && i < cxt.nrealwriters_stress; i++)
+		last = max(last, READ_ONCE(cxt.lwsa[i].bench_last));
+	for (i = 0; cxt.lrsa && i < cxt.nrealreaders_stress; i++)
+		last = max(last, READ_ONCE(cxt.lrsa[i].bench_last));
+	elapsed = last > cxt.bench_start ? last - cxt.bench_start : 0;
+
+	hist = kmalloc_array(LT_BENCH_BUCKETS, sizeof(*hist), GFP_KERNEL);
+	buf = kmalloc(size, GFP_KERNEL);
+	if (!hist || !buf) {
+		pr_err("lock_torture_bench_print: Out of memory\n");
+		goto out;
+	}
+
+	len = scnprintf(buf, size,
+			"{\"type\":\"%s\",\"elapsed_ns\":%llu,\"write_ns\":%d,"
+			"\"read_ns\":%d,\"gap_ns\":%d",
+			torture_type, elapsed, bench_write_ns, bench_read_ns,
+			bench_gap_ns);
+	/* A class has no histograms if init failed to allocate them. */
+	if (cxt.lwsa && cxt.bench_whist) {
+		len += scnprintf(buf + len, size - len, ",");
+		len += lt_bench_print_class(buf + len, size - len, hist, cxt.lwsa,
+					    cxt.nrealwriters_stress, true, elapsed);
+	}
+	if (cxt.lrsa && cxt.bench_rhist) {
+		len += scnprintf(buf + len, size - len, ",");
+		len += lt_bench_print_class(buf + len, size - len, hist, cxt.lrsa,
+					    cxt.nrealreaders_stress, false, elapsed);
+	}
+	scnprintf(buf + len, size - len, "}");
+	pr_alert("%s" TORTURE_FLAG " bench: %s\n", torture_type, buf);
+out:
+	kfree(buf);
+	kfree(hist);
+}
+
 /*
  * Print torture statistics.  Caller must ensure that there is only one
  * call to this function at a given time!!!  This is normally accomplished
@@ -1013,6 +1201,9 @@ static void lock_torture_stats_print(void)
 		pr_alert("%s", buf);
 		kfree(buf);
 	}
+
+	if (bench)
+		lock_torture_bench_print();
 }
 
 /*
@@ -1045,9 +1236,10 @@ lock_torture_print_module_parms(struct lock_torture_ops *cur_ops,
 
 	cpumask_setall(&cpumask_all);
 	pr_alert("%s" TORTURE_FLAG
-		 "--- %s%s: acq_writer_lim=%d bind_readers=%*pbl bind_writers=%*pbl call_rcu_chains=%d long_hold=%d nested_locks=%d nreaders_stress=%d nwriters_stress=%d onoff_holdoff=%d onoff_interval=%d rt_boost=%d rt_boost_factor=%d shuffle_interval=%d shutdown_secs=%d stat_interval=%d stutter=%d verbose=%d writer_fifo=%d\n",
+		 "--- %s%s: acq_writer_lim=%d bench=%d bench_gap_ns=%d bench_read_ns=%d bench_write_ns=%d bind_readers=%*pbl bind_writers=%*pbl call_rcu_chains=%d long_hold=%d nested_locks=%d nreaders_stress=%d nwriters_stress=%d onoff_holdoff=%d onoff_interval=%d rt_boost=%d rt_boost_factor=%d shuffle_interval=%d shutdown_secs=%d stat_interval=%d stutter=%d verbose=%d writer_fifo=%d\n",
 		 torture_type, tag, cxt.debug_lock ? " [debug]": "",
-		 acq_writer_lim, cpumask_pr_args(rcmp), cpumask_pr_args(wcmp),
+		 acq_writer_lim, bench, bench_gap_ns, bench_read_ns, bench_write_ns,
+		 cpumask_pr_args(rcmp), cpumask_pr_args(wcmp),
 		 call_rcu_chains, long_hold, nested_locks, cxt.nrealreaders_stress,
 		 cxt.nrealwriters_stress, onoff_holdoff, onoff_interval, rt_boost,
 		 rt_boost_factor, shuffle_interval, shutdown_secs, stat_interval, stutter,
@@ -1152,6 +1344,11 @@ static void lock_torture_cleanup(void)
 	call_rcu_chain_cleanup();
 
 end:
+	kfree(cxt.bench_whist);
+	cxt.bench_whist = NULL;
+	kfree(cxt.bench_rhist);
+	cxt.bench_rhist = NULL;
+
 	if (cxt.init_called) {
 		if (cxt.cur_ops->exit)
 			cxt.cur_ops->exit();
@@ -1248,6 +1445,18 @@ static int __init lock_torture_init(void)
 		for (i = 0; i < cxt.nrealwriters_stress; i++) {
 			cxt.lwsa[i].n_lock_fail = 0;
 			cxt.lwsa[i].n_lock_acquired = 0;
+			cxt.lwsa[i].bench_lat_max = 0;
+			cxt.lwsa[i].bench_last = 0;
+			cxt.lwsa[i].bench_hist = NULL;
+		}
+
+		if (bench) {
+			cxt.bench_whist = lt_bench_alloc(cxt.lwsa, cxt.nrealwriters_stress);
+			if (!cxt.bench_whist) {
+				VERBOSE_TOROUT_STRING("cxt.bench_whist: Out of memory");
+				firsterr = -ENOMEM;
+				goto unwind;
+			}
 		}
 	}
 
@@ -1280,6 +1489,19 @@ static int __init lock_torture_init(void)
 			for (i = 0; i < cxt.nrealreaders_stress; i++) {
 				cxt.lrsa[i].n_lock_fail = 0;
 				cxt.lrsa[i].n_lock_acquired = 0;
+				cxt.lrsa[i].bench_lat_max = 0;
+				cxt.lrsa[i].bench_last = 0;
+				cxt.lrsa[i].bench_hist = NULL;
+			}
+
+			if (bench) {
+				cxt.bench_rhist = lt_bench_alloc(cxt.lrsa,
+								 cxt.nrealreaders_stress);
+				if (!cxt.bench_rhist) {
+					VERBOSE_TOROUT_STRING("cxt.bench_rhist: Out of memory");
+					firsterr = -ENOMEM;
+					goto unwind;
+				}
 			}
 		}
 	}
@@ -1288,6 +1510,21 @@ static int __init lock_torture_init(void)
 	if (torture_init_error(firsterr))
 		goto unwind;
 
+	/*
+	 * The benchmark wants the same workload from every thread, so turn
+	 * off everything that perturbs it: long holds, nesting, priority
+	 * boosting, stuttering and shuffling.  Use bind_readers and
+	 * bind_writers to pick the CPUs, and nreaders_stress/nwriters_stress
+	 * for the reader/writer mix.
+	 */
+	if (bench) {
+		long_hold = 0;
+		nested_locks = 0;
+		rt_boost = 0;
+		stutter = 0;
+		shuffle_interval = 0;
+	}
+
 	lock_torture_print_module_parms(cxt.cur_ops, "Start of test");
 
 	/* Prepare torture context. */
@@ -1342,6 +1579,8 @@ static int __init lock_torture_init(void)
 		}
 	}
 
+	cxt.bench_start = local_clock();
+
 	/*
 	 * Create the kthreads and start torturing (oh, those poor little locks).
 	 *
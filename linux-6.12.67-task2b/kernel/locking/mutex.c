@@ -24,6 +24,7 @@
 #include <linux/sched/rt.h>
 #include <linux/sched/wake_q.h>
 #include <linux/sched/debug.h>
+#include <linux/sched/clock.h>
 #include <linux/export.h>
 #include <linux/spinlock.h>
 #include <linux/interrupt.h>
@@ -35,6 +36,7 @@
 
 #ifndef CONFIG_PREEMPT_RT
 #include "mutex.h"
+#include "lock_contention.h"
 
 #ifdef CONFIG_DEBUG_MUTEXES
 # define MUTEX_WARN_ON(cond) DEBUG_LOCKS_WARN_ON(cond)
@@ -50,6 +52,7 @@ __mutex_init(struct mutex *lock, const char *name, struct lock_class_key *key)
 	INIT_LIST_HEAD(&lock->wait_list);
 #ifdef CONFIG_MUTEX_SPIN_ON_OWNER
 	osq_lock_init(&lock->osq);
+	lock->spin_avg = 0;
 #endif
 
 	debug_mutex_init(lock, name, key);
@@ -292,6 +295,33 @@ EXPORT_SYMBOL(mutex_lock);
 
 #ifdef CONFIG_MUTEX_SPIN_ON_OWNER
 
+/*
+ * Spinning on a mutex whose owner keeps it for longer than it takes to sleep
+ * and be woken up again only wastes the difference. Each mutex keeps a moving
+ * average of how long spinners had to wait for the owner to let go; while that
+ * exceeds MUTEX_SPIN_SLEEP_COST_NS, a spinner gives up after spinning for that
+ * long and only one spinner at a time may try.
+ *
+ * Only spins that end with the owner releasing the lock feed the average, so
+ * it comes back down once the lock is held briefly again.
+ */
+#define MUTEX_SPIN_SLEEP_COST_NS	(10 * NSEC_PER_USEC)
+#define MUTEX_SPIN_AVG_WEIGHT		8
+
+static inline bool mutex_spin_capped(struct mutex *lock)
+{
+	return READ_ONCE(lock->spin_avg) > MUTEX_SPIN_SLEEP_COST_NS;
+}
+
+static inline void mutex_spin_account(struct mutex *lock, u64 delta)
+{
+	long avg = READ_ONCE(lock->spin_avg);
+
+	delta = min_t(u64, delta, UINT_MAX);
+	avg += ((long)delta - avg) / MUTEX_SPIN_AVG_WEIGHT;
+	WRITE_ONCE(lock->spin_avg, avg);
+}
+
 /*
  * Trylock variant that returns the owning task on failure.
  */
@@ -350,8 +380,10 @@ bool ww_mutex_spin_on_owner(struct mutex *lock, struct ww_acquire_ctx *ww_ctx,
  */
 static noinline
 bool mutex_spin_on_owner(struct mutex *lock, struct task_struct *owner,
-			 struct ww_acquire_ctx *ww_ctx, struct mutex_waiter *waiter)
+			 struct ww_acquire_ctx *ww_ctx, struct mutex_waiter *waiter,
+			 u64 deadline)
 {
+	u64 start = local_clock();
 	bool ret = true;
 
 	lockdep_assert_preemption_disabled();
@@ -380,9 +412,18 @@ bool mutex_spin_on_owner(struct mutex *lock, struct task_struct *owner,
 			break;
 		}
 
+		/* The owner is expected to hold on longer than a sleep costs. */
+		if (deadline && local_clock() > deadline) {
+			ret = false;
+			break;
+		}
+
 		cpu_relax();
 	}
 
+	if (ret)
+		mutex_spin_account(lock, local_clock() - start);
+
 	return ret;
 }
 
@@ -441,6 +482,15 @@ static __always_inline bool
 mutex_optimistic_spin(struct mutex *lock, struct ww_acquire_ctx *ww_ctx,
 		      struct mutex_waiter *waiter)
 {
+	u64 deadline = 0;
+
+	if (mutex_spin_capped(lock)) {
+		/* There is already somebody finding out whether that holds. */
+		if (!waiter && osq_is_locked(&lock->osq))
+			goto fail;
+		deadline = local_clock() + MUTEX_SPIN_SLEEP_COST_NS;
+	}
+
 	if (!waiter) {
 		/*
 		 * The purpose of the mutex_can_spin_on_owner() function is
@@ -473,7 +523,7 @@ mutex_optimistic_spin(struct mutex *lock, struct ww_acquire_ctx *ww_ctx,
 		 * There's an owner, wait for it to either
 		 * release the lock or go to sleep.
 		 */
-		if (!mutex_spin_on_owner(lock, owner, ww_ctx, waiter))
+		if (!mutex_spin_on_owner(lock, owner, ww_ctx, waiter, deadline))
 			goto fail_unlock;
 
 		/*
@@ -541,6 +591,7 @@ static noinline void __sched __mutex_unlock_slowpath(struct mutex *lock, unsigne
  */
 void __sched mutex_unlock(struct mutex *lock)
 {
+	lock_contention_release(lock);
 #ifndef CONFIG_DEBUG_LOCK_ALLOC
 	if (__mutex_unlock_fast(lock))
 		return;
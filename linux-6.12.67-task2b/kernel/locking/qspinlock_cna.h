@@ -0,0 +1,274 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _GEN_CNA_LOCK_SLOWPATH
+#error "do not include this file"
+#endif
+
+#include <linux/topology.h>
+
+/*
+ * Implement a NUMA-aware version of MCS (aka CNA, or compact NUMA-aware lock).
+ *
+ * In CNA, spinning threads are organized in two queues, a primary queue for
+ * threads running on the same NUMA node as the current lock holder, and a
+ * secondary queue for threads running on other nodes. Schematically, it
+ * looks like this:
+ *
+ *    cna_node
+ *   +----------+     +--------+         +--------+
+ *   |mcs:next  | --> |mcs:next| --> ... |mcs:next| --> NULL  [Primary queue]
+ *   |mcs:locked| -.  +--------+         +--------+
+ *   +----------+  |
+ *                 `----------------------.
+ *                                        v
+ *                 +--------+         +--------+
+ *                 |mcs:next| --> ... |mcs:next|            [Secondary queue]
+ *                 +--------+         +--------+
+ *                     ^                    |
+ *                     `--------------------'
+ *
+ * N.B. locked := 1 if secondary queue is absent. Otherwise, it contains the
+ * encoded pointer to the tail of the secondary queue, which is organized as a
+ * circular list.
+ *
+ * After acquiring the MCS lock and before acquiring the spinlock, the MCS lock
+ * holder checks whether the next waiter in the primary queue (if exists) is
+ * running on the same NUMA node. If it is not, that waiter is detached from
+ * the main queue and moved into the tail of the secondary queue. This way, we
+ * gradually filter the primary queue, leaving only waiters running on the same
+ * preferred NUMA node.
+ *
+ * For long-term fairness, the secondary queue is flushed into the head of the
+ * primary queue once the lock has been handed over within the primary queue
+ * numa_spinlock_threshold times in a row. The secondary queue is also handed
+ * the lock when the primary queue runs dry.
+ */
+
+struct cna_node {
+	struct mcs_spinlock	mcs;
+	int			numa_node;
+	u32			encoded_tail;	/* self */
+	u32			intra_count;	/* handovers since last flush */
+};
+
+/*
+ * Number of lock handovers within the primary queue, while the secondary
+ * queue is non-empty, after which the secondary queue is flushed. The
+ * default value of 2^16 keeps the worst-case wait of a remote waiter bounded
+ * while letting a node batch up plenty of local handovers.
+ */
+static unsigned int numa_spinlock_threshold __ro_after_init = 1U << 16;
+
+static inline bool cna_has_secondary(struct cna_node *cn)
+{
+	return (u32)cn->mcs.locked > 1;
+}
+
+static inline struct cna_node *cna_secondary_tail(struct cna_node *cn)
+{
+	return (struct cna_node *)decode_tail(cn->mcs.locked);
+}
+
+static void __init cna_init_nodes_per_cpu(unsigned int cpu)
+{
+	struct mcs_spinlock *base = per_cpu_ptr(&qnodes[0].mcs, cpu);
+	int i;
+
+	for (i = 0; i < MAX_NODES; i++) {
+		struct cna_node *cn = (struct cna_node *)grab_mcs_node(base, i);
+
+		cn->numa_node = cpu_to_node(cpu);
+		cn->encoded_tail = encode_tail(cpu, i);
+		/*
+		 * make sure @encoded_tail is not confused with other valid
+		 * values for @locked (0 or 1)
+		 */
+		WARN_ON(cn->encoded_tail <= 1);
+	}
+}
+
+static __always_inline void cna_init_node(struct mcs_spinlock *node)
+{
+	((struct cna_node *)node)->intra_count = 0;
+}
+
+/*
+ * cna_order_queue - move waiters that run on other NUMA nodes out of the way
+ *
+ * Called by the MCS lock holder before it spins on the lock word. If the next
+ * waiter in the primary queue runs on a different node, look for the first
+ * waiter further down the queue that runs on our node. If one is found, every
+ * waiter in between is moved to the tail of the secondary queue. The waiter at
+ * the tail of the primary queue is never moved, so concurrent xchg_tail()
+ * callers are not affected.
+ */
+static void cna_order_queue(struct cna_node *cn)
+{
+	struct mcs_spinlock *next = READ_ONCE(cn->mcs.next);
+	struct mcs_spinlock *last, *cur, *head;
+	int numa_node = cn->numa_node;
+
+	if (!next || ((struct cna_node *)next)->numa_node == numa_node)
+		return;
+
+	last = next;
+	for (;;) {
+		cur = READ_ONCE(last->next);
+		if (!cur)
+			return;
+		if (((struct cna_node *)cur)->numa_node == numa_node)
+			break;
+		last = cur;
+	}
+
+	/* splice next..last into the tail of the (circular) secondary queue */
+	if (cna_has_secondary(cn)) {
+		struct cna_node *tail = cna_secondary_tail(cn);
+
+		head = tail->mcs.next;
+		tail->mcs.next = next;
+	} else {
+		head = next;
+	}
+	last->next = head;
+	cn->mcs.locked = ((struct cna_node *)last)->encoded_tail;
+
+	WRITE_ONCE(cn->mcs.next, cur);
+	lockevent_inc(cna_reorder);
+}
+
+static __always_inline u32 cna_wait_head_or_lock(struct qspinlock *lock,
+						 struct mcs_spinlock *node)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+
+	/* no point in reordering if we are about to flush anyway */
+	if (cn->intra_count < numa_spinlock_threshold)
+		cna_order_queue(cn);
+
+	return 0; /* we lock the old-fashioned way */
+}
+
+/*
+ * We are the last waiter in the primary queue. If there is a secondary queue,
+ * make its tail the new lock tail and hand the MCS lock to its head, instead
+ * of clearing the tail.
+ */
+static __always_inline bool cna_try_clear_tail(struct qspinlock *lock, u32 val,
+					       struct mcs_spinlock *node)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+	struct cna_node *tail;
+	struct mcs_spinlock *head;
+
+	if (!cna_has_secondary(cn))
+		return __try_clear_tail(lock, val, node);
+
+	tail = cna_secondary_tail(cn);
+	head = tail->mcs.next;
+
+	/*
+	 * Break the cycle before publishing @tail; a new waiter that observes
+	 * it in the lock word will link itself to @tail->mcs.next, which is
+	 * ordered after this store by the release below.
+	 */
+	tail->mcs.next = NULL;
+	if (atomic_try_cmpxchg_release(&lock->val, &val,
+				       tail->encoded_tail | _Q_LOCKED_VAL)) {
+		arch_mcs_spin_unlock_contended(&head->locked);
+		lockevent_inc(cna_flush);
+		return true;
+	}
+
+	/* somebody queued behind us; keep the secondary queue as it was */
+	tail->mcs.next = head;
+	return false;
+}
+
+static __always_inline void cna_mcs_pass_lock(struct mcs_spinlock *node,
+					      struct mcs_spinlock *next)
+{
+	struct cna_node *cn = (struct cna_node *)node;
+	u32 val = 1;
+
+	/* cna_order_queue() may have changed our successor */
+	next = READ_ONCE(node->next);
+
+	if (cna_has_secondary(cn)) {
+		if (cn->intra_count < numa_spinlock_threshold) {
+			/* hand the secondary queue over with the lock */
+			((struct cna_node *)next)->intra_count = cn->intra_count + 1;
+			val = cn->mcs.locked;
+			lockevent_inc(cna_intra_node);
+		} else {
+			/* put the secondary queue in front of the primary one */
+			struct cna_node *tail = cna_secondary_tail(cn);
+			struct mcs_spinlock *head = tail->mcs.next;
+
+			tail->mcs.next = next;
+			next = head;
+			lockevent_inc(cna_flush);
+		}
+	}
+
+	smp_store_release(&next->locked, val);
+}
+
+/*
+ * Switch to the NUMA-friendly slow path for spinlocks when we have multiple
+ * NUMA nodes in native environment, unless the user has overridden this
+ * default behavior by setting the numa_spinlock flag.
+ */
+static int numa_spinlock_flag __initdata;
+
+static int __init numa_spinlock_setup(char *str)
+{
+	if (!strcmp(str, "auto")) {
+		numa_spinlock_flag = 0;
+		return 1;
+	} else if (!strcmp(str, "on")) {
+		numa_spinlock_flag = 1;
+		return 1;
+	} else if (!strcmp(str, "off")) {
+		numa_spinlock_flag = -1;
+		return 1;
+	}
+
+	return 0;
+}
+__setup("numa_spinlock=", numa_spinlock_setup);
+
+static int __init numa_spinlock_threshold_setup(char *str)
+{
+	unsigned int val;
+
+	if (kstrtouint(str, 0, &val) || !val)
+		return 0;
+
+	numa_spinlock_threshold = val;
+	return 1;
+}
+__setup("numa_spinlock_threshold=", numa_spinlock_threshold_setup);
+
+/*
+ * Runs before secondary CPUs are brought up, so no other CPU can be in either
+ * slow path when the static key flips.
+ */
+static int __init cna_configure_spin_lock_slowpath(void)
+{
+	unsigned int cpu;
+
+	BUILD_BUG_ON(sizeof(struct cna_node) > sizeof(struct qnode));
+
+	if (numa_spinlock_flag < 0 ||
+	    (numa_spinlock_flag == 0 && nr_node_ids < 2))
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		cna_init_nodes_per_cpu(cpu);
+
+	static_branch_enable(&numa_spinlock_key);
+	pr_info("Enabling CNA spinlock\n");
+
+	return 0;
+}
+early_initcall(cna_configure_spin_lock_slowpath);
@@ -25,10 +25,15 @@
 #include <linux/sched/signal.h>
 #include <linux/sched/clock.h>
 #include <linux/export.h>
+#include <linux/percpu.h>
+#include <linux/rcuwait.h>
+#include <linux/slab.h>
 #include <linux/rwsem.h>
 #include <linux/atomic.h>
 #include <trace/events/lock.h>
 
+#include "lock_contention.h"
+
 #ifndef CONFIG_PREEMPT_RT
 #include "lock_events.h"
 
@@ -322,6 +327,9 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	raw_spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
 	atomic_long_set(&sem->owner, 0L);
+#ifdef CONFIG_RWSEM_READER_BIAS
+	sem->bias = NULL;
+#endif
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 	osq_lock_init(&sem->osq);
 #endif
@@ -1235,6 +1243,340 @@ static struct rw_semaphore *rwsem_downgrade_wake(struct rw_semaphore *sem)
 	return sem;
 }
 
+#ifdef CONFIG_RWSEM_READER_BIAS
+/*
+ * Reader bias (after BRAVO, Dice & Kogan, USENIX ATC'19)
+ *
+ * A read-mostly rwsem makes every reader bounce the cacheline holding
+ * sem->count. Once rwsem_enable_reader_bias() has been called, a reader may
+ * instead take the lock by bumping a per-CPU counter while the bias is on;
+ * nothing shared is written in that case.
+ *
+ * The bias is a three-state flag:
+ *
+ *  RWSEM_BIAS_OFF	- readers use sem->count as usual
+ *  RWSEM_BIAS_ON	- readers use the per-CPU counters
+ *  RWSEM_BIAS_REVOKING	- a writer owns sem->count and waits for the
+ *			  per-CPU readers to drain
+ *
+ * A writer first takes sem->count for writing, then revokes the bias and
+ * waits, in the sleep state it locked with, for the per-CPU sum to reach
+ * zero. A signal leaves the bias on and fails the lock.
+ *
+ * Every writer is counted in a write rate that is halved for every
+ * RWSEM_BIAS_INTERVAL_NS that passes. The bias is turned back on by whoever
+ * next holds the lock exclusively, an up_write() without waiters or a lone
+ * reader that briefly upgrades itself, but only while that rate times the
+ * cost of the last revocation stays under 1/2^RWSEM_BIAS_COST_SHIFT of an
+ * interval. Frequent writers therefore keep the lock in its shared counter
+ * mode, and the per-CPU mode returns when writes become rare.
+ *
+ * The bias only leaves RWSEM_BIAS_OFF while sem->count is write locked, so
+ * a reader holding sem->count always sees RWSEM_BIAS_OFF at up_read() time,
+ * and a per-CPU reader never does. A reader that takes sem->count just as
+ * the bias is turned on moves itself over to the per-CPU counter before
+ * down_read() returns.
+ */
+enum rwsem_bias_state {
+	RWSEM_BIAS_OFF,
+	RWSEM_BIAS_ON,
+	RWSEM_BIAS_REVOKING,
+};
+
+#define RWSEM_BIAS_INTERVAL_NS	(10 * NSEC_PER_MSEC)
+#define RWSEM_BIAS_COST_SHIFT	4
+
+struct rwsem_bias {
+	int			state;
+	unsigned int __percpu	*read_count;
+	/* written by the exclusive owner of sem->count only */
+	u64			interval_start;	/* local_clock() */
+	unsigned int		writes;		/* decayed, see above */
+	u64			revoke_ns;
+	struct rcuwait		writer;
+};
+
+int rwsem_enable_reader_bias(struct rw_semaphore *sem)
+{
+	struct rwsem_bias *rb;
+
+	if (sem->bias)
+		return 0;
+
+	rb = kzalloc(sizeof(*rb), GFP_KERNEL);
+	if (!rb)
+		return -ENOMEM;
+
+	rb->read_count = alloc_percpu(unsigned int);
+	if (!rb->read_count) {
+		kfree(rb);
+		return -ENOMEM;
+	}
+	rb->state = RWSEM_BIAS_OFF;
+	rcuwait_init(&rb->writer);
+
+	/* Starts off; the next exclusive owner will turn it on. */
+	if (cmpxchg_release(&sem->bias, NULL, rb)) {
+		free_percpu(rb->read_count);
+		kfree(rb);
+	}
+	return 0;
+}
+EXPORT_SYMBOL(rwsem_enable_reader_bias);
+
+/*
+ * The rwsem must be unlocked and no longer in use.
+ */
+void rwsem_free_reader_bias(struct rw_semaphore *sem)
+{
+	struct rwsem_bias *rb = sem->bias;
+
+	if (!rb)
+		return;
+
+	sem->bias = NULL;
+	free_percpu(rb->read_count);
+	kfree(rb);
+}
+EXPORT_SYMBOL(rwsem_free_reader_bias);
+
+static unsigned int rwsem_bias_readers(struct rwsem_bias *rb)
+{
+	unsigned int sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *per_cpu_ptr(rb->read_count, cpu);
+
+	return sum;
+}
+
+bool __rwsem_bias_is_read_locked(const struct rw_semaphore *sem)
+{
+	struct rwsem_bias *rb = READ_ONCE(sem->bias);
+
+	return READ_ONCE(rb->state) != RWSEM_BIAS_OFF && rwsem_bias_readers(rb);
+}
+EXPORT_SYMBOL(__rwsem_bias_is_read_locked);
+
+/*
+ * Called with preemption disabled.
+ */
+static inline bool rwsem_bias_read_trylock(struct rw_semaphore *sem)
+{
+	struct rwsem_bias *rb = READ_ONCE(sem->bias);
+
+	if (!rb || READ_ONCE(rb->state) != RWSEM_BIAS_ON)
+		return false;
+
+	this_cpu_inc(*rb->read_count);
+	smp_mb(); /* A matches D */
+	if (likely(READ_ONCE(rb->state) == RWSEM_BIAS_ON)) {
+		lockevent_inc(rwsem_rlock_bias);
+		return true;
+	}
+
+	/* A writer is revoking the bias; back out and use sem->count. */
+	this_cpu_dec(*rb->read_count);
+	rcuwait_wake_up(&rb->writer);
+	return false;
+}
+
+/*
+ * Called with preemption disabled by a reader that holds sem->count. If the
+ * bias has been turned on meanwhile, trade the count for a per-CPU reference.
+ * No writer can revoke the bias while we hold sem->count.
+ */
+static inline void rwsem_bias_read_convert(struct rw_semaphore *sem)
+{
+	struct rwsem_bias *rb = READ_ONCE(sem->bias);
+	long tmp;
+
+	if (!rb || READ_ONCE(rb->state) == RWSEM_BIAS_OFF)
+		return;
+
+	this_cpu_inc(*rb->read_count);
+	rwsem_clear_reader_owned(sem);
+	tmp = atomic_long_add_return_release(-RWSEM_READER_BIAS, &sem->count);
+	if (unlikely((tmp & (RWSEM_LOCK_MASK|RWSEM_FLAG_WAITERS)) ==
+		      RWSEM_FLAG_WAITERS)) {
+		clear_nonspinnable(sem);
+		rwsem_wake(sem);
+	}
+}
+
+/*
+ * The write count as of @now, with the halvings for the intervals that passed
+ * since it was last updated applied; *@start is the interval @now is in.
+ */
+static unsigned int rwsem_bias_writes(struct rwsem_bias *rb, u64 now, u64 *start)
+{
+	unsigned int writes = READ_ONCE(rb->writes);
+	u64 n = 0;
+
+	*start = READ_ONCE(rb->interval_start);
+	/* local_clock() isn't monotonic across CPUs */
+	if (now > *start)
+		n = div64_u64(now - *start, RWSEM_BIAS_INTERVAL_NS);
+	*start += n * RWSEM_BIAS_INTERVAL_NS;
+
+	return n < 32 ? writes >> n : 0;
+}
+
+static void rwsem_bias_count_write(struct rwsem_bias *rb, u64 now)
+{
+	unsigned int writes;
+	u64 start;
+
+	writes = rwsem_bias_writes(rb, now, &start);
+	WRITE_ONCE(rb->interval_start, start);
+	if (writes < UINT_MAX)
+		writes++;
+	WRITE_ONCE(rb->writes, writes);
+}
+
+/*
+ * Whether revoking the bias for the writes at their current rate would cost
+ * little enough to have it on.
+ */
+static bool rwsem_bias_worth_it(struct rwsem_bias *rb, u64 now)
+{
+	u64 budget = RWSEM_BIAS_INTERVAL_NS >> RWSEM_BIAS_COST_SHIFT;
+	u64 cost = min_t(u64, READ_ONCE(rb->revoke_ns), budget);
+	u64 start;
+
+	return (u64)rwsem_bias_writes(rb, now, &start) * cost < budget;
+}
+
+/*
+ * Called with preemption disabled by the only reader of sem->count. If
+ * writes have become rare enough, upgrade to a writer so that no other reader can
+ * hold sem->count, turn the bias on and leave as a per-CPU reader.
+ */
+static void rwsem_bias_read_enable(struct rw_semaphore *sem)
+{
+	struct rwsem_bias *rb = READ_ONCE(sem->bias);
+	long tmp = RWSEM_READER_BIAS;
+
+	if (!rb || READ_ONCE(rb->state) != RWSEM_BIAS_OFF ||
+	    atomic_long_read(&sem->count) != tmp ||
+	    !rwsem_bias_worth_it(rb, local_clock()))
+		return;
+
+	rwsem_clear_reader_owned(sem);
+	if (!atomic_long_try_cmpxchg_acquire(&sem->count, &tmp,
+					     RWSEM_WRITER_LOCKED)) {
+		rwsem_set_reader_owned(sem);
+		return;
+	}
+	rwsem_set_owner(sem);
+
+	WRITE_ONCE(rb->state, RWSEM_BIAS_ON);
+	this_cpu_inc(*rb->read_count);
+	lockevent_inc(rwsem_bias_enable);
+
+	rwsem_clear_owner(sem);
+	tmp = atomic_long_fetch_add_release(-RWSEM_WRITER_LOCKED, &sem->count);
+	if (unlikely(tmp & RWSEM_FLAG_WAITERS))
+		rwsem_wake(sem);
+}
+
+/*
+ * Called with preemption disabled. Return true if the read lock was a
+ * per-CPU one and has been dropped.
+ */
+static inline bool rwsem_bias_read_unlock(struct rw_semaphore *sem)
+{
+	struct rwsem_bias *rb = READ_ONCE(sem->bias);
+
+	if (!rb || READ_ONCE(rb->state) == RWSEM_BIAS_OFF)
+		return false;
+
+	smp_mb(); /* B matches C */
+	this_cpu_dec(*rb->read_count);
+	smp_mb(); /* E matches D */
+	if (unlikely(READ_ONCE(rb->state) != RWSEM_BIAS_ON))
+		rcuwait_wake_up(&rb->writer);
+	return true;
+}
+
+/*
+ * Called by the write owner of sem->count. Wait in @state for the per-CPU
+ * readers to drain, or with @wait false fail with -EBUSY if there are any.
+ * On failure the bias is left on and the caller must release sem->count.
+ */
+static int rwsem_bias_revoke(struct rw_semaphore *sem, bool wait, int state)
+{
+	struct rwsem_bias *rb = READ_ONCE(sem->bias);
+	u64 start;
+	int ret;
+
+	if (!rb)
+		return 0;
+
+	start = local_clock();
+	rwsem_bias_count_write(rb, start);
+	if (READ_ONCE(rb->state) != RWSEM_BIAS_ON)
+		return 0;
+
+	WRITE_ONCE(rb->state, RWSEM_BIAS_REVOKING);
+	smp_mb(); /* D matches A and E */
+
+	if (!wait)
+		ret = rwsem_bias_readers(rb) ? -EBUSY : 0;
+	else
+		ret = rcuwait_wait_event(&rb->writer, !rwsem_bias_readers(rb),
+					 state);
+	if (ret) {
+		/* the per-CPU readers keep the lock */
+		WRITE_ONCE(rb->state, RWSEM_BIAS_ON);
+		return ret;
+	}
+
+	/* the per-CPU readers' critical sections happen before ours */
+	smp_mb(); /* C matches B */
+	WRITE_ONCE(rb->state, RWSEM_BIAS_OFF);
+
+	WRITE_ONCE(rb->revoke_ns, local_clock() - start);
+	lockevent_inc(rwsem_bias_revoke);
+	return 0;
+}
+
+/*
+ * Called by the write owner right before it releases sem->count.
+ */
+static inline void rwsem_bias_write_unlock(struct rw_semaphore *sem)
+{
+	struct rwsem_bias *rb = READ_ONCE(sem->bias);
+
+	if (!rb || READ_ONCE(rb->state) != RWSEM_BIAS_OFF ||
+	    (atomic_long_read(&sem->count) & RWSEM_FLAG_WAITERS))
+		return;
+
+	if (rwsem_bias_worth_it(rb, local_clock())) {
+		WRITE_ONCE(rb->state, RWSEM_BIAS_ON);
+		lockevent_inc(rwsem_bias_enable);
+	}
+}
+#else
+static inline bool rwsem_bias_read_trylock(struct rw_semaphore *sem)
+{
+	return false;
+}
+static inline void rwsem_bias_read_convert(struct rw_semaphore *sem) { }
+static inline void rwsem_bias_read_enable(struct rw_semaphore *sem) { }
+static inline bool rwsem_bias_read_unlock(struct rw_semaphore *sem)
+{
+	return false;
+}
+static inline int rwsem_bias_revoke(struct rw_semaphore *sem, bool wait,
+				    int state)
+{
+	return 0;
+}
+static inline void rwsem_bias_write_unlock(struct rw_semaphore *sem) { }
+#endif /* CONFIG_RWSEM_READER_BIAS */
+
 /*
  * lock for reading
  */
@@ -1244,6 +1586,8 @@ static __always_inline int __down_read_common(struct rw_semaphore *sem, int stat
 	long count;
 
 	preempt_disable();
+	if (rwsem_bias_read_trylock(sem))
+		goto out;
 	if (!rwsem_read_trylock(sem, &count)) {
 		if (IS_ERR(rwsem_down_read_slowpath(sem, count, state))) {
 			ret = -EINTR;
@@ -1251,6 +1595,8 @@ static __always_inline int __down_read_common(struct rw_semaphore *sem, int stat
 		}
 		DEBUG_RWSEMS_WARN_ON(!is_rwsem_reader_owned(sem), sem);
 	}
+	rwsem_bias_read_convert(sem);
+	rwsem_bias_read_enable(sem);
 out:
 	preempt_enable();
 	return ret;
@@ -1279,11 +1625,16 @@ static inline int __down_read_trylock(struct rw_semaphore *sem)
 	DEBUG_RWSEMS_WARN_ON(sem->magic != sem, sem);
 
 	preempt_disable();
+	if (rwsem_bias_read_trylock(sem)) {
+		preempt_enable();
+		return 1;
+	}
 	tmp = atomic_long_read(&sem->count);
 	while (!(tmp & RWSEM_READ_FAILED_MASK)) {
 		if (atomic_long_try_cmpxchg_acquire(&sem->count, &tmp,
 						    tmp + RWSEM_READER_BIAS)) {
 			rwsem_set_reader_owned(sem);
+			rwsem_bias_read_convert(sem);
 			ret = 1;
 			break;
 		}
@@ -1292,6 +1643,18 @@ static inline int __down_read_trylock(struct rw_semaphore *sem)
 	return ret;
 }
 
+/*
+ * Release sem->count taken for writing without the bias ever having been
+ * revoked, with preemption disabled.
+ */
+static inline void rwsem_write_backout(struct rw_semaphore *sem)
+{
+	rwsem_clear_owner(sem);
+	if (atomic_long_fetch_add_release(-RWSEM_WRITER_LOCKED,
+					  &sem->count) & RWSEM_FLAG_WAITERS)
+		rwsem_wake(sem);
+}
+
 /*
  * lock for writing
  */
@@ -1305,6 +1668,13 @@ static __always_inline int __down_write_common(struct rw_semaphore *sem, int sta
 			ret = -EINTR;
 	}
 	preempt_enable();
+	if (!ret && unlikely(rwsem_bias_revoke(sem, true, state))) {
+		/* interrupted while per-CPU readers hold the lock; back out */
+		preempt_disable();
+		rwsem_write_backout(sem);
+		preempt_enable();
+		ret = -EINTR;
+	}
 	return ret;
 }
 
@@ -1325,6 +1695,11 @@ static inline int __down_write_trylock(struct rw_semaphore *sem)
 	preempt_disable();
 	DEBUG_RWSEMS_WARN_ON(sem->magic != sem, sem);
 	ret = rwsem_write_trylock(sem);
+	if (ret && unlikely(rwsem_bias_revoke(sem, false, TASK_RUNNING))) {
+		/* per-CPU readers hold the lock; back out */
+		rwsem_write_backout(sem);
+		ret = 0;
+	}
 	preempt_enable();
 
 	return ret;
@@ -1338,9 +1713,13 @@ static inline void __up_read(struct rw_semaphore *sem)
 	long tmp;
 
 	DEBUG_RWSEMS_WARN_ON(sem->magic != sem, sem);
-	DEBUG_RWSEMS_WARN_ON(!is_rwsem_reader_owned(sem), sem);
 
 	preempt_disable();
+	if (rwsem_bias_read_unlock(sem)) {
+		preempt_enable();
+		return;
+	}
+	DEBUG_RWSEMS_WARN_ON(!is_rwsem_reader_owned(sem), sem);
 	rwsem_clear_reader_owned(sem);
 	tmp = atomic_long_add_return_release(-RWSEM_READER_BIAS, &sem->count);
 	DEBUG_RWSEMS_WARN_ON(tmp < 0, sem);
@@ -1368,6 +1747,7 @@ static inline void __up_write(struct rw_semaphore *sem)
 			    !rwsem_test_oflags(sem, RWSEM_NONSPINNABLE), sem);
 
 	preempt_disable();
+	rwsem_bias_write_unlock(sem);
 	rwsem_clear_owner(sem);
 	tmp = atomic_long_fetch_add_release(-RWSEM_WRITER_LOCKED, &sem->count);
 	if (unlikely(tmp & RWSEM_FLAG_WAITERS))
@@ -1617,6 +1997,7 @@ EXPORT_SYMBOL(down_write_trylock);
 void up_read(struct rw_semaphore *sem)
 {
 	rwsem_release(&sem->dep_map, _RET_IP_);
+	lock_contention_release(sem);
 	__up_read(sem);
 }
 EXPORT_SYMBOL(up_read);
@@ -1627,6 +2008,7 @@ EXPORT_SYMBOL(up_read);
 void up_write(struct rw_semaphore *sem)
 {
 	rwsem_release(&sem->dep_map, _RET_IP_);
+	lock_contention_release(sem);
 	__up_write(sem);
 }
 EXPORT_SYMBOL(up_write);
@@ -734,6 +734,19 @@ static int __init setup_hrtimer_hres(char *str)
 
 __setup("highres=", setup_hrtimer_hres);
 
+/*
+ * Coalesce expiry of softirq based timers into interrupts raised for other
+ * timers, see hrtimer_coalesce_soft().
+ */
+static bool hrtimer_coalesce_enabled __read_mostly;
+
+static int __init setup_hrtimer_coalesce(char *str)
+{
+	return (kstrtobool(str, &hrtimer_coalesce_enabled) == 0);
+}
+
+__setup("hrtimer_coalesce=", setup_hrtimer_coalesce);
+
 /*
  * hrtimer_high_res_enabled - query, if the highres mode is enabled
  */
@@ -1838,6 +1851,35 @@ static __latent_entropy void hrtimer_run_softirq(void)
 
 #ifdef CONFIG_HIGH_RES_TIMERS
 
+/*
+ * The clock event is programmed for the earliest hard expiry, and every
+ * timer whose [softexpires, expires] window contains the interrupt time is
+ * expired with it. That holds for the hard bases only: the softirq bases are
+ * not looked at before softirq_expires_next, so a soft timer whose window is
+ * already open at a hard timer interrupt still costs a wakeup of its own
+ * later on.
+ *
+ * Check whether the first timer of any softirq base is inside its slack
+ * window at @now, so the softirq can be raised right away.
+ */
+static bool hrtimer_coalesce_soft(struct hrtimer_cpu_base *cpu_base, ktime_t now)
+{
+	unsigned int active = cpu_base->active_bases & HRTIMER_ACTIVE_SOFT;
+	struct hrtimer_clock_base *base;
+
+	if (!hrtimer_coalesce_enabled || cpu_base->softirq_activated)
+		return false;
+
+	for_each_active_base(base, cpu_base, active) {
+		struct timerqueue_node *node = timerqueue_getnext(&base->active);
+		struct hrtimer *timer = container_of(node, struct hrtimer, node);
+
+		if (ktime_add(now, base->offset) >= hrtimer_get_softexpires_tv64(timer))
+			return true;
+	}
+	return false;
+}
+
 /*
  * High resolution timer interrupt
  * Called with interrupts disabled
@@ -1846,6 +1888,7 @@ void hrtimer_interrupt(struct clock_event_device *dev)
 {
 	struct hrtimer_cpu_base *cpu_base = this_cpu_ptr(&hrtimer_bases);
 	ktime_t expires_next, now, entry_time, delta;
+	ktime_t coalesced = KTIME_MAX;
 	unsigned long flags;
 	int retries = 0;
 
@@ -1870,12 +1913,25 @@ retry:
 		cpu_base->softirq_expires_next = KTIME_MAX;
 		cpu_base->softirq_activated = 1;
 		raise_softirq_irqoff(HRTIMER_SOFTIRQ);
+	} else if (hrtimer_coalesce_soft(cpu_base, now)) {
+		coalesced = cpu_base->softirq_expires_next;
+		cpu_base->softirq_expires_next = KTIME_MAX;
+		cpu_base->softirq_activated = 1;
+		raise_softirq_irqoff(HRTIMER_SOFTIRQ);
 	}
 
 	__hrtimer_run_queues(cpu_base, now, flags, HRTIMER_ACTIVE_HARD);
 
 	/* Reevaluate the clock bases for the [soft] next expiry */
 	expires_next = hrtimer_update_next_event(cpu_base);
+	/*
+	 * The soft bases are skipped while the softirq is pending, so
+	 * expires_next is the next hard event. If the soft expiry which was
+	 * pulled in came earlier, it would have been a wakeup of its own.
+	 */
+	if (coalesced < expires_next)
+		cpu_base->nr_coalesced++;
+	coalesced = KTIME_MAX;
 	/*
 	 * Store the new expiry value so the migration code can verify
 	 * against it.
@@ -16,6 +16,8 @@
 #include <linux/compat.h>
 #include <linux/sched/deadline.h>
 #include <linux/task_work.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
 
 #include "posix-timers.h"
 
@@ -237,6 +239,132 @@ static void proc_sample_cputime_atomic(struct task_cputime_atomic *at,
 	store_samples(samples, stime, utime, rtime);
 }
 
+/*
+ * Fold the cputime this CPU accumulated for the thread group into the
+ * shared atomics. Called from the accounting functions with interrupts
+ * disabled, so nothing else modifies this CPU's slot meanwhile.
+ */
+void thread_group_cputimer_fold(struct thread_group_cputimer *cputimer,
+				struct thread_group_cputimer_pcpu *pcpu)
+{
+	struct task_cputime_atomic *at = &cputimer->cputime_atomic;
+	struct task_cputime_pcpu *pc;
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&pcpu->lock, flags);
+	pc = this_cpu_ptr(pcpu->times);
+	atomic64_add(pc->utime, &at->utime);
+	atomic64_add(pc->stime, &at->stime);
+	atomic64_add(pc->sum_exec_runtime, &at->sum_exec_runtime);
+	pc->utime = pc->stime = pc->sum_exec_runtime = 0;
+	raw_spin_unlock_irqrestore(&pcpu->lock, flags);
+}
+
+/*
+ * Take an exact sample of the thread group cputimer: the shared atomics
+ * plus whatever the CPUs did not fold yet. Holding pcpu->lock excludes
+ * folding, so the sum is monotonic. Callers hold either the sighand lock
+ * or rcu_read_lock(), which keeps @pcpu alive.
+ */
+static void proc_sample_cputimer(struct thread_group_cputimer *cputimer,
+				 u64 *samples)
+{
+	struct thread_group_cputimer_pcpu *pcpu = READ_ONCE(cputimer->pcpu);
+	u64 stime, utime, rtime;
+	unsigned long flags;
+	int cpu;
+
+	if (!pcpu) {
+		proc_sample_cputime_atomic(&cputimer->cputime_atomic, samples);
+		return;
+	}
+
+	raw_spin_lock_irqsave(&pcpu->lock, flags);
+	utime = atomic64_read(&cputimer->cputime_atomic.utime);
+	stime = atomic64_read(&cputimer->cputime_atomic.stime);
+	rtime = atomic64_read(&cputimer->cputime_atomic.sum_exec_runtime);
+	for_each_possible_cpu(cpu) {
+		struct task_cputime_pcpu *pc = per_cpu_ptr(pcpu->times, cpu);
+
+		utime += READ_ONCE(pc->utime);
+		stime += READ_ONCE(pc->stime);
+		rtime += READ_ONCE(pc->sum_exec_runtime);
+	}
+	raw_spin_unlock_irqrestore(&pcpu->lock, flags);
+	store_samples(samples, stime, utime, rtime);
+}
+
+/*
+ * Set up the per CPU accumulators when the group accounting is started.
+ * Thousands of threads adding to the same atomics make them a global
+ * cacheline hotspot, while the per CPU slots are only written locally.
+ * The sighand lock is held, so the allocation has to be atomic. If it
+ * fails, the shared atomics are used directly as before.
+ *
+ * When the accounting is restarted, stale values from the previous run
+ * are dropped, the atomics are resynchronized with the thread group
+ * cputime right after.
+ *
+ * A group which inherited RLIMIT_CPU starts out with the accounting
+ * active, as fork sets it up without this function. Its first tick
+ * then has check_process_timers() call this instead. The atomics are
+ * exact at that point, so the accumulators can start from zero.
+ */
+static void thread_group_cputimer_start_pcpu(struct thread_group_cputimer *cputimer)
+{
+	struct thread_group_cputimer_pcpu *pcpu = cputimer->pcpu;
+	unsigned long flags;
+	int cpu;
+
+	WRITE_ONCE(cputimer->pcpu_tried, true);
+	if (!IS_ENABLED(CONFIG_64BIT) || nr_cpu_ids == 1)
+		return;
+
+	if (pcpu) {
+		raw_spin_lock_irqsave(&pcpu->lock, flags);
+		for_each_possible_cpu(cpu)
+			memset(per_cpu_ptr(pcpu->times, cpu), 0,
+			       sizeof(struct task_cputime_pcpu));
+		raw_spin_unlock_irqrestore(&pcpu->lock, flags);
+		return;
+	}
+
+	pcpu = kmalloc(sizeof(*pcpu), GFP_ATOMIC | __GFP_NOWARN);
+	if (!pcpu)
+		return;
+	pcpu->times = alloc_percpu_gfp(struct task_cputime_pcpu,
+				       GFP_ATOMIC | __GFP_NOWARN);
+	if (!pcpu->times) {
+		kfree(pcpu);
+		return;
+	}
+	raw_spin_lock_init(&pcpu->lock);
+	pcpu->tick_sample = jiffies - 1;
+	smp_store_release(&cputimer->pcpu, pcpu);
+}
+
+static void thread_group_cputimer_free_rcu(struct rcu_head *rcu)
+{
+	struct thread_group_cputimer_pcpu *pcpu;
+
+	pcpu = container_of(rcu, struct thread_group_cputimer_pcpu, rcu);
+	free_percpu(pcpu->times);
+	kfree(pcpu);
+}
+
+/*
+ * The accounting functions run with interrupts disabled and may still
+ * look at the accumulators of an exiting group from a remote CPU (see
+ * task_sched_runtime()), hence the RCU delayed free.
+ */
+static void thread_group_cputimer_free(struct thread_group_cputimer *cputimer)
+{
+	struct thread_group_cputimer_pcpu *pcpu = xchg(&cputimer->pcpu, NULL);
+
+	if (pcpu)
+		call_rcu(&pcpu->rcu, thread_group_cputimer_free_rcu);
+}
+
 /*
  * Set cputime to sum_cputime if sum_cputime > cputime. Use cmpxchg
  * to avoid race conditions with concurrent updates to cputime.
@@ -277,7 +405,7 @@ void thread_group_sample_cputime(struct task_struct *tsk, u64 *samples)
 
 	WARN_ON_ONCE(!pct->timers_active);
 
-	proc_sample_cputime_atomic(&cputimer->cputime_atomic, samples);
+	proc_sample_cputimer(cputimer, samples);
 }
 
 /**
@@ -309,6 +437,7 @@ static void thread_group_start_cputime(struct task_struct *tsk, u64 *samples)
 		 * to synchronize the timer to the clock every time we start it.
 		 */
 		thread_group_cputime(tsk, &sum);
+		thread_group_cputimer_start_pcpu(cputimer);
 		update_gt_cputime(&cputimer->cputime_atomic, &sum);
 
 		/*
@@ -320,7 +449,7 @@ static void thread_group_start_cputime(struct task_struct *tsk, u64 *samples)
 		 */
 		WRITE_ONCE(pct->timers_active, true);
 	}
-	proc_sample_cputime_atomic(&cputimer->cputime_atomic, samples);
+	proc_sample_cputimer(cputimer, samples);
 }
 
 static void __thread_group_cputime(struct task_struct *tsk, u64 *samples)
@@ -349,7 +478,7 @@ static u64 cpu_clock_sample_group(const clockid_t clkid, struct task_struct *p,
 		else
 			__thread_group_cputime(p, samples);
 	} else {
-		proc_sample_cputime_atomic(&cputimer->cputime_atomic, samples);
+		proc_sample_cputimer(cputimer, samples);
 	}
 
 	return samples[clkid];
@@ -548,6 +677,7 @@ void posix_cpu_timers_exit(struct task_struct *tsk)
 void posix_cpu_timers_exit_group(struct task_struct *tsk)
 {
 	cleanup_timers(&tsk->signal->posix_cputimers);
+	thread_group_cputimer_free(&tsk->signal->cputimer);
 }
 
 /*
@@ -956,11 +1086,14 @@ static void check_process_timers(struct task_struct *tsk,
 	 */
 	pct->expiry_active = true;
 
+	if (!sig->cputimer.pcpu_tried)
+		thread_group_cputimer_start_pcpu(&sig->cputimer);
+
 	/*
 	 * Collect the current process totals. Group accounting is active
 	 * so the sample can be taken directly.
 	 */
-	proc_sample_cputime_atomic(&sig->cputimer.cputime_atomic, samples);
+	proc_sample_cputimer(&sig->cputimer, samples);
 	collect_posix_cputimers(pct, samples, firing);
 
 	/*
@@ -1106,15 +1239,48 @@ static inline bool fastpath_timer_check(struct task_struct *tsk)
 	 * delays with signals actually getting sent are expected.
 	 */
 	if (READ_ONCE(pct->timers_active) && !READ_ONCE(pct->expiry_active)) {
+		struct thread_group_cputimer_pcpu *pcpu;
 		u64 samples[CPUCLOCK_MAX];
 
+		/* Inherited RLIMIT_CPU, let the slow path set up pcpu */
+		if (!READ_ONCE(sig->cputimer.pcpu_tried))
+			return true;
+
 		proc_sample_cputime_atomic(&sig->cputimer.cputime_atomic,
 					   samples);
 
 		if (task_cputimers_expired(samples, pct))
 			return true;
-	}
 
+		/*
+		 * The per CPU accumulators are only summed up when an
+		 * expiry is within reach of what they can hold, which
+		 * keeps the tick from touching every CPU's slot. Even
+		 * then only one tick per jiffy and group takes the exact
+		 * sample; the others wait for the next jiffy, which delays
+		 * the expiry by a tick at most.
+		 */
+		pcpu = READ_ONCE(sig->cputimer.pcpu);
+		if (pcpu) {
+			u64 lag = 2ULL * nr_cpu_ids * TG_CPUTIMER_BATCH;
+			unsigned long last, now = jiffies;
+			int i;
+
+			for (i = 0; i < CPUCLOCK_MAX; i++)
+				samples[i] += lag;
+			if (!task_cputimers_expired(samples, pct))
+				goto out;
+
+			last = READ_ONCE(pcpu->tick_sample);
+			if (last == now || cmpxchg(&pcpu->tick_sample, last, now) != last)
+				goto out;
+
+			proc_sample_cputimer(&sig->cputimer, samples);
+			if (task_cputimers_expired(samples, pct))
+				return true;
+		}
+	}
+out:
 	if (dl_task(tsk) && tsk->dl.dl_overrun)
 		return true;
 
@@ -211,6 +211,13 @@ EXPORT_SYMBOL(jiffies_64);
  *			currently running timer, the pointer is set to the
  *			timer, which expires at the moment. If no timer is
  *			running, the pointer is NULL.
+ * @expiry_batch:	Timers which were detached in one go and whose
+ *			callbacks are invoked without retaking the lock in
+ *			between, see expire_timer_batch(). A slot is cleared
+ *			by whoever claims the timer first: the expiry code
+ *			right before invoking the callback or a deleter,
+ *			which cancels it. NULL when no batch is in flight.
+ * @expiry_batch_len:	Number of slots in @expiry_batch.
  * @expiry_lock:	PREEMPT_RT only: Lock is taken in softirq around
  *			timer expiry callback execution and when trying to
  *			delete a running timer and it wasn't successful in
@@ -251,6 +258,8 @@ EXPORT_SYMBOL(jiffies_64);
 struct timer_base {
 	raw_spinlock_t		lock;
 	struct timer_list	*running_timer;
+	struct timer_list	**expiry_batch;
+	unsigned int		expiry_batch_len;
 #ifdef CONFIG_PREEMPT_RT
 	spinlock_t		expiry_lock;
 	atomic_t		timer_waiters;
@@ -267,6 +276,37 @@ struct timer_base {
 
 static DEFINE_PER_CPU(struct timer_base, timer_bases[NR_BASES]);
 
+/*
+ * Maximum number of timers which are expired per lock hold, see
+ * expire_timer_batch(). 0 and 1 select one lock round trip per timer.
+ */
+#define TIMER_EXPIRY_BATCH_MAX	16
+
+static unsigned int sysctl_timer_expiry_batch __read_mostly;
+
+#ifdef CONFIG_SYSCTL
+static const unsigned int timer_expiry_batch_max = TIMER_EXPIRY_BATCH_MAX;
+
+static struct ctl_table timer_expiry_sysctl[] = {
+	{
+		.procname	= "timer_expiry_batch",
+		.data		= &sysctl_timer_expiry_batch,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_douintvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= (void *)&timer_expiry_batch_max,
+	},
+};
+
+static int __init timer_expiry_sysctl_init(void)
+{
+	register_sysctl("kernel", timer_expiry_sysctl);
+	return 0;
+}
+device_initcall(timer_expiry_sysctl_init);
+#endif /* CONFIG_SYSCTL */
+
 #ifdef CONFIG_NO_HZ_COMMON
 
 static DEFINE_STATIC_KEY_FALSE(timers_nohz_active);
@@ -937,13 +977,47 @@ static inline void detach_timer(struct timer_list *timer, bool clear_pending)
 	entry->next = LIST_POISON2;
 }
 
+/*
+ * A timer which sits in an unclaimed slot of the expiry batch is still
+ * pending from the callers point of view. Cancel it, unless the expiry
+ * code claimed it already.
+ */
+static int timer_batch_cancel(struct timer_list *timer, struct timer_base *base)
+{
+	struct timer_list **batch = base->expiry_batch;
+	unsigned int i;
+
+	if (likely(!batch))
+		return 0;
+
+	for (i = 0; i < base->expiry_batch_len; i++) {
+		if (READ_ONCE(batch[i]) == timer &&
+		    cmpxchg(&batch[i], timer, NULL) == timer)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Check whether the callback of @timer is running on @base. Must be called
+ * with base->lock held. While a batch is in flight, base->running_timer is
+ * updated without the lock; see expire_timer_batch() for the pairing.
+ */
+static inline bool timer_base_running(struct timer_base *base,
+				      struct timer_list *timer)
+{
+	if (base->expiry_batch)
+		smp_mb();
+	return smp_load_acquire(&base->running_timer) == timer;
+}
+
 static int detach_if_pending(struct timer_list *timer, struct timer_base *base,
 			     bool clear_pending)
 {
 	unsigned idx = timer_get_idx(timer);
 
 	if (!timer_pending(timer))
-		return 0;
+		return timer_batch_cancel(timer, base);
 
 	if (hlist_is_singular_node(&timer->entry, base->vectors + idx)) {
 		__clear_bit(idx, base->pending_map);
@@ -1155,7 +1229,7 @@ __mod_timer(struct timer_list *timer, unsigned long expires, unsigned int option
 		 * handler yet has not finished. This also guarantees that the
 		 * timer is serialized wrt itself.
 		 */
-		if (likely(base->running_timer != timer)) {
+		if (likely(!timer_base_running(base, timer))) {
 			/* See the comment in lock_timer_base() */
 			timer->flags |= TIMER_MIGRATING;
 
@@ -1505,9 +1579,15 @@ static int __try_to_del_timer_sync(struct timer_list *timer, bool shutdown)
 
 	base = lock_timer_base(timer, &flags);
 
-	if (base->running_timer != timer) {
+	if (!timer_base_running(base, timer)) {
 		ret = detach_if_pending(timer, base, true);
-		if (shutdown)
+		/*
+		 * The expiry code can claim a batched timer while the lock
+		 * is held here. If it won, the callback is running now.
+		 */
+		if (!ret && timer_base_running(base, timer))
+			ret = -1;
+		else if (shutdown)
 			timer->function = NULL;
 	}
 
@@ -1810,6 +1890,80 @@ static void call_timer_fn(struct timer_list *timer,
 	}
 }
 
+/*
+ * Detach up to @max timers from @head and invoke their callbacks with a
+ * single drop of base->lock, instead of one unlock/lock pair per timer.
+ *
+ * Until the expiry code claims a slot, the timer is treated as pending:
+ * timer_delete(), mod_timer() and friends cancel it from the batch under
+ * base->lock, so a callback of this batch can delete a later timer of the
+ * same batch, synchronously or not, just as it could when that timer was
+ * still enqueued. Claiming and cancelling both clear the slot with
+ * cmpxchg(), so exactly one side wins.
+ *
+ * base->running_timer is published before the claim, and the successful
+ * cmpxchg() orders it against the deleter, which issues smp_mb() after
+ * losing the race and then reads base->running_timer. It is moved on with
+ * a release store once the callback returned, so a deleter which observes
+ * that the timer is no longer running also observes its completion.
+ *
+ * A callback which re-arms its own timer takes the (uncontended) lock in
+ * mod_timer() once; the timer went to the wheel already, so re-arming does
+ * not touch the batch. As the timer is reported as running, mod_timer()
+ * keeps it on this base.
+ *
+ * TIMER_IRQSAFE timers have to be invoked with interrupts disabled, so the
+ * batch stops in front of them and they are expired one by one.
+ */
+static void expire_timer_batch(struct timer_base *base, struct hlist_head *head,
+			       unsigned int max, unsigned long baseclk)
+{
+	struct timer_list *batch[TIMER_EXPIRY_BATCH_MAX];
+	void (*fns[TIMER_EXPIRY_BATCH_MAX])(struct timer_list *);
+	struct timer_list *timer;
+	unsigned int i, n = 0;
+
+	while (n < max && !hlist_empty(head)) {
+		timer = hlist_entry(head->first, struct timer_list, entry);
+		if (timer->flags & TIMER_IRQSAFE)
+			break;
+
+		detach_timer(timer, true);
+
+		/* Read under the lock, timer_shutdown() clears it */
+		fns[n] = timer->function;
+		if (WARN_ON_ONCE(!fns[n]))
+			continue;
+		batch[n++] = timer;
+	}
+
+	if (!n)
+		return;
+
+	base->running_timer = batch[0];
+	base->expiry_batch = batch;
+	base->expiry_batch_len = n;
+	raw_spin_unlock_irq(&base->lock);
+
+	for (i = 0; i < n; i++) {
+		timer = READ_ONCE(batch[i]);
+		if (!timer)
+			continue;
+
+		smp_store_release(&base->running_timer, timer);
+		if (cmpxchg(&batch[i], timer, NULL) != timer)
+			continue;
+
+		call_timer_fn(timer, fns[i], baseclk);
+	}
+
+	raw_spin_lock_irq(&base->lock);
+	base->expiry_batch = NULL;
+	base->expiry_batch_len = 0;
+	base->running_timer = NULL;
+	timer_sync_wait_running(base);
+}
+
 static void expire_timers(struct timer_base *base, struct hlist_head *head)
 {
 	/*
@@ -1818,6 +1972,8 @@ static void expire_timers(struct timer_base *base, struct hlist_head *head)
 	 * is related to the old base->clk value.
 	 */
 	unsigned long baseclk = base->clk - 1;
+	unsigned int batch = min_t(unsigned int, READ_ONCE(sysctl_timer_expiry_batch),
+				   TIMER_EXPIRY_BATCH_MAX);
 
 	while (!hlist_empty(head)) {
 		struct timer_list *timer;
@@ -1825,6 +1981,11 @@ static void expire_timers(struct timer_base *base, struct hlist_head *head)
 
 		timer = hlist_entry(head->first, struct timer_list, entry);
 
+		if (batch > 1 && !(timer->flags & TIMER_IRQSAFE)) {
+			expire_timer_batch(base, head, batch, baseclk);
+			continue;
+		}
+
 		base->running_timer = timer;
 		detach_timer(timer, true);
 
@@ -9,6 +9,7 @@
 #include <linux/smp.h>
 #include <linux/spinlock.h>
 #include <linux/timerqueue.h>
+#include <linux/topology.h>
 #include <trace/events/ipi.h>
 
 #include "timer_migration.h"
@@ -419,6 +420,7 @@ static struct list_head *tmigr_level_list __read_mostly;
 
 static unsigned int tmigr_hierarchy_levels __read_mostly;
 static unsigned int tmigr_crossnode_level __read_mostly;
+static unsigned int tmigr_cpus_per_node __read_mostly;
 
 static DEFINE_PER_CPU(struct tmigr_cpu, tmigr_cpu);
 
@@ -430,6 +432,42 @@ static inline bool tmigr_is_not_available(struct tmigr_cpu *tmc)
 	return !(tmc->tmgroup && tmc->online);
 }
 
+/*
+ * Pick the new migrator of @group among the @active children. Children
+ * which are CPUs are all equally awake, so take the first one. For child
+ * groups prefer the one with the most active children: the cluster it
+ * stands for is the least likely to power down and its CPUs then do not
+ * have to be woken up for the global timers of the others. The child
+ * states are read lockless; a stale value only makes the choice worse,
+ * not wrong.
+ */
+static unsigned long tmigr_elect_migrator(struct tmigr_group *group,
+					  unsigned long active)
+{
+	unsigned long bit, best = BIT_CNT;
+	unsigned int weight, best_weight = 0;
+
+	for_each_set_bit(bit, &active, BIT_CNT) {
+		struct tmigr_group *child = READ_ONCE(group->children[bit]);
+		union tmigr_state s;
+
+		if (!child)
+			return bit;
+
+		s.state = atomic_read(&child->migr_state);
+		weight = hweight8(s.active);
+		if (weight > best_weight) {
+			best = bit;
+			best_weight = weight;
+		}
+	}
+
+	if (best == BIT_CNT)
+		best = find_first_bit(&active, BIT_CNT);
+
+	return best;
+}
+
 /*
  * Returns true, when @childmask corresponds to the group migrator or when the
  * group is not active - so no migrator is set.
@@ -1270,7 +1308,7 @@ static bool tmigr_inactive_up(struct tmigr_group *group,
 			if (!childstate.active) {
 				unsigned long new_migr_bit, active = newstate.active;
 
-				new_migr_bit = find_first_bit(&active, BIT_CNT);
+				new_migr_bit = tmigr_elect_migrator(group, active);
 
 				if (new_migr_bit != BIT_CNT) {
 					newstate.migrator = BIT(new_migr_bit);
@@ -1476,7 +1514,7 @@ static int tmigr_cpu_online(unsigned int cpu)
 }
 
 static void tmigr_init_group(struct tmigr_group *group, unsigned int lvl,
-			     int node)
+			     int node, unsigned int cpu)
 {
 	union tmigr_state s;
 
@@ -1484,6 +1522,7 @@ static void tmigr_init_group(struct tmigr_group *group, unsigned int lvl,
 
 	group->level = lvl;
 	group->numa_node = lvl < tmigr_crossnode_level ? node : NUMA_NO_NODE;
+	group->leader = cpu;
 
 	group->num_children = 0;
 
@@ -1514,14 +1553,77 @@ static void tmigr_init_group(struct tmigr_group *group, unsigned int lvl,
 	group->groupevt.ignore = true;
 }
 
+/*
+ * Groups are picked from the prepare callback, before the CPU coming up has
+ * run any code. On x86 the topology IDs in cpu_data() are only filled in
+ * when the CPU boots, so derive them from the APIC IDs enumerated by the
+ * firmware instead. The module domain stands in for the cluster. The
+ * architectures using arch_topology parse the firmware tables before the
+ * secondary CPUs are brought up, so their IDs are valid already.
+ */
+#ifdef CONFIG_X86
+static inline int tmigr_topology_id(unsigned int cpu,
+				    enum x86_topology_domains dom)
+{
+	return topology_get_logical_id(per_cpu(x86_cpu_to_apicid, cpu), dom);
+}
+
+#define tmigr_package_id(cpu)	tmigr_topology_id(cpu, TOPO_PKG_DOMAIN)
+#define tmigr_die_id(cpu)	tmigr_topology_id(cpu, TOPO_DIE_DOMAIN)
+#define tmigr_cluster_id(cpu)	tmigr_topology_id(cpu, TOPO_MODULE_DOMAIN)
+#else
+#define tmigr_package_id(cpu)	topology_physical_package_id(cpu)
+#define tmigr_die_id(cpu)	topology_die_id(cpu)
+#define tmigr_cluster_id(cpu)	topology_cluster_id(cpu)
+#endif
+
+/*
+ * How close @cpu is to @other in the cache and power topology. IDs which
+ * are not provided (negative) don't count.
+ */
+static unsigned int tmigr_topology_score(unsigned int cpu, unsigned int other)
+{
+	unsigned int score = 0;
+	int id;
+
+	id = tmigr_package_id(cpu);
+	if (id >= 0 && id == tmigr_package_id(other))
+		score += 4;
+	id = tmigr_die_id(cpu);
+	if (id >= 0 && id == tmigr_die_id(other))
+		score += 2;
+	id = tmigr_cluster_id(cpu);
+	if (id >= 0 && id == tmigr_cluster_id(other))
+		score += 1;
+	return score;
+}
+
+/*
+ * Number of groups a NUMA node needs at @lvl, when the groups are filled
+ * up. The hierarchy depth is computed from that, so topology placement must
+ * not create more groups than this.
+ */
+static unsigned int tmigr_level_groups(unsigned int lvl)
+{
+	return DIV_ROUND_UP(tmigr_cpus_per_node,
+			    1U << (ilog2(TMIGR_CHILDREN_PER_GROUP) * (lvl + 1)));
+}
+
 static struct tmigr_group *tmigr_get_group(unsigned int cpu, int node,
 					   unsigned int lvl)
 {
 	struct tmigr_group *tmp, *group = NULL;
+	unsigned int score, best = 0, ngroups = 0;
+	bool topology = lvl < tmigr_crossnode_level;
 
 	lockdep_assert_held(&tmigr_mutex);
 
-	/* Try to attach to an existing group first */
+	/*
+	 * Try to attach to an existing group first. Below the cross NUMA
+	 * node level prefer the group whose leader is closest in the cache
+	 * topology so that the hierarchy mirrors it and the migrator of a
+	 * group runs in the cluster which owns the timers.
+	 */
 	list_for_each_entry(tmp, &tmigr_level_list[lvl], list) {
 		/*
 		 * If @lvl is below the cross NUMA node level, check whether
@@ -1530,22 +1632,26 @@ static struct tmigr_group *tmigr_get_group(unsigned int cpu, int node,
 		if (lvl < tmigr_crossnode_level && tmp->numa_node != node)
 			continue;
 
+		ngroups++;
+
 		/* Capacity left? */
 		if (tmp->num_children >= TMIGR_CHILDREN_PER_GROUP)
 			continue;
 
-		/*
-		 * TODO: A possible further improvement: Make sure that all CPU
-		 * siblings end up in the same group of the lowest level of the
-		 * hierarchy. Rely on the topology sibling mask would be a
-		 * reasonable solution.
-		 */
-
-		group = tmp;
-		break;
+		score = topology ? tmigr_topology_score(cpu, tmp->leader) : 0;
+		if (!group || score > best) {
+			group = tmp;
+			best = score;
+		}
 	}
 
-	if (group)
+	/*
+	 * Open a new group instead of joining a group in a different cluster,
+	 * as long as the level is not populated with the estimated number of
+	 * groups already.
+	 */
+	if (group && (!topology || best == tmigr_topology_score(cpu, cpu) ||
+		      ngroups >= tmigr_level_groups(lvl)))
 		return group;
 
 	/* Allocate and	set up a new group */
@@ -1553,7 +1659,7 @@ static struct tmigr_group *tmigr_get_group(unsigned int cpu, int node,
 	if (!group)
 		return ERR_PTR(-ENOMEM);
 
-	tmigr_init_group(group, lvl, node);
+	tmigr_init_group(group, lvl, node, cpu);
 
 	/* Setup successful. Add it to the hierarchy */
 	list_add(&group->list, &tmigr_level_list[lvl]);
@@ -1582,6 +1688,7 @@ static void tmigr_connect_child_parent(struct tmigr_group *child,
 		/* Adding @child for the CPU going up to @parent. */
 		child->groupmask = BIT(parent->num_children++);
 	}
+	WRITE_ONCE(parent->children[__ffs(child->groupmask)], child);
 
 	/*
 	 * Make sure parent initialization is visible before publishing it to a
@@ -1805,6 +1912,7 @@ static int __init tmigr_init(void)
 	 * online CPUs.
 	 */
 	cpus_per_node = DIV_ROUND_UP(ncpus, nnodes);
+	tmigr_cpus_per_node = cpus_per_node;
 
 	/* Calc the hierarchy levels required to hold the CPUs of a node */
 	cpulvl = DIV_ROUND_UP(order_base_2(cpus_per_node),
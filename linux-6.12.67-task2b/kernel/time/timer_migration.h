@@ -51,6 +51,13 @@ struct tmigr_event {
  * @num_children:	Counter of group children to make sure the group is only
  *			filled with TMIGR_CHILDREN_PER_GROUP; Required for setup
  *			only
+ * @leader:		First CPU which was connected through this group; its
+ *			topology is compared against the topology of CPUs
+ *			coming up to keep the group cache topology local;
+ *			Required for setup only
+ * @children:		Child groups indexed by their groupmask bit; NULL for
+ *			the lowest level, where the children are CPUs. Set once
+ *			during setup and used to weight the migrator election
  * @groupmask:		mask of the group in the parent group; is set during
  *			setup and will never change; can be read lockless
  * @list:		List head that is added to the per level
@@ -68,6 +75,8 @@ struct tmigr_group {
 	unsigned int		level;
 	int			numa_node;
 	unsigned int		num_children;
+	unsigned int		leader;
+	struct tmigr_group	*children[TMIGR_CHILDREN_PER_GROUP];
 	u8			groupmask;
 	struct list_head	list;
 };
@@ -640,12 +640,58 @@ static bool __init noinline_for_stack blake2s_random_test(void)
 	return success;
 }
 
+static bool __init noinline_for_stack blake2s_many_test(void)
+{
+	/* around block boundaries, and empty, which keyed ends in the key block */
+	static const size_t lens[] __initconst = {
+		0, 1, BLAKE2S_BLOCK_SIZE - 1, BLAKE2S_BLOCK_SIZE,
+		BLAKE2S_BLOCK_SIZE + 1, 2 * BLAKE2S_BLOCK_SIZE,
+		2 * BLAKE2S_BLOCK_SIZE + 1, 3 * BLAKE2S_BLOCK_SIZE, 7,
+	};
+	u8 hash[ARRAY_SIZE(lens)][BLAKE2S_HASH_SIZE];
+	u8 buf[3 * BLAKE2S_BLOCK_SIZE + 1];
+	u8 expected[BLAKE2S_HASH_SIZE];
+	u8 key[BLAKE2S_KEY_SIZE];
+	const u8 *in[ARRAY_SIZE(lens)];
+	u8 *out[ARRAY_SIZE(lens)];
+	size_t inlen[ARRAY_SIZE(lens)];
+	bool success = true;
+	int i, keylen;
+
+	get_random_bytes(key, sizeof(key));
+	get_random_bytes(buf, sizeof(buf));
+
+	for (keylen = 0; keylen <= BLAKE2S_KEY_SIZE;
+	     keylen += BLAKE2S_KEY_SIZE / 2) {
+		for (i = 0; i < ARRAY_SIZE(lens); ++i) {
+			inlen[i] = lens[i];
+			in[i] = buf + sizeof(buf) - lens[i];
+			out[i] = hash[i];
+		}
+
+		blake2s_many(out, in, inlen, ARRAY_SIZE(lens),
+			     keylen ? key : NULL, BLAKE2S_HASH_SIZE, keylen);
+		for (i = 0; i < ARRAY_SIZE(lens); ++i) {
+			blake2s(expected, in[i], keylen ? key : NULL,
+				BLAKE2S_HASH_SIZE, inlen[i], keylen);
+			if (memcmp(hash[i], expected, sizeof(expected))) {
+				pr_err("blake2s many keylen %d self-test %d: FAIL\n",
+				       keylen, i + 1);
+				success = false;
+			}
+		}
+	}
+
+	return success;
+}
+
 bool __init blake2s_selftest(void)
 {
 	bool success;
 
 	success = blake2s_digest_test();
 	success &= blake2s_random_test();
+	success &= blake2s_many_test();
 
 	return success;
 }
@@ -77,6 +77,14 @@
 #include <linux/kernel.h>
 #include <linux/zstd.h>
 
+#ifndef UNZSTD_PREBOOT
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/minmax.h>
+#include <linux/mm.h>
+#include <linux/workqueue.h>
+#endif
+
 /* 128MB is the maximum window size supported by zstd. */
 #define ZSTD_WINDOWSIZE_MAX	(1 << ZSTD_WINDOWLOG_MAX)
 /*
@@ -129,8 +137,9 @@ static int INIT decompress_single(const u8 *in_buf, long in_len, u8 *out_buf,
 	const size_t wksp_size = zstd_dctx_workspace_bound();
 	void *wksp = large_malloc(wksp_size);
 	zstd_dctx *dctx = zstd_init_dctx(wksp, wksp_size);
+	long pos = 0, out_pos = 0;
 	int err;
-	size_t ret;
+	size_t ret, frame_len;
 
 	if (dctx == NULL) {
 		error("Out of memory while allocating zstd_dctx");
@@ -138,22 +147,31 @@ static int INIT decompress_single(const u8 *in_buf, long in_len, u8 *out_buf,
 		goto out;
 	}
 	/*
-	 * Find out how large the frame actually is, there may be junk at
-	 * the end of the frame that zstd_decompress_dctx() can't handle.
+	 * Decompress the frames one after the other. Find out how large each
+	 * frame actually is, there may be junk at the end of the last frame
+	 * that zstd_decompress_dctx() can't handle.
 	 */
-	ret = zstd_find_frame_compressed_size(in_buf, in_len);
-	err = handle_zstd_error(ret, error);
-	if (err)
-		goto out;
-	in_len = (long)ret;
+	do {
+		frame_len = zstd_find_frame_compressed_size(in_buf + pos,
+							    in_len - pos);
+		if (pos != 0 && zstd_is_error(frame_len))
+			break;
+		err = handle_zstd_error(frame_len, error);
+		if (err)
+			goto out;
 
-	ret = zstd_decompress_dctx(dctx, out_buf, out_len, in_buf, in_len);
-	err = handle_zstd_error(ret, error);
-	if (err)
-		goto out;
+		ret = zstd_decompress_dctx(dctx, out_buf + out_pos,
+					   out_len - out_pos, in_buf + pos,
+					   frame_len);
+		err = handle_zstd_error(ret, error);
+		if (err)
+			goto out;
+		pos += frame_len;
+		out_pos += ret;
+	} while (pos < in_len);
 
 	if (in_pos != NULL)
-		*in_pos = in_len;
+		*in_pos = pos;
 
 	err = 0;
 out:
@@ -175,8 +193,8 @@ static int INIT __unzstd(unsigned char *in_buf, long in_len,
 	void *in_allocated = NULL;
 	void *out_allocated = NULL;
 	void *wksp = NULL;
-	size_t wksp_size;
-	zstd_dstream *dstream;
+	size_t wksp_size, window_size = 0;
+	zstd_dstream *dstream = NULL;
 	int err;
 	size_t ret;
 
@@ -239,81 +257,119 @@ static int INIT __unzstd(unsigned char *in_buf, long in_len,
 	out.pos = 0;
 	out.size = out_len;
 
-	/*
-	 * We need to know the window size to allocate the zstd_dstream.
-	 * Since we are streaming, we need to allocate a buffer for the sliding
-	 * window. The window size varies from 1 KB to ZSTD_WINDOWSIZE_MAX
-	 * (8 MB), so it is important to use the actual value so as not to
-	 * waste memory when it is smaller.
-	 */
-	ret = zstd_get_frame_header(&header, in.src, in.size);
-	err = handle_zstd_error(ret, error);
-	if (err)
-		goto out;
-	if (ret != 0) {
-		error("ZSTD-compressed data has an incomplete frame header");
-		err = -1;
-		goto out;
-	}
-	if (header.windowSize > ZSTD_WINDOWSIZE_MAX) {
-		error("ZSTD-compressed data has too large a window size");
-		err = -1;
-		goto out;
-	}
-
-	/*
-	 * Allocate the zstd_dstream now that we know how much memory is
-	 * required.
-	 */
-	wksp_size = zstd_dstream_workspace_bound(header.windowSize);
-	wksp = large_malloc(wksp_size);
-	dstream = zstd_init_dstream(header.windowSize, wksp, wksp_size);
-	if (dstream == NULL) {
-		error("Out of memory while allocating ZSTD_DStream");
-		err = -1;
-		goto out;
-	}
-
-	/*
-	 * Decompression loop:
-	 * Read more data if necessary (error if no more data can be read).
-	 * Call the decompression function, which returns 0 when finished.
-	 * Flush any data produced if using flush().
-	 */
 	if (in_pos != NULL)
 		*in_pos = 0;
-	do {
+	for (;;) {
 		/*
-		 * If we need to reload data, either we have fill() and can
-		 * try to get more data, or we don't and the input is truncated.
+		 * We need to know the window size to allocate the
+		 * zstd_dstream. Since we are streaming, we need to allocate a
+		 * buffer for the sliding window. The window size varies from
+		 * 1 KB to ZSTD_WINDOWSIZE_MAX (8 MB), so it is important to use
+		 * the actual value so as not to waste memory when it is
+		 * smaller. If a later frame's header is cut off by the end of
+		 * the input buffer, assume the largest window.
 		 */
-		if (in.pos == in.size) {
-			if (in_pos != NULL)
-				*in_pos += in.pos;
-			in_len = fill ? fill(in_buf, ZSTD_IOBUF_SIZE) : -1;
-			if (in_len < 0) {
-				error("ZSTD-compressed data is truncated");
-				err = -1;
-				goto out;
-			}
-			in.pos = 0;
-			in.size = in_len;
-		}
-		/* Returns zero when the frame is complete. */
-		ret = zstd_decompress_stream(dstream, &out, &in);
+		ret = zstd_get_frame_header(&header, in.src + in.pos,
+					    in.size - in.pos);
+		/* junk after the last frame */
+		if (dstream != NULL && (zstd_is_error(ret) ||
+					(ret != 0 && fill == NULL)))
+			break;
 		err = handle_zstd_error(ret, error);
 		if (err)
 			goto out;
-		/* Flush all of the data produced if using flush(). */
-		if (flush != NULL && out.pos > 0) {
-			if (out.pos != flush(out.dst, out.pos)) {
-				error("Failed to flush()");
+		if (ret != 0 && dstream == NULL) {
+			error("ZSTD-compressed data has an incomplete frame header");
+			err = -1;
+			goto out;
+		}
+		if (ret != 0)
+			header.windowSize = ZSTD_WINDOWSIZE_MAX;
+		if (header.windowSize > ZSTD_WINDOWSIZE_MAX) {
+			error("ZSTD-compressed data has too large a window size");
+			err = -1;
+			goto out;
+		}
+
+		/*
+		 * Allocate the zstd_dstream now that we know how much memory
+		 * is required, or reuse the one of the previous frame if its
+		 * window is large enough.
+		 */
+		if (dstream == NULL || header.windowSize > window_size) {
+			if (wksp != NULL)
+				large_free(wksp);
+			window_size = header.windowSize;
+			wksp_size = zstd_dstream_workspace_bound(window_size);
+			wksp = large_malloc(wksp_size);
+			dstream = zstd_init_dstream(window_size, wksp,
+						    wksp_size);
+			if (dstream == NULL) {
+				error("Out of memory while allocating ZSTD_DStream");
 				err = -1;
 				goto out;
 			}
-			out.pos = 0;
+		} else {
+			ret = zstd_reset_dstream(dstream);
+			err = handle_zstd_error(ret, error);
+			if (err)
+				goto out;
 		}
-	} while (ret != 0);
+
+		/*
+		 * Decompression loop:
+		 * Read more data if necessary (error if no more data can be
+		 * read). Call the decompression function, which returns 0 when
+		 * the frame is finished. Flush any data produced if using
+		 * flush().
+		 */
+		do {
+			/*
+			 * If we need to reload data, either we have fill() and
+			 * can try to get more data, or we don't and the input
+			 * is truncated.
+			 */
+			if (in.pos == in.size) {
+				if (in_pos != NULL)
+					*in_pos += in.pos;
+				in_len = fill ? fill(in_buf, ZSTD_IOBUF_SIZE) : -1;
+				if (in_len < 0) {
+					error("ZSTD-compressed data is truncated");
+					err = -1;
+					goto out;
+				}
+				in.pos = 0;
+				in.size = in_len;
+			}
+			/* Returns zero when the frame is complete. */
+			ret = zstd_decompress_stream(dstream, &out, &in);
+			err = handle_zstd_error(ret, error);
+			if (err)
+				goto out;
+			/* Flush all of the data produced if using flush(). */
+			if (flush != NULL && out.pos > 0) {
+				if (out.pos != flush(out.dst, out.pos)) {
+					error("Failed to flush()");
+					err = -1;
+					goto out;
+				}
+				out.pos = 0;
+			}
+		} while (ret != 0);
+
+		/* Go on with the next frame, if there is more input. */
+		if (in.pos == in.size) {
+			if (fill == NULL)
+				break;
+			if (in_pos != NULL)
+				*in_pos += in.pos;
+			in_len = fill(in_buf, ZSTD_IOBUF_SIZE);
+			in.pos = 0;
+			in.size = in_len > 0 ? in_len : 0;
+			if (in_len <= 0)
+				break;
+		}
+	}
 
 	if (in_pos != NULL)
 		*in_pos += in.pos;
@@ -330,6 +386,182 @@ out:
 }
 
 #ifndef UNZSTD_PREBOOT
+/*
+ * Parallel decompression of multi-frame input
+ *
+ * zstd frames are independent of each other, so when the whole input is in
+ * memory and the output goes to flush() (as for the initramfs), consecutive
+ * frames whose decompressed size is recorded in the frame header are
+ * decompressed by workers on the unbound workqueue, and their output is
+ * handed to flush() in order. Multi-frame archives are what pzstd or
+ * "zstd --split" style tools produce; a single frame, or a frame without a
+ * content size, is decompressed in the caller like before.
+ *
+ * In-flight output is bounded to an eighth of memory and frames are limited
+ * in size, so a large single frame never needs a buffer of its full size.
+ */
+#define UNZSTD_MT_MAX_JOBS	32
+#define UNZSTD_MT_MAX_FRAME	(64UL << 20)
+
+struct unzstd_job {
+	struct work_struct work;
+	struct completion done;
+	zstd_dctx *dctx;
+	void *wksp;
+	const u8 *src;
+	size_t src_len;
+	u8 *dst;
+	size_t dst_len;
+	size_t ret;
+};
+
+static void INIT unzstd_job_fn(struct work_struct *work)
+{
+	struct unzstd_job *job = container_of(work, struct unzstd_job, work);
+
+	job->ret = zstd_decompress_dctx(job->dctx, job->dst, job->dst_len,
+					job->src, job->src_len);
+	if (!zstd_is_error(job->ret) && job->ret != job->dst_len)
+		job->ret = -ZSTD_error_corruption_detected;
+	complete(&job->done);
+}
+
+/*
+ * Size up the frame at @in: returns its compressed size if it can go to a
+ * worker, storing the decompressed size in @out_len, or 0 if it can't.
+ */
+static size_t INIT unzstd_mt_frame(const u8 *in, size_t in_len,
+				   size_t *out_len)
+{
+	zstd_frame_header header;
+	size_t ret;
+
+	ret = zstd_get_frame_header(&header, in, in_len);
+	if (zstd_is_error(ret) || ret != 0 ||
+	    header.frameType != ZSTD_frame ||
+	    header.frameContentSize == ZSTD_CONTENTSIZE_UNKNOWN ||
+	    header.frameContentSize == 0 ||
+	    header.frameContentSize > UNZSTD_MT_MAX_FRAME)
+		return 0;
+
+	ret = zstd_find_frame_compressed_size(in, in_len);
+	if (zstd_is_error(ret))
+		return 0;
+
+	*out_len = header.frameContentSize;
+	return ret;
+}
+
+/* Returns 1 if the input is not worth decompressing in parallel. */
+static int INIT unzstd_mt(const u8 *in_buf, long in_len,
+			  long (*flush)(void*, unsigned long),
+			  long *in_pos, void (*error)(char *x))
+{
+	const size_t wksp_size = zstd_dctx_workspace_bound();
+	size_t budget = (totalram_pages() << PAGE_SHIFT) / 8;
+	unsigned int nr_alloc, nr_jobs, head = 0, nr_busy = 0, i;
+	size_t frame_len, out_len, busy_len = 0;
+	struct unzstd_job *jobs;
+	long pos = 0, used;
+	int err = 0;
+
+	/* a second frame is needed for there to be anything to overlap */
+	frame_len = unzstd_mt_frame(in_buf, in_len, &out_len);
+	if (!frame_len || frame_len >= in_len ||
+	    !unzstd_mt_frame(in_buf + frame_len, in_len - frame_len, &out_len))
+		return 1;
+
+	nr_alloc = nr_jobs = min(num_online_cpus(), UNZSTD_MT_MAX_JOBS);
+	if (nr_jobs < 2)
+		return 1;
+
+	jobs = kcalloc(nr_alloc, sizeof(*jobs), GFP_KERNEL);
+	if (!jobs)
+		return 1;
+	for (i = 0; i < nr_alloc; i++) {
+		jobs[i].wksp = large_malloc(wksp_size);
+		jobs[i].dctx = zstd_init_dctx(jobs[i].wksp, wksp_size);
+		if (!jobs[i].dctx) {
+			nr_jobs = i;
+			break;
+		}
+		INIT_WORK(&jobs[i].work, unzstd_job_fn);
+	}
+	if (nr_jobs < 2) {
+		err = 1;
+		goto out;
+	}
+
+	for (;;) {
+		/* keep every worker busy, within the memory budget */
+		while (!err && nr_busy < nr_jobs && pos < in_len) {
+			struct unzstd_job *job = &jobs[(head + nr_busy) % nr_jobs];
+
+			frame_len = unzstd_mt_frame(in_buf + pos, in_len - pos,
+						    &out_len);
+			if (!frame_len ||
+			    (nr_busy && busy_len + out_len > budget))
+				break;
+
+			job->dst = large_malloc(out_len);
+			if (!job->dst)
+				break;
+			job->src = in_buf + pos;
+			job->src_len = frame_len;
+			job->dst_len = out_len;
+			init_completion(&job->done);
+			queue_work(system_unbound_wq, &job->work);
+
+			pos += frame_len;
+			busy_len += out_len;
+			nr_busy++;
+		}
+
+		if (!nr_busy) {
+			if (err || pos >= in_len)
+				break;
+			/*
+			 * A frame without a usable content size: stream it
+			 * here, then carry on with the frames after it.
+			 */
+			frame_len = zstd_find_frame_compressed_size(in_buf + pos,
+								    in_len - pos);
+			if (zstd_is_error(frame_len))
+				break;
+			err = __unzstd((unsigned char *)in_buf + pos,
+				       frame_len, NULL, flush, NULL, 0,
+				       &used, error);
+			if (err)
+				break;
+			pos += used;
+			continue;
+		}
+
+		/* hand the oldest frame to flush(), in input order */
+		wait_for_completion(&jobs[head].done);
+		if (!err) {
+			err = handle_zstd_error(jobs[head].ret, error);
+			if (!err && flush(jobs[head].dst, jobs[head].dst_len) !=
+				    jobs[head].dst_len) {
+				error("Failed to flush()");
+				err = -1;
+			}
+		}
+		large_free(jobs[head].dst);
+		busy_len -= jobs[head].dst_len;
+		head = (head + 1) % nr_jobs;
+		nr_busy--;
+	}
+
+	if (in_pos != NULL)
+		*in_pos = pos;
+out:
+	for (i = 0; i < nr_alloc; i++)
+		large_free(jobs[i].wksp);
+	kfree(jobs);
+	return err;
+}
+
 STATIC int INIT unzstd(unsigned char *buf, long len,
 		       long (*fill)(void*, unsigned long),
 		       long (*flush)(void*, unsigned long),
@@ -337,6 +569,13 @@ STATIC int INIT unzstd(unsigned char *buf, long len,
 		       long *pos,
 		       void (*error)(char *x))
 {
+	if (buf != NULL && fill == NULL && flush != NULL) {
+		int ret = unzstd_mt(buf, len, flush, pos, error);
+
+		if (ret <= 0)
+			return ret;
+	}
+
 	return __unzstd(buf, len, fill, flush, out_buf, 0, pos, error);
 }
 #else
@@ -0,0 +1,706 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Throughput benchmark for lib/ data structures.
+ *
+ * A run is started by writing its configuration to
+ * <debugfs>/ds_benchmark/run, for example
+ *
+ *   echo "type=xarray threads=8 keys=1048576 dist=hot mix=90,5,5" > run
+ *
+ * The write returns once the run is over and reading the file afterwards
+ * gives the results of the last run as a single line of key=value pairs.
+ *
+ * Every thread is bound to its own online CPU, as far as there are any,
+ * and performs a random mix of lookups, inserts and erases on one shared
+ * instance of the structure, which is prefilled with fill percent of the
+ * keys. Keys are drawn uniformly, sequentially from a per-thread starting
+ * point, or from a hot range which receives most of the operations.
+ *
+ * What lookup, insert and erase map to:
+ *
+ *   rhashtable      rhashtable_lookup_fast / _lookup_insert_fast / _remove_fast
+ *   maple           mtree_load / mtree_insert / mtree_erase (RCU mode)
+ *   xarray          xa_load / xa_insert / xa_erase
+ *   sbitmap         sbitmap_test_bit / sbitmap_get / sbitmap_put
+ *   percpu_counter  percpu_counter_compare / percpu_counter_add(1) / (-1)
+ *
+ * sbitmap allocates bits rather than keys: an insert gets a free bit and
+ * an erase puts one of the bits the thread holds, fill percent of the bits
+ * stay allocated for the whole run. The percpu_counter lookup compares the
+ * counter against the key, which only sums up the per-CPU counts when the
+ * two are close.
+ */
+
+#include <linux/cpu.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/maple_tree.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/percpu_counter.h>
+#include <linux/prandom.h>
+#include <linux/rhashtable.h>
+#include <linux/sbitmap.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/xarray.h>
+
+#define DSB_MAX_THREADS		1024
+#define DSB_MAX_KEYS		(1U << 24)
+#define DSB_MAX_DURATION_MS	60000
+
+enum dsb_type {
+	DSB_RHASHTABLE,
+	DSB_MAPLE,
+	DSB_XARRAY,
+	DSB_SBITMAP,
+	DSB_PERCPU_COUNTER,
+	DSB_NR_TYPES,
+};
+
+static const char * const dsb_type_names[DSB_NR_TYPES] = {
+	[DSB_RHASHTABLE]	= "rhashtable",
+	[DSB_MAPLE]		= "maple",
+	[DSB_XARRAY]		= "xarray",
+	[DSB_SBITMAP]		= "sbitmap",
+	[DSB_PERCPU_COUNTER]	= "percpu_counter",
+};
+
+enum dsb_op {
+	DSB_LOOKUP,
+	DSB_INSERT,
+	DSB_ERASE,
+	DSB_NR_OPS,
+};
+
+enum dsb_dist {
+	DSB_UNIFORM,
+	DSB_SEQ,
+	DSB_HOT,
+	DSB_NR_DISTS,
+};
+
+static const char * const dsb_dist_names[DSB_NR_DISTS] = {
+	[DSB_UNIFORM]	= "uniform",
+	[DSB_SEQ]	= "seq",
+	[DSB_HOT]	= "hot",
+};
+
+struct dsb_config {
+	enum dsb_type	type;
+	enum dsb_dist	dist;
+	unsigned int	threads;
+	unsigned int	keys;
+	unsigned int	fill_pct;
+	unsigned int	duration_ms;
+	unsigned int	mix[DSB_NR_OPS];
+	unsigned int	hot_keys_pct;
+	unsigned int	hot_ops_pct;
+	u32		seed;
+};
+
+struct dsb_obj {
+	struct rhash_head	node;
+	u32			key;
+};
+
+struct dsb_thread {
+	struct task_struct	*task;
+	struct rnd_state	rnd;
+	u32			cursor;
+	u32			*held;		/* sbitmap bits owned */
+	unsigned int		nr_held;
+	unsigned int		max_held;
+	u64			ops[DSB_NR_OPS];
+	u64			fails[DSB_NR_OPS];
+	u64			elapsed_ns;
+} ____cacheline_aligned_in_smp;
+
+struct dsb_bench {
+	struct dsb_config	cfg;
+	unsigned int		mix_total;
+	unsigned int		hot_keys;
+	struct dsb_thread	*threads;
+	struct completion	start;
+	bool			stop;
+
+	/* read-mostly above, written by the threads below */
+	struct rhashtable	ht ____cacheline_aligned_in_smp;
+	struct dsb_obj		*objs;
+	struct maple_tree	mt;
+	struct xarray		xa;
+	struct sbitmap		sb;
+	struct percpu_counter	pcc;
+};
+
+static const struct rhashtable_params dsb_ht_params = {
+	.head_offset		= offsetof(struct dsb_obj, node),
+	.key_offset		= offsetof(struct dsb_obj, key),
+	.key_len		= sizeof(u32),
+	.automatic_shrinking	= true,
+};
+
+static DEFINE_MUTEX(dsb_mutex);
+static struct dsb_bench dsb;
+static char dsb_result[512];
+static struct dentry *dsb_dir;
+
+static const struct dsb_config dsb_defaults = {
+	.type		= DSB_NR_TYPES,
+	.dist		= DSB_UNIFORM,
+	.threads	= 1,
+	.keys		= 65536,
+	.fill_pct	= 50,
+	.duration_ms	= 1000,
+	.mix		= { 80, 10, 10 },
+	.hot_keys_pct	= 10,
+	.hot_ops_pct	= 90,
+	.seed		= 1,
+};
+
+/* a key in [lo, lo + n), without a division */
+static inline u32 dsb_range(struct dsb_thread *t, u32 lo, u32 n)
+{
+	return lo + (u32)(((u64)prandom_u32_state(&t->rnd) * n) >> 32);
+}
+
+static inline u32 dsb_pick_key(struct dsb_bench *b, struct dsb_thread *t)
+{
+	u32 keys = b->cfg.keys;
+
+	switch (b->cfg.dist) {
+	case DSB_SEQ:
+		if (++t->cursor >= keys)
+			t->cursor = 0;
+		return t->cursor;
+	case DSB_HOT:
+		if (keys > b->hot_keys &&
+		    dsb_range(t, 0, 100) >= b->cfg.hot_ops_pct)
+			return dsb_range(t, b->hot_keys, keys - b->hot_keys);
+		return dsb_range(t, 0, b->hot_keys);
+	default:
+		return dsb_range(t, 0, keys);
+	}
+}
+
+static inline enum dsb_op dsb_pick_op(struct dsb_bench *b, struct dsb_thread *t)
+{
+	u32 r = dsb_range(t, 0, b->mix_total);
+
+	if (r < b->cfg.mix[DSB_LOOKUP])
+		return DSB_LOOKUP;
+	if (r < b->cfg.mix[DSB_LOOKUP] + b->cfg.mix[DSB_INSERT])
+		return DSB_INSERT;
+	return DSB_ERASE;
+}
+
+/*
+ * The rhashtable objects are preallocated per key and only freed after the
+ * run, so an object erased by one thread may be inserted again right away
+ * by another; readers walking it meanwhile restart their lookup.
+ */
+static bool dsb_rhashtable_op(struct dsb_bench *b, enum dsb_op op, u32 key)
+{
+	struct dsb_obj *obj = &b->objs[key];
+
+	switch (op) {
+	case DSB_LOOKUP:
+		return rhashtable_lookup_fast(&b->ht, &key, dsb_ht_params);
+	case DSB_INSERT:
+		return !rhashtable_lookup_insert_fast(&b->ht, &obj->node,
+						      dsb_ht_params);
+	default:
+		return !rhashtable_remove_fast(&b->ht, &obj->node, dsb_ht_params);
+	}
+}
+
+static bool dsb_maple_op(struct dsb_bench *b, enum dsb_op op, u32 key)
+{
+	switch (op) {
+	case DSB_LOOKUP:
+		return mtree_load(&b->mt, key);
+	case DSB_INSERT:
+		return !mtree_insert(&b->mt, key, xa_mk_value(key), GFP_KERNEL);
+	default:
+		return mtree_erase(&b->mt, key);
+	}
+}
+
+static bool dsb_xarray_op(struct dsb_bench *b, enum dsb_op op, u32 key)
+{
+	switch (op) {
+	case DSB_LOOKUP:
+		return xa_load(&b->xa, key);
+	case DSB_INSERT:
+		return !xa_insert(&b->xa, key, xa_mk_value(key), GFP_KERNEL);
+	default:
+		return xa_erase(&b->xa, key);
+	}
+}
+
+static bool dsb_sbitmap_op(struct dsb_bench *b, struct dsb_thread *t,
+			   enum dsb_op op, u32 key)
+{
+	unsigned int i;
+	int bit;
+
+	switch (op) {
+	case DSB_LOOKUP:
+		return sbitmap_test_bit(&b->sb, key);
+	case DSB_INSERT:
+		if (t->nr_held == t->max_held)
+			return false;
+		bit = sbitmap_get(&b->sb);
+		if (bit < 0)
+			return false;
+		t->held[t->nr_held++] = bit;
+		return true;
+	default:
+		if (!t->nr_held)
+			return false;
+		/* put a random one of the held bits, not the latest */
+		i = dsb_range(t, 0, t->nr_held);
+		sbitmap_put(&b->sb, t->held[i]);
+		t->held[i] = t->held[--t->nr_held];
+		return true;
+	}
+}
+
+static bool dsb_percpu_counter_op(struct dsb_bench *b, enum dsb_op op, u32 key)
+{
+	switch (op) {
+	case DSB_LOOKUP:
+		return percpu_counter_compare(&b->pcc, key) >= 0;
+	case DSB_INSERT:
+		percpu_counter_add(&b->pcc, 1);
+		return true;
+	default:
+		percpu_counter_add(&b->pcc, -1);
+		return true;
+	}
+}
+
+static inline bool dsb_op(struct dsb_bench *b, struct dsb_thread *t,
+			  enum dsb_op op, u32 key)
+{
+	switch (b->cfg.type) {
+	case DSB_RHASHTABLE:
+		return dsb_rhashtable_op(b, op, key);
+	case DSB_MAPLE:
+		return dsb_maple_op(b, op, key);
+	case DSB_XARRAY:
+		return dsb_xarray_op(b, op, key);
+	case DSB_SBITMAP:
+		return dsb_sbitmap_op(b, t, op, key);
+	default:
+		return dsb_percpu_counter_op(b, op, key);
+	}
+}
+
+static int dsb_thread_fn(void *arg)
+{
+	struct dsb_thread *t = arg;
+	struct dsb_bench *b = &dsb;
+	unsigned int n = 0;
+	u64 start;
+
+	wait_for_completion(&b->start);
+
+	start = ktime_get_ns();
+	while (!READ_ONCE(b->stop)) {
+		enum dsb_op op = dsb_pick_op(b, t);
+
+		t->ops[op]++;
+		if (!dsb_op(b, t, op, dsb_pick_key(b, t)))
+			t->fails[op]++;
+		if (!(++n & 255))
+			cond_resched();
+	}
+	t->elapsed_ns = ktime_get_ns() - start;
+
+	/* stay around for kthread_stop() */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int dsb_init_struct(struct dsb_bench *b)
+{
+	unsigned int keys = b->cfg.keys;
+	int err;
+	u32 i;
+
+	switch (b->cfg.type) {
+	case DSB_RHASHTABLE:
+		b->objs = kvcalloc(keys, sizeof(*b->objs), GFP_KERNEL);
+		if (!b->objs)
+			return -ENOMEM;
+		for (i = 0; i < keys; i++)
+			b->objs[i].key = i;
+		err = rhashtable_init(&b->ht, &dsb_ht_params);
+		if (err) {
+			kvfree(b->objs);
+			b->objs = NULL;
+		}
+		return err;
+	case DSB_MAPLE:
+		mt_init_flags(&b->mt, MT_FLAGS_USE_RCU);
+		return 0;
+	case DSB_XARRAY:
+		xa_init(&b->xa);
+		return 0;
+	case DSB_SBITMAP:
+		return sbitmap_init_node(&b->sb, keys, -1, GFP_KERNEL,
+					 NUMA_NO_NODE, false, true);
+	default:
+		return percpu_counter_init(&b->pcc, 0, GFP_KERNEL);
+	}
+}
+
+static void dsb_destroy_struct(struct dsb_bench *b)
+{
+	switch (b->cfg.type) {
+	case DSB_RHASHTABLE:
+		rhashtable_destroy(&b->ht);
+		kvfree(b->objs);
+		b->objs = NULL;
+		break;
+	case DSB_MAPLE:
+		mtree_destroy(&b->mt);
+		break;
+	case DSB_XARRAY:
+		xa_destroy(&b->xa);
+		break;
+	case DSB_SBITMAP:
+		sbitmap_free(&b->sb);
+		break;
+	default:
+		percpu_counter_destroy(&b->pcc);
+		break;
+	}
+}
+
+static int dsb_fill(struct dsb_bench *b)
+{
+	struct dsb_thread *t = &b->threads[0];
+	s64 filled = 0;
+	u32 key;
+
+	for (key = 0; key < b->cfg.keys; key++) {
+		if (dsb_range(t, 0, 100) >= b->cfg.fill_pct)
+			continue;
+
+		switch (b->cfg.type) {
+		case DSB_SBITMAP:
+			sbitmap_set_bit(&b->sb, key);
+			break;
+		case DSB_PERCPU_COUNTER:
+			break;
+		default:
+			if (!dsb_op(b, t, DSB_INSERT, key))
+				return -ENOMEM;
+			break;
+		}
+		filled++;
+		if (!(key & 1023))
+			cond_resched();
+	}
+
+	if (b->cfg.type == DSB_PERCPU_COUNTER)
+		percpu_counter_set(&b->pcc, filled);
+	return 0;
+}
+
+static int dsb_alloc_threads(struct dsb_bench *b)
+{
+	unsigned int i, nr = b->cfg.threads;
+
+	b->threads = kvcalloc(nr, sizeof(*b->threads), GFP_KERNEL);
+	if (!b->threads)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		struct dsb_thread *t = &b->threads[i];
+
+		prandom_seed_state(&t->rnd, (u64)b->cfg.seed << 32 | i);
+		t->cursor = (u64)i * b->cfg.keys / nr;
+
+		if (b->cfg.type != DSB_SBITMAP)
+			continue;
+		t->max_held = DIV_ROUND_UP(b->cfg.keys, nr);
+		t->held = kvmalloc_array(t->max_held, sizeof(*t->held),
+					 GFP_KERNEL);
+		if (!t->held)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static void dsb_free_threads(struct dsb_bench *b)
+{
+	unsigned int i;
+
+	if (!b->threads)
+		return;
+
+	for (i = 0; i < b->cfg.threads; i++)
+		kvfree(b->threads[i].held);
+	kvfree(b->threads);
+	b->threads = NULL;
+}
+
+static int dsb_start_threads(struct dsb_bench *b)
+{
+	unsigned int i;
+	int cpu = -1, err = 0;
+
+	cpus_read_lock();
+	for (i = 0; i < b->cfg.threads; i++) {
+		struct task_struct *task;
+
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+
+		task = kthread_create(dsb_thread_fn, &b->threads[i],
+				      "ds_bench/%u", i);
+		if (IS_ERR(task)) {
+			err = PTR_ERR(task);
+			break;
+		}
+		kthread_bind(task, cpu);
+		b->threads[i].task = task;
+		wake_up_process(task);
+	}
+	cpus_read_unlock();
+
+	return err;
+}
+
+static void dsb_stop_threads(struct dsb_bench *b)
+{
+	unsigned int i;
+
+	WRITE_ONCE(b->stop, true);
+	complete_all(&b->start);
+	for (i = 0; i < b->cfg.threads; i++)
+		if (b->threads[i].task)
+			kthread_stop(b->threads[i].task);
+}
+
+static void dsb_report(struct dsb_bench *b)
+{
+	u64 ops[DSB_NR_OPS] = {}, fails[DSB_NR_OPS] = {};
+	u64 total = 0, elapsed = 0, tmin = U64_MAX, tmax = 0;
+	unsigned int i, op;
+
+	for (i = 0; i < b->cfg.threads; i++) {
+		struct dsb_thread *t = &b->threads[i];
+		u64 sum = 0;
+
+		for (op = 0; op < DSB_NR_OPS; op++) {
+			ops[op] += t->ops[op];
+			fails[op] += t->fails[op];
+			sum += t->ops[op];
+		}
+		total += sum;
+		tmin = min(tmin, sum);
+		tmax = max(tmax, sum);
+		elapsed = max(elapsed, t->elapsed_ns);
+	}
+
+	scnprintf(dsb_result, sizeof(dsb_result),
+		  "type=%s threads=%u keys=%u dist=%s fill=%u "
+		  "duration_ns=%llu ops=%llu ops_per_sec=%llu "
+		  "thread_min=%llu thread_max=%llu "
+		  "lookup=%llu lookup_miss=%llu insert=%llu insert_fail=%llu "
+		  "erase=%llu erase_fail=%llu\n",
+		  dsb_type_names[b->cfg.type], b->cfg.threads, b->cfg.keys,
+		  dsb_dist_names[b->cfg.dist], b->cfg.fill_pct, elapsed, total,
+		  elapsed ? mul_u64_u64_div_u64(total, NSEC_PER_SEC, elapsed) : 0,
+		  tmin, tmax, ops[DSB_LOOKUP], fails[DSB_LOOKUP],
+		  ops[DSB_INSERT], fails[DSB_INSERT],
+		  ops[DSB_ERASE], fails[DSB_ERASE]);
+}
+
+static int dsb_run(const struct dsb_config *cfg)
+{
+	struct dsb_bench *b = &dsb;
+	unsigned int op;
+	int err;
+
+	memset(b, 0, sizeof(*b));
+	b->cfg = *cfg;
+	for (op = 0; op < DSB_NR_OPS; op++)
+		b->mix_total += cfg->mix[op];
+	b->hot_keys = max(1U, (u32)((u64)cfg->keys * cfg->hot_keys_pct / 100));
+	init_completion(&b->start);
+
+	err = dsb_alloc_threads(b);
+	if (err)
+		goto out_threads;
+
+	err = dsb_init_struct(b);
+	if (err)
+		goto out_threads;
+
+	err = dsb_fill(b);
+	if (err)
+		goto out_struct;
+
+	err = dsb_start_threads(b);
+	if (!err) {
+		complete_all(&b->start);
+		if (msleep_interruptible(cfg->duration_ms))
+			err = -EINTR;
+	}
+	dsb_stop_threads(b);
+
+	if (!err)
+		dsb_report(b);
+	else
+		dsb_result[0] = '\0';
+
+out_struct:
+	dsb_destroy_struct(b);
+out_threads:
+	dsb_free_threads(b);
+	return err;
+}
+
+static int dsb_match(const char * const *names, unsigned int nr, const char *val)
+{
+	int i = match_string(names, nr, val);
+
+	return i < 0 ? -EINVAL : i;
+}
+
+static int dsb_parse(char *args, struct dsb_config *cfg)
+{
+	char *param, *val;
+	int ret;
+
+	*cfg = dsb_defaults;
+
+	args = skip_spaces(args);
+	while (*args) {
+		args = next_arg(args, &param, &val);
+		if (!val)
+			return -EINVAL;
+
+		if (!strcmp(param, "type")) {
+			ret = dsb_match(dsb_type_names, DSB_NR_TYPES, val);
+			cfg->type = ret;
+		} else if (!strcmp(param, "dist")) {
+			ret = dsb_match(dsb_dist_names, DSB_NR_DISTS, val);
+			cfg->dist = ret;
+		} else if (!strcmp(param, "threads")) {
+			ret = kstrtouint(val, 0, &cfg->threads);
+		} else if (!strcmp(param, "keys")) {
+			ret = kstrtouint(val, 0, &cfg->keys);
+		} else if (!strcmp(param, "fill")) {
+			ret = kstrtouint(val, 0, &cfg->fill_pct);
+		} else if (!strcmp(param, "duration_ms")) {
+			ret = kstrtouint(val, 0, &cfg->duration_ms);
+		} else if (!strcmp(param, "seed")) {
+			ret = kstrtou32(val, 0, &cfg->seed);
+		} else if (!strcmp(param, "mix")) {
+			ret = sscanf(val, "%u,%u,%u", &cfg->mix[DSB_LOOKUP],
+				     &cfg->mix[DSB_INSERT],
+				     &cfg->mix[DSB_ERASE]) == 3 ? 0 : -EINVAL;
+		} else if (!strcmp(param, "hot")) {
+			ret = sscanf(val, "%u,%u", &cfg->hot_keys_pct,
+				     &cfg->hot_ops_pct) == 2 ? 0 : -EINVAL;
+		} else {
+			ret = -EINVAL;
+		}
+		if (ret < 0)
+			return ret;
+	}
+
+	if (cfg->type >= DSB_NR_TYPES ||
+	    !cfg->threads || cfg->threads > DSB_MAX_THREADS ||
+	    !cfg->keys || cfg->keys > DSB_MAX_KEYS ||
+	    cfg->fill_pct > 100 || cfg->hot_keys_pct > 100 ||
+	    cfg->hot_ops_pct > 100 ||
+	    !cfg->duration_ms || cfg->duration_ms > DSB_MAX_DURATION_MS ||
+	    cfg->mix[DSB_LOOKUP] > 100 || cfg->mix[DSB_INSERT] > 100 ||
+	    cfg->mix[DSB_ERASE] > 100 ||
+	    !(cfg->mix[DSB_LOOKUP] + cfg->mix[DSB_INSERT] + cfg->mix[DSB_ERASE]))
+		return -EINVAL;
+	return 0;
+}
+
+static ssize_t dsb_run_write(struct file *file, const char __user *ubuf,
+			     size_t count, loff_t *ppos)
+{
+	struct dsb_config cfg;
+	char *buf;
+	int err;
+
+	if (count >= PAGE_SIZE)
+		return -EINVAL;
+
+	buf = memdup_user_nul(ubuf, count);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	err = dsb_parse(buf, &cfg);
+	kfree(buf);
+	if (err)
+		return err;
+
+	if (mutex_lock_interruptible(&dsb_mutex))
+		return -EINTR;
+	err = dsb_run(&cfg);
+	mutex_unlock(&dsb_mutex);
+
+	return err ? err : count;
+}
+
+static ssize_t dsb_run_read(struct file *file, char __user *ubuf,
+			    size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	if (mutex_lock_interruptible(&dsb_mutex))
+		return -EINTR;
+	ret = simple_read_from_buffer(ubuf, count, ppos, dsb_result,
+				      strlen(dsb_result));
+	mutex_unlock(&dsb_mutex);
+
+	return ret;
+}
+
+static const struct file_operations dsb_run_fops = {
+	.owner	= THIS_MODULE,
+	.read	= dsb_run_read,
+	.write	= dsb_run_write,
+	.llseek	= default_llseek,
+};
+
+static int __init ds_benchmark_init(void)
+{
+	dsb_dir = debugfs_create_dir("ds_benchmark", NULL);
+	debugfs_create_file("run", 0600, dsb_dir, NULL, &dsb_run_fops);
+	return 0;
+}
+
+static void __exit ds_benchmark_exit(void)
+{
+	debugfs_remove_recursive(dsb_dir);
+}
+
+module_init(ds_benchmark_init);
+module_exit(ds_benchmark_exit);
+
+MODULE_DESCRIPTION("Benchmark for lib/ data structures");
+MODULE_LICENSE("GPL");
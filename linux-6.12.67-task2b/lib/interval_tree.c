@@ -3,6 +3,9 @@
 #include <linux/interval_tree_generic.h>
 #include <linux/compiler.h>
 #include <linux/export.h>
+#include <linux/minmax.h>
+#include <linux/prefetch.h>
+#include <linux/slab.h>
 
 #define START(node) ((node)->start)
 #define LAST(node)  ((node)->last)
@@ -16,6 +19,312 @@ EXPORT_SYMBOL_GPL(interval_tree_remove);
 EXPORT_SYMBOL_GPL(interval_tree_iter_first);
 EXPORT_SYMBOL_GPL(interval_tree_iter_next);
 
+/*
+ * Static interval index. Entry i has children 2i and 2i + 1, an entry is
+ * in the index iff 1 <= i <= nr. Filling the entries in-order while walking
+ * the rbtree in start order gives a search tree ordered like the rbtree.
+ */
+/* number of lookups interval_tree_static_lookup() runs side by side */
+#define INTERVAL_TREE_STATIC_BATCH	8U
+
+static struct rb_node *
+interval_tree_static_fill(struct interval_tree_static *its, unsigned int i,
+			  struct rb_node *rb)
+{
+	struct interval_tree_static_entry *e;
+	struct interval_tree_node *node;
+
+	if (i > its->nr)
+		return rb;
+
+	rb = interval_tree_static_fill(its, 2 * i, rb);
+
+	node = rb_entry(rb, struct interval_tree_node, rb);
+	e = &its->entries[i];
+	e->start = node->start;
+	e->last = node->last;
+	e->node = node;
+
+	return interval_tree_static_fill(its, 2 * i + 1, rb_next(rb));
+}
+
+/**
+ * interval_tree_static_build - Build a static index of an interval tree
+ * @its: Index to (re)build
+ * @root: Interval tree to take the intervals from
+ * @gfp: Allocation flags
+ *
+ * Replaces any previous contents of @its with a snapshot of @root. On failure
+ * @its is left invalid, so queries keep working on @root.
+ *
+ * Return: 0 on success, -ENOMEM or -E2BIG on failure.
+ */
+int interval_tree_static_build(struct interval_tree_static *its,
+			       struct rb_root_cached *root, gfp_t gfp)
+{
+	struct rb_node *rb;
+	unsigned int i, nr = 0;
+
+	interval_tree_static_destroy(its);
+	its->root = root;
+
+	for (rb = rb_first_cached(root); rb; rb = rb_next(rb))
+		if (++nr == UINT_MAX)
+			return -E2BIG;
+	if (!nr)
+		return 0;
+
+	its->entries = kvmalloc_array(nr + 1, sizeof(*its->entries), gfp);
+	if (!its->entries)
+		return -ENOMEM;
+	its->nr = nr;
+
+	interval_tree_static_fill(its, 1, rb_first_cached(root));
+
+	for (i = nr; i; i--) {
+		struct interval_tree_static_entry *e = &its->entries[i];
+
+		e->subtree_last = e->last;
+		if (2 * i <= nr)
+			e->subtree_last = max(e->subtree_last,
+					      its->entries[2 * i].subtree_last);
+		if (2 * i + 1 <= nr)
+			e->subtree_last = max(e->subtree_last,
+					      its->entries[2 * i + 1].subtree_last);
+	}
+
+	its->valid = true;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(interval_tree_static_build);
+
+/**
+ * interval_tree_static_destroy - Free a static interval index
+ * @its: Index to free
+ *
+ * The rbtree the index was built from is not touched.
+ */
+void interval_tree_static_destroy(struct interval_tree_static *its)
+{
+	kvfree(its->entries);
+	its->entries = NULL;
+	its->nr = 0;
+	its->valid = false;
+}
+EXPORT_SYMBOL_GPL(interval_tree_static_destroy);
+
+/*
+ * Same as interval_tree_subtree_search(): find the leftmost entry in the
+ * subtree of @i intersecting [start;last], given start <= subtree_last(i).
+ * Returns 0 if there is none.
+ */
+static unsigned int
+interval_tree_static_search(const struct interval_tree_static *its,
+			    unsigned int i, unsigned long start,
+			    unsigned long last)
+{
+	const struct interval_tree_static_entry *e = its->entries;
+	unsigned int nr = its->nr;
+
+	while (true) {
+		/* the four grandchildren are adjacent */
+		prefetch(&e[4 * i]);
+
+		if (2 * i <= nr && start <= e[2 * i].subtree_last) {
+			i = 2 * i;
+			continue;
+		}
+		if (e[i].start <= last) {
+			if (start <= e[i].last)
+				return i;
+			if (2 * i + 1 <= nr) {
+				i = 2 * i + 1;
+				if (start <= e[i].subtree_last)
+					continue;
+			}
+		}
+		return 0;
+	}
+}
+
+static unsigned int
+interval_tree_static_first(const struct interval_tree_static *its,
+			   unsigned long start, unsigned long last)
+{
+	const struct interval_tree_static_entry *e = its->entries;
+
+	if (!its->nr || e[1].subtree_last < start)
+		return 0;
+	return interval_tree_static_search(its, 1, start, last);
+}
+
+/*
+ * One step of interval_tree_static_search() for the point @index. Returns the
+ * entry to continue at, the matching entry with @found set, or 0 if nothing
+ * in the subtree of @i contains @index.
+ */
+static unsigned int
+interval_tree_static_step(const struct interval_tree_static *its,
+			  unsigned int i, unsigned long index, bool *found)
+{
+	const struct interval_tree_static_entry *e = its->entries;
+
+	if (2 * i <= its->nr && index <= e[2 * i].subtree_last)
+		return 2 * i;
+	if (e[i].start <= index) {
+		if (index <= e[i].last) {
+			*found = true;
+			return i;
+		}
+		if (2 * i + 1 <= its->nr && index <= e[2 * i + 1].subtree_last)
+			return 2 * i + 1;
+	}
+	return 0;
+}
+
+/* Same as interval_tree_iter_next(), on the implicit tree */
+static unsigned int
+interval_tree_static_next(const struct interval_tree_static *its,
+			  unsigned int i, unsigned long start,
+			  unsigned long last)
+{
+	const struct interval_tree_static_entry *e = its->entries;
+	unsigned int prev;
+
+	while (true) {
+		if (2 * i + 1 <= its->nr && start <= e[2 * i + 1].subtree_last)
+			return interval_tree_static_search(its, 2 * i + 1,
+							   start, last);
+
+		/* Move up the tree until we come from an entry's left child */
+		do {
+			prev = i;
+			i >>= 1;
+			if (!i)
+				return 0;
+		} while (prev & 1);
+
+		if (last < e[i].start)
+			return 0;
+		if (start <= e[i].last)
+			return i;
+	}
+}
+
+/**
+ * interval_tree_static_iter_first - Find the first interval intersecting a range
+ * @its: Static index
+ * @iter: Iteration state, for interval_tree_static_iter_next()
+ * @start: First index of the range
+ * @last: Last index of the range (inclusive)
+ *
+ * Returns intervals in the same order as interval_tree_iter_first() does. If
+ * the index is invalid the rbtree it was built from is searched.
+ */
+struct interval_tree_node *
+interval_tree_static_iter_first(const struct interval_tree_static *its,
+				struct interval_tree_static_iter *iter,
+				unsigned long start, unsigned long last)
+{
+	iter->its = its;
+	iter->start = start;
+	iter->last = last;
+
+	if (!its->valid) {
+		iter->node = interval_tree_iter_first(its->root, start, last);
+		return iter->node;
+	}
+
+	iter->pos = interval_tree_static_first(its, start, last);
+	return iter->pos ? its->entries[iter->pos].node : NULL;
+}
+EXPORT_SYMBOL_GPL(interval_tree_static_iter_first);
+
+/**
+ * interval_tree_static_iter_next - Find the next interval intersecting a range
+ * @iter: Iteration state from interval_tree_static_iter_first()
+ *
+ * Must not be called after a previous call returned NULL.
+ */
+struct interval_tree_node *
+interval_tree_static_iter_next(struct interval_tree_static_iter *iter)
+{
+	const struct interval_tree_static *its = iter->its;
+
+	if (!its->valid) {
+		iter->node = interval_tree_iter_next(iter->node, iter->start,
+						     iter->last);
+		return iter->node;
+	}
+
+	iter->pos = interval_tree_static_next(its, iter->pos, iter->start,
+					      iter->last);
+	return iter->pos ? its->entries[iter->pos].node : NULL;
+}
+EXPORT_SYMBOL_GPL(interval_tree_static_iter_next);
+
+/**
+ * interval_tree_static_lookup - Stab a static index with many points
+ * @its: Static index
+ * @index: Points to look up
+ * @nr: Number of points in @index
+ * @nodes: Output, for each point the first interval containing it, or NULL
+ *
+ * Equivalent to calling interval_tree_iter_first(root, index[i], index[i])
+ * for every point, but the searches are interleaved so that the memory
+ * accesses of independent lookups overlap.
+ */
+void interval_tree_static_lookup(const struct interval_tree_static *its,
+				 const unsigned long *index, unsigned int nr,
+				 struct interval_tree_node **nodes)
+{
+	unsigned int i;
+
+	if (!its->valid) {
+		for (i = 0; i < nr; i++)
+			nodes[i] = interval_tree_iter_first(its->root, index[i],
+							    index[i]);
+		return;
+	}
+
+	for (i = 0; i < nr; i += INTERVAL_TREE_STATIC_BATCH) {
+		unsigned int pos[INTERVAL_TREE_STATIC_BATCH];
+		unsigned int k, n = min(nr - i, INTERVAL_TREE_STATIC_BATCH);
+		unsigned int active = 0;
+
+		for (k = 0; k < n; k++) {
+			pos[k] = 0;
+			nodes[i + k] = NULL;
+			if (its->nr && index[i + k] <= its->entries[1].subtree_last) {
+				pos[k] = 1;
+				active++;
+			}
+		}
+
+		/* advance every lookup of the batch by one level per round */
+		while (active) {
+			for (k = 0; k < n; k++) {
+				bool found = false;
+
+				if (!pos[k])
+					continue;
+				pos[k] = interval_tree_static_step(its, pos[k],
+								   index[i + k],
+								   &found);
+				if (found) {
+					nodes[i + k] = its->entries[pos[k]].node;
+					pos[k] = 0;
+				}
+				if (!pos[k])
+					active--;
+				else
+					prefetch(&its->entries[4 * pos[k]]);
+			}
+		}
+	}
+}
+EXPORT_SYMBOL_GPL(interval_tree_static_lookup);
+
 #ifdef CONFIG_INTERVAL_TREE_SPAN_ITER
 /*
  * Roll nodes[1] into nodes[0] by advancing nodes[1] to the end of a contiguous
@@ -21,6 +21,7 @@ __param(bool, search_all, false, "Searches will iterate all nodes in the tree");
 __param(uint, max_endpoint, ~0, "Largest value for the interval's endpoint");
 
 static struct rb_root_cached root = RB_ROOT_CACHED;
+static struct interval_tree_static its;
 static struct interval_tree_node *nodes = NULL;
 static u32 *queries = NULL;
 
@@ -38,6 +39,19 @@ search(struct rb_root_cached *root, unsigned long start, unsigned long last)
 	return results;
 }
 
+static inline unsigned long
+search_static(struct interval_tree_static *its, unsigned long start,
+	      unsigned long last)
+{
+	struct interval_tree_static_iter iter;
+	struct interval_tree_node *node;
+	unsigned long results = 0;
+
+	interval_tree_static_for_each(node, its, &iter, start, last)
+		results++;
+	return results;
+}
+
 static void init(void)
 {
 	int i;
@@ -64,6 +78,8 @@ static int interval_tree_test_init(void)
 	int i, j;
 	unsigned long results;
 	cycles_t time1, time2, time;
+	struct interval_tree_node **lookup_nodes = NULL;
+	unsigned long *lookup_index = NULL;
 
 	nodes = kmalloc_array(nnodes, sizeof(struct interval_tree_node),
 			      GFP_KERNEL);
@@ -120,6 +136,66 @@ static int interval_tree_test_init(void)
 	printk(" -> %llu cycles (%lu results)\n",
 	       (unsigned long long)time, results);
 
+	printk(KERN_ALERT "interval tree static search");
+
+	if (interval_tree_static_build(&its, &root, GFP_KERNEL))
+		goto out;
+
+	time1 = get_cycles();
+
+	results = 0;
+	for (i = 0; i < search_loops; i++)
+		for (j = 0; j < nsearches; j++) {
+			unsigned long start = search_all ? 0 : queries[j];
+			unsigned long last = search_all ? max_endpoint : queries[j];
+
+			results += search_static(&its, start, last);
+		}
+
+	time2 = get_cycles();
+	time = time2 - time1;
+
+	time = div_u64(time, search_loops);
+	results = div_u64(results, search_loops);
+	printk(" -> %llu cycles (%lu results)\n",
+	       (unsigned long long)time, results);
+
+	printk(KERN_ALERT "interval tree static batched lookup");
+
+	lookup_index = kmalloc_array(nsearches, sizeof(*lookup_index), GFP_KERNEL);
+	lookup_nodes = kmalloc_array(nsearches, sizeof(*lookup_nodes), GFP_KERNEL);
+	if (!lookup_index || !lookup_nodes)
+		goto out;
+
+	for (j = 0; j < nsearches; j++)
+		lookup_index[j] = queries[j];
+
+	time1 = get_cycles();
+
+	for (i = 0; i < search_loops; i++)
+		interval_tree_static_lookup(&its, lookup_index, nsearches,
+					    lookup_nodes);
+
+	time2 = get_cycles();
+	time = time2 - time1;
+
+	results = 0;
+	for (j = 0; j < nsearches; j++) {
+		if (lookup_nodes[j] != interval_tree_iter_first(&root,
+						lookup_index[j], lookup_index[j]))
+			printk(KERN_ALERT "lookup mismatch at %lu\n",
+			       lookup_index[j]);
+		results += !!lookup_nodes[j];
+	}
+
+	time = div_u64(time, search_loops);
+	printk(" -> %llu cycles (%lu hits)\n",
+	       (unsigned long long)time, results);
+
+out:
+	kfree(lookup_nodes);
+	kfree(lookup_index);
+	interval_tree_static_destroy(&its);
 	kfree(queries);
 	kfree(nodes);
 
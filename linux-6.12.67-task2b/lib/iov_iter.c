@@ -12,6 +12,8 @@
 #include <linux/scatterlist.h>
 #include <linux/instrumented.h>
 #include <linux/iov_iter.h>
+#include <linux/prefetch.h>
+#include <linux/unaligned.h>
 
 static __always_inline
 size_t copy_to_user_iter(void __user *iter_to, size_t progress,
@@ -74,6 +76,277 @@ size_t memcpy_from_iter(void *iter_from, size_t progress,
 	return 0;
 }
 
+/*
+ * Runs of up to IOV_BATCH_SEGS iovec segments of at most IOV_SMALL_SEG bytes
+ * each are checked up front and copied inline, with one user access window
+ * per range of segments that are adjacent in user memory. This saves the
+ * out of line raw_copy_{to,from}_user() call per segment, and the
+ * access_ok()/STAC/CLAC of all but the first segment of each such range,
+ * for readv()/writev() with many small segments.
+ */
+#define IOV_SMALL_SEG	128
+#define IOV_BATCH_SEGS	16
+
+#ifdef unsafe_copy_from_user
+#define iov_unsafe_copy_from_user unsafe_copy_from_user
+#else
+/* Not every architecture with user_access_begin() provides this one. */
+#define iov_unsafe_copy_from_user_loop(dst, src, len, type, label)	\
+	while (len >= sizeof(type)) {					\
+		type __v;						\
+		unsafe_get_user(__v, (type __user *)src, label);	\
+		put_unaligned(__v, (type *)dst);			\
+		dst += sizeof(type);					\
+		src += sizeof(type);					\
+		len -= sizeof(type);					\
+	}
+
+#define iov_unsafe_copy_from_user(_dst, _src, _len, label)		\
+do {									\
+	char *__ucf_dst = (_dst);					\
+	const char __user *__ucf_src = (_src);				\
+	size_t __ucf_len = (_len);					\
+	iov_unsafe_copy_from_user_loop(__ucf_dst, __ucf_src, __ucf_len, u64, label); \
+	iov_unsafe_copy_from_user_loop(__ucf_dst, __ucf_src, __ucf_len, u32, label); \
+	iov_unsafe_copy_from_user_loop(__ucf_dst, __ucf_src, __ucf_len, u16, label); \
+	iov_unsafe_copy_from_user_loop(__ucf_dst, __ucf_src, __ucf_len, u8, label);  \
+} while (0)
+#endif
+
+/*
+ * Copy @len bytes between @kbuf and the user range at @ubase in one user
+ * access window covering exactly that range. Returns false if it faults.
+ */
+static __always_inline
+bool iovec_copy_contig(void __user *ubase, void *kbuf, size_t len,
+		       bool to_user)
+{
+	if (to_user) {
+		instrument_copy_to_user(ubase, kbuf, len);
+		if (!user_write_access_begin(ubase, len))
+			return false;
+		unsafe_copy_to_user(ubase, kbuf, len, fault_write);
+		user_write_access_end();
+		return true;
+fault_write:
+		user_write_access_end();
+		return false;
+	}
+
+	instrument_copy_from_user_before(kbuf, ubase, len);
+	if (!user_read_access_begin(ubase, len))
+		goto out_fault;
+	iov_unsafe_copy_from_user(kbuf, ubase, len, fault_read);
+	user_read_access_end();
+	instrument_copy_from_user_after(kbuf, ubase, len, 0);
+	return true;
+fault_read:
+	user_read_access_end();
+out_fault:
+	instrument_copy_from_user_after(kbuf, ubase, len, len);
+	return false;
+}
+
+/*
+ * Copy the @nr segments of @bytes found by iovec_copy_run() in a single user
+ * access window, masking each segment's address instead of checking it with
+ * access_ok(). Returns @bytes, or on a fault the number of bytes in the
+ * segments before the faulting one, with *@pp and *@pskip advanced to it.
+ */
+static __always_inline
+size_t iovec_copy_masked(const struct iovec **pp, size_t *pskip,
+			 unsigned int nr, size_t bytes, void *kbuf,
+			 bool to_user)
+{
+	const struct iovec *p = *pp;
+	size_t skip = *pskip, done, part;
+	void __user *ubase;
+	unsigned int k;
+
+	/* nothing but the copies may run inside the window */
+	for (k = 0, done = 0; k < nr; k++, p++, skip = 0) {
+		part = min(bytes - done, p->iov_len - skip);
+		if (to_user)
+			instrument_copy_to_user(p->iov_base + skip,
+						kbuf + done, part);
+		else
+			instrument_copy_from_user_before(kbuf + done,
+							 p->iov_base + skip,
+							 part);
+		done += part;
+	}
+
+	p = *pp;
+	skip = *pskip;
+	ubase = masked_user_access_begin(p->iov_base + skip);
+	for (k = 0, done = 0; k < nr; k++, p++, skip = 0) {
+		part = min(bytes - done, p->iov_len - skip);
+		if (k)
+			ubase = mask_user_address(p->iov_base + skip);
+		if (to_user)
+			unsafe_copy_to_user(ubase, kbuf + done, part, fault);
+		else
+			iov_unsafe_copy_from_user(kbuf + done, ubase, part,
+						  fault);
+		done += part;
+	}
+	user_access_end();
+
+	if (!to_user)
+		instrument_copy_from_user_after(kbuf, (*pp)->iov_base + *pskip,
+						bytes, 0);
+	return bytes;
+
+fault:
+	user_access_end();
+	if (!to_user)
+		instrument_copy_from_user_after(kbuf, (*pp)->iov_base + *pskip,
+						bytes, bytes - done);
+	*pp = p;
+	*pskip = skip;
+	return done;
+}
+
+/*
+ * Copy a run of small segments starting at *@pp + *@pskip, for at most @len
+ * bytes, and advance *@pp and *@pskip past what was copied. Returns the
+ * number of bytes copied. If the first segment is too large, or the copy
+ * faults in it, nothing is copied or advanced and the caller has to fall
+ * back to copying one segment at a time.
+ *
+ * With masked user access the whole run is copied in one access window.
+ * Otherwise a window can only be opened by user_*_access_begin(), which
+ * checks access_ok() on its range: segments that are adjacent in user memory
+ * are copied as one range, but every other segment still opens a window of
+ * its own. The scan leaves the checks to those windows.
+ */
+static __always_inline
+size_t iovec_copy_run(const struct iovec **pp, size_t *pskip,
+		      const struct iovec *end, size_t len, void *kbuf,
+		      bool to_user)
+{
+	const struct iovec *p = *pp, *next;
+	size_t skip = *pskip, bytes = 0, done = 0, ulen = 0, part, next_skip;
+	void __user *ubase = NULL, *base;
+	unsigned int nr = 0, k;
+
+	prefetch(p + IOV_BATCH_SEGS);
+
+	/* Find the run, the copies check the addresses. */
+	while (nr < IOV_BATCH_SEGS && p < end && bytes < len) {
+		part = min(len - bytes, p->iov_len - skip);
+		if (part > IOV_SMALL_SEG)
+			break;
+		bytes += part;
+		nr++;
+		if (skip + part < p->iov_len) {
+			skip += part;
+			break;
+		}
+		p++;
+		skip = 0;
+	}
+	if (!nr)
+		return 0;
+	next = p;
+	next_skip = skip;
+
+	if (can_do_masked_user_access()) {
+		done = iovec_copy_masked(pp, pskip, nr, bytes, kbuf, to_user);
+		if (done == bytes) {
+			*pp = next;
+			*pskip = next_skip;
+		}
+		return done;
+	}
+
+	p = *pp;
+	skip = *pskip;
+	for (k = 0; k < nr; k++, p++, skip = 0) {
+		part = min(bytes - done - ulen, p->iov_len - skip);
+		base = p->iov_base + skip;
+		if (ulen && base != ubase + ulen) {
+			if (!iovec_copy_contig(ubase, kbuf + done, ulen,
+					       to_user))
+				return done;
+			done += ulen;
+			ulen = 0;
+			/* everything before this segment is done */
+			*pp = p;
+			*pskip = skip;
+		}
+		if (!ulen)
+			ubase = base;
+		ulen += part;
+	}
+	if (!iovec_copy_contig(ubase, kbuf + done, ulen, to_user))
+		return done;
+	done += ulen;
+
+	*pp = next;
+	*pskip = next_skip;
+	return done;
+}
+
+/*
+ * Like iterate_and_advance() with copy_{to,from}_user_iter() for an
+ * ITER_IOVEC iterator, but with runs of small segments batched by
+ * iovec_copy_run().
+ */
+static __always_inline
+size_t copy_iovec_batched(struct iov_iter *iter, size_t len, void *kbuf,
+			  bool to_user)
+{
+	const struct iovec *p = iter->__iov, *end = p + iter->nr_segs;
+	size_t progress = 0, skip = iter->iov_offset;
+
+	if (unlikely(iter->count < len))
+		len = iter->count;
+	if (unlikely(!len))
+		return 0;
+
+	do {
+		const struct iovec *run = p;
+		size_t run_skip = skip, remain, consumed, part;
+
+		if (!IS_ENABLED(CONFIG_FAULT_INJECTION_USERCOPY)) {
+			consumed = iovec_copy_run(&p, &skip, end, len,
+						  kbuf + progress, to_user);
+			progress += consumed;
+			len -= consumed;
+			if (p != run || skip != run_skip)
+				continue;
+		}
+
+		/* Large segment, bad address or fault: one segment at a time. */
+		part = min(len, p->iov_len - skip);
+		if (likely(part)) {
+			if (to_user)
+				remain = copy_to_user_iter(p->iov_base + skip,
+							   progress, part,
+							   kbuf, NULL);
+			else
+				remain = copy_from_user_iter(p->iov_base + skip,
+							     progress, part,
+							     kbuf, NULL);
+			consumed = part - remain;
+			progress += consumed;
+			skip += consumed;
+			len -= consumed;
+			if (skip < p->iov_len)
+				break;
+		}
+		p++;
+		skip = 0;
+	} while (len);
+
+	iter->nr_segs -= p - iter->__iov;
+	iter->__iov = p;
+	iter->iov_offset = skip;
+	iter->count -= progress;
+	return progress;
+}
+
 /*
  * fault_in_iov_iter_readable - fault in iov iterator for reading
  * @i: iterator
@@ -182,6 +455,8 @@ size_t _copy_to_iter(const void *addr, size_t bytes, struct iov_iter *i)
 		return 0;
 	if (user_backed_iter(i))
 		might_fault();
+	if (iter_is_iovec(i))
+		return copy_iovec_batched(i, bytes, (void *)addr, true);
 	return iterate_and_advance(i, bytes, (void *)addr,
 				   copy_to_user_iter, memcpy_to_iter);
 }
@@ -246,6 +521,8 @@ EXPORT_SYMBOL_GPL(_copy_mc_to_iter);
 static __always_inline
 size_t __copy_from_iter(void *addr, size_t bytes, struct iov_iter *i)
 {
+	if (iter_is_iovec(i))
+		return copy_iovec_batched(i, bytes, addr, false);
 	return iterate_and_advance(i, bytes, addr,
 				   copy_from_user_iter, memcpy_from_iter);
 }
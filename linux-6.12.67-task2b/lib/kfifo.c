@@ -593,3 +593,231 @@ unsigned int __kfifo_dma_out_prepare_r(struct __kfifo *fifo,
 }
 EXPORT_SYMBOL(__kfifo_dma_out_prepare_r);
 
+
+/*
+ * Slot of a kfifo_mp. @seq is pos when the slot is free for the writer at
+ * position pos, pos + 1 once that writer has published its record, and
+ * pos + size once the reader has consumed it, making it free for the writer
+ * one lap later.
+ */
+struct kfifo_mp_slot {
+	unsigned int	seq;
+	unsigned int	len;
+	unsigned char	data[];
+};
+
+static inline struct kfifo_mp_slot *kfifo_mp_slot(struct kfifo_mp *fifo,
+	unsigned int pos)
+{
+	return fifo->data + (size_t)(pos & fifo->mask) * fifo->slot_size;
+}
+
+/**
+ * kfifo_mp_alloc - allocate a multi-producer, multi-consumer fifo
+ * @fifo: the fifo to initialize
+ * @size: the number of records, rounded up to a power of 2
+ * @esize: the maximum size of a record in bytes
+ * @gfp_mask: get_free_pages mask, passed to kmalloc()
+ *
+ * Return: 0 on success, -EINVAL or -ENOMEM otherwise.
+ */
+int kfifo_mp_alloc(struct kfifo_mp *fifo, unsigned int size,
+		unsigned int esize, gfp_t gfp_mask)
+{
+	unsigned int i;
+
+	size = roundup_pow_of_two(size);
+
+	fifo->in = 0;
+	fifo->out = 0;
+	fifo->esize = esize;
+	fifo->slot_size = ALIGN(sizeof(struct kfifo_mp_slot) + esize,
+				sizeof(unsigned long));
+
+	if (size < 2 || !esize) {
+		fifo->data = NULL;
+		fifo->mask = 0;
+		return -EINVAL;
+	}
+
+	fifo->data = kmalloc_array(size, fifo->slot_size, gfp_mask);
+
+	if (!fifo->data) {
+		fifo->mask = 0;
+		return -ENOMEM;
+	}
+	fifo->mask = size - 1;
+
+	for (i = 0; i < size; i++)
+		kfifo_mp_slot(fifo, i)->seq = i;
+
+	return 0;
+}
+EXPORT_SYMBOL(kfifo_mp_alloc);
+
+/**
+ * kfifo_mp_free - free a fifo allocated with kfifo_mp_alloc()
+ * @fifo: the fifo to free
+ */
+void kfifo_mp_free(struct kfifo_mp *fifo)
+{
+	kfree(fifo->data);
+	fifo->in = 0;
+	fifo->out = 0;
+	fifo->esize = 0;
+	fifo->data = NULL;
+	fifo->mask = 0;
+}
+EXPORT_SYMBOL(kfifo_mp_free);
+
+/**
+ * kfifo_mp_in_prepare - claim the next free slot of the fifo
+ * @fifo: address of the fifo
+ * @pos: returns the position of the slot, to pass to kfifo_mp_in_finish()
+ *
+ * Return: a pointer to @fifo->esize bytes for the record, or NULL if the
+ * fifo is full.
+ */
+void *kfifo_mp_in_prepare(struct kfifo_mp *fifo, unsigned int *pos)
+{
+	unsigned int in = READ_ONCE(fifo->in);
+	struct kfifo_mp_slot *slot;
+	int diff;
+
+	for (;;) {
+		slot = kfifo_mp_slot(fifo, in);
+		/* Pairs with the release in kfifo_mp_out_finish(). */
+		diff = (int)(smp_load_acquire(&slot->seq) - in);
+		if (!diff) {
+			if (try_cmpxchg(&fifo->in, &in, in + 1))
+				break;
+		} else if (diff < 0) {
+			/* the reader a lap behind has not freed the slot */
+			return NULL;
+		} else {
+			in = READ_ONCE(fifo->in);
+		}
+	}
+
+	*pos = in;
+	return slot->data;
+}
+EXPORT_SYMBOL(kfifo_mp_in_prepare);
+
+/**
+ * kfifo_mp_in_finish - publish a record written to a claimed slot
+ * @fifo: address of the fifo
+ * @pos: the position returned by kfifo_mp_in_prepare()
+ * @len: the length of the record, at most @fifo->esize
+ */
+void kfifo_mp_in_finish(struct kfifo_mp *fifo, unsigned int pos,
+		unsigned int len)
+{
+	struct kfifo_mp_slot *slot = kfifo_mp_slot(fifo, pos);
+
+	slot->len = min(len, fifo->esize);
+	/* Pairs with the acquire in kfifo_mp_out_prepare(). */
+	smp_store_release(&slot->seq, pos + 1);
+}
+EXPORT_SYMBOL(kfifo_mp_in_finish);
+
+/**
+ * kfifo_mp_out_prepare - claim the oldest record of the fifo
+ * @fifo: address of the fifo
+ * @pos: returns the position of the slot, to pass to kfifo_mp_out_finish()
+ * @len: returns the length of the record
+ *
+ * Return: a pointer to the record, or NULL if the fifo is empty or its oldest
+ * record has not been published yet.
+ */
+const void *kfifo_mp_out_prepare(struct kfifo_mp *fifo, unsigned int *pos,
+		unsigned int *len)
+{
+	unsigned int out = READ_ONCE(fifo->out);
+	struct kfifo_mp_slot *slot;
+	int diff;
+
+	for (;;) {
+		slot = kfifo_mp_slot(fifo, out);
+		/* Pairs with the release in kfifo_mp_in_finish(). */
+		diff = (int)(smp_load_acquire(&slot->seq) - (out + 1));
+		if (!diff) {
+			if (try_cmpxchg(&fifo->out, &out, out + 1))
+				break;
+		} else if (diff < 0) {
+			return NULL;
+		} else {
+			out = READ_ONCE(fifo->out);
+		}
+	}
+
+	*pos = out;
+	*len = slot->len;
+	return slot->data;
+}
+EXPORT_SYMBOL(kfifo_mp_out_prepare);
+
+/**
+ * kfifo_mp_out_finish - release a slot claimed by kfifo_mp_out_prepare()
+ * @fifo: address of the fifo
+ * @pos: the position returned by kfifo_mp_out_prepare()
+ */
+void kfifo_mp_out_finish(struct kfifo_mp *fifo, unsigned int pos)
+{
+	/* Pairs with the acquire in kfifo_mp_in_prepare(). */
+	smp_store_release(&kfifo_mp_slot(fifo, pos)->seq, pos + fifo->mask + 1);
+}
+EXPORT_SYMBOL(kfifo_mp_out_finish);
+
+/**
+ * kfifo_mp_in - put a record into the fifo
+ * @fifo: address of the fifo
+ * @buf: the data to be added
+ * @len: the length of the data, truncated to @fifo->esize
+ *
+ * Return: the number of bytes stored, 0 if the fifo is full.
+ */
+unsigned int kfifo_mp_in(struct kfifo_mp *fifo, const void *buf,
+		unsigned int len)
+{
+	unsigned int pos;
+	void *data;
+
+	len = min(len, fifo->esize);
+
+	data = kfifo_mp_in_prepare(fifo, &pos);
+	if (!data)
+		return 0;
+
+	memcpy(data, buf, len);
+	kfifo_mp_in_finish(fifo, pos, len);
+
+	return len;
+}
+EXPORT_SYMBOL(kfifo_mp_in);
+
+/**
+ * kfifo_mp_out - get a record from the fifo
+ * @fifo: address of the fifo
+ * @buf: pointer to the storage buffer
+ * @len: the size of the buffer; the rest of a longer record is dropped
+ *
+ * Return: the number of bytes copied, 0 if the fifo is empty.
+ */
+unsigned int kfifo_mp_out(struct kfifo_mp *fifo, void *buf,
+		unsigned int len)
+{
+	unsigned int pos, n;
+	const void *data;
+
+	data = kfifo_mp_out_prepare(fifo, &pos, &n);
+	if (!data)
+		return 0;
+
+	n = min(n, len);
+	memcpy(buf, data, n);
+	kfifo_mp_out_finish(fifo, pos);
+
+	return n;
+}
+EXPORT_SYMBOL(kfifo_mp_out);
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0-only
-/* I/O iterator tests.  This can only test kernel-backed iterator types.
+/* I/O iterator tests.  ITER_IOVEC is tested against a KUnit-managed user
+ * mapping; the other user-backed iterator types aren't tested.
  *
  * Copyright (C) 2023 Red Hat, Inc. All Rights Reserved.
  * Written by David Howells (dhowells@redhat.com)
@@ -10,6 +11,8 @@
 #include <linux/module.h>
 #include <linux/vmalloc.h>
 #include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/ktime.h>
 #include <linux/uio.h>
 #include <linux/bvec.h>
 #include <linux/folio_queue.h>
@@ -696,6 +699,211 @@ stop:
 	KUNIT_SUCCEED(test);
 }
 
+static void __user *__init iov_kunit_create_user_buffer(struct kunit *test,
+							size_t size)
+{
+	unsigned long addr;
+
+	if (!IS_ENABLED(CONFIG_MMU))
+		kunit_skip(test, "Userspace allocation testing not available on non-MMU systems");
+
+	addr = kunit_vm_mmap(test, NULL, 0, size, PROT_READ | PROT_WRITE,
+			     MAP_ANONYMOUS | MAP_PRIVATE, 0);
+	KUNIT_ASSERT_NE_MSG(test, addr, 0, "Could not create userspace mm");
+	KUNIT_ASSERT_LT(test, addr, (unsigned long)TASK_SIZE);
+	return (void __user *)addr;
+}
+
+/*
+ * Load an iovec with @nr segments, mostly small, some adjacent to the previous
+ * one and some not.  Every segment starts @gap bytes after the previous one if
+ * @gap is non-zero and is @seglen bytes long if @seglen is non-zero.
+ */
+static void __init iov_kunit_load_iovec(struct kunit *test,
+					struct iov_iter *iter, int dir,
+					struct iovec *iov, unsigned int nr,
+					void __user *buffer, size_t bufsize,
+					size_t seglen, size_t gap)
+{
+	size_t size = 0, off = 0, len;
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		len = seglen ?: (i % 17 == 0 ? 300 : (i * 7) % 61);
+		off += gap ?: (i % 3 == 0 ? 8 : 0);
+		KUNIT_ASSERT_LE(test, off + len, bufsize);
+		iov[i].iov_base = buffer + off;
+		iov[i].iov_len = len;
+		off += len;
+		size += len;
+	}
+
+	iov_iter_init(iter, dir, iov, nr, size);
+}
+
+/*
+ * Test copying to a ITER_IOVEC-type iterator with many small segments.
+ */
+static void __init iov_kunit_copy_to_iovec(struct kunit *test)
+{
+	struct iov_iter iter;
+	struct iovec *iov;
+	void __user *ubuf;
+	u8 *scratch, *buffer;
+	size_t bufsize = 0x10000, size, copied;
+	unsigned int nr = 256, i, j, patt;
+
+	iov = kunit_kcalloc(test, nr, sizeof(*iov), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, iov);
+	scratch = kunit_kmalloc(test, bufsize, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, scratch);
+	buffer = kunit_kmalloc(test, bufsize, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buffer);
+	ubuf = iov_kunit_create_user_buffer(test, bufsize);
+
+	for (i = 0; i < bufsize; i++)
+		scratch[i] = pattern(i);
+
+	iov_kunit_load_iovec(test, &iter, READ, iov, nr, ubuf, bufsize, 0, 0);
+	size = iter.count;
+
+	/* Stop part way into a segment, then copy the rest. */
+	copied = copy_to_iter(scratch, size / 2 + 1, &iter);
+	KUNIT_EXPECT_EQ(test, copied, size / 2 + 1);
+	copied += copy_to_iter(scratch + copied, size - copied, &iter);
+
+	KUNIT_EXPECT_EQ(test, copied, size);
+	KUNIT_EXPECT_EQ(test, iter.count, 0);
+	KUNIT_EXPECT_EQ(test, iter.nr_segs, 0);
+
+	KUNIT_ASSERT_EQ(test, copy_from_user(buffer, ubuf, bufsize), 0);
+
+	/* Build the expected image in the scratch buffer. */
+	patt = 0;
+	memset(scratch, 0, bufsize);
+	for (i = 0; i < nr; i++) {
+		size_t off = iov[i].iov_base - ubuf;
+
+		for (j = 0; j < iov[i].iov_len; j++)
+			scratch[off + j] = pattern(patt++);
+	}
+
+	/* Compare the images */
+	for (i = 0; i < bufsize; i++) {
+		KUNIT_EXPECT_EQ_MSG(test, buffer[i], scratch[i], "at i=%x", i);
+		if (buffer[i] != scratch[i])
+			return;
+	}
+
+	KUNIT_SUCCEED(test);
+}
+
+/*
+ * Test copying from a ITER_IOVEC-type iterator with many small segments.
+ */
+static void __init iov_kunit_copy_from_iovec(struct kunit *test)
+{
+	struct iov_iter iter;
+	struct iovec *iov;
+	void __user *ubuf;
+	u8 *scratch, *buffer;
+	size_t bufsize = 0x10000, size, copied;
+	unsigned int nr = 256, i, j, k;
+
+	iov = kunit_kcalloc(test, nr, sizeof(*iov), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, iov);
+	scratch = kunit_kzalloc(test, bufsize, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, scratch);
+	buffer = kunit_kmalloc(test, bufsize, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buffer);
+	ubuf = iov_kunit_create_user_buffer(test, bufsize);
+
+	for (i = 0; i < bufsize; i++)
+		buffer[i] = pattern(i);
+	KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, buffer, bufsize), 0);
+
+	iov_kunit_load_iovec(test, &iter, WRITE, iov, nr, ubuf, bufsize, 0, 0);
+	size = iter.count;
+
+	copied = copy_from_iter(scratch, size / 2 + 1, &iter);
+	KUNIT_EXPECT_EQ(test, copied, size / 2 + 1);
+	copied += copy_from_iter(scratch + copied, size - copied, &iter);
+
+	KUNIT_EXPECT_EQ(test, copied, size);
+	KUNIT_EXPECT_EQ(test, iter.count, 0);
+	KUNIT_EXPECT_EQ(test, iter.nr_segs, 0);
+
+	/* Build the expected image in the main buffer. */
+	k = 0;
+	memset(buffer, 0, bufsize);
+	for (i = 0; i < nr; i++) {
+		size_t off = iov[i].iov_base - ubuf;
+
+		for (j = 0; j < iov[i].iov_len; j++)
+			buffer[k++] = pattern(off + j);
+	}
+
+	/* Compare the images */
+	for (i = 0; i < bufsize; i++) {
+		KUNIT_EXPECT_EQ_MSG(test, scratch[i], buffer[i], "at i=%x", i);
+		if (scratch[i] != buffer[i])
+			return;
+	}
+
+	KUNIT_SUCCEED(test);
+}
+
+/*
+ * Time copies through an ITER_IOVEC with 1024 small, non-adjacent segments,
+ * as issued by readv()/writev() for logging and RPC gather lists.
+ */
+static void __init iov_kunit_benchmark_iovec(struct kunit *test)
+{
+	const unsigned int nr = 1024, loops = 1000;
+	const size_t seglen = 64, bufsize = nr * seglen * 2;
+	struct iov_iter iter;
+	struct iovec *iov;
+	void __user *ubuf;
+	u8 *scratch;
+	ktime_t a, b;
+	unsigned int i;
+	size_t copied;
+
+	iov = kunit_kcalloc(test, nr, sizeof(*iov), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, iov);
+	scratch = kunit_kzalloc(test, nr * seglen, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, scratch);
+	ubuf = iov_kunit_create_user_buffer(test, bufsize);
+
+	/* Fault the user pages in. */
+	iov_kunit_load_iovec(test, &iter, READ, iov, nr, ubuf, bufsize,
+			     seglen, seglen);
+	KUNIT_ASSERT_EQ(test, copy_to_iter(scratch, nr * seglen, &iter),
+			nr * seglen);
+
+	a = ktime_get_real();
+	for (i = 0; i < loops; i++) {
+		iov_iter_init(&iter, READ, iov, nr, nr * seglen);
+		copied = copy_to_iter(scratch, nr * seglen, &iter);
+		KUNIT_ASSERT_EQ(test, copied, nr * seglen);
+	}
+	b = ktime_get_real();
+	kunit_info(test, "copy_to_iter: %u x %zu-byte segments: %llu ns\n",
+		   nr, seglen, div_u64(ktime_to_ns(ktime_sub(b, a)), loops));
+
+	a = ktime_get_real();
+	for (i = 0; i < loops; i++) {
+		iov_iter_init(&iter, WRITE, iov, nr, nr * seglen);
+		copied = copy_from_iter(scratch, nr * seglen, &iter);
+		KUNIT_ASSERT_EQ(test, copied, nr * seglen);
+	}
+	b = ktime_get_real();
+	kunit_info(test, "copy_from_iter: %u x %zu-byte segments: %llu ns\n",
+		   nr, seglen, div_u64(ktime_to_ns(ktime_sub(b, a)), loops));
+
+	KUNIT_SUCCEED(test);
+}
+
 /*
  * Test the extraction of ITER_KVEC-type iterators.
  */
@@ -1021,6 +1229,9 @@ static struct kunit_case __refdata iov_kunit_cases[] = {
 	KUNIT_CASE(iov_kunit_copy_from_folioq),
 	KUNIT_CASE(iov_kunit_copy_to_xarray),
 	KUNIT_CASE(iov_kunit_copy_from_xarray),
+	KUNIT_CASE(iov_kunit_copy_to_iovec),
+	KUNIT_CASE(iov_kunit_copy_from_iovec),
+	KUNIT_CASE(iov_kunit_benchmark_iovec),
 	KUNIT_CASE(iov_kunit_extract_pages_kvec),
 	KUNIT_CASE(iov_kunit_extract_pages_bvec),
 	KUNIT_CASE(iov_kunit_extract_pages_folioq),
@@ -2,10 +2,13 @@
 #include <linux/kernel.h>
 #include <linux/bug.h>
 #include <linux/compiler.h>
+#include <linux/cpumask.h>
 #include <linux/export.h>
 #include <linux/string.h>
 #include <linux/list_sort.h>
 #include <linux/list.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
 
 /*
  * Returns a list organized in an intermediate format suited
@@ -251,3 +254,118 @@ void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 	merge_final(priv, cmp, head, pending, list);
 }
 EXPORT_SYMBOL(list_sort);
+
+/* Smallest piece of a list worth sorting on another CPU */
+#define LIST_SORT_PARALLEL_CHUNK	(16 * 1024)
+/* Most pieces a list is split into */
+#define LIST_SORT_PARALLEL_MAX		16
+
+struct list_sort_work {
+	struct work_struct work;
+	void *priv;
+	list_cmp_func_t cmp;
+	struct list_head list;		/* piece to sort */
+	struct list_head *a, *b;	/* null-terminated, b is merged into a */
+};
+
+static void list_sort_workfn(struct work_struct *work)
+{
+	struct list_sort_work *w = container_of(work, struct list_sort_work, work);
+
+	list_sort(w->priv, &w->list, w->cmp);
+	/* Convert to the format merge() takes */
+	w->list.prev->next = NULL;
+	w->a = w->list.next;
+}
+
+static void list_merge_workfn(struct work_struct *work)
+{
+	struct list_sort_work *w = container_of(work, struct list_sort_work, work);
+
+	w->a = merge(w->priv, w->cmp, w->a, w->b);
+}
+
+/**
+ * list_sort_parallel - sort a long list on several CPUs
+ * @priv: private data, opaque to list_sort_parallel(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Sorts @head exactly like list_sort(), including its stability, but
+ * splits lists of many thousands of elements into pieces which are sorted
+ * concurrently on the unbound workqueue and then merged pairwise, again
+ * concurrently.  Shorter lists, or systems with only one CPU online, are
+ * simply passed to list_sort().
+ *
+ * @cmp is called from several threads at once and must not rely on being
+ * serialised.
+ *
+ * Context: Process context, may sleep.
+ */
+void list_sort_parallel(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+	struct list_sort_work *w;
+	struct list_head *pos;
+	unsigned int nr, i, step;
+	size_t count = 0, per, j;
+
+	might_sleep();
+
+	list_for_each(pos, head)
+		count++;
+
+	nr = min_t(size_t, count / LIST_SORT_PARALLEL_CHUNK,
+		   min_t(unsigned int, num_online_cpus(), LIST_SORT_PARALLEL_MAX));
+	if (nr < 2)
+		goto serial;
+
+	w = kcalloc(nr, sizeof(*w), GFP_KERNEL);
+	if (!w)
+		goto serial;
+
+	per = count / nr;
+	for (i = 0; i < nr; i++) {
+		w[i].priv = priv;
+		w[i].cmp = cmp;
+		INIT_LIST_HEAD(&w[i].list);
+		if (i == nr - 1) {
+			list_splice_init(head, &w[i].list);
+			break;
+		}
+		for (pos = head, j = 0; j < per; j++)
+			pos = pos->next;
+		list_cut_position(&w[i].list, head, pos);
+	}
+
+	for (i = 1; i < nr; i++) {
+		INIT_WORK(&w[i].work, list_sort_workfn);
+		queue_work(system_unbound_wq, &w[i].work);
+	}
+	list_sort_workfn(&w[0].work);
+	for (i = 1; i < nr; i++)
+		flush_work(&w[i].work);
+
+	/*
+	 * Merge neighbours only, so that equal elements keep their order.  A
+	 * piece without a neighbour is carried over to the next round.
+	 */
+	for (step = 1; 2 * step < nr; step *= 2) {
+		for (i = 2 * step; i + step < nr; i += 2 * step) {
+			w[i].b = w[i + step].a;
+			INIT_WORK(&w[i].work, list_merge_workfn);
+			queue_work(system_unbound_wq, &w[i].work);
+		}
+		w[0].b = w[step].a;
+		list_merge_workfn(&w[0].work);
+		for (i = 2 * step; i + step < nr; i += 2 * step)
+			flush_work(&w[i].work);
+	}
+	merge_final(priv, cmp, head, w[0].a, w[step].a);
+
+	kfree(w);
+	return;
+
+serial:
+	list_sort(priv, head, cmp);
+}
+EXPORT_SYMBOL(list_sort_parallel);
@@ -6870,6 +6870,341 @@ int mtree_dup(struct maple_tree *mt, struct maple_tree *new, gfp_t gfp)
 }
 EXPORT_SYMBOL(mtree_dup);
 
+/*
+ * Bulk loading builds a tree bottom-up from sorted ranges.  The ranges and the
+ * gaps between them are packed into leaves, then each level is packed into
+ * parents until a single root is left.  Every level is spread evenly over the
+ * nodes it needs, so no node ends up below the minimum and nothing has to be
+ * rebalanced.
+ */
+struct mt_bulk_state {
+	const struct maple_bulk_entry *entries;
+	unsigned long nr;
+	unsigned long i;	/* The next entry */
+	unsigned long min;	/* The first index of the next slot */
+};
+
+/* A node of the level being built */
+struct mt_bulk_child {
+	struct maple_enode *enode;
+	unsigned long max;
+	unsigned long gap;
+};
+
+/*
+ * mt_bulk_next() - Get the next leaf slot of a bulk load.
+ * @bs: The bulk load state
+ * @last: Set to the last index of the slot
+ * @entry: Set to the entry of the slot, NULL for a gap
+ */
+static void mt_bulk_next(struct mt_bulk_state *bs, unsigned long *last,
+		void **entry)
+{
+	const struct maple_bulk_entry *e;
+
+	if (bs->i == bs->nr) {
+		*last = ULONG_MAX;
+		*entry = NULL;
+	} else if (bs->entries[bs->i].index > bs->min) {
+		*last = bs->entries[bs->i].index - 1;
+		*entry = NULL;
+	} else {
+		e = &bs->entries[bs->i++];
+		*last = e->last;
+		*entry = e->entry;
+	}
+
+	bs->min = *last + 1;
+}
+
+/*
+ * mt_bulk_leaf() - Take the slots of the next leaf.
+ * @bs: The bulk load state
+ * @left: The number of slots not yet placed in a leaf
+ * @pivots: Filled with the last index of each slot
+ * @slots: Filled with the entry of each slot
+ *
+ * Spreads @left evenly over the leaves still needed.  Only the right most leaf
+ * may end in a gap, see mab_no_null_split().
+ *
+ * Return: The number of slots taken.
+ */
+static unsigned char mt_bulk_leaf(struct mt_bulk_state *bs, unsigned long left,
+		unsigned long *pivots, void **slots)
+{
+	unsigned char max = mt_slots[maple_leaf_64];
+	unsigned long nodes = DIV_ROUND_UP(left, max);
+	unsigned char count = DIV_ROUND_UP(left, nodes);
+	struct mt_bulk_state prev;
+	unsigned char n;
+
+	for (n = 0; n < count; n++) {
+		prev = *bs;
+		mt_bulk_next(bs, &pivots[n], &slots[n]);
+	}
+
+	if (nodes > 1 && !slots[n - 1]) {
+		if (n < max) {
+			mt_bulk_next(bs, &pivots[n], &slots[n]);
+			n++;
+		} else {
+			*bs = prev;
+			n--;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * mt_bulk_leaves() - Fill the leaves of a bulk load.
+ * @mt: The maple tree
+ * @bs: The bulk load state
+ * @left: The number of leaf slots
+ * @nodes: The nodes to use, or NULL to only count the leaves
+ * @level: Filled with the leaves, unless @nodes is NULL
+ *
+ * Return: The number of leaves.
+ */
+static unsigned long mt_bulk_leaves(struct maple_tree *mt,
+		struct mt_bulk_state *bs, unsigned long left,
+		struct maple_node **nodes, struct mt_bulk_child *level)
+{
+	unsigned long pivots[MAPLE_RANGE64_SLOTS];
+	void *slots[MAPLE_RANGE64_SLOTS];
+	unsigned long nr_leaves = 0;
+
+	while (left) {
+		unsigned long start = bs->min, gap = 0;
+		struct maple_node *node;
+		unsigned char n, i;
+
+		n = mt_bulk_leaf(bs, left, pivots, slots);
+		left -= n;
+		if (!nodes) {
+			nr_leaves++;
+			continue;
+		}
+
+		node = nodes[nr_leaves];
+		memset(node, 0, sizeof(*node));
+		for (i = 0; i < n; i++) {
+			if (!slots[i] && pivots[i] - start + 1 > gap)
+				gap = pivots[i] - start + 1;
+			start = pivots[i] + 1;
+
+			RCU_INIT_POINTER(node->mr64.slot[i], slots[i]);
+			if (i < mt_pivots[maple_leaf_64])
+				node->mr64.pivot[i] = pivots[i];
+		}
+		mas_leaf_set_meta(node, maple_leaf_64, n - 1);
+
+		level[nr_leaves].enode = mt_mk_node(node, maple_leaf_64);
+		level[nr_leaves].max = pivots[n - 1];
+		level[nr_leaves].gap = mt_is_alloc(mt) ? gap : 0;
+		nr_leaves++;
+	}
+
+	return nr_leaves;
+}
+
+/*
+ * mt_bulk_parents() - Pack one level of a bulk load into parents.
+ * @mas: The maple state of the tree
+ * @level: The nodes of the level, replaced by their parents
+ * @n: The number of nodes in @level
+ * @nodes: The nodes to use for the parents
+ *
+ * Return: The number of parents.
+ */
+static unsigned long mt_bulk_parents(struct ma_state *mas,
+		struct mt_bulk_child *level, unsigned long n,
+		struct maple_node **nodes)
+{
+	enum maple_type type = maple_range_64;
+	unsigned long in = 0, out = 0;
+	unsigned char width;
+
+	if (mt_is_alloc(mas->tree))
+		type = maple_arange_64;
+	width = mt_slots[type];
+
+	while (in < n) {
+		unsigned long nr_parents = DIV_ROUND_UP(n - in, width);
+		unsigned char count = DIV_ROUND_UP(n - in, nr_parents);
+		struct maple_node *node = nodes[out];
+		struct maple_enode *enode = mt_mk_node(node, type);
+		unsigned long *pivots, *gaps = NULL;
+		unsigned long max_gap = 0;
+		unsigned char i, offset = 0;
+		void __rcu **slots;
+
+		memset(node, 0, sizeof(*node));
+		slots = ma_slots(node, type);
+		pivots = ma_pivots(node, type);
+		if (type == maple_arange_64)
+			gaps = ma_gaps(node, type);
+
+		for (i = 0; i < count; i++) {
+			struct mt_bulk_child *child = &level[in + i];
+
+			mas_set_parent(mas, child->enode, enode, i);
+			RCU_INIT_POINTER(slots[i], child->enode);
+			if (i < mt_pivots[type])
+				pivots[i] = child->max;
+			if (gaps) {
+				gaps[i] = child->gap;
+				if (child->gap > max_gap) {
+					max_gap = child->gap;
+					offset = i;
+				}
+			}
+		}
+
+		if (gaps)
+			ma_set_meta(node, type, offset, count - 1);
+		else
+			mas_leaf_set_meta(node, type, count - 1);
+
+		/* out never passes in, the children have been consumed */
+		level[out].max = level[in + count - 1].max;
+		level[out].enode = enode;
+		level[out].gap = max_gap;
+		in += count;
+		out++;
+	}
+
+	return out;
+}
+
+static int mt_bulk_load(struct maple_tree *mt,
+		const struct maple_bulk_entry *entries, unsigned long nr,
+		gfp_t gfp, bool lock)
+{
+	struct mt_bulk_state bs = { .entries = entries, .nr = nr };
+	unsigned long i, n, count = 0, nr_leaves, total, used;
+	struct mt_bulk_child *level = NULL;
+	struct maple_node **nodes = NULL;
+	unsigned char width;
+	int ret = -ENOMEM;
+	MA_STATE(mas, mt, 0, 0);
+
+	if (!nr)
+		return 0;
+
+	for (i = 0; i < nr; i++) {
+		const struct maple_bulk_entry *e = &entries[i];
+
+		if (WARN_ON_ONCE(xa_is_advanced(e->entry)) || !e->entry ||
+		    e->index > e->last ||
+		    (i && entries[i - 1].last >= e->index))
+			return -EINVAL;
+
+		/* The gap in front of the range */
+		if (e->index && (!i || entries[i - 1].last + 1 < e->index))
+			count++;
+		count++;
+	}
+	/* The gap up to ULONG_MAX */
+	if (entries[nr - 1].last != ULONG_MAX)
+		count++;
+
+	nr_leaves = mt_bulk_leaves(mt, &bs, count, NULL, NULL);
+
+	width = mt_slots[mt_is_alloc(mt) ? maple_arange_64 : maple_range_64];
+	total = n = nr_leaves;
+	while (n > 1) {
+		n = DIV_ROUND_UP(n, width);
+		total += n;
+	}
+
+	level = kvmalloc_array(nr_leaves, sizeof(*level), gfp);
+	nodes = kvmalloc_array(total, sizeof(*nodes), gfp);
+	if (!level || !nodes)
+		goto out;
+
+	if (mt_alloc_bulk(gfp, total, (void **)nodes) != total)
+		goto out;
+
+	bs = (struct mt_bulk_state) { .entries = entries, .nr = nr };
+	n = mt_bulk_leaves(mt, &bs, count, nodes, level);
+	used = n;
+	mas.depth = 1;
+	while (n > 1) {
+		n = mt_bulk_parents(&mas, level, n, nodes + used);
+		used += n;
+		mas.depth++;
+	}
+	mte_to_node(level[0].enode)->parent =
+		ma_parent_ptr(mas_tree_parent(&mas));
+
+	if (lock)
+		mtree_lock(mt);
+	if (!mtree_empty(mt)) {
+		ret = -EEXIST;
+	} else {
+		mas_set_height(&mas);
+		rcu_assign_pointer(mt->ma_root, mte_mk_root(level[0].enode));
+		ret = 0;
+	}
+	if (lock)
+		mtree_unlock(mt);
+
+	if (ret)
+		mt_free_bulk(total, (void __rcu **)nodes);
+out:
+	kvfree(nodes);
+	kvfree(level);
+	return ret;
+}
+
+/**
+ * __mt_bulk_load() - Build a locked maple tree from sorted ranges
+ * @mt: The maple tree, which must be empty
+ * @entries: The ranges to store, sorted and not overlapping
+ * @nr: The number of ranges
+ * @gfp: The GFP_FLAGS to use for allocations
+ *
+ * This is much faster than storing the ranges one by one when building a large
+ * tree: all nodes are allocated in one go and filled bottom-up in a single
+ * pass, without splitting or rebalancing.  The nodes are also packed more
+ * densely than repeated stores leave them, so the tree uses less memory.  None
+ * of the entries may be NULL.
+ * Note that the user needs to manually lock the tree, and that @gfp must be
+ * valid under that lock.
+ *
+ * Return: 0 on success, -EINVAL on an invalid range or entry, -EEXIST if the
+ * tree is not empty, -ENOMEM if memory could not be allocated.
+ */
+int __mt_bulk_load(struct maple_tree *mt,
+		const struct maple_bulk_entry *entries, unsigned long nr,
+		gfp_t gfp)
+{
+	return mt_bulk_load(mt, entries, nr, gfp, false);
+}
+EXPORT_SYMBOL(__mt_bulk_load);
+
+/**
+ * mtree_bulk_load() - Build a maple tree from sorted ranges
+ * @mt: The maple tree, which must be empty
+ * @entries: The ranges to store, sorted and not overlapping
+ * @nr: The number of ranges
+ * @gfp: The GFP_FLAGS to use for allocations
+ *
+ * Like __mt_bulk_load(), but takes the tree lock itself.  The nodes are built
+ * without the lock held, it is only taken to publish the new root.
+ *
+ * Return: 0 on success, -EINVAL on an invalid range or entry, -EEXIST if the
+ * tree is not empty, -ENOMEM if memory could not be allocated.
+ */
+int mtree_bulk_load(struct maple_tree *mt,
+		const struct maple_bulk_entry *entries, unsigned long nr,
+		gfp_t gfp)
+{
+	return mt_bulk_load(mt, entries, nr, gfp, true);
+}
+EXPORT_SYMBOL(mtree_bulk_load);
+
 /**
  * __mt_destroy() - Walk and free all nodes of a locked maple tree.
  * @mt: The maple tree
@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0
 /*
- * Test cases for memcpy(), memmove(), and memset().
+ * Test cases for memcpy(), memmove(), memset() and memcmp().
  */
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
@@ -373,6 +373,43 @@ static void memmove_large_test(struct kunit *test)
 	copy_large_test(test, true);
 }
 
+/*
+ * Check that memcmp() finds the first difference and orders it by unsigned
+ * byte value, for all relative alignments of the two areas.
+ */
+static void memcmp_test(struct kunit *test)
+{
+	int s_off, d_off, bytes, diff;
+
+	init_large(test);
+
+	for (s_off = 0; s_off < 2 * sizeof(long); s_off++) {
+		for (d_off = 0; d_off < 2 * sizeof(long); d_off++) {
+			for (bytes = 0; bytes < 4 * sizeof(long) + 3; bytes++) {
+				u8 *s = large_src + s_off, *d = large_dst + d_off;
+
+				memcpy(d, s, bytes);
+				KUNIT_ASSERT_EQ_MSG(test, memcmp(d, s, bytes), 0,
+					"s_off:%d d_off:%d bytes:%d",
+					s_off, d_off, bytes);
+
+				for (diff = 0; diff < bytes; diff++) {
+					u8 saved = d[diff];
+
+					d[diff] = s[diff] ^ 0x80;
+					KUNIT_ASSERT_EQ_MSG(test,
+						memcmp(d, s, bytes) > 0,
+						d[diff] > s[diff],
+						"s_off:%d d_off:%d bytes:%d diff:%d",
+						s_off, d_off, bytes, diff);
+					KUNIT_ASSERT_NE(test, memcmp(s, d, bytes), 0);
+					d[diff] = saved;
+				}
+			}
+		}
+	}
+}
+
 /*
  * On the assumption that boundary conditions are going to be the most
  * sensitive, instead of taking a full step (inc) each iteration,
@@ -500,6 +537,7 @@ static struct kunit_case memcpy_test_cases[] = {
 	KUNIT_CASE_SLOW(memmove_test),
 	KUNIT_CASE_SLOW(memmove_large_test),
 	KUNIT_CASE_SLOW(memmove_overlap_test),
+	KUNIT_CASE(memcmp_test),
 	{}
 };
 
@@ -7,6 +7,8 @@
 #include <linux/irqflags.h>
 #include <linux/cpumask.h>
 #include <linux/log2.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
 
 /*
  * objpool: ring-array based lockless MPMC/FIFO queues
@@ -14,10 +16,121 @@
  * Copyright: wuqiang.matt@bytedance.com,mhiramat@kernel.org
  */
 
+static inline void *objpool_tag_obj(struct objpool_head *pool,
+				    struct llist_node *node)
+{
+	return (void *)node - pool->obj_size + sizeof(struct objpool_tag);
+}
+
+/* hand the pending batch of remote frees over to its home slot */
+static void objpool_flush_batch(struct objpool_head *pool,
+				struct objpool_slot *slot)
+{
+	if (!slot->batch_nr)
+		return;
+
+	llist_add_batch(slot->batch_first, slot->batch_last,
+			&pool->cpu_slots[slot->batch_cpu]->remote);
+	slot->batch_first = slot->batch_last = NULL;
+	slot->batch_nr = 0;
+}
+
+void __objpool_push_remote(void *obj, struct objpool_head *pool, int cpu)
+{
+	struct objpool_slot *slot = pool->cpu_slots[cpu];
+	struct objpool_tag *tag = __objpool_obj_tag(pool, obj);
+
+	/* a batch only ever goes to one node */
+	if (slot->batch_nr &&
+	    cpu_to_node(slot->batch_cpu) != cpu_to_node(tag->cpu))
+		objpool_flush_batch(pool, slot);
+
+	if (!slot->batch_nr) {
+		slot->batch_last = &tag->node;
+		slot->batch_cpu = tag->cpu;
+	}
+	tag->node.next = slot->batch_first;
+	slot->batch_first = &tag->node;
+
+	if (++slot->batch_nr >= OBJPOOL_REMOTE_BATCH)
+		objpool_flush_batch(pool, slot);
+}
+EXPORT_SYMBOL_GPL(__objpool_push_remote);
+
+/*
+ * take the objects returned to the slot of @cpu by other nodes: the
+ * first one is handed out, the rest go to the ring of @this_cpu
+ */
+static void *objpool_try_get_remote(struct objpool_head *pool, int cpu,
+				    int this_cpu)
+{
+	struct llist_node *first, *node, *next;
+
+	if (llist_empty(&pool->cpu_slots[cpu]->remote))
+		return NULL;
+
+	first = llist_del_all(&pool->cpu_slots[cpu]->remote);
+	if (!first)
+		return NULL;
+
+	llist_for_each_safe(node, next, first->next)
+		__objpool_try_add_slot(objpool_tag_obj(pool, node), pool, this_cpu);
+
+	return objpool_tag_obj(pool, first);
+}
+
+static void *objpool_try_get_cpu(struct objpool_head *pool, int cpu,
+				 int this_cpu)
+{
+	void *obj = __objpool_try_get_slot(pool, cpu);
+
+	if (!obj)
+		obj = objpool_try_get_remote(pool, cpu, this_cpu);
+	return obj;
+}
+
+void *__objpool_pop_slow(struct objpool_head *pool, int cpu)
+{
+	const struct cpumask *mask = cpumask_of_node(cpu_to_node(cpu));
+	struct objpool_slot *slot = pool->cpu_slots[cpu];
+	void *obj;
+	int i;
+
+	obj = objpool_try_get_remote(pool, cpu, cpu);
+	if (obj)
+		return obj;
+
+	/* slots of the local node first, their objects are node-local */
+	for_each_cpu_wrap(i, mask, cpu) {
+		if (i == cpu || !cpu_possible(i))
+			continue;
+		obj = objpool_try_get_cpu(pool, i, cpu);
+		if (obj)
+			return obj;
+	}
+
+	for_each_cpu_wrap(i, cpu_possible_mask, cpu) {
+		if (cpumask_test_cpu(i, mask))
+			continue;
+		obj = objpool_try_get_cpu(pool, i, cpu);
+		if (obj)
+			return obj;
+	}
+
+	/* last resort: our own batch of remote frees, not in nmi context */
+	if (!slot->batch_nr || in_nmi())
+		return NULL;
+
+	i = slot->batch_cpu;
+	objpool_flush_batch(pool, slot);
+	return objpool_try_get_remote(pool, i, cpu);
+}
+EXPORT_SYMBOL_GPL(__objpool_pop_slow);
+
 /* initialize percpu objpool_slot */
 static int
 objpool_init_percpu_slot(struct objpool_head *pool,
-			 struct objpool_slot *slot,
+			 struct objpool_slot *slot, int cpu,
 			 int nodes, void *context,
 			 objpool_init_obj_cb objinit)
 {
@@ -28,6 +141,8 @@ objpool_init_percpu_slot(struct objpool_head *pool,
 	slot->mask = pool->capacity - 1;
 
 	for (i = 0; i < nodes; i++) {
+		if (pool->flags & OBJPOOL_REMOTE_FREE)
+			__objpool_obj_tag(pool, obj)->cpu = cpu;
 		if (objinit) {
 			int rc = objinit(obj, context);
 			if (rc)
@@ -93,7 +208,7 @@ objpool_init_percpu_slots(struct objpool_head *pool, int nr_objs,
 		pool->cpu_slots[i] = slot;
 
 		/* initialize the objpool_slot of cpu node i */
-		rc = objpool_init_percpu_slot(pool, slot, nodes, context, objinit);
+		rc = objpool_init_percpu_slot(pool, slot, i, nodes, context, objinit);
 		if (rc)
 			return rc;
 	}
@@ -142,7 +257,23 @@ int objpool_init(struct objpool_head *pool, int nr_objs, int object_size,
 	pool->gfp = gfp & ~__GFP_ZERO;
 	pool->context = context;
 	pool->release = release;
-	slot_size = nr_cpu_ids * sizeof(struct objpool_slot);
+
+	/*
+	 * on NUMA systems objects released by cpus of other nodes are
+	 * returned to their home node in batches. objects in pending
+	 * batches are invisible to objpool_pop() on other cpus, so only
+	 * pools where full batches on all cpus hold at most half of the
+	 * objects do that. smaller ones, like the few objects per cpu of
+	 * a kretprobe, keep pushing to the local slot, as a batch of one
+	 * would pay a cross-node atomic per object anyway
+	 */
+	if (num_possible_nodes() > 1 &&
+	    nr_objs >= 2 * pool->nr_possible_cpus * OBJPOOL_REMOTE_BATCH) {
+		pool->flags |= OBJPOOL_REMOTE_FREE;
+		pool->obj_size += sizeof(struct objpool_tag);
+	}
+
+	slot_size = nr_cpu_ids * sizeof(struct objpool_slot *);
 	pool->cpu_slots = kzalloc(slot_size, pool->gfp);
 	if (!pool->cpu_slots)
 		return -ENOMEM;
@@ -192,6 +323,14 @@ EXPORT_SYMBOL_GPL(objpool_drop);
 void objpool_fini(struct objpool_head *pool)
 {
 	int count = 1; /* extra ref for objpool itself */
+	int i;
+
+	/*
+	 * no objpool_push() can be on the fly any more, so the pending
+	 * batches of all cpus can be handed over from here
+	 */
+	for_each_possible_cpu(i)
+		objpool_flush_batch(pool, pool->cpu_slots[i]);
 
 	/* drop all remained objects from objpool */
 	while (objpool_pop(pool))
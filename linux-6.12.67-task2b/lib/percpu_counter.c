@@ -9,6 +9,8 @@
 #include <linux/cpu.h>
 #include <linux/module.h>
 #include <linux/debugobjects.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
 
 #ifdef CONFIG_HOTPLUG_CPU
 static LIST_HEAD(percpu_counters);
@@ -57,17 +59,85 @@ static inline void debug_percpu_counter_deactivate(struct percpu_counter *fbc)
 { }
 #endif	/* CONFIG_DEBUG_OBJECTS_PERCPU_COUNTER */
 
+/*
+ * With ->lock held, lock all per-node accumulators of @fbc, which stops
+ * batches from moving between the CPUs, the nodes and ->count. Returns the
+ * sum of the per-node counts.
+ */
+static s64 percpu_counter_lock_nodes(struct percpu_counter *fbc)
+{
+	s64 ret = 0;
+	int node;
+
+	if (!fbc->nodes)
+		return 0;
+
+	for_each_node(node) {
+		raw_spin_lock_nest_lock(&fbc->nodes[node].lock, &fbc->lock);
+		ret += fbc->nodes[node].count;
+	}
+	return ret;
+}
+
+static void percpu_counter_unlock_nodes(struct percpu_counter *fbc)
+{
+	int node;
+
+	if (!fbc->nodes)
+		return;
+
+	for_each_node(node)
+		raw_spin_unlock(&fbc->nodes[node].lock);
+}
+
+/*
+ * Move the count of this CPU, plus @amount, to its node. Called with
+ * interrupts disabled. The node is folded into ->count once it exceeds
+ * @batch for each of its CPUs, which bounds the error of
+ * percpu_counter_read() by twice that of percpu_counter_read_nodes().
+ */
+static void percpu_counter_node_flush(struct percpu_counter *fbc, s64 amount,
+				      s32 batch)
+{
+	struct percpu_counter_node *node = &fbc->nodes[numa_node_id()];
+	s64 count, limit;
+
+	raw_spin_lock(&node->lock);
+	count = __this_cpu_read(*fbc->counters);
+	node->count += count + amount;
+	__this_cpu_sub(*fbc->counters, count);
+	count = node->count;
+	raw_spin_unlock(&node->lock);
+
+	limit = (s64)batch * max(nr_cpus_node(numa_node_id()), 1);
+	if (likely(abs(count) < limit))
+		return;
+
+	raw_spin_lock(&fbc->lock);
+	raw_spin_lock_nest_lock(&node->lock, &fbc->lock);
+	fbc->count += node->count;
+	node->count = 0;
+	raw_spin_unlock(&node->lock);
+	raw_spin_unlock(&fbc->lock);
+}
+
 void percpu_counter_set(struct percpu_counter *fbc, s64 amount)
 {
-	int cpu;
+	int cpu, node;
 	unsigned long flags;
 
 	raw_spin_lock_irqsave(&fbc->lock, flags);
+	percpu_counter_lock_nodes(fbc);
 	for_each_possible_cpu(cpu) {
 		s32 *pcount = per_cpu_ptr(fbc->counters, cpu);
 		*pcount = 0;
 	}
+	if (fbc->nodes) {
+		for_each_node(node)
+			fbc->nodes[node].count = 0;
+	}
 	fbc->count = amount;
+	percpu_counter_unlock_nodes(fbc);
 	raw_spin_unlock_irqrestore(&fbc->lock, flags);
 }
 EXPORT_SYMBOL(percpu_counter_set);
@@ -98,6 +168,12 @@ void percpu_counter_add_batch(struct percpu_counter *fbc, s64 amount, s32 batch)
 	count = this_cpu_read(*fbc->counters);
 	do {
 		if (unlikely(abs(count + amount) >= batch)) {
+			if (fbc->nodes) {
+				local_irq_save(flags);
+				percpu_counter_node_flush(fbc, amount, batch);
+				local_irq_restore(flags);
+				return;
+			}
 			raw_spin_lock_irqsave(&fbc->lock, flags);
 			/*
 			 * Note: by now we might have migrated to another CPU
@@ -124,7 +200,9 @@ void percpu_counter_add_batch(struct percpu_counter *fbc, s64 amount, s32 batch)
 
 	local_irq_save(flags);
 	count = __this_cpu_read(*fbc->counters) + amount;
-	if (abs(count) >= batch) {
+	if (abs(count) >= batch && fbc->nodes) {
+		percpu_counter_node_flush(fbc, amount, batch);
+	} else if (abs(count) >= batch) {
 		raw_spin_lock(&fbc->lock);
 		fbc->count += count;
 		__this_cpu_sub(*fbc->counters, count - amount);
@@ -175,16 +253,28 @@ s64 __percpu_counter_sum(struct percpu_counter *fbc)
 	unsigned long flags;
 
 	raw_spin_lock_irqsave(&fbc->lock, flags);
-	ret = fbc->count;
+	ret = fbc->count + percpu_counter_lock_nodes(fbc);
 	for_each_cpu_or(cpu, cpu_online_mask, cpu_dying_mask) {
 		s32 *pcount = per_cpu_ptr(fbc->counters, cpu);
 		ret += *pcount;
 	}
+	percpu_counter_unlock_nodes(fbc);
 	raw_spin_unlock_irqrestore(&fbc->lock, flags);
 	return ret;
 }
 EXPORT_SYMBOL(__percpu_counter_sum);
 
+s64 __percpu_counter_read_nodes(struct percpu_counter *fbc)
+{
+	s64 ret = READ_ONCE(fbc->count);
+	int node;
+
+	for_each_node(node)
+		ret += READ_ONCE(fbc->nodes[node].count);
+	return ret;
+}
+EXPORT_SYMBOL(__percpu_counter_read_nodes);
+
 int __percpu_counter_init_many(struct percpu_counter *fbc, s64 amount,
 			       gfp_t gfp, u32 nr_counters,
 			       struct lock_class_key *key)
@@ -210,6 +300,7 @@ int __percpu_counter_init_many(struct percpu_counter *fbc, s64 amount,
 #endif
 		fbc[i].count = amount;
 		fbc[i].counters = (void __percpu *)counters + i * counter_size;
+		fbc[i].nodes = NULL;
 
 		debug_percpu_counter_activate(&fbc[i]);
 	}
@@ -224,6 +315,31 @@ int __percpu_counter_init_many(struct percpu_counter *fbc, s64 amount,
 }
 EXPORT_SYMBOL(__percpu_counter_init_many);
 
+int __percpu_counter_init_nodes(struct percpu_counter *fbc, s64 amount,
+				gfp_t gfp, struct lock_class_key *key)
+{
+	struct percpu_counter_node *nodes;
+	int node, ret;
+
+	nodes = kcalloc(nr_node_ids, sizeof(*nodes), gfp);
+	if (!nodes) {
+		fbc->counters = NULL;
+		return -ENOMEM;
+	}
+
+	ret = __percpu_counter_init_many(fbc, amount, gfp, 1, key);
+	if (ret) {
+		kfree(nodes);
+		return ret;
+	}
+
+	for (node = 0; node < nr_node_ids; node++)
+		raw_spin_lock_init(&nodes[node].lock);
+	fbc->nodes = nodes;
+	return 0;
+}
+EXPORT_SYMBOL(__percpu_counter_init_nodes);
+
 void percpu_counter_destroy_many(struct percpu_counter *fbc, u32 nr_counters)
 {
 	unsigned long flags __maybe_unused;
@@ -247,8 +363,11 @@ void percpu_counter_destroy_many(struct percpu_counter *fbc, u32 nr_counters)
 
 	free_percpu(fbc[0].counters);
 
-	for (i = 0; i < nr_counters; i++)
+	for (i = 0; i < nr_counters; i++) {
+		kfree(fbc[i].nodes);
+		fbc[i].nodes = NULL;
 		fbc[i].counters = NULL;
+	}
 }
 EXPORT_SYMBOL(percpu_counter_destroy_many);
 
@@ -293,7 +412,7 @@ int __percpu_counter_compare(struct percpu_counter *fbc, s64 rhs, s32 batch)
 {
 	s64	count;
 
-	count = percpu_counter_read(fbc);
+	count = percpu_counter_read_nodes(fbc);
 	/* Check to see if rough count will be sufficient for comparison */
 	if (abs(count - rhs) > (batch * num_online_cpus())) {
 		if (count > rhs)
@@ -337,6 +456,9 @@ bool __percpu_counter_limited_add(struct percpu_counter *fbc,
 
 	local_irq_save(flags);
 	unknown = batch * num_online_cpus();
+	/* ->count alone misses up to one batch per CPU in the nodes */
+	if (fbc->nodes)
+		unknown *= 2;
 	count = __this_cpu_read(*fbc->counters);
 
 	/* Skip taking the lock when safe */
@@ -349,7 +471,9 @@ bool __percpu_counter_limited_add(struct percpu_counter *fbc,
 	}
 
 	raw_spin_lock(&fbc->lock);
-	count = fbc->count + amount;
+	count = fbc->count + percpu_counter_lock_nodes(fbc) + amount;
+	if (fbc->nodes)
+		unknown /= 2;
 
 	/* Skip percpu_counter_sum() when safe */
 	if (amount > 0) {
@@ -386,6 +510,7 @@ bool __percpu_counter_limited_add(struct percpu_counter *fbc,
 	fbc->count += count + amount;
 	__this_cpu_sub(*fbc->counters, count);
 out:
+	percpu_counter_unlock_nodes(fbc);
 	raw_spin_unlock(&fbc->lock);
 	local_irq_restore(flags);
 	return good;
@@ -106,11 +106,25 @@ static void nested_bucket_table_free(const struct bucket_table *tbl)
 	kfree(ntbl);
 }
 
+static void bucket_table_free_replicas(struct rhash_lock_head __rcu ***replicas)
+{
+	int node;
+
+	if (!replicas)
+		return;
+
+	for_each_node(node)
+		kvfree(replicas[node]);
+	kfree(replicas);
+}
+
 static void bucket_table_free(const struct bucket_table *tbl)
 {
 	if (tbl->nest)
 		nested_bucket_table_free(tbl);
 
+	bucket_table_free_replicas(tbl->replicas);
+
 	kvfree(tbl);
 }
 
@@ -174,6 +188,29 @@ static struct bucket_table *nested_bucket_table_alloc(struct rhashtable *ht,
 	return tbl;
 }
 
+/* Empty copies of the bucket array on every node */
+static struct rhash_lock_head __rcu ***bucket_table_alloc_replicas(size_t nbuckets,
+								  gfp_t gfp)
+{
+	struct rhash_lock_head __rcu ***replicas;
+	int node;
+
+	replicas = kcalloc(nr_node_ids, sizeof(*replicas), gfp | __GFP_NOWARN);
+	if (!replicas)
+		return NULL;
+
+	for_each_node(node) {
+		replicas[node] = kvcalloc_node(nbuckets, sizeof(**replicas),
+					       gfp | __GFP_NOWARN, node);
+		if (!replicas[node]) {
+			bucket_table_free_replicas(replicas);
+			return NULL;
+		}
+	}
+
+	return replicas;
+}
+
 static struct bucket_table *bucket_table_alloc(struct rhashtable *ht,
 					       size_t nbuckets,
 					       gfp_t gfp)
@@ -209,6 +246,12 @@ static struct bucket_table *bucket_table_alloc(struct rhashtable *ht,
 	for (i = 0; i < nbuckets; i++)
 		INIT_RHT_NULLS_HEAD(tbl->buckets[i]);
 
+	/* Nested tables are never replicated; without replicas lookups
+	 * simply use the shared buckets.
+	 */
+	if (ht->p.numa_replicate && nbuckets && nr_node_ids > 1)
+		tbl->replicas = bucket_table_alloc_replicas(nbuckets, gfp);
+
 	return tbl;
 }
 
@@ -271,7 +314,7 @@ static int rhashtable_rehash_one(struct rhashtable *ht,
 		rcu_assign_pointer(*pprev, next);
 	else
 		/* Need to preserved the bit lock. */
-		rht_assign_locked(bkt, next);
+		rht_assign_locked(old_tbl, bkt, next);
 
 out:
 	return err;
@@ -531,7 +574,7 @@ static void *rhashtable_lookup_one(struct rhashtable *ht,
 			rcu_assign_pointer(*pprev, obj);
 		else
 			/* Need to preserve the bit lock */
-			rht_assign_locked(bkt, obj);
+			rht_assign_locked(tbl, bkt, obj);
 
 		return NULL;
 	}
@@ -582,7 +625,7 @@ static struct bucket_table *rhashtable_insert_one(
 	/* bkt is always the head of the list, so it holds
 	 * the lock, which we need to preserve
 	 */
-	rht_assign_locked(bkt, obj);
+	rht_assign_locked(tbl, bkt, obj);
 
 	return NULL;
 }
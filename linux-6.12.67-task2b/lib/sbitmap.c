@@ -8,6 +8,7 @@
 #include <linux/random.h>
 #include <linux/sbitmap.h>
 #include <linux/seq_file.h>
+#include <linux/topology.h>
 
 static int init_alloc_hint(struct sbitmap *sb, gfp_t flags)
 {
@@ -26,14 +27,58 @@ static int init_alloc_hint(struct sbitmap *sb, gfp_t flags)
 	return 0;
 }
 
+/*
+ * Get the words [*first, *end) preferred by CPUs of @node. Returns false if
+ * @sb isn't partitioned by node or @node has no words of its own.
+ */
+static inline bool sbitmap_node_words(const struct sbitmap *sb, int node,
+				      unsigned int *first, unsigned int *end)
+{
+	if (likely(!sb->node_start) || node < 0 || node >= nr_node_ids)
+		return false;
+
+	*first = READ_ONCE(sb->node_start[node]);
+	*end = READ_ONCE(sb->node_start[node + 1]);
+	return *first < *end && *end <= READ_ONCE(sb->map_nr);
+}
+
+static inline bool sbitmap_bit_is_local(const struct sbitmap *sb, int node,
+					unsigned int bitnr)
+{
+	unsigned int first, end, index = SB_NR_TO_INDEX(sb, bitnr);
+
+	if (!sbitmap_node_words(sb, node, &first, &end))
+		return true;
+	return index >= first && index < end;
+}
+
+static unsigned int sbitmap_random_hint(const struct sbitmap *sb,
+					unsigned int depth, int node)
+{
+	unsigned int first, end;
+
+	if (!depth)
+		return 0;
+
+	if (sbitmap_node_words(sb, node, &first, &end)) {
+		unsigned int lo = first << sb->shift;
+		unsigned int hi = min(end << sb->shift, depth);
+
+		if (lo < hi)
+			return lo + get_random_u32_below(hi - lo);
+	}
+	return get_random_u32_below(depth);
+}
+
 static inline unsigned update_alloc_hint_before_get(struct sbitmap *sb,
 						    unsigned int depth)
 {
 	unsigned hint;
 
 	hint = this_cpu_read(*sb->alloc_hint);
-	if (unlikely(hint >= depth)) {
-		hint = depth ? get_random_u32_below(depth) : 0;
+	if (unlikely(hint >= depth ||
+		     !sbitmap_bit_is_local(sb, numa_node_id(), hint))) {
+		hint = sbitmap_random_hint(sb, depth, numa_node_id());
 		this_cpu_write(*sb->alloc_hint, hint);
 	}
 
@@ -116,6 +161,7 @@ int sbitmap_init_node(struct sbitmap *sb, unsigned int depth, int shift,
 	sb->depth = depth;
 	sb->map_nr = DIV_ROUND_UP(sb->depth, bits_per_word);
 	sb->round_robin = round_robin;
+	sb->node_start = NULL;
 
 	if (depth == 0) {
 		sb->map = NULL;
@@ -142,6 +188,31 @@ int sbitmap_init_node(struct sbitmap *sb, unsigned int depth, int shift,
 }
 EXPORT_SYMBOL_GPL(sbitmap_init_node);
 
+/*
+ * Give each node a share of the words in proportion to its possible CPUs.
+ * Nodes without CPUs get no words of their own.
+ */
+static void sbitmap_partition_words(struct sbitmap *sb)
+{
+	unsigned int total = 0, seen = 0;
+	int node, cpu;
+
+	for_each_possible_cpu(cpu) {
+		node = cpu_to_node(cpu);
+		if (node >= 0 && node < nr_node_ids)
+			total++;
+	}
+	total = max(total, 1U);
+
+	for (node = 0; node < nr_node_ids; node++) {
+		WRITE_ONCE(sb->node_start[node], sb->map_nr * seen / total);
+		for_each_possible_cpu(cpu)
+			if (cpu_to_node(cpu) == node)
+				seen++;
+	}
+	WRITE_ONCE(sb->node_start[nr_node_ids], sb->map_nr * seen / total);
+}
+
 void sbitmap_resize(struct sbitmap *sb, unsigned int depth)
 {
 	unsigned int bits_per_word = 1U << sb->shift;
@@ -152,9 +223,64 @@ void sbitmap_resize(struct sbitmap *sb, unsigned int depth)
 
 	sb->depth = depth;
 	sb->map_nr = DIV_ROUND_UP(sb->depth, bits_per_word);
+	if (sb->node_start)
+		sbitmap_partition_words(sb);
 }
 EXPORT_SYMBOL_GPL(sbitmap_resize);
 
+/*
+ * Order in which the words are searched: without a node partition, all words
+ * starting at the hinted one. With one, the local node's words starting at
+ * the hinted one, followed by the words of all other nodes.
+ */
+struct sbitmap_scan {
+	unsigned int map_nr;
+	unsigned int first;
+	unsigned int nr;
+	unsigned int start;
+};
+
+/*
+ * Returns false if the scan doesn't start at word @index, in which case the
+ * bit offset of the hint is meaningless.
+ */
+static bool sbitmap_scan_init(const struct sbitmap *sb,
+			      struct sbitmap_scan *scan, unsigned int index)
+{
+	unsigned int end;
+	bool ret = true;
+
+	scan->map_nr = sb->map_nr;
+	if (!sbitmap_node_words(sb, numa_node_id(), &scan->first, &end) ||
+	    end > scan->map_nr) {
+		scan->first = 0;
+		end = scan->map_nr;
+	}
+	scan->nr = end - scan->first;
+
+	if (index - scan->first >= scan->nr) {
+		index = scan->first;
+		ret = false;
+	}
+	scan->start = index - scan->first;
+	return ret;
+}
+
+/* the word to search in step @i, for 0 <= @i < @scan->map_nr */
+static inline unsigned int sbitmap_scan_index(const struct sbitmap_scan *scan,
+					      unsigned int i)
+{
+	if (i < scan->nr) {
+		i += scan->start;
+		if (i >= scan->nr)
+			i -= scan->nr;
+	}
+	i += scan->first;
+	if (i >= scan->map_nr)
+		i -= scan->map_nr;
+	return i;
+}
+
 static int __sbitmap_get_word(unsigned long *word, unsigned long depth,
 			      unsigned int hint, bool wrap)
 {
@@ -234,12 +360,16 @@ static int sbitmap_find_bit(struct sbitmap *sb,
 			    unsigned int alloc_hint,
 			    bool wrap)
 {
-	unsigned int i;
+	struct sbitmap_scan scan;
+	unsigned int i, depth;
 	int nr = -1;
 
-	for (i = 0; i < sb->map_nr; i++) {
-		unsigned int depth = __map_depth_with_shallow(sb, index,
-							      shallow_depth);
+	if (!sbitmap_scan_init(sb, &scan, index))
+		alloc_hint = 0;
+
+	for (i = 0; i < scan.map_nr; i++) {
+		index = sbitmap_scan_index(&scan, i);
+		depth = __map_depth_with_shallow(sb, index, shallow_depth);
 
 		if (depth)
 			nr = sbitmap_find_bit_in_word(&sb->map[index], depth,
@@ -251,8 +381,6 @@ static int sbitmap_find_bit(struct sbitmap *sb,
 
 		/* Jump to next index. */
 		alloc_hint = 0;
-		if (++index >= sb->map_nr)
-			index = 0;
 	}
 
 	return nr;
@@ -462,6 +590,33 @@ int sbitmap_queue_init_node(struct sbitmap_queue *sbq, unsigned int depth,
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_init_node);
 
+int sbitmap_queue_init_numa(struct sbitmap_queue *sbq, unsigned int depth,
+			    int shift, gfp_t flags)
+{
+	struct sbitmap *sb = &sbq->sb;
+	int ret, cpu;
+
+	ret = sbitmap_queue_init_node(sbq, depth, shift, false, flags,
+				      NUMA_NO_NODE);
+	if (ret || !depth || nr_node_ids < 2)
+		return ret;
+
+	sb->node_start = kcalloc(nr_node_ids + 1, sizeof(*sb->node_start),
+				 flags);
+	if (!sb->node_start) {
+		sbitmap_queue_free(sbq);
+		return -ENOMEM;
+	}
+	sbitmap_partition_words(sb);
+
+	for_each_possible_cpu(cpu)
+		*per_cpu_ptr(sb->alloc_hint, cpu) =
+			sbitmap_random_hint(sb, depth, cpu_to_node(cpu));
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sbitmap_queue_init_numa);
+
 static void sbitmap_queue_update_wake_batch(struct sbitmap_queue *sbq,
 					    unsigned int depth)
 {
@@ -502,6 +657,7 @@ unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq, int nr_tags,
 					unsigned int *offset)
 {
 	struct sbitmap *sb = &sbq->sb;
+	struct sbitmap_scan scan;
 	unsigned int hint, depth;
 	unsigned long index, nr;
 	int i;
@@ -512,18 +668,22 @@ unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq, int nr_tags,
 	depth = READ_ONCE(sb->depth);
 	hint = update_alloc_hint_before_get(sb, depth);
 
-	index = SB_NR_TO_INDEX(sb, hint);
+	sbitmap_scan_init(sb, &scan, SB_NR_TO_INDEX(sb, hint));
 
-	for (i = 0; i < sb->map_nr; i++) {
-		struct sbitmap_word *map = &sb->map[index];
+	for (i = 0; i < scan.map_nr; i++) {
+		struct sbitmap_word *map;
 		unsigned long get_mask;
-		unsigned int map_depth = __map_depth(sb, index);
+		unsigned int map_depth;
 		unsigned long val;
 
+		index = sbitmap_scan_index(&scan, i);
+		map = &sb->map[index];
+		map_depth = __map_depth(sb, index);
+
 		sbitmap_deferred_clear(map, 0, 0, 0);
 		val = READ_ONCE(map->word);
 		if (val == (1UL << (map_depth - 1)) - 1)
-			goto next;
+			continue;
 
 		nr = find_first_zero_bit(&val, map_depth);
 		if (nr + nr_tags <= map_depth) {
@@ -541,10 +701,6 @@ unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq, int nr_tags,
 				return get_mask;
 			}
 		}
-next:
-		/* Jump to next index. */
-		if (++index >= sb->map_nr)
-			index = 0;
 	}
 
 	return 0;
@@ -621,7 +777,9 @@ EXPORT_SYMBOL_GPL(sbitmap_queue_wake_up);
 
 static inline void sbitmap_update_cpu_hint(struct sbitmap *sb, int cpu, int tag)
 {
-	if (likely(!sb->round_robin && tag < sb->depth))
+	/* don't pull CPUs into words owned by another node */
+	if (likely(!sb->round_robin && tag < sb->depth) &&
+	    sbitmap_bit_is_local(sb, cpu_to_node(cpu), tag))
 		data_race(*per_cpu_ptr(sb->alloc_hint, cpu) = tag);
 }
 
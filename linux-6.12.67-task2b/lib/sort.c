@@ -1,17 +1,25 @@
 // SPDX-License-Identifier: GPL-2.0
 /*
- * A fast, small, non-recursive O(n log n) sort for the Linux kernel
+ * A fast, non-recursive O(n log n) sort for the Linux kernel
  *
- * This performs n*log2(n) + 0.37*n + o(n) comparisons on average,
- * and 1.5*n*log2(n) + O(n) in the (very contrived) worst case.
+ * This is a pattern-defeating quicksort: median-of-3 (or pseudomedian
+ * of 9) pivots, a partition which compares a block of elements at a
+ * time without branching on the result, insertion sort for short
+ * ranges, and a fallback to heapsort when too many partitions come out
+ * unbalanced, which keeps the worst case at O(n log n).  Inputs that
+ * are already (nearly) sorted finish in linear time.
  *
- * Quicksort manages n*log2(n) - 1.26*n for random inputs (1.63*n
- * better) at the expense of stack usage and much larger code to avoid
- * quicksort's O(n^2) worst case.
+ * The heapsort performs n*log2(n) + 0.37*n + o(n) comparisons on
+ * average, and 1.5*n*log2(n) + O(n) in the (very contrived) worst case.
+ * Quicksort manages n*log2(n) - 1.26*n for random inputs and touches
+ * memory sequentially, which matters more than the comparison count for
+ * large arrays.
  */
 
 #include <linux/types.h>
 #include <linux/export.h>
+#include <linux/log2.h>
+#include <linux/minmax.h>
 #include <linux/sort.h>
 
 /**
@@ -186,51 +194,25 @@ static size_t parent(size_t i, unsigned int lsbit, size_t size)
 	return i / 2;
 }
 
-/**
- * sort_r - sort an array of elements
- * @base: pointer to data to sort
- * @num: number of elements
- * @size: size of each element
- * @cmp_func: pointer to comparison function
- * @swap_func: pointer to swap function or NULL
- * @priv: third argument passed to comparison function
- *
- * This function does a heapsort on the given array.  You may provide
- * a swap_func function if you need to do something more than a memory
- * copy (e.g. fix up pointers or auxiliary data), but the built-in swap
- * avoids a slow retpoline and so is significantly faster.
+/*
+ * heapsort_r - heapsort an array of elements
  *
- * Sorting time is O(n log n) both on average and worst-case. While
- * quicksort is slightly faster on average, it suffers from exploitable
- * O(n*n) worst-case behavior and extra memory requirements that make
- * it less suitable for kernel use.
+ * Takes the same arguments as sort_r(), except that @swap_func has been
+ * resolved already.  Used on ranges quicksort does not make progress on.
  */
-void sort_r(void *base, size_t num, size_t size,
-	    cmp_r_func_t cmp_func,
-	    swap_r_func_t swap_func,
-	    const void *priv)
+static void heapsort_r(void *base, size_t num, size_t size,
+		       cmp_r_func_t cmp_func,
+		       swap_r_func_t swap_func,
+		       const void *priv)
 {
 	/* pre-scale counters for performance */
 	size_t n = num * size, a = (num/2) * size;
 	const unsigned int lsbit = size & -size;  /* Used to find parent */
 	size_t shift = 0;
 
-	if (!a)		/* num < 2 || size == 0 */
+	if (!a)		/* num < 2 */
 		return;
 
-	/* called from 'sort' without swap function, let's pick the default */
-	if (swap_func == SWAP_WRAPPER && !((struct wrapper *)priv)->swap)
-		swap_func = NULL;
-
-	if (!swap_func) {
-		if (is_aligned(base, size, 8))
-			swap_func = SWAP_WORDS_64;
-		else if (is_aligned(base, size, 4))
-			swap_func = SWAP_WORDS_32;
-		else
-			swap_func = SWAP_BYTES;
-	}
-
 	/*
 	 * Loop invariants:
 	 * 1. elements [a,n) satisfy the heap property (compare greater than
@@ -286,6 +268,303 @@ void sort_r(void *base, size_t num, size_t size,
 	if (n == size * 2 && do_cmp(base, base + size, cmp_func, priv) > 0)
 		do_swap(base, base + size, size, swap_func, priv);
 }
+
+/* Ranges up to this many elements are insertion sorted */
+#define SORT_INSERTION_MAX	16
+/* Ranges from this many elements pick their pivot out of nine */
+#define SORT_NINTHER_MIN	128
+/* Elements compared per side and step of the block partition */
+#define SORT_BLOCK		64
+/* Swaps allowed to partial_insertion_sort() before it gives up */
+#define SORT_PARTIAL_SWAPS	8
+/*
+ * Pending ranges.  The smaller side of a partition is sorted first, so
+ * this covers 2^SORT_STACK * SORT_INSERTION_MAX elements; beyond that
+ * the larger side is heapsorted instead.
+ */
+#define SORT_STACK		24
+
+struct sort_ctx {
+	void *base;
+	size_t size;
+	cmp_r_func_t cmp;
+	swap_r_func_t swap;
+	const void *priv;
+};
+
+/* The helpers below work on byte offsets into the array, like heapsort_r() */
+static __always_inline int sort_cmp(const struct sort_ctx *s, size_t a, size_t b)
+{
+	return do_cmp(s->base + a, s->base + b, s->cmp, s->priv);
+}
+
+static __always_inline void sort_swap(const struct sort_ctx *s, size_t a, size_t b)
+{
+	do_swap(s->base + a, s->base + b, s->size, s->swap, s->priv);
+}
+
+static void insertion_sort(const struct sort_ctx *s, size_t lo, size_t hi)
+{
+	size_t i, j;
+
+	for (i = lo + s->size; i < hi; i += s->size)
+		for (j = i; j > lo && sort_cmp(s, j - s->size, j) > 0; j -= s->size)
+			sort_swap(s, j - s->size, j);
+}
+
+/*
+ * partial_insertion_sort - insertion sort a range that is likely sorted
+ *
+ * Gives up after SORT_PARTIAL_SWAPS swaps.  Returns true if [lo, hi) is
+ * sorted.
+ */
+static bool partial_insertion_sort(const struct sort_ctx *s, size_t lo, size_t hi)
+{
+	unsigned int swaps = 0;
+	size_t i, j;
+
+	for (i = lo + s->size; i < hi; i += s->size) {
+		for (j = i; j > lo && sort_cmp(s, j - s->size, j) > 0; j -= s->size) {
+			if (++swaps > SORT_PARTIAL_SWAPS)
+				return false;
+			sort_swap(s, j - s->size, j);
+		}
+	}
+	return true;
+}
+
+static void sort3(const struct sort_ctx *s, size_t a, size_t b, size_t c)
+{
+	if (sort_cmp(s, b, a) < 0)
+		sort_swap(s, a, b);
+	if (sort_cmp(s, c, b) < 0) {
+		sort_swap(s, b, c);
+		if (sort_cmp(s, b, a) < 0)
+			sort_swap(s, a, b);
+	}
+}
+
+/* Move the pivot for [lo, hi) to lo */
+static void choose_pivot(const struct sort_ctx *s, size_t lo, size_t hi)
+{
+	const size_t size = s->size;
+	size_t n = (hi - lo) / size;
+	size_t mid = lo + n / 2 * size, last = hi - size;
+
+	sort3(s, lo, mid, last);
+	if (n >= SORT_NINTHER_MIN) {
+		sort3(s, lo + size, mid - size, last - size);
+		sort3(s, lo + 2 * size, mid + size, last - 2 * size);
+		sort3(s, mid - size, mid, mid + size);
+	}
+	sort_swap(s, lo, mid);
+}
+
+/*
+ * partition - partition [lo, hi) around the pivot at lo
+ * @swapped: set if any elements had to be moved
+ *
+ * Elements comparing equal to the pivot may end up on either side, which
+ * keeps ranges of many equal elements balanced.  Returns where the pivot
+ * ended up.
+ *
+ * While a wide enough range is left, SORT_BLOCK elements from either end
+ * are compared against the pivot and the offsets of those on the wrong
+ * side are recorded, adding the result of the comparison to the count
+ * rather than branching on it.  Pairs of recorded elements are then
+ * swapped.  The rest is a plain Hoare partition.
+ */
+static size_t partition(const struct sort_ctx *s, size_t lo, size_t hi,
+			bool *swapped)
+{
+	unsigned char offl[SORT_BLOCK], offr[SORT_BLOCK];
+	unsigned int nl = 0, nr = 0, sl = 0, sr = 0, i, k;
+	const size_t size = s->size;
+	size_t l = lo + size, r = hi;
+
+	*swapped = false;
+
+	/* Invariant: [lo + size, l) <= pivot <= [r, hi) */
+	while (r - l >= 2 * SORT_BLOCK * size) {
+		if (!nl) {
+			sl = 0;
+			for (i = 0; i < SORT_BLOCK; i++) {
+				offl[nl] = i;
+				nl += sort_cmp(s, l + i * size, lo) >= 0;
+			}
+		}
+		if (!nr) {
+			sr = 0;
+			for (i = 0; i < SORT_BLOCK; i++) {
+				offr[nr] = i;
+				nr += sort_cmp(s, r - (i + 1) * size, lo) <= 0;
+			}
+		}
+
+		k = min(nl, nr);
+		for (i = 0; i < k; i++)
+			sort_swap(s, l + offl[sl + i] * size,
+				  r - (offr[sr + i] + 1) * size);
+		if (k)
+			*swapped = true;
+		nl -= k;
+		nr -= k;
+		sl += k;
+		sr += k;
+		if (!nl)
+			l += SORT_BLOCK * size;
+		if (!nr)
+			r -= SORT_BLOCK * size;
+	}
+
+	/* Everything before the first element still recorded is in place */
+	if (nl)
+		l += offl[sl] * size;
+	if (nr)
+		r -= offr[sr] * size;
+
+	for (r -= size;; l += size, r -= size) {
+		while (l <= r && sort_cmp(s, l, lo) < 0)
+			l += size;
+		while (l <= r && sort_cmp(s, r, lo) > 0)
+			r -= size;
+		if (l >= r)
+			break;
+		sort_swap(s, l, r);
+		*swapped = true;
+	}
+
+	l -= size;
+	if (l != lo)
+		sort_swap(s, lo, l);
+	return l;
+}
+
+static void introsort(const struct sort_ctx *s, size_t num)
+{
+	size_t stack_lo[SORT_STACK], stack_hi[SORT_STACK];
+	unsigned char stack_bad[SORT_STACK];
+	const size_t size = s->size;
+	size_t lo = 0, hi = num * size;
+	/* unbalanced partitions allowed before falling back to heapsort */
+	unsigned int bad = ilog2(num);
+	unsigned int top = 0;
+
+	for (;;) {
+		size_t n = (hi - lo) / size, nl, nr, m, plo, phi;
+		bool swapped;
+
+		if (n <= SORT_INSERTION_MAX) {
+			insertion_sort(s, lo, hi);
+			goto next;
+		}
+		if (!bad) {
+			heapsort_r(s->base + lo, n, size, s->cmp, s->swap, s->priv);
+			goto next;
+		}
+
+		choose_pivot(s, lo, hi);
+		m = partition(s, lo, hi, &swapped);
+		nl = (m - lo) / size;
+		nr = n - nl - 1;
+
+		if (nl < n / 8 || nr < n / 8) {
+			/* Shuffle a little to break up the pattern */
+			bad--;
+			if (nl >= SORT_INSERTION_MAX) {
+				sort_swap(s, lo, lo + nl / 4 * size);
+				sort_swap(s, m - size, m - nl / 4 * size);
+			}
+			if (nr >= SORT_INSERTION_MAX) {
+				sort_swap(s, m + size, m + (1 + nr / 4) * size);
+				sort_swap(s, hi - size, hi - nr / 4 * size);
+			}
+		} else if (!swapped) {
+			/* Likely sorted already, see if both sides are */
+			bool sorted = partial_insertion_sort(s, lo, m);
+
+			if (partial_insertion_sort(s, m + size, hi) && sorted)
+				goto next;
+		}
+
+		/* Continue with the smaller side, push the larger one */
+		if (nl < nr) {
+			plo = m + size;
+			phi = hi;
+			hi = m;
+		} else {
+			plo = lo;
+			phi = m;
+			lo = m + size;
+		}
+		if (top < SORT_STACK) {
+			stack_lo[top] = plo;
+			stack_hi[top] = phi;
+			stack_bad[top++] = bad;
+		} else {
+			heapsort_r(s->base + plo, (phi - plo) / size, size,
+				   s->cmp, s->swap, s->priv);
+		}
+		continue;
+next:
+		if (!top)
+			break;
+		top--;
+		lo = stack_lo[top];
+		hi = stack_hi[top];
+		bad = stack_bad[top];
+	}
+}
+
+/**
+ * sort_r - sort an array of elements
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ * @priv: third argument passed to comparison function
+ *
+ * This function does an introspective quicksort on the given array.  You
+ * may provide a swap_func function if you need to do something more than
+ * a memory copy (e.g. fix up pointers or auxiliary data), but the built-in
+ * swap avoids a slow retpoline and so is significantly faster.
+ *
+ * Sorting time is O(n log n) both on average and worst-case: ranges that
+ * keep partitioning badly are heapsorted instead.  No recursion is used,
+ * and the stack usage is bounded.  The sort is not stable.
+ */
+void sort_r(void *base, size_t num, size_t size,
+	    cmp_r_func_t cmp_func,
+	    swap_r_func_t swap_func,
+	    const void *priv)
+{
+	struct sort_ctx s = {
+		.base = base,
+		.size = size,
+		.cmp  = cmp_func,
+		.priv = priv,
+	};
+
+	if (num < 2 || !size)
+		return;
+
+	/* called from 'sort' without swap function, let's pick the default */
+	if (swap_func == SWAP_WRAPPER && !((struct wrapper *)priv)->swap)
+		swap_func = NULL;
+
+	if (!swap_func) {
+		if (is_aligned(base, size, 8))
+			swap_func = SWAP_WORDS_64;
+		else if (is_aligned(base, size, 4))
+			swap_func = SWAP_WORDS_32;
+		else
+			swap_func = SWAP_BYTES;
+	}
+	s.swap = swap_func;
+
+	introsort(&s, num);
+}
 EXPORT_SYMBOL(sort_r);
 
 void sort(void *base, size_t num, size_t size,
@@ -22,6 +22,7 @@
 #include <linux/list.h>
 #include <linux/mm.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
 #include <linux/poison.h>
 #include <linux/printk.h>
 #include <linux/rculist.h>
@@ -56,6 +57,15 @@ static bool __stack_depot_early_init_passed __initdata;
 
 /* Hash table of stored stack records. */
 static struct list_head *stack_table;
+/*
+ * Locks serializing modifications of the hash table buckets; lookups are
+ * lockless. There are fewer locks than buckets, bucket i uses lock
+ * i % STACK_BUCKET_LOCKS.
+ */
+#define STACK_BUCKET_LOCKS 256
+static raw_spinlock_t stack_bucket_locks[STACK_BUCKET_LOCKS] = {
+	[0 ... STACK_BUCKET_LOCKS - 1] = __RAW_SPIN_LOCK_UNLOCKED(stack_bucket_locks),
+};
 /* Fixed order of the number of table buckets. Used when KASAN is enabled. */
 static unsigned int stack_bucket_number_order;
 /* Hash mask for indexing the table. */
@@ -71,9 +81,31 @@ static int pools_num;
 static size_t pool_offset = DEPOT_POOL_SIZE;
 /* Freelist of stack records within stack_pools. */
 static LIST_HEAD(free_stacks);
-/* The lock must be held when performing pool or freelist modifications. */
+/*
+ * The lock must be held when performing pool or freelist modifications. It
+ * nests inside the bucket locks.
+ */
 static DEFINE_RAW_SPINLOCK(pool_lock);
 
+/*
+ * Space each CPU reserves from the current pool at a time. New persistent
+ * stack records are carved out of it without taking pool_lock. Large enough
+ * for several records of CONFIG_STACKDEPOT_MAX_FRAMES frames.
+ */
+#define DEPOT_CPU_CHUNK_SIZE (DEPOT_POOL_SIZE / 4)
+static_assert(sizeof(struct stack_record) <= DEPOT_CPU_CHUNK_SIZE);
+
+/*
+ * A CPU's reserved range [offset, end) within stack_pools[pool_index]. Only
+ * accessed with interrupts disabled and never from NMI context.
+ */
+struct depot_cpu_chunk {
+	u32 pool_index;
+	size_t offset;
+	size_t end;
+};
+static DEFINE_PER_CPU(struct depot_cpu_chunk, depot_cpu_chunk);
+
 /* Statistics counters for debugfs. */
 enum depot_counter_id {
 	DEPOT_COUNTER_REFD_ALLOCS,
@@ -84,7 +116,7 @@ enum depot_counter_id {
 	DEPOT_COUNTER_PERSIST_BYTES,
 	DEPOT_COUNTER_COUNT,
 };
-static long counters[DEPOT_COUNTER_COUNT];
+static DEFINE_PER_CPU(long, counters[DEPOT_COUNTER_COUNT]);
 static const char *const counter_names[] = {
 	[DEPOT_COUNTER_REFD_ALLOCS]	= "refcounted_allocations",
 	[DEPOT_COUNTER_REFD_FREES]	= "refcounted_frees",
@@ -304,38 +336,114 @@ static void depot_keep_new_pool(void **prealloc)
 }
 
 /*
- * Try to initialize a new stack record from the current pool, a cached pool, or
- * the current pre-allocation.
+ * Reserve @size bytes from the current pool, a cached pool, or the current
+ * pre-allocation.
  */
-static struct stack_record *depot_pop_free_pool(void **prealloc, size_t size)
+static bool depot_reserve(void **prealloc, size_t size, u32 *pool_index,
+			  size_t *offset)
 {
-	struct stack_record *stack;
-	void *current_pool;
-	u32 pool_index;
-
 	lockdep_assert_held(&pool_lock);
 
 	if (pool_offset + size > DEPOT_POOL_SIZE) {
 		if (!depot_init_pool(prealloc))
-			return NULL;
+			return false;
 	}
 
 	if (WARN_ON_ONCE(pools_num < 1))
-		return NULL;
-	pool_index = pools_num - 1;
-	current_pool = stack_pools[pool_index];
-	if (WARN_ON_ONCE(!current_pool))
-		return NULL;
+		return false;
+	*pool_index = pools_num - 1;
+	if (WARN_ON_ONCE(!stack_pools[*pool_index]))
+		return false;
 
-	stack = current_pool + pool_offset;
+	*offset = pool_offset;
+	pool_offset += size;
+
+	return true;
+}
+
+static struct stack_record *depot_init_record(u32 pool_index, size_t offset)
+{
+	struct stack_record *stack = stack_pools[pool_index] + offset;
 
 	/* Pre-initialize handle once. */
 	stack->handle.pool_index_plus_1 = pool_index + 1;
-	stack->handle.offset = pool_offset >> DEPOT_STACK_ALIGN;
+	stack->handle.offset = offset >> DEPOT_STACK_ALIGN;
 	stack->handle.extra = 0;
 	INIT_LIST_HEAD(&stack->hash_list);
 
-	pool_offset += size;
+	return stack;
+}
+
+/* Try to initialize a new stack record directly from the current pool. */
+static struct stack_record *depot_pop_free_pool(void **prealloc, size_t size)
+{
+	u32 pool_index;
+	size_t offset;
+
+	if (!depot_reserve(prealloc, size, &pool_index, &offset))
+		return NULL;
+
+	return depot_init_record(pool_index, offset);
+}
+
+/*
+ * Try to initialize a new stack record from this CPU's chunk, refilling the
+ * chunk from the current pool if it is used up.
+ */
+static struct stack_record *depot_pop_cpu_chunk(void **prealloc, size_t size)
+{
+	struct depot_cpu_chunk *chunk = this_cpu_ptr(&depot_cpu_chunk);
+	struct stack_record *stack;
+
+	lockdep_assert_irqs_disabled();
+
+	if (chunk->offset + size > chunk->end) {
+		u32 pool_index;
+		size_t offset;
+		bool ok;
+
+		/* The rest of the old chunk is wasted. */
+		raw_spin_lock(&pool_lock);
+		ok = depot_reserve(prealloc, DEPOT_CPU_CHUNK_SIZE, &pool_index,
+				   &offset);
+		raw_spin_unlock(&pool_lock);
+		if (!ok)
+			return NULL;
+
+		chunk->pool_index = pool_index;
+		chunk->offset = offset;
+		chunk->end = offset + DEPOT_CPU_CHUNK_SIZE;
+	}
+
+	stack = depot_init_record(chunk->pool_index, chunk->offset);
+	chunk->offset += size;
+
+	return stack;
+}
+
+/*
+ * Try to get a new stack record under pool_lock: from the freelist if @reuse,
+ * otherwise or if that fails from the current pool.
+ */
+static struct stack_record *depot_pop_locked(void **prealloc, size_t size,
+					     bool reuse)
+{
+	struct stack_record *stack = NULL;
+
+	/* Best effort in NMI, which may have interrupted a pool_lock holder. */
+	if (in_nmi()) {
+		if (!raw_spin_trylock(&pool_lock))
+			return NULL;
+	} else {
+		raw_spin_lock(&pool_lock);
+	}
+
+	if (reuse)
+		stack = depot_pop_free();
+	if (!stack)
+		stack = depot_pop_free_pool(prealloc, size);
+
+	raw_spin_unlock(&pool_lock);
 
 	return stack;
 }
@@ -361,7 +469,7 @@ static struct stack_record *depot_pop_free(void)
 		return NULL;
 
 	list_del(&stack->free_list);
-	counters[DEPOT_COUNTER_FREELIST_SIZE]--;
+	this_cpu_dec(counters[DEPOT_COUNTER_FREELIST_SIZE]);
 
 	return stack;
 }
@@ -376,14 +484,17 @@ static inline size_t depot_stack_record_size(struct stack_record *s, unsigned in
 	return ALIGN(sizeof(struct stack_record) - unused, 1 << DEPOT_STACK_ALIGN);
 }
 
-/* Allocates a new stack in a stack depot pool. */
+/*
+ * Allocates a new stack in a stack depot pool. Called with the bucket lock for
+ * @hash held.
+ */
 static struct stack_record *
 depot_alloc_stack(unsigned long *entries, unsigned int nr_entries, u32 hash, depot_flags_t flags, void **prealloc)
 {
 	struct stack_record *stack = NULL;
 	size_t record_size;
 
-	lockdep_assert_held(&pool_lock);
+	lockdep_assert_not_held(&pool_lock);
 
 	/* This should already be checked by public API entry points. */
 	if (WARN_ON_ONCE(!nr_entries))
@@ -399,16 +510,21 @@ depot_alloc_stack(unsigned long *entries, unsigned int nr_entries, u32 hash, dep
 		 * safely be re-used by differently sized allocations.
 		 */
 		record_size = depot_stack_record_size(stack, CONFIG_STACKDEPOT_MAX_FRAMES);
-		stack = depot_pop_free();
 	} else {
 		record_size = depot_stack_record_size(stack, nr_entries);
 	}
 
-	if (!stack) {
-		stack = depot_pop_free_pool(prealloc, record_size);
-		if (!stack)
-			return NULL;
-	}
+	/*
+	 * Persistent records come from the per-CPU chunks; the freelist and
+	 * NMI context need pool_lock.
+	 */
+	if ((flags & STACK_DEPOT_FLAG_GET) || in_nmi())
+		stack = depot_pop_locked(prealloc, record_size,
+					 flags & STACK_DEPOT_FLAG_GET);
+	else
+		stack = depot_pop_cpu_chunk(prealloc, record_size);
+	if (!stack)
+		return NULL;
 
 	/* Save the stack trace. */
 	stack->hash = hash;
@@ -418,13 +534,13 @@ depot_alloc_stack(unsigned long *entries, unsigned int nr_entries, u32 hash, dep
 
 	if (flags & STACK_DEPOT_FLAG_GET) {
 		refcount_set(&stack->count, 1);
-		counters[DEPOT_COUNTER_REFD_ALLOCS]++;
-		counters[DEPOT_COUNTER_REFD_INUSE]++;
+		this_cpu_inc(counters[DEPOT_COUNTER_REFD_ALLOCS]);
+		this_cpu_inc(counters[DEPOT_COUNTER_REFD_INUSE]);
 	} else {
 		/* Warn on attempts to switch to refcounting this entry. */
 		refcount_set(&stack->count, REFCOUNT_SATURATED);
-		counters[DEPOT_COUNTER_PERSIST_COUNT]++;
-		counters[DEPOT_COUNTER_PERSIST_BYTES] += record_size;
+		this_cpu_inc(counters[DEPOT_COUNTER_PERSIST_COUNT]);
+		this_cpu_add(counters[DEPOT_COUNTER_PERSIST_BYTES], record_size);
 	}
 
 	/*
@@ -464,14 +580,23 @@ static struct stack_record *depot_fetch_stack(depot_stack_handle_t handle)
 	return stack;
 }
 
+static raw_spinlock_t *depot_bucket_lock(u32 hash)
+{
+	/* The table has at least STACK_BUCKET_LOCKS buckets. */
+	BUILD_BUG_ON(STACK_BUCKET_LOCKS > 1UL << STACK_BUCKET_NUMBER_ORDER_MIN);
+
+	return &stack_bucket_locks[hash % STACK_BUCKET_LOCKS];
+}
+
 /* Links stack into the freelist. */
 static void depot_free_stack(struct stack_record *stack)
 {
+	raw_spinlock_t *lock = depot_bucket_lock(stack->hash);
 	unsigned long flags;
 
 	lockdep_assert_not_held(&pool_lock);
 
-	raw_spin_lock_irqsave(&pool_lock, flags);
+	raw_spin_lock_irqsave(lock, flags);
 	printk_deferred_enter();
 
 	/*
@@ -498,14 +623,16 @@ static void depot_free_stack(struct stack_record *stack)
 	 * considered first - their RCU cookie is more likely to no longer be
 	 * associated with the current grace period.
 	 */
+	raw_spin_lock(&pool_lock);
 	list_add_tail(&stack->free_list, &free_stacks);
+	raw_spin_unlock(&pool_lock);
 
-	counters[DEPOT_COUNTER_FREELIST_SIZE]++;
-	counters[DEPOT_COUNTER_REFD_FREES]++;
-	counters[DEPOT_COUNTER_REFD_INUSE]--;
+	this_cpu_inc(counters[DEPOT_COUNTER_FREELIST_SIZE]);
+	this_cpu_inc(counters[DEPOT_COUNTER_REFD_FREES]);
+	this_cpu_dec(counters[DEPOT_COUNTER_REFD_INUSE]);
 
 	printk_deferred_exit();
-	raw_spin_unlock_irqrestore(&pool_lock, flags);
+	raw_spin_unlock_irqrestore(lock, flags);
 }
 
 /* Calculates the hash for a stack. */
@@ -587,6 +714,7 @@ depot_stack_handle_t stack_depot_save_flags(unsigned long *entries,
 					    depot_flags_t depot_flags)
 {
 	struct list_head *bucket;
+	raw_spinlock_t *lock;
 	struct stack_record *found = NULL;
 	depot_stack_handle_t handle = 0;
 	struct page *page = NULL;
@@ -630,14 +758,20 @@ depot_stack_handle_t stack_depot_save_flags(unsigned long *entries,
 			prealloc = page_address(page);
 	}
 
+	/*
+	 * Inserting only takes the lock of this bucket. pool_lock is needed
+	 * only when this CPU's chunk of pool space is used up, or for the
+	 * freelist.
+	 */
+	lock = depot_bucket_lock(hash);
 	if (in_nmi()) {
 		/* We can never allocate in NMI context. */
 		WARN_ON_ONCE(can_alloc);
 		/* Best effort; bail if we fail to take the lock. */
-		if (!raw_spin_trylock_irqsave(&pool_lock, flags))
+		if (!raw_spin_trylock_irqsave(lock, flags))
 			goto exit;
 	} else {
-		raw_spin_lock_irqsave(&pool_lock, flags);
+		raw_spin_lock_irqsave(lock, flags);
 	}
 	printk_deferred_enter();
 
@@ -663,11 +797,13 @@ depot_stack_handle_t stack_depot_save_flags(unsigned long *entries,
 		 * depot_alloc_stack() did not consume the preallocated memory.
 		 * Try to keep the preallocated memory for future.
 		 */
+		raw_spin_lock(&pool_lock);
 		depot_keep_new_pool(&prealloc);
+		raw_spin_unlock(&pool_lock);
 	}
 
 	printk_deferred_exit();
-	raw_spin_unlock_irqrestore(&pool_lock, flags);
+	raw_spin_unlock_irqrestore(lock, flags);
 exit:
 	if (prealloc) {
 		/* Stack depot didn't use this memory, free it. */
@@ -796,8 +932,14 @@ static int stats_show(struct seq_file *seq, void *v)
 	 * statistics are ok for debugging.
 	 */
 	seq_printf(seq, "pools: %d\n", data_race(pools_num));
-	for (int i = 0; i < DEPOT_COUNTER_COUNT; i++)
-		seq_printf(seq, "%s: %ld\n", counter_names[i], data_race(counters[i]));
+	for (int i = 0; i < DEPOT_COUNTER_COUNT; i++) {
+		long sum = 0;
+		int cpu;
+
+		for_each_possible_cpu(cpu)
+			sum += data_race(per_cpu(counters[i], cpu));
+		seq_printf(seq, "%s: %ld\n", counter_names[i], sum);
+	}
 
 	return 0;
 }
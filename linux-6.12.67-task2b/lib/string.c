@@ -30,6 +30,22 @@
 #include <linux/unaligned.h>
 #include <asm/word-at-a-time.h>
 
+/*
+ * Index of the first zero byte of @v in memory order, or sizeof(long) if it
+ * has none.
+ */
+static __always_inline __maybe_unused unsigned int word_find_zero(unsigned long v)
+{
+	const struct word_at_a_time constants = WORD_AT_A_TIME_CONSTANTS;
+	unsigned long data;
+
+	if (!has_zero(v, &data, &constants))
+		return sizeof(unsigned long);
+	data = prep_zero_mask(v, data, &constants);
+	data = create_zero_mask(data);
+	return find_zero(data);
+}
+
 #ifndef __HAVE_ARCH_STRNCASECMP
 /**
  * strncasecmp - Case insensitive, length-limited string comparison
@@ -404,9 +420,26 @@ EXPORT_SYMBOL(strnchr);
 #ifndef __HAVE_ARCH_STRLEN
 size_t strlen(const char *s)
 {
-	const char *sc;
+	const char *sc = s;
+	unsigned int i;
 
-	for (sc = s; *sc != '\0'; ++sc)
+	/*
+	 * Once aligned, whole words can be read without crossing into the
+	 * next page. The bytes read past the terminator are uninitialized
+	 * as far as KMSAN is concerned, so don't do this under KMSAN.
+	 */
+	if (!IS_ENABLED(CONFIG_KMSAN)) {
+		for (; !IS_ALIGNED((unsigned long)sc, sizeof(long)); ++sc)
+			if (*sc == '\0')
+				return sc - s;
+		for (;; sc += sizeof(long)) {
+			i = word_find_zero(read_word_at_a_time(sc));
+			if (i < sizeof(long))
+				return sc + i - s;
+		}
+	}
+
+	for (; *sc != '\0'; ++sc)
 		/* nothing */;
 	return sc - s;
 }
@@ -416,9 +449,27 @@ EXPORT_SYMBOL(strlen);
 #ifndef __HAVE_ARCH_STRNLEN
 size_t strnlen(const char *s, size_t count)
 {
-	const char *sc;
+	const char *sc = s;
+	unsigned int i;
 
-	for (sc = s; count-- && *sc != '\0'; ++sc)
+	/*
+	 * @count may be larger than the string, so as in strlen() only
+	 * aligned words are read, with read_word_at_a_time(), and not under
+	 * KMSAN.
+	 */
+	if (!IS_ENABLED(CONFIG_KMSAN)) {
+		for (; count && !IS_ALIGNED((unsigned long)sc, sizeof(long));
+		     ++sc, count--)
+			if (*sc == '\0')
+				return sc - s;
+		for (; count >= sizeof(long);
+		     sc += sizeof(long), count -= sizeof(long)) {
+			i = word_find_zero(read_word_at_a_time(sc));
+			if (i < sizeof(long))
+				return sc + i - s;
+		}
+	}
+	for (; count-- && *sc != '\0'; ++sc)
 		/* nothing */;
 	return sc - s;
 }
@@ -678,6 +729,28 @@ __visible int memcmp(const void *cs, const void *ct, size_t count)
 		cs = u1;
 		ct = u2;
 	}
+#else
+	/* Compare a word at a time if both areas can be aligned at once. */
+	if (count >= sizeof(unsigned long) &&
+	    IS_ALIGNED((unsigned long)cs ^ (unsigned long)ct, sizeof(long))) {
+		const unsigned long *u1, *u2;
+
+		for (su1 = cs, su2 = ct;
+		     !IS_ALIGNED((unsigned long)su1, sizeof(long));
+		     ++su1, ++su2, count--)
+			if ((res = *su1 - *su2) != 0)
+				return res;
+
+		u1 = (const unsigned long *)su1;
+		u2 = (const unsigned long *)su2;
+		while (count >= sizeof(unsigned long) && *u1 == *u2) {
+			u1++;
+			u2++;
+			count -= sizeof(unsigned long);
+		}
+		cs = u1;
+		ct = u2;
+	}
 #endif
 	for (su1 = cs, su2 = ct; 0 < count; ++su1, ++su2, count--)
 		if ((res = *su1 - *su2) != 0)
@@ -706,6 +779,35 @@ int bcmp(const void *a, const void *b, size_t len)
 EXPORT_SYMBOL(bcmp);
 #endif
 
+#if !defined(__HAVE_ARCH_MEMSCAN) || !defined(__HAVE_ARCH_MEMCHR)
+/*
+ * The first byte equal to @c in the @n bytes at @p, or @p + @n. Callers may
+ * pass an @n that runs past the object as long as @c comes first, so as in
+ * strlen() only aligned words are read, with read_word_at_a_time(), and not
+ * under KMSAN.
+ */
+static const unsigned char *memchr_words(const unsigned char *p, int c, size_t n)
+{
+	unsigned long repeat = REPEAT_BYTE((unsigned char)c);
+	unsigned int i;
+
+	if (!IS_ENABLED(CONFIG_KMSAN)) {
+		for (; n && !IS_ALIGNED((unsigned long)p, sizeof(long)); ++p, n--)
+			if (*p == (unsigned char)c)
+				return p;
+		for (; n >= sizeof(long); p += sizeof(long), n -= sizeof(long)) {
+			i = word_find_zero(read_word_at_a_time(p) ^ repeat);
+			if (i < sizeof(long))
+				return p + i;
+		}
+	}
+	for (; n; ++p, n--)
+		if (*p == (unsigned char)c)
+			return p;
+	return p;
+}
+#endif
+
 #ifndef __HAVE_ARCH_MEMSCAN
 /**
  * memscan - Find a character in an area of memory.
@@ -718,15 +820,7 @@ EXPORT_SYMBOL(bcmp);
  */
 void *memscan(void *addr, int c, size_t size)
 {
-	unsigned char *p = addr;
-
-	while (size) {
-		if (*p == (unsigned char)c)
-			return (void *)p;
-		p++;
-		size--;
-	}
-  	return (void *)p;
+	return (void *)memchr_words(addr, c, size);
 }
 EXPORT_SYMBOL(memscan);
 #endif
@@ -793,13 +887,9 @@ EXPORT_SYMBOL(strnstr);
  */
 void *memchr(const void *s, int c, size_t n)
 {
-	const unsigned char *p = s;
-	while (n-- != 0) {
-        	if ((unsigned char)c == *p++) {
-			return (void *)(p - 1);
-		}
-	}
-	return NULL;
+	const unsigned char *p = memchr_words(s, c, n);
+
+	return p != (const unsigned char *)s + n ? (void *)p : NULL;
 }
 EXPORT_SYMBOL(memchr);
 #endif
@@ -6,6 +6,7 @@
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
 #include <kunit/test.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/printk.h>
 #include <linux/slab.h>
@@ -160,6 +161,101 @@ static void string_test_strnchr(struct kunit *test)
 	KUNIT_ASSERT_NULL(test, result);
 }
 
+/*
+ * The word-at-a-time paths only kick in once aligned, so try every start
+ * alignment, length and match position around a few words.
+ */
+#define SCAN_TEST_LEN	(4 * sizeof(long))
+
+static void string_test_memchr(struct kunit *test)
+{
+	char buf[2 * SCAN_TEST_LEN] __aligned(sizeof(long));
+	int off, len, pos;
+
+	for (off = 0; off < sizeof(long); off++) {
+		for (len = 0; len <= SCAN_TEST_LEN; len++) {
+			for (pos = 0; pos <= len; pos++) {
+				char *s = buf + off;
+
+				memset(buf, 'a', sizeof(buf));
+				if (pos < len)
+					s[pos] = 'z';
+
+				KUNIT_ASSERT_PTR_EQ_MSG(test, memchr(s, 'z', len),
+					pos < len ? s + pos : NULL,
+					"off:%d len:%d pos:%d", off, len, pos);
+				KUNIT_ASSERT_PTR_EQ_MSG(test, memscan(s, 'z', len),
+					s + pos,
+					"off:%d len:%d pos:%d", off, len, pos);
+			}
+		}
+	}
+}
+
+static void string_test_strlen(struct kunit *test)
+{
+	char buf[2 * SCAN_TEST_LEN] __aligned(sizeof(long));
+	int off, len, count;
+
+	for (off = 0; off < sizeof(long); off++) {
+		for (len = 0; len < SCAN_TEST_LEN; len++) {
+			char *s = buf + off;
+
+			memset(buf, 'a', sizeof(buf));
+			s[len] = '\0';
+
+			KUNIT_ASSERT_EQ_MSG(test, strlen(s), len,
+					    "off:%d len:%d", off, len);
+			for (count = 0; count <= SCAN_TEST_LEN; count++)
+				KUNIT_ASSERT_EQ_MSG(test, strnlen(s, count),
+						    min(len, count),
+						    "off:%d len:%d count:%d",
+						    off, len, count);
+		}
+	}
+}
+
+#define SCAN_BENCH_LEN	4096
+#define SCAN_BENCH_LOOPS 1000
+
+/* Time the scanning functions over a buffer without a match. */
+static void string_test_scan_benchmark(struct kunit *test)
+{
+	char *a, *b;
+	ktime_t t;
+	size_t ret = 0;
+	int i;
+
+	a = kunit_kmalloc(test, SCAN_BENCH_LEN + 1, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, a);
+	b = kunit_kmalloc(test, SCAN_BENCH_LEN + 1, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, b);
+	memset(a, 'a', SCAN_BENCH_LEN);
+	memset(b, 'a', SCAN_BENCH_LEN);
+	a[SCAN_BENCH_LEN] = b[SCAN_BENCH_LEN] = '\0';
+
+#define SCAN_BENCH(expr) do {						\
+		t = ktime_get();					\
+		for (i = 0; i < SCAN_BENCH_LOOPS; i++) {		\
+			ret += (size_t)(expr);				\
+			barrier();					\
+		}							\
+		t = ktime_sub(ktime_get(), t);				\
+		kunit_info(test, "%s: %d bytes: %lld ns\n", #expr,	\
+			   SCAN_BENCH_LEN,				\
+			   div_s64(ktime_to_ns(t), SCAN_BENCH_LOOPS));	\
+	} while (0)
+
+	SCAN_BENCH(memchr(a, 'z', SCAN_BENCH_LEN));
+	SCAN_BENCH(memscan(a, 'z', SCAN_BENCH_LEN));
+	SCAN_BENCH(strlen(a));
+	SCAN_BENCH(strnlen(a, SCAN_BENCH_LEN + 1));
+	SCAN_BENCH(memcmp(a, b, SCAN_BENCH_LEN));
+#undef SCAN_BENCH
+
+	KUNIT_EXPECT_NE(test, ret, 0);
+}
+
 static void string_test_strspn(struct kunit *test)
 {
 	static const struct strspn_test {
@@ -608,6 +704,9 @@ static struct kunit_case string_test_cases[] = {
 	KUNIT_CASE(string_test_memset64),
 	KUNIT_CASE(string_test_strchr),
 	KUNIT_CASE(string_test_strnchr),
+	KUNIT_CASE(string_test_memchr),
+	KUNIT_CASE(string_test_strlen),
+	KUNIT_CASE_SLOW(string_test_scan_benchmark),
 	KUNIT_CASE(string_test_strspn),
 	KUNIT_CASE(string_test_strcmp),
 	KUNIT_CASE(string_test_strcmp_long_strings),
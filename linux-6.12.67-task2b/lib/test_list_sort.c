@@ -14,6 +14,8 @@
  * are hit in list_sort().
  */
 #define TEST_LIST_LEN (512+128+2) /* not including head */
+/* long enough to be split by list_sort_parallel() */
+#define TEST_PARALLEL_LEN (4 * 16 * 1024 + 512 + 3)
 
 #define TEST_POISON1 0xDEADBEEF
 #define TEST_POISON2 0xA324354C
@@ -26,12 +28,18 @@ struct debug_el {
 	unsigned int serial;
 };
 
+struct debug_elts {
+	struct debug_el **elts;
+	unsigned int len;
+};
+
 static void check(struct kunit *test, struct debug_el *ela, struct debug_el *elb)
 {
-	struct debug_el **elts = test->priv;
+	struct debug_elts *priv = test->priv;
+	struct debug_el **elts = priv->elts;
 
-	KUNIT_EXPECT_LT_MSG(test, ela->serial, (unsigned int)TEST_LIST_LEN, "incorrect serial");
-	KUNIT_EXPECT_LT_MSG(test, elb->serial, (unsigned int)TEST_LIST_LEN, "incorrect serial");
+	KUNIT_EXPECT_LT_MSG(test, ela->serial, priv->len, "incorrect serial");
+	KUNIT_EXPECT_LT_MSG(test, elb->serial, priv->len, "incorrect serial");
 
 	KUNIT_EXPECT_PTR_EQ_MSG(test, elts[ela->serial], ela, "phantom element");
 	KUNIT_EXPECT_PTR_EQ_MSG(test, elts[elb->serial], elb, "phantom element");
@@ -55,23 +63,29 @@ static int cmp(void *priv, const struct list_head *a, const struct list_head *b)
 	return ela->value - elb->value;
 }
 
-static void list_sort_test(struct kunit *test)
+static void __list_sort_test(struct kunit *test, int len,
+			     void (*sort)(void *, struct list_head *, list_cmp_func_t))
 {
 	int i, count = 1;
 	struct debug_el *el, **elts;
+	struct debug_elts *priv;
 	struct list_head *cur;
 	LIST_HEAD(head);
 
-	elts = kunit_kcalloc(test, TEST_LIST_LEN, sizeof(*elts), GFP_KERNEL);
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, priv);
+	elts = kunit_kcalloc(test, len, sizeof(*elts), GFP_KERNEL);
 	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, elts);
-	test->priv = elts;
+	priv->elts = elts;
+	priv->len = len;
+	test->priv = priv;
 
-	for (i = 0; i < TEST_LIST_LEN; i++) {
+	for (i = 0; i < len; i++) {
 		el = kunit_kmalloc(test, sizeof(*el), GFP_KERNEL);
 		KUNIT_ASSERT_NOT_ERR_OR_NULL(test, el);
 
 		 /* force some equivalencies */
-		el->value = get_random_u32_below(TEST_LIST_LEN / 3);
+		el->value = get_random_u32_below(len / 3);
 		el->serial = i;
 		el->poison1 = TEST_POISON1;
 		el->poison2 = TEST_POISON2;
@@ -79,7 +93,7 @@ static void list_sort_test(struct kunit *test)
 		list_add_tail(&el->list, &head);
 	}
 
-	list_sort(test, &head, cmp);
+	sort(test, &head, cmp);
 
 	for (cur = head.next; cur->next != &head; cur = cur->next) {
 		struct debug_el *el1;
@@ -103,12 +117,24 @@ static void list_sort_test(struct kunit *test)
 	}
 	KUNIT_EXPECT_PTR_EQ_MSG(test, head.prev, cur, "list is corrupted");
 
-	KUNIT_EXPECT_EQ_MSG(test, count, TEST_LIST_LEN,
+	KUNIT_EXPECT_EQ_MSG(test, count, len,
 			    "list length changed after sorting!");
 }
 
+static void list_sort_test(struct kunit *test)
+{
+	__list_sort_test(test, TEST_LIST_LEN, list_sort);
+}
+
+static void list_sort_parallel_test(struct kunit *test)
+{
+	__list_sort_test(test, TEST_LIST_LEN, list_sort_parallel);
+	__list_sort_test(test, TEST_PARALLEL_LEN, list_sort_parallel);
+}
+
 static struct kunit_case list_sort_cases[] = {
 	KUNIT_CASE(list_sort_test),
+	KUNIT_CASE(list_sort_parallel_test),
 	{}
 };
 
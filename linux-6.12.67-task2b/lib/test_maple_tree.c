@@ -2769,6 +2769,85 @@ static noinline void __init check_dup(struct maple_tree *mt)
 	}
 }
 
+static noinline void __init check_bulk_load_nr(struct maple_tree *mt,
+		unsigned long nr, bool zero_start, unsigned long gap)
+{
+	struct maple_bulk_entry *entries;
+	unsigned long i, start = zero_start ? 0 : 1;
+
+	entries = kcalloc(nr, sizeof(*entries), GFP_KERNEL);
+	MT_BUG_ON(mt, !entries);
+	for (i = 0; i < nr; i++) {
+		entries[i].index = (start + i) * 10;
+		entries[i].last = (start + i + 1) * 10 - 1 - gap;
+		entries[i].entry = xa_mk_value(i);
+	}
+
+	MT_BUG_ON(mt, mtree_bulk_load(mt, entries, nr, GFP_KERNEL) != 0);
+	mt_validate(mt);
+	for (i = 0; i < nr; i++) {
+		MT_BUG_ON(mt, mtree_load(mt, entries[i].index) != xa_mk_value(i));
+		MT_BUG_ON(mt, mtree_load(mt, entries[i].last) != xa_mk_value(i));
+		if (gap)
+			MT_BUG_ON(mt, mtree_load(mt, entries[i].last + 1));
+	}
+	MT_BUG_ON(mt, mtree_bulk_load(mt, entries, nr, GFP_KERNEL) != -EEXIST);
+
+	/* The tree must be usable by normal writes afterwards */
+	for (i = 0; i < nr; i += 3)
+		mtree_erase(mt, entries[i].index);
+	mt_validate(mt);
+	for (i = 0; i < nr; i += 3)
+		MT_BUG_ON(mt, mtree_store_range(mt, entries[i].index,
+				entries[i].last, xa_mk_value(i), GFP_KERNEL));
+	mt_validate(mt);
+	for (i = 0; i < nr; i++)
+		MT_BUG_ON(mt, mtree_load(mt, entries[i].index) != xa_mk_value(i));
+
+	kfree(entries);
+}
+
+static noinline void __init check_bulk_load(struct maple_tree *mt)
+{
+	struct maple_bulk_entry bad[2] = {
+		{ .index = 10, .last = 20, .entry = xa_mk_value(1) },
+		{ .index = 20, .last = 30, .entry = xa_mk_value(2) },
+	};
+	unsigned long flags[] = { 0, MT_FLAGS_ALLOC_RANGE };
+	int i, f;
+
+	/* Overlapping ranges */
+	MT_BUG_ON(mt, mtree_bulk_load(mt, bad, 2, GFP_KERNEL) != -EINVAL);
+	MT_BUG_ON(mt, !mtree_empty(mt));
+	/* Whole range */
+	bad[0].index = 0;
+	bad[0].last = ULONG_MAX;
+	MT_BUG_ON(mt, mtree_bulk_load(mt, bad, 1, GFP_KERNEL) != 0);
+	mt_validate(mt);
+	MT_BUG_ON(mt, mtree_load(mt, ULONG_MAX) != xa_mk_value(1));
+	mtree_destroy(mt);
+
+	for (f = 0; f < ARRAY_SIZE(flags); f++) {
+		for (i = 1; i < 1000; i++) {
+			mt_init_flags(mt, flags[f]);
+			check_bulk_load_nr(mt, i, i & 1, 5);
+			mtree_destroy(mt);
+			mt_init_flags(mt, flags[f]);
+			check_bulk_load_nr(mt, i, !(i & 1), 0);
+			mtree_destroy(mt);
+		}
+		cond_resched();
+		mt_cache_shrink();
+
+		mt_init_flags(mt, flags[f]);
+		check_bulk_load_nr(mt, 100010, false, 5);
+		mtree_destroy(mt);
+		rcu_barrier();
+		mt_cache_shrink();
+	}
+	mt_init_flags(mt, MT_FLAGS_ALLOC_RANGE);
+}
+
 static noinline void __init check_bnode_min_spanning(struct maple_tree *mt)
 {
 	int i = 50;
@@ -3903,6 +3982,10 @@ static int __init maple_tree_seed(void)
 	check_dup(&tree);
 	mtree_destroy(&tree);
 
+	mt_init_flags(&tree, MT_FLAGS_ALLOC_RANGE);
+	check_bulk_load(&tree);
+	mtree_destroy(&tree);
+
 	mt_init_flags(&tree, MT_FLAGS_ALLOC_RANGE);
 	check_bnode_min_spanning(&tree);
 	mtree_destroy(&tree);
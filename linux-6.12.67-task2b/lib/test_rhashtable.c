@@ -43,6 +43,10 @@ static bool shrinking = false;
 module_param(shrinking, bool, 0);
 MODULE_PARM_DESC(shrinking, "Enable automatic shrinking (default: off)");
 
+static bool replicate = false;
+module_param(replicate, bool, 0);
+MODULE_PARM_DESC(replicate, "Replicate buckets on every NUMA node (default: off)");
+
 static int size = 8;
 module_param(size, int, 0);
 MODULE_PARM_DESC(size, "Initial size hint of table (default: 8)");
@@ -693,6 +697,7 @@ static int __init test_rht_init(void)
 	entries = min(parm_entries, MAX_ENTRIES);
 
 	test_rht_params.automatic_shrinking = shrinking;
+	test_rht_params.numa_replicate = replicate;
 	test_rht_params.max_size = max_size ? : roundup_pow_of_two(entries);
 	test_rht_params.nelem_hint = size;
 
@@ -701,8 +706,8 @@ static int __init test_rht_init(void)
 	if (!objs)
 		return -ENOMEM;
 
-	pr_info("Running rhashtable test nelem=%d, max_size=%d, shrinking=%d\n",
-		size, max_size, shrinking);
+	pr_info("Running rhashtable test nelem=%d, max_size=%d, shrinking=%d, replicate=%d\n",
+		size, max_size, shrinking, replicate);
 
 	for (i = 0; i < runs; i++) {
 		s64 time;
@@ -45,8 +45,46 @@ static void test_sort(struct kunit *test)
 		KUNIT_ASSERT_LE(test, a[i], a[i + 1]);
 }
 
+/* inputs quicksort used to do badly on */
+static void test_sort_patterns(struct kunit *test)
+{
+	int *a, i, pattern, r = 1;
+
+	a = kunit_kmalloc_array(test, TEST_LEN, sizeof(*a), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, a);
+
+	for (pattern = 0; pattern < 5; pattern++) {
+		for (i = 0; i < TEST_LEN; i++) {
+			r = (r * 725861) % 6599;
+			switch (pattern) {
+			case 0:	/* sorted */
+				a[i] = i;
+				break;
+			case 1:	/* reversed */
+				a[i] = TEST_LEN - i;
+				break;
+			case 2:	/* all equal */
+				a[i] = 42;
+				break;
+			case 3:	/* few distinct values */
+				a[i] = r % 4;
+				break;
+			case 4:	/* organ pipe */
+				a[i] = i < TEST_LEN / 2 ? i : TEST_LEN - i;
+				break;
+			}
+		}
+
+		sort(a, TEST_LEN, sizeof(*a), cmpint, NULL);
+
+		for (i = 0; i < TEST_LEN - 1; i++)
+			KUNIT_ASSERT_LE(test, a[i], a[i + 1]);
+	}
+}
+
 static struct kunit_case sort_test_cases[] = {
 	KUNIT_CASE(test_sort),
+	KUNIT_CASE(test_sort_patterns),
 	{}
 };
 
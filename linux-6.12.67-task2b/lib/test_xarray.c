@@ -1783,6 +1783,61 @@ static noinline void check_store_range(struct xarray *xa)
 	}
 }
 
+static noinline void __check_store_batch(struct xarray *xa,
+		unsigned long start, unsigned int nr, unsigned long stride)
+{
+	struct xa_batch_entry *batch;
+	unsigned long *indices;
+	unsigned int i;
+
+	batch = kmalloc_array(nr, sizeof(*batch), GFP_KERNEL);
+	indices = kmalloc_array(nr, sizeof(*indices), GFP_KERNEL);
+	XA_BUG_ON(xa, !batch || !indices);
+	for (i = 0; i < nr; i++) {
+		indices[i] = batch[i].index = start + i * stride;
+		batch[i].entry = xa_mk_index(batch[i].index);
+	}
+
+	XA_BUG_ON(xa, xa_store_batch(xa, batch, nr, GFP_KERNEL) != 0);
+	for (i = 0; i < nr; i++)
+		XA_BUG_ON(xa, xa_load(xa, indices[i]) != batch[i].entry);
+	if (stride > 1)
+		XA_BUG_ON(xa, xa_load(xa, start + 1) != NULL);
+
+	/* Overwrite the same indices with themselves as a second pass */
+	XA_BUG_ON(xa, xa_store_batch(xa, batch, nr, GFP_KERNEL) != 0);
+	xa_erase_batch(xa, indices, nr);
+	for (i = 0; i < nr; i++)
+		XA_BUG_ON(xa, xa_load(xa, indices[i]) != NULL);
+
+	kfree(indices);
+	kfree(batch);
+}
+
+static noinline void check_store_batch(struct xarray *xa)
+{
+	unsigned int nr;
+
+	XA_BUG_ON(xa, xa_store_batch(xa, NULL, 0, GFP_KERNEL) != 0);
+	XA_BUG_ON(xa, !xa_empty(xa));
+
+	for (nr = 1; nr < 200; nr++) {
+		__check_store_batch(xa, 0, nr, 1);
+		__check_store_batch(xa, 1, nr, 1);
+		__check_store_batch(xa, 60, nr, 3);
+		__check_store_batch(xa, 4095, nr, 1);
+		__check_store_batch(xa, 123456, nr, 4096);
+		__check_store_batch(xa, ULONG_MAX - nr * 7, nr, 7);
+		XA_BUG_ON(xa, !xa_empty(xa));
+	}
+
+	/* Storing into an array that is already taller than the batch */
+	xa_store(xa, 1UL << 30, xa_mk_index(1UL << 30), GFP_KERNEL);
+	__check_store_batch(xa, 5, 100, 2);
+	xa_erase(xa, 1UL << 30);
+	XA_BUG_ON(xa, !xa_empty(xa));
+}
+
 #ifdef CONFIG_XARRAY_MULTI
 static void check_split_1(struct xarray *xa, unsigned long index,
 				unsigned int order, unsigned int new_order)
@@ -2154,6 +2209,8 @@ static int xarray_checks(void)
 	check_move(&array);
 	check_create_range(&array);
 	check_store_range(&array);
+	check_store_batch(&array);
+	check_store_batch(&xa0);
 	check_store_iter(&array);
 	check_align(&xa0);
 	check_split(&array);
@@ -0,0 +1,326 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * lib/ts_ac.c		Aho-Corasick multi-pattern text search
+ *
+ * ==========================================================================
+ *
+ *   Searches for any of a set of patterns in a single pass over the
+ *   text [1]. The patterns are merged into a trie whose missing edges
+ *   are resolved through the failure links at setup time, leaving a
+ *   deterministic automaton that consumes every byte of the text with
+ *   one table lookup, independent of the number of patterns.
+ *
+ *   The input alphabet is compressed to the bytes that occur in any
+ *   pattern, all other bytes share one class, which keeps the table
+ *   at nr_states * nr_classes entries. While the automaton sits in its
+ *   root state, bytes are checked against the set of first bytes of
+ *   all patterns; that test does not depend on the previous byte, so
+ *   runs of text that cannot start a match are skipped several bytes
+ *   at a time.
+ *
+ *   Matches are reported at their end in the text, the longest pattern
+ *   ending there wins. As with the other algorithms, the search for
+ *   the next occurrence starts right behind the previous match.
+ *
+ *   [1] A. V. Aho, M. J. Corasick, "Efficient string matching: an aid
+ *       to bibliographic search", Communications of the ACM 18(6), 1975
+ */
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/ctype.h>
+#include <linux/mm.h>
+#include <linux/textsearch.h>
+#include <linux/textsearch_ac.h>
+
+struct ts_ac
+{
+	unsigned int	nr_classes;
+	unsigned int	nr_states;
+	unsigned int	nr_patterns;
+	unsigned int	pattern_len;
+	u16		class_map[256];
+	unsigned long	first[BITS_TO_LONGS(256)];
+	u16		*delta;		/* nr_states * nr_classes */
+	u16		*report;	/* pattern + 1 matched in a state, or 0 */
+	u8		*lengths;	/* length of each pattern */
+	u8		*pattern;	/* copy of the pattern set */
+};
+
+/* skip text that cannot start a match while in the root state */
+static inline unsigned int ac_skip(const struct ts_ac *ac, const u8 *text,
+				   unsigned int i, unsigned int len)
+{
+	const unsigned long *first = ac->first;
+
+	for (; i + 4 <= len; i += 4)
+		if (test_bit(text[i], first) | test_bit(text[i + 1], first) |
+		    test_bit(text[i + 2], first) | test_bit(text[i + 3], first))
+			break;
+	for (; i < len; i++)
+		if (test_bit(text[i], first))
+			break;
+	return i;
+}
+
+static unsigned int ac_find(struct ts_config *conf, struct ts_state *state)
+{
+	struct ts_ac *ac = ts_config_priv(conf);
+	unsigned int i, q = 0, text_len, consumed = state->offset;
+	const u8 *text;
+
+	for (;;) {
+		text_len = conf->get_next_block(consumed, &text, conf, state);
+
+		if (unlikely(text_len == 0))
+			break;
+
+		for (i = 0; i < text_len; i++) {
+			if (!q) {
+				i = ac_skip(ac, text, i, text_len);
+				if (i == text_len)
+					break;
+			}
+
+			q = ac->delta[q * ac->nr_classes + ac->class_map[text[i]]];
+			if (unlikely(ac->report[q])) {
+				unsigned int p = ac->report[q] - 1;
+
+				state->offset = consumed + i + 1;
+				state->pattern = p;
+				return state->offset - ac->lengths[p];
+			}
+		}
+
+		consumed += text_len;
+	}
+
+	return UINT_MAX;
+}
+
+/* count and check the records of a pattern set */
+static int ac_parse(const u8 *pattern, unsigned int len,
+		    unsigned int *nr_patterns, unsigned int *nr_bytes)
+{
+	unsigned int pos = 0, n = 0, bytes = 0;
+
+	while (pos < len) {
+		const struct ts_ac_pattern *p = (const void *)(pattern + pos);
+
+		if (!p->len || len - pos - 1 < p->len)
+			return -EINVAL;
+		pos += 1 + p->len;
+		bytes += p->len;
+		n++;
+	}
+
+	if (!n || n > TS_AC_MAX_PATTERNS || bytes >= TS_AC_MAX_STATES)
+		return -EINVAL;
+
+	*nr_patterns = n;
+	*nr_bytes = bytes;
+	return 0;
+}
+
+static inline u8 ac_fold(u8 c, int flags)
+{
+	return flags & TS_IGNORECASE ? toupper(c) : c;
+}
+
+static void ac_build_classes(struct ts_ac *ac, const u8 *pattern,
+			     unsigned int len, int flags)
+{
+	unsigned int pos, c;
+
+	/* class 0 is for bytes that do not occur in any pattern */
+	ac->nr_classes = 1;
+	for (pos = 0; pos < len; pos += 1 + pattern[pos]) {
+		unsigned int j;
+
+		for (j = 1; j <= pattern[pos]; j++) {
+			u8 b = ac_fold(pattern[pos + j], flags);
+
+			if (!ac->class_map[b])
+				ac->class_map[b] = ac->nr_classes++;
+		}
+	}
+
+	if (flags & TS_IGNORECASE)
+		for (c = 0; c < 256; c++)
+			ac->class_map[c] = ac->class_map[toupper(c)];
+}
+
+/*
+ * Build the trie in ac->delta, 0 meaning "no edge" as no edge leads back
+ * to the root, then turn it into a complete automaton in breadth-first
+ * order, where the failure state of every state is already complete.
+ */
+static int ac_build(struct ts_ac *ac, const u8 *pattern, unsigned int len,
+		    gfp_t gfp_mask, int flags)
+{
+	unsigned int nc = ac->nr_classes, pos, p, head, tail, c;
+	u16 *fail, *queue;
+
+	fail = kvmalloc_array(ac->nr_states, sizeof(*fail), gfp_mask);
+	queue = kvmalloc_array(ac->nr_states, sizeof(*queue), gfp_mask);
+	if (!fail || !queue) {
+		kvfree(queue);
+		kvfree(fail);
+		return -ENOMEM;
+	}
+
+	ac->nr_states = 1;
+	for (pos = 0, p = 0; pos < len; pos += 1 + pattern[pos], p++) {
+		unsigned int j, q = 0;
+
+		ac->lengths[p] = pattern[pos];
+		for (j = 1; j <= pattern[pos]; j++) {
+			u16 *next;
+
+			c = ac->class_map[ac_fold(pattern[pos + j], flags)];
+			next = &ac->delta[q * nc + c];
+			if (!*next)
+				*next = ac->nr_states++;
+			q = *next;
+		}
+		/* a duplicate pattern keeps reporting the first one */
+		if (!ac->report[q])
+			ac->report[q] = p + 1;
+	}
+
+	head = tail = 0;
+	for (c = 0; c < nc; c++) {
+		u16 t = ac->delta[c];
+
+		if (t) {
+			fail[t] = 0;
+			queue[tail++] = t;
+		}
+	}
+
+	while (head < tail) {
+		unsigned int q = queue[head++];
+
+		if (!ac->report[q])
+			ac->report[q] = ac->report[fail[q]];
+
+		for (c = 0; c < nc; c++) {
+			u16 *t = &ac->delta[q * nc + c];
+			u16 f = ac->delta[fail[q] * nc + c];
+
+			if (*t) {
+				fail[*t] = f;
+				queue[tail++] = *t;
+			} else {
+				*t = f;
+			}
+		}
+	}
+
+	for (c = 0; c < 256; c++)
+		if (ac->delta[ac->class_map[c]])
+			__set_bit(c, ac->first);
+
+	kvfree(queue);
+	kvfree(fail);
+	return 0;
+}
+
+static void ac_free(struct ts_ac *ac)
+{
+	kvfree(ac->delta);
+	kvfree(ac->report);
+}
+
+static struct ts_config *ac_init(const void *pattern, unsigned int len,
+				 gfp_t gfp_mask, int flags)
+{
+	unsigned int nr_patterns, nr_bytes;
+	struct ts_config *conf;
+	struct ts_ac *ac;
+	size_t priv_size;
+	int err;
+
+	err = ac_parse(pattern, len, &nr_patterns, &nr_bytes);
+	if (err)
+		return ERR_PTR(err);
+
+	priv_size = sizeof(*ac) + nr_patterns + len;
+	conf = alloc_ts_config(priv_size, gfp_mask);
+	if (IS_ERR(conf))
+		return conf;
+
+	conf->flags = flags;
+	ac = ts_config_priv(conf);
+	ac->nr_patterns = nr_patterns;
+	ac->pattern_len = len;
+	ac->lengths = (u8 *)(ac + 1);
+	ac->pattern = ac->lengths + nr_patterns;
+	memcpy(ac->pattern, pattern, len);
+
+	ac_build_classes(ac, ac->pattern, len, flags);
+
+	ac->nr_states = nr_bytes + 1;
+	ac->delta = kvcalloc(array_size(ac->nr_states, ac->nr_classes),
+			     sizeof(*ac->delta), gfp_mask);
+	ac->report = kvcalloc(ac->nr_states, sizeof(*ac->report), gfp_mask);
+	err = -ENOMEM;
+	if (!ac->delta || !ac->report)
+		goto errout;
+
+	err = ac_build(ac, ac->pattern, len, gfp_mask, flags);
+	if (err)
+		goto errout;
+
+	return conf;
+
+errout:
+	ac_free(ac);
+	kfree(conf);
+	return ERR_PTR(err);
+}
+
+static void ac_destroy(struct ts_config *conf)
+{
+	ac_free(ts_config_priv(conf));
+}
+
+static void *ac_get_pattern(struct ts_config *conf)
+{
+	struct ts_ac *ac = ts_config_priv(conf);
+	return ac->pattern;
+}
+
+static unsigned int ac_get_pattern_len(struct ts_config *conf)
+{
+	struct ts_ac *ac = ts_config_priv(conf);
+	return ac->pattern_len;
+}
+
+static struct ts_ops ac_ops = {
+	.name		  = "ac",
+	.find		  = ac_find,
+	.init		  = ac_init,
+	.destroy	  = ac_destroy,
+	.get_pattern	  = ac_get_pattern,
+	.get_pattern_len  = ac_get_pattern_len,
+	.owner		  = THIS_MODULE,
+	.list		  = LIST_HEAD_INIT(ac_ops.list)
+};
+
+static int __init init_ac(void)
+{
+	return textsearch_register(&ac_ops);
+}
+
+static void __exit exit_ac(void)
+{
+	textsearch_unregister(&ac_ops);
+}
+
+MODULE_DESCRIPTION("Aho-Corasick multi-pattern text search implementation");
+MODULE_LICENSE("GPL");
+
+module_init(init_ac);
+module_exit(exit_ac);
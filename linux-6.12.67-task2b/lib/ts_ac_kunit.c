@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Test cases for the Aho-Corasick textsearch algorithm, lib/ts_ac.c.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <kunit/test.h>
+#include <linux/err.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/textsearch.h>
+#include <linux/textsearch_ac.h>
+
+/* "he", "she", "his", "hers" as an "ac" pattern set */
+static const u8 ac_set[] = "\x02he\x03she\x03his\x04hers";
+#define AC_SET_LEN	(sizeof(ac_set) - 1)
+
+static struct ts_config *ts_ac_prepare(struct kunit *test, const void *set,
+				       unsigned int len, int flags)
+{
+	struct ts_config *conf;
+
+	conf = textsearch_prepare("ac", set, len, GFP_KERNEL,
+				  flags | TS_AUTOLOAD);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, conf);
+	return conf;
+}
+
+static void ts_ac_test_find(struct kunit *test)
+{
+	static const char text[] = "ushers his hex";
+	struct ts_config *conf;
+	struct ts_state state;
+
+	conf = ts_ac_prepare(test, ac_set, AC_SET_LEN, 0);
+
+	/* the longest pattern ending at a given byte wins */
+	KUNIT_EXPECT_EQ(test, textsearch_find_continuous(conf, &state, text,
+							 strlen(text)), 1);
+	KUNIT_EXPECT_EQ(test, state.pattern, 1);
+	/* the search goes on behind the match, "hers" overlaps it */
+	KUNIT_EXPECT_EQ(test, textsearch_next(conf, &state), 7);
+	KUNIT_EXPECT_EQ(test, state.pattern, 2);
+	KUNIT_EXPECT_EQ(test, textsearch_next(conf, &state), 11);
+	KUNIT_EXPECT_EQ(test, state.pattern, 0);
+	KUNIT_EXPECT_EQ(test, textsearch_next(conf, &state), UINT_MAX);
+
+	KUNIT_EXPECT_EQ(test, textsearch_find_continuous(conf, &state, "SHE", 3),
+			UINT_MAX);
+
+	textsearch_destroy(conf);
+}
+
+static void ts_ac_test_ignorecase(struct kunit *test)
+{
+	struct ts_config *conf;
+	struct ts_state state;
+
+	conf = ts_ac_prepare(test, ac_set, AC_SET_LEN, TS_IGNORECASE);
+
+	KUNIT_EXPECT_EQ(test, textsearch_find_continuous(conf, &state, "xSHE", 4),
+			1);
+	KUNIT_EXPECT_EQ(test, state.pattern, 1);
+	KUNIT_EXPECT_EQ(test, textsearch_find_continuous(conf, &state, "hIs", 3),
+			0);
+	KUNIT_EXPECT_EQ(test, state.pattern, 2);
+
+	textsearch_destroy(conf);
+}
+
+static void ts_ac_test_invalid(struct kunit *test)
+{
+	static const u8 empty_record[] = "\x02he\x00";
+	static const u8 short_record[] = "\x02he\x05she";
+	struct ts_config *conf;
+
+	conf = textsearch_prepare("ac", ac_set, 0, GFP_KERNEL, TS_AUTOLOAD);
+	KUNIT_EXPECT_EQ(test, PTR_ERR_OR_ZERO(conf), -EINVAL);
+	conf = textsearch_prepare("ac", empty_record, sizeof(empty_record) - 1,
+				  GFP_KERNEL, TS_AUTOLOAD);
+	KUNIT_EXPECT_EQ(test, PTR_ERR_OR_ZERO(conf), -EINVAL);
+	conf = textsearch_prepare("ac", short_record, sizeof(short_record) - 1,
+				  GFP_KERNEL, TS_AUTOLOAD);
+	KUNIT_EXPECT_EQ(test, PTR_ERR_OR_ZERO(conf), -EINVAL);
+}
+
+struct ts_ac_chunks {
+	const u8	*data;
+	unsigned int	len;
+	unsigned int	chunk;
+};
+
+/* hand out the text a few bytes at a time, like skb fragments */
+static unsigned int ts_ac_next_chunk(unsigned int consumed, const u8 **dst,
+				     struct ts_config *conf,
+				     struct ts_state *state)
+{
+	struct ts_ac_chunks *c = (struct ts_ac_chunks *)state->cb;
+
+	if (consumed >= c->len)
+		return 0;
+	*dst = c->data + consumed;
+	return min(c->chunk, c->len - consumed);
+}
+
+static void ts_ac_test_blocks(struct kunit *test)
+{
+	static const char text[] = "xxxxxxxhisxxshe";
+	struct ts_ac_chunks *c;
+	struct ts_config *conf;
+	struct ts_state state;
+	unsigned int chunk;
+
+	BUILD_BUG_ON(sizeof(*c) > sizeof(state.cb));
+	conf = ts_ac_prepare(test, ac_set, AC_SET_LEN, 0);
+	conf->get_next_block = ts_ac_next_chunk;
+
+	for (chunk = 1; chunk <= strlen(text); chunk++) {
+		memset(&state, 0, sizeof(state));
+		c = (struct ts_ac_chunks *)state.cb;
+		c->data = text;
+		c->len = strlen(text);
+		c->chunk = chunk;
+
+		KUNIT_EXPECT_EQ_MSG(test, textsearch_find(conf, &state), 7,
+				    "chunk:%u", chunk);
+		KUNIT_EXPECT_EQ(test, state.pattern, 2);
+		KUNIT_EXPECT_EQ_MSG(test, textsearch_next(conf, &state), 12,
+				    "chunk:%u", chunk);
+		KUNIT_EXPECT_EQ(test, state.pattern, 1);
+		KUNIT_EXPECT_EQ(test, textsearch_next(conf, &state), UINT_MAX);
+	}
+
+	textsearch_destroy(conf);
+}
+
+static struct kunit_case ts_ac_test_cases[] = {
+	KUNIT_CASE(ts_ac_test_find),
+	KUNIT_CASE(ts_ac_test_ignorecase),
+	KUNIT_CASE(ts_ac_test_invalid),
+	KUNIT_CASE(ts_ac_test_blocks),
+	{}
+};
+
+static struct kunit_suite ts_ac_test_suite = {
+	.name = "ts_ac",
+	.test_cases = ts_ac_test_cases,
+};
+
+kunit_test_suites(&ts_ac_test_suite);
+
+MODULE_DESCRIPTION("Test cases for the Aho-Corasick textsearch algorithm");
+MODULE_LICENSE("GPL");
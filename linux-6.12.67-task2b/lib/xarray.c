@@ -366,7 +366,8 @@ static void *xas_alloc(struct xa_state *xas, unsigned int shift)
 		return NULL;
 
 	if (node) {
-		xas->xa_alloc = NULL;
+		/* Preallocated nodes are chained through their parent */
+		xas->xa_alloc = rcu_dereference_raw(node->parent);
 	} else {
 		gfp_t gfp = GFP_NOWAIT | __GFP_NOWARN;
 
@@ -1600,6 +1601,156 @@ void *xa_store(struct xarray *xa, unsigned long index, void *entry, gfp_t gfp)
 }
 EXPORT_SYMBOL(xa_store);
 
+static unsigned long xa_batch_chunk(unsigned long index, unsigned int shift)
+{
+	shift += XA_CHUNK_SHIFT;
+	return shift < BITS_PER_LONG ? index >> shift : 0;
+}
+
+/*
+ * The number of nodes needed to store @batch into an empty array: one for
+ * each distinct chunk of indices on every level.  This is an upper bound
+ * when the array already has entries, unless it is taller than @batch needs.
+ */
+static unsigned long xa_batch_nodes(const struct xa_batch_entry *batch,
+		unsigned int nr)
+{
+	unsigned long count = 0;
+	unsigned int shift, i;
+
+	if (!batch[nr - 1].index)
+		return 0;
+
+	for (shift = 0; shift < BITS_PER_LONG; shift += XA_CHUNK_SHIFT) {
+		for (i = 0; i < nr; i++) {
+			if (!i || xa_batch_chunk(batch[i].index, shift) !=
+				  xa_batch_chunk(batch[i - 1].index, shift))
+				count++;
+		}
+		if (!xa_batch_chunk(batch[nr - 1].index, shift))
+			break;
+	}
+
+	return count;
+}
+
+/**
+ * xa_store_batch() - Store many entries in the XArray.
+ * @xa: XArray.
+ * @batch: Entries to store, sorted by index.
+ * @nr: Number of entries in @batch.
+ * @gfp: Memory allocation flags.
+ *
+ * Stores each entry of @batch as xa_store() would, but allocates the nodes
+ * for all of them before taking the xa_lock and then stores them all in one
+ * lock hold.  Consecutive indices are stored without walking the tree from
+ * the top again.  Should the preallocated nodes run out, the lock is dropped
+ * to allocate more if the @gfp flags permit.  The old entries are not
+ * returned.
+ *
+ * If an error occurs, the entries before the failing one have been stored.
+ *
+ * Context: Any context.  Takes and releases the xa_lock.
+ * May sleep if the @gfp flags permit.
+ * Return: 0 on success, -EINVAL if an entry cannot be stored in an XArray,
+ * or -ENOMEM if memory allocation failed.
+ */
+int xa_store_batch(struct xarray *xa, const struct xa_batch_entry *batch,
+		unsigned int nr, gfp_t gfp)
+{
+	XA_STATE(xas, xa, 0);
+	unsigned long count;
+	void *prev = NULL;
+	unsigned int i;
+	int err = 0;
+
+	if (!nr)
+		return 0;
+
+	count = xa_batch_nodes(batch, nr);
+	if (count) {
+		gfp_t node_gfp = gfp | __GFP_NOWARN;
+
+		if (xa->xa_flags & XA_FLAGS_ACCOUNT)
+			node_gfp |= __GFP_ACCOUNT;
+		/* Whatever cannot be allocated now is allocated on demand */
+		while (count--) {
+			struct xa_node *node;
+
+			node = kmem_cache_alloc_lru(radix_tree_node_cachep,
+						    NULL, node_gfp);
+			if (!node)
+				break;
+			XA_NODE_BUG_ON(node, !list_empty(&node->private_list));
+			RCU_INIT_POINTER(node->parent, xas.xa_alloc);
+			xas.xa_alloc = node;
+		}
+	}
+
+	xa_lock(xa);
+	for (i = 0; i < nr; i++) {
+		void *entry = batch[i].entry;
+
+		if (WARN_ON_ONCE(xa_is_advanced(entry))) {
+			err = -EINVAL;
+			break;
+		}
+		if (xa_track_free(xa) && !entry)
+			entry = XA_ZERO_ENTRY;
+
+		/* Storing NULL may have freed the node we were in */
+		if (prev && batch[i].index == xas.xa_index + 1)
+			xas_next(&xas);
+		else
+			xas_set(&xas, batch[i].index);
+
+		for (;;) {
+			xas_store(&xas, entry);
+			if (xa_track_free(xa))
+				xas_clear_mark(&xas, XA_FREE_MARK);
+			if (!xas_error(&xas))
+				break;
+			/* The preallocated nodes are used up by now */
+			if (!__xas_nomem(&xas, gfp))
+				break;
+		}
+		err = xas_error(&xas);
+		if (err)
+			break;
+		prev = entry;
+	}
+	xa_unlock(xa);
+
+	xas_destroy(&xas);
+	return err;
+}
+EXPORT_SYMBOL(xa_store_batch);
+
+/**
+ * xa_erase_batch() - Erase many entries from the XArray.
+ * @xa: XArray.
+ * @indices: Indices to erase.
+ * @nr: Number of entries in @indices.
+ *
+ * Erases each index of @indices as xa_erase() would, in one lock hold.
+ *
+ * Context: Any context.  Takes and releases the xa_lock.
+ */
+void xa_erase_batch(struct xarray *xa, const unsigned long *indices,
+		unsigned int nr)
+{
+	XA_STATE(xas, xa, 0);
+	unsigned int i;
+
+	xa_lock(xa);
+	for (i = 0; i < nr; i++) {
+		xas_set(&xas, indices[i]);
+		xas_store(&xas, NULL);
+	}
+	xa_unlock(xa);
+}
+EXPORT_SYMBOL(xa_erase_batch);
+
 /**
  * __xa_cmpxchg() - Store this entry in the XArray.
  * @xa: XArray.
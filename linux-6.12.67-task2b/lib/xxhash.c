@@ -44,8 +44,14 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/string.h>
+#include <linux/swab.h>
 #include <linux/xxhash.h>
 
+#ifdef CONFIG_X86_64
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#endif
+
 /*-*************************************
  * Macros
  **************************************/
@@ -496,5 +502,579 @@ uint64_t xxh64_digest(const struct xxh64_state *state)
 }
 EXPORT_SYMBOL(xxh64_digest);
 
+/*-**************************
+ * XXH3
+ ***************************/
+#define XXH3_SECRET_SIZE		192
+#define XXH3_SECRET_SIZE_MIN		136
+#define XXH3_MIDSIZE_MAX		240
+#define XXH3_MIDSIZE_STARTOFFSET	3
+#define XXH3_MIDSIZE_LASTOFFSET		17
+#define XXH3_STRIPE_LEN			64
+#define XXH3_SECRET_CONSUME_RATE	8
+#define XXH3_ACC_NB			(XXH3_STRIPE_LEN / sizeof(uint64_t))
+#define XXH3_STRIPES_PER_BLOCK \
+	((XXH3_SECRET_SIZE - XXH3_STRIPE_LEN) / XXH3_SECRET_CONSUME_RATE)
+#define XXH3_BLOCK_LEN			(XXH3_STRIPE_LEN * XXH3_STRIPES_PER_BLOCK)
+#define XXH3_SECRET_LASTACC_START	7
+#define XXH3_SECRET_MERGEACCS_START	11
+
+static const uint8_t xxh3_secret[XXH3_SECRET_SIZE] __aligned(64) = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+	0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+	0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+	0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+	0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+	0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+	0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+	0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+	0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+	0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+	0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+	0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+	0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static const uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+static const uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+static struct xxh128_hash xxh_mult64to128(uint64_t lhs, uint64_t rhs)
+{
+	struct xxh128_hash r;
+#if defined(CONFIG_ARCH_SUPPORTS_INT128) && defined(__SIZEOF_INT128__)
+	unsigned __int128 product = (unsigned __int128)lhs * rhs;
+
+	r.low64 = (uint64_t)product;
+	r.high64 = (uint64_t)(product >> 64);
+#else
+	uint64_t lo_lo = (uint64_t)(uint32_t)lhs * (uint32_t)rhs;
+	uint64_t hi_lo = (lhs >> 32) * (uint32_t)rhs;
+	uint64_t lo_hi = (uint64_t)(uint32_t)lhs * (rhs >> 32);
+	uint64_t hi_hi = (lhs >> 32) * (rhs >> 32);
+	uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+
+	r.low64 = (cross << 32) | (uint32_t)lo_lo;
+	r.high64 = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+#endif
+	return r;
+}
+
+static uint64_t xxh3_mul128_fold64(uint64_t lhs, uint64_t rhs)
+{
+	struct xxh128_hash product = xxh_mult64to128(lhs, rhs);
+
+	return product.low64 ^ product.high64;
+}
+
+static uint64_t xxh64_avalanche(uint64_t h64)
+{
+	h64 ^= h64 >> 33;
+	h64 *= PRIME64_2;
+	h64 ^= h64 >> 29;
+	h64 *= PRIME64_3;
+	h64 ^= h64 >> 32;
+	return h64;
+}
+
+static uint64_t xxh3_avalanche(uint64_t h64)
+{
+	h64 ^= h64 >> 37;
+	h64 *= PRIME_MX1;
+	h64 ^= h64 >> 32;
+	return h64;
+}
+
+static uint64_t xxh3_rrmxmx(uint64_t h64, uint64_t len)
+{
+	h64 ^= xxh_rotl64(h64, 49) ^ xxh_rotl64(h64, 24);
+	h64 *= PRIME_MX2;
+	h64 ^= (h64 >> 35) + len;
+	h64 *= PRIME_MX2;
+	return h64 ^ (h64 >> 28);
+}
+
+static uint64_t xxh3_len_1to3_64(const uint8_t *p, size_t len,
+				 const uint8_t *secret, uint64_t seed)
+{
+	const uint32_t combined = ((uint32_t)p[0] << 16) |
+		((uint32_t)p[len >> 1] << 24) | p[len - 1] | ((uint32_t)len << 8);
+	const uint64_t bitflip = (get_unaligned_le32(secret) ^
+				  get_unaligned_le32(secret + 4)) + seed;
+
+	return xxh64_avalanche(combined ^ bitflip);
+}
+
+static uint64_t xxh3_len_4to8_64(const uint8_t *p, size_t len,
+				 const uint8_t *secret, uint64_t seed)
+{
+	uint64_t bitflip, input64;
+
+	seed ^= (uint64_t)swab32((uint32_t)seed) << 32;
+	bitflip = (get_unaligned_le64(secret + 8) ^
+		   get_unaligned_le64(secret + 16)) - seed;
+	input64 = get_unaligned_le32(p + len - 4) +
+		((uint64_t)get_unaligned_le32(p) << 32);
+
+	return xxh3_rrmxmx(input64 ^ bitflip, len);
+}
+
+static uint64_t xxh3_len_9to16_64(const uint8_t *p, size_t len,
+				  const uint8_t *secret, uint64_t seed)
+{
+	const uint64_t bitflip1 = (get_unaligned_le64(secret + 24) ^
+				   get_unaligned_le64(secret + 32)) + seed;
+	const uint64_t bitflip2 = (get_unaligned_le64(secret + 40) ^
+				   get_unaligned_le64(secret + 48)) - seed;
+	const uint64_t input_lo = get_unaligned_le64(p) ^ bitflip1;
+	const uint64_t input_hi = get_unaligned_le64(p + len - 8) ^ bitflip2;
+
+	return xxh3_avalanche(len + swab64(input_lo) + input_hi +
+			      xxh3_mul128_fold64(input_lo, input_hi));
+}
+
+static uint64_t xxh3_len_0to16_64(const uint8_t *p, size_t len,
+				  const uint8_t *secret, uint64_t seed)
+{
+	if (len > 8)
+		return xxh3_len_9to16_64(p, len, secret, seed);
+	if (len >= 4)
+		return xxh3_len_4to8_64(p, len, secret, seed);
+	if (len)
+		return xxh3_len_1to3_64(p, len, secret, seed);
+	return xxh64_avalanche(seed ^ get_unaligned_le64(secret + 56) ^
+			       get_unaligned_le64(secret + 64));
+}
+
+static uint64_t xxh3_mix16(const uint8_t *p, const uint8_t *secret,
+			   uint64_t seed)
+{
+	return xxh3_mul128_fold64(
+		get_unaligned_le64(p) ^ (get_unaligned_le64(secret) + seed),
+		get_unaligned_le64(p + 8) ^ (get_unaligned_le64(secret + 8) - seed));
+}
+
+static uint64_t xxh3_len_17to128_64(const uint8_t *p, size_t len,
+				    const uint8_t *secret, uint64_t seed)
+{
+	uint64_t acc = len * PRIME64_1;
+	unsigned int i = (len - 1) / 32;
+
+	do {
+		acc += xxh3_mix16(p + 16 * i, secret + 32 * i, seed);
+		acc += xxh3_mix16(p + len - 16 * (i + 1), secret + 32 * i + 16,
+				  seed);
+	} while (i-- != 0);
+
+	return xxh3_avalanche(acc);
+}
+
+static uint64_t xxh3_len_129to240_64(const uint8_t *p, size_t len,
+				     const uint8_t *secret, uint64_t seed)
+{
+	const unsigned int nb_rounds = len / 16;
+	uint64_t acc = len * PRIME64_1;
+	uint64_t acc_end;
+	unsigned int i;
+
+	for (i = 0; i < 8; i++)
+		acc += xxh3_mix16(p + 16 * i, secret + 16 * i, seed);
+	acc_end = xxh3_mix16(p + len - 16, secret + XXH3_SECRET_SIZE_MIN -
+			     XXH3_MIDSIZE_LASTOFFSET, seed);
+	acc = xxh3_avalanche(acc);
+
+	for (i = 8; i < nb_rounds; i++)
+		acc_end += xxh3_mix16(p + 16 * i, secret + 16 * (i - 8) +
+				      XXH3_MIDSIZE_STARTOFFSET, seed);
+
+	return xxh3_avalanche(acc + acc_end);
+}
+
+static void xxh3_accumulate_512(uint64_t *acc, const uint8_t *p,
+				const uint8_t *secret)
+{
+	size_t i;
+
+	for (i = 0; i < XXH3_ACC_NB; i++) {
+		const uint64_t data_val = get_unaligned_le64(p + 8 * i);
+		const uint64_t data_key = data_val ^
+			get_unaligned_le64(secret + 8 * i);
+
+		acc[i ^ 1] += data_val;
+		acc[i] += (uint64_t)(uint32_t)data_key * (data_key >> 32);
+	}
+}
+
+static void xxh3_accumulate(uint64_t *acc, const uint8_t *p,
+			    const uint8_t *secret, size_t nb_stripes)
+{
+	size_t n;
+
+	for (n = 0; n < nb_stripes; n++)
+		xxh3_accumulate_512(acc, p + n * XXH3_STRIPE_LEN,
+				    secret + n * XXH3_SECRET_CONSUME_RATE);
+}
+
+static void xxh3_scramble(uint64_t *acc, const uint8_t *secret)
+{
+	size_t i;
+
+	for (i = 0; i < XXH3_ACC_NB; i++) {
+		uint64_t acc64 = acc[i];
+
+		acc64 ^= acc64 >> 47;
+		acc64 ^= get_unaligned_le64(secret + 8 * i);
+		acc64 *= PRIME32_1;
+		acc[i] = acc64;
+	}
+}
+
+/*
+ * The long input loop, instantiated once per implementation of the stripe
+ * accumulation and scrambling so that those calls stay direct.
+ */
+static __always_inline void __xxh3_hash_long(uint64_t *acc, const uint8_t *p,
+		size_t len, const uint8_t *secret,
+		void (*accumulate)(uint64_t *, const uint8_t *,
+				   const uint8_t *, size_t),
+		void (*scramble)(uint64_t *, const uint8_t *))
+{
+	const size_t nb_blocks = (len - 1) / XXH3_BLOCK_LEN;
+	size_t n, nb_stripes;
+
+	for (n = 0; n < nb_blocks; n++) {
+		accumulate(acc, p + n * XXH3_BLOCK_LEN, secret,
+			   XXH3_STRIPES_PER_BLOCK);
+		scramble(acc, secret + XXH3_SECRET_SIZE - XXH3_STRIPE_LEN);
+	}
+
+	/* last partial block, then the last stripe which may overlap it */
+	nb_stripes = ((len - 1) - XXH3_BLOCK_LEN * nb_blocks) / XXH3_STRIPE_LEN;
+	accumulate(acc, p + nb_blocks * XXH3_BLOCK_LEN, secret, nb_stripes);
+	accumulate(acc, p + len - XXH3_STRIPE_LEN, secret + XXH3_SECRET_SIZE -
+		   XXH3_STRIPE_LEN - XXH3_SECRET_LASTACC_START, 1);
+}
+
+#ifdef CONFIG_X86_64
+/*
+ * SSE2 and AVX2 versions of xxh3_accumulate() and xxh3_scramble(), see
+ * arch/x86/lib/xxh3_64.S. Below XXH3_SIMD_MIN bytes saving the FPU state
+ * costs more than the vector loop gains.
+ */
+#define XXH3_SIMD_MIN		1024
+/* blocks hashed per kernel_fpu_begin() section */
+#define XXH3_SIMD_BLOCKS	4
+
+asmlinkage void xxh3_accumulate_sse2(uint64_t *acc, const uint8_t *p,
+				     const uint8_t *secret, size_t nb_stripes);
+asmlinkage void xxh3_scramble_sse2(uint64_t *acc, const uint8_t *secret);
+asmlinkage void xxh3_accumulate_avx2(uint64_t *acc, const uint8_t *p,
+				     const uint8_t *secret, size_t nb_stripes);
+asmlinkage void xxh3_scramble_avx2(uint64_t *acc, const uint8_t *secret);
+
+static void xxh3_hash_long(uint64_t *acc, const uint8_t *p, size_t len,
+			   const uint8_t *secret)
+{
+	size_t n;
+
+	if (len < XXH3_SIMD_MIN || !irq_fpu_usable()) {
+		__xxh3_hash_long(acc, p, len, secret, xxh3_accumulate,
+				 xxh3_scramble);
+		return;
+	}
+
+	/*
+	 * Hash whole blocks a few at a time so preemption is not held off
+	 * for the entire buffer; the tail always fits one section.
+	 */
+	while (len > (XXH3_SIMD_BLOCKS + 1) * XXH3_BLOCK_LEN) {
+		kernel_fpu_begin();
+		for (n = 0; n < XXH3_SIMD_BLOCKS; n++) {
+			if (boot_cpu_has(X86_FEATURE_AVX2)) {
+				xxh3_accumulate_avx2(acc, p, secret,
+						     XXH3_STRIPES_PER_BLOCK);
+				xxh3_scramble_avx2(acc, secret + XXH3_SECRET_SIZE -
+						   XXH3_STRIPE_LEN);
+			} else {
+				xxh3_accumulate_sse2(acc, p, secret,
+						     XXH3_STRIPES_PER_BLOCK);
+				xxh3_scramble_sse2(acc, secret + XXH3_SECRET_SIZE -
+						   XXH3_STRIPE_LEN);
+			}
+			p += XXH3_BLOCK_LEN;
+			len -= XXH3_BLOCK_LEN;
+		}
+		kernel_fpu_end();
+	}
+
+	kernel_fpu_begin();
+	if (boot_cpu_has(X86_FEATURE_AVX2))
+		__xxh3_hash_long(acc, p, len, secret, xxh3_accumulate_avx2,
+				 xxh3_scramble_avx2);
+	else
+		__xxh3_hash_long(acc, p, len, secret, xxh3_accumulate_sse2,
+				 xxh3_scramble_sse2);
+	kernel_fpu_end();
+}
+#else
+static void xxh3_hash_long(uint64_t *acc, const uint8_t *p, size_t len,
+			   const uint8_t *secret)
+{
+	__xxh3_hash_long(acc, p, len, secret, xxh3_accumulate, xxh3_scramble);
+}
+#endif
+
+static uint64_t xxh3_merge_accs(const uint64_t *acc, const uint8_t *secret,
+				uint64_t start)
+{
+	uint64_t result64 = start;
+	size_t i;
+
+	for (i = 0; i < 4; i++)
+		result64 += xxh3_mul128_fold64(
+			acc[2 * i] ^ get_unaligned_le64(secret + 16 * i),
+			acc[2 * i + 1] ^ get_unaligned_le64(secret + 16 * i + 8));
+
+	return xxh3_avalanche(result64);
+}
+
+#define XXH3_INIT_ACC { PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, \
+			PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1 }
+
+/* the secret used instead of xxh3_secret for a non-zero seed on long input */
+static void xxh3_init_secret(uint8_t *secret, uint64_t seed)
+{
+	size_t i;
+
+	for (i = 0; i < XXH3_SECRET_SIZE; i += 16) {
+		put_unaligned_le64(get_unaligned_le64(xxh3_secret + i) + seed,
+				   secret + i);
+		put_unaligned_le64(get_unaligned_le64(xxh3_secret + i + 8) - seed,
+				   secret + i + 8);
+	}
+}
+
+static noinline uint64_t xxh3_hash_long_64(const uint8_t *p, size_t len,
+					   uint64_t seed)
+{
+	uint64_t acc[XXH3_ACC_NB] __aligned(16) = XXH3_INIT_ACC;
+	uint8_t custom[XXH3_SECRET_SIZE] __aligned(16);
+	const uint8_t *secret = xxh3_secret;
+
+	if (seed) {
+		xxh3_init_secret(custom, seed);
+		secret = custom;
+	}
+
+	xxh3_hash_long(acc, p, len, secret);
+	return xxh3_merge_accs(acc, secret + XXH3_SECRET_MERGEACCS_START,
+			       len * PRIME64_1);
+}
+
+uint64_t xxh3_64(const void *input, const size_t len, const uint64_t seed)
+{
+	const uint8_t *p = (const uint8_t *)input;
+
+	if (len <= 16)
+		return xxh3_len_0to16_64(p, len, xxh3_secret, seed);
+	if (len <= 128)
+		return xxh3_len_17to128_64(p, len, xxh3_secret, seed);
+	if (len <= XXH3_MIDSIZE_MAX)
+		return xxh3_len_129to240_64(p, len, xxh3_secret, seed);
+	return xxh3_hash_long_64(p, len, seed);
+}
+EXPORT_SYMBOL(xxh3_64);
+
+static struct xxh128_hash xxh3_len_1to3_128(const uint8_t *p, size_t len,
+					    const uint8_t *secret,
+					    uint64_t seed)
+{
+	const uint32_t combinedl = ((uint32_t)p[0] << 16) |
+		((uint32_t)p[len >> 1] << 24) | p[len - 1] | ((uint32_t)len << 8);
+	const uint32_t combinedh = xxh_rotl32(swab32(combinedl), 13);
+	const uint64_t bitflipl = (get_unaligned_le32(secret) ^
+				   get_unaligned_le32(secret + 4)) + seed;
+	const uint64_t bitfliph = (get_unaligned_le32(secret + 8) ^
+				   get_unaligned_le32(secret + 12)) - seed;
+	struct xxh128_hash h128;
+
+	h128.low64 = xxh64_avalanche(combinedl ^ bitflipl);
+	h128.high64 = xxh64_avalanche(combinedh ^ bitfliph);
+	return h128;
+}
+
+static struct xxh128_hash xxh3_len_4to8_128(const uint8_t *p, size_t len,
+					    const uint8_t *secret,
+					    uint64_t seed)
+{
+	uint64_t input64, bitflip;
+	struct xxh128_hash m128;
+
+	seed ^= (uint64_t)swab32((uint32_t)seed) << 32;
+	input64 = get_unaligned_le32(p) +
+		((uint64_t)get_unaligned_le32(p + len - 4) << 32);
+	bitflip = (get_unaligned_le64(secret + 16) ^
+		   get_unaligned_le64(secret + 24)) + seed;
+
+	/* shift len to the left to ensure it is even, this avoids even multiplies */
+	m128 = xxh_mult64to128(input64 ^ bitflip, PRIME64_1 + (len << 2));
+	m128.high64 += m128.low64 << 1;
+	m128.low64 ^= m128.high64 >> 3;
+	m128.low64 ^= m128.low64 >> 35;
+	m128.low64 *= PRIME_MX2;
+	m128.low64 ^= m128.low64 >> 28;
+	m128.high64 = xxh3_avalanche(m128.high64);
+	return m128;
+}
+
+static struct xxh128_hash xxh3_len_9to16_128(const uint8_t *p, size_t len,
+					     const uint8_t *secret,
+					     uint64_t seed)
+{
+	const uint64_t bitflipl = (get_unaligned_le64(secret + 32) ^
+				   get_unaligned_le64(secret + 40)) - seed;
+	const uint64_t bitfliph = (get_unaligned_le64(secret + 48) ^
+				   get_unaligned_le64(secret + 56)) + seed;
+	const uint64_t input_lo = get_unaligned_le64(p);
+	uint64_t input_hi = get_unaligned_le64(p + len - 8);
+	struct xxh128_hash m128, h128;
+
+	m128 = xxh_mult64to128(input_lo ^ input_hi ^ bitflipl, PRIME64_1);
+	m128.low64 += (uint64_t)(len - 1) << 54;
+	input_hi ^= bitfliph;
+	m128.high64 += input_hi + (uint64_t)(uint32_t)input_hi * (PRIME32_2 - 1);
+	m128.low64 ^= swab64(m128.high64);
+
+	h128 = xxh_mult64to128(m128.low64, PRIME64_2);
+	h128.high64 += m128.high64 * PRIME64_2;
+	h128.low64 = xxh3_avalanche(h128.low64);
+	h128.high64 = xxh3_avalanche(h128.high64);
+	return h128;
+}
+
+static struct xxh128_hash xxh3_len_0to16_128(const uint8_t *p, size_t len,
+					     const uint8_t *secret,
+					     uint64_t seed)
+{
+	struct xxh128_hash h128;
+
+	if (len > 8)
+		return xxh3_len_9to16_128(p, len, secret, seed);
+	if (len >= 4)
+		return xxh3_len_4to8_128(p, len, secret, seed);
+	if (len)
+		return xxh3_len_1to3_128(p, len, secret, seed);
+
+	h128.low64 = xxh64_avalanche(seed ^ get_unaligned_le64(secret + 64) ^
+				     get_unaligned_le64(secret + 72));
+	h128.high64 = xxh64_avalanche(seed ^ get_unaligned_le64(secret + 80) ^
+				      get_unaligned_le64(secret + 88));
+	return h128;
+}
+
+static struct xxh128_hash xxh3_mix32(struct xxh128_hash acc,
+				     const uint8_t *p1, const uint8_t *p2,
+				     const uint8_t *secret, uint64_t seed)
+{
+	acc.low64 += xxh3_mix16(p1, secret, seed);
+	acc.low64 ^= get_unaligned_le64(p2) + get_unaligned_le64(p2 + 8);
+	acc.high64 += xxh3_mix16(p2, secret + 16, seed);
+	acc.high64 ^= get_unaligned_le64(p1) + get_unaligned_le64(p1 + 8);
+	return acc;
+}
+
+static struct xxh128_hash xxh3_finalize_mid_128(struct xxh128_hash acc,
+						size_t len, uint64_t seed)
+{
+	struct xxh128_hash h128;
+
+	h128.low64 = xxh3_avalanche(acc.low64 + acc.high64);
+	h128.high64 = 0 - xxh3_avalanche(acc.low64 * PRIME64_1 +
+					 acc.high64 * PRIME64_4 +
+					 (len - seed) * PRIME64_2);
+	return h128;
+}
+
+static struct xxh128_hash xxh3_len_17to128_128(const uint8_t *p, size_t len,
+					       const uint8_t *secret,
+					       uint64_t seed)
+{
+	struct xxh128_hash acc = { .low64 = len * PRIME64_1 };
+	unsigned int i = (len - 1) / 32;
+
+	do {
+		acc = xxh3_mix32(acc, p + 16 * i, p + len - 16 * (i + 1),
+				 secret + 32 * i, seed);
+	} while (i-- != 0);
+
+	return xxh3_finalize_mid_128(acc, len, seed);
+}
+
+static struct xxh128_hash xxh3_len_129to240_128(const uint8_t *p, size_t len,
+						const uint8_t *secret,
+						uint64_t seed)
+{
+	struct xxh128_hash acc = { .low64 = len * PRIME64_1 };
+	unsigned int i;
+
+	for (i = 32; i < 160; i += 32)
+		acc = xxh3_mix32(acc, p + i - 32, p + i - 16, secret + i - 32,
+				 seed);
+	acc.low64 = xxh3_avalanche(acc.low64);
+	acc.high64 = xxh3_avalanche(acc.high64);
+
+	for (i = 160; i <= len; i += 32)
+		acc = xxh3_mix32(acc, p + i - 32, p + i - 16,
+				 secret + XXH3_MIDSIZE_STARTOFFSET + i - 160,
+				 seed);
+
+	/* last bytes */
+	acc = xxh3_mix32(acc, p + len - 16, p + len - 32,
+			 secret + XXH3_SECRET_SIZE_MIN -
+			 XXH3_MIDSIZE_LASTOFFSET - 16, 0 - seed);
+
+	return xxh3_finalize_mid_128(acc, len, seed);
+}
+
+static noinline struct xxh128_hash xxh3_hash_long_128(const uint8_t *p,
+						      size_t len,
+						      uint64_t seed)
+{
+	uint64_t acc[XXH3_ACC_NB] __aligned(16) = XXH3_INIT_ACC;
+	uint8_t custom[XXH3_SECRET_SIZE] __aligned(16);
+	const uint8_t *secret = xxh3_secret;
+	struct xxh128_hash h128;
+
+	if (seed) {
+		xxh3_init_secret(custom, seed);
+		secret = custom;
+	}
+
+	xxh3_hash_long(acc, p, len, secret);
+	h128.low64 = xxh3_merge_accs(acc, secret + XXH3_SECRET_MERGEACCS_START,
+				     len * PRIME64_1);
+	h128.high64 = xxh3_merge_accs(acc, secret + XXH3_SECRET_SIZE -
+				      sizeof(acc) - XXH3_SECRET_MERGEACCS_START,
+				      ~(len * PRIME64_2));
+	return h128;
+}
+
+struct xxh128_hash xxh3_128(const void *input, const size_t len,
+			    const uint64_t seed)
+{
+	const uint8_t *p = (const uint8_t *)input;
+
+	if (len <= 16)
+		return xxh3_len_0to16_128(p, len, xxh3_secret, seed);
+	if (len <= 128)
+		return xxh3_len_17to128_128(p, len, xxh3_secret, seed);
+	if (len <= XXH3_MIDSIZE_MAX)
+		return xxh3_len_129to240_128(p, len, xxh3_secret, seed);
+	return xxh3_hash_long_128(p, len, seed);
+}
+EXPORT_SYMBOL(xxh3_128);
+
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION("xxHash");
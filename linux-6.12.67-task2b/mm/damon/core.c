@@ -692,7 +692,10 @@ static void damos_commit_quota_goal(
 	dst->target_value = src->target_value;
 	if (dst->metric == DAMOS_QUOTA_USER_INPUT)
 		dst->current_value = src->current_value;
-	/* keep last_psi_total as is, since it will be updated in next cycle */
+	/*
+	 * keep last_psi_total and last_refaults as is, since those will be
+	 * updated in next cycle
+	 */
 }
 
 /**
@@ -1511,8 +1514,15 @@ static inline u64 damos_get_some_mem_psi_total(void)
 
 #endif	/* CONFIG_PSI */
 
+static unsigned long damos_get_workingset_refaults(void)
+{
+	return global_node_page_state(WORKINGSET_REFAULT_ANON) +
+		global_node_page_state(WORKINGSET_REFAULT_FILE);
+}
+
 static void damos_set_quota_goal_current_value(struct damos_quota_goal *goal)
 {
+	unsigned long now_refaults;
 	u64 now_psi_total;
 
 	switch (goal->metric) {
@@ -1524,6 +1534,11 @@ static void damos_set_quota_goal_current_value(struct damos_quota_goal *goal)
 		goal->current_value = now_psi_total - goal->last_psi_total;
 		goal->last_psi_total = now_psi_total;
 		break;
+	case DAMOS_QUOTA_WORKINGSET_REFAULTS:
+		now_refaults = damos_get_workingset_refaults();
+		goal->current_value = now_refaults - goal->last_refaults;
+		goal->last_refaults = now_refaults;
+		break;
 	default:
 		break;
 	}
@@ -15,10 +15,49 @@
 #include <linux/memory-tiers.h>
 #include <linux/migrate.h>
 #include <linux/mm_inline.h>
+#include <linux/moduleparam.h>
+#include <linux/workqueue.h>
 
 #include "../internal.h"
 #include "ops-common.h"
 
+#ifdef MODULE_PARAM_PREFIX
+#undef MODULE_PARAM_PREFIX
+#endif
+#define MODULE_PARAM_PREFIX "damon_paddr."
+
+/*
+ * Number of threads sharing the access checks of a target.  The rmap walks
+ * of the checks dominate the cost of monitoring a large physical address
+ * space, and the regions are independent of each other, so they are split
+ * into contiguous shards checked in parallel by kdamond and unbound workers.
+ * 1 keeps all checks on kdamond.
+ */
+#define DAMON_PA_MAX_CHECK_THREADS	8
+static unsigned int check_threads __read_mostly = 1;
+module_param(check_threads, uint, 0600);
+
+/* Minimum number of regions per shard, below which it isn't worth a thread */
+#define DAMON_PA_MIN_SHARD_REGIONS	64
+
+struct damon_pa_access_cache {
+	unsigned long last_addr;
+	unsigned long last_folio_sz;
+	bool last_accessed;
+};
+
+struct damon_pa_shard {
+	struct work_struct work;
+	struct damon_region *first;
+	unsigned int nr_regions;
+	struct damon_attrs *attrs;
+	bool prepare;
+	unsigned int max_nr_accesses;
+};
+
+static void damon_pa_check_shard(struct damon_pa_shard *shard,
+		struct damon_pa_access_cache *cache);
+
 static bool damon_folio_mkold_one(struct folio *folio,
 		struct vm_area_struct *vma, unsigned long addr, void *arg)
 {
@@ -76,12 +115,78 @@ static void __damon_pa_prepare_access_check(struct damon_region *r)
 	damon_pa_mkold(r->sampling_addr);
 }
 
+static void damon_pa_shard_workfn(struct work_struct *work)
+{
+	struct damon_pa_shard *shard =
+		container_of(work, struct damon_pa_shard, work);
+	struct damon_pa_access_cache cache = {
+		.last_folio_sz = PAGE_SIZE,
+	};
+
+	damon_pa_check_shard(shard, &cache);
+}
+
+/*
+ * Prepare (@prepare) or check the accesses of the regions of @t in shards,
+ * the first of which is done by the caller using @cache.  Each shard keeps
+ * its own maximum of nr_accesses, so they are only combined once all shards
+ * are done.  Returns the maximum.
+ */
+static unsigned int damon_pa_check_sharded(struct damon_target *t,
+		struct damon_attrs *attrs, bool prepare,
+		struct damon_pa_access_cache *cache)
+{
+	struct damon_pa_shard shards[DAMON_PA_MAX_CHECK_THREADS];
+	unsigned int nr_regions = damon_nr_regions(t);
+	unsigned int nr_shards, per_shard, max_nr_accesses = 0;
+	unsigned int i = 0, n = 0;
+	struct damon_region *r;
+
+	nr_shards = min3(READ_ONCE(check_threads),
+			 (unsigned int)DAMON_PA_MAX_CHECK_THREADS,
+			 nr_regions / DAMON_PA_MIN_SHARD_REGIONS);
+	nr_shards = max(nr_shards, 1U);
+	per_shard = DIV_ROUND_UP(nr_regions, nr_shards);
+
+	damon_for_each_region(r, t) {
+		if (n++ % per_shard)
+			continue;
+		shards[i].first = r;
+		shards[i].nr_regions = min(per_shard, nr_regions - n + 1);
+		shards[i].attrs = attrs;
+		shards[i].prepare = prepare;
+		shards[i].max_nr_accesses = 0;
+		if (i) {
+			INIT_WORK_ONSTACK(&shards[i].work, damon_pa_shard_workfn);
+			queue_work(system_unbound_wq, &shards[i].work);
+		}
+		i++;
+	}
+	if (!i)
+		return 0;
+
+	damon_pa_check_shard(&shards[0], cache);
+	max_nr_accesses = shards[0].max_nr_accesses;
+	while (--i) {
+		flush_work(&shards[i].work);
+		destroy_work_on_stack(&shards[i].work);
+		max_nr_accesses = max(max_nr_accesses,
+				      shards[i].max_nr_accesses);
+	}
+
+	return max_nr_accesses;
+}
+
 static void damon_pa_prepare_access_checks(struct damon_ctx *ctx)
 {
 	struct damon_target *t;
 	struct damon_region *r;
 
 	damon_for_each_target(t, ctx) {
+		if (READ_ONCE(check_threads) > 1) {
+			damon_pa_check_sharded(t, &ctx->attrs, true, NULL);
+			continue;
+		}
 		damon_for_each_region(r, t)
 			__damon_pa_prepare_access_check(r);
 	}
@@ -163,34 +268,57 @@ static bool damon_pa_young(unsigned long paddr, unsigned long *folio_sz)
 }
 
 static void __damon_pa_check_access(struct damon_region *r,
-		struct damon_attrs *attrs)
+		struct damon_attrs *attrs, struct damon_pa_access_cache *cache)
 {
-	static unsigned long last_addr;
-	static unsigned long last_folio_sz = PAGE_SIZE;
-	static bool last_accessed;
-
 	/* If the region is in the last checked page, reuse the result */
-	if (ALIGN_DOWN(last_addr, last_folio_sz) ==
-				ALIGN_DOWN(r->sampling_addr, last_folio_sz)) {
-		damon_update_region_access_rate(r, last_accessed, attrs);
+	if (ALIGN_DOWN(cache->last_addr, cache->last_folio_sz) ==
+			ALIGN_DOWN(r->sampling_addr, cache->last_folio_sz)) {
+		damon_update_region_access_rate(r, cache->last_accessed, attrs);
 		return;
 	}
 
-	last_accessed = damon_pa_young(r->sampling_addr, &last_folio_sz);
-	damon_update_region_access_rate(r, last_accessed, attrs);
+	cache->last_accessed = damon_pa_young(r->sampling_addr,
+					      &cache->last_folio_sz);
+	damon_update_region_access_rate(r, cache->last_accessed, attrs);
 
-	last_addr = r->sampling_addr;
+	cache->last_addr = r->sampling_addr;
+}
+
+static void damon_pa_check_shard(struct damon_pa_shard *shard,
+		struct damon_pa_access_cache *cache)
+{
+	struct damon_region *r = shard->first;
+	unsigned int i;
+
+	for (i = 0; i < shard->nr_regions; i++, r = damon_next_region(r)) {
+		if (shard->prepare) {
+			__damon_pa_prepare_access_check(r);
+			continue;
+		}
+		__damon_pa_check_access(r, shard->attrs, cache);
+		shard->max_nr_accesses = max(r->nr_accesses,
+					     shard->max_nr_accesses);
+	}
 }
 
 static unsigned int damon_pa_check_accesses(struct damon_ctx *ctx)
 {
+	static struct damon_pa_access_cache cache = {
+		.last_folio_sz = PAGE_SIZE,
+	};
 	struct damon_target *t;
 	struct damon_region *r;
 	unsigned int max_nr_accesses = 0;
 
 	damon_for_each_target(t, ctx) {
+		if (READ_ONCE(check_threads) > 1) {
+			max_nr_accesses = max(max_nr_accesses,
+					damon_pa_check_sharded(t, &ctx->attrs,
+							       false, &cache));
+			continue;
+		}
 		damon_for_each_region(r, t) {
-			__damon_pa_check_access(r, &ctx->attrs);
+			__damon_pa_check_access(r, &ctx->attrs, &cache);
 			max_nr_accesses = max(r->nr_accesses, max_nr_accesses);
 		}
 	}
@@ -77,6 +77,20 @@ DEFINE_DAMON_MODULES_DAMOS_QUOTAS(damon_reclaim_quota);
 static unsigned long quota_mem_pressure_us __read_mostly;
 module_param(quota_mem_pressure_us, ulong, 0600);
 
+/*
+ * Desired level of workingset refaults in pages.
+ *
+ * Like ``quota_mem_pressure_us``, but the feedback is the number of system-wide
+ * workingset refaults per quota reset interval, that is, of reclaimed pages
+ * that had to be read back in.  Reclaiming hot memory shows up here before it
+ * does as memory stall time.  Value zero means disabling this auto-tuning
+ * feature.
+ *
+ * Disabled by default.
+ */
+static unsigned long quota_refaults __read_mostly;
+module_param(quota_refaults, ulong, 0600);
+
 /*
  * User-specifiable feedback for auto-tuning of the effective quota.
  *
@@ -217,6 +231,14 @@ static int damon_reclaim_apply_parameters(void)
 		damos_add_quota_goal(&scheme->quota, goal);
 	}
 
+	if (quota_refaults) {
+		goal = damos_new_quota_goal(DAMOS_QUOTA_WORKINGSET_REFAULTS,
+				quota_refaults);
+		if (!goal)
+			goto out;
+		damos_add_quota_goal(&scheme->quota, goal);
+	}
+
 	if (quota_autotune_feedback) {
 		goal = damos_new_quota_goal(DAMOS_QUOTA_USER_INPUT, 10000);
 		if (!goal)
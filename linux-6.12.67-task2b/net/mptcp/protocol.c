@@ -1464,11 +1464,25 @@ bool mptcp_subflow_active(struct mptcp_subflow_context *subflow)
 #define SSK_MODE_BACKUP	1
 #define SSK_MODE_MAX	2
 
+/* pessimistic one way delay of @ssk, srtt + 2 * mdev, in the same
+ * fixed point seconds as the linger time. rttvar_us is not used, it is
+ * floored at the minimum RTO and would hide the actual jitter.
+ */
+static u64 mptcp_subflow_delay(const struct sock *ssk)
+{
+	const struct tcp_sock *tp = tcp_sk(ssk);
+	u64 delay_us = (READ_ONCE(tp->srtt_us) >> 3) +
+		       2 * (READ_ONCE(tp->mdev_us) >> 2);
+
+	return div_u64(delay_us << 32, USEC_PER_SEC);
+}
+
 /* implement the mptcp packet scheduler;
  * returns the subflow that will transmit the next DSS
  * additionally updates the rtx timeout
  */
-struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
+static struct sock *__mptcp_subflow_get_send(struct mptcp_sock *msk,
+					     bool latency)
 {
 	struct subflow_send_info send_info[SSK_MODE_MAX];
 	struct mptcp_subflow_context *subflow;
@@ -1505,6 +1519,8 @@ struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 		}
 
 		linger_time = div_u64((u64)READ_ONCE(ssk->sk_wmem_queued) << 32, pace);
+		if (latency)
+			linger_time += mptcp_subflow_delay(ssk);
 		if (linger_time < send_info[backup].linger_time) {
 			send_info[backup].ssk = ssk;
 			send_info[backup].linger_time = linger_time;
@@ -1544,6 +1560,20 @@ struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 	return ssk;
 }
 
+struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
+{
+	return __mptcp_subflow_get_send(msk, false);
+}
+
+/* Like mptcp_subflow_get_send(), but also account for the path delay and
+ * its variance, so that data is not queued behind a jittery subflow while
+ * another one would deliver it sooner.
+ */
+struct sock *mptcp_subflow_get_send_latency(struct mptcp_sock *msk)
+{
+	return __mptcp_subflow_get_send(msk, true);
+}
+
 static void mptcp_push_release(struct sock *ssk, struct mptcp_sendmsg_info *info)
 {
 	tcp_push(ssk, 0, info->mss_now, tcp_sk(ssk)->nonagle, info->size_goal);
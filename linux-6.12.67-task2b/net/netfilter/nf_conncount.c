@@ -17,6 +17,7 @@
 #include <linux/ip.h>
 #include <linux/ipv6.h>
 #include <linux/jhash.h>
+#include <linux/log2.h>
 #include <linux/slab.h>
 #include <linux/list.h>
 #include <linux/rbtree.h>
@@ -24,11 +25,13 @@
 #include <linux/random.h>
 #include <linux/skbuff.h>
 #include <linux/spinlock.h>
+#include <linux/vmalloc.h>
 #include <linux/netfilter/nf_conntrack_tcp.h>
 #include <linux/netfilter/x_tables.h>
 #include <net/netfilter/nf_conntrack.h>
 #include <net/netfilter/nf_conntrack_count.h>
 #include <net/netfilter/nf_conntrack_core.h>
+#include <net/netfilter/nf_conntrack_extend.h>
 #include <net/netfilter/nf_conntrack_tuple.h>
 #include <net/netfilter/nf_conntrack_zones.h>
 
@@ -62,6 +65,7 @@ struct nf_conncount_data {
 	struct work_struct gc_work;
 	unsigned long pending_trees[BITS_TO_LONGS(CONNCOUNT_SLOTS)];
 	unsigned int gc_tree;
+	struct nf_conncount_sketch *sketch;	/* approximate mode */
 };
 
 static u_int32_t conncount_rnd __read_mostly;
@@ -579,6 +583,111 @@ next:
 	spin_unlock_bh(&nf_conncount_locks[tree]);
 }
 
+/* bounds of sketch sizes taken from nf_conntrack_max */
+#define CONNCOUNT_SKETCH_MIN_BITS	10
+#define CONNCOUNT_SKETCH_MAX_BITS	24
+
+static unsigned int sketch_estimate(const struct nf_conncount_sketch *sketch,
+				    const u32 *slot)
+{
+	unsigned int i, count = UINT_MAX;
+
+	for (i = 0; i < NF_CONNCOUNT_SKETCH_ROWS; i++)
+		count = min_t(unsigned int, count,
+			      atomic_read(&sketch->cnt[(i << sketch->bits) +
+						       slot[i]]));
+	return count;
+}
+
+/* Take a free reference from the records preallocated for @ct. */
+static struct nf_conncount_sketch_ref *
+sketch_ref_get(struct nf_conn *ct, struct nf_conncount_sketch *sketch)
+{
+	struct nf_conncount_refs *refs;
+	struct nf_conn_count *cc;
+	unsigned int i;
+
+	cc = nf_ct_ext_find(ct, NF_CT_EXT_CONNCOUNT);
+	if (unlikely(!cc)) {
+		/* the first sketch of the netns raced with the allocation */
+		cc = nf_ct_count_ext_add(ct, GFP_ATOMIC);
+		if (!cc)
+			return ERR_PTR(-ENOMEM);
+	}
+
+	for (refs = cc->refs; refs; refs = refs->next) {
+		for (i = 0; i < refs->nr; i++) {
+			if (refs->ref[i].sketch == sketch)
+				return NULL;
+		}
+	}
+
+	refs = cc->refs;
+	if (unlikely(!refs || refs->nr == NF_CONNCOUNT_REFS)) {
+		refs = kzalloc(sizeof(*refs), GFP_ATOMIC);
+		if (!refs)
+			return ERR_PTR(-ENOMEM);
+		refs->next = cc->refs;
+		cc->refs = refs;
+	}
+
+	return &refs->ref[refs->nr++];
+}
+
+/**
+ * nf_conncount_sketch_count_skb - count a new connection in a sketch
+ * @sketch: the sketch of the rule
+ * @skb: packet of the connection, or NULL to only read the count
+ * @key: key of the connection, ignored for a sketch of 0 bits
+ * @keylen: length of @key in u32 words
+ *
+ * No per connection state is kept here, a new conntrack is accounted
+ * once in each sketch that sees it and released when it is freed. Entries
+ * in TIME_WAIT keep being counted until they expire. Call with RCU read
+ * lock.
+ *
+ * Returns the estimated count for @key, which is never too low, or 0 if
+ * the connection could not be accounted.
+ */
+unsigned int nf_conncount_sketch_count_skb(struct nf_conncount_sketch *sketch,
+					   const struct sk_buff *skb,
+					   const u32 *key,
+					   unsigned int keylen)
+{
+	u32 slot[NF_CONNCOUNT_SKETCH_ROWS] = {};
+	struct nf_conncount_sketch_ref *ref;
+	enum ip_conntrack_info ctinfo;
+	struct nf_conn *ct;
+	unsigned int i;
+
+	for (i = 0; sketch->bits && i < NF_CONNCOUNT_SKETCH_ROWS; i++)
+		slot[i] = jhash2(key, keylen, conncount_rnd + i) &
+			  ((1U << sketch->bits) - 1);
+
+	if (!skb)
+		return sketch_estimate(sketch, slot);
+
+	ct = nf_ct_get(skb, &ctinfo);
+	if (!ct || nf_ct_is_template(ct) || nf_ct_is_confirmed(ct))
+		return max(sketch_estimate(sketch, slot), 1U);
+
+	ref = sketch_ref_get(ct, sketch);
+	if (IS_ERR(ref))
+		return 0; /* hotdrop */
+	if (!ref)
+		goto out;
+
+	percpu_ref_get(&sketch->ref);
+	for (i = 0; i < NF_CONNCOUNT_SKETCH_ROWS; i++) {
+		atomic_inc(&sketch->cnt[(i << sketch->bits) + slot[i]]);
+		ref->slot[i] = slot[i];
+	}
+	ref->sketch = sketch;
+out:
+	return max(sketch_estimate(sketch, slot), 1U);
+}
+EXPORT_SYMBOL_GPL(nf_conncount_sketch_count_skb);
+
 /* Count and return number of conntrack entries in 'net' with particular 'key'.
  * If 'skb' is not null, insert the corresponding tuple into the accounting
  * data structure. Call with RCU read lock.
@@ -589,6 +698,10 @@ unsigned int nf_conncount_count_skb(struct net *net,
 				    struct nf_conncount_data *data,
 				    const u32 *key)
 {
+	if (data->sketch)
+		return nf_conncount_sketch_count_skb(data->sketch, skb, key,
+						     data->keylen);
+
 	return count_tree(net, skb, l3num, data, key);
 
 }
@@ -615,12 +728,88 @@ struct nf_conncount_data *nf_conncount_init(struct net *net, unsigned int keylen
 
 	data->keylen = keylen / sizeof(u32);
 	data->net = net;
+	data->sketch = NULL;
 	INIT_WORK(&data->gc_work, tree_gc_worker);
 
 	return data;
 }
 EXPORT_SYMBOL_GPL(nf_conncount_init);
 
+/**
+ * nf_conncount_sketch_create - allocate a sketch of connection counts
+ * @net: netns of the connections counted
+ * @bits: log2 of the counters per row, 0 for a single exact count
+ * @gfp: allocation flags
+ *
+ * Conntracks of @net are allocated with room for their sketch references
+ * from now on, until the sketch is destroyed.
+ */
+struct nf_conncount_sketch *nf_conncount_sketch_create(struct net *net,
+							unsigned int bits,
+							gfp_t gfp)
+{
+	struct nf_conncount_sketch *sketch;
+
+	net_get_random_once(&conncount_rnd, sizeof(conncount_rnd));
+
+	sketch = kvzalloc(struct_size(sketch, cnt,
+				      NF_CONNCOUNT_SKETCH_ROWS << bits),
+			  gfp);
+	if (!sketch)
+		return ERR_PTR(-ENOMEM);
+
+	if (percpu_ref_init(&sketch->ref, nf_conncount_sketch_release, 0,
+			    gfp)) {
+		kvfree(sketch);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	sketch->net = net;
+	sketch->bits = bits;
+	atomic_inc(&nf_ct_pernet(net)->conncount_sketches);
+	return sketch;
+}
+EXPORT_SYMBOL_GPL(nf_conncount_sketch_create);
+
+/* The sketch itself goes away with the last conntrack counted in it. */
+void nf_conncount_sketch_destroy(struct nf_conncount_sketch *sketch)
+{
+	atomic_dec(&nf_ct_pernet(sketch->net)->conncount_sketches);
+	percpu_ref_kill(&sketch->ref);
+}
+EXPORT_SYMBOL_GPL(nf_conncount_sketch_destroy);
+
+/*
+ * Like nf_conncount_init(), counts are approximate and never too low. The
+ * sketch has a counter per row for each conntrack nf_conntrack_max allows,
+ * so collisions add less than one connection per key on average.
+ */
+struct nf_conncount_data *nf_conncount_init_approx(struct net *net,
+						   unsigned int keylen)
+{
+	struct nf_conncount_sketch *sketch;
+	struct nf_conncount_data *data;
+	unsigned int max, bits;
+
+	data = nf_conncount_init(net, keylen);
+	if (IS_ERR(data))
+		return data;
+
+	max = READ_ONCE(nf_conntrack_max) ?: nf_conntrack_htable_size;
+	bits = clamp(order_base_2(max), CONNCOUNT_SKETCH_MIN_BITS,
+		     CONNCOUNT_SKETCH_MAX_BITS);
+
+	sketch = nf_conncount_sketch_create(net, bits, GFP_KERNEL);
+	if (IS_ERR(sketch)) {
+		kfree(data);
+		return ERR_CAST(sketch);
+	}
+
+	data->sketch = sketch;
+	return data;
+}
+EXPORT_SYMBOL_GPL(nf_conncount_init_approx);
+
 void nf_conncount_cache_free(struct nf_conncount_list *list)
 {
 	struct nf_conncount_tuple *conn, *conn_n;
@@ -652,6 +841,9 @@ void nf_conncount_destroy(struct net *net, struct nf_conncount_data *data)
 
 	cancel_work_sync(&data->gc_work);
 
+	if (data->sketch)
+		nf_conncount_sketch_destroy(data->sketch);
+
 	for (i = 0; i < ARRAY_SIZE(data->root); ++i)
 		destroy_tree(&data->root[i]);
 
@@ -47,6 +47,7 @@
 #include <net/netfilter/nf_conntrack_timeout.h>
 #include <net/netfilter/nf_conntrack_labels.h>
 #include <net/netfilter/nf_conntrack_synproxy.h>
+#include <net/netfilter/nf_conntrack_count.h>
 #include <net/netfilter/nf_nat.h>
 #include <net/netfilter/nf_nat_helper.h>
 #include <net/netns/hash.h>
@@ -65,10 +66,8 @@ EXPORT_SYMBOL_GPL(nf_conntrack_hash);
 
 struct conntrack_gc_work {
 	struct delayed_work	dwork;
-	u32			next_bucket;
-	u32			avg_timeout;
-	u32			count;
-	u32			start_time;
+	u32			wheel_pos;	/* next slot to scan */
+	u32			next_group;	/* in that slot */
 	bool			exiting;
 	bool			early_drop;
 };
@@ -81,20 +80,85 @@ static __read_mostly bool nf_conntrack_locks_all;
 static DEFINE_MUTEX(nf_conntrack_mutex);
 
 #define GC_SCAN_INTERVAL_MAX	(60ul * HZ)
-#define GC_SCAN_INTERVAL_MIN	(1ul * HZ)
 
-/* clamp timeouts to this value (TCP unacked) */
-#define GC_SCAN_INTERVAL_CLAMP	(300ul * HZ)
+#define GC_SCAN_MAX_DURATION	msecs_to_jiffies(10)
+#define GC_SCAN_EXPIRED_MAX	(64000u / HZ)
 
-/* Initial bias pretending we have 100 entries at the upper bound so we don't
- * wakeup often just because we have three entries with a 1s timeout while still
- * allowing non-idle machines to wakeup more often when needed.
+/* Expiry wheel: GC_WHEEL_SLOTS slots of GC_WHEEL_GRANULE each, a slot is a
+ * bitmap of the groups of (1 << GC_WHEEL_GROUP_SHIFT) hash buckets that have
+ * an entry expiring in it, so that gc only scans buckets with something due
+ * instead of the whole table.
+ *
+ * Bits are only hints: entries are filed when inserted and again every time gc
+ * looks at them, timeouts beyond the wheel go to its last slot.  An entry whose
+ * timeout got shorter is thus still seen within one revolution, which matches
+ * GC_SCAN_INTERVAL_MAX.
  */
-#define GC_SCAN_INITIAL_COUNT	100
-#define GC_SCAN_INTERVAL_INIT	GC_SCAN_INTERVAL_MAX
+#define GC_WHEEL_SLOTS		64
+#define GC_WHEEL_GRANULE	HZ
+#define GC_WHEEL_GROUP_SHIFT	6
+
+struct nf_ct_gc_wheel {
+	unsigned int	nr_groups;
+	unsigned int	slot_longs;
+	unsigned long	bits[];
+};
 
-#define GC_SCAN_MAX_DURATION	msecs_to_jiffies(10)
-#define GC_SCAN_EXPIRED_MAX	(64000u / HZ)
+/* replaced together with nf_conntrack_hash, under nf_conntrack_generation */
+static struct nf_ct_gc_wheel *nf_ct_gc_wheel __read_mostly;
+
+static unsigned long *gc_wheel_slot(struct nf_ct_gc_wheel *wheel, u32 slot)
+{
+	return wheel->bits + (slot % GC_WHEEL_SLOTS) * wheel->slot_longs;
+}
+
+/* File @ct, which is hashed in @bucket, in the slot it expires in */
+static void gc_wheel_add(struct nf_ct_gc_wheel *wheel,
+			 const struct nf_conn *ct, unsigned int bucket)
+{
+	u32 expires = min_t(unsigned long, nf_ct_expires(ct),
+			    (GC_WHEEL_SLOTS - 2) * GC_WHEEL_GRANULE);
+	u32 slot = (nfct_time_stamp + expires) / GC_WHEEL_GRANULE + 1;
+	unsigned long *bits = gc_wheel_slot(wheel, slot);
+	unsigned int group = bucket >> GC_WHEEL_GROUP_SHIFT;
+
+	/* don't dirty the cacheline when it's already set */
+	if (!test_bit(group, bits))
+		set_bit(group, bits);
+}
+
+static struct nf_ct_gc_wheel *gc_wheel_alloc(unsigned int hashsize)
+{
+	unsigned int nr_groups = DIV_ROUND_UP(hashsize, 1U << GC_WHEEL_GROUP_SHIFT);
+	unsigned int slot_longs = BITS_TO_LONGS(nr_groups);
+	struct nf_ct_gc_wheel *wheel;
+
+	wheel = kvzalloc(struct_size(wheel, bits, GC_WHEEL_SLOTS * slot_longs),
+			 GFP_KERNEL);
+	if (!wheel)
+		return NULL;
+
+	wheel->nr_groups = nr_groups;
+	wheel->slot_longs = slot_longs;
+
+	/* entries rehashed into a new table haven't been filed yet */
+	bitmap_fill(gc_wheel_slot(wheel, nfct_time_stamp / GC_WHEEL_GRANULE + 1),
+		    nr_groups);
+	return wheel;
+}
+
+static void nf_ct_gc_get(struct hlist_nulls_head **hash, unsigned int *hsize,
+			 struct nf_ct_gc_wheel **wheel)
+{
+	unsigned int sequence;
+
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		*hsize = nf_conntrack_htable_size;
+		*hash = nf_conntrack_hash;
+		*wheel = nf_ct_gc_wheel;
+	} while (read_seqcount_retry(&nf_conntrack_generation, sequence));
+}
 
 #define MIN_CHAINLEN	50u
 #define MAX_CHAINLEN	(80u - MIN_CHAINLEN)
@@ -834,6 +898,7 @@ static void __nf_conntrack_hash_insert(struct nf_conn *ct,
 			   &nf_conntrack_hash[hash]);
 	hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode,
 			   &nf_conntrack_hash[reply_hash]);
+	gc_wheel_add(nf_ct_gc_wheel, ct, hash);
 }
 
 static bool nf_ct_ext_valid_pre(const struct nf_ct_ext *ext)
@@ -1121,6 +1186,7 @@ static int nf_ct_resolve_clash_harder(struct sk_buff *skb, u32 repl_idx)
 
 	hlist_nulls_add_head_rcu(&loser_ct->tuplehash[IP_CT_DIR_REPLY].hnnode,
 				 &nf_conntrack_hash[repl_idx]);
+	gc_wheel_add(nf_ct_gc_wheel, loser_ct, repl_idx);
 	/* confirmed bit must be set after hlist add, not before:
 	 * loser_ct can still be visible to other cpu due to
 	 * SLAB_TYPESAFE_BY_RCU.
@@ -1510,139 +1576,183 @@ static bool gc_worker_can_early_drop(const struct nf_conn *ct)
 	return false;
 }
 
-static void gc_worker(struct work_struct *work)
+static void gc_scan_bucket(struct hlist_nulls_head *head,
+			   struct nf_ct_gc_wheel *wheel, unsigned int bucket,
+			   unsigned int nf_conntrack_max95,
+			   unsigned int *expired_count)
 {
-	unsigned int i, hashsz, nf_conntrack_max95 = 0;
-	u32 end_time, start_time = nfct_time_stamp;
-	struct conntrack_gc_work *gc_work;
-	unsigned int expired_count = 0;
-	unsigned long next_run;
-	s32 delta_time;
-	long count;
+	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
+	struct nf_conn *tmp;
 
-	gc_work = container_of(work, struct conntrack_gc_work, dwork.work);
+	hlist_nulls_for_each_entry_rcu(h, n, head, hnnode) {
+		struct nf_conntrack_net *cnet;
+		struct net *net;
 
-	i = gc_work->next_bucket;
-	if (gc_work->early_drop)
-		nf_conntrack_max95 = nf_conntrack_max / 100u * 95u;
+		tmp = nf_ct_tuplehash_to_ctrack(h);
 
-	if (i == 0) {
-		gc_work->avg_timeout = GC_SCAN_INTERVAL_INIT;
-		gc_work->count = GC_SCAN_INITIAL_COUNT;
-		gc_work->start_time = start_time;
-	}
+		if (test_bit(IPS_OFFLOAD_BIT, &tmp->status)) {
+			nf_ct_offload_timeout(tmp);
+			if (!nf_conntrack_max95) {
+				gc_wheel_add(wheel, tmp, bucket);
+				continue;
+			}
+		}
+
+		if (nf_ct_is_expired(tmp)) {
+			nf_ct_gc_expired(tmp);
+			(*expired_count)++;
+			continue;
+		}
 
-	next_run = gc_work->avg_timeout;
-	count = gc_work->count;
+		gc_wheel_add(wheel, tmp, bucket);
 
-	end_time = start_time + GC_SCAN_MAX_DURATION;
+		if (nf_conntrack_max95 == 0 || gc_worker_skip_ct(tmp))
+			continue;
 
-	do {
-		struct nf_conntrack_tuple_hash *h;
+		net = nf_ct_net(tmp);
+		cnet = nf_ct_pernet(net);
+		if (atomic_read(&cnet->count) < nf_conntrack_max95)
+			continue;
+
+		/* need to take reference to avoid possible races */
+		if (!refcount_inc_not_zero(&tmp->ct_general.use))
+			continue;
+
+		/* load ->status after refcount increase */
+		smp_acquire__after_ctrl_dep();
+
+		if (gc_worker_skip_ct(tmp)) {
+			nf_ct_put(tmp);
+			continue;
+		}
+
+		if (gc_worker_can_early_drop(tmp)) {
+			nf_ct_kill(tmp);
+			(*expired_count)++;
+		}
+
+		nf_ct_put(tmp);
+	}
+}
+
+/* Scan one group of hash buckets, which may be gone after a resize */
+static void gc_scan_group(unsigned int group, unsigned int nf_conntrack_max95,
+			  unsigned int *expired_count)
+{
+	unsigned int i = group << GC_WHEEL_GROUP_SHIFT;
+	unsigned int end = i + (1U << GC_WHEEL_GROUP_SHIFT);
+
+	for (; i < end; i++) {
 		struct hlist_nulls_head *ct_hash;
-		struct hlist_nulls_node *n;
-		struct nf_conn *tmp;
+		struct nf_ct_gc_wheel *wheel;
+		unsigned int hashsz;
 
 		rcu_read_lock();
 
-		nf_conntrack_get_ht(&ct_hash, &hashsz);
+		nf_ct_gc_get(&ct_hash, &hashsz, &wheel);
 		if (i >= hashsz) {
 			rcu_read_unlock();
-			break;
+			return;
 		}
 
-		hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[i], hnnode) {
-			struct nf_conntrack_net *cnet;
-			struct net *net;
-			long expires;
+		gc_scan_bucket(&ct_hash[i], wheel, i, nf_conntrack_max95,
+			       expired_count);
 
-			tmp = nf_ct_tuplehash_to_ctrack(h);
-
-			if (test_bit(IPS_OFFLOAD_BIT, &tmp->status)) {
-				nf_ct_offload_timeout(tmp);
-				if (!nf_conntrack_max95)
-					continue;
-			}
-
-			if (expired_count > GC_SCAN_EXPIRED_MAX) {
-				rcu_read_unlock();
+		/* could check get_nulls_value() here and restart if ct
+		 * was moved to another chain.  But given gc is best-effort
+		 * we will just continue with next hash slot.
+		 */
+		rcu_read_unlock();
+	}
+}
 
-				gc_work->next_bucket = i;
-				gc_work->avg_timeout = next_run;
-				gc_work->count = count;
+static void gc_worker(struct work_struct *work)
+{
+	u32 cur, end_time = nfct_time_stamp + GC_SCAN_MAX_DURATION;
+	unsigned int i, nr_groups, nf_conntrack_max95 = 0;
+	struct conntrack_gc_work *gc_work;
+	unsigned int expired_count = 0;
+	struct nf_ct_gc_wheel *wheel;
+	unsigned long next_run;
+	s32 delta_time;
 
-				delta_time = nfct_time_stamp - gc_work->start_time;
+	gc_work = container_of(work, struct conntrack_gc_work, dwork.work);
 
-				/* re-sched immediately if total cycle time is exceeded */
-				next_run = delta_time < (s32)GC_SCAN_INTERVAL_MAX;
-				goto early_exit;
-			}
+	if (gc_work->early_drop)
+		nf_conntrack_max95 = nf_conntrack_max / 100u * 95u;
 
-			if (nf_ct_is_expired(tmp)) {
-				nf_ct_gc_expired(tmp);
-				expired_count++;
-				continue;
-			}
+	cur = nfct_time_stamp / GC_WHEEL_GRANULE;
+	delta_time = cur - gc_work->wheel_pos;
+	if (delta_time < 0 || delta_time >= GC_WHEEL_SLOTS) {
+		/* first run, time wrapped, or we're a whole revolution behind */
+		gc_work->wheel_pos = cur - (GC_WHEEL_SLOTS - 1);
+		gc_work->next_group = 0;
+	}
 
-			expires = clamp(nf_ct_expires(tmp), GC_SCAN_INTERVAL_MIN, GC_SCAN_INTERVAL_CLAMP);
-			expires = (expires - (long)next_run) / ++count;
-			next_run += expires;
+	/* Table is getting full: look at everything for early drop candidates */
+	if (nf_conntrack_max95 && !gc_work->next_group) {
+		rcu_read_lock();
+		wheel = READ_ONCE(nf_ct_gc_wheel);
+		bitmap_fill(gc_wheel_slot(wheel, gc_work->wheel_pos), wheel->nr_groups);
+		rcu_read_unlock();
+	}
 
-			if (nf_conntrack_max95 == 0 || gc_worker_skip_ct(tmp))
-				continue;
+	while ((s32)(cur - gc_work->wheel_pos) >= 0) {
+		unsigned int group = gc_work->next_group;
 
-			net = nf_ct_net(tmp);
-			cnet = nf_ct_pernet(net);
-			if (atomic_read(&cnet->count) < nf_conntrack_max95)
-				continue;
+		while (1) {
+			unsigned long *bits;
 
-			/* need to take reference to avoid possible races */
-			if (!refcount_inc_not_zero(&tmp->ct_general.use))
-				continue;
+			rcu_read_lock();
+			wheel = READ_ONCE(nf_ct_gc_wheel);
+			bits = gc_wheel_slot(wheel, gc_work->wheel_pos);
+			group = find_next_bit(bits, wheel->nr_groups, group);
+			if (group >= wheel->nr_groups) {
+				rcu_read_unlock();
+				break;
+			}
+			clear_bit(group, bits);
+			rcu_read_unlock();
 
-			/* load ->status after refcount increase */
-			smp_acquire__after_ctrl_dep();
+			gc_scan_group(group, nf_conntrack_max95, &expired_count);
+			cond_resched();
+			group++;
 
-			if (gc_worker_skip_ct(tmp)) {
-				nf_ct_put(tmp);
-				continue;
+			if (expired_count > GC_SCAN_EXPIRED_MAX) {
+				gc_work->next_group = group;
+				next_run = 1;
+				goto early_exit;
 			}
 
-			if (gc_worker_can_early_drop(tmp)) {
-				nf_ct_kill(tmp);
-				expired_count++;
+			delta_time = nfct_time_stamp - end_time;
+			if (delta_time > 0) {
+				gc_work->next_group = group;
+				next_run = 0;
+				goto early_exit;
 			}
-
-			nf_ct_put(tmp);
-		}
-
-		/* could check get_nulls_value() here and restart if ct
-		 * was moved to another chain.  But given gc is best-effort
-		 * we will just continue with next hash slot.
-		 */
-		rcu_read_unlock();
-		cond_resched();
-		i++;
-
-		delta_time = nfct_time_stamp - end_time;
-		if (delta_time > 0 && i < hashsz) {
-			gc_work->avg_timeout = next_run;
-			gc_work->count = count;
-			gc_work->next_bucket = i;
-			next_run = 0;
-			goto early_exit;
 		}
-	} while (i < hashsz);
 
-	gc_work->next_bucket = 0;
+		gc_work->next_group = 0;
+		gc_work->wheel_pos++;
+	}
 
-	next_run = clamp(next_run, GC_SCAN_INTERVAL_MIN, GC_SCAN_INTERVAL_MAX);
+	/* Sleep until the next slot that has anything in it is due */
+	next_run = GC_SCAN_INTERVAL_MAX;
 
-	delta_time = max_t(s32, nfct_time_stamp - gc_work->start_time, 1);
-	if (next_run > (unsigned long)delta_time)
-		next_run -= delta_time;
-	else
-		next_run = 1;
+	rcu_read_lock();
+	wheel = READ_ONCE(nf_ct_gc_wheel);
+	nr_groups = wheel->nr_groups;
+	for (i = 0; i < GC_WHEEL_SLOTS; i++) {
+		u32 slot = gc_work->wheel_pos + i;
+
+		if (find_first_bit(gc_wheel_slot(wheel, slot), nr_groups) < nr_groups) {
+			delta_time = slot * GC_WHEEL_GRANULE - nfct_time_stamp;
+			next_run = clamp_t(s32, delta_time, 1, GC_SCAN_INTERVAL_MAX);
+			break;
+		}
+	}
+	rcu_read_unlock();
 
 early_exit:
 	if (gc_work->exiting)
@@ -1725,6 +1835,74 @@ struct nf_conn *nf_conntrack_alloc(struct net *net,
 }
 EXPORT_SYMBOL_GPL(nf_conntrack_alloc);
 
+#if IS_ENABLED(CONFIG_NETFILTER_CONNCOUNT)
+/* The sketch outlives its connlimit rule until all counted entries are gone. */
+void nf_conncount_sketch_release(struct percpu_ref *ref)
+{
+	struct nf_conncount_sketch *sketch;
+
+	sketch = container_of(ref, struct nf_conncount_sketch, ref);
+	percpu_ref_exit(ref);
+	kvfree(sketch);
+}
+EXPORT_SYMBOL_GPL(nf_conncount_sketch_release);
+
+/* Preallocate the sketch references of a new conntrack. */
+struct nf_conn_count *nf_ct_count_ext_add(struct nf_conn *ct, gfp_t gfp)
+{
+	struct nf_conn_count *cc;
+
+	cc = nf_ct_ext_add(ct, NF_CT_EXT_CONNCOUNT, gfp);
+	if (cc)
+		cc->refs = kzalloc(sizeof(*cc->refs), gfp);
+	return cc;
+}
+EXPORT_SYMBOL_GPL(nf_ct_count_ext_add);
+
+static void nf_ct_count_put(struct nf_conn *ct)
+{
+	struct nf_conncount_refs *refs, *next;
+	struct nf_conncount_sketch_ref *ref;
+	struct nf_conncount_sketch *sketch;
+	struct nf_conn_count *cc;
+	unsigned int i, j;
+
+	/* not nf_ct_ext_find(): the reference is held regardless of genid */
+	if (!ct->ext || !__nf_ct_ext_exist(ct->ext, NF_CT_EXT_CONNCOUNT))
+		return;
+
+	cc = (void *)ct->ext + ct->ext->offset[NF_CT_EXT_CONNCOUNT];
+	for (refs = cc->refs; refs; refs = next) {
+		for (j = 0; j < refs->nr; j++) {
+			ref = &refs->ref[j];
+			sketch = ref->sketch;
+			for (i = 0; i < NF_CONNCOUNT_SKETCH_ROWS; i++)
+				atomic_dec(&sketch->cnt[(i << sketch->bits) +
+							ref->slot[i]]);
+			percpu_ref_put(&sketch->ref);
+		}
+		next = refs->next;
+		kfree(refs);
+	}
+}
+
+static void nf_ct_count_prealloc(struct nf_conn *ct,
+				 struct nf_conntrack_net *cnet)
+{
+	if (atomic_read(&cnet->conncount_sketches))
+		nf_ct_count_ext_add(ct, GFP_ATOMIC);
+}
+#else
+static inline void nf_ct_count_put(struct nf_conn *ct)
+{
+}
+
+static inline void nf_ct_count_prealloc(struct nf_conn *ct,
+					struct nf_conntrack_net *cnet)
+{
+}
+#endif
+
 void nf_conntrack_free(struct nf_conn *ct)
 {
 	struct net *net = nf_ct_net(ct);
@@ -1745,6 +1923,7 @@ void nf_conntrack_free(struct nf_conn *ct)
 		rcu_read_unlock();
 	}
 
+	nf_ct_count_put(ct);
 	kfree(ct->ext);
 	kmem_cache_free(nf_conntrack_cachep, ct);
 	cnet = nf_ct_pernet(net);
@@ -1812,6 +1991,8 @@ init_conntrack(struct net *net, struct nf_conn *tmpl,
 #endif
 
 	cnet = nf_ct_pernet(net);
+	nf_ct_count_prealloc(ct, cnet);
+
 	if (cnet->expect_count) {
 		spin_lock_bh(&nf_conntrack_expect_lock);
 		exp = nf_ct_find_expectation(net, zone, tuple, !tmpl || nf_ct_is_confirmed(tmpl));
@@ -2471,6 +2652,7 @@ void nf_conntrack_cleanup_end(void)
 {
 	RCU_INIT_POINTER(nf_ct_hook, NULL);
 	cancel_delayed_work_sync(&conntrack_gc_work.dwork);
+	kvfree(nf_ct_gc_wheel);
 	kvfree(nf_conntrack_hash);
 
 	nf_conntrack_proto_fini();
@@ -2555,6 +2737,7 @@ int nf_conntrack_hash_resize(unsigned int hashsize)
 	int i, bucket;
 	unsigned int old_size;
 	struct hlist_nulls_head *hash, *old_hash;
+	struct nf_ct_gc_wheel *wheel, *old_wheel;
 	struct nf_conntrack_tuple_hash *h;
 	struct nf_conn *ct;
 
@@ -2565,10 +2748,17 @@ int nf_conntrack_hash_resize(unsigned int hashsize)
 	if (!hash)
 		return -ENOMEM;
 
+	wheel = gc_wheel_alloc(hashsize);
+	if (!wheel) {
+		kvfree(hash);
+		return -ENOMEM;
+	}
+
 	mutex_lock(&nf_conntrack_mutex);
 	old_size = nf_conntrack_htable_size;
 	if (old_size == hashsize) {
 		mutex_unlock(&nf_conntrack_mutex);
+		kvfree(wheel);
 		kvfree(hash);
 		return 0;
 	}
@@ -2599,9 +2789,11 @@ int nf_conntrack_hash_resize(unsigned int hashsize)
 		}
 	}
 	old_hash = nf_conntrack_hash;
+	old_wheel = nf_ct_gc_wheel;
 
 	nf_conntrack_hash = hash;
 	nf_conntrack_htable_size = hashsize;
+	nf_ct_gc_wheel = wheel;
 
 	write_seqcount_end(&nf_conntrack_generation);
 	nf_conntrack_all_unlock();
@@ -2610,6 +2802,7 @@ int nf_conntrack_hash_resize(unsigned int hashsize)
 	mutex_unlock(&nf_conntrack_mutex);
 
 	synchronize_net();
+	kvfree(old_wheel);
 	kvfree(old_hash);
 	return 0;
 }
@@ -2671,6 +2864,12 @@ int nf_conntrack_init_start(void)
 	if (!nf_conntrack_hash)
 		return -ENOMEM;
 
+	nf_ct_gc_wheel = gc_wheel_alloc(nf_conntrack_htable_size);
+	if (!nf_ct_gc_wheel) {
+		kvfree(nf_conntrack_hash);
+		return -ENOMEM;
+	}
+
 	nf_conntrack_max = max_factor * nf_conntrack_htable_size;
 
 	nf_conntrack_cachep = kmem_cache_create("nf_conntrack",
@@ -2711,6 +2910,7 @@ err_helper:
 err_expect:
 	kmem_cache_destroy(nf_conntrack_cachep);
 err_cachep:
+	kvfree(nf_ct_gc_wheel);
 	kvfree(nf_conntrack_hash);
 	return ret;
 }
@@ -253,6 +253,24 @@ static const struct rhashtable_params nf_flow_offload_rhash_params = {
 	.automatic_shrinking	= true,
 };
 
+static u32 flow_offload_cache_slot(const struct flow_offload_tuple *tuple)
+{
+	return flow_offload_hash(tuple, 0, 0) & (NF_FLOW_CACHE_SIZE - 1);
+}
+
+/*
+ * A cache entry is only trusted while the generation of its slot is the one
+ * it was filled with. The generation is bumped after a tuple was unlinked and
+ * before the flow can be freed, so a reader that sees the old generation
+ * within its RCU read side section still holds a live flow.
+ */
+static void flow_offload_cache_invalidate(struct nf_flowtable *flow_table,
+					  const struct flow_offload_tuple *tuple)
+{
+	smp_mb__before_atomic();
+	atomic_inc(&flow_table->cache_gen[flow_offload_cache_slot(tuple)]);
+}
+
 unsigned long flow_offload_get_timeout(struct flow_offload *flow)
 {
 	unsigned long timeout = NF_FLOW_TIMEOUT;
@@ -291,6 +309,8 @@ int flow_offload_add(struct nf_flowtable *flow_table, struct flow_offload *flow)
 		rhashtable_remove_fast(&flow_table->rhashtable,
 				       &flow->tuplehash[0].node,
 				       nf_flow_offload_rhash_params);
+		flow_offload_cache_invalidate(flow_table,
+					      &flow->tuplehash[0].tuple);
 		return err;
 	}
 
@@ -337,6 +357,10 @@ static void flow_offload_del(struct nf_flowtable *flow_table,
 	rhashtable_remove_fast(&flow_table->rhashtable,
 			       &flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].node,
 			       nf_flow_offload_rhash_params);
+	flow_offload_cache_invalidate(flow_table,
+				      &flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple);
+	flow_offload_cache_invalidate(flow_table,
+				      &flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple);
 	flow_offload_free(flow);
 }
 
@@ -353,14 +377,34 @@ flow_offload_lookup(struct nf_flowtable *flow_table,
 		    struct flow_offload_tuple *tuple)
 {
 	struct flow_offload_tuple_rhash *tuplehash;
+	struct nf_flow_cache_entry *ent = NULL;
 	struct flow_offload *flow;
+	unsigned int gen = 0;
 	int dir;
 
+	/* cache entries are per cpu, only fill them with bottom halves off */
+	if (in_softirq()) {
+		u32 slot = flow_offload_cache_slot(tuple);
+
+		gen = atomic_read_acquire(&flow_table->cache_gen[slot]);
+		ent = &this_cpu_ptr(flow_table->cache)->ent[slot];
+		tuplehash = ent->tuplehash;
+		if (ent->gen == gen && tuplehash &&
+		    !memcmp(&tuplehash->tuple, tuple,
+			    offsetof(struct flow_offload_tuple, __hash)))
+			goto found;
+	}
+
 	tuplehash = rhashtable_lookup(&flow_table->rhashtable, tuple,
 				      nf_flow_offload_rhash_params);
 	if (!tuplehash)
 		return NULL;
 
+	if (ent) {
+		ent->tuplehash = tuplehash;
+		ent->gen = gen;
+	}
+found:
 	dir = tuplehash->tuple.dir;
 	flow = container_of(tuplehash, struct flow_offload, tuplehash[dir]);
 	if (test_bit(NF_FLOW_TEARDOWN, &flow->flags))
@@ -546,10 +590,16 @@ int nf_flow_table_init(struct nf_flowtable *flowtable)
 	flow_block_init(&flowtable->flow_block);
 	init_rwsem(&flowtable->flow_block_lock);
 
+	flowtable->cache = alloc_percpu(struct nf_flow_cache);
+	if (!flowtable->cache)
+		return -ENOMEM;
+
 	err = rhashtable_init(&flowtable->rhashtable,
 			      &nf_flow_offload_rhash_params);
-	if (err < 0)
+	if (err < 0) {
+		free_percpu(flowtable->cache);
 		return err;
+	}
 
 	queue_delayed_work(system_power_efficient_wq,
 			   &flowtable->gc_work, HZ);
@@ -610,6 +660,7 @@ void nf_flow_table_free(struct nf_flowtable *flow_table)
 	nf_flow_table_gc_run(flow_table);
 	nf_flow_table_offload_flush_cleanup(flow_table);
 	rhashtable_destroy(&flow_table->rhashtable);
+	free_percpu(flow_table->cache);
 }
 EXPORT_SYMBOL_GPL(nf_flow_table_free);
 
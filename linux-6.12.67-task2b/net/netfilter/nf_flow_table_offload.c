@@ -1,5 +1,6 @@
 #include <linux/kernel.h>
 #include <linux/init.h>
+#include <linux/llist.h>
 #include <linux/module.h>
 #include <linux/netfilter.h>
 #include <linux/rhashtable.h>
@@ -22,9 +23,33 @@ struct flow_offload_work {
 	enum flow_cls_command	cmd;
 	struct nf_flowtable	*flowtable;
 	struct flow_offload	*flow;
+	struct llist_node	llnode;
+};
+
+/*
+ * Commands are queued on the cpu that issued them, one batch per command
+ * type. A batch is drained by one work item on the unbound workqueue of its
+ * type, so the cpus' batches run in parallel. Within a batch, consecutive
+ * commands for the same flowtable, i.e. the same devices, share one hold of
+ * flow_block_lock, for up to FLOW_OFFLOAD_BATCH of them.
+ */
+enum {
+	FLOW_OFFLOAD_BATCH_ADD,
+	FLOW_OFFLOAD_BATCH_DEL,
+	FLOW_OFFLOAD_BATCH_STATS,
+	FLOW_OFFLOAD_BATCH_MAX,
+};
+
+#define FLOW_OFFLOAD_BATCH	64
+
+struct flow_offload_batch {
+	struct llist_head	cmds;
 	struct work_struct	work;
 };
 
+static DEFINE_PER_CPU(struct flow_offload_batch,
+		      flow_offload_batches[FLOW_OFFLOAD_BATCH_MAX]);
+
 #define NF_FLOW_DISSECTOR(__match, __type, __field)	\
 	(__match)->dissector.offset[__type] =		\
 		offsetof(struct nf_flow_key, __field)
@@ -851,7 +876,7 @@ static int nf_flow_offload_tuple(struct nf_flowtable *flowtable,
 	if (cmd == FLOW_CLS_REPLACE)
 		cls_flow.rule = flow_rule->rule;
 
-	down_read(&flowtable->flow_block_lock);
+	lockdep_assert_held_read(&flowtable->flow_block_lock);
 	list_for_each_entry(block_cb, block_cb_list, list) {
 		err = block_cb->cb(TC_SETUP_CLSFLOWER, &cls_flow,
 				   block_cb->cb_priv);
@@ -860,7 +885,6 @@ static int nf_flow_offload_tuple(struct nf_flowtable *flowtable,
 
 		i++;
 	}
-	up_read(&flowtable->flow_block_lock);
 
 	if (cmd == FLOW_CLS_STATS)
 		memcpy(stats, &cls_flow.stats, sizeof(*stats));
@@ -968,13 +992,11 @@ static void flow_offload_work_stats(struct flow_offload_work *offload)
 	}
 }
 
-static void flow_offload_work_handler(struct work_struct *work)
+/* called with flow_block_lock of the flowtable held for reading */
+static void flow_offload_work_run(struct flow_offload_work *offload)
 {
-	struct flow_offload_work *offload;
-	struct net *net;
+	struct net *net = read_pnet(&offload->flowtable->net);
 
-	offload = container_of(work, struct flow_offload_work, work);
-	net = read_pnet(&offload->flowtable->net);
 	switch (offload->cmd) {
 		case FLOW_CLS_REPLACE:
 			flow_offload_work_add(offload);
@@ -996,20 +1018,60 @@ static void flow_offload_work_handler(struct work_struct *work)
 	kfree(offload);
 }
 
+static void flow_offload_batch_work(struct work_struct *work)
+{
+	struct flow_offload_batch *batch;
+	struct flow_offload_work *offload, *next;
+	struct nf_flowtable *locked = NULL;
+	struct llist_node *cmds;
+	unsigned int nr = 0;
+
+	batch = container_of(work, struct flow_offload_batch, work);
+	cmds = llist_reverse_order(llist_del_all(&batch->cmds));
+
+	llist_for_each_entry_safe(offload, next, cmds, llnode) {
+		if (offload->flowtable != locked || nr == FLOW_OFFLOAD_BATCH) {
+			if (locked)
+				up_read(&locked->flow_block_lock);
+			cond_resched();
+			locked = offload->flowtable;
+			down_read(&locked->flow_block_lock);
+			nr = 0;
+		}
+		/* frees @offload */
+		flow_offload_work_run(offload);
+		nr++;
+	}
+	if (locked)
+		up_read(&locked->flow_block_lock);
+}
+
 static void flow_offload_queue_work(struct flow_offload_work *offload)
 {
 	struct net *net = read_pnet(&offload->flowtable->net);
+	struct workqueue_struct *wq;
+	struct flow_offload_batch *batch;
+	int type;
 
 	if (offload->cmd == FLOW_CLS_REPLACE) {
 		NF_FLOW_TABLE_STAT_INC_ATOMIC(net, count_wq_add);
-		queue_work(nf_flow_offload_add_wq, &offload->work);
+		type = FLOW_OFFLOAD_BATCH_ADD;
+		wq = nf_flow_offload_add_wq;
 	} else if (offload->cmd == FLOW_CLS_DESTROY) {
 		NF_FLOW_TABLE_STAT_INC_ATOMIC(net, count_wq_del);
-		queue_work(nf_flow_offload_del_wq, &offload->work);
+		type = FLOW_OFFLOAD_BATCH_DEL;
+		wq = nf_flow_offload_del_wq;
 	} else {
 		NF_FLOW_TABLE_STAT_INC_ATOMIC(net, count_wq_stats);
-		queue_work(nf_flow_offload_stats_wq, &offload->work);
+		type = FLOW_OFFLOAD_BATCH_STATS;
+		wq = nf_flow_offload_stats_wq;
 	}
+
+	/* the first command of an empty batch kicks its worker */
+	batch = get_cpu_ptr(&flow_offload_batches[type]);
+	if (llist_add(&offload->llnode, &batch->cmds))
+		queue_work(wq, &batch->work);
+	put_cpu_ptr(&flow_offload_batches[type]);
 }
 
 static struct flow_offload_work *
@@ -1030,7 +1092,6 @@ nf_flow_offload_work_alloc(struct nf_flowtable *flowtable,
 	offload->cmd = cmd;
 	offload->flow = flow;
 	offload->flowtable = flowtable;
-	INIT_WORK(&offload->work, flow_offload_work_handler);
 
 	return offload;
 }
@@ -1209,6 +1270,17 @@ EXPORT_SYMBOL_GPL(nf_flow_table_offload_setup);
 
 int nf_flow_table_offload_init(void)
 {
+	struct flow_offload_batch *batch;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		for (i = 0; i < FLOW_OFFLOAD_BATCH_MAX; i++) {
+			batch = &per_cpu(flow_offload_batches[i], cpu);
+			init_llist_head(&batch->cmds);
+			INIT_WORK(&batch->work, flow_offload_batch_work);
+		}
+	}
+
 	nf_flow_offload_add_wq  = alloc_workqueue("nf_ft_offload_add",
 						  WQ_UNBOUND | WQ_SYSFS, 0);
 	if (!nf_flow_offload_add_wq)
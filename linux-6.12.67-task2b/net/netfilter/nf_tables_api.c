@@ -2133,18 +2133,27 @@ static void nft_chain_stats_replace(struct nft_trans_chain *trans)
 		static_branch_inc(&nft_counters_enabled);
 }
 
+static void nft_rule_blob_free(struct nft_rule_blob *blob)
+{
+	if (!blob)
+		return;
+
+	nft_jit_release(blob);
+	kvfree(blob);
+}
+
 static void nf_tables_chain_free_chain_rules(struct nft_chain *chain)
 {
 	struct nft_rule_blob *g0 = rcu_dereference_raw(chain->blob_gen_0);
 	struct nft_rule_blob *g1 = rcu_dereference_raw(chain->blob_gen_1);
 
 	if (g0 != g1)
-		kvfree(g1);
-	kvfree(g0);
+		nft_rule_blob_free(g1);
+	nft_rule_blob_free(g0);
 
 	/* should be NULL either via abort or via successful commit */
 	WARN_ON_ONCE(chain->blob_next);
-	kvfree(chain->blob_next);
+	nft_rule_blob_free(chain->blob_next);
 }
 
 void nf_tables_chain_destroy(struct nft_chain *chain)
@@ -2427,6 +2436,7 @@ static void nft_last_rule(const struct nft_chain *chain, const void *ptr)
 
 	lrule = (struct nft_rule_dp_last *)ptr;
 	lrule->end.is_last = 1;
+	lrule->end.jit = 0;
 	lrule->chain = chain;
 	/* blob size does not include the trailer rule */
 }
@@ -4432,6 +4442,9 @@ static const struct nft_set_type *nft_set_types[] = {
 	&nft_set_rbtree_type,
 #if defined(CONFIG_X86_64) && !defined(CONFIG_UML)
 	&nft_set_pipapo_avx2_type,
+#endif
+#if defined(CONFIG_ARM64) && defined(CONFIG_KERNEL_MODE_NEON)
+	&nft_set_pipapo_neon_type,
 #endif
 	&nft_set_pipapo_type,
 };
@@ -9848,6 +9861,70 @@ static bool nft_expr_reduce(struct nft_regs_track *track,
 	return false;
 }
 
+/*
+ * Rebuild the next blob of @chain with a pseudo-rule in front of each run of
+ * rules that can be compiled, see nf_tables_jit.c. This is best effort: on
+ * failure, the interpreted blob is kept.
+ */
+static void nf_tables_commit_chain_jit(struct nft_chain *chain)
+{
+	const unsigned int psize = sizeof(struct nft_rule_dp) +
+				   sizeof(struct nft_jit_run);
+	struct nft_rule_blob *blob = chain->blob_next, *jblob;
+	const struct nft_rule_dp *rule, *end;
+	unsigned long size = blob->size;
+	struct nft_rule_dp *prule;
+	void *data;
+
+	for (rule = (const void *)blob->data; !rule->is_last; ) {
+		if (nft_jit_run_find(rule, &end))
+			size += psize;
+		else
+			end = nft_rule_next(rule);
+		rule = end;
+	}
+
+	if (size == blob->size)
+		return;
+
+	jblob = nf_tables_chain_alloc_rules(chain, size);
+	if (!jblob)
+		return;
+
+	data = jblob->data;
+	for (rule = (const void *)blob->data; !rule->is_last; rule = end) {
+		unsigned int n = nft_jit_run_find(rule, &end);
+
+		if (!n) {
+			end = nft_rule_next(rule);
+			memcpy(data, rule, (void *)end - (void *)rule);
+			data += (void *)end - (void *)rule;
+			continue;
+		}
+
+		prule = data;
+		prule->is_last = 0;
+		prule->jit = 0;
+		prule->dlen = sizeof(struct nft_jit_run);
+		prule->handle = 0;
+		memcpy(data + psize, rule, (void *)end - (void *)rule);
+
+		if (nft_jit_compile(prule, n)) {
+			nft_last_rule(chain, prule);
+			nft_rule_blob_free(jblob);
+			return;
+		}
+
+		data += psize + ((void *)end - (void *)rule);
+	}
+
+	jblob->size = data - (void *)jblob->data;
+	nft_last_rule(chain, data);
+
+	kvfree(blob);
+	chain->blob_next = jblob;
+}
+
 static int nf_tables_commit_chain_prepare(struct net *net, struct nft_chain *chain)
 {
 	const struct nft_expr *expr, *last;
@@ -9909,6 +9986,7 @@ static int nf_tables_commit_chain_prepare(struct net *net, struct nft_chain *cha
 		prule->handle = rule->handle;
 		prule->dlen = size;
 		prule->is_last = 0;
+		prule->jit = 0;
 
 		data += size;
 		size = 0;
@@ -9921,6 +9999,9 @@ static int nf_tables_commit_chain_prepare(struct net *net, struct nft_chain *cha
 	prule = (struct nft_rule_dp *)data;
 	nft_last_rule(chain, prule);
 
+	if (nft_jit_enabled())
+		nf_tables_commit_chain_jit(chain);
+
 	return 0;
 }
 
@@ -9934,7 +10015,7 @@ static void nf_tables_commit_chain_prepare_cancel(struct net *net)
 		    trans->msg_type == NFT_MSG_DELRULE) {
 			struct nft_chain *chain = nft_trans_rule_chain(trans);
 
-			kvfree(chain->blob_next);
+			nft_rule_blob_free(chain->blob_next);
 			chain->blob_next = NULL;
 		}
 	}
@@ -9944,7 +10025,7 @@ static void __nf_tables_commit_chain_free_rules(struct rcu_head *h)
 {
 	struct nft_rule_dp_last *l = container_of(h, struct nft_rule_dp_last, h);
 
-	kvfree(l->blob);
+	nft_rule_blob_free(l->blob);
 }
 
 static void nf_tables_commit_chain_free_rules_old(struct nft_rule_blob *blob)
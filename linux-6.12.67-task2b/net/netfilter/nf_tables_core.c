@@ -276,6 +276,12 @@ do_chain:
 next_rule:
 	regs.verdict.code = NFT_CONTINUE;
 	for (; !rule->is_last ; rule = nft_rule_next(rule)) {
+		/* skip to the first rule of a compiled run which may match */
+		while (IS_ENABLED(CONFIG_NF_TABLES_JIT) && unlikely(rule->jit))
+			rule = nft_jit_run(rule, pkt);
+		if (unlikely(rule->is_last))
+			break;
+
 		nft_rule_dp_for_each_expr(expr, last, rule) {
 			if (expr->ops == &nft_cmp_fast_ops)
 				nft_cmp_fast_eval(expr, &regs);
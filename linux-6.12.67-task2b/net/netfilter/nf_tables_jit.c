@@ -0,0 +1,535 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Compilation of nf_tables rules to eBPF, run through the BPF JIT.
+ *
+ * Runs of consecutive rules which only match on packet data are compiled
+ * into one program when the chain blob is built on commit. A pseudo-rule,
+ * flagged with ->jit, is placed in front of the run and holds the program.
+ * nft_do_chain() runs the program instead of interpreting the rules: it
+ * returns the offset of the first rule of the run which matches, which is
+ * then evaluated by the interpreter as usual, or the offset past the run if
+ * none does. Rules that don't match have no side effects, so skipping them
+ * doesn't change the outcome.
+ *
+ * Supported are rules made of payload loads from network or transport
+ * header, meta l4proto and nfproto, bitwise and cmp on those, counters after
+ * the last cmp, and a final verdict. Whenever the program can't tell for
+ * sure, e.g. for data outside the linear area, it returns the offset of the
+ * current rule and interpretation takes over from there.
+ *
+ * Registers live on the BPF stack, one 32-bit slot per nft_regs word, and
+ * loads store the same bytes the corresponding expressions would.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bitmap.h>
+#include <linux/filter.h>
+#include <linux/skbuff.h>
+#include <linux/netfilter.h>
+#include <net/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+#include <net/netfilter/nft_meta.h>
+
+/* Shortest run of rules worth compiling, and longest run in one program */
+#define NFT_JIT_RUN_MIN		4
+#define NFT_JIT_RUN_MAX		1024
+
+/* Instructions emitted for each rule besides its expressions */
+#define NFT_JIT_RULE_INSNS	2
+
+#define NFT_JIT_NO_L4PROTO	U32_MAX
+
+static bool nft_jit_enable __read_mostly;
+module_param_named(jit, nft_jit_enable, bool, 0644);
+MODULE_PARM_DESC(jit, "Compile rules to eBPF, takes effect on next commit");
+
+/**
+ * struct nft_jit_ctx - Packet data passed to compiled programs
+ * @data:	skb->data, start of linear area
+ * @tail:	End of linear area
+ * @nh:		Network header
+ * @th:		Transport header, NULL if not known or for fragments
+ * @l4proto:	Layer 4 protocol number, NFT_JIT_NO_L4PROTO if not known
+ * @nfproto:	Protocol family of the hook
+ */
+struct nft_jit_ctx {
+	const u8	*data;
+	const u8	*tail;
+	const u8	*nh;
+	const u8	*th;
+	u32		l4proto;
+	u32		nfproto;
+};
+
+/**
+ * struct nft_jit_gen - Program being generated
+ * @insn:	Instructions
+ * @cap:	Size of @insn, @fail and @done
+ * @len:	Number of instructions emitted
+ * @fail:	Indices of jumps to the next rule, pending fixup
+ * @nfail:	Number of pending jumps to the next rule
+ * @done:	Indices of jumps to the end of the rule, pending fixup
+ * @ndone:	Number of pending jumps to the end of the rule
+ * @overflow:	More instructions were emitted than @cap, program is invalid
+ */
+struct nft_jit_gen {
+	struct bpf_insn	*insn;
+	unsigned int	cap;
+	unsigned int	len;
+	unsigned int	*fail;
+	unsigned int	nfail;
+	unsigned int	*done;
+	unsigned int	ndone;
+	bool		overflow;
+};
+
+bool nft_jit_enabled(void)
+{
+	return READ_ONCE(nft_jit_enable);
+}
+
+/* stack offset of nft_regs word @reg */
+static s16 nft_jit_slot(unsigned int reg)
+{
+	return -(s16)((NFT_REG32_NUM - reg) * NFT_REG32_SIZE);
+}
+
+/* past @gen->cap, nothing is written any more and the program is dropped */
+static void nft_jit_emit(struct nft_jit_gen *gen, struct bpf_insn insn)
+{
+	if (WARN_ON_ONCE(gen->len >= gen->cap)) {
+		gen->overflow = true;
+		return;
+	}
+	gen->insn[gen->len++] = insn;
+}
+
+/* conditional jump to the next rule, rule doesn't match */
+static void nft_jit_emit_fail(struct nft_jit_gen *gen, struct bpf_insn insn)
+{
+	if (gen->len < gen->cap)
+		gen->fail[gen->nfail++] = gen->len;
+	nft_jit_emit(gen, insn);
+}
+
+/* conditional jump to the end of the rule: matches, or needs interpreting */
+static void nft_jit_emit_done(struct nft_jit_gen *gen, struct bpf_insn insn)
+{
+	if (gen->len < gen->cap)
+		gen->done[gen->ndone++] = gen->len;
+	nft_jit_emit(gen, insn);
+}
+
+static void nft_jit_fixup(struct nft_jit_gen *gen, unsigned int *idx,
+			  unsigned int n, unsigned int target)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		gen->insn[idx[i]].off = target - idx[i] - 1;
+}
+
+static bool nft_jit_payload_ok(const struct nft_payload *priv)
+{
+	return priv->base == NFT_PAYLOAD_NETWORK_HEADER ||
+	       priv->base == NFT_PAYLOAD_TRANSPORT_HEADER;
+}
+
+/*
+ * Load @len bytes at @offset from network or transport header into register
+ * @dreg: R2 points to the data, bounds checked against the linear area.
+ */
+static void nft_jit_emit_payload(struct nft_jit_gen *gen,
+				 const struct nft_payload *priv)
+{
+	unsigned int dreg = priv->dreg, len = priv->len, off = 0;
+	bool th = priv->base == NFT_PAYLOAD_TRANSPORT_HEADER;
+
+	nft_jit_emit(gen, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_6,
+				      th ? offsetof(struct nft_jit_ctx, th) :
+					   offsetof(struct nft_jit_ctx, nh)));
+	if (th)
+		nft_jit_emit_done(gen, BPF_JMP_IMM(BPF_JEQ, BPF_REG_2, 0, 0));
+	if (priv->offset)
+		nft_jit_emit(gen, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2,
+						priv->offset));
+
+	nft_jit_emit(gen, BPF_LDX_MEM(BPF_DW, BPF_REG_3, BPF_REG_6,
+				      offsetof(struct nft_jit_ctx, data)));
+	nft_jit_emit_done(gen, BPF_JMP_REG(BPF_JLT, BPF_REG_2, BPF_REG_3, 0));
+	nft_jit_emit(gen, BPF_MOV64_REG(BPF_REG_3, BPF_REG_2));
+	nft_jit_emit(gen, BPF_ALU64_IMM(BPF_ADD, BPF_REG_3, len));
+	nft_jit_emit(gen, BPF_LDX_MEM(BPF_DW, BPF_REG_4, BPF_REG_6,
+				      offsetof(struct nft_jit_ctx, tail)));
+	nft_jit_emit_done(gen, BPF_JMP_REG(BPF_JGT, BPF_REG_3, BPF_REG_4, 0));
+
+	/* as nft_payload_eval(), clear the last word if partially written */
+	if (len % NFT_REG32_SIZE)
+		nft_jit_emit(gen, BPF_ST_MEM(BPF_W, BPF_REG_10,
+					     nft_jit_slot(dreg + len / NFT_REG32_SIZE),
+					     0));
+
+	for (; len - off >= 4; off += 4) {
+		nft_jit_emit(gen, BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_2, off));
+		nft_jit_emit(gen, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_3,
+					      nft_jit_slot(dreg) + off));
+	}
+	if (len - off >= 2) {
+		nft_jit_emit(gen, BPF_LDX_MEM(BPF_H, BPF_REG_3, BPF_REG_2, off));
+		nft_jit_emit(gen, BPF_STX_MEM(BPF_H, BPF_REG_10, BPF_REG_3,
+					      nft_jit_slot(dreg) + off));
+		off += 2;
+	}
+	if (len - off) {
+		nft_jit_emit(gen, BPF_LDX_MEM(BPF_B, BPF_REG_3, BPF_REG_2, off));
+		nft_jit_emit(gen, BPF_STX_MEM(BPF_B, BPF_REG_10, BPF_REG_3,
+					      nft_jit_slot(dreg) + off));
+	}
+}
+
+static bool nft_jit_meta_ok(const struct nft_meta *priv)
+{
+	return priv->key == NFT_META_L4PROTO || priv->key == NFT_META_NFPROTO;
+}
+
+/* nft_reg_store8() of l4proto or nfproto */
+static void nft_jit_emit_meta(struct nft_jit_gen *gen,
+			      const struct nft_meta *priv)
+{
+	if (priv->key == NFT_META_L4PROTO) {
+		nft_jit_emit(gen, BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_6,
+					      offsetof(struct nft_jit_ctx, l4proto)));
+		nft_jit_emit_done(gen, BPF_JMP32_IMM(BPF_JEQ, BPF_REG_3,
+						     NFT_JIT_NO_L4PROTO, 0));
+	} else {
+		nft_jit_emit(gen, BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_6,
+					      offsetof(struct nft_jit_ctx, nfproto)));
+	}
+
+	nft_jit_emit(gen, BPF_ST_MEM(BPF_W, BPF_REG_10,
+				     nft_jit_slot(priv->dreg), 0));
+	nft_jit_emit(gen, BPF_STX_MEM(BPF_B, BPF_REG_10, BPF_REG_3,
+				      nft_jit_slot(priv->dreg)));
+}
+
+static void nft_jit_emit_bitwise(struct nft_jit_gen *gen,
+				 const struct nft_bitwise_fast_expr *priv)
+{
+	nft_jit_emit(gen, BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_10,
+				      nft_jit_slot(priv->sreg)));
+	nft_jit_emit(gen, BPF_ALU32_IMM(BPF_AND, BPF_REG_3, priv->mask));
+	nft_jit_emit(gen, BPF_ALU32_IMM(BPF_XOR, BPF_REG_3, priv->xor));
+	nft_jit_emit(gen, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_3,
+				      nft_jit_slot(priv->dreg)));
+}
+
+static void nft_jit_emit_cmp(struct nft_jit_gen *gen,
+			     const struct nft_cmp_fast_expr *priv)
+{
+	nft_jit_emit(gen, BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_10,
+				      nft_jit_slot(priv->sreg)));
+	nft_jit_emit(gen, BPF_ALU32_IMM(BPF_AND, BPF_REG_3, priv->mask));
+	nft_jit_emit_fail(gen, BPF_JMP32_IMM(priv->inv ? BPF_JEQ : BPF_JNE,
+					     BPF_REG_3, priv->data, 0));
+}
+
+static void nft_jit_emit_cmp16(struct nft_jit_gen *gen,
+			       const struct nft_cmp16_fast_expr *priv)
+{
+	int i, n = ARRAY_SIZE(priv->data.data);
+
+	/* with inv, one mismatching word is enough to match */
+	for (i = 0; i < n; i++) {
+		nft_jit_emit(gen, BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_10,
+					      nft_jit_slot(priv->sreg + i)));
+		nft_jit_emit(gen, BPF_ALU32_IMM(BPF_AND, BPF_REG_3,
+						priv->mask.data[i]));
+		if (priv->inv)
+			nft_jit_emit(gen, BPF_JMP32_IMM(BPF_JNE, BPF_REG_3,
+							priv->data.data[i],
+							(n - i - 1) * 3 + 1));
+		else
+			nft_jit_emit_fail(gen, BPF_JMP32_IMM(BPF_JNE, BPF_REG_3,
+							     priv->data.data[i],
+							     0));
+	}
+	if (priv->inv)
+		nft_jit_emit_fail(gen, BPF_JMP_A(0));
+}
+
+static bool nft_jit_verdict_ok(const struct nft_immediate_expr *priv)
+{
+	return priv->dreg == NFT_REG_VERDICT &&
+	       priv->data.verdict.code != NFT_CONTINUE;
+}
+
+/*
+ * Check that all expressions of @rule can be compiled, that registers are
+ * written before being read, and that the rule ends with a verdict. No
+ * expression with side effects may come before a cmp, as the rule is only
+ * interpreted if it matches.
+ */
+static bool nft_jit_rule_ok(const struct nft_rule_dp *rule)
+{
+	DECLARE_BITMAP(written, NFT_REG32_NUM) = { 0 };
+	const struct nft_expr *expr = (const struct nft_expr *)rule->data;
+	const void *last = rule->data + rule->dlen;
+	bool side_effects = false, verdict = false;
+
+	if (rule->jit || !rule->dlen)
+		return false;
+
+	for (; (const void *)expr < last; expr = nft_expr_next(expr)) {
+		if (verdict)
+			return false;
+
+		if (expr->ops == &nft_payload_fast_ops ||
+		    expr->ops->eval == nft_payload_eval) {
+			const struct nft_payload *priv = nft_expr_priv(expr);
+
+			if (!nft_jit_payload_ok(priv))
+				return false;
+			bitmap_set(written, priv->dreg,
+				   DIV_ROUND_UP(priv->len, NFT_REG32_SIZE));
+		} else if (expr->ops->eval == nft_meta_get_eval) {
+			const struct nft_meta *priv = nft_expr_priv(expr);
+
+			if (!nft_jit_meta_ok(priv))
+				return false;
+			__set_bit(priv->dreg, written);
+		} else if (expr->ops == &nft_bitwise_fast_ops) {
+			const struct nft_bitwise_fast_expr *priv = nft_expr_priv(expr);
+
+			if (!test_bit(priv->sreg, written))
+				return false;
+			__set_bit(priv->dreg, written);
+		} else if (expr->ops == &nft_cmp_fast_ops) {
+			const struct nft_cmp_fast_expr *priv = nft_expr_priv(expr);
+
+			if (side_effects || !test_bit(priv->sreg, written))
+				return false;
+		} else if (expr->ops == &nft_cmp16_fast_ops) {
+			const struct nft_cmp16_fast_expr *priv = nft_expr_priv(expr);
+			unsigned int n = ARRAY_SIZE(priv->data.data);
+
+			if (side_effects ||
+			    find_next_zero_bit(written, priv->sreg + n,
+					       priv->sreg) < priv->sreg + n)
+				return false;
+		} else if (expr->ops->eval == nft_counter_eval) {
+			side_effects = true;
+		} else if (expr->ops->eval == nft_immediate_eval) {
+			if (!nft_jit_verdict_ok(nft_expr_priv(expr)))
+				return false;
+			verdict = true;
+		} else {
+			return false;
+		}
+	}
+
+	return verdict;
+}
+
+/**
+ * nft_jit_run_find() - Find run of rules worth compiling
+ * @rule:	First rule, in blob being built
+ * @end:	Filled with first rule past the run
+ *
+ * Return: number of rules in the run, 0 if too short to be compiled.
+ */
+unsigned int nft_jit_run_find(const struct nft_rule_dp *rule,
+			      const struct nft_rule_dp **end)
+{
+	unsigned int n = 0;
+
+	while (!rule->is_last && n < NFT_JIT_RUN_MAX && nft_jit_rule_ok(rule)) {
+		rule = nft_rule_next(rule);
+		n++;
+	}
+
+	*end = rule;
+
+	return n >= NFT_JIT_RUN_MIN ? n : 0;
+}
+
+/* Number of instructions nft_jit_emit_rule() emits for @expr, keep in sync */
+static unsigned int nft_jit_expr_insns(const struct nft_expr *expr)
+{
+	if (expr->ops == &nft_payload_fast_ops ||
+	    expr->ops->eval == nft_payload_eval) {
+		const struct nft_payload *priv = nft_expr_priv(expr);
+		unsigned int tail = priv->len % NFT_REG32_SIZE;
+
+		return 7 + (priv->base == NFT_PAYLOAD_TRANSPORT_HEADER) +
+		       !!priv->offset + !!tail + 2 * (priv->len / NFT_REG32_SIZE) +
+		       2 * (tail >= 2) + 2 * (tail & 1);
+	}
+	if (expr->ops->eval == nft_meta_get_eval) {
+		const struct nft_meta *priv = nft_expr_priv(expr);
+
+		return priv->key == NFT_META_L4PROTO ? 4 : 3;
+	}
+	if (expr->ops == &nft_bitwise_fast_ops)
+		return 4;
+	if (expr->ops == &nft_cmp_fast_ops)
+		return 3;
+	if (expr->ops == &nft_cmp16_fast_ops) {
+		const struct nft_cmp16_fast_expr *priv = nft_expr_priv(expr);
+
+		return ARRAY_SIZE(priv->data.data) * 3 + priv->inv;
+	}
+	return 0;
+}
+
+static void nft_jit_emit_rule(struct nft_jit_gen *gen,
+			      const struct nft_rule_dp *rule, u32 offset)
+{
+	const struct nft_expr *expr = (const struct nft_expr *)rule->data;
+	const void *last = rule->data + rule->dlen;
+
+	gen->nfail = 0;
+	gen->ndone = 0;
+
+	for (; (const void *)expr < last; expr = nft_expr_next(expr)) {
+		if (expr->ops == &nft_payload_fast_ops ||
+		    expr->ops->eval == nft_payload_eval)
+			nft_jit_emit_payload(gen, nft_expr_priv(expr));
+		else if (expr->ops->eval == nft_meta_get_eval)
+			nft_jit_emit_meta(gen, nft_expr_priv(expr));
+		else if (expr->ops == &nft_bitwise_fast_ops)
+			nft_jit_emit_bitwise(gen, nft_expr_priv(expr));
+		else if (expr->ops == &nft_cmp_fast_ops)
+			nft_jit_emit_cmp(gen, nft_expr_priv(expr));
+		else if (expr->ops == &nft_cmp16_fast_ops)
+			nft_jit_emit_cmp16(gen, nft_expr_priv(expr));
+		/* counter and verdict: done by the interpreter on match */
+	}
+
+	nft_jit_fixup(gen, gen->done, gen->ndone, gen->len);
+	nft_jit_emit(gen, BPF_MOV32_IMM(BPF_REG_0, offset));
+	nft_jit_emit(gen, BPF_EXIT_INSN());
+	nft_jit_fixup(gen, gen->fail, gen->nfail, gen->len);
+}
+
+/**
+ * nft_jit_compile() - Compile run of rules following pseudo-rule
+ * @prule:	Pseudo-rule, its data is filled with &struct nft_jit_run
+ * @n:		Number of rules in the run, from nft_jit_run_find()
+ *
+ * On success, ->jit is set on @prule, which is otherwise left untouched.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+int nft_jit_compile(struct nft_rule_dp *prule, unsigned int n)
+{
+	struct nft_jit_run *run = (struct nft_jit_run *)prule->data;
+	const struct nft_rule_dp *first = nft_rule_next(prule), *rule;
+	struct nft_jit_gen gen = { };
+	unsigned int cap, i;
+	struct bpf_prog *fp;
+	int err = -ENOMEM;
+
+	/* R6 setup, and no match exit */
+	cap = 3;
+	for (i = 0, rule = first; i < n; i++, rule = nft_rule_next(rule)) {
+		const struct nft_expr *expr = (const struct nft_expr *)rule->data;
+		const void *last = rule->data + rule->dlen;
+
+		cap += NFT_JIT_RULE_INSNS;
+		for (; (const void *)expr < last; expr = nft_expr_next(expr))
+			cap += nft_jit_expr_insns(expr);
+	}
+
+	gen.cap = cap;
+	gen.insn = kvmalloc_array(cap, sizeof(*gen.insn), GFP_KERNEL);
+	gen.fail = kvmalloc_array(cap, sizeof(*gen.fail), GFP_KERNEL);
+	gen.done = kvmalloc_array(cap, sizeof(*gen.done), GFP_KERNEL);
+	if (!gen.insn || !gen.fail || !gen.done)
+		goto out;
+
+	nft_jit_emit(&gen, BPF_MOV64_REG(BPF_REG_6, BPF_REG_1));
+	for (i = 0, rule = first; i < n; i++, rule = nft_rule_next(rule))
+		nft_jit_emit_rule(&gen, rule, (void *)rule - (void *)first);
+
+	/* no match: continue past the run */
+	nft_jit_emit(&gen, BPF_MOV32_IMM(BPF_REG_0, (void *)rule - (void *)first));
+	nft_jit_emit(&gen, BPF_EXIT_INSN());
+
+	err = -E2BIG;
+	if (gen.overflow)
+		goto out;
+
+	err = -ENOMEM;
+	fp = bpf_prog_alloc(bpf_prog_size(gen.len), 0);
+	if (!fp)
+		goto out;
+
+	memcpy(fp->insnsi, gen.insn, gen.len * sizeof(*gen.insn));
+	fp->len = gen.len;
+	fp->aux->stack_depth = NFT_REG32_NUM * NFT_REG32_SIZE;
+
+	fp = bpf_prog_select_runtime(fp, &err);
+	if (err) {
+		bpf_prog_free(fp);
+		goto out;
+	}
+
+	run->prog = fp;
+	run->rules = n;
+	prule->jit = 1;
+out:
+	kvfree(gen.done);
+	kvfree(gen.fail);
+	kvfree(gen.insn);
+
+	return err;
+}
+
+/**
+ * nft_jit_release() - Free programs of compiled runs in blob
+ * @blob:	Rule blob, about to be freed
+ */
+void nft_jit_release(struct nft_rule_blob *blob)
+{
+	const struct nft_rule_dp *rule = (const struct nft_rule_dp *)blob->data;
+
+	for (; !rule->is_last; rule = nft_rule_next(rule)) {
+		const struct nft_jit_run *run = (const void *)rule->data;
+
+		if (rule->jit)
+			bpf_prog_free(run->prog);
+	}
+}
+
+/**
+ * nft_jit_run() - Run compiled run of rules
+ * @prule:	Pseudo-rule in front of the run
+ * @pkt:	Packet information
+ *
+ * Return: first rule of the run that matches, or that needs interpreting,
+ * or first rule past the run if none does.
+ */
+const struct nft_rule_dp *nft_jit_run(const struct nft_rule_dp *prule,
+				      const struct nft_pktinfo *pkt)
+{
+	const struct nft_jit_run *run = (const void *)prule->data;
+	const struct nft_rule_dp *first = nft_rule_next(prule);
+	const struct sk_buff *skb = pkt->skb;
+	struct nft_jit_ctx ctx;
+
+	ctx.data = skb->data;
+	ctx.tail = skb_tail_pointer(skb);
+	ctx.nh = skb_network_header(skb);
+	ctx.nfproto = nft_pf(pkt);
+
+	if (pkt->flags & NFT_PKTINFO_L4PROTO) {
+		ctx.th = pkt->fragoff ? NULL : skb->data + nft_thoff(pkt);
+		ctx.l4proto = pkt->tprot;
+	} else {
+		ctx.th = NULL;
+		ctx.l4proto = NFT_JIT_NO_L4PROTO;
+	}
+
+	return (const void *)first + bpf_prog_run_pin_on_cpu(run->prog, &ctx);
+}
@@ -30,6 +30,10 @@
 #include <linux/netfilter/nf_conntrack_common.h>
 #include <linux/list.h>
 #include <linux/cgroup-defs.h>
+#include <linux/miscdevice.h>
+#include <linux/nsproxy.h>
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
 #include <net/gso.h>
 #include <net/sock.h>
 #include <net/tcp_states.h>
@@ -56,6 +60,40 @@
  */
 #define NFQNL_MAX_COPY_RANGE (0xffff - NLA_HDRLEN)
 
+#define NFQNL_RING_FRAME_MIN	256
+#define NFQNL_RING_FRAME_MAX	65536
+#define NFQNL_RING_FRAMES_MAX	65536
+#define NFQNL_RING_SIZE_MAX	(256 << 20)
+
+/* Shared memory transport of one queue, see struct nfq_ring_hdr. */
+struct nfqnl_ring {
+	refcount_t		ref;		/* file and queue */
+	struct mutex		mutex;		/* setup and verdicts */
+	struct net		*net;
+	u32			portid;
+	u16			queue_num;
+	unsigned int		frame_size;
+	unsigned int		frame_nr;
+	void			*area;
+	size_t			size;
+	struct nfq_ring_hdr	*hdr;
+	u8			*frames;
+	struct nfq_ring_verdict	*verdicts;
+	u32			rx_head;	/* under the queue lock */
+	u32			vr_tail;	/* under mutex */
+	wait_queue_head_t	wait;
+};
+
+static void nfqnl_ring_put(struct nfqnl_ring *ring)
+{
+	if (!refcount_dec_and_test(&ring->ref))
+		return;
+
+	vfree(ring->area);
+	put_net(ring->net);
+	kfree(ring);
+}
+
 struct nfqnl_instance {
 	struct hlist_node hlist;		/* global list of queues */
 	struct rcu_head rcu;
@@ -78,6 +116,7 @@ struct nfqnl_instance {
 	unsigned int	queue_total;
 	unsigned int	id_sequence;		/* 'sequence' of pkt ids */
 	struct list_head queue_list;		/* packets in queue */
+	struct nfqnl_ring *ring;		/* delivery instead of netlink */
 };
 
 typedef int (*nfqnl_cmpfn)(struct nf_queue_entry *, unsigned long);
@@ -172,6 +211,8 @@ instance_destroy_rcu(struct rcu_head *head)
 	rcu_read_lock();
 	nfqnl_flush(inst, NULL, 0);
 	rcu_read_unlock();
+	if (inst->ring)
+		nfqnl_ring_put(inst->ring);
 	kfree(inst);
 	module_put(THIS_MODULE);
 }
@@ -867,6 +908,93 @@ static bool nf_ct_drop_unconfirmed(const struct nf_queue_entry *entry)
 	return false;
 }
 
+/* Put @entry into a frame of the ring attached to @queue, -EAGAIN if none. */
+static int
+__nfqnl_ring_enqueue(struct nfqnl_instance *queue, struct nf_queue_entry *entry)
+{
+	struct sk_buff *entskb = entry->skb;
+	struct nfq_ring_frame *frame;
+	unsigned int data_len = 0;
+	struct nfqnl_ring *ring;
+	int err = -ENOBUFS;
+	int failopen = 0;
+
+	if (READ_ONCE(queue->copy_mode) == NFQNL_COPY_PACKET &&
+	    !(queue->flags & NFQA_CFG_F_GSO) &&
+	    entskb->ip_summed == CHECKSUM_PARTIAL &&
+	    nf_queue_checksum_help(entskb))
+		return -ENOMEM;
+
+	spin_lock_bh(&queue->lock);
+
+	ring = queue->ring;
+	if (!ring) {
+		spin_unlock_bh(&queue->lock);
+		return -EAGAIN;
+	}
+
+	if (nf_ct_drop_unconfirmed(entry))
+		goto err_out_unlock;
+
+	if (queue->queue_total >= queue->queue_maxlen) {
+		if (queue->flags & NFQA_CFG_F_FAIL_OPEN) {
+			failopen = 1;
+			err = 0;
+		} else {
+			queue->queue_dropped++;
+			net_warn_ratelimited("nf_queue: full at %d entries, dropping packets(s)\n",
+					     queue->queue_total);
+		}
+		goto err_out_unlock;
+	}
+
+	/* userspace still owns all frames */
+	if (ring->rx_head - READ_ONCE(ring->hdr->rx_tail) >= ring->frame_nr) {
+		if (queue->flags & NFQA_CFG_F_FAIL_OPEN) {
+			failopen = 1;
+			err = 0;
+		} else {
+			queue->queue_user_dropped++;
+		}
+		goto err_out_unlock;
+	}
+
+	frame = (void *)(ring->frames +
+			 (ring->rx_head & (ring->frame_nr - 1)) * ring->frame_size);
+	if (queue->copy_mode == NFQNL_COPY_PACKET)
+		data_len = min3(entskb->len, queue->copy_range,
+				ring->frame_size - NFQ_RING_FRAME_DATA);
+	if (skb_copy_bits(entskb, 0, (u8 *)frame + NFQ_RING_FRAME_DATA,
+			  data_len))
+		goto err_out_unlock;
+
+	entry->id = ++queue->id_sequence;
+	frame->id = entry->id;
+	frame->len = data_len;
+	frame->cap_len = entskb->len;
+	frame->mark = entskb->mark;
+	frame->priority = entskb->priority;
+	frame->indev = entry->state.in ? entry->state.in->ifindex : 0;
+	frame->outdev = entry->state.out ? entry->state.out->ifindex : 0;
+	frame->hw_protocol = entskb->protocol;
+	frame->hook = entry->state.hook;
+	frame->pf = entry->state.pf;
+
+	ring->rx_head++;
+	smp_store_release(&ring->hdr->rx_head, ring->rx_head);
+	__enqueue_entry(queue, entry);
+	wake_up_interruptible(&ring->wait);
+
+	spin_unlock_bh(&queue->lock);
+	return 0;
+
+err_out_unlock:
+	spin_unlock_bh(&queue->lock);
+	if (failopen)
+		nfqnl_reinject(entry, NF_ACCEPT);
+	return err;
+}
+
 static int
 __nfqnl_enqueue_packet(struct net *net, struct nfqnl_instance *queue,
 			struct nf_queue_entry *entry)
@@ -876,6 +1004,13 @@ __nfqnl_enqueue_packet(struct net *net, struct nfqnl_instance *queue,
 	__be32 *packet_id_ptr;
 	int failopen = 0;
 
+	if (READ_ONCE(queue->ring)) {
+		err = __nfqnl_ring_enqueue(queue, entry);
+		if (err != -EAGAIN)
+			return err;
+		err = -ENOBUFS;
+	}
+
 	nskb = nfqnl_build_packet_message(net, queue, entry, &packet_id_ptr);
 	if (nskb == NULL) {
 		err = -ENOMEM;
@@ -1469,6 +1604,279 @@ static int nfqnl_recv_verdict(struct sk_buff *skb, const struct nfnl_info *info,
 	return 0;
 }
 
+static void nfqnl_ring_verdict(struct nfqnl_ring *ring,
+			       struct nfqnl_instance *queue,
+			       const struct nfq_ring_verdict *v)
+{
+	unsigned int verdict = v->verdict;
+	struct nf_queue_entry *entry;
+
+	if ((verdict & NF_VERDICT_MASK) > NF_MAX_VERDICT ||
+	    (verdict & NF_VERDICT_MASK) == NF_STOLEN)
+		return;
+
+	entry = find_dequeue_entry(queue, v->id);
+	if (entry == NULL)
+		return;
+
+	/* the new payload is taken from the frame in place */
+	if (v->flags & NFQ_RING_VF_PAYLOAD) {
+		int diff = v->len - entry->skb->len;
+
+		if (v->frame >= ring->frame_nr ||
+		    v->len > ring->frame_size - NFQ_RING_FRAME_DATA ||
+		    nfqnl_mangle(ring->frames + v->frame * ring->frame_size +
+				 NFQ_RING_FRAME_DATA, v->len, entry, diff) < 0)
+			verdict = NF_DROP;
+	}
+
+	if (v->flags & NFQ_RING_VF_MARK)
+		entry->skb->mark = v->mark;
+
+	nfqnl_reinject(entry, verdict);
+}
+
+/* Consume all verdicts userspace has put into the verdict ring so far. */
+static int __nfqnl_ring_verdicts(struct nfqnl_ring *ring)
+{
+	struct nfqnl_instance *queue;
+	struct nfq_ring_verdict v;
+	int err = 0;
+	u32 head;
+
+	lockdep_assert_held(&ring->mutex);
+	if (!ring->hdr)
+		return -ENXIO;
+
+	head = smp_load_acquire(&ring->hdr->vr_head);
+	if (head - ring->vr_tail > ring->frame_nr)
+		return -EINVAL;
+
+	rcu_read_lock();
+	queue = verdict_instance_lookup(nfnl_queue_pernet(ring->net),
+					ring->queue_num, ring->portid);
+	if (IS_ERR(queue)) {
+		err = PTR_ERR(queue);
+		goto out_unlock;
+	}
+	if (READ_ONCE(queue->ring) != ring) {
+		err = -ENODEV;
+		goto out_unlock;
+	}
+
+	for (; ring->vr_tail != head; ring->vr_tail++) {
+		memcpy(&v, &ring->verdicts[ring->vr_tail & (ring->frame_nr - 1)],
+		       sizeof(v));
+		nfqnl_ring_verdict(ring, queue, &v);
+	}
+	smp_store_release(&ring->hdr->vr_tail, ring->vr_tail);
+
+out_unlock:
+	rcu_read_unlock();
+	return err;
+}
+
+static int nfqnl_ring_verdicts(struct nfqnl_ring *ring)
+{
+	int err;
+
+	mutex_lock(&ring->mutex);
+	err = __nfqnl_ring_verdicts(ring);
+	mutex_unlock(&ring->mutex);
+
+	return err;
+}
+
+static int nfqnl_ring_setup(struct file *file, struct nfqnl_ring *ring,
+			    const struct nfq_ring_req __user *ureq)
+{
+	struct nfnl_queue_net *q = nfnl_queue_pernet(ring->net);
+	struct nfqnl_instance *queue;
+	struct nfq_ring_req req;
+	size_t vr_off, size;
+	void *area;
+	int err;
+
+	if (!file_ns_capable(file, ring->net->user_ns, CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (copy_from_user(&req, ureq, sizeof(req)))
+		return -EFAULT;
+
+	if (req.queue_num > U16_MAX ||
+	    !is_power_of_2(req.frame_size) ||
+	    req.frame_size < NFQNL_RING_FRAME_MIN ||
+	    req.frame_size > NFQNL_RING_FRAME_MAX ||
+	    !is_power_of_2(req.frame_nr) ||
+	    req.frame_nr > NFQNL_RING_FRAMES_MAX ||
+	    (u64)req.frame_size * req.frame_nr > NFQNL_RING_SIZE_MAX)
+		return -EINVAL;
+
+	vr_off = PAGE_ALIGN(PAGE_SIZE + (size_t)req.frame_size * req.frame_nr);
+	size = PAGE_ALIGN(vr_off + req.frame_nr * sizeof(struct nfq_ring_verdict));
+
+	mutex_lock(&ring->mutex);
+	err = -EBUSY;
+	if (ring->area)
+		goto out;
+
+	err = -ENOMEM;
+	area = vmalloc_user(size);
+	if (!area)
+		goto out;
+
+	ring->area = area;
+	ring->size = size;
+	ring->portid = req.portid;
+	ring->queue_num = req.queue_num;
+	ring->frame_size = req.frame_size;
+	ring->frame_nr = req.frame_nr;
+	ring->frames = area + PAGE_SIZE;
+	ring->verdicts = area + vr_off;
+	ring->hdr = area;
+	ring->hdr->frame_size = req.frame_size;
+	ring->hdr->frame_nr = req.frame_nr;
+	ring->hdr->rx_off = PAGE_SIZE;
+	ring->hdr->vr_off = vr_off;
+
+	/* only the owner of the queue can redirect its packets */
+	rcu_read_lock();
+	queue = verdict_instance_lookup(q, req.queue_num, req.portid);
+	err = PTR_ERR_OR_ZERO(queue);
+	if (!err) {
+		spin_lock_bh(&queue->lock);
+		err = -EBUSY;
+		if (!queue->ring) {
+			refcount_inc(&ring->ref);
+			WRITE_ONCE(queue->ring, ring);
+			err = 0;
+		}
+		spin_unlock_bh(&queue->lock);
+	}
+	rcu_read_unlock();
+
+	if (err) {
+		ring->hdr = NULL;
+		ring->area = NULL;
+		vfree(area);
+	}
+out:
+	mutex_unlock(&ring->mutex);
+	return err;
+}
+
+static long nfqnl_ring_ioctl(struct file *file, unsigned int cmd,
+			     unsigned long arg)
+{
+	struct nfqnl_ring *ring = file->private_data;
+
+	switch (cmd) {
+	case NFQ_RING_IOC_SETUP:
+		return nfqnl_ring_setup(file, ring, (void __user *)arg);
+	case NFQ_RING_IOC_VERDICT:
+		return nfqnl_ring_verdicts(ring);
+	}
+
+	return -ENOTTY;
+}
+
+static int nfqnl_ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct nfqnl_ring *ring = file->private_data;
+	int err = -EINVAL;
+
+	mutex_lock(&ring->mutex);
+	if (ring->area && vma->vm_pgoff == 0 &&
+	    vma->vm_end - vma->vm_start == ring->size)
+		err = remap_vmalloc_range(vma, ring->area, 0);
+	mutex_unlock(&ring->mutex);
+
+	return err;
+}
+
+/* ring->hdr is only stable under the mutex, a failed setup frees it */
+static __poll_t nfqnl_ring_poll(struct file *file, poll_table *wait)
+{
+	struct nfqnl_ring *ring = file->private_data;
+	__poll_t mask = 0;
+
+	poll_wait(file, &ring->wait, wait);
+
+	mutex_lock(&ring->mutex);
+	if (__nfqnl_ring_verdicts(ring) == -ENXIO)
+		mask = EPOLLERR;
+	else if (smp_load_acquire(&ring->hdr->rx_head) !=
+		 READ_ONCE(ring->hdr->rx_tail))
+		mask = EPOLLIN | EPOLLRDNORM;
+	mutex_unlock(&ring->mutex);
+
+	return mask;
+}
+
+static int nfqnl_ring_open(struct inode *inode, struct file *file)
+{
+	struct nfqnl_ring *ring;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	refcount_set(&ring->ref, 1);
+	mutex_init(&ring->mutex);
+	init_waitqueue_head(&ring->wait);
+	ring->net = get_net(current->nsproxy->net_ns);
+	file->private_data = ring;
+
+	return 0;
+}
+
+/* Packets delivered through the ring are dropped once it goes away. */
+static int nfqnl_ring_release(struct inode *inode, struct file *file)
+{
+	struct nfqnl_ring *ring = file->private_data;
+	struct nfqnl_instance *queue;
+	bool attached = false;
+
+	rcu_read_lock();
+	queue = instance_lookup(nfnl_queue_pernet(ring->net), ring->queue_num);
+	if (queue) {
+		spin_lock_bh(&queue->lock);
+		if (queue->ring == ring) {
+			WRITE_ONCE(queue->ring, NULL);
+			attached = true;
+		}
+		spin_unlock_bh(&queue->lock);
+
+		if (attached)
+			nfqnl_flush(queue, NULL, 0);
+	}
+	rcu_read_unlock();
+
+	if (attached)
+		nfqnl_ring_put(ring);
+	nfqnl_ring_put(ring);
+
+	return 0;
+}
+
+static const struct file_operations nfqnl_ring_fops = {
+	.owner		= THIS_MODULE,
+	.open		= nfqnl_ring_open,
+	.release	= nfqnl_ring_release,
+	.unlocked_ioctl	= nfqnl_ring_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
+	.mmap		= nfqnl_ring_mmap,
+	.poll		= nfqnl_ring_poll,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice nfqnl_ring_dev = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "nfqueue",
+	.fops		= &nfqnl_ring_fops,
+	.mode		= 0600,
+};
+
 static int nfqnl_recv_unsupp(struct sk_buff *skb, const struct nfnl_info *info,
 			     const struct nlattr * const cda[])
 {
@@ -1798,10 +2206,18 @@ static int __init nfnetlink_queue_init(void)
 		goto cleanup_netlink_subsys;
 	}
 
+	status = misc_register(&nfqnl_ring_dev);
+	if (status < 0) {
+		pr_err("failed to register ring device\n");
+		goto cleanup_netdev_notifier;
+	}
+
 	nf_register_queue_handler(&nfqh);
 
 	return status;
 
+cleanup_netdev_notifier:
+	unregister_netdevice_notifier(&nfqnl_dev_notifier);
 cleanup_netlink_subsys:
 	nfnetlink_subsys_unregister(&nfqnl_subsys);
 cleanup_netlink_notifier:
@@ -1814,6 +2230,7 @@ out:
 static void __exit nfnetlink_queue_fini(void)
 {
 	nf_unregister_queue_handler();
+	misc_deregister(&nfqnl_ring_dev);
 	unregister_netdevice_notifier(&nfqnl_dev_notifier);
 	nfnetlink_subsys_unregister(&nfqnl_subsys);
 	netlink_unregister_notifier(&nfqnl_rtnl_notifier);
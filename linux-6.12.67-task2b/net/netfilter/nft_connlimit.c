@@ -15,6 +15,7 @@
 
 struct nft_connlimit {
 	struct nf_conncount_list	*list;
+	struct nf_conncount_sketch	*sketch;	/* NFT_CONNLIMIT_F_APPROX */
 	u32				limit;
 	bool				invert;
 };
@@ -27,6 +28,16 @@ static inline void nft_connlimit_do_eval(struct nft_connlimit *priv,
 	unsigned int count;
 	int err;
 
+	if (priv->sketch) {
+		count = nf_conncount_sketch_count_skb(priv->sketch, pkt->skb,
+						      NULL, 0);
+		if (!count) {
+			regs->verdict.code = NF_DROP;
+			return;
+		}
+		goto out;
+	}
+
 	err = nf_conncount_add_skb(nft_net(pkt), pkt->skb, nft_pf(pkt), priv->list);
 	if (err) {
 		if (err == -EEXIST) {
@@ -43,7 +54,7 @@ static inline void nft_connlimit_do_eval(struct nft_connlimit *priv,
 	}
 
 	count = priv->list->count;
-
+out:
 	if ((count > priv->limit) ^ priv->invert) {
 		regs->verdict.code = NFT_BREAK;
 		return;
@@ -54,7 +65,7 @@ static int nft_connlimit_do_init(const struct nft_ctx *ctx,
 				 const struct nlattr * const tb[],
 				 struct nft_connlimit *priv)
 {
-	bool invert = false;
+	bool invert = false, approx = false;
 	u32 flags, limit;
 	int err;
 
@@ -65,10 +76,12 @@ static int nft_connlimit_do_init(const struct nft_ctx *ctx,
 
 	if (tb[NFTA_CONNLIMIT_FLAGS]) {
 		flags = ntohl(nla_get_be32(tb[NFTA_CONNLIMIT_FLAGS]));
-		if (flags & ~NFT_CONNLIMIT_F_INV)
+		if (flags & ~(NFT_CONNLIMIT_F_INV | NFT_CONNLIMIT_F_APPROX))
 			return -EOPNOTSUPP;
 		if (flags & NFT_CONNLIMIT_F_INV)
 			invert = true;
+		if (flags & NFT_CONNLIMIT_F_APPROX)
+			approx = true;
 	}
 
 	priv->list = kmalloc(sizeof(*priv->list), GFP_KERNEL_ACCOUNT);
@@ -78,12 +91,25 @@ static int nft_connlimit_do_init(const struct nft_ctx *ctx,
 	nf_conncount_list_init(priv->list);
 	priv->limit	= limit;
 	priv->invert	= invert;
+	priv->sketch	= NULL;
 
 	err = nf_ct_netns_get(ctx->net, ctx->family);
 	if (err < 0)
 		goto err_netns;
 
+	/* one exact count: the expression is cloned per set element */
+	if (approx) {
+		priv->sketch = nf_conncount_sketch_create(ctx->net, 0,
+							  GFP_KERNEL_ACCOUNT);
+		if (IS_ERR(priv->sketch)) {
+			err = PTR_ERR(priv->sketch);
+			goto err_sketch;
+		}
+	}
+
 	return 0;
+err_sketch:
+	nf_ct_netns_put(ctx->net, ctx->family);
 err_netns:
 	kfree(priv->list);
 
@@ -94,6 +120,8 @@ static void nft_connlimit_do_destroy(const struct nft_ctx *ctx,
 				     struct nft_connlimit *priv)
 {
 	nf_ct_netns_put(ctx->net, ctx->family);
+	if (priv->sketch)
+		nf_conncount_sketch_destroy(priv->sketch);
 	nf_conncount_cache_free(priv->list);
 	kfree(priv->list);
 }
@@ -101,10 +129,17 @@ static void nft_connlimit_do_destroy(const struct nft_ctx *ctx,
 static int nft_connlimit_do_dump(struct sk_buff *skb,
 				 struct nft_connlimit *priv)
 {
+	u32 flags = 0;
+
+	if (priv->invert)
+		flags |= NFT_CONNLIMIT_F_INV;
+	if (priv->sketch)
+		flags |= NFT_CONNLIMIT_F_APPROX;
+
 	if (nla_put_be32(skb, NFTA_CONNLIMIT_COUNT, htonl(priv->limit)))
 		goto nla_put_failure;
-	if (priv->invert &&
-	    nla_put_be32(skb, NFTA_CONNLIMIT_FLAGS, htonl(NFT_CONNLIMIT_F_INV)))
+	if (flags &&
+	    nla_put_be32(skb, NFTA_CONNLIMIT_FLAGS, htonl(flags)))
 		goto nla_put_failure;
 
 	return 0;
@@ -216,6 +251,17 @@ static int nft_connlimit_clone(struct nft_expr *dst, const struct nft_expr *src,
 	nf_conncount_list_init(priv_dst->list);
 	priv_dst->limit	 = priv_src->limit;
 	priv_dst->invert = priv_src->invert;
+	priv_dst->sketch = NULL;
+
+	if (priv_src->sketch) {
+		priv_dst->sketch =
+			nf_conncount_sketch_create(priv_src->sketch->net, 0,
+						   gfp);
+		if (IS_ERR(priv_dst->sketch)) {
+			kfree(priv_dst->list);
+			return PTR_ERR(priv_dst->sketch);
+		}
+	}
 
 	return 0;
 }
@@ -225,6 +271,8 @@ static void nft_connlimit_destroy_clone(const struct nft_ctx *ctx,
 {
 	struct nft_connlimit *priv = nft_expr_priv(expr);
 
+	if (priv->sketch)
+		nf_conncount_sketch_destroy(priv->sketch);
 	nf_conncount_cache_free(priv->list);
 	kfree(priv->list);
 }
@@ -234,6 +282,11 @@ static bool nft_connlimit_gc(struct net *net, const struct nft_expr *expr)
 	struct nft_connlimit *priv = nft_expr_priv(expr);
 	bool ret;
 
+	/* set elements go once their count drops to zero */
+	if (priv->sketch)
+		return !nf_conncount_sketch_count_skb(priv->sketch, NULL,
+						      NULL, 0);
+
 	local_bh_disable();
 	ret = nf_conncount_gc_list(net, priv->list);
 	local_bh_enable();
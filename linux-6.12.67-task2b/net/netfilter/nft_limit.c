@@ -8,6 +8,7 @@
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/spinlock.h>
 #include <linux/netlink.h>
 #include <linux/netfilter.h>
@@ -20,36 +21,100 @@ struct nft_limit {
 	u64		tokens;
 };
 
+/* tokens a cpu took from the shared bucket ahead of time */
+struct nft_limit_cpu {
+	u64		tokens;
+};
+
+/*
+ * Each cpu takes at most tokens_max / (NFT_LIMIT_CPU_SHARE * ncpus) in one
+ * go, so tokens parked on other cpus can let a burst exceed the configured
+ * one by a quarter of the bucket, the rate itself is never exceeded.
+ */
+#define NFT_LIMIT_CPU_SHARE	4
+
 struct nft_limit_priv {
 	struct nft_limit *limit;
+	struct nft_limit_cpu __percpu *cpu;
 	u64		tokens_max;
+	u64		quantum;
 	u64		rate;
 	u64		nsecs;
 	u32		burst;
 	bool		invert;
 };
 
-static inline bool nft_limit_eval(struct nft_limit_priv *priv, u64 cost)
+/* Refill the shared bucket, then charge @cost and move some tokens to @lc. */
+static bool nft_limit_refill(struct nft_limit_priv *priv,
+			     struct nft_limit_cpu *lc, u64 cost)
 {
-	u64 now, tokens;
-	s64 delta;
+	u64 now, tokens, take;
+	bool ok = false;
 
-	spin_lock_bh(&priv->limit->lock);
+	spin_lock(&priv->limit->lock);
 	now = ktime_get_ns();
-	tokens = priv->limit->tokens + now - priv->limit->last;
+	tokens = priv->limit->tokens + now - priv->limit->last + lc->tokens;
 	if (tokens > priv->tokens_max)
 		tokens = priv->tokens_max;
 
 	priv->limit->last = now;
-	delta = tokens - cost;
-	if (delta >= 0) {
-		priv->limit->tokens = delta;
-		spin_unlock_bh(&priv->limit->lock);
-		return priv->invert;
+	lc->tokens = 0;
+	if (tokens >= cost) {
+		tokens -= cost;
+		take = min(tokens, priv->quantum);
+		lc->tokens = take;
+		tokens -= take;
+		ok = true;
 	}
 	priv->limit->tokens = tokens;
-	spin_unlock_bh(&priv->limit->lock);
-	return !priv->invert;
+	spin_unlock(&priv->limit->lock);
+
+	return ok;
+}
+
+static inline bool nft_limit_eval(struct nft_limit_priv *priv, u64 cost)
+{
+	struct nft_limit_cpu *lc, none = {};
+	bool ok;
+
+	local_bh_disable();
+	/* set elements take no share, see nft_limit_clone() */
+	lc = priv->cpu ? this_cpu_ptr(priv->cpu) : &none;
+	if (likely(lc->tokens >= cost)) {
+		lc->tokens -= cost;
+		ok = true;
+	} else {
+		ok = nft_limit_refill(priv, lc, cost);
+	}
+	local_bh_enable();
+
+	return ok ? priv->invert : !priv->invert;
+}
+
+static int nft_limit_alloc(struct nft_limit_priv *priv, gfp_t gfp, bool percpu)
+{
+	priv->limit = kmalloc(sizeof(*priv->limit), gfp);
+	if (!priv->limit)
+		return -ENOMEM;
+
+	priv->cpu = NULL;
+	priv->quantum = 0;
+	if (percpu) {
+		priv->cpu = alloc_percpu_gfp(struct nft_limit_cpu,
+					     gfp | __GFP_ZERO);
+		if (!priv->cpu) {
+			kfree(priv->limit);
+			return -ENOMEM;
+		}
+		priv->quantum = div_u64(priv->tokens_max,
+					NFT_LIMIT_CPU_SHARE * num_possible_cpus());
+	}
+
+	priv->limit->tokens = priv->tokens_max;
+	priv->limit->last = ktime_get_ns();
+	spin_lock_init(&priv->limit->lock);
+
+	return 0;
 }
 
 /* Use same default as in iptables. */
@@ -110,17 +175,10 @@ static int nft_limit_init(struct nft_limit_priv *priv,
 			invert = true;
 	}
 
-	priv->limit = kmalloc(sizeof(*priv->limit), GFP_KERNEL_ACCOUNT);
-	if (!priv->limit)
-		return -ENOMEM;
-
-	priv->limit->tokens = tokens;
-	priv->tokens_max = priv->limit->tokens;
+	priv->tokens_max = tokens;
 	priv->invert = invert;
-	priv->limit->last = ktime_get_ns();
-	spin_lock_init(&priv->limit->lock);
 
-	return 0;
+	return nft_limit_alloc(priv, GFP_KERNEL_ACCOUNT, true);
 }
 
 static int nft_limit_dump(struct sk_buff *skb, const struct nft_limit_priv *priv,
@@ -146,6 +204,7 @@ nla_put_failure:
 static void nft_limit_destroy(const struct nft_ctx *ctx,
 			      const struct nft_limit_priv *priv)
 {
+	free_percpu(priv->cpu);
 	kfree(priv->limit);
 }
 
@@ -158,15 +217,11 @@ static int nft_limit_clone(struct nft_limit_priv *priv_dst,
 	priv_dst->burst = priv_src->burst;
 	priv_dst->invert = priv_src->invert;
 
-	priv_dst->limit = kmalloc(sizeof(*priv_dst->limit), gfp);
-	if (!priv_dst->limit)
-		return -ENOMEM;
-
-	spin_lock_init(&priv_dst->limit->lock);
-	priv_dst->limit->tokens = priv_src->tokens_max;
-	priv_dst->limit->last = ktime_get_ns();
-
-	return 0;
+	/*
+	 * Clones are made per set element from the packet path, a per cpu
+	 * allocation each time is too costly. They use the shared bucket only.
+	 */
+	return nft_limit_alloc(priv_dst, gfp, false);
 }
 
 struct nft_limit_priv_pkts {
@@ -340,6 +340,7 @@
 #include <linux/bitops.h>
 
 #include "nft_set_pipapo_avx2.h"
+#include "nft_set_pipapo_neon.h"
 #include "nft_set_pipapo.h"
 
 /**
@@ -1238,11 +1239,220 @@ static bool nft_pipapo_transaction_mutex_held(const struct nft_set *set)
 }
 
 static struct nft_pipapo_match *pipapo_clone(struct nft_pipapo_match *old);
+static void pipapo_free_match(struct nft_pipapo_match *m);
+static bool pipapo_do_remove(struct nft_pipapo_match *m,
+			     const struct nft_pipapo_elem *e,
+			     const u8 *data, const u8 *data_end);
+
+/**
+ * pipapo_lt_size() - Get total size of lookup tables in matching data
+ * @m:		Matching data
+ *
+ * Return: size of all lookup tables, in bytes.
+ */
+static size_t pipapo_lt_size(const struct nft_pipapo_match *m)
+{
+	const struct nft_pipapo_field *f;
+	size_t size = 0;
+	int i;
+
+	nft_pipapo_for_each_field(f, i, m)
+		size += f->groups * NFT_PIPAPO_BUCKETS(f->bb) * f->bsize *
+			sizeof(*f->lt);
+
+	return size;
+}
+
+/**
+ * pipapo_do_insert() - Insert rules for element in lookup and mapping tables
+ * @m:		Matching data
+ * @start:	Start of range, one key for each field, padded
+ * @end:	End of range, same as @start for non-ranged elements
+ * @e:		Element the rules map to in the last field
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+static int pipapo_do_insert(struct nft_pipapo_match *m, const u8 *start,
+			    const u8 *end, struct nft_pipapo_elem *e)
+{
+	union nft_pipapo_map_bucket rulemap[NFT_PIPAPO_MAX_FIELDS];
+	struct nft_pipapo_field *f;
+	int i, bsize_max, err;
+
+	bsize_max = m->bsize_max;
+
+	nft_pipapo_for_each_field(f, i, m) {
+		int ret;
+
+		rulemap[i].to = f->rules;
+
+		ret = memcmp(start, end,
+			     f->groups / NFT_PIPAPO_GROUPS_PER_BYTE(f));
+		if (!ret)
+			ret = pipapo_insert(f, start, f->groups * f->bb);
+		else
+			ret = pipapo_expand(f, start, end, f->groups * f->bb);
+
+		if (ret < 0)
+			return ret;
+
+		if (f->bsize > bsize_max)
+			bsize_max = f->bsize;
+
+		rulemap[i].n = ret;
+
+		start += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
+		end += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
+	}
+
+	if (!*get_cpu_ptr(m->scratch) || bsize_max > m->bsize_max) {
+		put_cpu_ptr(m->scratch);
+
+		err = pipapo_realloc_scratch(m, bsize_max);
+		if (err)
+			return err;
+
+		m->bsize_max = bsize_max;
+	} else {
+		put_cpu_ptr(m->scratch);
+	}
+
+	pipapo_map(m, rulemap, e);
+
+	return 0;
+}
+
+/**
+ * pipapo_log() - Record insertion or removal of element in working copy
+ * @set:	nftables API set representation
+ * @e:		Element inserted in or removed from priv->clone
+ * @insert:	Insertion if true, removal otherwise
+ */
+static void pipapo_log(const struct nft_set *set, struct nft_pipapo_elem *e,
+		       bool insert)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_log *log = priv->log;
+	struct nft_pipapo_log_entry *ent;
+	const u8 *start, *end;
+
+	if (!log || !log->valid)
+		return;
+
+	if (log->count == NFT_PIPAPO_LOG_MAX) {
+		log->valid = false;
+		return;
+	}
+
+	start = (const u8 *)nft_set_ext_key(&e->ext)->data;
+	if (nft_set_ext_exists(&e->ext, NFT_SET_EXT_KEY_END))
+		end = (const u8 *)nft_set_ext_key_end(&e->ext)->data;
+	else
+		end = start;
+
+	ent = &log->ent[log->count++];
+	ent->e = e;
+	ent->insert = insert;
+	memcpy(ent->start, start, set->klen);
+	memcpy(ent->end, end, set->klen);
+}
+
+/**
+ * pipapo_log_invalidate() - Working copy changed in a way that can't be logged
+ * @set:	nftables API set representation
+ */
+static void pipapo_log_invalidate(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+
+	if (priv->log)
+		priv->log->valid = false;
+}
+
+/**
+ * pipapo_log_start() - Start recording changes to a new working copy
+ * @set:	nftables API set representation
+ * @m:		Current matching data, the working copy is equivalent to it
+ *
+ * Changes are only recorded for sets with large lookup tables, where replaying
+ * them is considerably cheaper than cloning all the tables. For smaller sets,
+ * drop the log, if any, so that commits don't keep a spare copy around.
+ */
+static void pipapo_log_start(const struct nft_set *set,
+			     const struct nft_pipapo_match *m)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+
+	if (pipapo_lt_size(m) < NFT_PIPAPO_SPARE_SIZE_MIN) {
+		kvfree(priv->log);
+		priv->log = NULL;
+		return;
+	}
+
+	if (!priv->log) {
+		priv->log = kvmalloc(sizeof(*priv->log), GFP_KERNEL_ACCOUNT);
+		if (!priv->log)
+			return;
+	}
+
+	priv->log->valid = true;
+	priv->log->count = 0;
+}
+
+/**
+ * pipapo_replay() - Bring spare copy of matching data up to date
+ * @set:	nftables API set representation
+ *
+ * The spare copy is the matching data replaced by the last commit, and the log
+ * holds the changes which made the current matching data out of it. Once no
+ * lookup can use the spare copy any longer, apply the same changes, in the
+ * same order, to get a working copy equivalent to the current matching data.
+ *
+ * Insertions and removals are deterministic, so rule indices end up the same
+ * as in the current matching data. Unlike pipapo_clone(), this only touches the
+ * rules of elements in the log, and needs no allocations unless tables resize.
+ *
+ * Return: spare copy, now usable as working copy, or NULL if there's none or
+ * replaying failed.
+ */
+static struct nft_pipapo_match *pipapo_replay(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *m = priv->spare;
+	const struct nft_pipapo_log *log = priv->log;
+	unsigned int i;
+
+	if (!m)
+		return NULL;
+
+	priv->spare = NULL;
+	cond_synchronize_rcu(priv->spare_gp);
+
+	for (i = 0; i < log->count; i++) {
+		const struct nft_pipapo_log_entry *ent = &log->ent[i];
+		int err = 0;
+
+		if (ent->insert)
+			err = pipapo_do_insert(m, ent->start, ent->end, ent->e);
+		else if (!pipapo_do_remove(m, ent->e, ent->start, ent->end))
+			err = -ENOENT;
+
+		if (err) {
+			pipapo_free_match(m);
+			return NULL;
+		}
+	}
+
+	return m;
+}
 
 /**
  * pipapo_maybe_clone() - Build clone for pending data changes, if not existing
  * @set:	nftables API set representation
  *
+ * If the last commit left a spare copy of matching data, update it from the
+ * log instead of cloning the current matching data.
+ *
  * Return: newly created or existing clone, if any. NULL on allocation failure
  */
 static struct nft_pipapo_match *pipapo_maybe_clone(const struct nft_set *set)
@@ -1255,7 +1465,12 @@ static struct nft_pipapo_match *pipapo_maybe_clone(const struct nft_set *set)
 
 	m = rcu_dereference_protected(priv->match,
 				      nft_pipapo_transaction_mutex_held(set));
-	priv->clone = pipapo_clone(m);
+
+	priv->clone = pipapo_replay(set);
+	if (!priv->clone)
+		priv->clone = pipapo_clone(m);
+	if (priv->clone)
+		pipapo_log_start(set, m);
 
 	return priv->clone;
 }
@@ -1274,7 +1489,6 @@ static int nft_pipapo_insert(const struct net *net, const struct nft_set *set,
 			     struct nft_elem_priv **elem_priv)
 {
 	const struct nft_set_ext *ext = nft_set_elem_ext(set, elem->priv);
-	union nft_pipapo_map_bucket rulemap[NFT_PIPAPO_MAX_FIELDS];
 	const u8 *start = (const u8 *)elem->key.val.data, *end;
 	struct nft_pipapo_match *m = pipapo_maybe_clone(set);
 	u8 genmask = nft_genmask_next(net);
@@ -1282,7 +1496,7 @@ static int nft_pipapo_insert(const struct net *net, const struct nft_set *set,
 	u64 tstamp = nft_net_tstamp(net);
 	struct nft_pipapo_field *f;
 	const u8 *start_p, *end_p;
-	int i, bsize_max, err = 0;
+	int i, err;
 
 	if (!m)
 		return -ENOMEM;
@@ -1341,48 +1555,17 @@ static int nft_pipapo_insert(const struct net *net, const struct nft_set *set,
 	}
 
 	/* Insert */
-	bsize_max = m->bsize_max;
-
-	nft_pipapo_for_each_field(f, i, m) {
-		int ret;
-
-		rulemap[i].to = f->rules;
-
-		ret = memcmp(start, end,
-			     f->groups / NFT_PIPAPO_GROUPS_PER_BYTE(f));
-		if (!ret)
-			ret = pipapo_insert(f, start, f->groups * f->bb);
-		else
-			ret = pipapo_expand(f, start, end, f->groups * f->bb);
-
-		if (ret < 0)
-			return ret;
-
-		if (f->bsize > bsize_max)
-			bsize_max = f->bsize;
-
-		rulemap[i].n = ret;
-
-		start += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
-		end += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
-	}
-
-	if (!*get_cpu_ptr(m->scratch) || bsize_max > m->bsize_max) {
-		put_cpu_ptr(m->scratch);
-
-		err = pipapo_realloc_scratch(m, bsize_max);
-		if (err)
-			return err;
+	e = nft_elem_priv_cast(elem->priv);
 
-		m->bsize_max = bsize_max;
-	} else {
-		put_cpu_ptr(m->scratch);
+	err = pipapo_do_insert(m, start, end, e);
+	if (err) {
+		/* Tables might be partially updated, don't replay this */
+		pipapo_log_invalidate(set);
+		return err;
 	}
 
-	e = nft_elem_priv_cast(elem->priv);
 	*elem_priv = &e->priv;
-
-	pipapo_map(m, rulemap, e);
+	pipapo_log(set, e, true);
 
 	return 0;
 }
@@ -1717,6 +1900,7 @@ static void pipapo_gc(struct nft_set *set, struct nft_pipapo_match *m)
 
 			nft_pipapo_gc_deactivate(net, set, e);
 			pipapo_drop(m, rulemap);
+			pipapo_log(set, e, false);
 			nft_trans_gc_elem_add(gc, e);
 
 			/* And check again current first rule, which is now the
@@ -1800,8 +1984,18 @@ static void nft_pipapo_commit(struct nft_set *set)
 				  nft_pipapo_transaction_mutex_held(set));
 	priv->clone = NULL;
 
-	if (old)
+	if (!old)
+		return;
+
+	/* If all the changes are logged, keep the old copy: the next
+	 * transaction can replay them on it, see pipapo_replay().
+	 */
+	if (priv->log && priv->log->valid) {
+		priv->spare = old;
+		priv->spare_gp = get_state_synchronize_rcu();
+	} else {
 		call_rcu(&old->rcu, pipapo_reclaim_match);
+	}
 }
 
 static void nft_pipapo_abort(const struct nft_set *set)
@@ -1812,6 +2006,9 @@ static void nft_pipapo_abort(const struct nft_set *set)
 		return;
 	pipapo_free_match(priv->clone);
 	priv->clone = NULL;
+
+	/* No spare copy is left at this point, see pipapo_maybe_clone() */
+	pipapo_log_invalidate(set);
 }
 
 /**
@@ -2008,27 +2205,19 @@ static bool pipapo_match_field(struct nft_pipapo_field *f,
 }
 
 /**
- * nft_pipapo_remove() - Remove element given key, commit
- * @net:	Network namespace
- * @set:	nftables API set representation
- * @elem_priv:	nftables API element representation containing key data
+ * pipapo_do_remove() - Drop rules for element given its keys
+ * @m:		Matching data
+ * @e:		Element the rules map to in the last field, only compared
+ * @data:	Start of range, one key for each field, padded
+ * @data_end:	End of range, same as @data for non-ranged elements
  *
- * Similarly to nft_pipapo_activate(), this is used as commit operation by the
- * API, but it's called once per element in the pending transaction, so we can't
- * implement this as a single commit operation. Closest we can get is to remove
- * the matched element here, if any, and commit the updated matching data.
+ * Return: true if the element was found and dropped, false otherwise.
  */
-static void nft_pipapo_remove(const struct net *net, const struct nft_set *set,
-			      struct nft_elem_priv *elem_priv)
+static bool pipapo_do_remove(struct nft_pipapo_match *m,
+			     const struct nft_pipapo_elem *e,
+			     const u8 *data, const u8 *data_end)
 {
-	struct nft_pipapo *priv = nft_set_priv(set);
-	struct nft_pipapo_match *m = priv->clone;
 	unsigned int rules_f0, first_rule = 0;
-	struct nft_pipapo_elem *e;
-	const u8 *data;
-
-	e = nft_elem_priv_cast(elem_priv);
-	data = (const u8 *)nft_set_ext_key(&e->ext);
 
 	while ((rules_f0 = pipapo_rules_same_key(m->f, first_rule))) {
 		union nft_pipapo_map_bucket rulemap[NFT_PIPAPO_MAX_FIELDS];
@@ -2037,11 +2226,7 @@ static void nft_pipapo_remove(const struct net *net, const struct nft_set *set,
 		int i, start, rules_fx;
 
 		match_start = data;
-
-		if (nft_set_ext_exists(&e->ext, NFT_SET_EXT_KEY_END))
-			match_end = (const u8 *)nft_set_ext_key_end(&e->ext)->data;
-		else
-			match_end = data;
+		match_end = data_end;
 
 		start = first_rule;
 		rules_fx = rules_f0;
@@ -2064,14 +2249,49 @@ static void nft_pipapo_remove(const struct net *net, const struct nft_set *set,
 
 			if (last && f->mt[rulemap[i].to].e == e) {
 				pipapo_drop(m, rulemap);
-				return;
+				return true;
 			}
 		}
 
 		first_rule += rules_f0;
 	}
 
-	WARN_ON_ONCE(1); /* elem_priv not found */
+	return false;
+}
+
+/**
+ * nft_pipapo_remove() - Remove element given key, commit
+ * @net:	Network namespace
+ * @set:	nftables API set representation
+ * @elem_priv:	nftables API element representation containing key data
+ *
+ * Similarly to nft_pipapo_activate(), this is used as commit operation by the
+ * API, but it's called once per element in the pending transaction, so we can't
+ * implement this as a single commit operation. Closest we can get is to remove
+ * the matched element here, if any, and commit the updated matching data.
+ */
+static void nft_pipapo_remove(const struct net *net, const struct nft_set *set,
+			      struct nft_elem_priv *elem_priv)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_elem *e;
+	const u8 *data, *data_end;
+
+	e = nft_elem_priv_cast(elem_priv);
+	data = (const u8 *)nft_set_ext_key(&e->ext);
+
+	if (nft_set_ext_exists(&e->ext, NFT_SET_EXT_KEY_END))
+		data_end = (const u8 *)nft_set_ext_key_end(&e->ext)->data;
+	else
+		data_end = data;
+
+	if (!pipapo_do_remove(priv->clone, e, data, data_end)) {
+		WARN_ON_ONCE(1); /* elem_priv not found */
+		pipapo_log_invalidate(set);
+		return;
+	}
+
+	pipapo_log(set, e, false);
 }
 
 /**
@@ -2319,6 +2539,11 @@ static void nft_pipapo_destroy(const struct nft_ctx *ctx,
 	}
 
 	pipapo_free_match(m);
+
+	/* Older than @m, no lookup can use it either */
+	if (priv->spare)
+		pipapo_free_match(priv->spare);
+	kvfree(priv->log);
 }
 
 /**
@@ -2384,3 +2609,28 @@ const struct nft_set_type nft_set_pipapo_avx2_type = {
 	},
 };
 #endif
+
+#if defined(CONFIG_ARM64) && defined(CONFIG_KERNEL_MODE_NEON)
+const struct nft_set_type nft_set_pipapo_neon_type = {
+	.features	= NFT_SET_INTERVAL | NFT_SET_MAP | NFT_SET_OBJECT |
+			  NFT_SET_TIMEOUT,
+	.ops		= {
+		.lookup		= nft_pipapo_neon_lookup,
+		.insert		= nft_pipapo_insert,
+		.activate	= nft_pipapo_activate,
+		.deactivate	= nft_pipapo_deactivate,
+		.flush		= nft_pipapo_flush,
+		.remove		= nft_pipapo_remove,
+		.walk		= nft_pipapo_walk,
+		.get		= nft_pipapo_get,
+		.privsize	= nft_pipapo_privsize,
+		.estimate	= nft_pipapo_neon_estimate,
+		.init		= nft_pipapo_init,
+		.destroy	= nft_pipapo_destroy,
+		.gc_init	= nft_pipapo_gc_init,
+		.commit		= nft_pipapo_commit,
+		.abort		= nft_pipapo_abort,
+		.elemsize	= offsetof(struct nft_pipapo_elem, ext),
+	},
+};
+#endif
@@ -39,6 +39,14 @@
 #define NFT_PIPAPO_LT_SIZE_LOW		NFT_PIPAPO_LT_SIZE_THRESHOLD -	\
 					NFT_PIPAPO_LT_SIZE_HYSTERESIS
 
+/* Keep the previous copy of matching data on commit, to replay the next
+ * transaction on it rather than cloning, if lookup tables exceed this size...
+ */
+#define NFT_PIPAPO_SPARE_SIZE_MIN	NFT_PIPAPO_LT_SIZE_THRESHOLD
+
+/* ...and if the transaction didn't change more than this many elements */
+#define NFT_PIPAPO_LOG_MAX		256
+
 /* Fields are padded to 32 bits in input registers */
 #define NFT_PIPAPO_GROUPS_PADDED_SIZE(f)				\
 	(round_up((f)->groups / NFT_PIPAPO_GROUPS_PER_BYTE(f), sizeof(u32)))
@@ -150,22 +158,54 @@ struct nft_pipapo_match {
 	struct nft_pipapo_field f[] __counted_by(field_count);
 };
 
+struct nft_pipapo_elem;
+
+/**
+ * struct nft_pipapo_log_entry - Change made to the working copy
+ * @e:		Element inserted or removed
+ * @insert:	Insertion if true, removal otherwise
+ * @start:	Copy of start key, @e might be freed by the time of replay
+ * @end:	Copy of end key, same as @start for non-ranged elements
+ */
+struct nft_pipapo_log_entry {
+	struct nft_pipapo_elem *e;
+	bool insert;
+	u8 start[NFT_DATA_VALUE_MAXLEN];
+	u8 end[NFT_DATA_VALUE_MAXLEN];
+};
+
+/**
+ * struct nft_pipapo_log - Changes made to the working copy since it was built
+ * @valid:	All changes are recorded, log can be replayed
+ * @count:	Number of entries
+ * @ent:	Entries, in order
+ */
+struct nft_pipapo_log {
+	bool valid;
+	unsigned int count;
+	struct nft_pipapo_log_entry ent[NFT_PIPAPO_LOG_MAX];
+};
+
 /**
  * struct nft_pipapo - Representation of a set
  * @match:	Currently in-use matching data
  * @clone:	Copy where pending insertions and deletions are kept
+ * @spare:	Matching data replaced by the last commit, @log brings it up to date
+ * @spare_gp:	RCU grace period cookie, @spare is unused by lookups after it
+ * @log:	Changes made to @clone, NULL if not kept for this set size
  * @width:	Total bytes to be matched for one packet, including padding
  * @last_gc:	Timestamp of last garbage collection run, jiffies
  */
 struct nft_pipapo {
 	struct nft_pipapo_match __rcu *match;
 	struct nft_pipapo_match *clone;
+	struct nft_pipapo_match *spare;
+	unsigned long spare_gp;
+	struct nft_pipapo_log *log;
 	int width;
 	unsigned long last_gc;
 };
 
-struct nft_pipapo_elem;
-
 /**
  * struct nft_pipapo_elem - API-facing representation of single set element
  * @priv:	element placeholder
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: NEON packet lookup routines
+ *
+ * The bucket intersection, which is where the time goes for large sets, is
+ * vectorised in nft_set_pipapo_neon_and.c. The rest of the lookup is the same
+ * as nft_set_pipapo.c, running within a NEON section. The set layout is the
+ * one of the generic implementation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+#include <uapi/linux/netfilter/nf_tables.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+
+#include <asm/neon.h>
+#include <asm/simd.h>
+
+#include "nft_set_pipapo_neon.h"
+#include "nft_set_pipapo.h"
+
+/**
+ * nft_pipapo_neon_estimate() - Set size, space and lookup complexity
+ * @desc:	Set description, element count and field description used
+ * @features:	Flags: NFT_SET_INTERVAL needs to be there
+ * @est:	Storage for estimation data
+ *
+ * Return: true if set is compatible and NEON available, false otherwise.
+ */
+bool nft_pipapo_neon_estimate(const struct nft_set_desc *desc, u32 features,
+			      struct nft_set_estimate *est)
+{
+	if (!(features & NFT_SET_INTERVAL) ||
+	    desc->field_count < NFT_PIPAPO_MIN_FIELDS)
+		return false;
+
+	if (!cpu_has_neon())
+		return false;
+
+	est->size = pipapo_estimate_size(desc);
+	if (!est->size)
+		return false;
+
+	est->lookup = NFT_SET_CLASS_O_LOG_N;
+
+	est->space = NFT_SET_CLASS_O_N;
+
+	return true;
+}
+
+/**
+ * nft_pipapo_neon_lookup() - Lookup function for NEON implementation
+ * @net:	Network namespace
+ * @set:	nftables API set representation
+ * @key:	nftables API element representation containing key data
+ *
+ * For more details, see DOC: Theory of Operation in nft_set_pipapo.c.
+ *
+ * Same as pipapo_get() on the active copy, with NEON bucket intersection.
+ * Falls back to nft_pipapo_lookup() if NEON can't be used in this context.
+ *
+ * Return: nftables API extension pointer or NULL if no match.
+ */
+const struct nft_set_ext *
+nft_pipapo_neon_lookup(const struct net *net, const struct nft_set *set,
+		       const u32 *key)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	const struct nft_set_ext *ext = NULL;
+	struct nft_pipapo_scratch *scratch;
+	const struct nft_pipapo_match *m;
+	const struct nft_pipapo_field *f;
+	const u8 *rp = (const u8 *)key;
+	u64 tstamp = get_jiffies_64();
+	unsigned long *res, *fill;
+	bool map_index;
+	int i;
+
+	local_bh_disable();
+
+	if (unlikely(!may_use_simd())) {
+		ext = nft_pipapo_lookup(net, set, key);
+
+		local_bh_enable();
+		return ext;
+	}
+
+	m = rcu_dereference(priv->match);
+
+	scratch = *raw_cpu_ptr(m->scratch);
+	if (unlikely(!scratch)) {
+		local_bh_enable();
+		return NULL;
+	}
+
+	kernel_neon_begin();
+
+	map_index = scratch->map_index;
+
+	res  = scratch->map + (map_index ? m->bsize_max : 0);
+	fill = scratch->map + (map_index ? 0 : m->bsize_max);
+
+	pipapo_resmap_init(m, res);
+
+	nft_pipapo_for_each_field(f, i, m) {
+		bool last = i == m->field_count - 1;
+		int b;
+
+		nft_pipapo_neon_and_buckets(f, res, rp);
+
+		rp += f->groups / NFT_PIPAPO_GROUPS_PER_BYTE(f);
+
+next_match:
+		b = pipapo_refill(res, f->bsize, f->rules, fill, f->mt, last);
+		if (b < 0) {
+			scratch->map_index = map_index;
+			break;
+		}
+
+		if (last) {
+			struct nft_pipapo_elem *e = f->mt[b].e;
+
+			if (unlikely(__nft_set_elem_expired(&e->ext, tstamp) ||
+				     !nft_set_elem_active(&e->ext,
+							  NFT_GENMASK_ANY)))
+				goto next_match;
+
+			/* As in pipapo_get(): fill is clean, keep it as the
+			 * next bitmap for the next packet.
+			 */
+			scratch->map_index = map_index;
+			ext = &e->ext;
+			break;
+		}
+
+		map_index = !map_index;
+		swap(res, fill);
+
+		rp += NFT_PIPAPO_GROUPS_PADDING(f);
+	}
+
+	kernel_neon_end();
+	local_bh_enable();
+
+	return ext;
+}
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: NEON bucket intersection
+ *
+ * This file is built with FPU flags: everything in here may be compiled to
+ * use NEON registers, and must only run between kernel_neon_begin() and
+ * kernel_neon_end(), see nft_set_pipapo_neon.c.
+ */
+
+#include <linux/kernel.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+#include <uapi/linux/netfilter/nf_tables.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+
+#include <asm/neon-intrinsics.h>
+
+#include "nft_set_pipapo_neon.h"
+#include "nft_set_pipapo.h"
+
+/* Two 4-bit groups per byte, at most */
+#define NFT_PIPAPO_NEON_MAX_GROUPS	(NFT_PIPAPO_MAX_BYTES * BITS_PER_BYTE / 4)
+
+/**
+ * nft_pipapo_neon_and_buckets() - Intersect all buckets selected by a field
+ * @f:		Field including lookup table
+ * @dst:	Result map, also initial bitmap for this field
+ * @data:	Input data selecting table buckets
+ *
+ * Equivalent to pipapo_and_field_buckets_4bit() and _8bit(), but instead of
+ * one pass over @dst for each group, all buckets selected by the packet are
+ * ANDed together in registers, 128 bits per NEON register, two registers per
+ * step, and @dst is loaded and stored only once.
+ */
+void nft_pipapo_neon_and_buckets(const struct nft_pipapo_field *f,
+				 unsigned long *dst, const u8 *data)
+{
+	const u64 *bucket[NFT_PIPAPO_NEON_MAX_GROUPS];
+	const unsigned long *lt = NFT_PIPAPO_LT_ALIGN(f->lt);
+	unsigned int bsize = f->bsize, b, g;
+	u64 *res = (u64 *)dst;
+
+	BUILD_BUG_ON(BITS_PER_LONG != 64);
+
+	for (g = 0; g < f->groups; g++) {
+		unsigned int v;
+
+		if (f->bb == 8)
+			v = data[g];
+		else if (g % 2)
+			v = data[g / 2] & 0x0f;
+		else
+			v = data[g / 2] >> 4;
+		NFT_PIPAPO_GROUP_BITS_ARE_8_OR_4;
+
+		bucket[g] = (const u64 *)lt + v * bsize;
+		lt += bsize * NFT_PIPAPO_BUCKETS(f->bb);
+	}
+
+	for (b = 0; b + 4 <= bsize; b += 4) {
+		uint64x2_t r0 = vld1q_u64(res + b);
+		uint64x2_t r1 = vld1q_u64(res + b + 2);
+
+		for (g = 0; g < f->groups; g++) {
+			r0 = vandq_u64(r0, vld1q_u64(bucket[g] + b));
+			r1 = vandq_u64(r1, vld1q_u64(bucket[g] + b + 2));
+		}
+
+		vst1q_u64(res + b, r0);
+		vst1q_u64(res + b + 2, r1);
+	}
+
+	if (b + 2 <= bsize) {
+		uint64x2_t r0 = vld1q_u64(res + b);
+
+		for (g = 0; g < f->groups; g++)
+			r0 = vandq_u64(r0, vld1q_u64(bucket[g] + b));
+
+		vst1q_u64(res + b, r0);
+		b += 2;
+	}
+
+	if (b < bsize) {
+		u64 r = res[b];
+
+		for (g = 0; g < f->groups; g++)
+			r &= bucket[g][b];
+
+		res[b] = r;
+	}
+}
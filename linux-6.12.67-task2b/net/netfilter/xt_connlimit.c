@@ -94,7 +94,10 @@ static int connlimit_mt_check(const struct xt_mtchk_param *par)
 	}
 
 	/* init private data */
-	info->data = nf_conncount_init(par->net, keylen);
+	if (info->flags & XT_CONNLIMIT_APPROX)
+		info->data = nf_conncount_init_approx(par->net, keylen);
+	else
+		info->data = nf_conncount_init(par->net, keylen);
 	if (IS_ERR(info->data))
 		nf_ct_netns_put(par->net, par->family);
 
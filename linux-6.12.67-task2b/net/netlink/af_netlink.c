@@ -1702,6 +1702,9 @@ static int netlink_setsockopt(struct socket *sock, int level, int optname,
 	case NETLINK_GET_STRICT_CHK:
 		nr = NETLINK_F_STRICT_CHK;
 		break;
+	case NETLINK_RECV_BATCH:
+		nr = NETLINK_F_RECV_BATCH;
+		break;
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -1769,6 +1772,9 @@ static int netlink_getsockopt(struct socket *sock, int level, int optname,
 	case NETLINK_GET_STRICT_CHK:
 		flag = NETLINK_F_STRICT_CHK;
 		break;
+	case NETLINK_RECV_BATCH:
+		flag = NETLINK_F_RECV_BATCH;
+		break;
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -1893,6 +1899,53 @@ out:
 	return err;
 }
 
+/* Continue a dump once user space has drained enough of the queue. */
+static void netlink_dump_refill(struct sock *sk)
+{
+	struct netlink_sock *nlk = nlk_sk(sk);
+	int ret;
+
+	if (READ_ONCE(nlk->cb_running) &&
+	    atomic_read(&sk->sk_rmem_alloc) <= sk->sk_rcvbuf / 2) {
+		ret = netlink_dump(sk, false);
+		if (ret) {
+			WRITE_ONCE(sk->sk_err, -ret);
+			sk_error_report(sk);
+		}
+	}
+}
+
+/*
+ * With NETLINK_RECV_BATCH, take the next queued skb if it comes from the
+ * same sender, group and peer netns as the first one and fits in @room, so
+ * that it can be returned by the same recvmsg() call. Address and control
+ * messages are only filled in from the first skb, @first holds its
+ * NETLINK_CB().
+ */
+static struct sk_buff *netlink_recv_next(struct sock *sk,
+					 const struct netlink_skb_parms *first,
+					 size_t room)
+{
+	struct sk_buff_head *queue = &sk->sk_receive_queue;
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	spin_lock_irqsave(&queue->lock, flags);
+	skb = skb_peek(queue);
+	if (skb && (skb->len > room || skb_has_frag_list(skb) ||
+		    NETLINK_CB(skb).portid != first->portid ||
+		    NETLINK_CB(skb).dst_group != first->dst_group ||
+		    NETLINK_CB(skb).nsid_is_set != first->nsid_is_set ||
+		    (first->nsid_is_set &&
+		     NETLINK_CB(skb).nsid != first->nsid)))
+		skb = NULL;
+	if (skb)
+		__skb_unlink(skb, queue);
+	spin_unlock_irqrestore(&queue->lock, flags);
+
+	return skb;
+}
+
 static int netlink_recvmsg(struct socket *sock, struct msghdr *msg, size_t len,
 			   int flags)
 {
@@ -1901,7 +1954,9 @@ static int netlink_recvmsg(struct socket *sock, struct msghdr *msg, size_t len,
 	struct netlink_sock *nlk = nlk_sk(sk);
 	size_t copied, max_recvmsg_len;
 	struct sk_buff *skb, *data_skb;
-	int err, ret;
+	struct netlink_skb_parms first;
+	bool batch;
+	int err;
 
 	if (flags & MSG_OOB)
 		return -EOPNOTSUPP;
@@ -1964,15 +2019,31 @@ static int netlink_recvmsg(struct socket *sock, struct msghdr *msg, size_t len,
 	if (flags & MSG_TRUNC)
 		copied = data_skb->len;
 
+	batch = nlk_test_bit(RECV_BATCH, sk) && !err && data_skb == skb &&
+		!(flags & (MSG_PEEK | MSG_TRUNC)) &&
+		!(msg->msg_flags & MSG_TRUNC);
+	first = NETLINK_CB(skb);
+
 	skb_free_datagram(sk, skb);
 
-	if (READ_ONCE(nlk->cb_running) &&
-	    atomic_read(&sk->sk_rmem_alloc) <= sk->sk_rcvbuf / 2) {
-		ret = netlink_dump(sk, false);
-		if (ret) {
-			WRITE_ONCE(sk->sk_err, -ret);
-			sk_error_report(sk);
-		}
+	netlink_dump_refill(sk);
+
+	/* Hand out as many whole skbs as fit, refilling a running dump
+	 * in between so a large buffer is filled in a single call.
+	 */
+	while (batch && copied < len) {
+		skb = netlink_recv_next(sk, &first, len - copied);
+		if (!skb)
+			break;
+
+		err = skb_copy_datagram_msg(skb, 0, msg, skb->len);
+		if (!err)
+			copied += skb->len;
+		skb_free_datagram(sk, skb);
+		if (err)
+			break;
+
+		netlink_dump_refill(sk);
 	}
 
 	scm_recv(sock, msg, &scm, flags);
@@ -42,6 +42,8 @@
 #define MC_HASH_SHIFT		8
 #define MC_HASH_SEGS		((sizeof(uint32_t) * 8) / MC_HASH_SHIFT)
 
+#define EMC_ENTRIES		256
+
 static struct kmem_cache *flow_cache;
 struct kmem_cache *flow_stats_cache __read_mostly;
 
@@ -418,9 +420,15 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	if (!mc)
 		return -ENOMEM;
 
+	table->emc = __alloc_percpu(array_size(sizeof(struct emc_entry),
+					       EMC_ENTRIES),
+				    __alignof__(struct emc_entry));
+	if (!table->emc)
+		goto free_mask_cache;
+
 	ma = tbl_mask_array_alloc(MASK_ARRAY_SIZE_MIN);
 	if (!ma)
-		goto free_mask_cache;
+		goto free_emc;
 
 	ti = table_instance_alloc(TBL_MIN_BUCKETS);
 	if (!ti)
@@ -434,6 +442,7 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	rcu_assign_pointer(table->ufid_ti, ufid_ti);
 	rcu_assign_pointer(table->mask_array, ma);
 	rcu_assign_pointer(table->mask_cache, mc);
+	table->emc_gen = 0;
 	table->last_rehash = jiffies;
 	table->count = 0;
 	table->ufid_count = 0;
@@ -443,6 +452,8 @@ free_ti:
 	__table_instance_destroy(ti);
 free_mask_array:
 	__mask_array_destroy(ma);
+free_emc:
+	free_percpu(table->emc);
 free_mask_cache:
 	__mask_cache_destroy(mc);
 	return -ENOMEM;
@@ -463,6 +474,8 @@ static void table_instance_flow_free(struct flow_table *table,
 {
 	hlist_del_rcu(&flow->flow_table.node[ti->node_ver]);
 	table->count--;
+	/* pairs with smp_load_acquire() in ovs_flow_tbl_lookup_stats() */
+	smp_store_release(&table->emc_gen, table->emc_gen + 1);
 
 	if (ovs_identifier_is_ufid(&flow->id)) {
 		hlist_del_rcu(&flow->ufid_table.node[ufid_ti->node_ver]);
@@ -519,6 +532,7 @@ void ovs_flow_tbl_destroy(struct flow_table *table)
 
 	call_rcu(&mc->rcu, mask_cache_rcu_cb);
 	call_rcu(&ma->rcu, mask_array_rcu_cb);
+	free_percpu(table->emc);
 	table_instance_destroy(ti, ufid_ti);
 }
 
@@ -662,19 +676,23 @@ static int flow_key_start(const struct sw_flow_key *key)
 				 sizeof(long));
 }
 
+/* Callers have already matched the hash, so the keys almost always turn
+ * out equal and every word has to be looked at anyway: accumulate the
+ * differences and test once at the end.
+ */
 static bool cmp_key(const struct sw_flow_key *key1,
 		    const struct sw_flow_key *key2,
 		    int key_start, int key_end)
 {
 	const long *cp1 = (const long *)((const u8 *)key1 + key_start);
 	const long *cp2 = (const long *)((const u8 *)key2 + key_start);
+	long diffs = 0;
 	int i;
 
 	for (i = key_start; i < key_end; i += sizeof(long))
-		if (*cp1++ ^ *cp2++)
-			return false;
+		diffs |= *cp1++ ^ *cp2++;
 
-	return true;
+	return diffs == 0;
 }
 
 static bool flow_cmp_masked_key(const struct sw_flow *flow,
@@ -773,7 +791,56 @@ static struct sw_flow *flow_lookup(struct flow_table *tbl,
 	return NULL;
 }
 
+/* Must be called with BH disabled, like flow_lookup(). */
+static struct sw_flow *emc_lookup(struct mask_array *ma,
+				  const struct emc_entry *e,
+				  const struct sw_flow_key *key,
+				  u32 skb_hash, unsigned long gen,
+				  u32 *n_mask_hit)
+{
+	struct mask_array_stats *stats;
+	struct sw_flow_key masked_key;
+	struct sw_flow_mask *mask;
+	struct sw_flow *flow;
+
+	if (e->skb_hash != skb_hash || e->gen != gen)
+		return NULL;
+
+	flow = e->flow;
+	mask = flow->mask;
+	ovs_flow_mask_key(&masked_key, key, false, mask);
+	(*n_mask_hit)++;
+	if (!flow_cmp_masked_key(flow, &masked_key, &mask->range))
+		return NULL;
+
+	/* Keep ranking the mask for ovs_flow_masks_rebalance(). */
+	if (likely(e->mask_index < ma->max &&
+		   rcu_dereference(ma->masks[e->mask_index]) == mask)) {
+		stats = this_cpu_ptr(ma->masks_usage_stats);
+		u64_stats_update_begin(&stats->syncp);
+		stats->usage_cntrs[e->mask_index]++;
+		u64_stats_update_end(&stats->syncp);
+	}
+	return flow;
+}
+
+static void emc_insert(struct emc_entry *e, u32 skb_hash, u32 mask_index,
+		       unsigned long gen, struct sw_flow *flow)
+{
+	e->skb_hash = skb_hash;
+	e->mask_index = mask_index;
+	e->gen = gen;
+	e->flow = flow;
+}
+
 /*
+ * In front of the mask cache, the per cpu exact match cache maps skb_hash
+ * straight to the flow it last found, so that a hit costs a single masked
+ * compare instead of a hash table lookup per mask tried. An entry only
+ * holds while no flow has been removed from the table since it was filled:
+ * the flow it points to may be freed after an RCU grace period. It is
+ * skipped along with the mask cache when the mask cache size is zero.
+ *
  * mask_cache maps flow to probable mask. This cache is not tightly
  * coupled cache, It means updates to  mask list can result in inconsistent
  * cache entry in mask cache.
@@ -790,7 +857,9 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 	struct mask_array *ma = rcu_dereference(tbl->mask_array);
 	struct table_instance *ti = rcu_dereference(tbl->ti);
 	struct mask_cache_entry *entries, *ce;
+	struct emc_entry *emc;
 	struct sw_flow *flow;
+	unsigned long gen;
 	u32 hash;
 	int seg;
 
@@ -810,6 +879,17 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 	if (key->recirc_id)
 		skb_hash = jhash_1word(skb_hash, key->recirc_id);
 
+	/* Sample before the lookup, so that a flow removed meanwhile can't
+	 * be cached as still there.
+	 */
+	gen = smp_load_acquire(&tbl->emc_gen);
+	emc = &this_cpu_ptr(tbl->emc)[skb_hash & (EMC_ENTRIES - 1)];
+	flow = emc_lookup(ma, emc, key, skb_hash, gen, n_mask_hit);
+	if (flow) {
+		(*n_cache_hit)++;
+		return flow;
+	}
+
 	ce = NULL;
 	hash = skb_hash;
 	entries = this_cpu_ptr(mc->mask_cache);
@@ -823,7 +903,10 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 		if (e->skb_hash == skb_hash) {
 			flow = flow_lookup(tbl, ti, ma, key, n_mask_hit,
 					   n_cache_hit, &e->mask_index);
-			if (!flow)
+			if (flow)
+				emc_insert(emc, skb_hash, e->mask_index, gen,
+					   flow);
+			else
 				e->skb_hash = 0;
 			return flow;
 		}
@@ -837,8 +920,10 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 	/* Cache miss, do full lookup. */
 	flow = flow_lookup(tbl, ti, ma, key, n_mask_hit, n_cache_hit,
 			   &ce->mask_index);
-	if (flow)
+	if (flow) {
 		ce->skb_hash = skb_hash;
+		emc_insert(emc, skb_hash, ce->mask_index, gen, flow);
+	}
 
 	*n_cache_hit = 0;
 	return flow;
@@ -33,6 +33,14 @@ struct mask_cache {
 	struct mask_cache_entry __percpu *mask_cache;
 };
 
+/* Exact match cache entry, see ovs_flow_tbl_lookup_stats(). */
+struct emc_entry {
+	u32 skb_hash;
+	u32 mask_index;
+	unsigned long gen;	/* flow_table emc_gen when filled */
+	struct sw_flow *flow;
+};
+
 struct mask_count {
 	int index;
 	u64 counter;
@@ -64,6 +72,8 @@ struct flow_table {
 	struct table_instance __rcu *ufid_ti;
 	struct mask_cache __rcu *mask_cache;
 	struct mask_array __rcu *mask_array;
+	struct emc_entry __percpu *emc;
+	unsigned long emc_gen;	/* bumped when a flow goes away */
 	unsigned long last_rehash;
 	unsigned int count;
 	unsigned int ufid_count;
@@ -195,6 +195,10 @@ static void *packet_previous_frame(struct packet_sock *po,
 		struct packet_ring_buffer *rb,
 		int status);
 static void packet_increment_head(struct packet_ring_buffer *buff);
+static unsigned int packet_frame_position(const struct packet_ring_buffer *rb,
+					  void *frame);
+static void packet_dec_pending(struct packet_ring_buffer *rb);
+static void __packet_set_status(struct packet_sock *po, void *frame, int status);
 static int prb_curr_blk_in_use(struct tpacket_block_desc *);
 static void *prb_dispatch_next_block(struct tpacket_kbdq_core *,
 			struct packet_sock *);
@@ -285,6 +289,158 @@ static int packet_xmit(const struct packet_sock *po, struct sk_buff *skb)
 	return dev_direct_xmit(skb, packet_pick_tx_queue(skb));
 }
 
+/* frames of a PACKET_QDISC_BYPASS tx ring handed to the driver at once */
+#define PACKET_TX_BATCH		32
+
+/* keep the first error of a batch, as packet_xmit() would have returned it */
+static void packet_batch_err(int *err, int ret)
+{
+	if (ret > 0)
+		ret = net_xmit_errno(ret);
+	if (ret && !*err)
+		*err = ret;
+}
+
+/*
+ * Send @ready to tx queue @queue_index under a single lock, as dev_direct_xmit().
+ * Stops with -ENOBUFS at the first frame the queue doesn't take, leaving it and
+ * the rest on @ready.
+ */
+static int packet_direct_xmit_queue(struct net_device *dev,
+				    struct sk_buff_head *ready, u16 queue_index)
+{
+	struct netdev_queue *txq;
+	struct sk_buff *skb;
+	int err = 0;
+
+	if (skb_queue_empty(ready))
+		return 0;
+
+	if (unlikely(!netif_running(dev) || !netif_carrier_ok(dev))) {
+		while ((skb = __skb_dequeue(ready))) {
+			kfree_skb(skb);
+			dev_core_stats_tx_dropped_inc(dev);
+		}
+		return net_xmit_errno(NET_XMIT_DROP);
+	}
+
+	txq = netdev_get_tx_queue(dev, queue_index);
+	local_bh_disable();
+	dev_xmit_recursion_inc();
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+	while ((skb = __skb_dequeue(ready))) {
+		netdev_tx_t ret = NETDEV_TX_BUSY;
+
+		if (!netif_xmit_frozen_or_drv_stopped(txq))
+			ret = netdev_start_xmit(skb, dev, txq,
+						!skb_queue_empty(ready));
+		if (!dev_xmit_complete(ret)) {
+			__skb_queue_head(ready, skb);
+			err = -ENOBUFS;
+			break;
+		}
+		packet_batch_err(&err, ret);
+	}
+	HARD_TX_UNLOCK(dev, txq);
+	dev_xmit_recursion_dec();
+	local_bh_enable();
+
+	return err;
+}
+
+/*
+ * Hand the frames of @batch back to user space as still to be sent, and move
+ * the ring head back to the first one, as tpacket_snd() does for a single
+ * frame the driver didn't take. They are the last frames taken off the ring.
+ */
+static void packet_batch_unsend(struct packet_sock *po,
+				struct sk_buff_head *batch)
+{
+	struct sk_buff *skb = skb_peek(batch);
+	void *ph;
+
+	if (!skb)
+		return;
+
+	po->tx_ring.head = packet_frame_position(&po->tx_ring,
+						 skb_zcopy_get_nouarg(skb));
+	while ((skb = __skb_dequeue(batch))) {
+		ph = skb_zcopy_get_nouarg(skb);
+		skb->destructor = sock_wfree;
+		consume_skb(skb);
+		packet_dec_pending(&po->tx_ring);
+		__packet_set_status(po, ph, TP_STATUS_SEND_REQUEST);
+	}
+}
+
+/*
+ * Send a batch of tx ring frames, signalling xmit_more to the driver for all
+ * but the last one of each run of frames going to the same tx queue. A run
+ * is sent under a single tx queue lock. Frames that fail validation or find
+ * the device down are dropped as dev_direct_xmit() would, their destructor
+ * gives the ring slot back to user space. At the first frame a stopped queue
+ * or the driver doesn't take, that frame and the rest of the batch go back
+ * to the ring as TP_STATUS_SEND_REQUEST. Returns the first error, like
+ * packet_xmit() does for a single frame.
+ */
+static int packet_direct_xmit_batch(struct packet_sock *po,
+				    struct net_device *dev,
+				    struct sk_buff_head *batch)
+{
+	struct sk_buff_head ready;
+	struct sk_buff *skb;
+	bool again = false;
+	u16 queue_index = 0;
+	int err = 0;
+
+	__skb_queue_head_init(&ready);
+	while ((skb = __skb_dequeue(batch))) {
+		struct sk_buff *orig_skb;
+		u16 skb_queue;
+
+#ifdef CONFIG_NETFILTER_EGRESS
+		if (nf_hook_egress_active()) {
+			skb = nf_hook_direct_egress(skb);
+			if (!skb) {
+				packet_batch_err(&err, NET_XMIT_DROP);
+				continue;
+			}
+		}
+#endif
+		skb_queue = packet_pick_tx_queue(skb);
+		if (skb_queue != queue_index) {
+			packet_batch_err(&err,
+					 packet_direct_xmit_queue(dev, &ready,
+								  queue_index));
+			if (unlikely(!skb_queue_empty(&ready))) {
+				__skb_queue_head(batch, skb);
+				goto unsent;
+			}
+		}
+		queue_index = skb_queue;
+
+		orig_skb = skb;
+		skb = validate_xmit_skb_list(skb, dev, &again);
+		if (skb != orig_skb) {
+			kfree_skb_list(skb);
+			dev_core_stats_tx_dropped_inc(dev);
+			packet_batch_err(&err, NET_XMIT_DROP);
+			continue;
+		}
+		skb_set_queue_mapping(skb, queue_index);
+		__skb_queue_tail(&ready, skb);
+	}
+
+	packet_batch_err(&err, packet_direct_xmit_queue(dev, &ready,
+							 queue_index));
+	if (likely(skb_queue_empty(&ready)))
+		return err;
+unsent:
+	skb_queue_splice_init(&ready, batch);
+	packet_batch_unsend(po, batch);
+	return err;
+}
+
 static struct net_device *packet_cached_dev_get(struct packet_sock *po)
 {
 	struct net_device *dev;
@@ -531,6 +687,25 @@ static void *packet_lookup_frame(const struct packet_sock *po,
 	return h.raw;
 }
 
+/* the position of tx ring frame @frame, as passed to packet_lookup_frame() */
+static unsigned int packet_frame_position(const struct packet_ring_buffer *rb,
+					  void *frame)
+{
+	unsigned int block_size = rb->frames_per_block * rb->frame_size;
+	unsigned int i;
+
+	for (i = 0; i < rb->pg_vec_len; i++) {
+		char *buffer = rb->pg_vec[i].buffer;
+
+		if ((char *)frame >= buffer && (char *)frame < buffer + block_size)
+			return i * rb->frames_per_block +
+			       ((char *)frame - buffer) / rb->frame_size;
+	}
+
+	WARN_ON_ONCE(1);
+	return rb->head;
+}
+
 static void *packet_current_frame(struct packet_sock *po,
 		struct packet_ring_buffer *rb,
 		int status)
@@ -2772,8 +2947,10 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	struct net_device *dev;
 	struct virtio_net_hdr *vnet_hdr = NULL;
 	struct sockcm_cookie sockc;
+	struct sk_buff_head batch;
+	bool batching;
 	__be16 proto;
-	int err, reserve = 0;
+	int err, xmit_err, reserve = 0;
 	void *ph;
 	DECLARE_SOCKADDR(struct sockaddr_ll *, saddr, msg->msg_name);
 	bool need_wait = !(msg->msg_flags & MSG_DONTWAIT);
@@ -2787,6 +2964,7 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	long timeo;
 
 	mutex_lock(&po->pg_vec_lock);
+	__skb_queue_head_init(&batch);
 
 	/* packet_sendmsg() check on tx_ring.pg_vec was lockless,
 	 * we need to confirm it under protection of pg_vec_lock.
@@ -2841,10 +3019,16 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	timeo = sock_sndtimeo(&po->sk, msg->msg_flags & MSG_DONTWAIT);
 	reinit_completion(&po->skb_completion);
 
+	batching = packet_sock_flag(po, PACKET_SOCK_QDISC_BYPASS);
+
 	do {
 		ph = packet_current_frame(po, &po->tx_ring,
 					  TP_STATUS_SEND_REQUEST);
 		if (unlikely(ph == NULL)) {
+			err = packet_direct_xmit_batch(po, dev, &batch);
+			if (unlikely(err))
+				goto out_put;
+
 			/* Note: packet_read_pending() might be slow if we
 			 * have to call it as it's per_cpu variable, but in
 			 * fast-path we don't have to call it, only when ph
@@ -2883,6 +3067,12 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 						    vnet_hdr->hdr_len);
 		}
 		copylen = max_t(int, copylen, dev->hard_header_len);
+		/* the batch holds sndbuf space, don't wait on it */
+		if (!skb_queue_empty(&batch) && !sock_writeable(&po->sk)) {
+			err = packet_direct_xmit_batch(po, dev, &batch);
+			if (unlikely(err))
+				goto out_put;
+		}
 		skb = sock_alloc_send_skb(&po->sk,
 				hlen + tlen + sizeof(struct sockaddr_ll) +
 				(copylen - dev->hard_header_len),
@@ -2905,6 +3095,15 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		if (unlikely(tp_len < 0)) {
 tpacket_error:
 			if (packet_sock_flag(po, PACKET_SOCK_TP_LOSS)) {
+				/*
+				 * Frames of the batch may go back to the ring,
+				 * don't leave a hole behind them.
+				 */
+				err = packet_direct_xmit_batch(po, dev, &batch);
+				if (unlikely(err)) {
+					kfree_skb(skb);
+					goto out_put;
+				}
 				__packet_set_status(po, ph,
 						TP_STATUS_AVAILABLE);
 				packet_increment_head(&po->tx_ring);
@@ -2930,6 +3129,17 @@ tpacket_error:
 		packet_inc_pending(&po->tx_ring);
 
 		status = TP_STATUS_SEND_REQUEST;
+		if (batching) {
+			__skb_queue_tail(&batch, skb);
+			packet_increment_head(&po->tx_ring);
+			len_sum += tp_len;
+			if (skb_queue_len(&batch) >= PACKET_TX_BATCH) {
+				err = packet_direct_xmit_batch(po, dev, &batch);
+				if (unlikely(err))
+					goto out_put;
+			}
+			continue;
+		}
 		err = packet_xmit(po, skb);
 		if (unlikely(err != 0)) {
 			if (err > 0)
@@ -2957,6 +3167,9 @@ out_status:
 	__packet_set_status(po, ph, status);
 	kfree_skb(skb);
 out_put:
+	xmit_err = packet_direct_xmit_batch(po, dev, &batch);
+	if (unlikely(xmit_err) && err >= 0)
+		err = xmit_err;
 	dev_put(dev);
 out:
 	mutex_unlock(&po->pg_vec_lock);
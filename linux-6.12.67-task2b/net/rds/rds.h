@@ -93,8 +93,10 @@ enum {
 
 /* Max number of multipaths per RDS connection. Must be a power of 2 */
 #define	RDS_MPATH_WORKERS	8
-#define	RDS_MPATH_HASH(rs, n) (jhash_1word(ntohs((rs)->rs_bound_port), \
-			       (rs)->rs_hash_initval) & ((n) - 1))
+/* Ordering is only promised per socket pair, so spread on both ports */
+#define	RDS_MPATH_HASH(rs, dport, n) \
+	(jhash_2words(ntohs((rs)->rs_bound_port), ntohs(dport), \
+		      (rs)->rs_hash_initval) & ((n) - 1))
 
 #define IS_CANONICAL(laddr, faddr) (htonl(laddr) < htonl(faddr))
 
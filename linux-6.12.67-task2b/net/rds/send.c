@@ -1042,14 +1042,15 @@ static int rds_cmsg_send(struct rds_sock *rs, struct rds_message *rm,
 }
 
 static int rds_send_mprds_hash(struct rds_sock *rs,
-			       struct rds_connection *conn, int nonblock)
+			       struct rds_connection *conn, __be16 dport,
+			       int nonblock)
 {
 	int hash;
 
 	if (conn->c_npaths == 0)
-		hash = RDS_MPATH_HASH(rs, RDS_MPATH_WORKERS);
+		hash = RDS_MPATH_HASH(rs, dport, RDS_MPATH_WORKERS);
 	else
-		hash = RDS_MPATH_HASH(rs, conn->c_npaths);
+		hash = RDS_MPATH_HASH(rs, dport, conn->c_npaths);
 	if (conn->c_npaths == 0 && hash != 0) {
 		rds_send_ping(conn, 0);
 
@@ -1304,7 +1305,8 @@ int rds_sendmsg(struct socket *sock, struct msghdr *msg, size_t payload_len)
 	}
 
 	if (conn->c_trans->t_mp_capable)
-		cpath = &conn->c_path[rds_send_mprds_hash(rs, conn, nonblock)];
+		cpath = &conn->c_path[rds_send_mprds_hash(rs, conn, dport,
+							  nonblock)];
 	else
 		cpath = &conn->c_path[0];
 
@@ -38,7 +38,8 @@
 
 static void svc_unregister(const struct svc_serv *serv, struct net *net);
 
-#define SVC_POOL_DEFAULT	SVC_POOL_GLOBAL
+/* one pool on single node machines, threads stay on their node otherwise */
+#define SVC_POOL_DEFAULT	SVC_POOL_PERNODE
 
 /*
  * Mode for mapping cpus to pools.
@@ -394,6 +395,9 @@ svc_pool_map_set_cpumask(struct task_struct *task, unsigned int pidx)
  * select the svc thread pool to use. Once initialized, the
  * svc_pool_map does not change.
  *
+ * The service may run fewer threads than there are pools. Work for
+ * a pool without threads goes to the next pool that has some.
+ *
  * Return value:
  *   A pointer to an svc_pool
  */
@@ -401,7 +405,8 @@ struct svc_pool *svc_pool_for_cpu(struct svc_serv *serv)
 {
 	struct svc_pool_map *m = &svc_pool_map;
 	int cpu = raw_smp_processor_id();
-	unsigned int pidx = 0;
+	unsigned int pidx = 0, i;
+	struct svc_pool *pool;
 
 	if (serv->sv_nrpools <= 1)
 		return serv->sv_pools;
@@ -415,6 +420,11 @@ struct svc_pool *svc_pool_for_cpu(struct svc_serv *serv)
 		break;
 	}
 
+	for (i = 0; i < serv->sv_nrpools; i++) {
+		pool = &serv->sv_pools[(pidx + i) % serv->sv_nrpools];
+		if (READ_ONCE(pool->sp_nrthreads))
+			return pool;
+	}
 	return &serv->sv_pools[pidx % serv->sv_nrpools];
 }
 
@@ -545,6 +555,7 @@ __svc_create(struct svc_program *prog, int nprogs, struct svc_stat *stats,
 		percpu_counter_init(&pool->sp_messages_arrived, 0, GFP_KERNEL);
 		percpu_counter_init(&pool->sp_sockets_queued, 0, GFP_KERNEL);
 		percpu_counter_init(&pool->sp_threads_woken, 0, GFP_KERNEL);
+		percpu_counter_init(&pool->sp_threads_starved, 0, GFP_KERNEL);
 	}
 
 	return serv;
@@ -629,6 +640,7 @@ svc_destroy(struct svc_serv **servp)
 		percpu_counter_destroy(&pool->sp_messages_arrived);
 		percpu_counter_destroy(&pool->sp_sockets_queued);
 		percpu_counter_destroy(&pool->sp_threads_woken);
+		percpu_counter_destroy(&pool->sp_threads_starved);
 	}
 	kfree(serv->sv_pools);
 	kfree(serv);
@@ -714,7 +726,7 @@ svc_prepare_thread(struct svc_serv *serv, struct svc_pool *pool, int node)
 	rqstp->rq_err = -EAGAIN; /* No error yet */
 
 	serv->sv_nrthreads += 1;
-	pool->sp_nrthreads += 1;
+	WRITE_ONCE(pool->sp_nrthreads, pool->sp_nrthreads + 1);
 
 	/* Protected by whatever lock the service uses when calling
 	 * svc_set_num_threads()
@@ -736,6 +748,8 @@ out_enomem:
  * service thread and marking it BUSY is atomic with respect to
  * other calls to svc_pool_wake_idle_thread().
  *
+ * If every thread of @pool is busy, sp_threads_starved is bumped so that
+ * the thread count of the pool can be scaled to its load.
  */
 void svc_pool_wake_idle_thread(struct svc_pool *pool)
 {
@@ -757,6 +771,7 @@ void svc_pool_wake_idle_thread(struct svc_pool *pool)
 	}
 	rcu_read_unlock();
 
+	percpu_counter_inc(&pool->sp_threads_starved);
 }
 EXPORT_SYMBOL_GPL(svc_pool_wake_idle_thread);
 
@@ -959,7 +974,7 @@ svc_exit_thread(struct svc_rqst *rqstp)
 
 	list_del_rcu(&rqstp->rq_all);
 
-	pool->sp_nrthreads -= 1;
+	WRITE_ONCE(pool->sp_nrthreads, pool->sp_nrthreads - 1);
 	serv->sv_nrthreads -= 1;
 	svc_sock_update_bufs(serv);
 
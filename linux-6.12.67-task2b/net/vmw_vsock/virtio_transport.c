@@ -26,6 +26,9 @@ static struct virtio_vsock __rcu *the_virtio_vsock;
 static DEFINE_MUTEX(the_virtio_vsock_mutex); /* protects the_virtio_vsock */
 static struct virtio_transport virtio_transport; /* forward declaration */
 
+/* Buffers added to or reclaimed from the rx/tx queues at once */
+#define VIRTIO_VSOCK_BATCH 16
+
 struct virtio_vsock {
 	struct virtio_device *vdev;
 	struct virtqueue *vqs[VSOCK_VQ_MAX];
@@ -166,6 +169,7 @@ virtio_transport_send_pkt_work(struct work_struct *work)
 		goto out;
 
 	vq = vsock->vqs[VSOCK_VQ_TX];
+	virtqueue_add_batch_begin(vq);
 
 	for (;;) {
 		struct sk_buff *skb;
@@ -198,6 +202,7 @@ virtio_transport_send_pkt_work(struct work_struct *work)
 		added = true;
 	}
 
+	virtqueue_add_batch_end(vq);
 	if (added)
 		virtqueue_kick(vq);
 
@@ -308,7 +313,9 @@ out_rcu:
 static void virtio_vsock_rx_fill(struct virtio_vsock *vsock)
 {
 	int total_len = VIRTIO_VSOCK_DEFAULT_RX_BUF_SIZE;
-	struct scatterlist pkt, *p;
+	struct scatterlist pkts[VIRTIO_VSOCK_BATCH], *sgs[VIRTIO_VSOCK_BATCH];
+	void *skbs[VIRTIO_VSOCK_BATCH];
+	unsigned int i, n, want;
 	struct virtqueue *vq;
 	struct sk_buff *skb;
 	int ret;
@@ -316,21 +323,28 @@ static void virtio_vsock_rx_fill(struct virtio_vsock *vsock)
 	vq = vsock->vqs[VSOCK_VQ_RX];
 
 	do {
-		skb = virtio_vsock_alloc_skb(total_len, GFP_KERNEL);
-		if (!skb)
+		want = min_t(unsigned int, vq->num_free, VIRTIO_VSOCK_BATCH);
+		for (n = 0; n < want; n++) {
+			skb = virtio_vsock_alloc_skb(total_len, GFP_KERNEL);
+			if (!skb)
+				break;
+
+			memset(skb->head, 0, VIRTIO_VSOCK_SKB_HEADROOM);
+			sg_init_one(&pkts[n], virtio_vsock_hdr(skb), total_len);
+			sgs[n] = &pkts[n];
+			skbs[n] = skb;
+		}
+		if (!n)
 			break;
 
-		memset(skb->head, 0, VIRTIO_VSOCK_SKB_HEADROOM);
-		sg_init_one(&pkt, virtio_vsock_hdr(skb), total_len);
-		p = &pkt;
-		ret = virtqueue_add_sgs(vq, &p, 0, 1, skb, GFP_KERNEL);
-		if (ret < 0) {
-			kfree_skb(skb);
+		ret = virtqueue_add_inbufs(vq, sgs, skbs, n, GFP_KERNEL);
+		for (i = max(ret, 0); i < n; i++)
+			kfree_skb(skbs[i]);
+		if (ret < 0)
 			break;
-		}
 
-		vsock->rx_buf_nr++;
-	} while (vq->num_free);
+		vsock->rx_buf_nr += ret;
+	} while (ret == want && vq->num_free);
 	if (vsock->rx_buf_nr > vsock->rx_buf_max_nr)
 		vsock->rx_buf_max_nr = vsock->rx_buf_nr;
 	virtqueue_kick(vq);
@@ -350,12 +364,15 @@ static void virtio_transport_tx_work(struct work_struct *work)
 		goto out;
 
 	do {
-		struct sk_buff *skb;
-		unsigned int len;
+		unsigned int lens[VIRTIO_VSOCK_BATCH];
+		void *skbs[VIRTIO_VSOCK_BATCH];
+		unsigned int i, n;
 
 		virtqueue_disable_cb(vq);
-		while ((skb = virtqueue_get_buf(vq, &len)) != NULL) {
-			virtio_transport_consume_skb_sent(skb, true);
+		while ((n = virtqueue_get_bufs(vq, skbs, lens,
+					       VIRTIO_VSOCK_BATCH))) {
+			for (i = 0; i < n; i++)
+				virtio_transport_consume_skb_sent(skbs[i], true);
 			added = true;
 		}
 	} while (!virtqueue_enable_cb(vq));
@@ -528,6 +528,46 @@ static int xsk_wakeup(struct xdp_sock *xs, u8 flags)
 	return dev->netdev_ops->ndo_xsk_wakeup(dev, xs->queue_id, flags);
 }
 
+/*
+ * Wake up Tx on all queues of xs->dev whose pool sits on the same umem.
+ * Those pools belong to other sockets and may be released at any time, they
+ * are only freed after a grace period. Called under rcu_read_lock().
+ */
+static int xsk_wakeup_all(struct xdp_sock *xs)
+{
+	struct net_device *dev = xs->dev;
+	u16 qid, nr_queues;
+	int err, ret = 0;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+	nr_queues = max(dev->real_num_rx_queues, dev->real_num_tx_queues);
+	for (qid = 0; qid < nr_queues; qid++) {
+		struct xsk_buff_pool *pool = xsk_get_pool_from_qid(dev, qid);
+
+		if (!pool || pool->umem != xs->umem ||
+		    !(pool->cached_need_wakeup & XDP_WAKEUP_TX))
+			continue;
+
+		err = dev->netdev_ops->ndo_xsk_wakeup(dev, qid, XDP_WAKEUP_TX);
+		if (err && !ret)
+			ret = err;
+	}
+
+	return ret;
+}
+
+static bool xsk_msg_wakeup_all(struct msghdr *m)
+{
+	DECLARE_SOCKADDR(struct sockaddr_xdp *, sxdp, m->msg_name);
+
+	/* Older applications may pass anything here, only honour a valid
+	 * AF_XDP address.
+	 */
+	return sxdp && m->msg_namelen >= sizeof(*sxdp) &&
+	       sxdp->sxdp_family == AF_XDP &&
+	       (sxdp->sxdp_flags & XDP_WAKEUP_ALL);
+}
+
 static int xsk_cq_reserve_addr_locked(struct xdp_sock *xs, u64 addr)
 {
 	unsigned long flags;
@@ -918,6 +958,9 @@ static int __xsk_sendmsg(struct socket *sock, struct msghdr *m, size_t total_len
 	if (xs->zc && xsk_no_wakeup(sk))
 		return 0;
 
+	if (xs->zc && xsk_msg_wakeup_all(m))
+		return xsk_wakeup_all(xs);
+
 	pool = xs->pool;
 	if (pool->cached_need_wakeup & XDP_WAKEUP_TX) {
 		if (xs->zc)
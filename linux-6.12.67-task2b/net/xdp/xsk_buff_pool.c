@@ -240,6 +240,8 @@ err_unreg_pool:
 		err = 0; /* fallback to copy mode */
 	if (err) {
 		xsk_clear_pool_at_qid(netdev, queue_id);
+		/* the caller frees the pool, see xp_release_deferred() */
+		synchronize_net();
 		dev_put(netdev);
 	}
 	return err;
@@ -282,6 +284,9 @@ static void xp_release_deferred(struct work_struct *work)
 	xp_clear_dev(pool);
 	rtnl_unlock();
 
+	/* xsk_wakeup_all() looks at the pools of other sockets under RCU */
+	synchronize_net();
+
 	if (pool->fq) {
 		xskq_destroy(pool->fq);
 		pool->fq = NULL;
@@ -1165,14 +1165,17 @@ struct xfrm_state *xfrm_input_state_lookup(struct net *net, u32 mark,
 
 	x = __xfrm_state_lookup(&state_ptrs, mark, daddr, spi, proto, family);
 
-	if (x && x->km.state == XFRM_STATE_VALID) {
+	/* A state lives in the cache of one cpu only. Stealing it from another
+	 * cpu's cache would make an SA received on several cpus bounce between
+	 * them and take xfrm_state_lock for every packet, those cpus use the
+	 * lockless hash lookup above instead.
+	 */
+	if (x && x->km.state == XFRM_STATE_VALID &&
+	    hlist_unhashed_lockless(&x->state_cache_input)) {
 		spin_lock_bh(&net->xfrm.xfrm_state_lock);
-		if (hlist_unhashed(&x->state_cache_input)) {
+		if (x->km.state == XFRM_STATE_VALID &&
+		    hlist_unhashed(&x->state_cache_input))
 			hlist_add_head_rcu(&x->state_cache_input, state_cache_input);
-		} else {
-			hlist_del_rcu(&x->state_cache_input);
-			hlist_add_head_rcu(&x->state_cache_input, state_cache_input);
-		}
 		spin_unlock_bh(&net->xfrm.xfrm_state_lock);
 	}
 
@@ -1413,6 +1413,29 @@ enum {
 
 /* Do not translate kernel bpf_arena pointers to user pointers */
 	BPF_F_NO_USER_CONV	= (1U << 18),
+
+/* Grow and shrink the buckets of a hash map with its number of elements,
+ * or allocate the compressed traces of a stack trace map on demand
+ */
+	BPF_F_RESIZABLE		= (1U << 19),
+
+/* Keep a multibit index for full length lookups in an LPM trie */
+	BPF_F_LPM_MULTIBIT	= (1U << 20),
+
+/* Use a lock-free ring for a queue map */
+	BPF_F_LOCKLESS		= (1U << 21),
+
+/* Give each CPU its own ring in a BPF_MAP_TYPE_RINGBUF map */
+	BPF_F_RINGBUF_PERCPU	= (1U << 22),
+
+/* Evict elements of an LRU hash map with a CLOCK sweep instead of LRU lists */
+	BPF_F_LRU_CLOCK		= (1U << 23),
+
+/* Back an arena with physically contiguous chunks where alignment permits */
+	BPF_F_ARENA_HUGE	= (1U << 24),
+
+/* Interleave the pages of an arena across memory nodes */
+	BPF_F_ARENA_INTERLEAVE	= (1U << 25),
 };
 
 /* Flags for BPF_PROG_QUERY. */
@@ -1485,7 +1508,8 @@ union bpf_attr {
 		 *
 		 * BPF_MAP_TYPE_BLOOM_FILTER - the lowest 4 bits indicate the
 		 * number of hash functions (if 0, the bloom filter will default
-		 * to using 5 hash functions).
+		 * to using 5 hash functions). Bit 4 selects a blocked layout,
+		 * where all bits of a value fall into one 64 byte block.
 		 *
 		 * BPF_MAP_TYPE_ARENA - contains the address where user space
 		 * is going to mmap() the arena. It has to be page aligned.
@@ -31,6 +31,12 @@
  * such frames will be dropped.
  */
 #define XDP_USE_SG	(1 << 4)
+/* Only valid in the address passed to sendto() on a zero-copy socket, not
+ * for bind(). Wakes up Tx on every queue of the device that is bound to
+ * the same UMEM and needs a wakeup, so that one thread driving many
+ * queues with a shared UMEM needs a single syscall per batch.
+ */
+#define XDP_WAKEUP_ALL	(1 << 5)
 
 /* Flags for xsk_umem_config flags */
 #define XDP_UMEM_UNALIGNED_CHUNK_FLAG	(1 << 0)
@@ -20,7 +20,7 @@
 #include "bpf.h"
 #include "libbpf.h"
 #include "libbpf_internal.h"
-#include "hashmap.h"
+#include "flatmap.h"
 #include "strset.h"
 
 #define BTF_MAX_NR_TYPES 0x7fffffffU
@@ -1790,7 +1790,7 @@ static int btf_commit_type(struct btf *btf, int data_sz)
 struct btf_pipe {
 	const struct btf *src;
 	struct btf *dst;
-	struct hashmap *str_off_map; /* map string offsets from src to dst */
+	struct flatmap *str_off_map; /* map string offsets from src to dst */
 };
 
 static int btf_rewrite_str(struct btf_pipe *p, __u32 *str_off)
@@ -1802,7 +1802,7 @@ static int btf_rewrite_str(struct btf_pipe *p, __u32 *str_off)
 		return 0;
 
 	if (p->str_off_map &&
-	    hashmap__find(p->str_off_map, *str_off, &mapped_off)) {
+	    flatmap__find(p->str_off_map, *str_off, &mapped_off)) {
 		*str_off = mapped_off;
 		return 0;
 	}
@@ -1815,7 +1815,7 @@ static int btf_rewrite_str(struct btf_pipe *p, __u32 *str_off)
 	 * performing expensive string comparisons.
 	 */
 	if (p->str_off_map) {
-		err = hashmap__append(p->str_off_map, *str_off, off);
+		err = flatmap__append(p->str_off_map, *str_off, off);
 		if (err)
 			return err;
 	}
@@ -1902,7 +1902,7 @@ int btf__add_btf(struct btf *btf, const struct btf *src_btf)
 		return libbpf_err(-ENOMEM);
 
 	/* Map the string offsets from src_btf to the offsets from btf to improve performance */
-	p.str_off_map = hashmap__new(btf_dedup_identity_hash_fn, btf_dedup_equal_fn, NULL);
+	p.str_off_map = flatmap__new(btf_dedup_identity_hash_fn, btf_dedup_equal_fn, NULL);
 	if (IS_ERR(p.str_off_map))
 		return libbpf_err(-ENOMEM);
 
@@ -1966,7 +1966,7 @@ int btf__add_btf(struct btf *btf, const struct btf *src_btf)
 	btf->hdr->str_off += data_sz;
 	btf->nr_types += cnt;
 
-	hashmap__free(p.str_off_map);
+	flatmap__free(p.str_off_map);
 
 	/* return type ID of the first added BTF type */
 	return btf->start_id + btf->nr_types - cnt;
@@ -1982,7 +1982,7 @@ err_out:
 	 */
 	btf->hdr->str_len = old_strs_len;
 
-	hashmap__free(p.str_off_map);
+	flatmap__free(p.str_off_map);
 
 	return libbpf_err(err);
 }
@@ -3365,7 +3365,7 @@ struct btf_dedup {
 	 * candidates, which is fine because we rely on subsequent
 	 * btf_xxx_equal() checks to authoritatively verify type equality.
 	 */
-	struct hashmap *dedup_table;
+	struct flatmap *dedup_table;
 	/* Canonical types map */
 	__u32 *map;
 	/* Hypothetical mapping, used during type graph equivalence checks */
@@ -3391,12 +3391,12 @@ static long hash_combine(long h, long value)
 	return h * 31 + value;
 }
 
-#define for_each_dedup_cand(d, node, hash) \
-	hashmap__for_each_key_entry(d->dedup_table, node, hash)
+#define for_each_dedup_cand(d, node, it, hash) \
+	flatmap__for_each_key_entry(d->dedup_table, node, it, hash)
 
 static int btf_dedup_table_add(struct btf_dedup *d, long hash, __u32 type_id)
 {
-	return hashmap__append(d->dedup_table, hash, type_id);
+	return flatmap__append(d->dedup_table, hash, type_id);
 }
 
 static int btf_dedup_hypot_map_add(struct btf_dedup *d,
@@ -3428,7 +3428,7 @@ static void btf_dedup_clear_hypot_map(struct btf_dedup *d)
 
 static void btf_dedup_free(struct btf_dedup *d)
 {
-	hashmap__free(d->dedup_table);
+	flatmap__free(d->dedup_table);
 	d->dedup_table = NULL;
 
 	free(d->map);
@@ -3473,7 +3473,7 @@ static struct btf_dedup *btf_dedup_new(struct btf *btf, const struct btf_dedup_o
 	d->btf = btf;
 	d->btf_ext = OPTS_GET(opts, btf_ext, NULL);
 
-	d->dedup_table = hashmap__new(hash_fn, btf_dedup_equal_fn, NULL);
+	d->dedup_table = flatmap__new(hash_fn, btf_dedup_equal_fn, NULL);
 	if (IS_ERR(d->dedup_table)) {
 		err = PTR_ERR(d->dedup_table);
 		d->dedup_table = NULL;
@@ -3996,7 +3996,8 @@ static int btf_dedup_prep(struct btf_dedup *d)
 static int btf_dedup_prim_type(struct btf_dedup *d, __u32 type_id)
 {
 	struct btf_type *t = btf_type_by_id(d->btf, type_id);
-	struct hashmap_entry *hash_entry;
+	struct flatmap_entry *hash_entry;
+	struct flatmap_iter it;
 	struct btf_type *cand;
 	/* if we don't find equivalent type, then we are canonical */
 	__u32 new_id = type_id;
@@ -4022,7 +4023,7 @@ static int btf_dedup_prim_type(struct btf_dedup *d, __u32 type_id)
 
 	case BTF_KIND_INT:
 		h = btf_hash_int_decl_tag(t);
-		for_each_dedup_cand(d, hash_entry, h) {
+		for_each_dedup_cand(d, hash_entry, it, h) {
 			cand_id = hash_entry->value;
 			cand = btf_type_by_id(d->btf, cand_id);
 			if (btf_equal_int_tag(t, cand)) {
@@ -4035,7 +4036,7 @@ static int btf_dedup_prim_type(struct btf_dedup *d, __u32 type_id)
 	case BTF_KIND_ENUM:
 	case BTF_KIND_ENUM64:
 		h = btf_hash_enum(t);
-		for_each_dedup_cand(d, hash_entry, h) {
+		for_each_dedup_cand(d, hash_entry, it, h) {
 			cand_id = hash_entry->value;
 			cand = btf_type_by_id(d->btf, cand_id);
 			if (btf_equal_enum(t, cand)) {
@@ -4057,7 +4058,7 @@ static int btf_dedup_prim_type(struct btf_dedup *d, __u32 type_id)
 	case BTF_KIND_FWD:
 	case BTF_KIND_FLOAT:
 		h = btf_hash_common(t);
-		for_each_dedup_cand(d, hash_entry, h) {
+		for_each_dedup_cand(d, hash_entry, it, h) {
 			cand_id = hash_entry->value;
 			cand = btf_type_by_id(d->btf, cand_id);
 			if (btf_equal_common(t, cand)) {
@@ -4559,7 +4560,8 @@ static void btf_dedup_merge_hypot_map(struct btf_dedup *d)
 static int btf_dedup_struct_type(struct btf_dedup *d, __u32 type_id)
 {
 	struct btf_type *cand_type, *t;
-	struct hashmap_entry *hash_entry;
+	struct flatmap_entry *hash_entry;
+	struct flatmap_iter it;
 	/* if we don't find equivalent type, then we are canonical */
 	__u32 new_id = type_id;
 	__u16 kind;
@@ -4576,7 +4578,7 @@ static int btf_dedup_struct_type(struct btf_dedup *d, __u32 type_id)
 		return 0;
 
 	h = btf_hash_struct(t);
-	for_each_dedup_cand(d, hash_entry, h) {
+	for_each_dedup_cand(d, hash_entry, it, h) {
 		__u32 cand_id = hash_entry->value;
 		int eq;
 
@@ -4652,7 +4654,8 @@ static int btf_dedup_struct_types(struct btf_dedup *d)
  */
 static int btf_dedup_ref_type(struct btf_dedup *d, __u32 type_id)
 {
-	struct hashmap_entry *hash_entry;
+	struct flatmap_entry *hash_entry;
+	struct flatmap_iter it;
 	__u32 new_id = type_id, cand_id;
 	struct btf_type *t, *cand;
 	/* if we don't find equivalent type, then we are representative type */
@@ -4681,7 +4684,7 @@ static int btf_dedup_ref_type(struct btf_dedup *d, __u32 type_id)
 		t->type = ref_type_id;
 
 		h = btf_hash_common(t);
-		for_each_dedup_cand(d, hash_entry, h) {
+		for_each_dedup_cand(d, hash_entry, it, h) {
 			cand_id = hash_entry->value;
 			cand = btf_type_by_id(d->btf, cand_id);
 			if (btf_equal_common(t, cand)) {
@@ -4698,7 +4701,7 @@ static int btf_dedup_ref_type(struct btf_dedup *d, __u32 type_id)
 		t->type = ref_type_id;
 
 		h = btf_hash_int_decl_tag(t);
-		for_each_dedup_cand(d, hash_entry, h) {
+		for_each_dedup_cand(d, hash_entry, it, h) {
 			cand_id = hash_entry->value;
 			cand = btf_type_by_id(d->btf, cand_id);
 			if (btf_equal_int_tag(t, cand)) {
@@ -4722,7 +4725,7 @@ static int btf_dedup_ref_type(struct btf_dedup *d, __u32 type_id)
 		info->index_type = ref_type_id;
 
 		h = btf_hash_array(t);
-		for_each_dedup_cand(d, hash_entry, h) {
+		for_each_dedup_cand(d, hash_entry, it, h) {
 			cand_id = hash_entry->value;
 			cand = btf_type_by_id(d->btf, cand_id);
 			if (btf_equal_array(t, cand)) {
@@ -4754,7 +4757,7 @@ static int btf_dedup_ref_type(struct btf_dedup *d, __u32 type_id)
 		}
 
 		h = btf_hash_fnproto(t);
-		for_each_dedup_cand(d, hash_entry, h) {
+		for_each_dedup_cand(d, hash_entry, it, h) {
 			cand_id = hash_entry->value;
 			cand = btf_type_by_id(d->btf, cand_id);
 			if (btf_equal_fnproto(t, cand)) {
@@ -4786,7 +4789,7 @@ static int btf_dedup_ref_types(struct btf_dedup *d)
 			return err;
 	}
 	/* we won't need d->dedup_table anymore */
-	hashmap__free(d->dedup_table);
+	flatmap__free(d->dedup_table);
 	d->dedup_table = NULL;
 	return 0;
 }
@@ -4796,7 +4799,7 @@ static int btf_dedup_ref_types(struct btf_dedup *d)
  * and unions. If the same name is shared by several canonical types
  * use a special value 0 to indicate this fact.
  */
-static int btf_dedup_fill_unique_names_map(struct btf_dedup *d, struct hashmap *names_map)
+static int btf_dedup_fill_unique_names_map(struct btf_dedup *d, struct flatmap *names_map)
 {
 	__u32 nr_types = btf__type_cnt(d->btf);
 	struct btf_type *t;
@@ -4819,9 +4822,9 @@ static int btf_dedup_fill_unique_names_map(struct btf_dedup *d, struct hashmap *
 		if (type_id != d->map[type_id])
 			continue;
 
-		err = hashmap__add(names_map, t->name_off, type_id);
+		err = flatmap__add(names_map, t->name_off, type_id);
 		if (err == -EEXIST)
-			err = hashmap__set(names_map, t->name_off, 0, NULL, NULL);
+			err = flatmap__set(names_map, t->name_off, 0, NULL, NULL);
 
 		if (err)
 			return err;
@@ -4830,7 +4833,7 @@ static int btf_dedup_fill_unique_names_map(struct btf_dedup *d, struct hashmap *
 	return 0;
 }
 
-static int btf_dedup_resolve_fwd(struct btf_dedup *d, struct hashmap *names_map, __u32 type_id)
+static int btf_dedup_resolve_fwd(struct btf_dedup *d, struct flatmap *names_map, __u32 type_id)
 {
 	struct btf_type *t = btf_type_by_id(d->btf, type_id);
 	enum btf_fwd_kind fwd_kind = btf_kflag(t);
@@ -4845,7 +4848,7 @@ static int btf_dedup_resolve_fwd(struct btf_dedup *d, struct hashmap *names_map,
 	if (type_id != d->map[type_id])
 		return 0;
 
-	if (!hashmap__find(names_map, t->name_off, &cand_id))
+	if (!flatmap__find(names_map, t->name_off, &cand_id))
 		return 0;
 
 	/* Zero is a special value indicating that name is not unique */
@@ -4898,9 +4901,9 @@ static int btf_dedup_resolve_fwd(struct btf_dedup *d, struct hashmap *names_map,
 static int btf_dedup_resolve_fwds(struct btf_dedup *d)
 {
 	int i, err;
-	struct hashmap *names_map;
+	struct flatmap *names_map;
 
-	names_map = hashmap__new(btf_dedup_identity_hash_fn, btf_dedup_equal_fn, NULL);
+	names_map = flatmap__new(btf_dedup_identity_hash_fn, btf_dedup_equal_fn, NULL);
 	if (IS_ERR(names_map))
 		return PTR_ERR(names_map);
 
@@ -4915,7 +4918,7 @@ static int btf_dedup_resolve_fwds(struct btf_dedup *d)
 	}
 
 exit:
-	hashmap__free(names_map);
+	flatmap__free(names_map);
 	return err;
 }
 
@@ -5422,7 +5425,7 @@ int btf__distill_base(const struct btf *src_btf, struct btf **new_base_btf,
 	}
 	dist.pipe.src = src_btf;
 	dist.pipe.dst = new_base;
-	dist.pipe.str_off_map = hashmap__new(btf_dedup_identity_hash_fn, btf_dedup_equal_fn, NULL);
+	dist.pipe.str_off_map = flatmap__new(btf_dedup_identity_hash_fn, btf_dedup_equal_fn, NULL);
 	if (IS_ERR(dist.pipe.str_off_map)) {
 		err = -ENOMEM;
 		goto done;
@@ -5483,7 +5486,7 @@ int btf__distill_base(const struct btf *src_btf, struct btf **new_base_btf,
 	}
 done:
 	free(dist.id_map);
-	hashmap__free(dist.pipe.str_off_map);
+	flatmap__free(dist.pipe.str_off_map);
 	if (err) {
 		btf__free(new_split);
 		btf__free(new_base);
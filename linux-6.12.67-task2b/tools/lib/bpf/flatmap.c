@@ -0,0 +1,431 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+
+/*
+ * Generic non-thread safe open-addressing hash map.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/err.h>
+#include "flatmap.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* make sure libbpf doesn't use kernel-only integer typedefs */
+#pragma GCC poison u8 u16 u32 u64 s8 s16 s32 s64
+
+/* prevent accidental re-addition of reallocarray() */
+#pragma GCC poison reallocarray
+
+/*
+ * Control bytes: full slots hold the low 7 bits of the hash (h2) and are
+ * therefore non-negative, the two special values have the top bit set.
+ */
+#define FLATMAP_EMPTY	((signed char)-128)
+#define FLATMAP_DELETED	((signed char)-2)
+
+/*
+ * Group matching returns a mask with one bit (SSE2) or one byte (SWAR) per
+ * control byte of the group, FLATMAP_GROUP_SHIFT turns the position of the
+ * lowest set bit into the index of its control byte.
+ */
+#ifdef __SSE2__
+#define FLATMAP_GROUP_WIDTH	16
+#define FLATMAP_GROUP_SHIFT	0
+
+static inline __m128i flatmap_group(const signed char *ctrl)
+{
+	return _mm_loadu_si128((const __m128i *)ctrl);
+}
+
+static inline uint64_t flatmap_match(const signed char *ctrl, signed char h2)
+{
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2),
+							  flatmap_group(ctrl)));
+}
+
+static inline uint64_t flatmap_match_empty(const signed char *ctrl)
+{
+	return flatmap_match(ctrl, FLATMAP_EMPTY);
+}
+
+/* empty or deleted slots are exactly those with the top bit set */
+static inline uint64_t flatmap_match_free(const signed char *ctrl)
+{
+	return (uint32_t)_mm_movemask_epi8(flatmap_group(ctrl));
+}
+#else
+#define FLATMAP_GROUP_WIDTH	8
+#define FLATMAP_GROUP_SHIFT	3
+
+#define FLATMAP_LSBS	0x0101010101010101ULL
+#define FLATMAP_MSBS	0x8080808080808080ULL
+
+static inline uint64_t flatmap_group(const signed char *ctrl)
+{
+	uint64_t g;
+
+	memcpy(&g, ctrl, sizeof(g));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	g = __builtin_bswap64(g);
+#endif
+	return g;
+}
+
+/*
+ * May also report a full slot directly after a match with a different h2,
+ * never an empty or deleted one; callers recheck the control byte.
+ */
+static inline uint64_t flatmap_match(const signed char *ctrl, signed char h2)
+{
+	uint64_t x = flatmap_group(ctrl) ^ (FLATMAP_LSBS * (unsigned char)h2);
+
+	return (x - FLATMAP_LSBS) & ~x & FLATMAP_MSBS;
+}
+
+/* 0x80 is the only special value with bit 1 clear */
+static inline uint64_t flatmap_match_empty(const signed char *ctrl)
+{
+	uint64_t g = flatmap_group(ctrl);
+
+	return g & ~(g << 6) & FLATMAP_MSBS;
+}
+
+/* both special values have bit 0 clear, full slots the top bit clear */
+static inline uint64_t flatmap_match_free(const signed char *ctrl)
+{
+	uint64_t g = flatmap_group(ctrl);
+
+	return g & ~(g << 7) & FLATMAP_MSBS;
+}
+#endif
+
+static inline size_t flatmap_match_idx(uint64_t match)
+{
+	return __builtin_ctzll(match) >> FLATMAP_GROUP_SHIFT;
+}
+
+/*
+ * Callers' hash functions are often the identity, mix all bits of the
+ * hash into both the probe start (h1) and the control byte (h2).
+ */
+static inline uint64_t flatmap_hash(const struct flatmap *map, long key)
+{
+	uint64_t h = map->hash_fn(key, map->ctx);
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static inline signed char flatmap_h2(uint64_t hash)
+{
+	return hash & 0x7f;
+}
+
+static inline size_t flatmap_h1(const struct flatmap *map, uint64_t hash)
+{
+	return (hash >> 7) & (map->cap - 1);
+}
+
+/*
+ * Groups are probed triangularly, which visits every group of a power of
+ * two sized map exactly once before repeating.
+ */
+static inline size_t flatmap_next_group(const struct flatmap *map, size_t pos,
+				       size_t *step)
+{
+	*step += FLATMAP_GROUP_WIDTH;
+	return (pos + *step) & (map->cap - 1);
+}
+
+/*
+ * The first group width control bytes are mirrored behind the last slot, so
+ * that a group starting near the end of the map can be loaded in one go.
+ */
+static inline void flatmap_set_ctrl(struct flatmap *map, size_t i, signed char c)
+{
+	map->ctrl[i] = c;
+	map->ctrl[((i - FLATMAP_GROUP_WIDTH) & (map->cap - 1)) + FLATMAP_GROUP_WIDTH] = c;
+}
+
+/* max number of entries for a capacity, a 7/8 load factor */
+static inline size_t flatmap_max_load(size_t cap)
+{
+	return cap - cap / 8;
+}
+
+void flatmap__init(struct flatmap *map, hashmap_hash_fn hash_fn,
+		   hashmap_equal_fn equal_fn, void *ctx)
+{
+	map->hash_fn = hash_fn;
+	map->equal_fn = equal_fn;
+	map->ctx = ctx;
+
+	map->slots = NULL;
+	map->ctrl = NULL;
+	map->cap = 0;
+	map->sz = 0;
+	map->growth_left = 0;
+}
+
+struct flatmap *flatmap__new(hashmap_hash_fn hash_fn,
+			     hashmap_equal_fn equal_fn,
+			     void *ctx)
+{
+	struct flatmap *map = malloc(sizeof(struct flatmap));
+
+	if (!map)
+		return ERR_PTR(-ENOMEM);
+	flatmap__init(map, hash_fn, equal_fn, ctx);
+	return map;
+}
+
+void flatmap__clear(struct flatmap *map)
+{
+	free(map->slots);
+	map->slots = NULL;
+	map->ctrl = NULL;
+	map->cap = map->sz = map->growth_left = 0;
+}
+
+void flatmap__free(struct flatmap *map)
+{
+	if (IS_ERR_OR_NULL(map))
+		return;
+
+	flatmap__clear(map);
+	free(map);
+}
+
+size_t flatmap__size(const struct flatmap *map)
+{
+	return map->sz;
+}
+
+size_t flatmap__capacity(const struct flatmap *map)
+{
+	return map->cap;
+}
+
+/* first empty or deleted slot on the probe sequence of hash */
+static size_t flatmap_find_free(const struct flatmap *map, uint64_t hash)
+{
+	size_t pos = flatmap_h1(map, hash), step = 0;
+	uint64_t match;
+
+	for (;;) {
+		match = flatmap_match_free(map->ctrl + pos);
+		if (match)
+			return (pos + flatmap_match_idx(match)) & (map->cap - 1);
+		pos = flatmap_next_group(map, pos, &step);
+	}
+}
+
+static int flatmap_resize(struct flatmap *map, size_t new_cap)
+{
+	struct flatmap old = *map;
+	size_t i, ctrl_sz;
+	void *mem;
+
+	ctrl_sz = new_cap + FLATMAP_GROUP_WIDTH;
+	if (new_cap > (SIZE_MAX - ctrl_sz) / sizeof(struct flatmap_entry))
+		return -ENOMEM;
+	mem = malloc(new_cap * sizeof(struct flatmap_entry) + ctrl_sz);
+	if (!mem)
+		return -ENOMEM;
+
+	map->slots = mem;
+	map->ctrl = (signed char *)(map->slots + new_cap);
+	map->cap = new_cap;
+	map->growth_left = flatmap_max_load(new_cap) - map->sz;
+	memset(map->ctrl, FLATMAP_EMPTY, ctrl_sz);
+
+	for (i = 0; i < old.cap; i++) {
+		uint64_t hash;
+		size_t j;
+
+		if (old.ctrl[i] < 0)
+			continue;
+		hash = flatmap_hash(map, old.slots[i].key);
+		j = flatmap_find_free(map, hash);
+		flatmap_set_ctrl(map, j, flatmap_h2(hash));
+		map->slots[j] = old.slots[i];
+	}
+
+	free(old.slots);
+	return 0;
+}
+
+/* resize for one more entry, dropping deleted slots on the way */
+static int flatmap_grow(struct flatmap *map)
+{
+	size_t new_cap = map->cap;
+
+	/* only grow if it is not the tombstones that use up the space */
+	if (!new_cap)
+		new_cap = FLATMAP_GROUP_WIDTH;
+	else if (map->sz >= map->cap / 2)
+		new_cap <<= 1;
+	if (!new_cap)
+		return -ENOMEM;
+
+	return flatmap_resize(map, new_cap);
+}
+
+int flatmap__reserve(struct flatmap *map, size_t cnt)
+{
+	size_t new_cap = FLATMAP_GROUP_WIDTH;
+
+	while (flatmap_max_load(new_cap) < cnt) {
+		new_cap <<= 1;
+		if (!new_cap)
+			return -ENOMEM;
+	}
+	if (new_cap <= map->cap)
+		return 0;
+
+	return flatmap_resize(map, new_cap);
+}
+
+struct flatmap_entry *flatmap_next_key_entry(const struct flatmap *map,
+					     struct flatmap_iter *it)
+{
+	for (;;) {
+		while (it->match) {
+			size_t i = (it->pos + flatmap_match_idx(it->match)) & (map->cap - 1);
+
+			it->match &= it->match - 1;
+			if (map->ctrl[i] == it->h2 &&
+			    map->equal_fn(map->slots[i].key, it->key, map->ctx))
+				return &map->slots[i];
+		}
+
+		if (flatmap_match_empty(map->ctrl + it->pos))
+			return NULL;
+		it->pos = flatmap_next_group(map, it->pos, &it->step);
+		it->match = flatmap_match(map->ctrl + it->pos, it->h2);
+	}
+}
+
+struct flatmap_entry *flatmap_first_key_entry(const struct flatmap *map, long key,
+					      struct flatmap_iter *it)
+{
+	uint64_t hash;
+
+	if (!map->cap)
+		return NULL;
+
+	hash = flatmap_hash(map, key);
+	it->key = key;
+	it->h2 = flatmap_h2(hash);
+	it->pos = flatmap_h1(map, hash);
+	it->step = 0;
+	it->match = flatmap_match(map->ctrl + it->pos, it->h2);
+
+	return flatmap_next_key_entry(map, it);
+}
+
+int flatmap_insert(struct flatmap *map, long key, long value,
+		   enum hashmap_insert_strategy strategy,
+		   long *old_key, long *old_value)
+{
+	struct flatmap_entry *entry;
+	struct flatmap_iter it;
+	uint64_t hash;
+	size_t i;
+	int err;
+
+	if (old_key)
+		*old_key = 0;
+	if (old_value)
+		*old_value = 0;
+
+	if (strategy != HASHMAP_APPEND) {
+		entry = flatmap_first_key_entry(map, key, &it);
+		if (entry) {
+			if (old_key)
+				*old_key = entry->key;
+			if (old_value)
+				*old_value = entry->value;
+
+			if (strategy == HASHMAP_ADD)
+				return -EEXIST;
+			entry->key = key;
+			entry->value = value;
+			return 0;
+		}
+	}
+
+	if (strategy == HASHMAP_UPDATE)
+		return -ENOENT;
+
+	if (!map->cap) {
+		err = flatmap_grow(map);
+		if (err)
+			return err;
+	}
+
+	hash = flatmap_hash(map, key);
+	i = flatmap_find_free(map, hash);
+	if (map->ctrl[i] == FLATMAP_EMPTY && !map->growth_left) {
+		err = flatmap_grow(map);
+		if (err)
+			return err;
+		i = flatmap_find_free(map, hash);
+	}
+
+	if (map->ctrl[i] == FLATMAP_EMPTY)
+		map->growth_left--;
+	flatmap_set_ctrl(map, i, flatmap_h2(hash));
+	map->slots[i].key = key;
+	map->slots[i].value = value;
+	map->sz++;
+
+	return 0;
+}
+
+bool flatmap_find(const struct flatmap *map, long key, long *value)
+{
+	struct flatmap_entry *entry;
+	struct flatmap_iter it;
+
+	entry = flatmap_first_key_entry(map, key, &it);
+	if (!entry)
+		return false;
+
+	if (value)
+		*value = entry->value;
+	return true;
+}
+
+bool flatmap_delete(struct flatmap *map, long key,
+		    long *old_key, long *old_value)
+{
+	struct flatmap_entry *entry;
+	struct flatmap_iter it;
+
+	entry = flatmap_first_key_entry(map, key, &it);
+	if (!entry)
+		return false;
+
+	if (old_key)
+		*old_key = entry->key;
+	if (old_value)
+		*old_value = entry->value;
+
+	/*
+	 * Probing stops at empty slots only, so the slot has to stay in the
+	 * way of others with the same probe sequence until the next resize.
+	 */
+	flatmap_set_ctrl(map, entry - map->slots, FLATMAP_DELETED);
+	map->sz--;
+
+	return true;
+}
@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause) */
+
+/*
+ * Generic non-thread safe open-addressing hash map.
+ *
+ * Same interface and key/value conventions as hashmap.h, but entries live
+ * in one flat array instead of a malloc()'ed node per entry. Every slot has
+ * a control byte, either empty, deleted or holding 7 bits of the key's
+ * hash; lookups compare a whole group of control bytes at once (16 with
+ * SSE2, 8 otherwise) and only call equal_fn for slots whose hash bits
+ * match. This is the layout popularized by Swiss tables.
+ *
+ * Entries do not move until the map is resized, i.e. pointers returned
+ * through the iteration macros stay valid across deletions, but not
+ * across insertions.
+ */
+#ifndef __LIBBPF_FLATMAP_H
+#define __LIBBPF_FLATMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "hashmap.h"
+
+struct flatmap_entry {
+	union {
+		long key;
+		const void *pkey;
+	};
+	union {
+		long value;
+		void *pvalue;
+	};
+};
+
+struct flatmap {
+	hashmap_hash_fn hash_fn;
+	hashmap_equal_fn equal_fn;
+	void *ctx;
+
+	/* cap entries followed by cap + group width control bytes */
+	struct flatmap_entry *slots;
+	signed char *ctrl;
+	size_t cap;
+	size_t sz;
+	/* inserts into empty slots left before the map has to grow */
+	size_t growth_left;
+};
+
+/* cursor for flatmap__for_each_key_entry() */
+struct flatmap_iter {
+	long key;
+	size_t pos;
+	size_t step;
+	uint64_t match;
+	signed char h2;
+};
+
+void flatmap__init(struct flatmap *map, hashmap_hash_fn hash_fn,
+		   hashmap_equal_fn equal_fn, void *ctx);
+struct flatmap *flatmap__new(hashmap_hash_fn hash_fn,
+			     hashmap_equal_fn equal_fn,
+			     void *ctx);
+void flatmap__clear(struct flatmap *map);
+void flatmap__free(struct flatmap *map);
+
+size_t flatmap__size(const struct flatmap *map);
+size_t flatmap__capacity(const struct flatmap *map);
+
+/*
+ * flatmap__reserve() sizes the map for at least cnt entries up front,
+ * saving the rehashes on the way there.
+ */
+int flatmap__reserve(struct flatmap *map, size_t cnt);
+
+/* see hashmap_insert() for the semantics of each strategy */
+int flatmap_insert(struct flatmap *map, long key, long value,
+		   enum hashmap_insert_strategy strategy,
+		   long *old_key, long *old_value);
+
+#define flatmap__insert(map, key, value, strategy, old_key, old_value) \
+	flatmap_insert((map), (long)(key), (long)(value), (strategy),  \
+		       hashmap_cast_ptr(old_key),		       \
+		       hashmap_cast_ptr(old_value))
+
+#define flatmap__add(map, key, value) \
+	flatmap__insert((map), (key), (value), HASHMAP_ADD, NULL, NULL)
+
+#define flatmap__set(map, key, value, old_key, old_value) \
+	flatmap__insert((map), (key), (value), HASHMAP_SET, (old_key), (old_value))
+
+#define flatmap__update(map, key, value, old_key, old_value) \
+	flatmap__insert((map), (key), (value), HASHMAP_UPDATE, (old_key), (old_value))
+
+#define flatmap__append(map, key, value) \
+	flatmap__insert((map), (key), (value), HASHMAP_APPEND, NULL, NULL)
+
+bool flatmap_delete(struct flatmap *map, long key, long *old_key, long *old_value);
+
+#define flatmap__delete(map, key, old_key, old_value)		       \
+	flatmap_delete((map), (long)(key),			       \
+		       hashmap_cast_ptr(old_key),		       \
+		       hashmap_cast_ptr(old_value))
+
+/*
+ * With HASHMAP_APPEND, flatmap__find() returns one of the entries for the
+ * key, not necessarily the last one inserted as hashmap__find() does.
+ */
+bool flatmap_find(const struct flatmap *map, long key, long *value);
+
+#define flatmap__find(map, key, value) \
+	flatmap_find((map), (long)(key), hashmap_cast_ptr(value))
+
+struct flatmap_entry *flatmap_first_key_entry(const struct flatmap *map, long key,
+					      struct flatmap_iter *it);
+struct flatmap_entry *flatmap_next_key_entry(const struct flatmap *map,
+					     struct flatmap_iter *it);
+
+/*
+ * flatmap__for_each_entry - iterate over all entries in flatmap, safe
+ * against removals
+ * @map: flatmap to iterate
+ * @cur: struct flatmap_entry * used as a loop cursor
+ * @bkt: integer used as a slot loop cursor
+ */
+#define flatmap__for_each_entry(map, cur, bkt)				    \
+	for (bkt = 0; bkt < (map)->cap; bkt++)				    \
+		if ((map)->ctrl[bkt] >= 0 && ((cur = &(map)->slots[bkt]), true))
+
+/*
+ * flatmap__for_each_key_entry - iterate over entries associated with given
+ * key, in no particular order, safe against removals
+ * @map: flatmap to iterate
+ * @cur: struct flatmap_entry * used as a loop cursor
+ * @it: struct flatmap_iter used as the probe state
+ * @_key: key to iterate entries for
+ */
+#define flatmap__for_each_key_entry(map, cur, it, _key)			    \
+	for (cur = flatmap_first_key_entry((map), (long)(_key), &(it));	    \
+	     cur;							    \
+	     cur = flatmap_next_key_entry((map), &(it)))
+
+#endif /* __LIBBPF_FLATMAP_H */
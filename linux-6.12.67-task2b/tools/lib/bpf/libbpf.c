@@ -25,6 +25,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <asm/unistd.h>
 #include <linux/err.h>
 #include <linux/kernel.h>
@@ -53,6 +54,7 @@
 #include "str_error.h"
 #include "libbpf_internal.h"
 #include "hashmap.h"
+#include "flatmap.h"
 #include "bpf_gen_internal.h"
 #include "zip.h"
 
@@ -720,6 +722,11 @@ struct bpf_object {
 	size_t log_size;
 	__u32 log_level;
 
+	/* max number of threads bpf_object__load() spreads its work over */
+	__u32 load_threads;
+	/* held around lazily initialized object state while it does */
+	pthread_mutex_t *load_lock;
+
 	int *fd_array;
 	size_t fd_array_cap;
 	size_t fd_array_cnt;
@@ -5037,6 +5044,122 @@ bool kernel_supports(const struct bpf_object *obj, enum kern_feature_id feat_id)
 	return feat_supported(NULL, feat_id);
 }
 
+/* libbpf.a can end up linked without -lpthread against older glibc, in
+ * which case these resolve to NULL and all load work stays on the calling
+ * thread
+ */
+#pragma weak pthread_create
+#pragma weak pthread_join
+#pragma weak pthread_mutex_init
+#pragma weak pthread_mutex_destroy
+#pragma weak pthread_mutex_lock
+#pragma weak pthread_mutex_unlock
+
+static __u32 bpf_object_load_threads(const struct bpf_object *obj)
+{
+	if (obj->gen_loader || !pthread_create || obj->load_threads < 2)
+		return 1;
+	return obj->load_threads;
+}
+
+static void bpf_object_lock(struct bpf_object *obj)
+{
+	if (obj->load_lock)
+		pthread_mutex_lock(obj->load_lock);
+}
+
+static void bpf_object_unlock(struct bpf_object *obj)
+{
+	if (obj->load_lock)
+		pthread_mutex_unlock(obj->load_lock);
+}
+
+typedef int (*bpf_object_work_fn)(void *ctx, size_t idx);
+
+struct bpf_object_work {
+	struct bpf_object *obj;
+	bpf_object_work_fn fn;
+	void *ctx;
+	size_t cnt;
+	/* next item to be picked up by a worker */
+	size_t next;
+	/* lowest failed item (cnt if none) and its error */
+	size_t err_idx;
+	int err;
+};
+
+static void *bpf_object_worker(void *arg)
+{
+	struct bpf_object_work *w = arg;
+	size_t idx;
+	int err;
+
+	while (true) {
+		idx = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED);
+		if (idx >= w->cnt || idx > __atomic_load_n(&w->err_idx, __ATOMIC_RELAXED))
+			break;
+
+		err = w->fn(w->ctx, idx);
+		if (!err)
+			continue;
+
+		bpf_object_lock(w->obj);
+		if (idx < w->err_idx) {
+			__atomic_store_n(&w->err_idx, idx, __ATOMIC_RELAXED);
+			w->err = err;
+		}
+		bpf_object_unlock(w->obj);
+	}
+	return NULL;
+}
+
+/* Call fn(ctx, idx) for each idx in [0, cnt), spread over up to nr_threads
+ * threads, the calling one included. Items are picked up in order and none
+ * is started past a failed one, so the error returned is that of the lowest
+ * failed item, same as with a plain loop. Lazily initialized object state
+ * has to be accessed under bpf_object_lock() by fn.
+ */
+static int bpf_object_run_parallel(struct bpf_object *obj, __u32 nr_threads, size_t cnt,
+				   bpf_object_work_fn fn, void *ctx)
+{
+	struct bpf_object_work w = {
+		.obj = obj,
+		.fn = fn,
+		.ctx = ctx,
+		.cnt = cnt,
+		.err_idx = cnt,
+	};
+	pthread_t *threads = NULL;
+	pthread_mutex_t lock;
+	__u32 i, nr = 0;
+
+	if (nr_threads > cnt)
+		nr_threads = cnt;
+	if (nr_threads > 1)
+		threads = calloc(nr_threads - 1, sizeof(*threads));
+	if (threads) {
+		pthread_mutex_init(&lock, NULL);
+		obj->load_lock = &lock;
+		/* if we can't get all threads, go with what we have got */
+		while (nr < nr_threads - 1 &&
+		       !pthread_create(&threads[nr], NULL, bpf_object_worker, &w))
+			nr++;
+		pr_debug("object '%s': using %u threads for %zu items\n",
+			 obj->name, nr + 1, cnt);
+	}
+
+	bpf_object_worker(&w);
+
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i], NULL);
+	if (threads) {
+		obj->load_lock = NULL;
+		pthread_mutex_destroy(&lock);
+		free(threads);
+	}
+	return w.err;
+}
+
 static bool map_is_reuse_compat(const struct bpf_map *map, int map_fd)
 {
 	struct bpf_map_info map_info;
@@ -5629,7 +5752,7 @@ int bpf_core_add_cands(struct bpf_core_cand *local_cand,
 	return 0;
 }
 
-static int load_module_btfs(struct bpf_object *obj)
+static int __load_module_btfs(struct bpf_object *obj)
 {
 	struct bpf_btf_info info;
 	struct module_btf *mod_btf;
@@ -5725,10 +5848,197 @@ err_out:
 	return 0;
 }
 
+static int load_module_btfs(struct bpf_object *obj)
+{
+	int err;
+
+	bpf_object_lock(obj);
+	err = __load_module_btfs(obj);
+	bpf_object_unlock(obj);
+	return err;
+}
+
+/* Target BTF types by hash of their essential name, so that the candidate
+ * search doesn't have to go over all of vmlinux BTF for each local type.
+ */
+struct bpf_core_cand_index {
+	struct flatmap types;
+	bool built;
+};
+
+struct bpf_core_relo_job {
+	struct bpf_program *prog;
+	const struct bpf_core_relo *rec;
+	int relo_idx;
+	int insn_idx;
+};
+
+struct bpf_core_relo_ctx {
+	struct bpf_object *obj;
+	/* local type ID -> struct bpf_core_cand_list */
+	struct hashmap *cand_cache;
+	/* vmlinux (or its override) and module BTF name indices */
+	struct bpf_core_cand_index vmlinux_idx;
+	struct bpf_core_cand_index *module_idxs;
+	size_t module_idx_cnt;
+
+	struct bpf_core_relo_job *jobs;
+	size_t job_cnt;
+	size_t job_cap;
+};
+
+static size_t bpf_core_hash_fn(const long key, void *ctx)
+{
+	return key;
+}
+
+static bool bpf_core_equal_fn(const long k1, const long k2, void *ctx)
+{
+	return k1 == k2;
+}
+
+static size_t bpf_core_essential_name_hash(const char *name, size_t len)
+{
+	size_t h = 0;
+
+	while (len--)
+		h = h * 31 + *name++;
+	return h;
+}
+
+static int bpf_core_build_cand_index(struct bpf_core_cand_index *idx,
+				     const struct btf *targ_btf, int targ_start_id)
+{
+	const struct btf_type *t;
+	const char *name;
+	size_t hash;
+	int n, i, err;
+
+	flatmap__init(&idx->types, bpf_core_hash_fn, bpf_core_equal_fn, NULL);
+
+	n = btf__type_cnt(targ_btf);
+	for (i = targ_start_id; i < n; i++) {
+		t = btf__type_by_id(targ_btf, i);
+		name = btf__name_by_offset(targ_btf, t->name_off);
+		if (str_is_empty(name))
+			continue;
+
+		hash = bpf_core_essential_name_hash(name, bpf_core_essential_name_len(name));
+		err = flatmap__append(&idx->types, hash, i);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+static int bpf_core_cand_cmp(const void *a, const void *b)
+{
+	const struct bpf_core_cand *c1 = a, *c2 = b;
+
+	return c1->id < c2->id ? -1 : c1->id > c2->id;
+}
+
+/* same as bpf_core_add_cands(), using targ_btf's name index */
+static int bpf_core_add_indexed_cands(struct bpf_core_relo_ctx *ctx,
+				      struct bpf_core_cand_index *idx,
+				      struct bpf_core_cand *local_cand,
+				      size_t local_essent_len,
+				      const struct btf *targ_btf,
+				      const char *targ_btf_name,
+				      int targ_start_id,
+				      struct bpf_core_cand_list *cands)
+{
+	struct bpf_core_cand *new_cands, *cand;
+	const struct btf_type *t, *local_t;
+	const char *targ_name, *local_name;
+	struct flatmap_entry *entry;
+	struct flatmap_iter it;
+	size_t first = cands->len, i;
+	int err = 0;
+
+	if (!__atomic_load_n(&idx->built, __ATOMIC_ACQUIRE)) {
+		bpf_object_lock(ctx->obj);
+		if (!idx->built) {
+			err = bpf_core_build_cand_index(idx, targ_btf, targ_start_id);
+			if (err)
+				flatmap__clear(&idx->types);
+			else
+				__atomic_store_n(&idx->built, true, __ATOMIC_RELEASE);
+		}
+		bpf_object_unlock(ctx->obj);
+		if (err)
+			return err;
+	}
+
+	local_t = btf__type_by_id(local_cand->btf, local_cand->id);
+	local_name = btf__str_by_offset(local_cand->btf, local_t->name_off);
+
+	flatmap__for_each_key_entry(&idx->types, entry, it,
+				    bpf_core_essential_name_hash(local_name, local_essent_len)) {
+		t = btf__type_by_id(targ_btf, entry->value);
+		if (!btf_kind_core_compat(t, local_t))
+			continue;
+
+		targ_name = btf__name_by_offset(targ_btf, t->name_off);
+		if (bpf_core_essential_name_len(targ_name) != local_essent_len)
+			continue;
+
+		if (strncmp(local_name, targ_name, local_essent_len) != 0)
+			continue;
+
+		new_cands = libbpf_reallocarray(cands->cands, cands->len + 1,
+					      sizeof(*cands->cands));
+		if (!new_cands)
+			return -ENOMEM;
+
+		cand = &new_cands[cands->len];
+		cand->btf = targ_btf;
+		cand->id = entry->value;
+
+		cands->cands = new_cands;
+		cands->len++;
+	}
+
+	/* report and keep candidates in type ID order, as a full scan does */
+	qsort(cands->cands + first, cands->len - first, sizeof(*cands->cands),
+	      bpf_core_cand_cmp);
+	for (i = first; i < cands->len; i++) {
+		t = btf__type_by_id(targ_btf, cands->cands[i].id);
+		pr_debug("CO-RE relocating [%d] %s %s: found target candidate [%d] %s %s in [%s]\n",
+			 local_cand->id, btf_kind_str(local_t), local_name,
+			 cands->cands[i].id, btf_kind_str(t),
+			 btf__name_by_offset(targ_btf, t->name_off), targ_btf_name);
+	}
+	return 0;
+}
+
+static int bpf_core_init_module_idxs(struct bpf_core_relo_ctx *ctx)
+{
+	struct bpf_object *obj = ctx->obj;
+	int err;
+
+	err = load_module_btfs(obj);
+	if (err)
+		return err;
+
+	bpf_object_lock(obj);
+	if (!ctx->module_idxs && obj->btf_module_cnt) {
+		ctx->module_idxs = calloc(obj->btf_module_cnt, sizeof(*ctx->module_idxs));
+		if (ctx->module_idxs)
+			ctx->module_idx_cnt = obj->btf_module_cnt;
+		else
+			err = -ENOMEM;
+	}
+	bpf_object_unlock(obj);
+	return err;
+}
+
 static struct bpf_core_cand_list *
-bpf_core_find_cands(struct bpf_object *obj, const struct btf *local_btf, __u32 local_type_id)
+bpf_core_find_cands(struct bpf_core_relo_ctx *ctx, const struct btf *local_btf,
+		    __u32 local_type_id)
 {
 	struct bpf_core_cand local_cand = {};
+	struct bpf_object *obj = ctx->obj;
 	struct bpf_core_cand_list *cands;
 	const struct btf *main_btf;
 	const struct btf_type *local_t;
@@ -5753,7 +6063,8 @@ bpf_core_find_cands(struct bpf_object *obj, const struct btf *local_btf, __u32 l
 
 	/* Attempt to find target candidates in vmlinux BTF first */
 	main_btf = obj->btf_vmlinux_override ?: obj->btf_vmlinux;
-	err = bpf_core_add_cands(&local_cand, local_essent_len, main_btf, "vmlinux", 1, cands);
+	err = bpf_core_add_indexed_cands(ctx, &ctx->vmlinux_idx, &local_cand, local_essent_len,
+					 main_btf, "vmlinux", 1, cands);
 	if (err)
 		goto err_out;
 
@@ -5766,16 +6077,17 @@ bpf_core_find_cands(struct bpf_object *obj, const struct btf *local_btf, __u32 l
 		return cands;
 
 	/* now look through module BTFs, trying to still find candidates */
-	err = load_module_btfs(obj);
+	err = bpf_core_init_module_idxs(ctx);
 	if (err)
 		goto err_out;
 
-	for (i = 0; i < obj->btf_module_cnt; i++) {
-		err = bpf_core_add_cands(&local_cand, local_essent_len,
-					 obj->btf_modules[i].btf,
-					 obj->btf_modules[i].name,
-					 btf__type_cnt(obj->btf_vmlinux),
-					 cands);
+	for (i = 0; i < ctx->module_idx_cnt; i++) {
+		err = bpf_core_add_indexed_cands(ctx, &ctx->module_idxs[i],
+						 &local_cand, local_essent_len,
+						 obj->btf_modules[i].btf,
+						 obj->btf_modules[i].name,
+						 btf__type_cnt(obj->btf_vmlinux),
+						 cands);
 		if (err)
 			goto err_out;
 	}
@@ -5817,16 +6129,6 @@ int bpf_core_types_match(const struct btf *local_btf, __u32 local_id,
 	return __bpf_core_types_match(local_btf, local_id, targ_btf, targ_id, false, 32);
 }
 
-static size_t bpf_core_hash_fn(const long key, void *ctx)
-{
-	return key;
-}
-
-static bool bpf_core_equal_fn(const long k1, const long k2, void *ctx)
-{
-	return k1 == k2;
-}
-
 static int record_relo_core(struct bpf_program *prog,
 			    const struct bpf_core_relo *core_relo, int insn_idx)
 {
@@ -5865,15 +6167,16 @@ static int bpf_core_resolve_relo(struct bpf_program *prog,
 				 const struct bpf_core_relo *relo,
 				 int relo_idx,
 				 const struct btf *local_btf,
-				 struct hashmap *cand_cache,
+				 struct bpf_core_relo_ctx *ctx,
 				 struct bpf_core_relo_res *targ_res)
 {
 	struct bpf_core_spec specs_scratch[3] = {};
-	struct bpf_core_cand_list *cands = NULL;
+	struct bpf_core_cand_list *cands = NULL, *cached;
 	const char *prog_name = prog->name;
 	const struct btf_type *local_type;
 	const char *local_name;
 	__u32 local_id = relo->type_id;
+	bool found;
 	int err;
 
 	local_type = btf__type_by_id(local_btf, local_id);
@@ -5884,37 +6187,79 @@ static int bpf_core_resolve_relo(struct bpf_program *prog,
 	if (!local_name)
 		return -EINVAL;
 
-	if (relo->kind != BPF_CORE_TYPE_ID_LOCAL &&
-	    !hashmap__find(cand_cache, local_id, &cands)) {
-		cands = bpf_core_find_cands(prog->obj, local_btf, local_id);
-		if (IS_ERR(cands)) {
-			pr_warn("prog '%s': relo #%d: target candidate search failed for [%d] %s %s: %ld\n",
-				prog_name, relo_idx, local_id, btf_kind_str(local_type),
-				local_name, PTR_ERR(cands));
-			return PTR_ERR(cands);
-		}
-		err = hashmap__set(cand_cache, local_id, cands, NULL, NULL);
-		if (err) {
+	if (relo->kind == BPF_CORE_TYPE_ID_LOCAL)
+		goto calc;
+
+	bpf_object_lock(ctx->obj);
+	found = hashmap__find(ctx->cand_cache, local_id, &cands);
+	bpf_object_unlock(ctx->obj);
+	if (found)
+		goto calc;
+
+	/* search outside of the lock, other relocations can go on meanwhile */
+	cands = bpf_core_find_cands(ctx, local_btf, local_id);
+	if (IS_ERR(cands)) {
+		pr_warn("prog '%s': relo #%d: target candidate search failed for [%d] %s %s: %ld\n",
+			prog_name, relo_idx, local_id, btf_kind_str(local_type),
+			local_name, PTR_ERR(cands));
+		return PTR_ERR(cands);
+	}
+
+	bpf_object_lock(ctx->obj);
+	/* another thread might have beaten us to it */
+	if (hashmap__find(ctx->cand_cache, local_id, &cached)) {
+		bpf_core_free_cands(cands);
+		cands = cached;
+		err = 0;
+	} else {
+		err = hashmap__add(ctx->cand_cache, local_id, cands);
+		if (err)
 			bpf_core_free_cands(cands);
-			return err;
-		}
 	}
+	bpf_object_unlock(ctx->obj);
+	if (err)
+		return err;
 
+calc:
 	return bpf_core_calc_relo_insn(prog_name, relo, relo_idx, local_btf, cands, specs_scratch,
 				       targ_res);
 }
 
+static int bpf_core_relo_job_fn(void *arg, size_t idx)
+{
+	struct bpf_core_relo_ctx *ctx = arg;
+	struct bpf_core_relo_job *job = &ctx->jobs[idx];
+	struct bpf_program *prog = job->prog;
+	struct bpf_core_relo_res targ_res;
+	int err;
+
+	err = bpf_core_resolve_relo(prog, job->rec, job->relo_idx, ctx->obj->btf, ctx, &targ_res);
+	if (err) {
+		pr_warn("prog '%s': relo #%d: failed to relocate: %d\n",
+			prog->name, job->relo_idx, err);
+		return err;
+	}
+
+	err = bpf_core_patch_insn(prog->name, &prog->insns[job->insn_idx], job->insn_idx,
+				  job->rec, job->relo_idx, &targ_res);
+	if (err) {
+		pr_warn("prog '%s': relo #%d: failed to patch insn #%u: %d\n",
+			prog->name, job->relo_idx, job->insn_idx, err);
+		return err;
+	}
+	return 0;
+}
+
 static int
 bpf_object__relocate_core(struct bpf_object *obj, const char *targ_btf_path)
 {
+	struct bpf_core_relo_ctx ctx = { .obj = obj };
 	const struct btf_ext_info_sec *sec;
-	struct bpf_core_relo_res targ_res;
 	const struct bpf_core_relo *rec;
 	const struct btf_ext_info *seg;
+	struct bpf_core_relo_job *job;
 	struct hashmap_entry *entry;
-	struct hashmap *cand_cache = NULL;
 	struct bpf_program *prog;
-	struct bpf_insn *insn;
 	const char *sec_name;
 	int i, err = 0, insn_idx, sec_idx, sec_num;
 
@@ -5930,9 +6275,9 @@ bpf_object__relocate_core(struct bpf_object *obj, const char *targ_btf_path)
 		}
 	}
 
-	cand_cache = hashmap__new(bpf_core_hash_fn, bpf_core_equal_fn, NULL);
-	if (IS_ERR(cand_cache)) {
-		err = PTR_ERR(cand_cache);
+	ctx.cand_cache = hashmap__new(bpf_core_hash_fn, bpf_core_equal_fn, NULL);
+	if (IS_ERR(ctx.cand_cache)) {
+		err = PTR_ERR(ctx.cand_cache);
 		goto out;
 	}
 
@@ -5951,8 +6296,10 @@ bpf_object__relocate_core(struct bpf_object *obj, const char *targ_btf_path)
 		pr_debug("sec '%s': found %d CO-RE relocations\n", sec_name, sec->num_info);
 
 		for_each_btf_ext_rec(seg, sec, i, rec) {
-			if (rec->insn_off % BPF_INSN_SZ)
-				return -EINVAL;
+			if (rec->insn_off % BPF_INSN_SZ) {
+				err = -EINVAL;
+				goto out;
+			}
 			insn_idx = rec->insn_off / BPF_INSN_SZ;
 			prog = find_prog_by_sec_insn(obj, sec_idx, insn_idx);
 			if (!prog) {
@@ -5979,9 +6326,10 @@ bpf_object__relocate_core(struct bpf_object *obj, const char *targ_btf_path)
 			 * relocated, so it's enough to just subtract in-section offset
 			 */
 			insn_idx = insn_idx - prog->sec_insn_off;
-			if (insn_idx >= prog->insns_cnt)
-				return -EINVAL;
-			insn = &prog->insns[insn_idx];
+			if (insn_idx >= prog->insns_cnt) {
+				err = -EINVAL;
+				goto out;
+			}
 
 			err = record_relo_core(prog, rec, insn_idx);
 			if (err) {
@@ -5993,33 +6341,41 @@ bpf_object__relocate_core(struct bpf_object *obj, const char *targ_btf_path)
 			if (prog->obj->gen_loader)
 				continue;
 
-			err = bpf_core_resolve_relo(prog, rec, i, obj->btf, cand_cache, &targ_res);
-			if (err) {
-				pr_warn("prog '%s': relo #%d: failed to relocate: %d\n",
-					prog->name, i, err);
+			/* resolving and patching is left for after the walk,
+			 * so that it can be spread over multiple threads
+			 */
+			err = libbpf_ensure_mem((void **)&ctx.jobs, &ctx.job_cap,
+						sizeof(*ctx.jobs), ctx.job_cnt + 1);
+			if (err)
 				goto out;
-			}
 
-			err = bpf_core_patch_insn(prog->name, insn, insn_idx, rec, i, &targ_res);
-			if (err) {
-				pr_warn("prog '%s': relo #%d: failed to patch insn #%u: %d\n",
-					prog->name, i, insn_idx, err);
-				goto out;
-			}
+			job = &ctx.jobs[ctx.job_cnt++];
+			job->prog = prog;
+			job->rec = rec;
+			job->relo_idx = i;
+			job->insn_idx = insn_idx;
 		}
 	}
 
+	err = bpf_object_run_parallel(obj, bpf_object_load_threads(obj), ctx.job_cnt,
+				      bpf_core_relo_job_fn, &ctx);
+
 out:
 	/* obj->btf_vmlinux and module BTFs are freed after object load */
 	btf__free(obj->btf_vmlinux_override);
 	obj->btf_vmlinux_override = NULL;
 
-	if (!IS_ERR_OR_NULL(cand_cache)) {
-		hashmap__for_each_entry(cand_cache, entry, i) {
+	if (!IS_ERR_OR_NULL(ctx.cand_cache)) {
+		hashmap__for_each_entry(ctx.cand_cache, entry, i) {
 			bpf_core_free_cands(entry->pvalue);
 		}
-		hashmap__free(cand_cache);
+		hashmap__free(ctx.cand_cache);
 	}
+	flatmap__clear(&ctx.vmlinux_idx.types);
+	for (i = 0; i < ctx.module_idx_cnt; i++)
+		flatmap__clear(&ctx.module_idxs[i].types);
+	free(ctx.module_idxs);
+	free(ctx.jobs);
 	return err;
 }
 
@@ -7889,11 +8245,37 @@ static int bpf_program_record_relos(struct bpf_program *prog)
 	return 0;
 }
 
+struct bpf_prog_load_work {
+	struct bpf_object *obj;
+	struct bpf_program **progs;
+};
+
+static int bpf_object_load_prog_fn(void *arg, size_t idx)
+{
+	struct bpf_prog_load_work *work = arg;
+	struct bpf_program *prog = work->progs[idx];
+	struct bpf_object *obj = work->obj;
+	int err;
+
+	if (obj->gen_loader)
+		bpf_program_record_relos(prog);
+
+	err = bpf_object_load_prog(obj, prog, prog->insns, prog->insns_cnt,
+				   obj->license, obj->kern_version, &prog->fd);
+	if (err) {
+		pr_warn("prog '%s': failed to load: %d\n", prog->name, err);
+		return err;
+	}
+	return 0;
+}
+
 static int
 bpf_object__load_progs(struct bpf_object *obj, int log_level)
 {
+	struct bpf_prog_load_work work = { .obj = obj };
 	struct bpf_program *prog;
-	size_t i;
+	__u32 nr_threads;
+	size_t i, cnt = 0;
 	int err;
 
 	for (i = 0; i < obj->nr_programs; i++) {
@@ -7903,6 +8285,10 @@ bpf_object__load_progs(struct bpf_object *obj, int log_level)
 			return err;
 	}
 
+	work.progs = calloc(obj->nr_programs, sizeof(*work.progs));
+	if (obj->nr_programs && !work.progs)
+		return -ENOMEM;
+
 	for (i = 0; i < obj->nr_programs; i++) {
 		prog = &obj->programs[i];
 		if (prog_is_subprog(obj, prog))
@@ -7912,18 +8298,16 @@ bpf_object__load_progs(struct bpf_object *obj, int log_level)
 			continue;
 		}
 		prog->log_level |= log_level;
-
-		if (obj->gen_loader)
-			bpf_program_record_relos(prog);
-
-		err = bpf_object_load_prog(obj, prog, prog->insns, prog->insns_cnt,
-					   obj->license, obj->kern_version, &prog->fd);
-		if (err) {
-			pr_warn("prog '%s': failed to load: %d\n", prog->name, err);
-			return err;
-		}
+		work.progs[cnt++] = prog;
 	}
 
+	/* the object-wide log buffer can't be shared between loads */
+	nr_threads = obj->log_buf ? 1 : bpf_object_load_threads(obj);
+	err = bpf_object_run_parallel(obj, nr_threads, cnt, bpf_object_load_prog_fn, &work);
+	free(work.progs);
+	if (err)
+		return err;
+
 	bpf_object__free_relocs(obj);
 	return 0;
 }
@@ -7972,7 +8356,7 @@ static struct bpf_object *bpf_object_open(const char *path, const void *obj_buf,
 	int err;
 	char *log_buf;
 	size_t log_size;
-	__u32 log_level;
+	__u32 log_level, load_threads;
 
 	if (obj_buf && !obj_name)
 		return ERR_PTR(-EINVAL);
@@ -7997,6 +8381,7 @@ static struct bpf_object *bpf_object_open(const char *path, const void *obj_buf,
 	log_buf = OPTS_GET(opts, kernel_log_buf, NULL);
 	log_size = OPTS_GET(opts, kernel_log_size, 0);
 	log_level = OPTS_GET(opts, kernel_log_level, 0);
+	load_threads = OPTS_GET(opts, load_threads, 0);
 	if (log_size > UINT_MAX)
 		return ERR_PTR(-EINVAL);
 	if (log_size && !log_buf)
@@ -8019,6 +8404,7 @@ static struct bpf_object *bpf_object_open(const char *path, const void *obj_buf,
 	obj->log_buf = log_buf;
 	obj->log_size = log_size;
 	obj->log_level = log_level;
+	obj->load_threads = load_threads;
 
 	if (token_path) {
 		obj->token_path = strdup(token_path);
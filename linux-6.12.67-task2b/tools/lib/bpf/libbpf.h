@@ -199,10 +199,22 @@ struct bpf_object_open_opts {
 	 * point (/sys/fs/bpf), in case this default behavior is undesirable.
 	 */
 	const char *bpf_token_path;
+	/* Maximum number of threads bpf_object__load() can use to resolve
+	 * CO-RE relocations and to load BPF programs into the kernel. Zero
+	 * or one (default) keeps all the work on the calling thread.
+	 *
+	 * With more threads, print callback and custom program section
+	 * handlers' prog_prepare_load_fn callbacks (see
+	 * libbpf_register_prog_handler()) can be called concurrently, for
+	 * different programs, from threads other than the calling one.
+	 * Programs are always loaded one at a time if kernel_log_buf is set
+	 * or a light skeleton is generated.
+	 */
+	__u32 load_threads;
 
 	size_t :0;
 };
-#define bpf_object_open_opts__last_field bpf_token_path
+#define bpf_object_open_opts__last_field load_threads
 
 /**
  * @brief **bpf_object__open()** creates a bpf_object by opening
@@ -739,12 +751,17 @@ struct bpf_usdt_opts {
  * Statically Defined Tracepoint) attachment, instead of attaching to
  * user-space function entry or exit.
  *
+ * With NULL usdt_provider and/or usdt_name, all matching USDTs in the
+ * binary are attached through the single returned link (a single
+ * multi-uprobe link, if the kernel supports it), sharing the same
+ * usdt_cookie.
+ *
  * @param prog BPF program to attach
  * @param pid Process ID to attach the uprobe to, 0 for self (own process),
  * -1 for all processes
  * @param binary_path Path to binary that contains provided USDT probe
- * @param usdt_provider USDT provider name
- * @param usdt_name USDT probe name
+ * @param usdt_provider USDT provider name, or NULL to match any provider
+ * @param usdt_name USDT probe name, or NULL to match any probe name
  * @param opts Options for altering program attachment
  * @return Reference to the newly created BPF link; or NULL is returned on error,
  * error code is stored in errno
@@ -1313,9 +1330,15 @@ typedef int (*ring_buffer_sample_fn)(void *ctx, void *data, size_t size);
 
 struct ring_buffer_opts {
 	size_t sz; /* size of this struct, for forward/backward compatibility */
+	/* Consume the records of a BPF_F_RINGBUF_PERCPU map in the order of
+	 * a __u64 timestamp at the start of each record, as far as they are
+	 * available. Otherwise each CPU's records are consumed in turn.
+	 */
+	bool ordered;
+	size_t :0;
 };
 
-#define ring_buffer_opts__last_field sz
+#define ring_buffer_opts__last_field ordered
 
 LIBBPF_API struct ring_buffer *
 ring_buffer__new(int map_fd, ring_buffer_sample_fn sample_cb, void *ctx,
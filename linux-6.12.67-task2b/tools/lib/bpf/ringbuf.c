@@ -30,6 +30,8 @@ struct ring {
 	unsigned long *producer_pos;
 	unsigned long mask;
 	int map_fd;
+	/* number of rings of the map, starting with this one; 0 if not first */
+	int group_cnt;
 };
 
 struct ring_buffer {
@@ -38,6 +40,7 @@ struct ring_buffer {
 	size_t page_size;
 	int epoll_fd;
 	int ring_cnt;
+	bool ordered;
 };
 
 struct user_ring_buffer {
@@ -71,56 +74,26 @@ static void ringbuf_free_ring(struct ring_buffer *rb, struct ring *r)
 	free(r);
 }
 
-/* Add extra RINGBUF maps to this ring buffer manager */
-int ring_buffer__add(struct ring_buffer *rb, int map_fd,
-		     ring_buffer_sample_fn sample_cb, void *ctx)
+/* mmap() the ring at offset @off of the RINGBUF map @map_fd */
+static struct ring *ringbuf_map_ring(struct ring_buffer *rb, int map_fd,
+				     __u32 size, __u64 off, int *perr)
 {
-	struct bpf_map_info info;
-	__u32 len = sizeof(info);
-	struct epoll_event *e;
 	struct ring *r;
 	__u64 mmap_sz;
 	void *tmp;
 	int err;
 
-	memset(&info, 0, sizeof(info));
-
-	err = bpf_map_get_info_by_fd(map_fd, &info, &len);
-	if (err) {
-		err = -errno;
-		pr_warn("ringbuf: failed to get map info for fd=%d: %d\n",
-			map_fd, err);
-		return libbpf_err(err);
-	}
-
-	if (info.type != BPF_MAP_TYPE_RINGBUF) {
-		pr_warn("ringbuf: map fd=%d is not BPF_MAP_TYPE_RINGBUF\n",
-			map_fd);
-		return libbpf_err(-EINVAL);
-	}
-
-	tmp = libbpf_reallocarray(rb->rings, rb->ring_cnt + 1, sizeof(*rb->rings));
-	if (!tmp)
-		return libbpf_err(-ENOMEM);
-	rb->rings = tmp;
-
-	tmp = libbpf_reallocarray(rb->events, rb->ring_cnt + 1, sizeof(*rb->events));
-	if (!tmp)
-		return libbpf_err(-ENOMEM);
-	rb->events = tmp;
-
 	r = calloc(1, sizeof(*r));
-	if (!r)
-		return libbpf_err(-ENOMEM);
-	rb->rings[rb->ring_cnt] = r;
+	if (!r) {
+		*perr = -ENOMEM;
+		return NULL;
+	}
 
 	r->map_fd = map_fd;
-	r->sample_cb = sample_cb;
-	r->ctx = ctx;
-	r->mask = info.max_entries - 1;
+	r->mask = size - 1;
 
 	/* Map writable consumer page */
-	tmp = mmap(NULL, rb->page_size, PROT_READ | PROT_WRITE, MAP_SHARED, map_fd, 0);
+	tmp = mmap(NULL, rb->page_size, PROT_READ | PROT_WRITE, MAP_SHARED, map_fd, off);
 	if (tmp == MAP_FAILED) {
 		err = -errno;
 		pr_warn("ringbuf: failed to mmap consumer page for map fd=%d: %d\n",
@@ -133,13 +106,14 @@ int ring_buffer__add(struct ring_buffer *rb, int map_fd,
 	 * data size to allow simple reading of samples that wrap around the
 	 * end of a ring buffer. See kernel implementation for details.
 	 */
-	mmap_sz = rb->page_size + 2 * (__u64)info.max_entries;
+	mmap_sz = rb->page_size + 2 * (__u64)size;
 	if (mmap_sz != (__u64)(size_t)mmap_sz) {
 		err = -E2BIG;
-		pr_warn("ringbuf: ring buffer size (%u) is too big\n", info.max_entries);
+		pr_warn("ringbuf: ring buffer size (%u) is too big\n", size);
 		goto err_out;
 	}
-	tmp = mmap(NULL, (size_t)mmap_sz, PROT_READ, MAP_SHARED, map_fd, rb->page_size);
+	tmp = mmap(NULL, (size_t)mmap_sz, PROT_READ, MAP_SHARED, map_fd,
+		   off + rb->page_size);
 	if (tmp == MAP_FAILED) {
 		err = -errno;
 		pr_warn("ringbuf: failed to mmap data pages for map fd=%d: %d\n",
@@ -148,6 +122,71 @@ int ring_buffer__add(struct ring_buffer *rb, int map_fd,
 	}
 	r->producer_pos = tmp;
 	r->data = tmp + rb->page_size;
+	return r;
+
+err_out:
+	ringbuf_free_ring(rb, r);
+	*perr = err;
+	return NULL;
+}
+
+/* Add extra RINGBUF maps to this ring buffer manager */
+int ring_buffer__add(struct ring_buffer *rb, int map_fd,
+		     ring_buffer_sample_fn sample_cb, void *ctx)
+{
+	struct bpf_map_info info;
+	__u32 len = sizeof(info);
+	int i, err, cnt = 1;
+	struct epoll_event *e;
+	struct ring *r;
+	__u64 stride;
+	void *tmp;
+
+	memset(&info, 0, sizeof(info));
+
+	err = bpf_map_get_info_by_fd(map_fd, &info, &len);
+	if (err) {
+		err = -errno;
+		pr_warn("ringbuf: failed to get map info for fd=%d: %d\n",
+			map_fd, err);
+		return libbpf_err(err);
+	}
+
+	if (info.type != BPF_MAP_TYPE_RINGBUF) {
+		pr_warn("ringbuf: map fd=%d is not BPF_MAP_TYPE_RINGBUF\n",
+			map_fd);
+		return libbpf_err(-EINVAL);
+	}
+
+	/* A per-CPU map has one ring per possible CPU, mapped one after the
+	 * other. They are all polled through the map fd.
+	 */
+	if (info.map_flags & BPF_F_RINGBUF_PERCPU) {
+		cnt = libbpf_num_possible_cpus();
+		if (cnt < 0)
+			return libbpf_err(cnt);
+	}
+	stride = 2 * rb->page_size + 2 * (__u64)info.max_entries;
+
+	tmp = libbpf_reallocarray(rb->rings, rb->ring_cnt + cnt, sizeof(*rb->rings));
+	if (!tmp)
+		return libbpf_err(-ENOMEM);
+	rb->rings = tmp;
+
+	tmp = libbpf_reallocarray(rb->events, rb->ring_cnt + cnt, sizeof(*rb->events));
+	if (!tmp)
+		return libbpf_err(-ENOMEM);
+	rb->events = tmp;
+
+	for (i = 0; i < cnt; i++) {
+		r = ringbuf_map_ring(rb, map_fd, info.max_entries, i * stride, &err);
+		if (!r)
+			goto err_out;
+		r->sample_cb = sample_cb;
+		r->ctx = ctx;
+		rb->rings[rb->ring_cnt + i] = r;
+	}
+	rb->rings[rb->ring_cnt]->group_cnt = cnt;
 
 	e = &rb->events[rb->ring_cnt];
 	memset(e, 0, sizeof(*e));
@@ -161,11 +200,12 @@ int ring_buffer__add(struct ring_buffer *rb, int map_fd,
 		goto err_out;
 	}
 
-	rb->ring_cnt++;
+	rb->ring_cnt += cnt;
 	return 0;
 
 err_out:
-	ringbuf_free_ring(rb, r);
+	while (i--)
+		ringbuf_free_ring(rb, rb->rings[rb->ring_cnt + i]);
 	return libbpf_err(err);
 }
 
@@ -201,6 +241,7 @@ ring_buffer__new(int map_fd, ring_buffer_sample_fn sample_cb, void *ctx,
 		return errno = ENOMEM, NULL;
 
 	rb->page_size = getpagesize();
+	rb->ordered = OPTS_GET(opts, ordered, false);
 
 	rb->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
 	if (rb->epoll_fd < 0) {
@@ -277,6 +318,82 @@ done:
 	return cnt;
 }
 
+/* Consume up to n records of the rings of one per-CPU map in the order of
+ * the __u64 timestamp each of them starts with. This stops at the first
+ * record not committed yet, as it might be older than the ones after it.
+ */
+static int64_t ringbuf_process_ordered(struct ring **rings, int cnt, size_t n)
+{
+	unsigned long cons_pos, prod_pos, best_pos = 0;
+	struct ring *r, *best;
+	__u64 ts, best_ts = 0;
+	int64_t res = 0;
+	int *len_ptr, len, i, err;
+	void *sample;
+
+	while (res < n) {
+		best = NULL;
+		for (i = 0; i < cnt; i++) {
+			r = rings[i];
+			cons_pos = smp_load_acquire(r->consumer_pos);
+			prod_pos = smp_load_acquire(r->producer_pos);
+
+			/* skip discarded records */
+			while (cons_pos < prod_pos) {
+				len_ptr = r->data + (cons_pos & r->mask);
+				len = smp_load_acquire(len_ptr);
+				if (len & BPF_RINGBUF_BUSY_BIT)
+					return res;
+				if ((len & BPF_RINGBUF_DISCARD_BIT) == 0)
+					break;
+				cons_pos += roundup_len(len);
+				smp_store_release(r->consumer_pos, cons_pos);
+			}
+			if (cons_pos >= prod_pos)
+				continue;
+
+			sample = (void *)len_ptr + BPF_RINGBUF_HDR_SZ;
+			ts = len >= sizeof(ts) ? *(__u64 *)sample : 0;
+			if (!best || ts < best_ts) {
+				best = r;
+				best_ts = ts;
+				best_pos = cons_pos;
+			}
+		}
+		if (!best)
+			break;
+
+		len_ptr = best->data + (best_pos & best->mask);
+		len = *len_ptr;
+		sample = (void *)len_ptr + BPF_RINGBUF_HDR_SZ;
+		err = best->sample_cb(best->ctx, sample, len);
+		smp_store_release(best->consumer_pos, best_pos + roundup_len(len));
+		if (err < 0)
+			return err;
+		res++;
+	}
+	return res;
+}
+
+/* Consume the rings of the map whose first ring is rings[idx] */
+static int64_t ringbuf_process_group(struct ring_buffer *rb, int idx, size_t n)
+{
+	int64_t err, res = 0;
+	int i, cnt = rb->rings[idx]->group_cnt;
+
+	if (rb->ordered && cnt > 1)
+		return ringbuf_process_ordered(&rb->rings[idx], cnt, n);
+
+	for (i = idx; i < idx + cnt && n; i++) {
+		err = ringbuf_process_ring(rb->rings[i], n);
+		if (err < 0)
+			return err;
+		res += err;
+		n -= err;
+	}
+	return res;
+}
+
 /* Consume available ring buffer(s) data without event polling, up to n
  * records.
  *
@@ -289,10 +406,8 @@ int ring_buffer__consume_n(struct ring_buffer *rb, size_t n)
 	int64_t err, res = 0;
 	int i;
 
-	for (i = 0; i < rb->ring_cnt; i++) {
-		struct ring *ring = rb->rings[i];
-
-		err = ringbuf_process_ring(ring, n);
+	for (i = 0; i < rb->ring_cnt; i += rb->rings[i]->group_cnt) {
+		err = ringbuf_process_group(rb, i, n);
 		if (err < 0)
 			return libbpf_err(err);
 		res += err;
@@ -314,10 +429,8 @@ int ring_buffer__consume(struct ring_buffer *rb)
 	int64_t err, res = 0;
 	int i;
 
-	for (i = 0; i < rb->ring_cnt; i++) {
-		struct ring *ring = rb->rings[i];
-
-		err = ringbuf_process_ring(ring, INT_MAX);
+	for (i = 0; i < rb->ring_cnt; i += rb->rings[i]->group_cnt) {
+		err = ringbuf_process_group(rb, i, INT_MAX);
 		if (err < 0)
 			return libbpf_err(err);
 		res += err;
@@ -344,9 +457,8 @@ int ring_buffer__poll(struct ring_buffer *rb, int timeout_ms)
 
 	for (i = 0; i < cnt; i++) {
 		__u32 ring_id = rb->events[i].data.fd;
-		struct ring *ring = rb->rings[ring_id];
 
-		err = ringbuf_process_ring(ring, INT_MAX);
+		err = ringbuf_process_group(rb, ring_id, INT_MAX);
 		if (err < 0)
 			return libbpf_err(err);
 		res += err;
@@ -5,7 +5,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <linux/err.h>
-#include "hashmap.h"
+#include "flatmap.h"
 #include "libbpf_internal.h"
 #include "strset.h"
 
@@ -16,7 +16,7 @@ struct strset {
 	size_t strs_data_max_len;
 
 	/* lookup index for each unique string in strings set */
-	struct hashmap *strs_hash;
+	struct flatmap *strs_hash;
 };
 
 static size_t strset_hash_fn(long key, void *ctx)
@@ -39,13 +39,13 @@ static bool strset_equal_fn(long key1, long key2, void *ctx)
 struct strset *strset__new(size_t max_data_sz, const char *init_data, size_t init_data_sz)
 {
 	struct strset *set = calloc(1, sizeof(*set));
-	struct hashmap *hash;
+	struct flatmap *hash;
 	int err = -ENOMEM;
 
 	if (!set)
 		return ERR_PTR(-ENOMEM);
 
-	hash = hashmap__new(strset_hash_fn, strset_equal_fn, set);
+	hash = flatmap__new(strset_hash_fn, strset_equal_fn, set);
 	if (IS_ERR(hash))
 		goto err_out;
 
@@ -64,10 +64,10 @@ struct strset *strset__new(size_t max_data_sz, const char *init_data, size_t ini
 		set->strs_data_cap = init_data_sz;
 
 		for (off = 0; off < set->strs_data_len; off += strlen(set->strs_data + off) + 1) {
-			/* hashmap__add() returns EEXIST if string with the same
+			/* flatmap__add() returns EEXIST if string with the same
 			 * content already is in the hash map
 			 */
-			err = hashmap__add(hash, off, off);
+			err = flatmap__add(hash, off, off);
 			if (err == -EEXIST)
 				continue; /* duplicate */
 			if (err)
@@ -86,7 +86,7 @@ void strset__free(struct strset *set)
 	if (IS_ERR_OR_NULL(set))
 		return;
 
-	hashmap__free(set->strs_hash);
+	flatmap__free(set->strs_hash);
 	free(set->strs_data);
 	free(set);
 }
@@ -127,7 +127,7 @@ int strset__find_str(struct strset *set, const char *s)
 	new_off = set->strs_data_len;
 	memcpy(p, s, len);
 
-	if (hashmap__find(set->strs_hash, new_off, &old_off))
+	if (flatmap__find(set->strs_hash, new_off, &old_off))
 		return old_off;
 
 	return -ENOENT;
@@ -165,7 +165,7 @@ int strset__add_str(struct strset *set, const char *s)
 	 * contents doesn't exist already (HASHMAP_ADD strategy). If such
 	 * string exists, we'll get its offset in old_off (that's old_key).
 	 */
-	err = hashmap__insert(set->strs_hash, new_off, new_off,
+	err = flatmap__insert(set->strs_hash, new_off, new_off,
 			      HASHMAP_ADD, &old_off, NULL);
 	if (err == -EEXIST)
 		return old_off; /* duplicated string, return existing offset */
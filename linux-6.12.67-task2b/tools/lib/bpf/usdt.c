@@ -262,6 +262,8 @@ struct usdt_manager {
 	bool has_bpf_cookie;
 	bool has_sema_refcnt;
 	bool has_uprobe_multi;
+	/* cleared on first BPF_MAP_UPDATE_BATCH failure on old kernels */
+	bool has_batch_update;
 };
 
 struct usdt_manager *usdt_manager_new(struct bpf_object *obj)
@@ -301,6 +303,11 @@ struct usdt_manager *usdt_manager_new(struct bpf_object *obj)
 	 * usdt probes.
 	 */
 	man->has_uprobe_multi = kernel_supports(obj, FEAT_UPROBE_MULTI_LINK);
+
+	/* Batch map updates were added in v5.6. There is no cheap way to
+	 * probe for them, so just try and remember if it didn't work.
+	 */
+	man->has_batch_update = true;
 	return man;
 }
 
@@ -639,7 +646,9 @@ static int collect_usdt_targets(struct usdt_manager *man, Elf *elf, const char *
 		if (err)
 			goto err_out;
 
-		if (strcmp(note.provider, usdt_provider) != 0 || strcmp(note.name, usdt_name) != 0)
+		/* NULL provider or name matches any */
+		if ((usdt_provider && strcmp(note.provider, usdt_provider) != 0) ||
+		    (usdt_name && strcmp(note.name, usdt_name) != 0))
 			continue;
 
 		/* We need to compensate "prelink effect". See [0] for details,
@@ -682,13 +691,13 @@ static int collect_usdt_targets(struct usdt_manager *man, Elf *elf, const char *
 		if (!seg) {
 			err = -ESRCH;
 			pr_warn("usdt: failed to find ELF program segment for '%s:%s' in '%s' at IP 0x%lx\n",
-				usdt_provider, usdt_name, path, usdt_abs_ip);
+				note.provider, note.name, path, usdt_abs_ip);
 			goto err_out;
 		}
 		if (!seg->is_exec) {
 			err = -ESRCH;
 			pr_warn("usdt: matched ELF binary '%s' segment [0x%lx, 0x%lx) for '%s:%s' at IP 0x%lx is not executable\n",
-				path, seg->start, seg->end, usdt_provider, usdt_name,
+				path, seg->start, seg->end, note.provider, note.name,
 				usdt_abs_ip);
 			goto err_out;
 		}
@@ -729,7 +738,7 @@ static int collect_usdt_targets(struct usdt_manager *man, Elf *elf, const char *
 			if (!seg) {
 				err = -ESRCH;
 				pr_warn("usdt: failed to find shared lib memory segment for '%s:%s' in '%s' at relative IP 0x%lx\n",
-					usdt_provider, usdt_name, path, usdt_rel_ip);
+					note.provider, note.name, path, usdt_rel_ip);
 				goto err_out;
 			}
 
@@ -737,7 +746,7 @@ static int collect_usdt_targets(struct usdt_manager *man, Elf *elf, const char *
 		}
 
 		pr_debug("usdt: probe for '%s:%s' in %s '%s': addr 0x%lx base 0x%lx (resolved abs_ip 0x%lx rel_ip 0x%lx) args '%s' in segment [0x%lx, 0x%lx) at offset 0x%lx\n",
-			 usdt_provider, usdt_name, ehdr.e_type == ET_EXEC ? "exec" : "lib ", path,
+			 note.provider, note.name, ehdr.e_type == ET_EXEC ? "exec" : "lib ", path,
 			 note.loc_addr, note.base_addr, usdt_abs_ip, usdt_rel_ip, note.args,
 			 seg ? seg->start : 0, seg ? seg->end : 0, seg ? seg->offset : 0);
 
@@ -745,7 +754,7 @@ static int collect_usdt_targets(struct usdt_manager *man, Elf *elf, const char *
 		if (note.sema_addr) {
 			if (!man->has_sema_refcnt) {
 				pr_warn("usdt: kernel doesn't support USDT semaphore refcounting for '%s:%s' in '%s'\n",
-					usdt_provider, usdt_name, path);
+					note.provider, note.name, path);
 				err = -ENOTSUP;
 				goto err_out;
 			}
@@ -754,13 +763,13 @@ static int collect_usdt_targets(struct usdt_manager *man, Elf *elf, const char *
 			if (!seg) {
 				err = -ESRCH;
 				pr_warn("usdt: failed to find ELF loadable segment with semaphore of '%s:%s' in '%s' at 0x%lx\n",
-					usdt_provider, usdt_name, path, note.sema_addr);
+					note.provider, note.name, path, note.sema_addr);
 				goto err_out;
 			}
 			if (seg->is_exec) {
 				err = -ESRCH;
 				pr_warn("usdt: matched ELF binary '%s' segment [0x%lx, 0x%lx] for semaphore of '%s:%s' at 0x%lx is executable\n",
-					path, seg->start, seg->end, usdt_provider, usdt_name,
+					path, seg->start, seg->end, note.provider, note.name,
 					note.sema_addr);
 				goto err_out;
 			}
@@ -768,7 +777,7 @@ static int collect_usdt_targets(struct usdt_manager *man, Elf *elf, const char *
 			usdt_sema_off = note.sema_addr - seg->start + seg->offset;
 
 			pr_debug("usdt: sema  for '%s:%s' in %s '%s': addr 0x%lx base 0x%lx (resolved 0x%lx) in segment [0x%lx, 0x%lx] at offset 0x%lx\n",
-				 usdt_provider, usdt_name, ehdr.e_type == ET_EXEC ? "exec" : "lib ",
+				 note.provider, note.name, ehdr.e_type == ET_EXEC ? "exec" : "lib ",
 				 path, note.sema_addr, note.base_addr, usdt_sema_off,
 				 seg->start, seg->end, seg->offset);
 		}
@@ -963,22 +972,56 @@ static int allocate_spec_id(struct usdt_manager *man, struct hashmap *specs_hash
 	return 0;
 }
 
+/* Set up all new specs of a link with a single BPF_MAP_UPDATE_BATCH command
+ * or, if kernel doesn't support it, one by one
+ */
+static int update_specs(struct usdt_manager *man, const int *spec_ids,
+			const struct usdt_spec *specs, __u32 cnt)
+{
+	int spec_map_fd = bpf_map__fd(man->specs_map);
+	__u32 i, n = cnt;
+	int err;
+
+	if (!cnt)
+		return 0;
+
+	if (man->has_batch_update) {
+		err = bpf_map_update_batch(spec_map_fd, spec_ids, specs, &n, NULL);
+		if (!err)
+			return 0;
+		err = -errno;
+		/* specs map is an array, so only an unknown command can fail
+		 * like that; it's fine to redo elements it might have updated
+		 */
+		if (err != -EINVAL)
+			return err;
+		pr_debug("usdt: batch map updates are not supported, updating specs one by one\n");
+		man->has_batch_update = false;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		if (bpf_map_update_elem(spec_map_fd, &spec_ids[i], &specs[i], BPF_ANY))
+			return -errno;
+	}
+	return 0;
+}
+
 struct bpf_link *usdt_manager_attach_usdt(struct usdt_manager *man, const struct bpf_program *prog,
 					  pid_t pid, const char *path,
 					  const char *usdt_provider, const char *usdt_name,
 					  __u64 usdt_cookie)
 {
 	unsigned long *offsets = NULL, *ref_ctr_offsets = NULL;
-	int i, err, spec_map_fd, ip_map_fd;
 	LIBBPF_OPTS(bpf_uprobe_opts, opts);
 	struct hashmap *specs_hash = NULL;
 	struct bpf_link_usdt *link = NULL;
 	struct usdt_target *targets = NULL;
+	struct usdt_spec *specs = NULL;
 	__u64 *cookies = NULL;
 	struct elf_fd elf_fd;
 	size_t target_cnt;
+	int i, err, ip_map_fd;
 
-	spec_map_fd = bpf_map__fd(man->specs_map);
 	ip_map_fd = bpf_map__fd(man->ip_to_spec_id_map);
 
 	err = elf_open(path, &elf_fd);
@@ -1005,6 +1048,10 @@ struct bpf_link *usdt_manager_attach_usdt(struct usdt_manager *man, const struct
 		goto err_out;
 	}
 
+	/* for messages below, NULL provider or name matched any */
+	usdt_provider = usdt_provider ?: "*";
+	usdt_name = usdt_name ?: "*";
+
 	specs_hash = hashmap__new(specs_hash_fn, specs_equal_fn, NULL);
 	if (IS_ERR(specs_hash)) {
 		err = PTR_ERR(specs_hash);
@@ -1021,12 +1068,19 @@ struct bpf_link *usdt_manager_attach_usdt(struct usdt_manager *man, const struct
 	link->link.detach = &bpf_link_usdt_detach;
 	link->link.dealloc = &bpf_link_usdt_dealloc;
 
+	/* cookies double as spec IDs of each target on the single uprobe path */
+	cookies = calloc(target_cnt, sizeof(*cookies));
+	specs = calloc(target_cnt, sizeof(*specs));
+	if (!cookies || !specs) {
+		err = -ENOMEM;
+		goto err_out;
+	}
+
 	if (man->has_uprobe_multi) {
 		offsets = calloc(target_cnt, sizeof(*offsets));
-		cookies = calloc(target_cnt, sizeof(*cookies));
 		ref_ctr_offsets = calloc(target_cnt, sizeof(*ref_ctr_offsets));
 
-		if (!offsets || !ref_ctr_offsets || !cookies) {
+		if (!offsets || !ref_ctr_offsets) {
 			err = -ENOMEM;
 			goto err_out;
 		}
@@ -1040,7 +1094,6 @@ struct bpf_link *usdt_manager_attach_usdt(struct usdt_manager *man, const struct
 
 	for (i = 0; i < target_cnt; i++) {
 		struct usdt_target *target = &targets[i];
-		struct bpf_link *uprobe_link;
 		bool is_new;
 		int spec_id;
 
@@ -1056,12 +1109,25 @@ struct bpf_link *usdt_manager_attach_usdt(struct usdt_manager *man, const struct
 		if (err)
 			goto err_out;
 
-		if (is_new && bpf_map_update_elem(spec_map_fd, &spec_id, &target->spec, BPF_ANY)) {
-			err = -errno;
-			pr_warn("usdt: failed to set USDT spec #%d for '%s:%s' in '%s': %d\n",
-				spec_id, usdt_provider, usdt_name, path, err);
-			goto err_out;
-		}
+		/* new spec IDs are appended to link->spec_ids in order */
+		if (is_new)
+			specs[link->spec_cnt - 1] = target->spec;
+		cookies[i] = spec_id;
+	}
+
+	/* all the specs have to be in place before any uprobe can fire */
+	err = update_specs(man, link->spec_ids, specs, link->spec_cnt);
+	if (err) {
+		pr_warn("usdt: failed to set %zu USDT specs for '%s:%s' in '%s': %d\n",
+			link->spec_cnt, usdt_provider, usdt_name, path, err);
+		goto err_out;
+	}
+
+	for (i = 0; i < target_cnt; i++) {
+		struct usdt_target *target = &targets[i];
+		struct bpf_link *uprobe_link;
+		int spec_id = cookies[i];
+
 		if (!man->has_bpf_cookie &&
 		    bpf_map_update_elem(ip_map_fd, &target->abs_ip, &spec_id, BPF_NOEXIST)) {
 			err = -errno;
@@ -1079,7 +1145,6 @@ struct bpf_link *usdt_manager_attach_usdt(struct usdt_manager *man, const struct
 		if (man->has_uprobe_multi) {
 			offsets[i] = target->rel_ip;
 			ref_ctr_offsets[i] = target->sema_off;
-			cookies[i] = spec_id;
 		} else {
 			opts.ref_ctr_offset = target->sema_off;
 			opts.bpf_cookie = man->has_bpf_cookie ? spec_id : 0;
@@ -1117,9 +1182,10 @@ struct bpf_link *usdt_manager_attach_usdt(struct usdt_manager *man, const struct
 
 		free(offsets);
 		free(ref_ctr_offsets);
-		free(cookies);
 	}
 
+	free(cookies);
+	free(specs);
 	free(targets);
 	hashmap__free(specs_hash);
 	elf_close(&elf_fd);
@@ -1129,6 +1195,7 @@ err_out:
 	free(offsets);
 	free(ref_ctr_offsets);
 	free(cookies);
+	free(specs);
 
 	if (link)
 		bpf_link__destroy(&link->link);
@@ -35,8 +35,20 @@ int bench_futex_wake_parallel(int argc, const char **argv);
 int bench_futex_requeue(int argc, const char **argv);
 /* pi futexes */
 int bench_futex_lock_pi(int argc, const char **argv);
+int bench_ipc_sem(int argc, const char **argv);
+int bench_ipc_msg(int argc, const char **argv);
+int bench_ipc_mq(int argc, const char **argv);
+int bench_ipc_shm(int argc, const char **argv);
 int bench_epoll_wait(int argc, const char **argv);
 int bench_epoll_ctl(int argc, const char **argv);
+int bench_uring_nop(int argc, const char **argv);
+int bench_uring_read(int argc, const char **argv);
+int bench_uring_recv(int argc, const char **argv);
+int bench_ds_rhashtable(int argc, const char **argv);
+int bench_ds_maple(int argc, const char **argv);
+int bench_ds_xarray(int argc, const char **argv);
+int bench_ds_sbitmap(int argc, const char **argv);
+int bench_ds_percpu_counter(int argc, const char **argv);
 int bench_synthesize(int argc, const char **argv);
 int bench_kallsyms_parse(int argc, const char **argv);
 int bench_inject_build_id(int argc, const char **argv);
@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Drive the in-kernel lib/ data structure benchmark (CONFIG_DS_BENCHMARK).
+ *
+ * The measurement itself happens in the ds_benchmark module: every run is
+ * configured by writing to <debugfs>/ds_benchmark/run and its results are
+ * read back from the same file. This front end repeats the run for a list
+ * of thread counts and prints how throughput scales with them.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/kernel.h>
+#include <perf/cpumap.h>
+#include <api/fs/fs.h>
+
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <err.h>
+
+#define DS_MAX_RUNS	64
+
+static const char *threads_str;
+static unsigned int keys = 65536;
+static unsigned int fill = 50;
+static unsigned int duration = 1000;
+static unsigned int seed = 1;
+static const char *dist = "uniform";
+static const char *mix = "80,10,10";
+static const char *hot = "10,90";
+
+static const struct option options[] = {
+	OPT_STRING('t', "threads", &threads_str, "n[,n...]",
+		   "Thread counts to run with (default: powers of two up to the number of CPUs)"),
+	OPT_UINTEGER('k', "keys", &keys, "Size of the key space"),
+	OPT_UINTEGER('f', "fill", &fill, "Percentage of keys present at start"),
+	OPT_UINTEGER('l', "duration", &duration, "Duration of every run (in msecs)"),
+	OPT_STRING('d', "dist", &dist, "uniform|seq|hot", "Key distribution"),
+	OPT_STRING('m', "mix", &mix, "lookup,insert,erase", "Relative weight of the operations"),
+	OPT_STRING('H', "hot", &hot, "keys%,ops%", "Share of operations going to a share of the keys (--dist hot)"),
+	OPT_UINTEGER('s', "seed", &seed, "Random seed"),
+	OPT_END()
+};
+
+static const char * const bench_ds_usage[] = {
+	"perf bench ds <rhashtable|maple|xarray|sbitmap|percpu_counter> <options>",
+	NULL
+};
+
+struct ds_result {
+	unsigned long long ops_per_sec;
+	unsigned long long thread_min, thread_max;
+	unsigned long long lookup, lookup_miss;
+	unsigned long long insert, insert_fail;
+	unsigned long long erase, erase_fail;
+};
+
+static int ds_parse_result(char *line, struct ds_result *r)
+{
+	const struct {
+		const char *name;
+		unsigned long long *val;
+	} fields[] = {
+		{ "ops_per_sec",	&r->ops_per_sec },
+		{ "thread_min",		&r->thread_min },
+		{ "thread_max",		&r->thread_max },
+		{ "lookup",		&r->lookup },
+		{ "lookup_miss",	&r->lookup_miss },
+		{ "insert",		&r->insert },
+		{ "insert_fail",	&r->insert_fail },
+		{ "erase",		&r->erase },
+		{ "erase_fail",		&r->erase_fail },
+	};
+	char *tok, *saveptr = NULL;
+	unsigned int i, found = 0;
+
+	memset(r, 0, sizeof(*r));
+	for (tok = strtok_r(line, " \n", &saveptr); tok;
+	     tok = strtok_r(NULL, " \n", &saveptr)) {
+		char *val = strchr(tok, '=');
+
+		if (!val)
+			continue;
+		*val++ = '\0';
+		for (i = 0; i < ARRAY_SIZE(fields); i++) {
+			if (!strcmp(tok, fields[i].name)) {
+				*fields[i].val = strtoull(val, NULL, 0);
+				found++;
+			}
+		}
+	}
+	return found == ARRAY_SIZE(fields) ? 0 : -EINVAL;
+}
+
+static int ds_run(const char *path, const char *type, unsigned int nthreads,
+		  struct ds_result *r)
+{
+	char cmd[256], buf[512];
+	ssize_t len;
+	int fd, ret;
+
+	len = snprintf(cmd, sizeof(cmd),
+		       "type=%s threads=%u keys=%u fill=%u duration_ms=%u dist=%s mix=%s hot=%s seed=%u\n",
+		       type, nthreads, keys, fill, duration, dist, mix, hot, seed);
+
+	fd = open(path, O_RDWR);
+	if (fd < 0)
+		return -errno;
+
+	/* the write returns when the run is over */
+	if (write(fd, cmd, len) != len) {
+		ret = -errno;
+		goto out;
+	}
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0) {
+		ret = len ? -errno : -ENODATA;
+		goto out;
+	}
+	buf[len] = '\0';
+	ret = ds_parse_result(buf, r);
+out:
+	close(fd);
+	return ret;
+}
+
+static int ds_parse_threads(unsigned int *nr_threads)
+{
+	struct perf_cpu_map *cpus;
+	unsigned int n = 0, ncpus;
+	char *str, *tok, *saveptr = NULL;
+
+	if (threads_str) {
+		str = strdup(threads_str);
+		if (!str)
+			err(EXIT_FAILURE, "strdup");
+		for (tok = strtok_r(str, ",", &saveptr); tok && n < DS_MAX_RUNS;
+		     tok = strtok_r(NULL, ",", &saveptr)) {
+			nr_threads[n] = strtoul(tok, NULL, 0);
+			if (!nr_threads[n])
+				errx(EXIT_FAILURE, "invalid thread count '%s'", tok);
+			n++;
+		}
+		free(str);
+		return n;
+	}
+
+	cpus = perf_cpu_map__new_online_cpus();
+	if (!cpus)
+		err(EXIT_FAILURE, "calloc");
+	ncpus = perf_cpu_map__nr(cpus);
+	perf_cpu_map__put(cpus);
+
+	for (n = 0; n < DS_MAX_RUNS && (1U << n) < ncpus; n++)
+		nr_threads[n] = 1U << n;
+	nr_threads[n++] = ncpus;
+	return n;
+}
+
+static double ds_pct(unsigned long long part, unsigned long long whole)
+{
+	return whole ? 100.0 * part / whole : 0.0;
+}
+
+static int bench_ds(int argc, const char **argv, const char *type)
+{
+	unsigned int nr_threads[DS_MAX_RUNS], nr_runs, i;
+	unsigned long long base = 0;
+	const char *debugfs;
+	char path[PATH_MAX];
+	int ret;
+
+	argc = parse_options(argc, argv, options, bench_ds_usage, 0);
+	if (argc) {
+		usage_with_options(bench_ds_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	/* not fatal, so that "perf bench all" carries on without the module */
+	debugfs = debugfs__mountpoint();
+	if (!debugfs) {
+		fprintf(stderr, "debugfs is not mounted\n");
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/ds_benchmark/run", debugfs);
+	if (access(path, W_OK)) {
+		fprintf(stderr, "%s: %s (is the ds_benchmark module loaded?)\n",
+			path, strerror(errno));
+		return 1;
+	}
+
+	nr_runs = ds_parse_threads(nr_threads);
+	if (!nr_runs)
+		errx(EXIT_FAILURE, "no thread counts given");
+
+	printf("# %s: %u keys, %u%% filled, %s keys, mix %s (lookup,insert,erase), %u msecs per run\n\n",
+	       type, keys, fill, dist, mix, duration);
+	printf("%8s %14s %14s %8s %9s %12s %12s %12s\n", "threads", "ops/sec",
+	       "per thread", "scaling", "fairness", "lookup miss", "insert fail",
+	       "erase fail");
+
+	for (i = 0; i < nr_runs; i++) {
+		unsigned int n = nr_threads[i];
+		struct ds_result r;
+
+		ret = ds_run(path, type, n, &r);
+		if (ret) {
+			errno = -ret;
+			err(EXIT_FAILURE, "%s run with %u threads", type, n);
+		}
+		if (!base)
+			base = r.ops_per_sec / nr_threads[0];
+
+		printf("%8u %14llu %14llu %7.2fx %8.1f%% %11.1f%% %11.1f%% %11.1f%%\n",
+		       n, r.ops_per_sec, r.ops_per_sec / n,
+		       base ? (double)r.ops_per_sec / base : 0.0,
+		       ds_pct(r.thread_min, r.thread_max),
+		       ds_pct(r.lookup_miss, r.lookup),
+		       ds_pct(r.insert_fail, r.insert),
+		       ds_pct(r.erase_fail, r.erase));
+	}
+
+	return 0;
+}
+
+int bench_ds_rhashtable(int argc, const char **argv)
+{
+	return bench_ds(argc, argv, "rhashtable");
+}
+
+int bench_ds_maple(int argc, const char **argv)
+{
+	return bench_ds(argc, argv, "maple");
+}
+
+int bench_ds_xarray(int argc, const char **argv)
+{
+	return bench_ds(argc, argv, "xarray");
+}
+
+int bench_ds_sbitmap(int argc, const char **argv)
+{
+	return bench_ds(argc, argv, "sbitmap");
+}
+
+int bench_ds_percpu_counter(int argc, const char **argv)
+{
+	return bench_ds(argc, argv, "percpu_counter");
+}
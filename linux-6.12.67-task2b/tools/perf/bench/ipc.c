@@ -0,0 +1,565 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * ipc: SysV and POSIX IPC benchmarks
+ *
+ *  sem  ... semop() lock/unlock on contended sets, simple or complex ops
+ *  msg  ... msgsnd()/msgrcv() round trips with typed receive
+ *  mq   ... mq_send()/mq_receive() round trips over several priorities
+ *  shm  ... shmat()/shmdt() churn on shared segments
+ *
+ * Threads are spread round robin over the IPC objects, so --threads and
+ * --objects together set the amount of contention. Every operation is timed
+ * individually; besides throughput, latency percentiles are reported.
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <mqueue.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/zalloc.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include <sys/sem.h>
+#include <sys/shm.h>
+#include <sys/time.h>
+#include <perf/cpumap.h>
+
+#include "../util/mutex.h"
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <err.h>
+
+/*
+ * Latencies go into a log-linear histogram: values below 8ns get a bucket
+ * each, above that every power of two is split into 8 buckets, so a
+ * percentile is accurate to within 12.5%.
+ */
+#define HIST_SUB_BITS	3
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS	((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+#define MAX_SEMS	32
+
+struct worker {
+	unsigned int id;
+	unsigned int obj;
+	pthread_t thread;
+	unsigned long ops;
+	void *buf;	/* message buffer for msg and mq */
+	u64 hist[HIST_BUCKETS];
+};
+
+struct ipc_bench {
+	const char *name;
+	int (*setup)(void);
+	void (*op)(struct worker *w);
+	void (*teardown)(void);
+};
+
+static struct {
+	bool silent;
+	bool complex;
+	unsigned int runtime;
+	unsigned int nthreads;
+	unsigned int nobjects;
+	unsigned int nsems;
+	unsigned int ntypes;
+	unsigned int msgsize;
+	unsigned int npriorities;
+	unsigned int shmsize;
+} params = {
+	.runtime	= 5,
+	.nobjects	= 1,
+	.nsems		= 2,
+	.ntypes		= 4,
+	.msgsize	= 64,
+	.npriorities	= 4,
+	.shmsize	= 4096,
+};
+
+static bool done;
+static struct mutex thread_lock;
+static unsigned int threads_starting;
+static struct cond thread_parent, thread_worker;
+static const struct ipc_bench *bench;
+static int *ids;
+
+#define IPC_COMMON_OPTIONS						\
+	OPT_UINTEGER('t', "threads", &params.nthreads, "Specify amount of threads"), \
+	OPT_UINTEGER('o', "objects", &params.nobjects, "Specify amount of IPC objects"), \
+	OPT_UINTEGER('r', "runtime", &params.runtime, "Specify runtime (in seconds)"), \
+	OPT_BOOLEAN( 's', "silent",  &params.silent, "Silent mode: do not display data/details")
+
+static const struct option sem_options[] = {
+	IPC_COMMON_OPTIONS,
+	OPT_UINTEGER('n', "nsems", &params.nsems, "Specify semaphores per set (max 32)"),
+	OPT_BOOLEAN( 'c', "complex", &params.complex, "Operate on all semaphores of a set at once"),
+	OPT_END()
+};
+
+static const struct option msg_options[] = {
+	IPC_COMMON_OPTIONS,
+	OPT_UINTEGER('T', "types", &params.ntypes, "Specify message types per queue"),
+	OPT_UINTEGER('S', "size", &params.msgsize, "Specify message size (in bytes)"),
+	OPT_END()
+};
+
+static const struct option mq_options[] = {
+	IPC_COMMON_OPTIONS,
+	OPT_UINTEGER('p', "priorities", &params.npriorities, "Specify message priorities"),
+	OPT_UINTEGER('S', "size", &params.msgsize, "Specify message size (in bytes)"),
+	OPT_END()
+};
+
+static const struct option shm_options[] = {
+	IPC_COMMON_OPTIONS,
+	OPT_UINTEGER('S', "size", &params.shmsize, "Specify segment size (in bytes)"),
+	OPT_END()
+};
+
+static inline u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline unsigned int hist_bucket(u64 ns)
+{
+	unsigned int msb;
+
+	if (ns < HIST_SUB)
+		return ns;
+	msb = 63 - __builtin_clzll(ns);
+	return (msb - HIST_SUB_BITS + 1) * HIST_SUB +
+		((ns >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+static u64 hist_value(unsigned int bucket)
+{
+	unsigned int msb;
+
+	if (bucket < HIST_SUB)
+		return bucket;
+	msb = bucket / HIST_SUB - 1 + HIST_SUB_BITS;
+	return (u64)(HIST_SUB | (bucket % HIST_SUB)) << (msb - HIST_SUB_BITS);
+}
+
+/* sem: lock and unlock one semaphore of the set, or all of them */
+
+static int sem_setup(void)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < params.nobjects; i++) {
+		ids[i] = semget(IPC_PRIVATE, params.nsems, IPC_CREAT | 0600);
+		if (ids[i] < 0)
+			return -1;
+		for (j = 0; j < params.nsems; j++)
+			if (semctl(ids[i], j, SETVAL, 1))
+				return -1;
+	}
+	return 0;
+}
+
+static void sem_op(struct worker *w)
+{
+	struct sembuf sops[MAX_SEMS];
+	unsigned int i, n = 1;
+
+	if (params.complex) {
+		for (i = 0; i < params.nsems; i++)
+			sops[i] = (struct sembuf){ .sem_num = i, .sem_op = -1 };
+		n = params.nsems;
+	} else {
+		sops[0] = (struct sembuf){
+			.sem_num = (w->id + w->ops) % params.nsems,
+			.sem_op = -1,
+		};
+	}
+	if (semop(ids[w->obj], sops, n))
+		err(EXIT_FAILURE, "semop");
+	for (i = 0; i < n; i++)
+		sops[i].sem_op = 1;
+	if (semop(ids[w->obj], sops, n))
+		err(EXIT_FAILURE, "semop");
+}
+
+static void sem_teardown(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < params.nobjects; i++)
+		if (ids[i] >= 0)
+			semctl(ids[i], 0, IPC_RMID);
+}
+
+/*
+ * msg: send a message of our own type and receive one of that type back.
+ * Every thread sends before it receives, so a receiver always finds a
+ * message of its type eventually, whichever thread sent it.
+ */
+
+struct bench_msgbuf {
+	long mtype;
+	char mtext[];
+};
+
+static int msg_setup(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < params.nobjects; i++) {
+		ids[i] = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+		if (ids[i] < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static void msg_op(struct worker *w)
+{
+	struct bench_msgbuf *msg = w->buf;
+	long type = w->id % params.ntypes + 1;
+
+	msg->mtype = type;
+	if (msgsnd(ids[w->obj], msg, params.msgsize, 0))
+		err(EXIT_FAILURE, "msgsnd");
+	if (msgrcv(ids[w->obj], msg, params.msgsize, type, 0) < 0)
+		err(EXIT_FAILURE, "msgrcv");
+}
+
+static void msg_teardown(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < params.nobjects; i++)
+		if (ids[i] >= 0)
+			msgctl(ids[i], IPC_RMID, NULL);
+}
+
+/* mq: send at a rotating priority and receive the most urgent message */
+
+static void mq_name(char *name, size_t len, unsigned int i)
+{
+	snprintf(name, len, "/perf-bench-ipc-%d-%u", getpid(), i);
+}
+
+static int mq_setup(void)
+{
+	struct mq_attr attr = {
+		.mq_maxmsg = 10,
+		.mq_msgsize = params.msgsize,
+	};
+	char name[64];
+	unsigned int i;
+
+	for (i = 0; i < params.nobjects; i++) {
+		mq_name(name, sizeof(name), i);
+		ids[i] = mq_open(name, O_RDWR | O_CREAT | O_EXCL, 0600, &attr);
+		if (ids[i] < 0)
+			return -1;
+		mq_unlink(name);
+	}
+	return 0;
+}
+
+static void mq_op(struct worker *w)
+{
+	unsigned int prio = w->ops % params.npriorities;
+
+	if (mq_send(ids[w->obj], w->buf, params.msgsize, prio))
+		err(EXIT_FAILURE, "mq_send");
+	if (mq_receive(ids[w->obj], w->buf, params.msgsize, &prio) < 0)
+		err(EXIT_FAILURE, "mq_receive");
+}
+
+static void mq_teardown(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < params.nobjects; i++)
+		if (ids[i] >= 0)
+			mq_close(ids[i]);
+}
+
+/* shm: attach a segment, touch it and detach it again */
+
+static int shm_setup(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < params.nobjects; i++) {
+		ids[i] = shmget(IPC_PRIVATE, params.shmsize, IPC_CREAT | 0600);
+		if (ids[i] < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static void shm_op(struct worker *w)
+{
+	volatile char *p = shmat(ids[w->obj], NULL, 0);
+
+	if (p == (void *)-1)
+		err(EXIT_FAILURE, "shmat");
+	p[0]++;
+	if (shmdt((const void *)p))
+		err(EXIT_FAILURE, "shmdt");
+}
+
+static void shm_teardown(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < params.nobjects; i++)
+		if (ids[i] >= 0)
+			shmctl(ids[i], IPC_RMID, NULL);
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned long ops = 0;
+	u64 start, end;
+
+	mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		cond_signal(&thread_parent);
+	cond_wait(&thread_worker, &thread_lock);
+	mutex_unlock(&thread_lock);
+
+	start = now_ns();
+	do {
+		w->ops = ops;
+		bench->op(w);
+		end = now_ns();
+		w->hist[hist_bucket(end - start)]++;
+		start = end;
+		ops++;
+	} while (!done);
+
+	w->ops = ops;
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&bench__end, NULL);
+	timersub(&bench__end, &bench__start, &bench__runtime);
+}
+
+static void print_latency(struct worker *worker)
+{
+	static const double pct[] = { 50.0, 90.0, 99.0, 99.9 };
+	u64 hist[HIST_BUCKETS] = { 0 };
+	u64 total = 0, seen = 0, max = 0;
+	unsigned int i, j, p = 0;
+
+	for (i = 0; i < params.nthreads; i++) {
+		for (j = 0; j < HIST_BUCKETS; j++) {
+			hist[j] += worker[i].hist[j];
+			total += worker[i].hist[j];
+		}
+	}
+	if (!total)
+		return;
+
+	printf("Latency (usecs):");
+	for (j = 0; j < HIST_BUCKETS; j++) {
+		if (!hist[j])
+			continue;
+		seen += hist[j];
+		max = j;
+		while (p < ARRAY_SIZE(pct) && seen * 100.0 >= pct[p] * total) {
+			printf(" p%g %.2f", pct[p], hist_value(j) / 1000.0);
+			p++;
+		}
+	}
+	printf(" max %.2f\n", hist_value(max) / 1000.0);
+}
+
+static int bench_ipc(int argc, const char **argv, const struct ipc_bench *b,
+		     const struct option *options, const char * const *usage)
+{
+	struct stats throughput_stats;
+	struct worker *worker = NULL;
+	struct perf_cpu_map *cpu;
+	struct sigaction act;
+	unsigned int i;
+	int ret = 0;
+
+	argc = parse_options(argc, argv, options, usage, 0);
+	if (argc || !params.nobjects || !params.nsems ||
+	    params.nsems > MAX_SEMS || !params.ntypes ||
+	    !params.msgsize || !params.npriorities || !params.shmsize) {
+		usage_with_options(usage, options);
+		exit(EXIT_FAILURE);
+	}
+	bench = b;
+
+	cpu = perf_cpu_map__new_online_cpus();
+	if (!cpu)
+		err(EXIT_FAILURE, "calloc");
+
+	memset(&act, 0, sizeof(act));
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!params.nthreads) /* default to the number of CPUs */
+		params.nthreads = perf_cpu_map__nr(cpu);
+
+	ids = calloc(params.nobjects, sizeof(*ids));
+	worker = calloc(params.nthreads, sizeof(*worker));
+	if (!ids || !worker)
+		err(EXIT_FAILURE, "calloc");
+	memset(ids, -1, params.nobjects * sizeof(*ids));
+
+	if (bench->setup()) {
+		warn("%s setup", bench->name);
+		bench->teardown();
+		exit(EXIT_FAILURE);
+	}
+
+	printf("Run summary [PID %d]: %d threads on %d %s objects for %d secs.\n\n",
+	       getpid(), params.nthreads, params.nobjects, bench->name, params.runtime);
+
+	init_stats(&throughput_stats);
+	mutex_init(&thread_lock);
+	cond_init(&thread_parent);
+	cond_init(&thread_worker);
+
+	/* "perf bench ipc all" runs every benchmark in this process */
+	done = false;
+	threads_starting = params.nthreads;
+	gettimeofday(&bench__start, NULL);
+
+	for (i = 0; i < params.nthreads; i++) {
+		worker[i].id = i;
+		worker[i].obj = i % params.nobjects;
+		worker[i].buf = calloc(1, sizeof(struct bench_msgbuf) + params.msgsize);
+		if (!worker[i].buf)
+			err(EXIT_FAILURE, "calloc");
+		ret = pthread_create(&worker[i].thread, NULL, workerfn, &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	mutex_lock(&thread_lock);
+	while (threads_starting)
+		cond_wait(&thread_parent, &thread_lock);
+	cond_broadcast(&thread_worker);
+	mutex_unlock(&thread_lock);
+
+	sleep(params.runtime);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < params.nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	cond_destroy(&thread_parent);
+	cond_destroy(&thread_worker);
+	mutex_destroy(&thread_lock);
+	bench->teardown();
+
+	for (i = 0; i < params.nthreads; i++) {
+		unsigned long t = bench__runtime.tv_sec > 0 ?
+			worker[i].ops / bench__runtime.tv_sec : 0;
+
+		update_stats(&throughput_stats, t);
+		if (!params.silent)
+			printf("[thread %3d] %s %d [ %ld ops/sec ]\n",
+			       worker[i].id, bench->name, worker[i].obj, t);
+		zfree(&worker[i].buf);
+	}
+
+	printf("%sAveraged %ld operations/sec (+- %.2f%%), total secs = %d\n",
+	       !params.silent ? "\n" : "", (unsigned long)avg_stats(&throughput_stats),
+	       rel_stddev_stats(stddev_stats(&throughput_stats),
+				avg_stats(&throughput_stats)),
+	       (int)bench__runtime.tv_sec);
+	print_latency(worker);
+
+	zfree(&ids);
+	free(worker);
+	perf_cpu_map__put(cpu);
+	return ret;
+}
+
+static const struct ipc_bench sem_bench = {
+	.name = "sem", .setup = sem_setup, .op = sem_op, .teardown = sem_teardown,
+};
+
+static const struct ipc_bench msg_bench = {
+	.name = "msg", .setup = msg_setup, .op = msg_op, .teardown = msg_teardown,
+};
+
+static const struct ipc_bench mq_bench = {
+	.name = "mq", .setup = mq_setup, .op = mq_op, .teardown = mq_teardown,
+};
+
+static const struct ipc_bench shm_bench = {
+	.name = "shm", .setup = shm_setup, .op = shm_op, .teardown = shm_teardown,
+};
+
+static const char * const bench_ipc_sem_usage[] = {
+	"perf bench ipc sem <options>",
+	NULL
+};
+
+static const char * const bench_ipc_msg_usage[] = {
+	"perf bench ipc msg <options>",
+	NULL
+};
+
+static const char * const bench_ipc_mq_usage[] = {
+	"perf bench ipc mq <options>",
+	NULL
+};
+
+static const char * const bench_ipc_shm_usage[] = {
+	"perf bench ipc shm <options>",
+	NULL
+};
+
+int bench_ipc_sem(int argc, const char **argv)
+{
+	return bench_ipc(argc, argv, &sem_bench, sem_options, bench_ipc_sem_usage);
+}
+
+int bench_ipc_msg(int argc, const char **argv)
+{
+	return bench_ipc(argc, argv, &msg_bench, msg_options, bench_ipc_msg_usage);
+}
+
+int bench_ipc_mq(int argc, const char **argv)
+{
+	return bench_ipc(argc, argv, &mq_bench, mq_options, bench_ipc_mq_usage);
+}
+
+int bench_ipc_shm(int argc, const char **argv)
+{
+	return bench_ipc(argc, argv, &shm_bench, shm_options, bench_ipc_shm_usage);
+}
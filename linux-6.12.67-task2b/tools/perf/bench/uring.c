@@ -0,0 +1,684 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Benchmark io_uring submission and completion.
+ *
+ * Every thread sets up its own ring and runs batches of one kind of request
+ * through it: NOPs, reads into normal or registered (fixed) buffers, or
+ * receives on a socket pair into buffers provided through a buffer ring.
+ * The same workload can be run with the submission side polled by a kernel
+ * thread (--sqpoll), or with every request forced out to io-wq (--async) to
+ * see what the punt costs. Fixed reads (--fixed) also register the file, so
+ * neither the buffers nor the file are looked up per request.
+ *
+ * The latency reported is the round trip of a batch, from handing it to the
+ * kernel until the last completion has been reaped; with --batch 1 that is
+ * the latency of a single request.
+ */
+#include <string.h>
+#include <pthread.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <asm/barrier.h>
+#include <linux/compiler.h>
+#include <linux/stddef.h>
+#include <linux/io_uring.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/time64.h>
+#include <linux/zalloc.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <perf/cpumap.h>
+
+#include "../util/mutex.h"
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <err.h>
+
+/* the same on all architectures but alpha, which has no io_uring in libc */
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup	425
+#define __NR_io_uring_enter	426
+#define __NR_io_uring_register	427
+#endif
+
+enum uring_op {
+	URING_NOP,
+	URING_READ,
+	URING_RECV,
+};
+
+static const char * const uring_op_names[] = {
+	[URING_NOP]	= "nop",
+	[URING_READ]	= "read",
+	[URING_RECV]	= "recv",
+};
+
+static unsigned int nthreads;
+static unsigned int nsecs = 5;
+static unsigned int entries = 128;
+static unsigned int batch = 16;
+static unsigned int bs = 4096;
+static const char *file = "/dev/zero";
+static bool fixed, sqpoll, async, noaffinity, silent, done;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads, one ring each"),
+	OPT_UINTEGER('r', "runtime", &nsecs, "Specify runtime (in seconds)"),
+	OPT_UINTEGER('e', "entries", &entries, "Submission queue entries per ring"),
+	OPT_UINTEGER('b', "batch", &batch, "Requests submitted and reaped at once"),
+	OPT_UINTEGER('B', "bs", &bs, "Size of a read or received message"),
+	OPT_STRING('f', "file", &file, "path", "File to read from (read only)"),
+	OPT_BOOLEAN('F', "fixed", &fixed, "Read from a registered file into registered buffers (read only)"),
+	OPT_BOOLEAN('S', "sqpoll", &sqpoll, "Have a kernel thread poll the submission queue"),
+	OPT_BOOLEAN('A', "async", &async, "Force every request out to io-wq"),
+	OPT_BOOLEAN('n', "noaffinity", &noaffinity, "Disables CPU affinity"),
+	OPT_BOOLEAN('s', "silent", &silent, "Silent mode: do not display per thread data"),
+	OPT_END()
+};
+
+static const char * const bench_uring_usage[] = {
+	"perf bench uring <nop|read|recv> <options>",
+	NULL
+};
+
+/* completion polls with SQPOLL before waiting in the kernel */
+#define URING_SPINS	4096
+
+/*
+ * Batch latencies are kept in log-linear buckets: 8 buckets for every power
+ * of two, so percentiles are accurate to 1/8th of their value.
+ */
+#define LAT_SUB_BITS	3
+#define LAT_SUB		(1 << LAT_SUB_BITS)
+#define LAT_BUCKETS	(64 * LAT_SUB)
+
+static unsigned int lat_bucket(u64 ns)
+{
+	unsigned int e;
+
+	if (ns < LAT_SUB)
+		return ns;
+	e = ilog2(ns) - LAT_SUB_BITS;
+	return (e + 1) * LAT_SUB + ((ns >> e) & (LAT_SUB - 1));
+}
+
+static u64 lat_bucket_ns(unsigned int b)
+{
+	if (b < LAT_SUB)
+		return b;
+	return (u64)(LAT_SUB + b % LAT_SUB) << (b / LAT_SUB - 1);
+}
+
+struct uring {
+	int fd;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_flags, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr, *cq_ptr;
+	size_t sq_size, cq_size, sqes_size;
+	unsigned int sq_entries;
+};
+
+struct worker {
+	int tid;
+	pthread_t thread;
+	enum uring_op op;
+	struct uring ring;
+	int fd;				/* read: the file, recv: receiving end */
+	int peer;			/* recv: sending end */
+	void *bufs;			/* batch buffers of bs bytes */
+	struct io_uring_buf_ring *br;	/* recv: provided buffer ring */
+	unsigned int br_entries;
+	unsigned long ops;
+	unsigned long errors;
+	u64 lat_max;
+	unsigned long lat[LAT_BUCKETS];
+};
+
+static struct mutex thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static struct cond thread_parent, thread_worker;
+
+static int uring_setup(struct uring *r, unsigned int nr, unsigned int flags)
+{
+	struct io_uring_params p;
+	void *ptr;
+	int ret;
+
+	memset(r, 0, sizeof(*r));
+	memset(&p, 0, sizeof(p));
+	p.flags = flags;
+
+	r->fd = syscall(__NR_io_uring_setup, nr, &p);
+	if (r->fd < 0)
+		return -errno;
+
+	r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (ptr == MAP_FAILED)
+		goto out;
+	r->sq_ptr = ptr;
+	r->sq_head = ptr + p.sq_off.head;
+	r->sq_tail = ptr + p.sq_off.tail;
+	r->sq_mask = ptr + p.sq_off.ring_mask;
+	r->sq_flags = ptr + p.sq_off.flags;
+	r->sq_array = ptr + p.sq_off.array;
+
+	ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	if (ptr == MAP_FAILED)
+		goto out;
+	r->cq_ptr = ptr;
+	r->cq_head = ptr + p.cq_off.head;
+	r->cq_tail = ptr + p.cq_off.tail;
+	r->cq_mask = ptr + p.cq_off.ring_mask;
+	r->cqes = ptr + p.cq_off.cqes;
+
+	ptr = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (ptr == MAP_FAILED)
+		goto out;
+	r->sqes = ptr;
+	r->sq_entries = p.sq_entries;
+	return 0;
+out:
+	ret = -errno;
+	if (r->cq_ptr)
+		munmap(r->cq_ptr, r->cq_size);
+	if (r->sq_ptr)
+		munmap(r->sq_ptr, r->sq_size);
+	close(r->fd);
+	return ret;
+}
+
+static void uring_exit(struct uring *r)
+{
+	munmap(r->sqes, r->sqes_size);
+	munmap(r->cq_ptr, r->cq_size);
+	munmap(r->sq_ptr, r->sq_size);
+	close(r->fd);
+}
+
+static int uring_register(struct uring *r, unsigned int opcode, void *arg,
+			  unsigned int nr)
+{
+	return syscall(__NR_io_uring_register, r->fd, opcode, arg, nr) < 0 ? -errno : 0;
+}
+
+/* the @i-th entry after the current tail, we are the only submitter */
+static struct io_uring_sqe *uring_sqe(struct uring *r, unsigned int i)
+{
+	unsigned int idx = (*r->sq_tail + i) & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[idx];
+
+	r->sq_array[idx] = idx;
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+/*
+ * Publish @nr prepared entries and wait for @nr completions. With SQPOLL the
+ * kernel thread picks the entries up on its own, unless it went to sleep, and
+ * completions are polled for a while before falling back to waiting in the
+ * kernel, so the poller thread is not starved when it shares a CPU with us.
+ */
+static int uring_submit_and_wait(struct uring *r, unsigned int nr)
+{
+	unsigned int flags = IORING_ENTER_GETEVENTS, spins;
+	int ret;
+
+	smp_store_release(r->sq_tail, *r->sq_tail + nr);
+
+	if (sqpoll) {
+		/* order the tail store against reading the wakeup flag */
+		smp_mb();
+		if (READ_ONCE(*r->sq_flags) & IORING_SQ_NEED_WAKEUP) {
+			ret = syscall(__NR_io_uring_enter, r->fd, 0, 0,
+				      IORING_ENTER_SQ_WAKEUP, NULL, 0);
+			if (ret < 0)
+				return -errno;
+		}
+		for (spins = 0; spins < URING_SPINS; spins++) {
+			if (smp_load_acquire(r->cq_tail) - *r->cq_head >= nr)
+				return 0;
+		}
+		ret = syscall(__NR_io_uring_enter, r->fd, 0, nr, flags, NULL, 0);
+		return ret < 0 ? -errno : 0;
+	}
+
+	ret = syscall(__NR_io_uring_enter, r->fd, nr, nr, flags, NULL, 0);
+	return ret < 0 ? -errno : 0;
+}
+
+static void worker_prep(struct worker *w, unsigned int i)
+{
+	struct io_uring_sqe *sqe = uring_sqe(&w->ring, i);
+
+	switch (w->op) {
+	case URING_NOP:
+		sqe->opcode = IORING_OP_NOP;
+		break;
+	case URING_READ:
+		if (fixed) {
+			sqe->opcode = IORING_OP_READ_FIXED;
+			/* index 0 in the registered file table */
+			sqe->fd = 0;
+			sqe->flags = IOSQE_FIXED_FILE;
+			sqe->buf_index = i;
+		} else {
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = w->fd;
+		}
+		sqe->addr = (unsigned long)(w->bufs + (size_t)i * bs);
+		sqe->len = bs;
+		break;
+	case URING_RECV:
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = w->fd;
+		sqe->len = bs;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = 0;
+		break;
+	}
+
+	if (async)
+		sqe->flags |= IOSQE_ASYNC;
+}
+
+/* hand buffer @bid back to the kernel */
+static void worker_provide(struct worker *w, unsigned int bid, unsigned int tail)
+{
+	struct io_uring_buf *buf = &w->br->bufs[tail & (w->br_entries - 1)];
+
+	buf->addr = (unsigned long)(w->bufs + (size_t)bid * bs);
+	buf->len = bs;
+	buf->bid = bid;
+}
+
+static void worker_reap(struct worker *w, unsigned int nr)
+{
+	struct uring *r = &w->ring;
+	unsigned int head = *r->cq_head, i;
+	unsigned int br_tail = w->br ? w->br->tail : 0;
+
+	for (i = 0; i < nr; i++, head++) {
+		struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+
+		if (cqe->res < 0)
+			w->errors++;
+		else
+			w->ops++;
+
+		if (w->op == URING_RECV && (cqe->flags & IORING_CQE_F_BUFFER))
+			worker_provide(w, cqe->flags >> IORING_CQE_BUFFER_SHIFT,
+				       br_tail++);
+	}
+
+	smp_store_release(r->cq_head, head);
+	if (w->br)
+		smp_store_release(&w->br->tail, br_tail);
+}
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned int i;
+
+	mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		cond_signal(&thread_parent);
+	cond_wait(&thread_worker, &thread_lock);
+	mutex_unlock(&thread_lock);
+
+	do {
+		u64 start, lat;
+
+		/* the messages to receive are queued up front */
+		if (w->op == URING_RECV) {
+			for (i = 0; i < batch; i++) {
+				if (send(w->peer, w->bufs, bs, 0) != (ssize_t)bs)
+					err(EXIT_FAILURE, "send");
+			}
+		}
+
+		for (i = 0; i < batch; i++)
+			worker_prep(w, i);
+
+		start = now_ns();
+		if (uring_submit_and_wait(&w->ring, batch))
+			err(EXIT_FAILURE, "io_uring_enter");
+		worker_reap(w, batch);
+		lat = now_ns() - start;
+
+		w->lat[lat_bucket(lat)]++;
+		if (lat > w->lat_max)
+			w->lat_max = lat;
+	} while (!done);
+
+	return NULL;
+}
+
+static void worker_setup(struct worker *w, enum uring_op op)
+{
+	unsigned int i, flags = sqpoll ? IORING_SETUP_SQPOLL : 0;
+	int ret, sv[2];
+
+	w->op = op;
+	w->fd = w->peer = -1;
+
+	ret = uring_setup(&w->ring, entries, flags);
+	if (ret) {
+		errno = -ret;
+		err(EXIT_FAILURE, "io_uring_setup");
+	}
+	if (batch > w->ring.sq_entries)
+		errx(EXIT_FAILURE, "batch of %u exceeds the %u ring entries",
+		     batch, w->ring.sq_entries);
+
+	if (op == URING_NOP)
+		return;
+
+	w->bufs = mmap(NULL, (size_t)batch * bs, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (w->bufs == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap");
+
+	if (op == URING_READ) {
+		w->fd = open(file, O_RDONLY);
+		if (w->fd < 0)
+			err(EXIT_FAILURE, "open %s", file);
+
+		if (fixed) {
+			struct iovec *iov = calloc(batch, sizeof(*iov));
+
+			if (!iov)
+				err(EXIT_FAILURE, "calloc");
+			for (i = 0; i < batch; i++) {
+				iov[i].iov_base = w->bufs + (size_t)i * bs;
+				iov[i].iov_len = bs;
+			}
+			ret = uring_register(&w->ring, IORING_REGISTER_BUFFERS,
+					     iov, batch);
+			free(iov);
+			if (ret) {
+				errno = -ret;
+				err(EXIT_FAILURE, "IORING_REGISTER_BUFFERS");
+			}
+
+			ret = uring_register(&w->ring, IORING_REGISTER_FILES,
+					     &w->fd, 1);
+			if (ret) {
+				errno = -ret;
+				err(EXIT_FAILURE, "IORING_REGISTER_FILES");
+			}
+		}
+		return;
+	}
+
+	/* recv: keep message boundaries, one message per buffer */
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv))
+		err(EXIT_FAILURE, "socketpair");
+	w->fd = sv[0];
+	w->peer = sv[1];
+
+	{
+		struct io_uring_buf_reg reg = { };
+
+		w->br_entries = roundup_pow_of_two(batch);
+		w->br = mmap(NULL, w->br_entries * sizeof(struct io_uring_buf),
+			     PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (w->br == MAP_FAILED)
+			err(EXIT_FAILURE, "mmap");
+
+		reg.ring_addr = (unsigned long)w->br;
+		reg.ring_entries = w->br_entries;
+		reg.bgid = 0;
+		ret = uring_register(&w->ring, IORING_REGISTER_PBUF_RING, &reg, 1);
+		if (ret) {
+			errno = -ret;
+			err(EXIT_FAILURE, "IORING_REGISTER_PBUF_RING");
+		}
+
+		for (i = 0; i < batch; i++)
+			worker_provide(w, i, i);
+		smp_store_release(&w->br->tail, batch);
+	}
+}
+
+static void worker_cleanup(struct worker *w)
+{
+	uring_exit(&w->ring);
+	if (w->br)
+		munmap(w->br, w->br_entries * sizeof(struct io_uring_buf));
+	if (w->bufs)
+		munmap(w->bufs, (size_t)batch * bs);
+	if (w->fd >= 0)
+		close(w->fd);
+	if (w->peer >= 0)
+		close(w->peer);
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&bench__end, NULL);
+	timersub(&bench__end, &bench__start, &bench__runtime);
+}
+
+static void print_latency(struct worker *worker)
+{
+	static const double pcts[] = { 50.0, 90.0, 99.0, 99.9 };
+	unsigned long lat[LAT_BUCKETS] = { };
+	unsigned long total = 0, seen = 0;
+	unsigned int i, b, p = 0;
+	u64 lat_max = 0;
+
+	for (i = 0; i < nthreads; i++) {
+		for (b = 0; b < LAT_BUCKETS; b++)
+			lat[b] += worker[i].lat[b];
+		lat_max = max(lat_max, worker[i].lat_max);
+	}
+	for (b = 0; b < LAT_BUCKETS; b++)
+		total += lat[b];
+	if (!total)
+		return;
+
+	printf("Batch latency (usecs):");
+	for (b = 0; b < LAT_BUCKETS && p < ARRAY_SIZE(pcts); b++) {
+		seen += lat[b];
+		while (p < ARRAY_SIZE(pcts) && seen * 100.0 >= pcts[p] * total) {
+			printf(" p%g %.3f", pcts[p],
+			       (double)lat_bucket_ns(b) / NSEC_PER_USEC);
+			p++;
+		}
+	}
+	printf(" max %.3f\n", (double)lat_max / NSEC_PER_USEC);
+}
+
+static void print_summary(unsigned long total)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld operations/sec per ring (+- %.2f%%), total %ld operations/sec, secs = %d\n",
+	       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       total, (int)bench__runtime.tv_sec);
+}
+
+static int bench_uring(int argc, const char **argv, enum uring_op op)
+{
+	pthread_attr_t thread_attr, *attrp = NULL;
+	struct worker *worker = NULL;
+	struct perf_cpu_map *cpu;
+	unsigned long total = 0;
+	struct sigaction act;
+	cpu_set_t *cpuset;
+	unsigned int i;
+	int ret = 0, nrcpus;
+	size_t size;
+
+	argc = parse_options(argc, argv, options, bench_uring_usage, 0);
+	if (argc) {
+		usage_with_options(bench_uring_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!batch || !bs)
+		errx(EXIT_FAILURE, "batch and bs must not be 0");
+	if (fixed && op != URING_READ)
+		errx(EXIT_FAILURE, "--fixed only applies to read");
+
+	memset(&act, 0, sizeof(act));
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	cpu = perf_cpu_map__new_online_cpus();
+	if (!cpu)
+		err(EXIT_FAILURE, "calloc");
+
+	/* default to the number of CPUs */
+	if (!nthreads)
+		nthreads = perf_cpu_map__nr(cpu);
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	printf("Run summary [PID %d]: %u threads doing io_uring %s%s%s%s, batch %u, for %d secs.\n\n",
+	       getpid(), nthreads, uring_op_names[op], fixed ? " fixed" : "",
+	       sqpoll ? " sqpoll" : "", async ? " async" : "", batch, nsecs);
+
+	init_stats(&throughput_stats);
+	mutex_init(&thread_lock);
+	cond_init(&thread_parent);
+	cond_init(&thread_worker);
+
+	/* "perf bench uring all" runs every benchmark in this process */
+	done = false;
+	threads_starting = nthreads;
+
+	if (!noaffinity)
+		pthread_attr_init(&thread_attr);
+
+	nrcpus = cpu__max_cpu().cpu;
+	cpuset = CPU_ALLOC(nrcpus);
+	BUG_ON(!cpuset);
+	size = CPU_ALLOC_SIZE(nrcpus);
+
+	for (i = 0; i < nthreads; i++) {
+		struct worker *w = &worker[i];
+
+		w->tid = i;
+		worker_setup(w, op);
+
+		if (!noaffinity) {
+			CPU_ZERO_S(size, cpuset);
+			CPU_SET_S(perf_cpu_map__cpu(cpu, i % perf_cpu_map__nr(cpu)).cpu,
+				  size, cpuset);
+
+			ret = pthread_attr_setaffinity_np(&thread_attr, size, cpuset);
+			if (ret) {
+				CPU_FREE(cpuset);
+				err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+			}
+			attrp = &thread_attr;
+		}
+
+		ret = pthread_create(&w->thread, attrp, workerfn, w);
+		if (ret) {
+			CPU_FREE(cpuset);
+			err(EXIT_FAILURE, "pthread_create");
+		}
+	}
+
+	CPU_FREE(cpuset);
+	if (!noaffinity)
+		pthread_attr_destroy(&thread_attr);
+
+	mutex_lock(&thread_lock);
+	while (threads_starting)
+		cond_wait(&thread_parent, &thread_lock);
+	cond_broadcast(&thread_worker);
+	mutex_unlock(&thread_lock);
+
+	gettimeofday(&bench__start, NULL);
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	cond_destroy(&thread_parent);
+	cond_destroy(&thread_worker);
+	mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = bench__runtime.tv_sec > 0 ?
+			worker[i].ops / bench__runtime.tv_sec : 0;
+
+		update_stats(&throughput_stats, t);
+		total += t;
+		if (!silent)
+			printf("[thread %2d] ring fd %d: %ld ops/sec, %lu errors\n",
+			       worker[i].tid, worker[i].ring.fd, t,
+			       worker[i].errors);
+		worker_cleanup(&worker[i]);
+	}
+
+	print_summary(total);
+	print_latency(worker);
+
+	free(worker);
+	perf_cpu_map__put(cpu);
+	return ret;
+}
+
+int bench_uring_nop(int argc, const char **argv)
+{
+	return bench_uring(argc, argv, URING_NOP);
+}
+
+int bench_uring_read(int argc, const char **argv)
+{
+	return bench_uring(argc, argv, URING_READ);
+}
+
+int bench_uring_recv(int argc, const char **argv)
+{
+	return bench_uring(argc, argv, URING_RECV);
+}
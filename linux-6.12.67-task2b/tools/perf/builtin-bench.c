@@ -15,7 +15,10 @@
  *  mem   ... memory access performance
  *  numa  ... NUMA scheduling and MM performance
  *  futex ... Futex performance
+ *  ipc   ... SysV and POSIX IPC performance
  *  epoll ... Event poll performance
+ *  uring ... io_uring submission and completion performance
+ *  ds    ... kernel lib/ data structure performance
  */
 #include <subcmd/parse-options.h>
 #include "builtin.h"
@@ -80,6 +83,15 @@ static struct bench futex_benchmarks[] = {
 	{ NULL,		NULL,						NULL			}
 };
 
+static struct bench ipc_benchmarks[] = {
+	{ "sem",	"Benchmark for SysV semaphore operations",	bench_ipc_sem		},
+	{ "msg",	"Benchmark for SysV message queues",		bench_ipc_msg		},
+	{ "mq",		"Benchmark for POSIX message queues",		bench_ipc_mq		},
+	{ "shm",	"Benchmark for SysV shared memory attach/detach", bench_ipc_shm		},
+	{ "all",	"Run all IPC benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
 #ifdef HAVE_EVENTFD_SUPPORT
 static struct bench epoll_benchmarks[] = {
 	{ "wait",	"Benchmark epoll concurrent epoll_waits",       bench_epoll_wait	},
@@ -89,6 +101,24 @@ static struct bench epoll_benchmarks[] = {
 };
 #endif // HAVE_EVENTFD_SUPPORT
 
+static struct bench uring_benchmarks[] = {
+	{ "nop",	"Benchmark io_uring NOP round trips",		bench_uring_nop		},
+	{ "read",	"Benchmark io_uring reads, optionally into fixed buffers", bench_uring_read	},
+	{ "recv",	"Benchmark io_uring receives into provided buffers", bench_uring_recv	},
+	{ "all",	"Run all io_uring benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
+static struct bench ds_benchmarks[] = {
+	{ "rhashtable",	"Benchmark rhashtable lookup, insert and erase",	bench_ds_rhashtable	},
+	{ "maple",	"Benchmark maple tree load, insert and erase",	bench_ds_maple		},
+	{ "xarray",	"Benchmark xarray load, insert and erase",	bench_ds_xarray		},
+	{ "sbitmap",	"Benchmark sbitmap get, put and test",		bench_ds_sbitmap	},
+	{ "percpu_counter", "Benchmark percpu_counter add and compare",	bench_ds_percpu_counter	},
+	{ "all",	"Run all data structure benchmarks",		NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
 static struct bench internals_benchmarks[] = {
 	{ "synthesize", "Benchmark perf event synthesis",	bench_synthesize	},
 	{ "kallsyms-parse", "Benchmark kallsyms parsing",	bench_kallsyms_parse	},
@@ -128,9 +158,12 @@ static struct collection collections[] = {
 	{ "numa",	"NUMA scheduling and MM benchmarks",		numa_benchmarks		},
 #endif
 	{"futex",       "Futex stressing benchmarks",                   futex_benchmarks        },
+	{ "ipc",	"SysV and POSIX IPC benchmarks",		ipc_benchmarks		},
 #ifdef HAVE_EVENTFD_SUPPORT
 	{"epoll",       "Epoll stressing benchmarks",                   epoll_benchmarks        },
 #endif
+	{ "uring",	"io_uring benchmarks",				uring_benchmarks	},
+	{ "ds",		"Kernel lib/ data structure benchmarks (needs ds_benchmark)", ds_benchmarks	},
 	{ "internals",	"Perf-internals benchmarks",			internals_benchmarks	},
 	{ "breakpoint",	"Breakpoint benchmarks",			breakpoint_benchmarks	},
 	{ "uprobe",	"uprobe benchmarks",				uprobe_benchmarks	},
@@ -171,6 +171,7 @@ struct record {
 	bool			timestamp_filename;
 	bool			timestamp_boundary;
 	bool			off_cpu;
+	u64			off_cpu_flushed;	/* last flush, in clockid time */
 	const char		*filter_action;
 	struct switch_output	switch_output;
 	unsigned long long	samples;
@@ -926,6 +927,33 @@ static int record__config_off_cpu(struct record *rec)
 	return off_cpu_prepare(rec->evlist, &rec->opts.target, &rec->opts);
 }
 
+/*
+ * With --off-cpu-flush, write out the off-cpu time collected so far every
+ * off_cpu_flush_ms instead of only at the end, so the BPF maps don't fill up
+ * in long sessions and the samples land in the timeline next to the others.
+ */
+static void record__flush_off_cpu(struct record *rec)
+{
+	struct timespec ts;
+	int bytes;
+	u64 now;
+
+	if (!rec->off_cpu || !rec->opts.off_cpu_flush_ms)
+		return;
+
+	if (clock_gettime(rec->opts.clockid, &ts))
+		return;
+	now = (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+	if (now - rec->off_cpu_flushed <
+	    (u64)rec->opts.off_cpu_flush_ms * NSEC_PER_MSEC)
+		return;
+	rec->off_cpu_flushed = now;
+
+	bytes = off_cpu_flush(rec->session, now);
+	if (bytes > 0)
+		rec->bytes_written += bytes;
+}
+
 static bool record__tracking_system_wide(struct record *rec)
 {
 	struct evlist *evlist = rec->evlist;
@@ -2661,6 +2689,8 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 			goto out_child;
 		}
 
+		record__flush_off_cpu(rec);
+
 		if (auxtrace_record__snapshot_started) {
 			auxtrace_record__snapshot_started = 0;
 			if (!trigger_is_error(&auxtrace_snapshot_trigger))
@@ -2713,7 +2743,10 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		if (hits == thread->samples) {
 			if (done || draining)
 				break;
-			err = fdarray__poll(&thread->pollfd, -1);
+			/* wake up in time for the next off-cpu flush */
+			err = fdarray__poll(&thread->pollfd,
+					    rec->off_cpu && rec->opts.off_cpu_flush_ms ?
+					    (int)rec->opts.off_cpu_flush_ms : -1);
 			/*
 			 * Propagate error, only if there's any. Ignore positive
 			 * number of returned events and interrupt error.
@@ -2828,8 +2861,12 @@ out_free_threads:
 	} else
 		status = err;
 
-	if (rec->off_cpu)
+	if (rec->off_cpu) {
+		/* stamp the last interval like the ones before it */
+		rec->off_cpu_flushed = 0;
+		record__flush_off_cpu(rec);
 		rec->bytes_written += off_cpu_write(rec->session);
+	}
 
 	record__read_lost_samples(rec);
 	/* this will be recalculated during process_buildids() */
@@ -3562,6 +3599,8 @@ static struct option __record_options[] = {
 			    "write collected trace data into several data files using parallel threads",
 			    record__parse_threads),
 	OPT_BOOLEAN(0, "off-cpu", &record.off_cpu, "Enable off-cpu analysis"),
+	OPT_UINTEGER(0, "off-cpu-flush", &record.opts.off_cpu_flush_ms,
+		     "Write off-cpu samples every <ms> instead of at the end (needs --clockid)"),
 	OPT_STRING(0, "setup-filter", &record.filter_action, "pin|unpin",
 		   "BPF filter action"),
 	OPT_END()
@@ -131,6 +131,12 @@ int off_cpu_prepare(struct evlist *evlist, struct target *target,
 	struct strlist *pid_slist = NULL;
 	struct str_node *pos;
 
+	/* flushed samples need a real timestamp to sort with the others */
+	if (opts->off_cpu_flush_ms && !opts->use_clockid) {
+		pr_err("--off-cpu-flush needs -k/--clockid\n");
+		return -1;
+	}
+
 	if (off_cpu_config(evlist) < 0) {
 		pr_err("Failed to config off-cpu BPF event\n");
 		return -1;
@@ -291,23 +297,10 @@ out:
 	return -1;
 }
 
-int off_cpu_write(struct perf_session *session)
+static int off_cpu_sample_type(struct perf_session *session, u64 *sample_type,
+			       u64 *sid)
 {
-	int bytes = 0, size;
-	int fd, stack;
-	u64 sample_type, val, sid = 0;
 	struct evsel *evsel;
-	struct perf_data_file *file = &session->data->file;
-	struct off_cpu_key prev, key;
-	union off_cpu_data data = {
-		.hdr = {
-			.type = PERF_RECORD_SAMPLE,
-			.misc = PERF_RECORD_MISC_USER,
-		},
-	};
-	u64 tstamp = OFF_CPU_TIMESTAMP;
-
-	skel->bss->enabled = 0;
 
 	evsel = evlist__find_evsel_by_str(session->evlist, OFFCPU_EVENT);
 	if (evsel == NULL) {
@@ -315,77 +308,113 @@ int off_cpu_write(struct perf_session *session)
 		return 0;
 	}
 
-	sample_type = evsel->core.attr.sample_type;
+	*sample_type = evsel->core.attr.sample_type;
 
-	if (sample_type & ~OFFCPU_SAMPLE_TYPES) {
+	if (*sample_type & ~OFFCPU_SAMPLE_TYPES) {
 		pr_err("not supported sample type: %llx\n",
-		       (unsigned long long)sample_type);
+		       (unsigned long long)*sample_type);
 		return -1;
 	}
 
-	if (sample_type & (PERF_SAMPLE_ID | PERF_SAMPLE_IDENTIFIER)) {
+	*sid = 0;
+	if (*sample_type & (PERF_SAMPLE_ID | PERF_SAMPLE_IDENTIFIER)) {
 		if (evsel->core.id)
-			sid = evsel->core.id[0];
+			*sid = evsel->core.id[0];
 	}
+	return 1;
+}
+
+/* write the sample of @val off-cpu time for @key, returns its size or -1 */
+static int off_cpu_write_sample(struct perf_data_file *file, u64 sample_type,
+				u64 sid, struct off_cpu_key *key, u64 val,
+				u64 tstamp)
+{
+	int n = 1;  /* start from perf_event_header */
+	int ip_pos = -1, size;
+	int stack = bpf_map__fd(skel->maps.stacks);
+	union off_cpu_data data = {
+		.hdr = {
+			.type = PERF_RECORD_SAMPLE,
+			.misc = PERF_RECORD_MISC_USER,
+		},
+	};
+
+	if (sample_type & PERF_SAMPLE_IDENTIFIER)
+		data.array[n++] = sid;
+	if (sample_type & PERF_SAMPLE_IP) {
+		ip_pos = n;
+		data.array[n++] = 0;  /* will be updated */
+	}
+	if (sample_type & PERF_SAMPLE_TID)
+		data.array[n++] = (u64)key->pid << 32 | key->tgid;
+	if (sample_type & PERF_SAMPLE_TIME)
+		data.array[n++] = tstamp;
+	if (sample_type & PERF_SAMPLE_ID)
+		data.array[n++] = sid;
+	if (sample_type & PERF_SAMPLE_CPU)
+		data.array[n++] = 0;
+	if (sample_type & PERF_SAMPLE_PERIOD)
+		data.array[n++] = val;
+	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
+		int len = 0;
+
+		/* data.array[n] is callchain->nr (updated later) */
+		data.array[n + 1] = PERF_CONTEXT_USER;
+		data.array[n + 2] = 0;
+
+		bpf_map_lookup_elem(stack, &key->stack_id, &data.array[n + 2]);
+		while (data.array[n + 2 + len])
+			len++;
+
+		/* update length of callchain */
+		data.array[n] = len + 1;
+
+		/* update sample ip with the first callchain entry */
+		if (ip_pos >= 0)
+			data.array[ip_pos] = data.array[n + 2];
+
+		/* calculate sample callchain data array length */
+		n += len + 2;
+	}
+	if (sample_type & PERF_SAMPLE_CGROUP)
+		data.array[n++] = key->cgroup_id;
+
+	size = n * sizeof(u64);
+	data.hdr.size = size;
+
+	if (perf_data_file__write(file, &data, size) < 0) {
+		pr_err("failed to write perf data, error: %m\n");
+		return -1;
+	}
+	return size;
+}
+
+int off_cpu_write(struct perf_session *session)
+{
+	int bytes = 0, size, ret;
+	int fd;
+	u64 sample_type, val, sid;
+	struct perf_data_file *file = &session->data->file;
+	struct off_cpu_key prev, key;
+	u64 tstamp = OFF_CPU_TIMESTAMP;
+
+	skel->bss->enabled = 0;
+
+	ret = off_cpu_sample_type(session, &sample_type, &sid);
+	if (ret <= 0)
+		return ret;
 
 	fd = bpf_map__fd(skel->maps.off_cpu);
-	stack = bpf_map__fd(skel->maps.stacks);
 	memset(&prev, 0, sizeof(prev));
 
 	while (!bpf_map_get_next_key(fd, &prev, &key)) {
-		int n = 1;  /* start from perf_event_header */
-		int ip_pos = -1;
-
 		bpf_map_lookup_elem(fd, &key, &val);
 
-		if (sample_type & PERF_SAMPLE_IDENTIFIER)
-			data.array[n++] = sid;
-		if (sample_type & PERF_SAMPLE_IP) {
-			ip_pos = n;
-			data.array[n++] = 0;  /* will be updated */
-		}
-		if (sample_type & PERF_SAMPLE_TID)
-			data.array[n++] = (u64)key.pid << 32 | key.tgid;
-		if (sample_type & PERF_SAMPLE_TIME)
-			data.array[n++] = tstamp;
-		if (sample_type & PERF_SAMPLE_ID)
-			data.array[n++] = sid;
-		if (sample_type & PERF_SAMPLE_CPU)
-			data.array[n++] = 0;
-		if (sample_type & PERF_SAMPLE_PERIOD)
-			data.array[n++] = val;
-		if (sample_type & PERF_SAMPLE_CALLCHAIN) {
-			int len = 0;
-
-			/* data.array[n] is callchain->nr (updated later) */
-			data.array[n + 1] = PERF_CONTEXT_USER;
-			data.array[n + 2] = 0;
-
-			bpf_map_lookup_elem(stack, &key.stack_id, &data.array[n + 2]);
-			while (data.array[n + 2 + len])
-				len++;
-
-			/* update length of callchain */
-			data.array[n] = len + 1;
-
-			/* update sample ip with the first callchain entry */
-			if (ip_pos >= 0)
-				data.array[ip_pos] = data.array[n + 2];
-
-			/* calculate sample callchain data array length */
-			n += len + 2;
-		}
-		if (sample_type & PERF_SAMPLE_CGROUP)
-			data.array[n++] = key.cgroup_id;
-
-		size = n * sizeof(u64);
-		data.hdr.size = size;
-		bytes += size;
-
-		if (perf_data_file__write(file, &data, size) < 0) {
-			pr_err("failed to write perf data, error: %m\n");
+		size = off_cpu_write_sample(file, sample_type, sid, &key, val,
+					    tstamp);
+		if (size < 0)
 			return bytes;
-		}
+		bytes += size;
 
 		prev = key;
 		/* increase dummy timestamp to sort later samples */
@@ -393,3 +422,48 @@ int off_cpu_write(struct perf_session *session)
 	}
 	return bytes;
 }
+
+/*
+ * Write out and remove the off-cpu time collected so far, all stamped with
+ * @tstamp. Entries are taken out with lookup-and-delete, so time the BPF
+ * program adds concurrently either makes it into this flush or starts a new
+ * entry for the next one. The stacks are not removed, they are already
+ * deduplicated by the stack map and may still be referenced by new entries.
+ */
+int off_cpu_flush(struct perf_session *session, u64 tstamp)
+{
+	int bytes = 0, size, ret, fd;
+	u32 nr, max_entries;
+	u64 sample_type, val, sid;
+	struct perf_data_file *file = &session->data->file;
+	struct off_cpu_key key;
+
+	ret = off_cpu_sample_type(session, &sample_type, &sid);
+	if (ret <= 0)
+		return ret;
+
+	fd = bpf_map__fd(skel->maps.off_cpu);
+	max_entries = bpf_map__max_entries(skel->maps.off_cpu);
+
+	/* bound the walk, new entries may keep showing up behind us */
+	for (nr = 0; nr < max_entries; nr++) {
+		if (bpf_map_get_next_key(fd, NULL, &key))
+			break;
+
+		if (bpf_map_lookup_and_delete_elem(fd, &key, &val)) {
+			/* gone already, or hash maps don't support it (< v5.14) */
+			if (errno == ENOENT)
+				continue;
+			if (bpf_map_lookup_elem(fd, &key, &val))
+				continue;
+			bpf_map_delete_elem(fd, &key);
+		}
+
+		size = off_cpu_write_sample(file, sample_type, sid, &key, val,
+					    tstamp);
+		if (size < 0)
+			break;
+		bytes += size;
+	}
+	return bytes;
+}
@@ -21,6 +21,7 @@ struct record_opts;
 int off_cpu_prepare(struct evlist *evlist, struct target *target,
 		    struct record_opts *opts);
 int off_cpu_write(struct perf_session *session);
+int off_cpu_flush(struct perf_session *session, u64 tstamp);
 #else
 static inline int off_cpu_prepare(struct evlist *evlist __maybe_unused,
 				  struct target *target __maybe_unused,
@@ -33,6 +34,12 @@ static inline int off_cpu_write(struct perf_session *session __maybe_unused)
 {
 	return -1;
 }
+
+static inline int off_cpu_flush(struct perf_session *session __maybe_unused,
+				u64 tstamp __maybe_unused)
+{
+	return -1;
+}
 #endif
 
 #endif  /* PERF_UTIL_OFF_CPU_H */
@@ -79,6 +79,7 @@ struct record_opts {
 	int	      synth;
 	int	      threads_spec;
 	const char    *threads_user_spec;
+	unsigned int  off_cpu_flush_ms;
 };
 
 extern const char * const *record_usage;
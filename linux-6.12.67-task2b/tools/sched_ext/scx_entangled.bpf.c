@@ -0,0 +1,382 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * A FIFO scheduler which never runs tasks of different owners on the CPUs of
+ * one entangled group at the same time.
+ *
+ * The groups are handed in by the userspace side through cpu_group[],
+ * cpu_slot[] and group_cpus[], SMT siblings by default. The owner of a task is
+ * its UID, or its core scheduling cookie if use_cookie is set. Kernel threads
+ * have no owner and may run next to anything.
+ *
+ * - Every CPU of a group records the owner it is running for in its slot of
+ *   the group's context. A CPU may only claim an owner which no other CPU of
+ *   the group holds a different claim for, the check and the claim are done
+ *   under the group's lock.
+ *
+ * - All tasks are queued on one shared FIFO DSQ. A CPU looking for work moves
+ *   the first queued task it has a compatible owner for to its local DSQ and
+ *   skips over the others. If it skipped some and found none, it stays idle
+ *   and the time until it runs again is accounted as forced idle.
+ *
+ * - A CPU going idle drops its claim and kicks the rest of its group, which
+ *   may now be able to run what they had to skip. ops.running() catches the
+ *   cases where a task starts without having gone through a claim, and
+ *   preempts the siblings running for another owner.
+ *
+ * The scheduler is meant to put numbers on the cost of the policy, so the
+ * same workload can be compared against the in-kernel implementation and
+ * against running without the constraint. It reports tasks started, run time
+ * and forced idle time, as well as the per-CPU counters of
+ * /proc/sys/kernel/entangled_cpu_stats.
+ */
+#include <scx/common.bpf.h>
+#include "scx_entangled.h"
+
+char _license[] SEC("license") = "GPL";
+
+#define SHARED_DSQ 0
+
+const volatile u32 nr_cpu_ids = 1;	/* !0 for veristat, set during init */
+const volatile u64 slice_ns = SCX_SLICE_DFL;
+const volatile bool use_cookie;
+
+/* group index + 1 of each CPU, 0 if it isn't entangled */
+const volatile u32 cpu_group[ENT_MAX_CPUS];
+/* position of each CPU within its group */
+const volatile u32 cpu_slot[ENT_MAX_CPUS];
+/* CPU + 1 of each member of a group, 0 for unused slots */
+const volatile u32 group_cpus[ENT_MAX_GROUPS][ENT_GROUP_MAX_CPUS];
+
+UEI_DEFINE(uei);
+
+struct group_ctx {
+	struct bpf_spin_lock lock;
+	u64 owner[ENT_GROUP_MAX_CPUS];	/* owner claimed by each slot, 0 if none */
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, u32);
+	__type(value, struct group_ctx);
+	__uint(max_entries, ENT_MAX_GROUPS);
+} group_ctxs SEC(".maps");
+
+struct cpu_ctx {
+	u64 run_at;		/* when the current task started running */
+	u64 idle_at;		/* when forced idle started, 0 if not idle */
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, u32);
+	__type(value, struct cpu_ctx);
+	__uint(max_entries, 1);
+} cpu_ctxs SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__uint(key_size, sizeof(u32));
+	__uint(value_size, sizeof(u64));
+	__uint(max_entries, ENT_NR_STATS);
+} stats SEC(".maps");
+
+/* core_cookie only exists with CONFIG_SCHED_CORE */
+struct task_struct___core {
+	unsigned long core_cookie;
+} __attribute__((preserve_access_index));
+
+static void stat_add(u32 idx, u64 val)
+{
+	u64 *cnt_p = bpf_map_lookup_elem(&stats, &idx);
+	if (cnt_p)
+		(*cnt_p) += val;
+}
+
+static struct cpu_ctx *lookup_cpu_ctx(void)
+{
+	u32 zero = 0;
+
+	return bpf_map_lookup_elem(&cpu_ctxs, &zero);
+}
+
+/* the owner @p runs for, 0 if it may run next to anything */
+static u64 task_owner(struct task_struct *p)
+{
+	struct task_struct___core *pc = (void *)p;
+
+	if (p->flags & PF_KTHREAD)
+		return 0;
+
+	/* keep owners !0, uid 0 and cookie 0 are valid owners too */
+	if (use_cookie && bpf_core_field_exists(pc->core_cookie))
+		return BPF_CORE_READ(pc, core_cookie) + 1;
+
+	return (u64)BPF_CORE_READ(p, cred, uid.val) + 1;
+}
+
+static u32 cpu_to_group(s32 cpu)
+{
+	if (cpu < 0 || cpu >= ENT_MAX_CPUS)
+		return 0;
+	return cpu_group[cpu];
+}
+
+static u32 group_cpu(u32 group, u32 slot)
+{
+	if (!group || group > ENT_MAX_GROUPS || slot >= ENT_GROUP_MAX_CPUS)
+		return 0;
+	return group_cpus[group - 1][slot];
+}
+
+static struct group_ctx *lookup_group_ctx(s32 cpu, u32 *slotp)
+{
+	u32 group = cpu_to_group(cpu), idx;
+
+	if (!group)
+		return NULL;
+
+	*slotp = cpu_slot[cpu & (ENT_MAX_CPUS - 1)];
+	if (*slotp >= ENT_GROUP_MAX_CPUS)
+		return NULL;
+
+	idx = group - 1;
+	return bpf_map_lookup_elem(&group_ctxs, &idx);
+}
+
+/* kick the other CPUs of @cpu's group */
+static void kick_group(s32 cpu, u64 flags)
+{
+	u32 group = cpu_to_group(cpu), slot;
+
+	for (slot = 0; slot < ENT_GROUP_MAX_CPUS; slot++) {
+		u32 sib = group_cpu(group, slot);
+
+		if (sib && sib - 1 != cpu)
+			scx_bpf_kick_cpu(sib - 1, flags);
+	}
+}
+
+/*
+ * Claim @owner for @cpu if no other CPU of its group is running for a
+ * different owner. Returns whether @cpu may run a task of @owner. The claim
+ * it replaced is stored in @prevp, for unclaim().
+ */
+static bool try_claim(s32 cpu, u64 owner, u64 *prevp)
+{
+	struct group_ctx *gctx;
+	bool ok = true;
+	u32 slot, i;
+
+	gctx = lookup_group_ctx(cpu, &slot);
+	if (!gctx)
+		return true;
+
+	bpf_spin_lock(&gctx->lock);
+	for (i = 0; i < ENT_GROUP_MAX_CPUS; i++) {
+		if (owner && i != slot && gctx->owner[i] &&
+		    gctx->owner[i] != owner)
+			ok = false;
+	}
+	if (ok && slot < ENT_GROUP_MAX_CPUS) {
+		*prevp = gctx->owner[slot];
+		gctx->owner[slot] = owner;
+	}
+	bpf_spin_unlock(&gctx->lock);
+
+	return ok;
+}
+
+/*
+ * Put back the claim try_claim() replaced when the task of @owner couldn't be
+ * dispatched after all, unless the slot has been claimed again since.
+ */
+static void unclaim(s32 cpu, u64 owner, u64 prev)
+{
+	struct group_ctx *gctx;
+	u32 slot;
+
+	gctx = lookup_group_ctx(cpu, &slot);
+	if (!gctx)
+		return;
+
+	bpf_spin_lock(&gctx->lock);
+	if (slot < ENT_GROUP_MAX_CPUS && gctx->owner[slot] == owner)
+		gctx->owner[slot] = prev;
+	bpf_spin_unlock(&gctx->lock);
+}
+
+/* end the forced idle period of the current CPU, if any */
+static void end_forced_idle(struct cpu_ctx *cctx, u64 now)
+{
+	if (cctx->idle_at) {
+		stat_add(ENT_STAT_FORCED_IDLE_NS, now - cctx->idle_at);
+		cctx->idle_at = 0;
+	}
+}
+
+s32 BPF_STRUCT_OPS(entangled_select_cpu, struct task_struct *p, s32 prev_cpu,
+		   u64 wake_flags)
+{
+	bool is_idle = false;
+	u64 prev_owner;
+	s32 cpu;
+
+	cpu = scx_bpf_select_cpu_dfl(p, prev_cpu, wake_flags, &is_idle);
+	if (is_idle && try_claim(cpu, task_owner(p), &prev_owner))
+		scx_bpf_dispatch(p, SCX_DSQ_LOCAL, slice_ns, 0);
+
+	return cpu;
+}
+
+void BPF_STRUCT_OPS(entangled_enqueue, struct task_struct *p, u64 enq_flags)
+{
+	scx_bpf_dispatch(p, SHARED_DSQ, slice_ns, enq_flags);
+}
+
+void BPF_STRUCT_OPS(entangled_dispatch, s32 cpu, struct task_struct *prev)
+{
+	struct task_struct *p;
+	struct cpu_ctx *cctx;
+	bool blocked = false;
+	u32 nr_scanned = 0;
+	u64 owner, prev_owner;
+
+	bpf_for_each(scx_dsq, p, SHARED_DSQ, 0) {
+		if (++nr_scanned > ENT_MAX_SCAN)
+			break;
+		if (!bpf_cpumask_test_cpu(cpu, p->cpus_ptr))
+			continue;
+		owner = task_owner(p);
+		if (!try_claim(cpu, owner, &prev_owner)) {
+			blocked = true;
+			continue;
+		}
+		if (__COMPAT_scx_bpf_dispatch_from_dsq(BPF_FOR_EACH_ITER, p,
+						       SCX_DSQ_LOCAL, 0))
+			return;
+		/* lost @p to another CPU, keep the claim of what runs here */
+		unclaim(cpu, owner, prev_owner);
+	}
+
+	cctx = lookup_cpu_ctx();
+	if (!cctx)
+		return;
+
+	/* @prev keeps running if it is still runnable, that isn't idle */
+	if (blocked && !(prev && (prev->scx.flags & SCX_TASK_QUEUED))) {
+		stat_add(ENT_STAT_BLOCKED, 1);
+		if (!cctx->idle_at)
+			cctx->idle_at = bpf_ktime_get_ns();
+	} else if (!blocked) {
+		end_forced_idle(cctx, bpf_ktime_get_ns());
+	}
+}
+
+void BPF_STRUCT_OPS(entangled_running, struct task_struct *p)
+{
+	s32 cpu = scx_bpf_task_cpu(p);
+	u64 owner = task_owner(p), now = bpf_ktime_get_ns();
+	struct group_ctx *gctx;
+	struct cpu_ctx *cctx;
+	u32 slot, i, conflicts = 0;
+
+	stat_add(ENT_STAT_RUNS, 1);
+
+	cctx = lookup_cpu_ctx();
+	if (cctx) {
+		end_forced_idle(cctx, now);
+		cctx->run_at = now;
+	}
+
+	gctx = lookup_group_ctx(cpu, &slot);
+	if (!gctx)
+		return;
+
+	/*
+	 * The claim is normally in place already. If it isn't, e.g. because two
+	 * siblings raced to run something, this CPU wins and the siblings in
+	 * the way are preempted.
+	 */
+	bpf_spin_lock(&gctx->lock);
+	for (i = 0; i < ENT_GROUP_MAX_CPUS; i++) {
+		if (owner && i != slot && gctx->owner[i] &&
+		    gctx->owner[i] != owner) {
+			gctx->owner[i] = 0;
+			conflicts |= 1 << i;
+		}
+	}
+	if (slot < ENT_GROUP_MAX_CPUS)
+		gctx->owner[slot] = owner;
+	bpf_spin_unlock(&gctx->lock);
+
+	for (i = 0; i < ENT_GROUP_MAX_CPUS; i++) {
+		u32 sib = group_cpu(cpu_to_group(cpu), i);
+
+		if (sib && (conflicts & (1 << i))) {
+			stat_add(ENT_STAT_PREEMPT, 1);
+			scx_bpf_kick_cpu(sib - 1, SCX_KICK_PREEMPT);
+		}
+	}
+}
+
+void BPF_STRUCT_OPS(entangled_stopping, struct task_struct *p, bool runnable)
+{
+	struct cpu_ctx *cctx = lookup_cpu_ctx();
+
+	if (cctx && cctx->run_at) {
+		stat_add(ENT_STAT_RUNTIME_NS, bpf_ktime_get_ns() - cctx->run_at);
+		cctx->run_at = 0;
+	}
+}
+
+void BPF_STRUCT_OPS(entangled_update_idle, s32 cpu, bool idle)
+{
+	struct group_ctx *gctx;
+	u64 released = 0;
+	u32 slot;
+
+	if (!idle)
+		return;
+
+	gctx = lookup_group_ctx(cpu, &slot);
+	if (!gctx)
+		return;
+
+	bpf_spin_lock(&gctx->lock);
+	if (slot < ENT_GROUP_MAX_CPUS) {
+		released = gctx->owner[slot];
+		gctx->owner[slot] = 0;
+	}
+	bpf_spin_unlock(&gctx->lock);
+
+	/* only kick if something changed so idle siblings don't ping-pong */
+	if (released)
+		kick_group(cpu, SCX_KICK_IDLE);
+}
+
+s32 BPF_STRUCT_OPS_SLEEPABLE(entangled_init)
+{
+	if (!bpf_ksym_exists(scx_bpf_dispatch_from_dsq)) {
+		scx_bpf_error("scx_bpf_dispatch_from_dsq() is required");
+		return -EOPNOTSUPP;
+	}
+
+	return scx_bpf_create_dsq(SHARED_DSQ, -1);
+}
+
+void BPF_STRUCT_OPS(entangled_exit, struct scx_exit_info *ei)
+{
+	UEI_RECORD(uei, ei);
+}
+
+SCX_OPS_DEFINE(entangled_ops,
+	       .select_cpu		= (void *)entangled_select_cpu,
+	       .enqueue			= (void *)entangled_enqueue,
+	       .dispatch		= (void *)entangled_dispatch,
+	       .running			= (void *)entangled_running,
+	       .stopping		= (void *)entangled_stopping,
+	       .update_idle		= (void *)entangled_update_idle,
+	       .init			= (void *)entangled_init,
+	       .exit			= (void *)entangled_exit,
+	       .flags			= SCX_OPS_KEEP_BUILTIN_IDLE,
+	       .name			= "entangled");
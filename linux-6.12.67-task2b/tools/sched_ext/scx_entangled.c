@@ -0,0 +1,273 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <libgen.h>
+#include <bpf/bpf.h>
+#include <scx/common.h>
+#include "scx_entangled.h"
+#include "scx_entangled.bpf.skel.h"
+
+const char help_fmt[] =
+"A sched_ext scheduler keeping different owners off entangled CPUs.\n"
+"\n"
+"See the top-level comment in .bpf.c for more details.\n"
+"\n"
+"Usage: %s [-g GROUPS] [-c] [-s SLICE_US] [-p] [-v]\n"
+"\n"
+"  -g GROUPS     Entangled CPU groups, e.g. \"0,64;1,65;2-3\" (default: SMT siblings)\n"
+"  -c            Tell owners apart by core scheduling cookie instead of UID\n"
+"  -s SLICE_US   Override slice duration\n"
+"  -p            Also print per-CPU forced idle, blocked and preemption counts\n"
+"  -v            Print libbpf debug messages\n"
+"  -h            Display this help and exit\n";
+
+static bool verbose;
+static bool per_cpu;
+static volatile int exit_req;
+
+static int libbpf_print_fn(enum libbpf_print_level level, const char *format, va_list args)
+{
+	if (level == LIBBPF_DEBUG && !verbose)
+		return 0;
+	return vfprintf(stderr, format, args);
+}
+
+static void sigint_handler(int dummy)
+{
+	exit_req = 1;
+}
+
+/*
+ * Add the CPUs of the cpulist @list, e.g. "0-1,4", as one group. Returns 0 on
+ * success, -1 if @list is malformed or a limit is exceeded.
+ */
+static int add_group(struct scx_entangled *skel, const char *list, __u32 *nr_groups)
+{
+	int nr_cpus = skel->rodata->nr_cpu_ids;
+	__u32 group = *nr_groups, slot = 0;
+	const char *s = list;
+
+	if (group >= ENT_MAX_GROUPS) {
+		fprintf(stderr, "Only %d groups are supported\n", ENT_MAX_GROUPS);
+		return -1;
+	}
+
+	while (*s) {
+		char *end;
+		long first, last, cpu;
+
+		first = strtol(s, &end, 10);
+		if (end == s)
+			return -1;
+		last = first;
+		if (*end == '-') {
+			s = end + 1;
+			last = strtol(s, &end, 10);
+			if (end == s)
+				return -1;
+		}
+		if (first < 0 || last < first || last >= nr_cpus) {
+			fprintf(stderr, "Invalid CPU range in \"%s\"\n", list);
+			return -1;
+		}
+
+		for (cpu = first; cpu <= last; cpu++) {
+			if (skel->rodata->cpu_group[cpu]) {
+				fprintf(stderr, "CPU %ld is in more than one group\n", cpu);
+				return -1;
+			}
+			if (slot == ENT_GROUP_MAX_CPUS) {
+				fprintf(stderr, "Only %d CPUs per group are supported\n",
+					ENT_GROUP_MAX_CPUS);
+				return -1;
+			}
+			skel->rodata->cpu_group[cpu] = group + 1;
+			skel->rodata->cpu_slot[cpu] = slot;
+			skel->rodata->group_cpus[group][slot++] = cpu + 1;
+		}
+
+		if (*end == ',')
+			end++;
+		else if (*end && *end != '\n')
+			return -1;
+		s = end;
+		if (*s == '\n')
+			break;
+	}
+
+	/* a group of one doesn't constrain anything */
+	if (slot == 1) {
+		skel->rodata->cpu_group[skel->rodata->group_cpus[group][0] - 1] = 0;
+		skel->rodata->group_cpus[group][0] = 0;
+	} else if (slot) {
+		(*nr_groups)++;
+	}
+	return 0;
+}
+
+static int init_groups(struct scx_entangled *skel, char *groups, __u32 *nr_groups)
+{
+	char *tok, *saveptr;
+
+	for (tok = strtok_r(groups, ";", &saveptr); tok;
+	     tok = strtok_r(NULL, ";", &saveptr)) {
+		if (add_group(skel, tok, nr_groups)) {
+			fprintf(stderr, "Failed to parse group \"%s\"\n", tok);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* entangle the SMT siblings of every core */
+static int init_smt_groups(struct scx_entangled *skel, __u32 *nr_groups)
+{
+	int nr_cpus = skel->rodata->nr_cpu_ids;
+	char path[128], list[256];
+	int cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		FILE *fp;
+
+		if (skel->rodata->cpu_group[cpu])
+			continue;
+
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list",
+			 cpu);
+		fp = fopen(path, "r");
+		if (!fp)
+			continue;
+		if (!fgets(list, sizeof(list), fp))
+			list[0] = '\0';
+		fclose(fp);
+
+		if (list[0] && add_group(skel, list, nr_groups)) {
+			fprintf(stderr, "Failed to parse siblings of CPU %d\n", cpu);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void read_stats(struct scx_entangled *skel, __u64 *stats,
+		       __u64 (*cpu_stats)[ENT_NR_STATS])
+{
+	int nr_cpus = libbpf_num_possible_cpus();
+	__u64 cnts[ENT_NR_STATS][nr_cpus];
+	__u32 idx;
+
+	memset(stats, 0, sizeof(stats[0]) * ENT_NR_STATS);
+
+	for (idx = 0; idx < ENT_NR_STATS; idx++) {
+		int ret, cpu;
+
+		ret = bpf_map_lookup_elem(bpf_map__fd(skel->maps.stats),
+					  &idx, cnts[idx]);
+		if (ret < 0)
+			continue;
+		for (cpu = 0; cpu < nr_cpus; cpu++) {
+			stats[idx] += cnts[idx][cpu];
+			cpu_stats[cpu][idx] = cnts[idx][cpu];
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct scx_entangled *skel;
+	struct bpf_link *link;
+	char *groups = NULL;
+	__u32 nr_groups = 0;
+	__u64 ecode;
+	__s32 opt;
+
+	libbpf_set_print(libbpf_print_fn);
+	signal(SIGINT, sigint_handler);
+	signal(SIGTERM, sigint_handler);
+restart:
+	skel = SCX_OPS_OPEN(entangled_ops, scx_entangled);
+
+	skel->rodata->nr_cpu_ids = libbpf_num_possible_cpus();
+	if (skel->rodata->nr_cpu_ids > ENT_MAX_CPUS) {
+		fprintf(stderr, "Only %d CPUs are supported\n", ENT_MAX_CPUS);
+		return 1;
+	}
+
+	while ((opt = getopt(argc, argv, "g:cs:pvh")) != -1) {
+		switch (opt) {
+		case 'g':
+			groups = optarg;
+			break;
+		case 'c':
+			skel->rodata->use_cookie = true;
+			break;
+		case 's':
+			skel->rodata->slice_ns = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'p':
+			per_cpu = true;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, help_fmt, basename(argv[0]));
+			return opt != 'h';
+		}
+	}
+
+	nr_groups = 0;
+	if (groups) {
+		/* strtok_r() modifies the string, keep optarg intact for restarts */
+		char *copy = strdup(groups);
+		int ret = copy ? init_groups(skel, copy, &nr_groups) : -1;
+
+		free(copy);
+		if (ret)
+			return 1;
+	} else if (init_smt_groups(skel, &nr_groups)) {
+		return 1;
+	}
+	printf("%u CPUs in %u entangled groups, owners by %s\n",
+	       skel->rodata->nr_cpu_ids, nr_groups,
+	       skel->rodata->use_cookie ? "cookie" : "uid");
+
+	SCX_OPS_LOAD(skel, entangled_ops, scx_entangled, uei);
+	link = SCX_OPS_ATTACH(skel, entangled_ops, scx_entangled);
+
+	while (!exit_req && !UEI_EXITED(skel, uei)) {
+		__u64 cpu_stats[skel->rodata->nr_cpu_ids][ENT_NR_STATS];
+		__u64 stats[ENT_NR_STATS];
+		int cpu;
+
+		read_stats(skel, stats, cpu_stats);
+		printf("runs=%llu run_ms=%llu forced_idle_ms=%llu blocked=%llu preempted=%llu\n",
+		       stats[ENT_STAT_RUNS], stats[ENT_STAT_RUNTIME_NS] / 1000000,
+		       stats[ENT_STAT_FORCED_IDLE_NS] / 1000000,
+		       stats[ENT_STAT_BLOCKED], stats[ENT_STAT_PREEMPT]);
+
+		/* same layout as /proc/sys/kernel/entangled_cpu_stats */
+		for (cpu = 0; per_cpu && cpu < skel->rodata->nr_cpu_ids; cpu++) {
+			if (!skel->rodata->cpu_group[cpu])
+				continue;
+			printf("cpu%d %llu %llu %llu\n", cpu,
+			       cpu_stats[cpu][ENT_STAT_FORCED_IDLE_NS],
+			       cpu_stats[cpu][ENT_STAT_BLOCKED],
+			       cpu_stats[cpu][ENT_STAT_PREEMPT]);
+		}
+		fflush(stdout);
+		sleep(1);
+	}
+
+	bpf_link__destroy(link);
+	ecode = UEI_REPORT(skel, uei);
+	scx_entangled__destroy(skel);
+
+	if (UEI_ECODE_RESTART(ecode))
+		goto restart;
+	return 0;
+}
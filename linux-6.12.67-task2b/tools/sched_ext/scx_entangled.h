@@ -0,0 +1,20 @@
+#ifndef __SCX_EXAMPLE_ENTANGLED_H
+#define __SCX_EXAMPLE_ENTANGLED_H
+
+enum {
+	ENT_MAX_CPUS		= 1024,
+	ENT_MAX_GROUPS		= 512,
+	ENT_GROUP_MAX_CPUS	= 4,
+	ENT_MAX_SCAN		= 64,	/* queued tasks looked at per dispatch */
+};
+
+enum ent_stat_idx {
+	ENT_STAT_RUNS,		/* tasks started */
+	ENT_STAT_RUNTIME_NS,	/* time spent running tasks */
+	ENT_STAT_FORCED_IDLE_NS, /* time idle with only incompatible work queued */
+	ENT_STAT_BLOCKED,	/* dispatches that skipped an incompatible task */
+	ENT_STAT_PREEMPT,	/* siblings preempted to resolve a conflict */
+	ENT_NR_STATS,
+};
+
+#endif /* __SCX_EXAMPLE_ENTANGLED_H */
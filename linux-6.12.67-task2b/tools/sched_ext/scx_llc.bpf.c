@@ -0,0 +1,301 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * A cache topology aware FIFO scheduler.
+ *
+ * Every last level cache (LLC) domain has its own DSQ, whose ID is the index
+ * of the LLC. The topology is discovered by the userspace side and passed in
+ * through cpu_llc[] and llc_node[].
+ *
+ * - Idle CPU selection looks for an idle core, then for an idle CPU, first in
+ *   the LLC of the previous CPU, then in the rest of its NUMA node, and only
+ *   then anywhere. A task that finds an idle CPU is dispatched straight to its
+ *   local DSQ.
+ *
+ * - Otherwise the task is queued on the DSQ of the LLC of the CPU it was
+ *   enqueued on, and an idle CPU of that LLC is kicked if there is one.
+ *
+ * - A CPU running out of work consumes from its own LLC first. Failing that it
+ *   steals from the other LLCs of its node, and only then from LLCs on other
+ *   nodes, so tasks keep their cache footprint as long as there is work close
+ *   by.
+ *
+ * Queues are FIFO and there is no notion of weight. The scheduler is meant as
+ * a base for experimenting with topology aware placement on multi-LLC and
+ * multi-node machines rather than a complete policy.
+ */
+#include <scx/common.bpf.h>
+#include "scx_llc.h"
+
+char _license[] SEC("license") = "GPL";
+
+const volatile u32 nr_cpu_ids = 1;	/* !0 for veristat, set during init */
+const volatile u32 nr_llcs = 1;
+const volatile u64 slice_ns = SCX_SLICE_DFL;
+const volatile u32 cpu_llc[LLC_MAX_CPUS];
+const volatile u32 llc_node[LLC_MAX_LLCS];
+
+UEI_DEFINE(uei);
+
+struct llc_ctx {
+	struct bpf_cpumask __kptr *cpumask;	/* CPUs of the LLC */
+	struct bpf_cpumask __kptr *node_cpumask; /* CPUs of the LLC's node */
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, u32);
+	__type(value, struct llc_ctx);
+	__uint(max_entries, LLC_MAX_LLCS);
+} llc_ctxs SEC(".maps");
+
+/* scratch cpumask to intersect domains with the task's allowed CPUs */
+struct task_ctx {
+	struct bpf_cpumask __kptr *tmp_cpumask;
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, int);
+	__type(value, struct task_ctx);
+} task_ctx_stor SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__uint(key_size, sizeof(u32));
+	__uint(value_size, sizeof(u64));
+	__uint(max_entries, LLC_NR_STATS);
+} stats SEC(".maps");
+
+static void stat_inc(u32 idx)
+{
+	u64 *cnt_p = bpf_map_lookup_elem(&stats, &idx);
+	if (cnt_p)
+		(*cnt_p)++;
+}
+
+static u32 cpu_to_llc(s32 cpu)
+{
+	if (cpu < 0 || cpu >= LLC_MAX_CPUS)
+		return 0;
+	return cpu_llc[cpu];
+}
+
+static u32 llc_to_node(u32 llc)
+{
+	if (llc >= LLC_MAX_LLCS)
+		return 0;
+	return llc_node[llc];
+}
+
+/* pick an idle CPU from @mask that @p may run on */
+static s32 pick_idle_in(struct task_struct *p, struct task_ctx *tctx,
+			struct bpf_cpumask *mask, u64 flags)
+{
+	struct bpf_cpumask *tmp = tctx->tmp_cpumask;
+
+	if (!mask || !tmp)
+		return -EBUSY;
+
+	if (!bpf_cpumask_and(tmp, cast_mask(mask), p->cpus_ptr))
+		return -EBUSY;
+
+	return scx_bpf_pick_idle_cpu(cast_mask(tmp), flags);
+}
+
+static s32 pick_idle_cpu(struct task_struct *p, s32 prev_cpu)
+{
+	struct task_ctx *tctx;
+	struct llc_ctx *lctx;
+	u32 llc = cpu_to_llc(prev_cpu);
+	s32 cpu;
+
+	tctx = bpf_task_storage_get(&task_ctx_stor, p, 0, 0);
+	lctx = bpf_map_lookup_elem(&llc_ctxs, &llc);
+	if (!tctx || !lctx)
+		return scx_bpf_pick_idle_cpu(p->cpus_ptr, 0);
+
+	/* a whole idle core in the LLC avoids sharing it with an SMT sibling */
+	cpu = pick_idle_in(p, tctx, lctx->cpumask, SCX_PICK_IDLE_CORE);
+	if (cpu >= 0)
+		return cpu;
+
+	if (bpf_cpumask_test_cpu(prev_cpu, p->cpus_ptr) &&
+	    scx_bpf_test_and_clear_cpu_idle(prev_cpu))
+		return prev_cpu;
+
+	cpu = pick_idle_in(p, tctx, lctx->cpumask, 0);
+	if (cpu >= 0)
+		return cpu;
+
+	cpu = pick_idle_in(p, tctx, lctx->node_cpumask, SCX_PICK_IDLE_CORE);
+	if (cpu >= 0)
+		return cpu;
+
+	cpu = pick_idle_in(p, tctx, lctx->node_cpumask, 0);
+	if (cpu >= 0)
+		return cpu;
+
+	return scx_bpf_pick_idle_cpu(p->cpus_ptr, 0);
+}
+
+s32 BPF_STRUCT_OPS(llc_select_cpu, struct task_struct *p, s32 prev_cpu,
+		   u64 wake_flags)
+{
+	s32 cpu;
+
+	if (p->nr_cpus_allowed == 1)
+		return prev_cpu;
+
+	cpu = pick_idle_cpu(p, prev_cpu);
+	if (cpu < 0)
+		return prev_cpu;
+
+	stat_inc(LLC_STAT_LOCAL);
+	scx_bpf_dispatch(p, SCX_DSQ_LOCAL, slice_ns, 0);
+	return cpu;
+}
+
+void BPF_STRUCT_OPS(llc_enqueue, struct task_struct *p, u64 enq_flags)
+{
+	u32 llc = cpu_to_llc(scx_bpf_task_cpu(p));
+	struct task_ctx *tctx;
+	struct llc_ctx *lctx;
+	s32 cpu;
+
+	stat_inc(LLC_STAT_LLC);
+	scx_bpf_dispatch(p, llc, slice_ns, enq_flags);
+
+	/* wake up an idle CPU of the LLC to pick the task up */
+	tctx = bpf_task_storage_get(&task_ctx_stor, p, 0, 0);
+	lctx = bpf_map_lookup_elem(&llc_ctxs, &llc);
+	if (!tctx || !lctx)
+		return;
+
+	cpu = pick_idle_in(p, tctx, lctx->cpumask, 0);
+	if (cpu >= 0)
+		scx_bpf_kick_cpu(cpu, SCX_KICK_IDLE);
+}
+
+void BPF_STRUCT_OPS(llc_dispatch, s32 cpu, struct task_struct *prev)
+{
+	u32 llc = cpu_to_llc(cpu), node = llc_to_node(llc);
+	u32 i, victim;
+
+	if (scx_bpf_consume(llc)) {
+		stat_inc(LLC_STAT_CONSUME);
+		return;
+	}
+
+	/* steal from the LLCs of the same node, starting after our own */
+	bpf_for(i, 1, nr_llcs) {
+		victim = (llc + i) % nr_llcs;
+		if (llc_to_node(victim) == node && scx_bpf_consume(victim)) {
+			stat_inc(LLC_STAT_STEAL_NODE);
+			return;
+		}
+	}
+
+	bpf_for(i, 1, nr_llcs) {
+		victim = (llc + i) % nr_llcs;
+		if (llc_to_node(victim) != node && scx_bpf_consume(victim)) {
+			stat_inc(LLC_STAT_STEAL_REMOTE);
+			return;
+		}
+	}
+}
+
+s32 BPF_STRUCT_OPS(llc_init_task, struct task_struct *p,
+		   struct scx_init_task_args *args)
+{
+	struct bpf_cpumask *mask;
+	struct task_ctx *tctx;
+
+	tctx = bpf_task_storage_get(&task_ctx_stor, p, 0,
+				    BPF_LOCAL_STORAGE_GET_F_CREATE);
+	if (!tctx)
+		return -ENOMEM;
+
+	mask = bpf_cpumask_create();
+	if (!mask)
+		return -ENOMEM;
+
+	mask = bpf_kptr_xchg(&tctx->tmp_cpumask, mask);
+	if (mask)
+		bpf_cpumask_release(mask);
+
+	return 0;
+}
+
+static s32 init_llc(u32 llc)
+{
+	struct bpf_cpumask *mask, *node_mask;
+	struct llc_ctx *lctx;
+	u32 node = llc_to_node(llc);
+	s32 cpu, ret;
+
+	ret = scx_bpf_create_dsq(llc, -1);
+	if (ret)
+		return ret;
+
+	lctx = bpf_map_lookup_elem(&llc_ctxs, &llc);
+	if (!lctx)
+		return -ENOENT;
+
+	mask = bpf_cpumask_create();
+	if (!mask)
+		return -ENOMEM;
+
+	node_mask = bpf_cpumask_create();
+	if (!node_mask) {
+		bpf_cpumask_release(mask);
+		return -ENOMEM;
+	}
+
+	bpf_for(cpu, 0, nr_cpu_ids) {
+		u32 cpu_l = cpu_to_llc(cpu);
+
+		if (cpu_l == llc)
+			bpf_cpumask_set_cpu(cpu, mask);
+		if (llc_to_node(cpu_l) == node)
+			bpf_cpumask_set_cpu(cpu, node_mask);
+	}
+
+	mask = bpf_kptr_xchg(&lctx->cpumask, mask);
+	if (mask)
+		bpf_cpumask_release(mask);
+
+	node_mask = bpf_kptr_xchg(&lctx->node_cpumask, node_mask);
+	if (node_mask)
+		bpf_cpumask_release(node_mask);
+
+	return 0;
+}
+
+s32 BPF_STRUCT_OPS_SLEEPABLE(llc_init)
+{
+	u32 llc;
+	s32 ret;
+
+	bpf_for(llc, 0, nr_llcs) {
+		ret = init_llc(llc);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+void BPF_STRUCT_OPS(llc_exit, struct scx_exit_info *ei)
+{
+	UEI_RECORD(uei, ei);
+}
+
+SCX_OPS_DEFINE(llc_ops,
+	       .select_cpu		= (void *)llc_select_cpu,
+	       .enqueue			= (void *)llc_enqueue,
+	       .dispatch		= (void *)llc_dispatch,
+	       .init_task		= (void *)llc_init_task,
+	       .init			= (void *)llc_init,
+	       .exit			= (void *)llc_exit,
+	       .name			= "llc");
@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <libgen.h>
+#include <dirent.h>
+#include <bpf/bpf.h>
+#include <scx/common.h>
+#include "scx_llc.h"
+#include "scx_llc.bpf.skel.h"
+
+const char help_fmt[] =
+"A cache topology aware FIFO sched_ext scheduler.\n"
+"\n"
+"See the top-level comment in .bpf.c for more details.\n"
+"\n"
+"Usage: %s [-s SLICE_US] [-v]\n"
+"\n"
+"  -s SLICE_US   Override slice duration\n"
+"  -v            Print libbpf debug messages\n"
+"  -h            Display this help and exit\n";
+
+static bool verbose;
+static volatile int exit_req;
+
+static int libbpf_print_fn(enum libbpf_print_level level, const char *format, va_list args)
+{
+	if (level == LIBBPF_DEBUG && !verbose)
+		return 0;
+	return vfprintf(stderr, format, args);
+}
+
+static void sigint_handler(int dummy)
+{
+	exit_req = 1;
+}
+
+/*
+ * Identify the LLC of @cpu by the first CPU sharing its highest level cache,
+ * or return -1 if the cache topology of @cpu isn't known.
+ */
+static int cpu_llc_leader(int cpu)
+{
+	int index, level, max_level = -1, leader = -1;
+	char path[128];
+	FILE *fp;
+
+	for (index = 0; ; index++) {
+		int first;
+
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/cache/index%d/level",
+			 cpu, index);
+		fp = fopen(path, "r");
+		if (!fp)
+			break;
+		if (fscanf(fp, "%d", &level) != 1)
+			level = -1;
+		fclose(fp);
+
+		if (level <= max_level)
+			continue;
+
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+			 cpu, index);
+		fp = fopen(path, "r");
+		if (!fp)
+			continue;
+		if (fscanf(fp, "%d", &first) == 1) {
+			max_level = level;
+			leader = first;
+		}
+		fclose(fp);
+	}
+
+	return leader;
+}
+
+/* the NUMA node of @cpu, 0 if unknown */
+static int cpu_node(int cpu)
+{
+	struct dirent *ent;
+	char path[64];
+	int node = 0;
+	DIR *dir;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	while ((ent = readdir(dir))) {
+		if (sscanf(ent->d_name, "node%d", &node) == 1)
+			break;
+	}
+	closedir(dir);
+
+	return node;
+}
+
+static void init_topology(struct scx_llc *skel)
+{
+	int nr_cpus = skel->rodata->nr_cpu_ids;
+	int leaders[LLC_MAX_LLCS];
+	int cpu, llc, leader;
+	__u32 nr_llcs = 0;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		leader = cpu_llc_leader(cpu);
+		if (leader < 0)
+			leader = 0;
+
+		for (llc = 0; llc < nr_llcs; llc++)
+			if (leaders[llc] == leader)
+				break;
+
+		if (llc == nr_llcs) {
+			if (nr_llcs == LLC_MAX_LLCS) {
+				fprintf(stderr, "Too many LLCs, merging CPU %d into LLC 0\n", cpu);
+				llc = 0;
+			} else {
+				leaders[nr_llcs++] = leader;
+				skel->rodata->llc_node[llc] = cpu_node(cpu);
+			}
+		}
+		skel->rodata->cpu_llc[cpu] = llc;
+	}
+
+	skel->rodata->nr_llcs = nr_llcs ? nr_llcs : 1;
+}
+
+static void read_stats(struct scx_llc *skel, __u64 *stats)
+{
+	int nr_cpus = libbpf_num_possible_cpus();
+	__u64 cnts[LLC_NR_STATS][nr_cpus];
+	__u32 idx;
+
+	memset(stats, 0, sizeof(stats[0]) * LLC_NR_STATS);
+
+	for (idx = 0; idx < LLC_NR_STATS; idx++) {
+		int ret, cpu;
+
+		ret = bpf_map_lookup_elem(bpf_map__fd(skel->maps.stats),
+					  &idx, cnts[idx]);
+		if (ret < 0)
+			continue;
+		for (cpu = 0; cpu < nr_cpus; cpu++)
+			stats[idx] += cnts[idx][cpu];
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct scx_llc *skel;
+	struct bpf_link *link;
+	__u64 ecode;
+	__s32 opt;
+
+	libbpf_set_print(libbpf_print_fn);
+	signal(SIGINT, sigint_handler);
+	signal(SIGTERM, sigint_handler);
+restart:
+	skel = SCX_OPS_OPEN(llc_ops, scx_llc);
+
+	skel->rodata->nr_cpu_ids = libbpf_num_possible_cpus();
+	if (skel->rodata->nr_cpu_ids > LLC_MAX_CPUS) {
+		fprintf(stderr, "Only %d CPUs are supported\n", LLC_MAX_CPUS);
+		return 1;
+	}
+
+	while ((opt = getopt(argc, argv, "s:vh")) != -1) {
+		switch (opt) {
+		case 's':
+			skel->rodata->slice_ns = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, help_fmt, basename(argv[0]));
+			return opt != 'h';
+		}
+	}
+
+	init_topology(skel);
+	printf("%u CPUs in %u LLCs\n", skel->rodata->nr_cpu_ids,
+	       skel->rodata->nr_llcs);
+
+	SCX_OPS_LOAD(skel, llc_ops, scx_llc, uei);
+	link = SCX_OPS_ATTACH(skel, llc_ops, scx_llc);
+
+	while (!exit_req && !UEI_EXITED(skel, uei)) {
+		__u64 stats[LLC_NR_STATS];
+
+		read_stats(skel, stats);
+		printf("local=%llu llc=%llu consume=%llu steal_node=%llu steal_remote=%llu\n",
+		       stats[LLC_STAT_LOCAL], stats[LLC_STAT_LLC],
+		       stats[LLC_STAT_CONSUME], stats[LLC_STAT_STEAL_NODE],
+		       stats[LLC_STAT_STEAL_REMOTE]);
+		fflush(stdout);
+		sleep(1);
+	}
+
+	bpf_link__destroy(link);
+	ecode = UEI_REPORT(skel, uei);
+	scx_llc__destroy(skel);
+
+	if (UEI_ECODE_RESTART(ecode))
+		goto restart;
+	return 0;
+}
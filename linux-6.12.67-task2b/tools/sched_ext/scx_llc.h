@@ -0,0 +1,18 @@
+#ifndef __SCX_EXAMPLE_LLC_H
+#define __SCX_EXAMPLE_LLC_H
+
+enum {
+	LLC_MAX_CPUS		= 1024,
+	LLC_MAX_LLCS		= 256,
+};
+
+enum llc_stat_idx {
+	LLC_STAT_LOCAL,		/* dispatched to an idle CPU from select_cpu() */
+	LLC_STAT_LLC,		/* queued on the LLC's DSQ */
+	LLC_STAT_CONSUME,	/* consumed from the CPU's own LLC */
+	LLC_STAT_STEAL_NODE,	/* stolen from a sibling LLC on the same node */
+	LLC_STAT_STEAL_REMOTE,	/* stolen from an LLC on another node */
+	LLC_NR_STATS,
+};
+
+#endif /* __SCX_EXAMPLE_LLC_H */
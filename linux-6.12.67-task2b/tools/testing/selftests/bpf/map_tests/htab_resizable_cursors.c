@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <bpf_util.h>
+#include <test_maps.h>
+
+/*
+ * Walk a BPF_F_RESIZABLE map with get_next_key and batch lookups while
+ * adding or removing enough other elements between the steps to make it
+ * grow or shrink. Every element present for the whole walk has to come up
+ * exactly once, the others at most once.
+ */
+
+#define MAX_ENTRIES	8192
+#define NR_STABLE	256	/* keys [0, NR_STABLE) stay in the map */
+#define NR_EXTRA	4096	/* keys [EXTRA_BASE, EXTRA_BASE + NR_EXTRA) */
+#define EXTRA_BASE	100000
+#define EXTRA_STEP	64	/* extra keys added/removed per cursor step */
+
+static unsigned char seen[EXTRA_BASE + NR_EXTRA];
+static __u32 keys[NR_STABLE + NR_EXTRA], values[NR_STABLE + NR_EXTRA];
+
+static int create_map(void)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts,
+		.map_flags = BPF_F_NO_PREALLOC | BPF_F_RESIZABLE,
+	);
+	int map_fd;
+
+	map_fd = bpf_map_create(BPF_MAP_TYPE_HASH, "htab_resizable",
+				sizeof(__u32), sizeof(__u32), MAX_ENTRIES,
+				&opts);
+	CHECK(map_fd < 0, "bpf_map_create()", "error:%s\n", strerror(errno));
+	return map_fd;
+}
+
+static void update_range(int map_fd, __u32 first, __u32 nr)
+{
+	__u32 key, value;
+	int err;
+
+	for (key = first; key < first + nr; key++) {
+		value = key;
+		err = bpf_map_update_elem(map_fd, &key, &value, BPF_ANY);
+		CHECK(err, "bpf_map_update_elem()", "key %u error:%s\n", key,
+		      strerror(errno));
+	}
+}
+
+static void delete_range(int map_fd, __u32 first, __u32 nr)
+{
+	__u32 key;
+	int err;
+
+	for (key = first; key < first + nr; key++) {
+		/* may have been handed out by lookup_and_delete already */
+		err = bpf_map_delete_elem(map_fd, &key);
+		CHECK(err && errno != ENOENT, "bpf_map_delete_elem()",
+		      "key %u error:%s\n", key, strerror(errno));
+	}
+}
+
+/* Make the map grow (@grow) or shrink a little more after each step */
+static void churn(int map_fd, bool grow, __u32 *nr_extra)
+{
+	__u32 nr = EXTRA_STEP;
+
+	if (grow) {
+		nr = NR_EXTRA - *nr_extra < nr ? NR_EXTRA - *nr_extra : nr;
+		update_range(map_fd, EXTRA_BASE + *nr_extra, nr);
+		*nr_extra += nr;
+	} else {
+		nr = *nr_extra < nr ? *nr_extra : nr;
+		*nr_extra -= nr;
+		delete_range(map_fd, EXTRA_BASE + *nr_extra, nr);
+	}
+}
+
+static void mark_seen(__u32 key)
+{
+	CHECK(key >= NR_STABLE && (key < EXTRA_BASE ||
+				   key >= EXTRA_BASE + NR_EXTRA),
+	      "cursor", "unexpected key %u\n", key);
+	CHECK(seen[key], "cursor", "key %u seen twice\n", key);
+	seen[key] = 1;
+}
+
+static void check_stable_seen(const char *name)
+{
+	__u32 key;
+
+	for (key = 0; key < NR_STABLE; key++)
+		CHECK(!seen[key], name, "key %u skipped\n", key);
+}
+
+static void test_get_next_key(bool grow)
+{
+	__u32 key, next_key, nr_extra = grow ? 0 : NR_EXTRA;
+	int map_fd, err;
+	void *prev = NULL;
+
+	map_fd = create_map();
+	update_range(map_fd, 0, NR_STABLE);
+	update_range(map_fd, EXTRA_BASE, nr_extra);
+	memset(seen, 0, sizeof(seen));
+
+	while (!(err = bpf_map_get_next_key(map_fd, prev, &next_key))) {
+		mark_seen(next_key);
+		key = next_key;
+		prev = &key;
+		churn(map_fd, grow, &nr_extra);
+	}
+	CHECK(errno != ENOENT, "bpf_map_get_next_key()", "error:%s\n",
+	      strerror(errno));
+	check_stable_seen("get_next_key");
+
+	close(map_fd);
+}
+
+static void test_lookup_batch(bool grow, bool do_delete)
+{
+	__u32 batch, count, step = 7, nr_extra = grow ? 0 : NR_EXTRA;
+	DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts);
+	int map_fd, err, i;
+	bool first = true;
+
+	map_fd = create_map();
+	update_range(map_fd, 0, NR_STABLE);
+	update_range(map_fd, EXTRA_BASE, nr_extra);
+	memset(seen, 0, sizeof(seen));
+
+	for (;;) {
+		count = step;
+		if (do_delete)
+			err = bpf_map_lookup_and_delete_batch(map_fd,
+							      first ? NULL : &batch,
+							      &batch, keys, values,
+							      &count, &opts);
+		else
+			err = bpf_map_lookup_batch(map_fd, first ? NULL : &batch,
+						   &batch, keys, values,
+						   &count, &opts);
+		/* a bucket not split up yet may not fit, retry it with more */
+		if (err && errno == ENOSPC && step < ARRAY_SIZE(keys)) {
+			step = step * 2 < ARRAY_SIZE(keys) ? step * 2 :
+							      ARRAY_SIZE(keys);
+			continue;
+		}
+		CHECK(err && errno != ENOENT, "lookup batch", "error:%s\n",
+		      strerror(errno));
+
+		for (i = 0; i < count; i++) {
+			CHECK(keys[i] != values[i], "lookup batch",
+			      "key %u value %u\n", keys[i], values[i]);
+			mark_seen(keys[i]);
+		}
+		if (err)
+			break;
+		churn(map_fd, grow, &nr_extra);
+		first = false;
+	}
+	check_stable_seen(do_delete ? "lookup_and_delete_batch" :
+				      "lookup_batch");
+
+	close(map_fd);
+}
+
+void test_htab_resizable_cursors(void)
+{
+	test_get_next_key(true);
+	test_get_next_key(false);
+	test_lookup_batch(true, false);
+	test_lookup_batch(false, false);
+	test_lookup_batch(false, true);
+	printf("test_%s:PASS\n", __func__);
+}
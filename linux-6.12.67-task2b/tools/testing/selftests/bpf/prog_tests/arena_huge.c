@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <test_progs.h>
+#include <sys/mman.h>
+#include <sys/user.h>
+#ifndef PAGE_SIZE /* on some archs it comes in sys/user.h */
+#include <unistd.h>
+#define PAGE_SIZE getpagesize()
+#endif
+
+/* PMD size with 4k pages, the chunk size of BPF_F_ARENA_HUGE on x86 and arm64 */
+#define CHUNK_SIZE	(2UL << 20)
+#define ARENA_SIZE	(2 * CHUNK_SIZE)
+
+static int create_arena(void)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts,
+		.map_flags = BPF_F_MMAPABLE | BPF_F_ARENA_HUGE,
+	);
+
+	return bpf_map_create(BPF_MAP_TYPE_ARENA, "arena_huge", 0, 0,
+			      ARENA_SIZE / PAGE_SIZE, &opts);
+}
+
+/* Reserve @size bytes of address space to pick fixed addresses from */
+static void *reserve(size_t size)
+{
+	return mmap(NULL, size, PROT_NONE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+}
+
+/* Without an address, the user mapping is aligned to the chunk size */
+static void test_align(void)
+{
+	void *area;
+	int fd;
+
+	fd = create_arena();
+	if (!ASSERT_GE(fd, 0, "create_arena"))
+		return;
+
+	area = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (!ASSERT_NEQ(area, MAP_FAILED, "mmap"))
+		goto out;
+	if (PAGE_SIZE == 4096)
+		ASSERT_EQ((unsigned long)area % CHUNK_SIZE, 0, "chunk aligned");
+	munmap(area, ARENA_SIZE);
+out:
+	close(fd);
+}
+
+/* MAP_FIXED gets exactly the address asked for, even if not chunk aligned */
+static void test_fixed(void)
+{
+	unsigned long addr;
+	void *res, *area;
+	int fd;
+
+	res = reserve(4 * ARENA_SIZE);
+	if (!ASSERT_NEQ(res, MAP_FAILED, "reserve"))
+		return;
+
+	addr = ((unsigned long)res + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE;
+	addr += PAGE_SIZE;
+	/* the arena must not cross a 4G boundary */
+	if ((addr >> 32) != ((addr + ARENA_SIZE - 1) >> 32))
+		addr += ARENA_SIZE;
+
+	fd = create_arena();
+	if (!ASSERT_GE(fd, 0, "create_arena"))
+		goto out_unmap;
+
+	area = mmap((void *)addr, ARENA_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_FIXED, fd, 0);
+	ASSERT_EQ((unsigned long)area, addr, "mmap fixed address");
+	close(fd);
+out_unmap:
+	munmap(res, 4 * ARENA_SIZE);
+}
+
+/* A fixed address that would make the arena cross 4G is refused */
+static void test_fixed_cross_4g(void)
+{
+	size_t size = (1UL << 32) + 2 * ARENA_SIZE;
+	unsigned long addr;
+	void *res, *area;
+	int fd;
+
+	res = reserve(size);
+	if (!ASSERT_NEQ(res, MAP_FAILED, "reserve"))
+		return;
+
+	addr = ((unsigned long)res + (1UL << 32) - 1) >> 32 << 32;
+	addr -= PAGE_SIZE;
+
+	fd = create_arena();
+	if (!ASSERT_GE(fd, 0, "create_arena"))
+		goto out_unmap;
+
+	area = mmap((void *)addr, ARENA_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_FIXED, fd, 0);
+	if (!ASSERT_EQ(area, MAP_FAILED, "mmap across 4G"))
+		munmap(area, ARENA_SIZE);
+	else
+		ASSERT_EQ(errno, EINVAL, "mmap across 4G errno");
+	close(fd);
+out_unmap:
+	munmap(res, size);
+}
+
+void test_arena_huge(void)
+{
+	if (test__start_subtest("align"))
+		test_align();
+	if (test__start_subtest("fixed"))
+		test_fixed();
+	if (test__start_subtest("fixed_cross_4g"))
+		test_fixed_cross_4g();
+}
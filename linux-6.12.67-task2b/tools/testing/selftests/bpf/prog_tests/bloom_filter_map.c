@@ -36,6 +36,15 @@ static void test_fail_cases(void)
 	if (!ASSERT_LT(fd, 0, "bpf_map_create bloom filter invalid max entries size"))
 		close(fd);
 
+	/* Invalid map_extra: only the blocked layout bit is defined above the
+	 * number of hash functions
+	 */
+	opts.map_extra = 0x20;
+	fd = bpf_map_create(BPF_MAP_TYPE_BLOOM_FILTER, NULL, 0, sizeof(value), 100, &opts);
+	if (!ASSERT_LT(fd, 0, "bpf_map_create bloom filter invalid map_extra"))
+		close(fd);
+	opts.map_extra = 0;
+
 	/* Bloom filter maps do not support BPF_F_NO_PREALLOC */
 	opts.map_flags = BPF_F_NO_PREALLOC;
 	fd = bpf_map_create(BPF_MAP_TYPE_BLOOM_FILTER, NULL, 0, sizeof(value), 100, &opts);
@@ -150,6 +159,47 @@ done:
 	close(inner_map_fd);
 }
 
+/* map_extra bit 4: all bits of a value fall into one 512 bit block */
+#define BLOOM_EXTRA_BLOCKED	0x10
+
+static void test_blocked_layout(const __u32 *rand_vals, __u32 nr_rand_vals)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts,
+		.map_extra = BLOOM_EXTRA_BLOCKED | 3,
+	);
+	__u32 i, val, nr_false_pos = 0;
+	int fd, err;
+
+	fd = bpf_map_create(BPF_MAP_TYPE_BLOOM_FILTER, NULL, 0, sizeof(*rand_vals),
+			    nr_rand_vals, &opts);
+	if (!ASSERT_GE(fd, 0, "bpf_map_create blocked bloom filter"))
+		return;
+
+	for (i = 0; i < nr_rand_vals; i++) {
+		err = bpf_map_update_elem(fd, NULL, &rand_vals[i], BPF_ANY);
+		if (!ASSERT_OK(err, "bpf_map_update_elem blocked bloom filter"))
+			goto done;
+	}
+
+	/* no false negatives */
+	for (i = 0; i < nr_rand_vals; i++) {
+		err = bpf_map_lookup_elem(fd, NULL, (void *)&rand_vals[i]);
+		if (!ASSERT_OK(err, "bpf_map_lookup_elem blocked bloom filter"))
+			goto done;
+	}
+
+	/* and not everything matches, values not pushed mostly miss */
+	for (i = 0; i < nr_rand_vals; i++) {
+		val = ~rand_vals[i];
+		if (!bpf_map_lookup_elem(fd, NULL, &val))
+			nr_false_pos++;
+	}
+	ASSERT_LT(nr_false_pos, nr_rand_vals / 4, "blocked bloom filter false positives");
+
+done:
+	close(fd);
+}
+
 static int setup_progs(struct bloom_filter_map **out_skel, __u32 **out_rand_vals,
 		       __u32 *out_nr_rand_vals)
 {
@@ -216,6 +266,7 @@ void test_bloom_filter_map(void)
 		return;
 
 	test_inner_map(skel, rand_vals, nr_rand_vals);
+	test_blocked_layout(rand_vals, nr_rand_vals);
 	free(rand_vals);
 
 	check_bloom(skel);
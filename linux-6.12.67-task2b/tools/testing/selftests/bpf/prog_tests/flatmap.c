@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+
+/*
+ * Tests for libbpf's open-addressing flatmap.
+ */
+#include "test_progs.h"
+#include "bpf/flatmap.h"
+#include <stddef.h>
+
+static size_t hash_fn(long k, void *ctx)
+{
+	return k;
+}
+
+static size_t collision_hash_fn(long k, void *ctx)
+{
+	return 0;
+}
+
+static bool equal_fn(long a, long b, void *ctx)
+{
+	return a == b;
+}
+
+#define ELEM_CNT 1000
+
+static void test_flatmap_generic(void)
+{
+	static long vals[ELEM_CNT];
+	struct flatmap_entry *entry;
+	long oldk, oldv, k, v;
+	struct flatmap *map;
+	size_t bkt, cnt;
+	int err, i;
+
+	map = flatmap__new(hash_fn, equal_fn, NULL);
+	if (!ASSERT_OK_PTR(map, "flatmap__new"))
+		return;
+
+	for (i = 0; i < ELEM_CNT; i++) {
+		k = i;
+		v = 1024 + i;
+
+		err = flatmap__update(map, k, v, &oldk, &oldv);
+		if (!ASSERT_EQ(err, -ENOENT, "flatmap__update"))
+			goto cleanup;
+
+		if (i % 2)
+			err = flatmap__add(map, k, v);
+		else
+			err = flatmap__set(map, k, v, &oldk, &oldv);
+		if (!ASSERT_OK(err, "elem_add"))
+			goto cleanup;
+		vals[i] = v;
+
+		if (!ASSERT_EQ(flatmap__add(map, k, v), -EEXIST, "elem_add_dup"))
+			goto cleanup;
+		if (!ASSERT_TRUE(flatmap__find(map, k, &oldv), "elem_find") ||
+		    !ASSERT_EQ(oldv, v, "elem_val"))
+			goto cleanup;
+		if (!ASSERT_EQ(flatmap__size(map), i + 1, "flatmap__size"))
+			goto cleanup;
+		if (!ASSERT_LE(flatmap__size(map), flatmap__capacity(map) * 7 / 8,
+			       "load_factor"))
+			goto cleanup;
+	}
+
+	/* update every third element */
+	for (i = 0; i < ELEM_CNT; i += 3) {
+		err = flatmap__update(map, i, 2 * i, &oldk, &oldv);
+		if (!ASSERT_OK(err, "elem_upd") ||
+		    !ASSERT_EQ(oldk, i, "old_key") ||
+		    !ASSERT_EQ(oldv, vals[i], "old_val"))
+			goto cleanup;
+		vals[i] = 2 * i;
+	}
+
+	cnt = 0;
+	flatmap__for_each_entry(map, entry, bkt) {
+		if (!ASSERT_LT(entry->key, ELEM_CNT, "iter_key") ||
+		    !ASSERT_EQ(entry->value, vals[entry->key], "iter_val"))
+			goto cleanup;
+		cnt++;
+	}
+	if (!ASSERT_EQ(cnt, ELEM_CNT, "iter_cnt"))
+		goto cleanup;
+
+	/* delete odd keys while iterating */
+	flatmap__for_each_entry(map, entry, bkt) {
+		if (!(entry->key & 1))
+			continue;
+		k = entry->key;
+		if (!ASSERT_TRUE(flatmap__delete(map, k, &oldk, &oldv), "elem_del") ||
+		    !ASSERT_EQ(oldk, k, "del_key") ||
+		    !ASSERT_EQ(oldv, vals[k], "del_val"))
+			goto cleanup;
+	}
+	if (!ASSERT_EQ(flatmap__size(map), ELEM_CNT / 2, "size_after_del"))
+		goto cleanup;
+
+	for (i = 0; i < ELEM_CNT; i++) {
+		bool found = flatmap__find(map, i, &oldv);
+
+		if (!ASSERT_EQ(found, !(i & 1), "find_after_del"))
+			goto cleanup;
+		if (found && !ASSERT_EQ(oldv, vals[i], "val_after_del"))
+			goto cleanup;
+	}
+
+cleanup:
+	flatmap__free(map);
+}
+
+static void test_flatmap_multimap(void)
+{
+	struct flatmap_entry *entry;
+	struct flatmap_iter it;
+	struct flatmap *map;
+	long found_msk;
+	size_t bkt;
+	int err, i;
+
+	/* force collisions, key i % 2 gets value 1 << i */
+	map = flatmap__new(collision_hash_fn, equal_fn, NULL);
+	if (!ASSERT_OK_PTR(map, "flatmap__new"))
+		return;
+
+	for (i = 0; i < 30; i++) {
+		err = flatmap__append(map, i % 2, 1L << i);
+		if (!ASSERT_OK(err, "elem_add"))
+			goto cleanup;
+	}
+	if (!ASSERT_EQ(flatmap__size(map), 30, "flatmap__size"))
+		goto cleanup;
+
+	found_msk = 0;
+	flatmap__for_each_entry(map, entry, bkt)
+		found_msk |= entry->value;
+	if (!ASSERT_EQ(found_msk, (1L << 30) - 1, "found_msk"))
+		goto cleanup;
+
+	found_msk = 0;
+	flatmap__for_each_key_entry(map, entry, it, 0)
+		found_msk |= entry->value;
+	if (!ASSERT_EQ(found_msk, 0x15555555L, "k0_values"))
+		goto cleanup;
+
+	found_msk = 0;
+	flatmap__for_each_key_entry(map, entry, it, 1)
+		found_msk |= entry->value;
+	if (!ASSERT_EQ(found_msk, 0x2aaaaaaaL, "k1_values"))
+		goto cleanup;
+
+	/* deleting one entry of a key keeps the others reachable */
+	if (!ASSERT_TRUE(flatmap__delete(map, 0, NULL, &found_msk), "elem_del"))
+		goto cleanup;
+	flatmap__for_each_key_entry(map, entry, it, 0)
+		found_msk |= entry->value;
+	if (!ASSERT_EQ(found_msk, 0x15555555L, "k0_after_del"))
+		goto cleanup;
+
+cleanup:
+	flatmap__free(map);
+}
+
+static void test_flatmap_tombstones(void)
+{
+	struct flatmap *map;
+	size_t cap;
+	int err, i;
+
+	map = flatmap__new(hash_fn, equal_fn, NULL);
+	if (!ASSERT_OK_PTR(map, "flatmap__new"))
+		return;
+
+	err = flatmap__reserve(map, 100);
+	if (!ASSERT_OK(err, "flatmap__reserve"))
+		goto cleanup;
+	if (!ASSERT_GE(flatmap__capacity(map) * 7 / 8, 100, "reserved_cap"))
+		goto cleanup;
+
+	/*
+	 * A sliding window of 100 keys leaves a trail of deleted slots. Once
+	 * the map has settled, they have to be reclaimed instead of growing
+	 * the map further.
+	 */
+	cap = 0;
+	for (i = 0; i < 100 * 1000; i++) {
+		if (i == 1000)
+			cap = flatmap__capacity(map);
+		err = flatmap__add(map, i, i);
+		if (!ASSERT_OK(err, "elem_add"))
+			goto cleanup;
+		if (i >= 99 && !ASSERT_TRUE(flatmap__delete(map, i - 99, NULL, NULL),
+					    "elem_del"))
+			goto cleanup;
+	}
+	ASSERT_EQ(flatmap__size(map), 99, "flatmap__size");
+	ASSERT_EQ(flatmap__capacity(map), cap, "flatmap__capacity");
+	ASSERT_TRUE(flatmap__find(map, i - 1, NULL), "elem_find");
+	ASSERT_FALSE(flatmap__find(map, i - 100, NULL), "elem_gone");
+
+cleanup:
+	flatmap__free(map);
+}
+
+static void test_flatmap_empty(void)
+{
+	struct flatmap_entry *entry;
+	struct flatmap_iter it;
+	struct flatmap *map;
+	size_t bkt;
+	long k = 0;
+
+	map = flatmap__new(hash_fn, equal_fn, NULL);
+	if (!ASSERT_OK_PTR(map, "flatmap__new"))
+		return;
+
+	ASSERT_EQ(flatmap__size(map), 0, "flatmap__size");
+	ASSERT_EQ(flatmap__capacity(map), 0, "flatmap__capacity");
+	ASSERT_FALSE(flatmap__find(map, k, NULL), "elem_find");
+	ASSERT_FALSE(flatmap__delete(map, k, NULL, NULL), "elem_del");
+	ASSERT_EQ(flatmap__update(map, k, 1, NULL, NULL), -ENOENT, "elem_upd");
+
+	flatmap__for_each_entry(map, entry, bkt) {
+		ASSERT_FAIL("unexpected iterated entry");
+		break;
+	}
+	flatmap__for_each_key_entry(map, entry, it, k) {
+		ASSERT_FAIL("unexpected key entry");
+		break;
+	}
+
+	flatmap__free(map);
+}
+
+void test_flatmap(void)
+{
+	if (test__start_subtest("generic"))
+		test_flatmap_generic();
+	if (test__start_subtest("multimap"))
+		test_flatmap_multimap();
+	if (test__start_subtest("tombstones"))
+		test_flatmap_tombstones();
+	if (test__start_subtest("empty"))
+		test_flatmap_empty();
+}
@@ -6,6 +6,7 @@ void test_stacktrace_build_id(void)
 {
 
 	int control_map_fd, stackid_hmap_fd, stackmap_fd, stack_amap_fd;
+	int stackid_cmap_fd, stackmap_compact_fd;
 	struct test_stacktrace_build_id *skel;
 	int err, stack_trace_len, build_id_size;
 	__u32 key, prev_key, val, duration = 0;
@@ -28,6 +29,8 @@ retry:
 	stackid_hmap_fd = bpf_map__fd(skel->maps.stackid_hmap);
 	stackmap_fd = bpf_map__fd(skel->maps.stackmap);
 	stack_amap_fd = bpf_map__fd(skel->maps.stack_amap);
+	stackid_cmap_fd = bpf_map__fd(skel->maps.stackid_cmap);
+	stackmap_compact_fd = bpf_map__fd(skel->maps.stackmap_compact);
 
 	if (CHECK_FAIL(system("dd if=/dev/urandom of=/dev/zero count=4 2> /dev/null")))
 		goto cleanup;
@@ -95,7 +98,23 @@ retry:
 	stack_trace_len = PERF_MAX_STACK_DEPTH *
 			  sizeof(struct bpf_stack_build_id);
 	err = compare_stack_ips(stackmap_fd, stack_amap_fd, stack_trace_len);
-	CHECK(err, "compare_stack_ips stackmap vs. stack_amap",
+	if (CHECK(err, "compare_stack_ips stackmap vs. stack_amap",
+		  "err %d errno %d\n", err, errno))
+		goto cleanup;
+
+	/* same for the resizable build ID map, which stores traces as they are */
+	err = compare_map_keys(stackid_cmap_fd, stackmap_compact_fd);
+	if (CHECK(err, "compare_map_keys stackid_cmap vs. stackmap_compact",
+		  "err %d errno %d\n", err, errno))
+		goto cleanup;
+
+	err = compare_map_keys(stackmap_compact_fd, stackid_cmap_fd);
+	if (CHECK(err, "compare_map_keys stackmap_compact vs. stackid_cmap",
+		  "err %d errno %d\n", err, errno))
+		goto cleanup;
+
+	err = compare_stack_ips(stackmap_fd, stackmap_compact_fd, stack_trace_len);
+	CHECK(err, "compare_stack_ips stackmap vs. stackmap_compact",
 	      "err %d errno %d\n", err, errno);
 
 cleanup:
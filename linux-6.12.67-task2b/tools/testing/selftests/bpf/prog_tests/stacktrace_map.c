@@ -4,6 +4,7 @@
 void test_stacktrace_map(void)
 {
 	int control_map_fd, stackid_hmap_fd, stackmap_fd, stack_amap_fd;
+	int stackid_cmap_fd, stackmap_compact_fd;
 	const char *prog_name = "oncpu";
 	int err, prog_fd, stack_trace_len;
 	const char *file = "./test_stacktrace_map.bpf.o";
@@ -41,6 +42,14 @@ void test_stacktrace_map(void)
 	if (CHECK_FAIL(stack_amap_fd < 0))
 		goto disable_pmu;
 
+	stackid_cmap_fd = bpf_find_map(__func__, obj, "stackid_cmap");
+	if (CHECK_FAIL(stackid_cmap_fd < 0))
+		goto disable_pmu;
+
+	stackmap_compact_fd = bpf_find_map(__func__, obj, "stackmap_compact");
+	if (CHECK_FAIL(stackmap_compact_fd < 0))
+		goto disable_pmu;
+
 	/* give some time for bpf program run */
 	sleep(1);
 
@@ -68,6 +77,23 @@ void test_stacktrace_map(void)
 		  "err %d errno %d\n", err, errno))
 		goto disable_pmu;
 
+	/* same for the compact stack map, whose lookups decode the traces */
+	err = compare_map_keys(stackid_cmap_fd, stackmap_compact_fd);
+	if (CHECK(err, "compare_map_keys stackid_cmap vs. stackmap_compact",
+		  "err %d errno %d\n", err, errno))
+		goto disable_pmu;
+
+	err = compare_map_keys(stackmap_compact_fd, stackid_cmap_fd);
+	if (CHECK(err, "compare_map_keys stackmap_compact vs. stackid_cmap",
+		  "err %d errno %d\n", err, errno))
+		goto disable_pmu;
+
+	/* both maps have the same size, so equal traces get equal ids */
+	err = compare_stack_ips(stackmap_fd, stackmap_compact_fd, stack_trace_len);
+	if (CHECK(err, "compare_stack_ips stackmap vs. stackmap_compact",
+		  "err %d errno %d\n", err, errno))
+		goto disable_pmu;
+
 disable_pmu:
 	bpf_link__destroy(link);
 close_prog:
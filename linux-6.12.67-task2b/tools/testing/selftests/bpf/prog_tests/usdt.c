@@ -299,6 +299,29 @@ static void subtest_multispec_usdt(void)
 	ASSERT_EQ(bss->usdt_100_called, 400, "usdt_400_called");
 	ASSERT_EQ(bss->usdt_100_sum, 400 * 400, "usdt_400_sum");
 
+	/* NULL provider matches test:usdt_400 all the same */
+	bpf_link__destroy(skel->links.usdt_100);
+	skel->links.usdt_100 = bpf_program__attach_usdt(skel->progs.usdt_100, -1,
+							"/proc/self/exe",
+							NULL, "usdt_400", NULL);
+	if (!ASSERT_OK_PTR(skel->links.usdt_100, "any_usdt_400_attach"))
+		goto cleanup;
+
+	trigger_400_usdts();
+
+	ASSERT_EQ(bss->usdt_100_called, 800, "any_usdt_400_called");
+	ASSERT_EQ(bss->usdt_100_sum, 2 * 400 * 400, "any_usdt_400_sum");
+
+	/* while NULL name takes in test:usdt_300 and its 300 specs as well */
+	bpf_link__destroy(skel->links.usdt_100);
+	skel->links.usdt_100 = bpf_program__attach_usdt(skel->progs.usdt_100, -1,
+							"/proc/self/exe",
+							"test", NULL, NULL);
+	err = -errno;
+	if (!ASSERT_ERR_PTR(skel->links.usdt_100, "test_any_bad_attach"))
+		goto cleanup;
+	ASSERT_EQ(err, -E2BIG, "test_any_attach_err");
+
 cleanup:
 	test_usdt__destroy(skel);
 }
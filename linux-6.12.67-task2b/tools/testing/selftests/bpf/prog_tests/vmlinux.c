@@ -14,15 +14,20 @@ static void nsleep()
 	(void)syscall(__NR_nanosleep, &ts, NULL);
 }
 
-void test_vmlinux(void)
+static void test_vmlinux_load(__u32 load_threads)
 {
+	LIBBPF_OPTS(bpf_object_open_opts, opts, .load_threads = load_threads);
 	int err;
 	struct test_vmlinux* skel;
 	struct test_vmlinux__bss *bss;
 
-	skel = test_vmlinux__open_and_load();
-	if (!ASSERT_OK_PTR(skel, "test_vmlinux__open_and_load"))
+	skel = test_vmlinux__open_opts(&opts);
+	if (!ASSERT_OK_PTR(skel, "test_vmlinux__open_opts"))
 		return;
+
+	err = test_vmlinux__load(skel);
+	if (!ASSERT_OK(err, "test_vmlinux__load"))
+		goto cleanup;
 	bss = skel->bss;
 
 	err = test_vmlinux__attach(skel);
@@ -41,3 +46,12 @@ void test_vmlinux(void)
 cleanup:
 	test_vmlinux__destroy(skel);
 }
+
+void test_vmlinux(void)
+{
+	if (test__start_subtest("sequential"))
+		test_vmlinux_load(0);
+	/* CO-RE relocations and program loads spread over threads */
+	if (test__start_subtest("load_threads"))
+		test_vmlinux_load(4);
+}
@@ -39,6 +39,22 @@ struct {
 	__type(value, stack_trace_t);
 } stack_amap SEC(".maps");
 
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, 16384);
+	__type(key, __u32);
+	__type(value, __u32);
+} stackid_cmap SEC(".maps");
+
+/* same as stackmap, but with buckets allocated on demand */
+struct {
+	__uint(type, BPF_MAP_TYPE_STACK_TRACE);
+	__uint(max_entries, 128);
+	__uint(map_flags, BPF_F_STACK_BUILD_ID | BPF_F_RESIZABLE);
+	__type(key, __u32);
+	__type(value, stack_trace_t);
+} stackmap_compact SEC(".maps");
+
 SEC("kprobe/urandom_read_iter")
 int oncpu(struct pt_regs *args)
 {
@@ -61,6 +77,10 @@ int oncpu(struct pt_regs *args)
 				      BPF_F_USER_STACK | BPF_F_USER_BUILD_ID);
 	}
 
+	key = bpf_get_stackid(args, &stackmap_compact, BPF_F_USER_STACK);
+	if ((int)key >= 0)
+		bpf_map_update_elem(&stackid_cmap, &key, &val, 0);
+
 	return 0;
 }
 
@@ -38,6 +38,22 @@ struct {
 	__type(value, stack_trace_t);
 } stack_amap SEC(".maps");
 
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, 16384);
+	__type(key, __u32);
+	__type(value, __u32);
+} stackid_cmap SEC(".maps");
+
+/* same as stackmap, but with compressed buckets allocated on demand */
+struct {
+	__uint(type, BPF_MAP_TYPE_STACK_TRACE);
+	__uint(max_entries, 16384);
+	__uint(map_flags, BPF_F_RESIZABLE);
+	__type(key, __u32);
+	__type(value, stack_trace_t);
+} stackmap_compact SEC(".maps");
+
 /* taken from /sys/kernel/tracing/events/sched/sched_switch/format */
 struct sched_switch_args {
 	unsigned long long pad;
@@ -70,6 +86,10 @@ int oncpu(struct sched_switch_args *ctx)
 			bpf_get_stack(ctx, stack_p, max_len, 0);
 	}
 
+	key = bpf_get_stackid(ctx, &stackmap_compact, 0);
+	if ((int)key >= 0)
+		bpf_map_update_elem(&stackid_cmap, &key, &val, 0);
+
 	return 0;
 }
 
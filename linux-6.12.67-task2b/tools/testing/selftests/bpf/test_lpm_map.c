@@ -205,15 +205,48 @@ static void test_lpm_order(void)
 	tlpm_clear(l2);
 }
 
-static void test_lpm_map(int keysize)
+static __u64 map_memlock(int map)
 {
-	LIBBPF_OPTS(bpf_map_create_opts, opts, .map_flags = BPF_F_NO_PREALLOC);
+	char path[64], line[128];
+	__u64 memlock = 0;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", map);
+	f = fopen(path, "r");
+	assert(f);
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "memlock: %llu", &memlock) == 1)
+			break;
+	fclose(f);
+	return memlock;
+}
+
+/* The multibit index is built by a worker shortly after the last change to
+ * the trie. Once it is in place, it adds to the memory usage of @map over
+ * that of @plain, which holds the same prefixes without an index.
+ */
+static void wait_lpm_index(int map, int plain)
+{
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		if (map_memlock(map) > map_memlock(plain))
+			return;
+		usleep(1000);
+	}
+	assert(!"multibit index not built");
+}
+
+static void test_lpm_map(int keysize, __u32 map_flags)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts,
+		    .map_flags = BPF_F_NO_PREALLOC | map_flags);
 	volatile size_t n_matches, n_matches_after_delete;
 	size_t i, j, n_nodes, n_lookups;
 	struct tlpm_node *t, *list = NULL;
 	struct bpf_lpm_trie_key_u8 *key;
 	uint8_t *data, *value;
-	int r, map;
+	int r, map, plain = -1;
 
 	/* Compare behavior of tlpm vs. bpf-lpm. Create a randomized set of
 	 * prefixes and insert it into both tlpm and bpf-lpm. Then run some
@@ -241,6 +274,14 @@ static void test_lpm_map(int keysize)
 			     &opts);
 	assert(map >= 0);
 
+	if (map_flags & BPF_F_LPM_MULTIBIT) {
+		opts.map_flags = BPF_F_NO_PREALLOC;
+		plain = bpf_map_create(BPF_MAP_TYPE_LPM_TRIE, NULL,
+				       sizeof(*key) + keysize, keysize + 1,
+				       4096, &opts);
+		assert(plain >= 0);
+	}
+
 	for (i = 0; i < n_nodes; ++i) {
 		for (j = 0; j < keysize; ++j)
 			value[j] = rand() & 0xff;
@@ -252,8 +293,16 @@ static void test_lpm_map(int keysize)
 		memcpy(key->data, value, keysize);
 		r = bpf_map_update_elem(map, key, value, 0);
 		assert(!r);
+		if (plain >= 0) {
+			r = bpf_map_update_elem(plain, key, value, 0);
+			assert(!r);
+		}
 	}
 
+	/* make sure the lookups below go through the multibit index */
+	if (plain >= 0)
+		wait_lpm_index(map, plain);
+
 	for (i = 0; i < n_lookups; ++i) {
 		for (j = 0; j < keysize; ++j)
 			data[j] = rand() & 0xff;
@@ -288,9 +337,15 @@ static void test_lpm_map(int keysize)
 		memcpy(key->data, list->key, keysize);
 		r = bpf_map_delete_elem(map, key);
 		assert(!r);
+		if (plain >= 0) {
+			r = bpf_map_delete_elem(plain, key);
+			assert(!r);
+		}
 		list = tlpm_delete(list, list->key, list->n_bits);
 		assert(list);
 	}
+	if (plain >= 0)
+		wait_lpm_index(map, plain);
 	for (i = 0; i < n_lookups; ++i) {
 		for (j = 0; j < keysize; ++j)
 			data[j] = rand() & 0xff;
@@ -313,6 +368,8 @@ static void test_lpm_map(int keysize)
 	}
 
 	close(map);
+	if (plain >= 0)
+		close(plain);
 	tlpm_clear(list);
 
 	/* With 255 random nodes in the map, we are pretty likely to match
@@ -785,7 +842,11 @@ int main(void)
 
 	/* Test with 8, 16, 24, 32, ... 128 bit prefix length */
 	for (i = 1; i <= 16; ++i)
-		test_lpm_map(i);
+		test_lpm_map(i, 0);
+
+	/* And again with the multibit index */
+	for (i = 1; i <= 16; ++i)
+		test_lpm_map(i, BPF_F_LPM_MULTIBIT);
 
 	test_lpm_ipaddr();
 	test_lpm_delete();
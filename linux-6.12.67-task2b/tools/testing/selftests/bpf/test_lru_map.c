@@ -848,6 +848,54 @@ static void test_lru_sanity8(int map_type, int map_flags)
 	printf("Pass\n");
 }
 
+/* Test second chance eviction of a BPF_F_LRU_CLOCK map */
+static void test_lru_clock(int map_type)
+{
+	unsigned long long key, value[nr_cpus];
+	unsigned int map_size = 128;
+	int lru_map_fd;
+
+	printf("%s (map_type:%d map_flags:0x%X): ", __func__, map_type,
+	       BPF_F_LRU_CLOCK);
+
+	lru_map_fd = create_map(map_type, BPF_F_LRU_CLOCK, map_size);
+	assert(lru_map_fd != -1);
+
+	value[0] = 1234;
+
+	/* fill the map */
+	for (key = 0; key < map_size; key++)
+		assert(!bpf_map_update_elem(lru_map_fd, &key, value,
+					    BPF_NOEXIST));
+
+	/* reference the first half */
+	for (key = 0; key < map_size / 2; key++)
+		assert(!bpf_map_lookup_elem_with_ref_bit(lru_map_fd, key,
+							 value));
+
+	/* one lap of the hand evicts exactly the unreferenced half */
+	for (key = map_size; key < map_size + map_size / 2; key++)
+		assert(!bpf_map_update_elem(lru_map_fd, &key, value,
+					    BPF_NOEXIST));
+
+	for (key = 0; key < map_size + map_size / 2; key++) {
+		int ret = bpf_map_lookup_elem(lru_map_fd, &key, value);
+
+		if (key >= map_size / 2 && key < map_size)
+			assert(ret == -ENOENT);
+		else
+			assert(!ret && value[0] == 1234);
+	}
+
+	/* not valid without the common LRU */
+	assert(create_map(map_type, BPF_F_LRU_CLOCK | BPF_F_NO_COMMON_LRU,
+			  map_size) == -1);
+
+	close(lru_map_fd);
+
+	printf("Pass\n");
+}
+
 int main(int argc, char **argv)
 {
 	int map_types[] = {BPF_MAP_TYPE_LRU_HASH,
@@ -883,5 +931,8 @@ int main(int argc, char **argv)
 		}
 	}
 
+	for (t = 0; t < ARRAY_SIZE(map_types); t++)
+		test_lru_clock(map_types[t]);
+
 	return 0;
 }
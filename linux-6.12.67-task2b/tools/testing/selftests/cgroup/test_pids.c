@@ -7,6 +7,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "../kselftest.h"
@@ -128,6 +129,83 @@ cleanup:
 	return ret;
 }
 
+/*
+ * This test checks that pids.current stays exact across a hierarchy while
+ * children fork and exit, and that a limit set afterwards is still enforced.
+ */
+static int test_pids_current(const char *root)
+{
+	int ret = KSFT_FAIL;
+	char *cg_parent = NULL, *cg_child = NULL;
+	int pids[4];
+	int i, n = 0;
+
+	cg_parent = cg_name(root, "pids_parent");
+	cg_child = cg_name(cg_parent, "pids_child");
+	if (!cg_parent || !cg_child)
+		goto cleanup;
+
+	if (cg_create(cg_parent))
+		goto cleanup;
+	if (cg_write(cg_parent, "cgroup.subtree_control", "+pids"))
+		goto cleanup;
+	if (cg_create(cg_child))
+		goto cleanup;
+
+	if (cg_enter_current(cg_child))
+		goto cleanup;
+
+	for (n = 0; n < ARRAY_SIZE(pids); n++) {
+		pids[n] = cg_run_nowait(cg_child, run_pause, NULL);
+		if (pids[n] < 0)
+			goto cleanup;
+	}
+
+	if (cg_read_long(cg_child, "pids.current") != n + 1)
+		goto cleanup;
+	if (cg_read_long(cg_parent, "pids.current") != n + 1)
+		goto cleanup;
+
+	for (; n > 0; n--) {
+		if (kill(pids[n - 1], SIGINT))
+			goto cleanup;
+		if (waitpid(pids[n - 1], NULL, 0) < 0)
+			goto cleanup;
+	}
+
+	if (cg_read_long(cg_child, "pids.current") != 1)
+		goto cleanup;
+	if (cg_read_long(cg_parent, "pids.current") != 1)
+		goto cleanup;
+
+	if (cg_write(cg_parent, "pids.max", "2"))
+		goto cleanup;
+
+	pids[n] = cg_run_nowait(cg_child, run_pause, NULL);
+	if (pids[n] < 0)
+		goto cleanup;
+	n++;
+
+	if (cg_run_nowait(cg_child, run_success, NULL) != -1 || errno != EAGAIN)
+		goto cleanup;
+
+	ret = KSFT_PASS;
+
+cleanup:
+	for (i = 0; i < n; i++) {
+		kill(pids[i], SIGINT);
+		waitpid(pids[i], NULL, 0);
+	}
+	cg_enter_current(root);
+	if (cg_child)
+		cg_destroy(cg_child);
+	if (cg_parent)
+		cg_destroy(cg_parent);
+	free(cg_child);
+	free(cg_parent);
+
+	return ret;
+}
 
 
 #define T(x) { x, #x }
@@ -137,6 +215,7 @@ struct pids_test {
 } tests[] = {
 	T(test_pids_max),
 	T(test_pids_events),
+	T(test_pids_current),
 };
 #undef T
 
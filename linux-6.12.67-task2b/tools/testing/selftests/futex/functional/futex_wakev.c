@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * futex_wakev() test: one call wakes the waiters of several futexes,
+ * limited to the requested number per futex, and bad input wakes nobody.
+ */
+
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include "futextest.h"
+#include "futex2test.h"
+#include "logging.h"
+
+#define TEST_NAME "futex-wakev"
+#define WAKE_WAIT_US 10000
+#define NR_FUTEXES 8
+#define WAITERS_PER_FUTEX 2
+
+static u_int32_t futexes[NR_FUTEXES];
+static struct futex_waitv wakev[NR_FUTEXES];
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+void *waiterfn(void *arg)
+{
+	struct timespec to = { .tv_sec = 1 };
+
+	futex_wait((futex_t *)arg, 0, &to, FUTEX_PRIVATE_FLAG);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t waiters[NR_FUTEXES * WAITERS_PER_FUTEX];
+	int res, ret = RET_PASS;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "cht:v:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	ksft_print_header();
+	ksft_set_plan(3);
+	ksft_print_msg("%s: Test FUTEX_WAKEV\n",
+		       basename(argv[0]));
+
+	if (futex_wakev(NULL, 0, 0) < 0 && errno == ENOSYS)
+		ksft_exit_skip("futex_wakev not supported\n");
+
+	for (i = 0; i < NR_FUTEXES * WAITERS_PER_FUTEX; i++) {
+		if (pthread_create(&waiters[i], NULL, waiterfn,
+				   &futexes[i % NR_FUTEXES]))
+			error("pthread_create failed\n", errno);
+	}
+
+	usleep(WAKE_WAIT_US);
+
+	/* Wake one waiter on each futex */
+	for (i = 0; i < NR_FUTEXES; i++) {
+		wakev[i].uaddr = (uintptr_t)&futexes[i];
+		wakev[i].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+		wakev[i].val = 1;
+		wakev[i].__reserved = 0;
+	}
+
+	res = futex_wakev(wakev, NR_FUTEXES, 0);
+	if (res != NR_FUTEXES) {
+		ksft_test_result_fail("futex_wakev returned: %d %s\n",
+				      res < 0 ? errno : res,
+				      res < 0 ? strerror(errno) : "");
+		ret = RET_FAIL;
+	} else {
+		ksft_test_result_pass("futex_wakev one per futex\n");
+	}
+
+	/* A bad entry fails the call before anyone is woken */
+	wakev[NR_FUTEXES - 1].uaddr = 1;
+	res = futex_wakev(wakev, NR_FUTEXES, 0);
+	if (res != -1 || errno != EINVAL) {
+		ksft_test_result_fail("futex_wakev with an unaligned address returned: %d\n",
+				      res);
+		ret = RET_FAIL;
+	} else {
+		ksft_test_result_pass("futex_wakev with an unaligned address\n");
+	}
+	wakev[NR_FUTEXES - 1].uaddr = (uintptr_t)&futexes[NR_FUTEXES - 1];
+
+	/* Wake everyone left */
+	for (i = 0; i < NR_FUTEXES; i++)
+		wakev[i].val = WAITERS_PER_FUTEX;
+
+	res = futex_wakev(wakev, NR_FUTEXES, 0);
+	if (res != NR_FUTEXES * (WAITERS_PER_FUTEX - 1)) {
+		ksft_test_result_fail("futex_wakev returned: %d, expecting %d\n",
+				      res, NR_FUTEXES * (WAITERS_PER_FUTEX - 1));
+		ret = RET_FAIL;
+	} else {
+		ksft_test_result_pass("futex_wakev remaining waiters\n");
+	}
+
+	for (i = 0; i < NR_FUTEXES * WAITERS_PER_FUTEX; i++)
+		pthread_join(waiters[i], NULL);
+
+	ksft_print_cnts();
+	return ret;
+}
@@ -20,3 +20,19 @@ static inline int futex_waitv(volatile struct futex_waitv *waiters, unsigned lon
 {
 	return syscall(__NR_futex_waitv, waiters, nr_waiters, flags, timo, clockid);
 }
+
+#ifndef __NR_futex_wakev
+#define __NR_futex_wakev 465
+#endif
+
+/**
+ * futex_wakev - Wake waiters on multiple futexes
+ * @waiters:    Array of futexes, val is the number of waiters to wake
+ * @nr_waiters: Length of waiters array
+ * @flags: Operation flags
+ */
+static inline int futex_wakev(struct futex_waitv *waiters, unsigned long nr_waiters,
+			      unsigned long flags)
+{
+	return syscall(__NR_futex_wakev, waiters, nr_waiters, flags);
+}
@@ -192,6 +192,65 @@ int fill_msgque(struct msgque_data *msgque)
 	return 0;
 }
 
+/*
+ * Typed receives must return the oldest message of the requested type,
+ * or for a negative msgtyp the oldest one of the lowest type.
+ */
+int check_typed_receive(key_t key)
+{
+	static const long types[] = { 3, 1, 2, 1, 3 };
+	static const struct {
+		long msgtyp;
+		int index;
+	} expect[] = {
+		{ 3, 0 }, { -2, 1 }, { -2, 3 }, { -2, 2 }, { 3, 4 },
+	};
+	struct msg1 msgbuf;
+	int msq_id, i, ret;
+
+	msq_id = msgget(key, IPC_CREAT | IPC_EXCL | 0666);
+	if (msq_id == -1) {
+		printf("Can't create queue: %d\n", -errno);
+		return -errno;
+	}
+
+	for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		msgbuf.mtype = types[i];
+		msgbuf.mtext[0] = i;
+		if (msgsnd(msq_id, &msgbuf.mtype, 1, IPC_NOWAIT) != 0) {
+			printf("msgsnd failed (%m)\n");
+			ret = -errno;
+			goto destroy;
+		}
+	}
+
+	for (i = 0; i < sizeof(expect) / sizeof(expect[0]); i++) {
+		ret = msgrcv(msq_id, &msgbuf.mtype, MAX_MSG_SIZE,
+			     expect[i].msgtyp, IPC_NOWAIT);
+		if (ret != 1 || msgbuf.mtext[0] != expect[i].index) {
+			printf("msgrcv(%ld) returned message %d, expected %d\n",
+			       expect[i].msgtyp, ret == 1 ? msgbuf.mtext[0] : -1,
+			       expect[i].index);
+			ret = -EINVAL;
+			goto destroy;
+		}
+	}
+
+	ret = 0;
+	if (msgrcv(msq_id, &msgbuf.mtype, MAX_MSG_SIZE, 0, IPC_NOWAIT) != -1 ||
+	    errno != ENOMSG) {
+		printf("Queue not empty after typed receives\n");
+		ret = -EINVAL;
+	}
+
+destroy:
+	if (msgctl(msq_id, IPC_RMID, NULL)) {
+		printf("Failed to destroy queue: %d\n", -errno);
+		return -errno;
+	}
+	return ret;
+}
+
 int main(int argc, char **argv)
 {
 	int msg, pid, err;
@@ -242,6 +301,12 @@ int main(int argc, char **argv)
 		printf("Failed to test queue: %d\n", err);
 		goto err_out;
 	}
+
+	err = check_typed_receive(msgque.key);
+	if (err) {
+		printf("Failed typed receive test: %d\n", err);
+		goto err_out;
+	}
 	ksft_exit_pass();
 
 err_destroy:
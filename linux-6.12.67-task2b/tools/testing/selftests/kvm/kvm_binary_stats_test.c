@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/mman.h>
 
 #include "test_util.h"
 
@@ -170,6 +171,40 @@ static void stats_test(int stats_fd)
 	TEST_ASSERT(fcntl(stats_fd, F_GETFD) == -1, "Stats fd not freed");
 }
 
+/* Check the read-only snapshot mapping of a vCPU stats fd. */
+static void stats_mmap_test(int stats_fd)
+{
+	struct kvm_stats_header header;
+	struct kvm_stats_desc *stats_desc, *pdesc;
+	struct kvm_stats_mmap *map;
+	size_t size_data = 0;
+	void *wmap;
+	int i;
+
+	read_stats_header(stats_fd, &header);
+	stats_desc = read_stats_descriptors(stats_fd, &header);
+	for (i = 0; i < header.num_desc; ++i) {
+		pdesc = get_stats_descriptor(stats_desc, i, &header);
+		size_data = max(size_data, pdesc->offset + pdesc->size * sizeof(u64));
+	}
+
+	map = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, stats_fd, 0);
+	TEST_ASSERT(map != MAP_FAILED, "mmap of vCPU stats fd failed, errno %d",
+		    errno);
+	TEST_ASSERT(map->size >= size_data,
+		    "Mapped stats size %u smaller than data size %lu",
+		    map->size, size_data);
+	TEST_ASSERT(!(READ_ONCE(map->seq) & 1),
+		    "Mapped stats left in the middle of an update");
+
+	wmap = mmap(NULL, getpagesize(), PROT_READ | PROT_WRITE, MAP_SHARED,
+		    stats_fd, 0);
+	TEST_ASSERT(wmap == MAP_FAILED, "vCPU stats fd mapped writable");
+
+	munmap(map, getpagesize());
+	free(stats_desc);
+}
+
 #define DEFAULT_NUM_VM		4
 #define DEFAULT_NUM_VCPU	4
 
@@ -248,6 +283,7 @@ int main(int argc, char *argv[])
 			vcpu_stats_fds[j] = vcpu_get_stats_fd(vcpus[i * max_vcpu + j]);
 			stats_test(dup(vcpu_stats_fds[j]));
 			stats_test(vcpu_get_stats_fd(vcpus[i * max_vcpu + j]));
+			stats_mmap_test(vcpu_stats_fds[j]);
 		}
 
 		/*
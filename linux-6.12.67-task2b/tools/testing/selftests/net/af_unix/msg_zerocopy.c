@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/errqueue.h>
+#include <sys/socket.h>
+
+#include "../../kselftest_harness.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY	5
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+
+#define BUF_SIZE	(64 * 1024)
+#define NR_SENDS	4
+
+FIXTURE(msg_zerocopy)
+{
+	int fd[2];
+	char *buf;
+};
+
+FIXTURE_SETUP(msg_zerocopy)
+{
+	int i, ret;
+
+	ret = socketpair(AF_UNIX, SOCK_STREAM, 0, self->fd);
+	ASSERT_EQ(0, ret);
+
+	self->buf = malloc(BUF_SIZE);
+	ASSERT_NE(NULL, self->buf);
+
+	for (i = 0; i < BUF_SIZE; i++)
+		self->buf[i] = i * 7;
+}
+
+FIXTURE_TEARDOWN(msg_zerocopy)
+{
+	free(self->buf);
+	close(self->fd[0]);
+	close(self->fd[1]);
+}
+
+static void recv_all(struct __test_metadata *_metadata, int fd,
+		     const char *expected, int len)
+{
+	char *buf = malloc(len);
+	int ret, off = 0;
+
+	ASSERT_NE(NULL, buf);
+
+	while (off < len) {
+		ret = recv(fd, buf + off, len - off, 0);
+		ASSERT_LT(0, ret);
+		off += ret;
+	}
+
+	ASSERT_EQ(0, memcmp(buf, expected, len));
+	free(buf);
+}
+
+/* Wait for all completions, they may be coalesced into fewer notifications. */
+static void recv_completions(struct __test_metadata *_metadata, int fd,
+			     unsigned int nr)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+	unsigned int next = 0, tries = 0;
+
+	while (next < nr) {
+		struct msghdr msg = {
+			.msg_control = control,
+			.msg_controllen = sizeof(control),
+		};
+		struct sock_extended_err *serr;
+		struct cmsghdr *cmsg;
+		int ret;
+
+		ret = recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+		if (ret == -1 && errno == EAGAIN && ++tries < 1000) {
+			usleep(1000);
+			continue;
+		}
+		ASSERT_EQ(0, ret);
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		ASSERT_NE(NULL, cmsg);
+		serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+		ASSERT_EQ(SO_EE_ORIGIN_ZEROCOPY, serr->ee_origin);
+		ASSERT_EQ(0, serr->ee_errno);
+
+		/* ee_info..ee_data is the range of completed sends */
+		ASSERT_EQ(next, serr->ee_info);
+		ASSERT_LE(serr->ee_info, serr->ee_data);
+		next = serr->ee_data + 1;
+	}
+
+	ASSERT_EQ(nr, next);
+}
+
+TEST_F(msg_zerocopy, setsockopt)
+{
+	int val = 1, ret;
+	socklen_t len = sizeof(val);
+
+	ret = setsockopt(self->fd[0], SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val));
+	ASSERT_EQ(0, ret);
+
+	val = 0;
+	ret = getsockopt(self->fd[0], SOL_SOCKET, SO_ZEROCOPY, &val, &len);
+	ASSERT_EQ(0, ret);
+	ASSERT_EQ(1, val);
+
+	val = 2;
+	ret = setsockopt(self->fd[0], SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val));
+	ASSERT_EQ(-1, ret);
+	ASSERT_EQ(EINVAL, errno);
+}
+
+TEST_F(msg_zerocopy, send)
+{
+	int i, val = 1, ret;
+
+	ret = setsockopt(self->fd[0], SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val));
+	ASSERT_EQ(0, ret);
+
+	for (i = 0; i < NR_SENDS; i++) {
+		ret = send(self->fd[0], self->buf, BUF_SIZE,
+			   MSG_ZEROCOPY | MSG_DONTWAIT);
+		ASSERT_EQ(BUF_SIZE, ret);
+
+		/* the peer reads the pages of the sender in place */
+		recv_all(_metadata, self->fd[1], self->buf, BUF_SIZE);
+	}
+
+	recv_completions(_metadata, self->fd[0], NR_SENDS);
+}
+
+TEST_F(msg_zerocopy, no_sockopt)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+	struct msghdr msg = {
+		.msg_control = control,
+		.msg_controllen = sizeof(control),
+	};
+	int ret;
+
+	/* without SO_ZEROCOPY the flag is ignored and nothing is reported */
+	ret = send(self->fd[0], self->buf, BUF_SIZE, MSG_ZEROCOPY | MSG_DONTWAIT);
+	ASSERT_EQ(BUF_SIZE, ret);
+	recv_all(_metadata, self->fd[1], self->buf, BUF_SIZE);
+
+	ret = recvmsg(self->fd[0], &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+	ASSERT_EQ(-1, ret);
+	ASSERT_EQ(EAGAIN, errno);
+}
+
+TEST_HARNESS_MAIN
@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -9,6 +11,8 @@
 #include <string.h>
 #include <time.h>
 #include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 
 #include <libmnl/libmnl.h>
 #include <linux/netfilter.h>
@@ -18,6 +22,7 @@
 struct options {
 	bool count_packets;
 	bool gso_enabled;
+	bool ring;
 	int verbose;
 	unsigned int queue_num;
 	unsigned int timeout;
@@ -25,12 +30,15 @@ struct options {
 	uint32_t delay_ms;
 };
 
+#define RING_FRAME_SIZE	2048
+#define RING_FRAME_NR	64
+
 static unsigned int queue_stats[5];
 static struct options opts;
 
 static void help(const char *p)
 {
-	printf("Usage: %s [-c|-v [-vv] ] [-t timeout] [-q queue_num] [-Qdst_queue ] [ -d ms_delay ] [-G]\n", p);
+	printf("Usage: %s [-c|-v [-vv] ] [-t timeout] [-q queue_num] [-Qdst_queue ] [ -d ms_delay ] [-G] [-R]\n", p);
 }
 
 static int parse_attr_cb(const struct nlattr *attr, void *data)
@@ -267,6 +275,113 @@ static void sleep_ms(uint32_t delay)
 	nanosleep(&ts, NULL);
 }
 
+/* Deliver through a /dev/nfqueue ring attached to the queue bound on @nl */
+static int ring_mainloop(struct mnl_socket *nl)
+{
+	struct nfq_ring_req req = {
+		.queue_num = opts.queue_num,
+		.portid = mnl_socket_get_portid(nl),
+		.frame_size = RING_FRAME_SIZE,
+		.frame_nr = RING_FRAME_NR,
+	};
+	size_t page = sysconf(_SC_PAGESIZE), vr_off, size;
+	struct nfq_ring_verdict *verdicts;
+	uint32_t head, tail, vr_head = 0;
+	struct nfq_ring_hdr *hdr;
+	struct pollfd pfd;
+	char *area;
+	int fd, ret;
+
+	fd = open("/dev/nfqueue", O_RDWR);
+	if (fd < 0) {
+		perror("open /dev/nfqueue");
+		exit(EXIT_FAILURE);
+	}
+
+	/* a queue bound by another socket can't be taken over */
+	req.portid++;
+	if (ioctl(fd, NFQ_RING_IOC_SETUP, &req) == 0 || errno != EPERM) {
+		fprintf(stderr, "ring setup for foreign portid: %s\n",
+			strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	req.portid--;
+
+	if (ioctl(fd, NFQ_RING_IOC_SETUP, &req)) {
+		perror("NFQ_RING_IOC_SETUP");
+		exit(EXIT_FAILURE);
+	}
+
+	vr_off = (page + RING_FRAME_SIZE * RING_FRAME_NR + page - 1) & ~(page - 1);
+	size = (vr_off + RING_FRAME_NR * sizeof(*verdicts) + page - 1) & ~(page - 1);
+	area = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (area == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+	hdr = (struct nfq_ring_hdr *)area;
+	verdicts = (struct nfq_ring_verdict *)(area + hdr->vr_off);
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	for (;;) {
+		/* poll also consumes the verdicts posted so far */
+		ret = poll(&pfd, 1, opts.timeout ? opts.timeout * 1000 : -1);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			exit(EXIT_FAILURE);
+		}
+		if (ret == 0)
+			break;
+		if (pfd.revents & POLLERR) {
+			fprintf(stderr, "ring detached\n");
+			exit(EXIT_FAILURE);
+		}
+
+		head = __atomic_load_n(&hdr->rx_head, __ATOMIC_ACQUIRE);
+		for (tail = hdr->rx_tail; tail != head; tail++) {
+			struct nfq_ring_frame *frame;
+			struct nfq_ring_verdict *v;
+
+			frame = (struct nfq_ring_frame *)(area + hdr->rx_off +
+				(tail & (RING_FRAME_NR - 1)) * RING_FRAME_SIZE);
+			if (frame->hook >= 5) {
+				fprintf(stderr, "Unknown hook %d\n", frame->hook);
+				exit(EXIT_FAILURE);
+			}
+
+			if (opts.verbose > 0)
+				printf("packet hook=%u, hwproto 0x%x\n",
+				       frame->hook, ntohs(frame->hw_protocol));
+			if (opts.count_packets)
+				queue_stats[frame->hook]++;
+			if (opts.delay_ms)
+				sleep_ms(opts.delay_ms);
+
+			v = &verdicts[vr_head & (RING_FRAME_NR - 1)];
+			memset(v, 0, sizeof(*v));
+			v->id = frame->id;
+			v->verdict = opts.verdict;
+			__atomic_store_n(&hdr->vr_head, ++vr_head, __ATOMIC_RELEASE);
+		}
+		/* verdicts don't refer to frames, release them right away */
+		__atomic_store_n(&hdr->rx_tail, tail, __ATOMIC_RELEASE);
+
+		if (ioctl(fd, NFQ_RING_IOC_VERDICT)) {
+			perror("NFQ_RING_IOC_VERDICT");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	munmap(area, size);
+	close(fd);
+
+	return 0;
+}
+
 static int mainloop(void)
 {
 	unsigned int buflen = 64 * 1024 + MNL_SOCKET_BUFFER_SIZE;
@@ -285,6 +400,13 @@ static int mainloop(void)
 	nl = open_queue();
 	portid = mnl_socket_get_portid(nl);
 
+	if (opts.ring) {
+		ret = ring_mainloop(nl);
+		mnl_socket_close(nl);
+		free(buf);
+		return ret;
+	}
+
 	for (;;) {
 		uint32_t id;
 
@@ -329,7 +451,7 @@ static void parse_opts(int argc, char **argv)
 {
 	int c;
 
-	while ((c = getopt(argc, argv, "chvt:q:Q:d:G")) != -1) {
+	while ((c = getopt(argc, argv, "chvt:q:Q:d:GR")) != -1) {
 		switch (c) {
 		case 'c':
 			opts.count_packets = true;
@@ -366,6 +488,9 @@ static void parse_opts(int argc, char **argv)
 		case 'G':
 			opts.gso_enabled = false;
 			break;
+		case 'R':
+			opts.ring = true;
+			break;
 		case 'v':
 			opts.verbose++;
 			break;
@@ -0,0 +1,106 @@
+#!/bin/bash
+#
+# Check that a run of header-matching rules gives the same result with
+# nf_tables.jit enabled as when it is interpreted.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+sfx=$(mktemp -u "XXXXXXXX")
+ns0="ns0-$sfx"
+jit_param=/sys/module/nf_tables/parameters/jit
+
+if ! nft --version > /dev/null 2>&1; then
+	echo "SKIP: Could not run test without nft tool"
+	exit $ksft_skip
+fi
+
+modprobe -q nf_tables
+if [ ! -w "$jit_param" ]; then
+	echo "SKIP: nf_tables built without CONFIG_NF_TABLES_JIT"
+	exit $ksft_skip
+fi
+jit_saved=$(cat "$jit_param")
+
+cleanup()
+{
+	ip netns del "$ns0"
+	echo "$jit_saved" > "$jit_param"
+}
+
+ip netns add "$ns0"
+ip -net "$ns0" link set lo up
+ip -net "$ns0" addr add 127.0.0.1 dev lo
+
+trap cleanup EXIT
+
+# All rules but the last one can be compiled, so they make up one run. The
+# ip6 rules use 16 byte compares, the inverted one can't match ::1.
+load_ruleset()
+{
+	ip netns exec "$ns0" nft -f /dev/stdin <<EOF
+flush ruleset
+table inet filter {
+	chain input {
+		type filter hook input priority 0; policy accept;
+
+		ip saddr 10.9.9.9 counter accept comment "saddr"
+		meta l4proto udp counter accept comment "udp"
+		ip6 saddr dead::1 counter accept comment "saddr6"
+		ip6 daddr != ::1 meta l4proto ipv6-icmp counter accept comment "daddr6"
+		icmp type echo-reply counter accept comment "reply"
+		icmp type echo-request counter accept comment "request"
+		icmpv6 type echo-request counter accept comment "request6"
+		counter comment "rest"
+	}
+}
+EOF
+}
+
+ret=0
+
+check_counter()
+{
+	local comment="$1"
+	local want="packets $2 "
+
+	if ! ip netns exec "$ns0" nft list chain inet filter input |
+	     grep "comment \"$comment\"" | grep -q "$want"; then
+		echo "FAIL: $comment, want \"$want\", got"
+		ip netns exec "$ns0" nft list chain inet filter input |
+			grep "comment \"$comment\""
+		ret=1
+	fi
+}
+
+run_test()
+{
+	local jit="$1"
+
+	# takes effect on the next commit
+	echo "$jit" > "$jit_param"
+	if ! load_ruleset; then
+		echo "SKIP: Could not add test ruleset"
+		exit $ksft_skip
+	fi
+
+	ip netns exec "$ns0" ping -q -c 1 127.0.0.1 > /dev/null
+	ip netns exec "$ns0" ping -q -6 -c 1 ::1 > /dev/null
+
+	check_counter saddr 0
+	check_counter udp 0
+	check_counter saddr6 0
+	check_counter daddr6 0
+	check_counter reply 1
+	check_counter request 1
+	check_counter request6 1
+	check_counter rest 1
+
+	if [ $ret -eq 0 ]; then
+		echo "OK: counters at expected values with jit=$jit"
+	fi
+}
+
+run_test N
+run_test Y
+
+exit $ret
@@ -225,11 +225,12 @@ nf_queue_wait()
 test_queue()
 {
 	local expected="$1"
+	local ring="$2"
 	local last=""
 
 	# spawn nf_queue listeners
-	ip netns exec "$nsrouter" ./nf_queue -c -q 0 -t $timeout > "$TMPFILE0" &
-	ip netns exec "$nsrouter" ./nf_queue -c -q 1 -t $timeout > "$TMPFILE1" &
+	ip netns exec "$nsrouter" ./nf_queue -c -q 0 -t $timeout $ring > "$TMPFILE0" &
+	ip netns exec "$nsrouter" ./nf_queue -c -q 1 -t $timeout $ring > "$TMPFILE1" &
 
 	busywait "$BUSYWAIT_TIMEOUT" nf_queue_wait "$nsrouter" 0
 	busywait "$BUSYWAIT_TIMEOUT" nf_queue_wait "$nsrouter" 1
@@ -256,7 +257,7 @@ test_queue()
 		fi
 	done
 
-	echo "PASS: Expected and received $last"
+	echo "PASS: Expected and received $last${ring:+ through the ring}"
 }
 
 listener_ready()
@@ -628,6 +629,13 @@ load_counter_ruleset 10
 # so we expect that userspace program receives 10 packets.
 test_queue 10
 
+# same, delivered through /dev/nfqueue instead of netlink.
+if [ -c /dev/nfqueue ]; then
+	test_queue 10 -R
+else
+	echo "SKIP: /dev/nfqueue not available"
+fi
+
 # same.  We queue to a second program as well.
 load_ruleset "filter2" 20
 test_queue 20
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Builds the scx_llc example scheduler so that it can be run against a fake
+ * topology set up by userspace, and adds a syscall program to drive its idle
+ * CPU selection directly.
+ */
+
+#include "../../../sched_ext/scx_llc.bpf.c"
+#include "llc_steal_test.h"
+
+enum pick_dist {
+	PICK_LLC,
+	PICK_NODE,
+	PICK_REMOTE,
+};
+
+/* pick idle CPUs for @args->pid from @args->prev_cpu until there are none */
+SEC("syscall")
+int pick_idle_syscall(struct pick_idle_args *args)
+{
+	u32 prev_llc = cpu_to_llc(args->prev_cpu), llc;
+	u32 nr_llc = 0, nr_node = 0, nr_remote = 0, nr_inversions = 0;
+	enum pick_dist dist, max_dist = PICK_LLC;
+	struct task_struct *p;
+	s32 cpu, i;
+
+	p = bpf_task_from_pid(args->pid);
+	if (!p)
+		return -ESRCH;
+
+	bpf_for(i, 0, nr_cpu_ids) {
+		cpu = pick_idle_cpu(p, args->prev_cpu);
+		if (cpu < 0)
+			break;
+
+		llc = cpu_to_llc(cpu);
+		if (llc == prev_llc) {
+			dist = PICK_LLC;
+			nr_llc++;
+		} else if (llc_to_node(llc) == llc_to_node(prev_llc)) {
+			dist = PICK_NODE;
+			nr_node++;
+		} else {
+			dist = PICK_REMOTE;
+			nr_remote++;
+		}
+
+		if (dist < max_dist)
+			nr_inversions++;
+		else
+			max_dist = dist;
+	}
+
+	bpf_task_release(p);
+
+	/* the picked CPUs only show up as idle again once they go through idle */
+	bpf_for(cpu, 0, nr_cpu_ids)
+		scx_bpf_kick_cpu(cpu, SCX_KICK_IDLE);
+
+	args->nr_llc = nr_llc;
+	args->nr_node = nr_node;
+	args->nr_remote = nr_remote;
+	args->nr_inversions = nr_inversions;
+
+	return 0;
+}
@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#define _GNU_SOURCE
+#include <bpf/bpf.h>
+#include <pthread.h>
+#include <sched.h>
+#include <scx/common.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../../../sched_ext/scx_llc.h"
+#include "llc_steal.bpf.skel.h"
+#include "llc_steal_test.h"
+#include "scx_test.h"
+
+/*
+ * CPU n is in fake LLC n % NR_LLCS, and LLC n is on node n % NR_NODES. The
+ * LLCs of the two nodes are interleaved so that the next LLC in index order is
+ * always on the other node, and stealing that ignored nodes would show up as
+ * remote steals.
+ */
+#define NR_LLCS		4
+#define NR_NODES	2
+#define PICK_TRIES	10
+
+static volatile bool stop_workers;
+
+static enum scx_test_status setup(void **ctx)
+{
+	int cpu, llc, nr_cpus = libbpf_num_possible_cpus();
+	struct llc_steal *skel;
+
+	if (nr_cpus > LLC_MAX_CPUS) {
+		fprintf(stderr, "Only %d CPUs are supported\n", LLC_MAX_CPUS);
+		return SCX_TEST_SKIP;
+	}
+
+	if (nr_cpus < NR_LLCS || sysconf(_SC_NPROCESSORS_ONLN) < NR_LLCS) {
+		fprintf(stderr, "Stealing needs at least %d online CPUs\n", NR_LLCS);
+		return SCX_TEST_SKIP;
+	}
+
+	skel = SCX_OPS_OPEN(llc_ops, llc_steal);
+	SCX_FAIL_IF(!skel, "Failed to open skel");
+
+	skel->rodata->nr_cpu_ids = nr_cpus;
+	skel->rodata->nr_llcs = NR_LLCS;
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		skel->rodata->cpu_llc[cpu] = cpu % NR_LLCS;
+	for (llc = 0; llc < NR_LLCS; llc++)
+		skel->rodata->llc_node[llc] = llc % NR_NODES;
+
+	SCX_FAIL_IF(llc_steal__load(skel), "Failed to load skel");
+	*ctx = skel;
+
+	return SCX_TEST_PASS;
+}
+
+/*
+ * Pick idle CPUs for a sleeping child from a CPU on the other node than the
+ * one the test runs on, so that all three distances have idle CPUs. CPUs may
+ * wake up and go idle again behind our back, so only one of a few tries has
+ * to see the picks ordered.
+ */
+static enum scx_test_status test_pick_idle(struct llc_steal *skel)
+{
+	int prog_fd = bpf_program__fd(skel->progs.pick_idle_syscall);
+	int i, err = 0, this_cpu, prev_cpu;
+	struct pick_idle_args args = {};
+	cpu_set_t mask, saved;
+	pid_t pid;
+
+	LIBBPF_OPTS(bpf_test_run_opts, topts,
+		.ctx_in = &args,
+		.ctx_size_in = sizeof(args),
+		.ctx_out = &args,
+		.ctx_size_out = sizeof(args),
+	);
+
+	/* stay on one CPU so that it's known not to be idle */
+	SCX_FAIL_IF(sched_getaffinity(0, sizeof(saved), &saved),
+		    "Failed to get affinity");
+	this_cpu = sched_getcpu();
+	CPU_ZERO(&mask);
+	CPU_SET(this_cpu, &mask);
+	SCX_FAIL_IF(sched_setaffinity(0, sizeof(mask), &mask),
+		    "Failed to set affinity");
+
+	/* the child inherits the affinity, give it all CPUs back */
+	pid = fork();
+	if (pid == 0) {
+		sched_setaffinity(0, sizeof(saved), &saved);
+		pause();
+		exit(0);
+	}
+
+	/* the next LLC is on the other node, and has at least one CPU */
+	prev_cpu = (this_cpu + 1) % NR_LLCS;
+
+	for (i = 0; pid > 0 && i < PICK_TRIES; i++) {
+		args = (struct pick_idle_args){
+			.pid = pid,
+			.prev_cpu = prev_cpu,
+		};
+
+		err = bpf_prog_test_run_opts(prog_fd, &topts);
+		if (err || topts.retval)
+			break;
+
+		if (!args.nr_inversions && args.nr_llc && args.nr_node &&
+		    args.nr_remote)
+			break;
+
+		usleep(10000);
+	}
+
+	sched_setaffinity(0, sizeof(saved), &saved);
+	SCX_FAIL_IF(pid < 0, "Failed to fork child");
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+
+	SCX_EQ(err, 0);
+	SCX_EQ(topts.retval, 0);
+	SCX_EQ(args.nr_inversions, 0);
+	SCX_GT(args.nr_llc, 0);
+	SCX_GT(args.nr_node, 0);
+	SCX_GT(args.nr_remote, 0);
+
+	return SCX_TEST_PASS;
+}
+
+/* the counts of @idx summed over all CPUs */
+static __u64 read_stat(struct llc_steal *skel, __u32 idx)
+{
+	int cpu, nr_cpus = libbpf_num_possible_cpus();
+	__u64 cnts[nr_cpus], sum = 0;
+
+	if (bpf_map_lookup_elem(bpf_map__fd(skel->maps.stats), &idx, cnts))
+		return 0;
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		sum += cnts[cpu];
+
+	return sum;
+}
+
+/* spin and sleep in turns so that wakeups keep unbalancing the LLCs */
+static void *worker(void *arg)
+{
+	volatile unsigned long i;
+
+	while (!stop_workers) {
+		for (i = 0; i < 100000; i++)
+			;
+		usleep(100);
+	}
+
+	return NULL;
+}
+
+/*
+ * With workers on every CPU all the LLCs have tasks queued most of the time,
+ * so a CPU out of work should find it in the other LLC of its node in most
+ * cases before it has to go to the other node.
+ */
+static enum scx_test_status test_steal(struct llc_steal *skel)
+{
+	int i, nr_started, nr_workers = 2 * sysconf(_SC_NPROCESSORS_ONLN);
+	__u64 steal_node, steal_remote;
+	pthread_t workers[nr_workers];
+
+	steal_node = read_stat(skel, LLC_STAT_STEAL_NODE);
+	steal_remote = read_stat(skel, LLC_STAT_STEAL_REMOTE);
+
+	stop_workers = false;
+	for (i = 0; i < nr_workers; i++)
+		if (pthread_create(&workers[i], NULL, worker, NULL))
+			break;
+
+	if (i == nr_workers)
+		sleep(1);
+
+	stop_workers = true;
+	nr_started = i;
+	for (i = 0; i < nr_started; i++)
+		pthread_join(workers[i], NULL);
+
+	SCX_EQ(nr_started, nr_workers);
+
+	steal_node = read_stat(skel, LLC_STAT_STEAL_NODE) - steal_node;
+	steal_remote = read_stat(skel, LLC_STAT_STEAL_REMOTE) - steal_remote;
+
+	SCX_GT(read_stat(skel, LLC_STAT_CONSUME), 0);
+	SCX_GT(steal_node, 0);
+	SCX_GT(steal_node, steal_remote);
+
+	return SCX_TEST_PASS;
+}
+
+static enum scx_test_status run(void *ctx)
+{
+	struct llc_steal *skel = ctx;
+	enum scx_test_status status;
+	struct bpf_link *link;
+
+	link = bpf_map__attach_struct_ops(skel->maps.llc_ops);
+	SCX_FAIL_IF(!link, "Failed to attach scheduler");
+
+	status = test_pick_idle(skel);
+	if (status == SCX_TEST_PASS)
+		status = test_steal(skel);
+
+	if (status == SCX_TEST_PASS && UEI_EXITED(skel, uei)) {
+		SCX_ERR("Scheduler exited early");
+		status = SCX_TEST_FAIL;
+	}
+
+	bpf_link__destroy(link);
+
+	return status;
+}
+
+static void cleanup(void *ctx)
+{
+	struct llc_steal *skel = ctx;
+
+	llc_steal__destroy(skel);
+}
+
+struct scx_test llc_steal = {
+	.name = "llc_steal",
+	.description = "Verify that scx_llc picks idle CPUs and steals work "
+		       "from its own LLC first, then its node, then other nodes",
+	.setup = setup,
+	.run = run,
+	.cleanup = cleanup,
+};
+REGISTER_SCX_TEST(&llc_steal)
@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#ifndef __LLC_STEAL_TEST_H__
+#define __LLC_STEAL_TEST_H__
+
+/*
+ * pick_idle_syscall() input and output. The picks are counted by how far they
+ * are from @prev_cpu, and an inversion is a pick closer to @prev_cpu than an
+ * earlier one.
+ */
+struct pick_idle_args {
+	s32 pid;
+	s32 prev_cpu;
+	u32 nr_llc;
+	u32 nr_node;
+	u32 nr_remote;
+	u32 nr_inversions;
+};
+
+#endif  // # __LLC_STEAL_TEST_H__
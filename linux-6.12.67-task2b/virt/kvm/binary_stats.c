@@ -9,6 +9,8 @@
 #include <linux/kvm.h>
 #include <linux/errno.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
 
 /**
  * kvm_stats_read() - Common function to read from the binary statistics
@@ -142,3 +144,69 @@ ssize_t kvm_stats_read(char *id, const struct kvm_stats_header *header,
 	*offset = pos;
 	return len;
 }
+
+/**
+ * kvm_stats_mmap_update() - Refresh the mapped snapshot of the stats data.
+ *
+ * @map: the mapped snapshot
+ * @stats: start address of stats data block for a vm or a vcpu
+ * @size_stats: the size of stats data block pointed by @stats
+ *
+ * There must be only one updater of @map at a time, for a vcpu this is the
+ * thread running it.
+ */
+void kvm_stats_mmap_update(struct kvm_stats_mmap *map, const void *stats,
+			   size_t size_stats)
+{
+	u32 seq = map->seq;
+
+	WRITE_ONCE(map->seq, seq + 1);
+	smp_wmb();
+	memcpy(map->data, stats, size_stats);
+	smp_wmb();
+	WRITE_ONCE(map->seq, seq + 2);
+}
+
+/**
+ * kvm_stats_mmap() - Common function to map the binary statistics file
+ * descriptor.
+ *
+ * @mapp: where the snapshot of the stats is kept, allocated on first mmap
+ * @stats: start address of stats data block for a vm or a vcpu
+ * @size_stats: the size of stats data block pointed by @stats
+ * @vma: the mapping requested by userspace
+ *
+ * The stats themselves live in the middle of struct kvm or kvm_vcpu and
+ * cannot be mapped as they are; userspace gets a read-only view of a
+ * separate struct kvm_stats_mmap snapshot instead, which the owner of the
+ * stats refreshes with kvm_stats_mmap_update(). The snapshot is freed with
+ * the vm or vcpu.
+ *
+ * Return: 0 on success, negative errno otherwise
+ */
+int kvm_stats_mmap(struct kvm_stats_mmap **mapp, const void *stats,
+		   size_t size_stats, struct vm_area_struct *vma)
+{
+	struct kvm_stats_mmap *map = READ_ONCE(*mapp);
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	if (!map) {
+		map = vmalloc_user(sizeof(*map) + size_stats);
+		if (!map)
+			return -ENOMEM;
+		map->size = size_stats;
+		kvm_stats_mmap_update(map, stats, size_stats);
+
+		if (cmpxchg(mapp, NULL, map)) {
+			vfree(map);
+			map = READ_ONCE(*mapp);
+		}
+	}
+
+	vm_flags_clear(vma, VM_MAYWRITE);
+	return remap_vmalloc_range(vma, map, 0);
+}
@@ -50,7 +50,44 @@ static bool kvm_dirty_ring_full(struct kvm_dirty_ring *ring)
 	return kvm_dirty_ring_used(ring) >= ring->size;
 }
 
-static void kvm_reset_dirty_gfn(struct kvm *kvm, u32 slot, u64 offset, u64 mask)
+/*
+ * Reset masks are collected and applied under a single acquisition of the
+ * MMU lock, instead of taking it once per mask of 64 GFNs.  The batch is
+ * small enough to bound the lock hold time.
+ */
+#define KVM_DIRTY_RESET_BATCH	16
+
+struct kvm_dirty_reset_batch {
+	unsigned int nr;
+	struct {
+		struct kvm_memory_slot *memslot;
+		u64 offset;
+		u64 mask;
+	} entries[KVM_DIRTY_RESET_BATCH];
+};
+
+static void kvm_reset_dirty_flush(struct kvm *kvm,
+				  struct kvm_dirty_reset_batch *batch)
+{
+	unsigned int i;
+
+	if (!batch->nr)
+		return;
+
+	KVM_MMU_LOCK(kvm);
+	for (i = 0; i < batch->nr; i++)
+		kvm_arch_mmu_enable_log_dirty_pt_masked(kvm,
+							batch->entries[i].memslot,
+							batch->entries[i].offset,
+							batch->entries[i].mask);
+	KVM_MMU_UNLOCK(kvm);
+
+	batch->nr = 0;
+}
+
+static void kvm_reset_dirty_gfn(struct kvm *kvm,
+				struct kvm_dirty_reset_batch *batch,
+				u32 slot, u64 offset, u64 mask)
 {
 	struct kvm_memory_slot *memslot;
 	int as_id, id;
@@ -69,9 +106,11 @@ static void kvm_reset_dirty_gfn(struct kvm *kvm, u32 slot, u64 offset, u64 mask)
 	if (!memslot || (offset + __fls(mask)) >= memslot->npages)
 		return;
 
-	KVM_MMU_LOCK(kvm);
-	kvm_arch_mmu_enable_log_dirty_pt_masked(kvm, memslot, offset, mask);
-	KVM_MMU_UNLOCK(kvm);
+	batch->entries[batch->nr].memslot = memslot;
+	batch->entries[batch->nr].offset = offset;
+	batch->entries[batch->nr].mask = mask;
+	if (++batch->nr == KVM_DIRTY_RESET_BATCH)
+		kvm_reset_dirty_flush(kvm, batch);
 }
 
 int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, int index, u32 size)
@@ -111,8 +150,11 @@ int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring)
 	unsigned long mask;
 	int count = 0;
 	struct kvm_dirty_gfn *entry;
+	struct kvm_dirty_reset_batch batch;
 	bool first_round = true;
 
+	batch.nr = 0;
+
 	/* This is only needed to make compilers happy */
 	cur_slot = cur_offset = mask = 0;
 
@@ -150,14 +192,15 @@ int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring)
 				continue;
 			}
 		}
-		kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+		kvm_reset_dirty_gfn(kvm, &batch, cur_slot, cur_offset, mask);
 		cur_slot = next_slot;
 		cur_offset = next_offset;
 		mask = 1;
 		first_round = false;
 	}
 
-	kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+	kvm_reset_dirty_gfn(kvm, &batch, cur_slot, cur_offset, mask);
+	kvm_reset_dirty_flush(kvm, &batch);
 
 	/*
 	 * The request KVM_REQ_DIRTY_RING_SOFT_FULL will be cleared
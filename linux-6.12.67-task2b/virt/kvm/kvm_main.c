@@ -213,10 +213,19 @@ void vcpu_load(struct kvm_vcpu *vcpu)
 }
 EXPORT_SYMBOL_GPL(vcpu_load);
 
+static void kvm_vcpu_update_stats_map(struct kvm_vcpu *vcpu)
+{
+	struct kvm_stats_mmap *map = READ_ONCE(vcpu->stats_map);
+
+	if (map)
+		kvm_stats_mmap_update(map, &vcpu->stat, sizeof(vcpu->stat));
+}
+
 void vcpu_put(struct kvm_vcpu *vcpu)
 {
 	preempt_disable();
 	kvm_arch_vcpu_put(vcpu);
+	kvm_vcpu_update_stats_map(vcpu);
 	preempt_notifier_unregister(&vcpu->preempt_notifier);
 	__this_cpu_write(kvm_running_vcpu, NULL);
 	preempt_enable();
@@ -507,6 +516,7 @@ static void kvm_vcpu_destroy(struct kvm_vcpu *vcpu)
 {
 	kvm_arch_vcpu_destroy(vcpu);
 	kvm_dirty_ring_free(&vcpu->dirty_ring);
+	vfree(vcpu->stats_map);
 
 	/*
 	 * No need for rcu_read_lock as VCPU_RUN is the only place that changes
@@ -4355,6 +4365,14 @@ static ssize_t kvm_vcpu_stats_read(struct file *file, char __user *user_buffer,
 			sizeof(vcpu->stat), user_buffer, size, offset);
 }
 
+static int kvm_vcpu_stats_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct kvm_vcpu *vcpu = file->private_data;
+
+	return kvm_stats_mmap(&vcpu->stats_map, &vcpu->stat,
+			      sizeof(vcpu->stat), vma);
+}
+
 static int kvm_vcpu_stats_release(struct inode *inode, struct file *file)
 {
 	struct kvm_vcpu *vcpu = file->private_data;
@@ -4366,6 +4384,7 @@ static int kvm_vcpu_stats_release(struct inode *inode, struct file *file)
 static const struct file_operations kvm_vcpu_stats_fops = {
 	.owner = THIS_MODULE,
 	.read = kvm_vcpu_stats_read,
+	.mmap = kvm_vcpu_stats_mmap,
 	.release = kvm_vcpu_stats_release,
 	.llseek = noop_llseek,
 };
@@ -6397,6 +6416,7 @@ static void kvm_sched_out(struct preempt_notifier *pn,
 		WRITE_ONCE(vcpu->ready, true);
 	}
 	kvm_arch_vcpu_put(vcpu);
+	kvm_vcpu_update_stats_map(vcpu);
 	__this_cpu_write(kvm_running_vcpu, NULL);
 }
 
@@ -0,0 +1,79 @@
+/*
+ * cpulog.h - Binary CPU usage log shared by monitor.c and decode.c
+ *
+ * The log is a header followed by a stream of records.  All integers
+ * are unsigned LEB128 varints (7 bits per byte, low bits first).
+ *
+ * Header:
+ *   "TAML"             magic
+ *   version            one byte, CPULOG_VERSION
+ *   clk_tck            clock ticks per second of the CPU times below
+ *   start_ms           wall-clock time the log started (ms since the epoch)
+ *
+ * Records, each introduced by one tag byte:
+ *   'U' uid, name_len, name[name_len]
+ *       Defines the name of a UID.  Written once, before the first tick
+ *       that mentions the UID.
+ *   'T' interval_ms, count, { uid_delta, cpu_ticks } * count
+ *       CPU time used per user since the previous tick.  interval_ms is
+ *       relative to the previous tick (or to start_ms for the first one).
+ *       Users are listed by ascending UID and only when they used CPU;
+ *       each UID is stored as the difference to the previous one.
+ */
+
+#ifndef CPULOG_H
+#define CPULOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define CPULOG_MAGIC "TAML"
+#define CPULOG_MAGIC_LEN 4
+#define CPULOG_VERSION 1
+
+#define CPULOG_REC_USER 'U'
+#define CPULOG_REC_TICK 'T'
+
+/*
+ * Write an unsigned varint
+ * Returns 0 on success, -1 on write error
+ */
+static inline int cpulog_put_varint(FILE *fp, uint64_t v)
+{
+    unsigned char buf[10];
+    int len = 0;
+
+    do {
+        buf[len] = v & 0x7f;
+        v >>= 7;
+        if (v)
+            buf[len] |= 0x80;
+        len++;
+    } while (v);
+
+    return fwrite(buf, 1, len, fp) == (size_t)len ? 0 : -1;
+}
+
+/*
+ * Read an unsigned varint
+ * Returns 0 on success, -1 on end of file or a malformed value
+ */
+static inline int cpulog_get_varint(FILE *fp, uint64_t *v)
+{
+    uint64_t val = 0;
+    int shift = 0;
+    int c;
+
+    do {
+        c = fgetc(fp);
+        if (c == EOF || shift > 63)
+            return -1;
+        val |= (uint64_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    *v = val;
+    return 0;
+}
+
+#endif /* CPULOG_H */
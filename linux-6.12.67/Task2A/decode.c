@@ -0,0 +1,231 @@
+/*
+ * decode.c - CPU Usage Log Decoder
+ *
+ * Reads a binary log written by "monitor -o" and prints the same ranked
+ * per-user table as the monitor, for any time window of the log.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "cpulog.h"
+
+/* Maximum number of users to track */
+#define MAX_USERS 1024
+
+/* Structure to store per-user CPU time */
+typedef struct {
+    uint64_t uid;
+    char username[64];
+    unsigned long long cpu_time;  /* in clock ticks */
+} user_cpu_t;
+
+static user_cpu_t users[MAX_USERS];
+static int num_users = 0;
+
+/* Clock ticks per second, from the log header */
+static uint64_t clk_tck;
+
+/*
+ * Find or create user entry
+ */
+static user_cpu_t *find_or_create_user(uint64_t uid)
+{
+    int i;
+
+    for (i = 0; i < num_users; i++) {
+        if (users[i].uid == uid)
+            return &users[i];
+    }
+
+    if (num_users >= MAX_USERS)
+        return NULL;
+
+    users[num_users].uid = uid;
+    users[num_users].cpu_time = 0;
+    snprintf(users[num_users].username, sizeof(users[num_users].username),
+             "%llu", (unsigned long long)uid);
+
+    return &users[num_users++];
+}
+
+/*
+ * Read a user definition record
+ * Returns 0 on success, -1 on a truncated record
+ */
+static int read_user_record(FILE *fp)
+{
+    char name[256];
+    uint64_t uid, len;
+    user_cpu_t *user;
+
+    if (cpulog_get_varint(fp, &uid) < 0 || cpulog_get_varint(fp, &len) < 0 ||
+        len >= sizeof(name) || fread(name, 1, len, fp) != len)
+        return -1;
+    name[len] = '\0';
+
+    user = find_or_create_user(uid);
+    if (user) {
+        strncpy(user->username, name, sizeof(user->username) - 1);
+        user->username[sizeof(user->username) - 1] = '\0';
+    }
+    return 0;
+}
+
+/*
+ * Read a tick record, accumulating it if its time falls in [start, end)
+ * *now_ms is the time of the previous tick and is advanced to this one.
+ * Returns 0 on success, -1 on a truncated record
+ */
+static int read_tick_record(FILE *fp, uint64_t *now_ms,
+                            uint64_t start_ms, uint64_t end_ms)
+{
+    uint64_t interval, count, uid = 0, delta, ticks;
+    user_cpu_t *user;
+    int in_window;
+
+    if (cpulog_get_varint(fp, &interval) < 0 ||
+        cpulog_get_varint(fp, &count) < 0)
+        return -1;
+
+    *now_ms += interval;
+    in_window = *now_ms >= start_ms && *now_ms < end_ms;
+
+    while (count--) {
+        if (cpulog_get_varint(fp, &delta) < 0 ||
+            cpulog_get_varint(fp, &ticks) < 0)
+            return -1;
+        uid += delta;
+
+        if (!in_window)
+            continue;
+        user = find_or_create_user(uid);
+        if (user)
+            user->cpu_time += ticks;
+    }
+    return 0;
+}
+
+/*
+ * Comparison function for sorting users by CPU time (descending)
+ */
+static int compare_users(const void *a, const void *b)
+{
+    const user_cpu_t *ua = *(const user_cpu_t * const *)a;
+    const user_cpu_t *ub = *(const user_cpu_t * const *)b;
+
+    if (ub->cpu_time > ua->cpu_time)
+        return 1;
+    if (ub->cpu_time < ua->cpu_time)
+        return -1;
+    return 0;
+}
+
+/*
+ * Print the ranked table, in the same format as the monitor
+ */
+static void print_summary(void)
+{
+    static user_cpu_t *ranked[MAX_USERS];
+    int i;
+    int rank = 0;
+
+    for (i = 0; i < num_users; i++)
+        ranked[i] = &users[i];
+    qsort(ranked, num_users, sizeof(ranked[0]), compare_users);
+
+    printf("Rank User           CPU Time (milliseconds)\n");
+    printf("----------------------------------------\n");
+
+    for (i = 0; i < num_users; i++) {
+        if (ranked[i]->cpu_time > 0) {
+            rank++;
+            printf("%-4d %-14s %llu\n",
+                   rank,
+                   ranked[i]->username,
+                   ranked[i]->cpu_time * 1000 / clk_tck);
+        }
+    }
+
+    if (rank == 0) {
+        printf("(No CPU usage recorded)\n");
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-s start_seconds] [-e end_seconds] <log>\n", prog);
+    fprintf(stderr, "  The window is given in seconds since the log started;\n"
+                    "  by default the whole log is summarized.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char magic[CPULOG_MAGIC_LEN];
+    uint64_t start_ms = 0, end_ms = UINT64_MAX;
+    uint64_t log_start_ms, now_ms = 0;
+    FILE *fp;
+    int opt, c;
+
+    while ((opt = getopt(argc, argv, "s:e:")) != -1) {
+        switch (opt) {
+        case 's':
+            start_ms = strtoull(optarg, NULL, 10) * 1000;
+            break;
+        case 'e':
+            end_ms = strtoull(optarg, NULL, 10) * 1000;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fp = fopen(argv[optind], "rb");
+    if (!fp) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+        memcmp(magic, CPULOG_MAGIC, CPULOG_MAGIC_LEN) != 0 ||
+        fgetc(fp) != CPULOG_VERSION ||
+        cpulog_get_varint(fp, &clk_tck) < 0 || clk_tck == 0 ||
+        cpulog_get_varint(fp, &log_start_ms) < 0) {
+        fprintf(stderr, "Error: %s is not a CPU usage log\n", argv[optind]);
+        fclose(fp);
+        return 1;
+    }
+
+    /* A record cut short by a crash ends the log */
+    while ((c = fgetc(fp)) != EOF) {
+        int ret;
+
+        if (c == CPULOG_REC_USER)
+            ret = read_user_record(fp);
+        else if (c == CPULOG_REC_TICK)
+            ret = read_tick_record(fp, &now_ms, start_ms, end_ms);
+        else
+            ret = -1;
+
+        if (ret < 0) {
+            fprintf(stderr, "Warning: log truncated or corrupt, "
+                            "stopping at %llu s\n",
+                    (unsigned long long)(now_ms / 1000));
+            break;
+        }
+    }
+
+    fclose(fp);
+
+    print_summary();
+    return 0;
+}
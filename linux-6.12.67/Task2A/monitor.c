@@ -3,30 +3,90 @@
  *
  * Monitors CPU usage of all processes, aggregates per user,
  * and produces a ranked list by total CPU consumption.
+ *
+ * Two backends are available:
+ *   proc     - sample /proc once per second (default)
+ *   netlink  - charge exiting threads exactly through the proc connector
+ *              and taskstats, falling back to proc if unavailable
+ *
+ * The proc backend can split each scan across several threads (-j), and
+ * can stream per-interval, per-user deltas to a binary log (-o) that
+ * decode.c turns back into the ranked table for any time window.  It
+ * samples once per second by default, or at any interval down to 10ms
+ * (-i), and can export per-user histograms of CPU usage per interval (-H).
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
 #include <pwd.h>
 #include <time.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include <linux/taskstats.h>
+
+#include "cpulog.h"
 
 /* Maximum number of users to track */
 #define MAX_USERS 1024
 
 /* Maximum number of processes to track */
-#define MAX_PROCS 65536
+#define MAX_PROCS 131072
+
+/*
+ * Open-addressing lookup tables, sized to at least twice their capacity
+ * so that linear probe sequences stay short
+ */
+#define PROC_HASH_BITS 18
+#define PROC_HASH_SIZE (1U << PROC_HASH_BITS)
+#define USER_HASH_BITS 11
+#define USER_HASH_SIZE (1U << USER_HASH_BITS)
+
+/* Size of the buffer used to read /proc/<pid>/stat and status */
+#define PROC_BUF_SIZE 4096
+
+/* Descriptors kept free for everything other than per-PID files */
+#define RESERVED_FDS 64
+
+/* Maximum number of scanner threads */
+#define MAX_SHARDS 64
+
+/* Sampling interval limits, in milliseconds */
+#define MIN_INTERVAL_MS 10
+#define DEFAULT_INTERVAL_MS 1000
+
+/*
+ * Buckets of the per-interval usage histograms, in percent of one CPU:
+ * bucket 0 is below 1%, bucket k covers [2^(k-1)%, 2^k%) and the last
+ * bucket is open-ended
+ */
+#define HIST_BUCKETS 16
 
 /* Structure to store per-user CPU time */
 typedef struct {
     uid_t uid;
     char username[64];
     unsigned long long cpu_time;  /* in clock ticks */
+    unsigned long long logged_time; /* part of cpu_time already logged */
+    int logged;                   /* name written to the log */
+    unsigned long long hist_time; /* part of cpu_time already binned */
+    unsigned long hist[HIST_BUCKETS]; /* intervals per usage bucket */
 } user_cpu_t;
 
 /* Structure to store CPU time tracking for each process */
@@ -35,19 +95,69 @@ typedef struct {
     uid_t uid;
     unsigned long long last_utime;
     unsigned long long last_stime;
+    int stat_fd;                  /* persistent /proc/<pid>/stat fd */
+    int status_fd;                /* persistent /proc/<pid>/status fd */
+    unsigned int seen_gen;        /* scan generation last seen in */
     int valid;
 } proc_info_t;
 
+/* CPU time accumulated for one UID by one shard during a tick */
+typedef struct {
+    uid_t uid;
+    unsigned long long cpu_time;  /* in clock ticks */
+    int used;
+} uid_delta_t;
+
+/*
+ * A shard owns the processes whose PID maps to it: their table entries,
+ * their persistent descriptors and the CPU time they accumulated per UID
+ * during the current tick.  During a scan each shard is only touched by
+ * its own scanner thread, so no locking is needed; the main thread folds
+ * the per-shard deltas into users[] once all shards are done.
+ */
+typedef struct {
+    proc_info_t *table;           /* 1 << bits slots, valid == 0 is empty */
+    unsigned int bits;
+    int count;
+    int capacity;
+    long num_open_fds;            /* persistent descriptors held */
+    long max_open_fds;            /* and how many may be held */
+    pid_t *pids;                  /* PIDs listed for this shard this tick */
+    int num_pids;
+    int max_pids;
+    uid_delta_t deltas[USER_HASH_SIZE];
+} shard_t;
+
 /* Global arrays */
 static user_cpu_t users[MAX_USERS];
 static int num_users = 0;
 
-static proc_info_t proc_info[MAX_PROCS];
-static int num_procs = 0;
+/* Index into users[] by UID, -1 for an empty slot */
+static int user_hash[USER_HASH_SIZE];
+
+/* Process shards; PID p belongs to shards[p % num_shards] */
+static shard_t *shards;
+static int num_shards = 1;
+
+/* Scanner threads for shards 1..num_shards-1; shard 0 is the main thread's */
+static pthread_t scan_threads_id[MAX_SHARDS];
+static pthread_barrier_t tick_start, tick_done;
+static int scanners_exit;
+
+/* Streaming log (see cpulog.h), and the time of its last tick */
+static FILE *log_fp;
+static struct timespec log_last;
+
+/* Set by SIGINT/SIGTERM to end a streaming run */
+static volatile sig_atomic_t stop_requested;
 
 /* Clock ticks per second */
 static long clk_tck;
 
+/* Current scan generation, bumped once per pass over /proc */
+static unsigned int scan_gen;
+
+
 /*
  * Check if a string is a valid PID (all digits)
  */
@@ -62,103 +172,182 @@ static int is_pid_dir(const char *name)
 }
 
 /*
- * Get the UID of a process by reading /proc/<pid>/status
+ * Open /proc/<pid>/<name> read-only.
+ * Returns the file descriptor, or -1 on failure
  */
-static uid_t get_process_uid(pid_t pid)
+static int open_proc_file(pid_t pid, const char *name)
 {
-    char path[256];
-    FILE *fp;
-    char line[256];
-    uid_t uid = (uid_t)-1;
+    char path[64];
 
-    snprintf(path, sizeof(path), "/proc/%d/status", pid);
-    fp = fopen(path, "r");
-    if (!fp)
-        return (uid_t)-1;
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
 
-    while (fgets(line, sizeof(line), fp)) {
-        if (strncmp(line, "Uid:", 4) == 0) {
-            /* Format: Uid: real effective saved filesystem */
-            sscanf(line + 4, "%u", &uid);
-            break;
+/*
+ * Read the whole of a proc file into buf with a single pread().
+ *
+ * If *fdp holds an open descriptor it is re-read from offset 0, which
+ * makes procfs regenerate the file contents.  Otherwise the file is
+ * opened and, while the descriptor budget allows, kept open in *fdp so
+ * that the next tick does not pay for path lookup again.
+ *
+ * Returns the number of bytes read, or -1 on failure
+ */
+static ssize_t read_proc_file(shard_t *sh, pid_t pid, const char *name,
+                              int *fdp, char *buf, size_t size)
+{
+    ssize_t len;
+    int fd = *fdp;
+
+    if (fd < 0) {
+        fd = open_proc_file(pid, name);
+        if (fd < 0)
+            return -1;
+        if (sh->num_open_fds < sh->max_open_fds) {
+            *fdp = fd;
+            sh->num_open_fds++;
         }
     }
 
-    fclose(fp);
-    return uid;
+    len = pread(fd, buf, size - 1, 0);
+    if (fd != *fdp)
+        close(fd);
+    if (len <= 0)
+        return -1;
+
+    buf[len] = '\0';
+    return len;
 }
 
 /*
- * Read CPU time (utime + stime) from /proc/<pid>/stat
- * Returns 0 on success, -1 on failure
+ * Close the persistent descriptors held for a process
  */
-static int read_proc_cpu_time(pid_t pid, unsigned long long *utime, unsigned long long *stime)
+static void close_proc_fds(shard_t *sh, proc_info_t *pi)
 {
-    char path[256];
-    FILE *fp;
-    char comm[256];
-    char state;
-    int ppid, pgrp, session, tty_nr, tpgid;
-    unsigned int flags;
-    unsigned long minflt, cminflt, majflt, cmajflt;
-    unsigned long utime_val, stime_val;
-
-    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
-    fp = fopen(path, "r");
-    if (!fp)
+    if (pi->stat_fd >= 0) {
+        close(pi->stat_fd);
+        sh->num_open_fds--;
+    }
+    if (pi->status_fd >= 0) {
+        close(pi->status_fd);
+        sh->num_open_fds--;
+    }
+    pi->stat_fd = -1;
+    pi->status_fd = -1;
+}
+
+/*
+ * Parse an unsigned decimal number at *pp and advance *pp past it.
+ * Returns 0 on success, -1 if no digits were found
+ */
+static int parse_ull(const char **pp, unsigned long long *val)
+{
+    const char *p = *pp;
+    unsigned long long v = 0;
+
+    if (*p < '0' || *p > '9')
         return -1;
 
+    while (*p >= '0' && *p <= '9')
+        v = v * 10 + (unsigned long long)(*p++ - '0');
+
+    *pp = p;
+    *val = v;
+    return 0;
+}
+
+/*
+ * Extract utime and stime from the raw contents of /proc/<pid>/stat
+ * Returns 0 on success, -1 on failure
+ */
+static int parse_stat(const char *buf, unsigned long long *utime,
+                      unsigned long long *stime)
+{
+    const char *p;
+    int field;
+
     /*
      * /proc/<pid>/stat format:
      * pid (comm) state ppid pgrp session tty_nr tpgid flags
      * minflt cminflt majflt cmajflt utime stime ...
      *
-     * Fields 14 and 15 are utime and stime (in clock ticks)
+     * comm may itself contain spaces and parentheses, so fields are
+     * counted from the last ')'.  The character after it starts field 3
+     * (state); fields 14 and 15 are utime and stime (in clock ticks).
      */
-
-    /* Read pid */
-    int pid_read;
-    if (fscanf(fp, "%d ", &pid_read) != 1) {
-        fclose(fp);
+    p = strrchr(buf, ')');
+    if (!p)
         return -1;
+    p++;
+
+    for (field = 3; field < 14; field++) {
+        while (*p == ' ')
+            p++;
+        if (!*p)
+            return -1;
+        while (*p && *p != ' ')
+            p++;
     }
 
-    /* Read comm - handle parentheses and possible spaces in name */
-    int c;
-    int paren_depth = 0;
-    int comm_idx = 0;
+    while (*p == ' ')
+        p++;
+    if (parse_ull(&p, utime) < 0)
+        return -1;
 
-    while ((c = fgetc(fp)) != EOF) {
-        if (c == '(') {
-            paren_depth++;
-            if (paren_depth == 1)
-                continue;  /* Skip first '(' */
-        }
-        if (c == ')') {
-            paren_depth--;
-            if (paren_depth == 0)
-                break;  /* End of comm */
-        }
-        if (paren_depth > 0 && comm_idx < (int)sizeof(comm) - 1) {
-            comm[comm_idx++] = c;
-        }
-    }
-    comm[comm_idx] = '\0';
+    while (*p == ' ')
+        p++;
+    if (parse_ull(&p, stime) < 0)
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Extract the real UID from the raw contents of /proc/<pid>/status
+ * Returns the UID, or (uid_t)-1 on failure
+ */
+static uid_t parse_status_uid(const char *buf)
+{
+    const char *p;
+    unsigned long long uid;
+
+    /* Format: Uid: real effective saved filesystem */
+    p = strstr(buf, "\nUid:");
+    if (!p)
+        return (uid_t)-1;
+    p += 5;
+
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (parse_ull(&p, &uid) < 0)
+        return (uid_t)-1;
+
+    return (uid_t)uid;
+}
+
+/*
+ * Sample the UID and CPU time (utime + stime) of a process.
+ *
+ * stat_fd and status_fd are the persistent descriptors of the process
+ * (-1 if not open yet).  Returns 0 on success, -1 on failure
+ */
+static int sample_process(shard_t *sh, pid_t pid, int *stat_fd, int *status_fd,
+                          uid_t *uid, unsigned long long *utime,
+                          unsigned long long *stime)
+{
+    char buf[PROC_BUF_SIZE];
 
-    /* Read remaining fields */
-    if (fscanf(fp, " %c %d %d %d %d %d %u %lu %lu %lu %lu %lu %lu",
-               &state, &ppid, &pgrp, &session, &tty_nr, &tpgid, &flags,
-               &minflt, &cminflt, &majflt, &cmajflt,
-               &utime_val, &stime_val) != 13) {
-        fclose(fp);
+    if (read_proc_file(sh, pid, "status", status_fd, buf, sizeof(buf)) < 0)
         return -1;
-    }
 
-    fclose(fp);
+    *uid = parse_status_uid(buf);
+    if (*uid == (uid_t)-1)
+        return -1;
 
-    *utime = utime_val;
-    *stime = stime_val;
-    return 0;
+    if (read_proc_file(sh, pid, "stat", stat_fd, buf, sizeof(buf)) < 0)
+        return -1;
+
+    return parse_stat(buf, utime, stime);
 }
 
 /*
@@ -172,18 +361,28 @@ static const char *get_username(uid_t uid)
     return NULL;
 }
 
+/*
+ * Multiplicative hash of a PID or UID into a table of 2^bits slots
+ */
+static unsigned int hash_id(uint32_t id, unsigned int bits)
+{
+    return (id * 0x9E3779B1U) >> (32 - bits);
+}
+
 /*
  * Find or create user entry
  */
 static user_cpu_t *find_or_create_user(uid_t uid)
 {
-    int i;
+    unsigned int slot;
     const char *name;
 
     /* Search existing users */
-    for (i = 0; i < num_users; i++) {
-        if (users[i].uid == uid)
-            return &users[i];
+    slot = hash_id(uid, USER_HASH_BITS);
+    while (user_hash[slot] >= 0) {
+        if (users[user_hash[slot]].uid == uid)
+            return &users[user_hash[slot]];
+        slot = (slot + 1) & (USER_HASH_SIZE - 1);
     }
 
     /* Create new user entry */
@@ -192,6 +391,10 @@ static user_cpu_t *find_or_create_user(uid_t uid)
 
     users[num_users].uid = uid;
     users[num_users].cpu_time = 0;
+    users[num_users].logged_time = 0;
+    users[num_users].logged = 0;
+    users[num_users].hist_time = 0;
+    memset(users[num_users].hist, 0, sizeof(users[num_users].hist));
 
     name = get_username(uid);
     if (name) {
@@ -201,18 +404,22 @@ static user_cpu_t *find_or_create_user(uid_t uid)
         snprintf(users[num_users].username, sizeof(users[num_users].username), "%u", uid);
     }
 
+    user_hash[slot] = num_users;
     return &users[num_users++];
 }
 
 /*
  * Find process entry by PID
  */
-static proc_info_t *find_proc_info(pid_t pid)
+static proc_info_t *find_proc_info(shard_t *sh, pid_t pid)
 {
-    int i;
-    for (i = 0; i < num_procs; i++) {
-        if (proc_info[i].pid == pid && proc_info[i].valid)
-            return &proc_info[i];
+    unsigned int mask = (1U << sh->bits) - 1;
+    unsigned int slot = hash_id(pid, sh->bits);
+
+    while (sh->table[slot].valid) {
+        if (sh->table[slot].pid == pid)
+            return &sh->table[slot];
+        slot = (slot + 1) & mask;
     }
     return NULL;
 }
@@ -220,147 +427,279 @@ static proc_info_t *find_proc_info(pid_t pid)
 /*
  * Add new process entry
  */
-static proc_info_t *add_proc_info(pid_t pid, uid_t uid,
+static proc_info_t *add_proc_info(shard_t *sh, pid_t pid, uid_t uid,
                                    unsigned long long utime,
                                    unsigned long long stime)
 {
-    if (num_procs >= MAX_PROCS)
-        return NULL;
+    unsigned int mask = (1U << sh->bits) - 1;
+    unsigned int slot;
+    proc_info_t *pi;
 
-    proc_info[num_procs].pid = pid;
-    proc_info[num_procs].uid = uid;
-    proc_info[num_procs].last_utime = utime;
-    proc_info[num_procs].last_stime = stime;
-    proc_info[num_procs].valid = 1;
+    if (sh->count >= sh->capacity)
+        return NULL;
 
-    return &proc_info[num_procs++];
+    slot = hash_id(pid, sh->bits);
+    while (sh->table[slot].valid)
+        slot = (slot + 1) & mask;
+
+    pi = &sh->table[slot];
+    pi->pid = pid;
+    pi->uid = uid;
+    pi->last_utime = utime;
+    pi->last_stime = stime;
+    pi->stat_fd = -1;
+    pi->status_fd = -1;
+    pi->seen_gen = scan_gen;
+    pi->valid = 1;
+
+    sh->count++;
+    return pi;
 }
 
 /*
- * Scan all processes and accumulate CPU time
+ * Remove a process entry.
+ *
+ * Uses backward-shift deletion: later members of the probe run are moved
+ * up into the hole, so no tombstones are left behind and lookups never
+ * have to skip over deleted slots.
  */
-static void scan_processes(void)
+static void remove_proc_info(shard_t *sh, proc_info_t *pi)
 {
-    DIR *proc_dir;
-    struct dirent *entry;
-    pid_t pid;
-    uid_t uid;
-    unsigned long long utime, stime;
-    proc_info_t *pi;
-    user_cpu_t *user;
+    unsigned int mask = (1U << sh->bits) - 1;
+    unsigned int hole = pi - sh->table;
+    unsigned int slot = hole;
+    unsigned int home;
+
+    for (;;) {
+        slot = (slot + 1) & mask;
+        if (!sh->table[slot].valid)
+            break;
 
-    proc_dir = opendir("/proc");
-    if (!proc_dir) {
-        perror("opendir /proc");
-        return;
+        /* An entry may fill the hole only if its home slot is not in (hole, slot] */
+        home = hash_id(sh->table[slot].pid, sh->bits);
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            sh->table[hole] = sh->table[slot];
+            hole = slot;
+        }
     }
 
-    while ((entry = readdir(proc_dir)) != NULL) {
-        if (!is_pid_dir(entry->d_name))
-            continue;
+    sh->table[hole].valid = 0;
+    sh->count--;
+}
+
+/*
+ * Account CPU time to a UID in the shard's per-tick accumulators.
+ * A zero charge still registers the UID, so that it is listed.
+ *
+ * Returns -1 if the accumulators are full and the UID is not among them;
+ * like UIDs beyond MAX_USERS, its time then goes uncounted.
+ */
+static int shard_charge(shard_t *sh, uid_t uid, unsigned long long ticks)
+{
+    unsigned int slot = hash_id(uid, USER_HASH_BITS);
+    unsigned int probes = 0;
 
-        pid = atoi(entry->d_name);
+    while (sh->deltas[slot].used && sh->deltas[slot].uid != uid) {
+        if (++probes == USER_HASH_SIZE)
+            return -1;
+        slot = (slot + 1) & (USER_HASH_SIZE - 1);
+    }
 
-        uid = get_process_uid(pid);
-        if (uid == (uid_t)-1)
-            continue;
+    sh->deltas[slot].uid = uid;
+    sh->deltas[slot].used = 1;
+    sh->deltas[slot].cpu_time += ticks;
+    return 0;
+}
 
-        if (read_proc_cpu_time(pid, &utime, &stime) < 0)
-            continue;
+/*
+ * Fold every shard's per-tick accumulators into users[] and reset them
+ */
+static void merge_shard_deltas(void)
+{
+    user_cpu_t *user;
+    int i;
+    unsigned int slot;
 
-        pi = find_proc_info(pid);
-        if (!pi) {
-            /* New process - record initial values */
-            add_proc_info(pid, uid, utime, stime);
-            find_or_create_user(uid);
-        } else {
-            /* Existing process - accumulate delta */
-            unsigned long long delta_utime = 0;
-            unsigned long long delta_stime = 0;
-
-            if (utime >= pi->last_utime)
-                delta_utime = utime - pi->last_utime;
-            if (stime >= pi->last_stime)
-                delta_stime = stime - pi->last_stime;
+    for (i = 0; i < num_shards; i++) {
+        for (slot = 0; slot < USER_HASH_SIZE; slot++) {
+            uid_delta_t *d = &shards[i].deltas[slot];
 
-            user = find_or_create_user(uid);
+            if (!d->used)
+                continue;
+            user = find_or_create_user(d->uid);
             if (user)
-                user->cpu_time += delta_utime + delta_stime;
-
-            /* Update last seen values */
-            pi->last_utime = utime;
-            pi->last_stime = stime;
+                user->cpu_time += d->cpu_time;
+            d->cpu_time = 0;
+            d->used = 0;
         }
     }
+}
 
-    closedir(proc_dir);
+/*
+ * Start tracking a newly seen process, taking over its descriptors
+ */
+static void track_new_process(shard_t *sh, pid_t pid, int stat_fd,
+                              int status_fd, uid_t uid,
+                              unsigned long long utime,
+                              unsigned long long stime)
+{
+    proc_info_t *pi = add_proc_info(sh, pid, uid, utime, stime);
+
+    if (!pi) {
+        proc_info_t tmp = { .stat_fd = stat_fd, .status_fd = status_fd };
+
+        close_proc_fds(sh, &tmp);
+        return;
+    }
+
+    pi->stat_fd = stat_fd;
+    pi->status_fd = status_fd;
+    shard_charge(sh, uid, 0);
 }
 
 /*
- * Comparison function for sorting users by CPU time (descending)
+ * Forget processes that were not seen during the current scan
  */
-static int compare_users(const void *a, const void *b)
+static void reap_exited_processes(shard_t *sh)
 {
-    const user_cpu_t *ua = (const user_cpu_t *)a;
-    const user_cpu_t *ub = (const user_cpu_t *)b;
+    unsigned int size = 1U << sh->bits;
+    unsigned int i = 0;
 
-    if (ub->cpu_time > ua->cpu_time)
-        return 1;
-    if (ub->cpu_time < ua->cpu_time)
-        return -1;
-    return 0;
+    while (i < size) {
+        proc_info_t *pi = &sh->table[i];
+
+        if (pi->valid && pi->seen_gen != scan_gen) {
+            close_proc_fds(sh, pi);
+            /* Slot i may now hold an entry shifted back from later on */
+            remove_proc_info(sh, pi);
+            continue;
+        }
+        i++;
+    }
 }
 
 /*
- * Convert clock ticks to milliseconds
+ * Sample one listed process and accumulate its CPU time
  */
-static unsigned long long ticks_to_ms(unsigned long long ticks)
+static void scan_pid(shard_t *sh, pid_t pid)
 {
-    return (ticks * 1000) / clk_tck;
+    uid_t uid;
+    unsigned long long utime, stime;
+    proc_info_t *pi;
+
+    pi = find_proc_info(sh, pid);
+    if (!pi) {
+        /* New process - record initial values */
+        int stat_fd = -1, status_fd = -1;
+
+        if (sample_process(sh, pid, &stat_fd, &status_fd,
+                           &uid, &utime, &stime) == 0)
+            track_new_process(sh, pid, stat_fd, status_fd, uid, utime, stime);
+        else if (stat_fd >= 0 || status_fd >= 0) {
+            proc_info_t tmp = { .stat_fd = stat_fd, .status_fd = status_fd };
+
+            close_proc_fds(sh, &tmp);
+        }
+        return;
+    }
+
+    if (sample_process(sh, pid, &pi->stat_fd, &pi->status_fd,
+                       &uid, &utime, &stime) < 0) {
+        /*
+         * The descriptors refer to a task that has exited; a
+         * process listed under the same PID is a new one.
+         */
+        close_proc_fds(sh, pi);
+        if (sample_process(sh, pid, &pi->stat_fd, &pi->status_fd,
+                           &uid, &utime, &stime) < 0) {
+            close_proc_fds(sh, pi);
+            remove_proc_info(sh, pi);
+            return;
+        }
+
+        pi->uid = uid;
+        pi->last_utime = utime;
+        pi->last_stime = stime;
+        pi->seen_gen = scan_gen;
+        shard_charge(sh, uid, 0);
+        return;
+    }
+
+    /* Existing process - accumulate delta */
+    unsigned long long delta_utime = 0;
+    unsigned long long delta_stime = 0;
+
+    if (utime >= pi->last_utime)
+        delta_utime = utime - pi->last_utime;
+    if (stime >= pi->last_stime)
+        delta_stime = stime - pi->last_stime;
+
+    shard_charge(sh, uid, delta_utime + delta_stime);
+
+    /* Update last seen values */
+    pi->uid = uid;
+    pi->last_utime = utime;
+    pi->last_stime = stime;
+    pi->seen_gen = scan_gen;
 }
 
 /*
- * Print the final summary
+ * Process the PIDs listed for one shard during this tick
  */
-static void print_summary(void)
+static void scan_shard(shard_t *sh)
 {
     int i;
-    int rank = 0;
 
-    /* Sort users by CPU time (descending) */
-    qsort(users, num_users, sizeof(user_cpu_t), compare_users);
+    for (i = 0; i < sh->num_pids; i++)
+        scan_pid(sh, sh->pids[i]);
 
-    /* Print header */
-    printf("Rank User           CPU Time (milliseconds)\n");
-    printf("----------------------------------------\n");
+    reap_exited_processes(sh);
+}
 
-    /* Print each user with non-zero CPU time */
-    for (i = 0; i < num_users; i++) {
-        if (users[i].cpu_time > 0) {
-            rank++;
-            printf("%-4d %-14s %llu\n",
-                   rank,
-                   users[i].username,
-                   ticks_to_ms(users[i].cpu_time));
-        }
+/*
+ * Scanner thread: handles one shard per tick, in lockstep with main()
+ */
+static void *scanner_thread(void *arg)
+{
+    shard_t *sh = arg;
+
+    for (;;) {
+        pthread_barrier_wait(&tick_start);
+        if (scanners_exit)
+            break;
+        scan_shard(sh);
+        pthread_barrier_wait(&tick_done);
     }
+    return NULL;
+}
 
-    /* If no users had CPU time, print a message */
-    if (rank == 0) {
-        printf("(No CPU usage recorded)\n");
+/*
+ * Queue a listed PID on the shard that owns it
+ */
+static void shard_add_pid(pid_t pid)
+{
+    shard_t *sh = &shards[(unsigned int)pid % num_shards];
+
+    if (sh->num_pids == sh->max_pids) {
+        int max = sh->max_pids ? 2 * sh->max_pids : 1024;
+        pid_t *pids = realloc(sh->pids, max * sizeof(*pids));
+
+        if (!pids)
+            return;
+        sh->pids = pids;
+        sh->max_pids = max;
     }
+    sh->pids[sh->num_pids++] = pid;
 }
 
 /*
- * Initialize - record initial CPU times for all existing processes
+ * Scan all processes and accumulate CPU time
  */
-static void initialize(void)
+static void scan_processes(void)
 {
     DIR *proc_dir;
     struct dirent *entry;
-    pid_t pid;
-    uid_t uid;
-    unsigned long long utime, stime;
+    int i;
 
     proc_dir = opendir("/proc");
     if (!proc_dir) {
@@ -368,57 +707,1033 @@ static void initialize(void)
         return;
     }
 
+    scan_gen++;
+
+    for (i = 0; i < num_shards; i++)
+        shards[i].num_pids = 0;
+
+    /* List once, then let each shard's thread sample its own PIDs */
     while ((entry = readdir(proc_dir)) != NULL) {
         if (!is_pid_dir(entry->d_name))
             continue;
 
-        pid = atoi(entry->d_name);
-
-        uid = get_process_uid(pid);
-        if (uid == (uid_t)-1)
-            continue;
+        shard_add_pid(atoi(entry->d_name));
+    }
 
-        if (read_proc_cpu_time(pid, &utime, &stime) < 0)
-            continue;
+    closedir(proc_dir);
 
-        add_proc_info(pid, uid, utime, stime);
-        find_or_create_user(uid);
+    if (num_shards > 1) {
+        pthread_barrier_wait(&tick_start);
+        scan_shard(&shards[0]);
+        pthread_barrier_wait(&tick_done);
+    } else {
+        scan_shard(&shards[0]);
     }
 
-    closedir(proc_dir);
+    merge_shard_deltas();
 }
 
-int main(int argc, char *argv[])
+/*
+ * Allocate the process shards, sharing the table size and descriptor
+ * budget between them
+ */
+static int setup_shards(int nr)
 {
-    int duration;
-    int elapsed;
+    unsigned int bits = PROC_HASH_BITS;
+    int i;
 
-    /* Check command line arguments */
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <duration_seconds>\n", argv[0]);
-        return 1;
-    }
+    while (bits > 10 && (1 << (PROC_HASH_BITS - bits)) < nr)
+        bits--;
 
-    duration = atoi(argv[1]);
-    if (duration <= 0) {
-        fprintf(stderr, "Error: duration must be a positive integer\n");
-        return 1;
-    }
+    shards = calloc(nr, sizeof(*shards));
+    if (!shards)
+        return -1;
 
-    /* Get clock ticks per second */
-    clk_tck = sysconf(_SC_CLK_TCK);
-    if (clk_tck <= 0) {
-        clk_tck = 100;  /* Default fallback */
+    for (i = 0; i < nr; i++) {
+        shards[i].bits = bits;
+        shards[i].capacity = (1 << bits) / 2;
+        shards[i].table = calloc(1U << bits, sizeof(proc_info_t));
+        if (!shards[i].table)
+            return -1;
     }
+    num_shards = nr;
+    return 0;
+}
 
-    /* Initialize - record initial CPU times */
-    initialize();
+/*
+ * Start the scanner threads for shards 1..num_shards-1
+ */
+static int start_scanners(void)
+{
+    int i;
 
-    /* Monitor loop - scan every second */
-    for (elapsed = 0; elapsed < duration; elapsed++) {
-        sleep(1);
-        scan_processes();
+    if (num_shards == 1)
+        return 0;
+
+    pthread_barrier_init(&tick_start, NULL, num_shards);
+    pthread_barrier_init(&tick_done, NULL, num_shards);
+
+    for (i = 1; i < num_shards; i++) {
+        if (pthread_create(&scan_threads_id[i], NULL, scanner_thread,
+                           &shards[i]) != 0)
+            return -1;
     }
+    return 0;
+}
+
+/*
+ * Stop the scanner threads
+ */
+static void stop_scanners(void)
+{
+    int i;
+
+    if (num_shards == 1)
+        return;
+
+    scanners_exit = 1;
+    pthread_barrier_wait(&tick_start);
+    for (i = 1; i < num_shards; i++)
+        pthread_join(scan_threads_id[i], NULL);
+}
+
+/*
+ * ---- Event-driven backend: proc connector + taskstats ----
+ *
+ * Polling /proc misses tasks that live shorter than one tick.  In this
+ * mode the monitor instead tracks every thread:
+ *
+ *  - threads alive at start-up get a baseline from /proc/<pid>/task/<tid>/stat
+ *  - threads created later are announced by the proc connector (FORK) and
+ *    start from a zero baseline
+ *  - when a thread exits, taskstats delivers its final utime/stime and UID,
+ *    which is charged exactly, without touching /proc
+ *  - at the end, one last pass over /proc charges the threads still alive
+ *
+ * Both netlink interfaces need CAP_NET_ADMIN; without them the monitor
+ * falls back to the /proc scanner.  Events arrive on a single thread, so
+ * this backend always uses one shard.
+ */
+
+/* Receive buffer for netlink messages */
+#define NL_BUF_SIZE 65536
+
+/* Socket receive buffer requested for exit/fork storms */
+#define NL_RCVBUF_SIZE (8 * 1024 * 1024)
+
+static int cn_sock = -1;         /* NETLINK_CONNECTOR, CN_IDX_PROC */
+static int ts_sock = -1;         /* NETLINK_GENERIC, TASKSTATS family */
+static uint16_t ts_family;
+static unsigned long long lost_events;
+
+/*
+ * Convert microseconds from taskstats to clock ticks
+ */
+static unsigned long long usec_to_ticks(unsigned long long usec)
+{
+    return usec * clk_tck / 1000000;
+}
+
+/*
+ * Open a netlink socket bound to the given multicast groups
+ * Returns the socket, or -1 on failure
+ */
+static int nl_open(int protocol, unsigned int groups)
+{
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK, .nl_groups = groups };
+    int size = NL_RCVBUF_SIZE;
+    int sock;
+
+    sock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, protocol);
+    if (sock < 0)
+        return -1;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/*
+ * Append an attribute to a netlink message
+ */
+static void nl_put_attr(struct nlmsghdr *nlh, uint16_t type,
+                        const void *data, uint16_t len)
+{
+    struct nlattr *nla = (struct nlattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+
+    nla->nla_type = type;
+    nla->nla_len = NLA_HDRLEN + len;
+    memcpy((char *)nla + NLA_HDRLEN, data, len);
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(nla->nla_len);
+}
+
+/*
+ * Start a generic netlink request in buf
+ */
+static struct nlmsghdr *genl_start(void *buf, uint16_t family, uint8_t cmd)
+{
+    struct nlmsghdr *nlh = buf;
+    struct genlmsghdr *genl = NLMSG_DATA(nlh);
+
+    nlh->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    nlh->nlmsg_type = family;
+    nlh->nlmsg_flags = NLM_F_REQUEST;
+    nlh->nlmsg_seq = 0;
+    nlh->nlmsg_pid = 0;
+    genl->cmd = cmd;
+    genl->version = 1;
+    genl->reserved = 0;
+    return nlh;
+}
+
+/*
+ * Look up the generic netlink family ID of taskstats
+ * Returns 0 on success, -1 on failure
+ */
+static int taskstats_resolve_family(void)
+{
+    static char buf[NL_BUF_SIZE];
+    struct nlmsghdr *nlh;
+    struct nlattr *nla;
+    ssize_t len;
+    int rem;
+
+    nlh = genl_start(buf, GENL_ID_CTRL, CTRL_CMD_GETFAMILY);
+    nl_put_attr(nlh, CTRL_ATTR_FAMILY_NAME, TASKSTATS_GENL_NAME,
+                sizeof(TASKSTATS_GENL_NAME));
+    if (send(ts_sock, nlh, nlh->nlmsg_len, 0) < 0)
+        return -1;
+
+    len = recv(ts_sock, buf, sizeof(buf), 0);
+    if (len < 0 || !NLMSG_OK(nlh, (size_t)len) || nlh->nlmsg_type == NLMSG_ERROR)
+        return -1;
+
+    nla = (struct nlattr *)((char *)NLMSG_DATA(nlh) + GENL_HDRLEN);
+    rem = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+    while (rem >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN && nla->nla_len <= rem) {
+        if (nla->nla_type == CTRL_ATTR_FAMILY_ID) {
+            memcpy(&ts_family, (char *)nla + NLA_HDRLEN, sizeof(ts_family));
+            return 0;
+        }
+        rem -= NLA_ALIGN(nla->nla_len);
+        nla = (struct nlattr *)((char *)nla + NLA_ALIGN(nla->nla_len));
+    }
+    return -1;
+}
+
+/*
+ * Check a netlink acknowledgement
+ * Returns 0 if the request succeeded, -1 otherwise
+ */
+static int nl_wait_ack(int sock)
+{
+    static char buf[NL_BUF_SIZE];
+    struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+    ssize_t len;
+
+    len = recv(sock, buf, sizeof(buf), 0);
+    if (len < 0 || !NLMSG_OK(nlh, (size_t)len))
+        return -1;
+    if (nlh->nlmsg_type == NLMSG_ERROR &&
+        ((struct nlmsgerr *)NLMSG_DATA(nlh))->error != 0)
+        return -1;
+    return 0;
+}
+
+/*
+ * Ask taskstats to send exit statistics for tasks on all CPUs
+ * Returns 0 on success, -1 on failure
+ */
+static int taskstats_register(void)
+{
+    static char buf[NL_BUF_SIZE];
+    struct nlmsghdr *nlh;
+    char cpumask[32];
+    long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+
+    if (ncpus <= 0)
+        ncpus = 1;
+    snprintf(cpumask, sizeof(cpumask), "0-%ld", ncpus - 1);
+
+    nlh = genl_start(buf, ts_family, TASKSTATS_CMD_GET);
+    nlh->nlmsg_flags |= NLM_F_ACK;
+    nl_put_attr(nlh, TASKSTATS_CMD_ATTR_REGISTER_CPUMASK, cpumask,
+                strlen(cpumask) + 1);
+    if (send(ts_sock, nlh, nlh->nlmsg_len, 0) < 0)
+        return -1;
+
+    return nl_wait_ack(ts_sock);
+}
+
+/*
+ * Subscribe to proc connector events
+ * Returns 0 on success, -1 on failure
+ */
+static int proc_connector_listen(void)
+{
+    struct {
+        struct nlmsghdr nlh;
+        struct cn_msg cn;
+        enum proc_cn_mcast_op op;
+    } __attribute__((packed, aligned(NLMSG_ALIGNTO))) req;
+
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = sizeof(req);
+    req.nlh.nlmsg_type = NLMSG_DONE;
+    req.cn.id.idx = CN_IDX_PROC;
+    req.cn.id.val = CN_VAL_PROC;
+    req.cn.len = sizeof(req.op);
+    req.op = PROC_CN_MCAST_LISTEN;
+
+    if (send(cn_sock, &req, sizeof(req), 0) < 0)
+        return -1;
+    return 0;
+}
+
+/*
+ * Set up both netlink sockets
+ * Returns 0 on success, -1 if the event backend is unavailable
+ */
+static int netlink_setup(void)
+{
+    cn_sock = nl_open(NETLINK_CONNECTOR, CN_IDX_PROC);
+    if (cn_sock < 0 || proc_connector_listen() < 0) {
+        perror("proc connector");
+        goto fail;
+    }
+
+    ts_sock = nl_open(NETLINK_GENERIC, 0);
+    if (ts_sock < 0 || taskstats_resolve_family() < 0 ||
+        taskstats_register() < 0) {
+        perror("taskstats");
+        goto fail;
+    }
+    return 0;
+
+fail:
+    if (cn_sock >= 0)
+        close(cn_sock);
+    if (ts_sock >= 0)
+        close(ts_sock);
+    cn_sock = ts_sock = -1;
+    return -1;
+}
+
+/*
+ * Sample one thread through /proc/<tgid>/task/<tid>/{stat,status}
+ * Returns 0 on success, -1 on failure
+ */
+static int sample_thread(pid_t tgid, pid_t tid, uid_t *uid,
+                         unsigned long long *utime, unsigned long long *stime)
+{
+    proc_info_t tmp = { .stat_fd = -1, .status_fd = -1 };
+    char name[48];
+    char buf[PROC_BUF_SIZE];
+    int ret = -1;
+
+    snprintf(name, sizeof(name), "task/%d/status", tid);
+    if (read_proc_file(&shards[0], tgid, name, &tmp.status_fd, buf, sizeof(buf)) < 0)
+        goto out;
+    *uid = parse_status_uid(buf);
+    if (*uid == (uid_t)-1)
+        goto out;
+
+    snprintf(name, sizeof(name), "task/%d/stat", tid);
+    if (read_proc_file(&shards[0], tgid, name, &tmp.stat_fd, buf, sizeof(buf)) < 0)
+        goto out;
+    ret = parse_stat(buf, utime, stime);
+
+out:
+    /* Threads are only sampled twice, so their files are not kept open */
+    close_proc_fds(&shards[0], &tmp);
+    return ret;
+}
+
+/*
+ * Walk the threads of every process.
+ *
+ * With final == 0, record a baseline for each thread.  With final != 0,
+ * charge each thread the CPU time used since its baseline; threads not
+ * yet known were created during monitoring, so they are charged in full.
+ */
+static void scan_threads(int final)
+{
+    DIR *proc_dir, *task_dir;
+    struct dirent *entry, *task;
+    char path[64];
+    pid_t tgid, tid;
+    uid_t uid;
+    unsigned long long utime, stime, base;
+    proc_info_t *pi;
+    user_cpu_t *user;
+
+    proc_dir = opendir("/proc");
+    if (!proc_dir) {
+        perror("opendir /proc");
+        return;
+    }
+
+    while ((entry = readdir(proc_dir)) != NULL) {
+        if (!is_pid_dir(entry->d_name))
+            continue;
+
+        tgid = atoi(entry->d_name);
+        snprintf(path, sizeof(path), "/proc/%d/task", tgid);
+        task_dir = opendir(path);
+        if (!task_dir)
+            continue;
+
+        while ((task = readdir(task_dir)) != NULL) {
+            if (!is_pid_dir(task->d_name))
+                continue;
+
+            tid = atoi(task->d_name);
+            if (sample_thread(tgid, tid, &uid, &utime, &stime) < 0)
+                continue;
+
+            pi = find_proc_info(&shards[0], tid);
+            if (!final) {
+                if (!pi)
+                    add_proc_info(&shards[0], tid, uid, utime, stime);
+                find_or_create_user(uid);
+                continue;
+            }
+
+            base = pi ? pi->last_utime + pi->last_stime : 0;
+            user = find_or_create_user(uid);
+            if (user && utime + stime > base)
+                user->cpu_time += utime + stime - base;
+            if (pi)
+                remove_proc_info(&shards[0], pi);
+        }
+
+        closedir(task_dir);
+    }
+
+    closedir(proc_dir);
+}
+
+/*
+ * Charge the final statistics of an exited thread
+ */
+static void charge_exited_thread(const struct taskstats *st)
+{
+    unsigned long long total, base = 0;
+    proc_info_t *pi;
+    user_cpu_t *user;
+
+    total = usec_to_ticks(st->ac_utime) + usec_to_ticks(st->ac_stime);
+
+    pi = find_proc_info(&shards[0], (pid_t)st->ac_pid);
+    if (pi) {
+        base = pi->last_utime + pi->last_stime;
+        remove_proc_info(&shards[0], pi);
+    }
+
+    user = find_or_create_user((uid_t)st->ac_uid);
+    if (user && total > base)
+        user->cpu_time += total - base;
+}
+
+/*
+ * Handle one taskstats exit notification
+ */
+static void handle_taskstats_msg(struct nlmsghdr *nlh)
+{
+    struct nlattr *nla, *inner;
+    struct taskstats st;
+    int rem, irem;
+
+    nla = (struct nlattr *)((char *)NLMSG_DATA(nlh) + GENL_HDRLEN);
+    rem = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+
+    while (rem >= NLA_HDRLEN && nla->nla_len >= NLA_HDRLEN && nla->nla_len <= rem) {
+        /*
+         * The per-tgid aggregate only carries delay accounting, not
+         * CPU times, so only the per-thread record is used.
+         */
+        if (nla->nla_type == TASKSTATS_TYPE_AGGR_PID) {
+            inner = (struct nlattr *)((char *)nla + NLA_HDRLEN);
+            irem = nla->nla_len - NLA_HDRLEN;
+
+            while (irem >= NLA_HDRLEN && inner->nla_len >= NLA_HDRLEN &&
+                   inner->nla_len <= irem) {
+                if (inner->nla_type == TASKSTATS_TYPE_STATS) {
+                    size_t len = inner->nla_len - NLA_HDRLEN;
+
+                    memset(&st, 0, sizeof(st));
+                    memcpy(&st, (char *)inner + NLA_HDRLEN,
+                           len < sizeof(st) ? len : sizeof(st));
+                    charge_exited_thread(&st);
+                }
+                irem -= NLA_ALIGN(inner->nla_len);
+                inner = (struct nlattr *)((char *)inner + NLA_ALIGN(inner->nla_len));
+            }
+        }
+        rem -= NLA_ALIGN(nla->nla_len);
+        nla = (struct nlattr *)((char *)nla + NLA_ALIGN(nla->nla_len));
+    }
+}
+
+/*
+ * Handle one proc connector event
+ */
+static void handle_proc_event(struct nlmsghdr *nlh)
+{
+    struct cn_msg *cn = NLMSG_DATA(nlh);
+    struct proc_event *ev = (struct proc_event *)cn->data;
+    proc_info_t *parent;
+
+    if (ev->what != PROC_EVENT_FORK)
+        return;
+
+    /*
+     * A new thread starts with no CPU time; its real UID is reported
+     * again at exit or by the final scan.
+     */
+    if (find_proc_info(&shards[0], ev->event_data.fork.child_pid))
+        return;
+    parent = find_proc_info(&shards[0], ev->event_data.fork.parent_pid);
+    add_proc_info(&shards[0], ev->event_data.fork.child_pid,
+                  parent ? parent->uid : 0, 0, 0);
+}
+
+/*
+ * Drain all pending messages from a netlink socket
+ */
+static void netlink_drain(int sock, void (*handler)(struct nlmsghdr *))
+{
+    static char buf[NL_BUF_SIZE];
+    struct nlmsghdr *nlh;
+    ssize_t len;
+
+    for (;;) {
+        len = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == ENOBUFS) {
+                /* The kernel dropped events; count and keep going */
+                lost_events++;
+                continue;
+            }
+            return;
+        }
+
+        for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (size_t)len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_ERROR || nlh->nlmsg_type == NLMSG_NOOP)
+                continue;
+            handler(nlh);
+        }
+    }
+}
+
+/*
+ * Monitor for duration seconds using fork/exit events
+ */
+static void netlink_monitor(int duration)
+{
+    struct pollfd fds[2] = {
+        { .fd = cn_sock, .events = POLLIN },
+        { .fd = ts_sock, .events = POLLIN },
+    };
+    struct timespec now, end;
+    long timeout_ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    end.tv_sec += duration;
+
+    for (;;) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timeout_ms = (end.tv_sec - now.tv_sec) * 1000 +
+                     (end.tv_nsec - now.tv_nsec) / 1000000;
+        if (timeout_ms <= 0)
+            break;
+
+        if (poll(fds, 2, timeout_ms) < 0 && errno != EINTR)
+            break;
+
+        /* Forks first, so that an exit in the same batch finds its entry */
+        if (fds[0].revents)
+            netlink_drain(cn_sock, handle_proc_event);
+        if (fds[1].revents)
+            netlink_drain(ts_sock, handle_taskstats_msg);
+    }
+
+    /* Collect exits that raced with the deadline, then the survivors */
+    netlink_drain(cn_sock, handle_proc_event);
+    netlink_drain(ts_sock, handle_taskstats_msg);
+    scan_threads(1);
+
+    if (lost_events)
+        fprintf(stderr, "Warning: %llu netlink event batches were lost\n",
+                lost_events);
+}
+
+/*
+ * Comparison function for sorting users by CPU time (descending)
+ */
+static int compare_users(const void *a, const void *b)
+{
+    const user_cpu_t *ua = *(const user_cpu_t * const *)a;
+    const user_cpu_t *ub = *(const user_cpu_t * const *)b;
+
+    if (ub->cpu_time > ua->cpu_time)
+        return 1;
+    if (ub->cpu_time < ua->cpu_time)
+        return -1;
+    return 0;
+}
+
+/*
+ * Convert clock ticks to milliseconds
+ */
+static unsigned long long ticks_to_ms(unsigned long long ticks)
+{
+    return (ticks * 1000) / clk_tck;
+}
+
+/*
+ * Print the final summary
+ */
+static void print_summary(void)
+{
+    static user_cpu_t *ranked[MAX_USERS];
+    int i;
+    int rank = 0;
+
+    /*
+     * Sort users by CPU time (descending).  A separate array of pointers
+     * is sorted so that user_hash stays valid.
+     */
+    for (i = 0; i < num_users; i++)
+        ranked[i] = &users[i];
+    qsort(ranked, num_users, sizeof(ranked[0]), compare_users);
+
+    /* Print header */
+    printf("Rank User           CPU Time (milliseconds)\n");
+    printf("----------------------------------------\n");
+
+    /* Print each user with non-zero CPU time */
+    for (i = 0; i < num_users; i++) {
+        if (ranked[i]->cpu_time > 0) {
+            rank++;
+            printf("%-4d %-14s %llu\n",
+                   rank,
+                   ranked[i]->username,
+                   ticks_to_ms(ranked[i]->cpu_time));
+        }
+    }
+
+    /* If no users had CPU time, print a message */
+    if (rank == 0) {
+        printf("(No CPU usage recorded)\n");
+    }
+}
+
+/*
+ * Milliseconds elapsed from a to b
+ */
+static uint64_t elapsed_ms(const struct timespec *a, const struct timespec *b)
+{
+    return (uint64_t)(b->tv_sec - a->tv_sec) * 1000 +
+           (b->tv_nsec - a->tv_nsec) / 1000000;
+}
+
+/*
+ * Create the streaming log and write its header
+ * Returns 0 on success, -1 on failure
+ */
+static int log_open(const char *path)
+{
+    struct timespec now;
+    int err = 0;
+
+    log_fp = fopen(path, "wb");
+    if (!log_fp) {
+        perror(path);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    clock_gettime(CLOCK_MONOTONIC, &log_last);
+
+    err |= fwrite(CPULOG_MAGIC, 1, CPULOG_MAGIC_LEN, log_fp) != CPULOG_MAGIC_LEN;
+    err |= fputc(CPULOG_VERSION, log_fp) == EOF;
+    err |= cpulog_put_varint(log_fp, clk_tck);
+    err |= cpulog_put_varint(log_fp, (uint64_t)now.tv_sec * 1000 +
+                                     now.tv_nsec / 1000000);
+    if (err || fflush(log_fp) == EOF) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Order users by ascending UID
+ */
+static int compare_uids(const void *a, const void *b)
+{
+    const user_cpu_t *ua = *(const user_cpu_t * const *)a;
+    const user_cpu_t *ub = *(const user_cpu_t * const *)b;
+
+    return (ua->uid > ub->uid) - (ua->uid < ub->uid);
+}
+
+/*
+ * Append one tick of per-user deltas to the streaming log
+ * Returns 0 on success, -1 on write error
+ */
+static int log_write_tick(void)
+{
+    static user_cpu_t *active[MAX_USERS];
+    struct timespec now;
+    uid_t prev_uid = 0;
+    int err = 0;
+    int i, n = 0;
+
+    for (i = 0; i < num_users; i++) {
+        if (users[i].cpu_time > users[i].logged_time)
+            active[n++] = &users[i];
+    }
+    qsort(active, n, sizeof(active[0]), compare_uids);
+
+    /* Name newly active users before the tick that refers to them */
+    for (i = 0; i < n; i++) {
+        size_t len = strlen(active[i]->username);
+
+        if (active[i]->logged)
+            continue;
+        err |= fputc(CPULOG_REC_USER, log_fp) == EOF;
+        err |= cpulog_put_varint(log_fp, active[i]->uid);
+        err |= cpulog_put_varint(log_fp, len);
+        err |= fwrite(active[i]->username, 1, len, log_fp) != len;
+        active[i]->logged = 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    err |= fputc(CPULOG_REC_TICK, log_fp) == EOF;
+    err |= cpulog_put_varint(log_fp, elapsed_ms(&log_last, &now));
+    err |= cpulog_put_varint(log_fp, n);
+    for (i = 0; i < n; i++) {
+        err |= cpulog_put_varint(log_fp, active[i]->uid - prev_uid);
+        err |= cpulog_put_varint(log_fp, active[i]->cpu_time -
+                                         active[i]->logged_time);
+        prev_uid = active[i]->uid;
+        active[i]->logged_time = active[i]->cpu_time;
+    }
+    log_last = now;
+
+    /* Flush every tick, so that a crash loses at most one interval */
+    if (err || fflush(log_fp) == EOF) {
+        perror("write log");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Bin the CPU time each user consumed during the last interval_ms
+ */
+static void record_histograms(uint64_t interval_ms)
+{
+    unsigned long long ticks, percent;
+    int i, bucket;
+
+    if (interval_ms == 0)
+        return;
+
+    for (i = 0; i < num_users; i++) {
+        ticks = users[i].cpu_time - users[i].hist_time;
+        users[i].hist_time = users[i].cpu_time;
+
+        percent = ticks * 1000 * 100 / clk_tck / interval_ms;
+        for (bucket = 0; percent && bucket < HIST_BUCKETS - 1; bucket++)
+            percent >>= 1;
+        users[i].hist[bucket]++;
+    }
+}
+
+/*
+ * Write the per-user usage histograms as tab-separated text
+ * Returns 0 on success, -1 on failure
+ */
+static int export_histograms(const char *path, int interval_ms)
+{
+    FILE *fp;
+    int i, bucket;
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(fp, "# CPU usage per %d ms interval, in percent of one CPU\n",
+            interval_ms);
+    fprintf(fp, "user\t<1");
+    for (bucket = 1; bucket < HIST_BUCKETS - 1; bucket++)
+        fprintf(fp, "\t<%lu", 1UL << bucket);
+    fprintf(fp, "\t>=%lu\n", 1UL << (HIST_BUCKETS - 2));
+
+    for (i = 0; i < num_users; i++) {
+        fprintf(fp, "%s", users[i].username);
+        for (bucket = 0; bucket < HIST_BUCKETS; bucket++)
+            fprintf(fp, "\t%lu", users[i].hist[bucket]);
+        fprintf(fp, "\n");
+    }
+
+    if (fclose(fp) == EOF) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Create a periodic timer whose expirations fall on absolute deadlines
+ * start + k * interval, so that time spent scanning never adds drift
+ * Returns the timerfd, or -1 on failure
+ */
+static int start_tick_timer(int interval_ms)
+{
+    struct itimerspec its;
+    struct timespec now;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    its.it_value.tv_sec = now.tv_sec + its.it_interval.tv_sec;
+    its.it_value.tv_nsec = now.tv_nsec + its.it_interval.tv_nsec;
+    if (its.it_value.tv_nsec >= 1000000000L) {
+        its.it_value.tv_sec++;
+        its.it_value.tv_nsec -= 1000000000L;
+    }
+
+    if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * SIGINT/SIGTERM handler for streaming runs
+ */
+static void handle_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+/*
+ * Size the budget of per-PID descriptors from RLIMIT_NOFILE and split it
+ * evenly between the shards.  Two descriptors are kept per process; beyond
+ * the budget, files are opened and closed on every tick instead.
+ */
+static void setup_fd_budget(void)
+{
+    struct rlimit rl;
+    long max_open_fds;
+    int i;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+        return;
+
+    if (rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    if (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > 2 * MAX_PROCS + RESERVED_FDS)
+        max_open_fds = 2 * MAX_PROCS;
+    else if (rl.rlim_cur > RESERVED_FDS)
+        max_open_fds = (long)rl.rlim_cur - RESERVED_FDS;
+    else
+        max_open_fds = 0;
+
+    for (i = 0; i < num_shards; i++)
+        shards[i].max_open_fds = max_open_fds / num_shards;
+}
+
+/*
+ * Initialize - record initial CPU times for all existing processes
+ */
+static void initialize(void)
+{
+    setup_fd_budget();
+
+    /* Every process is new on the first pass, so nothing is accumulated */
+    scan_processes();
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-b proc|netlink] [-j threads] [-i interval_ms]\n"
+                    "       [-o log] [-H histogram_file] <duration_seconds>\n",
+            prog);
+    fprintf(stderr, "  -o log  stream per-interval, per-user deltas to a binary log;\n"
+                    "          a duration of 0 runs until SIGINT or SIGTERM\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int duration;
+    uint64_t elapsed_ms, expirations, overruns = 0;
+    int interval_ms = DEFAULT_INTERVAL_MS;
+    int timer_fd;
+    int use_netlink = 0;
+    int nr_threads = 1;
+    const char *log_path = NULL;
+    const char *hist_path = NULL;
+    int opt;
+
+    /* Check command line arguments */
+    while ((opt = getopt(argc, argv, "b:j:i:o:H:")) != -1) {
+        switch (opt) {
+        case 'b':
+            if (strcmp(optarg, "netlink") == 0) {
+                use_netlink = 1;
+            } else if (strcmp(optarg, "proc") != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'j':
+            nr_threads = atoi(optarg);
+            if (nr_threads < 1 || nr_threads > MAX_SHARDS) {
+                fprintf(stderr, "Error: threads must be between 1 and %d\n",
+                        MAX_SHARDS);
+                return 1;
+            }
+            break;
+        case 'i':
+            interval_ms = atoi(optarg);
+            if (interval_ms < MIN_INTERVAL_MS) {
+                fprintf(stderr, "Error: interval must be at least %d ms\n",
+                        MIN_INTERVAL_MS);
+                return 1;
+            }
+            break;
+        case 'o':
+            log_path = optarg;
+            break;
+        case 'H':
+            hist_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    duration = atoi(argv[optind]);
+    if (duration < 0 || (duration == 0 && !log_path)) {
+        fprintf(stderr, "Error: duration must be a positive integer\n");
+        return 1;
+    }
+
+    if ((log_path || hist_path || interval_ms != DEFAULT_INTERVAL_MS) &&
+        use_netlink) {
+        fprintf(stderr, "Error: -i, -o and -H require the proc backend\n");
+        return 1;
+    }
+
+    /* Get clock ticks per second */
+    clk_tck = sysconf(_SC_CLK_TCK);
+    if (clk_tck <= 0) {
+        clk_tck = 100;  /* Default fallback */
+    }
+
+    memset(user_hash, -1, sizeof(user_hash));
+
+    if (use_netlink && netlink_setup() < 0) {
+        fprintf(stderr, "Warning: netlink backend unavailable, using /proc\n");
+        use_netlink = 0;
+    }
+
+    if (setup_shards(use_netlink ? 1 : nr_threads) < 0 || start_scanners() < 0) {
+        fprintf(stderr, "Error: cannot set up %d scanner threads\n", nr_threads);
+        return 1;
+    }
+
+    if (use_netlink) {
+        /* Register for events first so that no fork or exit is missed */
+        scan_threads(0);
+        netlink_monitor(duration);
+        print_summary();
+        return 0;
+    }
+
+    if (log_path) {
+        if (log_open(log_path) < 0)
+            return 1;
+        signal(SIGINT, handle_stop);
+        signal(SIGTERM, handle_stop);
+    }
+
+    /* Initialize - record initial CPU times */
+    initialize();
+
+    timer_fd = start_tick_timer(interval_ms);
+    if (timer_fd < 0) {
+        perror("timerfd");
+        return 1;
+    }
+
+    /* Monitor loop - scan once per interval */
+    elapsed_ms = 0;
+    while ((duration == 0 || elapsed_ms < (uint64_t)duration * 1000) &&
+           !stop_requested) {
+        if (read(timer_fd, &expirations, sizeof(expirations)) !=
+            sizeof(expirations)) {
+            if (errno == EINTR)
+                continue;
+            perror("timerfd");
+            break;
+        }
+
+        /*
+         * Deadlines that passed while the previous scan overran are
+         * coalesced into this one rather than queued up.
+         */
+        overruns += expirations - 1;
+        elapsed_ms += expirations * interval_ms;
+
+        scan_processes();
+        record_histograms(expirations * interval_ms);
+        if (log_fp && log_write_tick() < 0)
+            break;
+    }
+
+    close(timer_fd);
+    stop_scanners();
+
+    if (overruns)
+        fprintf(stderr, "Warning: %llu ticks overran and were coalesced\n",
+                (unsigned long long)overruns);
+
+    if (hist_path)
+        export_histograms(hist_path, interval_ms);
+
+    if (log_fp)
+        fclose(log_fp);
 
     /* Print summary */
     print_summary();
@@ -2,7 +2,26 @@
  * Test program for Task 1: Entangled CPU mutual exclusion
  *
  * Compile: gcc -o test_entangled test_entangled.c -lpthread
- * Run as root: ./test_entangled
+ * Run as root: ./test_entangled [-g groups | -s] [-b [-t threads] [-d seconds]]
+ *
+ * Besides the legacy pair in entangled_cpus_1/_2, the kernel accepts any
+ * number of disjoint entanglement groups through entangled_cpu_groups:
+ * one cpulist per group, groups separated by ';', e.g. "0,64;1,65;2-3".
+ * Writing an empty line removes all groups.
+ *
+ * By default tasks on entangled CPUs may co-run when they have the same
+ * UID.  With entangled_use_cookie set to 1 they are instead compared by
+ * their core-scheduling cookie (prctl(PR_SCHED_CORE)), so that trusted
+ * tasks of different users can share a cookie and co-run while
+ * untrusted tasks of one user are kept apart.
+ *
+ *   -g groups  run the group tests on the given groups
+ *   -s         run the group tests on every set of SMT siblings
+ *   -b         instead of the tests, benchmark the groups with
+ *              entanglement off and on (see run_benchmarks())
+ *   -t threads threads per CPU in benchmark mode (default 1)
+ *   -d seconds length of each benchmark run (default TEST_DURATION)
+ * By default the group tests use disjoint pairs of consecutive CPUs.
  */
 
 #define _GNU_SOURCE
@@ -16,11 +35,37 @@
 #include <pwd.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
 
 #define CPU1 1
 #define CPU2 3
 #define TEST_DURATION 10  /* seconds */
 
+#define GROUPS_FILE "/proc/sys/kernel/entangled_cpu_groups"
+#define MAX_GROUPS 1024
+#define MAX_GROUP_CPUS 64
+#define NOBODY_UID 65534
+#define COOKIE_FILE "/proc/sys/kernel/entangled_use_cookie"
+
+#ifndef PR_SCHED_CORE
+#define PR_SCHED_CORE 62
+#define PR_SCHED_CORE_GET 0
+#define PR_SCHED_CORE_CREATE 1
+#define PR_SCHED_CORE_SCOPE_THREAD 0
+#define PR_SCHED_CORE_SCOPE_THREAD_GROUP 1
+#endif
+
+/* One entanglement group: CPUs that must never run different users */
+struct cpu_group {
+    int ncpus;
+    int cpus[MAX_GROUP_CPUS];
+};
+
+static struct cpu_group groups[MAX_GROUPS];
+static int num_groups;
+
 volatile int running = 1;
 
 /* Set CPU affinity for current process */
@@ -116,6 +161,349 @@ void print_entangled_cpus() {
     printf("Current entangled CPUs: %d <-> %d\n", cpu1, cpu2);
 }
 
+/* Parse a cpulist ("0-3,8") into a group; returns 0 on success */
+int parse_cpulist(const char *list, struct cpu_group *g) {
+    const char *p = list;
+    char *end;
+    long first, last;
+
+    g->ncpus = 0;
+    while (*p && *p != ';' && *p != '\n') {
+        first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return -1;
+        last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+                return -1;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (g->ncpus == MAX_GROUP_CPUS)
+                return -1;
+            g->cpus[g->ncpus++] = cpu;
+        }
+        if (*p == ',')
+            p++;
+    }
+    return g->ncpus > 0 ? 0 : -1;
+}
+
+/* Parse "list;list;..." into groups[]; returns the number of groups */
+int parse_cpu_groups(const char *spec) {
+    const char *p = spec;
+
+    num_groups = 0;
+    while (*p && *p != '\n' && num_groups < MAX_GROUPS) {
+        if (parse_cpulist(p, &groups[num_groups]) < 0)
+            return -1;
+        num_groups++;
+        p = strchr(p, ';');
+        if (!p)
+            break;
+        p++;
+    }
+    return num_groups;
+}
+
+/* Format groups[] as "list;list;..." */
+void format_cpu_groups(char *buf, size_t size) {
+    size_t len = 0;
+
+    buf[0] = '\0';
+    for (int i = 0; i < num_groups && len < size; i++) {
+        for (int j = 0; j < groups[i].ncpus && len < size; j++)
+            len += snprintf(buf + len, size - len, "%s%d",
+                            j ? "," : (i ? ";" : ""), groups[i].cpus[j]);
+    }
+}
+
+/* Build disjoint pairs of consecutive online CPUs: (0,1), (2,3), ... */
+int build_pair_groups() {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    num_groups = 0;
+    for (long cpu = 0; cpu + 1 < ncpus && num_groups < MAX_GROUPS; cpu += 2) {
+        groups[num_groups].ncpus = 2;
+        groups[num_groups].cpus[0] = cpu;
+        groups[num_groups].cpus[1] = cpu + 1;
+        num_groups++;
+    }
+    return num_groups;
+}
+
+/* Build one group per set of SMT siblings with more than one thread */
+int build_smt_groups() {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    char path[128], line[256];
+    FILE *f;
+
+    num_groups = 0;
+    for (long cpu = 0; cpu < ncpus && num_groups < MAX_GROUPS; cpu++) {
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%ld/topology/thread_siblings_list",
+                 cpu);
+        f = fopen(path, "r");
+        if (!f)
+            continue;
+        if (!fgets(line, sizeof(line), f)) {
+            fclose(f);
+            continue;
+        }
+        fclose(f);
+
+        /* Each sibling set is listed once, by its first CPU */
+        if (parse_cpulist(line, &groups[num_groups]) < 0 ||
+            groups[num_groups].cpus[0] != cpu ||
+            groups[num_groups].ncpus < 2)
+            continue;
+        num_groups++;
+    }
+    return num_groups;
+}
+
+/* Write groups[] to the kernel; returns 0 on success */
+int set_entangled_groups() {
+    char buf[8192];
+    FILE *f;
+
+    format_cpu_groups(buf, sizeof(buf));
+    f = fopen(GROUPS_FILE, "w");
+    if (!f) {
+        perror("Cannot open " GROUPS_FILE);
+        return -1;
+    }
+    fprintf(f, "%s\n", buf);
+    if (fclose(f) != 0) {
+        perror("Cannot set entanglement groups");
+        return -1;
+    }
+
+    printf("Set %d entanglement groups: %s\n", num_groups, buf);
+    return 0;
+}
+
+/* Remove all entanglement groups */
+void clear_entangled_groups() {
+    FILE *f = fopen(GROUPS_FILE, "w");
+
+    if (f) {
+        fprintf(f, "\n");
+        fclose(f);
+    }
+}
+
+/* Read back the groups the kernel has and check them against groups[] */
+int verify_entangled_groups() {
+    char expected[8192], actual[8192];
+    FILE *f;
+
+    format_cpu_groups(expected, sizeof(expected));
+    f = fopen(GROUPS_FILE, "r");
+    if (!f || !fgets(actual, sizeof(actual), f)) {
+        if (f)
+            fclose(f);
+        printf("Cannot read back " GROUPS_FILE "\n");
+        return -1;
+    }
+    fclose(f);
+    actual[strcspn(actual, "\n")] = '\0';
+
+    /* The kernel may print ranges, so compare the parsed form */
+    struct cpu_group saved[MAX_GROUPS];
+    int saved_num = num_groups;
+    int ok;
+
+    memcpy(saved, groups, sizeof(saved));
+    ok = parse_cpu_groups(actual) == saved_num;
+    for (int i = 0; ok && i < saved_num; i++)
+        ok = groups[i].ncpus == saved[i].ncpus &&
+             !memcmp(groups[i].cpus, saved[i].cpus,
+                     saved[i].ncpus * sizeof(int));
+    memcpy(groups, saved, sizeof(saved));
+    num_groups = saved_num;
+
+    printf("Read back groups: %s (%s)\n", actual, ok ? "match" : "MISMATCH");
+    return ok ? 0 : -1;
+}
+
+/* CPU time (user + system) used by the calling process, in seconds */
+double self_cpu_seconds() {
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+/* Give the calling process a core-scheduling cookie of its own */
+int create_cookie() {
+    if (prctl(PR_SCHED_CORE, PR_SCHED_CORE_CREATE, 0,
+              PR_SCHED_CORE_SCOPE_THREAD_GROUP, 0) < 0) {
+        perror("prctl(PR_SCHED_CORE_CREATE)");
+        return -1;
+    }
+    return 0;
+}
+
+/* Switch entanglement between UID (0) and cookie (1) comparison */
+int set_use_cookie(int on) {
+    FILE *f = fopen(COOKIE_FILE, "w");
+
+    if (!f) {
+        perror("Cannot open " COOKIE_FILE);
+        return -1;
+    }
+    fprintf(f, "%d\n", on);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/*
+ * Fork a busy worker pinned to cpu, running as uid, for duration seconds.
+ * With own_cookie it first gets a core-scheduling cookie of its own;
+ * otherwise it keeps the one it inherits.  It writes the CPU seconds it
+ * got to the pipe.
+ */
+pid_t spawn_group_worker(int cpu, uid_t uid, int own_cookie, int duration, int fd) {
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+
+    if (pid != 0)
+        return pid;
+
+    set_cpu_affinity(cpu);
+    if (own_cookie && create_cookie() < 0)
+        exit(1);
+    if (uid != getuid() && setuid(uid) < 0) {
+        perror("setuid");
+        exit(1);
+    }
+
+    time_t start = time(NULL);
+    while (time(NULL) - start < duration)
+        do_work();
+
+    double cpu_time = self_cpu_seconds();
+    if (write(fd, &cpu_time, sizeof(cpu_time)) != sizeof(cpu_time))
+        exit(1);
+    exit(0);
+}
+
+/*
+ * Run one worker per CPU of every group: the first CPU of a group as the
+ * current user, the others as another user (or as the current user when
+ * same_user is set), each with its own cookie when own_cookies is set.
+ * Returns the number of groups that misbehaved.
+ *
+ * Workers that may co-run keep all n CPUs of a group busy.  Workers that
+ * exclude each other limit a group to about one CPU's worth, no matter
+ * how many CPUs it has.  expect_corun says which of the two is expected.
+ */
+int run_group_workers(int same_user, int own_cookies, int expect_corun, int duration) {
+    static pid_t pids[MAX_GROUPS][MAX_GROUP_CPUS];
+    static int fds[MAX_GROUPS][2];
+    uid_t other = same_user ? getuid() : NOBODY_UID;
+    int failures = 0;
+
+    for (int i = 0; i < num_groups; i++) {
+        if (pipe(fds[i]) < 0) {
+            perror("pipe");
+            return num_groups;
+        }
+        for (int j = 0; j < groups[i].ncpus; j++)
+            pids[i][j] = spawn_group_worker(groups[i].cpus[j],
+                                            j ? other : getuid(), own_cookies,
+                                            duration, fds[i][1]);
+        close(fds[i][1]);
+    }
+
+    for (int i = 0; i < num_groups; i++) {
+        double total = 0, cpu_time;
+        int ncpus = groups[i].ncpus;
+
+        for (int j = 0; j < ncpus; j++)
+            waitpid(pids[i][j], NULL, 0);
+        while (read(fds[i][0], &cpu_time, sizeof(cpu_time)) == sizeof(cpu_time))
+            total += cpu_time;
+        close(fds[i][0]);
+
+        /* Allow 25% slack for scheduling noise at either bound */
+        double corun = total / duration;
+        int ok = expect_corun ? corun > 0.75 * ncpus : corun < 1.25;
+
+        printf("  group %d (%d CPUs, first CPU %d): %.2f CPUs busy - %s\n",
+               i, ncpus, groups[i].cpus[0], corun, ok ? "OK" : "UNEXPECTED");
+        failures += !ok;
+    }
+    return failures;
+}
+
+void test_many_groups_same_user() {
+    printf("\n=== TEST 3: Same user across %d entanglement groups ===\n",
+           num_groups);
+    printf("Expected: Every CPU of every group stays busy\n\n");
+
+    int failures = run_group_workers(1, 0, 1, TEST_DURATION);
+
+    printf("TEST 3 complete: %d/%d groups as expected.\n",
+           num_groups - failures, num_groups);
+}
+
+void test_many_groups_different_users() {
+    printf("\n=== TEST 4: Different users across %d entanglement groups ===\n",
+           num_groups);
+    printf("Expected: Each group runs about one CPU's worth of work, since\n");
+    printf("its first CPU (UID %d) and the others (UID %d) exclude each other\n\n",
+           getuid(), NOBODY_UID);
+
+    int failures = run_group_workers(0, 0, 0, TEST_DURATION);
+
+    printf("TEST 4 complete: %d/%d groups as expected.\n",
+           num_groups - failures, num_groups);
+}
+
+void test_cookie_same_user() {
+    printf("\n=== TEST 5: Same user, different cookies across %d groups ===\n",
+           num_groups);
+    printf("Expected: Each group runs about one CPU's worth of work, since\n");
+    printf("every worker has a cookie of its own\n\n");
+
+    int failures = run_group_workers(1, 1, 0, TEST_DURATION);
+
+    printf("TEST 5 complete: %d/%d groups as expected.\n",
+           num_groups - failures, num_groups);
+}
+
+void test_cookie_different_users() {
+    printf("\n=== TEST 6: Different users, shared cookie across %d groups ===\n",
+           num_groups);
+    printf("Expected: Every CPU of every group stays busy, since UID %d and\n",
+           getuid());
+    printf("UID %d workers inherit one cookie\n\n", NOBODY_UID);
+
+    /* Create the cookie in a helper so that this process keeps none */
+    int failures = num_groups;
+    int status;
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        if (create_cookie() < 0)
+            exit(num_groups);
+        exit(run_group_workers(0, 0, 1, TEST_DURATION));
+    }
+    if (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status))
+        failures = WEXITSTATUS(status);
+
+    printf("TEST 6 complete: %d/%d groups as expected.\n",
+           num_groups - failures, num_groups);
+}
+
 void test_same_user() {
     printf("\n=== TEST 1: Same user on both entangled CPUs ===\n");
     printf("Expected: Both processes should run normally\n\n");
@@ -188,7 +576,393 @@ void test_different_users() {
     printf("TEST 2 complete.\n");
 }
 
+/*
+ * Benchmark mode (-b): the cost of entanglement.
+ *
+ * Each workload runs once with the groups cleared and once with them
+ * set. In every group, the first CPU runs the current user and the
+ * other CPUs run NOBODY_UID. Each CPU runs one process of bench_threads
+ * threads:
+ *   throughput  busy threads on both sides; ops are work units
+ *   ctxsw       pairs of threads ping-ponging a byte over pipes on the
+ *               same CPU; ops are wakeups, each one a context switch
+ *   latency     the first CPU runs periodic sleepers that measure how
+ *               late they wake up, while the other CPUs run busy threads
+ */
+
+#define BENCH_SPIN 100000            /* iterations per throughput work unit */
+#define BENCH_LAT_BUCKETS 10000     /* 1us latency buckets; the last is the tail */
+#define BENCH_LAT_PERIOD_NS 1000000 /* sleeper period */
+#define BENCH_MAX_THREADS 64
+
+enum bench_kind { BENCH_THROUGHPUT, BENCH_CTXSW, BENCH_LATENCY };
+
+static const char *bench_names[] = { "throughput", "ctxsw", "latency" };
+
+/* What one benchmark process reports back to the parent */
+struct bench_result {
+    unsigned long long ops;
+    unsigned long long lat_max_us;
+    unsigned long long lat[BENCH_LAT_BUCKETS];
+};
+
+struct bench_thread {
+    pthread_t thread;
+    int kind;
+    int rfd, wfd;  /* ping-pong pipe ends, ctxsw only */
+    int starts;    /* ping-pong: 1 for the thread that sends first */
+    unsigned long long ops;
+    unsigned long long lat_max_us;
+    unsigned long long *lat;
+};
+
+static int bench_threads = 1;
+static int bench_duration = TEST_DURATION;
+static volatile int bench_stop;
+
+static unsigned long long now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void *bench_busy(void *arg) {
+    struct bench_thread *t = arg;
+
+    while (!bench_stop) {
+        volatile long sum = 0;
+        for (long i = 0; i < BENCH_SPIN; i++)
+            sum += i;
+        t->ops++;
+    }
+    return NULL;
+}
+
+/* Writing end is closed on exit so that the partner sees EOF, never hangs */
+void *bench_pingpong(void *arg) {
+    struct bench_thread *t = arg;
+    char c = 0;
+
+    if (t->starts && write(t->wfd, &c, 1) != 1)
+        goto out;
+    while (!bench_stop) {
+        if (read(t->rfd, &c, 1) != 1)
+            break;
+        t->ops++;
+        if (write(t->wfd, &c, 1) != 1)
+            break;
+    }
+out:
+    close(t->wfd);
+    return NULL;
+}
+
+void *bench_sleeper(void *arg) {
+    struct bench_thread *t = arg;
+    struct timespec ts;
+    unsigned long long next = now_ns(), late;
+
+    while (!bench_stop) {
+        next += BENCH_LAT_PERIOD_NS;
+        ts.tv_sec = next / 1000000000ULL;
+        ts.tv_nsec = next % 1000000000ULL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+        late = (now_ns() - next) / 1000;
+        t->lat[late < BENCH_LAT_BUCKETS ? late : BENCH_LAT_BUCKETS - 1]++;
+        if (late > t->lat_max_us)
+            t->lat_max_us = late;
+        t->ops++;
+
+        /* After a long stall, measure from now rather than catch up */
+        if (late * 1000 > BENCH_LAT_PERIOD_NS)
+            next = now_ns();
+    }
+    return NULL;
+}
+
+/* Run bench_threads threads of the given kind until bench_duration ends */
+void bench_run_threads(int kind, struct bench_result *res) {
+    static struct bench_thread threads[BENCH_MAX_THREADS];
+    int n = bench_threads;
+    int fds[2][2];
+
+    memset(threads, 0, sizeof(threads));
+    for (int i = 0; i < n; i++) {
+        threads[i].kind = kind;
+        if (kind == BENCH_LATENCY)
+            threads[i].lat = calloc(BENCH_LAT_BUCKETS, sizeof(*threads[i].lat));
+    }
+
+    for (int i = 0; i < n; i++) {
+        void *(*fn)(void *) = bench_busy;
+
+        if (kind == BENCH_LATENCY) {
+            fn = bench_sleeper;
+        } else if (kind == BENCH_CTXSW) {
+            /* Threads 2k and 2k+1 are partners; an odd last thread pairs with itself */
+            if (i % 2 == 0) {
+                if (pipe(fds[0]) < 0 || pipe(fds[1]) < 0) {
+                    perror("pipe");
+                    exit(1);
+                }
+            }
+            if (i % 2 == 0 && i + 1 == n) {
+                threads[i].rfd = fds[0][0];
+                threads[i].wfd = fds[0][1];
+                close(fds[1][0]);
+                close(fds[1][1]);
+            } else {
+                threads[i].rfd = fds[i % 2][0];
+                threads[i].wfd = fds[!(i % 2)][1];
+            }
+            threads[i].starts = i % 2 == 0;
+            fn = bench_pingpong;
+        }
+        pthread_create(&threads[i].thread, NULL, fn, &threads[i]);
+    }
+
+    sleep(bench_duration);
+    bench_stop = 1;
+
+    /* Join everyone before closing, or a partner still writing gets SIGPIPE */
+    for (int i = 0; i < n; i++)
+        pthread_join(threads[i].thread, NULL);
+
+    memset(res, 0, sizeof(*res));
+    for (int i = 0; i < n; i++) {
+        res->ops += threads[i].ops;
+        if (kind == BENCH_CTXSW)
+            close(threads[i].rfd);
+        if (kind == BENCH_LATENCY) {
+            for (int b = 0; b < BENCH_LAT_BUCKETS; b++)
+                res->lat[b] += threads[i].lat[b];
+            if (threads[i].lat_max_us > res->lat_max_us)
+                res->lat_max_us = threads[i].lat_max_us;
+            free(threads[i].lat);
+        }
+    }
+}
+
+/* Read exactly size bytes; returns 0 on success */
+int read_full(int fd, void *buf, size_t size) {
+    char *p = buf;
+
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n <= 0)
+            return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/* Fork one benchmark process pinned to cpu as uid; it reports through fd */
+pid_t spawn_bench_process(int cpu, uid_t uid, int kind, int fd) {
+    static struct bench_result res;
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+
+    if (pid != 0)
+        return pid;
+
+    set_cpu_affinity(cpu);
+    if (uid != getuid() && setuid(uid) < 0) {
+        perror("setuid");
+        exit(1);
+    }
+
+    bench_run_threads(kind, &res);
+
+    const char *p = (const char *)&res;
+    size_t left = sizeof(res);
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n <= 0)
+            exit(1);
+        p += n;
+        left -= n;
+    }
+    exit(0);
+}
+
+/*
+ * Run one workload on every group. Results for the first CPUs of all
+ * groups are summed into res[0] and those of the other CPUs into res[1].
+ */
+int run_bench(int kind, struct bench_result res[2]) {
+    static pid_t pids[MAX_GROUPS][MAX_GROUP_CPUS];
+    static int fds[MAX_GROUPS][MAX_GROUP_CPUS];
+    static struct bench_result one;
+    int pfd[2];
+
+    memset(res, 0, 2 * sizeof(*res));
+    for (int i = 0; i < num_groups; i++) {
+        for (int j = 0; j < groups[i].ncpus; j++) {
+            int side_kind = kind == BENCH_LATENCY && j ? BENCH_THROUGHPUT : kind;
+
+            if (pipe(pfd) < 0) {
+                perror("pipe");
+                return -1;
+            }
+            pids[i][j] = spawn_bench_process(groups[i].cpus[j],
+                                             j ? NOBODY_UID : getuid(),
+                                             side_kind, pfd[1]);
+            close(pfd[1]);
+            fds[i][j] = pfd[0];
+        }
+    }
+
+    for (int i = 0; i < num_groups; i++) {
+        for (int j = 0; j < groups[i].ncpus; j++) {
+            struct bench_result *r = &res[j != 0];
+
+            if (read_full(fds[i][j], &one, sizeof(one)) == 0) {
+                r->ops += one.ops;
+                for (int b = 0; b < BENCH_LAT_BUCKETS; b++)
+                    r->lat[b] += one.lat[b];
+                if (one.lat_max_us > r->lat_max_us)
+                    r->lat_max_us = one.lat_max_us;
+            }
+            close(fds[i][j]);
+            waitpid(pids[i][j], NULL, 0);
+        }
+    }
+    return 0;
+}
+
+/* Smallest latency (us) that at least pct percent of the samples reach */
+unsigned long long lat_percentile(const struct bench_result *r, double pct) {
+    unsigned long long total = 0, seen = 0;
+
+    for (int b = 0; b < BENCH_LAT_BUCKETS; b++)
+        total += r->lat[b];
+    for (int b = 0; b < BENCH_LAT_BUCKETS; b++) {
+        seen += r->lat[b];
+        if (total && seen * 100.0 >= total * pct)
+            return b;
+    }
+    return 0;
+}
+
+double pct_change(double off, double on) {
+    return off > 0 ? (on - off) * 100.0 / off : 0;
+}
+
+void print_bench_ops(const char *what, double off, double on) {
+    printf("  %-24s %14.1f %14.1f %+8.1f%%\n", what, off, on, pct_change(off, on));
+}
+
+void run_benchmarks() {
+    static struct bench_result off[2], on[2];
+    char buf[8192];
+    double secs = bench_duration;
+
+    format_cpu_groups(buf, sizeof(buf));
+    printf("\n=== Benchmark: %d groups (%s), %d threads per CPU, %d s per run ===\n",
+           num_groups, buf, bench_threads, bench_duration);
+    printf("First CPU of each group: UID %d, other CPUs: UID %d\n",
+           getuid(), NOBODY_UID);
+
+    for (int kind = BENCH_THROUGHPUT; kind <= BENCH_LATENCY; kind++) {
+        printf("\n--- %s ---\n", bench_names[kind]);
+
+        clear_entangled_groups();
+        if (run_bench(kind, off) < 0)
+            return;
+        if (set_entangled_groups() < 0)
+            return;
+        if (run_bench(kind, on) < 0)
+            return;
+        clear_entangled_groups();
+
+        printf("  %-24s %14s %14s %9s\n", "", "off", "on", "change");
+        if (kind == BENCH_THROUGHPUT) {
+            print_bench_ops("first CPUs (units/s)", off[0].ops / secs, on[0].ops / secs);
+            print_bench_ops("other CPUs (units/s)", off[1].ops / secs, on[1].ops / secs);
+            print_bench_ops("aggregate (units/s)", (off[0].ops + off[1].ops) / secs,
+                            (on[0].ops + on[1].ops) / secs);
+        } else if (kind == BENCH_CTXSW) {
+            print_bench_ops("first CPUs (switches/s)", off[0].ops / secs, on[0].ops / secs);
+            print_bench_ops("other CPUs (switches/s)", off[1].ops / secs, on[1].ops / secs);
+            print_bench_ops("aggregate (switches/s)", (off[0].ops + off[1].ops) / secs,
+                            (on[0].ops + on[1].ops) / secs);
+        } else {
+            static const double pcts[] = { 50, 90, 99, 99.9 };
+            char label[32];
+
+            for (int p = 0; p < 4; p++) {
+                snprintf(label, sizeof(label), "wakeup p%g (us)", pcts[p]);
+                print_bench_ops(label, lat_percentile(&off[0], pcts[p]),
+                                lat_percentile(&on[0], pcts[p]));
+            }
+            print_bench_ops("wakeup max (us)", off[0].lat_max_us, on[0].lat_max_us);
+            print_bench_ops("busy CPUs (units/s)", off[1].ops / secs, on[1].ops / secs);
+        }
+    }
+}
+
 int main(int argc, char *argv[]) {
+    const char *group_spec = NULL;
+    int smt_groups = 0;
+    int bench = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "g:sbt:d:")) != -1) {
+        switch (opt) {
+        case 'g':
+            group_spec = optarg;
+            break;
+        case 's':
+            smt_groups = 1;
+            break;
+        case 'b':
+            bench = 1;
+            break;
+        case 't':
+            bench_threads = atoi(optarg);
+            if (bench_threads < 1 || bench_threads > BENCH_MAX_THREADS) {
+                fprintf(stderr, "Threads must be 1-%d\n", BENCH_MAX_THREADS);
+                return 1;
+            }
+            break;
+        case 'd':
+            bench_duration = atoi(optarg);
+            if (bench_duration < 1) {
+                fprintf(stderr, "Duration must be at least 1 second\n");
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-g groups | -s] [-b [-t threads] [-d seconds]]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (bench) {
+        if (access(GROUPS_FILE, W_OK) != 0) {
+            printf("%s not available, cannot benchmark.\n", GROUPS_FILE);
+            return 1;
+        }
+        if (group_spec)
+            parse_cpu_groups(group_spec);
+        else if (smt_groups)
+            build_smt_groups();
+        else
+            build_pair_groups();
+        if (num_groups <= 0) {
+            printf("No usable groups to benchmark.\n");
+            return 1;
+        }
+        run_benchmarks();
+        return 0;
+    }
+
     printf("=== Entangled CPU Test Program ===\n");
     printf("Testing CPUs %d and %d\n\n", CPU1, CPU2);
 
@@ -219,6 +993,45 @@ int main(int argc, char *argv[]) {
     set_entangled_cpus(0, 0);
     print_entangled_cpus();
 
+    /* N-way groups */
+    printf("\n=== Entanglement groups ===\n");
+    if (access(GROUPS_FILE, W_OK) != 0) {
+        printf("%s not available, skipping group tests.\n", GROUPS_FILE);
+    } else {
+        if (group_spec)
+            parse_cpu_groups(group_spec);
+        else if (smt_groups)
+            build_smt_groups();
+        else
+            build_pair_groups();
+
+        if (num_groups <= 0) {
+            printf("No usable groups, skipping group tests.\n");
+        } else if (set_entangled_groups() == 0) {
+            verify_entangled_groups();
+            test_many_groups_same_user();
+            test_many_groups_different_users();
+
+            /* Cookies instead of UIDs */
+            unsigned long cookie;
+            if (access(COOKIE_FILE, W_OK) != 0) {
+                printf("\n%s not available, skipping cookie tests.\n", COOKIE_FILE);
+            } else if (prctl(PR_SCHED_CORE, PR_SCHED_CORE_GET, 0,
+                             PR_SCHED_CORE_SCOPE_THREAD,
+                             (unsigned long)&cookie) < 0) {
+                printf("\nCore-scheduling cookies not supported (%s), "
+                       "skipping cookie tests.\n", strerror(errno));
+            } else if (set_use_cookie(1) == 0) {
+                test_cookie_same_user();
+                test_cookie_different_users();
+                set_use_cookie(0);
+            }
+
+            printf("\n=== Resetting entanglement groups ===\n");
+            clear_entangled_groups();
+        }
+    }
+
     printf("\n=== All tests complete ===\n");
     return 0;
 }
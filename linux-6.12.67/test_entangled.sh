@@ -3,10 +3,30 @@
 # Test script for Task 1: Entangled CPU mutual exclusion
 # Must be run as root on a system with the modified kernel
 #
+# Usage: ./test_entangled.sh [groups]
+#        ./test_entangled.sh stats [interval]
+#   groups    entanglement groups for the N-way test, as written to
+#             /proc/sys/kernel/entangled_cpu_groups ("0,64;1,65;2-3");
+#             by default every set of SMT siblings becomes one group
+#   stats     only report the per-CPU entanglement counters: the totals
+#             so far, or with an interval the change every interval seconds
+#
+# The counters are read from /proc/sys/kernel/entangled_cpu_stats, one
+# line per CPU in /proc/schedstat style:
+#   cpu<N> <forced_idle_ns> <blocked_picks> <forced_preemptions>
+# forced_idle_ns      time the CPU sat idle although it had runnable tasks,
+#                     because a CPU it is entangled with ran another user
+# blocked_picks       picks that skipped a task for that reason
+# forced_preemptions  tasks preempted because an entangled CPU started
+#                     running another user
+#
 
 CPU1=1
 CPU2=3
 DURATION=15
+GROUP_DURATION=10
+GROUPS_FILE=/proc/sys/kernel/entangled_cpu_groups
+STATS_FILE=/proc/sys/kernel/entangled_cpu_stats
 
 echo "============================================"
 echo "  Entangled CPU Mutual Exclusion Test"
@@ -36,6 +56,50 @@ get_cpu_time() {
     fi
 }
 
+# Expand a cpulist ("0-2,5") into one CPU number per line
+expand_cpulist() {
+    local part
+    for part in ${1//,/ }; do
+        if [[ $part == *-* ]]; then
+            seq "${part%-*}" "${part#*-}"
+        else
+            echo "$part"
+        fi
+    done
+}
+
+# Print one group per set of SMT siblings, joined with ';'
+smt_groups() {
+    local f list out=""
+    for f in /sys/devices/system/cpu/cpu[0-9]*/topology/thread_siblings_list; do
+        list=$(cat "$f")
+        [[ $list == *[,-]* ]] || continue
+        [[ ";$out;" == *";$list;"* ]] && continue
+        out="${out:+$out;}$list"
+    done
+    echo "$out"
+}
+
+# Print the entanglement counters of the given CPUs (all CPUs if none),
+# as the change since the snapshot in $1 (an earlier read of $STATS_FILE)
+print_stats() {
+    local before=$1
+    shift
+    awk -v before="$before" -v cpus=" $* " '
+        BEGIN {
+            n = split(before, lines, "\n")
+            for (i = 1; i <= n; i++) {
+                split(lines[i], f, " ")
+                idle[f[1]] = f[2]; picks[f[1]] = f[3]; preempt[f[1]] = f[4]
+            }
+            printf "%-8s %16s %14s %14s\n", "", "forced idle ms", "blocked picks", "forced preempt"
+        }
+        cpus == "  " || index(cpus, " " substr($1, 4) " ") {
+            printf "%-8s %16.1f %14d %14d\n", $1,
+                   ($2 - idle[$1]) / 1e6, $3 - picks[$1], $4 - preempt[$1]
+        }' $STATS_FILE
+}
+
 # Function to monitor which CPU a process is running on
 monitor_cpu() {
     local pid=$1
@@ -46,6 +110,24 @@ monitor_cpu() {
     fi
 }
 
+if [ "$1" = "stats" ]; then
+    if [ ! -f $STATS_FILE ]; then
+        echo "Error: $STATS_FILE not found"
+        exit 1
+    fi
+    if [ -z "$2" ]; then
+        print_stats ""
+        exit 0
+    fi
+    while true; do
+        SNAP=$(cat $STATS_FILE)
+        sleep $2
+        echo "=== $(date +%T), last $2 s ==="
+        print_stats "$SNAP"
+        echo ""
+    done
+fi
+
 echo "Step 1: Check procfs interface"
 echo "--------------------------------"
 echo "entangled_cpus_1: $(cat /proc/sys/kernel/entangled_cpus_1)"
@@ -109,6 +191,8 @@ sudo -u $USER2 taskset -c $CPU2 yes > /dev/null &
 PID2=$!
 echo "Process 2 (User: $USER2, UID $(id -u $USER2)) started on CPU $CPU2, PID=$PID2"
 
+[ -f $STATS_FILE ] && SNAP=$(cat $STATS_FILE)
+
 echo ""
 echo "Monitoring for $DURATION seconds..."
 echo "If mutual exclusion works, Process 2 should NOT run on CPU $CPU2"
@@ -128,6 +212,11 @@ done
 kill $PID1 $PID2 2>/dev/null
 wait 2>/dev/null
 
+if [ -f $STATS_FILE ]; then
+    echo "Entanglement counters during the test:"
+    print_stats "$SNAP" $CPU1 $CPU2
+fi
+
 echo ""
 echo "Step 5: Reset entangled CPUs"
 echo "-----------------------------"
@@ -137,6 +226,78 @@ echo "entangled_cpus_1: $(cat /proc/sys/kernel/entangled_cpus_1)"
 echo "entangled_cpus_2: $(cat /proc/sys/kernel/entangled_cpus_2)"
 echo ""
 
+echo "Step 6: Test N-way entanglement groups"
+echo "---------------------------------------"
+if [ ! -f $GROUPS_FILE ]; then
+    echo "$GROUPS_FILE not found, skipping group test"
+else
+    ENT_GROUPS=${1:-$(smt_groups)}
+    if [ -z "$ENT_GROUPS" ]; then
+        echo "No SMT siblings found; pass groups explicitly, e.g. \"0,1;2,3\""
+    else
+        echo "$ENT_GROUPS" > $GROUPS_FILE
+        echo "entangled_cpu_groups: $(cat $GROUPS_FILE)"
+        echo ""
+        echo "Each group runs $USER1 on its first CPU and $USER2 on the others."
+        echo "If mutual exclusion works, each group is about 1 CPU busy in"
+        echo "total, however many CPUs it has."
+        echo ""
+
+        declare -a GPIDS
+        IFS=';' read -ra GLIST <<< "$ENT_GROUPS"
+        for g in "${!GLIST[@]}"; do
+            first=1
+            GPIDS[$g]=""
+            for cpu in $(expand_cpulist "${GLIST[$g]}"); do
+                if [ $first -eq 1 ]; then
+                    taskset -c $cpu yes > /dev/null &
+                    first=0
+                else
+                    sudo -u $USER2 taskset -c $cpu yes > /dev/null &
+                fi
+                GPIDS[$g]="${GPIDS[$g]} $!"
+            done
+        done
+
+        [ -f $STATS_FILE ] && SNAP=$(cat $STATS_FILE)
+
+        declare -a START
+        for g in "${!GLIST[@]}"; do
+            START[$g]=0
+            for pid in ${GPIDS[$g]}; do
+                START[$g]=$(( ${START[$g]} + $(get_cpu_time $pid) ))
+            done
+        done
+
+        sleep $GROUP_DURATION
+
+        HZ=$(getconf CLK_TCK)
+        for g in "${!GLIST[@]}"; do
+            total=0
+            for pid in ${GPIDS[$g]}; do
+                total=$(( total + $(get_cpu_time $pid) ))
+            done
+            busy=$(( (total - ${START[$g]}) * 100 / (HZ * GROUP_DURATION) ))
+            echo "Group $g (${GLIST[$g]}): $((busy / 100)).$(printf %02d $((busy % 100))) CPUs busy"
+        done
+
+        for g in "${!GLIST[@]}"; do
+            kill ${GPIDS[$g]} 2>/dev/null
+        done
+        wait 2>/dev/null
+
+        if [ -f $STATS_FILE ]; then
+            echo ""
+            echo "Entanglement counters during the group test:"
+            print_stats "$SNAP" $(expand_cpulist "${ENT_GROUPS//;/,}")
+        fi
+
+        echo "" > $GROUPS_FILE
+        echo "entangled_cpu_groups after reset: '$(cat $GROUPS_FILE)'"
+    fi
+fi
+echo ""
+
 echo "============================================"
 echo "  Test Complete"
 echo "============================================"
@@ -146,3 +307,4 @@ echo "- If mutual exclusion works correctly:"
 echo "  * Same user: Both processes run on their assigned CPUs"
 echo "  * Different users: One of the entangled CPUs should be idle"
 echo "    (the task is prevented from running)"
+echo "  * Groups: every group is about 1 CPU busy, independent of its size"